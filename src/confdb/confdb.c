@@ -106,6 +106,137 @@ done:
     return ret;
 }
 
+/* All sections of the configuration, read with a single search. The
+ * providers and responders look up dozens of options per section while
+ * starting, these lookups are served from here without searching the
+ * database again. The snapshot is replaced as a whole, it is dropped when
+ * the configuration is written and read again on the next lookup. It is not
+ * allocated below the connection, whose size would otherwise change with
+ * the first lookup, but freed together with it. */
+struct confdb_snapshot {
+    struct ldb_result *res;
+    hash_table_t *sections;
+};
+
+static errno_t confdb_snapshot_load(struct confdb_ctx *cdb)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct confdb_snapshot *snapshot;
+    struct ldb_dn *dn;
+    hash_key_t key;
+    hash_value_t value;
+    const char *casefold;
+    unsigned int i;
+    errno_t ret;
+    int hret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    snapshot = talloc_zero(tmp_ctx, struct confdb_snapshot);
+    if (snapshot == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    dn = ldb_dn_new(tmp_ctx, cdb->ldb, "cn=config");
+    if (dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_search(cdb->ldb, snapshot, &snapshot->res,
+                     dn, LDB_SCOPE_SUBTREE, NULL, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = EIO;
+        goto done;
+    }
+
+    ret = sss_hash_create(snapshot, snapshot->res->count, &snapshot->sections);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < snapshot->res->count; i++) {
+        casefold = ldb_dn_get_casefold(snapshot->res->msgs[i]->dn);
+        if (casefold == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        key.type = HASH_KEY_STRING;
+        key.str = discard_const(casefold);
+        value.type = HASH_VALUE_PTR;
+        value.ptr = snapshot->res->msgs[i];
+
+        hret = hash_enter(snapshot->sections, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            ret = EIO;
+            goto done;
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Loaded %u configuration sections\n",
+          snapshot->res->count);
+
+    talloc_free(cdb->snapshot);
+    cdb->snapshot = talloc_steal(NULL, snapshot);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Returns the section found at dn, or NULL if there is no such section */
+static errno_t confdb_snapshot_find(struct confdb_ctx *cdb,
+                                    struct ldb_dn *dn,
+                                    struct ldb_message **_msg)
+{
+    hash_key_t key;
+    hash_value_t value;
+    const char *casefold;
+    errno_t ret;
+    int hret;
+
+    if (cdb->snapshot == NULL) {
+        ret = confdb_snapshot_load(cdb);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Cannot load the configuration snapshot [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            return ret;
+        }
+    }
+
+    casefold = ldb_dn_get_casefold(dn);
+    if (casefold == NULL) {
+        return ENOMEM;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(casefold);
+
+    hret = hash_lookup(cdb->snapshot->sections, &key, &value);
+    switch (hret) {
+    case HASH_SUCCESS:
+        *_msg = talloc_get_type(value.ptr, struct ldb_message);
+        return EOK;
+    case HASH_ERROR_KEY_NOT_FOUND:
+        *_msg = NULL;
+        return EOK;
+    default:
+        return EIO;
+    }
+}
+
+void confdb_invalidate_snapshot(struct confdb_ctx *cdb)
+{
+    talloc_zfree(cdb->snapshot);
+}
+
 int confdb_add_param(struct confdb_ctx *cdb,
                      bool replace,
                      const char *section,
@@ -211,6 +342,7 @@ int confdb_add_param(struct confdb_ctx *cdb,
     ret = EOK;
 
 done:
+    confdb_invalidate_snapshot(cdb);
     talloc_free(tmp_ctx);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE,
@@ -228,6 +360,7 @@ int confdb_get_param(struct confdb_ctx *cdb,
 {
     TALLOC_CTX *tmp_ctx;
     struct ldb_result *res;
+    struct ldb_message *msg;
     struct ldb_dn *dn;
     char *secdn;
     const char *attrs[] = { attribute, NULL };
@@ -250,22 +383,28 @@ int confdb_get_param(struct confdb_ctx *cdb,
         goto done;
     }
 
-    ret = ldb_search(cdb->ldb, tmp_ctx, &res,
-                     dn, LDB_SCOPE_BASE, attrs, NULL);
-    if (ret != LDB_SUCCESS) {
-        ret = EIO;
-        goto done;
-    }
-    if (res->count > 1) {
-        ret = EIO;
-        goto done;
+    ret = confdb_snapshot_find(cdb, dn, &msg);
+    if (ret != EOK) {
+        /* search the section directly */
+        ret = ldb_search(cdb->ldb, tmp_ctx, &res,
+                         dn, LDB_SCOPE_BASE, attrs, NULL);
+        if (ret != LDB_SUCCESS) {
+            ret = EIO;
+            goto done;
+        }
+        if (res->count > 1) {
+            ret = EIO;
+            goto done;
+        }
+
+        msg = res->count > 0 ? res->msgs[0] : NULL;
     }
 
     vals = talloc_zero(mem_ctx, char *);
     ret = EOK;
 
-    if (res->count > 0) {
-        el = ldb_msg_find_element(res->msgs[0], attribute);
+    if (msg != NULL) {
+        el = ldb_msg_find_element(msg, attribute);
         if (el && el->num_values > 0) {
             vals = talloc_realloc(mem_ctx, vals, char *, el->num_values +1);
             if (!vals) {
@@ -360,6 +499,7 @@ int confdb_set_string(struct confdb_ctx *cdb,
     ret = EOK;
 
 done:
+    confdb_invalidate_snapshot(cdb);
     talloc_free(tmp_ctx);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE,
@@ -621,6 +761,12 @@ done:
     return ret;
 }
 
+static int confdb_ctx_destructor(struct confdb_ctx *cdb)
+{
+    confdb_invalidate_snapshot(cdb);
+    return 0;
+}
+
 int confdb_init(TALLOC_CTX *mem_ctx,
                 struct confdb_ctx **cdb_ctx,
                 const char *confdb_location)
@@ -633,6 +779,8 @@ int confdb_init(TALLOC_CTX *mem_ctx,
     if (!cdb)
         return ENOMEM;
 
+    talloc_set_destructor(cdb, confdb_ctx_destructor);
+
     /* Because confdb calls use sync ldb calls, we create a separate event
      * context here. This will prevent the ldb sync calls to start nested
      * events.
@@ -1195,6 +1343,42 @@ static int confdb_get_domain_internal(struct confdb_ctx *cdb,
               domain->refresh_expired_interval);
     }
 
+    ret = get_entry_as_uint32(res->msgs[0], &domain->cache_snapshot_interval,
+                              CONFDB_DOMAIN_CACHE_SNAPSHOT_INTERVAL, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Invalid value for [%s]\n",
+               CONFDB_DOMAIN_CACHE_SNAPSHOT_INTERVAL);
+        goto done;
+    }
+
+    ret = get_entry_as_uint32(res->msgs[0], &domain->cache_commit_delay,
+                              CONFDB_DOMAIN_CACHE_COMMIT_DELAY, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Invalid value for [%s]\n",
+               CONFDB_DOMAIN_CACHE_COMMIT_DELAY);
+        goto done;
+    }
+
+    ret = get_entry_as_uint32(res->msgs[0], &domain->initgr_reuse_timeout,
+                              CONFDB_DOMAIN_INITGR_REUSE_TIMEOUT, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Invalid value for [%s]\n",
+               CONFDB_DOMAIN_INITGR_REUSE_TIMEOUT);
+        goto done;
+    }
+
+    ret = get_entry_as_uint32(res->msgs[0], &domain->provider_neg_timeout,
+                              CONFDB_DOMAIN_PROVIDER_NEG_TIMEOUT, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Invalid value for [%s]\n",
+               CONFDB_DOMAIN_PROVIDER_NEG_TIMEOUT);
+        goto done;
+    }
+
     /* Set the PAM warning time, if specified. If not specified, pass on
      * the "not set" value of "-1" which means "use provider default". The
      * value 0 means "always display the warning if server sends one" */
@@ -55,6 +55,8 @@
 #define CONFDB_SERVICE_DEBUG_TIMESTAMPS "debug_timestamps"
 #define CONFDB_SERVICE_DEBUG_MICROSECONDS "debug_microseconds"
 #define CONFDB_SERVICE_DEBUG_TO_FILES "debug_to_files"
+#define CONFDB_SERVICE_DEBUG_BUFFER_SIZE "debug_buffer_size"
+#define CONFDB_SERVICE_DEBUG_BACKTRACE_LEVEL "debug_backtrace_level"
 #define CONFDB_SERVICE_TIMEOUT "timeout"
 #define CONFDB_SERVICE_FORCE_TIMEOUT "force_timeout"
 #define CONFDB_SERVICE_RECON_RETRIES "reconnection_retries"
@@ -84,11 +86,19 @@
 #define CONFDB_RESPONDER_GET_DOMAINS_TIMEOUT "get_domains_timeout"
 #define CONFDB_RESPONDER_CLI_IDLE_TIMEOUT "client_idle_timeout"
 #define CONFDB_RESPONDER_CLI_IDLE_DEFAULT_TIMEOUT 60
+#define CONFDB_RESPONDER_OBJECT_CACHE_SIZE "object_cache_size"
+#define CONFDB_RESPONDER_OBJECT_CACHE_DEFAULT_SIZE 1024
+#define CONFDB_RESPONDER_OBJECT_CACHE_TIMEOUT "object_cache_timeout"
+#define CONFDB_RESPONDER_OBJECT_CACHE_DEFAULT_TIMEOUT 5
+#define CONFDB_RESPONDER_DP_FAST_TRANSPORT "dp_fast_transport"
+#define CONFDB_RESPONDER_SLOW_REQUEST_THRESHOLD "slow_request_threshold"
+#define CONFDB_RESPONDER_PARALLEL_DOMAIN_LOOKUP "parallel_domain_lookup"
 
 /* NSS */
 #define CONFDB_NSS_CONF_ENTRY "config/nss"
 #define CONFDB_NSS_ENUM_CACHE_TIMEOUT "enum_cache_timeout"
 #define CONFDB_NSS_ENTRY_CACHE_NOWAIT_PERCENTAGE "entry_cache_nowait_percentage"
+#define CONFDB_NSS_REFRESH_AHEAD_ENTRIES "refresh_ahead_entries"
 #define CONFDB_NSS_ENTRY_NEG_TIMEOUT "entry_negative_timeout"
 #define CONFDB_NSS_FILTER_USERS_IN_GROUPS "filter_users_in_groups"
 #define CONFDB_NSS_FILTER_USERS "filter_users"
@@ -104,6 +114,8 @@
 #define CONFDB_MEMCACHE_TIMEOUT "memcache_timeout"
 #define CONFDB_NSS_HOMEDIR_SUBSTRING "homedir_substring"
 #define CONFDB_DEFAULT_HOMEDIR_SUBSTRING "/home"
+#define CONFDB_NSS_WORKER_PROCESSES "worker_processes"
+#define CONFDB_NSS_ENUM_CURSOR "enum_cursor"
 
 /* PAM */
 #define CONFDB_PAM_CONF_ENTRY "config/pam"
@@ -114,6 +126,7 @@
 #define CONFDB_DEFAULT_PAM_FAILED_LOGIN_DELAY 5
 #define CONFDB_PAM_VERBOSITY "pam_verbosity"
 #define CONFDB_PAM_ID_TIMEOUT "pam_id_timeout"
+#define CONFDB_PAM_PREAUTH_CACHE_TIMEOUT "pam_preauth_cache_timeout"
 #define CONFDB_PAM_PWD_EXPIRATION_WARNING "pam_pwd_expiration_warning"
 #define CONFDB_PAM_TRUSTED_USERS "pam_trusted_users"
 #define CONFDB_PAM_PUBLIC_DOMAINS "pam_public_domains"
@@ -122,6 +135,7 @@
 #define CONFDB_PAM_CERT_AUTH "pam_cert_auth"
 #define CONFDB_PAM_CERT_DB_PATH "pam_cert_db_path"
 #define CONFDB_PAM_P11_CHILD_TIMEOUT "p11_child_timeout"
+#define CONFDB_PAM_P11_CHILD_PERSISTENT "p11_child_persistent"
 
 /* SUDO */
 #define CONFDB_SUDO_CONF_ENTRY "config/sudo"
@@ -147,6 +161,7 @@
 
 /* PAC */
 #define CONFDB_PAC_CONF_ENTRY "config/pac"
+#define CONFDB_PAC_LIFETIME "pac_lifetime"
 
 /* InfoPipe */
 #define CONFDB_IFP_CONF_ENTRY "config/ifp"
@@ -198,6 +213,13 @@
 #define CONFDB_DOMAIN_SSH_HOST_CACHE_TIMEOUT "entry_cache_ssh_host_timeout"
 #define CONFDB_DOMAIN_PWD_EXPIRATION_WARNING "pwd_expiration_warning"
 #define CONFDB_DOMAIN_REFRESH_EXPIRED_INTERVAL "refresh_expired_interval"
+#define CONFDB_DOMAIN_CACHE_SNAPSHOT_INTERVAL "cache_snapshot_interval"
+#define CONFDB_DOMAIN_CACHE_COMMIT_DELAY "cache_commit_delay"
+#define CONFDB_DOMAIN_PTASK_MAX_HEAVY "periodic_tasks_max_heavy"
+#define CONFDB_DOMAIN_SLOW_REQUEST_THRESHOLD "slow_request_threshold"
+#define CONFDB_DOMAIN_OFFLINE_PROBE_TIMEOUT "offline_probe_timeout"
+#define CONFDB_DOMAIN_INITGR_REUSE_TIMEOUT "initgroups_reuse_timeout"
+#define CONFDB_DOMAIN_PROVIDER_NEG_TIMEOUT "provider_negative_timeout"
 #define CONFDB_DOMAIN_OFFLINE_TIMEOUT "offline_timeout"
 #define CONFDB_DOMAIN_SUBDOMAIN_INHERIT "subdomain_inherit"
 #define CONFDB_DOMAIN_CACHED_AUTH_TIMEOUT "cached_auth_timeout"
@@ -216,6 +238,7 @@
 #define CONFDB_PROXY_LIBNAME "proxy_lib_name"
 #define CONFDB_PROXY_PAM_TARGET "proxy_pam_target"
 #define CONFDB_PROXY_FAST_ALIAS "proxy_fast_alias"
+#define CONFDB_PROXY_MIRROR_FILES "proxy_mirror_files"
 
 struct confdb_ctx;
 struct config_file_ctx;
@@ -277,6 +300,10 @@ struct sss_domain_info {
     uint32_t ssh_host_timeout;
 
     uint32_t refresh_expired_interval;
+    uint32_t cache_snapshot_interval;
+    uint32_t cache_commit_delay;
+    uint32_t initgr_reuse_timeout;
+    uint32_t provider_neg_timeout;
     uint32_t subdomain_refresh_interval;
     uint32_t cached_auth_timeout;
 
@@ -325,6 +352,19 @@ int confdb_init(TALLOC_CTX *mem_ctx,
                 struct confdb_ctx **cdb_ctx,
                 const char *confdb_location);
 
+/**
+ * Drop the in-memory copy of the configuration
+ *
+ * The values returned by the confdb_get_* functions are read from a copy of
+ * the whole configuration, which is taken on the first lookup and kept
+ * until it is written through this connection. Call this function when
+ * another process may have changed the configuration, the next lookup
+ * reads it again.
+ *
+ * @param[in] cdb The connection object to the confdb
+ */
+void confdb_invalidate_snapshot(struct confdb_ctx *cdb);
+
 /**
  * Get a domain object for the named domain
  *
@@ -27,6 +27,8 @@ struct confdb_ctx {
     struct ldb_context *ldb;
 
     struct sss_domain_info *doms;
+
+    struct confdb_snapshot *snapshot;
 };
 
 int parse_section(TALLOC_CTX *mem_ctx, const char *section,
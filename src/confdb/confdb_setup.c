@@ -111,6 +111,8 @@ int confdb_create_base(struct confdb_ctx *cdb)
 
     const char *base_ldif = CONFDB_BASE_LDIF;
 
+    confdb_invalidate_snapshot(cdb);
+
     while ((ldif = ldb_ldif_read_string(cdb->ldb, &base_ldif))) {
         ret = ldb_add(cdb->ldb, ldif->msg);
         if (ret != LDB_SUCCESS) {
@@ -316,6 +318,9 @@ done:
         }
     }
 
+    /* the configuration was replaced or the transaction cancelled */
+    confdb_invalidate_snapshot(cdb);
+
     sss_ini_config_destroy(init_data);
     sss_ini_close_file(init_data);
 
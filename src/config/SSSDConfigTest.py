@@ -303,10 +303,17 @@ class SSSDConfigTestSSSDService(unittest.TestCase):
             'debug_timestamps',
             'debug_microseconds',
             'debug_to_files',
+            'debug_buffer_size',
+            'debug_backtrace_level',
             'command',
             'reconnection_retries',
             'fd_limit',
             'client_idle_timeout',
+            'object_cache_size',
+            'object_cache_timeout',
+            'dp_fast_transport',
+            'slow_request_threshold',
+            'parallel_domain_lookup',
             'diag_cmd',
             'description',
             'certificate_verification']
@@ -523,6 +530,13 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'entry_cache_sudo_timeout',
             'entry_cache_ssh_host_timeout',
             'refresh_expired_interval',
+            'cache_snapshot_interval',
+            'cache_commit_delay',
+            'periodic_tasks_max_heavy',
+            'slow_request_threshold',
+            'offline_probe_timeout',
+            'initgroups_reuse_timeout',
+            'provider_negative_timeout',
             'lookup_family_order',
             'account_cache_expiration',
             'dns_resolver_timeout',
@@ -640,7 +654,8 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
              'krb5_canonicalize',
              'krb5_use_enterprise_principal',
              'krb5_use_kdcinfo',
-             'krb5_map_user'])
+             'krb5_map_user',
+             'krb5_child_pool_size'])
 
         options = domain.list_options()
 
@@ -802,7 +817,8 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'krb5_canonicalize',
             'krb5_use_enterprise_principal',
             'krb5_use_kdcinfo',
-            'krb5_map_user']
+            'krb5_map_user',
+            'krb5_child_pool_size']
 
         self.assertTrue(type(options) == dict,
                         "Options should be a dictionary")
@@ -889,6 +905,13 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'entry_cache_sudo_timeout',
             'entry_cache_ssh_host_timeout',
             'refresh_expired_interval',
+            'cache_snapshot_interval',
+            'cache_commit_delay',
+            'periodic_tasks_max_heavy',
+            'slow_request_threshold',
+            'offline_probe_timeout',
+            'initgroups_reuse_timeout',
+            'provider_negative_timeout',
             'account_cache_expiration',
             'lookup_family_order',
             'dns_resolver_timeout',
@@ -1007,7 +1030,8 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
              'krb5_canonicalize',
              'krb5_use_enterprise_principal',
              'krb5_use_kdcinfo',
-             'krb5_map_user'])
+             'krb5_map_user',
+             'krb5_child_pool_size'])
 
         options = domain.list_options()
 
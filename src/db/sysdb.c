@@ -25,12 +25,17 @@
 #include "util/sss_utf8.h"
 #include "db/sysdb_private.h"
 #include "confdb/confdb.h"
+#include "util/probes.h"
 #include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #define LDB_MODULES_PATH "LDB_MODULES_PATH"
 
-errno_t sysdb_ldb_connect(TALLOC_CTX *mem_ctx, const char *filename,
-                          struct ldb_context **_ldb)
+static errno_t sysdb_ldb_connect_ext(TALLOC_CTX *mem_ctx,
+                                     const char *filename,
+                                     unsigned int flags,
+                                     struct ldb_context **_ldb)
 {
     int ret;
     struct ldb_context *ldb;
@@ -56,8 +61,9 @@ errno_t sysdb_ldb_connect(TALLOC_CTX *mem_ctx, const char *filename,
         ldb_set_modules_dir(ldb, mod_path);
     }
 
-    ret = ldb_connect(ldb, filename, 0, NULL);
+    ret = ldb_connect(ldb, filename, flags, NULL);
     if (ret != LDB_SUCCESS) {
+        talloc_free(ldb);
         return EIO;
     }
 
@@ -66,6 +72,12 @@ errno_t sysdb_ldb_connect(TALLOC_CTX *mem_ctx, const char *filename,
     return EOK;
 }
 
+errno_t sysdb_ldb_connect(TALLOC_CTX *mem_ctx, const char *filename,
+                          struct ldb_context **_ldb)
+{
+    return sysdb_ldb_connect_ext(mem_ctx, filename, 0, _ldb);
+}
+
 errno_t sysdb_dn_sanitize(TALLOC_CTX *mem_ctx, const char *input,
                           char **sanitized)
 {
@@ -890,6 +902,12 @@ int sysdb_error_to_errno(int ldberr)
 
 /* =Transactions========================================================== */
 
+/* The timestamp cache follows the transactions of the cache. Its entries
+ * are ignored when the cache does not match them, so a failure to commit
+ * it, or a crash in between, does not stop the cache. */
+
+static void sysdb_snapshot_publish(struct sysdb_ctx *sysdb);
+
 int sysdb_transaction_start(struct sysdb_ctx *sysdb)
 {
     int ret;
@@ -898,266 +916,1625 @@ int sysdb_transaction_start(struct sysdb_ctx *sysdb)
     if (ret != LDB_SUCCESS) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Failed to start ldb transaction! (%d)\n", ret);
+        return sysdb_error_to_errno(ret);
     }
-    return sysdb_error_to_errno(ret);
+
+    if (sysdb->ldb_ts != NULL) {
+        ret = ldb_transaction_start(sysdb->ldb_ts);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Failed to start timestamp cache transaction! (%d)\n", ret);
+            ldb_transaction_cancel(sysdb->ldb);
+            return sysdb_error_to_errno(ret);
+        }
+    }
+
+    PROBE(SYSDB_TRANSACTION_START, sysdb->transaction_nesting);
+    sysdb->transaction_nesting++;
+
+    sysdb_snapshot_publish(sysdb);
+    return EOK;
 }
 
 int sysdb_transaction_commit(struct sysdb_ctx *sysdb)
 {
     int ret;
 
+    PROBE(SYSDB_TRANSACTION_COMMIT_BEFORE, sysdb->transaction_nesting - 1);
+
+    /* ldb ends the transaction even if the commit fails */
+    sysdb->transaction_nesting--;
     ret = ldb_transaction_commit(sysdb->ldb);
     if (ret != LDB_SUCCESS) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Failed to commit ldb transaction! (%d)\n", ret);
+        if (sysdb->ldb_ts != NULL) {
+            ldb_transaction_cancel(sysdb->ldb_ts);
+        }
+        return sysdb_error_to_errno(ret);
     }
-    return sysdb_error_to_errno(ret);
+
+    if (sysdb->ldb_ts != NULL) {
+        ret = ldb_transaction_commit(sysdb->ldb_ts);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Failed to commit timestamp cache transaction! (%d)\n", ret);
+        }
+    }
+
+    PROBE(SYSDB_TRANSACTION_COMMIT_AFTER, sysdb->transaction_nesting);
+    sysdb_sync_committed(sysdb);
+    return EOK;
 }
 
 int sysdb_transaction_cancel(struct sysdb_ctx *sysdb)
 {
     int ret;
 
+    if (sysdb->ldb_ts != NULL) {
+        ret = ldb_transaction_cancel(sysdb->ldb_ts);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Failed to cancel timestamp cache transaction! (%d)\n",
+                  ret);
+        }
+    }
+
     ret = ldb_transaction_cancel(sysdb->ldb);
     if (ret != LDB_SUCCESS) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Failed to cancel ldb transaction! (%d)\n", ret);
+    } else {
+        sysdb->transaction_nesting--;
+        PROBE(SYSDB_TRANSACTION_CANCEL, sysdb->transaction_nesting);
     }
     return sysdb_error_to_errno(ret);
 }
 
-/* =Initialization======================================================== */
+/* =Unindexed-Searches===================================================== */
 
-int sysdb_get_db_file(TALLOC_CTX *mem_ctx,
-                      const char *provider, const char *name,
-                      const char *base_path, char **_ldb_file)
+static bool sysdb_is_indexed_attr(struct ldb_message_element *indexes,
+                                  const char *attr)
 {
-    char *ldb_file;
+    unsigned int i;
 
-    /* special case for the local domain */
-    if (strcasecmp(provider, "local") == 0) {
-        ldb_file = talloc_asprintf(mem_ctx, "%s/"LOCAL_SYSDB_FILE,
-                                   base_path);
-    } else {
-        ldb_file = talloc_asprintf(mem_ctx, "%s/"CACHE_SYSDB_FILE,
-                                   base_path, name);
+    if (strcasecmp(attr, "dn") == 0
+            || strcasecmp(attr, "distinguishedName") == 0) {
+        return true;
     }
-    if (!ldb_file) {
-        return ENOMEM;
+
+    for (i = 0; i < indexes->num_values; i++) {
+        if (strcasecmp(attr, (const char *)indexes->values[i].data) == 0) {
+            return true;
+        }
     }
 
-    *_ldb_file = ldb_file;
-    return EOK;
+    return false;
 }
 
-errno_t sysdb_domain_create(struct sysdb_ctx *sysdb, const char *domain_name)
+/* Mirrors how ldb_tdb uses the indexes: only equality is looked up in an
+ * index, an AND needs one indexed term and an OR needs all of them. */
+static bool sysdb_is_indexed_tree(struct ldb_message_element *indexes,
+                                  struct ldb_parse_tree *tree)
 {
-    struct ldb_message *msg;
-    TALLOC_CTX *tmp_ctx;
-    int ret;
+    unsigned int i;
 
-    tmp_ctx = talloc_new(NULL);
-    if (tmp_ctx == NULL) {
-        ret = ENOMEM;
-        goto done;
+    switch (tree->operation) {
+    case LDB_OP_AND:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            if (sysdb_is_indexed_tree(indexes, tree->u.list.elements[i])) {
+                return true;
+            }
+        }
+        return false;
+    case LDB_OP_OR:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            if (!sysdb_is_indexed_tree(indexes, tree->u.list.elements[i])) {
+                return false;
+            }
+        }
+        return true;
+    case LDB_OP_EQUALITY:
+        return sysdb_is_indexed_attr(indexes, tree->u.equality.attr);
+    default:
+        return false;
     }
+}
 
-    /* == create base domain object == */
+static struct ldb_message_element *sysdb_get_indexes(struct sysdb_ctx *sysdb)
+{
+    static const char *attrs[] = { "@IDXATTR", NULL };
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    int lret;
 
-    msg = ldb_msg_new(tmp_ctx);
-    if (!msg) {
-        ret = ENOMEM;
-        goto done;
-    }
-    msg->dn = ldb_dn_new_fmt(msg, sysdb->ldb, SYSDB_DOM_BASE, domain_name);
-    if (!msg->dn) {
-        ret = ENOMEM;
-        goto done;
+    if (sysdb->indexes != NULL) {
+        return sysdb->indexes;
     }
-    ret = ldb_msg_add_string(msg, "cn", domain_name);
-    if (ret != LDB_SUCCESS) {
-        ret = EIO;
-        goto done;
+
+    dn = ldb_dn_new(NULL, sysdb->ldb, "@INDEXLIST");
+    if (dn == NULL) {
+        return NULL;
     }
-    /* do a synchronous add */
-    ret = ldb_add(sysdb->ldb, msg);
-    if (ret != LDB_SUCCESS) {
-        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to initialize DB (%d, [%s]) "
-                                     "for domain %s!\n",
-                                     ret, ldb_errstring(sysdb->ldb),
-                                     domain_name);
-        ret = EIO;
-        goto done;
+
+    lret = ldb_search(sysdb->ldb, sysdb, &res, dn, LDB_SCOPE_BASE,
+                      attrs, NULL);
+    talloc_free(dn);
+    if (lret != LDB_SUCCESS || res->count != 1) {
+        return NULL;
     }
-    talloc_zfree(msg);
 
-    /* == create Users tree == */
+    sysdb->indexes = ldb_msg_find_element(res->msgs[0], "@IDXATTR");
+    return sysdb->indexes;
+}
 
-    msg = ldb_msg_new(tmp_ctx);
-    if (!msg) {
-        ret = ENOMEM;
-        goto done;
+/* Logs the search if it is not answered from an index. Only a subtree or
+ * one level search can be slow, a base search is a direct lookup. */
+static void sysdb_warn_unindexed(struct sysdb_ctx *sysdb,
+                                 struct ldb_dn *base_dn,
+                                 enum ldb_scope scope,
+                                 const char *filter,
+                                 struct timeval *start,
+                                 unsigned int count)
+{
+    struct ldb_message_element *indexes;
+    struct ldb_parse_tree *tree;
+    struct timeval now;
+    bool indexed;
+
+    if (scope == LDB_SCOPE_BASE || filter == NULL) {
+        return;
     }
-    msg->dn = ldb_dn_new_fmt(msg, sysdb->ldb,
-                             SYSDB_TMPL_USER_BASE, domain_name);
-    if (!msg->dn) {
-        ret = ENOMEM;
-        goto done;
+
+    indexes = sysdb_get_indexes(sysdb);
+    if (indexes == NULL) {
+        return;
     }
-    ret = ldb_msg_add_string(msg, "cn", "Users");
-    if (ret != LDB_SUCCESS) {
-        ret = EIO;
-        goto done;
+
+    tree = ldb_parse_tree(NULL, filter);
+    if (tree == NULL) {
+        return;
     }
-    /* do a synchronous add */
-    ret = ldb_add(sysdb->ldb, msg);
-    if (ret != LDB_SUCCESS) {
-        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to initialize DB (%d, [%s]) "
-                                     "for domain %s!\n",
-                                     ret, ldb_errstring(sysdb->ldb),
-                                     domain_name);
-        ret = EIO;
-        goto done;
+    indexed = sysdb_is_indexed_tree(indexes, tree);
+    talloc_free(tree);
+
+    if (indexed) {
+        return;
     }
-    talloc_zfree(msg);
 
-    /* == create Groups tree == */
+    gettimeofday(&now, NULL);
+    DEBUG(SSSDBG_MINOR_FAILURE,
+          "Unindexed search [%s] under [%s] took %ld us, %u results\n",
+          filter, ldb_dn_get_linearized(base_dn),
+          (long)((now.tv_sec - start->tv_sec) * 1000000
+                 + (now.tv_usec - start->tv_usec)), count);
+}
 
-    msg = ldb_msg_new(tmp_ctx);
-    if (!msg) {
-        ret = ENOMEM;
-        goto done;
-    }
-    msg->dn = ldb_dn_new_fmt(msg, sysdb->ldb,
-                             SYSDB_TMPL_GROUP_BASE, domain_name);
-    if (!msg->dn) {
-        ret = ENOMEM;
-        goto done;
-    }
-    ret = ldb_msg_add_string(msg, "cn", "Groups");
-    if (ret != LDB_SUCCESS) {
-        ret = EIO;
-        goto done;
-    }
-    /* do a synchronous add */
-    ret = ldb_add(sysdb->ldb, msg);
-    if (ret != LDB_SUCCESS) {
-        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to initialize DB (%d, [%s]) for "
-                                     "domain %s!\n",
-                                     ret, ldb_errstring(sysdb->ldb),
-                                     domain_name);
-        ret = EIO;
-        goto done;
-    }
-    talloc_zfree(msg);
+/* =Timestamp-cache======================================================== */
 
-    ret = EOK;
+static const char *sysdb_ts_attrs[] = { SYSDB_LAST_UPDATE,
+                                        SYSDB_CACHE_EXPIRE,
+                                        SYSDB_TS_CACHE_EXPIRE,
+                                        NULL };
 
-done:
-    talloc_zfree(tmp_ctx);
-    return ret;
+static bool sysdb_is_ts_attr(const char *name)
+{
+    return strcasecmp(name, SYSDB_LAST_UPDATE) == 0
+           || strcasecmp(name, SYSDB_CACHE_EXPIRE) == 0;
 }
 
-/* Compare versions of sysdb, returns ERRNO accordingly */
-static errno_t
-sysdb_version_check(const char *expected,
-                    const char *received)
+static errno_t sysdb_ts_read(TALLOC_CTX *mem_ctx,
+                             struct ldb_context *ldb_ts,
+                             struct ldb_dn *dn,
+                             struct ldb_message **_msg)
 {
-    int ret;
-    unsigned int exp_major, exp_minor, recv_major, recv_minor;
+    struct ldb_result *res;
+    struct ldb_dn *ts_dn;
+    int lret;
 
-    ret = sscanf(expected, "%u.%u", &exp_major, &exp_minor);
-    if (ret != 2) {
-        return EINVAL;
-    }
-    ret = sscanf(received, "%u.%u", &recv_major, &recv_minor);
-    if (ret != 2) {
-        return EINVAL;
+    /* a DN is bound to the ldb context it was created for */
+    ts_dn = ldb_dn_new(mem_ctx, ldb_ts, ldb_dn_get_linearized(dn));
+    if (ts_dn == NULL) {
+        return ENOMEM;
     }
 
-    if (recv_major > exp_major) {
-        return EUCLEAN;
-    } else if (recv_major < exp_major) {
-        return EMEDIUMTYPE;
+    lret = ldb_search(ldb_ts, mem_ctx, &res, ts_dn, LDB_SCOPE_BASE,
+                      sysdb_ts_attrs, NULL);
+    if (lret == LDB_ERR_NO_SUCH_OBJECT) {
+        return ENOENT;
+    } else if (lret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(lret);
     }
 
-    if (recv_minor > exp_minor) {
-        return EUCLEAN;
-    } else if (recv_minor < exp_minor) {
-        return EMEDIUMTYPE;
+    if (res->count == 0) {
+        return ENOENT;
     }
 
+    *_msg = res->msgs[0];
     return EOK;
 }
 
-int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
-                               struct sss_domain_info *domain,
-                               const char *db_path,
-                               bool allow_upgrade,
-                               struct sysdb_ctx **_ctx)
+/* Writes the timestamps replaced by msg together with the value of
+ * SYSDB_CACHE_EXPIRE in the cache once msg is applied */
+static errno_t sysdb_ts_write(struct sysdb_ctx *sysdb,
+                              struct ldb_message *msg,
+                              struct ldb_dn *dn,
+                              const struct ldb_val *cache_expire)
 {
-    TALLOC_CTX *tmp_ctx = NULL;
-    struct sysdb_ctx *sysdb;
-    const char *base_ldif;
-    struct ldb_ldif *ldif;
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *ts_msg;
     struct ldb_message_element *el;
-    struct ldb_result *res;
-    struct ldb_dn *verdn;
-    const char *version = NULL;
-    int ret;
+    unsigned int i;
+    int lret;
+    errno_t ret;
 
-    sysdb = talloc_zero(mem_ctx, struct sysdb_ctx);
-    if (!sysdb) {
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
         return ENOMEM;
     }
 
-    ret = sysdb_get_db_file(sysdb, domain->provider,
-                            domain->name, db_path,
-                            &sysdb->ldb_file);
-    if (ret != EOK) {
-        goto done;
-    }
-    DEBUG(SSSDBG_FUNC_DATA,
-          "DB File for %s: %s\n", domain->name, sysdb->ldb_file);
-
-    ret = sysdb_ldb_connect(sysdb, sysdb->ldb_file, &sysdb->ldb);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_ldb_connect failed.\n");
+    ts_msg = ldb_msg_new(tmp_ctx);
+    if (ts_msg == NULL) {
+        ret = ENOMEM;
         goto done;
     }
 
-    tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
+    ts_msg->dn = ldb_dn_new(ts_msg, sysdb->ldb_ts, ldb_dn_get_linearized(dn));
+    if (ts_msg->dn == NULL) {
         ret = ENOMEM;
         goto done;
     }
 
-    verdn = ldb_dn_new(tmp_ctx, sysdb->ldb, SYSDB_BASE);
-    if (!verdn) {
-        ret = EIO;
-        goto done;
+    for (i = 0; i < msg->num_elements; i++) {
+        el = &msg->elements[i];
+        if (!sysdb_is_ts_attr(el->name) || el->num_values == 0
+                || LDB_FLAG_MOD_TYPE(el->flags) != LDB_FLAG_MOD_REPLACE) {
+            continue;
+        }
+
+        lret = ldb_msg_add(ts_msg, el, LDB_FLAG_MOD_REPLACE);
+        if (lret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
     }
 
-    ret = ldb_search(sysdb->ldb, tmp_ctx, &res,
-                     verdn, LDB_SCOPE_BASE,
-                     NULL, NULL);
-    if (ret != LDB_SUCCESS) {
-        ret = EIO;
-        goto done;
+    lret = ldb_msg_add_empty(ts_msg, SYSDB_TS_CACHE_EXPIRE,
+                             LDB_FLAG_MOD_REPLACE, NULL);
+    if (lret == LDB_SUCCESS) {
+        lret = ldb_msg_add_value(ts_msg, SYSDB_TS_CACHE_EXPIRE,
+                                 cache_expire, NULL);
     }
-    if (res->count > 1) {
-        ret = EIO;
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
         goto done;
     }
 
-    if (res->count == 1) {
-        el = ldb_msg_find_element(res->msgs[0], "version");
-        if (!el) {
-            ret = EIO;
-            goto done;
+    lret = ldb_modify(sysdb->ldb_ts, ts_msg);
+    if (lret == LDB_ERR_NO_SUCH_OBJECT) {
+        for (i = 0; i < ts_msg->num_elements; i++) {
+            ts_msg->elements[i].flags = 0;
         }
+        lret = ldb_add(sysdb->ldb_ts, ts_msg);
+    }
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to write the timestamp cache: [%s](%d)[%s]\n",
+              ldb_strerror(lret), lret, ldb_errstring(sysdb->ldb_ts));
+    }
+    ret = sysdb_error_to_errno(lret);
 
-        if (el->num_values != 1) {
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Only a replaced value is compared, adding or deleting values goes to the
+ * cache to keep its error reporting. */
+static bool sysdb_ts_entry_changed(struct ldb_message *msg,
+                                   struct ldb_message *old)
+{
+    struct ldb_message_element *el;
+    struct ldb_message_element *old_el;
+    unsigned int i;
+
+    for (i = 0; i < msg->num_elements; i++) {
+        el = &msg->elements[i];
+        if (sysdb_is_ts_attr(el->name)) {
+            continue;
+        }
+
+        if (LDB_FLAG_MOD_TYPE(el->flags) != LDB_FLAG_MOD_REPLACE) {
+            return true;
+        }
+
+        old_el = ldb_msg_find_element(old, el->name);
+        if (old_el == NULL || old_el->num_values == 0) {
+            if (el->num_values != 0) {
+                return true;
+            }
+            continue;
+        }
+
+        if (ldb_msg_element_compare(el, old_el) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Applies the modify msg to a user or a group. If msg changes nothing but
+ * the timestamps, only the timestamp cache is written. old is the entry in
+ * the cache with at least the attributes of msg and SYSDB_CACHE_EXPIRE, it
+ * is read if NULL. */
+errno_t sysdb_ts_modify(struct sysdb_ctx *sysdb,
+                        struct ldb_message *msg,
+                        struct ldb_message *old)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    struct ldb_message_element *expire_el = NULL;
+    struct ldb_message_element *el;
+    const struct ldb_val *cache_expire = NULL;
+    const char **attrs;
+    bool has_ts = false;
+    bool changed = true;
+    unsigned int i;
+    int lret;
+    errno_t ret;
+
+    for (i = 0; sysdb->ldb_ts != NULL && i < msg->num_elements; i++) {
+        if (sysdb_is_ts_attr(msg->elements[i].name)
+                && LDB_FLAG_MOD_TYPE(msg->elements[i].flags)
+                        == LDB_FLAG_MOD_REPLACE) {
+            has_ts = true;
+            break;
+        }
+    }
+
+    if (!has_ts) {
+        lret = ldb_modify(sysdb->ldb, msg);
+        return sysdb_error_to_errno(lret);
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    if (old == NULL) {
+        attrs = talloc_zero_array(tmp_ctx, const char *,
+                                  msg->num_elements + 2);
+        if (attrs == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (i = 0; i < msg->num_elements; i++) {
+            attrs[i] = msg->elements[i].name;
+        }
+        attrs[i] = SYSDB_CACHE_EXPIRE;
+
+        lret = ldb_search(sysdb->ldb, tmp_ctx, &res, msg->dn, LDB_SCOPE_BASE,
+                          attrs, NULL);
+        if (lret == LDB_SUCCESS && res->count == 1) {
+            old = res->msgs[0];
+        } else if (lret != LDB_SUCCESS && lret != LDB_ERR_NO_SUCH_OBJECT) {
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+    }
+
+    if (old != NULL) {
+        expire_el = ldb_msg_find_element(old, SYSDB_CACHE_EXPIRE);
+    }
+
+    /* An entry is expired in the cache by setting SYSDB_CACHE_EXPIRE to 1,
+     * e.g. by sss_cache or the memberof plugin. That must not become the
+     * value the timestamp cache relies on, expiring the entry once more
+     * would not be noticed then. So an expired entry is always written. */
+    if (expire_el != NULL && expire_el->num_values == 1
+            && !(expire_el->values[0].length == 1
+                 && expire_el->values[0].data[0] == '1')) {
+        changed = sysdb_ts_entry_changed(msg, old);
+    }
+
+    if (changed) {
+        /* a missing entry is reported by the cache */
+        lret = ldb_modify(sysdb->ldb, msg);
+        if (lret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+
+        el = ldb_msg_find_element(msg, SYSDB_CACHE_EXPIRE);
+        if (el != NULL
+                && LDB_FLAG_MOD_TYPE(el->flags) == LDB_FLAG_MOD_REPLACE) {
+            if (el->num_values == 1) {
+                cache_expire = &el->values[0];
+            }
+        } else if (expire_el != NULL && expire_el->num_values == 1) {
+            cache_expire = &expire_el->values[0];
+        }
+    } else {
+        DEBUG(SSSDBG_TRACE_ALL, "Only the timestamps of [%s] changed\n",
+              ldb_dn_get_linearized(msg->dn));
+        cache_expire = &expire_el->values[0];
+    }
+
+    if (cache_expire == NULL) {
+        ret = sysdb_ts_delete_entry(sysdb, msg->dn);
+        goto done;
+    }
+
+    ret = sysdb_ts_write(sysdb, msg, old != NULL ? old->dn : msg->dn,
+                         cache_expire);
+    if (ret != EOK && changed) {
+        /* the timestamps in the cache are used, the timestamp cache is
+         * outdated now */
+        ret = EOK;
+    }
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_ts_delete_entry(struct sysdb_ctx *sysdb, struct ldb_dn *dn)
+{
+    struct ldb_dn *ts_dn;
+    int lret;
+
+    if (sysdb->ldb_ts == NULL) {
+        return EOK;
+    }
+
+    ts_dn = ldb_dn_new(NULL, sysdb->ldb_ts, ldb_dn_get_linearized(dn));
+    if (ts_dn == NULL) {
+        return ENOMEM;
+    }
+
+    lret = ldb_delete(sysdb->ldb_ts, ts_dn);
+    talloc_free(ts_dn);
+    if (lret != LDB_SUCCESS && lret != LDB_ERR_NO_SUCH_OBJECT) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to delete from the timestamp cache: [%s](%d)[%s]\n",
+              ldb_strerror(lret), lret, ldb_errstring(sysdb->ldb_ts));
+        return sysdb_error_to_errno(lret);
+    }
+
+    return EOK;
+}
+
+/* Replaces the timestamps of msg with those of the timestamp cache unless
+ * they are outdated. Only timestamps already in msg are replaced and
+ * SYSDB_CACHE_EXPIRE is needed to check them. */
+static errno_t sysdb_ts_merge_msg(struct ldb_context *ldb_ts,
+                                  struct ldb_message *msg)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *ts_msg;
+    struct ldb_message_element *expire_el;
+    struct ldb_message_element *cache_el;
+    struct ldb_message_element *ts_el;
+    struct ldb_message_element *el;
+    struct ldb_val *values;
+    unsigned int i;
+    unsigned int j;
+    errno_t ret;
+
+    expire_el = ldb_msg_find_element(msg, SYSDB_CACHE_EXPIRE);
+    if (expire_el == NULL || expire_el->num_values != 1) {
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_ts_read(tmp_ctx, ldb_ts, msg->dn, &ts_msg);
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    cache_el = ldb_msg_find_element(ts_msg, SYSDB_TS_CACHE_EXPIRE);
+    if (cache_el == NULL || cache_el->num_values != 1
+            || ldb_val_equal_exact(&cache_el->values[0],
+                                   &expire_el->values[0]) == 0) {
+        /* the entry was written to the cache since, e.g. expired */
+        ret = EOK;
+        goto done;
+    }
+
+    for (i = 0; i < msg->num_elements; i++) {
+        el = &msg->elements[i];
+        if (!sysdb_is_ts_attr(el->name)) {
+            continue;
+        }
+
+        ts_el = ldb_msg_find_element(ts_msg, el->name);
+        if (ts_el == NULL || ts_el->num_values == 0) {
+            continue;
+        }
+
+        values = talloc_array(msg, struct ldb_val, ts_el->num_values);
+        if (values == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (j = 0; j < ts_el->num_values; j++) {
+            values[j] = ldb_val_dup(values, &ts_el->values[j]);
+            if (values[j].data == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+        }
+
+        el->values = values;
+        el->num_values = ts_el->num_values;
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t sysdb_ts_merge_ldb(struct ldb_context *ldb_ts,
+                                  size_t count,
+                                  struct ldb_message **msgs)
+{
+    size_t i;
+    errno_t ret;
+
+    if (ldb_ts == NULL) {
+        return EOK;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = sysdb_ts_merge_msg(ldb_ts, msgs[i]);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Unable to merge the timestamps of [%s] [%d]: %s\n",
+                  ldb_dn_get_linearized(msgs[i]->dn), ret, sss_strerror(ret));
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_ts_merge_msgs(struct sysdb_ctx *sysdb,
+                            size_t count,
+                            struct ldb_message **msgs)
+{
+    return sysdb_ts_merge_ldb(sysdb->ldb_ts, count, msgs);
+}
+
+errno_t sysdb_ts_merge_res(struct sysdb_ctx *sysdb, struct ldb_result *res)
+{
+    return sysdb_ts_merge_msgs(sysdb, res->count, res->msgs);
+}
+
+/* Returns a copy of tree in which every condition on a timestamp accepts
+ * any value */
+static struct ldb_parse_tree *sysdb_ts_relax_tree(TALLOC_CTX *mem_ctx,
+                                                  struct ldb_parse_tree *tree,
+                                                  bool negated)
+{
+    struct ldb_parse_tree *relaxed;
+    struct ldb_parse_tree *not;
+    const char *attr;
+    unsigned int i;
+
+    switch (tree->operation) {
+    case LDB_OP_AND:
+    case LDB_OP_OR:
+        relaxed = talloc_zero(mem_ctx, struct ldb_parse_tree);
+        if (relaxed == NULL) {
+            return NULL;
+        }
+        relaxed->operation = tree->operation;
+        relaxed->u.list.num_elements = tree->u.list.num_elements;
+        relaxed->u.list.elements = talloc_array(relaxed,
+                                                struct ldb_parse_tree *,
+                                                tree->u.list.num_elements);
+        if (relaxed->u.list.elements == NULL) {
+            return NULL;
+        }
+
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            relaxed->u.list.elements[i] = sysdb_ts_relax_tree(relaxed,
+                                                  tree->u.list.elements[i],
+                                                  negated);
+            if (relaxed->u.list.elements[i] == NULL) {
+                return NULL;
+            }
+        }
+        return relaxed;
+    case LDB_OP_NOT:
+        relaxed = talloc_zero(mem_ctx, struct ldb_parse_tree);
+        if (relaxed == NULL) {
+            return NULL;
+        }
+        relaxed->operation = LDB_OP_NOT;
+        relaxed->u.isnot.child = sysdb_ts_relax_tree(relaxed,
+                                                     tree->u.isnot.child,
+                                                     !negated);
+        if (relaxed->u.isnot.child == NULL) {
+            return NULL;
+        }
+        return relaxed;
+    case LDB_OP_EQUALITY:
+        attr = tree->u.equality.attr;
+        break;
+    case LDB_OP_SUBSTRING:
+        attr = tree->u.substring.attr;
+        break;
+    case LDB_OP_GREATER:
+    case LDB_OP_LESS:
+    case LDB_OP_APPROX:
+        attr = tree->u.comparison.attr;
+        break;
+    case LDB_OP_PRESENT:
+        attr = tree->u.present.attr;
+        break;
+    case LDB_OP_EXTENDED:
+        attr = tree->u.extended.attr;
+        break;
+    default:
+        attr = NULL;
+        break;
+    }
+
+    if (attr == NULL || !sysdb_is_ts_attr(attr)) {
+        return tree;
+    }
+
+    /* true for every entry, false if negated */
+    relaxed = talloc_zero(mem_ctx, struct ldb_parse_tree);
+    if (relaxed == NULL) {
+        return NULL;
+    }
+    relaxed->operation = LDB_OP_PRESENT;
+    relaxed->u.present.attr = SYSDB_OBJECTCLASS;
+
+    if (!negated) {
+        return relaxed;
+    }
+
+    not = talloc_zero(mem_ctx, struct ldb_parse_tree);
+    if (not == NULL) {
+        return NULL;
+    }
+    not->operation = LDB_OP_NOT;
+    not->u.isnot.child = talloc_steal(not, relaxed);
+    return not;
+}
+
+/* Searches the cache and merges the timestamp cache into the result. The
+ * timestamps in the cache may be outdated, so a filter on them is applied
+ * to the merged entries: the cache is searched with the timestamp
+ * conditions relaxed and all attributes, then the filter is evaluated. */
+errno_t sysdb_ts_search(TALLOC_CTX *mem_ctx,
+                        struct sysdb_ctx *sysdb,
+                        struct ldb_dn *base_dn,
+                        enum ldb_scope scope,
+                        const char *filter,
+                        const char **attrs,
+                        struct ldb_result **_res)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_parse_tree *tree = NULL;
+    struct ldb_parse_tree *relaxed;
+    struct ldb_result *res;
+    struct timeval start;
+    bool ghosts;
+    bool matched;
+    unsigned int count;
+    unsigned int i;
+    int lret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ghosts = sysdb_ghosts_requested(attrs);
+
+    if (sysdb->ldb_ts != NULL && filter != NULL
+            && (strcasestr(filter, SYSDB_LAST_UPDATE) != NULL
+                || strcasestr(filter, SYSDB_CACHE_EXPIRE) != NULL)) {
+        tree = ldb_parse_tree(tmp_ctx, filter);
+        if (tree == NULL) {
+            DEBUG(SSSDBG_OP_FAILURE, "Invalid filter [%s]\n", filter);
+            ret = EINVAL;
+            goto done;
+        }
+
+        relaxed = sysdb_ts_relax_tree(tmp_ctx, tree, false);
+        if (relaxed == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        filter = ldb_filter_from_tree(tmp_ctx, relaxed);
+        if (filter == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        attrs = NULL;
+    }
+
+    if (sysdb->warn_unindexed) {
+        gettimeofday(&start, NULL);
+    }
+
+    lret = ldb_search(sysdb->ldb, tmp_ctx, &res, base_dn, scope, attrs,
+                      filter ? "%s" : NULL, filter);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (sysdb->warn_unindexed) {
+        sysdb_warn_unindexed(sysdb, base_dn, scope, filter, &start,
+                             res->count);
+    }
+
+    ret = sysdb_ts_merge_res(sysdb, res);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (tree != NULL) {
+        count = 0;
+        for (i = 0; i < res->count; i++) {
+            lret = ldb_match_msg_general(sysdb->ldb, res->msgs[i], tree,
+                                         base_dn, scope, &matched);
+            if (lret != LDB_SUCCESS) {
+                ret = sysdb_error_to_errno(lret);
+                goto done;
+            }
+
+            if (matched) {
+                res->msgs[count] = res->msgs[i];
+                count++;
+            }
+        }
+
+        if (count < res->count) {
+            res->msgs[count] = NULL;
+            res->count = count;
+        }
+    }
+
+    if (ghosts) {
+        ret = sysdb_ghosts_merge_ldb(sysdb->ldb, res->count, res->msgs);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    *_res = talloc_steal(mem_ctx, res);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t sysdb_ts_cache_connect(struct sysdb_ctx *sysdb,
+                                      struct sss_domain_info *domain,
+                                      const char *db_path)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_context *ldb = NULL;
+    const char *base_ldif;
+    struct ldb_ldif *ldif;
+    struct ldb_result *res;
+    struct ldb_dn *verdn;
+    const char *version;
+    int lret;
+    int i;
+    errno_t ret;
+
+    /* the local domain has no timestamp cache */
+    if (strcasecmp(domain->provider, "local") == 0) {
+        return EOK;
+    }
+
+    sysdb->ldb_ts_file = talloc_asprintf(sysdb, "%s/"CACHE_TIMESTAMPS_FILE,
+                                         db_path, domain->name);
+    if (sysdb->ldb_ts_file == NULL) {
+        return ENOMEM;
+    }
+    DEBUG(SSSDBG_FUNC_DATA, "Timestamp file for %s: %s\n",
+          domain->name, sysdb->ldb_ts_file);
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    /* the second attempt follows the removal of an unknown version */
+    for (i = 0; i < 2; i++) {
+        ret = sysdb_ldb_connect(sysdb, sysdb->ldb_ts_file, &ldb);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_ldb_connect failed.\n");
+            goto done;
+        }
+
+        verdn = ldb_dn_new(tmp_ctx, ldb, SYSDB_BASE);
+        if (verdn == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        lret = ldb_search(ldb, tmp_ctx, &res, verdn, LDB_SCOPE_BASE,
+                          NULL, NULL);
+        if (lret == LDB_ERR_NO_SUCH_OBJECT
+                || (lret == LDB_SUCCESS && res->count == 0)) {
+            break;
+        } else if (lret != LDB_SUCCESS) {
+            ret = EIO;
+            goto done;
+        }
+
+        version = ldb_msg_find_attr_as_string(res->msgs[0], "version", NULL);
+        if (version != NULL && strcmp(version, SYSDB_TS_VERSION) == 0) {
+            sysdb->ldb_ts = ldb;
+            ret = EOK;
+            goto done;
+        }
+
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "Recreating the timestamp cache of %s with version %s\n",
+              domain->name, version ? version : "unknown");
+        talloc_zfree(ldb);
+
+        ret = unlink(sysdb->ldb_ts_file);
+        if (ret == -1) {
+            ret = errno;
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to remove [%s] [%d]: %s\n",
+                  sysdb->ldb_ts_file, ret, sss_strerror(ret));
+            goto done;
+        }
+    }
+
+    if (ldb == NULL) {
+        ret = EIO;
+        goto done;
+    }
+
+    /* the timestamp cache is empty, populate */
+    base_ldif = SYSDB_TS_BASE_LDIF;
+    while ((ldif = ldb_ldif_read_string(ldb, &base_ldif))) {
+        lret = ldb_add(ldb, ldif->msg);
+        ldb_ldif_read_free(ldb, ldif);
+        if (lret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_FATAL_FAILURE,
+                  "Failed to initialize the timestamp cache (%d, [%s]) "
+                  "for domain %s!\n", lret, ldb_errstring(ldb), domain->name);
+            ret = EIO;
+            goto done;
+        }
+    }
+
+    /* reopen so that the attributes take effect */
+    talloc_zfree(ldb);
+    ret = sysdb_ldb_connect_ext(sysdb, sysdb->ldb_ts_file,
+                                sysdb->nosync ? LDB_FLG_NOSYNC : 0,
+                                &sysdb->ldb_ts);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_ldb_connect failed.\n");
+    }
+
+done:
+    if (ret != EOK) {
+        talloc_free(ldb);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* =Snapshots============================================================== */
+
+/* The back end copies the cache files at the start of a transaction, when
+ * it holds the transaction lock and before anything is written. Writes of
+ * a tdb transaction are deferred until the commit, so the copy is
+ * consistent. The responders search the copy and do not wait for the
+ * commits of long write transactions, e.g. of an enumeration. */
+
+#define SYSDB_SNAPSHOT_SUFFIX ".snapshot"
+#define SYSDB_SNAPSHOT_BUFSIZE (64 * 1024)
+
+/* Copies @path to a new file next to @snap_path, which is renamed over the
+ * published copy by the caller */
+static errno_t sysdb_snapshot_copy(TALLOC_CTX *mem_ctx,
+                                   const char *path,
+                                   const char *snap_path,
+                                   char **_tmp_path)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct stat st;
+    char *tmp_path;
+    uint8_t *buf;
+    ssize_t len;
+    ssize_t written;
+    int src_fd = -1;
+    int dst_fd = -1;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    tmp_path = talloc_asprintf(tmp_ctx, "%s.XXXXXX", snap_path);
+    buf = talloc_size(tmp_ctx, SYSDB_SNAPSHOT_BUFSIZE);
+    if (tmp_path == NULL || buf == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    src_fd = sss_open_cloexec(path, O_RDONLY, &ret);
+    if (src_fd == -1) {
+        goto done;
+    }
+
+    ret = fstat(src_fd, &st);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    dst_fd = sss_unique_file(NULL, tmp_path, &ret);
+    if (dst_fd == -1) {
+        goto done;
+    }
+
+    while ((len = sss_atomic_read_s(src_fd, buf, SYSDB_SNAPSHOT_BUFSIZE)) > 0) {
+        written = sss_atomic_write_s(dst_fd, buf, len);
+        if (written != len) {
+            ret = written == -1 ? errno : EIO;
+            goto done;
+        }
+    }
+    if (len == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    /* the responders may run as a different user, like for the cache */
+    ret = fchown(dst_fd, st.st_uid, st.st_gid);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = fchmod(dst_fd, st.st_mode & 0777);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    *_tmp_path = talloc_steal(mem_ctx, tmp_path);
+    ret = EOK;
+
+done:
+    if (src_fd != -1) {
+        close(src_fd);
+    }
+    if (dst_fd != -1) {
+        close(dst_fd);
+        if (ret != EOK) {
+            unlink(tmp_path);
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static void sysdb_snapshot_publish(struct sysdb_ctx *sysdb)
+{
+    TALLOC_CTX *tmp_ctx;
+    char *tmp_path = NULL;
+    char *ts_tmp_path = NULL;
+    struct stat st;
+    time_t mtime;
+    time_t now;
+    errno_t ret;
+
+    if (!sysdb->snapshot_publisher || sysdb->snapshot_interval == 0) {
+        return;
+    }
+
+    now = time(NULL);
+    if (now < sysdb->snapshot_published + sysdb->snapshot_interval) {
+        return;
+    }
+
+    ret = stat(sysdb->ldb_file, &st);
+    if (ret == -1) {
+        return;
+    }
+    mtime = st.st_mtime;
+
+    if (sysdb->ldb_ts_file != NULL) {
+        ret = stat(sysdb->ldb_ts_file, &st);
+        if (ret == 0 && st.st_mtime > mtime) {
+            mtime = st.st_mtime;
+        }
+    }
+
+    if (mtime < sysdb->snapshot_published) {
+        /* nothing was written since the last copy */
+        return;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return;
+    }
+
+    /* both files are copied before either copy is replaced */
+    ret = sysdb_snapshot_copy(tmp_ctx, sysdb->ldb_file, sysdb->ldb_snap_file,
+                              &tmp_path);
+    if (ret == EOK && sysdb->ldb_ts_file != NULL) {
+        ret = sysdb_snapshot_copy(tmp_ctx, sysdb->ldb_ts_file,
+                                  sysdb->ldb_ts_snap_file, &ts_tmp_path);
+    }
+
+    /* the responders reopen both files when the copy of the cache gets a
+     * new inode, so it is replaced last */
+    if (ret == EOK && ts_tmp_path != NULL) {
+        ret = rename(ts_tmp_path, sysdb->ldb_ts_snap_file);
+        if (ret == -1) {
+            ret = errno;
+        } else {
+            ts_tmp_path = NULL;
+        }
+    }
+    if (ret == EOK) {
+        ret = rename(tmp_path, sysdb->ldb_snap_file);
+        if (ret == -1) {
+            ret = errno;
+        } else {
+            tmp_path = NULL;
+        }
+    }
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to publish the copy of [%s] [%d]: %s\n",
+              sysdb->ldb_file, ret, sss_strerror(ret));
+        /* the previous copy stays published, the responders stop using it
+         * once the cache is written and the interval is over */
+        if (tmp_path != NULL) {
+            unlink(tmp_path);
+        }
+        if (ts_tmp_path != NULL) {
+            unlink(ts_tmp_path);
+        }
+    }
+
+    /* a failure is not retried before the next interval either */
+    sysdb->snapshot_published = now;
+    talloc_free(tmp_ctx);
+}
+
+static errno_t sysdb_snapshot_names(struct sysdb_ctx *sysdb)
+{
+    sysdb->ldb_snap_file = talloc_asprintf(sysdb, "%s"SYSDB_SNAPSHOT_SUFFIX,
+                                           sysdb->ldb_file);
+    if (sysdb->ldb_snap_file == NULL) {
+        return ENOMEM;
+    }
+
+    if (sysdb->ldb_ts_file != NULL) {
+        sysdb->ldb_ts_snap_file = talloc_asprintf(sysdb,
+                                                  "%s"SYSDB_SNAPSHOT_SUFFIX,
+                                                  sysdb->ldb_ts_file);
+        if (sysdb->ldb_ts_snap_file == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    return EOK;
+}
+
+void sysdb_set_snapshot_publisher(struct sysdb_ctx *sysdb, uint32_t interval)
+{
+    if (interval == 0) {
+        /* a copy left by an earlier configuration must not be used */
+        if (sysdb_snapshot_names(sysdb) == EOK) {
+            unlink(sysdb->ldb_snap_file);
+        }
+        return;
+    }
+
+    if (sysdb_snapshot_names(sysdb) != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory, not publishing a copy\n");
+        return;
+    }
+
+    sysdb->snapshot_interval = interval;
+    sysdb->snapshot_publisher = true;
+}
+
+void sysdb_set_snapshot_reader(struct sysdb_ctx *sysdb, uint32_t interval)
+{
+    if (interval == 0) {
+        return;
+    }
+
+    if (sysdb_snapshot_names(sysdb) != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory, not reading a copy\n");
+        return;
+    }
+
+    sysdb->snapshot_interval = interval;
+    sysdb->snapshot_publisher = false;
+}
+
+static void sysdb_snapshot_close(struct sysdb_ctx *sysdb)
+{
+    talloc_zfree(sysdb->ldb_snap);
+    talloc_zfree(sysdb->ldb_ts_snap);
+    sysdb->snapshot_ino = 0;
+    sysdb->snapshot_current = false;
+}
+
+void sysdb_snapshot_invalidate(struct sysdb_ctx *sysdb)
+{
+    struct stat snap_st;
+    int ret;
+
+    if (sysdb == NULL || sysdb->snapshot_publisher
+            || sysdb->snapshot_interval == 0) {
+        return;
+    }
+
+    /* a new copy is renamed over the old one and gets a new inode */
+    ret = stat(sysdb->ldb_snap_file, &snap_st);
+    if (ret == 0) {
+        sysdb->snapshot_stale_ino = snap_st.st_ino;
+    }
+
+    sysdb_snapshot_close(sysdb);
+}
+
+/* Reopens the copy when a new one was published and decides whether it is
+ * recent enough. The copy is used for the interval after it was published
+ * and as long as the cache was not written since. */
+static void sysdb_snapshot_check(struct sysdb_ctx *sysdb, time_t now)
+{
+    struct stat snap_st;
+    struct stat st;
+    errno_t ret;
+
+    ret = stat(sysdb->ldb_snap_file, &snap_st);
+    if (ret == -1 || snap_st.st_ino == sysdb->snapshot_stale_ino) {
+        sysdb_snapshot_close(sysdb);
+        return;
+    }
+
+    if (snap_st.st_ino != sysdb->snapshot_ino) {
+        sysdb_snapshot_close(sysdb);
+
+        ret = sysdb_ldb_connect_ext(sysdb, sysdb->ldb_snap_file,
+                                    LDB_FLG_RDONLY, &sysdb->ldb_snap);
+        if (ret == EOK && sysdb->ldb_ts_snap_file != NULL) {
+            ret = sysdb_ldb_connect_ext(sysdb, sysdb->ldb_ts_snap_file,
+                                        LDB_FLG_RDONLY, &sysdb->ldb_ts_snap);
+        }
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Unable to open the copy of [%s], using the cache\n",
+                  sysdb->ldb_file);
+            sysdb_snapshot_close(sysdb);
+            return;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Opened the copy of [%s]\n",
+              sysdb->ldb_file);
+        sysdb->snapshot_ino = snap_st.st_ino;
+    }
+
+    if (now < snap_st.st_mtime + sysdb->snapshot_interval) {
+        sysdb->snapshot_current = true;
+        return;
+    }
+
+    ret = stat(sysdb->ldb_file, &st);
+    sysdb->snapshot_current = (ret == 0 && st.st_mtime < snap_st.st_mtime);
+}
+
+static struct ldb_context *sysdb_snapshot_get(struct sysdb_ctx *sysdb,
+                                              time_t now)
+{
+    if (sysdb->snapshot_publisher || sysdb->snapshot_interval == 0) {
+        return NULL;
+    }
+
+    /* at most once a second */
+    if (now != sysdb->snapshot_checked) {
+        sysdb->snapshot_checked = now;
+        sysdb_snapshot_check(sysdb, now);
+    }
+
+    return sysdb->snapshot_current ? sysdb->ldb_snap : NULL;
+}
+
+/* Expired entries are refreshed by the responders, which then need to see
+ * what the back end wrote, so they are only returned from the cache. */
+static bool sysdb_snapshot_res_valid(struct ldb_result *res, time_t now)
+{
+    uint64_t expire;
+    size_t i;
+
+    if (res->count == 0) {
+        return false;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        expire = ldb_msg_find_attr_as_uint64(res->msgs[i],
+                                             SYSDB_CACHE_EXPIRE, 0);
+        if (expire != 0 && expire < now) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static errno_t sysdb_read_search_ldb(TALLOC_CTX *mem_ctx,
+                                     struct ldb_context *ldb,
+                                     struct ldb_context *ldb_ts,
+                                     struct ldb_dn *base_dn,
+                                     enum ldb_scope scope,
+                                     const char **attrs,
+                                     const char *filter,
+                                     struct ldb_result **_res)
+{
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    int lret;
+    errno_t ret;
+
+    /* a DN is bound to the ldb context it was created for */
+    dn = ldb_dn_new(mem_ctx, ldb, ldb_dn_get_linearized(base_dn));
+    if (dn == NULL) {
+        return ENOMEM;
+    }
+
+    lret = ldb_search(ldb, mem_ctx, &res, dn, scope, attrs, "%s", filter);
+    if (lret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(lret);
+    }
+
+    ret = sysdb_ts_merge_ldb(ldb_ts, res->count, res->msgs);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (sysdb_ghosts_requested(attrs)) {
+        ret = sysdb_ghosts_merge_ldb(ldb, res->count, res->msgs);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    *_res = res;
+    return EOK;
+}
+
+errno_t sysdb_read_search(TALLOC_CTX *mem_ctx,
+                          struct sysdb_ctx *sysdb,
+                          struct ldb_dn *base_dn,
+                          enum ldb_scope scope,
+                          const char **attrs,
+                          struct ldb_result **_res,
+                          const char *fmt, ...)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_context *ldb_snap;
+    struct ldb_result *res;
+    char *filter;
+    va_list ap;
+    time_t now;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    va_start(ap, fmt);
+    filter = talloc_vasprintf(tmp_ctx, fmt, ap);
+    va_end(ap);
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    now = time(NULL);
+    ldb_snap = sysdb_snapshot_get(sysdb, now);
+    if (ldb_snap != NULL) {
+        ret = sysdb_read_search_ldb(tmp_ctx, ldb_snap, sysdb->ldb_ts_snap,
+                                    base_dn, scope, attrs, filter, &res);
+        if (ret == EOK && sysdb_snapshot_res_valid(res, now)) {
+            goto done;
+        } else if (ret != EOK && ret != ENOENT) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Unable to search the copy of the cache [%d]: %s\n",
+                  ret, sss_strerror(ret));
+        }
+        /* the entry may have been added or refreshed since the copy */
+    }
+
+    ret = sysdb_read_search_ldb(tmp_ctx, sysdb->ldb, sysdb->ldb_ts,
+                                base_dn, scope, attrs, filter, &res);
+
+done:
+    if (ret == EOK) {
+        *_res = talloc_steal(mem_ctx, res);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* =Initialization======================================================== */
+
+int sysdb_get_db_file(TALLOC_CTX *mem_ctx,
+                      const char *provider, const char *name,
+                      const char *base_path, char **_ldb_file)
+{
+    char *ldb_file;
+
+    /* special case for the local domain */
+    if (strcasecmp(provider, "local") == 0) {
+        ldb_file = talloc_asprintf(mem_ctx, "%s/"LOCAL_SYSDB_FILE,
+                                   base_path);
+    } else {
+        ldb_file = talloc_asprintf(mem_ctx, "%s/"CACHE_SYSDB_FILE,
+                                   base_path, name);
+    }
+    if (!ldb_file) {
+        return ENOMEM;
+    }
+
+    *_ldb_file = ldb_file;
+    return EOK;
+}
+
+errno_t sysdb_domain_create(struct sysdb_ctx *sysdb, const char *domain_name)
+{
+    struct ldb_message *msg;
+    TALLOC_CTX *tmp_ctx;
+    int ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* == create base domain object == */
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (!msg) {
+        ret = ENOMEM;
+        goto done;
+    }
+    msg->dn = ldb_dn_new_fmt(msg, sysdb->ldb, SYSDB_DOM_BASE, domain_name);
+    if (!msg->dn) {
+        ret = ENOMEM;
+        goto done;
+    }
+    ret = ldb_msg_add_string(msg, "cn", domain_name);
+    if (ret != LDB_SUCCESS) {
+        ret = EIO;
+        goto done;
+    }
+    /* do a synchronous add */
+    ret = ldb_add(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to initialize DB (%d, [%s]) "
+                                     "for domain %s!\n",
+                                     ret, ldb_errstring(sysdb->ldb),
+                                     domain_name);
+        ret = EIO;
+        goto done;
+    }
+    talloc_zfree(msg);
+
+    /* == create Users tree == */
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (!msg) {
+        ret = ENOMEM;
+        goto done;
+    }
+    msg->dn = ldb_dn_new_fmt(msg, sysdb->ldb,
+                             SYSDB_TMPL_USER_BASE, domain_name);
+    if (!msg->dn) {
+        ret = ENOMEM;
+        goto done;
+    }
+    ret = ldb_msg_add_string(msg, "cn", "Users");
+    if (ret != LDB_SUCCESS) {
+        ret = EIO;
+        goto done;
+    }
+    /* do a synchronous add */
+    ret = ldb_add(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to initialize DB (%d, [%s]) "
+                                     "for domain %s!\n",
+                                     ret, ldb_errstring(sysdb->ldb),
+                                     domain_name);
+        ret = EIO;
+        goto done;
+    }
+    talloc_zfree(msg);
+
+    /* == create Groups tree == */
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (!msg) {
+        ret = ENOMEM;
+        goto done;
+    }
+    msg->dn = ldb_dn_new_fmt(msg, sysdb->ldb,
+                             SYSDB_TMPL_GROUP_BASE, domain_name);
+    if (!msg->dn) {
+        ret = ENOMEM;
+        goto done;
+    }
+    ret = ldb_msg_add_string(msg, "cn", "Groups");
+    if (ret != LDB_SUCCESS) {
+        ret = EIO;
+        goto done;
+    }
+    /* do a synchronous add */
+    ret = ldb_add(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to initialize DB (%d, [%s]) for "
+                                     "domain %s!\n",
+                                     ret, ldb_errstring(sysdb->ldb),
+                                     domain_name);
+        ret = EIO;
+        goto done;
+    }
+    talloc_zfree(msg);
+
+    ret = EOK;
+
+done:
+    talloc_zfree(tmp_ctx);
+    return ret;
+}
+
+/* Compare versions of sysdb, returns ERRNO accordingly */
+static errno_t
+sysdb_version_check(const char *expected,
+                    const char *received)
+{
+    int ret;
+    unsigned int exp_major, exp_minor, recv_major, recv_minor;
+
+    ret = sscanf(expected, "%u.%u", &exp_major, &exp_minor);
+    if (ret != 2) {
+        return EINVAL;
+    }
+    ret = sscanf(received, "%u.%u", &recv_major, &recv_minor);
+    if (ret != 2) {
+        return EINVAL;
+    }
+
+    if (recv_major > exp_major) {
+        return EUCLEAN;
+    } else if (recv_major < exp_major) {
+        return EMEDIUMTYPE;
+    }
+
+    if (recv_minor > exp_minor) {
+        return EUCLEAN;
+    } else if (recv_minor < exp_minor) {
+        return EMEDIUMTYPE;
+    }
+
+    return EOK;
+}
+
+int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
+                               struct sss_domain_info *domain,
+                               const char *db_path,
+                               bool allow_upgrade,
+                               uint32_t flags,
+                               struct sysdb_ctx **_ctx)
+{
+    TALLOC_CTX *tmp_ctx = NULL;
+    struct sysdb_ctx *sysdb;
+    const char *base_ldif;
+    struct ldb_ldif *ldif;
+    struct ldb_message_element *el;
+    struct ldb_result *res;
+    struct ldb_dn *verdn;
+    const char *version = NULL;
+    int ret;
+
+    sysdb = talloc_zero(mem_ctx, struct sysdb_ctx);
+    if (!sysdb) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_get_db_file(sysdb, domain->provider,
+                            domain->name, db_path,
+                            &sysdb->ldb_file);
+    if (ret != EOK) {
+        goto done;
+    }
+    DEBUG(SSSDBG_FUNC_DATA,
+          "DB File for %s: %s\n", domain->name, sysdb->ldb_file);
+
+    /* the commits are flushed by sysdb_sync.c, which only the back end
+     * runs */
+    sysdb->nosync = (flags & SYSDB_INIT_FLAG_NOSYNC)
+                        && domain->cache_commit_delay > 0;
+
+    ret = sysdb_ldb_connect_ext(sysdb, sysdb->ldb_file,
+                                sysdb->nosync ? LDB_FLG_NOSYNC : 0,
+                                &sysdb->ldb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_ldb_connect failed.\n");
+        goto done;
+    }
+
+    sysdb->warn_unindexed = getenv(SYSDB_WARN_UNINDEXED_ENV) != NULL;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    verdn = ldb_dn_new(tmp_ctx, sysdb->ldb, SYSDB_BASE);
+    if (!verdn) {
+        ret = EIO;
+        goto done;
+    }
+
+    ret = ldb_search(sysdb->ldb, tmp_ctx, &res,
+                     verdn, LDB_SCOPE_BASE,
+                     NULL, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = EIO;
+        goto done;
+    }
+    if (res->count > 1) {
+        ret = EIO;
+        goto done;
+    }
+
+    if (res->count == 1) {
+        el = ldb_msg_find_element(res->msgs[0], "version");
+        if (!el) {
+            ret = EIO;
+            goto done;
+        }
+
+        if (el->num_values != 1) {
             ret = EINVAL;
             goto done;
         }
@@ -1284,6 +2661,27 @@ int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
             }
         }
 
+        if (strcmp(version, SYSDB_VERSION_0_17) == 0) {
+            ret = sysdb_upgrade_17(sysdb, &version);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+
+        if (strcmp(version, SYSDB_VERSION_0_18) == 0) {
+            ret = sysdb_upgrade_18(sysdb, &version);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+
+        if (strcmp(version, SYSDB_VERSION_0_19) == 0) {
+            ret = sysdb_upgrade_19(sysdb, &version);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+
         /* The version should now match SYSDB_VERSION.
          * If not, it means we didn't match any of the
          * known older versions. The DB might be
@@ -1344,6 +2742,9 @@ int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
 
 done:
     talloc_free(tmp_ctx);
+    if (ret == EOK) {
+        ret = sysdb_ts_cache_connect(sysdb, domain, db_path);
+    }
     if (ret == EOK) {
         *_ctx = sysdb;
     } else {
@@ -1382,7 +2783,7 @@ int sysdb_init_ext(TALLOC_CTX *mem_ctx,
     for (dom = domains; dom; dom = dom->next) {
 
         ret = sysdb_domain_init_internal(mem_ctx, dom, DB_PATH,
-                                         allow_upgrade, &sysdb);
+                                         allow_upgrade, 0, &sysdb);
         if (ret != EOK) {
             return ret;
         }
@@ -1396,6 +2797,17 @@ int sysdb_init_ext(TALLOC_CTX *mem_ctx,
                       uid, gid);
                 return ret;
             }
+
+            if (sysdb->ldb_ts_file != NULL) {
+                ret = chown(sysdb->ldb_ts_file, uid, gid);
+                if (ret != 0) {
+                    ret = errno;
+                    DEBUG(SSSDBG_CRIT_FAILURE,
+                          "Cannot set timestamp cache ownership to "
+                          "%"SPRIuid":%"SPRIgid"\n", uid, gid);
+                    return ret;
+                }
+            }
         }
 
         dom->sysdb = talloc_move(dom, &sysdb);
@@ -1408,9 +2820,18 @@ int sysdb_domain_init(TALLOC_CTX *mem_ctx,
                       struct sss_domain_info *domain,
                       const char *db_path,
                       struct sysdb_ctx **_ctx)
+{
+    return sysdb_domain_init_ext(mem_ctx, domain, db_path, 0, _ctx);
+}
+
+int sysdb_domain_init_ext(TALLOC_CTX *mem_ctx,
+                          struct sss_domain_info *domain,
+                          const char *db_path,
+                          uint32_t flags,
+                          struct sysdb_ctx **_ctx)
 {
     return sysdb_domain_init_internal(mem_ctx, domain,
-                                      db_path, false, _ctx);
+                                      db_path, false, flags, _ctx);
 }
 
 int compare_ldb_dn_comp_num(const void *m1, const void *m2)
@@ -1724,6 +3145,156 @@ done:
     return ret;
 }
 
+errno_t sysdb_get_dirsync_cookie(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *domain,
+                                 struct ldb_val **_cookie)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    const struct ldb_val *val;
+    struct ldb_val *cookie;
+    const char *attrs[] = { SYSDB_DIRSYNC_COOKIE, NULL };
+    errno_t ret;
+    int lret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    dn = ldb_dn_new_fmt(tmp_ctx, domain->sysdb->ldb, SYSDB_DOM_BASE,
+                        domain->name);
+    if (dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, dn, LDB_SCOPE_BASE,
+                      attrs, NULL);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (res->count == 0) {
+        ret = ENOENT;
+        goto done;
+    } else if (res->count != 1) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Got more than one reply for base search!\n");
+        ret = EIO;
+        goto done;
+    }
+
+    val = ldb_msg_find_ldb_val(res->msgs[0], SYSDB_DIRSYNC_COOKIE);
+    if (val == NULL || val->length == 0) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    cookie = talloc_zero(tmp_ctx, struct ldb_val);
+    if (cookie == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    *cookie = ldb_val_dup(cookie, val);
+    if (cookie->data == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    *_cookie = talloc_steal(mem_ctx, cookie);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_set_dirsync_cookie(struct sss_domain_info *domain,
+                                 const struct ldb_val *cookie)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    errno_t ret;
+    int lret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    msg->dn = ldb_dn_new_fmt(msg, domain->sysdb->ldb, SYSDB_DOM_BASE,
+                             domain->name);
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, msg->dn,
+                      LDB_SCOPE_BASE, NULL, NULL);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (res->count == 0) {
+        if (cookie == NULL) {
+            ret = EOK;
+            goto done;
+        }
+
+        lret = ldb_msg_add_string(msg, "cn", domain->name);
+    } else if (cookie == NULL) {
+        lret = ldb_msg_add_empty(msg, SYSDB_DIRSYNC_COOKIE,
+                                 LDB_FLAG_MOD_DELETE, NULL);
+    } else {
+        lret = ldb_msg_add_empty(msg, SYSDB_DIRSYNC_COOKIE,
+                                 LDB_FLAG_MOD_REPLACE, NULL);
+    }
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (cookie != NULL) {
+        lret = ldb_msg_add_value(msg, SYSDB_DIRSYNC_COOKIE, cookie, NULL);
+        if (lret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+    }
+
+    if (res->count) {
+        lret = ldb_modify(domain->sysdb->ldb, msg);
+        if (lret == LDB_ERR_NO_SUCH_ATTRIBUTE && cookie == NULL) {
+            lret = LDB_SUCCESS;
+        }
+    } else {
+        lret = ldb_add(domain->sysdb->ldb, msg);
+    }
+
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "ldb operation failed: [%s](%d)[%s]\n",
+              ldb_strerror(lret), lret, ldb_errstring(domain->sysdb->ldb));
+    }
+    ret = sysdb_error_to_errno(lret);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 errno_t sysdb_attrs_primary_name(struct sysdb_ctx *sysdb,
                                  struct sysdb_attrs *attrs,
                                  const char *ldap_attr,
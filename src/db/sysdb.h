@@ -28,6 +28,7 @@
 #include <tevent.h>
 
 #define CACHE_SYSDB_FILE "cache_%s.ldb"
+#define CACHE_TIMESTAMPS_FILE "timestamps_%s.ldb"
 #define LOCAL_SYSDB_FILE "sssd.ldb"
 
 #define SYSDB_BASE "cn=sysdb"
@@ -93,6 +94,7 @@
 #define SYSDB_LAST_UPDATE "lastUpdate"
 #define SYSDB_CACHE_EXPIRE "dataExpireTimestamp"
 #define SYSDB_INITGR_EXPIRE "initgrExpireTimestamp"
+#define SYSDB_INITGR_GIDS "initgrGIDs"
 #define SYSDB_IFP_CACHED "ifpCached"
 
 #define SYSDB_AUTHORIZED_SERVICE "authorizedService"
@@ -135,6 +137,7 @@
 
 #define SYSDB_AUTH_TYPE "authType"
 #define SYSDB_USER_CERT "userCertificate"
+#define SYSDB_USER_CERT_HASH "userCertificateSha256"
 
 #define SYSDB_SUBDOMAIN_REALM "realmName"
 #define SYSDB_SUBDOMAIN_FLAT "flatName"
@@ -154,6 +157,7 @@
 #define ORIGINALAD_PREFIX "originalAD"
 #define OVERRIDE_PREFIX "override"
 #define SYSDB_DEFAULT_OVERRIDE_NAME "defaultOverrideName"
+#define SYSDB_MERGED_OVERRIDE_VIEW "mergedOverrideView"
 
 #define SYSDB_AD_ACCOUNT_EXPIRES "adAccountExpires"
 #define SYSDB_AD_USER_ACCOUNT_CONTROL "adUserAccountControl"
@@ -198,14 +202,27 @@
 #define SYSDB_SID_FILTER "(&(|("SYSDB_UC")("SYSDB_GC"))("SYSDB_SID_STR"=%s))"
 #define SYSDB_UUID_FILTER "(&(|("SYSDB_UC")("SYSDB_GC"))("SYSDB_UUID"=%s))"
 #define SYSDB_USER_CERT_FILTER "(&("SYSDB_UC")%s)"
+#define SYSDB_USER_CERT_HASH_FILTER "(&("SYSDB_UC")("SYSDB_USER_CERT_HASH"=%s))"
 
 #define SYSDB_HAS_ENUMERATED "has_enumerated"
+#define SYSDB_DIRSYNC_COOKIE "dirSyncCookie"
 
 #define SYSDB_DEFAULT_ATTRS SYSDB_LAST_UPDATE, \
                             SYSDB_CACHE_EXPIRE, \
                             SYSDB_INITGR_EXPIRE, \
                             SYSDB_OBJECTCLASS
 
+/* Override data of the current view merged into the original object by
+ * sysdb_store_override(), see sysdb_add_overrides_to_object() */
+#define SYSDB_MERGED_OVERRIDE_ATTRS SYSDB_MERGED_OVERRIDE_VIEW, \
+                                    OVERRIDE_PREFIX SYSDB_NAME, \
+                                    OVERRIDE_PREFIX SYSDB_UIDNUM, \
+                                    OVERRIDE_PREFIX SYSDB_GIDNUM, \
+                                    OVERRIDE_PREFIX SYSDB_GECOS, \
+                                    OVERRIDE_PREFIX SYSDB_HOMEDIR, \
+                                    OVERRIDE_PREFIX SYSDB_SHELL, \
+                                    OVERRIDE_PREFIX SYSDB_SSH_PUBKEY
+
 #define SYSDB_PW_ATTRS {SYSDB_NAME, SYSDB_UIDNUM, \
                         SYSDB_GIDNUM, SYSDB_GECOS, \
                         SYSDB_HOMEDIR, SYSDB_SHELL, \
@@ -216,6 +233,7 @@
                         SYSDB_OVERRIDE_DN, \
                         SYSDB_OVERRIDE_OBJECT_DN, \
                         SYSDB_DEFAULT_OVERRIDE_NAME, \
+                        SYSDB_MERGED_OVERRIDE_ATTRS, \
                         NULL}
 
 #define SYSDB_GRSRC_ATTRS {SYSDB_NAME, SYSDB_GIDNUM, \
@@ -227,6 +245,7 @@
                            SYSDB_OVERRIDE_DN, \
                            SYSDB_OVERRIDE_OBJECT_DN, \
                            SYSDB_DEFAULT_OVERRIDE_NAME, \
+                           SYSDB_MERGED_OVERRIDE_ATTRS, \
                            NULL}
 
 #define SYSDB_NETGR_ATTRS {SYSDB_NAME, SYSDB_NETGROUP_TRIPLE, \
@@ -241,6 +260,7 @@
                             SYSDB_SID_STR, \
                             SYSDB_NAME, \
                             SYSDB_OVERRIDE_DN, \
+                            SYSDB_MERGED_OVERRIDE_ATTRS, \
                             NULL}
 
 #define SYSDB_TMPL_USER SYSDB_NAME"=%s,"SYSDB_TMPL_USER_BASE
@@ -606,6 +626,83 @@ int sysdb_domain_init(TALLOC_CTX *mem_ctx,
                       const char *db_path,
                       struct sysdb_ctx **_ctx);
 
+/* Only for the back end, which flushes the commits itself with
+ * sysdb_sync_init(): the cache files are opened without syncing every
+ * commit if the domain has a cache_commit_delay */
+#define SYSDB_INIT_FLAG_NOSYNC 0x0001
+
+/* Same as sysdb_domain_init, but with SYSDB_INIT_FLAG_* flags */
+int sysdb_domain_init_ext(TALLOC_CTX *mem_ctx,
+                          struct sss_domain_info *domain,
+                          const char *db_path,
+                          uint32_t flags,
+                          struct sysdb_ctx **_ctx);
+
+/* Read-only copy of the cache. The back end publishes a copy at the start
+ * of a transaction at most every interval seconds, the responders search
+ * the copy for single users and groups. An interval of 0 disables it. */
+void sysdb_set_snapshot_publisher(struct sysdb_ctx *sysdb, uint32_t interval);
+void sysdb_set_snapshot_reader(struct sysdb_ctx *sysdb, uint32_t interval);
+
+/* Called by the responders once the back end answered a request. The copy
+ * published before may not have what the back end just wrote, so it is not
+ * searched until the back end publishes the next one. */
+void sysdb_snapshot_invalidate(struct sysdb_ctx *sysdb);
+
+/* With a cache_commit_delay the commits are flushed to disk by a thread
+ * that many milliseconds later, see sysdb_sync.c. Only the process which
+ * writes the cache runs the thread. sysdb_sync_send() completes once all
+ * the transactions committed before it are on disk. */
+errno_t sysdb_sync_init(struct sysdb_ctx *sysdb,
+                        struct tevent_context *ev,
+                        uint32_t delay);
+struct tevent_req *sysdb_sync_send(TALLOC_CTX *mem_ctx,
+                                   struct tevent_context *ev,
+                                   struct sysdb_ctx *sysdb);
+errno_t sysdb_sync_recv(struct tevent_req *req);
+
+/* Snapshots of the users, groups and @custom_subtrees of the cache of
+ * @domain, see sysdb_snapshot.c. The cached credentials are not exported.
+ * The imported entries are expired and replace the ones in the cache, only
+ * a snapshot of the same cache version and domain can be imported, else
+ * EMEDIUMTYPE or EINVAL is returned. An entry which cannot be imported is
+ * counted in @_failed and does not stop the import. */
+errno_t sysdb_snapshot_export(struct sss_domain_info *domain,
+                              const char **custom_subtrees,
+                              FILE *file,
+                              size_t *_count);
+
+errno_t sysdb_snapshot_import(struct sss_domain_info *domain,
+                              FILE *file,
+                              size_t *_count,
+                              size_t *_failed);
+
+/* Size report and compaction of a cache file, see sysdb_compact.c. The
+ * cache must not be open in the calling process. */
+struct sysdb_cache_stats {
+    off_t file_size;
+    size_t records;
+    /* keys and values of the records, the rest of the file is free space,
+     * record headers and the hash table */
+    size_t data_size;
+    int free_records;
+};
+
+errno_t sysdb_cache_file_stats(const char *ldb_file,
+                               struct sysdb_cache_stats *stats);
+
+/* With @in_use the records are repacked in place, otherwise the file is
+ * rewritten into a new one which replaces it and is smaller */
+errno_t sysdb_cache_file_compact(const char *ldb_file, bool in_use);
+
+/* The cache and timestamp cache files of @domain, @_ts_file is NULL if the
+ * domain has no timestamp cache */
+errno_t sysdb_get_cache_files(TALLOC_CTX *mem_ctx,
+                              struct sss_domain_info *domain,
+                              const char *db_path,
+                              char **_ldb_file,
+                              char **_ts_file);
+
 /* functions to retrieve information from sysdb
  * These functions automatically starts an operation
  * therefore they cannot be called within a transaction */
@@ -674,6 +771,29 @@ int sysdb_enumgrent_filter_with_views(TALLOC_CTX *mem_ctx,
                                       const char *addtl_filter,
                                       struct ldb_result **res);
 
+/* An enumeration cursor keeps only the DNs of the enumerated users,
+ * groups or automounter entries, the objects are read from the cache, with
+ * the overrides of the view applied, a page at a time with
+ * sysdb_enum_cursor_read(). Objects removed from the cache meanwhile are
+ * skipped. */
+struct sysdb_enum_cursor;
+
+errno_t sysdb_enumpwent_cursor(TALLOC_CTX *mem_ctx,
+                               struct sss_domain_info *domain,
+                               struct sysdb_enum_cursor **_cursor);
+
+errno_t sysdb_enumgrent_cursor(TALLOC_CTX *mem_ctx,
+                               struct sss_domain_info *domain,
+                               struct sysdb_enum_cursor **_cursor);
+
+size_t sysdb_enum_cursor_count(struct sysdb_enum_cursor *cursor);
+
+errno_t sysdb_enum_cursor_read(TALLOC_CTX *mem_ctx,
+                               struct sysdb_enum_cursor *cursor,
+                               size_t start,
+                               size_t count,
+                               struct ldb_result **_res);
+
 struct sysdb_netgroup_ctx {
     enum {SYSDB_NETGROUP_TRIPLE_VAL, SYSDB_NETGROUP_GROUP_VAL} type;
     union {
@@ -706,6 +826,17 @@ int sysdb_initgroups_with_views(TALLOC_CTX *mem_ctx,
                                 const char *name,
                                 struct ldb_result **res);
 
+/* Reads the user entry together with the GIDs of the POSIX groups the user
+ * is a member of as precomputed by sysdb_update_initgr_gids(). The result
+ * contains only the user entry. Returns ENOENT if the user is not cached or
+ * the list is not available, sysdb_initgroups() must be used then. */
+int sysdb_initgroups_gids(TALLOC_CTX *mem_ctx,
+                          struct sss_domain_info *domain,
+                          const char *name,
+                          struct ldb_result **_res,
+                          gid_t **_gids,
+                          size_t *_num_gids);
+
 int sysdb_get_user_attr(TALLOC_CTX *mem_ctx,
                         struct sss_domain_info *domain,
                         const char *name,
@@ -838,6 +969,12 @@ int sysdb_set_user_attr(struct sss_domain_info *domain,
                         struct sysdb_attrs *attrs,
                         int mod_op);
 
+/* Stores the GIDs of the groups of the user with the user entry so that the
+ * responders can answer initgroups without walking the memberships. The
+ * memberof plugin removes the list when the memberships change. */
+errno_t sysdb_update_initgr_gids(struct sss_domain_info *domain,
+                                 const char *name);
+
 /* Replace group attrs */
 int sysdb_set_group_attr(struct sss_domain_info *domain,
                          const char *name,
@@ -850,6 +987,18 @@ int sysdb_set_netgroup_attr(struct sss_domain_info *domain,
                             struct sysdb_attrs *attrs,
                             int mod_op);
 
+/* Expires in one transaction the entries below base_dn that match
+ * sub_filter, e.g. all users of the domain. The initgroups expiration is
+ * reset as well if initgr is set. Only the DNs and the expiration are read
+ * and entries which are expired already are not written, so this is much
+ * cheaper than a sysdb_set_*_attr() per entry. Returns ENOENT if nothing
+ * matches, the number of entries expired is returned in _count. */
+errno_t sysdb_invalidate_cache_entries(struct sss_domain_info *domain,
+                                       struct ldb_dn *base_dn,
+                                       const char *sub_filter,
+                                       bool initgr,
+                                       size_t *_count);
+
 /* Allocate a new id */
 int sysdb_get_new_id(struct sss_domain_info *domain,
                      uint32_t *id);
@@ -932,6 +1081,50 @@ int sysdb_store_group(struct sss_domain_info *domain,
                       uint64_t cache_timeout,
                       time_t now);
 
+/* A user stored by sysdb_store_users_bulk(), the members are the arguments
+ * of sysdb_store_user(). */
+struct sysdb_bulk_user {
+    const char *name;
+    const char *pwd;
+    uid_t uid;
+    gid_t gid;
+    const char *gecos;
+    const char *homedir;
+    const char *shell;
+    const char *orig_dn;
+    struct sysdb_attrs *attrs;
+    char **remove_attrs;
+
+    /* set to the result of storing the user */
+    errno_t ret;
+};
+
+/* A group stored by sysdb_store_groups_bulk(), the members are the
+ * arguments of sysdb_store_group(). */
+struct sysdb_bulk_group {
+    const char *name;
+    gid_t gid;
+    struct sysdb_attrs *attrs;
+
+    /* set to the result of storing the group */
+    errno_t ret;
+};
+
+/* Store many users or groups of @domain in one transaction. A failure to
+ * store one of them is reported in its ret member and does not stop the
+ * others, only a failure of the transaction itself is returned. */
+errno_t sysdb_store_users_bulk(struct sss_domain_info *domain,
+                               struct sysdb_bulk_user *users,
+                               size_t num_users,
+                               uint64_t cache_timeout,
+                               time_t now);
+
+errno_t sysdb_store_groups_bulk(struct sss_domain_info *domain,
+                                struct sysdb_bulk_group *groups,
+                                size_t num_groups,
+                                uint64_t cache_timeout,
+                                time_t now);
+
 enum sysdb_member_type {
     SYSDB_MEMBER_USER,
     SYSDB_MEMBER_GROUP,
@@ -983,6 +1176,17 @@ int sysdb_cache_password_ex(struct sss_domain_info *domain,
                             enum sss_authtok_type authtok_type,
                             size_t second_factor_size);
 
+/* Computes the hash outside of the event loop, the password can be freed
+ * as soon as the request was created */
+struct tevent_req *sysdb_cache_password_send(TALLOC_CTX *mem_ctx,
+                                             struct tevent_context *ev,
+                                             struct sss_domain_info *domain,
+                                             const char *username,
+                                             const char *password,
+                                             enum sss_authtok_type authtok_type,
+                                             size_t second_factor_len);
+errno_t sysdb_cache_password_recv(struct tevent_req *req);
+
 errno_t check_failed_login_attempts(struct confdb_ctx *cdb,
                                     struct ldb_message *ldb_msg,
                                     uint32_t *failed_login_attempts,
@@ -995,6 +1199,19 @@ int sysdb_cache_auth(struct sss_domain_info *domain,
                      time_t *_expire_date,
                      time_t *_delayed_until);
 
+/* Same as sysdb_cache_auth() but the hashes are computed outside of the
+ * event loop. The expiration and delay are returned on failure as well. */
+struct tevent_req *sysdb_cache_auth_send(TALLOC_CTX *mem_ctx,
+                                         struct tevent_context *ev,
+                                         struct sss_domain_info *domain,
+                                         const char *name,
+                                         const char *password,
+                                         struct confdb_ctx *cdb,
+                                         bool just_check);
+errno_t sysdb_cache_auth_recv(struct tevent_req *req,
+                              time_t *_expire_date,
+                              time_t *_delayed_until);
+
 int sysdb_store_custom(struct sss_domain_info *domain,
                        const char *object_name,
                        const char *subtree_name,
@@ -1093,6 +1310,15 @@ errno_t sysdb_has_enumerated(struct sss_domain_info *domain,
 errno_t sysdb_set_enumerated(struct sss_domain_info *domain,
                              bool enumerated);
 
+/* The cookie of the last AD DirSync search of the domain, ENOENT if
+ * there is none. Setting a NULL cookie removes it. */
+errno_t sysdb_get_dirsync_cookie(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *domain,
+                                 struct ldb_val **_cookie);
+
+errno_t sysdb_set_dirsync_cookie(struct sss_domain_info *domain,
+                                 const struct ldb_val *cookie);
+
 errno_t sysdb_remove_attrs(struct sss_domain_info *domain,
                            const char *name,
                            enum sysdb_member_type type,
@@ -1138,6 +1364,15 @@ errno_t sysdb_search_object_by_sid(TALLOC_CTX *mem_ctx,
                                    const char **attrs,
                                    struct ldb_result **res);
 
+/* Looks up the users and groups with any of the SIDs using as few searches
+ * as possible, SIDs not found in the cache are missing from @_res */
+errno_t sysdb_search_objects_by_sids(TALLOC_CTX *mem_ctx,
+                                     struct sss_domain_info *domain,
+                                     const char **sid_strs,
+                                     size_t num_sids,
+                                     const char **attrs,
+                                     struct ldb_result **_res);
+
 errno_t sysdb_search_object_by_uuid(TALLOC_CTX *mem_ctx,
                                     struct sss_domain_info *domain,
                                     const char *uuid_str,
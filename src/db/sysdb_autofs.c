@@ -406,6 +406,112 @@ done:
     return ret;
 }
 
+errno_t
+sysdb_autofs_entries_cursor(TALLOC_CTX *mem_ctx,
+                            struct sss_domain_info *domain,
+                            const char *mapname,
+                            struct sysdb_enum_cursor **_cursor)
+{
+    errno_t ret;
+    TALLOC_CTX *tmp_ctx;
+    char *filter;
+    struct ldb_dn *mapdn;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Creating entries cursor for map %s\n", mapname);
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    mapdn = sysdb_autofsmap_dn(tmp_ctx, domain, mapname);
+    if (!mapdn) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    filter = talloc_asprintf(tmp_ctx, "(objectclass=%s)",
+                             SYSDB_AUTOFS_ENTRY_OC);
+    if (!filter) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_enum_cursor_create(mem_ctx, domain, SYSDB_ENUM_CURSOR_AUTOFS,
+                                   mapdn, LDB_SCOPE_ONELEVEL, filter,
+                                   _cursor);
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t
+sysdb_get_autofsentry(TALLOC_CTX *mem_ctx,
+                      struct sss_domain_info *domain,
+                      const char *mapname,
+                      const char *key,
+                      struct ldb_message **_entry)
+{
+    errno_t ret;
+    TALLOC_CTX *tmp_ctx;
+    char *safe_key;
+    char *filter;
+    const char *attrs[] = { SYSDB_AUTOFS_ENTRY_KEY,
+                            SYSDB_AUTOFS_ENTRY_VALUE,
+                            NULL };
+    size_t count;
+    struct ldb_message **msgs;
+    struct ldb_dn *mapdn;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Getting entry [%s] of map %s\n", key, mapname);
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    mapdn = sysdb_autofsmap_dn(tmp_ctx, domain, mapname);
+    if (!mapdn) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_filter_sanitize(tmp_ctx, key, &safe_key);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    filter = talloc_asprintf(tmp_ctx, "(&(objectclass=%s)(%s=%s))",
+                             SYSDB_AUTOFS_ENTRY_OC, SYSDB_AUTOFS_ENTRY_KEY,
+                             safe_key);
+    if (!filter) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_search_entry(tmp_ctx, domain->sysdb, mapdn, LDB_SCOPE_ONELEVEL,
+                             filter, attrs, &count, &msgs);
+    if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_OP_FAILURE, "sysdb search failed: %d\n", ret);
+        goto done;
+    } else if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC, "No entry [%s] in the map\n", key);
+        goto done;
+    }
+
+    if (count > 1) {
+        /* the same key may be defined more times, the first one wins */
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Key [%s] found %zu times in map %s\n", key, count, mapname);
+    }
+
+    *_entry = talloc_steal(mem_ctx, msgs[0]);
+    ret = EOK;
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 errno_t
 sysdb_set_autofsmap_attr(struct sss_domain_info *domain,
                          const char *name,
@@ -70,6 +70,22 @@ sysdb_autofs_entries_by_map(TALLOC_CTX *mem_ctx,
                             size_t *_count,
                             struct ldb_message ***_entries);
 
+/* Enumerates the entries of the map a page at a time, see
+ * sysdb_enum_cursor_read() */
+errno_t
+sysdb_autofs_entries_cursor(TALLOC_CTX *mem_ctx,
+                            struct sss_domain_info *domain,
+                            const char *mapname,
+                            struct sysdb_enum_cursor **_cursor);
+
+/* Returns ENOENT if the map has no entry with this key */
+errno_t
+sysdb_get_autofsentry(TALLOC_CTX *mem_ctx,
+                      struct sss_domain_info *domain,
+                      const char *mapname,
+                      const char *key,
+                      struct ldb_message **_entry);
+
 errno_t
 sysdb_set_autofsmap_attr(struct sss_domain_info *domain,
                          const char *name,
@@ -0,0 +1,241 @@
+/*
+    SSSD
+
+    Size report and compaction of the cache files
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <tdb.h>
+
+#include "util/util.h"
+#include "db/sysdb_private.h"
+
+/* The cache files are tdb files which never shrink, the space of deleted
+ * and rewritten records is only reused through the free list. These
+ * functions work on the files directly, tdb refuses to open a file twice
+ * in a process so the caller must not have the cache open itself. */
+
+/* the hash size ldb uses for new files */
+#define SYSDB_COMPACT_HASH_SIZE 10000
+
+static int sysdb_cache_stats_cb(struct tdb_context *tdb,
+                                TDB_DATA key, TDB_DATA data,
+                                void *pvt)
+{
+    struct sysdb_cache_stats *stats = pvt;
+
+    stats->records++;
+    stats->data_size += key.dsize + data.dsize;
+    return 0;
+}
+
+errno_t sysdb_cache_file_stats(const char *ldb_file,
+                               struct sysdb_cache_stats *stats)
+{
+    struct tdb_context *tdb;
+    struct stat st;
+    errno_t ret;
+
+    memset(stats, 0, sizeof(struct sysdb_cache_stats));
+
+    tdb = tdb_open(ldb_file, 0, TDB_DEFAULT, O_RDONLY, 0);
+    if (tdb == NULL) {
+        ret = errno ? errno : EIO;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s]: %d [%s]\n",
+              ldb_file, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = fstat(tdb_fd(tdb), &st);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+    stats->file_size = st.st_size;
+
+    if (tdb_traverse_read(tdb, sysdb_cache_stats_cb, stats) == -1) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot read [%s]: %s\n",
+              ldb_file, tdb_errorstr(tdb));
+        ret = EIO;
+        goto done;
+    }
+
+    stats->free_records = tdb_freelist_size(tdb);
+    if (stats->free_records == -1) {
+        ret = EIO;
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    tdb_close(tdb);
+    return ret;
+}
+
+static int sysdb_cache_copy_cb(struct tdb_context *tdb,
+                               TDB_DATA key, TDB_DATA data,
+                               void *pvt)
+{
+    struct tdb_context *dst = pvt;
+
+    return tdb_store(dst, key, data, TDB_INSERT);
+}
+
+/* Writes the records into a new file which replaces the cache, only safe
+ * when no other process has the cache open */
+static errno_t sysdb_cache_file_rewrite(const char *ldb_file,
+                                        struct tdb_context *src)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct tdb_context *dst = NULL;
+    struct stat st;
+    char *tmp_path;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    tmp_path = talloc_asprintf(tmp_ctx, "%s.XXXXXX", ldb_file);
+    if (tmp_path == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_unique_filename(NULL, tmp_path);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    dst = tdb_open(tmp_path, SYSDB_COMPACT_HASH_SIZE, TDB_DEFAULT,
+                   O_RDWR | O_CREAT, 0600);
+    if (dst == NULL) {
+        ret = errno ? errno : EIO;
+        goto done;
+    }
+
+    /* the read lock on the whole file keeps the copy consistent */
+    if (tdb_traverse_read(src, sysdb_cache_copy_cb, dst) == -1) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot copy [%s]: %s\n",
+              ldb_file, tdb_errorstr(dst));
+        ret = EIO;
+        goto done;
+    }
+
+    ret = fstat(tdb_fd(src), &st);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    if (fchown(tdb_fd(dst), st.st_uid, st.st_gid) == -1
+            || fchmod(tdb_fd(dst), st.st_mode & 0777) == -1
+            || fsync(tdb_fd(dst)) == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = rename(tmp_path, ldb_file);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    if (dst != NULL) {
+        tdb_close(dst);
+    }
+    if (ret != EOK) {
+        unlink(tmp_path);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_cache_file_compact(const char *ldb_file, bool in_use)
+{
+    struct tdb_context *tdb;
+    errno_t ret;
+
+    /* TDB_SEQNUM so that the other processes notice the change */
+    tdb = tdb_open(ldb_file, 0, TDB_DEFAULT | TDB_SEQNUM, O_RDWR, 0);
+    if (tdb == NULL) {
+        ret = errno ? errno : EIO;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s]: %d [%s]\n",
+              ldb_file, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    if (in_use) {
+        /* The other processes cannot switch to a new file. Repacking in a
+         * transaction rewrites the records at the start of the file and
+         * leaves a single free record, the file keeps its size. */
+        if (tdb_repack(tdb) != 0) {
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot repack [%s]: %s\n",
+                  ldb_file, tdb_errorstr(tdb));
+            ret = EIO;
+        } else {
+            ret = EOK;
+        }
+    } else {
+        ret = sysdb_cache_file_rewrite(ldb_file, tdb);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot rewrite [%s]: %d [%s]\n",
+                  ldb_file, ret, sss_strerror(ret));
+        }
+    }
+
+    tdb_close(tdb);
+    return ret;
+}
+
+errno_t sysdb_get_cache_files(TALLOC_CTX *mem_ctx,
+                              struct sss_domain_info *domain,
+                              const char *db_path,
+                              char **_ldb_file,
+                              char **_ts_file)
+{
+    char *ldb_file;
+    char *ts_file = NULL;
+    errno_t ret;
+
+    ret = sysdb_get_db_file(mem_ctx, domain->provider, domain->name, db_path,
+                            &ldb_file);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    /* the local domain has no timestamp cache */
+    if (strcasecmp(domain->provider, "local") != 0) {
+        ts_file = talloc_asprintf(mem_ctx, "%s/"CACHE_TIMESTAMPS_FILE,
+                                  db_path, domain->name);
+        if (ts_file == NULL) {
+            talloc_free(ldb_file);
+            return ENOMEM;
+        }
+    }
+
+    *_ldb_file = ldb_file;
+    *_ts_file = ts_file;
+    return EOK;
+}
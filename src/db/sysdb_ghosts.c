@@ -0,0 +1,764 @@
+/*
+   SSSD
+
+   System Database - ghost members of groups
+
+   Copyright (C) Red Hat 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/util.h"
+#include "util/murmurhash3.h"
+#include "util/strtonum.h"
+#include "db/sysdb_private.h"
+
+/* The ghost members of a group, the members which are not cached as users,
+ * are not kept in the group entry. ldb rewrites a whole entry on every
+ * change, so a group with many thousands of ghost members was rewritten,
+ * and passed through the memberof plugin, for each member added or
+ * removed. The ghost members are split by a hash of their names among up
+ * to SYSDB_GHOST_BUCKETS entries below SYSDB_GHOSTS_CONTAINER of the domain
+ * and a change rewrites only the entries of the names it touches.
+ *
+ * Only the direct ghost members are stored, a group read with the
+ * SYSDB_GHOST attribute gets those of the groups nested in it as well. */
+
+static int sysdb_ghost_val_cmp(const void *a, const void *b)
+{
+    const struct ldb_val *va = a;
+    const struct ldb_val *vb = b;
+    int ret;
+
+    ret = memcmp(va->data, vb->data, MIN(va->length, vb->length));
+    if (ret != 0) {
+        return ret;
+    }
+
+    return va->length < vb->length ? -1 : va->length > vb->length;
+}
+
+/* Sorts the values and drops the duplicates, the buckets are stored sorted
+ * so that they are compared in linear time */
+static void sysdb_ghost_sort(struct ldb_message_element *el)
+{
+    unsigned int i;
+    unsigned int n;
+
+    if (el->num_values < 2) {
+        return;
+    }
+
+    qsort(el->values, el->num_values, sizeof(struct ldb_val),
+          sysdb_ghost_val_cmp);
+
+    for (i = 1, n = 1; i < el->num_values; i++) {
+        if (sysdb_ghost_val_cmp(&el->values[n - 1], &el->values[i]) != 0) {
+            el->values[n] = el->values[i];
+            n++;
+        }
+    }
+    el->num_values = n;
+}
+
+static bool sysdb_ghost_el_equal(struct ldb_message_element *a,
+                                 struct ldb_message_element *b)
+{
+    unsigned int i;
+
+    if (a == NULL || b == NULL || a->num_values != b->num_values) {
+        return false;
+    }
+
+    for (i = 0; i < a->num_values; i++) {
+        if (sysdb_ghost_val_cmp(&a->values[i], &b->values[i]) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static unsigned int sysdb_ghost_bucket(const struct ldb_val *name)
+{
+    return murmurhash3((const char *)name->data, name->length, 0)
+           % SYSDB_GHOST_BUCKETS;
+}
+
+/* cn=<bucket>,cn=<group name>,cn=ghosts,cn=<domain>,cn=sysdb */
+static struct ldb_dn *sysdb_ghost_bucket_dn(TALLOC_CTX *mem_ctx,
+                                            struct ldb_dn *group_dn,
+                                            unsigned int bucket)
+{
+    const struct ldb_val *rdn;
+    struct ldb_dn *groups_dn;
+    struct ldb_dn *dn;
+    char *name;
+
+    rdn = ldb_dn_get_rdn_val(group_dn);
+    if (rdn == NULL || ldb_dn_get_comp_num(group_dn) < 3) {
+        return NULL;
+    }
+
+    groups_dn = ldb_dn_get_parent(mem_ctx, group_dn);
+    if (groups_dn == NULL) {
+        return NULL;
+    }
+
+    dn = ldb_dn_get_parent(mem_ctx, groups_dn);
+    talloc_free(groups_dn);
+    if (dn == NULL) {
+        return NULL;
+    }
+
+    name = ldb_dn_escape_value(dn, *rdn);
+    if (name == NULL
+            || !ldb_dn_add_child_fmt(dn, "cn=%u,cn=%s,"SYSDB_GHOSTS_CONTAINER,
+                                     bucket, name)) {
+        talloc_free(dn);
+        return NULL;
+    }
+
+    return dn;
+}
+
+static int sysdb_ghost_bucket_of(struct ldb_message *msg)
+{
+    const struct ldb_val *rdn;
+    char *endptr;
+    uint32_t bucket;
+
+    rdn = ldb_dn_get_rdn_val(msg->dn);
+    if (rdn == NULL) {
+        return -1;
+    }
+
+    errno = 0;
+    bucket = strtouint32((const char *)rdn->data, &endptr, 10);
+    if (errno != 0 || *endptr != '\0' || bucket >= SYSDB_GHOST_BUCKETS) {
+        return -1;
+    }
+
+    return bucket;
+}
+
+/* Returns the buckets of all the groups in @group_dns */
+static errno_t sysdb_ghost_buckets(TALLOC_CTX *mem_ctx,
+                                   struct ldb_context *ldb,
+                                   struct ldb_dn **group_dns,
+                                   size_t num_groups,
+                                   struct ldb_result **_res)
+{
+    TALLOC_CTX *tmp_ctx;
+    static const char *attrs[] = { SYSDB_GHOST_NAME, SYSDB_GHOST_GROUP,
+                                   NULL };
+    struct ldb_result *res;
+    struct ldb_dn *base_dn;
+    char *sanitized;
+    char *filter;
+    size_t i;
+    int lret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    filter = talloc_strdup(tmp_ctx, "(|");
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_groups; i++) {
+        ret = sss_filter_sanitize(tmp_ctx, ldb_dn_get_linearized(group_dns[i]),
+                                  &sanitized);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        filter = talloc_asprintf_append(filter, "(%s=%s)",
+                                        SYSDB_GHOST_GROUP, sanitized);
+        if (filter == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    filter = talloc_asprintf_append(filter, ")");
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    base_dn = ldb_dn_new(tmp_ctx, ldb, SYSDB_BASE);
+    if (base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_search(ldb, tmp_ctx, &res, base_dn, LDB_SCOPE_SUBTREE, attrs,
+                      "%s", filter);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    *_res = talloc_steal(mem_ctx, res);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t sysdb_ghost_bucket_write(struct sysdb_ctx *sysdb,
+                                        struct ldb_dn *group_dn,
+                                        unsigned int bucket,
+                                        struct ldb_message *old,
+                                        struct ldb_message_element *el,
+                                        int mod_op)
+{
+    struct ldb_message *msg;
+    int lret;
+    errno_t ret;
+
+    if (el->num_values == 0) {
+        if (mod_op != SYSDB_MOD_REP || old == NULL) {
+            return EOK;
+        }
+
+        lret = ldb_delete(sysdb->ldb, old->dn);
+        return sysdb_error_to_errno(lret);
+    }
+
+    if (old == NULL && mod_op == SYSDB_MOD_DEL) {
+        return EOK;
+    }
+
+    if (old != NULL && mod_op == SYSDB_MOD_REP
+            && sysdb_ghost_el_equal(ldb_msg_find_element(old,
+                                                         SYSDB_GHOST_NAME),
+                                    el)) {
+        return EOK;
+    }
+
+    msg = ldb_msg_new(NULL);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    if (old == NULL) {
+        msg->dn = sysdb_ghost_bucket_dn(msg, group_dn, bucket);
+        if (msg->dn == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        lret = ldb_msg_add_string(msg, SYSDB_GHOST_GROUP,
+                                  ldb_dn_get_linearized(group_dn));
+        if (lret == LDB_SUCCESS) {
+            lret = ldb_msg_add(msg, el, 0);
+        }
+        if (lret == LDB_SUCCESS) {
+            lret = ldb_add(sysdb->ldb, msg);
+        }
+    } else {
+        msg->dn = old->dn;
+
+        lret = ldb_msg_add(msg, el, mod_op);
+        if (lret == LDB_SUCCESS) {
+            /* values already present or missing are skipped */
+            lret = sss_ldb_modify_permissive(sysdb->ldb, msg);
+        }
+    }
+
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to write the ghost members [%s](%d)[%s]\n",
+              ldb_strerror(lret), lret, ldb_errstring(sysdb->ldb));
+    }
+    ret = sysdb_error_to_errno(lret);
+
+done:
+    talloc_free(msg);
+    return ret;
+}
+
+errno_t sysdb_ghosts_modify(struct sysdb_ctx *sysdb,
+                            struct ldb_dn *group_dn,
+                            struct ldb_message_element *el,
+                            int mod_op)
+{
+    TALLOC_CTX *tmp_ctx;
+    static const char *attrs[] = { SYSDB_OBJECTCLASS, NULL };
+    struct ldb_message *old[SYSDB_GHOST_BUCKETS] = { NULL };
+    struct ldb_message_element *buckets;
+    struct ldb_result *res;
+    unsigned int b;
+    unsigned int i;
+    int bucket;
+    int lret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    lret = ldb_search(sysdb->ldb, tmp_ctx, &res, group_dn, LDB_SCOPE_BASE,
+                      attrs, NULL);
+    if (lret == LDB_ERR_NO_SUCH_OBJECT || (lret == LDB_SUCCESS
+                                           && res->count == 0)) {
+        ret = ENOENT;
+        goto done;
+    } else if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    ret = sysdb_ghost_buckets(tmp_ctx, sysdb->ldb, &group_dn, 1, &res);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (mod_op == SYSDB_MOD_DEL && el->num_values == 0) {
+        /* all of them */
+        for (i = 0; i < res->count; i++) {
+            lret = ldb_delete(sysdb->ldb, res->msgs[i]->dn);
+            if (lret != LDB_SUCCESS) {
+                ret = sysdb_error_to_errno(lret);
+                goto done;
+            }
+        }
+
+        ret = EOK;
+        goto done;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        bucket = sysdb_ghost_bucket_of(res->msgs[i]);
+        if (bucket < 0) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Unexpected entry [%s]\n",
+                  ldb_dn_get_linearized(res->msgs[i]->dn));
+            continue;
+        }
+        old[bucket] = res->msgs[i];
+    }
+
+    buckets = talloc_zero_array(tmp_ctx, struct ldb_message_element,
+                                SYSDB_GHOST_BUCKETS);
+    if (buckets == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < el->num_values; i++) {
+        buckets[sysdb_ghost_bucket(&el->values[i])].num_values++;
+    }
+
+    for (b = 0; b < SYSDB_GHOST_BUCKETS; b++) {
+        buckets[b].name = SYSDB_GHOST_NAME;
+        buckets[b].values = talloc_array(buckets, struct ldb_val,
+                                         buckets[b].num_values);
+        if (buckets[b].values == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        buckets[b].num_values = 0;
+    }
+
+    /* the values are shared with @el */
+    for (i = 0; i < el->num_values; i++) {
+        b = sysdb_ghost_bucket(&el->values[i]);
+        buckets[b].values[buckets[b].num_values] = el->values[i];
+        buckets[b].num_values++;
+    }
+
+    for (b = 0; b < SYSDB_GHOST_BUCKETS; b++) {
+        sysdb_ghost_sort(&buckets[b]);
+
+        ret = sysdb_ghost_bucket_write(sysdb, group_dn, b, old[b],
+                                       &buckets[b], mod_op);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_ghosts_delete(struct sysdb_ctx *sysdb,
+                            struct ldb_dn *group_dn)
+{
+    struct ldb_result *res;
+    unsigned int i;
+    int lret;
+    errno_t ret;
+
+    ret = sysdb_ghost_buckets(NULL, sysdb->ldb, &group_dn, 1, &res);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        lret = ldb_delete(sysdb->ldb, res->msgs[i]->dn);
+        if (lret != LDB_SUCCESS && lret != LDB_ERR_NO_SUCH_OBJECT) {
+            ret = sysdb_error_to_errno(lret);
+            break;
+        }
+    }
+
+    talloc_free(res);
+    return ret;
+}
+
+errno_t sysdb_ghosts_remove_names(TALLOC_CTX *mem_ctx,
+                                  struct sysdb_ctx *sysdb,
+                                  struct ldb_dn *base_dn,
+                                  const char **names,
+                                  struct ldb_dn ***_group_dns,
+                                  size_t *_num_groups)
+{
+    TALLOC_CTX *tmp_ctx;
+    static const char *attrs[] = { SYSDB_GHOST_GROUP, NULL };
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    struct ldb_dn **group_dns;
+    size_t num_groups = 0;
+    const char *group;
+    char *sanitized;
+    char *filter;
+    size_t i;
+    size_t j;
+    int lret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_msg_add_empty(msg, SYSDB_GHOST_NAME, LDB_FLAG_MOD_DELETE,
+                             NULL);
+    if (lret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    filter = talloc_strdup(tmp_ctx, "(|");
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; names[i] != NULL; i++) {
+        ret = sss_filter_sanitize(tmp_ctx, names[i], &sanitized);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        filter = talloc_asprintf_append(filter, "(%s=%s)",
+                                        SYSDB_GHOST_NAME, sanitized);
+        if (filter == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        lret = ldb_msg_add_string(msg, SYSDB_GHOST_NAME, names[i]);
+        if (lret != LDB_SUCCESS) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    filter = talloc_asprintf_append(filter, ")");
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_search(sysdb->ldb, tmp_ctx, &res, base_dn, LDB_SCOPE_SUBTREE,
+                      attrs, "%s", filter);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    group_dns = talloc_zero_array(tmp_ctx, struct ldb_dn *, res->count + 1);
+    if (group_dns == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        msg->dn = res->msgs[i]->dn;
+
+        /* the names which are not in this bucket are skipped */
+        lret = sss_ldb_modify_permissive(sysdb->ldb, msg);
+        if (lret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "sss_ldb_modify_permissive failed: [%s](%d)[%s]\n",
+                  ldb_strerror(lret), lret, ldb_errstring(sysdb->ldb));
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+
+        group = ldb_msg_find_attr_as_string(res->msgs[i], SYSDB_GHOST_GROUP,
+                                            NULL);
+        if (group == NULL) {
+            continue;
+        }
+
+        /* a name and its alias may be in different buckets of a group */
+        for (j = 0; j < num_groups; j++) {
+            if (strcasecmp(ldb_dn_get_linearized(group_dns[j]), group) == 0) {
+                break;
+            }
+        }
+        if (j < num_groups) {
+            continue;
+        }
+
+        group_dns[num_groups] = ldb_dn_new(group_dns, sysdb->ldb, group);
+        if (group_dns[num_groups] == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        num_groups++;
+    }
+
+    if (_group_dns != NULL) {
+        *_group_dns = talloc_steal(mem_ctx, group_dns);
+    }
+    if (_num_groups != NULL) {
+        *_num_groups = num_groups;
+    }
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_ghosts_split(TALLOC_CTX *mem_ctx,
+                           struct sysdb_attrs *attrs,
+                           struct sysdb_attrs **_rest,
+                           struct ldb_message_element **_ghosts)
+{
+    struct sysdb_attrs *rest;
+    struct ldb_message_element *ghosts = NULL;
+    int i;
+
+    rest = sysdb_new_attrs(mem_ctx);
+    if (rest == NULL) {
+        return ENOMEM;
+    }
+
+    rest->a = talloc_array(rest, struct ldb_message_element, attrs->num);
+    if (rest->a == NULL) {
+        talloc_free(rest);
+        return ENOMEM;
+    }
+
+    for (i = 0; i < attrs->num; i++) {
+        if (strcasecmp(attrs->a[i].name, SYSDB_GHOST) == 0) {
+            ghosts = &attrs->a[i];
+            continue;
+        }
+
+        rest->a[rest->num] = attrs->a[i];
+        rest->num++;
+    }
+
+    *_rest = rest;
+    *_ghosts = ghosts;
+    return EOK;
+}
+
+bool sysdb_ghosts_requested(const char **attrs)
+{
+    int i;
+
+    for (i = 0; attrs != NULL && attrs[i] != NULL; i++) {
+        if (strcasecmp(attrs[i], SYSDB_GHOST) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static errno_t sysdb_ghosts_merge_msg(struct ldb_context *ldb,
+                                      struct ldb_message *msg)
+{
+    TALLOC_CTX *tmp_ctx;
+    static const char *attrs[] = { SYSDB_OBJECTCLASS, NULL };
+    struct ldb_message_element all = { 0 };
+    struct ldb_message_element *el;
+    struct ldb_result *nested;
+    struct ldb_result *res;
+    struct ldb_dn **group_dns;
+    struct ldb_dn *base_dn;
+    const char *class;
+    char *sanitized;
+    unsigned int i;
+    unsigned int j;
+    int lret;
+    errno_t ret;
+
+    class = ldb_msg_find_attr_as_string(msg, SYSDB_OBJECTCLASS, NULL);
+    if (class != NULL && strcasecmp(class, SYSDB_GROUP_CLASS) != 0) {
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    base_dn = ldb_dn_new(tmp_ctx, ldb, SYSDB_BASE);
+    if (base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_filter_sanitize(tmp_ctx, ldb_dn_get_linearized(msg->dn),
+                              &sanitized);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    /* the groups nested in this one at any depth */
+    lret = ldb_search(ldb, tmp_ctx, &nested, base_dn, LDB_SCOPE_SUBTREE,
+                      attrs, "(&(%s)(%s=%s))", SYSDB_GC, SYSDB_MEMBEROF,
+                      sanitized);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    group_dns = talloc_array(tmp_ctx, struct ldb_dn *, nested->count + 1);
+    if (group_dns == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    group_dns[0] = msg->dn;
+    for (i = 0; i < nested->count; i++) {
+        group_dns[i + 1] = nested->msgs[i]->dn;
+    }
+
+    ret = sysdb_ghost_buckets(tmp_ctx, ldb, group_dns, nested->count + 1,
+                              &res);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        el = ldb_msg_find_element(res->msgs[i], SYSDB_GHOST_NAME);
+        if (el != NULL) {
+            all.num_values += el->num_values;
+        }
+    }
+
+    all.values = talloc_array(tmp_ctx, struct ldb_val, all.num_values);
+    if (all.values == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    all.num_values = 0;
+
+    for (i = 0; i < res->count; i++) {
+        el = ldb_msg_find_element(res->msgs[i], SYSDB_GHOST_NAME);
+        for (j = 0; el != NULL && j < el->num_values; j++) {
+            all.values[all.num_values] = el->values[j];
+            all.num_values++;
+        }
+    }
+
+    /* a user may be a ghost member of several of the groups */
+    sysdb_ghost_sort(&all);
+
+    ldb_msg_remove_attr(msg, SYSDB_GHOST);
+    if (all.num_values == 0) {
+        ret = EOK;
+        goto done;
+    }
+
+    lret = ldb_msg_add_empty(msg, SYSDB_GHOST, 0, &el);
+    if (lret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    el->values = talloc_array(msg->elements, struct ldb_val, all.num_values);
+    if (el->values == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < all.num_values; i++) {
+        el->values[i] = ldb_val_dup(el->values, &all.values[i]);
+        if (el->values[i].data == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        el->num_values++;
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_ghosts_merge_ldb(struct ldb_context *ldb,
+                               size_t count,
+                               struct ldb_message **msgs)
+{
+    size_t i;
+    errno_t ret;
+
+    for (i = 0; i < count; i++) {
+        ret = sysdb_ghosts_merge_msg(ldb, msgs[i]);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Unable to read the ghost members of [%s] [%d]: %s\n",
+                  ldb_dn_get_linearized(msgs[i]->dn), ret, sss_strerror(ret));
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_ghosts_merge_msgs(struct sysdb_ctx *sysdb,
+                                size_t count,
+                                struct ldb_message **msgs)
+{
+    return sysdb_ghosts_merge_ldb(sysdb->ldb, count, msgs);
+}
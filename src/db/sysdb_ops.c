@@ -24,7 +24,6 @@
 #include "db/sysdb_services.h"
 #include "db/sysdb_autofs.h"
 #include "util/crypto/sss_crypto.h"
-#include "util/cert.h"
 #include <time.h>
 
 int add_string(struct ldb_message *msg, int flags,
@@ -132,7 +131,10 @@ int sysdb_delete_entry(struct sysdb_ctx *sysdb,
     ret = ldb_delete(sysdb->ldb, dn);
     switch (ret) {
     case LDB_SUCCESS:
-        return EOK;
+        /* a left over timestamp entry is ignored anyway */
+        sysdb_ts_delete_entry(sysdb, dn);
+        /* but the ghost members would show up in a new group of the name */
+        return sysdb_ghosts_delete(sysdb, dn);
     case LDB_ERR_NO_SUCH_OBJECT:
         if (ignore_not_found) {
             return EOK;
@@ -231,11 +233,8 @@ int sysdb_search_entry(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(sysdb->ldb, tmp_ctx, &res,
-                     base_dn, scope, attrs,
-                     filter?"%s":NULL, filter);
+    ret = sysdb_ts_search(tmp_ctx, sysdb, base_dn, scope, filter, attrs, &res);
     if (ret != EOK) {
-        ret = sysdb_error_to_errno(ret);
         goto done;
     }
 
@@ -483,6 +482,7 @@ int sysdb_search_user_by_upn_res(TALLOC_CTX *mem_ctx,
     TALLOC_CTX *tmp_ctx;
     struct ldb_result *res;
     struct ldb_dn *base_dn;
+    char *filter;
     int ret;
     const char *def_attrs[] = { SYSDB_NAME, SYSDB_UPN, SYSDB_CANONICAL_UPN,
                                 NULL };
@@ -499,11 +499,15 @@ int sysdb_search_user_by_upn_res(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res,
-                     base_dn, LDB_SCOPE_SUBTREE, attrs ? attrs : def_attrs,
-                     SYSDB_PWUPN_FILTER, upn, upn);
+    filter = talloc_asprintf(tmp_ctx, SYSDB_PWUPN_FILTER, upn, upn);
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_ts_search(tmp_ctx, domain->sysdb, base_dn, LDB_SCOPE_SUBTREE,
+                          filter, attrs ? attrs : def_attrs, &res);
     if (ret != EOK) {
-        ret = sysdb_error_to_errno(ret);
         goto done;
     }
 
@@ -687,12 +691,109 @@ done:
     return ret;
 }
 
+/* =Certificate-Hashes==================================================== */
+
+errno_t sysdb_cert_hash(TALLOC_CTX *mem_ctx,
+                        const uint8_t *der, size_t der_len,
+                        char **_hash)
+{
+    unsigned char digest[SSS_SHA256_LENGTH];
+    char *hash;
+    size_t i;
+    int ret;
+
+    ret = sss_sha256(der, der_len, digest);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "sss_sha256 failed.\n");
+        return ret;
+    }
+
+    hash = talloc_array(mem_ctx, char, 2 * SSS_SHA256_LENGTH + 1);
+    if (hash == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < SSS_SHA256_LENGTH; i++) {
+        snprintf(hash + 2 * i, 3, "%02x", digest[i]);
+    }
+
+    *_hash = hash;
+    return EOK;
+}
+
+/* Adds to the modify message the change of the certificate hashes matching
+ * the change of the certificates in it */
+static errno_t sysdb_msg_add_cert_hashes(struct ldb_message *msg)
+{
+    struct ldb_message_element *certs;
+    struct ldb_message_element *el;
+    struct ldb_val *values = NULL;
+    unsigned int num_values;
+    unsigned int flags;
+    unsigned int i;
+    char *hash;
+    errno_t ret;
+
+    certs = ldb_msg_find_element(msg, SYSDB_USER_CERT);
+    if (certs == NULL
+            || ldb_msg_find_element(msg, SYSDB_USER_CERT_HASH) != NULL) {
+        return EOK;
+    }
+
+    flags = certs->flags;
+    num_values = certs->num_values;
+
+    /* the entries stored before the hashes were indexed might miss them,
+     * removing all of them must not fail the modify */
+    if (LDB_FLAG_MOD_TYPE(flags) == LDB_FLAG_MOD_DELETE && num_values == 0) {
+        flags = LDB_FLAG_MOD_REPLACE;
+    }
+
+    if (num_values > 0) {
+        values = talloc_array(msg, struct ldb_val, num_values);
+        if (values == NULL) {
+            return ENOMEM;
+        }
+
+        for (i = 0; i < num_values; i++) {
+            ret = sysdb_cert_hash(values, certs->values[i].data,
+                                  certs->values[i].length, &hash);
+            if (ret != EOK) {
+                talloc_free(values);
+                return ret;
+            }
+
+            values[i].data = (uint8_t *) hash;
+            values[i].length = 2 * SSS_SHA256_LENGTH;
+        }
+    }
+
+    /* certs points into the array which is reallocated */
+    el = talloc_realloc(msg, msg->elements, struct ldb_message_element,
+                        msg->num_elements + 1);
+    if (el == NULL) {
+        talloc_free(values);
+        return ENOMEM;
+    }
+    msg->elements = el;
+
+    el = &msg->elements[msg->num_elements];
+    el->name = SYSDB_USER_CERT_HASH;
+    el->flags = flags;
+    el->num_values = num_values;
+    el->values = values;
+    msg->num_elements++;
+
+    return EOK;
+}
+
 /* =Replace-Attributes-On-Entry=========================================== */
 
-int sysdb_set_entry_attr(struct sysdb_ctx *sysdb,
-                         struct ldb_dn *entry_dn,
-                         struct sysdb_attrs *attrs,
-                         int mod_op)
+static int sysdb_set_entry_attr_internal(struct sysdb_ctx *sysdb,
+                                         struct ldb_dn *entry_dn,
+                                         struct sysdb_attrs *attrs,
+                                         int mod_op,
+                                         bool use_ts)
 {
     struct ldb_message *msg;
     int i, ret;
@@ -730,6 +831,20 @@ int sysdb_set_entry_attr(struct sysdb_ctx *sysdb,
 
     msg->num_elements = attrs->num;
 
+    ret = sysdb_msg_add_cert_hashes(msg);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (use_ts) {
+        ret = sysdb_ts_modify(sysdb, msg, NULL);
+        if (ret != EOK && ret != ENOENT) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_ts_modify failed: [%s]\n",
+                  ldb_errstring(sysdb->ldb));
+        }
+        goto done;
+    }
+
     lret = ldb_modify(sysdb->ldb, msg);
     if (lret != LDB_SUCCESS) {
         DEBUG(SSSDBG_MINOR_FAILURE,
@@ -750,6 +865,15 @@ done:
     return ret;
 }
 
+int sysdb_set_entry_attr(struct sysdb_ctx *sysdb,
+                         struct ldb_dn *entry_dn,
+                         struct sysdb_attrs *attrs,
+                         int mod_op)
+{
+    return sysdb_set_entry_attr_internal(sysdb, entry_dn, attrs, mod_op,
+                                         false);
+}
+
 
 /* =Replace-Attributes-On-User============================================ */
 
@@ -773,7 +897,8 @@ int sysdb_set_user_attr(struct sss_domain_info *domain,
         goto done;
     }
 
-    ret = sysdb_set_entry_attr(domain->sysdb, dn, attrs, mod_op);
+    ret = sysdb_set_entry_attr_internal(domain->sysdb, dn, attrs, mod_op,
+                                        true);
     if (ret != EOK) {
         goto done;
     }
@@ -784,17 +909,194 @@ done:
     return ret;
 }
 
+errno_t sysdb_update_initgr_gids(struct sss_domain_info *domain,
+                                 const char *name)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    struct sysdb_attrs *attrs;
+    const char *posix;
+    const char *sep = "";
+    char *str;
+    gid_t gid;
+    size_t i;
+    errno_t ret;
+
+    /* the list would miss the overridden GIDs, see sysdb_initgroups_gids() */
+    if (DOM_HAS_VIEWS(domain)) {
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_initgroups(tmp_ctx, domain, name, &res);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (res->count == 0) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    str = talloc_asprintf(tmp_ctx, "%d:", SYSDB_INITGR_GIDS_VERSION);
+    if (str == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* the first entry is the user, the same rules as in the NSS responder
+     * apply to the groups */
+    for (i = 1; i < res->count; i++) {
+        gid = ldb_msg_find_attr_as_uint64(res->msgs[i], SYSDB_GIDNUM, 0);
+        if (gid == 0) {
+            posix = ldb_msg_find_attr_as_string(res->msgs[i], SYSDB_POSIX,
+                                                NULL);
+            if (posix != NULL && strcmp(posix, "FALSE") == 0) {
+                continue;
+            }
+
+            DEBUG(SSSDBG_TRACE_FUNC, "Incomplete group [%s], not storing "
+                  "the groups of [%s]\n",
+                  ldb_dn_get_linearized(res->msgs[i]->dn), name);
+            ret = EOK;
+            goto done;
+        }
+
+        str = talloc_asprintf_append(str, "%s%"SPRIgid, sep, gid);
+        if (str == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        sep = ",";
+    }
+
+    attrs = sysdb_new_attrs(tmp_ctx);
+    if (attrs == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_INITGR_GIDS, str);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_set_entry_attr(domain->sysdb, res->msgs[0]->dn, attrs,
+                               SYSDB_MOD_REP);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 
 /* =Replace-Attributes-On-Group=========================================== */
 
+/* The memberof plugin drops the precomputed initgroups result of the users
+ * whose memberships change, changing the GID or the POSIX status of a group
+ * has to drop it for all its members. */
+static bool sysdb_initgr_gids_affected(struct sysdb_attrs *attrs)
+{
+    size_t i;
+
+    for (i = 0; i < attrs->num; i++) {
+        if (strcasecmp(attrs->a[i].name, SYSDB_GIDNUM) == 0
+                || strcasecmp(attrs->a[i].name, SYSDB_POSIX) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static errno_t sysdb_invalidate_initgr_gids(struct sysdb_ctx *sysdb,
+                                            struct ldb_dn *group_dn)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    struct ldb_message *msg;
+    struct ldb_dn *base_dn;
+    char *sanitized;
+    static const char *attrs[] = { SYSDB_NAME, NULL };
+    size_t i;
+    errno_t ret;
+    int lret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    base_dn = ldb_dn_new(tmp_ctx, sysdb->ldb, SYSDB_BASE);
+    if (base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_filter_sanitize(tmp_ctx, ldb_dn_get_linearized(group_dn),
+                              &sanitized);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    lret = ldb_search(sysdb->ldb, tmp_ctx, &res, base_dn, LDB_SCOPE_SUBTREE,
+                      attrs, "(&("SYSDB_UC")("SYSDB_MEMBEROF"=%s)("
+                      SYSDB_INITGR_GIDS"=*))", sanitized);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        msg = ldb_msg_new(tmp_ctx);
+        if (msg == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        msg->dn = res->msgs[i]->dn;
+
+        lret = ldb_msg_add_empty(msg, SYSDB_INITGR_GIDS, LDB_FLAG_MOD_DELETE,
+                                 NULL);
+        if (lret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+
+        lret = ldb_modify(sysdb->ldb, msg);
+        if (lret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot drop %s of [%s]: [%s]\n",
+                  SYSDB_INITGR_GIDS, ldb_dn_get_linearized(msg->dn),
+                  ldb_errstring(sysdb->ldb));
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+        talloc_free(msg);
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 int sysdb_set_group_attr(struct sss_domain_info *domain,
                          const char *name,
                          struct sysdb_attrs *attrs,
                          int mod_op)
 {
     struct ldb_dn *dn;
+    struct sysdb_attrs *rest;
+    struct ldb_message_element *ghosts;
     TALLOC_CTX *tmp_ctx;
+    bool in_transaction = false;
+    bool invalidate;
     errno_t ret;
+    errno_t sret;
 
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
@@ -808,13 +1110,61 @@ int sysdb_set_group_attr(struct sss_domain_info *domain,
         goto done;
     }
 
-    ret = sysdb_set_entry_attr(domain->sysdb, dn, attrs, mod_op);
+    /* the ghost members are not stored in the group entry */
+    ret = sysdb_ghosts_split(tmp_ctx, attrs, &rest, &ghosts);
     if (ret) {
         goto done;
     }
 
-    ret = EOK;
+    invalidate = sysdb_initgr_gids_affected(rest);
+
+    if (ghosts == NULL && !invalidate) {
+        ret = sysdb_set_entry_attr_internal(domain->sysdb, dn, attrs, mod_op,
+                                            true);
+        goto done;
+    }
+
+    ret = sysdb_transaction_start(domain->sysdb);
+    if (ret) {
+        goto done;
+    }
+    in_transaction = true;
+
+    if (rest->num > 0) {
+        ret = sysdb_set_entry_attr_internal(domain->sysdb, dn, rest, mod_op,
+                                            true);
+        if (ret) {
+            goto done;
+        }
+    }
+
+    if (ghosts != NULL) {
+        ret = sysdb_ghosts_modify(domain->sysdb, dn, ghosts, mod_op);
+        if (ret) {
+            goto done;
+        }
+    }
+
+    if (invalidate) {
+        ret = sysdb_invalidate_initgr_gids(domain->sysdb, dn);
+        if (ret) {
+            goto done;
+        }
+    }
+
+    ret = sysdb_transaction_commit(domain->sysdb);
+    if (ret) {
+        goto done;
+    }
+    in_transaction = false;
+
 done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
     talloc_free(tmp_ctx);
     return ret;
 }
@@ -848,39 +1198,156 @@ done:
     return ret;
 }
 
-/* =Get-New-ID============================================================ */
+/* =Expire-Entries-in-Bulk================================================ */
 
-int sysdb_get_new_id(struct sss_domain_info *domain,
-                     uint32_t *_id)
+/* Setting SYSDB_CACHE_EXPIRE in the cache is enough to invalidate the
+ * timestamp cache as well, its entries are only used while the
+ * SYSDB_CACHE_EXPIRE they recorded matches the cache. */
+errno_t sysdb_invalidate_cache_entries(struct sss_domain_info *domain,
+                                       struct ldb_dn *base_dn,
+                                       const char *sub_filter,
+                                       bool initgr,
+                                       size_t *_count)
 {
     TALLOC_CTX *tmp_ctx;
-    const char *attrs_1[] = { SYSDB_NEXTID, NULL };
-    const char *attrs_2[] = { SYSDB_UIDNUM, SYSDB_GIDNUM, NULL };
-    struct ldb_dn *base_dn;
-    char *filter;
-    uint32_t new_id = 0;
-    struct ldb_message **msgs;
-    size_t count;
+    struct ldb_result *res;
     struct ldb_message *msg;
-    uint32_t id;
-    int ret;
-    int i;
+    const char *attrs[] = { SYSDB_CACHE_EXPIRE, SYSDB_INITGR_EXPIRE, NULL };
+    bool in_transaction = false;
+    size_t count = 0;
+    unsigned int i;
+    int lret;
+    errno_t ret;
+    errno_t sret;
 
     tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
+    if (tmp_ctx == NULL) {
         return ENOMEM;
     }
 
-    base_dn = sysdb_domain_dn(tmp_ctx, domain);
-    if (!base_dn) {
-        talloc_zfree(tmp_ctx);
-        return ENOMEM;
+    msg = ldb_msg_new(tmp_ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
     }
 
-    ret = ldb_transaction_start(domain->sysdb->ldb);
-    if (ret) {
-        talloc_zfree(tmp_ctx);
-        ret = sysdb_error_to_errno(ret);
+    lret = ldb_msg_add_empty(msg, SYSDB_CACHE_EXPIRE, LDB_FLAG_MOD_REPLACE,
+                             NULL);
+    if (lret == LDB_SUCCESS) {
+        lret = ldb_msg_add_string(msg, SYSDB_CACHE_EXPIRE, "1");
+    }
+    if (lret == LDB_SUCCESS && initgr) {
+        lret = ldb_msg_add_empty(msg, SYSDB_INITGR_EXPIRE,
+                                 LDB_FLAG_MOD_REPLACE, NULL);
+        if (lret == LDB_SUCCESS) {
+            lret = ldb_msg_add_string(msg, SYSDB_INITGR_EXPIRE, "1");
+        }
+    }
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    ret = sysdb_transaction_start(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    lret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                      LDB_SCOPE_SUBTREE, attrs, "%s", sub_filter);
+    if (lret == LDB_ERR_NO_SUCH_OBJECT || (lret == LDB_SUCCESS
+                                           && res->count == 0)) {
+        ret = ENOENT;
+        goto done;
+    } else if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Expiring %u entries below [%s]\n",
+          res->count, ldb_dn_get_linearized(base_dn));
+
+    /* the same modify message is reused for all entries */
+    for (i = 0; i < res->count; i++) {
+        /* entries which are expired already are not written again */
+        if (ldb_msg_find_attr_as_uint64(res->msgs[i],
+                                        SYSDB_CACHE_EXPIRE, 0) == 1
+                && (!initgr || ldb_msg_find_attr_as_uint64(res->msgs[i],
+                                        SYSDB_INITGR_EXPIRE, 0) == 1)) {
+            continue;
+        }
+
+        msg->dn = res->msgs[i]->dn;
+
+        lret = ldb_modify(domain->sysdb->ldb, msg);
+        if (lret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "ldb_modify failed for [%s]: [%s](%d)[%s]\n",
+                  ldb_dn_get_linearized(msg->dn), ldb_strerror(lret), lret,
+                  ldb_errstring(domain->sysdb->ldb));
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+        count++;
+    }
+
+    ret = sysdb_transaction_commit(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    if (_count != NULL) {
+        *_count = count;
+    }
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* =Get-New-ID============================================================ */
+
+int sysdb_get_new_id(struct sss_domain_info *domain,
+                     uint32_t *_id)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char *attrs_1[] = { SYSDB_NEXTID, NULL };
+    const char *attrs_2[] = { SYSDB_UIDNUM, SYSDB_GIDNUM, NULL };
+    struct ldb_dn *base_dn;
+    char *filter;
+    uint32_t new_id = 0;
+    struct ldb_message **msgs;
+    size_t count;
+    struct ldb_message *msg;
+    uint32_t id;
+    int ret;
+    int i;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    base_dn = sysdb_domain_dn(tmp_ctx, domain);
+    if (!base_dn) {
+        talloc_zfree(tmp_ctx);
+        return ENOMEM;
+    }
+
+    ret = ldb_transaction_start(domain->sysdb->ldb);
+    if (ret) {
+        talloc_zfree(tmp_ctx);
+        ret = sysdb_error_to_errno(ret);
         return ret;
     }
 
@@ -1101,15 +1568,15 @@ done:
 
 static errno_t
 sysdb_remove_ghost_from_group(struct sss_domain_info *dom,
-                              struct ldb_message *group,
-                              struct ldb_message_element *alias_el,
-                              const char *name,
+                              struct ldb_dn *group_dn,
                               const char *orig_dn,
                               const char *userdn)
 {
     TALLOC_CTX *tmp_ctx;
+    const char *group_attrs[] = { SYSDB_ORIG_MEMBER, NULL };
     struct ldb_message *msg;
     struct ldb_message_element *orig_members;
+    struct ldb_result *res;
     bool add_member = false;
     errno_t ret = EOK;
     int i;
@@ -1119,20 +1586,22 @@ sysdb_remove_ghost_from_group(struct sss_domain_info *dom,
         return ENOENT;
     }
 
-    msg = ldb_msg_new(tmp_ctx);
-    if (!msg) {
-        ERROR_OUT(ret, ENOMEM, done);
+    ret = ldb_search(dom->sysdb->ldb, tmp_ctx, &res, group_dn,
+                     LDB_SCOPE_BASE, group_attrs, NULL);
+    if (ret == LDB_ERR_NO_SUCH_OBJECT
+            || (ret == LDB_SUCCESS && res->count == 0)) {
+        ERROR_OUT(ret, ENOENT, done);
+    } else if (ret != LDB_SUCCESS) {
+        ERROR_OUT(ret, sysdb_error_to_errno(ret), done);
     }
 
-    msg->dn = group->dn;
-
     if (orig_dn == NULL) {
         /* We have no way of telling which groups this user belongs to.
-         * Add it to all that reference it in the ghost attribute */
+         * Add it to all that reference it as a ghost member */
         add_member = true;
     } else {
         add_member = false;
-        orig_members = ldb_msg_find_element(group, SYSDB_ORIG_MEMBER);
+        orig_members = ldb_msg_find_element(res->msgs[0], SYSDB_ORIG_MEMBER);
         if (orig_members) {
             for (i = 0; i < orig_members->num_values; i++) {
                 if (strcmp((const char *) orig_members->values[i].data,
@@ -1149,26 +1618,20 @@ sysdb_remove_ghost_from_group(struct sss_domain_info *dom,
         }
     }
 
-    if (add_member) {
-        ret = add_string(msg, LDB_FLAG_MOD_ADD, SYSDB_MEMBER, userdn);
-        if (ret) goto done;
+    if (!add_member) {
+        ret = EOK;
+        goto done;
     }
 
-    ret = add_string(msg, LDB_FLAG_MOD_DELETE, SYSDB_GHOST, name);
-    if (ret) goto done;
-
-    /* Delete aliases from the ghost attribute as well */
-    for (i = 0; i < alias_el->num_values; i++) {
-        if (strcmp((const char *)alias_el->values[i].data, name) == 0) {
-            continue;
-        }
-        ret = ldb_msg_add_string(msg, SYSDB_GHOST,
-                (char *) alias_el->values[i].data);
-        if (ret != LDB_SUCCESS) {
-            ERROR_OUT(ret, EINVAL, done);
-        }
+    msg = ldb_msg_new(tmp_ctx);
+    if (!msg) {
+        ERROR_OUT(ret, ENOMEM, done);
     }
 
+    msg->dn = group_dn;
+
+    ret = add_string(msg, LDB_FLAG_MOD_ADD, SYSDB_MEMBER, userdn);
+    if (ret) goto done;
 
     ret = sss_ldb_modify_permissive(dom->sysdb->ldb, msg);
     if (ret != LDB_SUCCESS) {
@@ -1178,12 +1641,6 @@ sysdb_remove_ghost_from_group(struct sss_domain_info *dom,
     }
 
     ret = sysdb_error_to_errno(ret);
-    if (ret != EOK) {
-        goto done;
-    }
-
-    talloc_zfree(msg);
-
 
 done:
     talloc_free(tmp_ctx);
@@ -1197,15 +1654,14 @@ sysdb_remove_ghostattr_from_groups(struct sss_domain_info *domain,
                                    const char *name)
 {
     TALLOC_CTX *tmp_ctx;
-    struct ldb_message **groups;
+    struct ldb_dn **groups;
     struct ldb_message_element *alias_el;
     struct ldb_dn *tmpdn;
-    const char *group_attrs[] = {SYSDB_NAME, SYSDB_GHOST, SYSDB_ORIG_MEMBER, NULL};
     const char *userdn;
-    char *sanitized_name;
-    char *filter;
+    const char **names;
     errno_t ret = EOK;
     size_t group_count = 0;
+    size_t num_names = 0;
     int i;
 
     tmp_ctx = talloc_new(NULL);
@@ -1213,39 +1669,25 @@ sysdb_remove_ghostattr_from_groups(struct sss_domain_info *domain,
         return ENOENT;
     }
 
-    ret = sss_filter_sanitize(tmp_ctx, name, &sanitized_name);
+    ret = sysdb_attrs_get_el(attrs, SYSDB_NAME_ALIAS, &alias_el);
     if (ret != EOK) {
         goto done;
     }
 
-    filter = talloc_asprintf(tmp_ctx, "(|(%s=%s)",
-                                      SYSDB_GHOST, sanitized_name);
-    if (!filter) {
+    names = talloc_array(tmp_ctx, const char *, alias_el->num_values + 2);
+    if (names == NULL) {
         ret = ENOMEM;
         goto done;
     }
-    ret = sysdb_attrs_get_el(attrs, SYSDB_NAME_ALIAS, &alias_el);
-    if (ret != EOK) {
-        goto done;
-    }
 
+    names[num_names++] = name;
     for (i = 0; i < alias_el->num_values; i++) {
         if (strcmp((const char *)alias_el->values[i].data, name) == 0) {
             continue;
         }
-        filter = talloc_asprintf_append(filter, "(%s=%s)",
-                                        SYSDB_GHOST, alias_el->values[i].data);
-        if (filter == NULL) {
-            ret = ENOMEM;
-            goto done;
-        }
-    }
-
-    filter = talloc_asprintf_append(filter, ")");
-    if (filter == NULL) {
-        ret = ENOMEM;
-        goto done;
+        names[num_names++] = (const char *)alias_el->values[i].data;
     }
+    names[num_names] = NULL;
 
     tmpdn = sysdb_user_dn(tmp_ctx, domain, name);
     if (!tmpdn) {
@@ -1270,15 +1712,14 @@ sysdb_remove_ghostattr_from_groups(struct sss_domain_info *domain,
      * Note that this object can be referred to either by its name or any
      * of its aliases
      */
-    ret = sysdb_search_entry(tmp_ctx, domain->sysdb, tmpdn, LDB_SCOPE_SUBTREE,
-                             filter, group_attrs, &group_count, &groups);
-    if (ret != EOK && ret != ENOENT) {
+    ret = sysdb_ghosts_remove_names(tmp_ctx, domain->sysdb, tmpdn, names,
+                                    &groups, &group_count);
+    if (ret != EOK) {
         goto done;
     }
 
     for (i = 0; i < group_count; i++) {
-        sysdb_remove_ghost_from_group(domain, groups[i], alias_el, name,
-                                      orig_dn, userdn);
+        sysdb_remove_ghost_from_group(domain, groups[i], orig_dn, userdn);
     }
 
     ret = EOK;
@@ -1884,6 +2325,149 @@ done:
 
 /* =Store-Users-(Native/Legacy)-(replaces-existing-data)================== */
 
+static errno_t sysdb_store_new_user(struct sss_domain_info *domain,
+                                    const char *name,
+                                    uid_t uid, gid_t gid,
+                                    const char *gecos,
+                                    const char *homedir,
+                                    const char *shell,
+                                    const char *orig_dn,
+                                    struct sysdb_attrs *attrs,
+                                    uint64_t cache_timeout,
+                                    time_t now)
+{
+    errno_t ret;
+
+    ret = sysdb_add_user(domain, name, uid, gid, gecos, homedir,
+                         shell, orig_dn, attrs, cache_timeout, now);
+    if (ret == EEXIST) {
+        /* This may be a user rename. If there is a user with the
+         * same UID, remove it and try to add the basic user again
+         */
+        ret = sysdb_delete_user(domain, NULL, uid);
+        if (ret == ENOENT) {
+            /* Not found by UID, return the original EEXIST,
+             * this may be a conflict in MPG domain or something
+             * else */
+            return EEXIST;
+        } else if (ret != EOK) {
+            return ret;
+        }
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "A user with the same UID [%llu] was removed from the "
+               "cache\n", (unsigned long long) uid);
+        ret = sysdb_add_user(domain, name, uid, gid, gecos, homedir,
+                             shell, orig_dn, attrs, cache_timeout, now);
+    }
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Could not add user\n");
+    }
+
+    return ret;
+}
+
+/* the attributes replaced on an existing user */
+static errno_t sysdb_store_user_attrs(struct sss_domain_info *domain,
+                                      struct sysdb_attrs *attrs,
+                                      uid_t uid, gid_t gid,
+                                      const char *gecos,
+                                      const char *homedir,
+                                      const char *shell,
+                                      uint64_t cache_timeout,
+                                      time_t now)
+{
+    errno_t ret;
+
+    if (uid) {
+        ret = sysdb_attrs_add_uint32(attrs, SYSDB_UIDNUM, uid);
+        if (ret) return ret;
+    }
+
+    if (gid) {
+        ret = sysdb_attrs_add_uint32(attrs, SYSDB_GIDNUM, gid);
+        if (ret) return ret;
+    }
+
+    if (uid && !gid && domain->mpg) {
+        ret = sysdb_attrs_add_uint32(attrs, SYSDB_GIDNUM, uid);
+        if (ret) return ret;
+    }
+
+    if (gecos) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_GECOS, gecos);
+        if (ret) return ret;
+    }
+
+    if (homedir) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_HOMEDIR, homedir);
+        if (ret) return ret;
+    }
+
+    if (shell) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_SHELL, shell);
+        if (ret) return ret;
+    }
+
+    ret = sysdb_attrs_add_time_t(attrs, SYSDB_LAST_UPDATE, now);
+    if (ret) return ret;
+
+    return sysdb_attrs_add_time_t(attrs, SYSDB_CACHE_EXPIRE,
+                                  ((cache_timeout) ?
+                                   (now + cache_timeout) : 0));
+}
+
+/* Returns the attributes of @attrs whose values differ from those of the
+ * stored entry @old, so that a refresh modifies only what changed. The
+ * timestamps are always returned, the timestamp cache decides whether they
+ * are written, and so are the ghost members, which are not in @old and are
+ * compared when they are written. The elements are shared with @attrs. */
+static errno_t sysdb_attrs_get_changed(TALLOC_CTX *mem_ctx,
+                                       struct sysdb_attrs *attrs,
+                                       struct ldb_message *old,
+                                       struct sysdb_attrs **_changed)
+{
+    struct sysdb_attrs *changed;
+    struct ldb_message_element *old_el;
+    int i;
+
+    changed = sysdb_new_attrs(mem_ctx);
+    if (changed == NULL) {
+        return ENOMEM;
+    }
+
+    changed->a = talloc_array(changed, struct ldb_message_element,
+                              attrs->num);
+    if (changed->a == NULL) {
+        talloc_free(changed);
+        return ENOMEM;
+    }
+
+    for (i = 0; i < attrs->num; i++) {
+        if (strcasecmp(attrs->a[i].name, SYSDB_LAST_UPDATE) != 0
+                && strcasecmp(attrs->a[i].name, SYSDB_CACHE_EXPIRE) != 0
+                && strcasecmp(attrs->a[i].name, SYSDB_GHOST) != 0) {
+            old_el = ldb_msg_find_element(old, attrs->a[i].name);
+            if (old_el == NULL) {
+                if (attrs->a[i].num_values == 0) {
+                    continue;
+                }
+            } else if (ldb_msg_element_compare(&attrs->a[i], old_el) == 0) {
+                continue;
+            }
+        }
+
+        changed->a[changed->num] = attrs->a[i];
+        changed->num++;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "%d of %d attributes of [%s] changed\n",
+          changed->num, attrs->num, ldb_dn_get_linearized(old->dn));
+
+    *_changed = changed;
+    return EOK;
+}
+
 /* if one of the basic attributes is empty ("") as opposed to NULL,
  * this will just remove it */
 
@@ -1901,6 +2485,8 @@ int sysdb_store_user(struct sss_domain_info *domain,
                      time_t now)
 {
     TALLOC_CTX *tmp_ctx;
+    static const char *all_attrs[] = { "*", NULL };
+    struct sysdb_attrs *changed;
     struct ldb_message *msg;
     int ret;
     errno_t sret = EOK;
@@ -1932,7 +2518,8 @@ int sysdb_store_user(struct sss_domain_info *domain,
 
     in_transaction = true;
 
-    ret = sysdb_search_user_by_name(tmp_ctx, domain, name, NULL, &msg);
+    /* the whole entry is compared with the new attributes */
+    ret = sysdb_search_user_by_name(tmp_ctx, domain, name, all_attrs, &msg);
     if (ret && ret != ENOENT) {
         goto fail;
     }
@@ -1944,79 +2531,27 @@ int sysdb_store_user(struct sss_domain_info *domain,
 
     if (ret == ENOENT) {
         /* users doesn't exist, turn into adding a user */
-        ret = sysdb_add_user(domain, name, uid, gid, gecos, homedir,
-                             shell, orig_dn, attrs, cache_timeout, now);
-        if (ret == EEXIST) {
-            /* This may be a user rename. If there is a user with the
-             * same UID, remove it and try to add the basic user again
-             */
-            ret = sysdb_delete_user(domain, NULL, uid);
-            if (ret == ENOENT) {
-                /* Not found by UID, return the original EEXIST,
-                 * this may be a conflict in MPG domain or something
-                 * else */
-                ret = EEXIST;
-                goto fail;
-            } else if (ret != EOK) {
-                goto fail;
-            }
-            DEBUG(SSSDBG_MINOR_FAILURE,
-                  "A user with the same UID [%llu] was removed from the "
-                   "cache\n", (unsigned long long) uid);
-            ret = sysdb_add_user(domain, name, uid, gid, gecos, homedir,
-                                 shell, orig_dn, attrs, cache_timeout, now);
-        }
-
-        /* Handle the result of sysdb_add_user */
+        ret = sysdb_store_new_user(domain, name, uid, gid, gecos, homedir,
+                                   shell, orig_dn, attrs, cache_timeout, now);
         if (ret == EOK) {
             goto done;
         } else {
-            DEBUG(SSSDBG_OP_FAILURE, "Could not add user\n");
             goto fail;
         }
     }
 
     /* the user exists, let's just replace attributes when set */
-    if (uid) {
-        ret = sysdb_attrs_add_uint32(attrs, SYSDB_UIDNUM, uid);
-        if (ret) goto fail;
-    }
-
-    if (gid) {
-        ret = sysdb_attrs_add_uint32(attrs, SYSDB_GIDNUM, gid);
-        if (ret) goto fail;
-    }
-
-    if (uid && !gid && domain->mpg) {
-        ret = sysdb_attrs_add_uint32(attrs, SYSDB_GIDNUM, uid);
-        if (ret) goto fail;
-    }
-
-    if (gecos) {
-        ret = sysdb_attrs_add_string(attrs, SYSDB_GECOS, gecos);
-        if (ret) goto fail;
-    }
-
-    if (homedir) {
-        ret = sysdb_attrs_add_string(attrs, SYSDB_HOMEDIR, homedir);
-        if (ret) goto fail;
-    }
-
-    if (shell) {
-        ret = sysdb_attrs_add_string(attrs, SYSDB_SHELL, shell);
-        if (ret) goto fail;
-    }
-
-    ret = sysdb_attrs_add_time_t(attrs, SYSDB_LAST_UPDATE, now);
+    ret = sysdb_store_user_attrs(domain, attrs, uid, gid, gecos, homedir,
+                                 shell, cache_timeout, now);
     if (ret) goto fail;
 
-    ret = sysdb_attrs_add_time_t(attrs, SYSDB_CACHE_EXPIRE,
-                                 ((cache_timeout) ?
-                                  (now + cache_timeout) : 0));
+    ret = sysdb_attrs_get_changed(tmp_ctx, attrs, msg, &changed);
     if (ret) goto fail;
 
-    ret = sysdb_set_user_attr(domain, name, attrs, SYSDB_MOD_REP);
-    if (ret != EOK) goto fail;
+    if (changed->num > 0) {
+        ret = sysdb_set_user_attr(domain, name, changed, SYSDB_MOD_REP);
+        if (ret != EOK) goto fail;
+    }
 
     if (remove_attrs) {
         ret = sysdb_remove_attrs(domain, name,
@@ -2054,19 +2589,96 @@ fail:
 
 /* =Store-Group-(Native/Legacy)-(replaces-existing-data)================== */
 
-/* this function does not check that all user members are actually present */
-
-int sysdb_store_group(struct sss_domain_info *domain,
-                      const char *name,
-                      gid_t gid,
-                      struct sysdb_attrs *attrs,
-                      uint64_t cache_timeout,
-                      time_t now)
+static errno_t sysdb_store_new_group(struct sss_domain_info *domain,
+                                     const char *name,
+                                     gid_t gid,
+                                     struct sysdb_attrs *attrs,
+                                     uint64_t cache_timeout,
+                                     time_t now)
 {
-    TALLOC_CTX *tmp_ctx;
-    static const char *src_attrs[] = { SYSDB_NAME, SYSDB_GIDNUM,
-                                       SYSDB_ORIG_MODSTAMP, NULL };
-    struct ldb_message *msg;
+    errno_t ret;
+
+    ret = sysdb_add_group(domain, name, gid, attrs, cache_timeout, now);
+    if (ret == EEXIST) {
+        /* This may be a group rename. If there is a group with the
+         * same GID, remove it and try to add the basic group again
+         */
+        DEBUG(SSSDBG_TRACE_LIBS, "sysdb_add_group failed: [EEXIST].\n");
+        ret = sysdb_delete_group(domain, NULL, gid);
+        if (ret == ENOENT) {
+            /* Not found by GID, return the original EEXIST,
+             * this may be a conflict in MPG domain or something
+             * else */
+            DEBUG(SSSDBG_TRACE_LIBS,
+                  "sysdb_delete_group failed (while renaming group). Not "
+                  "found by gid: [%"SPRIgid"].\n", gid);
+            return EEXIST;
+        } else if (ret != EOK) {
+            DEBUG(SSSDBG_TRACE_LIBS, "sysdb_add_group failed.\n");
+            return ret;
+        }
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "A group with the same GID [%"SPRIgid"] was removed from "
+              "the cache\n", gid);
+        ret = sysdb_add_group(domain, name, gid, attrs, cache_timeout,
+                              now);
+        if (ret) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "sysdb_add_group failed (while renaming group) for: "
+                  "%s [%"SPRIgid"].\n", name, gid);
+        }
+    }
+
+    return ret;
+}
+
+/* the attributes replaced on an existing group */
+static errno_t sysdb_store_group_attrs(struct sysdb_attrs *attrs,
+                                       gid_t gid,
+                                       uint64_t cache_timeout,
+                                       time_t now)
+{
+    errno_t ret;
+
+    if (gid) {
+        ret = sysdb_attrs_add_uint32(attrs, SYSDB_GIDNUM, gid);
+        if (ret) {
+            DEBUG(SSSDBG_TRACE_LIBS, "Failed to add GID.\n");
+            return ret;
+        }
+    }
+
+    ret = sysdb_attrs_add_time_t(attrs, SYSDB_LAST_UPDATE, now);
+    if (ret) {
+        DEBUG(SSSDBG_TRACE_LIBS, "Failed to add sysdb-last-update.\n");
+        return ret;
+    }
+
+    ret = sysdb_attrs_add_time_t(attrs, SYSDB_CACHE_EXPIRE,
+                                 ((cache_timeout) ?
+                                  (now + cache_timeout) : 0));
+    if (ret) {
+        DEBUG(SSSDBG_TRACE_LIBS, "Failed to add sysdb-cache-expire.\n");
+        return ret;
+    }
+
+    return EOK;
+}
+
+/* this function does not check that all user members are actually present */
+
+int sysdb_store_group(struct sss_domain_info *domain,
+                      const char *name,
+                      gid_t gid,
+                      struct sysdb_attrs *attrs,
+                      uint64_t cache_timeout,
+                      time_t now)
+{
+    TALLOC_CTX *tmp_ctx;
+    /* the whole entry is compared with the new attributes */
+    static const char *src_attrs[] = { "*", NULL };
+    struct sysdb_attrs *changed;
+    struct ldb_message *msg;
     bool new_group = false;
     int ret;
 
@@ -2105,64 +2717,30 @@ int sysdb_store_group(struct sss_domain_info *domain,
 
     if (new_group) {
         /* group doesn't exist, turn into adding a group */
-        ret = sysdb_add_group(domain, name, gid, attrs, cache_timeout,
-                              now);
-        if (ret == EEXIST) {
-            /* This may be a group rename. If there is a group with the
-             * same GID, remove it and try to add the basic group again
-             */
-            DEBUG(SSSDBG_TRACE_LIBS, "sysdb_add_group failed: [EEXIST].\n");
-            ret = sysdb_delete_group(domain, NULL, gid);
-            if (ret == ENOENT) {
-                /* Not found by GID, return the original EEXIST,
-                 * this may be a conflict in MPG domain or something
-                 * else */
-                DEBUG(SSSDBG_TRACE_LIBS,
-                      "sysdb_delete_group failed (while renaming group). Not "
-                      "found by gid: [%"SPRIgid"].\n", gid);
-                return EEXIST;
-            } else if (ret != EOK) {
-                DEBUG(SSSDBG_TRACE_LIBS, "sysdb_add_group failed.\n");
-                goto done;
-            }
-            DEBUG(SSSDBG_MINOR_FAILURE,
-                  "A group with the same GID [%"SPRIgid"] was removed from "
-                  "the cache\n", gid);
-            ret = sysdb_add_group(domain, name, gid, attrs, cache_timeout,
-                                  now);
-            if (ret) {
-                DEBUG(SSSDBG_MINOR_FAILURE,
-                      "sysdb_add_group failed (while renaming group) for: "
-                      "%s [%"SPRIgid"].\n", name, gid);
-            }
-        }
+        ret = sysdb_store_new_group(domain, name, gid, attrs, cache_timeout,
+                                    now);
         goto done;
     }
 
     /* the group exists, let's just replace attributes when set */
-    if (gid) {
-        ret = sysdb_attrs_add_uint32(attrs, SYSDB_GIDNUM, gid);
-        if (ret) {
-            DEBUG(SSSDBG_TRACE_LIBS, "Failed to add GID.\n");
-            goto done;
-        }
+    ret = sysdb_store_group_attrs(attrs, gid, cache_timeout, now);
+    if (ret) {
+        goto done;
     }
 
-    ret = sysdb_attrs_add_time_t(attrs, SYSDB_LAST_UPDATE, now);
+    /* an unchanged member list is not replaced, which also spares the
+     * memberof plugin from recomputing the memberships */
+    ret = sysdb_attrs_get_changed(tmp_ctx, attrs, msg, &changed);
     if (ret) {
-        DEBUG(SSSDBG_TRACE_LIBS, "Failed to add sysdb-last-update.\n");
         goto done;
     }
 
-    ret = sysdb_attrs_add_time_t(attrs, SYSDB_CACHE_EXPIRE,
-                                 ((cache_timeout) ?
-                                  (now + cache_timeout) : 0));
-    if (ret) {
-        DEBUG(SSSDBG_TRACE_LIBS, "Failed to add sysdb-cache-expire.\n");
+    if (changed->num == 0) {
+        ret = EOK;
         goto done;
     }
 
-    ret = sysdb_set_group_attr(domain, name, attrs, SYSDB_MOD_REP);
+    ret = sysdb_set_group_attr(domain, name, changed, SYSDB_MOD_REP);
     if (ret) {
         DEBUG(SSSDBG_TRACE_LIBS, "sysdb_set_group_attr failed.\n");
         goto done;
@@ -2177,422 +2755,535 @@ done:
 }
 
 
-/* =Add-User-to-Group(Native/Legacy)====================================== */
-static int
-sysdb_group_membership_mod(struct sss_domain_info *domain,
-                           const char *group,
-                           const char *member,
-                           enum sysdb_member_type type,
-                           int modify_op,
-                           bool is_dn)
+/* =Store-Users-and-Groups-in-Bulk======================================= */
+
+/* Storing one entry at a time searches it by name, which costs a lookup
+ * in the large objectClass index for each entry. The bulk functions read
+ * the entries directly by their DN instead and update an existing entry
+ * with a single modify, only new entries go through the add functions. */
+
+static errno_t sysdb_bulk_read_entry(TALLOC_CTX *mem_ctx,
+                                     struct sysdb_ctx *sysdb,
+                                     struct ldb_dn *dn,
+                                     const char **attrs,
+                                     struct ldb_message **_msg)
 {
-    struct ldb_dn *group_dn;
-    struct ldb_dn *member_dn;
-    int ret;
-    TALLOC_CTX *tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
+    struct ldb_result *res;
+    int lret;
+
+    lret = ldb_search(sysdb->ldb, mem_ctx, &res, dn, LDB_SCOPE_BASE,
+                      attrs, NULL);
+    if (lret == LDB_ERR_NO_SUCH_OBJECT) {
+        return ENOENT;
+    } else if (lret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(lret);
+    }
+
+    if (res->count == 0) {
+        return ENOENT;
+    }
+
+    *_msg = res->msgs[0];
+    return EOK;
+}
+
+/* Replace those of @attrs that differ from @old and remove those of
+ * @remove_attrs that are present in @old in one modify */
+static errno_t sysdb_bulk_modify(struct sysdb_ctx *sysdb,
+                                 struct ldb_dn *dn,
+                                 struct sysdb_attrs *attrs,
+                                 struct ldb_message *old,
+                                 char **remove_attrs)
+{
+    struct sysdb_attrs *changed;
+    struct ldb_message *msg;
+    size_t num_remove = 0;
+    size_t i;
+    int j;
+    errno_t ret;
+
+    while (remove_attrs != NULL && remove_attrs[num_remove] != NULL) {
+        num_remove++;
+    }
+
+    msg = ldb_msg_new(NULL);
+    if (msg == NULL) {
         return ENOMEM;
     }
+    msg->dn = dn;
 
-    if (type == SYSDB_MEMBER_USER) {
-        member_dn = sysdb_user_dn(tmp_ctx, domain, member);
-    } else if (type == SYSDB_MEMBER_GROUP) {
-        member_dn = sysdb_group_dn(tmp_ctx, domain, member);
-    } else {
-        ret = EINVAL;
+    msg->elements = talloc_zero_array(msg, struct ldb_message_element,
+                                      attrs->num + num_remove);
+    if (msg->elements == NULL) {
+        ret = ENOMEM;
         goto done;
     }
 
-    if (!member_dn) {
-        ret = ENOMEM;
+    ret = sysdb_attrs_get_changed(msg, attrs, old, &changed);
+    if (ret != EOK) {
         goto done;
     }
 
-    if (!is_dn) {
-        group_dn = sysdb_group_dn(tmp_ctx, domain, group);
-    } else {
-        group_dn = ldb_dn_new(tmp_ctx, domain->sysdb->ldb, group);
+    for (j = 0; j < changed->num; j++) {
+        msg->elements[j] = changed->a[j];
+        msg->elements[j].flags = SYSDB_MOD_REP;
     }
+    msg->num_elements = changed->num;
 
-    if (!group_dn) {
-        ret = ENOMEM;
+    for (i = 0; i < num_remove; i++) {
+        /* SYSDB_MEMBEROF is exclusively handled by the memberof plugin */
+        if (strcasecmp(remove_attrs[i], SYSDB_MEMBEROF) == 0) {
+            continue;
+        }
+
+        /* removing a missing attribute would fail the whole modify */
+        if (ldb_msg_find_element(old, remove_attrs[i]) == NULL) {
+            continue;
+        }
+
+        for (j = 0; j < attrs->num; j++) {
+            if (strcasecmp(attrs->a[j].name, remove_attrs[i]) == 0) {
+                break;
+            }
+        }
+        if (j < attrs->num) {
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Removing attribute [%s] from [%s]\n",
+              remove_attrs[i], ldb_dn_get_linearized(dn));
+        msg->elements[msg->num_elements].name = remove_attrs[i];
+        msg->elements[msg->num_elements].flags = LDB_FLAG_MOD_DELETE;
+        msg->num_elements++;
+    }
+
+    if (msg->num_elements == 0) {
+        ret = EOK;
         goto done;
     }
 
-    ret = sysdb_mod_group_member(domain, member_dn, group_dn, modify_op);
+    ret = sysdb_msg_add_cert_hashes(msg);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_ts_modify(sysdb, msg, old);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_ts_modify failed: [%s]\n",
+              ldb_errstring(sysdb->ldb));
+    }
 
 done:
-    talloc_free(tmp_ctx);
+    talloc_free(msg);
     return ret;
 }
 
-int sysdb_add_group_member(struct sss_domain_info *domain,
-                           const char *group,
-                           const char *member,
-                           enum sysdb_member_type type,
-                           bool is_dn)
+static errno_t sysdb_store_bulk_user(TALLOC_CTX *mem_ctx,
+                                     struct sss_domain_info *domain,
+                                     struct sysdb_bulk_user *user,
+                                     uint64_t cache_timeout,
+                                     time_t now)
 {
-    return sysdb_group_membership_mod(domain, group, member, type,
-                                      SYSDB_MOD_ADD, is_dn);
-}
+    struct sysdb_attrs *attrs;
+    struct ldb_message *old;
+    struct ldb_dn *dn;
+    errno_t ret;
 
-/* =Remove-member-from-Group(Native/Legacy)=============================== */
+    attrs = user->attrs;
+    if (attrs == NULL) {
+        attrs = sysdb_new_attrs(mem_ctx);
+        if (attrs == NULL) {
+            return ENOMEM;
+        }
+    }
 
+    if (user->pwd && (domain->legacy_passwords || !*user->pwd)) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_PWD, user->pwd);
+        if (ret) return ret;
+    }
 
-int sysdb_remove_group_member(struct sss_domain_info *domain,
-                              const char *group,
-                              const char *member,
-                              enum sysdb_member_type type,
-                              bool is_dn)
-{
-    return sysdb_group_membership_mod(domain, group, member, type,
-                                      SYSDB_MOD_DEL, is_dn);
-}
+    dn = sysdb_user_dn(mem_ctx, domain, user->name);
+    if (dn == NULL) {
+        return ENOMEM;
+    }
 
+    /* the whole entry is compared with the new attributes */
+    ret = sysdb_bulk_read_entry(mem_ctx, domain->sysdb, dn, NULL, &old);
+    if (ret == ENOENT) {
+        return sysdb_store_new_user(domain, user->name, user->uid, user->gid,
+                                    user->gecos, user->homedir, user->shell,
+                                    user->orig_dn, attrs, cache_timeout, now);
+    } else if (ret != EOK) {
+        return ret;
+    }
 
-/* =Password-Caching====================================================== */
+    ret = sysdb_store_user_attrs(domain, attrs, user->uid, user->gid,
+                                 user->gecos, user->homedir, user->shell,
+                                 cache_timeout, now);
+    if (ret != EOK) {
+        return ret;
+    }
 
-int sysdb_cache_password_ex(struct sss_domain_info *domain,
-                            const char *username,
-                            const char *password,
-                            enum sss_authtok_type authtok_type,
-                            size_t second_factor_len)
+    return sysdb_bulk_modify(domain->sysdb, dn, attrs, old,
+                             user->remove_attrs);
+}
+
+errno_t sysdb_store_users_bulk(struct sss_domain_info *domain,
+                               struct sysdb_bulk_user *users,
+                               size_t num_users,
+                               uint64_t cache_timeout,
+                               time_t now)
 {
     TALLOC_CTX *tmp_ctx;
-    struct sysdb_attrs *attrs;
-    char *hash = NULL;
-    char *salt;
-    int ret;
+    bool in_transaction = false;
+    errno_t ret;
+    errno_t sret;
+    size_t i;
+
+    if (num_users == 0) {
+        return EOK;
+    }
 
     tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
+    if (tmp_ctx == NULL) {
         return ENOMEM;
     }
 
-    ret = s3crypt_gen_salt(tmp_ctx, &salt);
-    if (ret) {
-        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to generate random salt.\n");
-        goto fail;
+    if (!now) {
+        now = time(NULL);
     }
 
-    ret = s3crypt_sha512(tmp_ctx, password, salt, &hash);
-    if (ret) {
-        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to create password hash.\n");
-        goto fail;
+    ret = sysdb_transaction_start(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
     }
+    in_transaction = true;
 
-    attrs = sysdb_new_attrs(tmp_ctx);
-    if (!attrs) {
-        ERROR_OUT(ret, ENOMEM, fail);
+    for (i = 0; i < num_users; i++) {
+        users[i].ret = sysdb_store_bulk_user(tmp_ctx, domain, &users[i],
+                                             cache_timeout, now);
+        if (users[i].ret != EOK) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Could not store user [%s]: %d (%s)\n",
+                  users[i].name, users[i].ret, sss_strerror(users[i].ret));
+        }
+        talloc_free_children(tmp_ctx);
     }
 
-    ret = sysdb_attrs_add_string(attrs, SYSDB_CACHEDPWD, hash);
-    if (ret) goto fail;
-
-    ret = sysdb_attrs_add_long(attrs, SYSDB_CACHEDPWD_TYPE, authtok_type);
-    if (ret) goto fail;
-
-    if (authtok_type == SSS_AUTHTOK_TYPE_2FA && second_factor_len > 0) {
-        ret = sysdb_attrs_add_long(attrs, SYSDB_CACHEDPWD_FA2_LEN,
-                                   second_factor_len);
-        if (ret) goto fail;
+    ret = sysdb_transaction_commit(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
     }
+    in_transaction = false;
 
-    /* FIXME: should we use a different attribute for chache passwords ?? */
-    ret = sysdb_attrs_add_long(attrs, "lastCachedPasswordChange",
-                               (long)time(NULL));
-    if (ret) goto fail;
-
-    ret = sysdb_attrs_add_uint32(attrs, SYSDB_FAILED_LOGIN_ATTEMPTS, 0U);
-    if (ret) goto fail;
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
 
+/* The bulk store always sends the GID, unlike sysdb_store_group() which only
+ * passes the changed attributes to sysdb_set_group_attr() */
+static bool sysdb_bulk_initgr_gids_changed(struct ldb_message *old,
+                                           struct sysdb_attrs *attrs)
+{
+    const char *names[] = { SYSDB_GIDNUM, SYSDB_POSIX, NULL };
+    struct ldb_message_element *el;
+    const char *old_val;
+    size_t i;
+    int j;
 
-    ret = sysdb_set_user_attr(domain, username, attrs, SYSDB_MOD_REP);
-    if (ret) {
-        goto fail;
+    for (i = 0; names[i] != NULL; i++) {
+        for (j = 0; j < attrs->num; j++) {
+            if (strcasecmp(attrs->a[j].name, names[i]) == 0) {
+                break;
+            }
+        }
+        if (j == attrs->num) {
+            continue;
+        }
+        el = &attrs->a[j];
+
+        old_val = ldb_msg_find_attr_as_string(old, names[i], NULL);
+        if (old_val == NULL || el->num_values != 1
+                || strlen(old_val) != el->values[0].length
+                || strncmp(old_val, (const char *)el->values[0].data,
+                           el->values[0].length) != 0) {
+            return true;
+        }
     }
-    talloc_zfree(tmp_ctx);
-    return EOK;
 
-fail:
-    if (ret) {
-        DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
-    }
-    talloc_zfree(tmp_ctx);
-    return ret;
+    return false;
 }
 
-int sysdb_cache_password(struct sss_domain_info *domain,
-                         const char *username,
-                         const char *password)
+static errno_t sysdb_store_bulk_group(TALLOC_CTX *mem_ctx,
+                                      struct sss_domain_info *domain,
+                                      struct sysdb_bulk_group *group,
+                                      uint64_t cache_timeout,
+                                      time_t now)
 {
-    return sysdb_cache_password_ex(domain, username, password,
-                                   SSS_AUTHTOK_TYPE_PASSWORD, 0);
-}
+    struct sysdb_attrs *attrs;
+    struct sysdb_attrs *rest;
+    struct ldb_message_element *ghosts;
+    struct ldb_message *old;
+    struct ldb_dn *dn;
+    errno_t ret;
 
-/* =Custom Search================== */
+    attrs = group->attrs;
+    if (attrs == NULL) {
+        attrs = sysdb_new_attrs(mem_ctx);
+        if (attrs == NULL) {
+            return ENOMEM;
+        }
+    }
 
-int sysdb_search_custom(TALLOC_CTX *mem_ctx,
-                        struct sss_domain_info *domain,
-                        const char *filter,
-                        const char *subtree_name,
-                        const char **attrs,
-                        size_t *msgs_count,
-                        struct ldb_message ***msgs)
-{
-    TALLOC_CTX *tmp_ctx;
-    struct ldb_dn *basedn = NULL;
-    int ret;
+    dn = sysdb_group_dn(mem_ctx, domain, group->name);
+    if (dn == NULL) {
+        return ENOMEM;
+    }
 
-    tmp_ctx = talloc_new(NULL);
-    if (tmp_ctx == NULL) {
-        ret = ENOMEM;
-        goto done;
+    ret = sysdb_bulk_read_entry(mem_ctx, domain->sysdb, dn, NULL, &old);
+    if (ret == ENOENT) {
+        return sysdb_store_new_group(domain, group->name, group->gid, attrs,
+                                     cache_timeout, now);
+    } else if (ret != EOK) {
+        return ret;
     }
 
-    if (filter == NULL || subtree_name == NULL) {
-        ret = EINVAL;
-        goto done;
+    ret = sysdb_store_group_attrs(attrs, group->gid, cache_timeout, now);
+    if (ret != EOK) {
+        return ret;
     }
 
-    basedn = sysdb_custom_subtree_dn(tmp_ctx, domain, subtree_name);
-    if (basedn == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_custom_subtree_dn failed.\n");
-        ret = ENOMEM;
-        goto done;
+    ret = sysdb_ghosts_split(mem_ctx, attrs, &rest, &ghosts);
+    if (ret != EOK) {
+        return ret;
     }
-    if (!ldb_dn_validate(basedn)) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to create DN.\n");
-        ret = EINVAL;
-        goto done;
+
+    if (ghosts != NULL) {
+        ret = sysdb_ghosts_modify(domain->sysdb, dn, ghosts, SYSDB_MOD_REP);
+        if (ret != EOK) {
+            return ret;
+        }
     }
 
-    ret = sysdb_search_entry(mem_ctx, domain->sysdb, basedn,
-                             LDB_SCOPE_SUBTREE, filter, attrs,
-                             msgs_count, msgs);
-done:
-    talloc_free(tmp_ctx);
-    return ret;
+    if (sysdb_bulk_initgr_gids_changed(old, rest)) {
+        ret = sysdb_invalidate_initgr_gids(domain->sysdb, dn);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return sysdb_bulk_modify(domain->sysdb, dn, rest, old, NULL);
 }
 
-int sysdb_search_custom_by_name(TALLOC_CTX *mem_ctx,
-                                struct sss_domain_info *domain,
-                                const char *object_name,
-                                const char *subtree_name,
-                                const char **attrs,
-                                size_t *_count,
-                                struct ldb_message ***_msgs)
+errno_t sysdb_store_groups_bulk(struct sss_domain_info *domain,
+                                struct sysdb_bulk_group *groups,
+                                size_t num_groups,
+                                uint64_t cache_timeout,
+                                time_t now)
 {
     TALLOC_CTX *tmp_ctx;
-    struct ldb_dn *basedn;
-    struct ldb_message **msgs;
-    size_t count;
-    int ret;
+    bool in_transaction = false;
+    errno_t ret;
+    errno_t sret;
+    size_t i;
 
-    if (object_name == NULL || subtree_name == NULL) {
-        return EINVAL;
+    if (num_groups == 0) {
+        return EOK;
     }
 
     tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
+    if (tmp_ctx == NULL) {
         return ENOMEM;
     }
 
-    basedn = sysdb_custom_dn(tmp_ctx, domain, object_name, subtree_name);
-    if (basedn == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_custom_dn failed.\n");
-        ret = ENOMEM;
-        goto done;
+    if (!now) {
+        now = time(NULL);
     }
-    if (!ldb_dn_validate(basedn)) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to create DN.\n");
-        ret = EINVAL;
+
+    ret = sysdb_transaction_start(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
         goto done;
     }
+    in_transaction = true;
 
-    ret = sysdb_search_entry(tmp_ctx, domain->sysdb, basedn,
-                             LDB_SCOPE_BASE, NULL, attrs, &count, &msgs);
-    if (ret) {
-        goto done;
+    for (i = 0; i < num_groups; i++) {
+        groups[i].ret = sysdb_store_bulk_group(tmp_ctx, domain, &groups[i],
+                                               cache_timeout, now);
+        if (groups[i].ret != EOK) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Could not store group [%s]: %d (%s)\n",
+                  groups[i].name, groups[i].ret,
+                  sss_strerror(groups[i].ret));
+        }
+        talloc_free_children(tmp_ctx);
     }
 
-    if (count > 1) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "More than one result found.\n");
-        ret = EFAULT;
+    ret = sysdb_transaction_commit(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
         goto done;
     }
-
-    *_count = count;
-    *_msgs = talloc_move(mem_ctx, &msgs);
+    in_transaction = false;
 
 done:
-    talloc_zfree(tmp_ctx);
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    talloc_free(tmp_ctx);
     return ret;
 }
 
-
-/* =Custom Store (replaces-existing-data)================== */
-
-int sysdb_store_custom(struct sss_domain_info *domain,
-                       const char *object_name,
-                       const char *subtree_name,
-                       struct sysdb_attrs *attrs)
+/* =Add-User-to-Group(Native/Legacy)====================================== */
+static int
+sysdb_group_membership_mod(struct sss_domain_info *domain,
+                           const char *group,
+                           const char *member,
+                           enum sysdb_member_type type,
+                           int modify_op,
+                           bool is_dn)
 {
-    TALLOC_CTX *tmp_ctx;
-    const char *search_attrs[] = { "*", NULL };
-    size_t resp_count = 0;
-    struct ldb_message **resp;
-    struct ldb_message *msg;
-    struct ldb_message_element *el;
-    bool add_object = false;
+    struct ldb_dn *group_dn;
+    struct ldb_dn *member_dn;
     int ret;
-    int i;
-
-    if (object_name == NULL || subtree_name == NULL) {
-        return EINVAL;
-    }
-
-    ret = ldb_transaction_start(domain->sysdb->ldb);
-    if (ret) {
-        return sysdb_error_to_errno(ret);
-    }
-
-    tmp_ctx = talloc_new(NULL);
+    TALLOC_CTX *tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
-        ret = ENOMEM;
-        goto done;
+        return ENOMEM;
     }
 
-    ret = sysdb_search_custom_by_name(tmp_ctx, domain,
-                                      object_name, subtree_name,
-                                      search_attrs, &resp_count, &resp);
-    if (ret != EOK && ret != ENOENT) {
+    if (type == SYSDB_MEMBER_USER) {
+        member_dn = sysdb_user_dn(tmp_ctx, domain, member);
+    } else if (type == SYSDB_MEMBER_GROUP) {
+        member_dn = sysdb_group_dn(tmp_ctx, domain, member);
+    } else {
+        ret = EINVAL;
         goto done;
     }
 
-    if (ret == ENOENT) {
-       add_object = true;
-    }
-
-    msg = ldb_msg_new(tmp_ctx);
-    if (msg == NULL) {
+    if (!member_dn) {
         ret = ENOMEM;
         goto done;
     }
 
-    msg->dn = sysdb_custom_dn(tmp_ctx, domain, object_name, subtree_name);
-    if (!msg->dn) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_custom_dn failed.\n");
-        ret = ENOMEM;
-        goto done;
+    if (!is_dn) {
+        group_dn = sysdb_group_dn(tmp_ctx, domain, group);
+    } else {
+        group_dn = ldb_dn_new(tmp_ctx, domain->sysdb->ldb, group);
     }
 
-    msg->elements = talloc_array(msg, struct ldb_message_element, attrs->num);
-    if (!msg->elements) {
+    if (!group_dn) {
         ret = ENOMEM;
         goto done;
     }
 
-    for (i = 0; i < attrs->num; i++) {
-        msg->elements[i] = attrs->a[i];
-        if (add_object) {
-            msg->elements[i].flags = LDB_FLAG_MOD_ADD;
-        } else {
-            el = ldb_msg_find_element(resp[0], attrs->a[i].name);
-            if (el == NULL) {
-                msg->elements[i].flags = LDB_FLAG_MOD_ADD;
-            } else {
-                msg->elements[i].flags = LDB_FLAG_MOD_REPLACE;
-            }
-        }
-    }
-    msg->num_elements = attrs->num;
-
-    if (add_object) {
-        ret = ldb_add(domain->sysdb->ldb, msg);
-    } else {
-        ret = ldb_modify(domain->sysdb->ldb, msg);
-    }
-    if (ret != LDB_SUCCESS) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store custom entry: %s(%d)[%s]\n",
-                  ldb_strerror(ret), ret, ldb_errstring(domain->sysdb->ldb));
-        ret = sysdb_error_to_errno(ret);
-    }
+    ret = sysdb_mod_group_member(domain, member_dn, group_dn, modify_op);
 
 done:
-    if (ret) {
-        DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
-        ldb_transaction_cancel(domain->sysdb->ldb);
-    } else {
-        ret = ldb_transaction_commit(domain->sysdb->ldb);
-        ret = sysdb_error_to_errno(ret);
-    }
-    talloc_zfree(tmp_ctx);
+    talloc_free(tmp_ctx);
     return ret;
 }
 
-/* = Custom Delete======================================= */
+int sysdb_add_group_member(struct sss_domain_info *domain,
+                           const char *group,
+                           const char *member,
+                           enum sysdb_member_type type,
+                           bool is_dn)
+{
+    return sysdb_group_membership_mod(domain, group, member, type,
+                                      SYSDB_MOD_ADD, is_dn);
+}
 
-int sysdb_delete_custom(struct sss_domain_info *domain,
-                        const char *object_name,
-                        const char *subtree_name)
+/* =Remove-member-from-Group(Native/Legacy)=============================== */
+
+
+int sysdb_remove_group_member(struct sss_domain_info *domain,
+                              const char *group,
+                              const char *member,
+                              enum sysdb_member_type type,
+                              bool is_dn)
+{
+    return sysdb_group_membership_mod(domain, group, member, type,
+                                      SYSDB_MOD_DEL, is_dn);
+}
+
+
+/* =Password-Caching====================================================== */
+
+static int sysdb_cache_password_hash(struct sss_domain_info *domain,
+                                     const char *username,
+                                     const char *hash,
+                                     enum sss_authtok_type authtok_type,
+                                     size_t second_factor_len)
 {
     TALLOC_CTX *tmp_ctx;
-    struct ldb_dn *dn;
+    struct sysdb_attrs *attrs;
     int ret;
 
-    if (object_name == NULL || subtree_name == NULL) {
-        return EINVAL;
-    }
-
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
         return ENOMEM;
     }
 
-    dn = sysdb_custom_dn(tmp_ctx, domain, object_name, subtree_name);
-    if (dn == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_custom_dn failed.\n");
-        ret = ENOMEM;
-        goto done;
+    attrs = sysdb_new_attrs(tmp_ctx);
+    if (!attrs) {
+        ERROR_OUT(ret, ENOMEM, fail);
     }
 
-    ret = ldb_delete(domain->sysdb->ldb, dn);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_CACHEDPWD, hash);
+    if (ret) goto fail;
 
-    switch (ret) {
-    case LDB_SUCCESS:
-    case LDB_ERR_NO_SUCH_OBJECT:
-        ret = EOK;
-        break;
+    ret = sysdb_attrs_add_long(attrs, SYSDB_CACHEDPWD_TYPE, authtok_type);
+    if (ret) goto fail;
 
-    default:
-        DEBUG(SSSDBG_CRIT_FAILURE, "LDB Error: %s(%d)\nError Message: [%s]\n",
-                  ldb_strerror(ret), ret, ldb_errstring(domain->sysdb->ldb));
-        ret = sysdb_error_to_errno(ret);
-        break;
+    if (authtok_type == SSS_AUTHTOK_TYPE_2FA && second_factor_len > 0) {
+        ret = sysdb_attrs_add_long(attrs, SYSDB_CACHEDPWD_FA2_LEN,
+                                   second_factor_len);
+        if (ret) goto fail;
     }
 
-done:
+    /* FIXME: should we use a different attribute for chache passwords ?? */
+    ret = sysdb_attrs_add_long(attrs, "lastCachedPasswordChange",
+                               (long)time(NULL));
+    if (ret) goto fail;
+
+    ret = sysdb_attrs_add_uint32(attrs, SYSDB_FAILED_LOGIN_ATTEMPTS, 0U);
+    if (ret) goto fail;
+
+
+    ret = sysdb_set_user_attr(domain, username, attrs, SYSDB_MOD_REP);
+    if (ret) {
+        goto fail;
+    }
+    talloc_zfree(tmp_ctx);
+    return EOK;
+
+fail:
+    if (ret) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
+    }
     talloc_zfree(tmp_ctx);
     return ret;
 }
 
-/* = ASQ search request ======================================== */
-
-int sysdb_asq_search(TALLOC_CTX *mem_ctx,
-                     struct sss_domain_info *domain,
-                     struct ldb_dn *base_dn,
-                     const char *expression,
-                     const char *asq_attribute,
-                     const char **attrs,
-                     size_t *msgs_count,
-                     struct ldb_message ***msgs)
+int sysdb_cache_password_ex(struct sss_domain_info *domain,
+                            const char *username,
+                            const char *password,
+                            enum sss_authtok_type authtok_type,
+                            size_t second_factor_len)
 {
     TALLOC_CTX *tmp_ctx;
-    struct ldb_request *ldb_req;
-    struct ldb_control **ctrl;
-    struct ldb_asq_control *asq_control;
-    struct ldb_result *res;
+    char *hash = NULL;
+    char *salt;
     int ret;
 
     tmp_ctx = talloc_new(NULL);
@@ -2600,367 +3291,479 @@ int sysdb_asq_search(TALLOC_CTX *mem_ctx,
         return ENOMEM;
     }
 
-    ctrl = talloc_array(tmp_ctx, struct ldb_control *, 2);
-    if (ctrl == NULL) {
-        ret = ENOMEM;
-        goto fail;
+    ret = s3crypt_gen_salt(tmp_ctx, &salt);
+    if (ret) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to generate random salt.\n");
+        goto done;
     }
 
-    ctrl[0] = talloc(ctrl, struct ldb_control);
-    if (ctrl[0] == NULL) {
-        ret = ENOMEM;
-        goto fail;
+    ret = s3crypt_sha512(tmp_ctx, password, salt, &hash);
+    if (ret) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to create password hash.\n");
+        goto done;
     }
-    ctrl[1] = NULL;
 
-    ctrl[0]->oid = LDB_CONTROL_ASQ_OID;
-    ctrl[0]->critical = 1;
+    ret = sysdb_cache_password_hash(domain, username, hash,
+                                    authtok_type, second_factor_len);
 
-    asq_control = talloc(ctrl[0], struct ldb_asq_control);
-    if (asq_control == NULL) {
-        ret = ENOMEM;
-        goto fail;
+done:
+    talloc_zfree(tmp_ctx);
+    return ret;
+}
+
+struct sysdb_cache_password_state {
+    struct sss_domain_info *domain;
+    const char *username;
+    enum sss_authtok_type authtok_type;
+    size_t second_factor_len;
+};
+
+static void sysdb_cache_password_done(struct tevent_req *subreq);
+
+struct tevent_req *sysdb_cache_password_send(TALLOC_CTX *mem_ctx,
+                                             struct tevent_context *ev,
+                                             struct sss_domain_info *domain,
+                                             const char *username,
+                                             const char *password,
+                                             enum sss_authtok_type authtok_type,
+                                             size_t second_factor_len)
+{
+    struct sysdb_cache_password_state *state;
+    struct tevent_req *subreq;
+    struct tevent_req *req;
+    char *salt;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state,
+                            struct sysdb_cache_password_state);
+    if (req == NULL) {
+        return NULL;
     }
 
-    asq_control->request = 1;
-    asq_control->source_attribute = talloc_strdup(asq_control, asq_attribute);
-    if (asq_control->source_attribute == NULL) {
+    state->domain = domain;
+    state->authtok_type = authtok_type;
+    state->second_factor_len = second_factor_len;
+    state->username = talloc_strdup(state, username);
+    if (state->username == NULL) {
         ret = ENOMEM;
-        goto fail;
+        goto immediately;
     }
-    asq_control->src_attr_len = strlen(asq_control->source_attribute);
-    ctrl[0]->data = asq_control;
 
-    res = talloc_zero(tmp_ctx, struct ldb_result);
-    if (!res) {
-        ret = ENOMEM;
-        goto fail;
+    ret = s3crypt_gen_salt(state, &salt);
+    if (ret) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to generate random salt.\n");
+        goto immediately;
     }
 
-    ret = ldb_build_search_req(&ldb_req, domain->sysdb->ldb, tmp_ctx,
-                               base_dn, LDB_SCOPE_BASE,
-                               expression, attrs, ctrl,
-                               res, ldb_search_default_callback, NULL);
-    if (ret != LDB_SUCCESS) {
-        ret = sysdb_error_to_errno(ret);
-        goto fail;
+    subreq = s3crypt_sha512_send(state, ev, password, salt);
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto immediately;
     }
+    tevent_req_set_callback(subreq, sysdb_cache_password_done, req);
 
-    ret = ldb_request(domain->sysdb->ldb, ldb_req);
-    if (ret == LDB_SUCCESS) {
-        ret = ldb_wait(ldb_req->handle, LDB_WAIT_ALL);
+    return req;
+
+immediately:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static void sysdb_cache_password_done(struct tevent_req *subreq)
+{
+    struct sysdb_cache_password_state *state;
+    struct tevent_req *req;
+    char *hash;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sysdb_cache_password_state);
+
+    ret = s3crypt_sha512_recv(subreq, state, &hash);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to create password hash.\n");
+        tevent_req_error(req, ret);
+        return;
     }
-    if (ret) {
-        ret = sysdb_error_to_errno(ret);
-        goto fail;
+
+    ret = sysdb_cache_password_hash(state->domain, state->username, hash,
+                                    state->authtok_type,
+                                    state->second_factor_len);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
     }
 
-    *msgs_count = res->count;
-    *msgs = talloc_move(mem_ctx, &res->msgs);
+    tevent_req_done(req);
+}
+
+errno_t sysdb_cache_password_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
 
-    talloc_zfree(tmp_ctx);
     return EOK;
+}
 
-fail:
-    if (ret == ENOENT) {
-        DEBUG(SSSDBG_TRACE_FUNC, "No such entry\n");
-    }
-    else if (ret) {
-        DEBUG(SSSDBG_OP_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
-    }
-    talloc_zfree(tmp_ctx);
-    return ret;
+int sysdb_cache_password(struct sss_domain_info *domain,
+                         const char *username,
+                         const char *password)
+{
+    return sysdb_cache_password_ex(domain, username, password,
+                                   SSS_AUTHTOK_TYPE_PASSWORD, 0);
 }
 
-/* =Search-Users-with-Custom-Filter====================================== */
+/* =Custom Search================== */
 
-int sysdb_search_users(TALLOC_CTX *mem_ctx,
-                       struct sss_domain_info *domain,
-                       const char *sub_filter,
-                       const char **attrs,
-                       size_t *msgs_count,
-                       struct ldb_message ***msgs)
+int sysdb_search_custom(TALLOC_CTX *mem_ctx,
+                        struct sss_domain_info *domain,
+                        const char *filter,
+                        const char *subtree_name,
+                        const char **attrs,
+                        size_t *msgs_count,
+                        struct ldb_message ***msgs)
 {
     TALLOC_CTX *tmp_ctx;
-    struct ldb_dn *basedn;
-    char *filter;
+    struct ldb_dn *basedn = NULL;
     int ret;
 
     tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
-        return ENOMEM;
+    if (tmp_ctx == NULL) {
+        ret = ENOMEM;
+        goto done;
     }
 
-    basedn = sysdb_user_base_dn(tmp_ctx, domain);
-    if (!basedn) {
-        DEBUG(SSSDBG_OP_FAILURE, "Failed to build base dn\n");
-        ret = ENOMEM;
-        goto fail;
+    if (filter == NULL || subtree_name == NULL) {
+        ret = EINVAL;
+        goto done;
     }
 
-    filter = talloc_asprintf(tmp_ctx, "(&(%s)%s)", SYSDB_UC, sub_filter);
-    if (!filter) {
-        DEBUG(SSSDBG_OP_FAILURE, "Failed to build filter\n");
+    basedn = sysdb_custom_subtree_dn(tmp_ctx, domain, subtree_name);
+    if (basedn == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_custom_subtree_dn failed.\n");
         ret = ENOMEM;
-        goto fail;
+        goto done;
+    }
+    if (!ldb_dn_validate(basedn)) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to create DN.\n");
+        ret = EINVAL;
+        goto done;
     }
-
-    DEBUG(SSSDBG_TRACE_INTERNAL,
-          "Search users with filter: %s\n", filter);
 
     ret = sysdb_search_entry(mem_ctx, domain->sysdb, basedn,
                              LDB_SCOPE_SUBTREE, filter, attrs,
                              msgs_count, msgs);
-    if (ret) {
-        goto fail;
-    }
-
-    talloc_zfree(tmp_ctx);
-    return EOK;
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
 
-fail:
-    if (ret == ENOENT) {
-        DEBUG(SSSDBG_TRACE_INTERNAL, "No such entry\n");
-    }
-    else if (ret) {
-        DEBUG(SSSDBG_MINOR_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
-    }
-    talloc_zfree(tmp_ctx);
-    return ret;
-}
-
-/* =Delete-User-by-Name-OR-uid============================================ */
-
-int sysdb_delete_user(struct sss_domain_info *domain,
-                      const char *name, uid_t uid)
+int sysdb_search_custom_by_name(TALLOC_CTX *mem_ctx,
+                                struct sss_domain_info *domain,
+                                const char *object_name,
+                                const char *subtree_name,
+                                const char **attrs,
+                                size_t *_count,
+                                struct ldb_message ***_msgs)
 {
     TALLOC_CTX *tmp_ctx;
-    const char *attrs[] = {SYSDB_GHOST, NULL};
-    size_t msg_count;
-    char *filter;
+    struct ldb_dn *basedn;
     struct ldb_message **msgs;
-    struct ldb_message *msg;
+    size_t count;
     int ret;
-    int i;
-    char *sanitized_name;
+
+    if (object_name == NULL || subtree_name == NULL) {
+        return EINVAL;
+    }
 
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
         return ENOMEM;
     }
 
-    if (name) {
-        ret = sysdb_search_user_by_name(tmp_ctx, domain, name, NULL, &msg);
-    } else {
-        ret = sysdb_search_user_by_uid(tmp_ctx, domain, uid, NULL, &msg);
+    basedn = sysdb_custom_dn(tmp_ctx, domain, object_name, subtree_name);
+    if (basedn == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_custom_dn failed.\n");
+        ret = ENOMEM;
+        goto done;
+    }
+    if (!ldb_dn_validate(basedn)) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to create DN.\n");
+        ret = EINVAL;
+        goto done;
     }
-    if (ret == EOK) {
-        if (name && uid) {
-            /* verify name/gid match */
-            const char *c_name;
-            uint64_t c_uid;
-
-            c_name = ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL);
-            c_uid = ldb_msg_find_attr_as_uint64(msg, SYSDB_UIDNUM, 0);
-            if (c_name == NULL || c_uid == 0) {
-                DEBUG(SSSDBG_OP_FAILURE,
-                      "Attribute is missing but this should never happen!\n");
-                ret = EFAULT;
-                goto fail;
-            }
-            if (strcmp(name, c_name) || uid != c_uid) {
-                /* this is not the entry we are looking for */
-                ret = EINVAL;
-                goto fail;
-            }
-        }
-
-        ret = sysdb_delete_entry(domain->sysdb, msg->dn, false);
-        if (ret) {
-            goto fail;
-        }
-    } else if (ret == ENOENT && name != NULL) {
-        /* Perhaps a ghost user? */
-        ret = sss_filter_sanitize(tmp_ctx, name, &sanitized_name);
-        if (ret != EOK) {
-            goto fail;
-        }
-
-        filter = talloc_asprintf(tmp_ctx, "(%s=%s)",
-                                          SYSDB_GHOST, sanitized_name);
-        if (filter == NULL) {
-            ret = ENOMEM;
-            goto fail;
-        }
-
-        ret = sysdb_search_groups(tmp_ctx, domain, filter, attrs,
-                                  &msg_count, &msgs);
-        if (ret != EOK) {
-            goto fail;
-        }
-
-        for (i = 0; i < msg_count; i++) {
-            msg = ldb_msg_new(tmp_ctx);
-            if (!msg) {
-                ERROR_OUT(ret, ENOMEM, fail);
-            }
-
-            msg->dn = msgs[i]->dn;
-
-            ret = add_string(msg, LDB_FLAG_MOD_DELETE, SYSDB_GHOST, name);
-            if (ret) goto fail;
-
-            ret = ldb_modify(domain->sysdb->ldb, msg);
-            if (ret != LDB_SUCCESS) {
-                DEBUG(SSSDBG_MINOR_FAILURE,
-                      "ldb_modify failed: [%s](%d)[%s]\n",
-                      ldb_strerror(ret), ret,
-                      ldb_errstring(domain->sysdb->ldb));
-            }
-            ret = sysdb_error_to_errno(ret);
-            if (ret != EOK) {
-                goto fail;
-            }
 
-            talloc_zfree(msg);
-        }
-    } else {
-        goto fail;
+    ret = sysdb_search_entry(tmp_ctx, domain->sysdb, basedn,
+                             LDB_SCOPE_BASE, NULL, attrs, &count, &msgs);
+    if (ret) {
+        goto done;
     }
 
+    if (count > 1) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "More than one result found.\n");
+        ret = EFAULT;
+        goto done;
+    }
 
-    talloc_zfree(tmp_ctx);
-    return EOK;
+    *_count = count;
+    *_msgs = talloc_move(mem_ctx, &msgs);
 
-fail:
-    DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
+done:
     talloc_zfree(tmp_ctx);
     return ret;
 }
 
 
-/* =Search-Groups-with-Custom-Filter===================================== */
+/* =Custom Store (replaces-existing-data)================== */
 
-int sysdb_search_groups(TALLOC_CTX *mem_ctx,
-                        struct sss_domain_info *domain,
-                        const char *sub_filter,
-                        const char **attrs,
-                        size_t *msgs_count,
-                        struct ldb_message ***msgs)
+int sysdb_store_custom(struct sss_domain_info *domain,
+                       const char *object_name,
+                       const char *subtree_name,
+                       struct sysdb_attrs *attrs)
 {
     TALLOC_CTX *tmp_ctx;
-    struct ldb_dn *basedn;
-    char *filter;
+    const char *search_attrs[] = { "*", NULL };
+    size_t resp_count = 0;
+    struct ldb_message **resp;
+    struct ldb_message *msg;
+    struct ldb_message_element *el;
+    bool add_object = false;
     int ret;
+    int i;
+
+    if (object_name == NULL || subtree_name == NULL) {
+        return EINVAL;
+    }
+
+    ret = ldb_transaction_start(domain->sysdb->ldb);
+    if (ret) {
+        return sysdb_error_to_errno(ret);
+    }
 
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
-        return ENOMEM;
+        ret = ENOMEM;
+        goto done;
     }
 
-    basedn = sysdb_group_base_dn(tmp_ctx, domain);
-    if (!basedn) {
-        DEBUG(SSSDBG_OP_FAILURE, "Failed to build base dn\n");
-        ret = ENOMEM;
-        goto fail;
+    ret = sysdb_search_custom_by_name(tmp_ctx, domain,
+                                      object_name, subtree_name,
+                                      search_attrs, &resp_count, &resp);
+    if (ret != EOK && ret != ENOENT) {
+        goto done;
     }
 
-    filter = talloc_asprintf(tmp_ctx, "(&(%s)%s)", SYSDB_GC, sub_filter);
-    if (!filter) {
-        DEBUG(SSSDBG_OP_FAILURE, "Failed to build filter\n");
+    if (ret == ENOENT) {
+       add_object = true;
+    }
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (msg == NULL) {
         ret = ENOMEM;
-        goto fail;
+        goto done;
     }
 
-    DEBUG(SSSDBG_TRACE_INTERNAL,
-          "Search groups with filter: %s\n", filter);
+    msg->dn = sysdb_custom_dn(tmp_ctx, domain, object_name, subtree_name);
+    if (!msg->dn) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_custom_dn failed.\n");
+        ret = ENOMEM;
+        goto done;
+    }
 
-    ret = sysdb_search_entry(mem_ctx, domain->sysdb, basedn,
-                             LDB_SCOPE_SUBTREE, filter, attrs,
-                             msgs_count, msgs);
-    if (ret) {
-        goto fail;
+    msg->elements = talloc_array(msg, struct ldb_message_element, attrs->num);
+    if (!msg->elements) {
+        ret = ENOMEM;
+        goto done;
     }
 
-    talloc_zfree(tmp_ctx);
-    return EOK;
+    for (i = 0; i < attrs->num; i++) {
+        msg->elements[i] = attrs->a[i];
+        if (add_object) {
+            msg->elements[i].flags = LDB_FLAG_MOD_ADD;
+        } else {
+            el = ldb_msg_find_element(resp[0], attrs->a[i].name);
+            if (el == NULL) {
+                msg->elements[i].flags = LDB_FLAG_MOD_ADD;
+            } else {
+                msg->elements[i].flags = LDB_FLAG_MOD_REPLACE;
+            }
+        }
+    }
+    msg->num_elements = attrs->num;
 
-fail:
-    if (ret == ENOENT) {
-        DEBUG(SSSDBG_TRACE_INTERNAL, "No such entry\n");
+    if (add_object) {
+        ret = ldb_add(domain->sysdb->ldb, msg);
+    } else {
+        ret = ldb_modify(domain->sysdb->ldb, msg);
     }
-    else if (ret) {
-        DEBUG(SSSDBG_MINOR_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store custom entry: %s(%d)[%s]\n",
+                  ldb_strerror(ret), ret, ldb_errstring(domain->sysdb->ldb));
+        ret = sysdb_error_to_errno(ret);
+    }
+
+done:
+    if (ret) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
+        ldb_transaction_cancel(domain->sysdb->ldb);
+    } else {
+        ret = ldb_transaction_commit(domain->sysdb->ldb);
+        ret = sysdb_error_to_errno(ret);
     }
     talloc_zfree(tmp_ctx);
     return ret;
 }
 
-/* =Delete-Group-by-Name-OR-gid=========================================== */
+/* = Custom Delete======================================= */
 
-int sysdb_delete_group(struct sss_domain_info *domain,
-                       const char *name, gid_t gid)
+int sysdb_delete_custom(struct sss_domain_info *domain,
+                        const char *object_name,
+                        const char *subtree_name)
 {
     TALLOC_CTX *tmp_ctx;
-    struct ldb_message *msg;
+    struct ldb_dn *dn;
     int ret;
 
+    if (object_name == NULL || subtree_name == NULL) {
+        return EINVAL;
+    }
+
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
         return ENOMEM;
     }
 
-    if (name) {
-        ret = sysdb_search_group_by_name(tmp_ctx, domain, name, NULL, &msg);
-    } else {
-        ret = sysdb_search_group_by_gid(tmp_ctx, domain, gid, NULL, &msg);
-    }
-    if (ret) {
-        goto fail;
+    dn = sysdb_custom_dn(tmp_ctx, domain, object_name, subtree_name);
+    if (dn == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_custom_dn failed.\n");
+        ret = ENOMEM;
+        goto done;
     }
 
-    if (name && gid) {
-        /* verify name/gid match */
-        const char *c_name;
-        uint64_t c_gid;
+    ret = ldb_delete(domain->sysdb->ldb, dn);
 
-        c_name = ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL);
-        c_gid = ldb_msg_find_attr_as_uint64(msg, SYSDB_GIDNUM, 0);
-        if (c_name == NULL || c_gid == 0) {
-            DEBUG(SSSDBG_OP_FAILURE,
-                  "Attribute is missing but this should never happen!\n");
-            ret = EFAULT;
-            goto fail;
-        }
-        if (strcmp(name, c_name) || gid != c_gid) {
-            /* this is not the entry we are looking for */
-            ret = EINVAL;
-            goto fail;
-        }
+    switch (ret) {
+    case LDB_SUCCESS:
+    case LDB_ERR_NO_SUCH_OBJECT:
+        ret = EOK;
+        break;
+
+    default:
+        DEBUG(SSSDBG_CRIT_FAILURE, "LDB Error: %s(%d)\nError Message: [%s]\n",
+                  ldb_strerror(ret), ret, ldb_errstring(domain->sysdb->ldb));
+        ret = sysdb_error_to_errno(ret);
+        break;
     }
 
-    ret = sysdb_delete_entry(domain->sysdb, msg->dn, false);
+done:
+    talloc_zfree(tmp_ctx);
+    return ret;
+}
+
+/* = ASQ search request ======================================== */
+
+int sysdb_asq_search(TALLOC_CTX *mem_ctx,
+                     struct sss_domain_info *domain,
+                     struct ldb_dn *base_dn,
+                     const char *expression,
+                     const char *asq_attribute,
+                     const char **attrs,
+                     size_t *msgs_count,
+                     struct ldb_message ***msgs)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_request *ldb_req;
+    struct ldb_control **ctrl;
+    struct ldb_asq_control *asq_control;
+    struct ldb_result *res;
+    int ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    ctrl = talloc_array(tmp_ctx, struct ldb_control *, 2);
+    if (ctrl == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+
+    ctrl[0] = talloc(ctrl, struct ldb_control);
+    if (ctrl[0] == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    ctrl[1] = NULL;
+
+    ctrl[0]->oid = LDB_CONTROL_ASQ_OID;
+    ctrl[0]->critical = 1;
+
+    asq_control = talloc(ctrl[0], struct ldb_asq_control);
+    if (asq_control == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+
+    asq_control->request = 1;
+    asq_control->source_attribute = talloc_strdup(asq_control, asq_attribute);
+    if (asq_control->source_attribute == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    asq_control->src_attr_len = strlen(asq_control->source_attribute);
+    ctrl[0]->data = asq_control;
+
+    res = talloc_zero(tmp_ctx, struct ldb_result);
+    if (!res) {
+        ret = ENOMEM;
+        goto fail;
+    }
+
+    ret = ldb_build_search_req(&ldb_req, domain->sysdb->ldb, tmp_ctx,
+                               base_dn, LDB_SCOPE_BASE,
+                               expression, attrs, ctrl,
+                               res, ldb_search_default_callback, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto fail;
+    }
+
+    ret = ldb_request(domain->sysdb->ldb, ldb_req);
+    if (ret == LDB_SUCCESS) {
+        ret = ldb_wait(ldb_req->handle, LDB_WAIT_ALL);
+    }
     if (ret) {
+        ret = sysdb_error_to_errno(ret);
         goto fail;
     }
 
+    *msgs_count = res->count;
+    *msgs = talloc_move(mem_ctx, &res->msgs);
+
     talloc_zfree(tmp_ctx);
     return EOK;
 
 fail:
-    DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
+    if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC, "No such entry\n");
+    }
+    else if (ret) {
+        DEBUG(SSSDBG_OP_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
+    }
     talloc_zfree(tmp_ctx);
     return ret;
 }
 
-/* =Search-Netgroups-with-Custom-Filter===================================== */
+/* =Search-Users-with-Custom-Filter====================================== */
 
-int sysdb_search_netgroups(TALLOC_CTX *mem_ctx,
-                           struct sss_domain_info *domain,
-                           const char *sub_filter,
-                           const char **attrs,
-                           size_t *msgs_count,
-                           struct ldb_message ***msgs)
+int sysdb_search_users(TALLOC_CTX *mem_ctx,
+                       struct sss_domain_info *domain,
+                       const char *sub_filter,
+                       const char **attrs,
+                       size_t *msgs_count,
+                       struct ldb_message ***msgs)
 {
     TALLOC_CTX *tmp_ctx;
     struct ldb_dn *basedn;
@@ -2972,22 +3775,22 @@ int sysdb_search_netgroups(TALLOC_CTX *mem_ctx,
         return ENOMEM;
     }
 
-    basedn = ldb_dn_new_fmt(tmp_ctx, domain->sysdb->ldb,
-                            SYSDB_TMPL_NETGROUP_BASE, domain->name);
+    basedn = sysdb_user_base_dn(tmp_ctx, domain);
     if (!basedn) {
         DEBUG(SSSDBG_OP_FAILURE, "Failed to build base dn\n");
         ret = ENOMEM;
         goto fail;
     }
 
-    filter = talloc_asprintf(tmp_ctx, "(&(%s)%s)", SYSDB_NC, sub_filter);
+    filter = talloc_asprintf(tmp_ctx, "(&(%s)%s)", SYSDB_UC, sub_filter);
     if (!filter) {
         DEBUG(SSSDBG_OP_FAILURE, "Failed to build filter\n");
         ret = ENOMEM;
         goto fail;
     }
 
-    DEBUG(SSSDBG_TRACE_FUNC, "Search netgroups with filter: %s\n", filter);
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Search users with filter: %s\n", filter);
 
     ret = sysdb_search_entry(mem_ctx, domain->sysdb, basedn,
                              LDB_SCOPE_SUBTREE, filter, attrs,
@@ -3001,96 +3804,341 @@ int sysdb_search_netgroups(TALLOC_CTX *mem_ctx,
 
 fail:
     if (ret == ENOENT) {
-        DEBUG(SSSDBG_TRACE_FUNC, "Entry not found\n");
-    } else {
-        DEBUG(SSSDBG_OP_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
+        DEBUG(SSSDBG_TRACE_INTERNAL, "No such entry\n");
+    }
+    else if (ret) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
     }
     talloc_zfree(tmp_ctx);
     return ret;
 }
 
-/* =Delete-Netgroup-by-Name============================================== */
+/* =Delete-User-by-Name-OR-uid============================================ */
 
-int sysdb_delete_netgroup(struct sss_domain_info *domain,
-                          const char *name)
+int sysdb_delete_user(struct sss_domain_info *domain,
+                      const char *name, uid_t uid)
 {
     TALLOC_CTX *tmp_ctx;
+    const char *names[] = { name, NULL };
     struct ldb_message *msg;
+    struct ldb_dn *basedn;
     int ret;
 
-    if (!name) return EINVAL;
-
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
         return ENOMEM;
     }
 
-    ret = sysdb_search_netgroup_by_name(tmp_ctx, domain, name, NULL, &msg);
-    if (ret != EOK && ret != ENOENT) {
-        DEBUG(SSSDBG_TRACE_FUNC,
-              "sysdb_search_netgroup_by_name failed: %d (%s)\n",
-                   ret, strerror(ret));
-        goto done;
-    } else if (ret == ENOENT) {
-        DEBUG(SSSDBG_TRACE_FUNC,
-              "Netgroup does not exist, nothing to delete\n");
-        ret = EOK;
-        goto done;
+    if (name) {
+        ret = sysdb_search_user_by_name(tmp_ctx, domain, name, NULL, &msg);
+    } else {
+        ret = sysdb_search_user_by_uid(tmp_ctx, domain, uid, NULL, &msg);
     }
+    if (ret == EOK) {
+        if (name && uid) {
+            /* verify name/gid match */
+            const char *c_name;
+            uint64_t c_uid;
 
-    ret = sysdb_delete_entry(domain->sysdb, msg->dn, false);
-    if (ret != EOK) {
-        goto done;
-    }
+            c_name = ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL);
+            c_uid = ldb_msg_find_attr_as_uint64(msg, SYSDB_UIDNUM, 0);
+            if (c_name == NULL || c_uid == 0) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "Attribute is missing but this should never happen!\n");
+                ret = EFAULT;
+                goto fail;
+            }
+            if (strcmp(name, c_name) || uid != c_uid) {
+                /* this is not the entry we are looking for */
+                ret = EINVAL;
+                goto fail;
+            }
+        }
 
-done:
-    if (ret != EOK) {
-        DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
+        ret = sysdb_delete_entry(domain->sysdb, msg->dn, false);
+        if (ret) {
+            goto fail;
+        }
+    } else if (ret == ENOENT && name != NULL) {
+        /* Perhaps a ghost user? */
+        basedn = ldb_dn_new_fmt(tmp_ctx, domain->sysdb->ldb, SYSDB_DOM_BASE,
+                                domain->name);
+        if (basedn == NULL) {
+            ERROR_OUT(ret, ENOMEM, fail);
+        }
+
+        ret = sysdb_ghosts_remove_names(tmp_ctx, domain->sysdb, basedn, names,
+                                        NULL, NULL);
+        if (ret != EOK) {
+            goto fail;
+        }
+    } else {
+        goto fail;
     }
-    talloc_free(tmp_ctx);
+
+
+    talloc_zfree(tmp_ctx);
+    return EOK;
+
+fail:
+    DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
+    talloc_zfree(tmp_ctx);
     return ret;
 }
 
-int sysdb_delete_by_sid(struct sysdb_ctx *sysdb,
+
+/* =Search-Groups-with-Custom-Filter===================================== */
+
+int sysdb_search_groups(TALLOC_CTX *mem_ctx,
                         struct sss_domain_info *domain,
-                        const char *sid_str)
+                        const char *sub_filter,
+                        const char **attrs,
+                        size_t *msgs_count,
+                        struct ldb_message ***msgs)
 {
     TALLOC_CTX *tmp_ctx;
-    struct ldb_result *res;
+    struct ldb_dn *basedn;
+    char *filter;
     int ret;
 
-    if (!sid_str) return EINVAL;
-
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
         return ENOMEM;
     }
 
-    ret = sysdb_search_object_by_sid(tmp_ctx, domain, sid_str, NULL, &res);
-
-    if (ret == ENOENT) {
-        /* No existing entry. Just quit. */
-        DEBUG(SSSDBG_TRACE_FUNC,
-              "search by sid did not return any results.\n");
-        ret = EOK;
-        goto done;
-    } else if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "search by sid failed: %d (%s)\n",
-              ret, strerror(ret));
-        goto done;
+    basedn = sysdb_group_base_dn(tmp_ctx, domain);
+    if (!basedn) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to build base dn\n");
+        ret = ENOMEM;
+        goto fail;
     }
 
-    if (res->count > 1) {
-        DEBUG(SSSDBG_FATAL_FAILURE, "getbysid call returned more than one " \
-                                     "result !?!\n");
-        ret = EIO;
-        goto done;
+    filter = talloc_asprintf(tmp_ctx, "(&(%s)%s)", SYSDB_GC, sub_filter);
+    if (!filter) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to build filter\n");
+        ret = ENOMEM;
+        goto fail;
     }
 
-    ret = sysdb_delete_entry(sysdb, res->msgs[0]->dn, false);
-    if (ret != EOK) {
-        goto done;
-    }
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Search groups with filter: %s\n", filter);
+
+    ret = sysdb_search_entry(mem_ctx, domain->sysdb, basedn,
+                             LDB_SCOPE_SUBTREE, filter, attrs,
+                             msgs_count, msgs);
+    if (ret) {
+        goto fail;
+    }
+
+    talloc_zfree(tmp_ctx);
+    return EOK;
+
+fail:
+    if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "No such entry\n");
+    }
+    else if (ret) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
+    }
+    talloc_zfree(tmp_ctx);
+    return ret;
+}
+
+/* =Delete-Group-by-Name-OR-gid=========================================== */
+
+int sysdb_delete_group(struct sss_domain_info *domain,
+                       const char *name, gid_t gid)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    int ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    if (name) {
+        ret = sysdb_search_group_by_name(tmp_ctx, domain, name, NULL, &msg);
+    } else {
+        ret = sysdb_search_group_by_gid(tmp_ctx, domain, gid, NULL, &msg);
+    }
+    if (ret) {
+        goto fail;
+    }
+
+    if (name && gid) {
+        /* verify name/gid match */
+        const char *c_name;
+        uint64_t c_gid;
+
+        c_name = ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL);
+        c_gid = ldb_msg_find_attr_as_uint64(msg, SYSDB_GIDNUM, 0);
+        if (c_name == NULL || c_gid == 0) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Attribute is missing but this should never happen!\n");
+            ret = EFAULT;
+            goto fail;
+        }
+        if (strcmp(name, c_name) || gid != c_gid) {
+            /* this is not the entry we are looking for */
+            ret = EINVAL;
+            goto fail;
+        }
+    }
+
+    ret = sysdb_delete_entry(domain->sysdb, msg->dn, false);
+    if (ret) {
+        goto fail;
+    }
+
+    talloc_zfree(tmp_ctx);
+    return EOK;
+
+fail:
+    DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
+    talloc_zfree(tmp_ctx);
+    return ret;
+}
+
+/* =Search-Netgroups-with-Custom-Filter===================================== */
+
+int sysdb_search_netgroups(TALLOC_CTX *mem_ctx,
+                           struct sss_domain_info *domain,
+                           const char *sub_filter,
+                           const char **attrs,
+                           size_t *msgs_count,
+                           struct ldb_message ***msgs)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *basedn;
+    char *filter;
+    int ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    basedn = ldb_dn_new_fmt(tmp_ctx, domain->sysdb->ldb,
+                            SYSDB_TMPL_NETGROUP_BASE, domain->name);
+    if (!basedn) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to build base dn\n");
+        ret = ENOMEM;
+        goto fail;
+    }
+
+    filter = talloc_asprintf(tmp_ctx, "(&(%s)%s)", SYSDB_NC, sub_filter);
+    if (!filter) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to build filter\n");
+        ret = ENOMEM;
+        goto fail;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Search netgroups with filter: %s\n", filter);
+
+    ret = sysdb_search_entry(mem_ctx, domain->sysdb, basedn,
+                             LDB_SCOPE_SUBTREE, filter, attrs,
+                             msgs_count, msgs);
+    if (ret) {
+        goto fail;
+    }
+
+    talloc_zfree(tmp_ctx);
+    return EOK;
+
+fail:
+    if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Entry not found\n");
+    } else {
+        DEBUG(SSSDBG_OP_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
+    }
+    talloc_zfree(tmp_ctx);
+    return ret;
+}
+
+/* =Delete-Netgroup-by-Name============================================== */
+
+int sysdb_delete_netgroup(struct sss_domain_info *domain,
+                          const char *name)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    int ret;
+
+    if (!name) return EINVAL;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_search_netgroup_by_name(tmp_ctx, domain, name, NULL, &msg);
+    if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "sysdb_search_netgroup_by_name failed: %d (%s)\n",
+                   ret, strerror(ret));
+        goto done;
+    } else if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Netgroup does not exist, nothing to delete\n");
+        ret = EOK;
+        goto done;
+    }
+
+    ret = sysdb_delete_entry(domain->sysdb, msg->dn, false);
+    if (ret != EOK) {
+        goto done;
+    }
+
+done:
+    if (ret != EOK) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Error: %d (%s)\n", ret, strerror(ret));
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+int sysdb_delete_by_sid(struct sysdb_ctx *sysdb,
+                        struct sss_domain_info *domain,
+                        const char *sid_str)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    int ret;
+
+    if (!sid_str) return EINVAL;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_search_object_by_sid(tmp_ctx, domain, sid_str, NULL, &res);
+
+    if (ret == ENOENT) {
+        /* No existing entry. Just quit. */
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "search by sid did not return any results.\n");
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "search by sid failed: %d (%s)\n",
+              ret, strerror(ret));
+        goto done;
+    }
+
+    if (res->count > 1) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "getbysid call returned more than one " \
+                                     "result !?!\n");
+        ret = EIO;
+        goto done;
+    }
+
+    ret = sysdb_delete_entry(sysdb, res->msgs[0]->dn, false);
+    if (ret != EOK) {
+        goto done;
+    }
 
 done:
     if (ret != EOK) {
@@ -3179,19 +4227,19 @@ done:
     return ret;
 }
 
-static errno_t check_for_combined_2fa_password(struct sss_domain_info *domain,
-                                               struct ldb_message *ldb_msg,
-                                               const char *password,
-                                               const char *userhash)
+/* Returns the first factor of the password if the cached credentials are a
+ * combined 2FA password, EINVAL if they are not or the password is too
+ * short */
+static errno_t cached_2fa_first_factor(TALLOC_CTX *mem_ctx,
+                                       struct sss_domain_info *domain,
+                                       struct ldb_message *ldb_msg,
+                                       const char *password,
+                                       char **_short_pw)
 {
-
     unsigned int cached_authtok_type;
     unsigned int cached_fa2_len;
     char *short_pw;
-    char *comphash;
     size_t pw_len;
-    TALLOC_CTX *tmp_ctx;
-    int ret;
 
     cached_authtok_type = ldb_msg_find_attr_as_uint(ldb_msg,
                                                     SYSDB_CACHEDPWD_TYPE,
@@ -3214,16 +4262,36 @@ static errno_t check_for_combined_2fa_password(struct sss_domain_info *domain,
         return EINVAL;
     }
 
+    short_pw = talloc_strndup(mem_ctx, password, (pw_len - cached_fa2_len));
+    if (short_pw == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "talloc_strndup failed.\n");
+        return ENOMEM;
+    }
+
+    *_short_pw = short_pw;
+    return EOK;
+}
+
+static errno_t check_for_combined_2fa_password(struct sss_domain_info *domain,
+                                               struct ldb_message *ldb_msg,
+                                               const char *password,
+                                               const char *userhash)
+{
+
+    char *short_pw = NULL;
+    char *comphash;
+    TALLOC_CTX *tmp_ctx;
+    int ret;
+
     tmp_ctx = talloc_new(NULL);
     if (tmp_ctx == NULL) {
         DEBUG(SSSDBG_OP_FAILURE, "talloc_new failed.\n");
         return ENOMEM;
     }
 
-    short_pw = talloc_strndup(tmp_ctx, password, (pw_len - cached_fa2_len));
-    if (short_pw == NULL) {
-        DEBUG(SSSDBG_OP_FAILURE, "talloc_strndup failed.\n");
-        ret = ENOMEM;
+    ret = cached_2fa_first_factor(tmp_ctx, domain, ldb_msg, password,
+                                  &short_pw);
+    if (ret != EOK) {
         goto done;
     }
 
@@ -3244,20 +4312,53 @@ static errno_t check_for_combined_2fa_password(struct sss_domain_info *domain,
     ret = EOK;
 
 done:
+    if (short_pw != NULL) {
+        safezero(short_pw, strlen(short_pw));
+    }
     talloc_free(tmp_ctx);
 
     return ret;
 }
 
-int sysdb_cache_auth(struct sss_domain_info *domain,
-                     const char *name,
-                     const char *password,
-                     struct confdb_ctx *cdb,
-                     bool just_check,
-                     time_t *_expire_date,
-                     time_t *_delayed_until)
+static errno_t sysdb_cache_auth_check_args(struct sss_domain_info *domain,
+                                           const char *name,
+                                           struct confdb_ctx *cdb)
+{
+    if (name == NULL || *name == '\0') {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Missing user name.\n");
+        return EINVAL;
+    }
+
+    if (cdb == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Missing config db context.\n");
+        return EINVAL;
+    }
+
+    if (domain->sysdb == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Missing sysdb db context.\n");
+        return EINVAL;
+    }
+
+    if (!domain->cache_credentials) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cached credentials not available.\n");
+        return EINVAL;
+    }
+
+    return EOK;
+}
+
+/* Reads the cached credentials of the user and checks if they may be used,
+ * the expiration and delay are returned in any case */
+static errno_t sysdb_cache_auth_lookup(TALLOC_CTX *mem_ctx,
+                                       struct sss_domain_info *domain,
+                                       const char *name,
+                                       struct confdb_ctx *cdb,
+                                       struct ldb_message **_ldb_msg,
+                                       const char **_userhash,
+                                       uint32_t *_failed_login_attempts,
+                                       time_t *_expire_date,
+                                       time_t *_delayed_until)
 {
-    TALLOC_CTX *tmp_ctx;
     const char *attrs[] = { SYSDB_NAME, SYSDB_CACHEDPWD, SYSDB_DISABLED,
                             SYSDB_LAST_LOGIN, SYSDB_LAST_ONLINE_AUTH,
                             "lastCachedPasswordChange",
@@ -3266,197 +4367,547 @@ int sysdb_cache_auth(struct sss_domain_info *domain,
                             SYSDB_CACHEDPWD_FA2_LEN, NULL };
     struct ldb_message *ldb_msg;
     const char *userhash;
-    char *comphash;
     uint64_t lastLogin = 0;
     int cred_expiration;
-    uint32_t failed_login_attempts = 0;
+    int ret;
+
+    ret = sysdb_search_user_by_name(mem_ctx, domain, name, attrs, &ldb_msg);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "sysdb_search_user_by_name failed [%d][%s].\n",
+                  ret, strerror(ret));
+        if (ret == ENOENT) ret = ERR_ACCOUNT_UNKNOWN;
+        return ret;
+    }
+
+    /* Check offline_auth_cache_timeout */
+    lastLogin = ldb_msg_find_attr_as_uint64(ldb_msg,
+                                            SYSDB_LAST_ONLINE_AUTH,
+                                            0);
+
+    ret = confdb_get_int(cdb, CONFDB_PAM_CONF_ENTRY,
+                         CONFDB_PAM_CRED_TIMEOUT, 0, &cred_expiration);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to read expiration time of offline credentials.\n");
+        return ret;
+    }
+    DEBUG(SSSDBG_TRACE_ALL, "Offline credentials expiration is [%d] days.\n",
+              cred_expiration);
+
+    if (cred_expiration) {
+        *_expire_date = lastLogin + (cred_expiration * 86400);
+        if (*_expire_date < time(NULL)) {
+            DEBUG(SSSDBG_CONF_SETTINGS, "Cached user entry is too old.\n");
+            *_expire_date = 0;
+            return ERR_CACHED_CREDS_EXPIRED;
+        }
+    } else {
+        *_expire_date = 0;
+    }
+
+    ret = check_failed_login_attempts(cdb, ldb_msg, _failed_login_attempts,
+                                      _delayed_until);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to check login attempts\n");
+        return ret;
+    }
+
+    /* TODO: verify user account (disabled, expired ...) */
+
+    userhash = ldb_msg_find_attr_as_string(ldb_msg, SYSDB_CACHEDPWD, NULL);
+    if (userhash == NULL || *userhash == '\0') {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Cached credentials not available.\n");
+        return ERR_NO_CACHED_CREDS;
+    }
+
+    *_ldb_msg = ldb_msg;
+    *_userhash = userhash;
+    return EOK;
+}
+
+static errno_t sysdb_cache_auth_update(struct sss_domain_info *domain,
+                                       const char *name,
+                                       bool authentication_successful,
+                                       uint32_t failed_login_attempts)
+{
+    TALLOC_CTX *tmp_ctx;
     struct sysdb_attrs *update_attrs;
+    int ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    update_attrs = sysdb_new_attrs(tmp_ctx);
+    if (update_attrs == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_new_attrs failed.\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    if (authentication_successful) {
+        ret = sysdb_attrs_add_time_t(update_attrs,
+                                     SYSDB_LAST_LOGIN, time(NULL));
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_attrs_add_time_t failed, "
+                      "but authentication is successful.\n");
+            ret = EOK;
+            goto done;
+        }
+
+        ret = sysdb_attrs_add_uint32(update_attrs,
+                                     SYSDB_FAILED_LOGIN_ATTEMPTS, 0U);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_attrs_add_uint32 failed, "
+                      "but authentication is successful.\n");
+            ret = EOK;
+            goto done;
+        }
+
+    } else {
+        ret = sysdb_attrs_add_time_t(update_attrs,
+                                     SYSDB_LAST_FAILED_LOGIN,
+                                     time(NULL));
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_attrs_add_time_t failed.\n");
+            goto done;
+        }
+
+        ret = sysdb_attrs_add_uint32(update_attrs,
+                                     SYSDB_FAILED_LOGIN_ATTEMPTS,
+                                     ++failed_login_attempts);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_attrs_add_uint32 failed.\n");
+            goto done;
+        }
+    }
+
+    ret = sysdb_set_user_attr(domain, name, update_attrs,
+                              LDB_FLAG_MOD_REPLACE);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to update Login attempt information!\n");
+    }
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+int sysdb_cache_auth(struct sss_domain_info *domain,
+                     const char *name,
+                     const char *password,
+                     struct confdb_ctx *cdb,
+                     bool just_check,
+                     time_t *_expire_date,
+                     time_t *_delayed_until)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *ldb_msg;
+    const char *userhash;
+    char *comphash;
+    uint32_t failed_login_attempts = 0;
     bool authentication_successful = false;
     time_t expire_date = -1;
     time_t delayed_until = -1;
     int ret;
 
-    if (name == NULL || *name == '\0') {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Missing user name.\n");
-        return EINVAL;
+    ret = sysdb_cache_auth_check_args(domain, name, cdb);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    ret = ldb_transaction_start(domain->sysdb->ldb);
+    if (ret) {
+        talloc_zfree(tmp_ctx);
+        ret = sysdb_error_to_errno(ret);
+        return ret;
+    }
+
+    ret = sysdb_cache_auth_lookup(tmp_ctx, domain, name, cdb, &ldb_msg,
+                                  &userhash, &failed_login_attempts,
+                                  &expire_date, &delayed_until);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = s3crypt_sha512(tmp_ctx, password, userhash, &comphash);
+    if (ret) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to create password hash.\n");
+        ret = ERR_INTERNAL;
+        goto done;
+    }
+
+    if (strcmp(userhash, comphash) == 0
+            || check_for_combined_2fa_password(domain, ldb_msg,
+                                               password, userhash) == EOK) {
+        /* TODO: probable good point for audit logging */
+        DEBUG(SSSDBG_CONF_SETTINGS, "Hashes do match!\n");
+        authentication_successful = true;
+
+        if (just_check) {
+            ret = EOK;
+            goto done;
+        }
+    } else {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Authentication failed.\n");
+        authentication_successful = false;
+    }
+
+    ret = sysdb_cache_auth_update(domain, name, authentication_successful,
+                                  failed_login_attempts);
+
+done:
+    if (_expire_date != NULL) {
+        *_expire_date = expire_date;
+    }
+    if (_delayed_until != NULL) {
+        *_delayed_until = delayed_until;
+    }
+    if (ret) {
+        ldb_transaction_cancel(domain->sysdb->ldb);
+    } else {
+        ret = ldb_transaction_commit(domain->sysdb->ldb);
+        ret = sysdb_error_to_errno(ret);
+        if (ret) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to commit transaction!\n");
+        }
+    }
+    if (authentication_successful) {
+        ret = EOK;
+    } else {
+        if (ret == EOK) {
+            ret = ERR_AUTH_FAILED;
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* The asynchronous variant reads the entry and computes the hashes outside
+ * of a transaction. The entry is read again before the result is written,
+ * if the cached password changed in the meantime the check is repeated. */
+struct sysdb_cache_auth_state {
+    struct tevent_context *ev;
+    struct sss_domain_info *domain;
+    const char *name;
+    char *password;
+    struct confdb_ctx *cdb;
+    bool just_check;
+
+    TALLOC_CTX *lookup_ctx;
+    const char *userhash;
+    char *short_pw;
+    bool restarted;
+
+    time_t expire_date;
+    time_t delayed_until;
+};
+
+static errno_t sysdb_cache_auth_step(struct tevent_req *req);
+static void sysdb_cache_auth_hash_done(struct tevent_req *subreq);
+static void sysdb_cache_auth_short_done(struct tevent_req *subreq);
+static void sysdb_cache_auth_finish(struct tevent_req *req,
+                                    bool authentication_successful);
+
+static int sysdb_cache_auth_state_destructor(struct sysdb_cache_auth_state *state)
+{
+    if (state->password != NULL) {
+        safezero(state->password, strlen(state->password));
+    }
+    if (state->short_pw != NULL) {
+        safezero(state->short_pw, strlen(state->short_pw));
+    }
+
+    return 0;
+}
+
+struct tevent_req *sysdb_cache_auth_send(TALLOC_CTX *mem_ctx,
+                                         struct tevent_context *ev,
+                                         struct sss_domain_info *domain,
+                                         const char *name,
+                                         const char *password,
+                                         struct confdb_ctx *cdb,
+                                         bool just_check)
+{
+    struct sysdb_cache_auth_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct sysdb_cache_auth_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    talloc_set_destructor(state, sysdb_cache_auth_state_destructor);
+
+    state->ev = ev;
+    state->domain = domain;
+    state->cdb = cdb;
+    state->just_check = just_check;
+    state->expire_date = -1;
+    state->delayed_until = -1;
+
+    ret = sysdb_cache_auth_check_args(domain, name, cdb);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    state->name = talloc_strdup(state, name);
+    state->password = talloc_strdup(state, password);
+    if (state->name == NULL || state->password == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    ret = sysdb_cache_auth_step(req);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    return req;
+
+immediately:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static errno_t sysdb_cache_auth_step(struct tevent_req *req)
+{
+    struct sysdb_cache_auth_state *state;
+    struct tevent_req *subreq;
+    struct ldb_message *ldb_msg;
+    uint32_t failed_login_attempts;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct sysdb_cache_auth_state);
+
+    talloc_zfree(state->lookup_ctx);
+    state->lookup_ctx = talloc_new(state);
+    if (state->lookup_ctx == NULL) {
+        return ENOMEM;
     }
 
-    if (cdb == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Missing config db context.\n");
-        return EINVAL;
-    }
+    ret = sysdb_cache_auth_lookup(state->lookup_ctx, state->domain,
+                                  state->name, state->cdb, &ldb_msg,
+                                  &state->userhash, &failed_login_attempts,
+                                  &state->expire_date, &state->delayed_until);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (state->short_pw != NULL) {
+        safezero(state->short_pw, strlen(state->short_pw));
+        talloc_zfree(state->short_pw);
+    }
+
+    /* only tried if the full password does not match */
+    ret = cached_2fa_first_factor(state, state->domain, ldb_msg,
+                                  state->password, &state->short_pw);
+    if (ret == ENOMEM) {
+        return ret;
+    }
+
+    subreq = s3crypt_sha512_send(state, state->ev, state->password,
+                                 state->userhash);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(subreq, sysdb_cache_auth_hash_done, req);
+
+    return EOK;
+}
+
+static void sysdb_cache_auth_hash_done(struct tevent_req *subreq)
+{
+    struct sysdb_cache_auth_state *state;
+    struct tevent_req *req;
+    char *comphash;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sysdb_cache_auth_state);
 
-    if (domain->sysdb == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Missing sysdb db context.\n");
-        return EINVAL;
+    ret = s3crypt_sha512_recv(subreq, state->lookup_ctx, &comphash);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to create password hash.\n");
+        tevent_req_error(req, ERR_INTERNAL);
+        return;
     }
 
-    if (!domain->cache_credentials) {
-        DEBUG(SSSDBG_MINOR_FAILURE, "Cached credentials not available.\n");
-        return EINVAL;
+    if (strcmp(state->userhash, comphash) == 0) {
+        sysdb_cache_auth_finish(req, true);
+        return;
     }
 
-    tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
-        return ENOMEM;
+    if (state->short_pw == NULL) {
+        sysdb_cache_auth_finish(req, false);
+        return;
     }
 
-    ret = ldb_transaction_start(domain->sysdb->ldb);
-    if (ret) {
-        talloc_zfree(tmp_ctx);
-        ret = sysdb_error_to_errno(ret);
-        return ret;
+    subreq = s3crypt_sha512_send(state, state->ev, state->short_pw,
+                                 state->userhash);
+    if (subreq == NULL) {
+        tevent_req_error(req, ENOMEM);
+        return;
     }
+    tevent_req_set_callback(subreq, sysdb_cache_auth_short_done, req);
+}
 
-    ret = sysdb_search_user_by_name(tmp_ctx, domain, name, attrs, &ldb_msg);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "sysdb_search_user_by_name failed [%d][%s].\n",
-                  ret, strerror(ret));
-        if (ret == ENOENT) ret = ERR_ACCOUNT_UNKNOWN;
-        goto done;
-    }
+static void sysdb_cache_auth_short_done(struct tevent_req *subreq)
+{
+    struct sysdb_cache_auth_state *state;
+    struct tevent_req *req;
+    char *comphash;
+    errno_t ret;
 
-    /* Check offline_auth_cache_timeout */
-    lastLogin = ldb_msg_find_attr_as_uint64(ldb_msg,
-                                            SYSDB_LAST_ONLINE_AUTH,
-                                            0);
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sysdb_cache_auth_state);
 
-    ret = confdb_get_int(cdb, CONFDB_PAM_CONF_ENTRY,
-                         CONFDB_PAM_CRED_TIMEOUT, 0, &cred_expiration);
+    ret = s3crypt_sha512_recv(subreq, state->lookup_ctx, &comphash);
+    talloc_zfree(subreq);
     if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "Failed to read expiration time of offline credentials.\n");
-        goto done;
+        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to create password hash.\n");
+        sysdb_cache_auth_finish(req, false);
+        return;
     }
-    DEBUG(SSSDBG_TRACE_ALL, "Offline credentials expiration is [%d] days.\n",
-              cred_expiration);
 
-    if (cred_expiration) {
-        expire_date = lastLogin + (cred_expiration * 86400);
-        if (expire_date < time(NULL)) {
-            DEBUG(SSSDBG_CONF_SETTINGS, "Cached user entry is too old.\n");
-            expire_date = 0;
-            ret = ERR_CACHED_CREDS_EXPIRED;
-            goto done;
-        }
-    } else {
-        expire_date = 0;
+    if (strcmp(state->userhash, comphash) != 0) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Hash of shorten password does not match.\n");
+        sysdb_cache_auth_finish(req, false);
+        return;
     }
 
-    ret = check_failed_login_attempts(cdb, ldb_msg, &failed_login_attempts,
-                                      &delayed_until);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to check login attempts\n");
-        goto done;
-    }
+    sysdb_cache_auth_finish(req, true);
+}
 
-    /* TODO: verify user account (disabled, expired ...) */
+static void sysdb_cache_auth_finish(struct tevent_req *req,
+                                    bool authentication_successful)
+{
+    struct sysdb_cache_auth_state *state;
+    struct ldb_message *ldb_msg;
+    const char *userhash;
+    uint32_t failed_login_attempts = 0;
+    bool in_transaction = false;
+    TALLOC_CTX *tmp_ctx;
+    errno_t sret;
+    errno_t ret;
 
-    userhash = ldb_msg_find_attr_as_string(ldb_msg, SYSDB_CACHEDPWD, NULL);
-    if (userhash == NULL || *userhash == '\0') {
-        DEBUG(SSSDBG_CONF_SETTINGS, "Cached credentials not available.\n");
-        ret = ERR_NO_CACHED_CREDS;
-        goto done;
+    state = tevent_req_data(req, struct sysdb_cache_auth_state);
+
+    if (authentication_successful) {
+        /* TODO: probable good point for audit logging */
+        DEBUG(SSSDBG_CONF_SETTINGS, "Hashes do match!\n");
+        if (state->just_check) {
+            tevent_req_done(req);
+            return;
+        }
+    } else {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Authentication failed.\n");
     }
 
-    ret = s3crypt_sha512(tmp_ctx, password, userhash, &comphash);
-    if (ret) {
-        DEBUG(SSSDBG_CONF_SETTINGS, "Failed to create password hash.\n");
-        ret = ERR_INTERNAL;
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        ret = ENOMEM;
         goto done;
     }
 
-    update_attrs = sysdb_new_attrs(tmp_ctx);
-    if (update_attrs == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_new_attrs failed.\n");
-        ret = ENOMEM;
+    ret = sysdb_transaction_start(state->domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
         goto done;
     }
+    in_transaction = true;
 
-    if (strcmp(userhash, comphash) == 0
-            || check_for_combined_2fa_password(domain, ldb_msg,
-                                               password, userhash) == EOK) {
-        /* TODO: probable good point for audit logging */
-        DEBUG(SSSDBG_CONF_SETTINGS, "Hashes do match!\n");
-        authentication_successful = true;
+    ret = sysdb_cache_auth_lookup(tmp_ctx, state->domain, state->name,
+                                  state->cdb, &ldb_msg, &userhash,
+                                  &failed_login_attempts, &state->expire_date,
+                                  &state->delayed_until);
+    if (ret != EOK) {
+        goto done;
+    }
 
-        if (just_check) {
-            ret = EOK;
+    if (strcmp(userhash, state->userhash) != 0) {
+        sret = sysdb_transaction_cancel(state->domain->sysdb);
+        in_transaction = false;
+        if (sret != EOK || state->restarted) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "The cached password of [%s] keeps changing.\n",
+                  state->name);
+            authentication_successful = false;
+            ret = ERR_INTERNAL;
             goto done;
         }
 
-        ret = sysdb_attrs_add_time_t(update_attrs,
-                                     SYSDB_LAST_LOGIN, time(NULL));
+        DEBUG(SSSDBG_TRACE_FUNC, "The cached password of [%s] was changed, "
+              "checking again.\n", state->name);
+        state->restarted = true;
+        ret = sysdb_cache_auth_step(req);
         if (ret != EOK) {
-            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_attrs_add_time_t failed, "
-                      "but authentication is successful.\n");
-            ret = EOK;
             goto done;
         }
 
-        ret = sysdb_attrs_add_uint32(update_attrs,
-                                     SYSDB_FAILED_LOGIN_ATTEMPTS, 0U);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_attrs_add_uint32 failed, "
-                      "but authentication is successful.\n");
-            ret = EOK;
-            goto done;
-        }
+        talloc_free(tmp_ctx);
+        return;
+    }
 
-    } else {
-        DEBUG(SSSDBG_CONF_SETTINGS, "Authentication failed.\n");
-        authentication_successful = false;
+    ret = sysdb_cache_auth_update(state->domain, state->name,
+                                  authentication_successful,
+                                  failed_login_attempts);
+    if (ret != EOK) {
+        goto done;
+    }
 
-        ret = sysdb_attrs_add_time_t(update_attrs,
-                                     SYSDB_LAST_FAILED_LOGIN,
-                                     time(NULL));
-        if (ret != EOK) {
-            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_attrs_add_time_t failed.\n");
-            goto done;
-        }
+    ret = sysdb_transaction_commit(state->domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to commit transaction!\n");
+        goto done;
+    }
+    in_transaction = false;
 
-        ret = sysdb_attrs_add_uint32(update_attrs,
-                                     SYSDB_FAILED_LOGIN_ATTEMPTS,
-                                     ++failed_login_attempts);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_MINOR_FAILURE, "sysdb_attrs_add_uint32 failed.\n");
-            goto done;
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(state->domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
         }
     }
+    talloc_free(tmp_ctx);
 
-    ret = sysdb_set_user_attr(domain, name, update_attrs,
-                              LDB_FLAG_MOD_REPLACE);
-    if (ret) {
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "Failed to update Login attempt information!\n");
+    if (authentication_successful) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret == EOK ? ERR_AUTH_FAILED : ret);
     }
+}
+
+errno_t sysdb_cache_auth_recv(struct tevent_req *req,
+                              time_t *_expire_date,
+                              time_t *_delayed_until)
+{
+    struct sysdb_cache_auth_state *state;
+
+    state = tevent_req_data(req, struct sysdb_cache_auth_state);
 
-done:
     if (_expire_date != NULL) {
-        *_expire_date = expire_date;
+        *_expire_date = state->expire_date;
     }
     if (_delayed_until != NULL) {
-        *_delayed_until = delayed_until;
-    }
-    if (ret) {
-        ldb_transaction_cancel(domain->sysdb->ldb);
-    } else {
-        ret = ldb_transaction_commit(domain->sysdb->ldb);
-        ret = sysdb_error_to_errno(ret);
-        if (ret) {
-            DEBUG(SSSDBG_OP_FAILURE, "Failed to commit transaction!\n");
-        }
-    }
-    if (authentication_successful) {
-        ret = EOK;
-    } else {
-        if (ret == EOK) {
-            ret = ERR_AUTH_FAILED;
-        }
+        *_delayed_until = state->delayed_until;
     }
-    talloc_free(tmp_ctx);
-    return ret;
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
 }
 
 static errno_t sysdb_update_members_ex(struct sss_domain_info *domain,
@@ -3610,6 +5061,11 @@ errno_t sysdb_remove_attrs(struct sss_domain_info *domain,
             goto done;
         }
 
+        ret = sysdb_msg_add_cert_hashes(msg);
+        if (ret != EOK) {
+            goto done;
+        }
+
         /* We need to do individual modifies so that we can
          * skip unknown attributes. Otherwise, any nonexistent
          * attribute in the sysdb will cause other removals to
@@ -3626,6 +5082,7 @@ errno_t sysdb_remove_attrs(struct sss_domain_info *domain,
 
         /* Remove this attribute and move on to the next one */
         ldb_msg_remove_attr(msg, remove_attrs[i]);
+        ldb_msg_remove_attr(msg, SYSDB_USER_CERT_HASH);
     }
 
     ret = sysdb_transaction_commit(domain->sysdb);
@@ -3661,6 +5118,7 @@ static errno_t sysdb_search_object_by_str_attr(TALLOC_CTX *mem_ctx,
                                 SYSDB_DEFAULT_ATTRS,
                                 NULL };
     struct ldb_dn *basedn;
+    char *filter;
     int ret;
     struct ldb_result *res = NULL;
 
@@ -3677,11 +5135,15 @@ static errno_t sysdb_search_object_by_str_attr(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res,
-                     basedn, LDB_SCOPE_SUBTREE, attrs?attrs:def_attrs,
-                     filter_tmpl, str);
+    filter = talloc_asprintf(tmp_ctx, filter_tmpl, str);
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_ts_search(tmp_ctx, domain->sysdb, basedn, LDB_SCOPE_SUBTREE,
+                          filter, attrs?attrs:def_attrs, &res);
     if (ret != EOK) {
-        ret = sysdb_error_to_errno(ret);
         DEBUG(SSSDBG_OP_FAILURE, "ldb_search failed.\n");
         goto done;
     }
@@ -3720,6 +5182,111 @@ errno_t sysdb_search_object_by_sid(TALLOC_CTX *mem_ctx,
                                            sid_str, attrs, res);
 }
 
+/* Keeps the OR-filters of sysdb_search_objects_by_sids() reasonably short */
+#define SYSDB_SIDS_PER_SEARCH 100
+
+errno_t sysdb_search_objects_by_sids(TALLOC_CTX *mem_ctx,
+                                     struct sss_domain_info *domain,
+                                     const char **sid_strs,
+                                     size_t num_sids,
+                                     const char **attrs,
+                                     struct ldb_result **_res)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char *def_attrs[] = { SYSDB_NAME, SYSDB_UIDNUM, SYSDB_GIDNUM,
+                                SYSDB_SID_STR, SYSDB_DEFAULT_ATTRS,
+                                NULL };
+    struct ldb_result *res;
+    struct ldb_result *chunk;
+    struct ldb_dn *basedn;
+    char *sanitized;
+    char *filter;
+    size_t i;
+    size_t c;
+    int ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    res = talloc_zero(tmp_ctx, struct ldb_result);
+    if (res == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    basedn = ldb_dn_new_fmt(tmp_ctx, domain->sysdb->ldb, SYSDB_DOM_BASE,
+                            domain->name);
+    if (basedn == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldb_dn_new_fmt failed.\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_sids; i += SYSDB_SIDS_PER_SEARCH) {
+        filter = talloc_asprintf(tmp_ctx, "(&(|(%s)(%s))(|",
+                                 SYSDB_UC, SYSDB_GC);
+        for (c = i; c < num_sids && c < i + SYSDB_SIDS_PER_SEARCH; c++) {
+            if (filter == NULL) {
+                break;
+            }
+
+            ret = sss_filter_sanitize(tmp_ctx, sid_strs[c], &sanitized);
+            if (ret != EOK) {
+                goto done;
+            }
+
+            filter = talloc_asprintf_append(filter, "(%s=%s)",
+                                            SYSDB_SID_STR, sanitized);
+            talloc_free(sanitized);
+        }
+        if (filter != NULL) {
+            filter = talloc_strdup_append(filter, "))");
+        }
+        if (filter == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sysdb_ts_search(tmp_ctx, domain->sysdb, basedn,
+                              LDB_SCOPE_SUBTREE, filter,
+                              attrs ? attrs : def_attrs, &chunk);
+        talloc_free(filter);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "ldb_search failed.\n");
+            goto done;
+        }
+
+        if (chunk->count == 0) {
+            talloc_free(chunk);
+            continue;
+        }
+
+        res->msgs = talloc_realloc(res, res->msgs, struct ldb_message *,
+                                   res->count + chunk->count + 1);
+        if (res->msgs == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (c = 0; c < chunk->count; c++) {
+            res->msgs[res->count + c] = talloc_steal(res->msgs,
+                                                     chunk->msgs[c]);
+        }
+        res->count += chunk->count;
+        res->msgs[res->count] = NULL;
+        talloc_free(chunk);
+    }
+
+    *_res = talloc_steal(mem_ctx, res);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 errno_t sysdb_search_object_by_uuid(TALLOC_CTX *mem_ctx,
                                     struct sss_domain_info *domain,
                                     const char *uuid_str,
@@ -3737,19 +5304,28 @@ errno_t sysdb_search_object_by_cert(TALLOC_CTX *mem_ctx,
                                     struct ldb_result **res)
 {
     int ret;
-    char *user_filter;
+    unsigned char *der;
+    size_t der_size;
+    char *hash;
+
+    der = sss_base64_decode(mem_ctx, cert, &der_size);
+    if (der == NULL || der_size == 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "sss_base64_decode failed.\n");
+        talloc_free(der);
+        return EINVAL;
+    }
 
-    ret = sss_cert_derb64_to_ldap_filter(mem_ctx, cert, SYSDB_USER_CERT,
-                                         &user_filter);
+    /* the fixed size hash is indexed, unlike the certificate itself */
+    ret = sysdb_cert_hash(mem_ctx, der, der_size, &hash);
+    talloc_free(der);
     if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "sss_cert_derb64_to_ldap_filter failed.\n");
         return ret;
     }
 
     ret = sysdb_search_object_by_str_attr(mem_ctx, domain,
-                                          SYSDB_USER_CERT_FILTER,
-                                          user_filter, attrs, res);
-    talloc_free(user_filter);
+                                          SYSDB_USER_CERT_HASH_FILTER,
+                                          hash, attrs, res);
+    talloc_free(hash);
 
     return ret;
 }
@@ -23,6 +23,9 @@
 #ifndef __INT_SYS_DB_H__
 #define __INT_SYS_DB_H__
 
+#define SYSDB_VERSION_0_20 "0.20"
+#define SYSDB_VERSION_0_19 "0.19"
+#define SYSDB_VERSION_0_18 "0.18"
 #define SYSDB_VERSION_0_17 "0.17"
 #define SYSDB_VERSION_0_16 "0.16"
 #define SYSDB_VERSION_0_15 "0.15"
@@ -41,7 +44,7 @@
 #define SYSDB_VERSION_0_2 "0.2"
 #define SYSDB_VERSION_0_1 "0.1"
 
-#define SYSDB_VERSION SYSDB_VERSION_0_17
+#define SYSDB_VERSION SYSDB_VERSION_0_20
 
 #define SYSDB_BASE_LDIF \
      "dn: @ATTRIBUTES\n" \
@@ -52,6 +55,7 @@
      "dn: CASE_INSENSITIVE\n" \
      "originalDN: CASE_INSENSITIVE\n" \
      "objectclass: CASE_INSENSITIVE\n" \
+     "ghostGroup: CASE_INSENSITIVE\n" \
      "\n" \
      "dn: @INDEXLIST\n" \
      "@IDXATTR: cn\n" \
@@ -70,6 +74,13 @@
      "@IDXATTR: sudoUser\n" \
      "@IDXATTR: sshKnownHostsExpire\n" \
      "@IDXATTR: objectSIDString\n" \
+     "@IDXATTR: uniqueID\n" \
+     "@IDXATTR: userCertificate\n" \
+     "@IDXATTR: userCertificateSha256\n" \
+     "@IDXATTR: userPrincipalName\n" \
+     "@IDXATTR: canonicalUserPrincipalName\n" \
+     "@IDXATTR: ghostName\n" \
+     "@IDXATTR: ghostGroup\n" \
      "@IDXONE: 1\n" \
      "\n" \
      "dn: @MODULES\n" \
@@ -84,14 +95,80 @@
      "cn: ranges\n" \
      "\n"
 
+/* The ghost members of the groups, see sysdb_ghosts.c */
+#define SYSDB_GHOSTS_CONTAINER "cn=ghosts"
+#define SYSDB_GHOST_NAME "ghostName"
+#define SYSDB_GHOST_GROUP "ghostGroup"
+#define SYSDB_GHOST_BUCKETS 32
+
+/* Format of the precomputed initgroups result, "<version>:<gid>,<gid>..." */
+#define SYSDB_INITGR_GIDS_VERSION 1
+
+/* If set in the environment, searches which ldb cannot answer from an
+ * index are logged with their filter and duration */
+#define SYSDB_WARN_UNINDEXED_ENV "SSS_SYSDB_WARN_UNINDEXED"
+
+/* The timestamp cache keeps the timestamps of users and groups which
+ * change on every refresh, so that a refresh which changes nothing else
+ * does not rewrite the entry in the cache. It is disposable, a file of an
+ * unknown version is recreated. */
+#define SYSDB_TS_VERSION "0.1"
+
+#define SYSDB_TS_BASE_LDIF \
+     "dn: @ATTRIBUTES\n" \
+     "cn: CASE_INSENSITIVE\n" \
+     "dc: CASE_INSENSITIVE\n" \
+     "dn: CASE_INSENSITIVE\n" \
+     "\n" \
+     "dn: cn=sysdb\n" \
+     "cn: sysdb\n" \
+     "version: " SYSDB_TS_VERSION "\n" \
+     "description: timestamp cache\n" \
+     "\n"
+
+/* The value of SYSDB_CACHE_EXPIRE in the cache when the timestamps were
+ * written, the timestamps are outdated if the cache says otherwise. */
+#define SYSDB_TS_CACHE_EXPIRE "cacheExpireTimestamp"
+
 #include "db/sysdb.h"
 
 struct sysdb_ctx {
     struct ldb_context *ldb;
     char *ldb_file;
+
+    /* the timestamp cache, NULL for the local domain */
+    struct ldb_context *ldb_ts;
+    char *ldb_ts_file;
+
+    bool warn_unindexed;
+    /* @IDXATTR of @INDEXLIST, read on the first check */
+    struct ldb_message_element *indexes;
+
+    /* the read-only copy of the cache, 0 if disabled */
+    uint32_t snapshot_interval;
+    bool snapshot_publisher;
+    time_t snapshot_published;
+    time_t snapshot_checked;
+    ino_t snapshot_ino;
+    /* the copy which was published before the last provider request */
+    ino_t snapshot_stale_ino;
+    bool snapshot_current;
+    char *ldb_snap_file;
+    struct ldb_context *ldb_snap;
+    char *ldb_ts_snap_file;
+    struct ldb_context *ldb_ts_snap;
+
+    /* the files are opened without fsync(), see sysdb_sync.c */
+    bool nosync;
+    struct sysdb_sync *sync;
+
+    /* the depth of the transactions, only reported to the probes */
+    int transaction_nesting;
 };
 
 /* Internal utility functions */
+void sysdb_sync_committed(struct sysdb_ctx *sysdb);
+
 int sysdb_get_db_file(TALLOC_CTX *mem_ctx,
                       const char *provider, const char *name,
                       const char *base_path, char **_ldb_file);
@@ -101,6 +178,7 @@ int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
                                struct sss_domain_info *domain,
                                const char *db_path,
                                bool allow_upgrade,
+                               uint32_t flags,
                                struct sysdb_ctx **_ctx);
 
 /* Upgrade routines */
@@ -123,6 +201,88 @@ int sysdb_upgrade_13(struct sysdb_ctx *sysdb, const char **ver);
 int sysdb_upgrade_14(struct sysdb_ctx *sysdb, const char **ver);
 int sysdb_upgrade_15(struct sysdb_ctx *sysdb, const char **ver);
 int sysdb_upgrade_16(struct sysdb_ctx *sysdb, const char **ver);
+int sysdb_upgrade_17(struct sysdb_ctx *sysdb, const char **ver);
+int sysdb_upgrade_18(struct sysdb_ctx *sysdb, const char **ver);
+int sysdb_upgrade_19(struct sysdb_ctx *sysdb, const char **ver);
+
+/* The lowercase hex SHA-256 of the DER certificate, the certificates are
+ * searched by it in the cache */
+errno_t sysdb_cert_hash(TALLOC_CTX *mem_ctx,
+                        const uint8_t *der, size_t der_len,
+                        char **_hash);
+
+/* Timestamp cache */
+errno_t sysdb_ts_modify(struct sysdb_ctx *sysdb,
+                        struct ldb_message *msg,
+                        struct ldb_message *old);
+errno_t sysdb_ts_delete_entry(struct sysdb_ctx *sysdb, struct ldb_dn *dn);
+errno_t sysdb_ts_merge_msgs(struct sysdb_ctx *sysdb,
+                            size_t count,
+                            struct ldb_message **msgs);
+errno_t sysdb_ts_merge_res(struct sysdb_ctx *sysdb, struct ldb_result *res);
+errno_t sysdb_ts_search(TALLOC_CTX *mem_ctx,
+                        struct sysdb_ctx *sysdb,
+                        struct ldb_dn *base_dn,
+                        enum ldb_scope scope,
+                        const char *filter,
+                        const char **attrs,
+                        struct ldb_result **_res);
+
+/* Searches the read-only copy of the cache if it is recent enough and
+ * contains a matching entry, the cache otherwise */
+errno_t sysdb_read_search(TALLOC_CTX *mem_ctx,
+                          struct sysdb_ctx *sysdb,
+                          struct ldb_dn *base_dn,
+                          enum ldb_scope scope,
+                          const char **attrs,
+                          struct ldb_result **_res,
+                          const char *fmt, ...) SSS_ATTRIBUTE_PRINTF(7, 8);
+
+/* Ghost members */
+errno_t sysdb_ghosts_modify(struct sysdb_ctx *sysdb,
+                            struct ldb_dn *group_dn,
+                            struct ldb_message_element *el,
+                            int mod_op);
+errno_t sysdb_ghosts_delete(struct sysdb_ctx *sysdb,
+                            struct ldb_dn *group_dn);
+/* Removes @names from the ghost members of the groups below @base_dn and
+ * returns the groups they were removed from */
+errno_t sysdb_ghosts_remove_names(TALLOC_CTX *mem_ctx,
+                                  struct sysdb_ctx *sysdb,
+                                  struct ldb_dn *base_dn,
+                                  const char **names,
+                                  struct ldb_dn ***_group_dns,
+                                  size_t *_num_groups);
+/* Separates the SYSDB_GHOST element from the other attributes, the
+ * elements are shared with @attrs */
+errno_t sysdb_ghosts_split(TALLOC_CTX *mem_ctx,
+                           struct sysdb_attrs *attrs,
+                           struct sysdb_attrs **_rest,
+                           struct ldb_message_element **_ghosts);
+bool sysdb_ghosts_requested(const char **attrs);
+/* Adds the SYSDB_GHOST attribute with the ghost members of the group and
+ * of the groups nested in it to the group entries */
+errno_t sysdb_ghosts_merge_ldb(struct ldb_context *ldb,
+                               size_t count,
+                               struct ldb_message **msgs);
+errno_t sysdb_ghosts_merge_msgs(struct sysdb_ctx *sysdb,
+                                size_t count,
+                                struct ldb_message **msgs);
+
+/* Enumeration cursors, see sysdb_enum_cursor_read() */
+enum sysdb_enum_cursor_type {
+    SYSDB_ENUM_CURSOR_USERS,
+    SYSDB_ENUM_CURSOR_GROUPS,
+    SYSDB_ENUM_CURSOR_AUTOFS,
+};
+
+errno_t sysdb_enum_cursor_create(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *domain,
+                                 enum sysdb_enum_cursor_type type,
+                                 struct ldb_dn *base_dn,
+                                 enum ldb_scope scope,
+                                 const char *filter,
+                                 struct sysdb_enum_cursor **_cursor);
 
 int add_string(struct ldb_message *msg, int flags,
                const char *attr, const char *value);
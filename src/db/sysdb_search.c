@@ -22,6 +22,8 @@
 #include "util/util.h"
 #include "db/sysdb_private.h"
 #include "confdb/confdb.h"
+#include "util/strtonum.h"
+#include "db/sysdb_autofs.h"
 #include <time.h>
 #include <ctype.h>
 
@@ -66,12 +68,11 @@ int sysdb_getpwnam(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, SYSDB_PWNAM_FILTER,
-                     lc_sanitized_name,
-                     sanitized_name, sanitized_name);
-    if (ret) {
-        ret = sysdb_error_to_errno(ret);
+    ret = sysdb_read_search(tmp_ctx, domain->sysdb, base_dn,
+                            LDB_SCOPE_SUBTREE, attrs, &res,
+                            SYSDB_PWNAM_FILTER, lc_sanitized_name,
+                            sanitized_name, sanitized_name);
+    if (ret != EOK) {
         goto done;
     }
 
@@ -173,10 +174,10 @@ int sysdb_getpwuid(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, SYSDB_PWUID_FILTER, ul_uid);
-    if (ret) {
-        ret = sysdb_error_to_errno(ret);
+    ret = sysdb_read_search(tmp_ctx, domain->sysdb, base_dn,
+                            LDB_SCOPE_SUBTREE, attrs, &res,
+                            SYSDB_PWUID_FILTER, ul_uid);
+    if (ret != EOK) {
         goto done;
     }
 
@@ -356,10 +357,9 @@ int sysdb_enumpwent_filter(TALLOC_CTX *mem_ctx,
     }
     DEBUG(SSSDBG_TRACE_LIBS, "Searching cache with [%s]\n", filter);
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+    ret = sysdb_ts_search(tmp_ctx, domain->sysdb, base_dn,
+                          LDB_SCOPE_SUBTREE, filter, attrs, &res);
     if (ret) {
-        ret = sysdb_error_to_errno(ret);
         goto done;
     }
 
@@ -605,11 +605,11 @@ int sysdb_getgrnam(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, fmt_filter,
-                     lc_sanitized_name, sanitized_name, sanitized_name);
-    if (ret) {
-        ret = sysdb_error_to_errno(ret);
+    ret = sysdb_read_search(tmp_ctx, domain->sysdb, base_dn,
+                            LDB_SCOPE_SUBTREE, attrs, &res, fmt_filter,
+                            lc_sanitized_name, sanitized_name,
+                            sanitized_name);
+    if (ret != EOK) {
         goto done;
     }
 
@@ -743,10 +743,10 @@ int sysdb_getgrgid(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, fmt_filter, ul_gid);
-    if (ret) {
-        ret = sysdb_error_to_errno(ret);
+    ret = sysdb_read_search(tmp_ctx, domain->sysdb, base_dn,
+                            LDB_SCOPE_SUBTREE, attrs, &res, fmt_filter,
+                            ul_gid);
+    if (ret != EOK) {
         goto done;
     }
 
@@ -802,10 +802,9 @@ int sysdb_enumgrent_filter(TALLOC_CTX *mem_ctx,
     }
     DEBUG(SSSDBG_TRACE_LIBS, "Searching cache with [%s]\n", filter);
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+    ret = sysdb_ts_search(tmp_ctx, domain->sysdb, base_dn,
+                          LDB_SCOPE_SUBTREE, filter, attrs, &res);
     if (ret) {
-        ret = sysdb_error_to_errno(ret);
         goto done;
     }
 
@@ -886,6 +885,379 @@ int sysdb_enumgrent_with_views(TALLOC_CTX *mem_ctx,
     return sysdb_enumgrent_filter_with_views(mem_ctx, domain, NULL, NULL, _res);
 }
 
+/* enumeration cursors */
+
+struct sysdb_enum_cursor {
+    struct sss_domain_info *domain;
+    enum sysdb_enum_cursor_type type;
+    const char *filter;
+
+    /* the linearized DNs, packed one after the other */
+    char *dns;
+    size_t dns_len;
+    size_t *offsets;
+    size_t count;
+    size_t size;
+};
+
+static errno_t sysdb_enum_cursor_add(struct sysdb_enum_cursor *cursor,
+                                     struct ldb_dn *dn)
+{
+    const char *str;
+    size_t len;
+    size_t alloc;
+
+    str = ldb_dn_get_linearized(dn);
+    if (str == NULL) {
+        return EINVAL;
+    }
+    len = strlen(str) + 1;
+
+    if (cursor->count == cursor->size) {
+        cursor->size = cursor->size == 0 ? 256 : cursor->size * 2;
+        cursor->offsets = talloc_realloc(cursor, cursor->offsets,
+                                         size_t, cursor->size);
+        if (cursor->offsets == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    alloc = talloc_get_size(cursor->dns);
+    if (cursor->dns_len + len > alloc) {
+        alloc = MAX(alloc * 2, cursor->dns_len + len);
+        cursor->dns = talloc_realloc(cursor, cursor->dns, char, alloc);
+        if (cursor->dns == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    memcpy(cursor->dns + cursor->dns_len, str, len);
+    cursor->offsets[cursor->count] = cursor->dns_len;
+    cursor->dns_len += len;
+    cursor->count++;
+
+    return EOK;
+}
+
+static int sysdb_enum_cursor_callback(struct ldb_request *req,
+                                      struct ldb_reply *ares)
+{
+    struct sysdb_enum_cursor *cursor;
+    errno_t ret;
+
+    cursor = talloc_get_type(req->context, struct sysdb_enum_cursor);
+
+    if (ares == NULL) {
+        return ldb_request_done(req, LDB_ERR_OPERATIONS_ERROR);
+    }
+    if (ares->error != LDB_SUCCESS) {
+        ret = ares->error;
+        talloc_free(ares);
+        return ldb_request_done(req, ret);
+    }
+
+    switch (ares->type) {
+    case LDB_REPLY_ENTRY:
+        /* the message is dropped right away, only the DN is kept */
+        ret = sysdb_enum_cursor_add(cursor, ares->message->dn);
+        talloc_free(ares);
+        if (ret != EOK) {
+            return ldb_request_done(req, LDB_ERR_OPERATIONS_ERROR);
+        }
+        return LDB_SUCCESS;
+
+    case LDB_REPLY_REFERRAL:
+        talloc_free(ares);
+        return LDB_SUCCESS;
+
+    case LDB_REPLY_DONE:
+        talloc_free(ares);
+        return ldb_request_done(req, LDB_SUCCESS);
+    }
+
+    talloc_free(ares);
+    return LDB_SUCCESS;
+}
+
+errno_t sysdb_enum_cursor_create(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *domain,
+                                 enum sysdb_enum_cursor_type type,
+                                 struct ldb_dn *base_dn,
+                                 enum ldb_scope scope,
+                                 const char *filter,
+                                 struct sysdb_enum_cursor **_cursor)
+{
+    static const char *attrs[] = { SYSDB_NAME, NULL };
+    struct sysdb_enum_cursor *cursor;
+    struct ldb_request *req;
+    int ret;
+
+    cursor = talloc_zero(mem_ctx, struct sysdb_enum_cursor);
+    if (cursor == NULL) {
+        return ENOMEM;
+    }
+    cursor->domain = domain;
+    cursor->type = type;
+    cursor->filter = talloc_strdup(cursor, filter);
+    if (cursor->filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_LIBS, "Creating cursor with [%s]\n", filter);
+
+    ret = ldb_build_search_req(&req, domain->sysdb->ldb, cursor,
+                               base_dn, scope,
+                               cursor->filter, attrs, NULL,
+                               cursor, sysdb_enum_cursor_callback,
+                               NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    ret = ldb_request(domain->sysdb->ldb, req);
+    if (ret == LDB_SUCCESS) {
+        ret = ldb_wait(req->handle, LDB_WAIT_ALL);
+    }
+    talloc_free(req);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    *_cursor = cursor;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(cursor);
+    }
+    return ret;
+}
+
+errno_t sysdb_enumpwent_cursor(TALLOC_CTX *mem_ctx,
+                               struct sss_domain_info *domain,
+                               struct sysdb_enum_cursor **_cursor)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *base_dn;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    base_dn = sysdb_user_base_dn(tmp_ctx, domain);
+    if (base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_enum_cursor_create(mem_ctx, domain, SYSDB_ENUM_CURSOR_USERS,
+                                   base_dn, LDB_SCOPE_SUBTREE,
+                                   SYSDB_PWENT_FILTER, _cursor);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_enumgrent_cursor(TALLOC_CTX *mem_ctx,
+                               struct sss_domain_info *domain,
+                               struct sysdb_enum_cursor **_cursor)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *base_dn;
+    const char *filter;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    if (domain->mpg) {
+        filter = SYSDB_GRENT_MPG_FILTER;
+        base_dn = ldb_dn_new_fmt(tmp_ctx, domain->sysdb->ldb,
+                                 SYSDB_DOM_BASE, domain->name);
+    } else {
+        filter = SYSDB_GRENT_FILTER;
+        base_dn = sysdb_group_base_dn(tmp_ctx, domain);
+    }
+    if (base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_enum_cursor_create(mem_ctx, domain, SYSDB_ENUM_CURSOR_GROUPS,
+                                   base_dn, LDB_SCOPE_SUBTREE,
+                                   filter, _cursor);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+size_t sysdb_enum_cursor_count(struct sysdb_enum_cursor *cursor)
+{
+    return cursor->count;
+}
+
+/* Adds what the cursor did not read from the cache entries of the users
+ * and groups themselves */
+static errno_t sysdb_enum_cursor_complete(struct sss_domain_info *domain,
+                                          enum sysdb_enum_cursor_type type,
+                                          struct ldb_result *res)
+{
+    size_t c;
+    errno_t ret;
+
+    ret = sysdb_ts_merge_res(domain->sysdb, res);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (type == SYSDB_ENUM_CURSOR_GROUPS) {
+        ret = sysdb_ghosts_merge_msgs(domain->sysdb, res->count, res->msgs);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = mpg_res_convert(res);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    if (DOM_HAS_VIEWS(domain)) {
+        for (c = 0; c < res->count; c++) {
+            ret = sysdb_add_overrides_to_object(domain, res->msgs[c], NULL,
+                                                NULL);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "sysdb_add_overrides_to_object failed.\n");
+                return ret;
+            }
+
+            if (type == SYSDB_ENUM_CURSOR_GROUPS) {
+                ret = sysdb_add_group_member_overrides(domain, res->msgs[c]);
+                if (ret != EOK) {
+                    DEBUG(SSSDBG_OP_FAILURE,
+                          "sysdb_add_group_member_overrides failed.\n");
+                    return ret;
+                }
+            }
+        }
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_enum_cursor_read(TALLOC_CTX *mem_ctx,
+                               struct sysdb_enum_cursor *cursor,
+                               size_t start,
+                               size_t count,
+                               struct ldb_result **_res)
+{
+    static const char *pw_attrs[] = SYSDB_PW_ATTRS;
+    static const char *gr_attrs[] = SYSDB_GRSRC_ATTRS;
+    static const char *autofs_attrs[] = { SYSDB_AUTOFS_ENTRY_KEY,
+                                          SYSDB_AUTOFS_ENTRY_VALUE,
+                                          NULL };
+    struct sss_domain_info *domain = cursor->domain;
+    const char **attrs;
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    struct ldb_result *obj;
+    struct ldb_dn *dn;
+    size_t c;
+    int ret;
+
+    if (start > cursor->count) {
+        return EINVAL;
+    }
+    count = MIN(count, cursor->count - start);
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    res = talloc_zero(tmp_ctx, struct ldb_result);
+    if (res == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    res->msgs = talloc_zero_array(res, struct ldb_message *, count + 1);
+    if (res->msgs == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    switch (cursor->type) {
+    case SYSDB_ENUM_CURSOR_USERS:
+        attrs = pw_attrs;
+        break;
+    case SYSDB_ENUM_CURSOR_GROUPS:
+        attrs = gr_attrs;
+        break;
+    case SYSDB_ENUM_CURSOR_AUTOFS:
+        attrs = autofs_attrs;
+        break;
+    default:
+        ret = EINVAL;
+        goto done;
+    }
+
+    for (c = start; c < start + count; c++) {
+        dn = ldb_dn_new(tmp_ctx, domain->sysdb->ldb,
+                        cursor->dns + cursor->offsets[c]);
+        if (dn == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &obj, dn,
+                         LDB_SCOPE_BASE, attrs,
+                         "%s", cursor->filter);
+        talloc_free(dn);
+        if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+            continue;
+        } else if (ret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(ret);
+            goto done;
+        }
+
+        if (obj->count == 0) {
+            /* removed or changed since the cursor was created */
+            talloc_free(obj);
+            continue;
+        }
+
+        res->msgs[res->count] = talloc_steal(res->msgs, obj->msgs[0]);
+        res->count++;
+        talloc_free(obj);
+    }
+
+    /* automounter entries have neither timestamps nor overrides */
+    if (cursor->type != SYSDB_ENUM_CURSOR_AUTOFS) {
+        ret = sysdb_enum_cursor_complete(domain, cursor->type, res);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    *_res = talloc_steal(mem_ctx, res);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 int sysdb_initgroups(TALLOC_CTX *mem_ctx,
                      struct sss_domain_info *domain,
                      const char *name,
@@ -979,6 +1351,12 @@ int sysdb_initgroups(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    /* the user was merged by sysdb_getpwnam() */
+    ret = sysdb_ts_merge_msgs(domain->sysdb, res->count - 1, res->msgs + 1);
+    if (ret != EOK) {
+        goto done;
+    }
+
     *_res = talloc_steal(mem_ctx, res);
 
 done:
@@ -1164,6 +1542,123 @@ done:
     return ret;
 }
 
+static errno_t sysdb_parse_initgr_gids(TALLOC_CTX *mem_ctx,
+                                       const char *str,
+                                       gid_t **_gids,
+                                       size_t *_num_gids)
+{
+    gid_t *gids;
+    size_t num_gids = 0;
+    size_t max_gids = 1;
+    const char *p;
+    char *endptr;
+    uint32_t val;
+
+    errno = 0;
+    val = strtouint32(str, &endptr, 10);
+    if (errno != 0 || *endptr != ':') {
+        return EINVAL;
+    }
+
+    if (val != SYSDB_INITGR_GIDS_VERSION) {
+        /* written by another version, it will be recomputed */
+        return ENOENT;
+    }
+
+    for (p = endptr + 1; *p != '\0'; p++) {
+        if (*p == ',') {
+            max_gids++;
+        }
+    }
+
+    gids = talloc_array(mem_ctx, gid_t, max_gids);
+    if (gids == NULL) {
+        return ENOMEM;
+    }
+
+    p = endptr + 1;
+    while (*p != '\0') {
+        errno = 0;
+        val = strtouint32(p, &endptr, 10);
+        if (errno != 0 || endptr == p
+                || (*endptr != ',' && *endptr != '\0')) {
+            talloc_free(gids);
+            return EINVAL;
+        }
+
+        gids[num_gids++] = val;
+        p = (*endptr == ',') ? endptr + 1 : endptr;
+    }
+
+    *_gids = gids;
+    *_num_gids = num_gids;
+    return EOK;
+}
+
+int sysdb_initgroups_gids(TALLOC_CTX *mem_ctx,
+                          struct sss_domain_info *domain,
+                          const char *name,
+                          struct ldb_result **_res,
+                          gid_t **_gids,
+                          size_t *_num_gids)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    const char *str;
+    gid_t *gids;
+    size_t num_gids;
+    static const char *attrs[] = { SYSDB_NAME, SYSDB_UIDNUM, SYSDB_GIDNUM,
+                                   SYSDB_PRIMARY_GROUP_GIDNUM,
+                                   SYSDB_DEFAULT_ATTRS,
+                                   SYSDB_INITGR_GIDS,
+                                   NULL };
+    int ret;
+
+    /* the overrides of the groups are not part of the list */
+    if (DOM_HAS_VIEWS(domain)) {
+        return ENOENT;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_get_user_attr(tmp_ctx, domain, name, attrs, &res);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (res->count != 1) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    str = ldb_msg_find_attr_as_string(res->msgs[0], SYSDB_INITGR_GIDS, NULL);
+    if (str == NULL) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    ret = sysdb_parse_initgr_gids(tmp_ctx, str, &gids, &num_gids);
+    if (ret == EINVAL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Ignoring malformed %s [%s] of [%s]\n",
+              SYSDB_INITGR_GIDS, str, name);
+        ret = ENOENT;
+    }
+    if (ret != EOK) {
+        goto done;
+    }
+
+    *_res = talloc_steal(mem_ctx, res);
+    *_gids = talloc_steal(mem_ctx, gids);
+    *_num_gids = num_gids;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 int sysdb_get_user_attr(TALLOC_CTX *mem_ctx,
                         struct sss_domain_info *domain,
                         const char *name,
@@ -1212,6 +1707,11 @@ int sysdb_get_user_attr(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    ret = sysdb_ts_merge_res(domain->sysdb, res);
+    if (ret != EOK) {
+        goto done;
+    }
+
     *_res = talloc_steal(mem_ctx, res);
 
 done:
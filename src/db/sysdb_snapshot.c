@@ -0,0 +1,496 @@
+/*
+    SSSD
+
+    Export and import of snapshots of the cache of a domain
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/util.h"
+#include "db/sysdb_private.h"
+
+/* A snapshot is an LDIF file. The first record is a header with the version
+ * of the snapshot format, the version of the cache it was exported from and
+ * the name of the domain. The entries follow as they are stored in the
+ * cache, without the attributes maintained by the memberof plugin and
+ * without the cached credentials, which must not leave the host.
+ *
+ * The entries are imported in two passes. The first one stores the entries
+ * without their members and the second one adds the members, so that the
+ * memberof plugin finds all the members in the cache whatever the order of
+ * the entries in the file. */
+
+#define SNAPSHOT_VERSION "1"
+
+#define SNAPSHOT_HEADER_DN "cn=snapshot"
+#define SNAPSHOT_VERSION_ATTR "snapshotVersion"
+#define SNAPSHOT_CACHE_VERSION_ATTR "cacheVersion"
+#define SNAPSHOT_DOMAIN_ATTR "domainName"
+
+static const char *sysdb_snapshot_skip_attrs[] = {
+    SYSDB_MEMBEROF,
+    SYSDB_MEMBERUID,
+    SYSDB_INITGR_GIDS,
+    SYSDB_CACHEDPWD,
+    SYSDB_CACHEDPWD_TYPE,
+    SYSDB_CACHEDPWD_FA2_LEN,
+    SYSDB_LAST_LOGIN,
+    SYSDB_LAST_ONLINE_AUTH,
+    SYSDB_LAST_ONLINE_AUTH_WITH_CURR_TOKEN,
+    SYSDB_LAST_FAILED_LOGIN,
+    SYSDB_FAILED_LOGIN_ATTEMPTS,
+    NULL
+};
+
+static errno_t sysdb_snapshot_write_msg(struct ldb_context *ldb,
+                                        FILE *file,
+                                        struct ldb_message *msg)
+{
+    struct ldb_ldif ldif;
+    int lret;
+
+    ldif.changetype = LDB_CHANGETYPE_NONE;
+    ldif.msg = msg;
+
+    lret = ldb_ldif_write_file(ldb, file, &ldif);
+    if (lret < 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to write [%s]\n",
+              ldb_dn_get_linearized(msg->dn));
+        return EIO;
+    }
+
+    return EOK;
+}
+
+static errno_t sysdb_snapshot_write_header(struct sss_domain_info *domain,
+                                           FILE *file)
+{
+    struct ldb_context *ldb = domain->sysdb->ldb;
+    struct ldb_message *msg;
+    errno_t ret;
+    int lret;
+
+    msg = ldb_msg_new(NULL);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    msg->dn = ldb_dn_new(msg, ldb, SNAPSHOT_HEADER_DN);
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_msg_add_string(msg, SNAPSHOT_VERSION_ATTR, SNAPSHOT_VERSION);
+    if (lret == LDB_SUCCESS) {
+        lret = ldb_msg_add_string(msg, SNAPSHOT_CACHE_VERSION_ATTR,
+                                  SYSDB_VERSION);
+    }
+    if (lret == LDB_SUCCESS) {
+        lret = ldb_msg_add_string(msg, SNAPSHOT_DOMAIN_ATTR, domain->name);
+    }
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    ret = sysdb_snapshot_write_msg(ldb, file, msg);
+
+done:
+    talloc_free(msg);
+    return ret;
+}
+
+static errno_t sysdb_snapshot_write_subtree(struct sysdb_ctx *sysdb,
+                                            struct ldb_dn *base_dn,
+                                            FILE *file,
+                                            size_t *_count)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    unsigned int i;
+    int j;
+    int lret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    lret = ldb_search(sysdb->ldb, tmp_ctx, &res, base_dn, LDB_SCOPE_SUBTREE,
+                      NULL, "(distinguishedName=*)");
+    if (lret == LDB_ERR_NO_SUCH_OBJECT) {
+        DEBUG(SSSDBG_TRACE_FUNC, "[%s] is not in the cache\n",
+              ldb_dn_get_linearized(base_dn));
+        ret = EOK;
+        goto done;
+    } else if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        for (j = 0; sysdb_snapshot_skip_attrs[j] != NULL; j++) {
+            ldb_msg_remove_attr(res->msgs[i], sysdb_snapshot_skip_attrs[j]);
+        }
+
+        ret = sysdb_snapshot_write_msg(sysdb->ldb, file, res->msgs[i]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Exported %u entries of [%s]\n",
+          res->count, ldb_dn_get_linearized(base_dn));
+    *_count += res->count;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_snapshot_export(struct sss_domain_info *domain,
+                              const char **custom_subtrees,
+                              FILE *file,
+                              size_t *_count)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *dns[4];
+    struct ldb_dn *dn;
+    bool in_transaction = false;
+    size_t count = 0;
+    errno_t ret;
+    errno_t sret;
+    int i;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    dns[0] = sysdb_user_base_dn(tmp_ctx, domain);
+    dns[1] = sysdb_group_base_dn(tmp_ctx, domain);
+    dns[2] = sysdb_domain_dn(tmp_ctx, domain);
+    dns[3] = NULL;
+    if (dns[0] == NULL || dns[1] == NULL || dns[2] == NULL
+            || !ldb_dn_add_child_fmt(dns[2], SYSDB_GHOSTS_CONTAINER)) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_snapshot_write_header(domain, file);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    /* the entries are read in one transaction to get a consistent copy */
+    ret = sysdb_transaction_start(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    for (i = 0; dns[i] != NULL; i++) {
+        ret = sysdb_snapshot_write_subtree(domain->sysdb, dns[i], file,
+                                           &count);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    for (i = 0; custom_subtrees != NULL && custom_subtrees[i] != NULL; i++) {
+        dn = sysdb_custom_subtree_dn(tmp_ctx, domain, custom_subtrees[i]);
+        if (dn == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sysdb_snapshot_write_subtree(domain->sysdb, dn, file, &count);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = sysdb_transaction_commit(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    if (fflush(file) != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    if (_count != NULL) {
+        *_count = count;
+    }
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t sysdb_snapshot_check_header(struct sss_domain_info *domain,
+                                           FILE *file)
+{
+    struct ldb_ldif *ldif;
+    const char *version;
+    const char *cache_version;
+    const char *name;
+    errno_t ret;
+
+    ldif = ldb_ldif_read_file(domain->sysdb->ldb, file);
+    if (ldif == NULL || ldb_dn_compare(ldif->msg->dn,
+                            ldb_dn_new(ldif, domain->sysdb->ldb,
+                                       SNAPSHOT_HEADER_DN)) != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "The file is not a cache snapshot\n");
+        ret = EINVAL;
+        goto done;
+    }
+
+    version = ldb_msg_find_attr_as_string(ldif->msg, SNAPSHOT_VERSION_ATTR,
+                                          NULL);
+    cache_version = ldb_msg_find_attr_as_string(ldif->msg,
+                                                SNAPSHOT_CACHE_VERSION_ATTR,
+                                                NULL);
+    name = ldb_msg_find_attr_as_string(ldif->msg, SNAPSHOT_DOMAIN_ATTR, NULL);
+
+    if (version == NULL || strcmp(version, SNAPSHOT_VERSION) != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unsupported snapshot version [%s]\n",
+              version ? version : "none");
+        ret = EINVAL;
+        goto done;
+    }
+
+    /* the entries are stored as they are, the upgrades of sysdb_upgrade.c
+     * work on a whole cache and are not run on them */
+    if (cache_version == NULL || strcmp(cache_version, SYSDB_VERSION) != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "The snapshot was exported from cache version [%s], "
+              "this cache has version [%s]\n",
+              cache_version ? cache_version : "none", SYSDB_VERSION);
+        ret = EMEDIUMTYPE;
+        goto done;
+    }
+
+    if (name == NULL || strcasecmp(name, domain->name) != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "The snapshot is of domain [%s], not [%s]\n",
+              name ? name : "none", domain->name);
+        ret = EINVAL;
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(ldif);
+    return ret;
+}
+
+static errno_t sysdb_snapshot_set_expired(struct ldb_message *msg,
+                                          const char *attr)
+{
+    int lret;
+
+    ldb_msg_remove_attr(msg, attr);
+    lret = ldb_msg_add_string(msg, attr, "1");
+    return sysdb_error_to_errno(lret);
+}
+
+/* Stores the entry without its members, expired so that it is refreshed
+ * on the next lookup. An entry already in the cache is overwritten. */
+static errno_t sysdb_snapshot_import_entry(struct sysdb_ctx *sysdb,
+                                           struct ldb_message *msg)
+{
+    unsigned int i;
+    errno_t ret;
+    int lret;
+
+    ldb_msg_remove_attr(msg, SYSDB_MEMBER);
+
+    if (ldb_msg_find_element(msg, SYSDB_CACHE_EXPIRE) != NULL) {
+        ret = sysdb_snapshot_set_expired(msg, SYSDB_CACHE_EXPIRE);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    if (ldb_msg_check_string_attribute(msg, SYSDB_OBJECTCLASS,
+                                       SYSDB_USER_CLASS)) {
+        ret = sysdb_snapshot_set_expired(msg, SYSDB_INITGR_EXPIRE);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    lret = ldb_add(sysdb->ldb, msg);
+    if (lret == LDB_ERR_ENTRY_ALREADY_EXISTS) {
+        for (i = 0; i < msg->num_elements; i++) {
+            msg->elements[i].flags = LDB_FLAG_MOD_REPLACE;
+        }
+        lret = ldb_modify(sysdb->ldb, msg);
+    }
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to store [%s]: [%s](%d)[%s]\n",
+              ldb_dn_get_linearized(msg->dn), ldb_strerror(lret), lret,
+              ldb_errstring(sysdb->ldb));
+    }
+
+    return sysdb_error_to_errno(lret);
+}
+
+static errno_t sysdb_snapshot_import_members(struct sysdb_ctx *sysdb,
+                                             struct ldb_message *msg)
+{
+    struct ldb_message_element *el;
+    struct ldb_message *mod;
+    errno_t ret;
+    int lret;
+
+    el = ldb_msg_find_element(msg, SYSDB_MEMBER);
+    if (el == NULL) {
+        return EOK;
+    }
+
+    mod = ldb_msg_new(msg);
+    if (mod == NULL) {
+        return ENOMEM;
+    }
+    mod->dn = msg->dn;
+
+    lret = ldb_msg_add(mod, el, LDB_FLAG_MOD_REPLACE);
+    if (lret == LDB_SUCCESS) {
+        lret = ldb_modify(sysdb->ldb, mod);
+    }
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Unable to store the members of [%s]: [%s](%d)[%s]\n",
+              ldb_dn_get_linearized(msg->dn), ldb_strerror(lret), lret,
+              ldb_errstring(sysdb->ldb));
+    }
+    ret = sysdb_error_to_errno(lret);
+
+    talloc_free(mod);
+    return ret;
+}
+
+static errno_t sysdb_snapshot_import_pass(struct sss_domain_info *domain,
+                                          FILE *file,
+                                          bool members,
+                                          size_t *_count,
+                                          size_t *_failed)
+{
+    struct ldb_ldif *ldif;
+    errno_t ret;
+
+    rewind(file);
+
+    ret = sysdb_snapshot_check_header(domain, file);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    while ((ldif = ldb_ldif_read_file(domain->sysdb->ldb, file)) != NULL) {
+        if (ldif->changetype != LDB_CHANGETYPE_NONE) {
+            ret = EINVAL;
+        } else if (members) {
+            ret = sysdb_snapshot_import_members(domain->sysdb, ldif->msg);
+        } else {
+            ret = sysdb_snapshot_import_entry(domain->sysdb, ldif->msg);
+        }
+        talloc_free(ldif);
+
+        if (ret == ENOMEM) {
+            return ret;
+        } else if (ret != EOK) {
+            (*_failed)++;
+        } else if (!members) {
+            (*_count)++;
+        }
+    }
+
+    if (ferror(file)) {
+        return EIO;
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_snapshot_import(struct sss_domain_info *domain,
+                              FILE *file,
+                              size_t *_count,
+                              size_t *_failed)
+{
+    bool in_transaction = false;
+    size_t count = 0;
+    size_t failed = 0;
+    errno_t ret;
+    errno_t sret;
+
+    ret = sysdb_transaction_start(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        return ret;
+    }
+    in_transaction = true;
+
+    ret = sysdb_snapshot_import_pass(domain, file, false, &count, &failed);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_snapshot_import_pass(domain, file, true, &count, &failed);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_transaction_commit(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Imported %zu entries, %zu failed\n",
+          count, failed);
+    if (_count != NULL) {
+        *_count = count;
+    }
+    if (_failed != NULL) {
+        *_failed = failed;
+    }
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    return ret;
+}
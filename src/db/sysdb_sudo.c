@@ -22,6 +22,7 @@
 
 #include <talloc.h>
 #include <time.h>
+#include <dhash.h>
 
 #include "db/sysdb.h"
 #include "db/sysdb_private.h"
@@ -429,9 +430,9 @@ done:
     return ret;
 }
 
-static errno_t sysdb_sudo_set_refresh_time(struct sss_domain_info *domain,
-                                           const char *attr_name,
-                                           time_t value)
+static errno_t sysdb_sudo_set_subdir_attr(struct sss_domain_info *domain,
+                                          const char *attr_name,
+                                          const char *value)
 {
     TALLOC_CTX *tmp_ctx;
     struct ldb_dn *dn;
@@ -487,7 +488,7 @@ static errno_t sysdb_sudo_set_refresh_time(struct sss_domain_info *domain,
         }
     }
 
-    lret = ldb_msg_add_fmt(msg, attr_name, "%lld", (long long)value);
+    lret = ldb_msg_add_string(msg, attr_name, value);
     if (lret != LDB_SUCCESS) {
         ret = sysdb_error_to_errno(lret);
         goto done;
@@ -511,6 +512,23 @@ done:
     return ret;
 }
 
+static errno_t sysdb_sudo_set_refresh_time(struct sss_domain_info *domain,
+                                           const char *attr_name,
+                                           time_t value)
+{
+    char *str;
+    errno_t ret;
+
+    str = talloc_asprintf(NULL, "%lld", (long long)value);
+    if (str == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_sudo_set_subdir_attr(domain, attr_name, str);
+    talloc_free(str);
+    return ret;
+}
+
 static errno_t sysdb_sudo_get_refresh_time(struct sss_domain_info *domain,
                                            const char *attr_name,
                                            time_t *value)
@@ -580,6 +598,82 @@ errno_t sysdb_sudo_get_last_full_refresh(struct sss_domain_info *domain,
                                        SYSDB_SUDO_AT_LAST_FULL_REFRESH, value);
 }
 
+/* The generation is the sequence number of the cache at the last write
+ * to the rules. It increases with each write, also when the whole subtree
+ * was deleted in between. It must be called inside the transaction which
+ * modifies the rules. */
+static errno_t sysdb_sudo_bump_generation(struct sss_domain_info *domain)
+{
+    uint64_t seq;
+    char *str;
+    errno_t ret;
+    int lret;
+
+    lret = ldb_sequence_number(domain->sysdb->ldb, LDB_SEQ_HIGHEST_SEQ, &seq);
+    if (lret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(lret);
+    }
+
+    str = talloc_asprintf(NULL, "%llu", (unsigned long long)seq);
+    if (str == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_sudo_set_subdir_attr(domain, SYSDB_SUDO_AT_GENERATION, str);
+    talloc_free(str);
+    return ret;
+}
+
+errno_t sysdb_sudo_get_generation(struct sss_domain_info *domain,
+                                  uint64_t *_generation)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *dn;
+    struct ldb_result *res;
+    errno_t ret;
+    int lret;
+    const char *attrs[2] = { SYSDB_SUDO_AT_GENERATION, NULL };
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    dn = ldb_dn_new_fmt(tmp_ctx, domain->sysdb->ldb, SYSDB_TMPL_CUSTOM_SUBTREE,
+                        SUDORULE_SUBDIR, domain->name);
+    if (dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, dn, LDB_SCOPE_BASE,
+                      attrs, NULL);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (res->count == 0) {
+        /* no rules were stored yet */
+        *_generation = 0;
+        ret = EOK;
+        goto done;
+    } else if (res->count != 1) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Got more than one reply for base search!\n");
+        ret = EIO;
+        goto done;
+    }
+
+    *_generation = ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                               SYSDB_SUDO_AT_GENERATION, 0);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 /* ====================  Purge functions ==================== */
 
 static const char *
@@ -744,6 +838,11 @@ errno_t sysdb_sudo_purge(struct sss_domain_info *domain,
         goto done;
     }
 
+    ret = sysdb_sudo_bump_generation(domain);
+    if (ret != EOK) {
+        goto done;
+    }
+
     ret = sysdb_transaction_commit(domain->sysdb);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
@@ -867,6 +966,353 @@ sysdb_sudo_store(struct sss_domain_info *domain,
         }
     }
 
+    ret = sysdb_sudo_bump_generation(domain);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_transaction_commit(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to store sudo rules [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
+    return ret;
+}
+
+/* ====================  Incremental store ==================== */
+
+static bool
+sysdb_sudo_rule_unchanged(struct sysdb_attrs *rule,
+                          struct ldb_message *cached)
+{
+    const char *modstamp;
+    const char *cached_modstamp;
+    const char *usn = NULL;
+    const char *cached_usn;
+    errno_t ret;
+
+    /* without a modification timestamp we cannot tell */
+    ret = sysdb_attrs_get_string(rule, SYSDB_ORIG_MODSTAMP, &modstamp);
+    if (ret != EOK) {
+        return false;
+    }
+
+    cached_modstamp = ldb_msg_find_attr_as_string(cached, SYSDB_ORIG_MODSTAMP,
+                                                  NULL);
+    if (cached_modstamp == NULL || strcmp(modstamp, cached_modstamp) != 0) {
+        return false;
+    }
+
+    /* the timestamp has only a resolution of one second, the USN catches
+     * modifications within the same second when available */
+    ret = sysdb_attrs_get_string(rule, SYSDB_USN, &usn);
+    if (ret != EOK && ret != ENOENT) {
+        return false;
+    }
+
+    cached_usn = ldb_msg_find_attr_as_string(cached, SYSDB_USN, NULL);
+    if (usn == NULL || cached_usn == NULL) {
+        return usn == cached_usn;
+    }
+
+    return strcmp(usn, cached_usn) == 0;
+}
+
+static errno_t
+sysdb_sudo_bump_expire(struct sss_domain_info *domain,
+                       const char *name,
+                       int cache_timeout,
+                       time_t now)
+{
+    struct sysdb_attrs *attrs;
+    time_t expire;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(NULL);
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+
+    expire = cache_timeout > 0 ? now + cache_timeout : 0;
+    ret = sysdb_attrs_add_time_t(attrs, SYSDB_CACHE_EXPIRE, expire);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_store_custom(domain, name, SUDORULE_SUBDIR, attrs);
+
+done:
+    talloc_free(attrs);
+    return ret;
+}
+
+static errno_t
+sysdb_sudo_get_cached(TALLOC_CTX *mem_ctx,
+                      struct sss_domain_info *domain,
+                      const char *filter,
+                      const char **attrs,
+                      hash_table_t **_table)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message **msgs = NULL;
+    hash_table_t *table;
+    hash_key_t key;
+    hash_value_t value;
+    const char *name;
+    size_t count = 0;
+    size_t i;
+    errno_t ret;
+    int hret;
+
+    tmp_ctx = talloc_new(NULL);
+    NULL_CHECK(tmp_ctx, ret, done);
+
+    ret = sysdb_search_custom(tmp_ctx, domain, filter, SUDORULE_SUBDIR,
+                              attrs, &count, &msgs);
+    if (ret == ENOENT) {
+        count = 0;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Error looking up SUDO rules\n");
+        goto done;
+    }
+
+    ret = sss_hash_create(tmp_ctx, count, &table);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        name = ldb_msg_find_attr_as_string(msgs[i], SYSDB_NAME, NULL);
+        if (name == NULL) {
+            continue;
+        }
+
+        key.type = HASH_KEY_STRING;
+        key.str = discard_const(name);
+        value.type = HASH_VALUE_PTR;
+        value.ptr = talloc_steal(table, msgs[i]);
+
+        hret = hash_enter(table, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            ret = EIO;
+            goto done;
+        }
+    }
+
+    *_table = talloc_steal(mem_ctx, table);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t
+sysdb_sudo_purge_not_listed(struct sss_domain_info *domain,
+                            hash_table_t *cached,
+                            hash_table_t *listed,
+                            size_t *_num_deleted)
+{
+    hash_key_t *keys = NULL;
+    unsigned long count;
+    unsigned long i;
+    size_t deleted = 0;
+    errno_t ret;
+    int hret;
+
+    hret = hash_keys(cached, &count, &keys);
+    if (hret != HASH_SUCCESS) {
+        return EIO;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (hash_has_key(listed, &keys[i])) {
+            continue;
+        }
+
+        ret = sysdb_sudo_purge_byname(domain, keys[i].str);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Failed to delete rule "
+                  "%s [%d]: %s\n", keys[i].str, ret, sss_strerror(ret));
+            continue;
+        }
+        deleted++;
+    }
+
+    talloc_free(keys);
+
+    if (_num_deleted != NULL) {
+        *_num_deleted = deleted;
+    }
+
+    return EOK;
+}
+
+static errno_t
+sysdb_sudo_list_rules(TALLOC_CTX *mem_ctx,
+                      struct sysdb_attrs **rules,
+                      size_t num_rules,
+                      hash_table_t **_table)
+{
+    hash_table_t *table;
+    hash_key_t key;
+    hash_value_t value;
+    const char *name;
+    size_t i;
+    errno_t ret;
+    int hret;
+
+    ret = sss_hash_create(mem_ctx, num_rules, &table);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    for (i = 0; i < num_rules; i++) {
+        name = sysdb_sudo_get_rule_name(rules[i]);
+        if (name == NULL) {
+            continue;
+        }
+
+        key.type = HASH_KEY_STRING;
+        key.str = discard_const(name);
+        value.type = HASH_VALUE_PTR;
+        value.ptr = rules[i];
+
+        hret = hash_enter(table, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            talloc_free(table);
+            return EIO;
+        }
+    }
+
+    *_table = table;
+    return EOK;
+}
+
+errno_t
+sysdb_sudo_store_changed(struct sss_domain_info *domain,
+                         const char *delete_filter,
+                         struct sysdb_attrs **rules,
+                         size_t num_rules,
+                         size_t *_num_changed)
+{
+    TALLOC_CTX *tmp_ctx;
+    hash_table_t *cached = NULL;
+    hash_table_t *listed = NULL;
+    hash_key_t key;
+    hash_value_t value;
+    const char *name;
+    bool in_transaction = false;
+    size_t changed = 0;
+    size_t deleted = 0;
+    time_t now;
+    size_t i;
+    errno_t sret;
+    errno_t ret;
+    int hret;
+    const char *attrs[] = { SYSDB_NAME,
+                            SYSDB_ORIG_MODSTAMP,
+                            SYSDB_USN,
+                            NULL };
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_transaction_start(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    ret = sysdb_sudo_get_cached(tmp_ctx, domain,
+                                delete_filter != NULL ? delete_filter
+                                                      : SUDO_ALL_FILTER,
+                                attrs, &cached);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (delete_filter != NULL) {
+        /* remove cached rules that are no longer on the server */
+        ret = sysdb_sudo_list_rules(tmp_ctx, rules, num_rules, &listed);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = sysdb_sudo_purge_not_listed(domain, cached, listed, &deleted);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    now = time(NULL);
+    for (i = 0; i < num_rules; i++) {
+        name = sysdb_sudo_get_rule_name(rules[i]);
+        if (name == NULL) {
+            /* Multiple CNs are error on server side, we can just ignore this
+             * rule and save the others. Loud debug message is in logs. */
+            continue;
+        }
+
+        key.type = HASH_KEY_STRING;
+        key.str = discard_const(name);
+        hret = hash_lookup(cached, &key, &value);
+        if (hret == HASH_SUCCESS) {
+            if (sysdb_sudo_rule_unchanged(rules[i], value.ptr)) {
+                ret = sysdb_sudo_bump_expire(domain, name,
+                                             domain->sudo_timeout, now);
+                if (ret != EOK) {
+                    goto done;
+                }
+                continue;
+            }
+
+            /* replace the whole rule so removed attributes are dropped */
+            ret = sysdb_sudo_purge_byname(domain, name);
+            if (ret != EOK) {
+                goto done;
+            }
+        } else if (hret != HASH_ERROR_KEY_NOT_FOUND) {
+            ret = EIO;
+            goto done;
+        }
+
+        ret = sysdb_sudo_store_rule(domain, rules[i],
+                                    domain->sudo_timeout, now);
+        if (ret == EINVAL) {
+            continue;
+        } else if (ret != EOK) {
+            goto done;
+        }
+        changed++;
+    }
+
+    if (num_rules > 0 || deleted > 0) {
+        /* the expiration times are part of the index, too */
+        ret = sysdb_sudo_bump_generation(domain);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
     ret = sysdb_transaction_commit(domain->sysdb);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
@@ -874,6 +1320,13 @@ sysdb_sudo_store(struct sss_domain_info *domain,
     }
     in_transaction = false;
 
+    DEBUG(SSSDBG_TRACE_FUNC, "Stored %zu new or changed sudo rules out of "
+          "%zu, deleted %zu\n", changed, num_rules, deleted);
+
+    if (_num_changed != NULL) {
+        *_num_changed = changed;
+    }
+
 done:
     if (in_transaction) {
         sret = sysdb_transaction_cancel(domain->sysdb);
@@ -887,5 +1340,85 @@ done:
               ret, sss_strerror(ret));
     }
 
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t
+sysdb_sudo_purge_missing(struct sss_domain_info *domain,
+                         struct sysdb_attrs **rules,
+                         size_t num_rules,
+                         size_t *_num_deleted)
+{
+    TALLOC_CTX *tmp_ctx;
+    hash_table_t *cached = NULL;
+    hash_table_t *listed = NULL;
+    bool in_transaction = false;
+    size_t deleted = 0;
+    errno_t sret;
+    errno_t ret;
+    const char *attrs[] = { SYSDB_NAME,
+                            NULL };
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_transaction_start(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    ret = sysdb_sudo_get_cached(tmp_ctx, domain, SUDO_ALL_FILTER, attrs,
+                                &cached);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_sudo_list_rules(tmp_ctx, rules, num_rules, &listed);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_sudo_purge_not_listed(domain, cached, listed, &deleted);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (deleted > 0) {
+        ret = sysdb_sudo_bump_generation(domain);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = sysdb_transaction_commit(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    if (_num_deleted != NULL) {
+        *_num_deleted = deleted;
+    }
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(domain->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to purge sudo cache [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
+    talloc_free(tmp_ctx);
     return ret;
 }
@@ -31,6 +31,8 @@
  * should be true if we have downloaded all rules atleast once */
 #define SYSDB_SUDO_AT_REFRESHED      "refreshed"
 #define SYSDB_SUDO_AT_LAST_FULL_REFRESH "sudoLastFullRefreshTime"
+/* changes with each write to the rules, see sysdb_sudo_get_generation() */
+#define SYSDB_SUDO_AT_GENERATION     "sudoRulesGeneration"
 
 /* sysdb attributes */
 #define SYSDB_SUDO_CACHE_OC            "sudoRule"
@@ -111,6 +113,11 @@ errno_t sysdb_sudo_set_last_full_refresh(struct sss_domain_info *domain,
 errno_t sysdb_sudo_get_last_full_refresh(struct sss_domain_info *domain,
                                          time_t *value);
 
+/* Returns a number which changes whenever rules of the domain are stored,
+ * changed or removed, 0 if no rules were stored yet. */
+errno_t sysdb_sudo_get_generation(struct sss_domain_info *domain,
+                                  uint64_t *_generation);
+
 errno_t sysdb_sudo_purge(struct sss_domain_info *domain,
                          const char *delete_filter,
                          struct sysdb_attrs **rules,
@@ -121,4 +128,22 @@ sysdb_sudo_store(struct sss_domain_info *domain,
                  struct sysdb_attrs **rules,
                  size_t num_rules);
 
+/* Stores the downloaded rules. Rules whose modification timestamp (and USN,
+ * if any) did not change are not rewritten, only their expiration time is
+ * updated. If delete_filter is set, the cached rules matching it that were
+ * not downloaded are removed. */
+errno_t
+sysdb_sudo_store_changed(struct sss_domain_info *domain,
+                         const char *delete_filter,
+                         struct sysdb_attrs **rules,
+                         size_t num_rules,
+                         size_t *_num_changed);
+
+/* Removes all cached rules whose names are not among the given rules. */
+errno_t
+sysdb_sudo_purge_missing(struct sss_domain_info *domain,
+                         struct sysdb_attrs **rules,
+                         size_t num_rules,
+                         size_t *_num_deleted);
+
 #endif /* _SYSDB_SUDO_H_ */
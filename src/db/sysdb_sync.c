@@ -0,0 +1,399 @@
+/*
+   SSSD
+
+   System Database - flushing the cache to disk outside of the event loop
+
+   Copyright (C) 2016 Red Hat
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "util/util.h"
+#include "db/sysdb_private.h"
+
+/* With cache_commit_delay the cache files are opened without the fsync()
+ * of every transaction, a commit only writes the pages. A thread flushes
+ * the files once the delay after a commit passed, so all the commits of
+ * that time are flushed together and the event loop never waits for the
+ * disk. ldb itself is only ever used by the main thread. */
+
+#define SYSDB_SYNC_MAX_DELAY 10000
+
+struct sysdb_sync_state {
+    struct sysdb_sync_state *prev;
+    struct sysdb_sync_state *next;
+
+    struct sysdb_sync *sync;
+    struct tevent_req *req;
+    uint64_t gen;
+};
+
+struct sysdb_sync {
+    struct tevent_fd *fde;
+    int pipefd[2];
+    int fds[2];
+    int num_fds;
+    uint32_t delay;
+
+    /* protects the generations, the error and the shutdown flag */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    /* incremented by every commit */
+    uint64_t committed;
+    /* the last commit which is on disk */
+    uint64_t synced;
+    int error;
+    bool shutdown;
+    pthread_t thread;
+
+    /* only touched by the main thread */
+    struct sysdb_sync_state *waiting;
+};
+
+static int sysdb_sync_files(struct sysdb_sync *sync)
+{
+    int ret = EOK;
+    int i;
+
+    for (i = 0; i < sync->num_fds; i++) {
+        if (fdatasync(sync->fds[i]) != 0) {
+            ret = errno;
+        }
+    }
+
+    return ret;
+}
+
+static void *sysdb_sync_thread(void *ptr)
+{
+    struct sysdb_sync *sync = (struct sysdb_sync *) ptr;
+    struct timespec delay;
+    uint64_t gen;
+    const char c = 0;
+    ssize_t len;
+    int ret;
+
+    delay.tv_sec = sync->delay / 1000;
+    delay.tv_nsec = (sync->delay % 1000) * 1000000;
+
+    pthread_mutex_lock(&sync->lock);
+    while (true) {
+        while (sync->committed == sync->synced && !sync->shutdown) {
+            pthread_cond_wait(&sync->cond, &sync->lock);
+        }
+
+        if (sync->shutdown) {
+            break;
+        }
+        pthread_mutex_unlock(&sync->lock);
+
+        /* the commits of the next moments are flushed together */
+        nanosleep(&delay, NULL);
+
+        pthread_mutex_lock(&sync->lock);
+        gen = sync->committed;
+        pthread_mutex_unlock(&sync->lock);
+
+        ret = sysdb_sync_files(sync);
+
+        pthread_mutex_lock(&sync->lock);
+        sync->synced = gen;
+        sync->error = ret;
+
+        /* if the pipe is full the event loop is woken up anyway */
+        len = write(sync->pipefd[1], &c, sizeof(c));
+        (void) len;
+    }
+    pthread_mutex_unlock(&sync->lock);
+
+    return NULL;
+}
+
+static void sysdb_sync_wakeup(struct tevent_context *ev,
+                              struct tevent_fd *fde,
+                              uint16_t flags, void *pvt)
+{
+    struct sysdb_sync *sync = talloc_get_type(pvt, struct sysdb_sync);
+    struct sysdb_sync_state *state;
+    struct sysdb_sync_state *next;
+    uint64_t synced;
+    char buf[64];
+    int error;
+
+    while (read(sync->pipefd[0], buf, sizeof(buf)) > 0);
+
+    pthread_mutex_lock(&sync->lock);
+    synced = sync->synced;
+    error = sync->error;
+    pthread_mutex_unlock(&sync->lock);
+
+    if (error != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to flush the cache [%d]: %s\n",
+              error, sss_strerror(error));
+    }
+
+    for (state = sync->waiting; state != NULL; state = next) {
+        next = state->next;
+        if (state->gen > synced) {
+            continue;
+        }
+
+        DLIST_REMOVE(sync->waiting, state);
+        state->sync = NULL;
+        if (error != EOK) {
+            tevent_req_error(state->req, error);
+        } else {
+            tevent_req_done(state->req);
+        }
+    }
+}
+
+static int sysdb_sync_destructor(struct sysdb_sync *sync)
+{
+    struct sysdb_sync_state *state;
+    int ret;
+    int i;
+
+    pthread_mutex_lock(&sync->lock);
+    sync->shutdown = true;
+    pthread_cond_broadcast(&sync->cond);
+    pthread_mutex_unlock(&sync->lock);
+
+    pthread_join(sync->thread, NULL);
+    pthread_cond_destroy(&sync->cond);
+    pthread_mutex_destroy(&sync->lock);
+
+    /* nothing committed is left behind */
+    ret = sysdb_sync_files(sync);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to flush the cache [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
+    while ((state = sync->waiting) != NULL) {
+        DLIST_REMOVE(sync->waiting, state);
+        state->sync = NULL;
+    }
+
+    talloc_zfree(sync->fde);
+    close(sync->pipefd[0]);
+    close(sync->pipefd[1]);
+    for (i = 0; i < sync->num_fds; i++) {
+        close(sync->fds[i]);
+    }
+
+    return 0;
+}
+
+static errno_t sysdb_sync_open(struct sysdb_sync *sync, const char *file)
+{
+    int fd;
+
+    fd = open(file, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        return errno;
+    }
+
+    sync->fds[sync->num_fds++] = fd;
+    return EOK;
+}
+
+static errno_t sysdb_sync_pipe_setup(int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return errno;
+    }
+
+    flags = fcntl(fd, F_GETFD, 0);
+    if (flags == -1 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
+        return errno;
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_sync_init(struct sysdb_ctx *sysdb,
+                        struct tevent_context *ev,
+                        uint32_t delay)
+{
+    struct sysdb_sync *sync;
+    sigset_t sigset;
+    sigset_t oldset;
+    int ret;
+    int i;
+
+    if (!sysdb->nosync) {
+        /* every commit is flushed by ldb */
+        return EOK;
+    }
+
+    if (sysdb->sync != NULL) {
+        return EEXIST;
+    }
+
+    sync = talloc_zero(sysdb, struct sysdb_sync);
+    if (sync == NULL) {
+        return ENOMEM;
+    }
+    sync->delay = MIN(delay, SYSDB_SYNC_MAX_DELAY);
+    sync->pipefd[0] = -1;
+    sync->pipefd[1] = -1;
+
+    ret = sysdb_sync_open(sync, sysdb->ldb_file);
+    if (ret == EOK && sysdb->ldb_ts_file != NULL) {
+        ret = sysdb_sync_open(sync, sysdb->ldb_ts_file);
+    }
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    if (pipe(sync->pipefd) == -1) {
+        ret = errno;
+        goto fail;
+    }
+
+    ret = sysdb_sync_pipe_setup(sync->pipefd[0]);
+    if (ret == EOK) {
+        ret = sysdb_sync_pipe_setup(sync->pipefd[1]);
+    }
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    ret = pthread_mutex_init(&sync->lock, NULL);
+    if (ret != 0) {
+        goto fail;
+    }
+
+    ret = pthread_cond_init(&sync->cond, NULL);
+    if (ret != 0) {
+        pthread_mutex_destroy(&sync->lock);
+        goto fail;
+    }
+
+    /* signals are handled by the event loop of the main thread */
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, &oldset);
+    ret = pthread_create(&sync->thread, NULL, sysdb_sync_thread, sync);
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+    if (ret != 0) {
+        pthread_cond_destroy(&sync->cond);
+        pthread_mutex_destroy(&sync->lock);
+        goto fail;
+    }
+
+    talloc_set_destructor(sync, sysdb_sync_destructor);
+
+    sync->fde = tevent_add_fd(ev, sync, sync->pipefd[0], TEVENT_FD_READ,
+                              sysdb_sync_wakeup, sync);
+    if (sync->fde == NULL) {
+        talloc_free(sync);
+        return ENOMEM;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Flushing [%s] %u ms after the commits\n",
+          sysdb->ldb_file, sync->delay);
+    sysdb->sync = sync;
+    return EOK;
+
+fail:
+    if (sync->pipefd[0] != -1) {
+        close(sync->pipefd[0]);
+        close(sync->pipefd[1]);
+    }
+    for (i = 0; i < sync->num_fds; i++) {
+        close(sync->fds[i]);
+    }
+    talloc_free(sync);
+    return ret;
+}
+
+void sysdb_sync_committed(struct sysdb_ctx *sysdb)
+{
+    struct sysdb_sync *sync = sysdb->sync;
+
+    if (sync == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&sync->lock);
+    sync->committed++;
+    pthread_cond_signal(&sync->cond);
+    pthread_mutex_unlock(&sync->lock);
+}
+
+static int sysdb_sync_state_destructor(struct sysdb_sync_state *state)
+{
+    if (state->sync != NULL) {
+        DLIST_REMOVE(state->sync->waiting, state);
+        state->sync = NULL;
+    }
+
+    return 0;
+}
+
+struct tevent_req *sysdb_sync_send(TALLOC_CTX *mem_ctx,
+                                   struct tevent_context *ev,
+                                   struct sysdb_ctx *sysdb)
+{
+    struct sysdb_sync *sync = sysdb->sync;
+    struct sysdb_sync_state *state;
+    struct tevent_req *req;
+    bool synced;
+
+    req = tevent_req_create(mem_ctx, &state, struct sysdb_sync_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->req = req;
+
+    if (sync == NULL) {
+        /* the commits were flushed synchronously */
+        tevent_req_done(req);
+        tevent_req_post(req, ev);
+        return req;
+    }
+
+    pthread_mutex_lock(&sync->lock);
+    state->gen = sync->committed;
+    synced = sync->synced >= state->gen;
+    pthread_mutex_unlock(&sync->lock);
+
+    if (synced) {
+        tevent_req_done(req);
+        tevent_req_post(req, ev);
+        return req;
+    }
+
+    state->sync = sync;
+    DLIST_ADD_END(sync->waiting, state, struct sysdb_sync_state *);
+    talloc_set_destructor(state, sysdb_sync_state_destructor);
+
+    return req;
+}
+
+errno_t sysdb_sync_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
@@ -26,6 +26,15 @@
 #include "db/sysdb_private.h"
 #include "db/sysdb_autofs.h"
 
+/* The upgrades which convert every entry of a big cache commit every
+ * UPGRADE_CHUNK entries instead of holding a single transaction for the
+ * whole conversion. The version number is only updated at the end, so an
+ * interrupted upgrade runs again on the next start. It has to skip what is
+ * already converted, either because the converted entries do not match its
+ * search anymore or by resuming at the checkpoint it stored in cn=sysdb. */
+#define UPGRADE_CHUNK 1000
+#define UPGRADE_CHECKPOINT "upgradeCheckpoint"
+
 struct upgrade_ctx {
     struct ldb_context *ldb;
     const char *new_version;
@@ -64,6 +73,135 @@ done:
     return ret;
 }
 
+/* Returns where an interrupted run of this upgrade stopped, the checkpoint
+ * is stored as "<new version>:<phase>:<position>" */
+static errno_t upgrade_get_checkpoint(struct upgrade_ctx *ctx,
+                                      unsigned int *_phase, size_t *_pos)
+{
+    const char *attrs[] = { UPGRADE_CHECKPOINT, NULL };
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    const char *val;
+    size_t len;
+    unsigned int phase;
+    size_t pos;
+    errno_t ret;
+
+    *_phase = 0;
+    *_pos = 0;
+
+    dn = ldb_dn_new(ctx, ctx->ldb, SYSDB_BASE);
+    if (dn == NULL) {
+        return ENOMEM;
+    }
+
+    ret = ldb_search(ctx->ldb, ctx, &res, dn, LDB_SCOPE_BASE, attrs, NULL);
+    talloc_free(dn);
+    if (ret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(ret);
+    }
+
+    if (res->count != 1) {
+        talloc_free(res);
+        return EOK;
+    }
+
+    val = ldb_msg_find_attr_as_string(res->msgs[0], UPGRADE_CHECKPOINT, NULL);
+    len = strlen(ctx->new_version);
+    if (val != NULL && strncmp(val, ctx->new_version, len) == 0
+            && val[len] == ':'
+            && sscanf(val + len + 1, "%u:%zu", &phase, &pos) == 2) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Resuming the upgrade to version %s at "
+              "step %u, entry %zu\n", ctx->new_version, phase, pos);
+        *_phase = phase;
+        *_pos = pos;
+    }
+
+    talloc_free(res);
+    return EOK;
+}
+
+static errno_t upgrade_set_checkpoint(struct upgrade_ctx *ctx,
+                                      unsigned int phase, size_t pos)
+{
+    struct ldb_message *msg;
+    errno_t ret;
+
+    msg = ldb_msg_new(ctx);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    msg->dn = ldb_dn_new(msg, ctx->ldb, SYSDB_BASE);
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_empty(msg, UPGRADE_CHECKPOINT, LDB_FLAG_MOD_REPLACE,
+                            NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_fmt(msg, UPGRADE_CHECKPOINT, "%s:%u:%zu",
+                          ctx->new_version, phase, pos);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_modify(ctx->ldb, msg);
+    ret = sysdb_error_to_errno(ret);
+
+done:
+    talloc_free(msg);
+    return ret;
+}
+
+/* Called after each converted entry, @done of @total. Commits the work
+ * every UPGRADE_CHUNK entries and reports the progress. With @checkpoint
+ * the position is stored as well, for the upgrades whose search still
+ * returns the converted entries. */
+static errno_t upgrade_entry_done(struct upgrade_ctx *ctx,
+                                  unsigned int phase, size_t done,
+                                  size_t total, bool checkpoint)
+{
+    errno_t ret;
+
+    if (done % UPGRADE_CHUNK != 0 || done == total) {
+        return EOK;
+    }
+
+    if (checkpoint) {
+        ret = upgrade_set_checkpoint(ctx, phase, done);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    ret = ldb_transaction_commit(ctx->ldb);
+    if (ret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(ret);
+    }
+
+    DEBUG(SSSDBG_IMPORTANT_INFO,
+          "Upgrade to version %s: %zu of %zu entries converted\n",
+          ctx->new_version, done, total);
+
+    ret = ldb_transaction_start(ctx->ldb);
+    if (ret != LDB_SUCCESS) {
+        /* there is no transaction for finish_upgrade() to cancel, this
+         * part is committed and the next start resumes after it */
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot restart the upgrade "
+              "transaction: %s\n", ldb_strerror(ret));
+        return EIO;
+    }
+
+    return EOK;
+}
+
 static errno_t update_version(struct upgrade_ctx *ctx)
 {
     struct ldb_message *msg = NULL;
@@ -92,6 +230,14 @@ static errno_t update_version(struct upgrade_ctx *ctx)
         goto done;
     }
 
+    /* the checkpoint of an interrupted run is not needed anymore */
+    ret = ldb_msg_add_empty(msg, UPGRADE_CHECKPOINT, LDB_FLAG_MOD_REPLACE,
+                            NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
     ret = ldb_modify(ctx->ldb, msg);
     if (ret != LDB_SUCCESS) {
         ret = sysdb_error_to_errno(ret);
@@ -410,7 +556,7 @@ int sysdb_check_upgrade_02(struct sss_domain_info *domains,
 
         /* create new dom db */
         ret = sysdb_domain_init_internal(tmp_ctx, dom,
-                                         db_path, false, &sysdb);
+                                         db_path, false, 0, &sysdb);
         if (ret != EOK) {
             goto done;
         }
@@ -1155,6 +1301,13 @@ int sysdb_upgrade_10(struct sysdb_ctx *sysdb, struct sss_domain_info *domain,
             ret = sysdb_error_to_errno(ret);
             goto done;
         }
+
+        /* the fake users already converted are gone, a new run does not
+         * find them */
+        ret = upgrade_entry_done(ctx, 0, i + 1, res->count, false);
+        if (ret != EOK) {
+            goto done;
+        }
     }
 
     /* conversion done, update version number */
@@ -1634,6 +1787,502 @@ done:
     return ret;
 }
 
+int sysdb_upgrade_17(struct sysdb_ctx *sysdb, const char **ver)
+{
+    const char *attrs[] = { SYSDB_UUID, SYSDB_USER_CERT, SYSDB_UPN,
+                            SYSDB_CANONICAL_UPN, SYSDB_GHOST, NULL };
+    struct ldb_message *msg;
+    struct upgrade_ctx *ctx;
+    errno_t ret;
+    int i;
+
+    ret = commence_upgrade(sysdb, sysdb->ldb, SYSDB_VERSION_0_18, &ctx);
+    if (ret) {
+        return ret;
+    }
+
+    msg = ldb_msg_new(ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    msg->dn = ldb_dn_new(msg, sysdb->ldb, "@INDEXLIST");
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* add indexes for the attributes searched by uuid, certificate, UPN
+     * lookups and when a ghost user becomes a real one */
+    ret = ldb_msg_add_empty(msg, "@IDXATTR", LDB_FLAG_MOD_ADD, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; attrs[i] != NULL; i++) {
+        ret = ldb_msg_add_string(msg, "@IDXATTR", attrs[i]);
+        if (ret != LDB_SUCCESS) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    ret = ldb_modify(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    /* conversion done, update version number */
+    ret = update_version(ctx);
+
+done:
+    ret = finish_upgrade(ret, &ctx, ver);
+    return ret;
+}
+
+static int upgrade_18_memberof_cmp(const void *a, const void *b)
+{
+    struct ldb_message_element *ea;
+    struct ldb_message_element *eb;
+    unsigned int na;
+    unsigned int nb;
+
+    ea = ldb_msg_find_element(*(struct ldb_message * const *)a,
+                              SYSDB_MEMBEROF);
+    eb = ldb_msg_find_element(*(struct ldb_message * const *)b,
+                              SYSDB_MEMBEROF);
+    na = ea ? ea->num_values : 0;
+    nb = eb ? eb->num_values : 0;
+
+    /* the most nested first, the order must not change between the runs
+     * because the checkpoint is a position in the sorted list */
+    if (na != nb) {
+        return na < nb ? 1 : -1;
+    }
+
+    return ldb_dn_compare((*(struct ldb_message * const *)a)->dn,
+                          (*(struct ldb_message * const *)b)->dn);
+}
+
+static bool upgrade_18_is_nested(struct ldb_message *msg, const char *dn)
+{
+    struct ldb_message_element *el;
+    unsigned int i;
+
+    el = ldb_msg_find_element(msg, SYSDB_MEMBEROF);
+    for (i = 0; el != NULL && i < el->num_values; i++) {
+        if (strcasecmp((const char *)el->values[i].data, dn) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Moves the direct ghost members of @group out of the entry, those which
+ * the memberof plugin copied from the groups nested in @group are not
+ * stored anymore */
+static errno_t upgrade_18_group(struct upgrade_ctx *ctx,
+                                struct sysdb_ctx *sysdb,
+                                struct ldb_message *group,
+                                struct ldb_message **groups,
+                                size_t count)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message_element *ghosts;
+    struct ldb_message_element *el;
+    struct ldb_message_element direct = { 0 };
+    hash_table_t *inherited;
+    hash_key_t key;
+    hash_value_t value;
+    const char *dn;
+    unsigned int i;
+    size_t j;
+    int hret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(ctx);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ghosts = ldb_msg_find_element(group, SYSDB_GHOST);
+    if (ghosts == NULL) {
+        ret = EOK;
+        goto done;
+    }
+
+    ret = sss_hash_create(tmp_ctx, 0, &inherited);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    dn = ldb_dn_get_linearized(group->dn);
+    key.type = HASH_KEY_STRING;
+    value.type = HASH_VALUE_UNDEF;
+
+    for (j = 0; j < count; j++) {
+        if (groups[j] == group || !upgrade_18_is_nested(groups[j], dn)) {
+            continue;
+        }
+
+        el = ldb_msg_find_element(groups[j], SYSDB_GHOST);
+        for (i = 0; el != NULL && i < el->num_values; i++) {
+            key.str = (char *)el->values[i].data;
+            hret = hash_enter(inherited, &key, &value);
+            if (hret != HASH_SUCCESS) {
+                ret = ENOMEM;
+                goto done;
+            }
+        }
+    }
+
+    direct.name = SYSDB_GHOST;
+    direct.values = talloc_array(tmp_ctx, struct ldb_val, ghosts->num_values);
+    if (direct.values == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < ghosts->num_values; i++) {
+        key.str = (char *)ghosts->values[i].data;
+        if (!hash_has_key(inherited, &key)) {
+            direct.values[direct.num_values] = ghosts->values[i];
+            direct.num_values++;
+        }
+    }
+
+    ret = sysdb_ghosts_modify(sysdb, group->dn, &direct, SYSDB_MOD_REP);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+int sysdb_upgrade_18(struct sysdb_ctx *sysdb, const char **ver)
+{
+    const char *attrs[] = { SYSDB_GHOST, SYSDB_MEMBEROF, NULL };
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    struct upgrade_ctx *ctx;
+    struct ldb_dn *base_dn;
+    unsigned int phase;
+    size_t pos;
+    errno_t ret;
+    size_t i;
+
+    ret = commence_upgrade(sysdb, sysdb->ldb, SYSDB_VERSION_0_19, &ctx);
+    if (ret) {
+        return ret;
+    }
+
+    ret = upgrade_get_checkpoint(ctx, &phase, &pos);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    msg = ldb_msg_new(ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* the ghost members entries are found by their names and groups, the
+     * changes are permissive in case an interrupted run already made them */
+    msg->dn = ldb_dn_new(msg, sysdb->ldb, "@INDEXLIST");
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_empty(msg, "@IDXATTR", LDB_FLAG_MOD_ADD, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_string(msg, "@IDXATTR", SYSDB_GHOST_NAME);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_string(msg, "@IDXATTR", SYSDB_GHOST_GROUP);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_ldb_modify_permissive(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    talloc_free(msg);
+    msg = ldb_msg_new(ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    msg->dn = ldb_dn_new(msg, sysdb->ldb, "@ATTRIBUTES");
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_empty(msg, SYSDB_GHOST_GROUP, LDB_FLAG_MOD_ADD, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_string(msg, SYSDB_GHOST_GROUP, "CASE_INSENSITIVE");
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_ldb_modify_permissive(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    base_dn = ldb_dn_new(ctx, sysdb->ldb, SYSDB_BASE);
+    if (base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_search(sysdb->ldb, ctx, &res, base_dn, LDB_SCOPE_SUBTREE, attrs,
+                     "(&("SYSDB_GC")("SYSDB_GHOST"=*))");
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    /* the nested groups lose their ghost attribute before their parents,
+     * from which the memberof plugin removes the inherited values */
+    qsort(res->msgs, res->count, sizeof(struct ldb_message *),
+          upgrade_18_memberof_cmp);
+
+    /* step 0 keeps the ghost attributes, the position in the sorted list
+     * tells which groups are done */
+    for (i = (phase == 0) ? pos : res->count; i < res->count; i++) {
+        ret = upgrade_18_group(ctx, sysdb, res->msgs[i], res->msgs,
+                               res->count);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = upgrade_entry_done(ctx, 0, i + 1, res->count, true);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    if (phase == 0) {
+        ret = upgrade_set_checkpoint(ctx, 1, 0);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    /* step 1 only sees the groups which still have the attribute */
+    for (i = 0; i < res->count; i++) {
+        talloc_free(msg);
+        msg = ldb_msg_new(ctx);
+        if (msg == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        msg->dn = res->msgs[i]->dn;
+
+        ret = ldb_msg_add_empty(msg, SYSDB_GHOST, LDB_FLAG_MOD_DELETE, NULL);
+        if (ret != LDB_SUCCESS) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sss_ldb_modify_permissive(sysdb->ldb, msg);
+        if (ret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(ret);
+            goto done;
+        }
+
+        ret = upgrade_entry_done(ctx, 1, i + 1, res->count, false);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    talloc_free(msg);
+    msg = ldb_msg_new(ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* nothing is searched by the ghost attribute anymore */
+    msg->dn = ldb_dn_new(msg, sysdb->ldb, "@INDEXLIST");
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_empty(msg, "@IDXATTR", LDB_FLAG_MOD_DELETE, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_string(msg, "@IDXATTR", SYSDB_GHOST);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_ldb_modify_permissive(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    /* conversion done, update version number */
+    ret = update_version(ctx);
+
+done:
+    ret = finish_upgrade(ret, &ctx, ver);
+    return ret;
+}
+
+int sysdb_upgrade_19(struct sysdb_ctx *sysdb, const char **ver)
+{
+    const char *attrs[] = { SYSDB_USER_CERT, NULL };
+    struct ldb_message_element *certs;
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    struct upgrade_ctx *ctx;
+    struct ldb_dn *base_dn;
+    char *hash;
+    errno_t ret;
+    size_t i;
+    unsigned int j;
+
+    ret = commence_upgrade(sysdb, sysdb->ldb, SYSDB_VERSION_0_20, &ctx);
+    if (ret) {
+        return ret;
+    }
+
+    msg = ldb_msg_new(ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* the users are found by the hashes of their certificates */
+    msg->dn = ldb_dn_new(msg, sysdb->ldb, "@INDEXLIST");
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_empty(msg, "@IDXATTR", LDB_FLAG_MOD_ADD, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_string(msg, "@IDXATTR", SYSDB_USER_CERT_HASH);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_ldb_modify_permissive(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    base_dn = ldb_dn_new(ctx, sysdb->ldb, SYSDB_BASE);
+    if (base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* an interrupted run does not find the users it already converted */
+    ret = ldb_search(sysdb->ldb, ctx, &res, base_dn, LDB_SCOPE_SUBTREE, attrs,
+                     "(&("SYSDB_UC")("SYSDB_USER_CERT"=*)"
+                     "(!("SYSDB_USER_CERT_HASH"=*)))");
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        certs = ldb_msg_find_element(res->msgs[i], SYSDB_USER_CERT);
+        if (certs == NULL) {
+            continue;
+        }
+
+        talloc_free(msg);
+        msg = ldb_msg_new(ctx);
+        if (msg == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        msg->dn = res->msgs[i]->dn;
+
+        ret = ldb_msg_add_empty(msg, SYSDB_USER_CERT_HASH,
+                                LDB_FLAG_MOD_REPLACE, NULL);
+        if (ret != LDB_SUCCESS) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (j = 0; j < certs->num_values; j++) {
+            ret = sysdb_cert_hash(msg, certs->values[j].data,
+                                  certs->values[j].length, &hash);
+            if (ret != EOK) {
+                goto done;
+            }
+
+            ret = ldb_msg_add_steal_string(msg, SYSDB_USER_CERT_HASH, hash);
+            if (ret != LDB_SUCCESS) {
+                ret = ENOMEM;
+                goto done;
+            }
+        }
+
+        ret = ldb_modify(sysdb->ldb, msg);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Cannot store the certificate hashes "
+                  "of [%s]: %s\n", ldb_dn_get_linearized(msg->dn),
+                  ldb_errstring(sysdb->ldb));
+            ret = sysdb_error_to_errno(ret);
+            goto done;
+        }
+
+        ret = upgrade_entry_done(ctx, 0, i + 1, res->count, false);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    /* conversion done, update version number */
+    ret = update_version(ctx);
+
+done:
+    ret = finish_upgrade(ret, &ctx, ver);
+    return ret;
+}
+
 /*
  * Example template for future upgrades.
  * Copy and change version numbers as appropriate.
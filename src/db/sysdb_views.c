@@ -212,6 +212,23 @@ done:
     return ret;
 }
 
+static struct override_attr_map {
+    const char *attr;
+    const char *new_attr;
+} override_attr_map[] = {
+    {SYSDB_UIDNUM, OVERRIDE_PREFIX SYSDB_UIDNUM},
+    {SYSDB_GIDNUM, OVERRIDE_PREFIX SYSDB_GIDNUM},
+    {SYSDB_GECOS, OVERRIDE_PREFIX SYSDB_GECOS},
+    {SYSDB_HOMEDIR, OVERRIDE_PREFIX SYSDB_HOMEDIR},
+    {SYSDB_SHELL, OVERRIDE_PREFIX SYSDB_SHELL},
+    {SYSDB_NAME, OVERRIDE_PREFIX SYSDB_NAME},
+    {SYSDB_SSH_PUBKEY, OVERRIDE_PREFIX SYSDB_SSH_PUBKEY},
+    {NULL, NULL}
+};
+
+static const char *merged_override_attrs[] = { SYSDB_MERGED_OVERRIDE_ATTRS,
+                                               NULL };
+
 errno_t sysdb_invalidate_overrides(struct sysdb_ctx *sysdb)
 {
     int ret;
@@ -264,6 +281,16 @@ errno_t sysdb_invalidate_overrides(struct sysdb_ctx *sysdb)
         goto done;
     }
 
+    for (c = 0; merged_override_attrs[c] != NULL; c++) {
+        ret = ldb_msg_add_empty(msg, merged_override_attrs[c],
+                                LDB_FLAG_MOD_REPLACE, NULL);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE, "ldb_msg_add_empty failed.\n");
+            ret = sysdb_error_to_errno(ret);
+            goto done;
+        }
+    }
+
     ret = sysdb_transaction_start(sysdb);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "sysdb_transaction_start failed.\n");
@@ -395,6 +422,96 @@ done:
     return ret;
 }
 
+/* Copy the override data into the original object so that lookups with the
+ * same view can skip the search for the override object. If attrs is NULL
+ * the object has no override and only the view name is recorded. */
+static errno_t sysdb_store_merged_override(struct sss_domain_info *domain,
+                                           const char *view_name,
+                                           struct sysdb_attrs *attrs,
+                                           struct ldb_dn *obj_dn)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    struct ldb_message_element *el;
+    size_t c;
+    size_t d;
+    int ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    msg->dn = obj_dn;
+
+    for (c = 0; override_attr_map[c].attr != NULL; c++) {
+        ret = ldb_msg_add_empty(msg, override_attr_map[c].new_attr,
+                                LDB_FLAG_MOD_REPLACE, NULL);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE, "ldb_msg_add_empty failed.\n");
+            ret = sysdb_error_to_errno(ret);
+            goto done;
+        }
+
+        if (attrs == NULL) {
+            continue;
+        }
+
+        ret = sysdb_attrs_get_el_ext(attrs, override_attr_map[c].attr, false,
+                                     &el);
+        if (ret == ENOENT) {
+            continue;
+        } else if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "sysdb_attrs_get_el_ext failed.\n");
+            goto done;
+        }
+
+        for (d = 0; d < el->num_values; d++) {
+            ret = ldb_msg_add_value(msg, override_attr_map[c].new_attr,
+                                    &el->values[d], NULL);
+            if (ret != LDB_SUCCESS) {
+                DEBUG(SSSDBG_OP_FAILURE, "ldb_msg_add_value failed.\n");
+                ret = sysdb_error_to_errno(ret);
+                goto done;
+            }
+        }
+    }
+
+    ret = ldb_msg_add_empty(msg, SYSDB_MERGED_OVERRIDE_VIEW,
+                            LDB_FLAG_MOD_REPLACE, NULL);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldb_msg_add_empty failed.\n");
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    ret = ldb_msg_add_string(msg, SYSDB_MERGED_OVERRIDE_VIEW, view_name);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    ret = ldb_modify(domain->sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to store merged override data: %s(%d)[%s]\n",
+              ldb_strerror(ret), ret, ldb_errstring(domain->sysdb->ldb));
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 errno_t sysdb_store_override(struct sss_domain_info *domain,
                              const char *view_name,
                              enum sysdb_member_type type,
@@ -628,6 +745,12 @@ errno_t sysdb_store_override(struct sss_domain_info *domain,
         }
     }
 
+    ret = sysdb_store_merged_override(domain, view_name, attrs, obj_dn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "sysdb_store_merged_override failed.\n");
+        goto done;
+    }
+
     ret = EOK;
 
 done:
@@ -1128,6 +1251,28 @@ errno_t sysdb_search_group_override_by_gid(TALLOC_CTX *mem_ctx,
                                        override_obj, orig_obj);
 }
 
+/* The override data merged by sysdb_store_override() can only be used if it
+ * was stored for the view currently in use and the object still references
+ * its override. */
+static bool sysdb_has_merged_overrides(struct sss_domain_info *domain,
+                                       struct ldb_message *obj)
+{
+    const char *merged_view;
+
+    if (domain->view_name == NULL
+            || ldb_msg_find_element(obj, SYSDB_OVERRIDE_DN) == NULL) {
+        return false;
+    }
+
+    merged_view = ldb_msg_find_attr_as_string(obj, SYSDB_MERGED_OVERRIDE_VIEW,
+                                              NULL);
+    if (merged_view == NULL) {
+        return false;
+    }
+
+    return strcmp(merged_view, domain->view_name) == 0;
+}
+
 /**
  * @brief Add override data to the original object
  *
@@ -1159,23 +1304,23 @@ errno_t sysdb_add_overrides_to_object(struct sss_domain_info *domain,
     static const char *user_attrs[] = SYSDB_PW_ATTRS;
     static const char *group_attrs[] = SYSDB_GRSRC_ATTRS;
     const char **attrs;
-    struct attr_map {
-        const char *attr;
-        const char *new_attr;
-    } attr_map[] = {
-        {SYSDB_UIDNUM, OVERRIDE_PREFIX SYSDB_UIDNUM},
-        {SYSDB_GIDNUM, OVERRIDE_PREFIX SYSDB_GIDNUM},
-        {SYSDB_GECOS, OVERRIDE_PREFIX SYSDB_GECOS},
-        {SYSDB_HOMEDIR, OVERRIDE_PREFIX SYSDB_HOMEDIR},
-        {SYSDB_SHELL, OVERRIDE_PREFIX SYSDB_SHELL},
-        {SYSDB_NAME, OVERRIDE_PREFIX SYSDB_NAME},
-        {SYSDB_SSH_PUBKEY, OVERRIDE_PREFIX SYSDB_SSH_PUBKEY},
-        {NULL, NULL}
-    };
     size_t c;
     size_t d;
     struct ldb_message_element *tmp_el;
 
+    if (override_obj == NULL && sysdb_has_merged_overrides(domain, obj)) {
+        DEBUG(SSSDBG_TRACE_ALL,
+              "Using merged override data of object [%s].\n",
+              ldb_dn_get_linearized(obj->dn));
+        return EOK;
+    }
+
+    /* Stale or unrelated merged data must not be mixed with the data added
+     * below. */
+    for (c = 0; merged_override_attrs[c] != NULL; c++) {
+        ldb_msg_remove_attr(obj, merged_override_attrs[c]);
+    }
+
     tmp_ctx = talloc_new(NULL);
     if (tmp_ctx == NULL) {
         DEBUG(SSSDBG_OP_FAILURE, "talloc_new failed.\n");
@@ -1250,11 +1395,12 @@ errno_t sysdb_add_overrides_to_object(struct sss_domain_info *domain,
         override = override_obj;
     }
 
-    for (c = 0; attr_map[c].attr != NULL; c++) {
-        tmp_el = ldb_msg_find_element(override, attr_map[c].attr);
+    for (c = 0; override_attr_map[c].attr != NULL; c++) {
+        tmp_el = ldb_msg_find_element(override, override_attr_map[c].attr);
         if (tmp_el != NULL) {
             for (d = 0; d < tmp_el->num_values; d++) {
-                ret = ldb_msg_add_steal_value(obj, attr_map[c].new_attr,
+                ret = ldb_msg_add_steal_value(obj,
+                                              override_attr_map[c].new_attr,
                                               &tmp_el->values[d]);
                 if (ret != LDB_SUCCESS) {
                     DEBUG(SSSDBG_OP_FAILURE, "ldb_msg_add_value failed.\n");
@@ -1370,27 +1516,35 @@ errno_t sysdb_add_group_member_overrides(struct sss_domain_info *domain,
 
         memberuid = NULL;
         if (ldb_dn_compare(member_obj->msgs[0]->dn, override_dn) != 0) {
-            DEBUG(SSSDBG_TRACE_ALL, "Checking override for object [%s].\n",
-                  ldb_dn_get_linearized(member_obj->msgs[0]->dn));
+            if (sysdb_has_merged_overrides(domain, member_obj->msgs[0])) {
+                memberuid = ldb_msg_find_attr_as_string(member_obj->msgs[0],
+                                                    OVERRIDE_PREFIX SYSDB_NAME,
+                                                    NULL);
+            } else {
+                DEBUG(SSSDBG_TRACE_ALL,
+                      "Checking override for object [%s].\n",
+                      ldb_dn_get_linearized(member_obj->msgs[0]->dn));
 
-            ret = ldb_search(domain->sysdb->ldb, member_obj, &override_obj,
-                             override_dn, LDB_SCOPE_BASE, member_attrs, NULL);
-            if (ret != LDB_SUCCESS) {
-                ret = sysdb_error_to_errno(ret);
-                goto done;
-            }
+                ret = ldb_search(domain->sysdb->ldb, member_obj, &override_obj,
+                                 override_dn, LDB_SCOPE_BASE, member_attrs,
+                                 NULL);
+                if (ret != LDB_SUCCESS) {
+                    ret = sysdb_error_to_errno(ret);
+                    goto done;
+                }
 
-            if (override_obj->count != 1) {
-                DEBUG(SSSDBG_CRIT_FAILURE,
-                     "Base search for override object returned [%d] results.\n",
-                     member_obj->count);
-                ret = EINVAL;
-                goto done;
-            }
+                if (override_obj->count != 1) {
+                    DEBUG(SSSDBG_CRIT_FAILURE,
+                         "Base search for override object returned [%d] "
+                         "results.\n", member_obj->count);
+                    ret = EINVAL;
+                    goto done;
+                }
 
-            memberuid = ldb_msg_find_attr_as_string(override_obj->msgs[0],
-                                                    SYSDB_NAME,
-                                                    NULL);
+                memberuid = ldb_msg_find_attr_as_string(override_obj->msgs[0],
+                                                        SYSDB_NAME,
+                                                        NULL);
+            }
 
             if (memberuid != NULL) {
                 ret = sss_parse_name(tmp_ctx, domain->names, orig_name,
@@ -82,6 +82,9 @@ AC_CHECK_MEMBERS([struct ldap_conncb.lc_arg],
                    [])],
                  [], [[#include <ldap.h>]])
 
+AC_CHECK_DECLS([LDAP_OPT_X_TLS_CONNECT_CB, LDAP_OPT_X_TLS_PACKAGE], [], [],
+               [[#include <ldap.h>]])
+
 AC_CHECK_TYPE([LDAPDerefRes],
               [],
               [AC_MSG_ERROR([The OpenLDAP version found does not contain the required type LDAPDerefRes])],
@@ -90,6 +93,20 @@ AC_CHECK_TYPE([LDAPDerefRes],
 CFLAGS=$SAVE_CFLAGS
 LIBS=$SAVE_LIBS
 
+dnl The TLS sessions can only be resumed with the OpenSSL back end of libldap
+PKG_CHECK_MODULES([SSL], [libssl], [have_libssl=yes], [have_libssl=no])
+if test x"$have_libssl" = xyes -a \
+        x"$ac_cv_have_decl_LDAP_OPT_X_TLS_CONNECT_CB" = xyes -a \
+        x"$ac_cv_have_decl_LDAP_OPT_X_TLS_PACKAGE" = xyes; then
+    AC_DEFINE([HAVE_LDAP_TLS_SESSION_CACHE], [1],
+              [Define if TLS sessions of LDAP connections can be resumed])
+else
+    SSL_CFLAGS=""
+    SSL_LIBS=""
+fi
+AC_SUBST(SSL_CFLAGS)
+AC_SUBST(SSL_LIBS)
+
 AC_PATH_PROG([SLAPD], [slapd], ,
              [$PATH$PATH_SEPARATOR/usr/sbin$PATH_SEPARATOR])
 AS_IF([test -n "$SLAPD"], [HAVE_SLAPD=yes], [HAVE_SLAPD=no])
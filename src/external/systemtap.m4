@@ -0,0 +1,25 @@
+dnl Checks for the static probes of systemtap
+dnl Usage:
+dnl     SSS_ENABLE_SYSTEMTAP
+
+AC_DEFUN([SSS_ENABLE_SYSTEMTAP], [
+    AC_ARG_ENABLE([systemtap],
+        [AS_HELP_STRING([--enable-systemtap],
+                        [build the static probes for systemtap and bpftrace [default=no]])],
+        [enable_systemtap="$enableval"],
+        [enable_systemtap="no"])
+
+    AS_IF([test x"$enable_systemtap" = xyes], [
+        AC_CHECK_PROGS([DTRACE], [dtrace])
+        AS_IF([test -z "$DTRACE"],
+              [AC_MSG_ERROR([cannot enable systemtap: dtrace not found])])
+
+        AC_CHECK_HEADER([sys/sdt.h], ,
+              [AC_MSG_ERROR([cannot enable systemtap: sys/sdt.h not found])])
+
+        AC_DEFINE([HAVE_SYSTEMTAP], [1],
+                  [Define to 1 to build the static probes])
+    ])
+
+    AM_CONDITIONAL([BUILD_SYSTEMTAP], [test x"$enable_systemtap" = xyes])
+])
@@ -31,6 +31,7 @@
 #define DB_USER_CLASS "user"
 #define DB_GROUP_CLASS "group"
 #define DB_CACHE_EXPIRE "dataExpireTimestamp"
+#define DB_INITGR_GIDS "initgrGIDs"
 #define DB_OC "objectClass"
 
 #ifndef MAX
@@ -73,6 +74,9 @@ struct mbof_add_operation {
 struct mbof_memberuid_op {
     struct ldb_dn *dn;
     struct ldb_message_element *el;
+
+    /* the values of el */
+    hash_table_t *values;
 };
 
 struct mbof_add_ctx {
@@ -80,6 +84,9 @@ struct mbof_add_ctx {
 
     struct mbof_add_operation *add_list;
     struct mbof_add_operation *current_op;
+    struct mbof_add_operation *last_op;
+    /* the entry DNs of add_list */
+    hash_table_t *add_index;
 
     struct ldb_message *msg;
     struct ldb_dn *msg_dn;
@@ -90,6 +97,7 @@ struct mbof_add_ctx {
     struct mbof_memberuid_op *muops;
     int num_muops;
     int cur_muop;
+    hash_table_t *muop_index;
 };
 
 struct mbof_del_ancestors_ctx {
@@ -131,10 +139,12 @@ struct mbof_del_ctx {
     struct mbof_memberuid_op *muops;
     int num_muops;
     int cur_muop;
+    hash_table_t *muop_index;
 
     struct mbof_memberuid_op *ghops;
     int num_ghops;
     int cur_ghop;
+    hash_table_t *ghop_index;
 
     struct mbof_mod_ctx *follow_mod;
     bool is_mod;
@@ -193,6 +203,44 @@ static void hash_free(void *ptr, void *pvt)
     talloc_free(ptr);
 }
 
+static int mbof_hash_create(TALLOC_CTX *memctx, hash_table_t **_table)
+{
+    int ret;
+
+    ret = hash_create_ex(1024, _table, 0, 0, 0, 0,
+                         hash_alloc, hash_free, memctx, NULL, NULL);
+    if (ret != HASH_SUCCESS) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    return LDB_SUCCESS;
+}
+
+/* The casefolded DN is equal exactly when ldb_dn_compare() returns 0 */
+static int mbof_dn_key(struct ldb_dn *dn, hash_key_t *key)
+{
+    const char *casefold;
+
+    if (dn == NULL) {
+        return LDB_ERR_INVALID_DN_SYNTAX;
+    }
+
+    casefold = ldb_dn_get_casefold(dn);
+    if (casefold == NULL) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    key->type = HASH_KEY_STRING;
+    key->str = discard_const(casefold);
+    return LDB_SUCCESS;
+}
+
+/* Grows an array of which num elements are used by at least one element,
+ * doubling the size so that appending one by one stays linear */
+#define mbof_array_grow(memctx, array, type, num) \
+    ((num) < talloc_array_length(array) ? (array) : \
+     talloc_realloc(memctx, array, type, MAX(16, 2 * (num))))
+
 static int entry_has_objectclass(struct ldb_message *entry,
                                  const char *objectclass)
 {
@@ -226,9 +274,21 @@ static int entry_is_group_object(struct ldb_message *entry)
     return entry_has_objectclass(entry, DB_GROUP_CLASS);
 }
 
+/* The ops are looked up in _index by the parent DN and the values of an op
+ * in its own table, so that filling the ops of a group with many members
+ * does not compare every new value with all the previous ones. */
+/* The GID list precomputed by sysdb for initgroups is stale as soon as the
+ * memberof attribute of the entry changes. Replacing it with no values
+ * removes it and does not fail if it is not there. */
+static int mbof_drop_initgr_gids(struct ldb_message *msg)
+{
+    return ldb_msg_add_empty(msg, DB_INITGR_GIDS, LDB_FLAG_MOD_REPLACE, NULL);
+}
+
 static int mbof_append_muop(TALLOC_CTX *memctx,
                             struct mbof_memberuid_op **_muops,
                             int *_num_muops,
+                            hash_table_t **_index,
                             int flags,
                             struct ldb_dn *parent,
                             const char *name,
@@ -238,31 +298,48 @@ static int mbof_append_muop(TALLOC_CTX *memctx,
     int num_muops = *_num_muops;
     struct mbof_memberuid_op *op;
     struct ldb_val *val;
-    int i;
+    hash_value_t value;
+    hash_key_t key;
+    int ret;
 
-    op = NULL;
-    if (muops) {
-        for (i = 0; i < num_muops; i++) {
-            if (ldb_dn_compare(parent, muops[i].dn) == 0) {
-                op = &muops[i];
-                break;
-            }
+    if (*_index == NULL) {
+        ret = mbof_hash_create(memctx, _index);
+        if (ret != LDB_SUCCESS) {
+            return ret;
         }
     }
+
+    ret = mbof_dn_key(parent, &key);
+    if (ret != LDB_SUCCESS) {
+        return ret;
+    }
+
+    op = NULL;
+    if (hash_lookup(*_index, &key, &value) == HASH_SUCCESS) {
+        op = &muops[value.ul];
+    }
     if (!op) {
-        muops = talloc_realloc(memctx, muops,
-                               struct mbof_memberuid_op,
-                               num_muops + 1);
+        muops = mbof_array_grow(memctx, muops,
+                                struct mbof_memberuid_op, num_muops);
         if (!muops) {
             return LDB_ERR_OPERATIONS_ERROR;
         }
+        *_muops = muops;
+
+        value.type = HASH_VALUE_ULONG;
+        value.ul = num_muops;
+        ret = hash_enter(*_index, &key, &value);
+        if (ret != HASH_SUCCESS) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+
         op = &muops[num_muops];
         num_muops++;
-        *_muops = muops;
         *_num_muops = num_muops;
 
         op->dn = parent;
         op->el = NULL;
+        op->values = NULL;
     }
 
     if (!op->el) {
@@ -275,27 +352,40 @@ static int mbof_append_muop(TALLOC_CTX *memctx,
             return LDB_ERR_OPERATIONS_ERROR;
         }
         op->el->flags = flags;
-    }
 
-    for (i = 0; i < op->el->num_values; i++) {
-        if (strcmp((char *)op->el->values[i].data, name) == 0) {
-            /* we already have this value, get out*/
-            return LDB_SUCCESS;
+        ret = mbof_hash_create(op->el, &op->values);
+        if (ret != LDB_SUCCESS) {
+            return ret;
         }
     }
 
-    val = talloc_realloc(op->el, op->el->values,
-                         struct ldb_val, op->el->num_values + 1);
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(name);
+    if (hash_has_key(op->values, &key)) {
+        /* we already have this value, get out*/
+        return LDB_SUCCESS;
+    }
+
+    val = mbof_array_grow(op->el, op->el->values,
+                          struct ldb_val, op->el->num_values);
     if (!val) {
         return LDB_ERR_OPERATIONS_ERROR;
     }
+    op->el->values = val;
+
     val[op->el->num_values].data = (uint8_t *)talloc_strdup(val, name);
     if (!val[op->el->num_values].data) {
         return LDB_ERR_OPERATIONS_ERROR;
     }
     val[op->el->num_values].length = strlen(name);
 
-    op->el->values = val;
+    value.type = HASH_VALUE_UNDEF;
+    value.ptr = NULL;
+    ret = hash_enter(op->values, &key, &value);
+    if (ret != HASH_SUCCESS) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
     op->el->num_values++;
 
     return LDB_SUCCESS;
@@ -347,25 +437,28 @@ static int mbof_append_addop(struct mbof_add_ctx *add_ctx,
                              struct mbof_dn_array *parents,
                              struct ldb_dn *entry_dn)
 {
-    struct mbof_add_operation *lastop = NULL;
     struct mbof_add_operation *addop;
+    hash_value_t value;
+    hash_key_t key;
+    int ret;
+
+    if (add_ctx->add_index == NULL) {
+        ret = mbof_hash_create(add_ctx, &add_ctx->add_index);
+        if (ret != LDB_SUCCESS) {
+            return ret;
+        }
+    }
 
     /* test if this is a duplicate */
-    /* FIXME: this is not efficient */
-    if (add_ctx->add_list) {
-        do {
-            if (lastop) {
-                lastop = lastop->next;
-            } else {
-                lastop = add_ctx->add_list;
-            }
+    ret = mbof_dn_key(entry_dn, &key);
+    if (ret != LDB_SUCCESS) {
+        return ret;
+    }
 
-            /* FIXME: check if this is right, might have to compare parents */
-            if (ldb_dn_compare(lastop->entry_dn, entry_dn) == 0) {
-                /* duplicate found */
-                return LDB_SUCCESS;
-            }
-        } while (lastop->next);
+    /* FIXME: check if this is right, might have to compare parents */
+    if (hash_has_key(add_ctx->add_index, &key)) {
+        /* duplicate found */
+        return LDB_SUCCESS;
     }
 
     addop = talloc_zero(add_ctx, struct mbof_add_operation);
@@ -377,11 +470,20 @@ static int mbof_append_addop(struct mbof_add_ctx *add_ctx,
     addop->parents = parents;
     addop->entry_dn = entry_dn;
 
+    value.type = HASH_VALUE_PTR;
+    value.ptr = addop;
+    ret = hash_enter(add_ctx->add_index, &key, &value);
+    if (ret != HASH_SUCCESS) {
+        talloc_free(addop);
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
     if (add_ctx->add_list) {
-        lastop->next = addop;
+        add_ctx->last_op->next = addop;
     } else {
         add_ctx->add_list = addop;
     }
+    add_ctx->last_op = addop;
 
     return LDB_SUCCESS;
 }
@@ -424,6 +526,7 @@ static int mbof_add_fill_ghop_ex(struct mbof_add_ctx *add_ctx,
         for (j = 0; j < num_gh_vals; j++) {
             ret = mbof_append_muop(add_ctx, &add_ctx->muops,
                                    &add_ctx->num_muops,
+                                   &add_ctx->muop_index,
                                    LDB_FLAG_MOD_ADD,
                                    parents->dns[i],
                                    (const char *) ghvals[j].data,
@@ -896,6 +999,7 @@ static int mbof_add_operation(struct mbof_add_operation *addop)
         for (i = 0; i < parents->num; i++) {
             ret = mbof_append_muop(add_ctx, &add_ctx->muops,
                                    &add_ctx->num_muops,
+                                   &add_ctx->muop_index,
                                    LDB_FLAG_MOD_ADD,
                                    parents->dns[i], name,
                                    DB_MEMBERUID);
@@ -950,6 +1054,11 @@ static int mbof_add_operation(struct mbof_add_operation *addop)
     }
     el->num_values = j;
 
+    ret = mbof_drop_initgr_gids(msg);
+    if (ret != LDB_SUCCESS) {
+        return ret;
+    }
+
     ret = ldb_build_mod_req(&mod_req, ldb, add_ctx,
                             msg, NULL,
                             add_ctx, mbof_add_callback,
@@ -2235,6 +2344,7 @@ static int mbof_del_mod_entry(struct mbof_del_operation *delop)
         for (i = 0; diff[i]; i++) {
             ret = mbof_append_muop(del_ctx, &del_ctx->muops,
                                    &del_ctx->num_muops,
+                                   &del_ctx->muop_index,
                                    LDB_FLAG_MOD_DELETE,
                                    diff[i], name,
                                    DB_MEMBERUID);
@@ -2244,6 +2354,11 @@ static int mbof_del_mod_entry(struct mbof_del_operation *delop)
         }
     }
 
+    ret = mbof_drop_initgr_gids(msg);
+    if (ret != LDB_SUCCESS) {
+        return ret;
+    }
+
     ret = ldb_build_mod_req(&mod_req, ldb, delop,
                             msg, NULL,
                             delop, mbof_del_mod_callback,
@@ -2482,6 +2597,7 @@ static int mbof_del_fill_muop(struct mbof_del_ctx *del_ctx,
 
         ret = mbof_append_muop(del_ctx, &del_ctx->muops,
                                &del_ctx->num_muops,
+                               &del_ctx->muop_index,
                                LDB_FLAG_MOD_DELETE,
                                valdn, name,
                                DB_MEMBERUID);
@@ -2548,6 +2664,7 @@ static int mbof_del_fill_ghop_ex(struct mbof_del_ctx *del_ctx,
         for (j = 0; j < num_gh_vals; j++) {
             ret = mbof_append_muop(del_ctx, &del_ctx->ghops,
                                    &del_ctx->num_ghops,
+                                   &del_ctx->ghop_index,
                                    LDB_FLAG_MOD_DELETE,
                                    valdn,
                                    (const char *) ghvals[j].data,
@@ -3413,6 +3530,131 @@ static int mbof_mod_process(struct mbof_mod_ctx *mod_ctx, bool *done)
     return LDB_SUCCESS;
 }
 
+/* Removes the DNs present in both arrays from both of them. The removed
+ * DNs are indexed so that replacing the members of a big group with an
+ * almost identical list stays linear. */
+static int mbof_dn_array_unchanged(TALLOC_CTX *mem_ctx,
+                                   struct mbof_dn_array *added,
+                                   struct mbof_dn_array *removed)
+{
+    TALLOC_CTX *tmp_ctx;
+    hash_table_t *table;
+    hash_value_t value;
+    hash_key_t key;
+    int i, j, ret;
+
+    tmp_ctx = talloc_new(mem_ctx);
+    if (!tmp_ctx) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    ret = mbof_hash_create(tmp_ctx, &table);
+    if (ret != LDB_SUCCESS) {
+        goto done;
+    }
+
+    for (i = 0; i < removed->num; i++) {
+        ret = mbof_dn_key(removed->dns[i], &key);
+        if (ret != LDB_SUCCESS) {
+            goto done;
+        }
+        value.type = HASH_VALUE_ULONG;
+        value.ul = i;
+        ret = hash_enter(table, &key, &value);
+        if (ret != HASH_SUCCESS) {
+            ret = LDB_ERR_OPERATIONS_ERROR;
+            goto done;
+        }
+    }
+
+    for (i = 0, j = 0; i < added->num; i++) {
+        ret = mbof_dn_key(added->dns[i], &key);
+        if (ret != LDB_SUCCESS) {
+            goto done;
+        }
+        if (hash_lookup(table, &key, &value) == HASH_SUCCESS) {
+            /* preexisting one, not removed, nor added */
+            removed->dns[value.ul] = NULL;
+            hash_delete(table, &key);
+            continue;
+        }
+        added->dns[j++] = added->dns[i];
+    }
+    added->num = j;
+
+    for (i = 0, j = 0; i < removed->num; i++) {
+        if (removed->dns[i] != NULL) {
+            removed->dns[j++] = removed->dns[i];
+        }
+    }
+    removed->num = j;
+
+    ret = LDB_SUCCESS;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Same as mbof_dn_array_unchanged() for the ghost values */
+static int mbof_val_array_unchanged(TALLOC_CTX *mem_ctx,
+                                    struct mbof_val_array *added,
+                                    struct mbof_val_array *removed)
+{
+    TALLOC_CTX *tmp_ctx;
+    hash_table_t *table;
+    hash_value_t value;
+    hash_key_t key;
+    int i, j, ret;
+
+    tmp_ctx = talloc_new(mem_ctx);
+    if (!tmp_ctx) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    ret = mbof_hash_create(tmp_ctx, &table);
+    if (ret != LDB_SUCCESS) {
+        goto done;
+    }
+
+    key.type = HASH_KEY_STRING;
+    for (i = 0; i < removed->num; i++) {
+        key.str = (char *) removed->vals[i].data;
+        value.type = HASH_VALUE_ULONG;
+        value.ul = i;
+        ret = hash_enter(table, &key, &value);
+        if (ret != HASH_SUCCESS) {
+            ret = LDB_ERR_OPERATIONS_ERROR;
+            goto done;
+        }
+    }
+
+    for (i = 0, j = 0; i < added->num; i++) {
+        key.str = (char *) added->vals[i].data;
+        if (hash_lookup(table, &key, &value) == HASH_SUCCESS) {
+            /* preexisting one, not removed, nor added */
+            removed->vals[value.ul].data = NULL;
+            hash_delete(table, &key);
+            continue;
+        }
+        added->vals[j++] = added->vals[i];
+    }
+    added->num = j;
+
+    for (i = 0, j = 0; i < removed->num; i++) {
+        if (removed->vals[i].data != NULL) {
+            removed->vals[j++] = removed->vals[i];
+        }
+    }
+    removed->num = j;
+
+    ret = LDB_SUCCESS;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 static int mbof_mod_process_membel(TALLOC_CTX *mem_ctx,
                                    struct ldb_context *ldb,
                                    struct ldb_message *entry,
@@ -3423,7 +3665,7 @@ static int mbof_mod_process_membel(TALLOC_CTX *mem_ctx,
     const struct ldb_message_element *el;
     struct mbof_dn_array *removed = NULL;
     struct mbof_dn_array *added = NULL;
-    int i, j, ret;
+    int ret;
 
     if (!membel) {
         /* Nothing to do.. */
@@ -3481,24 +3723,11 @@ static int mbof_mod_process_membel(TALLOC_CTX *mem_ctx,
 
         /* remove from arrays values that ended up unchanged */
         if (removed && removed->num && added && added->num) {
-            for (i = 0; i < added->num; i++) {
-                for (j = 0; j < removed->num; j++) {
-                    if (ldb_dn_compare(added->dns[i], removed->dns[j]) == 0) {
-                        break;
-                    }
-                }
-                if (j < removed->num) {
-                    /* preexisting one, not removed, nor added */
-                    for (; j+1 < removed->num; j++) {
-                        removed->dns[j] = removed->dns[j+1];
-                    }
-                    removed->num--;
-                    for (j = i; j+1 < added->num; j++) {
-                        added->dns[j] = added->dns[j+1];
-                    }
-                    added->num--;
-                    i--;
-                }
+            ret = mbof_dn_array_unchanged(mem_ctx, added, removed);
+            if (ret != LDB_SUCCESS) {
+                talloc_free(added);
+                talloc_free(removed);
+                return ret;
             }
         }
         break;
@@ -3522,7 +3751,7 @@ static int mbof_mod_process_ghel(TALLOC_CTX *mem_ctx,
     const struct ldb_message_element *el;
     struct mbof_val_array *removed = NULL;
     struct mbof_val_array *added = NULL;
-    int i, j, ret;
+    int ret;
 
     if (!ghel) {
         /* Nothing to do.. */
@@ -3590,25 +3819,11 @@ static int mbof_mod_process_ghel(TALLOC_CTX *mem_ctx,
 
         /* remove from arrays values that ended up unchanged */
         if (removed && removed->num && added && added->num) {
-            for (i = 0; i < added->num; i++) {
-                for (j = 0; j < removed->num; j++) {
-                    if (strcmp((const char *) added->vals[i].data,
-                               (const char *) removed->vals[j].data) == 0) {
-                        break;
-                    }
-                }
-                if (j < removed->num) {
-                    /* preexisting one, not removed, nor added */
-                    for (; j+1 < removed->num; j++) {
-                        removed->vals[j] = removed->vals[j+1];
-                    }
-                    removed->num--;
-                    for (j = i; j+1 < added->num; j++) {
-                        added->vals[j] = added->vals[j+1];
-                    }
-                    added->num--;
-                    i--;
-                }
+            ret = mbof_val_array_unchanged(mem_ctx, added, removed);
+            if (ret != LDB_SUCCESS) {
+                talloc_free(added);
+                talloc_free(removed);
+                return ret;
             }
         }
         break;
@@ -4483,6 +4698,11 @@ static int mbof_rcmp_update(struct mbof_rcmp_context *ctx)
         }
     }
 
+    ret = mbof_drop_initgr_gids(msg);
+    if (ret != LDB_SUCCESS) {
+        goto done;
+    }
+
     ret = ldb_build_mod_req(&req, ldb, ctx, msg, NULL,
                             ctx, mbof_rcmp_mod_callback,
                             ctx->req);
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stdlib.h>
 
 #include "lib/idmap/sss_idmap.h"
 #include "lib/idmap/sss_idmap_private.h"
@@ -58,6 +59,24 @@ struct idmap_domain_info {
 
     idmap_store_cb cb;
     void *pvt;
+
+    /* position in the domain list, set when the index is built */
+    size_t list_pos;
+};
+
+/* Lookup tables over the domain list, built on first use and dropped
+ * whenever a domain is added. Where several domains match, the one which
+ * comes first in the list wins, as with a linear walk over the list. */
+struct idmap_index {
+    /* domains with a SID, sorted by SID and list position */
+    struct idmap_domain_info **by_sid;
+    size_t sid_count;
+
+    /* primary ranges sorted by their first ID, max_upto[i] being the
+     * highest ID of the ranges 0 to i */
+    struct idmap_domain_info **by_range;
+    uint32_t *max_upto;
+    size_t range_count;
 };
 
 static void *default_alloc(size_t size, void *pvt)
@@ -108,6 +127,200 @@ static bool id_is_in_range(uint32_t id,
     return false;
 }
 
+static void idmap_index_free(struct sss_idmap_ctx *ctx)
+{
+    struct idmap_index *index = ctx->index;
+
+    if (index == NULL) {
+        return;
+    }
+
+    ctx->free_func(index->by_sid, ctx->alloc_pvt);
+    ctx->free_func(index->by_range, ctx->alloc_pvt);
+    ctx->free_func(index->max_upto, ctx->alloc_pvt);
+    ctx->free_func(index, ctx->alloc_pvt);
+    ctx->index = NULL;
+}
+
+static int idmap_index_sid_cmp(const void *a, const void *b)
+{
+    const struct idmap_domain_info *dom_a =
+                                *(struct idmap_domain_info * const *) a;
+    const struct idmap_domain_info *dom_b =
+                                *(struct idmap_domain_info * const *) b;
+    int ret;
+
+    ret = strcmp(dom_a->sid, dom_b->sid);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return dom_a->list_pos < dom_b->list_pos ? -1 : 1;
+}
+
+static int idmap_index_range_cmp(const void *a, const void *b)
+{
+    const struct idmap_domain_info *dom_a =
+                                *(struct idmap_domain_info * const *) a;
+    const struct idmap_domain_info *dom_b =
+                                *(struct idmap_domain_info * const *) b;
+
+    if (dom_a->range_params.min_id != dom_b->range_params.min_id) {
+        return dom_a->range_params.min_id < dom_b->range_params.min_id
+                    ? -1 : 1;
+    }
+
+    return dom_a->list_pos < dom_b->list_pos ? -1 : 1;
+}
+
+static enum idmap_error_code idmap_index_get(struct sss_idmap_ctx *ctx,
+                                             struct idmap_index **_index)
+{
+    struct idmap_index *index;
+    struct idmap_domain_info *dom;
+    size_t count = 0;
+    size_t i;
+
+    if (ctx->index != NULL) {
+        *_index = ctx->index;
+        return IDMAP_SUCCESS;
+    }
+
+    for (dom = ctx->idmap_domain_info; dom != NULL; dom = dom->next) {
+        dom->list_pos = count;
+        count++;
+    }
+
+    index = ctx->alloc_func(sizeof(struct idmap_index), ctx->alloc_pvt);
+    if (index == NULL) {
+        return IDMAP_OUT_OF_MEMORY;
+    }
+    memset(index, 0, sizeof(struct idmap_index));
+    ctx->index = index;
+
+    if (count == 0) {
+        *_index = index;
+        return IDMAP_SUCCESS;
+    }
+
+    index->by_sid = ctx->alloc_func(count * sizeof(struct idmap_domain_info *),
+                                    ctx->alloc_pvt);
+    index->by_range = ctx->alloc_func(
+                                  count * sizeof(struct idmap_domain_info *),
+                                  ctx->alloc_pvt);
+    index->max_upto = ctx->alloc_func(count * sizeof(uint32_t),
+                                      ctx->alloc_pvt);
+    if (index->by_sid == NULL || index->by_range == NULL
+            || index->max_upto == NULL) {
+        idmap_index_free(ctx);
+        return IDMAP_OUT_OF_MEMORY;
+    }
+
+    for (dom = ctx->idmap_domain_info; dom != NULL; dom = dom->next) {
+        if (dom->sid != NULL) {
+            index->by_sid[index->sid_count] = dom;
+            index->sid_count++;
+        }
+        index->by_range[index->range_count] = dom;
+        index->range_count++;
+    }
+
+    qsort(index->by_sid, index->sid_count,
+          sizeof(struct idmap_domain_info *), idmap_index_sid_cmp);
+    qsort(index->by_range, index->range_count,
+          sizeof(struct idmap_domain_info *), idmap_index_range_cmp);
+
+    for (i = 0; i < index->range_count; i++) {
+        index->max_upto[i] = index->by_range[i]->range_params.max_id;
+        if (i > 0 && index->max_upto[i - 1] > index->max_upto[i]) {
+            index->max_upto[i] = index->max_upto[i - 1];
+        }
+    }
+
+    *_index = index;
+    return IDMAP_SUCCESS;
+}
+
+/* Compares the first len characters of key, which are not necessarily
+ * followed by a terminator, with the string str */
+static int idmap_index_key_cmp(const char *key, size_t len, const char *str)
+{
+    int ret;
+
+    ret = strncmp(key, str, len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return str[len] == '\0' ? 0 : -1;
+}
+
+/* Returns the position of the first domain with the SID given by the first
+ * len characters of dom_sid and sets _count to the number of such
+ * domains */
+static size_t idmap_index_find_sid(struct idmap_index *index,
+                                   const char *dom_sid, size_t len,
+                                   size_t *_count)
+{
+    size_t lo = 0;
+    size_t hi = index->sid_count;
+    size_t mid;
+    size_t end;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (idmap_index_key_cmp(dom_sid, len, index->by_sid[mid]->sid) > 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (end = lo; end < index->sid_count
+                        && idmap_index_key_cmp(dom_sid, len,
+                                               index->by_sid[end]->sid) == 0;
+         end++);
+
+    *_count = end - lo;
+    return lo;
+}
+
+/* Returns the first domain of the list whose primary range contains id */
+static struct idmap_domain_info *
+idmap_index_find_id(struct idmap_index *index, uint32_t id, uint32_t *_rid)
+{
+    struct idmap_domain_info *found = NULL;
+    struct idmap_domain_info *dom;
+    uint32_t rid;
+    size_t lo = 0;
+    size_t hi = index->range_count;
+    size_t mid;
+
+    /* number of ranges starting at or below id */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (index->by_range[mid]->range_params.min_id <= id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    /* Without overlapping ranges only the first step matters, the loop stops
+     * as soon as no earlier range can reach id anymore */
+    while (lo > 0 && index->max_upto[lo - 1] >= id) {
+        lo--;
+        dom = index->by_range[lo];
+        if ((found == NULL || dom->list_pos < found->list_pos)
+                && id_is_in_range(id, &dom->range_params, &rid)) {
+            found = dom;
+            *_rid = rid;
+        }
+    }
+
+    return found;
+}
+
 const char *idmap_error_string(enum idmap_error_code err)
 {
     switch (err) {
@@ -262,6 +475,7 @@ enum idmap_error_code sss_idmap_free(struct sss_idmap_ctx *ctx)
         sss_idmap_free_domain(ctx, dom);
     }
 
+    idmap_index_free(ctx);
     ctx->free_func(ctx, ctx->alloc_pvt);
 
     return IDMAP_SUCCESS;
@@ -712,6 +926,7 @@ enum idmap_error_code sss_idmap_add_domain_ex(struct sss_idmap_ctx *ctx,
 
     dom->next = ctx->idmap_domain_info;
     ctx->idmap_domain_info = dom;
+    idmap_index_free(ctx);
 
     return IDMAP_SUCCESS;
 
@@ -816,25 +1031,6 @@ static bool parse_rid(const char *sid, size_t dom_prefix_len, long long *_rid)
     return true;
 }
 
-static bool is_sid_from_dom(const char *dom_sid, const char *sid,
-                            size_t *_dom_sid_len)
-{
-    size_t dom_sid_len;
-
-    if (dom_sid == NULL) {
-        return false;
-    }
-
-    dom_sid_len = strlen(dom_sid);
-    *_dom_sid_len = dom_sid_len;
-
-    if (strlen(sid) < dom_sid_len || sid[dom_sid_len] != '-') {
-        return false;
-    }
-
-    return strncmp(sid, dom_sid, dom_sid_len) == 0;
-}
-
 static bool comp_id(struct idmap_range_params *range_params, long long rid,
                     uint32_t *_id)
 {
@@ -988,9 +1184,15 @@ enum idmap_error_code sss_idmap_sid_to_unix(struct sss_idmap_ctx *ctx,
                                             const char *sid,
                                             uint32_t *_id)
 {
-    struct idmap_domain_info *idmap_domain_info;
+    struct idmap_index *index;
+    struct idmap_domain_info *dom;
     struct idmap_domain_info *matched_dom = NULL;
+    enum idmap_error_code err;
+    const char *sep;
     size_t dom_len;
+    size_t first;
+    size_t count;
+    size_t i;
     long long rid;
 
     if (sid == NULL || _id == NULL) {
@@ -999,33 +1201,56 @@ enum idmap_error_code sss_idmap_sid_to_unix(struct sss_idmap_ctx *ctx,
 
     CHECK_IDMAP_CTX(ctx, IDMAP_CONTEXT_INVALID);
 
-    idmap_domain_info = ctx->idmap_domain_info;
-
     if (sss_idmap_sid_is_builtin(sid)) {
         return IDMAP_BUILTIN_SID;
     }
 
+    err = idmap_index_get(ctx, &index);
+    if (err != IDMAP_SUCCESS) {
+        return err;
+    }
+
+    /* The domain SID is everything in front of the RID */
+    sep = strrchr(sid, '-');
+    if (sep == NULL) {
+        return IDMAP_NO_DOMAIN;
+    }
+    dom_len = sep - sid;
+
     /* Try primary slices */
-    while (idmap_domain_info != NULL) {
+    first = idmap_index_find_sid(index, sid, dom_len, &count);
+    for (i = first; i < first + count; i++) {
+        dom = index->by_sid[i];
 
-        if (is_sid_from_dom(idmap_domain_info->sid, sid, &dom_len)) {
+        if (dom->external_mapping == true) {
+            return IDMAP_EXTERNAL;
+        }
 
-            if (idmap_domain_info->external_mapping == true) {
-                return IDMAP_EXTERNAL;
-            }
+        if (parse_rid(sid, dom_len, &rid) == false) {
+            return IDMAP_SID_INVALID;
+        }
 
-            if (parse_rid(sid, dom_len, &rid) == false) {
-                return IDMAP_SID_INVALID;
-            }
+        if (comp_id(&dom->range_params, rid, _id)) {
+            return IDMAP_SUCCESS;
+        }
 
-            if (comp_id(&idmap_domain_info->range_params, rid, _id)) {
-                return IDMAP_SUCCESS;
+        matched_dom = dom;
+    }
+
+    if (matched_dom == NULL) {
+        /* A known domain SID followed by more than a RID */
+        while (dom_len > 0) {
+            dom_len--;
+            if (sid[dom_len] != '-') {
+                continue;
             }
 
-            matched_dom = idmap_domain_info;
+            first = idmap_index_find_sid(index, sid, dom_len, &count);
+            if (count != 0) {
+                return index->by_sid[first]->external_mapping
+                            ? IDMAP_EXTERNAL : IDMAP_SID_INVALID;
+            }
         }
-
-        idmap_domain_info = idmap_domain_info->next;
     }
 
     if (matched_dom != NULL && matched_dom->auto_add_ranges) {
@@ -1114,25 +1339,25 @@ enum idmap_error_code sss_idmap_unix_to_sid(struct sss_idmap_ctx *ctx,
                                             char **_sid)
 {
     struct idmap_domain_info *idmap_domain_info;
+    struct idmap_index *index;
     uint32_t rid;
     enum idmap_error_code err;
 
     CHECK_IDMAP_CTX(ctx, IDMAP_CONTEXT_INVALID);
 
-    idmap_domain_info = ctx->idmap_domain_info;
-
-    while (idmap_domain_info != NULL) {
-        if (id_is_in_range(id, &idmap_domain_info->range_params, &rid)) {
-
-            if (idmap_domain_info->external_mapping == true
-                    || idmap_domain_info->sid == NULL) {
-                return IDMAP_EXTERNAL;
-            }
+    err = idmap_index_get(ctx, &index);
+    if (err != IDMAP_SUCCESS) {
+        return err;
+    }
 
-            return generate_sid(ctx, idmap_domain_info->sid, rid, _sid);
+    idmap_domain_info = idmap_index_find_id(index, id, &rid);
+    if (idmap_domain_info != NULL) {
+        if (idmap_domain_info->external_mapping == true
+                || idmap_domain_info->sid == NULL) {
+            return IDMAP_EXTERNAL;
         }
 
-        idmap_domain_info = idmap_domain_info->next;
+        return generate_sid(ctx, idmap_domain_info->sid, rid, _sid);
     }
 
     /* Check secondary ranges. */
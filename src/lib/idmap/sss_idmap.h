@@ -119,6 +119,28 @@ struct sss_idmap_range {
  */
 struct sss_dom_sid;
 
+/**
+ * Maximal number of sub-authorities of a SID
+ */
+#define SSS_IDMAP_SID_SUB_AUTHS 15
+
+/**
+ * Size of a buffer which can hold the string representation of any SID,
+ * including the terminating zero
+ */
+#define SSS_IDMAP_SID_STR_MAX (25 + SSS_IDMAP_SID_SUB_AUTHS * 11)
+
+/**
+ * SID in a compact binary form. It can be placed on the stack or in other
+ * structures, converted and compared without allocating memory.
+ */
+struct sss_idmap_sid {
+    uint8_t sid_rev_num;
+    uint8_t num_auths;
+    uint8_t id_auth[6];                           /* highest order byte first */
+    uint32_t sub_auths[SSS_IDMAP_SID_SUB_AUTHS];  /* host byte-order */
+};
+
 /**
  * Opaque type for the idmap context
  */
@@ -952,6 +974,75 @@ enum idmap_error_code sss_idmap_smb_sid_to_bin_sid(struct sss_idmap_ctx *ctx,
                                                    struct dom_sid *smb_sid,
                                                    uint8_t **bin_sid,
                                                    size_t *length);
+
+/**
+ * @brief Parse the string representation of a SID
+ *
+ * @param[in] sid       Zero-terminated string representation of the SID
+ * @param[out] _sid     Parsed SID
+ *
+ * @return
+ *  - #IDMAP_SID_INVALID: Given SID is invalid
+ */
+enum idmap_error_code sss_idmap_sid_parse(const char *sid,
+                                          struct sss_idmap_sid *_sid);
+
+/**
+ * @brief Parse a binary SID as used by Active Directory
+ *
+ * @param[in] bin_sid   Array with the binary SID
+ * @param[in] length    Size of the array containing the binary SID
+ * @param[out] _sid     Parsed SID
+ *
+ * @return
+ *  - #IDMAP_SID_INVALID: Given SID is invalid
+ */
+enum idmap_error_code sss_idmap_bin_sid_parse(const uint8_t *bin_sid,
+                                              size_t length,
+                                              struct sss_idmap_sid *_sid);
+
+/**
+ * @brief Copy a Samba dom_sid structure
+ *
+ * @param[in] smb_sid   Samba dom_sid structure
+ * @param[out] _sid     Copy of the SID
+ *
+ * @return
+ *  - #IDMAP_SID_INVALID: Given SID is invalid
+ */
+enum idmap_error_code sss_idmap_smb_sid_parse(const struct dom_sid *smb_sid,
+                                              struct sss_idmap_sid *_sid);
+
+/**
+ * @brief Write the string representation of a SID into a buffer
+ *
+ * @param[in] sid       SID
+ * @param[out] buf      Buffer for the zero-terminated string, a size of
+ *                      #SSS_IDMAP_SID_STR_MAX is always sufficient
+ * @param[in] buf_len   Size of the buffer
+ *
+ * @return
+ *  - #IDMAP_SID_INVALID: Given SID is invalid
+ *  - #IDMAP_ERROR:       Buffer is too small
+ */
+enum idmap_error_code sss_idmap_sid_format(const struct sss_idmap_sid *sid,
+                                           char *buf, size_t buf_len);
+
+/**
+ * @brief Compare two SIDs
+ *
+ * The order is suitable for sorting and binary searches, it is not the
+ * order of the string representations.
+ *
+ * @param[in] sid1      First SID
+ * @param[in] sid2      Second SID
+ *
+ * @return Less than, equal to or greater than zero if sid1 is found to be
+ *         less than, equal to or greater than sid2
+ */
+int sss_idmap_sid_cmp(const struct sss_idmap_sid *sid1,
+                      const struct sss_idmap_sid *sid2);
+
 /**
  * @}
  */
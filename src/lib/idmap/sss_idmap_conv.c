@@ -41,6 +41,238 @@ struct sss_dom_sid {
         uint32_t sub_auths[SID_SUB_AUTHS]; /* host byte-order */
 };
 
+enum idmap_error_code sss_idmap_sid_parse(const char *sid,
+                                          struct sss_idmap_sid *_sid)
+{
+    struct sss_idmap_sid out;
+    unsigned long ul;
+    char *r;
+    char *end;
+
+    if (sid == NULL || _sid == NULL
+            || (sid[0] != 'S' && sid[0] != 's') || sid[1] != '-') {
+        return IDMAP_SID_INVALID;
+    }
+
+    memset(&out, 0, sizeof(out));
+
+    if (!isdigit(sid[2])) {
+        return IDMAP_SID_INVALID;
+    }
+    errno = 0;
+    ul = strtoul(sid + 2, &r, 10);
+    if (errno != 0 || r == NULL || *r != '-' || ul > UINT8_MAX) {
+        return IDMAP_SID_INVALID;
+    }
+    out.sid_rev_num = (uint8_t) ul;
+    r++;
+
+    if (!isdigit(*r)) {
+        return IDMAP_SID_INVALID;
+    }
+    errno = 0;
+    ul = strtoul(r, &r, 10);
+    if (errno != 0 || r == NULL || ul > UINT32_MAX) {
+        return IDMAP_SID_INVALID;
+    }
+
+    /* id_auth in the string should always be <2^32 in decimal */
+    /* store values in the same order as the binary representation */
+    out.id_auth[0] = 0;
+    out.id_auth[1] = 0;
+    out.id_auth[2] = (ul & 0xff000000) >> 24;
+    out.id_auth[3] = (ul & 0x00ff0000) >> 16;
+    out.id_auth[4] = (ul & 0x0000ff00) >> 8;
+    out.id_auth[5] = (ul & 0x000000ff);
+
+    if (*r != '\0' && *r != '-') {
+        return IDMAP_SID_INVALID;
+    }
+
+    while (*r != '\0') {
+        if (out.num_auths >= SID_SUB_AUTHS) {
+            return IDMAP_SID_INVALID;
+        }
+
+        r++;
+        if (!isdigit(*r)) {
+            return IDMAP_SID_INVALID;
+        }
+
+        errno = 0;
+        ul = strtoul(r, &end, 10);
+        if (errno != 0 || ul > UINT32_MAX || end == NULL ||
+            (*end != '\0' && *end != '-')) {
+            return IDMAP_SID_INVALID;
+        }
+
+        out.sub_auths[out.num_auths++] = ul;
+
+        r = end;
+    }
+
+    *_sid = out;
+    return IDMAP_SUCCESS;
+}
+
+enum idmap_error_code sss_idmap_bin_sid_parse(const uint8_t *bin_sid,
+                                              size_t length,
+                                              struct sss_idmap_sid *_sid)
+{
+    struct sss_idmap_sid out;
+    size_t p = 0;
+    size_t i;
+    uint32_t val;
+
+    if (bin_sid == NULL || _sid == NULL || length < 2 + SID_ID_AUTHS) {
+        return IDMAP_SID_INVALID;
+    }
+
+    memset(&out, 0, sizeof(out));
+
+    out.sid_rev_num = bin_sid[p];
+    p++;
+
+    out.num_auths = bin_sid[p];
+    p++;
+
+    if (out.num_auths > SID_SUB_AUTHS
+            || length < 2 + SID_ID_AUTHS + out.num_auths * sizeof(uint32_t)) {
+        return IDMAP_SID_INVALID;
+    }
+
+    for (i = 0; i < SID_ID_AUTHS; i++) {
+        out.id_auth[i] = bin_sid[p];
+        p++;
+    }
+
+    for (i = 0; i < out.num_auths; i++) {
+        /* SID sub auth values in Active Directory are stored little-endian,
+         * we store them in host order */
+        SAFEALIGN_COPY_UINT32(&val, bin_sid + p, &p);
+        out.sub_auths[i] = le32toh(val);
+    }
+
+    *_sid = out;
+    return IDMAP_SUCCESS;
+}
+
+enum idmap_error_code sss_idmap_smb_sid_parse(const struct dom_sid *smb_sid,
+                                              struct sss_idmap_sid *_sid)
+{
+    size_t c;
+
+    if (smb_sid == NULL || _sid == NULL
+            || smb_sid->num_auths < 0 || smb_sid->num_auths > SID_SUB_AUTHS) {
+        return IDMAP_SID_INVALID;
+    }
+
+    memset(_sid, 0, sizeof(struct sss_idmap_sid));
+
+    _sid->sid_rev_num = smb_sid->sid_rev_num;
+    _sid->num_auths = smb_sid->num_auths;
+    for (c = 0; c < SID_ID_AUTHS; c++) {
+        _sid->id_auth[c] = smb_sid->id_auth[c];
+    }
+    for (c = 0; c < smb_sid->num_auths; c++) {
+        _sid->sub_auths[c] = smb_sid->sub_auths[c];
+    }
+
+    return IDMAP_SUCCESS;
+}
+
+enum idmap_error_code sss_idmap_sid_format(const struct sss_idmap_sid *sid,
+                                           char *buf, size_t buf_len)
+{
+    char *p = buf;
+    int nc;
+    uint8_t i;
+    uint32_t id_auth_val = 0;
+
+    if (sid == NULL || buf == NULL || sid->num_auths > SID_SUB_AUTHS) {
+        return IDMAP_SID_INVALID;
+    }
+
+    /* Only 32bits are used for the string representation */
+    id_auth_val = (sid->id_auth[2] << 24) +
+                  (sid->id_auth[3] << 16) +
+                  (sid->id_auth[4] << 8) +
+                  (sid->id_auth[5]);
+
+    nc = snprintf(p, buf_len, "S-%u-%lu", sid->sid_rev_num,
+                                          (unsigned long) id_auth_val);
+    if (nc < 0 || nc >= buf_len) {
+        return IDMAP_ERROR;
+    }
+
+    /* Loop through the sub-auths, if any, prepending a hyphen
+     * for each one.
+     */
+    for (i = 0; i < sid->num_auths; i++) {
+        p += nc;
+        buf_len -= nc;
+
+        nc = snprintf(p, buf_len, "-%lu", (unsigned long) sid->sub_auths[i]);
+        if (nc < 0 || nc >= buf_len) {
+            return IDMAP_ERROR;
+        }
+    }
+
+    return IDMAP_SUCCESS;
+}
+
+int sss_idmap_sid_cmp(const struct sss_idmap_sid *sid1,
+                      const struct sss_idmap_sid *sid2)
+{
+    uint8_t c;
+
+    if (sid1->num_auths != sid2->num_auths) {
+        return sid1->num_auths < sid2->num_auths ? -1 : 1;
+    }
+
+    /* the last sub auth, usually the RID, differs first most of the time */
+    for (c = sid1->num_auths; c > 0; c--) {
+        if (sid1->sub_auths[c - 1] != sid2->sub_auths[c - 1]) {
+            return sid1->sub_auths[c - 1] < sid2->sub_auths[c - 1] ? -1 : 1;
+        }
+    }
+
+    if (sid1->sid_rev_num != sid2->sid_rev_num) {
+        return sid1->sid_rev_num < sid2->sid_rev_num ? -1 : 1;
+    }
+
+    return memcmp(sid1->id_auth, sid2->id_auth, SID_ID_AUTHS);
+}
+
+/* Allocates a string for a SID of this size */
+static enum idmap_error_code idmap_sid_to_str(struct sss_idmap_ctx *ctx,
+                                              struct sss_idmap_sid *sid,
+                                              char **_sid)
+{
+    enum idmap_error_code err;
+    char *sid_buf;
+    size_t sid_buf_len;
+
+    if (sid->num_auths > SID_SUB_AUTHS) {
+        return IDMAP_SID_INVALID;
+    }
+
+    sid_buf_len = 25 + sid->num_auths * 11;
+    sid_buf = ctx->alloc_func(sid_buf_len, ctx->alloc_pvt);
+    if (sid_buf == NULL) {
+        return IDMAP_OUT_OF_MEMORY;
+    }
+
+    err = sss_idmap_sid_format(sid, sid_buf, sid_buf_len);
+    if (err != IDMAP_SUCCESS) {
+        ctx->free_func(sid_buf, ctx->alloc_pvt);
+        return IDMAP_SID_INVALID;
+    }
+
+    *_sid = sid_buf;
+    return IDMAP_SUCCESS;
+}
+
 enum idmap_error_code sss_idmap_bin_sid_to_dom_sid(struct sss_idmap_ctx *ctx,
                                                    const uint8_t *bin_sid,
                                                    size_t length,
@@ -162,64 +394,19 @@ enum idmap_error_code sss_idmap_dom_sid_to_sid(struct sss_idmap_ctx *ctx,
                                                struct sss_dom_sid *dom_sid,
                                                char **_sid)
 {
-    enum idmap_error_code err;
-    char *sid_buf;
-    size_t sid_buf_len;
-    char *p;
-    int nc;
-    int8_t i;
-    uint32_t id_auth_val = 0;
+    struct sss_idmap_sid sid;
 
-    if (dom_sid->num_auths > SID_SUB_AUTHS) {
+    if (dom_sid->num_auths < 0 || dom_sid->num_auths > SID_SUB_AUTHS) {
         return IDMAP_SID_INVALID;
     }
 
-    sid_buf_len = 25 + dom_sid->num_auths * 11;
-    sid_buf = ctx->alloc_func(sid_buf_len, ctx->alloc_pvt);
-    if (sid_buf == NULL) {
-        return IDMAP_OUT_OF_MEMORY;
-    }
-    memset(sid_buf, 0, sid_buf_len);
-
-    /* Only 32bits are used for the string representation */
-    id_auth_val = (dom_sid->id_auth[2] << 24) +
-                  (dom_sid->id_auth[3] << 16) +
-                  (dom_sid->id_auth[4] << 8) +
-                  (dom_sid->id_auth[5]);
-
-    nc = snprintf(sid_buf, sid_buf_len, "S-%u-%lu", dom_sid->sid_rev_num,
-                                                    (unsigned long) id_auth_val);
-    if (nc < 0 || nc >= sid_buf_len) {
-        err = IDMAP_SID_INVALID;
-        goto done;
-    }
-
-
-    /* Loop through the sub-auths, if any, prepending a hyphen
-     * for each one.
-     */
-    p = sid_buf;
-    for (i = 0; i < dom_sid->num_auths ; i++) {
-        p += nc;
-        sid_buf_len -= nc;
-
-        nc = snprintf(p, sid_buf_len, "-%lu",
-                                      (unsigned long) dom_sid->sub_auths[i]);
-        if (nc < 0 || nc >= sid_buf_len) {
-            err = IDMAP_SID_INVALID;
-            goto done;
-        }
-    }
+    sid.sid_rev_num = dom_sid->sid_rev_num;
+    sid.num_auths = dom_sid->num_auths;
+    memcpy(sid.id_auth, dom_sid->id_auth, SID_ID_AUTHS);
+    memcpy(sid.sub_auths, dom_sid->sub_auths,
+           dom_sid->num_auths * sizeof(uint32_t));
 
-    *_sid = sid_buf;
-    err = IDMAP_SUCCESS;
-
-done:
-    if (err != IDMAP_SUCCESS) {
-        ctx->free_func(sid_buf, ctx->alloc_pvt);
-    }
-
-    return err;
+    return idmap_sid_to_str(ctx, &sid, _sid);
 }
 
 enum idmap_error_code sss_idmap_sid_to_dom_sid(struct sss_idmap_ctx *ctx,
@@ -227,15 +414,14 @@ enum idmap_error_code sss_idmap_sid_to_dom_sid(struct sss_idmap_ctx *ctx,
                                                struct sss_dom_sid **_dom_sid)
 {
     enum idmap_error_code err;
-    unsigned long ul;
-    char *r;
-    char *end;
+    struct sss_idmap_sid parsed;
     struct sss_dom_sid *dom_sid;
 
     CHECK_IDMAP_CTX(ctx, IDMAP_CONTEXT_INVALID);
 
-    if (sid == NULL || (sid[0] != 'S' && sid[0] != 's') || sid[1] != '-') {
-            return IDMAP_SID_INVALID;
+    err = sss_idmap_sid_parse(sid, &parsed);
+    if (err != IDMAP_SUCCESS) {
+        return err;
     }
 
     dom_sid = ctx->alloc_func(sizeof(struct sss_dom_sid), ctx->alloc_pvt);
@@ -244,86 +430,15 @@ enum idmap_error_code sss_idmap_sid_to_dom_sid(struct sss_idmap_ctx *ctx,
     }
     memset(dom_sid, 0, sizeof(struct sss_dom_sid));
 
+    dom_sid->sid_rev_num = parsed.sid_rev_num;
+    dom_sid->num_auths = parsed.num_auths;
+    memcpy(dom_sid->id_auth, parsed.id_auth, SID_ID_AUTHS);
+    memcpy(dom_sid->sub_auths, parsed.sub_auths,
+           parsed.num_auths * sizeof(uint32_t));
 
-    if (!isdigit(sid[2])) {
-        err = IDMAP_SID_INVALID;
-        goto done;
-    }
-    errno = 0;
-    ul = strtoul(sid + 2, &r, 10);
-    if (errno != 0 || r == NULL || *r != '-' || ul > UINT8_MAX) {
-        err = IDMAP_SID_INVALID;
-        goto done;
-    }
-    dom_sid->sid_rev_num = (uint8_t) ul;
-    r++;
-
-    if (!isdigit(*r)) {
-        err = IDMAP_SID_INVALID;
-        goto done;
-    }
-    errno = 0;
-    ul = strtoul(r, &r, 10);
-    if (errno != 0 || r == NULL || ul > UINT32_MAX) {
-        err = IDMAP_SID_INVALID;
-        goto done;
-    }
-
-    /* id_auth in the string should always be <2^32 in decimal */
-    /* store values in the same order as the binary representation */
-    dom_sid->id_auth[0] = 0;
-    dom_sid->id_auth[1] = 0;
-    dom_sid->id_auth[2] = (ul & 0xff000000) >> 24;
-    dom_sid->id_auth[3] = (ul & 0x00ff0000) >> 16;
-    dom_sid->id_auth[4] = (ul & 0x0000ff00) >> 8;
-    dom_sid->id_auth[5] = (ul & 0x000000ff);
-
-    if (*r == '\0') {
-        /* no sub auths given */
-        err = IDMAP_SUCCESS;
-        goto done;
-    }
-
-    if (*r != '-') {
-        err = IDMAP_SID_INVALID;
-        goto done;
-    }
-
-    do {
-        if (dom_sid->num_auths >= SID_SUB_AUTHS) {
-            err = IDMAP_SID_INVALID;
-            goto done;
-        }
-
-        r++;
-        if (!isdigit(*r)) {
-            err = IDMAP_SID_INVALID;
-            goto done;
-        }
-
-        errno = 0;
-        ul = strtoul(r, &end, 10);
-        if (errno != 0 || ul > UINT32_MAX || end == NULL ||
-            (*end != '\0' && *end != '-')) {
-            err = IDMAP_SID_INVALID;
-            goto done;
-        }
-
-        dom_sid->sub_auths[dom_sid->num_auths++] = ul;
-
-        r = end;
-    } while (*r != '\0');
-
-    err = IDMAP_SUCCESS;
-
-done:
-    if (err != IDMAP_SUCCESS) {
-        ctx->free_func(dom_sid, ctx->alloc_pvt);
-    } else {
-        *_dom_sid = dom_sid;
-    }
+    *_dom_sid = dom_sid;
 
-    return err;
+    return IDMAP_SUCCESS;
 }
 
 enum idmap_error_code sss_idmap_sid_to_bin_sid(struct sss_idmap_ctx *ctx,
@@ -365,29 +480,16 @@ enum idmap_error_code sss_idmap_bin_sid_to_sid(struct sss_idmap_ctx *ctx,
                                                char **_sid)
 {
     enum idmap_error_code err;
-    struct sss_dom_sid *dom_sid = NULL;
-    char *sid = NULL;
+    struct sss_idmap_sid sid;
 
-    err = sss_idmap_bin_sid_to_dom_sid(ctx, bin_sid, length, &dom_sid);
-    if (err != IDMAP_SUCCESS) {
-        goto done;
-    }
+    CHECK_IDMAP_CTX(ctx, IDMAP_CONTEXT_INVALID);
 
-    err = sss_idmap_dom_sid_to_sid(ctx, dom_sid, &sid);
+    err = sss_idmap_bin_sid_parse(bin_sid, length, &sid);
     if (err != IDMAP_SUCCESS) {
-        goto done;
+        return err;
     }
 
-    *_sid = sid;
-    err = IDMAP_SUCCESS;
-
-done:
-    ctx->free_func(dom_sid, ctx->alloc_pvt);
-    if (err != IDMAP_SUCCESS) {
-        ctx->free_func(sid, ctx->alloc_pvt);
-    }
-
-    return err;
+    return idmap_sid_to_str(ctx, &sid, _sid);
 }
 
 enum idmap_error_code sss_idmap_sid_to_smb_sid(struct sss_idmap_ctx *ctx,
@@ -425,29 +527,16 @@ enum idmap_error_code sss_idmap_smb_sid_to_sid(struct sss_idmap_ctx *ctx,
                                                char **_sid)
 {
     enum idmap_error_code err;
-    struct sss_dom_sid *dom_sid = NULL;
-    char *sid = NULL;
+    struct sss_idmap_sid sid;
 
-    err = sss_idmap_smb_sid_to_dom_sid(ctx, smb_sid, &dom_sid);
-    if (err != IDMAP_SUCCESS) {
-        goto done;
-    }
-
-    err = sss_idmap_dom_sid_to_sid(ctx, dom_sid, &sid);
-    if (err != IDMAP_SUCCESS) {
-        goto done;
-    }
-
-    *_sid = sid;
-    err = IDMAP_SUCCESS;
+    CHECK_IDMAP_CTX(ctx, IDMAP_CONTEXT_INVALID);
 
-done:
-    ctx->free_func(dom_sid, ctx->alloc_pvt);
+    err = sss_idmap_smb_sid_parse(smb_sid, &sid);
     if (err != IDMAP_SUCCESS) {
-        ctx->free_func(sid, ctx->alloc_pvt);
+        return err;
     }
 
-    return err;
+    return idmap_sid_to_str(ctx, &sid, _sid);
 }
 
 enum idmap_error_code sss_idmap_dom_sid_to_smb_sid(struct sss_idmap_ctx *ctx,
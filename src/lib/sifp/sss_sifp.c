@@ -264,24 +264,52 @@ sss_sifp_fetch_object(sss_sifp_ctx *ctx,
         goto done;
     }
 
+    ret = sss_sifp_create_object(ctx, name, object_path, interface,
+                                 &attrs, &object);
+    if (ret != SSS_SIFP_OK) {
+        goto done;
+    }
+
+    *_object = object;
+
+    ret = SSS_SIFP_OK;
+
+done:
+    sss_sifp_free_attrs(ctx, &attrs);
+
+    return ret;
+}
+
+sss_sifp_error
+sss_sifp_create_object(sss_sifp_ctx *ctx,
+                       const char *name,
+                       const char *object_path,
+                       const char *interface,
+                       sss_sifp_attr ***_attrs,
+                       sss_sifp_object **_object)
+{
+    sss_sifp_object *object = NULL;
+    sss_sifp_error ret;
+
     object = _alloc_zero(ctx, sss_sifp_object, 1);
     if (object == NULL) {
         ret = SSS_SIFP_OUT_OF_MEMORY;
         goto done;
     }
 
-    object->attrs = attrs;
-
     object->name = sss_sifp_strdup(ctx, name);
     if (object->name == NULL) {
         ret = SSS_SIFP_OUT_OF_MEMORY;
         goto done;
     }
 
-    object->object_path = sss_sifp_strdup(ctx, object_path);
-    if (object->object_path == NULL) {
-        ret = SSS_SIFP_OUT_OF_MEMORY;
-        goto done;
+    /* objects returned by batch methods have no path */
+    if (object_path != NULL) {
+        object->object_path = sss_sifp_strdup(ctx, object_path);
+        if (object->object_path == NULL) {
+            ret = SSS_SIFP_OUT_OF_MEMORY;
+            goto done;
+        }
     }
 
     object->interface = sss_sifp_strdup(ctx, interface);
@@ -290,6 +318,10 @@ sss_sifp_fetch_object(sss_sifp_ctx *ctx,
         goto done;
     }
 
+    /* the object takes over the attributes */
+    object->attrs = *_attrs;
+    *_attrs = NULL;
+
     *_object = object;
 
     ret = SSS_SIFP_OK;
@@ -407,6 +439,28 @@ sss_sifp_free_object(sss_sifp_ctx *ctx,
     *_object = NULL;
 }
 
+void
+sss_sifp_free_object_list(sss_sifp_ctx *ctx,
+                          sss_sifp_object ***_objects)
+{
+    sss_sifp_object **objects = NULL;
+    int i;
+
+    if (_objects == NULL || *_objects == NULL) {
+        return;
+    }
+
+    objects = *_objects;
+
+    for (i = 0; objects[i] != NULL; i++) {
+        sss_sifp_free_object(ctx, &objects[i]);
+    }
+
+    _free(ctx, objects);
+
+    *_objects = NULL;
+}
+
 void
 sss_sifp_free_string(sss_sifp_ctx *ctx,
                      char **_str)
@@ -458,6 +458,16 @@ void
 sss_sifp_free_object(sss_sifp_ctx *ctx,
                      sss_sifp_object **_object);
 
+/**
+ * @brief Free NULL-terminated list of sss_sifp objects and set it to NULL.
+ *
+ * @param[in] ctx sss_sifp context
+ * @param[in,out] _objects List of objects
+ */
+void
+sss_sifp_free_object_list(sss_sifp_ctx *ctx,
+                          sss_sifp_object ***_objects);
+
 /**
  * @brief Free string and set it to NULL.
  *
@@ -533,6 +543,39 @@ sss_sifp_fetch_user_by_name(sss_sifp_ctx *ctx,
                             const char *name,
                             sss_sifp_object **_user);
 
+/**
+ * @brief Fetch all information about several users by name.
+ *
+ * The lookups are sent to the InfoPipe responder at once over the shared
+ * connection instead of one round trip after another. Users which do not
+ * exist are left out of the result.
+ *
+ * @param[in] ctx     sss_sifp context
+ * @param[in] names   NULL-terminated list of user names
+ * @param[out] _users NULL-terminated list of user objects
+ */
+sss_sifp_error
+sss_sifp_fetch_users_by_name(sss_sifp_ctx *ctx,
+                             const char **names,
+                             sss_sifp_object ***_users);
+
+/**
+ * @brief Fetch selected attributes of several users by name.
+ *
+ * All users are looked up with a single D-Bus call. Users which do not
+ * exist are left out of the result. The objects have no object path set.
+ *
+ * @param[in] ctx     sss_sifp context
+ * @param[in] names   NULL-terminated list of user names
+ * @param[in] attrs   NULL-terminated list of attribute names
+ * @param[out] _users NULL-terminated list of user objects
+ */
+sss_sifp_error
+sss_sifp_fetch_users_attrs(sss_sifp_ctx *ctx,
+                           const char **names,
+                           const char **attrs,
+                           sss_sifp_object ***_users);
+
 /**
  * @}
  */
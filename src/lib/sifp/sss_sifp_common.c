@@ -18,6 +18,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdbool.h>
 #include <dbus/dbus.h>
 
 #include "lib/sifp/sss_sifp.h"
@@ -25,6 +26,9 @@
 #include "lib/sifp/sss_sifp_private.h"
 
 #define SSS_SIFP_ATTR_NAME "name"
+#define SSS_SIFP_PATH_USERS SSS_SIFP_PATH_IFP "/Users"
+#define SSS_SIFP_IFACE_USERS_USER SSS_SIFP_IFACE_USERS ".User"
+#define SSS_SIFP_ERROR_NOT_FOUND "org.freedesktop.sssd.Error.NotFound"
 
 static sss_sifp_error
 sss_sifp_fetch_object_by_attr(sss_sifp_ctx *ctx,
@@ -176,3 +180,267 @@ sss_sifp_fetch_user_by_name(sss_sifp_ctx *ctx,
 {
     return sss_sifp_fetch_object_by_name(ctx, "UserByName", name, _user);
 }
+
+static void
+sss_sifp_free_messages(DBusMessage **msgs, unsigned int num_msgs)
+{
+    unsigned int i;
+
+    if (msgs == NULL) {
+        return;
+    }
+
+    for (i = 0; i < num_msgs; i++) {
+        if (msgs[i] != NULL) {
+            dbus_message_unref(msgs[i]);
+            msgs[i] = NULL;
+        }
+    }
+}
+
+/* Returns SSS_SIFP_OK for a method return or if the object does not exist
+ * and SSS_SIFP_IO_ERROR for any other error reply. */
+static sss_sifp_error
+sss_sifp_check_reply(sss_sifp_ctx *ctx,
+                     DBusMessage *reply,
+                     bool *_not_found)
+{
+    DBusError dbus_error;
+
+    *_not_found = false;
+
+    if (dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_ERROR) {
+        return SSS_SIFP_OK;
+    }
+
+    if (dbus_message_is_error(reply, SSS_SIFP_ERROR_NOT_FOUND)) {
+        *_not_found = true;
+        return SSS_SIFP_OK;
+    }
+
+    dbus_error_init(&dbus_error);
+    dbus_set_error_from_message(&dbus_error, reply);
+    sss_sifp_set_io_error(ctx, &dbus_error);
+    dbus_error_free(&dbus_error);
+
+    return SSS_SIFP_IO_ERROR;
+}
+
+sss_sifp_error
+sss_sifp_fetch_users_by_name(sss_sifp_ctx *ctx,
+                             const char **names,
+                             sss_sifp_object ***_users)
+{
+    sss_sifp_object **users = NULL;
+    sss_sifp_attr **attrs = NULL;
+    DBusMessage **msgs = NULL;
+    DBusMessage **replies = NULL;
+    char **object_paths = NULL;
+    const char *interface = SSS_SIFP_IFACE_USERS_USER;
+    const char *name = NULL;
+    unsigned int num_names;
+    unsigned int num_paths;
+    unsigned int num_users;
+    bool not_found;
+    dbus_bool_t bret;
+    sss_sifp_error ret;
+    unsigned int i;
+
+    if (ctx == NULL || names == NULL || _users == NULL) {
+        return SSS_SIFP_INVALID_ARGUMENT;
+    }
+
+    for (num_names = 0; names[num_names] != NULL; num_names++);
+
+    msgs = _alloc_zero(ctx, DBusMessage *, num_names + 1);
+    replies = _alloc_zero(ctx, DBusMessage *, num_names + 1);
+    object_paths = _alloc_zero(ctx, char *, num_names + 1);
+    users = _alloc_zero(ctx, sss_sifp_object *, num_names + 1);
+    if (msgs == NULL || replies == NULL || object_paths == NULL
+            || users == NULL) {
+        ret = SSS_SIFP_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    /* first find all the users ... */
+    for (i = 0; i < num_names; i++) {
+        msgs[i] = sss_sifp_create_message(SSS_SIFP_PATH_USERS,
+                                          SSS_SIFP_IFACE_USERS, "FindByName");
+        if (msgs[i] == NULL) {
+            ret = SSS_SIFP_OUT_OF_MEMORY;
+            goto done;
+        }
+
+        bret = dbus_message_append_args(msgs[i], DBUS_TYPE_STRING, &names[i],
+                                        DBUS_TYPE_INVALID);
+        if (!bret) {
+            ret = SSS_SIFP_OUT_OF_MEMORY;
+            goto done;
+        }
+    }
+
+    ret = sss_sifp_send_messages(ctx, msgs, num_names, replies);
+    if (ret != SSS_SIFP_OK) {
+        goto done;
+    }
+
+    num_paths = 0;
+    for (i = 0; i < num_names; i++) {
+        ret = sss_sifp_check_reply(ctx, replies[i], &not_found);
+        if (ret != SSS_SIFP_OK) {
+            goto done;
+        } else if (not_found) {
+            /* users which do not exist are left out */
+            continue;
+        }
+
+        ret = sss_sifp_parse_object_path(ctx, replies[i],
+                                         &object_paths[num_paths]);
+        if (ret != SSS_SIFP_OK) {
+            goto done;
+        }
+        num_paths++;
+    }
+
+    sss_sifp_free_messages(msgs, num_names);
+    sss_sifp_free_messages(replies, num_names);
+
+    /* ... and then read all their attributes */
+    for (i = 0; i < num_paths; i++) {
+        msgs[i] = sss_sifp_create_message(object_paths[i],
+                                          "org.freedesktop.DBus.Properties",
+                                          "GetAll");
+        if (msgs[i] == NULL) {
+            ret = SSS_SIFP_OUT_OF_MEMORY;
+            goto done;
+        }
+
+        bret = dbus_message_append_args(msgs[i], DBUS_TYPE_STRING, &interface,
+                                        DBUS_TYPE_INVALID);
+        if (!bret) {
+            ret = SSS_SIFP_OUT_OF_MEMORY;
+            goto done;
+        }
+    }
+
+    ret = sss_sifp_send_messages(ctx, msgs, num_paths, replies);
+    if (ret != SSS_SIFP_OK) {
+        goto done;
+    }
+
+    num_users = 0;
+    for (i = 0; i < num_paths; i++) {
+        ret = sss_sifp_check_reply(ctx, replies[i], &not_found);
+        if (ret != SSS_SIFP_OK) {
+            goto done;
+        } else if (not_found) {
+            /* removed from the cache in the meantime */
+            continue;
+        }
+
+        ret = sss_sifp_parse_attr_list(ctx, replies[i], &attrs);
+        if (ret != SSS_SIFP_OK) {
+            goto done;
+        }
+
+        ret = sss_sifp_find_attr_as_string(attrs, SSS_SIFP_ATTR_NAME, &name);
+        if (ret != SSS_SIFP_OK) {
+            goto done;
+        }
+
+        ret = sss_sifp_create_object(ctx, name, object_paths[i], interface,
+                                     &attrs, &users[num_users]);
+        if (ret != SSS_SIFP_OK) {
+            goto done;
+        }
+        num_users++;
+    }
+
+    *_users = users;
+
+    ret = SSS_SIFP_OK;
+
+done:
+    sss_sifp_free_attrs(ctx, &attrs);
+    sss_sifp_free_string_array(ctx, &object_paths);
+
+    if (msgs != NULL) {
+        sss_sifp_free_messages(msgs, num_names);
+        _free(ctx, msgs);
+    }
+
+    if (replies != NULL) {
+        sss_sifp_free_messages(replies, num_names);
+        _free(ctx, replies);
+    }
+
+    if (ret != SSS_SIFP_OK) {
+        sss_sifp_free_object_list(ctx, &users);
+    }
+
+    return ret;
+}
+
+sss_sifp_error
+sss_sifp_fetch_users_attrs(sss_sifp_ctx *ctx,
+                           const char **names,
+                           const char **attrs,
+                           sss_sifp_object ***_users)
+{
+    DBusMessage *msg = NULL;
+    DBusMessage *reply = NULL;
+    unsigned int num_names;
+    unsigned int num_attrs;
+    dbus_bool_t bret;
+    sss_sifp_error ret;
+
+    if (ctx == NULL || names == NULL || attrs == NULL || _users == NULL) {
+        return SSS_SIFP_INVALID_ARGUMENT;
+    }
+
+    for (num_names = 0; names[num_names] != NULL; num_names++);
+    for (num_attrs = 0; attrs[num_attrs] != NULL; num_attrs++);
+
+    /* Message format:
+     * In: array:string:users
+     * In: array:string:attributes
+     * Out: array of dict_entry(string:user, array of dict_entry(...))
+     */
+
+    msg = sss_sifp_create_message(SSS_SIFP_PATH_IFP, SSS_SIFP_IFACE_IFP,
+                                  "GetUsersAttr");
+    if (msg == NULL) {
+        ret = SSS_SIFP_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    bret = dbus_message_append_args(msg,
+                                    DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                    &names, num_names,
+                                    DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                    &attrs, num_attrs,
+                                    DBUS_TYPE_INVALID);
+    if (!bret) {
+        ret = SSS_SIFP_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    ret = sss_sifp_send_message(ctx, msg, &reply);
+    if (ret != SSS_SIFP_OK) {
+        goto done;
+    }
+
+    ret = sss_sifp_parse_object_dict(ctx, reply, SSS_SIFP_IFACE_USERS_USER,
+                                     _users);
+
+done:
+    if (msg != NULL) {
+        dbus_message_unref(msg);
+    }
+
+    if (reply != NULL) {
+        dbus_message_unref(reply);
+    }
+
+    return ret;
+}
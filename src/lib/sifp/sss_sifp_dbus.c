@@ -55,6 +55,40 @@ done:
    return ret;
 }
 
+/* SSSD or the system bus may have been restarted since the connection was
+ * opened. Open a new one instead of failing every following call. */
+static sss_sifp_error sss_sifp_check_connection(sss_sifp_ctx *ctx)
+{
+    DBusConnection *conn = NULL;
+    DBusError dbus_error;
+    sss_sifp_error ret;
+
+    if (ctx->conn != NULL && dbus_connection_get_is_connected(ctx->conn)) {
+        return SSS_SIFP_OK;
+    }
+
+    dbus_error_init(&dbus_error);
+
+    if (ctx->conn != NULL) {
+        dbus_connection_unref(ctx->conn);
+        ctx->conn = NULL;
+    }
+
+    conn = dbus_bus_get(DBUS_BUS_SYSTEM, &dbus_error);
+    if (dbus_error_is_set(&dbus_error)) {
+        sss_sifp_set_io_error(ctx, &dbus_error);
+        ret = SSS_SIFP_IO_ERROR;
+        goto done;
+    }
+
+    ctx->conn = conn;
+    ret = SSS_SIFP_OK;
+
+done:
+    dbus_error_free(&dbus_error);
+    return ret;
+}
+
 DBusMessage *
 sss_sifp_create_message(const char *object_path,
                         const char *interface,
@@ -86,6 +120,11 @@ sss_sifp_send_message_ex(sss_sifp_ctx *ctx,
         return SSS_SIFP_INVALID_ARGUMENT;
     }
 
+    ret = sss_sifp_check_connection(ctx);
+    if (ret != SSS_SIFP_OK) {
+        return ret;
+    }
+
     dbus_error_init(&dbus_error);
 
     reply = dbus_connection_send_with_reply_and_block(ctx->conn, msg,
@@ -109,6 +148,118 @@ done:
     return ret;
 }
 
+sss_sifp_error
+sss_sifp_send_messages(sss_sifp_ctx *ctx,
+                       DBusMessage **msgs,
+                       unsigned int num_msgs,
+                       DBusMessage **replies)
+{
+    return sss_sifp_send_messages_ex(ctx, msgs, num_msgs, 5000, replies);
+}
+
+sss_sifp_error
+sss_sifp_send_messages_ex(sss_sifp_ctx *ctx,
+                          DBusMessage **msgs,
+                          unsigned int num_msgs,
+                          int timeout,
+                          DBusMessage **replies)
+{
+    DBusPendingCall **pending = NULL;
+    DBusError dbus_error;
+    dbus_bool_t bret;
+    sss_sifp_error ret;
+    unsigned int i;
+
+    if (ctx == NULL || msgs == NULL || replies == NULL) {
+        return SSS_SIFP_INVALID_ARGUMENT;
+    }
+
+    for (i = 0; i < num_msgs; i++) {
+        replies[i] = NULL;
+    }
+
+    if (num_msgs == 0) {
+        return SSS_SIFP_OK;
+    }
+
+    ret = sss_sifp_check_connection(ctx);
+    if (ret != SSS_SIFP_OK) {
+        return ret;
+    }
+
+    dbus_error_init(&dbus_error);
+
+    pending = _alloc_zero(ctx, DBusPendingCall *, num_msgs);
+    if (pending == NULL) {
+        ret = SSS_SIFP_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    /* Queue all the calls first so there is a single round trip to wait
+     * for instead of one per message. */
+    for (i = 0; i < num_msgs; i++) {
+        bret = dbus_connection_send_with_reply(ctx->conn, msgs[i],
+                                               &pending[i], timeout);
+        if (!bret) {
+            ret = SSS_SIFP_OUT_OF_MEMORY;
+            goto done;
+        }
+
+        if (pending[i] == NULL) {
+            dbus_set_error_const(&dbus_error, DBUS_ERROR_DISCONNECTED,
+                                 "Connection to the system bus is closed");
+            sss_sifp_set_io_error(ctx, &dbus_error);
+            ret = SSS_SIFP_IO_ERROR;
+            goto done;
+        }
+    }
+
+    dbus_connection_flush(ctx->conn);
+
+    for (i = 0; i < num_msgs; i++) {
+        dbus_pending_call_block(pending[i]);
+
+        /* error replies, including time outs, are returned in place */
+        replies[i] = dbus_pending_call_steal_reply(pending[i]);
+        if (replies[i] == NULL) {
+            dbus_set_error_const(&dbus_error, DBUS_ERROR_NO_REPLY,
+                                 "No reply received");
+            sss_sifp_set_io_error(ctx, &dbus_error);
+            ret = SSS_SIFP_IO_ERROR;
+            goto done;
+        }
+    }
+
+    ret = SSS_SIFP_OK;
+
+done:
+    if (pending != NULL) {
+        for (i = 0; i < num_msgs; i++) {
+            if (pending[i] == NULL) {
+                continue;
+            }
+
+            if (ret != SSS_SIFP_OK) {
+                dbus_pending_call_cancel(pending[i]);
+            }
+            dbus_pending_call_unref(pending[i]);
+        }
+        _free(ctx, pending);
+    }
+
+    if (ret != SSS_SIFP_OK) {
+        for (i = 0; i < num_msgs; i++) {
+            if (replies[i] != NULL) {
+                dbus_message_unref(replies[i]);
+                replies[i] = NULL;
+            }
+        }
+    }
+
+    dbus_error_free(&dbus_error);
+    return ret;
+}
+
 sss_sifp_error
 sss_sifp_invoke_list(sss_sifp_ctx *ctx,
                      const char *method,
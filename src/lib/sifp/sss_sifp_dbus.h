@@ -84,6 +84,48 @@ sss_sifp_send_message_ex(sss_sifp_ctx *ctx,
                          int timeout,
                          DBusMessage **_reply);
 
+/**
+ * @brief Send several D-Bus messages to SSSD InfoPipe bus with 5 seconds
+ * timeout and wait for all the replies.
+ *
+ * All messages are queued before waiting for the first reply, so the
+ * calls are processed by SSSD while the replies travel back.
+ *
+ * @param[in] ctx      sss_sifp context
+ * @param[in] msgs     D-Bus messages
+ * @param[in] num_msgs Number of messages
+ * @param[out] replies Array of at least @num_msgs replies, filled in the
+ *                     order of the messages. Error replies are returned as
+ *                     they are, the caller must check the type of each
+ *                     reply and unref all of them.
+ *
+ * @return SSS_SIFP_OK if a reply was received for every message.
+ */
+sss_sifp_error
+sss_sifp_send_messages(sss_sifp_ctx *ctx,
+                       DBusMessage **msgs,
+                       unsigned int num_msgs,
+                       DBusMessage **replies);
+
+/**
+ * @brief Send several D-Bus messages to SSSD InfoPipe bus and wait for all
+ * the replies.
+ *
+ * @param[in] ctx      sss_sifp context
+ * @param[in] msgs     D-Bus messages
+ * @param[in] num_msgs Number of messages
+ * @param[in] timeout  Timeout of each message
+ * @param[out] replies Array of at least @num_msgs replies
+ *
+ * @see sss_sifp_send_messages
+ */
+sss_sifp_error
+sss_sifp_send_messages_ex(sss_sifp_ctx *ctx,
+                          DBusMessage **msgs,
+                          unsigned int num_msgs,
+                          int timeout,
+                          DBusMessage **replies);
+
 /**
  * @brief List objects that satisfies given conditions. This routine will
  * invoke List<method> D-Bus method on SSSD InfoPipe interface. Arguments
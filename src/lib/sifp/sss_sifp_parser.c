@@ -560,6 +560,73 @@ done:
     return ret;
 }
 
+/**
+ * DBusMessageIter format:
+ * array of dict_entry(string:attr_name, variant:value)
+ */
+static sss_sifp_error
+sss_sifp_parse_attr_list_iter(sss_sifp_ctx *ctx,
+                              DBusMessageIter *iter,
+                              sss_sifp_attr ***_attrs)
+{
+    DBusMessageIter array_iter;
+    DBusMessageIter dict_iter;
+    sss_sifp_attr **attrs = NULL;
+    const char *name = NULL;
+    unsigned int num_values;
+    sss_sifp_error ret;
+    unsigned int i;
+
+    check_dbus_arg(iter, DBUS_TYPE_ARRAY, ret, done);
+
+    if (dbus_message_iter_get_element_type(iter) != DBUS_TYPE_DICT_ENTRY) {
+        ret = SSS_SIFP_INTERNAL_ERROR;
+        goto done;
+    }
+
+    num_values = sss_sifp_get_array_length(iter);
+    attrs = _alloc_zero(ctx, sss_sifp_attr *, num_values + 1);
+    if (attrs == NULL) {
+        ret = SSS_SIFP_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    dbus_message_iter_recurse(iter, &array_iter);
+
+    for (i = 0; i < num_values; i++) {
+        dbus_message_iter_recurse(&array_iter, &dict_iter);
+
+        /* get the key */
+        check_dbus_arg(&dict_iter, DBUS_TYPE_STRING, ret, done);
+        dbus_message_iter_get_basic(&dict_iter, &name);
+
+        if (!dbus_message_iter_next(&dict_iter)) {
+            ret = SSS_SIFP_INTERNAL_ERROR;
+            goto done;
+        }
+
+        /* now read the value */
+        check_dbus_arg(&dict_iter, DBUS_TYPE_VARIANT, ret, done);
+
+        ret = sss_sifp_parse_single_attr(ctx, name, &dict_iter, &attrs[i]);
+        if (ret != SSS_SIFP_OK) {
+            goto done;
+        }
+
+        dbus_message_iter_next(&array_iter);
+    }
+
+    *_attrs = attrs;
+    ret = SSS_SIFP_OK;
+
+done:
+    if (ret != SSS_SIFP_OK) {
+        sss_sifp_free_attrs(ctx, &attrs);
+    }
+
+    return ret;
+}
+
 /**
  * DBusMessage format:
  * array of dict_entry(string:attr_name, variant:value)
@@ -570,11 +637,30 @@ sss_sifp_parse_attr_list(sss_sifp_ctx *ctx,
                          sss_sifp_attr ***_attrs)
 {
     DBusMessageIter iter;
+
+    dbus_message_iter_init(msg, &iter);
+
+    return sss_sifp_parse_attr_list_iter(ctx, &iter, _attrs);
+}
+
+/**
+ * DBusMessage format:
+ * array of dict_entry(string:object_name,
+ *                     array of dict_entry(string:attr_name, variant:value))
+ */
+sss_sifp_error
+sss_sifp_parse_object_dict(sss_sifp_ctx *ctx,
+                           DBusMessage *msg,
+                           const char *interface,
+                           sss_sifp_object ***_objects)
+{
+    DBusMessageIter iter;
     DBusMessageIter array_iter;
     DBusMessageIter dict_iter;
+    sss_sifp_object **objects = NULL;
     sss_sifp_attr **attrs = NULL;
     const char *name = NULL;
-    unsigned int num_values;
+    unsigned int num_objects;
     sss_sifp_error ret;
     unsigned int i;
 
@@ -587,16 +673,16 @@ sss_sifp_parse_attr_list(sss_sifp_ctx *ctx,
         goto done;
     }
 
-    num_values = sss_sifp_get_array_length(&iter);
-    attrs = _alloc_zero(ctx, sss_sifp_attr *, num_values + 1);
-    if (attrs == NULL) {
+    num_objects = sss_sifp_get_array_length(&iter);
+    objects = _alloc_zero(ctx, sss_sifp_object *, num_objects + 1);
+    if (objects == NULL) {
         ret = SSS_SIFP_OUT_OF_MEMORY;
         goto done;
     }
 
     dbus_message_iter_recurse(&iter, &array_iter);
 
-    for (i = 0; i < num_values; i++) {
+    for (i = 0; i < num_objects; i++) {
         dbus_message_iter_recurse(&array_iter, &dict_iter);
 
         /* get the key */
@@ -608,10 +694,14 @@ sss_sifp_parse_attr_list(sss_sifp_ctx *ctx,
             goto done;
         }
 
-        /* now read the value */
-        check_dbus_arg(&dict_iter, DBUS_TYPE_VARIANT, ret, done);
+        /* now read the attributes */
+        ret = sss_sifp_parse_attr_list_iter(ctx, &dict_iter, &attrs);
+        if (ret != SSS_SIFP_OK) {
+            goto done;
+        }
 
-        ret = sss_sifp_parse_single_attr(ctx, name, &dict_iter, &attrs[i]);
+        ret = sss_sifp_create_object(ctx, name, NULL, interface,
+                                     &attrs, &objects[i]);
         if (ret != SSS_SIFP_OK) {
             goto done;
         }
@@ -619,12 +709,14 @@ sss_sifp_parse_attr_list(sss_sifp_ctx *ctx,
         dbus_message_iter_next(&array_iter);
     }
 
-    *_attrs = attrs;
+    *_objects = objects;
     ret = SSS_SIFP_OK;
 
 done:
+    sss_sifp_free_attrs(ctx, &attrs);
+
     if (ret != SSS_SIFP_OK) {
-        sss_sifp_free_attrs(ctx, &attrs);
+        sss_sifp_free_object_list(ctx, &objects);
     }
 
     return ret;
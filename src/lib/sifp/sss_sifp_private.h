@@ -104,6 +104,20 @@ sss_sifp_parse_attr_list(sss_sifp_ctx *ctx,
                          DBusMessage *msg,
                          sss_sifp_attr ***_attrs);
 
+sss_sifp_error
+sss_sifp_parse_object_dict(sss_sifp_ctx *ctx,
+                           DBusMessage *msg,
+                           const char *interface,
+                           sss_sifp_object ***_objects);
+
+sss_sifp_error
+sss_sifp_create_object(sss_sifp_ctx *ctx,
+                       const char *name,
+                       const char *object_path,
+                       const char *interface,
+                       sss_sifp_attr ***_attrs,
+                       sss_sifp_object **_object);
+
 sss_sifp_error
 sss_sifp_parse_object_path(sss_sifp_ctx *ctx,
                            DBusMessage *msg,
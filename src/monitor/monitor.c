@@ -32,6 +32,7 @@
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <popt.h>
@@ -129,6 +130,17 @@ struct mt_svc {
     int failed_pongs;
     DBusPendingCall *pending;
 
+    /* the startup times of the service are logged once it started */
+    bool startup_logged;
+    DBusPendingCall *startup_pending;
+
+    /* replaces the pings once the service started beating */
+    struct sss_heartbeat *heartbeat;
+    int heartbeat_fd;
+    uint32_t last_beat;
+    unsigned long long last_cpu_time;
+    int busy_checks;
+
     int debug_level;
 
     struct tevent_timer *ping_ev;
@@ -154,11 +166,20 @@ struct config_file_ctx {
     struct config_file_callback *callbacks;
 };
 
+/* The providers a responder waits for before it is started */
+struct mt_svc_deps {
+    /* NULL-terminated list of domain names */
+    char **domains;
+    bool queued;
+};
+
 struct mt_ctx {
     struct tevent_context *ev;
     struct confdb_ctx *cdb;
     struct sss_domain_info *domains;
     char **services;
+    /* one entry for each of the services above */
+    struct mt_svc_deps *svc_deps;
     int num_services;
     int started_services;
     struct mt_svc *svc_list;
@@ -186,6 +207,7 @@ static int monitor_service_init(struct sbus_connection *conn, void *data);
 static int service_send_ping(struct mt_svc *svc);
 static int service_signal_reset_offline(struct mt_svc *svc);
 static void ping_check(DBusPendingCall *pending, void *data);
+static void service_query_startup_times(struct mt_svc *svc);
 
 static void set_tasks_checker(struct mt_svc *srv);
 static int monitor_kill_service (struct mt_svc *svc);
@@ -341,6 +363,16 @@ static int svc_destructor(void *mem)
     if (svc->pending) {
         dbus_pending_call_cancel(svc->pending);
     }
+    if (svc->startup_pending) {
+        dbus_pending_call_cancel(svc->startup_pending);
+    }
+
+    if (svc->heartbeat != NULL) {
+        munmap(svc->heartbeat, sizeof(struct sss_heartbeat));
+    }
+    if (svc->heartbeat_fd != -1) {
+        close(svc->heartbeat_fd);
+    }
 
     /* svc is being freed, neutralize the spy */
     if (svc->conn_spy) {
@@ -554,12 +586,172 @@ static void svc_run_diag_cmd(struct mt_svc *svc)
     _exit(1);
 }
 
+/* The sudo and autofs responders only need the domains which implement
+ * them, the other responders need all of them. */
+static bool monitor_service_needs_domain(struct mt_ctx *ctx,
+                                         const char *service,
+                                         const char *domain)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char *option;
+    char *path;
+    char *provider = NULL;
+    char *id_provider = NULL;
+    bool needed = true;
+    errno_t ret;
+
+    if (strcasecmp(service, "sudo") == 0) {
+        option = CONFDB_DOMAIN_SUDO_PROVIDER;
+    } else if (strcasecmp(service, "autofs") == 0) {
+        option = CONFDB_DOMAIN_AUTOFS_PROVIDER;
+    } else {
+        return true;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return true;
+    }
+
+    path = talloc_asprintf(tmp_ctx, CONFDB_DOMAIN_PATH_TMPL, domain);
+    if (path == NULL) {
+        goto done;
+    }
+
+    ret = confdb_get_string(ctx->cdb, tmp_ctx, path, option,
+                            NULL, &provider);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (provider != NULL) {
+        needed = strcasecmp(provider, "none") != 0;
+        goto done;
+    }
+
+    /* by default the ID provider is used, only these implement both */
+    ret = confdb_get_string(ctx->cdb, tmp_ctx, path,
+                            CONFDB_DOMAIN_ID_PROVIDER, NULL, &id_provider);
+    if (ret != EOK || id_provider == NULL) {
+        goto done;
+    }
+
+    needed = strcasecmp(id_provider, "ldap") == 0
+             || strcasecmp(id_provider, "ipa") == 0
+             || strcasecmp(id_provider, "ad") == 0;
+
+done:
+    talloc_free(tmp_ctx);
+    return needed;
+}
+
+static errno_t monitor_init_service_deps(struct mt_ctx *ctx)
+{
+    struct sss_domain_info *dom;
+    int num_domains;
+    int n;
+    int i;
+
+    ctx->svc_deps = talloc_zero_array(ctx, struct mt_svc_deps,
+                                      ctx->num_services + 1);
+    if (ctx->svc_deps == NULL) {
+        return ENOMEM;
+    }
+
+    num_domains = 0;
+    for (dom = ctx->domains; dom; dom = get_next_domain(dom, 0)) {
+        num_domains++;
+    }
+
+    for (i = 0; ctx->services[i]; i++) {
+        ctx->svc_deps[i].domains = talloc_zero_array(ctx->svc_deps, char *,
+                                                     num_domains + 1);
+        if (ctx->svc_deps[i].domains == NULL) {
+            return ENOMEM;
+        }
+
+        n = 0;
+        for (dom = ctx->domains; dom; dom = get_next_domain(dom, 0)) {
+            if (!monitor_service_needs_domain(ctx, ctx->services[i],
+                                              dom->name)) {
+                DEBUG(SSSDBG_TRACE_FUNC, "Service %s does not wait for "
+                      "domain %s\n", ctx->services[i], dom->name);
+                continue;
+            }
+
+            ctx->svc_deps[i].domains[n] = talloc_strdup(ctx->svc_deps,
+                                                        dom->name);
+            if (ctx->svc_deps[i].domains[n] == NULL) {
+                return ENOMEM;
+            }
+            n++;
+        }
+    }
+
+    return EOK;
+}
+
+static bool monitor_provider_is_started(struct mt_ctx *ctx,
+                                        const char *name)
+{
+    struct mt_svc *iter;
+
+    for (iter = ctx->svc_list; iter; iter = iter->next) {
+        if (iter->provider && strcasecmp(iter->name, name) == 0) {
+            return iter->svc_started;
+        }
+    }
+
+    return false;
+}
+
+/* Starts the responders whose providers are all registered, or all of the
+ * remaining ones if @force is set. */
+static void monitor_start_ready_services(struct mt_ctx *ctx, bool force)
+{
+    struct mt_svc_deps *deps;
+    bool ready;
+    int queued = 0;
+    int i;
+    int j;
+
+    for (i = 0; ctx->services[i]; i++) {
+        deps = &ctx->svc_deps[i];
+        if (deps->queued) {
+            queued++;
+            continue;
+        }
+
+        ready = true;
+        for (j = 0; !force && deps->domains[j]; j++) {
+            if (!monitor_provider_is_started(ctx, deps->domains[j])) {
+                DEBUG(SSSDBG_FUNC_DATA, "Service %s is still waiting on "
+                      "%s provider.\n", ctx->services[i], deps->domains[j]);
+                ready = false;
+                break;
+            }
+        }
+
+        if (!ready) {
+            continue;
+        }
+
+        DEBUG(SSSDBG_CONF_SETTINGS, "Now starting service %s\n",
+              ctx->services[i]);
+        deps->queued = true;
+        queued++;
+        add_new_service(ctx, ctx->services[i], 0);
+    }
+
+    if (queued == ctx->num_services) {
+        ctx->services_started = true;
+    }
+}
+
 static int mark_service_as_started(struct mt_svc *svc)
 {
     struct mt_ctx *ctx = svc->mt_ctx;
-    struct mt_svc *iter;
     int ret;
-    int i;
 
     DEBUG(SSSDBG_FUNC_DATA, "Marking %s as started.\n", svc->name);
     svc->svc_started = true;
@@ -573,29 +765,9 @@ static int mark_service_as_started(struct mt_svc *svc)
         goto done;
     }
 
-    if (!ctx->services_started) {
-
-        /* check if all providers are up */
-        for (iter = ctx->svc_list; iter; iter = iter->next) {
-            if (iter->provider && !iter->svc_started) {
-                DEBUG(SSSDBG_FUNC_DATA,
-                      "Still waiting on %s provider.\n", iter->name);
-                break;
-            }
-        }
-
-        if (iter) {
-            /* there are still unstarted providers */
-            goto done;
-        }
-
-        ctx->services_started = true;
-
-        DEBUG(SSSDBG_CONF_SETTINGS, "Now starting services!\n");
-        /* then start all services */
-        for (i = 0; ctx->services[i]; i++) {
-            add_new_service(ctx, ctx->services[i], 0);
-        }
+    if (!ctx->services_started && svc->provider) {
+        /* start the responders which were waiting for this provider */
+        monitor_start_ready_services(ctx, false);
     }
 
     if (svc->type == MT_SVC_SERVICE) {
@@ -635,7 +807,6 @@ static void services_startup_timeout(struct tevent_context *ev,
                                      struct timeval t, void *ptr)
 {
     struct mt_ctx *ctx = talloc_get_type(ptr, struct mt_ctx);
-    int i;
 
     DEBUG(SSSDBG_TRACE_FUNC, "Handling timeout\n");
 
@@ -644,13 +815,7 @@ static void services_startup_timeout(struct tevent_context *ev,
         DEBUG(SSSDBG_CRIT_FAILURE, "Providers did not start in time, "
                   "forcing services startup!\n");
 
-        ctx->services_started = true;
-
-        DEBUG(SSSDBG_CONF_SETTINGS, "Now starting services!\n");
-        /* then start all services */
-        for (i = 0; ctx->services[i]; i++) {
-            add_new_service(ctx, ctx->services[i], 0);
-        }
+        monitor_start_ready_services(ctx, true);
     }
 }
 
@@ -700,6 +865,109 @@ static int monitor_dbus_init(struct mt_ctx *ctx)
     return ret;
 }
 
+/* A service whose heartbeat stopped is given more time while it is using
+ * the CPU or waiting for the disk, e.g. in a long cache transaction, but
+ * not forever. */
+#define MT_SVC_MAX_BUSY_CHECKS 30
+
+static errno_t service_get_cpu_time(pid_t pid, char *_state,
+                                    unsigned long long *_cpu_time)
+{
+    char path[64];
+    char buf[1024];
+    unsigned long long utime;
+    unsigned long long stime;
+    char state;
+    char *p;
+    ssize_t len;
+    int fd;
+    int ret;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return errno;
+    }
+
+    len = sss_atomic_read_s(fd, buf, sizeof(buf) - 1);
+    ret = errno;
+    close(fd);
+    if (len <= 0) {
+        return len == 0 ? EINVAL : ret;
+    }
+    buf[len] = '\0';
+
+    /* the command name may contain spaces and parentheses */
+    p = strrchr(buf, ')');
+    if (p == NULL) {
+        return EINVAL;
+    }
+
+    ret = sscanf(p + 1, " %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                 &state, &utime, &stime);
+    if (ret != 3) {
+        return EINVAL;
+    }
+
+    *_state = state;
+    *_cpu_time = utime + stime;
+    return EOK;
+}
+
+/* Returns false if the service does not beat (yet) and must be pinged */
+static bool service_check_heartbeat(struct mt_svc *svc)
+{
+    unsigned long long cpu_time;
+    uint32_t beat;
+    char state;
+    bool busy = false;
+    errno_t ret;
+
+    if (svc->heartbeat == NULL) {
+        return false;
+    }
+
+    beat = __sync_add_and_fetch(&svc->heartbeat->counter, 0);
+    if (beat == 0) {
+        return false;
+    }
+
+    if (beat != svc->last_beat) {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Service %s is alive\n", svc->name);
+        svc->last_beat = beat;
+        svc->failed_pongs = 0;
+        svc->busy_checks = 0;
+        return true;
+    }
+
+    /* the event loop is blocked, see whether the service is working */
+    ret = service_get_cpu_time(svc->pid, &state, &cpu_time);
+    if (ret == EOK) {
+        busy = state == 'D' || cpu_time != svc->last_cpu_time;
+        svc->last_cpu_time = cpu_time;
+    }
+
+    if (busy && svc->busy_checks < MT_SVC_MAX_BUSY_CHECKS) {
+        svc->busy_checks++;
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Service %s is busy and missed its heartbeat. Attempt [%d]\n",
+              svc->name, svc->busy_checks);
+        return true;
+    }
+
+    DEBUG(SSSDBG_CRIT_FAILURE,
+          "Service %s missed its heartbeat. Attempt [%d]\n",
+          svc->name, svc->failed_pongs);
+    svc->failed_pongs++;
+
+    if (debug_level & SSSDBG_TRACE_LIBS) {
+        svc_run_diag_cmd(svc);
+    }
+
+    return true;
+}
+
 static void tasks_check_handler(struct tevent_context *ev,
                                 struct tevent_timer *te,
                                 struct timeval t, void *ptr)
@@ -707,7 +975,16 @@ static void tasks_check_handler(struct tevent_context *ev,
     struct mt_svc *svc = talloc_get_type(ptr, struct mt_svc);
     int ret;
 
-    ret = service_send_ping(svc);
+    if (service_check_heartbeat(svc)) {
+        ret = EOK;
+    } else {
+        ret = service_send_ping(svc);
+    }
+
+    if (!svc->startup_logged) {
+        service_query_startup_times(svc);
+    }
+
     switch (ret) {
     case EOK:
         /* all fine */
@@ -971,6 +1248,11 @@ static int service_signal_sysbus_reconnect(struct mt_svc *svc)
     return service_signal(svc, MON_CLI_IFACE_SYSBUSRECONNECT);
 }
 
+static int service_signal_mem_report(struct mt_svc *svc)
+{
+    return service_signal(svc, MON_CLI_IFACE_MEMREPORT);
+}
+
 static int check_domain_ranges(struct sss_domain_info *domains)
 {
     struct sss_domain_info *dom = domains, *other = NULL;
@@ -1305,6 +1587,7 @@ static int get_service_config(struct mt_ctx *ctx, const char *name,
     }
     svc->mt_ctx = ctx;
     svc->type = MT_SVC_SERVICE;
+    svc->heartbeat_fd = -1;
 
     talloc_set_destructor((TALLOC_CTX *)svc, svc_destructor);
 
@@ -1461,6 +1744,7 @@ static int get_provider_config(struct mt_ctx *ctx, const char *name,
     }
     svc->mt_ctx = ctx;
     svc->type = MT_SVC_PROVIDER;
+    svc->heartbeat_fd = -1;
 
     talloc_set_destructor((TALLOC_CTX *)svc, svc_destructor);
 
@@ -1640,7 +1924,8 @@ static void monitor_hup(struct tevent_context *ev,
     DEBUG(SSSDBG_CRIT_FAILURE, "Received SIGHUP.\n");
 
     /* Send D-Bus message to other services to rotate their logs.
-     * NSS service receives also message to clear memory caches. */
+     * NSS, SUDO and AUTOFS services receive also message to clear memory
+     * caches. */
     for(cur_svc = ctx->svc_list; cur_svc; cur_svc = cur_svc->next) {
         service_signal_rotate(cur_svc);
         if (!strcmp(NSS_SBUS_SERVICE_NAME, cur_svc->name)) {
@@ -1648,7 +1933,12 @@ static void monitor_hup(struct tevent_context *ev,
             service_signal_clear_enum_cache(cur_svc);
         }
 
+        if (!strcmp(SSS_SUDO_SBUS_SERVICE_NAME, cur_svc->name)) {
+            service_signal_clear_memcache(cur_svc);
+        }
+
         if (!strcmp(SSS_AUTOFS_SBUS_SERVICE_NAME, cur_svc->name)) {
+            service_signal_clear_memcache(cur_svc);
             service_signal_clear_enum_cache(cur_svc);
         }
 
@@ -1848,6 +2138,27 @@ static void signal_offline_reset(struct tevent_context *ev,
     signal_res_init(monitor);
 }
 
+static void signal_mem_report(struct tevent_context *ev,
+                              struct tevent_signal *se,
+                              int signum,
+                              int count,
+                              void *siginfo,
+                              void *private_data)
+{
+    struct mt_ctx *monitor;
+    struct mt_svc *cur_svc;
+
+    monitor = talloc_get_type(private_data, struct mt_ctx);
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+         "Signaling all services to write a memory report.\n");
+
+    /* the monitor writes its own report from the handler of server.c */
+    for(cur_svc = monitor->svc_list; cur_svc; cur_svc = cur_svc->next) {
+        service_signal_mem_report(cur_svc);
+    }
+}
+
 static int monitor_ctx_destructor(void *mem)
 {
     struct mt_ctx *mon = talloc_get_type(mem, struct mt_ctx);
@@ -2545,6 +2856,13 @@ static int monitor_process_init(struct mt_ctx *ctx,
         return EIO;
     }
 
+    /* Handle SIGWINCH (tell all services to write a memory report) */
+    tes = tevent_add_signal(ctx->ev, ctx, SIGWINCH, 0,
+                            signal_mem_report, ctx);
+    if (tes == NULL) {
+        return EIO;
+    }
+
     /* Set up the SIGCHLD handler */
     ret = sss_sigchld_init(ctx, ctx->ev, &ctx->sigchld_ctx);
     if (ret != EOK) return ret;
@@ -2583,6 +2901,7 @@ static int monitor_process_init(struct mt_ctx *ctx,
     if (!tmp_ctx) {
         return ENOMEM;
     }
+    server_startup_begin(STARTUP_PHASE_SYSDB);
     ret = sysdb_init_ext(tmp_ctx, ctx->domains, true,
                          true, ctx->uid, ctx->gid);
     if (ret != EOK) {
@@ -2590,14 +2909,17 @@ static int monitor_process_init(struct mt_ctx *ctx,
         return ret;
     }
     talloc_zfree(tmp_ctx);
+    server_startup_end(STARTUP_PHASE_SYSDB);
 
     /* Initialize D-BUS Server
      * The monitor will act as a D-BUS server for all
      * SSSD processes */
+    server_startup_begin(STARTUP_PHASE_SBUS);
     ret = monitor_dbus_init(ctx);
     if (ret != EOK) {
         return ret;
     }
+    server_startup_end(STARTUP_PHASE_SBUS);
 
     ret = setup_netlink(ctx, ctx->ev, network_status_change_cb,
                         ctx, &ctx->nlctx);
@@ -2607,7 +2929,12 @@ static int monitor_process_init(struct mt_ctx *ctx,
         return ret;
     }
 
-    /* start providers */
+    ret = monitor_init_service_deps(ctx);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    /* start all providers at once */
     num_providers = 0;
     for (dom = ctx->domains; dom; dom = get_next_domain(dom, 0)) {
         ret = add_new_provider(ctx, dom->name, 0);
@@ -2621,25 +2948,22 @@ static int monitor_process_init(struct mt_ctx *ctx,
 
     if (num_providers > 0) {
         /* now set the services stratup timeout *
-         * (responders will be started automatically when all
-         *  providers are up and running or when the tomeout
-         *  expires) */
+         * (each responder is started as soon as the providers it needs
+         *  are up and running or when the tomeout expires) */
         ret = add_services_startup_timeout(ctx);
         if (ret != EOK) {
             return ret;
         }
-    } else {
-        int i;
-
-        ctx->services_started = true;
 
+        /* responders which need none of the providers start right away */
+        monitor_start_ready_services(ctx, false);
+    } else {
         /* No providers start services immediately
          * Normally this means only LOCAL is configured */
-        for (i = 0; ctx->services[i]; i++) {
-            add_new_service(ctx, ctx->services[i], 0);
-        }
+        monitor_start_ready_services(ctx, true);
     }
 
+    server_startup_ready();
     return EOK;
 }
 
@@ -2827,6 +3151,132 @@ done:
     dbus_message_unref(reply);
 }
 
+static void startup_times_check(DBusPendingCall *pending, void *data);
+
+/* Asked along with the pings until the service finished its startup, the
+ * backends only finish once they checked whether they are online */
+static void service_query_startup_times(struct mt_svc *svc)
+{
+    DBusMessage *msg;
+    int ret;
+
+    if (svc->conn == NULL || svc->startup_pending != NULL) {
+        return;
+    }
+
+    msg = dbus_message_new_method_call(NULL,
+                                       MONITOR_PATH,
+                                       MON_CLI_IFACE,
+                                       MON_CLI_IFACE_STARTUPTIMES);
+    if (msg == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory?!\n");
+        return;
+    }
+
+    ret = sbus_conn_send(svc->conn, msg,
+                         svc->ping_time * 1000, /* milliseconds */
+                         startup_times_check, svc, &svc->startup_pending);
+    dbus_message_unref(msg);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot ask %s for its startup times [%d]: %s\n",
+              svc->name, ret, sss_strerror(ret));
+    }
+}
+
+static void startup_times_check(DBusPendingCall *pending, void *data)
+{
+    struct mt_svc *svc;
+    DBusMessage *reply;
+    DBusError dbus_error;
+    const char *error_name;
+    char **names = NULL;
+    dbus_uint64_t *usec;
+    dbus_uint64_t *end_usec;
+    int num_names;
+    int num_usec;
+    int num_end_usec;
+    dbus_bool_t done;
+    dbus_bool_t dbret;
+    uint64_t total = 0;
+    char *summary;
+    int i;
+
+    svc = talloc_get_type(data, struct mt_svc);
+    if (svc == NULL) {
+        return;
+    }
+    svc->startup_pending = NULL;
+
+    dbus_error_init(&dbus_error);
+
+    reply = dbus_pending_call_steal_reply(pending);
+    if (reply == NULL) {
+        goto done;
+    }
+
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+        error_name = dbus_message_get_error_name(reply);
+        if (error_name == NULL
+                || strcmp(error_name, DBUS_ERROR_NO_REPLY) != 0) {
+            /* e.g. not supported, do not ask again */
+            DEBUG(SSSDBG_TRACE_FUNC, "Service %s returned no startup times "
+                  "[%s]\n", svc->name, error_name ? error_name : "unknown");
+            svc->startup_logged = true;
+        }
+        goto done;
+    }
+
+    dbret = dbus_message_get_args(reply, &dbus_error,
+                                  DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                  &names, &num_names,
+                                  DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64,
+                                  &usec, &num_usec,
+                                  DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64,
+                                  &end_usec, &num_end_usec,
+                                  DBUS_TYPE_BOOLEAN, &done,
+                                  DBUS_TYPE_INVALID);
+    if (!dbret || num_names != num_usec || num_names != num_end_usec) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Invalid startup times of service %s\n", svc->name);
+        svc->startup_logged = true;
+        goto done;
+    }
+
+    if (!done) {
+        /* ask again with the next ping */
+        goto done;
+    }
+    svc->startup_logged = true;
+
+    summary = talloc_strdup(NULL, "");
+    for (i = 0; i < num_names && summary != NULL; i++) {
+        summary = talloc_asprintf_append(summary, ", %s %"PRIu64" ms "
+                                         "(done at %"PRIu64" ms)",
+                                         names[i],
+                                         (uint64_t) usec[i] / 1000,
+                                         (uint64_t) end_usec[i] / 1000);
+        total = MAX(total, end_usec[i]);
+    }
+
+    DEBUG(SSSDBG_IMPORTANT_INFO,
+          "Service %s finished its startup in %"PRIu64" ms%s\n",
+          svc->name, total / 1000, summary == NULL ? "" : summary);
+    talloc_free(summary);
+
+done:
+    if (names != NULL) {
+        dbus_free_string_array(names);
+    }
+    if (dbus_error_is_set(&dbus_error)) {
+        dbus_error_free(&dbus_error);
+    }
+    dbus_pending_call_unref(pending);
+    if (reply != NULL) {
+        dbus_message_unref(reply);
+    }
+}
+
 static void service_startup_handler(struct tevent_context *ev,
                                     struct tevent_timer *te,
                                     struct timeval t, void *ptr);
@@ -2856,6 +3306,65 @@ static int start_service(struct mt_svc *svc)
     return EOK;
 }
 
+/* The shared file is unlinked right away, the monitor and the service only
+ * know it by the descriptor. */
+static errno_t service_setup_heartbeat(struct mt_svc *svc)
+{
+    char template[] = DB_PATH"/heartbeat_XXXXXX";
+    struct sss_heartbeat *heartbeat;
+    mode_t old_umask;
+    int fd;
+    errno_t ret;
+
+    if (svc->heartbeat != NULL) {
+        /* restarted service */
+        svc->heartbeat->counter = 0;
+        goto done;
+    }
+
+    old_umask = umask(SSS_DFL_UMASK);
+    fd = mkstemp(template);
+    ret = errno;
+    umask(old_umask);
+    if (fd == -1) {
+        return ret;
+    }
+    unlink(template);
+
+    if (ftruncate(fd, sizeof(struct sss_heartbeat)) != 0) {
+        ret = errno;
+        close(fd);
+        return ret;
+    }
+
+    heartbeat = mmap(NULL, sizeof(struct sss_heartbeat),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (heartbeat == MAP_FAILED) {
+        ret = errno;
+        close(fd);
+        return ret;
+    }
+
+    /* only the service is meant to inherit it */
+    ret = fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (ret == -1) {
+        ret = errno;
+        munmap(heartbeat, sizeof(struct sss_heartbeat));
+        close(fd);
+        return ret;
+    }
+
+    svc->heartbeat = heartbeat;
+    svc->heartbeat_fd = fd;
+
+done:
+    /* at least one beat between two checks */
+    svc->heartbeat->interval = svc->ping_time > 2 ? svc->ping_time / 2 : 1;
+    svc->last_beat = 0;
+    svc->busy_checks = 0;
+    return EOK;
+}
+
 static void mt_svc_exit_handler(int pid, int wait_status, void *pvt);
 static void service_startup_handler(struct tevent_context *ev,
                                     struct tevent_timer *te,
@@ -2870,6 +3379,13 @@ static void service_startup_handler(struct tevent_context *ev,
         return;
     }
 
+    ret = service_setup_heartbeat(mt_svc);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Could not set up the heartbeat of [%s], it will be pinged "
+              "instead [%d]: %s\n", mt_svc->name, ret, sss_strerror(ret));
+    }
+
     mt_svc->pid = fork();
     if (mt_svc->pid != 0) {
         if (mt_svc->pid == -1) {
@@ -2882,6 +3398,7 @@ static void service_startup_handler(struct tevent_context *ev,
         /* Parent */
         mt_svc->mt_ctx->check_children = true;
         mt_svc->failed_pongs = 0;
+        mt_svc->startup_logged = false;
 
         /* Handle process exit */
         ret = sss_child_register(mt_svc,
@@ -2906,6 +3423,15 @@ static void service_startup_handler(struct tevent_context *ev,
 
     /* child */
 
+    if (mt_svc->heartbeat_fd != -1) {
+        if (fcntl(mt_svc->heartbeat_fd, F_SETFD, 0) == 0) {
+            char fd_str[16];
+
+            snprintf(fd_str, sizeof(fd_str), "%d", mt_svc->heartbeat_fd);
+            setenv(SSS_HEARTBEAT_FD_ENV, fd_str, 1);
+        }
+    }
+
     args = parse_args(mt_svc->command);
     execvp(args[0], args);
 
@@ -3022,6 +3548,7 @@ static void monitor_restart_service(struct mt_svc *svc)
     }
 }
 
+#ifndef UNIT_TESTING
 int main(int argc, const char *argv[])
 {
     int opt;
@@ -3189,6 +3716,7 @@ int main(int argc, const char *argv[])
     }
 
     /* Parse config file, fail if cannot be done */
+    server_startup_begin(STARTUP_PHASE_CONFDB);
     ret = load_configuration(tmp_ctx, config_file, &monitor);
     if (ret != EOK) {
         switch (ret) {
@@ -3242,3 +3770,4 @@ int main(int argc, const char *argv[])
 
     return 0;
 }
+#endif
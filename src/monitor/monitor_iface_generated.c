@@ -99,6 +99,20 @@ const struct sbus_method_meta mon_cli_iface__methods[] = {
         offsetof(struct mon_cli_iface, sysbusReconnect),
         NULL, /* no invoker */
     },
+    {
+        "memReport", /* name */
+        NULL, /* no in_args */
+        NULL, /* no out_args */
+        offsetof(struct mon_cli_iface, memReport),
+        NULL, /* no invoker */
+    },
+    {
+        "startupTimes", /* name */
+        NULL, /* no in_args */
+        NULL, /* no out_args */
+        offsetof(struct mon_cli_iface, startupTimes),
+        NULL, /* no invoker */
+    },
     { NULL, }
 };
 
@@ -35,11 +35,24 @@
 
 #define SSSD_SERVICE_PIPE "private/sbus-monitor"
 
+/* Liveness counter shared by the monitor with each service it starts. The
+ * descriptor of the shared file is passed in the environment variable, the
+ * service increments the counter from its event loop every @interval
+ * seconds so the monitor does not need to ping it over D-Bus. */
+#define SSS_HEARTBEAT_FD_ENV "_SSS_HEARTBEAT_FD"
+
+struct sss_heartbeat {
+    uint32_t interval;
+    uint32_t counter;
+};
+
 int monitor_get_sbus_address(TALLOC_CTX *mem_ctx, char **address);
 int monitor_common_send_id(struct sbus_connection *conn,
                            const char *name, uint16_t version);
 int monitor_common_pong(struct sbus_request *dbus_req, void *data);
 int monitor_common_res_init(struct sbus_request *dbus_req, void *data);
+int monitor_common_mem_report(struct sbus_request *dbus_req, void *data);
+int monitor_common_startup_times(struct sbus_request *dbus_req, void *data);
 
 errno_t sss_monitor_init(TALLOC_CTX *mem_ctx,
                          struct tevent_context *ev,
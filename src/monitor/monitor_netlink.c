@@ -68,6 +68,16 @@
 
 #define BUFSIZE 8
 
+#define DEVICE_LINK "device"
+/* 7 = strlen(DEVICE_LINK)+1, 1 = path delimeter */
+#define SYSFS_DEVICE_PATH_MAX (SYSFS_IFACE_PATH_MAX+7+1)
+
+/* The changes are reported once no other message came for
+ * NETLINK_SETTLE_MSEC, but at most NETLINK_MAX_DELAY seconds after the
+ * first one, so that a flapping interface does not postpone them forever */
+#define NETLINK_SETTLE_MSEC 1000
+#define NETLINK_MAX_DELAY 5
+
 #ifdef HAVE_LIBNL
 /* Wrappers determining use of libnl version 1 or 3 */
 #ifdef HAVE_LIBNL3
@@ -101,14 +111,29 @@ enum nlw_msg_type {
     NLW_OTHER
 };
 
+/* The last known carrier status of an interface */
+struct netlink_link {
+    int ifidx;
+    bool up;
+};
+
 struct netlink_ctx {
 #ifdef HAVE_LIBNL
     struct nlw_handle *nlp;
 #endif
+    struct tevent_context *ev;
     struct tevent_fd *tefd;
 
     network_change_cb change_cb;
     void *cb_data;
+
+    /* the changes which are not reported yet */
+    struct tevent_timer *settle_te;
+    struct timeval first_change;
+    unsigned int pending;
+
+    struct netlink_link *links;
+    size_t num_links;
 };
 
 #ifdef HAVE_LIBNL
@@ -250,6 +275,39 @@ static bool has_phy_80211_subdir(const char *sysfs_path)
     return false;
 }
 
+/* Interfaces such as the veth pairs and bridges of containers or the tun
+ * devices of a VPN have no device behind them */
+static bool has_device_link(const char *sysfs_path)
+{
+    char device_path[SYSFS_DEVICE_PATH_MAX];
+    struct stat statbuf;
+    errno_t ret;
+
+    ret = snprintf(device_path, SYSFS_DEVICE_PATH_MAX,
+                   "%s/%s", sysfs_path, DEVICE_LINK);
+    if (ret < 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "snprintf failed\n");
+        return true;
+    } else if (ret >= SYSFS_DEVICE_PATH_MAX) {
+        DEBUG(SSSDBG_OP_FAILURE, "path too long?!?!\n");
+        return true;
+    }
+
+    errno = 0;
+    ret = stat(device_path, &statbuf);
+    if (ret == -1) {
+        ret = errno;
+        if (ret != ENOENT && ret != ENOTDIR) {
+            DEBUG(SSSDBG_OP_FAILURE, "stat failed: [%d] %s\n",
+                  ret, strerror(ret));
+            return true;
+        }
+        return false;
+    }
+
+    return true;
+}
+
 static bool discard_iff_up(const char *ifname)
 {
     char path[SYSFS_IFACE_PATH_MAX];
@@ -286,6 +344,14 @@ static bool discard_iff_up(const char *ifname)
         return true;
     }
 
+    /* Their carrier comes and goes with the containers, an address or a
+     * route which is set on them is still reported */
+    if (!has_device_link(path)) {
+        DEBUG(SSSDBG_TRACE_FUNC, "%s is a virtual interface, filtering out\n",
+              ifname);
+        return true;
+    }
+
     return false;
 }
 
@@ -309,6 +375,87 @@ static void nladdr_to_string(struct nl_addr *nl, char *buf, size_t bufsize)
     }
 }
 
+/*******************************************************************
+ *                 Coalescing of the network changes
+ *******************************************************************/
+
+static void netlink_change_handler(struct tevent_context *ev,
+                                   struct tevent_timer *te,
+                                   struct timeval current_time,
+                                   void *pvt)
+{
+    struct netlink_ctx *ctx = talloc_get_type(pvt, struct netlink_ctx);
+
+    ctx->settle_te = NULL;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "The network settled after %u change(s)\n",
+          ctx->pending);
+    ctx->pending = 0;
+
+    ctx->change_cb(ctx->cb_data);
+}
+
+/* Every message postpones the report until the network settles */
+static void netlink_changed(struct netlink_ctx *ctx)
+{
+    struct timeval deadline;
+    struct timeval tv;
+
+    tv = tevent_timeval_current();
+    if (ctx->pending++ == 0) {
+        ctx->first_change = tv;
+    }
+
+    tv = tevent_timeval_add(&tv, NETLINK_SETTLE_MSEC / 1000,
+                            (NETLINK_SETTLE_MSEC % 1000) * 1000);
+    deadline = tevent_timeval_add(&ctx->first_change, NETLINK_MAX_DELAY, 0);
+    if (tevent_timeval_compare(&tv, &deadline) > 0) {
+        tv = deadline;
+    }
+
+    talloc_zfree(ctx->settle_te);
+    ctx->settle_te = tevent_add_timer(ctx->ev, ctx, tv,
+                                      netlink_change_handler, ctx);
+    if (ctx->settle_te == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot delay the network change, "
+              "reporting it right away\n");
+        ctx->pending = 0;
+        ctx->change_cb(ctx->cb_data);
+    }
+}
+
+static struct netlink_link *netlink_find_link(struct netlink_ctx *ctx,
+                                              int ifidx)
+{
+    size_t i;
+
+    for (i = 0; i < ctx->num_links; i++) {
+        if (ctx->links[i].ifidx == ifidx) {
+            return &ctx->links[i];
+        }
+    }
+
+    return NULL;
+}
+
+static errno_t netlink_add_link(struct netlink_ctx *ctx, int ifidx, bool up)
+{
+    struct netlink_link *links;
+
+    links = talloc_realloc(ctx, ctx->links, struct netlink_link,
+                           ctx->num_links + 1);
+    if (links == NULL) {
+        return ENOMEM;
+    }
+
+    links[ctx->num_links].ifidx = ifidx;
+    links[ctx->num_links].up = up;
+    ctx->links = links;
+    ctx->num_links++;
+
+    return EOK;
+}
+
 /*******************************************************************
  * Wrappers for different capabilities of different libnl versions
  *******************************************************************/
@@ -626,6 +773,30 @@ static bool route_is_multicast(struct rtnl_route *route_obj)
     return false;
 }
 
+/* The kernel adds and removes the routes to the addresses of the host in
+ * the local table and the fe80::/64 routes together with the addresses and
+ * the links, neither leads to a server */
+static bool route_is_local(struct rtnl_route *route_obj)
+{
+    struct in6_addr *addr6;
+    struct nl_addr *nl;
+
+    if (rtnl_route_get_table(route_obj) == RT_TABLE_LOCAL
+            || rtnl_route_get_scope(route_obj) == RT_SCOPE_HOST) {
+        return true;
+    }
+
+    nl = rtnl_route_get_dst(route_obj);
+    if (nl != NULL && nl_addr_get_family(nl) == AF_INET6) {
+        addr6 = nl_addr_get_binary_addr(nl);
+        if (addr6 != NULL && IN6_IS_ADDR_LINKLOCAL(addr6)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static void route_msg_handler(struct nl_object *obj, void *arg)
 {
     struct rtnl_route *route_obj;
@@ -635,6 +806,12 @@ static void route_msg_handler(struct nl_object *obj, void *arg)
 
     route_obj = (struct rtnl_route *) obj;
 
+    if (route_is_local(route_obj)) {
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "Discarding local route message\n");
+        return;
+    }
+
     if (route_is_multicast(route_obj)) {
         DEBUG(SSSDBG_TRACE_INTERNAL,
               "Discarding multicast route message\n");
@@ -645,7 +822,7 @@ static void route_msg_handler(struct nl_object *obj, void *arg)
         route_msg_debug_print(route_obj);
     }
 
-    ctx->change_cb(ctx->cb_data);
+    netlink_changed(ctx);
 }
 
 static void addr_msg_debug_print(struct rtnl_addr *addr_obj)
@@ -679,17 +856,34 @@ static void addr_msg_handler(struct nl_object *obj, void *arg)
         addr_msg_debug_print(addr_obj);
     }
 
-    ctx->change_cb(ctx->cb_data);
+    /* Loopback and link-local addresses do not lead to a server, a
+     * tentative address is reported again once it passed DAD */
+    if (rtnl_addr_get_scope(addr_obj) >= RT_SCOPE_LINK) {
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "Discarding link-local address message\n");
+        return;
+    }
+
+    if (rtnl_addr_get_flags(addr_obj) & IFA_F_TENTATIVE) {
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "Discarding tentative address message\n");
+        return;
+    }
+
+    netlink_changed(ctx);
 }
 
 static void link_msg_handler(struct nl_object *obj, void *arg)
 {
     struct netlink_ctx *ctx = (struct netlink_ctx *) arg;
+    struct netlink_link *link;
     struct rtnl_link *link_obj;
     unsigned int flags;
     char str_flags[512];
     int ifidx;
     const char *ifname;
+    bool up;
+    errno_t ret;
 
     if (!nlw_is_link_object(obj)) return;
 
@@ -703,11 +897,40 @@ static void link_msg_handler(struct nl_object *obj, void *arg)
     DEBUG(SSSDBG_TRACE_LIBS, "netlink link message: iface idx %u (%s) "
           "flags 0x%X (%s)\n", ifidx, ifname, flags, str_flags);
 
+    if (flags & IFF_LOOPBACK) {
+        return;
+    }
+
     /* IFF_LOWER_UP is the indicator of carrier status */
-    if ((flags & IFF_RUNNING) && (flags & IFF_LOWER_UP) &&
-         !discard_iff_up(ifname)) {
-        ctx->change_cb(ctx->cb_data);
+    up = (flags & IFF_RUNNING) && (flags & IFF_LOWER_UP);
+
+    /* The kernel reports every change of the interface, not only those of
+     * the carrier. Only the interfaces which were not discarded when they
+     * came up are remembered. */
+    link = netlink_find_link(ctx, ifidx);
+    if (link != NULL) {
+        if (link->up == up) {
+            return;
+        }
+
+        link->up = up;
+        if (up) {
+            netlink_changed(ctx);
+        }
+        return;
+    }
+
+    if (!up || discard_iff_up(ifname)) {
+        return;
     }
+
+    ret = netlink_add_link(ctx, ifidx, up);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot remember the status of %s\n",
+              ifname);
+    }
+
+    netlink_changed(ctx);
 }
 
 static void netlink_fd_handler(struct tevent_context *ev, struct tevent_fd *fde,
@@ -748,6 +971,7 @@ int setup_netlink(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
     if (!nlctx) return ENOMEM;
     talloc_set_destructor((TALLOC_CTX *) nlctx, netlink_ctx_destructor);
 
+    nlctx->ev        = ev;
     nlctx->change_cb = change_cb;
     nlctx->cb_data   = cb_data;
 
@@ -105,6 +105,7 @@ static void id_callback(DBusPendingCall *pending, void *ptr)
     }
 
 done:
+    server_startup_end(STARTUP_PHASE_SBUS);
     dbus_pending_call_unref(pending);
     dbus_message_unref(reply);
 }
@@ -162,6 +163,41 @@ int monitor_common_res_init(struct sbus_request *dbus_req, void *data)
     return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
 }
 
+int monitor_common_mem_report(struct sbus_request *dbus_req, void *data)
+{
+    sss_talloc_report(NULL, SSS_MEM_REPORT_DEPTH, SSS_MEM_REPORT_MIN_SIZE);
+
+    return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
+}
+
+int monitor_common_startup_times(struct sbus_request *dbus_req, void *data)
+{
+    const char **names;
+    uint64_t *usec;
+    uint64_t *end_usec;
+    size_t count;
+    bool done;
+    dbus_bool_t dbus_done;
+    errno_t ret;
+
+    ret = server_startup_times(dbus_req, &names, &usec, &end_usec,
+                               &count, &done);
+    if (ret != EOK) {
+        return ret;
+    }
+    dbus_done = done;
+
+    return sbus_request_return_and_finish(dbus_req,
+                                          DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                          &names, (int) count,
+                                          DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64,
+                                          &usec, (int) count,
+                                          DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64,
+                                          &end_usec, (int) count,
+                                          DBUS_TYPE_BOOLEAN, &dbus_done,
+                                          DBUS_TYPE_INVALID);
+}
+
 errno_t sss_monitor_init(TALLOC_CTX *mem_ctx,
                          struct tevent_context *ev,
                          struct mon_cli_iface *mon_iface,
@@ -174,6 +210,9 @@ errno_t sss_monitor_init(TALLOC_CTX *mem_ctx,
     char *sbus_address;
     struct sbus_connection *conn;
 
+    /* ends when the monitor acknowledges the registration */
+    server_startup_begin(STARTUP_PHASE_SBUS);
+
     /* Set up SBUS connection to the monitor */
     ret = monitor_get_sbus_address(NULL, &sbus_address);
     if (ret != EOK) {
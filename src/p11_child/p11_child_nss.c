@@ -27,6 +27,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <popt.h>
+#ifdef HAVE_PRCTL
+#include <sys/prctl.h>
+#endif
 
 #include "util/util.h"
 
@@ -57,6 +60,94 @@ enum pin_mode {
     PIN_KEYPAD
 };
 
+/* With --worker the same process serves one request after the other, the
+ * successful validation of a certificate is trusted for this long so that
+ * the pre-auth and the auth request of a login do not both wait for OCSP. */
+#define P11C_VERIFY_CACHE_TIMEOUT 30
+#define P11C_VERIFY_CACHE_SIZE 16
+
+struct p11c_verify_cache_entry {
+    SECItem *der;
+    time_t valid_until;
+};
+
+static struct p11c_verify_cache_entry verify_cache[P11C_VERIFY_CACHE_SIZE];
+static bool verify_cache_enabled;
+
+static bool p11c_verify_cache_lookup(CERTCertificate *cert)
+{
+    time_t now = time(NULL);
+    size_t c;
+
+    for (c = 0; c < P11C_VERIFY_CACHE_SIZE; c++) {
+        if (verify_cache[c].der != NULL
+                && verify_cache[c].valid_until > now
+                && SECITEM_ItemsAreEqual(verify_cache[c].der,
+                                         &cert->derCert)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void p11c_verify_cache_add(CERTCertificate *cert)
+{
+    time_t now = time(NULL);
+    size_t oldest = 0;
+    size_t c;
+
+    /* an expired entry or else the one which expires first is replaced */
+    for (c = 0; c < P11C_VERIFY_CACHE_SIZE; c++) {
+        if (verify_cache[c].der == NULL || verify_cache[c].valid_until <= now) {
+            oldest = c;
+            break;
+        }
+        if (verify_cache[c].valid_until < verify_cache[oldest].valid_until) {
+            oldest = c;
+        }
+    }
+
+    if (verify_cache[oldest].der != NULL) {
+        SECITEM_FreeItem(verify_cache[oldest].der, PR_TRUE);
+    }
+
+    verify_cache[oldest].der = SECITEM_DupItem(&cert->derCert);
+    verify_cache[oldest].valid_until = now + P11C_VERIFY_CACHE_TIMEOUT;
+}
+
+static void p11c_verify_cache_clear(void)
+{
+    size_t c;
+
+    for (c = 0; c < P11C_VERIFY_CACHE_SIZE; c++) {
+        if (verify_cache[c].der != NULL) {
+            SECITEM_FreeItem(verify_cache[c].der, PR_TRUE);
+            verify_cache[c].der = NULL;
+        }
+    }
+}
+
+static SECStatus p11c_verify_cert(CERTCertDBHandle *handle,
+                                  CERTCertificate *cert)
+{
+    SECStatus rv;
+
+    if (verify_cache_enabled && p11c_verify_cache_lookup(cert)) {
+        DEBUG(SSSDBG_TRACE_ALL, "Certificate [%s] was validated recently.\n",
+                                cert->subjectName);
+        return SECSuccess;
+    }
+
+    rv = CERT_VerifyCertificateNow(handle, cert, PR_TRUE,
+                                   certificateUsageSSLClient, NULL, NULL);
+    if (rv == SECSuccess && verify_cache_enabled) {
+        p11c_verify_cache_add(cert);
+    }
+
+    return rv;
+}
+
 static char *password_passthrough(PK11SlotInfo *slot, PRBool retry, void *arg)
 {
   /* give up if 1) no password was supplied, or 2) the password has already
@@ -69,17 +160,11 @@ static char *password_passthrough(PK11SlotInfo *slot, PRBool retry, void *arg)
 
 
 
-int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
-            enum op_mode mode, const char *pin, bool do_ocsp, char **cert,
-            char **token_name_out)
+static errno_t p11c_nss_init(const char *nss_db, NSSInitContext **_nss_ctx)
 {
-    int ret;
-    SECStatus rv;
     NSSInitContext *nss_ctx;
     SECMODModuleList *mod_list;
     SECMODModuleList *mod_list_item;
-    const char *slot_name;
-    const char *token_name;
     uint32_t flags = NSS_INIT_READONLY
                                    | NSS_INIT_FORCEOPEN
                                    | NSS_INIT_NOROOTINIT
@@ -87,24 +172,6 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
                                    | NSS_INIT_PK11RELOAD;
     NSSInitParameters parameters = { 0 };
     parameters.length =  sizeof (parameters);
-    PK11SlotInfo *slot = NULL;
-    CK_SLOT_ID slot_id;
-    SECMODModuleID module_id;
-    CERTCertList *cert_list = NULL;
-    CERTCertListNode *cert_list_node;
-    const PK11DefaultArrayEntry friendly_attr = { "Publicly-readable certs",
-                                                  SECMOD_FRIENDLY_FLAG,
-                                                  CKM_INVALID_MECHANISM };
-    CERTCertDBHandle *handle;
-    unsigned char random_value[128];
-    SECKEYPrivateKey *priv_key;
-    SECOidTag algtag;
-    SECItem signed_random_value = {0};
-    SECKEYPublicKey *pub_key;
-    CERTCertificate *found_cert = NULL;
-    PK11SlotList *list = NULL;
-    PK11SlotListElement *le;
-
 
     nss_ctx = NSS_InitContext(nss_db, "", "", SECMOD_DB, &parameters, flags);
     if (nss_ctx == NULL) {
@@ -145,6 +212,62 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
                                 mod_list_item->module->dllName);
     }
 
+    *_nss_ctx = nss_ctx;
+    return EOK;
+}
+
+static void p11c_nss_shutdown(NSSInitContext *nss_ctx)
+{
+    SECStatus rv;
+
+    rv = NSS_ShutdownContext(nss_ctx);
+    if (rv != SECSuccess) {
+        DEBUG(SSSDBG_OP_FAILURE, "NSS_ShutdownContext failed [%d].\n",
+                                 PR_GetError());
+    }
+}
+
+/* A reader plugged in after the module was loaded is only seen by modules
+ * which are asked for it, a worker asks before every request. */
+static void p11c_update_slot_lists(void)
+{
+    SECMODModuleList *mod_list_item;
+
+    for (mod_list_item = SECMOD_GetDefaultModuleList(); mod_list_item != NULL;
+                                   mod_list_item = mod_list_item->next) {
+        if (mod_list_item->module->loaded
+                && SECMOD_HasRemovableSlots(mod_list_item->module)) {
+            (void) SECMOD_UpdateSlotList(mod_list_item->module);
+        }
+    }
+}
+
+int do_work(TALLOC_CTX *mem_ctx, const char *slot_name_in,
+            enum op_mode mode, const char *pin, bool do_ocsp, char **cert,
+            char **token_name_out)
+{
+    int ret;
+    SECStatus rv;
+    const char *slot_name;
+    const char *token_name;
+    PK11SlotInfo *slot = NULL;
+    CK_SLOT_ID slot_id;
+    SECMODModuleID module_id;
+    CERTCertList *cert_list = NULL;
+    CERTCertListNode *cert_list_node;
+    const PK11DefaultArrayEntry friendly_attr = { "Publicly-readable certs",
+                                                  SECMOD_FRIENDLY_FLAG,
+                                                  CKM_INVALID_MECHANISM };
+    CERTCertDBHandle *handle;
+    unsigned char random_value[128];
+    SECKEYPrivateKey *priv_key;
+    SECOidTag algtag;
+    SECItem signed_random_value = {0};
+    SECKEYPublicKey *pub_key;
+    CERTCertificate *found_cert = NULL;
+    PK11SlotList *list = NULL;
+    PK11SlotListElement *le;
+
     if (slot_name_in != NULL) {
         slot = PK11_FindSlotByName(slot_name_in);
         if (slot == NULL) {
@@ -212,7 +335,8 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
             if (rv !=  SECSuccess) {
                 DEBUG(SSSDBG_OP_FAILURE, "PK11_Authenticate failed: [%d].\n",
                                          PR_GetError());
-                return EIO;
+                ret = EIO;
+                goto done;
             }
         } else {
             DEBUG(SSSDBG_CRIT_FAILURE,
@@ -226,7 +350,8 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
     if (cert_list == NULL) {
         DEBUG(SSSDBG_OP_FAILURE, "PK11_ListCertsInSlot failed: [%d].\n",
                                  PR_GetError());
-        return EIO;
+        ret = EIO;
+        goto done;
     }
 
     for (cert_list_node = CERT_LIST_HEAD(cert_list);
@@ -245,14 +370,16 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
     if (rv != SECSuccess) {
         DEBUG(SSSDBG_OP_FAILURE, "CERT_FilterCertListByUsage failed: [%d].\n",
                                  PR_GetError());
-        return EIO;
+        ret = EIO;
+        goto done;
     }
 
     rv = CERT_FilterCertListForUserCerts(cert_list);
     if (rv != SECSuccess) {
         DEBUG(SSSDBG_OP_FAILURE, "CERT_FilterCertListForUserCerts failed: [%d].\n",
                                  PR_GetError());
-        return EIO;
+        ret = EIO;
+        goto done;
     }
 
 
@@ -260,7 +387,8 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
     if (handle == NULL) {
         DEBUG(SSSDBG_OP_FAILURE, "CERT_GetDefaultCertDB failed: [%d].\n",
                                  PR_GetError());
-        return EIO;
+        ret = EIO;
+        goto done;
     }
 
     if (do_ocsp) {
@@ -268,7 +396,8 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
         if (rv != SECSuccess) {
             DEBUG(SSSDBG_OP_FAILURE, "CERT_EnableOCSPChecking failed: [%d].\n",
                                      PR_GetError());
-            return EIO;
+            ret = EIO;
+            goto done;
         }
     }
 
@@ -282,9 +411,7 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
                              cert_list_node->cert->nickname,
                              cert_list_node->cert->subjectName);
 
-            rv = CERT_VerifyCertificateNow(handle, cert_list_node->cert,
-                                           PR_TRUE, certificateUsageSSLClient,
-                                           NULL, NULL);
+            rv = p11c_verify_cert(handle, cert_list_node->cert);
             if (rv != SECSuccess) {
                 DEBUG(SSSDBG_OP_FAILURE,
                       "Certificate [%s][%s] not valid [%d], skipping.\n",
@@ -318,7 +445,8 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
         if (rv != SECSuccess) {
             DEBUG(SSSDBG_OP_FAILURE,
                   "PK11_GenerateRandom failed [%d].\n", PR_GetError());
-            return EIO;
+            ret = EIO;
+            goto done;
         }
 
         priv_key = PK11_FindPrivateKeyFromCert(slot, found_cert, NULL);
@@ -394,6 +522,14 @@ int do_work(TALLOC_CTX *mem_ctx, const char *nss_db, const char *slot_name_in,
 
 done:
     if (slot != NULL) {
+        /* a worker must not leave the token logged in for the next request */
+        if (mode == OP_AUTH) {
+            rv = PK11_Logout(slot);
+            if (rv != SECSuccess) {
+                DEBUG(SSSDBG_MINOR_FAILURE, "PK11_Logout failed [%d].\n",
+                                            PR_GetError());
+            }
+        }
         PK11_FreeSlot(slot);
     }
 
@@ -403,12 +539,6 @@ done:
 
     PORT_Free(signed_random_value.data);
 
-    rv = NSS_ShutdownContext(nss_ctx);
-    if (rv != SECSuccess) {
-        DEBUG(SSSDBG_OP_FAILURE, "NSS_ShutdownContext failed [%d].\n",
-                                 PR_GetError());
-    }
-
     return ret;
 }
 
@@ -452,6 +582,203 @@ static errno_t p11c_recv_data(TALLOC_CTX *mem_ctx, int fd, char **pin)
     return EOK;
 }
 
+/* ==Worker-mode============================================================ */
+
+/* With --worker the PAM responder keeps the child running, the modules and
+ * the certificate DB are loaded only once. Each request is preceded by its
+ * length and contains the PAM command and the PIN, if any. The reply is
+ * what a single run prints to stdout, preceded by its length, an empty reply
+ * means that no certificate was found or that the request failed. */
+#define P11C_WORKER_MSG_SIZE 4096
+
+static errno_t p11c_worker_read_msg(int fd, uint8_t *buf, size_t size,
+                                    size_t *_len)
+{
+    uint8_t len_buf[sizeof(uint32_t)];
+    uint32_t len;
+    ssize_t ret;
+    size_t p = 0;
+
+    errno = 0;
+    ret = sss_atomic_read_s(fd, len_buf, sizeof(len_buf));
+    if (ret == -1) {
+        return errno;
+    } else if (ret == 0) {
+        return ENOENT;
+    } else if (ret != sizeof(len_buf)) {
+        return EINVAL;
+    }
+    SAFEALIGN_COPY_UINT32(&len, len_buf, &p);
+
+    if (len < 2 * sizeof(uint32_t) || len > size) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid message size %u.\n", len);
+        return EINVAL;
+    }
+
+    errno = 0;
+    ret = sss_atomic_read_s(fd, buf, len);
+    if (ret == -1) {
+        return errno;
+    } else if (ret != len) {
+        return EINVAL;
+    }
+
+    *_len = len;
+    return EOK;
+}
+
+static errno_t p11c_worker_write_msg(int fd, const char *msg)
+{
+    ssize_t written;
+
+    errno = 0;
+    written = sss_atomic_write_msg_s(fd, msg, msg == NULL ? 0 : strlen(msg));
+    if (written == -1) {
+        return errno;
+    }
+
+    return EOK;
+}
+
+static errno_t p11c_worker_request(TALLOC_CTX *mem_ctx,
+                                   uint8_t *buf, size_t len, bool do_ocsp,
+                                   char **_reply)
+{
+    uint32_t cmd;
+    uint32_t pin_len;
+    enum op_mode mode;
+    char *pin = NULL;
+    char *cert = NULL;
+    char *token_name = NULL;
+    size_t p = 0;
+    errno_t ret;
+
+    SAFEALIGN_COPY_UINT32(&cmd, buf, &p);
+    SAFEALIGN_COPY_UINT32(&pin_len, buf + p, &p);
+    switch (cmd) {
+    case SSS_PAM_AUTHENTICATE:
+        mode = OP_AUTH;
+        break;
+    case SSS_PAM_PREAUTH:
+        mode = OP_PREAUTH;
+        break;
+    default:
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unexpected PAM command [%u].\n", cmd);
+        return EINVAL;
+    }
+
+    if (pin_len > len - p || (mode == OP_PREAUTH && pin_len != 0)) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid request.\n");
+        return EINVAL;
+    }
+
+    if (pin_len != 0) {
+        pin = talloc_strndup(mem_ctx, (char *) buf + p, pin_len);
+        if (pin == NULL) {
+            return ENOMEM;
+        }
+        if (strlen(pin) != pin_len) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "PIN contains additional data.\n");
+            ret = EINVAL;
+            goto done;
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Serving a [%s] request.\n",
+          mode == OP_AUTH ? "auth" : "pre-auth");
+
+    p11c_update_slot_lists();
+
+    ret = do_work(mem_ctx, NULL, mode, pin, do_ocsp, &cert, &token_name);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "do_work failed.\n");
+        goto done;
+    }
+
+    if (cert == NULL) {
+        *_reply = NULL;
+        ret = EOK;
+        goto done;
+    }
+
+    *_reply = talloc_asprintf(mem_ctx, "%s\n%s\n", token_name, cert);
+    if (*_reply == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    if (pin != NULL) {
+        safezero(pin, pin_len);
+    }
+    talloc_free(pin);
+    talloc_free(cert);
+    talloc_free(token_name);
+    return ret;
+}
+
+static errno_t p11c_worker_serve(TALLOC_CTX *mem_ctx, const char *nss_db,
+                                 bool do_ocsp)
+{
+    uint8_t buf[P11C_WORKER_MSG_SIZE];
+    NSSInitContext *nss_ctx;
+    char *reply;
+    size_t len;
+    errno_t ret;
+
+#ifdef HAVE_PRCTL
+    /* the PINs pass through the memory of the long running process */
+    if (prctl(PR_SET_DUMPABLE, 0, 0, 0, 0) != 0
+            || prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "prctl failed [%d][%s].\n",
+                                   ret, strerror(ret));
+        return ret;
+    }
+#endif
+
+    ret = p11c_nss_init(nss_db, &nss_ctx);
+    if (ret != EOK) {
+        return ret;
+    }
+    verify_cache_enabled = true;
+
+    while (true) {
+        ret = p11c_worker_read_msg(STDIN_FILENO, buf, sizeof(buf), &len);
+        if (ret == ENOENT) {
+            DEBUG(SSSDBG_TRACE_FUNC, "The responder closed the pipe.\n");
+            ret = EOK;
+            break;
+        } else if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "read failed [%d][%s].\n", ret, strerror(ret));
+            break;
+        }
+
+        reply = NULL;
+        ret = p11c_worker_request(mem_ctx, buf, len, do_ocsp, &reply);
+        safezero(buf, len);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Request failed [%d][%s].\n",
+                  ret, sss_strerror(ret));
+        }
+
+        ret = p11c_worker_write_msg(STDOUT_FILENO, reply);
+        talloc_free(reply);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "write failed [%d][%s].\n", ret, strerror(ret));
+            break;
+        }
+    }
+
+    p11c_verify_cache_clear();
+    p11c_nss_shutdown(nss_ctx);
+    return ret;
+}
+
 int main(int argc, const char *argv[])
 {
     int opt;
@@ -468,6 +795,8 @@ int main(int argc, const char *argv[])
     char *nss_db = NULL;
     bool do_ocsp = true;
     char *verify_opts = NULL;
+    NSSInitContext *nss_ctx;
+    int worker = 0;
 
     struct poptOption long_options[] = {
         POPT_AUTOHELP
@@ -491,6 +820,8 @@ int main(int argc, const char *argv[])
          NULL},
         {"nssdb", 0, POPT_ARG_STRING, &nss_db, 0, _("NSS DB to use"),
          NULL},
+        {"worker", 0, POPT_ARG_NONE, &worker, 0,
+         _("Serve requests until the input is closed"), NULL},
         POPT_TABLEEND
     };
 
@@ -562,7 +893,14 @@ int main(int argc, const char *argv[])
         _exit(-1);
     }
 
-    if (mode == OP_NONE) {
+    if (worker) {
+        if (mode != OP_NONE || pin_mode != PIN_NONE) {
+            fprintf(stderr, "\n--worker gets the operation mode and the " \
+                            "PIN with each request.\n\n");
+            poptPrintUsage(pc, stderr, 0);
+            _exit(-1);
+        }
+    } else if (mode == OP_NONE) {
         fprintf(stderr, "\nMissing operation mode, " \
                         "either --auth or --pre must be specified.\n\n");
         poptPrintUsage(pc, stderr, 0);
@@ -594,8 +932,10 @@ int main(int argc, const char *argv[])
     DEBUG(SSSDBG_TRACE_FUNC, "p11_child started.\n");
 
     DEBUG(SSSDBG_TRACE_INTERNAL, "Running in [%s] mode.\n",
-          mode == OP_AUTH ? "auth"
-                          : (mode == OP_PREAUTH ? "pre-auth" : "unknown"));
+          worker ? "worker"
+                 : (mode == OP_AUTH ? "auth"
+                                    : (mode == OP_PREAUTH ? "pre-auth"
+                                                          : "unknown")));
 
     DEBUG(SSSDBG_TRACE_INTERNAL,
           "Running with effective IDs: [%"SPRIuid"][%"SPRIgid"].\n",
@@ -621,6 +961,16 @@ int main(int argc, const char *argv[])
         }
     }
 
+    if (worker) {
+        ret = p11c_worker_serve(main_ctx, nss_db, do_ocsp);
+        if (ret != EOK) {
+            goto fail;
+        }
+
+        talloc_free(main_ctx);
+        return EXIT_SUCCESS;
+    }
+
     if (mode == OP_AUTH && pin_mode == PIN_STDIN) {
         ret = p11c_recv_data(main_ctx, STDIN_FILENO, &pin);
         if (ret != EOK) {
@@ -629,8 +979,14 @@ int main(int argc, const char *argv[])
         }
     }
 
-    ret = do_work(main_ctx, nss_db, slot_name_in, mode, pin, do_ocsp, &cert,
+    ret = p11c_nss_init(nss_db, &nss_ctx);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    ret = do_work(main_ctx, slot_name_in, mode, pin, do_ocsp, &cert,
                   &token_name_out);
+    p11c_nss_shutdown(nss_ctx);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "do_work failed.\n");
         goto fail;
@@ -230,6 +230,74 @@ done:
     return ret;
 }
 
+/* The filter of a domain never changes, so it is chosen and compiled only
+ * once */
+static errno_t
+ad_get_access_filter(struct ad_access_ctx *ctx,
+                     struct sss_domain_info *dom,
+                     struct sdap_access_filter **_filter)
+{
+    struct sdap_access_filter *compiled;
+    hash_key_t key;
+    hash_value_t value;
+    char *filter;
+    errno_t ret;
+    int hret;
+
+    if (ctx->filters == NULL) {
+        ret = sss_hash_create(ctx, 8, &ctx->filters);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = dom->name;
+
+    hret = hash_lookup(ctx->filters, &key, &value);
+    if (hret == HASH_SUCCESS) {
+        *_filter = talloc_get_type(value.ptr, struct sdap_access_filter);
+        return EOK;
+    } else if (hret != HASH_ERROR_KEY_NOT_FOUND) {
+        DEBUG(SSSDBG_OP_FAILURE, "hash_lookup failed [%d]\n", hret);
+        return EIO;
+    }
+
+    ret = ad_parse_access_filter(ctx, dom, ctx->sdap_access_ctx->filter,
+                                 &filter);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sdap_access_filter_compile(ctx, ctx->sdap_access_ctx->id_ctx->opts,
+                                     filter, &compiled);
+    if (ret != EOK) {
+        talloc_free(filter);
+        return ret;
+    }
+    talloc_steal(compiled, filter);
+
+    /* Users and their memberships are also read from the Global Catalog,
+     * which only holds a partial set of the memberOf values. A cached entry
+     * can then not be trusted to answer the filter like the DC would. */
+    if (dp_opt_get_bool(ctx->ad_id_ctx->ad_options->basic, AD_ENABLE_GC)) {
+        talloc_zfree(compiled->tree);
+    }
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = compiled;
+
+    hret = hash_enter(ctx->filters, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%d]\n", hret);
+        talloc_free(compiled);
+        return EIO;
+    }
+
+    *_filter = compiled;
+    return EOK;
+}
+
 struct ad_access_state {
     struct tevent_context *ev;
     struct ad_access_ctx *ctx;
@@ -237,7 +305,7 @@ struct ad_access_state {
     struct be_ctx *be_ctx;
     struct sss_domain_info *domain;
 
-    char *filter;
+    struct sdap_access_filter *filter;
     struct sdap_id_conn_ctx **clist;
     int cindex;
 };
@@ -270,8 +338,7 @@ ad_access_send(TALLOC_CTX *mem_ctx,
     state->be_ctx = be_ctx;
     state->domain = domain;
 
-    ret = ad_parse_access_filter(state, domain, ctx->sdap_access_ctx->filter,
-                                 &state->filter);
+    ret = ad_get_access_filter(ctx, domain, &state->filter);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not determine the best filter\n");
         ret = ERR_ACCESS_DENIED;
@@ -313,7 +380,8 @@ ad_sdap_access_step(struct tevent_req *req, struct sdap_id_conn_ctx *conn)
         return ENOMEM;
     }
     req_ctx->id_ctx = state->ctx->sdap_access_ctx->id_ctx;
-    req_ctx->filter = state->filter;
+    req_ctx->filter = state->filter->filter;
+    req_ctx->compiled_filter = state->filter;
     memcpy(&req_ctx->access_rule,
            state->ctx->sdap_access_ctx->access_rule,
            sizeof(int) * LDAP_ACCESS_LAST);
@@ -47,6 +47,8 @@ struct ad_access_ctx {
     } gpo_map_type;
     hash_table_t *gpo_map_options_table;
     enum gpo_map_type gpo_default_right;
+    /* the compiled access filter of each domain, keyed by the domain name */
+    hash_table_t *filters;
 };
 
 void
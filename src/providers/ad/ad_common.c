@@ -1248,6 +1248,28 @@ ad_id_ctx_init(struct ad_options *ad_opts, struct be_ctx *bectx)
     return ad_ctx;
 }
 
+struct ad_id_ctx *
+ad_get_sdom_id_ctx(struct ad_id_ctx *ad_ctx, struct sdap_domain *sdom)
+{
+    errno_t ret;
+
+    if (IS_SUBDOMAIN(sdom->dom) && ad_ctx->subdom_id_ctx_fn != NULL) {
+        ret = ad_ctx->subdom_id_ctx_fn(ad_ctx->subdom_id_ctx_pvt, sdom);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Cannot set up the ID ctx of [%s] [%d]: %s\n",
+                  sdom->dom->name, ret, sss_strerror(ret));
+            return NULL;
+        }
+    }
+
+    if (sdom->pvt == NULL) {
+        return NULL;
+    }
+
+    return talloc_get_type(sdom->pvt, struct ad_id_ctx);
+}
+
 struct sdap_id_conn_ctx *
 ad_get_dom_ldap_conn(struct ad_id_ctx *ad_ctx, struct sss_domain_info *dom)
 {
@@ -1256,12 +1278,18 @@ ad_get_dom_ldap_conn(struct ad_id_ctx *ad_ctx, struct sss_domain_info *dom)
     struct ad_id_ctx *subdom_id_ctx;
 
     sdom = sdap_domain_get(ad_ctx->sdap_id_ctx->opts, dom);
-    if (sdom == NULL || sdom->pvt == NULL) {
+    if (sdom == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "No ID ctx available for [%s].\n",
+                                    dom->name);
+        return NULL;
+    }
+
+    subdom_id_ctx = ad_get_sdom_id_ctx(ad_ctx, sdom);
+    if (subdom_id_ctx == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "No ID ctx available for [%s].\n",
                                     dom->name);
         return NULL;
     }
-    subdom_id_ctx = talloc_get_type(sdom->pvt, struct ad_id_ctx);
     conn = subdom_id_ctx->ldap_ctx;
 
     if (IS_SUBDOMAIN(sdom->dom) == true && conn != NULL) {
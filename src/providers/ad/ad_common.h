@@ -64,15 +64,28 @@ enum ad_basic_opt {
     AD_KRB5_CONFD_PATH,
     AD_MAXIMUM_MACHINE_ACCOUNT_PASSWORD_AGE,
     AD_MACHINE_ACCOUNT_PASSWORD_RENEWAL_OPTS,
+    AD_ENABLE_DIRSYNC,
+    AD_DC_LATENCY_PING,
+    AD_SUBDOMAIN_IDLE_TIMEOUT,
 
     AD_OPTS_BASIC /* opts counter */
 };
 
+/* Sets sdom->pvt to the ID context of the subdomain, creating it if needed */
+typedef errno_t (*ad_subdom_id_ctx_fn)(void *pvt, struct sdap_domain *sdom);
+
 struct ad_id_ctx {
     struct sdap_id_ctx *sdap_id_ctx;
     struct sdap_id_conn_ctx *ldap_ctx;
     struct sdap_id_conn_ctx *gc_ctx;
     struct ad_options *ad_options;
+
+    /* time of the last lookup, only maintained for subdomains */
+    time_t last_used;
+
+    /* set up by the subdomains provider to create subdomains lazily */
+    ad_subdom_id_ctx_fn subdom_id_ctx_fn;
+    void *subdom_id_ctx_pvt;
 };
 
 struct ad_service {
@@ -163,6 +176,11 @@ struct sdap_id_conn_ctx **
 ad_user_conn_list(struct ad_id_ctx *ad_ctx,
                   struct sss_domain_info *dom);
 
+/* Returns the ID context of sdom, which is created on first use if sdom is
+ * a subdomain */
+struct ad_id_ctx *
+ad_get_sdom_id_ctx(struct ad_id_ctx *ad_ctx, struct sdap_domain *sdom);
+
 struct sdap_id_conn_ctx *
 ad_get_dom_ldap_conn(struct ad_id_ctx *ad_ctx, struct sss_domain_info *dom);
 
@@ -0,0 +1,573 @@
+/*
+    SSSD
+
+    AD Directory Synchronization
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/util.h"
+#include "providers/ldap/sdap_async.h"
+#include "providers/ldap/sdap_async_enum.h"
+#include "providers/ad/ad_dirsync.h"
+
+/* DirSync only sends the changed attributes of an object, the changed
+ * objects are searched for again by their objectGUID, this many at once */
+#define AD_DIRSYNC_CHUNK_SIZE 50
+
+#define AD_DIRSYNC_IS_DELETED "isDeleted"
+
+struct ad_dirsync_state {
+    struct tevent_context *ev;
+    struct sdap_id_ctx *ctx;
+    struct sdap_domain *sdom;
+    struct sdap_id_op *op;
+    const char *uuid_attr;
+    int timeout;
+
+    struct berval cookie;
+    bool full_enum;
+
+    const char **user_attrs;
+    const char **group_attrs;
+
+    /* (objectGUID=...) of every changed object */
+    char **changed;
+    size_t num_changed;
+    size_t chunk_start;
+    char *chunk_filter;
+};
+
+static void ad_dirsync_connect_done(struct tevent_req *subreq);
+static errno_t ad_dirsync_search(struct tevent_req *req);
+static errno_t ad_dirsync_entry(struct sysdb_attrs *attrs, void *pvt);
+static void ad_dirsync_search_done(struct tevent_req *subreq);
+static errno_t ad_dirsync_refresh_next(struct tevent_req *req);
+static void ad_dirsync_users_done(struct tevent_req *subreq);
+static void ad_dirsync_groups_done(struct tevent_req *subreq);
+static errno_t ad_dirsync_finish(struct ad_dirsync_state *state);
+
+struct tevent_req *
+ad_dirsync_send(TALLOC_CTX *mem_ctx,
+                struct tevent_context *ev,
+                struct ad_id_ctx *id_ctx,
+                struct sdap_domain *sdom)
+{
+    struct tevent_req *req;
+    struct tevent_req *subreq;
+    struct ad_dirsync_state *state;
+    struct ldb_val *stored;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct ad_dirsync_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->ctx = id_ctx->sdap_id_ctx;
+    state->sdom = sdom;
+    state->uuid_attr = state->ctx->opts->user_map[SDAP_AT_USER_UUID].name;
+    state->timeout = dp_opt_get_int(state->ctx->opts->basic,
+                                    SDAP_ENUM_SEARCH_TIMEOUT);
+
+    if (state->uuid_attr == NULL) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "DirSync needs the UUID attribute of the users\n");
+        ret = EINVAL;
+        goto immediately;
+    }
+
+    ret = sysdb_get_dirsync_cookie(state, sdom->dom, &stored);
+    if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC, "No DirSync cookie for [%s] yet\n",
+              sdom->dom->name);
+        state->full_enum = true;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot read the DirSync cookie [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto immediately;
+    } else {
+        state->cookie.bv_val = (char *) stored->data;
+        state->cookie.bv_len = stored->length;
+    }
+
+    ret = build_attrs_from_map(state, state->ctx->opts->user_map,
+                               state->ctx->opts->user_map_cnt,
+                               NULL, &state->user_attrs, NULL);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    ret = build_attrs_from_map(state, state->ctx->opts->group_map,
+                               SDAP_OPTS_GROUP, NULL,
+                               &state->group_attrs, NULL);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    /* DirSync is only answered on the LDAP port of a domain controller */
+    state->op = sdap_id_op_create(state, id_ctx->ldap_ctx->conn_cache);
+    if (state->op == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "sdap_id_op_create failed\n");
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    subreq = sdap_id_op_connect_send(state->op, state, &ret);
+    if (subreq == NULL) {
+        goto immediately;
+    }
+    tevent_req_set_callback(subreq, ad_dirsync_connect_done, req);
+
+    return req;
+
+immediately:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static void ad_dirsync_connect_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req;
+    int dp_error;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+
+    ret = sdap_id_op_connect_recv(subreq, &dp_error);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    ret = ad_dirsync_search(req);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+}
+
+/* The changes of which attributes are reported */
+static const char **ad_dirsync_attrs(TALLOC_CTX *mem_ctx,
+                                     struct ad_dirsync_state *state)
+{
+    const char **attrs;
+    size_t num_user;
+    size_t num_group;
+
+    if (state->full_enum) {
+        /* the entries are not used, only the cookie */
+        attrs = talloc_zero_array(mem_ctx, const char *, 2);
+        if (attrs == NULL) {
+            return NULL;
+        }
+        attrs[0] = state->uuid_attr;
+        return attrs;
+    }
+
+    for (num_user = 0; state->user_attrs[num_user] != NULL; num_user++);
+    for (num_group = 0; state->group_attrs[num_group] != NULL; num_group++);
+
+    attrs = talloc_zero_array(mem_ctx, const char *, num_user + num_group + 2);
+    if (attrs == NULL) {
+        return NULL;
+    }
+
+    memcpy(attrs, state->user_attrs, num_user * sizeof(char *));
+    memcpy(attrs + num_user, state->group_attrs, num_group * sizeof(char *));
+    attrs[num_user + num_group] = AD_DIRSYNC_IS_DELETED;
+
+    return attrs;
+}
+
+static errno_t ad_dirsync_search(struct tevent_req *req)
+{
+    struct ad_dirsync_state *state = tevent_req_data(req,
+                                                     struct ad_dirsync_state);
+    struct sdap_options *opts = state->ctx->opts;
+    struct tevent_req *subreq;
+    const char **attrs;
+    char *oc_list;
+    char *filter;
+
+    oc_list = sdap_make_oc_list(state, opts->group_map);
+    if (oc_list == NULL) {
+        return ENOMEM;
+    }
+
+    filter = talloc_asprintf(state, "(|(objectclass=%s)(%s))",
+                             opts->user_map[SDAP_OC_USER].name, oc_list);
+    talloc_free(oc_list);
+    if (filter == NULL) {
+        return ENOMEM;
+    }
+
+    attrs = ad_dirsync_attrs(state, state);
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+
+    /* DirSync searches always start at the root of the naming context */
+    subreq = sdap_dirsync_search_send(state, state->ev, opts,
+                                      sdap_id_op_handle(state->op),
+                                      state->sdom->basedn, filter, attrs,
+                                      &state->cookie, state->timeout,
+                                      state->full_enum ? NULL
+                                                       : ad_dirsync_entry,
+                                      req);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(subreq, ad_dirsync_search_done, req);
+
+    return EOK;
+}
+
+static errno_t ad_dirsync_delete(struct ad_dirsync_state *state,
+                                 const uint8_t *guid)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char *attrs[] = { SYSDB_NAME, SYSDB_OBJECTCLASS, NULL };
+    char guid_str[GUID_STR_BUF_SIZE];
+    struct ldb_result *res;
+    const char *name;
+    errno_t ret;
+
+    ret = guid_blob_to_string_buf(guid, guid_str, GUID_STR_BUF_SIZE);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_search_object_by_uuid(tmp_ctx, state->sdom->dom, guid_str,
+                                      attrs, &res);
+    if (ret == ENOENT) {
+        /* not cached */
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    name = ldb_msg_find_attr_as_string(res->msgs[0], SYSDB_NAME, NULL);
+    if (name == NULL) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "[%s] was deleted on the server\n", name);
+
+    if (ldb_msg_check_string_attribute(res->msgs[0], SYSDB_OBJECTCLASS,
+                                       SYSDB_USER_CLASS)) {
+        ret = sysdb_delete_user(state->sdom->dom, name, 0);
+    } else {
+        ret = sysdb_delete_group(state->sdom->dom, name, 0);
+    }
+    if (ret == ENOENT) {
+        ret = EOK;
+    }
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t ad_dirsync_add_changed(struct ad_dirsync_state *state,
+                                      const struct ldb_val *guid)
+{
+    char **changed;
+    char *filter;
+    size_t i;
+
+    changed = talloc_realloc(state, state->changed, char *,
+                             state->num_changed + 1);
+    if (changed == NULL) {
+        return ENOMEM;
+    }
+    state->changed = changed;
+
+    /* the objectGUID is binary, every byte is escaped */
+    filter = talloc_asprintf(changed, "(%s=", state->uuid_attr);
+    for (i = 0; filter != NULL && i < guid->length; i++) {
+        filter = talloc_asprintf_append_buffer(filter, "\\%02hhx",
+                                               guid->data[i]);
+    }
+    if (filter != NULL) {
+        filter = talloc_strdup_append_buffer(filter, ")");
+    }
+    if (filter == NULL) {
+        return ENOMEM;
+    }
+
+    changed[state->num_changed] = filter;
+    state->num_changed++;
+
+    return EOK;
+}
+
+static errno_t ad_dirsync_entry(struct sysdb_attrs *attrs, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct ad_dirsync_state *state = tevent_req_data(req,
+                                                     struct ad_dirsync_state);
+    struct ldb_message_element *el;
+    const char *deleted;
+    errno_t ret;
+
+    ret = sysdb_attrs_get_el_ext(attrs, state->uuid_attr, false, &el);
+    if (ret != EOK || el->num_values == 0
+            || el->values[0].length != GUID_BIN_LENGTH) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Changed object without a valid %s, "
+              "ignoring\n", state->uuid_attr);
+        return EOK;
+    }
+
+    ret = sysdb_attrs_get_string(attrs, AD_DIRSYNC_IS_DELETED, &deleted);
+    if (ret == EOK && strcasecmp(deleted, "TRUE") == 0) {
+        return ad_dirsync_delete(state, el->values[0].data);
+    }
+
+    return ad_dirsync_add_changed(state, &el->values[0]);
+}
+
+static void ad_dirsync_search_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req;
+    struct ad_dirsync_state *state;
+    int dp_error;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct ad_dirsync_state);
+
+    ret = sdap_dirsync_search_recv(subreq, state, &state->cookie);
+    talloc_zfree(subreq);
+    if (ret == ERR_SYNC_REFRESH_REQUIRED) {
+        /* The cookie is too old or not valid for this server, start over
+         * with a new one */
+        DEBUG(SSSDBG_MINOR_FAILURE, "The DirSync cookie of [%s] was "
+              "refused, the domain will be enumerated\n",
+              state->sdom->dom->name);
+
+        ret = sysdb_set_dirsync_cookie(state->sdom->dom, NULL);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        state->cookie.bv_val = NULL;
+        state->cookie.bv_len = 0;
+        state->full_enum = true;
+        state->num_changed = 0;
+        ret = ad_dirsync_search(req);
+        goto done;
+    } else if (ret != EOK) {
+        sdap_id_op_done(state->op, ret, &dp_error);
+        goto done;
+    }
+
+    if (state->num_changed == 0) {
+        ret = ad_dirsync_finish(state);
+        if (ret == EOK) {
+            tevent_req_done(req);
+        }
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "%zu objects of [%s] changed\n",
+          state->num_changed, state->sdom->dom->name);
+
+    ret = ad_dirsync_refresh_next(req);
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+    }
+}
+
+/* Searches for the users of the next chunk of changed objects, then for
+ * the groups */
+static errno_t ad_dirsync_refresh_next(struct tevent_req *req)
+{
+    struct ad_dirsync_state *state = tevent_req_data(req,
+                                                     struct ad_dirsync_state);
+    struct tevent_req *subreq;
+    char *filter;
+    size_t i;
+
+    talloc_zfree(state->chunk_filter);
+
+    state->chunk_filter = talloc_strdup(state, "(|");
+    for (i = state->chunk_start;
+         state->chunk_filter != NULL && i < state->num_changed
+            && i < state->chunk_start + AD_DIRSYNC_CHUNK_SIZE;
+         i++) {
+        state->chunk_filter = talloc_strdup_append_buffer(state->chunk_filter,
+                                                          state->changed[i]);
+    }
+    if (state->chunk_filter != NULL) {
+        state->chunk_filter = talloc_strdup_append_buffer(state->chunk_filter,
+                                                          ")");
+    }
+    if (state->chunk_filter == NULL) {
+        return ENOMEM;
+    }
+
+    filter = sdap_enum_users_filter(state, state->ctx, state->sdom,
+                                    state->chunk_filter);
+    if (filter == NULL) {
+        return ENOMEM;
+    }
+
+    subreq = sdap_get_users_send(state, state->ev,
+                                 state->sdom->dom,
+                                 state->sdom->dom->sysdb,
+                                 state->ctx->opts,
+                                 state->sdom->user_search_bases,
+                                 sdap_id_op_handle(state->op),
+                                 state->user_attrs, filter,
+                                 state->timeout,
+                                 SDAP_LOOKUP_ENUMERATE);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+    talloc_steal(subreq, filter);
+    tevent_req_set_callback(subreq, ad_dirsync_users_done, req);
+
+    return EOK;
+}
+
+static void ad_dirsync_users_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req;
+    struct ad_dirsync_state *state;
+    char *filter;
+    int dp_error;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct ad_dirsync_state);
+
+    ret = sdap_get_users_recv(subreq, NULL, NULL);
+    talloc_zfree(subreq);
+    if (ret != EOK && ret != ENOENT) {
+        sdap_id_op_done(state->op, ret, &dp_error);
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    filter = sdap_enum_groups_filter(state, state->ctx, state->sdom,
+                                     state->chunk_filter);
+    if (filter == NULL) {
+        tevent_req_error(req, ENOMEM);
+        return;
+    }
+
+    subreq = sdap_get_groups_send(state, state->ev,
+                                  state->sdom,
+                                  state->ctx->opts,
+                                  sdap_id_op_handle(state->op),
+                                  state->group_attrs, filter,
+                                  state->timeout,
+                                  SDAP_LOOKUP_ENUMERATE, false);
+    if (subreq == NULL) {
+        talloc_free(filter);
+        tevent_req_error(req, ENOMEM);
+        return;
+    }
+    talloc_steal(subreq, filter);
+    tevent_req_set_callback(subreq, ad_dirsync_groups_done, req);
+}
+
+static void ad_dirsync_groups_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req;
+    struct ad_dirsync_state *state;
+    int dp_error;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct ad_dirsync_state);
+
+    ret = sdap_get_groups_recv(subreq, NULL, NULL);
+    talloc_zfree(subreq);
+    if (ret != EOK && ret != ENOENT) {
+        sdap_id_op_done(state->op, ret, &dp_error);
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    state->chunk_start += AD_DIRSYNC_CHUNK_SIZE;
+    if (state->chunk_start < state->num_changed) {
+        ret = ad_dirsync_refresh_next(req);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+        }
+        return;
+    }
+
+    ret = ad_dirsync_finish(state);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+/* The cookie is only stored once all the changes are in the cache, if the
+ * update fails the next one starts from the same point */
+static errno_t ad_dirsync_finish(struct ad_dirsync_state *state)
+{
+    struct ldb_val cookie;
+    int dp_error;
+    errno_t ret;
+
+    sdap_id_op_done(state->op, EOK, &dp_error);
+
+    if (state->cookie.bv_len == 0) {
+        return EOK;
+    }
+
+    cookie.data = (uint8_t *) state->cookie.bv_val;
+    cookie.length = state->cookie.bv_len;
+
+    ret = sysdb_set_dirsync_cookie(state->sdom->dom, &cookie);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot store the DirSync cookie [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
+errno_t ad_dirsync_recv(struct tevent_req *req, bool *_full_enum)
+{
+    struct ad_dirsync_state *state = tevent_req_data(req,
+                                                     struct ad_dirsync_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_full_enum = state->full_enum;
+    return EOK;
+}
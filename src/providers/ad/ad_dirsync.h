@@ -0,0 +1,39 @@
+/*
+    SSSD
+
+    AD Directory Synchronization
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AD_DIRSYNC_H_
+#define _AD_DIRSYNC_H_
+
+#include "providers/ad/ad_common.h"
+
+/* Updates the cached users and groups of the domain with the objects which
+ * changed since the DirSync cookie stored in the cache. Without a cookie
+ * only a new one is fetched and *_full_enum is set, the caller must then
+ * enumerate the domain. */
+struct tevent_req *
+ad_dirsync_send(TALLOC_CTX *mem_ctx,
+                struct tevent_context *ev,
+                struct ad_id_ctx *id_ctx,
+                struct sdap_domain *sdom);
+
+errno_t ad_dirsync_recv(struct tevent_req *req, bool *_full_enum);
+
+#endif /* _AD_DIRSYNC_H_ */
@@ -65,6 +65,7 @@
 #define AD_AT_MACHINE_EXT_NAMES "gPCMachineExtensionNames"
 #define AD_AT_FUNC_VERSION "gPCFunctionalityVersion"
 #define AD_AT_FLAGS "flags"
+#define AD_AT_VERSION_NUMBER "versionNumber"
 
 #define UAC_WORKSTATION_TRUST_ACCOUNT 0x00001000
 #define UAC_SERVER_TRUST_ACCOUNT 0x00002000
@@ -97,6 +98,9 @@
 #define GPO_CHILD SSSD_LIBEXEC_PATH"/gpo_child"
 #endif
 
+/* maximum number of GPOs which are retrieved at the same time */
+#define AD_GPO_MAX_PARALLEL_FETCHES 5
+
 /* fd used by the gpo_child process for logging */
 int gpo_child_debug_fd = -1;
 
@@ -124,10 +128,27 @@ struct gp_gpo {
     int num_gpo_cse_guids;
     int gpo_func_version;
     int gpo_flags;
+    int gpo_version;
     bool send_to_child;
     const char *policy_filename;
 };
 
+/*
+ * The SIDs of the user and of all of its groups. They are retrieved once per
+ * access request and shared by the DACL filtering and the access check, the
+ * table allows to look up a SID without comparing it against every group.
+ */
+struct ad_gpo_sids {
+    const char *user_sid;
+    const char **group_sids;
+    int group_size;
+    hash_table_t *table;
+
+    /* the same SIDs in binary form, sorted for ACE checks */
+    struct sss_idmap_sid *bin_sids;
+    size_t bin_count;
+};
+
 enum ace_eval_status {
     AD_GPO_ACE_DENIED,
     AD_GPO_ACE_ALLOWED,
@@ -486,46 +507,91 @@ fail:
 
 /* == ad_gpo_access_send/recv helpers =======================================*/
 
-static bool
-ad_gpo_dom_sid_equal(const struct dom_sid *sid1, const struct dom_sid *sid2)
+/*
+ * This function creates an ad_gpo_sids object from the input user_sid and
+ * group_sids. The strings are not copied and have to outlive the object.
+ */
+static int ad_gpo_bin_sid_cmp(const void *a, const void *b)
 {
+    return sss_idmap_sid_cmp(a, b);
+}
+
+static errno_t
+ad_gpo_create_sids(TALLOC_CTX *mem_ctx,
+                   const char *user_sid,
+                   const char **group_sids,
+                   int group_size,
+                   struct ad_gpo_sids **_sids)
+{
+    struct ad_gpo_sids *sids;
+    hash_key_t key;
+    hash_value_t value;
+    enum idmap_error_code err;
+    int hret;
+    int ret;
     int i;
 
-    if (sid1 == sid2) {
-        return true;
+    sids = talloc_zero(mem_ctx, struct ad_gpo_sids);
+    if (sids == NULL) {
+        return ENOMEM;
     }
 
-    if (!sid1 || !sid2) {
-        return false;
+    sids->user_sid = user_sid;
+    sids->group_sids = group_sids;
+    sids->group_size = group_size;
+
+    ret = sss_hash_create(sids, group_size + 1, &sids->table);
+    if (ret != EOK) {
+        goto done;
     }
 
-    if (sid1->sid_rev_num != sid2->sid_rev_num) {
-        return false;
+    sids->bin_sids = talloc_array(sids, struct sss_idmap_sid, group_size + 1);
+    if (sids->bin_sids == NULL) {
+        ret = ENOMEM;
+        goto done;
     }
 
-    for (i = 0; i < 6; i++) {
-        if (sid1->id_auth[i] != sid2->id_auth[i]) {
-            return false;
+    key.type = HASH_KEY_STRING;
+    value.type = HASH_VALUE_UNDEF;
+
+    for (i = -1; i < group_size; i++) {
+        key.str = discard_const(i < 0 ? user_sid : group_sids[i]);
+        if (key.str == NULL) {
+            continue;
         }
-    }
 
-    if (sid1->num_auths != sid2->num_auths) {
-        return false;
-    }
+        hret = hash_enter(sids->table, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%s]\n",
+                  hash_error_string(hret));
+            ret = EIO;
+            goto done;
+        }
 
-    for (i = 0; i < sid1->num_auths; i++) {
-        if (sid1->sub_auths[i] != sid2->sub_auths[i]) {
-            return false;
+        err = sss_idmap_sid_parse(key.str, &sids->bin_sids[sids->bin_count]);
+        if (err != IDMAP_SUCCESS) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Cannot parse SID [%s].\n", key.str);
+            continue;
         }
+        sids->bin_count++;
     }
 
-    return true;
-}
+    qsort(sids->bin_sids, sids->bin_count, sizeof(struct sss_idmap_sid),
+          ad_gpo_bin_sid_cmp);
+
+    *_sids = sids;
+    ret = EOK;
 
+done:
+    if (ret != EOK) {
+        talloc_free(sids);
+    }
+    return ret;
+}
 
 /*
  * This function retrieves the SIDs corresponding to the input user and returns
- * the user_sid, group_sids, and group_size in their respective output params.
+ * them as an ad_gpo_sids object in the _sids output param.
  *
  * Note: since authentication must complete successfully before the
  * gpo access checks are called, we can safely assume that the user/computer
@@ -536,9 +602,7 @@ static errno_t
 ad_gpo_get_sids(TALLOC_CTX *mem_ctx,
                 const char *user,
                 struct sss_domain_info *domain,
-                const char **_user_sid,
-                const char ***_group_sids,
-                int *_group_size)
+                struct ad_gpo_sids **_sids)
 {
     TALLOC_CTX *tmp_ctx = NULL;
     struct ldb_result *res;
@@ -548,6 +612,7 @@ ad_gpo_get_sids(TALLOC_CTX *mem_ctx,
     const char *user_sid = NULL;
     const char *group_sid = NULL;
     const char **group_sids = NULL;
+    struct ad_gpo_sids *sids = NULL;
 
     tmp_ctx = talloc_new(NULL);
     if (tmp_ctx == NULL) {
@@ -600,9 +665,15 @@ ad_gpo_get_sids(TALLOC_CTX *mem_ctx,
     group_sids[i++] = talloc_strdup(group_sids, AD_AUTHENTICATED_USERS_SID);
     group_sids[i] = NULL;
 
-    *_group_size = num_group_sids + 1;
-    *_group_sids = talloc_steal(mem_ctx, group_sids);
-    *_user_sid = talloc_steal(mem_ctx, user_sid);
+    ret = ad_gpo_create_sids(tmp_ctx, user_sid, group_sids,
+                             num_group_sids + 1, &sids);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    talloc_steal(sids, group_sids);
+    talloc_steal(sids, user_sid);
+    *_sids = talloc_steal(mem_ctx, sids);
     ret = EOK;
 
  done:
@@ -610,52 +681,44 @@ ad_gpo_get_sids(TALLOC_CTX *mem_ctx,
     return ret;
 }
 
+/*
+ * This function determines whether the input sid is one of the client's SIDs.
+ */
+static bool
+ad_gpo_sids_include(struct ad_gpo_sids *sids, const char *sid)
+{
+    hash_key_t key;
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(sid);
+
+    return hash_has_key(sids->table, &key);
+}
+
 /*
  * This function determines whether the input ace_dom_sid matches any of the
  * client's SIDs. The boolean result is assigned to the _included output param.
  */
 static errno_t
-ad_gpo_ace_includes_client_sid(const char *user_sid,
-                               const char **group_sids,
-                               int group_size,
+ad_gpo_ace_includes_client_sid(struct ad_gpo_sids *sids,
                                struct dom_sid ace_dom_sid,
                                struct sss_idmap_ctx *idmap_ctx,
                                bool *_included)
 {
-    int i = 0;
-    struct dom_sid *user_dom_sid;
-    struct dom_sid *group_dom_sid;
     enum idmap_error_code err;
-    bool included = false;
+    struct sss_idmap_sid ace_sid;
 
-    err = sss_idmap_sid_to_smb_sid(idmap_ctx, user_sid, &user_dom_sid);
+    /* compared in binary form, no need to allocate a string for each ACE */
+    err = sss_idmap_smb_sid_parse(&ace_dom_sid, &ace_sid);
     if (err != IDMAP_SUCCESS) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to initialize idmap context.\n");
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to convert the SID of the ACE.\n");
         return EFAULT;
     }
 
-    included = ad_gpo_dom_sid_equal(&ace_dom_sid, user_dom_sid);
-    sss_idmap_free_smb_sid(idmap_ctx, user_dom_sid);
-    if (included) {
-        *_included = true;
-        return EOK;
-    }
-
-    for (i = 0; i < group_size; i++) {
-        err = sss_idmap_sid_to_smb_sid(idmap_ctx, group_sids[i], &group_dom_sid);
-        if (err != IDMAP_SUCCESS) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "Failed to initialize idmap context.\n");
-            return EFAULT;
-        }
-        included = ad_gpo_dom_sid_equal(&ace_dom_sid, group_dom_sid);
-        sss_idmap_free_smb_sid(idmap_ctx, group_dom_sid);
-        if (included) {
-            *_included = true;
-            return EOK;
-        }
-    }
+    *_included = bsearch(&ace_sid, sids->bin_sids, sids->bin_count,
+                         sizeof(struct sss_idmap_sid),
+                         ad_gpo_bin_sid_cmp) != NULL;
 
-    *_included = false;
     return EOK;
 }
 
@@ -689,9 +752,7 @@ ad_gpo_ace_includes_client_sid(const char *user_sid,
  */
 static enum ace_eval_status ad_gpo_evaluate_ace(struct security_ace *ace,
                                                 struct sss_idmap_ctx *idmap_ctx,
-                                                const char *user_sid,
-                                                const char **group_sids,
-                                                int group_size)
+                                                struct ad_gpo_sids *sids)
 {
     bool agp_included = false;
     bool included = false;
@@ -703,8 +764,8 @@ static enum ace_eval_status ad_gpo_evaluate_ace(struct security_ace *ace,
         return AD_GPO_ACE_NEUTRAL;
     }
 
-    ret = ad_gpo_ace_includes_client_sid(user_sid, group_sids, group_size,
-                                         ace->trustee, idmap_ctx, &included);
+    ret = ad_gpo_ace_includes_client_sid(sids, ace->trustee, idmap_ctx,
+                                         &included);
 
     if (ret != EOK) {
         return AD_GPO_ACE_DENIED;
@@ -747,9 +808,7 @@ static enum ace_eval_status ad_gpo_evaluate_ace(struct security_ace *ace,
  */
 static errno_t ad_gpo_evaluate_dacl(struct security_acl *dacl,
                                     struct sss_idmap_ctx *idmap_ctx,
-                                    const char *user_sid,
-                                    const char **group_sids,
-                                    int group_size,
+                                    struct ad_gpo_sids *sids,
                                     bool *_dacl_access_allowed)
 {
     uint32_t num_aces = 0;
@@ -772,8 +831,7 @@ static errno_t ad_gpo_evaluate_dacl(struct security_acl *dacl,
     for (i = 0; i < dacl->num_aces; i ++) {
         ace = &dacl->aces[i];
 
-        ace_status = ad_gpo_evaluate_ace(ace, idmap_ctx, user_sid,
-                                         group_sids, group_size);
+        ace_status = ad_gpo_evaluate_ace(ace, idmap_ctx, sids);
 
         switch (ace_status) {
         case AD_GPO_ACE_NEUTRAL:
@@ -799,8 +857,7 @@ static errno_t ad_gpo_evaluate_dacl(struct security_acl *dacl,
  */
 static errno_t
 ad_gpo_filter_gpos_by_dacl(TALLOC_CTX *mem_ctx,
-                           const char *user,
-                           struct sss_domain_info *domain,
+                           struct ad_gpo_sids *sids,
                            struct sss_idmap_ctx *idmap_ctx,
                            struct gp_gpo **candidate_gpos,
                            int num_candidate_gpos,
@@ -813,9 +870,6 @@ ad_gpo_filter_gpos_by_dacl(TALLOC_CTX *mem_ctx,
     struct gp_gpo *candidate_gpo = NULL;
     struct security_descriptor *sd = NULL;
     struct security_acl *dacl = NULL;
-    const char *user_sid = NULL;
-    const char **group_sids = NULL;
-    int group_size = 0;
     int gpo_dn_idx = 0;
     bool access_allowed = false;
     struct gp_gpo **dacl_filtered_gpos = NULL;
@@ -826,15 +880,6 @@ ad_gpo_filter_gpos_by_dacl(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ad_gpo_get_sids(tmp_ctx, user, domain, &user_sid,
-                          &group_sids, &group_size);
-    if (ret != EOK) {
-        ret = ERR_NO_SIDS;
-        DEBUG(SSSDBG_OP_FAILURE,
-              "Unable to retrieve SIDs: [%d](%s)\n", ret, sss_strerror(ret));
-        goto done;
-    }
-
     dacl_filtered_gpos = talloc_array(tmp_ctx,
                                  struct gp_gpo *,
                                  num_candidate_gpos + 1);
@@ -880,8 +925,7 @@ ad_gpo_filter_gpos_by_dacl(TALLOC_CTX *mem_ctx,
             break;
         }
 
-        ret = ad_gpo_evaluate_dacl(dacl, idmap_ctx, user_sid, group_sids,
-                                   group_size, &access_allowed);
+        ret = ad_gpo_evaluate_dacl(dacl, idmap_ctx, sids, &access_allowed);
         if (ret != EOK) {
             DEBUG(SSSDBG_MINOR_FAILURE, "Could not determine if GPO is applicable\n");
             continue;
@@ -1008,27 +1052,20 @@ ad_gpo_filter_gpos_by_cse_guid(TALLOC_CTX *mem_ctx,
 
 /*
  * This cse-specific function (GP_EXT_GUID_SECURITY) returns a boolean value
- * based on whether the input user_sid or any of the input group_sids appear
- * in the input list of privilege_sids.
+ * based on whether the user_sid or any of the group_sids of the input sids
+ * appear in the input list of privilege_sids.
  */
 static bool
 check_rights(char **privilege_sids,
              int privilege_size,
-             const char *user_sid,
-             const char **group_sids,
-             int group_size)
+             struct ad_gpo_sids *sids)
 {
-    int i, j;
+    int i;
 
     for (i = 0; i < privilege_size; i++) {
-        if (strcmp(user_sid, privilege_sids[i]) == 0) {
+        if (ad_gpo_sids_include(sids, privilege_sids[i])) {
             return true;
         }
-        for (j = 0; j < group_size; j++) {
-            if (strcmp(group_sids[j], privilege_sids[i]) == 0) {
-                return true;
-            }
-        }
     }
 
     return false;
@@ -1234,19 +1271,14 @@ static errno_t
 ad_gpo_access_check(TALLOC_CTX *mem_ctx,
                     enum gpo_access_control_mode gpo_mode,
                     enum gpo_map_type gpo_map_type,
-                    const char *user,
-                    struct sss_domain_info *domain,
+                    struct ad_gpo_sids *sids,
                     char **allowed_sids,
                     int allowed_size,
                     char **denied_sids,
                     int denied_size)
 {
-    const char *user_sid;
-    const char **group_sids;
-    int group_size = 0;
     bool access_granted = false;
     bool access_denied = false;
-    int ret;
     int j;
 
     DEBUG(SSSDBG_TRACE_FUNC, "RESULTANT POLICY:\n");
@@ -1262,36 +1294,25 @@ ad_gpo_access_check(TALLOC_CTX *mem_ctx,
         DEBUG(SSSDBG_TRACE_FUNC, " denied_sids[%d] = %s\n", j, denied_sids[j]);
     }
 
-    ret = ad_gpo_get_sids(mem_ctx, user, domain, &user_sid,
-                          &group_sids, &group_size);
-    if (ret != EOK) {
-        ret = ERR_NO_SIDS;
-        DEBUG(SSSDBG_OP_FAILURE,
-              "Unable to retrieve SIDs: [%d](%s)\n", ret, sss_strerror(ret));
-        goto done;
-    }
-
     DEBUG(SSSDBG_TRACE_FUNC, "CURRENT USER:\n");
-    DEBUG(SSSDBG_TRACE_FUNC, "       user_sid = %s\n", user_sid);
+    DEBUG(SSSDBG_TRACE_FUNC, "       user_sid = %s\n", sids->user_sid);
 
-    for (j= 0; j < group_size; j++) {
+    for (j= 0; j < sids->group_size; j++) {
         DEBUG(SSSDBG_TRACE_FUNC, "  group_sids[%d] = %s\n", j,
-              group_sids[j]);
+              sids->group_sids[j]);
     }
 
     if (allowed_size == 0) {
         access_granted = true;
     }  else {
-        access_granted = check_rights(allowed_sids, allowed_size, user_sid,
-                                      group_sids, group_size);
+        access_granted = check_rights(allowed_sids, allowed_size, sids);
     }
 
     DEBUG(SSSDBG_TRACE_FUNC, "POLICY DECISION:\n");
 
     DEBUG(SSSDBG_TRACE_FUNC, " access_granted = %d\n", access_granted);
 
-    access_denied = check_rights(denied_sids, denied_size, user_sid,
-                                 group_sids, group_size);
+    access_denied = check_rights(denied_sids, denied_size, sids);
     DEBUG(SSSDBG_TRACE_FUNC, "  access_denied = %d\n", access_denied);
 
     if (access_granted && !access_denied) {
@@ -1311,14 +1332,6 @@ ad_gpo_access_check(TALLOC_CTX *mem_ctx,
             return EINVAL;
         }
     }
-
- done:
-
-    if (ret) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Error encountered: %d.\n", ret);
-    }
-
-    return ret;
 }
 
 #define GPO_CHILD_LOG_FILE "gpo_child"
@@ -1398,14 +1411,13 @@ parse_policy_setting_value(TALLOC_CTX *mem_ctx,
  * input gpo_map_type from the GPO Result object in the sysdb cache, parses
  * the values into allow_sids and deny_sids, and executes the access control
  * algorithm which compares the allow_sids and deny_sids against the user_sid
- * and group_sids for the input user.
+ * and group_sids of the input sids.
  */
 static errno_t
 ad_gpo_perform_hbac_processing(TALLOC_CTX *mem_ctx,
                                enum gpo_access_control_mode gpo_mode,
                                enum gpo_map_type gpo_map_type,
-                               const char *user,
-                               struct sss_domain_info *user_domain,
+                               struct ad_gpo_sids *sids,
                                struct sss_domain_info *host_domain)
 {
     int ret;
@@ -1442,9 +1454,8 @@ ad_gpo_perform_hbac_processing(TALLOC_CTX *mem_ctx,
     }
 
     /* perform access check with the final resultant allow_sids and deny_sids */
-    ret = ad_gpo_access_check(mem_ctx, gpo_mode, gpo_map_type, user,
-                              user_domain, allow_sids, allow_size, deny_sids,
-                              deny_size);
+    ret = ad_gpo_access_check(mem_ctx, gpo_mode, gpo_map_type, sids,
+                              allow_sids, allow_size, deny_sids, deny_size);
 
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE,
@@ -1478,9 +1489,12 @@ struct ad_gpo_access_state {
     const char *target_dn;
     struct gp_gpo **dacl_filtered_gpos;
     int num_dacl_filtered_gpos;
+    struct ad_gpo_sids *sids;
     struct gp_gpo **cse_filtered_gpos;
     int num_cse_filtered_gpos;
     int cse_gpo_index;
+    TALLOC_CTX *cse_ctx;
+    int num_pending_cses;
 };
 
 static void ad_gpo_connect_done(struct tevent_req *subreq);
@@ -1489,6 +1503,8 @@ static void ad_gpo_process_som_done(struct tevent_req *subreq);
 static void ad_gpo_process_gpo_done(struct tevent_req *subreq);
 
 static errno_t ad_gpo_cse_step(struct tevent_req *req);
+static errno_t ad_gpo_cse_fetch(struct tevent_req *req,
+                                struct gp_gpo *cse_filtered_gpo);
 static void ad_gpo_cse_done(struct tevent_req *subreq);
 
 struct tevent_req *
@@ -1576,6 +1592,7 @@ ad_gpo_access_send(TALLOC_CTX *mem_ctx,
     state->cse_filtered_gpos = NULL;
     state->num_cse_filtered_gpos = 0;
     state->cse_gpo_index = 0;
+    state->num_pending_cses = 0;
     state->ev = ev;
     state->user = user;
     state->ldb_ctx = sysdb_ctx_get_ldb(state->host_domain->sysdb);
@@ -1625,13 +1642,21 @@ process_offline_gpos(TALLOC_CTX *mem_ctx,
                      enum gpo_map_type gpo_map_type)
 
 {
+    struct ad_gpo_sids *sids;
     errno_t ret;
 
+    ret = ad_gpo_get_sids(mem_ctx, user, user_domain, &sids);
+    if (ret != EOK) {
+        ret = ERR_NO_SIDS;
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Unable to retrieve SIDs: [%d](%s)\n", ret, sss_strerror(ret));
+        goto done;
+    }
+
     ret = ad_gpo_perform_hbac_processing(mem_ctx,
                                          gpo_mode,
                                          gpo_map_type,
-                                         user,
-                                         user_domain,
+                                         sids,
                                          host_domain);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "HBAC processing failed: [%d](%s}\n",
@@ -1985,7 +2010,16 @@ ad_gpo_process_gpo_done(struct tevent_req *subreq)
         goto done;
     }
 
-    ret = ad_gpo_filter_gpos_by_dacl(state, state->user, state->user_domain,
+    ret = ad_gpo_get_sids(state, state->user, state->user_domain,
+                          &state->sids);
+    if (ret != EOK) {
+        ret = ERR_NO_SIDS;
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Unable to retrieve SIDs: [%d](%s)\n", ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = ad_gpo_filter_gpos_by_dacl(state, state->sids,
                                      state->opts->idmap_ctx->map,
                                      candidate_gpos, num_candidate_gpos,
                                      &state->dacl_filtered_gpos,
@@ -2104,8 +2138,76 @@ ad_gpo_process_gpo_done(struct tevent_req *subreq)
     }
 }
 
+/*
+ * The versionNumber of the GPC in LDAP is kept in sync with the version of
+ * the GPT.INI file on the sysvol share. If it matches the version of the
+ * cached GPO entry and the policy file downloaded for it is still present
+ * in the GPO CACHE, the gpo_child does not have to be run even if the cache
+ * timeout has expired.
+ */
+static bool
+ad_gpo_cached_version_matches(struct gp_gpo *gpo, int cached_gpt_version)
+{
+    if (gpo->gpo_version < 0 || gpo->gpo_version != cached_gpt_version) {
+        return false;
+    }
+
+    if (access(gpo->policy_filename, R_OK) != 0) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Policy file [%s] of GPO [%s] is not cached\n",
+              gpo->policy_filename, gpo->gpo_guid);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * This function starts the download of the policy files of the next
+ * cse_filtered_gpos until AD_GPO_MAX_PARALLEL_FETCHES are in progress. It
+ * returns EOK once all policy files have been downloaded and EAGAIN as long
+ * as some downloads are pending.
+ */
 static errno_t
 ad_gpo_cse_step(struct tevent_req *req)
+{
+    struct ad_gpo_access_state *state;
+    struct gp_gpo *cse_filtered_gpo;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct ad_gpo_access_state);
+
+    if (state->cse_ctx == NULL) {
+        state->cse_ctx = talloc_new(state);
+        if (state->cse_ctx == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    /* cse_filtered_gpo is NULL after all GPO policy files have been sent */
+    while (state->num_pending_cses < AD_GPO_MAX_PARALLEL_FETCHES
+            && (cse_filtered_gpo =
+                    state->cse_filtered_gpos[state->cse_gpo_index]) != NULL) {
+        ret = ad_gpo_cse_fetch(req, cse_filtered_gpo);
+        if (ret != EOK) {
+            talloc_zfree(state->cse_ctx);
+            return ret;
+        }
+
+        state->cse_gpo_index++;
+        state->num_pending_cses++;
+    }
+
+    if (state->num_pending_cses > 0) {
+        return EAGAIN;
+    }
+
+    talloc_zfree(state->cse_ctx);
+    return EOK;
+}
+
+static errno_t
+ad_gpo_cse_fetch(struct tevent_req *req, struct gp_gpo *cse_filtered_gpo)
 {
     struct tevent_req *subreq;
     struct ad_gpo_access_state *state;
@@ -2118,12 +2220,6 @@ ad_gpo_cse_step(struct tevent_req *req)
 
     state = tevent_req_data(req, struct ad_gpo_access_state);
 
-    struct gp_gpo *cse_filtered_gpo =
-        state->cse_filtered_gpos[state->cse_gpo_index];
-
-    /* cse_filtered_gpo is NULL after all GPO policy files have been downloaded */
-    if (cse_filtered_gpo == NULL) return EOK;
-
     DEBUG(SSSDBG_TRACE_FUNC, "cse filtered_gpos[%d]->gpo_guid is %s\n",
           state->cse_gpo_index, cse_filtered_gpo->gpo_guid);
     for (i = 0; i < cse_filtered_gpo->num_gpo_cse_guids; i++) {
@@ -2173,6 +2269,25 @@ ad_gpo_cse_step(struct tevent_req *req)
             (res->msgs[0], SYSDB_GPO_TIMEOUT_ATTR, 0);
 
         if (policy_file_timeout >= time(NULL)) {
+            send_to_child = false;
+        } else if (ad_gpo_cached_version_matches(cse_filtered_gpo,
+                                                 cached_gpt_version)) {
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "GPO [%s] is unchanged, using the cached policy file\n",
+                  cse_filtered_gpo->gpo_guid);
+
+            ret = sysdb_gpo_store_gpo(state->host_domain,
+                                      cse_filtered_gpo->gpo_guid,
+                                      cached_gpt_version,
+                                      state->gpo_timeout_option,
+                                      time(NULL));
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "Unable to store gpo cache entry: [%d](%s)\n",
+                      ret, sss_strerror(ret));
+                return ret;
+            }
+
             send_to_child = false;
         }
     } else if (ret == ENOENT) {
@@ -2189,7 +2304,7 @@ ad_gpo_cse_step(struct tevent_req *req)
 
     cse_filtered_gpo->send_to_child = send_to_child;
 
-    subreq = ad_gpo_process_cse_send(state,
+    subreq = ad_gpo_process_cse_send(state->cse_ctx,
                                      state->ev,
                                      send_to_child,
                                      state->host_domain,
@@ -2200,18 +2315,23 @@ ad_gpo_cse_step(struct tevent_req *req)
                                      GP_EXT_GUID_SECURITY_SUFFIX,
                                      cached_gpt_version,
                                      state->gpo_timeout_option);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
 
     tevent_req_set_callback(subreq, ad_gpo_cse_done, req);
-    return EAGAIN;
+    return EOK;
 }
 
 /*
- * This cse-specific function (GP_EXT_GUID_SECURITY) increments the
- * cse_gpo_index until the policy settings for all applicable GPOs have been
- * stored as part of the GPO Result object in the sysdb cache. Once all
- * GPOs have been processed, this functions performs HBAC processing by
- * comparing the resultant policy setting values in the GPO Result object
- * with the user_sid/group_sids of interest.
+ * This cse-specific function (GP_EXT_GUID_SECURITY) starts the next download
+ * until the policy files of all applicable GPOs are in the GPO CACHE. Then
+ * the policy settings of all GPOs are stored as part of the GPO Result
+ * object in the sysdb cache, in the order of the cse_filtered_gpos list, so
+ * the result does not depend on the order in which the downloads finished.
+ * Finally, this functions performs HBAC processing by comparing the
+ * resultant policy setting values in the GPO Result object with the
+ * user_sid/group_sids of interest.
  */
 static void
 ad_gpo_cse_done(struct tevent_req *subreq)
@@ -2219,20 +2339,15 @@ ad_gpo_cse_done(struct tevent_req *subreq)
     struct tevent_req *req;
     struct ad_gpo_access_state *state;
     int ret;
+    int i;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct ad_gpo_access_state);
 
-    struct gp_gpo *cse_filtered_gpo =
-        state->cse_filtered_gpos[state->cse_gpo_index];
-
-    const char *gpo_guid = cse_filtered_gpo->gpo_guid;
-
-    DEBUG(SSSDBG_TRACE_FUNC, "gpo_guid: %s\n", gpo_guid);
-
     ret = ad_gpo_process_cse_recv(subreq);
 
     talloc_zfree(subreq);
+    state->num_pending_cses--;
 
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "Unable to retrieve policy data: [%d](%s}\n",
@@ -2240,37 +2355,39 @@ ad_gpo_cse_done(struct tevent_req *subreq)
         goto done;
     }
 
-    /*
-     * now that the policy file for this gpo have been downloaded to the
-     * GPO CACHE, we store all of the supported keys present in the file
-     * (as part of the GPO Result object in the sysdb cache).
-     */
-    ret = ad_gpo_store_policy_settings(state->host_domain,
-                                       cse_filtered_gpo->policy_filename);
+    ret = ad_gpo_cse_step(req);
     if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE,
-              "ad_gpo_store_policy_settings failed: [%d](%s)\n",
-              ret, sss_strerror(ret));
         goto done;
     }
 
-    state->cse_gpo_index++;
-    ret = ad_gpo_cse_step(req);
+    /*
+     * now that the policy files of all gpos have been downloaded to the
+     * GPO CACHE, we store all of the supported keys present in the files
+     * (as part of the GPO Result object in the sysdb cache).
+     */
+    for (i = 0; i < state->num_cse_filtered_gpos; i++) {
+        DEBUG(SSSDBG_TRACE_FUNC, "gpo_guid: %s\n",
+              state->cse_filtered_gpos[i]->gpo_guid);
 
-    if (ret == EOK) {
-        /* ret is EOK only after all GPO policy files have been downloaded */
-        ret = ad_gpo_perform_hbac_processing(state,
-                                             state->gpo_mode,
-                                             state->gpo_map_type,
-                                             state->user,
-                                             state->user_domain,
-                                             state->host_domain);
+        ret = ad_gpo_store_policy_settings(state->host_domain,
+                                   state->cse_filtered_gpos[i]->policy_filename);
         if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE, "HBAC processing failed: [%d](%s}\n",
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "ad_gpo_store_policy_settings failed: [%d](%s)\n",
                   ret, sss_strerror(ret));
             goto done;
         }
+    }
 
+    ret = ad_gpo_perform_hbac_processing(state,
+                                         state->gpo_mode,
+                                         state->gpo_map_type,
+                                         state->sids,
+                                         state->host_domain);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "HBAC processing failed: [%d](%s}\n",
+              ret, sss_strerror(ret));
+        goto done;
     }
 
  done:
@@ -2278,6 +2395,8 @@ ad_gpo_cse_done(struct tevent_req *subreq)
     if (ret == EOK) {
         tevent_req_done(req);
     } else if (ret != EAGAIN) {
+        /* cancel the downloads which are still pending */
+        talloc_zfree(state->cse_ctx);
         tevent_req_error(req, ret);
     }
 }
@@ -3414,10 +3533,21 @@ struct ad_gpo_process_gpo_state {
     struct gp_gpo **candidate_gpos;
     int num_candidate_gpos;
     int gpo_index;
+
+    TALLOC_CTX *fetch_ctx;
+    int num_pending;
+};
+
+/* callback data of the lookup of a single GPO */
+struct ad_gpo_attrs_fetch {
+    struct tevent_req *req;
+    struct gp_gpo *gp_gpo;
 };
 
 static errno_t ad_gpo_get_gpo_attrs_step(struct tevent_req *req);
 static void ad_gpo_get_gpo_attrs_done(struct tevent_req *subreq);
+static void ad_gpo_get_gpo_attrs_finish(struct ad_gpo_attrs_fetch *fetch,
+                                        errno_t ret);
 
 /*
  * This function uses the input som_list to populate a prioritized list of
@@ -3426,7 +3556,9 @@ static void ad_gpo_get_gpo_attrs_done(struct tevent_req *subreq);
  * that might be applicable to the target. This list can not be expanded, but
  * it might be reduced based on subsequent filtering steps. The GPO object DNs
  * are used to retrieve certain LDAP attributes of each GPO object, that are
- * parsed into the various fields of the gp_gpo object.
+ * parsed into the various fields of the gp_gpo object. Up to
+ * AD_GPO_MAX_PARALLEL_FETCHES GPO objects are retrieved at the same time,
+ * each result is stored in its own gp_gpo object so the list keeps its order.
  */
 struct tevent_req *
 ad_gpo_process_gpo_send(TALLOC_CTX *mem_ctx,
@@ -3459,6 +3591,13 @@ ad_gpo_process_gpo_send(TALLOC_CTX *mem_ctx,
     state->gpo_index = 0;
     state->candidate_gpos = NULL;
     state->num_candidate_gpos = 0;
+    state->num_pending = 0;
+
+    state->fetch_ctx = talloc_new(state);
+    if (state->fetch_ctx == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
 
     ret = ad_gpo_populate_candidate_gpos(state,
                                          som_list,
@@ -3493,37 +3632,53 @@ immediately:
     return req;
 }
 
+/*
+ * Starts the lookups of the next GPOs until AD_GPO_MAX_PARALLEL_FETCHES are
+ * in progress. Returns EOK once all GPOs have been processed and EAGAIN as
+ * long as some lookups are pending.
+ */
 static errno_t
 ad_gpo_get_gpo_attrs_step(struct tevent_req *req)
 {
     const char *attrs[] = AD_GPO_ATTRS;
     struct tevent_req *subreq;
     struct ad_gpo_process_gpo_state *state;
+    struct ad_gpo_attrs_fetch *fetch;
+    struct gp_gpo *gp_gpo;
 
     state = tevent_req_data(req, struct ad_gpo_process_gpo_state);
 
-    struct gp_gpo *gp_gpo = state->candidate_gpos[state->gpo_index];
-
-    /* gp_gpo is NULL only after all GPOs have been processed */
-    if (gp_gpo == NULL) return EOK;
-
-    const char *gpo_dn = gp_gpo->gpo_dn;
-
-    subreq = sdap_sd_search_send(state, state->ev,
-                                 state->opts, sdap_id_op_handle(state->sdap_op),
-                                 gpo_dn, SECINFO_DACL, attrs, state->timeout);
+    /* gp_gpo is NULL only after all GPOs have been sent */
+    while (state->num_pending < AD_GPO_MAX_PARALLEL_FETCHES
+            && (gp_gpo = state->candidate_gpos[state->gpo_index]) != NULL) {
+        fetch = talloc_zero(state->fetch_ctx, struct ad_gpo_attrs_fetch);
+        if (fetch == NULL) {
+            talloc_zfree(state->fetch_ctx);
+            return ENOMEM;
+        }
+        fetch->req = req;
+        fetch->gp_gpo = gp_gpo;
+
+        subreq = sdap_sd_search_send(fetch, state->ev, state->opts,
+                                     sdap_id_op_handle(state->sdap_op),
+                                     gp_gpo->gpo_dn, SECINFO_DACL, attrs,
+                                     state->timeout);
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_OP_FAILURE, "sdap_sd_search_send failed.\n");
+            talloc_zfree(state->fetch_ctx);
+            return ENOMEM;
+        }
 
-    if (subreq == NULL) {
-        DEBUG(SSSDBG_OP_FAILURE, "sdap_sd_search_send failed.\n");
-        return ENOMEM;
+        tevent_req_set_callback(subreq, ad_gpo_get_gpo_attrs_done, fetch);
+        state->gpo_index++;
+        state->num_pending++;
     }
 
-    tevent_req_set_callback(subreq, ad_gpo_get_gpo_attrs_done, req);
-    return EAGAIN;
+    return state->num_pending == 0 ? EOK : EAGAIN;
 }
 
 static errno_t
-ad_gpo_sd_process_attrs(struct tevent_req *req,
+ad_gpo_sd_process_attrs(struct gp_gpo *gp_gpo,
                         char *smb_host,
                         struct sysdb_attrs *result);
 void
@@ -3546,7 +3701,7 @@ ad_gpo_get_sd_referral_recv(struct tevent_req *req,
 static void
 ad_gpo_get_gpo_attrs_done(struct tevent_req *subreq)
 {
-    struct tevent_req *req;
+    struct ad_gpo_attrs_fetch *fetch;
     struct ad_gpo_process_gpo_state *state;
     int ret;
     int dp_error;
@@ -3554,10 +3709,10 @@ ad_gpo_get_gpo_attrs_done(struct tevent_req *subreq)
     struct sysdb_attrs **results;
     char **refs;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct ad_gpo_process_gpo_state);
+    fetch = tevent_req_callback_data(subreq, struct ad_gpo_attrs_fetch);
+    state = tevent_req_data(fetch->req, struct ad_gpo_process_gpo_state);
 
-    ret = sdap_sd_search_recv(subreq, state,
+    ret = sdap_sd_search_recv(subreq, fetch,
                               &num_results, &results,
                               &refcount, &refs);
     talloc_zfree(subreq);
@@ -3579,7 +3734,7 @@ ad_gpo_get_gpo_attrs_done(struct tevent_req *subreq)
              * more than one (or zero) it's a bug.
              */
 
-            subreq = ad_gpo_get_sd_referral_send(state, state->ev,
+            subreq = ad_gpo_get_sd_referral_send(fetch, state->ev,
                                                  state->access_ctx,
                                                  state->opts,
                                                  refs[0],
@@ -3590,15 +3745,13 @@ ad_gpo_get_gpo_attrs_done(struct tevent_req *subreq)
                 goto done;
             }
 
-            tevent_req_set_callback(subreq, ad_gpo_get_sd_referral_done, req);
-            ret = EAGAIN;
-            goto done;
+            tevent_req_set_callback(subreq, ad_gpo_get_sd_referral_done,
+                                    fetch);
+            return;
 
         } else {
-            const char *gpo_dn = state->candidate_gpos[state->gpo_index]->gpo_dn;
-
             DEBUG(SSSDBG_OP_FAILURE,
-                  "No attrs found for GPO [%s].\n", gpo_dn);
+                  "No attrs found for GPO [%s].\n", fetch->gp_gpo->gpo_dn);
             ret = ENOENT;
             goto done;
         }
@@ -3608,15 +3761,12 @@ ad_gpo_get_gpo_attrs_done(struct tevent_req *subreq)
         goto done;
     }
 
-    ret = ad_gpo_sd_process_attrs(req, state->server_hostname, results[0]);
+    ret = ad_gpo_sd_process_attrs(fetch->gp_gpo, state->server_hostname,
+                                  results[0]);
 
 done:
 
-   if (ret == EOK) {
-       tevent_req_done(req);
-   } else if (ret != EAGAIN) {
-       tevent_req_error(req, ret);
-   }
+    ad_gpo_get_gpo_attrs_finish(fetch, ret);
 }
 
 void
@@ -3627,12 +3777,12 @@ ad_gpo_get_sd_referral_done(struct tevent_req *subreq)
     struct sysdb_attrs *reply;
     char *smb_host;
 
-    struct tevent_req *req =
-            tevent_req_callback_data(subreq, struct tevent_req);
+    struct ad_gpo_attrs_fetch *fetch =
+            tevent_req_callback_data(subreq, struct ad_gpo_attrs_fetch);
     struct ad_gpo_process_gpo_state *state =
-            tevent_req_data(req, struct ad_gpo_process_gpo_state);
+            tevent_req_data(fetch->req, struct ad_gpo_process_gpo_state);
 
-    ret = ad_gpo_get_sd_referral_recv(subreq, state, &smb_host, &reply);
+    ret = ad_gpo_get_sd_referral_recv(subreq, fetch, &smb_host, &reply);
     talloc_zfree(subreq);
     if (ret != EOK) {
         /* Terminate the sdap_id_op */
@@ -3646,24 +3796,45 @@ ad_gpo_get_sd_referral_done(struct tevent_req *subreq)
     }
 
     /* Lookup succeeded. Process it */
-    ret = ad_gpo_sd_process_attrs(req, smb_host, reply);
+    ret = ad_gpo_sd_process_attrs(fetch->gp_gpo, smb_host, reply);
 
 done:
 
-   if (ret == EOK) {
-       tevent_req_done(req);
-   } else if (ret != EAGAIN) {
-       tevent_req_error(req, ret);
-   }
+    ad_gpo_get_gpo_attrs_finish(fetch, ret);
+}
+
+/*
+ * Completes the lookup of a single GPO and starts the next one. If a lookup
+ * failed, the remaining ones are cancelled by freeing fetch_ctx.
+ */
+static void
+ad_gpo_get_gpo_attrs_finish(struct ad_gpo_attrs_fetch *fetch, errno_t ret)
+{
+    struct tevent_req *req = fetch->req;
+    struct ad_gpo_process_gpo_state *state =
+            tevent_req_data(req, struct ad_gpo_process_gpo_state);
+
+    talloc_free(fetch);
+    state->num_pending--;
+
+    if (ret == EOK) {
+        ret = ad_gpo_get_gpo_attrs_step(req);
+    }
+
+    if (ret == EOK) {
+        talloc_zfree(state->fetch_ctx);
+        tevent_req_done(req);
+    } else if (ret != EAGAIN) {
+        talloc_zfree(state->fetch_ctx);
+        tevent_req_error(req, ret);
+    }
 }
 
 static errno_t
-ad_gpo_sd_process_attrs(struct tevent_req *req,
+ad_gpo_sd_process_attrs(struct gp_gpo *gp_gpo,
                         char *smb_host,
                         struct sysdb_attrs *result)
 {
-    struct ad_gpo_process_gpo_state *state;
-    struct gp_gpo *gp_gpo;
     int ret;
     struct ldb_message_element *el = NULL;
     const char *gpo_guid = NULL;
@@ -3671,9 +3842,6 @@ ad_gpo_sd_process_attrs(struct tevent_req *req,
     char *file_sys_path = NULL;
     uint8_t *raw_machine_ext_names = NULL;
 
-    state = tevent_req_data(req, struct ad_gpo_process_gpo_state);
-    gp_gpo = state->candidate_gpos[state->gpo_index];
-
     /* retrieve AD_AT_CN */
     ret = sysdb_attrs_get_string(result, AD_AT_CN, &gpo_guid);
     if (ret != EOK) {
@@ -3745,6 +3913,20 @@ ad_gpo_sd_process_attrs(struct tevent_req *req,
 
     DEBUG(SSSDBG_TRACE_ALL, "gpo_flags: %d\n", gp_gpo->gpo_flags);
 
+    /* retrieve AD_AT_VERSION_NUMBER; -1 means the version is not known */
+    ret = sysdb_attrs_get_int32_t(result, AD_AT_VERSION_NUMBER,
+                                  &gp_gpo->gpo_version);
+    if (ret == ENOENT) {
+        gp_gpo->gpo_version = -1;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "sysdb_attrs_get_int32_t failed: [%d](%s)\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_ALL, "gpo_version: %d\n", gp_gpo->gpo_version);
+
     /* retrieve AD_AT_NT_SEC_DESC */
     ret = sysdb_attrs_get_el(result, AD_AT_NT_SEC_DESC, &el);
     if (ret != EOK && ret != ENOENT) {
@@ -3779,7 +3961,7 @@ ad_gpo_sd_process_attrs(struct tevent_req *req,
          */
         DEBUG(SSSDBG_TRACE_ALL,
               "machine_ext_names attribute not found or has no value\n");
-        state->gpo_index++;
+        ret = EOK;
     } else {
         raw_machine_ext_names = el[0].values[0].data;
 
@@ -3792,12 +3974,8 @@ ad_gpo_sd_process_attrs(struct tevent_req *req,
                   "ad_gpo_parse_machine_ext_names() failed\n");
             goto done;
         }
-
-        state->gpo_index++;
     }
 
-    ret = ad_gpo_get_gpo_attrs_step(req);
-
  done:
 
     return ret;
@@ -4139,36 +4317,33 @@ gpo_fork_child(struct tevent_req *req)
         return err;
     }
 
-    pid = fork();
-
-    if (pid == 0) { /* child */
-        err = exec_child_ex(state,
-                            pipefd_to_child, pipefd_from_child,
-                            GPO_CHILD, gpo_child_debug_fd, NULL, false,
-                            STDIN_FILENO, AD_GPO_CHILD_OUT_FILENO);
+    err = spawn_child(state,
+                      pipefd_to_child, pipefd_from_child,
+                      GPO_CHILD, gpo_child_debug_fd, NULL, false,
+                      STDIN_FILENO, AD_GPO_CHILD_OUT_FILENO, &pid);
+    if (err != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not exec gpo_child: [%d][%s].\n",
               err, strerror(err));
-        return err;
-    } else if (pid > 0) { /* parent */
-        state->child_pid = pid;
-        state->io->read_from_child_fd = pipefd_from_child[0];
+        close(pipefd_from_child[0]);
         close(pipefd_from_child[1]);
-        state->io->write_to_child_fd = pipefd_to_child[1];
         close(pipefd_to_child[0]);
-        sss_fd_nonblocking(state->io->read_from_child_fd);
-        sss_fd_nonblocking(state->io->write_to_child_fd);
+        close(pipefd_to_child[1]);
+        return err;
+    }
 
-        ret = child_handler_setup(state->ev, pid, NULL, NULL, NULL);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE,
-                  "Could not set up child signal handler\n");
-            return ret;
-        }
-    } else { /* error */
-        err = errno;
+    state->child_pid = pid;
+    state->io->read_from_child_fd = pipefd_from_child[0];
+    close(pipefd_from_child[1]);
+    state->io->write_to_child_fd = pipefd_to_child[1];
+    close(pipefd_to_child[0]);
+    sss_fd_nonblocking(state->io->read_from_child_fd);
+    sss_fd_nonblocking(state->io->write_to_child_fd);
+
+    ret = child_handler_setup(state->ev, pid, NULL, NULL, NULL);
+    if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE,
-              "fork failed [%d][%s].\n", errno, strerror(errno));
-        return err;
+              "Could not set up child signal handler\n");
+        return ret;
     }
 
     return EOK;
@@ -24,6 +24,7 @@
 #include "providers/ad/ad_common.h"
 #include "providers/ad/ad_id.h"
 #include "providers/ad/ad_domain_info.h"
+#include "providers/ad/ad_dirsync.h"
 #include "providers/ldap/sdap_async_enum.h"
 #include "providers/ldap/sdap_idmap.h"
 
@@ -480,13 +481,17 @@ struct ad_enumeration_state {
     const char *realm;
     struct sdap_domain *sdom;
     struct sdap_domain *sditer;
+    struct ad_id_ctx *iter_id_ctx;
 };
 
 static void ad_enumeration_conn_done(struct tevent_req *subreq);
 static void ad_enumeration_master_done(struct tevent_req *subreq);
 static errno_t ad_enum_sdom(struct tevent_req *req, struct sdap_domain *sd,
                             struct ad_id_ctx *id_ctx);
+static void ad_enumeration_dirsync_done(struct tevent_req *subreq);
+static errno_t ad_enum_sdom_full(struct tevent_req *req);
 static void ad_enumeration_done(struct tevent_req *subreq);
+static void ad_enumeration_next(struct tevent_req *req);
 
 struct tevent_req *
 ad_enumeration_send(TALLOC_CTX *mem_ctx,
@@ -630,11 +635,74 @@ static errno_t
 ad_enum_sdom(struct tevent_req *req,
              struct sdap_domain *sd,
              struct ad_id_ctx *id_ctx)
+{
+    struct tevent_req *subreq;
+    struct ad_enumeration_state *state = tevent_req_data(req,
+                                                struct ad_enumeration_state);
+
+    state->iter_id_ctx = id_ctx;
+
+    if (!dp_opt_get_bool(id_ctx->ad_options->basic, AD_ENABLE_DIRSYNC)) {
+        return ad_enum_sdom_full(req);
+    }
+
+    /* Only the changes since the last cycle are fetched, the domain is
+     * enumerated when there is no usable cookie */
+    subreq = ad_dirsync_send(state, state->ev, id_ctx, sd);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Failed to schedule DirSync, retrying later!\n");
+        return ENOMEM;
+    }
+    tevent_req_set_callback(subreq, ad_enumeration_dirsync_done, req);
+
+    return EOK;
+}
+
+static void
+ad_enumeration_dirsync_done(struct tevent_req *subreq)
+{
+    errno_t ret;
+    bool full_enum;
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ad_enumeration_state *state = tevent_req_data(req,
+                                                struct ad_enumeration_state);
+
+    ret = ad_dirsync_recv(subreq, &full_enum);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "DirSync of domain %s failed [%d]: %s, "
+              "enumerating it\n", state->sditer->dom->name,
+              ret, sss_strerror(ret));
+        full_enum = true;
+    }
+
+    if (!full_enum) {
+        state->sditer->last_enum = tevent_timeval_current();
+        ad_enumeration_next(req);
+        return;
+    }
+
+    ret = ad_enum_sdom_full(req);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Could not enumerate domain %s\n", state->sditer->dom->name);
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    /* Execution will resume in ad_enumeration_done */
+}
+
+static errno_t
+ad_enum_sdom_full(struct tevent_req *req)
 {
     struct sdap_id_conn_ctx *user_conn;
     struct tevent_req *subreq;
     struct ad_enumeration_state *state = tevent_req_data(req,
                                                 struct ad_enumeration_state);
+    struct ad_id_ctx *id_ctx = state->iter_id_ctx;
 
     if (dp_opt_get_bool(id_ctx->ad_options->basic, AD_ENABLE_GC)) {
         user_conn = id_ctx->gc_ctx;
@@ -647,7 +715,7 @@ ad_enum_sdom(struct tevent_req *req,
      */
     subreq = sdap_dom_enum_ex_send(state, state->ev,
                                    id_ctx->sdap_id_ctx,
-                                   sd,
+                                   state->sditer,
                                    user_conn,         /* Users    */
                                    id_ctx->ldap_ctx,  /* Groups   */
                                    id_ctx->ldap_ctx); /* Services */
@@ -681,8 +749,8 @@ ad_enumeration_done(struct tevent_req *subreq)
         /* Retry enumerating the same domain again, this time w/o
          * connecting to GC
          */
-        disable_gc(state->id_ctx->ad_options);
-        ret = ad_enum_sdom(req, state->sditer, state->id_ctx);
+        disable_gc(state->iter_id_ctx->ad_options);
+        ret = ad_enum_sdom_full(req);
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE,
                 "Could not retry domain %s\n", state->sditer->dom->name);
@@ -699,13 +767,32 @@ ad_enumeration_done(struct tevent_req *subreq)
         return;
     }
 
+    ad_enumeration_next(req);
+}
+
+static void
+ad_enumeration_next(struct tevent_req *req)
+{
+    struct ad_id_ctx *subdom_id_ctx;
+    errno_t ret;
+    struct ad_enumeration_state *state = tevent_req_data(req,
+                                                struct ad_enumeration_state);
+
     do {
         state->sditer = state->sditer->next;
     } while (state->sditer &&
              state->sditer->dom->enumerate == false);
 
     if (state->sditer != NULL) {
-        ret = ad_enum_sdom(req, state->sditer, state->sditer->pvt);
+        subdom_id_ctx = ad_get_sdom_id_ctx(state->id_ctx, state->sditer);
+        if (subdom_id_ctx == NULL) {
+            DEBUG(SSSDBG_OP_FAILURE, "No ID ctx available for [%s].\n",
+                  state->sditer->dom->name);
+            tevent_req_error(req, EFAULT);
+            return;
+        }
+
+        ret = ad_enum_sdom(req, state->sditer, subdom_id_ctx);
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE, "Could not enumerate domain %s\n",
                   state->sditer->dom->name);
@@ -258,6 +258,33 @@ sssm_ad_id_init(struct be_ctx *bectx,
         goto done;
     }
 
+    ret = sdap_id_conn_warmup_setup(ad_ctx->ldap_ctx);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_offline_probe_setup(ad_ctx->ldap_ctx);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_server_probe_setup(ad_ctx->ldap_ctx);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_stats_setup(ad_ctx->ldap_ctx);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (dp_opt_get_bool(ad_options->basic, AD_ENABLE_GC)) {
+        ret = sdap_id_conn_warmup_setup(ad_ctx->gc_ctx);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
     ad_ctx->sdap_id_ctx->opts->sdom->pvt = ad_ctx;
 
     /* Set up the ID mapping object */
@@ -279,10 +306,12 @@ sssm_ad_id_init(struct be_ctx *bectx,
         ad_domain = dp_opt_get_string(ad_options->basic, AD_DOMAIN);
         ad_site_override = dp_opt_get_string(ad_options->basic, AD_SITE);
 
-        srv_ctx = ad_srv_plugin_ctx_init(bectx, bectx->be_res,
+        srv_ctx = ad_srv_plugin_ctx_init(bectx, bectx, bectx->be_res,
                                          default_host_dbs, ad_options->id,
                                          hostname, ad_domain,
-                                         ad_site_override);
+                                         ad_site_override,
+                                         dp_opt_get_bool(ad_options->basic,
+                                                         AD_DC_LATENCY_PING));
         if (srv_ctx == NULL) {
             DEBUG(SSSDBG_FATAL_FAILURE, "Out of memory?\n");
             ret = ENOMEM;
@@ -50,6 +50,9 @@ struct dp_option ad_basic_opts[] = {
     { "krb5_confd_path", DP_OPT_STRING, { KRB5_MAPPING_DIR }, NULL_STRING },
     { "ad_maximum_machine_account_password_age", DP_OPT_NUMBER, { .number = 30 }, NULL_NUMBER },
     { "ad_machine_account_password_renewal_opts", DP_OPT_STRING, { "86400:750" }, NULL_STRING },
+    { "ad_enable_dirsync", DP_OPT_BOOL, BOOL_FALSE, BOOL_FALSE },
+    { "ad_dc_latency_ping", DP_OPT_BOOL, BOOL_FALSE, BOOL_FALSE },
+    { "ad_subdomain_idle_timeout", DP_OPT_NUMBER, { .number = 900 }, NULL_NUMBER },
     DP_OPTION_TERMINATOR
 };
 
@@ -147,6 +150,27 @@ struct dp_option ad_def_ldap_opts[] = {
     { "ldap_max_id", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER},
     { "ldap_pwdlockout_dn", DP_OPT_STRING, NULL_STRING, NULL_STRING },
     { "wildcard_limit", DP_OPT_NUMBER, { .number = 1000 }, NULL_NUMBER},
+    { "ldap_connection_pool_size", DP_OPT_NUMBER, { .number = 1 }, NULL_NUMBER },
+    { "ldap_connection_pool_min", DP_OPT_NUMBER, { .number = 1 }, NULL_NUMBER },
+    { "ldap_connection_pool_idle_timeout", DP_OPT_NUMBER, { .number = 60 }, NULL_NUMBER },
+    { "ldap_max_outstanding_ops", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
+    { "ldap_lookup_batch_window", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
+    { "ldap_lookup_batch_size", DP_OPT_NUMBER, { .number = 50 }, NULL_NUMBER },
+    { "ldap_content_sync", DP_OPT_BOOL, BOOL_FALSE, BOOL_FALSE },
+    { "ldap_group_nesting_parallel_lookups", DP_OPT_NUMBER, { .number = 4 }, NULL_NUMBER },
+    { "ldap_group_nesting_memo_timeout", DP_OPT_NUMBER, { .number = 10 }, NULL_NUMBER },
+    { "ldap_range_parallel_requests", DP_OPT_NUMBER, { .number = 4 }, NULL_NUMBER },
+    { "ldap_page_size_max", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
+    { "ldap_tls_session_resumption", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
+    { "ldap_child_idle_timeout", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
+    { "ldap_purge_cache_batch_size", DP_OPT_NUMBER, { .number = 100 }, NULL_NUMBER },
+    { "ldap_purge_cache_time_budget", DP_OPT_NUMBER, { .number = 50 }, NULL_NUMBER },
+    { "ldap_connection_warmup", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
+    { "ldap_deref_adaptive", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
+    { "ldap_connection_stagger", DP_OPT_NUMBER, { .number = 500 }, NULL_NUMBER },
+    { "ldap_server_probe_interval", DP_OPT_NUMBER, { .number = 60 }, NULL_NUMBER },
+    { "ldap_connection_keepalive", DP_OPT_NUMBER, { .number = 0 }, NULL_NUMBER },
+    { "ldap_connection_stats_interval", DP_OPT_NUMBER, { .number = 0 }, NULL_NUMBER },
     DP_OPTION_TERMINATOR
 };
 
@@ -171,6 +195,7 @@ struct dp_option ad_def_krb5_opts[] = {
     { "krb5_use_enterprise_principal", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
     { "krb5_use_kdcinfo", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
     { "krb5_map_user", DP_OPT_STRING, NULL_STRING, NULL_STRING },
+    { "krb5_child_pool_size", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
     DP_OPTION_TERMINATOR
 };
 
@@ -37,6 +37,13 @@
 
 #define AD_SITE_DOMAIN_FMT "%s._sites.%s"
 
+/* at most this many domain controllers are pinged after a SRV lookup */
+#define AD_SRV_MAX_PINGS 10
+/* all pings have to complete within this time */
+#define AD_SRV_PING_TIMEOUT_MSEC 1000
+/* the UDP port of connectionless LDAP */
+#define AD_CLDAP_PORT 389
+
 static errno_t ad_sort_servers_by_dns(TALLOC_CTX *mem_ctx,
                                       const char *domain,
                                       struct fo_server_info **_srv,
@@ -230,11 +237,58 @@ static int ad_get_dc_servers_recv(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
-struct ad_get_client_site_state {
-    struct tevent_context *ev;
+struct ad_srv_plugin_ctx {
+    struct be_ctx *be_ctx;
     struct be_resolv_ctx *be_res;
-    enum host_database *host_db;
+    enum host_database *host_dbs;
     struct sdap_options *opts;
+    const char *hostname;
+    const char *ad_domain;
+    const char *ad_site_override;
+    bool ping_dcs;
+};
+
+/* The filter of the LDAP ping, which is answered with the NetLogon
+ * information of the domain controller */
+static char *ad_netlogon_filter(TALLOC_CTX *mem_ctx, const char *ad_domain)
+{
+    char *ntver;
+    char *filter;
+
+    ntver = sss_ldap_encode_ndr_uint32(mem_ctx, NETLOGON_NT_VERSION_5EX |
+                                       NETLOGON_NT_VERSION_WITH_CLOSEST_SITE);
+    if (ntver == NULL) {
+        return NULL;
+    }
+
+    filter = talloc_asprintf(mem_ctx, "(&(%s=%s)(%s=%s))",
+                             AD_AT_DNS_DOMAIN, ad_domain,
+                             AD_AT_NT_VERSION, ntver);
+    talloc_free(ntver);
+
+    return filter;
+}
+
+static struct tevent_req *ad_srv_ping_send(TALLOC_CTX *mem_ctx,
+                                           struct tevent_context *ev,
+                                           struct ad_srv_plugin_ctx *ctx,
+                                           const char *ad_domain,
+                                           struct fo_server_info *servers,
+                                           size_t num_servers,
+                                           bool first_answer);
+static errno_t ad_srv_ping_recv(TALLOC_CTX *mem_ctx,
+                                struct tevent_req *req,
+                                char **_site,
+                                char **_forest);
+
+/* The site is taken from the first domain controller which answers the CLDAP
+ * ping. If none does, e.g. because UDP is filtered or libldap was built
+ * without CLDAP support, the domain controllers are asked one by one over
+ * LDAP. */
+
+struct ad_get_client_site_state {
+    struct tevent_context *ev;
+    struct ad_srv_plugin_ctx *ctx;
     const char *ad_domain;
     struct fo_server_info *dcs;
     size_t num_dcs;
@@ -246,21 +300,22 @@ struct ad_get_client_site_state {
     char *forest;
 };
 
+static void ad_get_client_site_ping_done(struct tevent_req *subreq);
 static errno_t ad_get_client_site_next_dc(struct tevent_req *req);
 static void ad_get_client_site_connect_done(struct tevent_req *subreq);
 static void ad_get_client_site_done(struct tevent_req *subreq);
 
-struct tevent_req *ad_get_client_site_send(TALLOC_CTX *mem_ctx,
-                                           struct tevent_context *ev,
-                                           struct be_resolv_ctx *be_res,
-                                           enum host_database *host_db,
-                                           struct sdap_options *opts,
-                                           const char *ad_domain,
-                                           struct fo_server_info *dcs,
-                                           size_t num_dcs)
+static struct tevent_req *
+ad_get_client_site_send(TALLOC_CTX *mem_ctx,
+                        struct tevent_context *ev,
+                        struct ad_srv_plugin_ctx *ctx,
+                        const char *ad_domain,
+                        struct fo_server_info *dcs,
+                        size_t num_dcs)
 {
     struct ad_get_client_site_state *state = NULL;
     struct tevent_req *req = NULL;
+    struct tevent_req *subreq = NULL;
     errno_t ret;
 
     req = tevent_req_create(mem_ctx, &state,
@@ -270,28 +325,30 @@ struct tevent_req *ad_get_client_site_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    if (be_res == NULL || host_db == NULL || opts == NULL) {
+    if (ctx->be_res == NULL || ctx->host_dbs == NULL || ctx->opts == NULL) {
         ret = EINVAL;
         goto immediately;
     }
 
     state->ev = ev;
-    state->be_res = be_res;
-    state->host_db = host_db;
-    state->opts = opts;
+    state->ctx = ctx;
     state->ad_domain = ad_domain;
     state->dcs = dcs;
     state->num_dcs = num_dcs;
 
-    state->dc_index = 0;
-    ret = ad_get_client_site_next_dc(req);
-    if (ret == EOK) {
+    if (num_dcs == 0) {
         ret = ENOENT;
         goto immediately;
-    } else if (ret != EAGAIN) {
+    }
+
+    subreq = ad_srv_ping_send(state, ev, ctx, ad_domain, dcs, num_dcs, true);
+    if (subreq == NULL) {
+        ret = ENOMEM;
         goto immediately;
     }
 
+    tevent_req_set_callback(subreq, ad_get_client_site_ping_done, req);
+
     return req;
 
 immediately:
@@ -305,6 +362,34 @@ immediately:
     return req;
 }
 
+static void ad_get_client_site_ping_done(struct tevent_req *subreq)
+{
+    struct ad_get_client_site_state *state = NULL;
+    struct tevent_req *req = NULL;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct ad_get_client_site_state);
+
+    ret = ad_srv_ping_recv(state, subreq, &state->site, &state->forest);
+    talloc_zfree(subreq);
+    if (ret == EOK) {
+        tevent_req_done(req);
+        return;
+    }
+
+    DEBUG(SSSDBG_MINOR_FAILURE, "No domain controller returned the site in "
+          "the CLDAP ping, trying LDAP\n");
+
+    state->dc_index = 0;
+    ret = ad_get_client_site_next_dc(req);
+    if (ret == EOK) {
+        tevent_req_error(req, ENOENT);
+    } else if (ret != EAGAIN) {
+        tevent_req_error(req, ret);
+    }
+}
+
 static errno_t ad_get_client_site_next_dc(struct tevent_req *req)
 {
     struct ad_get_client_site_state *state = NULL;
@@ -320,11 +405,11 @@ static errno_t ad_get_client_site_next_dc(struct tevent_req *req)
 
     state->dc = state->dcs[state->dc_index];
 
-    subreq = sdap_connect_host_send(state, state->ev, state->opts,
-                                    state->be_res->resolv,
-                                    state->be_res->family_order,
-                                    state->host_db, "ldap", state->dc.host,
-                                    state->dc.port, false);
+    subreq = sdap_connect_host_send(state, state->ev, state->ctx->opts,
+                                    state->ctx->be_res->resolv,
+                                    state->ctx->be_res->family_order,
+                                    state->ctx->host_dbs, "ldap",
+                                    state->dc.host, state->dc.port, false);
     if (subreq == NULL) {
         ret = ENOMEM;
         goto done;
@@ -345,7 +430,6 @@ static void ad_get_client_site_connect_done(struct tevent_req *subreq)
     struct tevent_req *req = NULL;
     static const char *attrs[] = {AD_AT_NETLOGON, NULL};
     char *filter = NULL;
-    char *ntver = NULL;
     errno_t ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
@@ -365,25 +449,16 @@ static void ad_get_client_site_connect_done(struct tevent_req *subreq)
         goto done;
     }
 
-    ntver = sss_ldap_encode_ndr_uint32(state, NETLOGON_NT_VERSION_5EX |
-                                       NETLOGON_NT_VERSION_WITH_CLOSEST_SITE);
-    if (ntver == NULL) {
-        ret = ENOMEM;
-        goto done;
-    }
-
-    filter = talloc_asprintf(state, "(&(%s=%s)(%s=%s))",
-                             AD_AT_DNS_DOMAIN, state->ad_domain,
-                             AD_AT_NT_VERSION, ntver);
+    filter = ad_netlogon_filter(state, state->ad_domain);
     if (filter == NULL) {
         ret = ENOMEM;
         goto done;
     }
 
-    subreq = sdap_get_generic_send(state, state->ev, state->opts, state->sh,
-                                   "", LDAP_SCOPE_BASE, filter,
+    subreq = sdap_get_generic_send(state, state->ev, state->ctx->opts,
+                                   state->sh, "", LDAP_SCOPE_BASE, filter,
                                    attrs, NULL, 0,
-                                   dp_opt_get_int(state->opts->basic,
+                                   dp_opt_get_int(state->ctx->opts->basic,
                                                   SDAP_SEARCH_TIMEOUT),
                                    false);
     if (subreq == NULL) {
@@ -487,11 +562,50 @@ done:
     return ret;
 }
 
+static errno_t ad_netlogon_parse_reply(TALLOC_CTX *mem_ctx,
+                                       size_t reply_count,
+                                       struct sysdb_attrs **reply,
+                                       char **_site_name,
+                                       char **_forest_name)
+{
+    struct ldb_message_element *el = NULL;
+    errno_t ret;
+
+    if (reply_count == 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "No netlogon information retrieved\n");
+        return ENOENT;
+    }
+
+    ret = sysdb_attrs_get_el(reply[0], AD_AT_NETLOGON, &el);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "sysdb_attrs_get_el() failed\n");
+        return ret;
+    }
+
+    if (el->num_values == 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "netlogon has no value\n");
+        return ENOENT;
+    } else if (el->num_values > 1) {
+        DEBUG(SSSDBG_OP_FAILURE, "More than one netlogon value?\n");
+        return EIO;
+    }
+
+    ret = ad_get_client_site_parse_ndr(mem_ctx, el->values[0].data,
+                                       el->values[0].length, _site_name,
+                                       _forest_name);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to retrieve site name [%d]: %s\n",
+                                  ret, strerror(ret));
+        return ENOENT;
+    }
+
+    return EOK;
+}
+
 static void ad_get_client_site_done(struct tevent_req *subreq)
 {
     struct ad_get_client_site_state *state = NULL;
     struct tevent_req *req = NULL;
-    struct ldb_message_element *el = NULL;
     struct sysdb_attrs **reply = NULL;
     size_t reply_count;
     errno_t ret;
@@ -514,42 +628,18 @@ static void ad_get_client_site_done(struct tevent_req *subreq)
         goto done;
     }
 
-    if (reply_count == 0) {
-        DEBUG(SSSDBG_OP_FAILURE, "No netlogon information retrieved\n");
-        ret = ENOENT;
-        goto done;
-    }
-
-    ret = sysdb_attrs_get_el(reply[0], AD_AT_NETLOGON, &el);
+    ret = ad_netlogon_parse_reply(state, reply_count, reply, &state->site,
+                                  &state->forest);
     if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "sysdb_attrs_get_el() failed\n");
-        goto done;
-    }
-
-    if (el->num_values == 0) {
-        DEBUG(SSSDBG_OP_FAILURE, "netlogon has no value\n");
-        ret = ENOENT;
-        goto done;
-    } else if (el->num_values > 1) {
-        DEBUG(SSSDBG_OP_FAILURE, "More than one netlogon value?\n");
-        ret = EIO;
-        goto done;
-    }
-
-    ret = ad_get_client_site_parse_ndr(state, el->values[0].data,
-                                       el->values[0].length, &state->site,
-                                       &state->forest);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "Unable to retrieve site name [%d]: %s\n",
-                                  ret, strerror(ret));
-        ret = ENOENT;
         goto done;
     }
 
     DEBUG(SSSDBG_TRACE_FUNC, "Found site: %s\n", state->site);
 
 done:
-    if (ret != EOK) {
+    if (ret == EAGAIN) {
+        return;
+    } else if (ret != EOK) {
         tevent_req_error(req, ret);
         return;
     }
@@ -557,10 +647,10 @@ done:
     tevent_req_done(req);
 }
 
-int ad_get_client_site_recv(TALLOC_CTX *mem_ctx,
-                            struct tevent_req *req,
-                            const char **_site,
-                            const char **_forest)
+static int ad_get_client_site_recv(TALLOC_CTX *mem_ctx,
+                                   struct tevent_req *req,
+                                   const char **_site,
+                                   const char **_forest)
 {
     struct ad_get_client_site_state *state = NULL;
     state = tevent_req_data(req, struct ad_get_client_site_state);
@@ -573,23 +663,16 @@ int ad_get_client_site_recv(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
-struct ad_srv_plugin_ctx {
-    struct be_resolv_ctx *be_res;
-    enum host_database *host_dbs;
-    struct sdap_options *opts;
-    const char *hostname;
-    const char *ad_domain;
-    const char *ad_site_override;
-};
-
 struct ad_srv_plugin_ctx *
 ad_srv_plugin_ctx_init(TALLOC_CTX *mem_ctx,
+                       struct be_ctx *be_ctx,
                        struct be_resolv_ctx *be_res,
                        enum host_database *host_dbs,
                        struct sdap_options *opts,
                        const char *hostname,
                        const char *ad_domain,
-                       const char *ad_site_override)
+                       const char *ad_site_override,
+                       bool ping_dcs)
 {
     struct ad_srv_plugin_ctx *ctx = NULL;
 
@@ -598,6 +681,8 @@ ad_srv_plugin_ctx_init(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
+    ctx->be_ctx = be_ctx;
+    ctx->ping_dcs = ping_dcs;
     ctx->be_res = be_res;
     ctx->host_dbs = host_dbs;
     ctx->opts = opts;
@@ -626,6 +711,295 @@ fail:
     return NULL;
 }
 
+/* Sends a CLDAP netlogon ping to each of the servers in parallel and feeds
+ * the time the servers took to answer into the fail over. A server which
+ * fails or does not answer within AD_SRV_PING_TIMEOUT_MSEC is recorded with
+ * the timeout. With first_answer the request finishes as soon as a server
+ * returns the site of the client, the servers which did not answer yet are
+ * not recorded. */
+
+struct ad_srv_ping {
+    struct ad_srv_ping *prev;
+    struct ad_srv_ping *next;
+
+    struct tevent_req *req;
+    struct fo_server_info *server;
+    struct sdap_handle *sh;
+    struct timeval start;
+};
+
+struct ad_srv_ping_state {
+    struct ad_srv_plugin_ctx *ctx;
+    struct tevent_context *ev;
+    const char *ad_domain;
+    bool first_answer;
+
+    struct ad_srv_ping *pings;
+    struct tevent_timer *timeout;
+
+    char *site;
+    char *forest;
+};
+
+static void ad_srv_ping_connect_done(struct tevent_req *subreq);
+static void ad_srv_ping_done(struct tevent_req *subreq);
+static void ad_srv_ping_timeout(struct tevent_context *ev,
+                                struct tevent_timer *te,
+                                struct timeval tv, void *pvt);
+
+static struct tevent_req *ad_srv_ping_send(TALLOC_CTX *mem_ctx,
+                                           struct tevent_context *ev,
+                                           struct ad_srv_plugin_ctx *ctx,
+                                           const char *ad_domain,
+                                           struct fo_server_info *servers,
+                                           size_t num_servers,
+                                           bool first_answer)
+{
+    struct ad_srv_ping_state *state;
+    struct ad_srv_ping *ping;
+    struct tevent_req *req;
+    struct tevent_req *subreq;
+    size_t i;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct ad_srv_ping_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
+        return NULL;
+    }
+
+    state->ctx = ctx;
+    state->ev = ev;
+    state->ad_domain = ad_domain;
+    state->first_answer = first_answer;
+
+    for (i = 0; i < num_servers && i < AD_SRV_MAX_PINGS; i++) {
+        ping = talloc_zero(state, struct ad_srv_ping);
+        if (ping == NULL) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+
+        ping->req = req;
+        ping->server = &servers[i];
+        ping->start = tevent_timeval_current();
+
+        /* the SRV records name the TCP port, CLDAP always uses 389 */
+        subreq = sdap_connect_host_send(ping, ev, ctx->opts,
+                                        ctx->be_res->resolv,
+                                        ctx->be_res->family_order,
+                                        ctx->host_dbs, "cldap",
+                                        servers[i].host, AD_CLDAP_PORT,
+                                        false);
+        if (subreq == NULL) {
+            talloc_free(ping);
+            ret = ENOMEM;
+            goto immediately;
+        }
+
+        tevent_req_set_callback(subreq, ad_srv_ping_connect_done, ping);
+        DLIST_ADD(state->pings, ping);
+    }
+
+    if (state->pings == NULL) {
+        ret = EOK;
+        goto immediately;
+    }
+
+    state->timeout = tevent_add_timer(ev, state,
+                        tevent_timeval_current_ofs(0,
+                                        AD_SRV_PING_TIMEOUT_MSEC * 1000),
+                        ad_srv_ping_timeout, req);
+    if (state->timeout == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    return req;
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+
+    return req;
+}
+
+static void ad_srv_ping_record(struct ad_srv_ping_state *state,
+                               struct ad_srv_ping *ping,
+                               uint32_t rtt_usec)
+{
+    errno_t ret;
+
+    ret = be_fo_record_server_rtt(state->ctx->be_ctx, ping->server->host,
+                                  rtt_usec);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to record the round trip time of [%s] [%d]: %s\n",
+              ping->server->host, ret, sss_strerror(ret));
+    }
+
+    DLIST_REMOVE(state->pings, ping);
+    talloc_free(ping);
+}
+
+/* With last set, the pings which are still pending are dropped */
+static void ad_srv_ping_finish(struct ad_srv_ping *ping, uint32_t rtt_usec,
+                               bool last)
+{
+    struct tevent_req *req = ping->req;
+    struct ad_srv_ping_state *state;
+    struct ad_srv_ping *pending;
+
+    state = tevent_req_data(req, struct ad_srv_ping_state);
+
+    ad_srv_ping_record(state, ping, rtt_usec);
+
+    while (last && (pending = state->pings) != NULL) {
+        DLIST_REMOVE(state->pings, pending);
+        talloc_free(pending);
+    }
+
+    if (state->pings == NULL) {
+        talloc_zfree(state->timeout);
+        tevent_req_done(req);
+    }
+}
+
+static void ad_srv_ping_connect_done(struct tevent_req *subreq)
+{
+    static const char *attrs[] = {AD_AT_NETLOGON, NULL};
+    struct ad_srv_ping_state *state;
+    struct ad_srv_ping *ping;
+    char *filter;
+    errno_t ret;
+
+    ping = tevent_req_callback_data(subreq, struct ad_srv_ping);
+    state = tevent_req_data(ping->req, struct ad_srv_ping_state);
+
+    ret = sdap_connect_host_recv(ping, subreq, &ping->sh);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to send a CLDAP ping to domain "
+              "controller [%s]\n", ping->server->host);
+        ad_srv_ping_finish(ping, AD_SRV_PING_TIMEOUT_MSEC * 1000, false);
+        return;
+    }
+
+    filter = ad_netlogon_filter(ping, state->ad_domain);
+    if (filter == NULL) {
+        ad_srv_ping_finish(ping, AD_SRV_PING_TIMEOUT_MSEC * 1000, false);
+        return;
+    }
+
+    /* only the request itself is timed, the name resolution says nothing
+     * about the load of the server */
+    ping->start = tevent_timeval_current();
+
+    subreq = sdap_get_generic_send(ping, state->ev, state->ctx->opts,
+                                   ping->sh, "", LDAP_SCOPE_BASE, filter,
+                                   attrs, NULL, 0,
+                                   dp_opt_get_int(state->ctx->opts->basic,
+                                                  SDAP_SEARCH_TIMEOUT),
+                                   false);
+    if (subreq == NULL) {
+        ad_srv_ping_finish(ping, AD_SRV_PING_TIMEOUT_MSEC * 1000, false);
+        return;
+    }
+
+    tevent_req_set_callback(subreq, ad_srv_ping_done, ping);
+}
+
+static void ad_srv_ping_done(struct tevent_req *subreq)
+{
+    struct ad_srv_ping_state *state;
+    struct ad_srv_ping *ping;
+    struct sysdb_attrs **reply = NULL;
+    size_t reply_count;
+    struct timeval now;
+    uint64_t rtt_usec;
+    errno_t ret;
+
+    ping = tevent_req_callback_data(subreq, struct ad_srv_ping);
+    state = tevent_req_data(ping->req, struct ad_srv_ping_state);
+
+    ret = sdap_get_generic_recv(subreq, ping, &reply_count, &reply);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "CLDAP ping to [%s] failed [%d]: %s\n",
+              ping->server->host, ret, sss_strerror(ret));
+        ad_srv_ping_finish(ping, AD_SRV_PING_TIMEOUT_MSEC * 1000, false);
+        return;
+    }
+
+    now = tevent_timeval_current();
+    rtt_usec = (now.tv_sec - ping->start.tv_sec) * 1000000
+                    + now.tv_usec - ping->start.tv_usec;
+    rtt_usec = MIN(rtt_usec, AD_SRV_PING_TIMEOUT_MSEC * 1000);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Domain controller [%s] answered in %"PRIu64" us\n",
+          ping->server->host, rtt_usec);
+
+    if (state->first_answer) {
+        ret = ad_netlogon_parse_reply(state, reply_count, reply,
+                                      &state->site, &state->forest);
+        if (ret == EOK) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Found site: %s\n", state->site);
+            ad_srv_ping_finish(ping, rtt_usec, true);
+            return;
+        }
+    }
+
+    ad_srv_ping_finish(ping, rtt_usec, false);
+}
+
+static void ad_srv_ping_timeout(struct tevent_context *ev,
+                                struct tevent_timer *te,
+                                struct timeval tv, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct ad_srv_ping_state *state;
+
+    state = tevent_req_data(req, struct ad_srv_ping_state);
+    state->timeout = NULL;
+
+    while (state->pings != NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Domain controller [%s] did not answer the CLDAP ping in time\n",
+              state->pings->server->host);
+        ad_srv_ping_record(state, state->pings,
+                           AD_SRV_PING_TIMEOUT_MSEC * 1000);
+    }
+
+    tevent_req_done(req);
+}
+
+/* Returns ENOENT if _site is requested and no server returned it */
+static errno_t ad_srv_ping_recv(TALLOC_CTX *mem_ctx,
+                                struct tevent_req *req,
+                                char **_site,
+                                char **_forest)
+{
+    struct ad_srv_ping_state *state;
+    state = tevent_req_data(req, struct ad_srv_ping_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    if (_site != NULL) {
+        if (state->site == NULL) {
+            return ENOENT;
+        }
+
+        *_site = talloc_steal(mem_ctx, state->site);
+        *_forest = talloc_steal(mem_ctx, state->forest);
+    }
+
+    return EOK;
+}
+
 struct ad_srv_plugin_state {
     struct tevent_context *ev;
     struct ad_srv_plugin_ctx *ctx;
@@ -646,6 +1020,7 @@ struct ad_srv_plugin_state {
 static void ad_srv_plugin_dcs_done(struct tevent_req *subreq);
 static void ad_srv_plugin_site_done(struct tevent_req *subreq);
 static void ad_srv_plugin_servers_done(struct tevent_req *subreq);
+static void ad_srv_plugin_ping_done(struct tevent_req *subreq);
 
 /* 1. Do a DNS lookup to find any DC in domain
  *    _ldap._tcp.domain.name
@@ -656,6 +1031,8 @@ static void ad_srv_plugin_servers_done(struct tevent_req *subreq);
  *    _service._protocol.domain.name
  * 5. If the site is found, use (a) as primary and (b) as backup servers,
  *    otherwise use (b) as primary servers
+ * 6. If enabled, send a CLDAP ping to the primary servers, the fail over
+ *    orders the servers with the same priority by their answer times
  */
 struct tevent_req *ad_srv_plugin_send(TALLOC_CTX *mem_ctx,
                                        struct tevent_context *ev,
@@ -748,10 +1125,7 @@ static void ad_srv_plugin_dcs_done(struct tevent_req *subreq)
 
     DEBUG(SSSDBG_TRACE_FUNC, "About to locate suitable site\n");
 
-    subreq = ad_get_client_site_send(state, state->ev,
-                                     state->ctx->be_res,
-                                     state->ctx->host_dbs,
-                                     state->ctx->opts,
+    subreq = ad_get_client_site_send(state, state->ev, state->ctx,
                                      state->discovery_domain,
                                      dcs, num_dcs);
     if (subreq == NULL) {
@@ -898,6 +1272,41 @@ static void ad_srv_plugin_servers_done(struct tevent_req *subreq)
         /* continue */
     }
 
+    if (!state->ctx->ping_dcs || state->num_primary_servers <= 1) {
+        tevent_req_done(req);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "About to ping the primary servers\n");
+
+    subreq = ad_srv_ping_send(state, state->ev, state->ctx,
+                              state->discovery_domain,
+                              state->primary_servers,
+                              state->num_primary_servers, false);
+    if (subreq == NULL) {
+        /* the servers are just not ordered by their answer times */
+        tevent_req_done(req);
+        return;
+    }
+
+    tevent_req_set_callback(subreq, ad_srv_plugin_ping_done, req);
+}
+
+static void ad_srv_plugin_ping_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+
+    ret = ad_srv_ping_recv(NULL, subreq, NULL, NULL);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to ping the primary servers "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        /* continue */
+    }
+
     tevent_req_done(req);
 }
 
@@ -23,14 +23,18 @@
 
 struct ad_srv_plugin_ctx;
 
+/* If ping_dcs is set, the round trip times of the primary servers found by
+ * every SRV lookup are measured and fed into the fail over of be_ctx. */
 struct ad_srv_plugin_ctx *
 ad_srv_plugin_ctx_init(TALLOC_CTX *mem_ctx,
+                       struct be_ctx *be_ctx,
                        struct be_resolv_ctx *be_res,
                        enum host_database *host_dbs,
                        struct sdap_options *opts,
                        const char *hostname,
                        const char *ad_domain,
-                       const char *ad_site_override);
+                       const char *ad_site_override,
+                       bool ping_dcs);
 
 struct tevent_req *ad_srv_plugin_send(TALLOC_CTX *mem_ctx,
                                        struct tevent_context *ev,
@@ -67,6 +67,7 @@ struct ad_subdomains_ctx {
     time_t last_refreshed;
     struct tevent_timer *timer_event;
     struct ad_id_ctx *ad_id_ctx;
+    struct be_ptask *idle_task;
 };
 
 struct ad_subdomains_req_ctx {
@@ -151,12 +152,14 @@ ad_subdom_ad_ctx_new(struct be_ctx *be_ctx,
     ad_options->id_ctx = ad_id_ctx;
 
     /* use AD plugin */
-    srv_ctx = ad_srv_plugin_ctx_init(be_ctx, be_ctx->be_res,
+    srv_ctx = ad_srv_plugin_ctx_init(be_ctx, be_ctx, be_ctx->be_res,
                                      default_host_dbs,
                                      ad_id_ctx->ad_options->id,
                                      hostname,
                                      ad_domain,
-                                     ad_site_override);
+                                     ad_site_override,
+                                     dp_opt_get_bool(id_ctx->ad_options->basic,
+                                                     AD_DC_LATENCY_PING));
     if (srv_ctx == NULL) {
         DEBUG(SSSDBG_FATAL_FAILURE, "Out of memory?\n");
         return ENOMEM;
@@ -190,13 +193,84 @@ ad_subdom_ad_ctx_new(struct be_ctx *be_ctx,
     return EOK;
 }
 
+/* The ID context of a subdomain, with its fail over service and connection
+ * caches, is only created by the first lookup which needs it */
+static errno_t ad_subdom_id_ctx_get(void *pvt, struct sdap_domain *sdom)
+{
+    struct ad_subdomains_ctx *ctx;
+    struct ad_id_ctx *subdom_id_ctx;
+    errno_t ret;
+
+    ctx = talloc_get_type(pvt, struct ad_subdomains_ctx);
+
+    if (sdom->pvt == NULL) {
+        ret = ad_subdom_ad_ctx_new(ctx->be_ctx, ctx->ad_id_ctx,
+                                   sdom->dom, &subdom_id_ctx);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "ad_subdom_ad_ctx_new failed.\n");
+            return ret;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Created the ID context of subdomain [%s]\n", sdom->dom->name);
+        sdom->pvt = subdom_id_ctx;
+    }
+
+    subdom_id_ctx = talloc_get_type(sdom->pvt, struct ad_id_ctx);
+    subdom_id_ctx->last_used = time(NULL);
+
+    return EOK;
+}
+
+static errno_t ad_subdom_idle_task(TALLOC_CTX *mem_ctx,
+                                   struct tevent_context *ev,
+                                   struct be_ctx *be_ctx,
+                                   struct be_ptask *be_ptask,
+                                   void *pvt)
+{
+    struct ad_subdomains_ctx *ctx;
+    struct ad_id_ctx *subdom_id_ctx;
+    struct sdap_domain *sditer;
+    struct sdap_id_conn_ctx *conn;
+    time_t timeout;
+    time_t now;
+    int released;
+
+    ctx = talloc_get_type(pvt, struct ad_subdomains_ctx);
+    timeout = dp_opt_get_int(ctx->ad_id_ctx->ad_options->basic,
+                             AD_SUBDOMAIN_IDLE_TIMEOUT);
+    now = time(NULL);
+
+    DLIST_FOR_EACH(sditer, ctx->sdom) {
+        if (!IS_SUBDOMAIN(sditer->dom) || sditer->pvt == NULL) {
+            continue;
+        }
+
+        subdom_id_ctx = talloc_get_type(sditer->pvt, struct ad_id_ctx);
+        if (subdom_id_ctx->last_used + timeout > now) {
+            continue;
+        }
+
+        released = 0;
+        DLIST_FOR_EACH(conn, subdom_id_ctx->sdap_id_ctx->conn) {
+            released += sdap_id_conn_cache_release(conn->conn_cache);
+        }
+
+        if (released > 0) {
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "Closing %d idle connections of subdomain [%s]\n",
+                  released, sditer->dom->name);
+        }
+    }
+
+    return EOK;
+}
+
 static errno_t
 ads_store_sdap_subdom(struct ad_subdomains_ctx *ctx,
                       struct sss_domain_info *parent)
 {
     int ret;
-    struct sdap_domain *sditer;
-    struct ad_id_ctx *subdom_id_ctx;
 
     ret = sdap_domain_subdom_add(ctx->sdap_id_ctx, ctx->sdom, parent);
     if (ret != EOK) {
@@ -204,18 +278,6 @@ ads_store_sdap_subdom(struct ad_subdomains_ctx *ctx,
         return ret;
     }
 
-    DLIST_FOR_EACH(sditer, ctx->sdom) {
-        if (IS_SUBDOMAIN(sditer->dom) && sditer->pvt == NULL) {
-            ret = ad_subdom_ad_ctx_new(ctx->be_ctx, ctx->ad_id_ctx,
-                                       sditer->dom, &subdom_id_ctx);
-            if (ret != EOK) {
-                DEBUG(SSSDBG_OP_FAILURE, "ad_subdom_ad_ctx_new failed.\n");
-            } else {
-                sditer->pvt = subdom_id_ctx;
-            }
-        }
-    }
-
     return EOK;
 }
 
@@ -834,7 +896,6 @@ static struct sss_domain_info *ads_get_root_domain(struct ad_subdomains_req_ctx
 
 static struct ad_id_ctx *ads_get_root_id_ctx(struct ad_subdomains_req_ctx *ctx)
 {
-    errno_t ret;
     struct sdap_domain *sdom;
     struct ad_id_ctx *root_id_ctx;
 
@@ -846,19 +907,9 @@ static struct ad_id_ctx *ads_get_root_id_ctx(struct ad_subdomains_req_ctx *ctx)
         return NULL;
     }
 
-    if (sdom->pvt == NULL) {
-        ret = ad_subdom_ad_ctx_new(ctx->sd_ctx->be_ctx,
-                                   ctx->sd_ctx->ad_id_ctx,
-                                   ctx->root_domain,
-                                   &root_id_ctx);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE, "ad_subdom_ad_ctx_new failed.\n");
-            return NULL;
-        }
-
-        sdom->pvt = root_id_ctx;
-    } else {
-        root_id_ctx = sdom->pvt;
+    root_id_ctx = ad_get_sdom_id_ctx(ctx->sd_ctx->ad_id_ctx, sdom);
+    if (root_id_ctx == NULL) {
+        return NULL;
     }
 
     root_id_ctx->ldap_ctx->ignore_mark_offline = true;
@@ -1181,6 +1232,7 @@ int ad_subdom_init(struct be_ctx *be_ctx,
                    void **pvt_data)
 {
     struct ad_subdomains_ctx *ctx;
+    time_t idle_timeout;
     int ret;
     enum idmap_error_code err;
 
@@ -1203,6 +1255,25 @@ int ad_subdom_init(struct be_ctx *be_ctx,
     *ops = &ad_subdomains_ops;
     *pvt_data = ctx;
 
+    id_ctx->subdom_id_ctx_fn = ad_subdom_id_ctx_get;
+    id_ctx->subdom_id_ctx_pvt = ctx;
+
+    idle_timeout = dp_opt_get_int(id_ctx->ad_options->basic,
+                                  AD_SUBDOMAIN_IDLE_TIMEOUT);
+    if (idle_timeout > 0) {
+        ret = be_ptask_create_sync(ctx, be_ctx, idle_timeout, idle_timeout,
+                                   idle_timeout, 0, idle_timeout,
+                                   BE_PTASK_OFFLINE_SKIP, 0,
+                                   ad_subdom_idle_task, ctx,
+                                   "Close idle subdomain connections",
+                                   &ctx->idle_task);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Unable to set up the idle subdomain task, the connections "
+                  "to trusted domains will be kept open\n");
+        }
+    }
+
     ret = be_add_online_cb(ctx, be_ctx, ad_subdom_online_cb, ctx, NULL);
     if (ret != EOK) {
         DEBUG(SSSDBG_MINOR_FAILURE, "Failed to add subdom online callback\n");
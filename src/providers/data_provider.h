@@ -48,6 +48,7 @@
 
 #define DATA_PROVIDER_VERSION 0x0001
 #define DATA_PROVIDER_PIPE "private/sbus-dp"
+#define DATA_PROVIDER_FAST_PIPE "private/fast-dp"
 
 #define DP_PATH "/org/freedesktop/sssd/dataprovider"
 
@@ -234,6 +235,47 @@ void dp_id_callback(DBusPendingCall *pending, void *ptr);
 int dp_get_sbus_address(TALLOC_CTX *mem_ctx,
                         char **address, const char *domain_name);
 
+/**
+ * A getAccountInfoMulti request carries up to DP_ACCT_MULTI_MAX lookups of
+ * the same entry type, the back end runs them concurrently:
+ *
+ * @param DBUS_TYPE_UINT32 Entry type, as for getAccountInfo
+ * @param DBUS_TYPE_UINT32 Attribute type, as for getAccountInfo
+ * @param DBUS_TYPE_ARRAY__(STRING) The filters of the lookups
+ * @param DBUS_TYPE_STRING Domain
+ *
+ * The reply is the one of getAccountInfo. DP_ERR_OK means that all
+ * lookups succeeded, otherwise it is the reply of a failed lookup.
+ */
+#define DP_ACCT_MULTI_MAX 256
+
+/**
+ * The getAccountInfo requests may also be sent to the back end over a
+ * plain unix socket which avoids the D-Bus marshalling, see dp_fast.c.
+ * Every frame starts with the length of the rest of the frame. All
+ * numbers are uint32_t in host byte order, the strings are prefixed with
+ * their length and are not terminated.
+ *
+ * request: length, id, entry type, attribute type, filter, domain,
+ *          request id
+ * reply:   length, id, DP error, errno, error message
+ *
+ * The back end answers the requests with their id, not necessarily in the
+ * order they were sent. A request with the BE_REQ_FAST flag may be
+ * answered before it is finished, its later reply has no id and is never
+ * sent.
+ */
+#define DP_FAST_MAX_FRAME (64 * 1024)
+
+/* The getAccountInfo requests of the responders carry the id of the
+ * client request which needs the lookup as an optional last argument,
+ * DBUS_TYPE_UINT32, or in the last field of the frame. The back end logs
+ * it with its own messages about the request, 0 means that there is no
+ * client request. */
+
+int dp_get_fast_address(TALLOC_CTX *mem_ctx,
+                        char **address, const char *domain_name);
+
 
 /* Helpers */
 
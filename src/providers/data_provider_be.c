@@ -27,6 +27,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <string.h>
+#include <ctype.h>
 #include <sys/time.h>
 #include <errno.h>
 #include <dlfcn.h>
@@ -48,6 +49,7 @@
 #include "util/child_common.h"
 #include "resolv/async_resolv.h"
 #include "monitor/monitor_interfaces.h"
+#include "util/probes.h"
 
 #define MSG_TARGET_NO_CONFIGURED "sssd_be: The requested target is not configured"
 
@@ -71,15 +73,24 @@ struct mon_cli_iface monitor_be_methods = {
     .clearMemcache = NULL,
     .clearEnumCache = NULL,
     .sysbusReconnect = NULL,
+    .memReport = monitor_common_mem_report,
+    .startupTimes = monitor_common_startup_times,
 };
 
 static int client_registration(struct sbus_request *dbus_req, void *data);
 static int be_get_account_info(struct sbus_request *dbus_req, void *user_data);
+static int be_get_account_info_multi(struct sbus_request *dbus_req,
+                                     void *user_data);
 static int be_pam_handler(struct sbus_request *dbus_req, void *user_data);
 static int be_sudo_handler(struct sbus_request *dbus_req, void *user_data);
 static int be_autofs_handler(struct sbus_request *dbus_req, void *user_data);
 static int be_host_handler(struct sbus_request *dbus_req, void *user_data);
 static int be_get_subdomains(struct sbus_request *dbus_req, void *user_data);
+static int be_get_task_stats(struct sbus_request *dbus_req, void *user_data);
+static int be_get_resolver_stats(struct sbus_request *dbus_req,
+                                 void *user_data);
+static int be_get_cache_metrics(struct sbus_request *dbus_req,
+                                void *user_data);
 
 struct data_provider_iface be_methods = {
     { &data_provider_iface_meta, 0 },
@@ -90,6 +101,10 @@ struct data_provider_iface be_methods = {
     .hostHandler = be_host_handler,
     .getDomains = be_get_subdomains,
     .getAccountInfo = be_get_account_info,
+    .getAccountInfoMulti = be_get_account_info_multi,
+    .getTaskStats = be_get_task_stats,
+    .getResolverStats = be_get_resolver_stats,
+    .getCacheMetrics = be_get_cache_metrics,
 };
 
 static struct bet_data bet_data[] = {
@@ -159,6 +174,17 @@ static const char *safe_be_req_err_msg(const char *msg_in,
 #define REQ_PHASE_ACCESS 0
 #define REQ_PHASE_SELINUX 1
 
+/* The classes of the back end requests, in the order they are started */
+enum be_req_prio {
+    BE_REQ_PRIO_AUTH,
+    BE_REQ_PRIO_ACCESS,
+    BE_REQ_PRIO_LOOKUP,
+    BE_REQ_PRIO_INITGR,
+    BE_REQ_PRIO_BULK,
+
+    BE_REQ_PRIO_MAX
+};
+
 struct be_req {
     struct be_client *becli;
     struct be_ctx *be_ctx;
@@ -176,6 +202,21 @@ struct be_req {
 
     /* Just for nicer debugging */
     const char *req_name;
+    /* the type in the metrics, req_name if NULL */
+    const char *stats_type;
+
+    /* The class the request is dispatched in and its dispatcher entry */
+    enum be_req_prio prio;
+    struct be_async_req *areq;
+
+    /* The id in the logs, the one of the client request if there is one,
+     * and the stages of a slow request, see be_req_log_slow() */
+    uint32_t id;
+    struct timeval created;
+    struct timeval dispatched;
+    uint64_t ldap_usec;
+    unsigned int ldap_ops;
+    unsigned int children;
 
     struct be_req *prev;
     struct be_req *next;
@@ -188,6 +229,26 @@ static int be_req_destructor(struct be_req *be_req)
     return 0;
 }
 
+/* The provider requests and the entries they parse are allocated below the
+ * be_req. Most of them are freed before the request terminates when its
+ * usage is measured, hence the larger minimum than in the responders. */
+#define BE_REQ_POOL_MIN_SIZE (16 * 1024)
+#define BE_REQ_POOL_MAX_SIZE (256 * 1024)
+
+static uint32_t be_next_req_id(struct be_ctx *be_ctx)
+{
+    /* seeded like the ids of the responders, see sss_cmd_execute() */
+    if (be_ctx->last_req_id == 0) {
+        be_ctx->last_req_id = (uint32_t) getpid() << 16;
+    }
+    be_ctx->last_req_id++;
+    if (be_ctx->last_req_id == 0) {
+        be_ctx->last_req_id++;
+    }
+
+    return be_ctx->last_req_id;
+}
+
 struct be_req *be_req_create(TALLOC_CTX *mem_ctx,
                              struct be_client *becli,
                              struct be_ctx *be_ctx,
@@ -197,14 +258,20 @@ struct be_req *be_req_create(TALLOC_CTX *mem_ctx,
 {
     struct be_req *be_req;
 
-    be_req = talloc_zero(mem_ctx, struct be_req);
+    /* freeing the request releases all its allocations at once */
+    be_req = talloc_pooled_object(mem_ctx, struct be_req, 0,
+                                  be_ctx->req_pool.size);
     if (be_req == NULL) return NULL;
+    memset(be_req, 0, sizeof(struct be_req));
 
     be_req->becli = becli;
     be_req->be_ctx = be_ctx;
     be_req->domain = be_ctx->domain;
     be_req->fn = fn;
     be_req->pvt = pvt_fn_data;
+    be_req->prio = BE_REQ_PRIO_LOOKUP;
+    be_req->id = be_next_req_id(be_ctx);
+    be_req->created = tevent_timeval_current();
     be_req->req_name = talloc_strdup(be_req, name);
     if (be_req->req_name == NULL) {
         talloc_free(be_req);
@@ -246,10 +313,174 @@ void *be_req_get_data(struct be_req *be_req)
     return be_req->req_data;
 }
 
+struct be_req *be_req_find(TALLOC_CTX *mem_ctx)
+{
+    if (mem_ctx == NULL) {
+        return NULL;
+    }
+
+    return talloc_find_parent_bytype(mem_ctx, struct be_req);
+}
+
+uint32_t be_req_get_id(struct be_req *be_req)
+{
+    return be_req == NULL ? 0 : be_req->id;
+}
+
+void be_req_add_ldap_op(struct be_req *be_req, uint64_t usec)
+{
+    if (be_req == NULL) {
+        return;
+    }
+
+    be_req->ldap_ops++;
+    be_req->ldap_usec += usec;
+}
+
+static void be_req_child_spawned(TALLOC_CTX *mem_ctx,
+                                 const char *binary, pid_t pid)
+{
+    struct be_req *be_req;
+
+    be_req = be_req_find(mem_ctx);
+    if (be_req == NULL) {
+        return;
+    }
+
+    be_req->children++;
+    DEBUG(SSSDBG_TRACE_FUNC, "[RID#%u] Request [%s] started %s as [%d]\n",
+          be_req->id, be_req->req_name, binary, pid);
+}
+
+static uint64_t be_usec_between(struct timeval *from, struct timeval *to)
+{
+    struct timeval elapsed;
+
+    if (tevent_timeval_is_zero(from) || tevent_timeval_compare(from, to) > 0) {
+        return 0;
+    }
+
+    elapsed = tevent_timeval_until(from, to);
+    return (uint64_t) elapsed.tv_sec * 1000000 + elapsed.tv_usec;
+}
+
+/* The latency of a slow request is split into the time it waited for the
+ * dispatcher and the time the provider worked on it, of which the LDAP
+ * operations took the given sum. The operations may run in parallel. */
+static void be_req_log_slow(struct be_req *be_req,
+                            int dp_err_type, int errnum)
+{
+    struct be_ctx *be_ctx = be_req->be_ctx;
+    struct timeval now;
+    uint64_t total;
+    uint64_t queued;
+
+    if (be_ctx->slow_request_threshold <= 0) {
+        return;
+    }
+
+    now = tevent_timeval_current();
+    total = be_usec_between(&be_req->created, &now);
+    if (total < (uint64_t) be_ctx->slow_request_threshold * 1000) {
+        return;
+    }
+
+    queued = be_usec_between(&be_req->created, &be_req->dispatched);
+
+    DEBUG(SSSDBG_IMPORTANT_INFO,
+          "[RID#%u] Slow request [%s] took %"PRIu64" ms: "
+          "queued %"PRIu64" ms, provider %"PRIu64" ms, "
+          "%u LDAP operations %"PRIu64" ms, %u children, "
+          "result [%d][%d]\n",
+          be_req->id, be_req->req_name, total / 1000, queued / 1000,
+          (total - queued) / 1000, be_req->ldap_ops,
+          be_req->ldap_usec / 1000, be_req->children, dp_err_type, errnum);
+}
+
+struct be_ctx *be_ctx_find(TALLOC_CTX *mem_ctx)
+{
+    if (mem_ctx == NULL) {
+        return NULL;
+    }
+
+    return talloc_find_parent_bytype(mem_ctx, struct be_ctx);
+}
+
+/* The names in the metrics are lowercase, e.g. the type of the "PAM" requests
+ * is "pam" and of the BE_REQ_USER requests "user" */
+static void be_stats_label(const char *name, char *buf, size_t size)
+{
+    size_t i;
+
+    if (strncmp(name, "BE_REQ_", 7) == 0) {
+        name += 7;
+    }
+
+    for (i = 0; name[i] != '\0' && i < size - 1; i++) {
+        buf[i] = isalnum((unsigned char)name[i])
+                     ? tolower((unsigned char)name[i]) : '_';
+    }
+    buf[i] = '\0';
+}
+
+static void be_req_stats_add(struct be_req *be_req, int dp_err_type)
+{
+    struct be_ctx *be_ctx = be_req->be_ctx;
+    struct be_req_stats *stats = NULL;
+    struct timeval now;
+    char type[64];
+    uint64_t usec;
+    size_t i;
+
+    be_stats_label(be_req->stats_type != NULL ? be_req->stats_type
+                                                 : be_req->req_name,
+                      type, sizeof(type));
+
+    for (i = 0; i < be_ctx->num_req_stats; i++) {
+        if (strcmp(be_ctx->req_stats[i].type, type) == 0) {
+            stats = &be_ctx->req_stats[i];
+            break;
+        }
+    }
+
+    if (stats == NULL) {
+        stats = talloc_realloc(be_ctx, be_ctx->req_stats, struct be_req_stats,
+                               be_ctx->num_req_stats + 1);
+        if (stats == NULL) {
+            return;
+        }
+        be_ctx->req_stats = stats;
+
+        stats = &be_ctx->req_stats[be_ctx->num_req_stats];
+        memset(stats, 0, sizeof(struct be_req_stats));
+        stats->type = talloc_strdup(be_ctx->req_stats, type);
+        if (stats->type == NULL) {
+            return;
+        }
+        be_ctx->num_req_stats++;
+    }
+
+    now = tevent_timeval_current();
+    usec = be_usec_between(&be_req->created, &now);
+
+    stats->count++;
+    if (dp_err_type != DP_ERR_OK) {
+        stats->failures++;
+    }
+    stats->total_usec += usec;
+    if (usec > stats->max_usec) {
+        stats->max_usec = usec;
+    }
+}
+
 void be_req_terminate(struct be_req *be_req,
                       int dp_err_type, int errnum, const char *errstr)
 {
     if (be_req->fn == NULL) return;
+    PROBE(DP_REQ_DONE, be_req, be_req->req_name, dp_err_type, errnum);
+    be_req_log_slow(be_req, dp_err_type, errnum);
+    be_req_stats_add(be_req, dp_err_type);
+    sss_pool_size_update(&be_req->be_ctx->req_pool, be_req);
     be_req->fn(be_req, dp_err_type, errnum, errstr);
 }
 
@@ -403,20 +634,153 @@ void be_terminate_domain_requests(struct be_ctx *be_ctx,
     }
 }
 
+/* The requests are dispatched by their class, a class with a lower value is
+ * started first. Each class may only run a limited number of requests at
+ * the same time, so that a flood of enumerations or initgroups requests
+ * does not delay the authentication and the lookups a user waits for. */
+static const struct {
+    const char *name;
+    size_t limit;
+} be_req_prio_classes[BE_REQ_PRIO_MAX] = {
+    [BE_REQ_PRIO_AUTH]   = { "auth",       32 },
+    [BE_REQ_PRIO_ACCESS] = { "access",     32 },
+    [BE_REQ_PRIO_LOOKUP] = { "lookup",     32 },
+    [BE_REQ_PRIO_INITGR] = { "initgroups", 8 },
+    [BE_REQ_PRIO_BULK]   = { "bulk",       2 },
+};
+
+struct be_dispatch;
+
 struct be_async_req {
+    struct be_async_req *prev;
+    struct be_async_req *next;
+
+    /* NULL if the dispatcher was freed first */
+    struct be_dispatch *dispatch;
+    enum be_req_prio prio;
+    bool running;
+
     be_req_fn_t fn;
     struct be_req *req;
 };
 
-static void be_async_req_handler(struct tevent_context *ev,
-                                 struct tevent_timer *te,
-                                 struct timeval tv, void *pvt)
+struct be_dispatch {
+    struct be_ctx *be_ctx;
+    struct tevent_timer *te;
+
+    struct be_async_req *queued[BE_REQ_PRIO_MAX];
+    struct be_async_req *running[BE_REQ_PRIO_MAX];
+    size_t num_running[BE_REQ_PRIO_MAX];
+};
+
+static void be_dispatch_handler(struct tevent_context *ev,
+                                struct tevent_timer *te,
+                                struct timeval tv, void *pvt)
+{
+    struct be_dispatch *dispatch = talloc_get_type(pvt, struct be_dispatch);
+    struct be_async_req *async_req;
+    size_t limit;
+    int prio;
+
+    dispatch->te = NULL;
+
+    for (prio = 0; prio < BE_REQ_PRIO_MAX; prio++) {
+        limit = be_req_prio_classes[prio].limit;
+
+        while (dispatch->queued[prio] != NULL
+                && dispatch->num_running[prio] < limit) {
+            async_req = dispatch->queued[prio];
+            DLIST_REMOVE(dispatch->queued[prio], async_req);
+            DLIST_ADD(dispatch->running[prio], async_req);
+            dispatch->num_running[prio]++;
+            async_req->running = true;
+            if (tevent_timeval_is_zero(&async_req->req->dispatched)) {
+                async_req->req->dispatched = tevent_timeval_current();
+            }
+            PROBE(DP_REQ_DISPATCH, async_req->req, async_req->req->req_name,
+                  prio);
+
+            /* the request may be finished and freed right away */
+            async_req->fn(async_req->req);
+        }
+
+        if (dispatch->queued[prio] != NULL) {
+            DEBUG(SSSDBG_TRACE_INTERNAL,
+                  "Requests of class [%s] are waiting, %zu are running\n",
+                  be_req_prio_classes[prio].name,
+                  dispatch->num_running[prio]);
+        }
+    }
+}
+
+static errno_t be_dispatch_schedule(struct be_dispatch *dispatch)
+{
+    if (dispatch->te != NULL) {
+        return EOK;
+    }
+
+    /* fire immediately */
+    dispatch->te = tevent_add_timer(dispatch->be_ctx->ev, dispatch,
+                                    tevent_timeval_zero(),
+                                    be_dispatch_handler, dispatch);
+    if (dispatch->te == NULL) {
+        return EIO;
+    }
+
+    return EOK;
+}
+
+static int be_dispatch_destructor(struct be_dispatch *dispatch)
 {
     struct be_async_req *async_req;
+    int prio;
+
+    for (prio = 0; prio < BE_REQ_PRIO_MAX; prio++) {
+        DLIST_FOR_EACH(async_req, dispatch->queued[prio]) {
+            async_req->dispatch = NULL;
+        }
+        DLIST_FOR_EACH(async_req, dispatch->running[prio]) {
+            async_req->dispatch = NULL;
+        }
+    }
+
+    if (dispatch->be_ctx->dispatch == dispatch) {
+        dispatch->be_ctx->dispatch = NULL;
+    }
+
+    return 0;
+}
+
+static int be_async_req_destructor(struct be_async_req *async_req)
+{
+    struct be_dispatch *dispatch = async_req->dispatch;
+    errno_t ret;
+
+    if (async_req->req->areq == async_req) {
+        async_req->req->areq = NULL;
+    }
+
+    if (dispatch == NULL) {
+        return 0;
+    }
+
+    if (!async_req->running) {
+        DLIST_REMOVE(dispatch->queued[async_req->prio], async_req);
+        return 0;
+    }
 
-    async_req = talloc_get_type(pvt, struct be_async_req);
+    DLIST_REMOVE(dispatch->running[async_req->prio], async_req);
+    dispatch->num_running[async_req->prio]--;
 
-    async_req->fn(async_req->req);
+    if (dispatch->queued[async_req->prio] != NULL) {
+        ret = be_dispatch_schedule(dispatch);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Cannot schedule the waiting requests\n");
+        }
+    }
+
+    return 0;
 }
 
 struct be_spy {
@@ -504,29 +868,47 @@ static errno_t be_file_request(TALLOC_CTX *mem_ctx,
 {
     errno_t ret;
     struct be_async_req *areq;
-    struct tevent_timer *te;
-    struct timeval tv;
+    struct be_dispatch *dispatch;
+    struct be_ctx *be_ctx;
 
     if (!fn || !be_req) return EINVAL;
 
+    be_ctx = be_req->be_ctx;
+
     ret = be_spy_create(mem_ctx, be_req);
     if (ret != EOK) return ret;
 
-    areq = talloc(be_req, struct be_async_req);
+    if (be_ctx->dispatch == NULL) {
+        dispatch = talloc_zero(be_ctx, struct be_dispatch);
+        if (dispatch == NULL) {
+            return ENOMEM;
+        }
+        dispatch->be_ctx = be_ctx;
+        talloc_set_destructor(dispatch, be_dispatch_destructor);
+        be_ctx->dispatch = dispatch;
+    }
+    dispatch = be_ctx->dispatch;
+
+    /* A request which is filed again, e.g. for the SELinux phase, gives
+     * back the slot of its previous phase */
+    talloc_zfree(be_req->areq);
+
+    areq = talloc_zero(be_req, struct be_async_req);
     if (!areq) {
         return ENOMEM;
     }
     areq->fn = fn;
     areq->req = be_req;
+    areq->prio = be_req->prio;
+    areq->dispatch = dispatch;
+    DLIST_ADD_END(dispatch->queued[areq->prio], areq, struct be_async_req *);
+    talloc_set_destructor(areq, be_async_req_destructor);
+    be_req->areq = areq;
 
-    /* fire immediately */
-    tv.tv_sec = 0;
-    tv.tv_usec = 0;
-
-    te = tevent_add_timer(be_req->be_ctx->ev, be_req,
-                          tv, be_async_req_handler, areq);
-    if (te == NULL) {
-        return EIO;
+    ret = be_dispatch_schedule(dispatch);
+    if (ret != EOK) {
+        talloc_zfree(be_req->areq);
+        return ret;
     }
 
     return EOK;
@@ -667,6 +1049,9 @@ void be_mark_offline(struct be_ctx *ctx)
     ctx->offstat.offline = true;
     ctx->run_online_cb = true;
 
+    /* the first online check failed */
+    server_startup_end(STARTUP_PHASE_ONLINE);
+
     if (ctx->check_if_online_ptask == NULL) {
         /* This is the first time we go offline - create a periodic task
          * to check if we can switch to online. */
@@ -872,11 +1257,148 @@ immediate:
     return EOK;
 }
 
+/* A login usually triggers initgroups from several responders, the
+ * successful refreshes are remembered for initgroups_reuse_timeout seconds
+ * and the repeated requests are answered without the provider. The value
+ * of an entry is its expiration time. */
+struct be_initgr_memo {
+    hash_table_t *entries;
+    time_t next_purge;
+};
+
+static char *be_initgr_memo_key(TALLOC_CTX *mem_ctx,
+                                struct be_req *be_req,
+                                struct be_acct_req *ar)
+{
+    if (ar->filter_type != BE_FILTER_NAME || ar->filter_value == NULL) {
+        return NULL;
+    }
+
+    return talloc_asprintf(mem_ctx, "%s/%s/%s", be_req->domain->name,
+                           ar->filter_value,
+                           ar->extra_value ? ar->extra_value : "");
+}
+
+static void be_initgr_memo_purge(struct be_initgr_memo *memo, time_t now)
+{
+    hash_key_t *keys;
+    hash_value_t value;
+    unsigned long count;
+    unsigned long i;
+    int hret;
+
+    if (now < memo->next_purge) {
+        return;
+    }
+
+    hret = hash_keys(memo->entries, &count, &keys);
+    if (hret != HASH_SUCCESS) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        hret = hash_lookup(memo->entries, &keys[i], &value);
+        if (hret == HASH_SUCCESS && value.ul <= now) {
+            hash_delete(memo->entries, &keys[i]);
+        }
+    }
+    talloc_free(keys);
+
+    memo->next_purge = now + 60;
+}
+
+static bool be_initgr_memo_lookup(struct be_req *be_req,
+                                  struct be_acct_req *ar)
+{
+    struct be_initgr_memo *memo = be_req->be_ctx->initgr_memo;
+    hash_key_t key;
+    hash_value_t value;
+    bool found = false;
+    int hret;
+
+    if (memo == NULL || be_req->domain == NULL) {
+        return false;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = be_initgr_memo_key(be_req, be_req, ar);
+    if (key.str == NULL) {
+        return false;
+    }
+
+    hret = hash_lookup(memo->entries, &key, &value);
+    if (hret == HASH_SUCCESS) {
+        if (value.ul > time(NULL)) {
+            found = true;
+        } else {
+            hash_delete(memo->entries, &key);
+        }
+    }
+
+    talloc_free(key.str);
+    return found;
+}
+
+static void be_initgr_memo_add(struct be_req *be_req,
+                               struct be_acct_req *ar)
+{
+    struct be_ctx *be_ctx = be_req->be_ctx;
+    struct be_initgr_memo *memo;
+    hash_key_t key;
+    hash_value_t value;
+    time_t now;
+    errno_t ret;
+
+    if (be_req->domain == NULL
+            || be_req->domain->initgr_reuse_timeout == 0) {
+        return;
+    }
+
+    if (be_ctx->initgr_memo == NULL) {
+        memo = talloc_zero(be_ctx, struct be_initgr_memo);
+        if (memo == NULL) {
+            return;
+        }
+
+        ret = sss_hash_create(memo, 0, &memo->entries);
+        if (ret != EOK) {
+            talloc_free(memo);
+            return;
+        }
+        be_ctx->initgr_memo = memo;
+    }
+    memo = be_ctx->initgr_memo;
+
+    now = time(NULL);
+    be_initgr_memo_purge(memo, now);
+
+    key.type = HASH_KEY_STRING;
+    key.str = be_initgr_memo_key(be_req, be_req, ar);
+    if (key.str == NULL) {
+        return;
+    }
+
+    value.type = HASH_VALUE_ULONG;
+    value.ul = now + be_req->domain->initgr_reuse_timeout;
+
+    if (hash_enter(memo->entries, &key, &value) != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot remember the initgroups of [%s]\n", ar->filter_value);
+    }
+    talloc_free(key.str);
+}
+
+static void be_initgr_memo_handler(struct be_req *be_req)
+{
+    be_req_terminate(be_req, DP_ERR_OK, EOK, NULL);
+}
+
 struct be_initgr_prereq {
     char *user;
     char *domain;
     uint32_t gnum;
     uint32_t *groups;
+    bool notify_nss;
 
     void *orig_pvt_data;
     int orig_dp_err_type;
@@ -919,6 +1441,24 @@ static void acctinfo_initgroups_callback(struct be_req *be_req,
     pr->orig_errnum = errnum;
     pr->orig_errstr = errstr;
 
+    if (dp_err_type == DP_ERR_OK) {
+        ret = sysdb_update_initgr_gids(be_req->be_ctx->domain, pr->user);
+        if (ret != EOK && ret != ENOENT) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Cannot store the groups of [%s]: %d [%s]\n",
+                  pr->user, ret, sss_strerror(ret));
+        }
+
+        if (errnum == EOK) {
+            be_initgr_memo_add(be_req, be_req_get_data(be_req));
+        }
+    }
+
+    if (!pr->notify_nss) {
+        acctinfo_callback_initgr_wrap(be_req);
+        return;
+    }
+
     if (!be_req->be_ctx->nss_cli || !be_req->be_ctx->nss_cli->conn) {
         DEBUG(SSSDBG_MINOR_FAILURE, "NSS Service not conected\n");
         ret = EACCES;
@@ -973,7 +1513,7 @@ static errno_t be_initgroups_prereq(struct be_req *be_req)
     struct be_acct_req *ar = talloc_get_type(be_req_get_data(be_req),
                                              struct be_acct_req);
     struct be_initgr_prereq *pr;
-    struct ldb_result *res;
+    struct ldb_result *res = NULL;
     errno_t ret;
     const char *tmpstr;
     int i;
@@ -983,17 +1523,28 @@ static errno_t be_initgroups_prereq(struct be_req *be_req)
     if (ret && ret != ENOENT) {
         return ret;
     }
-    /* if the user is completely missing there is no need to contact NSS,
-     * it would be a noop */
-    if (ret == ENOENT || res->count == 0) {
-        /* yet unknown, ignore */
-        return EOK;
-    }
 
-    pr = talloc(be_req, struct be_initgr_prereq);
+    pr = talloc_zero(be_req, struct be_initgr_prereq);
     if (!pr) {
         return ENOMEM;
     }
+    pr->domain = talloc_strdup(pr, be_req->be_ctx->domain->name);
+    if (!pr->domain) {
+        return ENOMEM;
+    }
+
+    /* if the user is completely missing there is no need to contact NSS,
+     * it would be a noop, but the groups are still stored for the
+     * responders once the user is there */
+    if (ret == ENOENT || res->count == 0) {
+        pr->user = talloc_strdup(pr, ar->filter_value);
+        if (!pr->user) {
+            return ENOMEM;
+        }
+        pr->notify_nss = false;
+        goto done;
+    }
+
     pr->groups = talloc_array(pr, gid_t, res->count);
     if (!pr->groups) {
         return ENOMEM;
@@ -1006,10 +1557,6 @@ static errno_t be_initgroups_prereq(struct be_req *be_req)
     if (!pr->user) {
         return ENOMEM;
     }
-    pr->domain = talloc_strdup(pr, be_req->be_ctx->domain->name);
-    if (!pr->domain) {
-        return ENOMEM;
-    }
     /* The first GID is the primary so it might be duplicated
      * later in the list */
     for (pr->gnum = 0, i = 0; i < res->count; i++) {
@@ -1020,7 +1567,9 @@ static errno_t be_initgroups_prereq(struct be_req *be_req)
             pr->gnum++;
         }
     }
+    pr->notify_nss = true;
 
+done:
     talloc_zfree(res);
 
     pr->orig_pvt_data = be_req->pvt;
@@ -1030,13 +1579,830 @@ static errno_t be_initgroups_prereq(struct be_req *be_req)
     return EOK;
 }
 
-static errno_t
-be_file_account_request(struct be_req *be_req, struct be_acct_req *ar)
-{
-    errno_t ret;
-    struct be_ctx *be_ctx = be_req->be_ctx;
+/* The lookups of users and groups which do not exist are remembered for
+ * provider_negative_timeout seconds, the repeated requests from all
+ * responders are then answered without the provider. The value of an
+ * entry is its expiration time, like in the initgroups memo. */
+struct be_negcache {
+    hash_table_t *entries;
+    time_t next_purge;
+};
 
-    be_req->req_data = ar;
+struct be_negcache_req {
+    be_async_callback_t orig_fn;
+    void *orig_pvt;
+};
+
+static char *be_negcache_key(TALLOC_CTX *mem_ctx,
+                             struct be_req *be_req,
+                             struct be_acct_req *ar)
+{
+    switch (ar->entry_type & BE_REQ_TYPE_MASK) {
+    case BE_REQ_USER:
+    case BE_REQ_GROUP:
+        break;
+    default:
+        return NULL;
+    }
+
+    if ((ar->filter_type != BE_FILTER_NAME
+                && ar->filter_type != BE_FILTER_IDNUM)
+            || ar->filter_value == NULL) {
+        return NULL;
+    }
+
+    return talloc_asprintf(mem_ctx, "%s/%d/%d/%s/%s", be_req->domain->name,
+                           ar->entry_type & BE_REQ_TYPE_MASK, ar->filter_type,
+                           ar->filter_value,
+                           ar->extra_value ? ar->extra_value : "");
+}
+
+static void be_negcache_purge(struct be_negcache *negcache, time_t now)
+{
+    hash_key_t *keys;
+    hash_value_t value;
+    unsigned long count;
+    unsigned long i;
+    int hret;
+
+    if (now < negcache->next_purge) {
+        return;
+    }
+
+    hret = hash_keys(negcache->entries, &count, &keys);
+    if (hret != HASH_SUCCESS) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        hret = hash_lookup(negcache->entries, &keys[i], &value);
+        if (hret == HASH_SUCCESS && value.ul <= now) {
+            hash_delete(negcache->entries, &keys[i]);
+        }
+    }
+    talloc_free(keys);
+
+    negcache->next_purge = now + 60;
+}
+
+static bool be_negcache_lookup(struct be_req *be_req,
+                               struct be_acct_req *ar)
+{
+    struct be_negcache *negcache = be_req->be_ctx->negcache;
+    hash_key_t key;
+    hash_value_t value;
+    bool found = false;
+    int hret;
+
+    if (negcache == NULL || be_req->domain == NULL) {
+        return false;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = be_negcache_key(be_req, be_req, ar);
+    if (key.str == NULL) {
+        return false;
+    }
+
+    hret = hash_lookup(negcache->entries, &key, &value);
+    if (hret == HASH_SUCCESS) {
+        if (value.ul > time(NULL)) {
+            found = true;
+        } else {
+            hash_delete(negcache->entries, &key);
+        }
+    }
+
+    talloc_free(key.str);
+    return found;
+}
+
+/* The providers report success for objects which are not found on the
+ * server and remove them from the cache, so the cache tells the result */
+static bool be_negcache_not_cached(struct be_req *be_req,
+                                   struct be_acct_req *ar)
+{
+    struct ldb_result *res = NULL;
+    unsigned long id;
+    char *endptr;
+    bool user;
+    bool missing;
+    errno_t ret;
+
+    user = (ar->entry_type & BE_REQ_TYPE_MASK) == BE_REQ_USER;
+
+    if (ar->filter_type == BE_FILTER_IDNUM) {
+        errno = 0;
+        id = strtoul(ar->filter_value, &endptr, 10);
+        if (errno != 0 || *endptr != '\0' || id == 0) {
+            return false;
+        }
+
+        if (user) {
+            ret = sysdb_getpwuid(be_req, be_req->domain, id, &res);
+        } else {
+            ret = sysdb_getgrgid(be_req, be_req->domain, id, &res);
+        }
+    } else {
+        if (user) {
+            ret = sysdb_getpwnam(be_req, be_req->domain, ar->filter_value,
+                                 &res);
+        } else {
+            ret = sysdb_getgrnam(be_req, be_req->domain, ar->filter_value,
+                                 &res);
+        }
+    }
+
+    if (ret == ENOENT) {
+        return true;
+    } else if (ret != EOK) {
+        return false;
+    }
+
+    missing = (res->count == 0);
+    talloc_free(res);
+    return missing;
+}
+
+static void be_negcache_add(struct be_req *be_req,
+                            struct be_acct_req *ar)
+{
+    struct be_ctx *be_ctx = be_req->be_ctx;
+    struct be_negcache *negcache;
+    hash_key_t key;
+    hash_value_t value;
+    time_t now;
+    errno_t ret;
+
+    if (be_ctx->negcache == NULL) {
+        negcache = talloc_zero(be_ctx, struct be_negcache);
+        if (negcache == NULL) {
+            return;
+        }
+
+        ret = sss_hash_create(negcache, 0, &negcache->entries);
+        if (ret != EOK) {
+            talloc_free(negcache);
+            return;
+        }
+        be_ctx->negcache = negcache;
+    }
+    negcache = be_ctx->negcache;
+
+    now = time(NULL);
+    be_negcache_purge(negcache, now);
+
+    key.type = HASH_KEY_STRING;
+    key.str = be_negcache_key(be_req, be_req, ar);
+    if (key.str == NULL) {
+        return;
+    }
+
+    value.type = HASH_VALUE_ULONG;
+    value.ul = now + be_ctx->domain->provider_neg_timeout;
+
+    if (hash_enter(negcache->entries, &key, &value) != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot remember that [%s] does not exist\n", ar->filter_value);
+    }
+    talloc_free(key.str);
+}
+
+static void be_negcache_callback(struct be_req *be_req,
+                                 int dp_err_type,
+                                 int errnum,
+                                 const char *errstr)
+{
+    struct be_negcache_req *nr = talloc_get_type(be_req->pvt,
+                                                 struct be_negcache_req);
+    struct be_acct_req *ar = be_req_get_data(be_req);
+
+    be_req->fn = nr->orig_fn;
+    be_req->pvt = nr->orig_pvt;
+    talloc_free(nr);
+
+    if (dp_err_type == DP_ERR_OK && errnum == EOK
+            && be_negcache_not_cached(be_req, ar)) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "[%s] does not exist, the lookups are answered from the "
+              "back end for %"PRIu32" seconds\n", ar->filter_value,
+              be_req->be_ctx->domain->provider_neg_timeout);
+        be_negcache_add(be_req, ar);
+    }
+
+    be_req_terminate(be_req, dp_err_type, errnum, errstr);
+}
+
+static errno_t be_negcache_prereq(struct be_req *be_req,
+                                  struct be_acct_req *ar)
+{
+    struct be_negcache_req *nr;
+    char *key;
+
+    if (be_req->be_ctx->domain->provider_neg_timeout == 0
+            || be_req->domain == NULL) {
+        return EOK;
+    }
+
+    /* only the lookups which can be remembered are wrapped */
+    key = be_negcache_key(be_req, be_req, ar);
+    if (key == NULL) {
+        return EOK;
+    }
+    talloc_free(key);
+
+    nr = talloc_zero(be_req, struct be_negcache_req);
+    if (nr == NULL) {
+        return ENOMEM;
+    }
+
+    nr->orig_fn = be_req->fn;
+    nr->orig_pvt = be_req->pvt;
+    be_req->fn = be_negcache_callback;
+    be_req->pvt = nr;
+
+    return EOK;
+}
+
+static void be_negcache_handler(struct be_req *be_req)
+{
+    be_req_terminate(be_req, DP_ERR_OK, EOK, NULL);
+}
+
+/* The InfoPipe responder tells its clients which users and groups were
+ * refreshed so they do not have to poll. The refreshed entries are
+ * collected for a moment and reported in one message. */
+#define BE_IFP_NOTIFY_DELAY 1
+#define BE_IFP_NOTIFY_MAX 256
+
+struct be_ifp_notify {
+    struct be_ctx *be_ctx;
+    struct tevent_timer *te;
+
+    /* keys of the collected entries, to report each one once */
+    hash_table_t *seen;
+    const char **domains;
+    uint32_t *types;
+    uint32_t *ids;
+    int count;
+};
+
+struct be_ifp_notify_req {
+    be_async_callback_t orig_fn;
+    void *orig_pvt;
+};
+
+static void be_ifp_notify_send(struct tevent_context *ev,
+                               struct tevent_timer *te,
+                               struct timeval tv, void *pvt)
+{
+    struct be_ifp_notify *notify = talloc_get_type(pvt, struct be_ifp_notify);
+    struct be_ctx *be_ctx = notify->be_ctx;
+    DBusMessage *msg = NULL;
+    dbus_bool_t dbret;
+
+    be_ctx->ifp_notify = NULL;
+
+    if (be_ctx->ifp_cli == NULL || be_ctx->ifp_cli->conn == NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "InfoPipe is not connected\n");
+        goto done;
+    }
+
+    msg = dbus_message_new_method_call(NULL,
+                                       DP_PATH,
+                                       DATA_PROVIDER_REV_IFACE,
+                                       DATA_PROVIDER_REV_IFACE_OBJECTSCHANGED);
+    if (msg == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory?!\n");
+        goto done;
+    }
+
+    dbret = dbus_message_append_args(msg,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                     &notify->domains, notify->count,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32,
+                                     &notify->types, notify->count,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32,
+                                     &notify->ids, notify->count,
+                                     DBUS_TYPE_INVALID);
+    if (!dbret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory?!\n");
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Reporting %d refreshed entries to InfoPipe\n", notify->count);
+
+    /* no reply expected */
+    dbus_message_set_no_reply(msg, TRUE);
+    sbus_conn_send_reply(be_ctx->ifp_cli->conn, msg);
+
+done:
+    if (msg != NULL) {
+        dbus_message_unref(msg);
+    }
+    talloc_free(notify);
+}
+
+static struct be_ifp_notify *be_ifp_notify_get(struct be_ctx *be_ctx)
+{
+    struct be_ifp_notify *notify;
+    struct timeval tv;
+    errno_t ret;
+
+    if (be_ctx->ifp_notify != NULL) {
+        return be_ctx->ifp_notify;
+    }
+
+    notify = talloc_zero(be_ctx, struct be_ifp_notify);
+    if (notify == NULL) {
+        return NULL;
+    }
+    notify->be_ctx = be_ctx;
+
+    ret = sss_hash_create(notify, 0, &notify->seen);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    notify->domains = talloc_zero_array(notify, const char *,
+                                        BE_IFP_NOTIFY_MAX);
+    notify->types = talloc_zero_array(notify, uint32_t, BE_IFP_NOTIFY_MAX);
+    notify->ids = talloc_zero_array(notify, uint32_t, BE_IFP_NOTIFY_MAX);
+    if (notify->domains == NULL || notify->types == NULL
+            || notify->ids == NULL) {
+        goto fail;
+    }
+
+    tv = tevent_timeval_current_ofs(BE_IFP_NOTIFY_DELAY, 0);
+    notify->te = tevent_add_timer(be_ctx->ev, notify, tv,
+                                  be_ifp_notify_send, notify);
+    if (notify->te == NULL) {
+        goto fail;
+    }
+
+    be_ctx->ifp_notify = notify;
+    return notify;
+
+fail:
+    talloc_free(notify);
+    return NULL;
+}
+
+static void be_ifp_notify_add(struct be_ctx *be_ctx,
+                              struct sss_domain_info *domain,
+                              uint32_t type,
+                              uint32_t id)
+{
+    struct be_ifp_notify *notify;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    notify = be_ifp_notify_get(be_ctx);
+    if (notify == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot report refreshed entry\n");
+        return;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = talloc_asprintf(notify, "%s/%"PRIu32"/%"PRIu32,
+                              domain->name, type, id);
+    if (key.str == NULL) {
+        return;
+    }
+
+    if (hash_has_key(notify->seen, &key)) {
+        talloc_free(key.str);
+        return;
+    }
+
+    value.type = HASH_VALUE_UNDEF;
+    hret = hash_enter(notify->seen, &key, &value);
+    talloc_free(key.str);
+    if (hret != HASH_SUCCESS) {
+        return;
+    }
+
+    /* the domain is kept alive by the back end */
+    notify->domains[notify->count] = domain->name;
+    notify->types[notify->count] = type;
+    notify->ids[notify->count] = id;
+    notify->count++;
+
+    if (notify->count == BE_IFP_NOTIFY_MAX) {
+        /* send it now, the next entries start a new message */
+        talloc_zfree(notify->te);
+        be_ifp_notify_send(be_ctx->ev, NULL, tevent_timeval_zero(), notify);
+    }
+}
+
+/* Report the entry the request refreshed by its ID. Users and groups which
+ * were looked up by name and removed from the cache cannot be reported,
+ * their ID is not known anymore. */
+static void be_ifp_notify_entry(struct be_req *be_req,
+                                struct be_acct_req *ar)
+{
+    struct ldb_result *res = NULL;
+    const char *attr;
+    unsigned long id;
+    uint32_t type;
+    char *endptr;
+    errno_t ret;
+
+    switch (ar->entry_type & BE_REQ_TYPE_MASK) {
+    case BE_REQ_USER:
+    case BE_REQ_INITGROUPS:
+        type = BE_REQ_USER;
+        attr = SYSDB_UIDNUM;
+        break;
+    case BE_REQ_GROUP:
+        type = BE_REQ_GROUP;
+        attr = SYSDB_GIDNUM;
+        break;
+    default:
+        return;
+    }
+
+    if (ar->filter_value == NULL) {
+        return;
+    }
+
+    if (ar->filter_type == BE_FILTER_IDNUM) {
+        errno = 0;
+        id = strtoul(ar->filter_value, &endptr, 10);
+        if (errno != 0 || *endptr != '\0' || id == 0 || id > UINT32_MAX) {
+            return;
+        }
+    } else if (ar->filter_type == BE_FILTER_NAME) {
+        if (type == BE_REQ_USER) {
+            ret = sysdb_getpwnam(be_req, be_req->domain, ar->filter_value,
+                                 &res);
+        } else {
+            ret = sysdb_getgrnam(be_req, be_req->domain, ar->filter_value,
+                                 &res);
+        }
+        if (ret != EOK || res->count != 1) {
+            talloc_free(res);
+            return;
+        }
+
+        id = ldb_msg_find_attr_as_uint(res->msgs[0], attr, 0);
+        talloc_free(res);
+        if (id == 0) {
+            return;
+        }
+    } else {
+        return;
+    }
+
+    be_ifp_notify_add(be_req->be_ctx, be_req->domain, type, id);
+}
+
+static void be_ifp_notify_callback(struct be_req *be_req,
+                                   int dp_err_type,
+                                   int errnum,
+                                   const char *errstr)
+{
+    struct be_ifp_notify_req *nr = talloc_get_type(be_req->pvt,
+                                                   struct be_ifp_notify_req);
+    struct be_acct_req *ar = be_req_get_data(be_req);
+
+    be_req->fn = nr->orig_fn;
+    be_req->pvt = nr->orig_pvt;
+    talloc_free(nr);
+
+    if (dp_err_type == DP_ERR_OK && errnum == EOK) {
+        be_ifp_notify_entry(be_req, ar);
+    }
+
+    be_req_terminate(be_req, dp_err_type, errnum, errstr);
+}
+
+static errno_t be_ifp_notify_prereq(struct be_req *be_req,
+                                    struct be_acct_req *ar)
+{
+    struct be_ifp_notify_req *nr;
+
+    /* nobody to tell */
+    if (be_req->be_ctx->ifp_cli == NULL || be_req->domain == NULL) {
+        return EOK;
+    }
+
+    if (ar->filter_type != BE_FILTER_NAME
+            && ar->filter_type != BE_FILTER_IDNUM) {
+        return EOK;
+    }
+
+    nr = talloc_zero(be_req, struct be_ifp_notify_req);
+    if (nr == NULL) {
+        return ENOMEM;
+    }
+
+    nr->orig_fn = be_req->fn;
+    nr->orig_pvt = be_req->pvt;
+    be_req->fn = be_ifp_notify_callback;
+    be_req->pvt = nr;
+
+    return EOK;
+}
+
+/* Identical account requests which arrive while the first one is still
+ * running, e.g. from several responders or clients, are not passed to the
+ * provider again. They wait for the first request and get its result. */
+struct be_pending_waiter;
+
+struct be_pending_acct {
+    struct be_ctx *be_ctx;
+    char *key;
+
+    /* NULL once the provider answered or the request was freed */
+    struct be_req *leader;
+    be_async_callback_t orig_fn;
+    void *orig_pvt;
+    struct be_pending_guard *guard;
+
+    struct be_pending_waiter *waiters;
+
+    int dp_err_type;
+    int errnum;
+    char *errstr;
+};
+
+struct be_pending_guard {
+    struct be_pending_acct *pending;
+};
+
+struct be_pending_waiter {
+    struct be_pending_waiter *prev;
+    struct be_pending_waiter *next;
+
+    struct be_pending_acct *pending;
+    struct be_req *be_req;
+};
+
+static char *be_pending_acct_key(TALLOC_CTX *mem_ctx,
+                                 struct be_req *be_req,
+                                 struct be_acct_req *ar)
+{
+    if (be_req->domain == NULL) {
+        return NULL;
+    }
+
+    return talloc_asprintf(mem_ctx, "%s/%d/%d/%d/%s/%s", be_req->domain->name,
+                           ar->entry_type & ~BE_REQ_FAST, ar->attr_type,
+                           ar->filter_type,
+                           ar->filter_value ? ar->filter_value : "",
+                           ar->extra_value ? ar->extra_value : "");
+}
+
+static void be_pending_acct_reply(struct tevent_context *ev,
+                                  struct tevent_timer *te,
+                                  struct timeval tv, void *pvt)
+{
+    struct be_pending_acct *pending = talloc_get_type(pvt,
+                                                      struct be_pending_acct);
+    struct be_pending_waiter *waiter;
+    struct be_req *be_req;
+
+    while ((waiter = pending->waiters) != NULL) {
+        DLIST_REMOVE(pending->waiters, waiter);
+        be_req = waiter->be_req;
+        waiter->pending = NULL;
+        talloc_free(waiter);
+
+        be_req_terminate(be_req, pending->dp_err_type, pending->errnum,
+                         pending->errstr);
+    }
+
+    talloc_free(pending);
+}
+
+static void be_pending_acct_finish(struct be_pending_acct *pending,
+                                   int dp_err_type,
+                                   int errnum,
+                                   const char *errstr)
+{
+    struct tevent_timer *te;
+    hash_key_t key;
+
+    key.type = HASH_KEY_STRING;
+    key.str = pending->key;
+    hash_delete(pending->be_ctx->pending_acct, &key);
+    pending->leader = NULL;
+
+    if (pending->waiters == NULL) {
+        talloc_free(pending);
+        return;
+    }
+
+    pending->dp_err_type = dp_err_type;
+    pending->errnum = errnum;
+    if (errstr != NULL) {
+        pending->errstr = talloc_strdup(pending, errstr);
+    }
+
+    /* the waiters are answered from the main loop, the caller may be
+     * iterating over the active requests */
+    te = tevent_add_timer(pending->be_ctx->ev, pending, tevent_timeval_zero(),
+                          be_pending_acct_reply, pending);
+    if (te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot answer the waiting requests\n");
+        be_pending_acct_reply(pending->be_ctx->ev, NULL,
+                              tevent_timeval_zero(), pending);
+    }
+}
+
+static int be_pending_guard_destructor(struct be_pending_guard *guard)
+{
+    /* the first request was freed before the provider answered */
+    be_pending_acct_finish(guard->pending, DP_ERR_FATAL, EIO,
+                           "Request aborted");
+    return 0;
+}
+
+static int be_pending_waiter_destructor(struct be_pending_waiter *waiter)
+{
+    if (waiter->pending != NULL) {
+        DLIST_REMOVE(waiter->pending->waiters, waiter);
+    }
+    return 0;
+}
+
+static void be_pending_acct_callback(struct be_req *be_req,
+                                     int dp_err_type,
+                                     int errnum,
+                                     const char *errstr)
+{
+    struct be_pending_acct *pending = talloc_get_type(be_req->pvt,
+                                                      struct be_pending_acct);
+
+    be_req->fn = pending->orig_fn;
+    be_req->pvt = pending->orig_pvt;
+    talloc_set_destructor(pending->guard, NULL);
+    talloc_zfree(pending->guard);
+
+    be_pending_acct_finish(pending, dp_err_type, errnum, errstr);
+    be_req_terminate(be_req, dp_err_type, errnum, errstr);
+}
+
+static bool be_pending_acct_join(struct be_req *be_req,
+                                 struct be_acct_req *ar)
+{
+    struct be_pending_acct *pending;
+    struct be_pending_waiter *waiter;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    if (be_req->be_ctx->pending_acct == NULL) {
+        return false;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = be_pending_acct_key(be_req, be_req, ar);
+    if (key.str == NULL) {
+        return false;
+    }
+
+    hret = hash_lookup(be_req->be_ctx->pending_acct, &key, &value);
+    talloc_free(key.str);
+    if (hret != HASH_SUCCESS) {
+        return false;
+    }
+
+    pending = talloc_get_type(value.ptr, struct be_pending_acct);
+    if (pending == NULL || pending->leader == NULL) {
+        return false;
+    }
+
+    waiter = talloc_zero(be_req, struct be_pending_waiter);
+    if (waiter == NULL) {
+        return false;
+    }
+    waiter->pending = pending;
+    waiter->be_req = be_req;
+    talloc_set_destructor(waiter, be_pending_waiter_destructor);
+    DLIST_ADD_END(pending->waiters, waiter, struct be_pending_waiter *);
+
+    return true;
+}
+
+/* Must be the last wrapper of the callback, the waiters get the result
+ * the caller of the first request gets */
+static errno_t be_pending_acct_lead(struct be_req *be_req,
+                                    struct be_acct_req *ar)
+{
+    struct be_ctx *be_ctx = be_req->be_ctx;
+    struct be_pending_acct *pending;
+    hash_key_t key;
+    hash_value_t value;
+    errno_t ret;
+    int hret;
+
+    if (be_ctx->pending_acct == NULL) {
+        ret = sss_hash_create(be_ctx, 0, &be_ctx->pending_acct);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    pending = talloc_zero(be_ctx, struct be_pending_acct);
+    if (pending == NULL) {
+        return ENOMEM;
+    }
+    pending->be_ctx = be_ctx;
+
+    pending->key = be_pending_acct_key(pending, be_req, ar);
+    if (pending->key == NULL) {
+        /* nothing to merge with */
+        talloc_free(pending);
+        return EOK;
+    }
+
+    pending->guard = talloc_zero(be_req, struct be_pending_guard);
+    if (pending->guard == NULL) {
+        talloc_free(pending);
+        return ENOMEM;
+    }
+    pending->guard->pending = pending;
+
+    key.type = HASH_KEY_STRING;
+    key.str = pending->key;
+    value.type = HASH_VALUE_PTR;
+    value.ptr = pending;
+
+    hret = hash_enter(be_ctx->pending_acct, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        talloc_free(pending->guard);
+        talloc_free(pending);
+        return EIO;
+    }
+    talloc_set_destructor(pending->guard, be_pending_guard_destructor);
+
+    pending->leader = be_req;
+    pending->orig_fn = be_req->fn;
+    pending->orig_pvt = be_req->pvt;
+    be_req->fn = be_pending_acct_callback;
+    be_req->pvt = pending;
+
+    return EOK;
+}
+
+static enum be_req_prio be_acct_req_prio(struct be_acct_req *ar)
+{
+    if (ar->filter_type == BE_FILTER_ENUM
+            || ar->filter_type == BE_FILTER_WILDCARD) {
+        return BE_REQ_PRIO_BULK;
+    }
+
+    if ((ar->entry_type & BE_REQ_TYPE_MASK) == BE_REQ_INITGROUPS) {
+        return BE_REQ_PRIO_INITGR;
+    }
+
+    return BE_REQ_PRIO_LOOKUP;
+}
+
+static errno_t
+be_file_account_request(struct be_req *be_req, struct be_acct_req *ar)
+{
+    errno_t ret;
+    struct be_ctx *be_ctx = be_req->be_ctx;
+
+    be_req->req_data = ar;
+    be_req->prio = be_acct_req_prio(ar);
+    be_req->stats_type = be_req2str(ar->entry_type & BE_REQ_TYPE_MASK);
+    if (ar->req_id != 0) {
+        be_req->id = ar->req_id;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "[RID#%u] Account request [%#x][%s][%s]\n",
+          be_req->id, ar->entry_type, be_req2str(ar->entry_type),
+          ar->filter_value ? ar->filter_value : "-");
+
+    if ((ar->entry_type & 0xFF) == BE_REQ_INITGROUPS
+            && be_initgr_memo_lookup(be_req, ar)) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "The groups of [%s] were refreshed recently\n",
+              ar->filter_value);
+        be_ctx->initgr_memo_hits++;
+        return be_file_request(be_ctx, be_req, be_initgr_memo_handler);
+    }
+
+    if (be_negcache_lookup(be_req, ar)) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "[%s] was not found recently\n", ar->filter_value);
+        be_ctx->negcache_hits++;
+        return be_file_request(be_ctx, be_req, be_negcache_handler);
+    }
+
+    if (be_pending_acct_join(be_req, ar)) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "An identical request for [%s] is already running\n",
+              ar->filter_value ? ar->filter_value : "");
+        be_ctx->pending_joins++;
+        return EOK;
+    }
 
     /* see if we need a pre request call, only done for initgroups for now */
     if ((ar->entry_type & 0xFF) == BE_REQ_INITGROUPS) {
@@ -1047,6 +2413,24 @@ be_file_account_request(struct be_req *be_req, struct be_acct_req *ar)
         }
     }
 
+    ret = be_negcache_prereq(be_req, ar);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Prerequest failed\n");
+        return ret;
+    }
+
+    ret = be_ifp_notify_prereq(be_req, ar);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Prerequest failed\n");
+        return ret;
+    }
+
+    ret = be_pending_acct_lead(be_req, ar);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Prerequest failed\n");
+        return ret;
+    }
+
     /* process request */
     ret = be_file_request(be_ctx, be_req,
                           be_ctx->bet_info[BET_ID].bet_ops->handler);
@@ -1084,6 +2468,46 @@ split_name_extended(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+errno_t be_acct_req_set_filter(struct be_acct_req *req, const char *filter)
+{
+    errno_t ret = EOK;
+
+    if (strncmp(filter, "name=", 5) == 0) {
+        req->filter_type = BE_FILTER_NAME;
+        ret = split_name_extended(req, &filter[5],
+                                  &req->filter_value,
+                                  &req->extra_value);
+    } else if (strncmp(filter, "idnumber=", 9) == 0) {
+        req->filter_type = BE_FILTER_IDNUM;
+        ret = split_name_extended(req, &filter[9],
+                                  &req->filter_value,
+                                  &req->extra_value);
+    } else if (strncmp(filter, DP_SEC_ID"=", DP_SEC_ID_LEN + 1) == 0) {
+        req->filter_type = BE_FILTER_SECID;
+        ret = split_name_extended(req, &filter[DP_SEC_ID_LEN + 1],
+                                  &req->filter_value,
+                                  &req->extra_value);
+    } else if (strncmp(filter, DP_CERT"=", DP_CERT_LEN + 1) == 0) {
+        req->filter_type = BE_FILTER_CERT;
+        ret = split_name_extended(req, &filter[DP_CERT_LEN + 1],
+                                  &req->filter_value,
+                                  &req->extra_value);
+    } else if (strncmp(filter, DP_WILDCARD"=", DP_WILDCARD_LEN + 1) == 0) {
+        req->filter_type = BE_FILTER_WILDCARD;
+        ret = split_name_extended(req, &filter[DP_WILDCARD_LEN + 1],
+                                  &req->filter_value,
+                                  &req->extra_value);
+    } else if (strcmp(filter, ENUM_INDICATOR) == 0) {
+        req->filter_type = BE_FILTER_ENUM;
+        req->filter_value = NULL;
+        req->extra_value = NULL;
+    } else {
+        return EINVAL;
+    }
+
+    return ret == EOK ? EOK : EINVAL;
+}
+
 static void
 be_get_account_info_done(struct be_req *be_req,
                          int dp_err, int dp_ret,
@@ -1191,6 +2615,30 @@ errno_t be_get_account_info_recv(struct tevent_req *req,
     return EOK;
 }
 
+/* The id of the client request is an optional fifth argument */
+static uint32_t be_acct_msg_req_id(DBusMessage *msg)
+{
+    DBusMessageIter iter;
+    dbus_uint32_t req_id = 0;
+    int i;
+
+    if (!dbus_message_iter_init(msg, &iter)) {
+        return 0;
+    }
+
+    for (i = 0; i < 4; i++) {
+        if (!dbus_message_iter_next(&iter)) {
+            return 0;
+        }
+    }
+
+    if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_UINT32) {
+        dbus_message_iter_get_basic(&iter, &req_id);
+    }
+
+    return req_id;
+}
+
 static int be_get_account_info(struct sbus_request *dbus_req, void *user_data)
 {
     struct be_acct_req *req;
@@ -1262,6 +2710,7 @@ static int be_get_account_info(struct sbus_request *dbus_req, void *user_data)
     }
     req->entry_type = type;
     req->attr_type = (int)attr_type;
+    req->req_id = be_acct_msg_req_id(dbus_req->message);
     req->domain = talloc_strdup(req, domain);
     if (!req->domain) {
         be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, ENOMEM,
@@ -1279,42 +2728,7 @@ static int be_get_account_info(struct sbus_request *dbus_req, void *user_data)
     }
 
     if (filter) {
-        ret = EOK;
-        if (strncmp(filter, "name=", 5) == 0) {
-            req->filter_type = BE_FILTER_NAME;
-            ret = split_name_extended(req, &filter[5],
-                                      &req->filter_value,
-                                      &req->extra_value);
-        } else if (strncmp(filter, "idnumber=", 9) == 0) {
-            req->filter_type = BE_FILTER_IDNUM;
-            ret = split_name_extended(req, &filter[9],
-                                      &req->filter_value,
-                                      &req->extra_value);
-        } else if (strncmp(filter, DP_SEC_ID"=", DP_SEC_ID_LEN + 1) == 0) {
-            req->filter_type = BE_FILTER_SECID;
-            ret = split_name_extended(req, &filter[DP_SEC_ID_LEN + 1],
-                                      &req->filter_value,
-                                      &req->extra_value);
-        } else if (strncmp(filter, DP_CERT"=", DP_CERT_LEN + 1) == 0) {
-            req->filter_type = BE_FILTER_CERT;
-            ret = split_name_extended(req, &filter[DP_CERT_LEN + 1],
-                                      &req->filter_value,
-                                      &req->extra_value);
-        } else if (strncmp(filter, DP_WILDCARD"=", DP_WILDCARD_LEN + 1) == 0) {
-            req->filter_type = BE_FILTER_WILDCARD;
-            ret = split_name_extended(req, &filter[DP_WILDCARD_LEN + 1],
-                                      &req->filter_value,
-                                      &req->extra_value);
-        } else if (strcmp(filter, ENUM_INDICATOR) == 0) {
-            req->filter_type = BE_FILTER_ENUM;
-            req->filter_value = NULL;
-            req->extra_value = NULL;
-        } else {
-            be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, EINVAL,
-                                   "Invalid filter");
-            goto done;
-        }
-
+        ret = be_acct_req_set_filter(req, filter);
         if (ret != EOK) {
             be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, EINVAL,
                                    "Invalid filter");
@@ -1342,6 +2756,531 @@ done:
     return EOK;
 }
 
+struct be_acct_multi_state {
+    /* NULL if the fast reply was already sent */
+    struct sbus_request *dbus_req;
+    unsigned int pending;
+
+    bool failed;
+    dbus_uint16_t err_maj;
+    dbus_uint32_t err_min;
+    char *err_msg;
+};
+
+static void be_get_account_info_multi_done(struct tevent_req *subreq);
+
+/* The lookups are filed one after the other in the same event, so the
+ * provider may merge them, e.g. into one LDAP search */
+static int be_get_account_info_multi(struct sbus_request *dbus_req,
+                                     void *user_data)
+{
+    struct be_acct_multi_state *state;
+    struct be_client *becli;
+    struct be_acct_req **reqs;
+    struct tevent_req *subreq;
+    uint32_t type;
+    uint32_t attr_type;
+    char **filters;
+    int num_filters;
+    char *domain;
+    int ret;
+    int i;
+    struct be_sbus_reply_data req_reply = BE_SBUS_REPLY_DATA_INIT;
+
+    becli = talloc_get_type(user_data, struct be_client);
+    if (!becli) return EINVAL;
+
+    if (!sbus_request_parse_or_finish(dbus_req,
+                                      DBUS_TYPE_UINT32, &type,
+                                      DBUS_TYPE_UINT32, &attr_type,
+                                      DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                      &filters, &num_filters,
+                                      DBUS_TYPE_STRING, &domain,
+                                      DBUS_TYPE_INVALID))
+        return EOK; /* handled */
+
+    DEBUG(SSSDBG_FUNC_DATA,
+          "Got request for %d lookups of [%#x][%s][%d]\n", num_filters,
+          type, be_req2str(type), attr_type);
+
+    state = talloc_zero(becli, struct be_acct_multi_state);
+    if (state == NULL) {
+        be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, ENOMEM,
+                               "Out of memory");
+        goto done;
+    }
+    state->dbus_req = dbus_req;
+
+    if ((attr_type != BE_ATTR_CORE) &&
+        (attr_type != BE_ATTR_MEM) &&
+        (attr_type != BE_ATTR_ALL)) {
+        /* Unrecognized attr type */
+        be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, EINVAL,
+                               "Invalid Attrs Parameter");
+        goto done;
+    }
+
+    if (num_filters == 0 || num_filters > DP_ACCT_MULTI_MAX) {
+        be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, EINVAL,
+                               "Invalid number of filters");
+        goto done;
+    }
+
+    /* the whole request is rejected if one of the filters is invalid */
+    reqs = talloc_zero_array(state, struct be_acct_req *, num_filters);
+    if (reqs == NULL) {
+        be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, ENOMEM,
+                               "Out of memory");
+        goto done;
+    }
+
+    for (i = 0; i < num_filters; i++) {
+        reqs[i] = talloc_zero(reqs, struct be_acct_req);
+        if (reqs[i] == NULL) {
+            be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, ENOMEM,
+                                   "Out of memory");
+            goto done;
+        }
+        reqs[i]->entry_type = type;
+        reqs[i]->attr_type = (int)attr_type;
+        reqs[i]->domain = talloc_strdup(reqs[i], domain);
+        if (reqs[i]->domain == NULL) {
+            be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, ENOMEM,
+                                   "Out of memory");
+            goto done;
+        }
+
+        ret = be_acct_req_set_filter(reqs[i], filters[i]);
+        if (ret != EOK) {
+            be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, EINVAL,
+                                   "Invalid filter");
+            goto done;
+        }
+    }
+
+    /* If we are offline and fast reply was requested
+     * return offline immediately
+     */
+    if ((type & BE_REQ_FAST) && becli->bectx->offstat.offline) {
+        ret = be_offline_reply(&state->dbus_req);
+        if (ret != EOK) {
+            talloc_free(state);
+            return ret;
+        }
+    }
+
+    for (i = 0; i < num_filters; i++) {
+        subreq = be_get_account_info_send(state, becli->bectx->ev, becli,
+                                          becli->bectx, reqs[i]);
+        if (subreq == NULL) {
+            /* the lookups already filed are still answered */
+            if (!state->failed) {
+                state->failed = true;
+                state->err_maj = DP_ERR_FATAL;
+                state->err_min = ENOMEM;
+            }
+            break;
+        }
+        talloc_steal(subreq, reqs[i]);
+        tevent_req_set_callback(subreq, be_get_account_info_multi_done,
+                                state);
+        state->pending++;
+    }
+
+    if (state->pending == 0) {
+        be_sbus_reply_data_set(&req_reply, DP_ERR_FATAL, ENOMEM,
+                               "Out of memory");
+        dbus_req = state->dbus_req;
+        goto done;
+    }
+
+    return EOK;
+
+done:
+    talloc_free(state);
+    be_sbus_req_reply_data(dbus_req, &req_reply);
+    return EOK;
+}
+
+static void be_get_account_info_multi_done(struct tevent_req *subreq)
+{
+    struct be_acct_multi_state *state;
+    const char *err_msg = NULL;
+    int err_maj;
+    int err_min;
+    errno_t ret;
+
+    state = tevent_req_callback_data(subreq, struct be_acct_multi_state);
+
+    ret = be_get_account_info_recv(subreq, state, &err_maj, &err_min,
+                                   &err_msg);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        err_maj = DP_ERR_FATAL;
+        err_min = ret;
+        err_msg = NULL;
+    }
+
+    if (err_maj != DP_ERR_OK && !state->failed) {
+        state->failed = true;
+        state->err_maj = err_maj;
+        state->err_min = err_min;
+        state->err_msg = discard_const(err_msg);
+    }
+
+    state->pending--;
+    if (state->pending > 0) {
+        return;
+    }
+
+    if (state->failed) {
+        be_sbus_reply(state->dbus_req, state->err_maj, state->err_min,
+                      state->err_msg);
+    } else {
+        be_sbus_reply(state->dbus_req, DP_ERR_OK, EOK, NULL);
+    }
+
+    talloc_free(state);
+}
+
+/* One element per periodic task in each array except histograms, which
+ * holds the buckets of each task one after the other */
+static int be_get_task_stats(struct sbus_request *dbus_req, void *user_data)
+{
+    struct be_client *becli;
+    struct be_ptask_stats *stats;
+    const char **names;
+    uint64_t *runs;
+    uint64_t *failures;
+    uint64_t *timeouts;
+    uint64_t *skips;
+    uint64_t *overlaps;
+    uint64_t *total_msec;
+    uint64_t *max_msec;
+    uint64_t *limits;
+    uint64_t *histograms;
+    size_t count;
+    size_t i;
+    int j;
+    int len;
+    int nbuckets = BE_PTASK_STATS_BUCKETS;
+    int nhist;
+    int ret;
+
+    becli = talloc_get_type(user_data, struct be_client);
+    if (!becli) return EINVAL;
+
+    ret = be_ptask_get_all_stats(dbus_req, becli->bectx, &names, &stats,
+                                 &count);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    runs = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    failures = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    timeouts = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    skips = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    overlaps = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    total_msec = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    max_msec = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    limits = talloc_zero_array(dbus_req, uint64_t, BE_PTASK_STATS_BUCKETS);
+    histograms = talloc_zero_array(dbus_req, uint64_t,
+                                   count * BE_PTASK_STATS_BUCKETS + 1);
+    if (runs == NULL || failures == NULL || timeouts == NULL || skips == NULL
+            || overlaps == NULL || total_msec == NULL || max_msec == NULL
+            || limits == NULL || histograms == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < count; i++) {
+        runs[i] = stats[i].runs;
+        failures[i] = stats[i].failures;
+        timeouts[i] = stats[i].timeouts;
+        skips[i] = stats[i].skips;
+        overlaps[i] = stats[i].overlaps;
+        total_msec[i] = stats[i].total_msec;
+        max_msec[i] = stats[i].max_msec;
+        memcpy(&histograms[i * BE_PTASK_STATS_BUCKETS], stats[i].buckets,
+               sizeof(stats[i].buckets));
+    }
+
+    /* the last bucket is unbounded */
+    for (j = 0; j < BE_PTASK_STATS_BUCKETS - 1; j++) {
+        limits[j] = be_ptask_stats_bucket_limit(j);
+    }
+    limits[j] = UINT64_MAX;
+    len = count;
+    nhist = count * BE_PTASK_STATS_BUCKETS;
+
+    return sbus_request_return_and_finish(dbus_req,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &names, len,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &runs, len,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &failures, len,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &timeouts, len,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &skips, len,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &overlaps, len,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &total_msec, len,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &max_msec, len,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &limits, nbuckets,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &histograms, nhist,
+                            DBUS_TYPE_INVALID);
+}
+
+/* Name and value pairs of getCacheMetrics */
+struct be_metrics {
+    const char **names;
+    uint64_t *values;
+    size_t count;
+    errno_t error;
+};
+
+static void be_metrics_add(struct be_metrics *metrics, uint64_t value,
+                           const char *format, ...) SSS_ATTRIBUTE_PRINTF(3, 4);
+
+static void be_metrics_add(struct be_metrics *metrics, uint64_t value,
+                           const char *format, ...)
+{
+    const char **names;
+    uint64_t *values;
+    va_list ap;
+
+    if (metrics->error != EOK) {
+        return;
+    }
+
+    names = talloc_realloc(metrics, metrics->names, const char *,
+                           metrics->count + 1);
+    values = talloc_realloc(metrics, metrics->values, uint64_t,
+                            metrics->count + 1);
+    if (names == NULL || values == NULL) {
+        metrics->error = ENOMEM;
+        return;
+    }
+    metrics->names = names;
+    metrics->values = values;
+
+    va_start(ap, format);
+    names[metrics->count] = talloc_vasprintf(names, format, ap);
+    va_end(ap);
+    if (names[metrics->count] == NULL) {
+        metrics->error = ENOMEM;
+        return;
+    }
+
+    values[metrics->count] = value;
+    metrics->count++;
+}
+
+/* One value per name, the counters of the requests of each type, of the
+ * account requests answered without the provider, of the periodic tasks
+ * and of the LDAP operations */
+static int be_get_cache_metrics(struct sbus_request *dbus_req,
+                                void *user_data)
+{
+    struct be_client *becli;
+    struct be_ctx *be_ctx;
+    struct be_metrics *metrics;
+    struct be_ptask_stats *tstats;
+    struct be_req_stats *rstats;
+    const char **tasks;
+    char label[64];
+    size_t count;
+    size_t i;
+    int len;
+    int ret;
+
+    becli = talloc_get_type(user_data, struct be_client);
+    if (!becli) return EINVAL;
+    be_ctx = becli->bectx;
+
+    metrics = talloc_zero(dbus_req, struct be_metrics);
+    if (metrics == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < be_ctx->num_req_stats; i++) {
+        rstats = &be_ctx->req_stats[i];
+        be_metrics_add(metrics, rstats->count, "requests.%s.count",
+                       rstats->type);
+        be_metrics_add(metrics, rstats->failures, "requests.%s.failures",
+                       rstats->type);
+        be_metrics_add(metrics, rstats->total_usec, "requests.%s.total_usec",
+                       rstats->type);
+        be_metrics_add(metrics, rstats->max_usec, "requests.%s.max_usec",
+                       rstats->type);
+    }
+
+    be_metrics_add(metrics, be_ctx->negcache_hits, "negcache_hits");
+    be_metrics_add(metrics, be_ctx->initgr_memo_hits, "initgr_memo_hits");
+    be_metrics_add(metrics, be_ctx->pending_joins, "pending_joins");
+
+    ret = be_ptask_get_all_stats(metrics, be_ctx, &tasks, &tstats, &count);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    for (i = 0; i < count; i++) {
+        be_stats_label(tasks[i], label, sizeof(label));
+        be_metrics_add(metrics, tstats[i].runs, "tasks.%s.runs", label);
+        be_metrics_add(metrics, tstats[i].failures, "tasks.%s.failures",
+                       label);
+        be_metrics_add(metrics, tstats[i].timeouts, "tasks.%s.timeouts",
+                       label);
+        be_metrics_add(metrics, tstats[i].skips, "tasks.%s.skips", label);
+    }
+
+    be_metrics_add(metrics, be_ctx->ldap_stats.ops, "ldap.operations");
+    be_metrics_add(metrics, be_ctx->ldap_stats.results, "ldap.results");
+    be_metrics_add(metrics, be_ctx->ldap_stats.total_usec, "ldap.total_usec");
+    be_metrics_add(metrics, be_ctx->ldap_stats.max_usec, "ldap.max_usec");
+    be_metrics_add(metrics, be_ctx->ldap_stats.timeouts, "ldap.timeouts");
+
+    if (metrics->error != EOK) {
+        return metrics->error;
+    }
+    len = metrics->count;
+
+    return sbus_request_return_and_finish(dbus_req,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &metrics->names, len,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &metrics->values, len,
+                DBUS_TYPE_INVALID);
+}
+
+/* The DNS counters hold one element per query type and outcome, the outcomes
+ * of each type one after the other. The server arrays hold one element per
+ * server except connect_histograms, which holds the buckets of each server
+ * one after the other */
+static int be_get_resolver_stats(struct sbus_request *dbus_req,
+                                 void *user_data)
+{
+    struct be_client *becli;
+    struct resolv_stats rstats;
+    struct fo_server_stats *fstats = NULL;
+    const char **types;
+    const char **outcomes;
+    uint64_t *network;
+    uint64_t *cached;
+    uint64_t *latency_limits;
+    uint64_t *latency_buckets;
+    const char **servers;
+    uint64_t *successes;
+    uint64_t *failures;
+    uint64_t *transitions;
+    uint64_t *srtt_usec;
+    uint64_t *connect_limits;
+    uint64_t *connect_histograms;
+    uint64_t total_msec;
+    uint64_t max_msec;
+    size_t count = 0;
+    size_t i;
+    int t;
+    int o;
+    int b;
+    int ntypes = RESOLV_STATS_TYPES;
+    int noutcomes = RESOLV_STATS_OUTCOMES;
+    int ncounters = RESOLV_STATS_TYPES * RESOLV_STATS_OUTCOMES;
+    int nlatency = RESOLV_STATS_BUCKETS;
+    int nconnect = FO_RTT_BUCKETS;
+    int nservers;
+    int nhist;
+    int ret;
+
+    becli = talloc_get_type(user_data, struct be_client);
+    if (!becli) return EINVAL;
+
+    memset(&rstats, 0, sizeof(rstats));
+    if (becli->bectx->be_res != NULL) {
+        resolv_get_stats(becli->bectx->be_res->resolv, &rstats);
+    }
+
+    ret = be_fo_get_server_stats(dbus_req, becli->bectx, &fstats, &count);
+    if (ret == ENOENT) {
+        count = 0;
+    } else if (ret != EOK) {
+        return ret;
+    }
+
+    types = talloc_zero_array(dbus_req, const char *, RESOLV_STATS_TYPES);
+    outcomes = talloc_zero_array(dbus_req, const char *,
+                                 RESOLV_STATS_OUTCOMES);
+    network = talloc_zero_array(dbus_req, uint64_t, ncounters);
+    cached = talloc_zero_array(dbus_req, uint64_t, ncounters);
+    latency_limits = talloc_zero_array(dbus_req, uint64_t,
+                                       RESOLV_STATS_BUCKETS);
+    latency_buckets = talloc_zero_array(dbus_req, uint64_t,
+                                        RESOLV_STATS_BUCKETS);
+    servers = talloc_zero_array(dbus_req, const char *, count + 1);
+    successes = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    failures = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    transitions = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    srtt_usec = talloc_zero_array(dbus_req, uint64_t, count + 1);
+    connect_limits = talloc_zero_array(dbus_req, uint64_t, FO_RTT_BUCKETS);
+    connect_histograms = talloc_zero_array(dbus_req, uint64_t,
+                                           count * FO_RTT_BUCKETS + 1);
+    if (types == NULL || outcomes == NULL || network == NULL
+            || cached == NULL || latency_limits == NULL
+            || latency_buckets == NULL || servers == NULL
+            || successes == NULL || failures == NULL || transitions == NULL
+            || srtt_usec == NULL || connect_limits == NULL
+            || connect_histograms == NULL) {
+        return ENOMEM;
+    }
+
+    for (t = 0; t < RESOLV_STATS_TYPES; t++) {
+        types[t] = resolv_stats_type_str(t);
+        for (o = 0; o < RESOLV_STATS_OUTCOMES; o++) {
+            network[t * RESOLV_STATS_OUTCOMES + o] = rstats.network[t][o];
+            cached[t * RESOLV_STATS_OUTCOMES + o] = rstats.cached[t][o];
+        }
+    }
+    for (o = 0; o < RESOLV_STATS_OUTCOMES; o++) {
+        outcomes[o] = resolv_stats_outcome_str(o);
+    }
+
+    /* the last bucket is unbounded */
+    for (b = 0; b < RESOLV_STATS_BUCKETS - 1; b++) {
+        latency_limits[b] = resolv_stats_bucket_limit(b);
+    }
+    latency_limits[b] = UINT64_MAX;
+    memcpy(latency_buckets, rstats.buckets, sizeof(rstats.buckets));
+    total_msec = rstats.total_msec;
+    max_msec = rstats.max_msec;
+
+    for (i = 0; i < count; i++) {
+        servers[i] = fstats[i].name;
+        successes[i] = fstats[i].successes;
+        failures[i] = fstats[i].failures;
+        transitions[i] = fstats[i].transitions;
+        srtt_usec[i] = fstats[i].rtt.srtt;
+        memcpy(&connect_histograms[i * FO_RTT_BUCKETS],
+               fstats[i].rtt.buckets, sizeof(fstats[i].rtt.buckets));
+    }
+
+    for (b = 0; b < FO_RTT_BUCKETS; b++) {
+        connect_limits[b] = fo_rtt_bucket_limit(b);
+    }
+    nservers = count;
+    nhist = count * FO_RTT_BUCKETS;
+
+    return sbus_request_return_and_finish(dbus_req,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &types, ntypes,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &outcomes, noutcomes,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &network, ncounters,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &cached, ncounters,
+                DBUS_TYPE_UINT64, &total_msec,
+                DBUS_TYPE_UINT64, &max_msec,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &latency_limits, nlatency,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &latency_buckets, nlatency,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &servers, nservers,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &successes, nservers,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &failures, nservers,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &transitions, nservers,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &srtt_usec, nservers,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &connect_limits, nconnect,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &connect_histograms, nhist,
+                DBUS_TYPE_INVALID);
+}
+
 static void be_pam_handler_callback(struct be_req *req,
                                     int dp_err_type,
                                     int errnum,
@@ -1495,6 +3434,8 @@ static int be_pam_handler(struct sbus_request *dbus_req, void *user_data)
     }
 
     be_req->req_data = pd;
+    be_req->prio = target == BET_ACCESS ? BE_REQ_PRIO_ACCESS
+                                        : BE_REQ_PRIO_AUTH;
 
     ret = be_file_request(becli->bectx->bet_info[target].pvt_bet_data,
                           be_req,
@@ -1989,6 +3930,9 @@ static int client_registration(struct sbus_request *dbus_req, void *data)
         becli->bectx->pac_cli = becli;
     } else if (strcasecmp(cli_name, "InfoPipe") == 0) {
         becli->bectx->ifp_cli = becli;
+    } else if (strcasecmp(cli_name, "NSS worker") == 0) {
+        /* NSS worker processes only send requests, the reverse calls
+         * belong to the main NSS responder */
     } else {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unknown client! [%s]\n", cli_name);
     }
@@ -2201,6 +4145,13 @@ static int be_srv_init(struct be_ctx *ctx,
         return ret;
     }
 
+    /* The responders fall back to D-Bus if the socket is not there */
+    ret = be_fast_init(ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "The fast transport of account requests is not available\n");
+    }
+
     return EOK;
 }
 
@@ -2410,6 +4361,17 @@ static void signal_be_offline(struct tevent_context *ev,
     be_mark_offline(ctx);
 }
 
+static void signal_be_dump_stats(struct tevent_context *ev,
+                                 struct tevent_signal *se,
+                                 int signum,
+                                 int count,
+                                 void *siginfo,
+                                 void *private_data)
+{
+    struct be_ctx *ctx = talloc_get_type(private_data, struct be_ctx);
+    be_fo_dump_stats(ctx);
+}
+
 static void signal_be_reset_offline(struct tevent_context *ev,
                                     struct tevent_signal *se,
                                     int signum,
@@ -2491,6 +4453,7 @@ int be_process_init(TALLOC_CTX *mem_ctx,
 {
     struct be_ctx *ctx;
     struct tevent_signal *tes;
+    int max_heavy;
     int ret;
 
     ctx = talloc_zero(mem_ctx, struct be_ctx);
@@ -2500,6 +4463,9 @@ int be_process_init(TALLOC_CTX *mem_ctx,
     }
     ctx->ev = ev;
     ctx->cdb = cdb;
+    ctx->req_pool = (struct sss_pool_size) SSS_POOL_SIZE_INIT(
+                                                    BE_REQ_POOL_MIN_SIZE,
+                                                    BE_REQ_POOL_MAX_SIZE);
     ctx->identity = talloc_asprintf(ctx, "%%BE_%s", be_domain);
     ctx->conf_path = talloc_asprintf(ctx, CONFDB_DOMAIN_PATH_TMPL, be_domain);
     if (!ctx->identity || !ctx->conf_path) {
@@ -2515,11 +4481,46 @@ int be_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
-    ret = sssd_domain_init(ctx, cdb, be_domain, DB_PATH, &ctx->domain);
+    ret = confdb_get_int(ctx->cdb, ctx->conf_path,
+                         CONFDB_DOMAIN_PTASK_MAX_HEAVY, 1, &max_heavy);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "fatal error reading " CONFDB_DOMAIN_PTASK_MAX_HEAVY "\n");
+        goto fail;
+    }
+    ctx->ptask_max_heavy = max_heavy < 0 ? 0 : max_heavy;
+
+    ret = confdb_get_int(ctx->cdb, ctx->conf_path,
+                         CONFDB_DOMAIN_SLOW_REQUEST_THRESHOLD, 0,
+                         &ctx->slow_request_threshold);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "fatal error reading "
+              CONFDB_DOMAIN_SLOW_REQUEST_THRESHOLD "\n");
+        goto fail;
+    }
+
+    /* the children of the providers are logged with their requests */
+    sss_child_set_spawn_hook(be_req_child_spawned);
+
+    server_startup_begin(STARTUP_PHASE_SYSDB);
+    ret = sssd_domain_init_ext(ctx, cdb, be_domain, DB_PATH,
+                               SYSDB_INIT_FLAG_NOSYNC, &ctx->domain);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "fatal error opening cache database\n");
         goto fail;
     }
+    server_startup_end(STARTUP_PHASE_SYSDB);
+
+    sysdb_set_snapshot_publisher(ctx->domain->sysdb,
+                                 ctx->domain->cache_snapshot_interval);
+
+    ret = sysdb_sync_init(ctx->domain->sysdb, ctx->ev,
+                          ctx->domain->cache_commit_delay);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "fatal error setting up the flushing of the cache\n");
+        goto fail;
+    }
 
     ret = sss_monitor_init(ctx, ctx->ev, &monitor_be_methods,
                            ctx->identity, DATA_PROVIDER_VERSION,
@@ -2556,8 +4557,11 @@ int be_process_init(TALLOC_CTX *mem_ctx,
     }
 
     if (ctx->domain->refresh_expired_interval > 0) {
+        /* the random offset keeps the hosts from refreshing at the same
+         * moment */
         ret = be_ptask_create(ctx, ctx, ctx->domain->refresh_expired_interval,
-                              30, 5, 0, ctx->domain->refresh_expired_interval,
+                              30, 5, ctx->domain->refresh_expired_interval / 4,
+                              ctx->domain->refresh_expired_interval,
                               BE_PTASK_OFFLINE_SKIP, 0,
                               be_refresh_send, be_refresh_recv,
                               ctx->refresh_ctx, "Refresh Records", NULL);
@@ -2568,6 +4572,7 @@ int be_process_init(TALLOC_CTX *mem_ctx,
         }
     }
 
+    server_startup_begin(STARTUP_PHASE_PROVIDERS);
     ret = load_backend_module(ctx, BET_ID,
                               &ctx->bet_info[BET_ID], NULL);
     if (ret != EOK) {
@@ -2700,6 +4705,7 @@ int be_process_init(TALLOC_CTX *mem_ctx,
                   "from provider [%s].\n",
                   ctx->bet_info[BET_SUBDOMAINS].mod_name);
     }
+    server_startup_end(STARTUP_PHASE_PROVIDERS);
 
     /* Handle SIGUSR1 to force offline behavior */
     BlockSignals(false, SIGUSR1);
@@ -2719,6 +4725,15 @@ int be_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    /* SIGHUP re-reads the debug level, also log the DNS and server stats */
+    tes = tevent_add_signal(ctx->ev, ctx, SIGHUP, 0,
+                            signal_be_dump_stats, ctx);
+    if (tes == NULL) {
+        ret = EIO;
+        goto fail;
+    }
+
+    server_startup_ready();
     return EOK;
 
 fail:
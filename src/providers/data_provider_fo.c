@@ -19,6 +19,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <sys/socket.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include "providers/dp_backend.h"
@@ -47,6 +48,8 @@ struct be_svc_data {
 
     struct be_svc_callback *callbacks;
     struct fo_server *first_resolved;
+
+    struct be_fo_probe *probe;
 };
 
 struct be_failover_ctx {
@@ -55,8 +58,36 @@ struct be_failover_ctx {
 
     struct be_svc_data *svcs;
     struct tevent_timer *primary_server_handler;
+
+    /* offline_probe_timeout, 0 if the servers are not probed */
+    int probe_timeout;
+
+    struct tevent_timer *reevaluate_handler;
 };
 
+/* How often the active servers are compared with the other servers of their
+ * service, to move away from a server which became slow or unreliable */
+#define BE_FO_REEVALUATE_INTERVAL 300
+
+/* The servers of a service are probed at most this often */
+#define BE_FO_PROBE_MIN_INTERVAL 10
+
+struct be_fo_probe {
+    struct be_ctx *be_ctx;
+    struct be_svc_data *svc;
+    be_fo_unreachable_fn_t *fn;
+    void *pvt;
+
+    /* started when a server was handed out, until it works */
+    struct tevent_timer *watch;
+    /* parent of the running connections and the servers they use */
+    TALLOC_CTX *probe_ctx;
+    int pending;
+    time_t last_probe;
+};
+
+static void be_fo_probe_start(struct be_fo_probe *probe);
+
 static const char *proto_table[] = { FO_PROTO_TCP, FO_PROTO_UDP, NULL };
 
 int be_fo_is_srv_identifier(const char *server)
@@ -76,6 +107,35 @@ static int be_fo_get_options(struct be_ctx *ctx,
     return EOK;
 }
 
+static void be_fo_reevaluate(struct tevent_context *ev,
+                             struct tevent_timer *te,
+                             struct timeval tv, void *pvt)
+{
+    struct be_ctx *ctx = talloc_get_type(pvt, struct be_ctx);
+    struct be_svc_data *svc;
+    bool switched = false;
+
+    ctx->be_fo->reevaluate_handler = NULL;
+
+    DLIST_FOR_EACH(svc, ctx->be_fo->svcs) {
+        if (fo_prefer_faster_server(svc->fo_service)) {
+            switched = true;
+        }
+    }
+
+    if (switched) {
+        /* the cached connections go to the servers used until now */
+        be_run_reconnect_cb(ctx);
+    }
+
+    ctx->be_fo->reevaluate_handler = tevent_add_timer(ev, ctx->be_fo,
+                    tevent_timeval_current_ofs(BE_FO_REEVALUATE_INTERVAL, 0),
+                    be_fo_reevaluate, ctx);
+    if (ctx->be_fo->reevaluate_handler == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot schedule the server selection\n");
+    }
+}
+
 int be_init_failover(struct be_ctx *ctx)
 {
     int ret;
@@ -90,6 +150,16 @@ int be_init_failover(struct be_ctx *ctx)
         return ENOMEM;
     }
 
+    ret = confdb_get_int(ctx->cdb, ctx->conf_path,
+                         CONFDB_DOMAIN_OFFLINE_PROBE_TIMEOUT, 5,
+                         &ctx->be_fo->probe_timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Failed to read " CONFDB_DOMAIN_OFFLINE_PROBE_TIMEOUT "\n");
+        talloc_zfree(ctx->be_fo);
+        return ret;
+    }
+
     ret = be_res_init(ctx);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE,
@@ -111,6 +181,14 @@ int be_init_failover(struct be_ctx *ctx)
         return ENOMEM;
     }
 
+    ctx->be_fo->reevaluate_handler = tevent_add_timer(ctx->ev, ctx->be_fo,
+                    tevent_timeval_current_ofs(BE_FO_REEVALUATE_INTERVAL, 0),
+                    be_fo_reevaluate, ctx);
+    if (ctx->be_fo->reevaluate_handler == NULL) {
+        talloc_zfree(ctx->be_fo);
+        return ENOMEM;
+    }
+
     return EOK;
 }
 
@@ -190,6 +268,10 @@ int be_fo_add_service(struct be_ctx *ctx, const char *service_name,
 
     DLIST_ADD(ctx->be_fo->svcs, svc);
 
+    /* ends when a server of any of the services works or the backend goes
+     * offline */
+    server_startup_begin(STARTUP_PHASE_ONLINE);
+
     return EOK;
 }
 
@@ -254,6 +336,13 @@ void be_fo_set_srv_lookup_plugin(struct be_ctx *ctx,
     }
 }
 
+errno_t be_fo_record_server_rtt(struct be_ctx *ctx,
+                                const char *server_name,
+                                uint32_t rtt_usec)
+{
+    return fo_record_server_rtt(ctx->be_fo->fo_ctx, server_name, rtt_usec);
+}
+
 errno_t be_fo_set_dns_srv_lookup_plugin(struct be_ctx *be_ctx,
                                         const char *hostname)
 {
@@ -524,6 +613,9 @@ be_primary_server_timeout_activate(TALLOC_CTX *mem_ctx,
 
 
 static void be_resolve_server_done(struct tevent_req *subreq);
+static void be_fo_probe_watch(struct tevent_context *ev,
+                              struct tevent_timer *te,
+                              struct timeval tv, void *pvt);
 
 struct tevent_req *be_resolve_server_send(TALLOC_CTX *memctx,
                                           struct tevent_context *ev,
@@ -584,6 +676,20 @@ static void be_resolve_server_done(struct tevent_req *subreq)
         goto fail;
     }
 
+    if (state->svc->probe != NULL && state->svc->probe->watch == NULL
+            && state->svc->probe->probe_ctx == NULL
+            && state->ctx->be_fo->probe_timeout > 0) {
+        /* the probe starts unless the server works before the timeout */
+        state->svc->probe->watch = tevent_add_timer(state->ev,
+                            state->svc->probe,
+                            tevent_timeval_current_ofs(
+                                state->ctx->be_fo->probe_timeout, 0),
+                            be_fo_probe_watch, state->svc->probe);
+        if (state->svc->probe->watch == NULL) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Cannot watch the connection\n");
+        }
+    }
+
     if (!fo_is_server_primary(state->srv)) {
         /* FIXME: make the timeout configurable */
         ret = be_primary_server_timeout_activate(state->ctx, state->ev,
@@ -732,6 +838,18 @@ void be_fo_try_next_server(struct be_ctx *ctx, const char *service_name)
     }
 }
 
+bool be_fo_prefer_faster_server(struct be_ctx *ctx, const char *service_name)
+{
+    struct be_svc_data *svc;
+
+    svc = be_fo_find_svc_data(ctx, service_name);
+    if (svc == NULL) {
+        return false;
+    }
+
+    return fo_prefer_faster_server(svc->fo_service);
+}
+
 const char *be_fo_get_active_server_name(struct be_ctx *ctx,
                                          const char *service_name)
 {
@@ -749,6 +867,68 @@ const char *be_fo_get_active_server_name(struct be_ctx *ctx,
     return NULL;
 }
 
+errno_t be_fo_get_resolved_servers(TALLOC_CTX *mem_ctx,
+                                   struct be_ctx *ctx,
+                                   const char *service_name,
+                                   struct fo_server ***_servers,
+                                   size_t *_count)
+{
+    struct be_svc_data *svc;
+
+    svc = be_fo_find_svc_data(ctx, service_name);
+    if (svc == NULL) {
+        return ENOENT;
+    }
+
+    return fo_get_resolved_servers(mem_ctx, svc->fo_service,
+                                   _servers, _count);
+}
+
+void be_fo_set_server_probed(struct be_ctx *ctx,
+                             const char *service_name,
+                             struct fo_server *server,
+                             bool working)
+{
+    struct be_svc_data *be_svc;
+
+    be_svc = be_fo_find_svc_data(ctx, service_name);
+    if (be_svc == NULL || !fo_svc_has_server(be_svc->fo_service, server)) {
+        /* removed by an SRV refresh in the meantime */
+        return;
+    }
+
+    if (working) {
+        if (!fo_is_server_usable(server)) {
+            fo_set_server_recovered(server);
+        }
+    } else {
+        fo_set_port_status(server, PORT_NOT_WORKING);
+    }
+}
+
+errno_t be_fo_get_server_stats(TALLOC_CTX *mem_ctx,
+                               struct be_ctx *ctx,
+                               struct fo_server_stats **_stats,
+                               size_t *_count)
+{
+    if (ctx->be_fo == NULL) {
+        return ENOENT;
+    }
+
+    return fo_get_server_stats(mem_ctx, ctx->be_fo->fo_ctx, _stats, _count);
+}
+
+void be_fo_dump_stats(struct be_ctx *ctx)
+{
+    if (ctx->be_res != NULL) {
+        resolv_dump_stats(ctx->be_res->resolv);
+    }
+
+    if (ctx->be_fo != NULL) {
+        fo_dump_stats(ctx->be_fo->fo_ctx);
+    }
+}
+
 int be_fo_run_callbacks_at_next_request(struct be_ctx *ctx,
                                         const char *service_name)
 {
@@ -838,7 +1018,302 @@ void _be_fo_set_port_status(struct be_ctx *ctx,
         /* We were successful in connecting to the server. Cycle through all
          * available servers next time */
         be_svc->first_resolved = NULL;
+        server_startup_end(STARTUP_PHASE_ONLINE);
+
+        if (be_svc->probe != NULL) {
+            talloc_zfree(be_svc->probe->watch);
+        }
+    } else if (status == PORT_NOT_WORKING && be_svc->probe != NULL) {
+        be_fo_probe_start(be_svc->probe);
+    }
+}
+
+struct be_fo_connect_state {
+    int fd;
+};
+
+static void be_fo_connect_done(struct tevent_context *ev,
+                               struct tevent_fd *fde,
+                               uint16_t flags, void *pvt);
+static void be_fo_connect_timeout(struct tevent_context *ev,
+                                  struct tevent_timer *te,
+                                  struct timeval tv, void *pvt);
+
+static int be_fo_connect_state_destructor(struct be_fo_connect_state *state)
+{
+    if (state->fd != -1) {
+        close(state->fd);
+    }
+
+    return 0;
+}
+
+struct tevent_req *be_fo_connect_send(TALLOC_CTX *mem_ctx,
+                                      struct tevent_context *ev,
+                                      struct sockaddr_storage *addr,
+                                      int timeout)
+{
+    struct be_fo_connect_state *state;
+    struct tevent_req *req;
+    struct tevent_fd *fde;
+    struct tevent_timer *te;
+    socklen_t addr_len;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct be_fo_connect_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->fd = socket(addr->ss_family, SOCK_STREAM, 0);
+    if (state->fd == -1) {
+        ret = errno;
+        goto done;
+    }
+    talloc_set_destructor(state, be_fo_connect_state_destructor);
+
+    ret = sss_fd_nonblocking(state->fd);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    addr_len = addr->ss_family == AF_INET6 ? sizeof(struct sockaddr_in6)
+                                           : sizeof(struct sockaddr_in);
+
+    ret = connect(state->fd, (struct sockaddr *) addr, addr_len);
+    if (ret == 0) {
+        goto done;
+    } else if (errno != EINPROGRESS) {
+        ret = errno;
+        goto done;
+    }
+
+    fde = tevent_add_fd(ev, state, state->fd, TEVENT_FD_WRITE,
+                        be_fo_connect_done, req);
+    te = tevent_add_timer(ev, state, tevent_timeval_current_ofs(timeout, 0),
+                          be_fo_connect_timeout, req);
+    if (fde == NULL || te == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    return req;
+
+done:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static void be_fo_connect_done(struct tevent_context *ev,
+                               struct tevent_fd *fde,
+                               uint16_t flags, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct be_fo_connect_state *state =
+            tevent_req_data(req, struct be_fo_connect_state);
+    socklen_t len = sizeof(int);
+    int err;
+    int ret;
+
+    ret = getsockopt(state->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (ret == -1) {
+        err = errno;
+    }
+
+    if (err != 0) {
+        tevent_req_error(req, err);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static void be_fo_connect_timeout(struct tevent_context *ev,
+                                  struct tevent_timer *te,
+                                  struct timeval tv, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+
+    tevent_req_error(req, ETIMEDOUT);
+}
+
+errno_t be_fo_connect_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+struct be_fo_probe_conn {
+    struct be_fo_probe *probe;
+    struct fo_server *srv;
+};
+
+static void be_fo_probe_done(struct tevent_req *subreq);
+
+static void be_fo_probe_watch(struct tevent_context *ev,
+                              struct tevent_timer *te,
+                              struct timeval tv, void *pvt)
+{
+    struct be_fo_probe *probe = talloc_get_type(pvt, struct be_fo_probe);
+
+    probe->watch = NULL;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "No server of service %s worked in time, "
+          "probing the servers\n", probe->svc->name);
+    be_fo_probe_start(probe);
+}
+
+static void be_fo_probe_start(struct be_fo_probe *probe)
+{
+    struct be_fo_probe_conn *conn;
+    struct sockaddr_storage *addr;
+    struct fo_server **servers;
+    struct tevent_req *subreq;
+    size_t count;
+    size_t i;
+    time_t now;
+    int port;
+    errno_t ret;
+
+    talloc_zfree(probe->watch);
+
+    if (probe->probe_ctx != NULL || probe->be_ctx->be_fo->probe_timeout <= 0
+            || probe->be_ctx->offstat.offline) {
+        return;
+    }
+
+    now = time(NULL);
+    if (now < probe->last_probe + BE_FO_PROBE_MIN_INTERVAL) {
+        return;
+    }
+    probe->last_probe = now;
+
+    probe->probe_ctx = talloc_new(probe);
+    if (probe->probe_ctx == NULL) {
+        return;
+    }
+
+    ret = fo_get_resolved_servers(probe->probe_ctx, probe->svc->fo_service,
+                                  &servers, &count);
+    if (ret != EOK) {
+        talloc_zfree(probe->probe_ctx);
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        port = fo_get_server_port(servers[i]);
+        if (port == 0) {
+            /* the protocol default is not known here */
+            continue;
+        }
+
+        addr = resolv_get_sockaddr_address(probe->probe_ctx,
+                                           fo_get_server_hostent(servers[i]),
+                                           port);
+        conn = talloc_zero(probe->probe_ctx, struct be_fo_probe_conn);
+        if (addr == NULL || conn == NULL) {
+            break;
+        }
+        conn->probe = probe;
+        conn->srv = servers[i];
+        fo_ref_server(conn, servers[i]);
+
+        subreq = be_fo_connect_send(conn, probe->be_ctx->ev, addr,
+                                    probe->be_ctx->be_fo->probe_timeout);
+        if (subreq == NULL) {
+            break;
+        }
+        tevent_req_set_callback(subreq, be_fo_probe_done, conn);
+        probe->pending++;
+    }
+
+    if (i < count || probe->pending == 0) {
+        /* nothing can be said about the servers */
+        probe->pending = 0;
+        talloc_zfree(probe->probe_ctx);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Probing %d servers of service %s\n",
+          probe->pending, probe->svc->name);
+}
+
+static void be_fo_probe_done(struct tevent_req *subreq)
+{
+    struct be_fo_probe_conn *conn = tevent_req_callback_data(subreq,
+                                                    struct be_fo_probe_conn);
+    struct be_fo_probe *probe = conn->probe;
+    errno_t ret;
+
+    ret = be_fo_connect_recv(subreq);
+    talloc_zfree(subreq);
+    probe->pending--;
+
+    /* a refused connection means that the network and the host are up, the
+     * service will answer the next request quickly on its own */
+    if (ret == EOK || ret == ECONNREFUSED) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Server [%s] of service %s can be reached\n",
+              fo_get_server_name(conn->srv), probe->svc->name);
+        probe->pending = 0;
+        talloc_zfree(probe->probe_ctx);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Server [%s] of service %s cannot be reached "
+          "[%d]: %s\n", fo_get_server_name(conn->srv), probe->svc->name,
+          ret, sss_strerror(ret));
+    if (fo_svc_has_server(probe->svc->fo_service, conn->srv)) {
+        fo_set_port_status(conn->srv, PORT_NOT_WORKING);
+    }
+    talloc_free(conn);
+
+    if (probe->pending > 0) {
+        return;
+    }
+
+    talloc_zfree(probe->probe_ctx);
+    if (probe->be_ctx->offstat.offline) {
+        return;
+    }
+
+    DEBUG(SSSDBG_OP_FAILURE, "No server of service %s can be reached\n",
+          probe->svc->name);
+    probe->fn(probe->pvt);
+}
+
+errno_t be_fo_set_unreachable_probe(struct be_ctx *ctx,
+                                    const char *service_name,
+                                    be_fo_unreachable_fn_t *fn,
+                                    void *pvt)
+{
+    struct be_svc_data *svc;
+
+    svc = be_fo_find_svc_data(ctx, service_name);
+    if (svc == NULL) {
+        return ENOENT;
+    }
+
+    if (svc->probe != NULL) {
+        return EEXIST;
     }
+
+    svc->probe = talloc_zero(svc, struct be_fo_probe);
+    if (svc->probe == NULL) {
+        return ENOMEM;
+    }
+
+    svc->probe->be_ctx = ctx;
+    svc->probe->svc = svc;
+    svc->probe->fn = fn;
+    svc->probe->pvt = pvt;
+
+    return EOK;
 }
 
 /* Resolver back end interface */
@@ -57,6 +57,34 @@ const struct sbus_method_meta data_provider_iface__methods[] = {
         offsetof(struct data_provider_iface, getAccountInfo),
         NULL, /* no invoker */
     },
+    {
+        "getAccountInfoMulti", /* name */
+        NULL, /* no in_args */
+        NULL, /* no out_args */
+        offsetof(struct data_provider_iface, getAccountInfoMulti),
+        NULL, /* no invoker */
+    },
+    {
+        "getTaskStats", /* name */
+        NULL, /* no in_args */
+        NULL, /* no out_args */
+        offsetof(struct data_provider_iface, getTaskStats),
+        NULL, /* no invoker */
+    },
+    {
+        "getResolverStats", /* name */
+        NULL, /* no in_args */
+        NULL, /* no out_args */
+        offsetof(struct data_provider_iface, getResolverStats),
+        NULL, /* no invoker */
+    },
+    {
+        "getCacheMetrics", /* name */
+        NULL, /* no in_args */
+        NULL, /* no out_args */
+        offsetof(struct data_provider_iface, getCacheMetrics),
+        NULL, /* no invoker */
+    },
     { NULL, }
 };
 
@@ -85,6 +113,13 @@ const struct sbus_method_meta data_provider_rev_iface__methods[] = {
         offsetof(struct data_provider_rev_iface, initgrCheck),
         NULL, /* no invoker */
     },
+    {
+        "objectsChanged", /* name */
+        NULL, /* no in_args */
+        NULL, /* no out_args */
+        offsetof(struct data_provider_rev_iface, objectsChanged),
+        NULL, /* no invoker */
+    },
     { NULL, }
 };
 
@@ -20,11 +20,16 @@
 #define DATA_PROVIDER_IFACE_HOSTHANDLER "hostHandler"
 #define DATA_PROVIDER_IFACE_GETDOMAINS "getDomains"
 #define DATA_PROVIDER_IFACE_GETACCOUNTINFO "getAccountInfo"
+#define DATA_PROVIDER_IFACE_GETACCOUNTINFOMULTI "getAccountInfoMulti"
+#define DATA_PROVIDER_IFACE_GETTASKSTATS "getTaskStats"
+#define DATA_PROVIDER_IFACE_GETRESOLVERSTATS "getResolverStats"
+#define DATA_PROVIDER_IFACE_GETCACHEMETRICS "getCacheMetrics"
 
 /* constants for org.freedesktop.sssd.dataprovider_rev */
 #define DATA_PROVIDER_REV_IFACE "org.freedesktop.sssd.dataprovider_rev"
 #define DATA_PROVIDER_REV_IFACE_UPDATECACHE "updateCache"
 #define DATA_PROVIDER_REV_IFACE_INITGRCHECK "initgrCheck"
+#define DATA_PROVIDER_REV_IFACE_OBJECTSCHANGED "objectsChanged"
 
 /* ------------------------------------------------------------------------
  * DBus handlers
@@ -54,6 +59,10 @@ struct data_provider_iface {
     sbus_msg_handler_fn hostHandler;
     sbus_msg_handler_fn getDomains;
     sbus_msg_handler_fn getAccountInfo;
+    sbus_msg_handler_fn getAccountInfoMulti;
+    sbus_msg_handler_fn getTaskStats;
+    sbus_msg_handler_fn getResolverStats;
+    sbus_msg_handler_fn getCacheMetrics;
 };
 
 /* vtable for org.freedesktop.sssd.dataprovider_rev */
@@ -61,6 +70,7 @@ struct data_provider_rev_iface {
     struct sbus_vtable vtable; /* derive from sbus_vtable */
     sbus_msg_handler_fn updateCache;
     sbus_msg_handler_fn initgrCheck;
+    sbus_msg_handler_fn objectsChanged;
 };
 
 /* ------------------------------------------------------------------------
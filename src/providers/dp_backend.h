@@ -99,6 +99,30 @@ struct be_client {
 struct be_failover_ctx;
 
 struct be_cb;
+struct be_initgr_memo;
+struct be_negcache;
+struct be_ifp_notify;
+struct be_dispatch;
+
+/* Finished requests of one type, for getCacheMetrics */
+struct be_req_stats {
+    const char *type;
+    uint64_t count;
+    /* the requests which did not end with DP_ERR_OK */
+    uint64_t failures;
+    uint64_t total_usec;
+    uint64_t max_usec;
+};
+
+/* LDAP operations over all connections of the back end */
+struct be_ldap_stats {
+    uint64_t ops;
+    /* operations which got their final result, and the time they took */
+    uint64_t results;
+    uint64_t total_usec;
+    uint64_t max_usec;
+    uint64_t timeouts;
+};
 
 struct be_ctx {
     struct tevent_context *ev;
@@ -127,6 +151,10 @@ struct be_ctx {
     struct be_offline_status offstat;
     /* Periodicly check if we can go online. */
     struct be_ptask *check_if_online_ptask;
+    /* All periodic tasks of the back end */
+    struct be_ptask *ptasks;
+    /* How many heavy periodic tasks may run at once, 0 for no limit */
+    uint32_t ptask_max_heavy;
 
     struct sbus_connection *mon_conn;
     struct sbus_connection *sbus_srv;
@@ -148,6 +176,34 @@ struct be_ctx {
 
     /* List of ongoing requests */
     struct be_req *active_requests;
+    /* talloc pool of each request, see be_req_create() */
+    struct sss_pool_size req_pool;
+    /* the requests slower than that many ms are logged, 0 to disable */
+    int slow_request_threshold;
+    uint32_t last_req_id;
+
+    /* Users whose initgroups refresh succeeded recently */
+    struct be_initgr_memo *initgr_memo;
+
+    /* Users and groups which were not found recently */
+    struct be_negcache *negcache;
+
+    /* Account requests which are waiting for the provider */
+    hash_table_t *pending_acct;
+
+    /* Refreshed users and groups not reported to InfoPipe yet */
+    struct be_ifp_notify *ifp_notify;
+
+    /* Requests which wait for or run in the provider, by their class */
+    struct be_dispatch *dispatch;
+
+    /* Counters for getCacheMetrics */
+    struct be_req_stats *req_stats;
+    size_t num_req_stats;
+    struct be_ldap_stats ldap_stats;
+    uint64_t negcache_hits;
+    uint64_t initgr_memo_hits;
+    uint64_t pending_joins;
 };
 
 struct bet_ops {
@@ -163,6 +219,8 @@ struct be_acct_req {
     char *filter_value;
     char *extra_value;
     char *domain;
+    /* the id of the client request in the responder, 0 if none */
+    uint32_t req_id;
 };
 
 struct be_sudo_req {
@@ -243,6 +301,16 @@ void be_fo_set_srv_lookup_plugin(struct be_ctx *ctx,
 errno_t be_fo_set_dns_srv_lookup_plugin(struct be_ctx *be_ctx,
                                         const char *hostname);
 
+/* Feeds a round trip time measured against the server into the fail over,
+ * the SRV lookup results are ordered by it. */
+errno_t be_fo_record_server_rtt(struct be_ctx *ctx,
+                                const char *server_name,
+                                uint32_t rtt_usec);
+
+/* Switches the service to a considerably faster working server, see
+ * fo_prefer_faster_server(). */
+bool be_fo_prefer_faster_server(struct be_ctx *ctx, const char *service_name);
+
 int be_fo_add_srv_server(struct be_ctx *ctx,
                          const char *service_name,
                          const char *query_service,
@@ -290,6 +358,54 @@ void be_fo_reset_svc(struct be_ctx *be_ctx, const char *svc_name);
 const char *be_fo_get_active_server_name(struct be_ctx *ctx,
                                          const char *service_name);
 
+/* The servers of the service whose address is known, NULL-terminated */
+errno_t be_fo_get_resolved_servers(TALLOC_CTX *mem_ctx,
+                                   struct be_ctx *ctx,
+                                   const char *service_name,
+                                   struct fo_server ***_servers,
+                                   size_t *_count);
+
+/*
+ * Feeds the result of a background probe of the server back. A server which
+ * answered can be used again right away, one which did not is marked as not
+ * working without going offline.
+ */
+void be_fo_set_server_probed(struct be_ctx *ctx,
+                             const char *service_name,
+                             struct fo_server *server,
+                             bool working);
+
+/* The statistics of all servers of the back end, ENOENT without fail over */
+errno_t be_fo_get_server_stats(TALLOC_CTX *mem_ctx,
+                               struct be_ctx *ctx,
+                               struct fo_server_stats **_stats,
+                               size_t *_count);
+
+/* Writes the statistics of the resolver and of the servers to the debug log */
+void be_fo_dump_stats(struct be_ctx *ctx);
+
+typedef void (be_fo_unreachable_fn_t)(void *pvt);
+
+/*
+ * Watch the servers of the service in the background. When a server stops
+ * working, or a connection is not established within
+ * offline_probe_timeout seconds, a TCP connection is opened to every
+ * server whose address is known. If none of them answers within the same
+ * timeout, fn is called, typically to mark the back end offline.
+ */
+errno_t be_fo_set_unreachable_probe(struct be_ctx *ctx,
+                                    const char *service_name,
+                                    be_fo_unreachable_fn_t *fn,
+                                    void *pvt);
+
+/* Open a TCP connection to addr and close it again. A refused connection
+ * fails with ECONNREFUSED, no answer within timeout with ETIMEDOUT. */
+struct tevent_req *be_fo_connect_send(TALLOC_CTX *mem_ctx,
+                                      struct tevent_context *ev,
+                                      struct sockaddr_storage *addr,
+                                      int timeout);
+errno_t be_fo_connect_recv(struct tevent_req *req);
+
 errno_t be_res_init(struct be_ctx *ctx);
 
 /* be_req helpers */
@@ -311,9 +427,26 @@ void *be_req_get_data(struct be_req *be_req);
 void be_req_terminate(struct be_req *be_req,
                       int dp_err_type, int errnum, const char *errstr);
 
+/* The request @mem_ctx is allocated below, NULL if none. The requests of
+ * the providers are allocated below the be_req they serve. */
+struct be_req *be_req_find(TALLOC_CTX *mem_ctx);
+
+/* The id of @be_req in the logs, 0 if @be_req is NULL */
+uint32_t be_req_get_id(struct be_req *be_req);
+
+/* Adds an LDAP operation which took @usec to the stages of @be_req */
+void be_req_add_ldap_op(struct be_req *be_req, uint64_t usec);
+
+/* The back end @mem_ctx is allocated below, NULL if none. The contexts of
+ * the providers and their connections are allocated below the be_ctx. */
+struct be_ctx *be_ctx_find(TALLOC_CTX *mem_ctx);
+
 void be_terminate_domain_requests(struct be_ctx *be_ctx,
                                   const char *domain);
 
+/* Parses the filter of a getAccountInfo request, e.g. "name=user" */
+errno_t be_acct_req_set_filter(struct be_acct_req *req, const char *filter);
+
 /* Request account information */
 struct tevent_req *
 be_get_account_info_send(TALLOC_CTX *mem_ctx,
@@ -328,4 +461,8 @@ errno_t be_get_account_info_recv(struct tevent_req *req,
                                  int *_err_min,
                                  const char **_err_msg);
 
+/* Accepts account requests of the responders on the socket returned by
+ * dp_get_fast_address(), see data_provider.h */
+errno_t be_fast_init(struct be_ctx *be_ctx);
+
 #endif /* __DP_BACKEND_H___ */
@@ -0,0 +1,513 @@
+/*
+    SSSD
+
+    Framed binary transport of the account requests
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <talloc.h>
+#include <tevent.h>
+
+#include "util/util.h"
+#include "providers/dp_backend.h"
+
+/* The responders may send their getAccountInfo requests over this socket
+ * instead of D-Bus, the format of the frames is described in
+ * data_provider.h. The requests are handled exactly like the ones which
+ * arrive over D-Bus. */
+
+/* a client which does not read its replies is disconnected */
+#define BE_FAST_MAX_OUTPUT (1024 * 1024)
+
+struct be_fast_srv {
+    struct be_ctx *be_ctx;
+    char *path;
+    int fd;
+    struct tevent_fd *fde;
+};
+
+struct be_fast_cli {
+    struct be_fast_srv *srv;
+    int fd;
+    struct tevent_fd *fde;
+
+    uint8_t *in;
+    size_t in_len;
+
+    uint8_t *out;
+    size_t out_len;
+};
+
+struct be_fast_call {
+    struct be_fast_cli *cli;
+    uint32_t id;
+};
+
+static int be_fast_cli_destructor(struct be_fast_cli *cli)
+{
+    talloc_zfree(cli->fde);
+    if (cli->fd != -1) {
+        close(cli->fd);
+    }
+    return 0;
+}
+
+static int be_fast_srv_destructor(struct be_fast_srv *srv)
+{
+    talloc_zfree(srv->fde);
+    if (srv->fd != -1) {
+        close(srv->fd);
+        unlink(srv->path);
+    }
+    return 0;
+}
+
+static errno_t be_fast_fd_setup(int fd)
+{
+    int flags;
+    errno_t ret;
+
+    ret = sss_fd_nonblocking(fd);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    flags = fcntl(fd, F_GETFD, 0);
+    if (flags == -1 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
+        return errno;
+    }
+
+    return EOK;
+}
+
+static void be_fast_cli_handler(struct tevent_context *ev,
+                                struct tevent_fd *fde,
+                                uint16_t flags, void *pvt);
+
+static errno_t be_fast_reply(struct be_fast_cli *cli, uint32_t id,
+                            uint32_t dp_err, uint32_t dp_ret,
+                            const char *err_msg)
+{
+    uint32_t msg_len;
+    uint32_t frame_len;
+    uint8_t *out;
+    size_t p;
+
+    if (err_msg == NULL) {
+        err_msg = "";
+    }
+    msg_len = strlen(err_msg);
+    frame_len = 4 * sizeof(uint32_t) + msg_len;
+
+    if (cli->out_len + sizeof(uint32_t) + frame_len > BE_FAST_MAX_OUTPUT) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "A client of the fast socket does not read its replies\n");
+        return EIO;
+    }
+
+    out = talloc_realloc(cli, cli->out, uint8_t,
+                         cli->out_len + sizeof(uint32_t) + frame_len);
+    if (out == NULL) {
+        return ENOMEM;
+    }
+    cli->out = out;
+
+    p = cli->out_len;
+    SAFEALIGN_SET_UINT32(&out[p], frame_len, &p);
+    SAFEALIGN_SET_UINT32(&out[p], id, &p);
+    SAFEALIGN_SET_UINT32(&out[p], dp_err, &p);
+    SAFEALIGN_SET_UINT32(&out[p], dp_ret, &p);
+    SAFEALIGN_SET_UINT32(&out[p], msg_len, &p);
+    safealign_memcpy(&out[p], err_msg, msg_len, &p);
+    cli->out_len = p;
+
+    TEVENT_FD_WRITEABLE(cli->fde);
+    return EOK;
+}
+
+static void be_fast_call_done(struct tevent_req *subreq)
+{
+    struct be_fast_call *call;
+    struct be_fast_cli *cli;
+    const char *err_msg = NULL;
+    int err_maj;
+    int err_min;
+    uint32_t id;
+    errno_t ret;
+
+    call = tevent_req_callback_data(subreq, struct be_fast_call);
+    cli = call->cli;
+    id = call->id;
+
+    ret = be_get_account_info_recv(subreq, cli, &err_maj, &err_min, &err_msg);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        err_maj = DP_ERR_FATAL;
+        err_min = ret;
+        err_msg = "Cannot handle the account request";
+    }
+
+    if (id != 0) {
+        ret = be_fast_reply(cli, id, err_maj, err_min, err_msg);
+        if (ret != EOK) {
+            talloc_free(cli);
+        }
+    }
+}
+
+static errno_t be_fast_get_string(TALLOC_CTX *mem_ctx,
+                                  uint8_t *body, size_t len, size_t *p,
+                                  char **_str)
+{
+    uint32_t str_len;
+
+    SAFEALIGN_COPY_UINT32_CHECK(&str_len, &body[*p], len, p);
+    if (str_len > len - *p) {
+        return EINVAL;
+    }
+
+    *_str = talloc_strndup(mem_ctx, (char *) &body[*p], str_len);
+    if (*_str == NULL) {
+        return ENOMEM;
+    }
+    *p += str_len;
+
+    return EOK;
+}
+
+static errno_t be_fast_parse(TALLOC_CTX *mem_ctx,
+                             uint8_t *body, size_t len,
+                             uint32_t *_id,
+                             struct be_acct_req **_ar)
+{
+    struct be_acct_req *ar;
+    uint32_t type;
+    uint32_t attr_type;
+    char *filter;
+    size_t p = 0;
+    errno_t ret;
+
+    SAFEALIGN_COPY_UINT32_CHECK(_id, body, len, &p);
+    SAFEALIGN_COPY_UINT32_CHECK(&type, &body[p], len, &p);
+    SAFEALIGN_COPY_UINT32_CHECK(&attr_type, &body[p], len, &p);
+
+    if ((attr_type != BE_ATTR_CORE) &&
+        (attr_type != BE_ATTR_MEM) &&
+        (attr_type != BE_ATTR_ALL)) {
+        return EINVAL;
+    }
+
+    ar = talloc_zero(mem_ctx, struct be_acct_req);
+    if (ar == NULL) {
+        return ENOMEM;
+    }
+    ar->entry_type = type;
+    ar->attr_type = attr_type;
+
+    ret = be_fast_get_string(ar, body, len, &p, &filter);
+    if (ret == EOK) {
+        ret = be_fast_get_string(ar, body, len, &p, &ar->domain);
+    }
+    if (ret == EOK && len - p >= sizeof(uint32_t)) {
+        /* the id of the client request, optional */
+        SAFEALIGN_COPY_UINT32(&ar->req_id, &body[p], &p);
+    }
+    if (ret == EOK) {
+        ret = be_acct_req_set_filter(ar, filter);
+    }
+    if (ret != EOK) {
+        talloc_free(ar);
+        return ret;
+    }
+
+    *_ar = ar;
+    return EOK;
+}
+
+static errno_t be_fast_request(struct be_fast_cli *cli,
+                              uint8_t *body, size_t len)
+{
+    struct be_ctx *be_ctx = cli->srv->be_ctx;
+    struct be_fast_call *call;
+    struct tevent_req *subreq;
+    struct be_acct_req *ar;
+    uint32_t id = 0;
+    errno_t ret;
+
+    ret = be_fast_parse(cli, body, len, &id, &ar);
+    if (ret != EOK) {
+        return be_fast_reply(cli, id, DP_ERR_FATAL, EINVAL, "Invalid request");
+    }
+
+    DEBUG(SSSDBG_FUNC_DATA,
+          "Got fast request for [%#x][%s][%d][%s]\n", ar->entry_type,
+          be_req2str(ar->entry_type), ar->attr_type,
+          ar->filter_value ? ar->filter_value : "-");
+
+    if ((ar->entry_type & BE_REQ_FAST) && be_is_offline(be_ctx)) {
+        /* the request is still processed in case we are going back
+         * online, but not answered again */
+        ret = be_fast_reply(cli, id, DP_ERR_OFFLINE, EAGAIN,
+                            "Fast reply - offline");
+        if (ret != EOK) {
+            talloc_free(ar);
+            return ret;
+        }
+        id = 0;
+    }
+
+    subreq = be_get_account_info_send(cli, be_ctx->ev, NULL, be_ctx, ar);
+    if (subreq == NULL) {
+        talloc_free(ar);
+        return ENOMEM;
+    }
+    talloc_steal(subreq, ar);
+
+    call = talloc_zero(subreq, struct be_fast_call);
+    if (call == NULL) {
+        talloc_free(subreq);
+        return ENOMEM;
+    }
+    call->cli = cli;
+    call->id = id;
+
+    tevent_req_set_callback(subreq, be_fast_call_done, call);
+    return EOK;
+}
+
+static errno_t be_fast_cli_read(struct be_fast_cli *cli)
+{
+    uint32_t frame_len;
+    size_t used = 0;
+    size_t p;
+    ssize_t len;
+    errno_t ret;
+
+    len = read(cli->fd, &cli->in[cli->in_len],
+               sizeof(uint32_t) + DP_FAST_MAX_FRAME - cli->in_len);
+    if (len == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return EOK;
+        }
+        return errno;
+    } else if (len == 0) {
+        /* the responder went away */
+        return ENOTCONN;
+    }
+    cli->in_len += len;
+
+    while (cli->in_len - used >= sizeof(uint32_t)) {
+        p = used;
+        SAFEALIGN_COPY_UINT32(&frame_len, &cli->in[p], &p);
+        if (frame_len > DP_FAST_MAX_FRAME) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "The fast socket is out of sync\n");
+            return EIO;
+        }
+
+        if (cli->in_len - p < frame_len) {
+            break;
+        }
+
+        ret = be_fast_request(cli, &cli->in[p], frame_len);
+        if (ret != EOK) {
+            return ret;
+        }
+        used = p + frame_len;
+    }
+
+    memmove(cli->in, &cli->in[used], cli->in_len - used);
+    cli->in_len -= used;
+
+    return EOK;
+}
+
+static errno_t be_fast_cli_write(struct be_fast_cli *cli)
+{
+    ssize_t len;
+
+    len = write(cli->fd, cli->out, cli->out_len);
+    if (len == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return EOK;
+        }
+        return errno;
+    }
+
+    memmove(cli->out, &cli->out[len], cli->out_len - len);
+    cli->out_len -= len;
+
+    if (cli->out_len == 0) {
+        TEVENT_FD_NOT_WRITEABLE(cli->fde);
+    }
+
+    return EOK;
+}
+
+static void be_fast_cli_handler(struct tevent_context *ev,
+                                struct tevent_fd *fde,
+                                uint16_t flags, void *pvt)
+{
+    struct be_fast_cli *cli = talloc_get_type(pvt, struct be_fast_cli);
+    errno_t ret = EOK;
+
+    if (flags & TEVENT_FD_WRITE) {
+        ret = be_fast_cli_write(cli);
+    }
+
+    if (ret == EOK && (flags & TEVENT_FD_READ)) {
+        ret = be_fast_cli_read(cli);
+    }
+
+    if (ret != EOK) {
+        if (ret != ENOTCONN) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Dropping a client of the fast socket [%d]: %s\n",
+                  ret, sss_strerror(ret));
+        }
+        talloc_free(cli);
+    }
+}
+
+static void be_fast_accept(struct tevent_context *ev,
+                           struct tevent_fd *fde,
+                           uint16_t flags, void *pvt)
+{
+    struct be_fast_srv *srv = talloc_get_type(pvt, struct be_fast_srv);
+    struct be_fast_cli *cli;
+    errno_t ret;
+    int fd;
+
+    fd = accept(srv->fd, NULL, NULL);
+    if (fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "accept failed [%d]: %s\n", ret, sss_strerror(ret));
+        return;
+    }
+
+    ret = be_fast_fd_setup(fd);
+    if (ret != EOK) {
+        close(fd);
+        return;
+    }
+
+    cli = talloc_zero(srv, struct be_fast_cli);
+    if (cli == NULL) {
+        close(fd);
+        return;
+    }
+    cli->srv = srv;
+    cli->fd = fd;
+    talloc_set_destructor(cli, be_fast_cli_destructor);
+
+    cli->in = talloc_size(cli, sizeof(uint32_t) + DP_FAST_MAX_FRAME);
+    cli->fde = tevent_add_fd(ev, cli, fd, TEVENT_FD_READ,
+                             be_fast_cli_handler, cli);
+    if (cli->in == NULL || cli->fde == NULL) {
+        talloc_free(cli);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "A responder connected to the fast socket\n");
+}
+
+errno_t be_fast_init(struct be_ctx *be_ctx)
+{
+    struct be_fast_srv *srv;
+    struct sockaddr_un addr;
+    errno_t ret;
+
+    srv = talloc_zero(be_ctx, struct be_fast_srv);
+    if (srv == NULL) {
+        return ENOMEM;
+    }
+    srv->be_ctx = be_ctx;
+    srv->fd = -1;
+    talloc_set_destructor(srv, be_fast_srv_destructor);
+
+    ret = dp_get_fast_address(srv, &srv->path, be_ctx->domain->name);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(srv->path) >= sizeof(addr.sun_path)) {
+        ret = ENAMETOOLONG;
+        goto done;
+    }
+    strncpy(addr.sun_path, srv->path, sizeof(addr.sun_path) - 1);
+
+    srv->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (srv->fd == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = be_fast_fd_setup(srv->fd);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    /* make sure we have no old sockets around */
+    if (unlink(srv->path) != 0 && errno != ENOENT) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot remove old socket [%s]\n",
+              srv->path);
+    }
+
+    if (bind(srv->fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    /* only the responders, which run as the same user, may connect */
+    if (chmod(srv->path, 0600) != 0
+            || chown(srv->path, be_ctx->uid, be_ctx->gid) != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    if (listen(srv->fd, 10) == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    srv->fde = tevent_add_fd(be_ctx->ev, srv, srv->fd, TEVENT_FD_READ,
+                             be_fast_accept, srv);
+    if (srv->fde == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Listening for account requests on [%s]\n",
+          srv->path);
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot set up the fast socket [%d]: %s\n",
+              ret, sss_strerror(ret));
+        talloc_free(srv);
+    }
+    return ret;
+}
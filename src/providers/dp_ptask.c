@@ -30,6 +30,13 @@
 
 #define backoff_allowed(ptask) (ptask->max_backoff != 0)
 
+/* tasks whose runs take this long on average are not run together */
+#define BE_PTASK_HEAVY_MSEC 1000
+
+/* the first runs of tasks with the same period are spread over this many
+ * parts of the period */
+#define BE_PTASK_STAGGER_SLOTS 8
+
 enum be_ptask_schedule {
     BE_PTASK_SCHEDULE_FROM_NOW,
     BE_PTASK_SCHEDULE_FROM_LAST
@@ -45,6 +52,11 @@ static void be_ptask_schedule(struct be_ptask *task,
                               enum be_ptask_delay delay_type,
                               enum be_ptask_schedule from);
 
+static void be_ptask_execute(struct tevent_context *ev,
+                             struct tevent_timer *tt,
+                             struct timeval tv,
+                             void *pvt);
+
 static int be_ptask_destructor(void *pvt)
 {
     struct be_ptask *task;
@@ -57,9 +69,188 @@ static int be_ptask_destructor(void *pvt)
 
     DEBUG(SSSDBG_TRACE_FUNC, "Terminating periodic task [%s]\n", task->name);
 
+    DLIST_REMOVE(task->be_ctx->ptasks, task);
+
     return 0;
 }
 
+uint64_t be_ptask_stats_bucket_limit(int bucket)
+{
+    return UINT64_C(16) << bucket;
+}
+
+static void be_ptask_record_run(struct be_ptask *task)
+{
+    struct be_ptask_stats *stats = &task->stats;
+    struct timeval now;
+    struct timeval runtime;
+    uint64_t msec;
+    int bucket;
+
+    now = tevent_timeval_current();
+    runtime = tevent_timeval_until(&task->started, &now);
+    msec = (uint64_t) runtime.tv_sec * 1000 + runtime.tv_usec / 1000;
+
+    for (bucket = 0; bucket < BE_PTASK_STATS_BUCKETS - 1; bucket++) {
+        if (msec < be_ptask_stats_bucket_limit(bucket)) {
+            break;
+        }
+    }
+
+    stats->runs++;
+    stats->total_msec += msec;
+    stats->max_msec = MAX(stats->max_msec, msec);
+    stats->buckets[bucket]++;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Task [%s]: run took %"PRIu64" ms\n",
+                              task->name, msec);
+}
+
+/* Expected length of a run in seconds, 0 if the task is not heavy. */
+static time_t be_ptask_heavy_length(struct be_ptask *task)
+{
+    uint64_t mean;
+
+    if (task->stats.runs == 0) {
+        return 0;
+    }
+
+    mean = task->stats.total_msec / task->stats.runs;
+    if (mean < BE_PTASK_HEAVY_MSEC) {
+        return 0;
+    }
+
+    return (mean + 999) / 1000;
+}
+
+/* Move a heavy task after the expected end of the other heavy tasks which
+ * would run at the same time, unless it would be later than half of the
+ * period. */
+static time_t be_ptask_spread(struct be_ptask *task, time_t when)
+{
+    struct be_ptask *other;
+    time_t length;
+    time_t other_length;
+    time_t start;
+    time_t limit;
+    time_t moved;
+    bool again;
+
+    length = be_ptask_heavy_length(task);
+    if (length == 0) {
+        return when;
+    }
+
+    limit = when + task->period / 2;
+    moved = when;
+    do {
+        again = false;
+        DLIST_FOR_EACH(other, task->be_ctx->ptasks) {
+            if (other == task) {
+                continue;
+            }
+
+            other_length = be_ptask_heavy_length(other);
+            if (other_length == 0) {
+                continue;
+            }
+
+            if (other->req != NULL) {
+                start = other->last_execution;
+            } else if (other->timer != NULL) {
+                start = other->next_execution;
+            } else {
+                continue;
+            }
+
+            if (moved < start + other_length && start < moved + length) {
+                moved = start + other_length;
+                again = true;
+            }
+        }
+    } while (again && moved <= limit);
+
+    if (moved > limit) {
+        /* there is no free slot, keep the planned time */
+        return when;
+    }
+
+    return moved;
+}
+
+/* If the back end already runs as many heavy tasks as allowed, a heavy task
+ * waits until the first of them is expected to finish. */
+static bool be_ptask_defer(struct be_ptask *task)
+{
+    struct be_ptask *other;
+    time_t length;
+    time_t end = 0;
+    time_t now;
+    uint32_t running = 0;
+
+    if (task->be_ctx->ptask_max_heavy == 0
+            || be_ptask_heavy_length(task) == 0) {
+        return false;
+    }
+
+    DLIST_FOR_EACH(other, task->be_ctx->ptasks) {
+        if (other == task || other->req == NULL) {
+            continue;
+        }
+
+        length = be_ptask_heavy_length(other);
+        if (length == 0) {
+            continue;
+        }
+
+        running++;
+        if (end == 0 || other->last_execution + length < end) {
+            end = other->last_execution + length;
+        }
+    }
+
+    if (running < task->be_ctx->ptask_max_heavy) {
+        return false;
+    }
+
+    now = time(NULL);
+    if (end <= now) {
+        /* the estimate was too short */
+        end = now + 1;
+    }
+
+    task->timer = tevent_add_timer(task->ev, task, tevent_timeval_set(end, 0),
+                                   be_ptask_execute, task);
+    if (task->timer == NULL) {
+        /* better run it now than not at all */
+        return false;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Task [%s]: %u heavy tasks are running, "
+          "delaying the task to [%lu]\n", task->name, running, end);
+
+    task->next_execution = end;
+    return true;
+}
+
+/* Tasks with the same period, for example the same task of all subdomains,
+ * are not run at the same time. */
+static time_t be_ptask_stagger(struct be_ctx *be_ctx, time_t period)
+{
+    struct be_ptask *other;
+    time_t step;
+    time_t count = 0;
+
+    DLIST_FOR_EACH(other, be_ctx->ptasks) {
+        if (other->orig_period == period) {
+            count++;
+        }
+    }
+
+    step = MAX(period / BE_PTASK_STAGGER_SLOTS, 1);
+    return (count * step) % period;
+}
+
 static void be_ptask_online_cb(void *pvt)
 {
     struct be_ptask *task = NULL;
@@ -93,6 +284,9 @@ static void be_ptask_timeout(struct tevent_context *ev,
 
     DEBUG(SSSDBG_OP_FAILURE, "Task [%s]: timed out\n", task->name);
 
+    task->stats.timeouts++;
+    be_ptask_record_run(task);
+
     talloc_zfree(task->req);
     be_ptask_schedule(task, BE_PTASK_PERIOD, BE_PTASK_SCHEDULE_FROM_NOW);
 }
@@ -105,6 +299,7 @@ static void be_ptask_execute(struct tevent_context *ev,
                              void *pvt)
 {
     struct be_ptask *task = NULL;
+    struct be_ptask *other = NULL;
     struct tevent_timer *timeout = NULL;
 
     task = talloc_get_type(pvt, struct be_ptask);
@@ -114,6 +309,7 @@ static void be_ptask_execute(struct tevent_context *ev,
         DEBUG(SSSDBG_TRACE_FUNC, "Back end is offline\n");
         switch (task->offline) {
         case BE_PTASK_OFFLINE_SKIP:
+            task->stats.skips++;
             be_ptask_schedule(task, BE_PTASK_PERIOD,
                               BE_PTASK_SCHEDULE_FROM_NOW);
             return;
@@ -129,17 +325,32 @@ static void be_ptask_execute(struct tevent_context *ev,
         }
     }
 
+    if (be_ptask_defer(task)) {
+        return;
+    }
+
     DEBUG(SSSDBG_TRACE_FUNC, "Task [%s]: executing task, timeout %lu "
                               "seconds\n", task->name, task->timeout);
 
     task->last_execution = tv.tv_sec;
 
+    DLIST_FOR_EACH(other, task->be_ctx->ptasks) {
+        if (other != task && other->req != NULL) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Task [%s]: task [%s] is still "
+                  "running\n", task->name, other->name);
+            task->stats.overlaps++;
+            break;
+        }
+    }
+
+    task->started = tevent_timeval_current();
     task->req = task->send_fn(task, task->ev, task->be_ctx, task, task->pvt);
     if (task->req == NULL) {
         /* skip this iteration and try again later */
         DEBUG(SSSDBG_OP_FAILURE, "Task [%s]: failed to execute task, "
               "will try again later\n", task->name);
 
+        task->stats.skips++;
         be_ptask_schedule(task, BE_PTASK_PERIOD, BE_PTASK_SCHEDULE_FROM_NOW);
         return;
     }
@@ -155,6 +366,7 @@ static void be_ptask_execute(struct tevent_context *ev,
             /* If we can't guarantee a timeout,
              * we need to cancel the request. */
             talloc_zfree(task->req);
+            task->stats.skips++;
 
             DEBUG(SSSDBG_OP_FAILURE, "Task [%s]: failed to set timeout, "
                   "the task will be rescheduled\n", task->name);
@@ -177,6 +389,7 @@ static void be_ptask_done(struct tevent_req *req)
     ret = task->recv_fn(req);
     talloc_zfree(req);
     task->req = NULL;
+    be_ptask_record_run(task);
     switch (ret) {
     case EOK:
         DEBUG(SSSDBG_TRACE_FUNC, "Task [%s]: finished successfully\n",
@@ -188,6 +401,7 @@ static void be_ptask_done(struct tevent_req *req)
         DEBUG(SSSDBG_OP_FAILURE, "Task [%s]: failed with [%d]: %s\n",
                                   task->name, ret, sss_strerror(ret));
 
+        task->stats.failures++;
         be_ptask_schedule(task, BE_PTASK_PERIOD, BE_PTASK_SCHEDULE_FROM_NOW);
         break;
     }
@@ -199,6 +413,7 @@ static void be_ptask_schedule(struct be_ptask *task,
 {
     struct timeval tv = { 0, };
     time_t delay = 0;
+    time_t spread;
 
     if (!task->enabled) {
         DEBUG(SSSDBG_TRACE_FUNC, "Task [%s]: disabled\n", task->name);
@@ -243,6 +458,14 @@ static void be_ptask_schedule(struct be_ptask *task,
         break;
     }
 
+    spread = be_ptask_spread(task, tv.tv_sec);
+    if (spread != tv.tv_sec) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Task [%s]: moved by %lu seconds to keep "
+              "it apart from another heavy task\n",
+              task->name, spread - tv.tv_sec);
+        tv.tv_sec = spread;
+    }
+
     if (task->timer != NULL) {
         DEBUG(SSSDBG_MINOR_FAILURE, "Task [%s]: another timer is already "
                                      "active?\n", task->name);
@@ -276,6 +499,7 @@ errno_t be_ptask_create(TALLOC_CTX *mem_ctx,
                         struct be_ptask **_task)
 {
     struct be_ptask *task = NULL;
+    time_t stagger;
     errno_t ret;
 
     if (be_ctx == NULL || period == 0 || send_fn == NULL || recv_fn == NULL
@@ -311,6 +535,15 @@ errno_t be_ptask_create(TALLOC_CTX *mem_ctx,
 
     task->enabled = true;
 
+    stagger = be_ptask_stagger(be_ctx, period);
+    if (stagger != 0) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Periodic task [%s] starts %lu seconds "
+              "later to stay apart from tasks with the same period\n",
+              task->name, stagger);
+        task->first_delay += stagger;
+    }
+
+    DLIST_ADD(be_ctx->ptasks, task);
     talloc_set_destructor((TALLOC_CTX*)task, be_ptask_destructor);
 
     if (offline == BE_PTASK_OFFLINE_DISABLE) {
@@ -389,6 +622,52 @@ time_t be_ptask_get_timeout(struct be_ptask *task)
     return task->timeout;
 }
 
+const char *be_ptask_get_name(struct be_ptask *task)
+{
+    return task->name;
+}
+
+void be_ptask_get_stats(struct be_ptask *task, struct be_ptask_stats *stats)
+{
+    *stats = task->stats;
+}
+
+errno_t be_ptask_get_all_stats(TALLOC_CTX *mem_ctx,
+                               struct be_ctx *be_ctx,
+                               const char ***_names,
+                               struct be_ptask_stats **_stats,
+                               size_t *_count)
+{
+    struct be_ptask *task;
+    struct be_ptask_stats *stats;
+    const char **names;
+    size_t count = 0;
+    size_t i = 0;
+
+    DLIST_FOR_EACH(task, be_ctx->ptasks) {
+        count++;
+    }
+
+    names = talloc_zero_array(mem_ctx, const char *, count + 1);
+    stats = talloc_zero_array(mem_ctx, struct be_ptask_stats, count + 1);
+    if (names == NULL || stats == NULL) {
+        talloc_free(names);
+        talloc_free(stats);
+        return ENOMEM;
+    }
+
+    DLIST_FOR_EACH(task, be_ctx->ptasks) {
+        names[i] = task->name;
+        stats[i] = task->stats;
+        i++;
+    }
+
+    *_names = names;
+    *_stats = stats;
+    *_count = count;
+    return EOK;
+}
+
 struct be_ptask_sync_ctx {
     be_ptask_sync_t fn;
     void *pvt;
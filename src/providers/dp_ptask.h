@@ -24,6 +24,7 @@
 #include <tevent.h>
 #include <talloc.h>
 #include <time.h>
+#include <stdint.h>
 
 /* solve circular dependency */
 struct be_ctx;
@@ -73,7 +74,8 @@ typedef errno_t
 
 /**
  * The first execution is scheduled first_delay seconds after the task is
- * created.
+ * created. Tasks with the same period as tasks which already exist start
+ * later by a fraction of the period, so that they do not run together.
  *
  * If request does not complete in timeout seconds, it will be
  * cancelled and rescheduled to 'now + period'.
@@ -127,5 +129,41 @@ void be_ptask_destroy(struct be_ptask **task);
 
 time_t be_ptask_get_period(struct be_ptask *task);
 time_t be_ptask_get_timeout(struct be_ptask *task);
+const char *be_ptask_get_name(struct be_ptask *task);
+
+/* Runtime buckets, see be_ptask_stats_bucket_limit() */
+#define BE_PTASK_STATS_BUCKETS 16
+
+struct be_ptask_stats {
+    uint64_t runs;          /* finished or timed out executions */
+    uint64_t failures;      /* executions which returned an error */
+    uint64_t timeouts;      /* executions cancelled after the timeout */
+    uint64_t skips;         /* executions skipped offline or on errors */
+    uint64_t overlaps;      /* started while another task was running */
+    uint64_t total_msec;
+    uint64_t max_msec;
+    uint64_t buckets[BE_PTASK_STATS_BUCKETS];
+};
+
+/**
+ * Copy the statistics which were recorded since the task was created.
+ *
+ * The mean runtime is also used when the task is scheduled: a task whose
+ * runs take at least a second is moved after the expected end of another
+ * such task of the back end, by at most half of its period. It is also
+ * delayed while periodic_tasks_max_heavy such tasks are running.
+ */
+void be_ptask_get_stats(struct be_ptask *task, struct be_ptask_stats *stats);
+
+/* The names and statistics of all tasks of the back end. */
+errno_t be_ptask_get_all_stats(TALLOC_CTX *mem_ctx,
+                               struct be_ctx *be_ctx,
+                               const char ***_names,
+                               struct be_ptask_stats **_stats,
+                               size_t *_count);
+
+/* Runs in @bucket took less than the returned number of milliseconds,
+ * the last bucket has no upper limit. */
+uint64_t be_ptask_stats_bucket_limit(int bucket);
 
 #endif /* _DP_PTASK_H_ */
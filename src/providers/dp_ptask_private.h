@@ -21,7 +21,12 @@
 #ifndef DP_PTASK_PRIVATE_H_
 #define DP_PTASK_PRIVATE_H_
 
+#include "providers/dp_ptask.h"
+
 struct be_ptask {
+    struct be_ptask *prev;
+    struct be_ptask *next;
+
     struct tevent_context *ev;
     struct be_ctx *be_ctx;
     time_t orig_period;
@@ -42,7 +47,10 @@ struct be_ptask {
     time_t last_execution;  /* last time when send was called */
     struct tevent_req *req; /* active tevent request */
     struct tevent_timer *timer; /* active tevent timer */
+    struct timeval started; /* when the active request was sent */
     bool enabled;
+
+    struct be_ptask_stats stats;
 };
 
 #endif /* DP_PTASK_PRIVATE_H_ */
@@ -179,6 +179,14 @@ errno_t be_refresh_add_cb(struct be_refresh_ctx *ctx,
     return EOK;
 }
 
+/* The expired entries are refreshed in small batches, a few batches at the
+ * same time. A cycle stops starting new batches when it used up its object
+ * or time budget, the remaining entries are still expired and are picked
+ * up by the next cycle. */
+#define BE_REFRESH_BATCH_SIZE 16
+#define BE_REFRESH_MAX_ACTIVE 4
+#define BE_REFRESH_MAX_OBJECTS 2000
+
 struct be_refresh_state {
     struct tevent_context *ev;
     struct be_ctx *be_ctx;
@@ -188,6 +196,21 @@ struct be_refresh_state {
     struct sss_domain_info *domain;
     enum be_refresh_type index;
     time_t period;
+
+    /* expired entries of the current type which were not passed on yet */
+    char **values;
+    size_t values_index;
+
+    size_t active;
+    size_t budget;
+    time_t deadline;
+    bool exhausted;
+    errno_t error;
+};
+
+struct be_refresh_batch {
+    struct tevent_req *req;
+    struct be_refresh_cb *cb;
 };
 
 static errno_t be_refresh_step(struct tevent_req *req);
@@ -214,6 +237,8 @@ struct tevent_req *be_refresh_send(TALLOC_CTX *mem_ctx,
     state->be_ctx = be_ctx;
     state->domain = be_ctx->domain;
     state->period = be_ptask_get_period(be_ptask);
+    state->budget = BE_REFRESH_MAX_OBJECTS;
+    state->deadline = time(NULL) + state->period * 3 / 4;
     state->ctx = talloc_get_type(pvt, struct be_refresh_ctx);
     if (state->ctx == NULL) {
         ret = EINVAL;
@@ -242,21 +267,23 @@ immediately:
     return req;
 }
 
-static errno_t be_refresh_step(struct tevent_req *req)
+/* Moves to the next enabled type or domain which has expired entries */
+static errno_t be_refresh_next_values(struct be_refresh_state *state)
 {
-    struct be_refresh_state *state = NULL;
-    struct tevent_req *subreq = NULL;
-    char **values = NULL;
     errno_t ret;
 
-    state = tevent_req_data(req, struct be_refresh_state);
+    while (state->values == NULL || state->values[state->values_index] == NULL) {
+        talloc_zfree(state->values);
+        state->values_index = 0;
+
+        if (state->domain == NULL) {
+            return ENOENT;
+        }
 
-    while (state->domain != NULL) {
         /* find first enabled callback */
-        state->cb = &state->ctx->callbacks[state->index];
-        while (state->index != BE_REFRESH_TYPE_SENTINEL && !state->cb->enabled) {
+        while (state->index != BE_REFRESH_TYPE_SENTINEL
+                && !state->ctx->callbacks[state->index].enabled) {
             state->index++;
-            state->cb = &state->ctx->callbacks[state->index];
         }
 
         /* if not found than continue with next domain */
@@ -265,22 +292,75 @@ static errno_t be_refresh_step(struct tevent_req *req)
             continue;
         }
 
+        state->cb = &state->ctx->callbacks[state->index];
         if (state->cb->send_fn == NULL || state->cb->recv_fn == NULL) {
             DEBUG(SSSDBG_CRIT_FAILURE, "Invalid parameters!\n");
-            ret = ERR_INTERNAL;
-            goto done;
+            return ERR_INTERNAL;
         }
 
         ret = be_refresh_get_values(state, state->index, state->domain,
-                                    state->period, &values);
+                                    state->period, &state->values);
         if (ret != EOK) {
             DEBUG(SSSDBG_CRIT_FAILURE, "Unable to obtain DN list [%d]: %s\n",
                                         ret, sss_strerror(ret));
+            return ret;
+        }
+
+        if (state->values != NULL && state->values[0] != NULL) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Refreshing %s in domain %s\n",
+                  state->cb->name, state->domain->name);
+        }
+
+        state->index++;
+    }
+
+    return EOK;
+}
+
+static errno_t be_refresh_step(struct tevent_req *req)
+{
+    struct be_refresh_state *state = NULL;
+    struct be_refresh_batch *batch = NULL;
+    struct tevent_req *subreq = NULL;
+    char **values = NULL;
+    size_t count;
+    size_t i;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct be_refresh_state);
+
+    while (state->active < BE_REFRESH_MAX_ACTIVE && !state->exhausted) {
+        ret = be_refresh_next_values(state);
+        if (ret == ENOENT) {
+            break;
+        } else if (ret != EOK) {
             goto done;
         }
 
-        DEBUG(SSSDBG_TRACE_FUNC, "Refreshing %s in domain %s\n",
-              state->cb->name, state->domain->name);
+        if (state->budget == 0 || time(NULL) >= state->deadline) {
+            DEBUG(SSSDBG_TRACE_FUNC, "The refresh budget of this cycle is "
+                  "used up, the remaining entries are refreshed later\n");
+            state->exhausted = true;
+            break;
+        }
+
+        for (count = 0;
+             count < MIN(BE_REFRESH_BATCH_SIZE, state->budget)
+                && state->values[state->values_index + count] != NULL;
+             count++);
+
+        values = talloc_zero_array(state, char *, count + 1);
+        if (values == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (i = 0; i < count; i++) {
+            values[i] = talloc_steal(values,
+                                     state->values[state->values_index + i]);
+        }
+        state->values_index += count;
+        state->budget -= count;
 
         subreq = state->cb->send_fn(state, state->ev, state->be_ctx,
                                     state->domain, values, state->cb->pvt);
@@ -291,20 +371,25 @@ static errno_t be_refresh_step(struct tevent_req *req)
 
         /* make the list disappear with subreq */
         talloc_steal(subreq, values);
+        values = NULL;
 
-        tevent_req_set_callback(subreq, be_refresh_done, req);
+        batch = talloc_zero(subreq, struct be_refresh_batch);
+        if (batch == NULL) {
+            talloc_free(subreq);
+            ret = ENOMEM;
+            goto done;
+        }
+        batch->req = req;
+        batch->cb = state->cb;
 
-        state->index++;
-        ret = EAGAIN;
-        goto done;
+        tevent_req_set_callback(subreq, be_refresh_done, batch);
+        state->active++;
     }
 
-    ret = EOK;
+    ret = state->active > 0 ? EAGAIN : EOK;
 
 done:
-    if (ret != EOK && ret != EAGAIN) {
-        talloc_free(values);
-    }
+    talloc_free(values);
 
     return ret;
 }
@@ -312,24 +397,31 @@ done:
 static void be_refresh_done(struct tevent_req *subreq)
 {
     struct be_refresh_state *state = NULL;
+    struct be_refresh_batch *batch = NULL;
     struct tevent_req *req = NULL;
     errno_t ret;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
+    batch = tevent_req_callback_data(subreq, struct be_refresh_batch);
+    req = batch->req;
     state = tevent_req_data(req, struct be_refresh_state);
 
-    ret = state->cb->recv_fn(subreq);
+    ret = batch->cb->recv_fn(subreq);
     talloc_zfree(subreq);
-    if (ret != EOK) {
-        goto done;
+    state->active--;
+
+    if (ret != EOK && state->error == EOK) {
+        /* the batches which are running are still waited for */
+        state->error = ret;
+        state->exhausted = true;
     }
 
     ret = be_refresh_step(req);
     if (ret == EAGAIN) {
         return;
+    } else if (ret == EOK) {
+        ret = state->error;
     }
 
-done:
     if (ret != EOK) {
         tevent_req_error(req, ret);
         return;
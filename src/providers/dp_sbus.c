@@ -44,3 +44,16 @@ int dp_get_sbus_address(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+int dp_get_fast_address(TALLOC_CTX *mem_ctx,
+                        char **address, const char *domain_name)
+{
+    *address = talloc_asprintf(mem_ctx, "%s/%s_%s",
+                               PIPE_PATH, DATA_PROVIDER_FAST_PIPE,
+                               domain_name);
+    if (*address == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
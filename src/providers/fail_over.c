@@ -43,6 +43,31 @@
 #define DEFAULT_SERVER_STATUS SERVER_NAME_NOT_RESOLVED
 #define DEFAULT_SRV_STATUS SRV_NEUTRAL
 
+/* A resolved SRV lookup is repeated in the background once
+ * FO_SRV_PREFETCH_PERCENT of its TTL passed, so that no request has to wait
+ * for it to be resolved again. Lookups with a TTL shorter than
+ * FO_SRV_PREFETCH_MIN_TTL seconds are just left to expire. */
+#define FO_SRV_PREFETCH_PERCENT 90
+#define FO_SRV_PREFETCH_MIN_TTL 10
+
+/* a new round trip time counts 1/FO_RTT_SMOOTHING of the smoothed one */
+#define FO_RTT_SMOOTHING 8
+
+/* The active server is only left for a working one of the same class which
+ * answers at least FO_RTT_SLOW_FACTOR times faster, once it got
+ * FO_RTT_MIN_SAMPLES answers slower than FO_RTT_SLOW_MIN microseconds on
+ * average. A few slow answers or a server which is fast anyway are not worth
+ * a switch. */
+#define FO_RTT_SLOW_FACTOR 3
+#define FO_RTT_SLOW_MIN 100000
+#define FO_RTT_MIN_SAMPLES 4
+
+/* The error rate is the smoothed share of the failed connection attempts in
+ * 1/FO_ERR_SCALE. A server which always fails counts as FO_ERR_WEIGHT + 1
+ * times slower than its round trip time when the servers are compared. */
+#define FO_ERR_SCALE 1000
+#define FO_ERR_WEIGHT 4
+
 enum srv_lookup_status {
     SRV_NEUTRAL,        /* We didn't try this SRV lookup yet */
     SRV_RESOLVED,       /* This SRV lookup is resolved       */
@@ -53,6 +78,7 @@ enum srv_lookup_status {
 struct fo_ctx {
     struct fo_service *service_list;
     struct server_common *server_common_list;
+    struct server_rtt *server_rtt_list;
 
     struct fo_options *opts;
 
@@ -111,6 +137,33 @@ struct server_common {
     struct timeval last_status_change;
 };
 
+/* The smoothed round trip time of a server. Unlike server_common it is not
+ * released with the last server which uses it, the measurements survive the
+ * SRV lookups which recreate the servers. */
+struct server_rtt {
+    struct server_rtt *prev;
+    struct server_rtt *next;
+
+    char *name;
+    uint32_t srtt;
+    uint64_t count;
+    uint64_t buckets[FO_RTT_BUCKETS];
+
+    uint32_t error_rate;
+
+    /* how often the server was marked as working or not working and how
+     * often it changed between the two */
+    uint64_t successes;
+    uint64_t failures;
+    uint64_t transitions;
+    bool failed;
+};
+
+/* upper bounds of the histogram buckets, in microseconds */
+static const uint32_t fo_rtt_bucket_limits[FO_RTT_BUCKETS] = {
+    1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000, UINT32_MAX
+};
+
 struct srv_data {
     char *dns_domain;
     char *discovery_domain;
@@ -123,6 +176,10 @@ struct srv_data {
     int srv_lookup_status;
     int ttl;
     struct timeval last_status_change;
+
+    struct tevent_context *ev;
+    struct tevent_timer *prefetch_te;
+    struct tevent_req *prefetch_req;
 };
 
 struct resolve_service_request {
@@ -231,6 +288,13 @@ static void fo_server_free(struct fo_server *server)
     talloc_free(server->fo_internal_owner);
 }
 
+static void
+fo_srv_prefetch_cancel(struct srv_data *data)
+{
+    talloc_zfree(data->prefetch_te);
+    talloc_zfree(data->prefetch_req);
+}
+
 static struct fo_server *
 collapse_srv_lookup(struct fo_server **_server)
 {
@@ -268,6 +332,7 @@ collapse_srv_lookup(struct fo_server **_server)
 
     meta->srv_data->srv_lookup_status = SRV_NEUTRAL;
     meta->srv_data->last_status_change.tv_sec = 0;
+    fo_srv_prefetch_cancel(meta->srv_data);
 
     *_server = NULL;
 
@@ -695,6 +760,36 @@ fo_get_server_count(struct fo_service *service)
     return count;
 }
 
+errno_t fo_get_resolved_servers(TALLOC_CTX *mem_ctx,
+                                struct fo_service *service,
+                                struct fo_server ***_servers,
+                                size_t *_count)
+{
+    struct fo_server **servers;
+    struct fo_server *server;
+    size_t count = 0;
+
+    servers = talloc_zero_array(mem_ctx, struct fo_server *,
+                                fo_get_server_count(service) + 1);
+    if (servers == NULL) {
+        return ENOMEM;
+    }
+
+    /* the servers found by an SRV lookup share its srv_data, only the
+     * lookup entry itself has no name */
+    DLIST_FOR_EACH(server, service->server_list) {
+        if (server->common == NULL || server->common->rhostent == NULL) {
+            continue;
+        }
+
+        servers[count++] = server;
+    }
+
+    *_servers = servers;
+    *_count = count;
+    return EOK;
+}
+
 static bool fo_server_match(struct fo_server *server,
                            const char *name,
                            int port,
@@ -863,10 +958,15 @@ void fo_ref_server(TALLOC_CTX *ref_ctx,
     }
 }
 
+static struct fo_server *fo_find_faster_server(struct fo_service *service,
+                                               struct fo_server *current);
+static void fo_record_server_result(struct fo_server *server, bool failed);
+
 static int
 get_first_server_entity(struct fo_service *service, struct fo_server **_server)
 {
     struct fo_server *server;
+    struct fo_server *faster;
 
     /* If we already have a working server, use that one. */
     server = service->active_server;
@@ -889,7 +989,7 @@ get_first_server_entity(struct fo_service *service, struct fo_server **_server)
         if (service->last_tried_server->port_status == PORT_NEUTRAL &&
             server_works(service->last_tried_server)) {
             server = service->last_tried_server;
-            goto done;
+            goto found;
         }
 
         DLIST_FOR_EACH(server, service->last_tried_server->next) {
@@ -897,7 +997,7 @@ get_first_server_entity(struct fo_service *service, struct fo_server **_server)
             if (!server->primary) continue;
 
             if (service_works(server)) {
-                goto done;
+                goto found;
             }
         }
     }
@@ -908,7 +1008,7 @@ get_first_server_entity(struct fo_service *service, struct fo_server **_server)
         if (!server->primary) continue;
 
         if (service_works(server)) {
-            goto done;
+            goto found;
         }
         if (server == service->last_tried_server) {
             break;
@@ -920,13 +1020,21 @@ get_first_server_entity(struct fo_service *service, struct fo_server **_server)
         if (server->primary) continue;
 
         if (service_works(server)) {
-            goto done;
+            goto found;
         }
     }
 
     service->last_tried_server = NULL;
     return ENOENT;
 
+found:
+    /* a new server is chosen, prefer one which answers considerably faster
+     * than the next one in the list */
+    faster = fo_find_faster_server(service, server);
+    if (faster != NULL) {
+        server = faster;
+    }
+
 done:
     service->last_tried_server = server;
     *_server = server;
@@ -1239,6 +1347,8 @@ fo_resolve_service_recv(struct tevent_req *req,
  *******************************************************************/
 
 static void resolve_srv_done(struct tevent_req *subreq);
+static void fo_srv_prefetch_schedule(struct srv_data *data,
+                                     struct tevent_context *ev);
 
 struct resolve_srv_state {
     struct fo_server *meta;
@@ -1375,6 +1485,11 @@ resolve_srv_done(struct tevent_req *subreq)
 
         last_server = state->meta;
 
+        fo_sort_servers_by_rtt(state->fo_ctx, primary_servers,
+                               num_primary_servers);
+        fo_sort_servers_by_rtt(state->fo_ctx, backup_servers,
+                               num_backup_servers);
+
         if (primary_servers != NULL) {
             ret = fo_add_server_list(state->service, last_server,
                                      primary_servers, num_primary_servers,
@@ -1425,6 +1540,7 @@ resolve_srv_done(struct tevent_req *subreq)
         }
 
         set_srv_data_status(state->meta->srv_data, SRV_RESOLVED);
+        fo_srv_prefetch_schedule(state->meta->srv_data, state->ev);
         ret = EOK;
         break;
     case ERR_SRV_NOT_FOUND:
@@ -1465,6 +1581,290 @@ resolve_srv_recv(struct tevent_req *req, struct fo_server **server)
     return EOK;
 }
 
+/*******************************************************************
+ * Refresh a resolved SRV lookup before it expires.                *
+ *******************************************************************/
+
+static void fo_srv_prefetch_handler(struct tevent_context *ev,
+                                    struct tevent_timer *te,
+                                    struct timeval tv, void *pvt);
+static void fo_srv_prefetch_done(struct tevent_req *subreq);
+
+static void
+fo_srv_prefetch_schedule(struct srv_data *data, struct tevent_context *ev)
+{
+    struct timeval tv;
+    time_t delay;
+
+    talloc_zfree(data->prefetch_te);
+
+    if (ev == NULL || data->ttl < FO_SRV_PREFETCH_MIN_TTL) {
+        return;
+    }
+    data->ev = ev;
+
+    /* The extra second makes sure that a DNS answer which was cached by
+     * the resolver is already due for a refresh by then. */
+    delay = data->ttl * FO_SRV_PREFETCH_PERCENT / 100 + 1;
+    tv = tevent_timeval_current_ofs(delay, 0);
+
+    data->prefetch_te = tevent_add_timer(ev, data, tv,
+                                         fo_srv_prefetch_handler, data);
+    if (data->prefetch_te == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to schedule the refresh of the "
+              "SRV lookup, it will be resolved again once it expires\n");
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "SRV lookup of service '%s' will be "
+          "refreshed in %ld seconds\n", data->meta->service->name,
+          (long) delay);
+}
+
+static void
+fo_srv_prefetch_handler(struct tevent_context *ev,
+                        struct tevent_timer *te,
+                        struct timeval tv, void *pvt)
+{
+    struct srv_data *data = talloc_get_type(pvt, struct srv_data);
+    struct fo_ctx *ctx = data->meta->service->ctx;
+    struct tevent_req *subreq;
+
+    data->prefetch_te = NULL;
+
+    if (data->srv_lookup_status != SRV_RESOLVED
+            || data->prefetch_req != NULL
+            || ctx->srv_send_fn == NULL || ctx->srv_recv_fn == NULL) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Refreshing SRV lookup of service '%s'\n",
+          data->meta->service->name);
+
+    subreq = ctx->srv_send_fn(data, ev, data->srv, data->proto,
+                              data->discovery_domain, ctx->srv_pvt);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to refresh the SRV lookup\n");
+        return;
+    }
+
+    tevent_req_set_callback(subreq, fo_srv_prefetch_done, data);
+    data->prefetch_req = subreq;
+}
+
+static struct fo_server *
+fo_srv_find_server(struct fo_server *list, struct srv_data *data,
+                   struct fo_server_info *info)
+{
+    struct fo_server *server;
+
+    DLIST_FOR_EACH(server, list) {
+        if (server->srv_data == data
+                && fo_server_match(server, info->host, info->port,
+                                   data->meta->user_data)) {
+            return server;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Replaces the servers expanded from the SRV lookup 'data' by the ones
+ * found now. The servers which are still present are kept with their
+ * status, those which disappeared are released. The service list is only
+ * changed once all the new servers were created, so it is either replaced
+ * as a whole or not at all.
+ */
+static errno_t
+fo_srv_replace_servers(struct srv_data *data,
+                       struct fo_server_info *primary_servers,
+                       size_t num_primary_servers,
+                       struct fo_server_info *backup_servers,
+                       size_t num_backup_servers)
+{
+    struct fo_service *service = data->meta->service;
+    struct fo_server_info *info;
+    struct fo_server **servers;
+    struct fo_server *new_list = NULL;
+    struct fo_server *anchor = NULL;
+    struct fo_server *server;
+    struct fo_server *next;
+    bool primary;
+    size_t num_servers;
+    size_t num_new = 0;
+    size_t i;
+    size_t j;
+
+    num_servers = num_primary_servers + num_backup_servers;
+    servers = talloc_zero_array(NULL, struct fo_server *, num_servers);
+    if (servers == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < num_servers; i++) {
+        primary = i < num_primary_servers;
+        info = primary ? &primary_servers[i]
+                       : &backup_servers[i - num_primary_servers];
+
+        server = fo_srv_find_server(service->server_list, data, info);
+        if (server != NULL) {
+            num_new++;
+            continue;
+        }
+
+        if (fo_server_exists(service->server_list, info->host, info->port,
+                             data->meta->user_data)) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Server '%s:%d' for service '%s' "
+                  "is already present\n", info->host, info->port,
+                  service->name);
+            continue;
+        }
+
+        servers[i] = create_fo_server(service, info->host, info->port,
+                                      data->meta->user_data, primary);
+        if (servers[i] == NULL) {
+            for (j = 0; j < i; j++) {
+                fo_server_free(servers[j]);
+            }
+            talloc_free(servers);
+            return ENOMEM;
+        }
+        servers[i]->srv_data = data;
+        num_new++;
+    }
+
+    if (num_new == 0) {
+        talloc_free(servers);
+        return ERR_SRV_DUPLICATES;
+    }
+
+    /* nothing can fail from here on */
+    for (server = service->server_list; server != NULL;
+         server = server->next) {
+        if (server->srv_data == data) {
+            break;
+        }
+        anchor = server;
+    }
+
+    for (i = 0; i < num_servers; i++) {
+        primary = i < num_primary_servers;
+        info = primary ? &primary_servers[i]
+                       : &backup_servers[i - num_primary_servers];
+
+        server = servers[i];
+        if (server == NULL) {
+            server = fo_srv_find_server(service->server_list, data, info);
+            if (server == NULL) {
+                /* a duplicate or listed twice in the answer */
+                continue;
+            }
+            DLIST_REMOVE(service->server_list, server);
+            server->primary = primary;
+        } else if (fo_server_exists(new_list, info->host, info->port,
+                                    data->meta->user_data)) {
+            /* listed twice in the answer */
+            fo_server_free(server);
+            continue;
+        }
+
+        DLIST_ADD_END(new_list, server, struct fo_server *);
+    }
+    talloc_free(servers);
+
+    /* the servers which are left disappeared from DNS */
+    for (server = service->server_list; server != NULL; server = next) {
+        next = server->next;
+        if (server->srv_data != data) {
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Server '%s:%d' for service '%s' is no "
+              "longer listed in DNS\n", SERVER_NAME(server), server->port,
+              service->name);
+
+        DLIST_REMOVE(service->server_list, server);
+        if (server == service->active_server) {
+            service->active_server = NULL;
+        }
+        if (server == service->last_tried_server) {
+            service->last_tried_server = new_list;
+        }
+        fo_server_free(server);
+    }
+
+    if (anchor == NULL) {
+        DLIST_CONCATENATE(new_list, service->server_list, struct fo_server *);
+        service->server_list = new_list;
+    } else {
+        DLIST_ADD_LIST_AFTER(service->server_list, anchor, new_list,
+                             struct fo_server *);
+    }
+
+    return EOK;
+}
+
+static void
+fo_srv_prefetch_done(struct tevent_req *subreq)
+{
+    struct srv_data *data = tevent_req_callback_data(subreq, struct srv_data);
+    struct fo_ctx *ctx = data->meta->service->ctx;
+    struct fo_server_info *primary_servers = NULL;
+    struct fo_server_info *backup_servers = NULL;
+    size_t num_primary_servers = 0;
+    size_t num_backup_servers = 0;
+    char *dns_domain = NULL;
+    uint32_t ttl;
+    errno_t ret;
+
+    data->prefetch_req = NULL;
+
+    ret = ctx->srv_recv_fn(data, subreq, &dns_domain, &ttl,
+                           &primary_servers, &num_primary_servers,
+                           &backup_servers, &num_backup_servers);
+    talloc_free(subreq);
+    if (ret == EOK && num_primary_servers == 0 && num_backup_servers == 0) {
+        ret = ERR_SRV_NOT_FOUND;
+    }
+    if (ret != EOK) {
+        /* the current servers are kept, a request will try again once the
+         * lookup expires */
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to refresh SRV lookup [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    if (data->srv_lookup_status != SRV_RESOLVED) {
+        /* collapsed in the meantime, a new lookup is running */
+        goto done;
+    }
+
+    fo_sort_servers_by_rtt(ctx, primary_servers, num_primary_servers);
+    fo_sort_servers_by_rtt(ctx, backup_servers, num_backup_servers);
+
+    ret = fo_srv_replace_servers(data, primary_servers, num_primary_servers,
+                                 backup_servers, num_backup_servers);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to apply the refreshed SRV "
+              "lookup [%d]: %s\n", ret, sss_strerror(ret));
+        goto done;
+    }
+
+    data->ttl = ttl;
+    talloc_zfree(data->dns_domain);
+    data->dns_domain = talloc_steal(data, dns_domain);
+    dns_domain = NULL;
+
+    set_srv_data_status(data, SRV_RESOLVED);
+    fo_srv_prefetch_schedule(data, data->ev);
+
+done:
+    talloc_free(dns_domain);
+    talloc_free(primary_servers);
+    talloc_free(backup_servers);
+}
+
 /*******************************************************************
  *     Get Fully Qualified Domain Name of the host machine         *
  *******************************************************************/
@@ -1507,6 +1907,10 @@ fo_set_port_status(struct fo_server *server, enum port_status status)
         server->service->active_server = server;
     }
 
+    if (status != PORT_NEUTRAL) {
+        fo_record_server_result(server, status == PORT_NOT_WORKING);
+    }
+
     if (!server->common || !server->common->name) return;
 
     /* It is possible to introduce duplicates when expanding SRV results
@@ -1524,6 +1928,18 @@ fo_set_port_status(struct fo_server *server, enum port_status status)
     }
 }
 
+void fo_set_server_recovered(struct fo_server *server)
+{
+    DEBUG(SSSDBG_FUNC_DATA, "Server '%s' of service '%s' answered the probe\n",
+          SERVER_NAME(server), server->service->name);
+
+    if (server->common != NULL) {
+        set_server_common_status(server->common, SERVER_WORKING);
+    }
+    fo_record_server_result(server, false);
+    fo_set_port_status(server, PORT_NEUTRAL);
+}
+
 struct fo_server *fo_get_active_server(struct fo_service *service)
 {
     return service->active_server;
@@ -1601,6 +2017,12 @@ fo_is_server_primary(struct fo_server *server)
     return server->primary;
 }
 
+bool
+fo_is_server_usable(struct fo_server *server)
+{
+    return service_works(server) ? true : false;
+}
+
 time_t
 fo_get_server_hostname_last_change(struct fo_server *server)
 {
@@ -1660,6 +2082,416 @@ bool fo_svc_has_server(struct fo_service *service, struct fo_server *server)
     return false;
 }
 
+static struct server_rtt *
+get_server_rtt(struct fo_ctx *ctx, const char *name)
+{
+    struct server_rtt *rtt;
+
+    DLIST_FOR_EACH(rtt, ctx->server_rtt_list) {
+        if (strcasecmp(name, rtt->name) == 0) {
+            return rtt;
+        }
+    }
+
+    return NULL;
+}
+
+static struct server_rtt *
+get_or_create_server_rtt(struct fo_ctx *ctx, const char *name)
+{
+    struct server_rtt *rtt;
+
+    rtt = get_server_rtt(ctx, name);
+    if (rtt != NULL) {
+        return rtt;
+    }
+
+    rtt = talloc_zero(ctx, struct server_rtt);
+    if (rtt == NULL) {
+        return NULL;
+    }
+
+    rtt->name = talloc_strdup(rtt, name);
+    if (rtt->name == NULL) {
+        talloc_free(rtt);
+        return NULL;
+    }
+
+    DLIST_ADD(ctx->server_rtt_list, rtt);
+    return rtt;
+}
+
+/* only the servers with a recorded round trip time can be compared */
+static struct server_rtt *
+get_measured_server_rtt(struct fo_ctx *ctx, const char *name)
+{
+    struct server_rtt *rtt;
+
+    rtt = get_server_rtt(ctx, name);
+    if (rtt == NULL || rtt->count == 0) {
+        return NULL;
+    }
+
+    return rtt;
+}
+
+/* the round trip time weighted by the error rate */
+static uint64_t server_rtt_score(struct server_rtt *rtt)
+{
+    return (uint64_t) rtt->srtt
+                * (FO_ERR_SCALE + FO_ERR_WEIGHT * (uint64_t) rtt->error_rate)
+                / FO_ERR_SCALE;
+}
+
+static void fo_record_server_result(struct fo_server *server, bool failed)
+{
+    struct server_rtt *rtt;
+    uint32_t sample;
+
+    if (server->common == NULL || server->common->name == NULL) {
+        return;
+    }
+
+    rtt = get_or_create_server_rtt(server->service->ctx,
+                                   server->common->name);
+    if (rtt == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot record the error rate of [%s]\n",
+              server->common->name);
+        return;
+    }
+
+    sample = failed ? FO_ERR_SCALE : 0;
+    rtt->error_rate = ((uint64_t) rtt->error_rate * (FO_RTT_SMOOTHING - 1)
+                           + sample) / FO_RTT_SMOOTHING;
+
+    if (rtt->successes + rtt->failures > 0 && rtt->failed != failed) {
+        rtt->transitions++;
+    }
+    rtt->failed = failed;
+    if (failed) {
+        rtt->failures++;
+    } else {
+        rtt->successes++;
+    }
+}
+
+errno_t fo_record_server_rtt(struct fo_ctx *ctx, const char *name,
+                             uint32_t rtt_usec)
+{
+    struct server_rtt *rtt;
+    size_t i;
+
+    if (ctx == NULL || name == NULL) {
+        return EINVAL;
+    }
+
+    rtt = get_or_create_server_rtt(ctx, name);
+    if (rtt == NULL) {
+        return ENOMEM;
+    }
+
+    if (rtt->count == 0) {
+        rtt->srtt = rtt_usec;
+    } else {
+        /* exponentially weighted moving average, as in RFC 6298 */
+        rtt->srtt = ((uint64_t) rtt->srtt * (FO_RTT_SMOOTHING - 1)
+                        + rtt_usec) / FO_RTT_SMOOTHING;
+    }
+
+    for (i = 0; rtt_usec > fo_rtt_bucket_limits[i]; i++);
+    rtt->buckets[i]++;
+    rtt->count++;
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Round trip time of [%s] is %"PRIu32" us, smoothed %"PRIu32" us\n",
+          name, rtt_usec, rtt->srtt);
+
+    return EOK;
+}
+
+errno_t fo_get_server_rtt(struct fo_ctx *ctx, const char *name,
+                          uint32_t *_rtt_usec)
+{
+    struct server_rtt *rtt;
+
+    rtt = get_measured_server_rtt(ctx, name);
+    if (rtt == NULL) {
+        return ENOENT;
+    }
+
+    *_rtt_usec = rtt->srtt;
+    return EOK;
+}
+
+uint32_t fo_rtt_bucket_limit(size_t bucket)
+{
+    if (bucket >= FO_RTT_BUCKETS) {
+        return UINT32_MAX;
+    }
+
+    return fo_rtt_bucket_limits[bucket];
+}
+
+errno_t fo_get_server_rtt_histogram(struct fo_ctx *ctx, const char *name,
+                                    struct fo_rtt_histogram *_histogram)
+{
+    struct server_rtt *rtt;
+
+    if (ctx == NULL || name == NULL || _histogram == NULL) {
+        return EINVAL;
+    }
+
+    rtt = get_measured_server_rtt(ctx, name);
+    if (rtt == NULL) {
+        return ENOENT;
+    }
+
+    _histogram->srtt = rtt->srtt;
+    _histogram->count = rtt->count;
+    memcpy(_histogram->buckets, rtt->buckets, sizeof(rtt->buckets));
+
+    return EOK;
+}
+
+errno_t fo_get_server_stats(TALLOC_CTX *mem_ctx, struct fo_ctx *ctx,
+                            struct fo_server_stats **_stats, size_t *_count)
+{
+    struct fo_server_stats *stats;
+    struct server_rtt *rtt;
+    size_t count = 0;
+    size_t i = 0;
+
+    if (ctx == NULL || _stats == NULL || _count == NULL) {
+        return EINVAL;
+    }
+
+    DLIST_FOR_EACH(rtt, ctx->server_rtt_list) {
+        count++;
+    }
+
+    stats = talloc_zero_array(mem_ctx, struct fo_server_stats, count + 1);
+    if (stats == NULL) {
+        return ENOMEM;
+    }
+
+    DLIST_FOR_EACH(rtt, ctx->server_rtt_list) {
+        stats[i].name = talloc_strdup(stats, rtt->name);
+        if (stats[i].name == NULL) {
+            talloc_free(stats);
+            return ENOMEM;
+        }
+        stats[i].successes = rtt->successes;
+        stats[i].failures = rtt->failures;
+        stats[i].transitions = rtt->transitions;
+        stats[i].error_rate = rtt->error_rate;
+        stats[i].rtt.srtt = rtt->srtt;
+        stats[i].rtt.count = rtt->count;
+        memcpy(stats[i].rtt.buckets, rtt->buckets, sizeof(rtt->buckets));
+        i++;
+    }
+
+    *_stats = stats;
+    *_count = count;
+    return EOK;
+}
+
+static void fo_debug_rtt_histogram(struct server_rtt *rtt, int level)
+{
+    char buf[256];
+    size_t pos = 0;
+    size_t i;
+    int ret;
+
+    if (!DEBUG_IS_SET(level)) {
+        return;
+    }
+
+    buf[0] = '\0';
+    for (i = 0; i < FO_RTT_BUCKETS; i++) {
+        if (fo_rtt_bucket_limits[i] == UINT32_MAX) {
+            ret = snprintf(buf + pos, sizeof(buf) - pos, " inf:%"PRIu64,
+                           rtt->buckets[i]);
+        } else {
+            ret = snprintf(buf + pos, sizeof(buf) - pos, " %"PRIu32"ms:%"PRIu64,
+                           fo_rtt_bucket_limits[i] / 1000, rtt->buckets[i]);
+        }
+        if (ret < 0 || (size_t) ret >= sizeof(buf) - pos) {
+            break;
+        }
+        pos += ret;
+    }
+
+    DEBUG(level,
+          "Round trip times of [%s], %"PRIu64" samples, %"PRIu32
+          "/%d failed:%s\n", rtt->name, rtt->count, rtt->error_rate,
+          FO_ERR_SCALE, buf);
+}
+
+void fo_dump_stats(struct fo_ctx *ctx)
+{
+    struct server_rtt *rtt;
+
+    DLIST_FOR_EACH(rtt, ctx->server_rtt_list) {
+        DEBUG(SSSDBG_IMPORTANT_INFO,
+              "Server [%s]: %"PRIu64" times working, %"PRIu64" times not "
+              "working, %"PRIu64" changes, now %s\n", rtt->name,
+              rtt->successes, rtt->failures, rtt->transitions,
+              rtt->failed ? "not working" : "working");
+        fo_debug_rtt_histogram(rtt, SSSDBG_IMPORTANT_INFO);
+    }
+}
+
+/* Returns a working server of the same class as current whose weighted
+ * round trip time is at least FO_RTT_SLOW_FACTOR times smaller, or NULL. */
+static struct fo_server *fo_find_faster_server(struct fo_service *service,
+                                               struct fo_server *current)
+{
+    struct fo_server *server;
+    struct fo_server *fastest = NULL;
+    struct server_rtt *current_rtt;
+    struct server_rtt *rtt;
+    uint64_t current_score;
+    uint64_t fastest_score = 0;
+    uint64_t score;
+
+    if (current->common == NULL) {
+        return NULL;
+    }
+
+    current_rtt = get_measured_server_rtt(service->ctx, current->common->name);
+    if (current_rtt == NULL || current_rtt->count < FO_RTT_MIN_SAMPLES) {
+        return NULL;
+    }
+
+    current_score = server_rtt_score(current_rtt);
+    if (current_score < FO_RTT_SLOW_MIN) {
+        return NULL;
+    }
+
+    /* Only servers which answered before have a round trip time, a server
+     * which was never measured is not assumed to be faster. */
+    DLIST_FOR_EACH(server, service->server_list) {
+        if (server == current || server->primary != current->primary
+                || server->common == NULL || !service_works(server)) {
+            continue;
+        }
+
+        rtt = get_measured_server_rtt(service->ctx, server->common->name);
+        if (rtt == NULL || rtt == current_rtt) {
+            continue;
+        }
+
+        score = server_rtt_score(rtt);
+        if (fastest == NULL || score < fastest_score) {
+            fastest = server;
+            fastest_score = score;
+        }
+    }
+
+    if (fastest == NULL
+            || fastest_score * FO_RTT_SLOW_FACTOR > current_score) {
+        return NULL;
+    }
+
+    DEBUG(SSSDBG_FUNC_DATA,
+          "Server [%s] of service '%s' answers in %"PRIu64" us weighted, "
+          "[%s] answers in %"PRIu64" us\n",
+          SERVER_NAME(current), service->name, current_score,
+          SERVER_NAME(fastest), fastest_score);
+    fo_debug_rtt_histogram(current_rtt, SSSDBG_TRACE_FUNC);
+    fo_debug_rtt_histogram(get_server_rtt(service->ctx,
+                                          fastest->common->name),
+                           SSSDBG_TRACE_FUNC);
+
+    return fastest;
+}
+
+bool fo_prefer_faster_server(struct fo_service *service)
+{
+    struct fo_server *active;
+    struct fo_server *fastest;
+
+    if (service == NULL) {
+        return false;
+    }
+
+    active = service->active_server;
+    if (active == NULL || !active->primary) {
+        return false;
+    }
+
+    fastest = fo_find_faster_server(service, active);
+    if (fastest == NULL) {
+        return false;
+    }
+
+    DEBUG(SSSDBG_FUNC_DATA, "Switching service '%s' from [%s] to [%s]\n",
+          service->name, SERVER_NAME(active), SERVER_NAME(fastest));
+
+    /* the next resolution of the service returns the faster server */
+    service->active_server = fastest;
+
+    return true;
+}
+
+static bool fo_server_info_faster(struct fo_server_info *a, uint64_t a_rtt,
+                                  struct fo_server_info *b, uint64_t b_rtt)
+{
+    if (a->priority != b->priority) {
+        return a->priority < b->priority;
+    }
+
+    return a_rtt < b_rtt;
+}
+
+void fo_sort_servers_by_rtt(struct fo_ctx *ctx,
+                            struct fo_server_info *servers,
+                            size_t num)
+{
+    struct fo_server_info tmp;
+    uint64_t rtts[num];
+    uint64_t tmp_rtt;
+    uint32_t rtt;
+    bool measured = false;
+    size_t i, j;
+
+    if (ctx == NULL || servers == NULL || num <= 1) {
+        return;
+    }
+
+    /* servers which were not measured yet go after the measured ones */
+    for (i = 0; i < num; i++) {
+        if (fo_get_server_rtt(ctx, servers[i].host, &rtt) == EOK) {
+            rtts[i] = rtt;
+            measured = true;
+        } else {
+            rtts[i] = UINT64_MAX;
+        }
+    }
+
+    if (!measured) {
+        return;
+    }
+
+    /* The list is short and already ordered by priority, an insertion sort
+     * keeps the order of the servers with the same priority and round trip
+     * time. */
+    for (i = 1; i < num; i++) {
+        tmp = servers[i];
+        tmp_rtt = rtts[i];
+
+        for (j = i; j > 0 && fo_server_info_faster(&tmp, tmp_rtt,
+                                                   &servers[j - 1],
+                                                   rtts[j - 1]); j--) {
+            servers[j] = servers[j - 1];
+            rtts[j] = rtts[j - 1];
+        }
+
+        servers[j] = tmp;
+        rtts[j] = tmp_rtt;
+    }
+}
+
 bool fo_set_srv_lookup_plugin(struct fo_ctx *ctx,
                               fo_srv_lookup_plugin_send_t send_fn,
                               fo_srv_lookup_plugin_recv_t recv_fn,
@@ -120,6 +120,16 @@ int fo_get_service(struct fo_ctx *ctx,
  */
 int fo_get_server_count(struct fo_service *service);
 
+/*
+ * Get the servers of the 'service' whose address is already known, SRV
+ * lookup entries which were not expanded yet are left out. The array is
+ * NULL-terminated.
+ */
+errno_t fo_get_resolved_servers(TALLOC_CTX *mem_ctx,
+                                struct fo_service *service,
+                                struct fo_server ***_servers,
+                                size_t *_count);
+
 /*
  * Adds a server 'name' to the 'service'. Port 'port' will be used for
  * connection. If 'name' is NULL, no server resolution will be done.
@@ -179,6 +189,13 @@ void fo_set_server_status(struct fo_server *server,
 void fo_set_port_status(struct fo_server *server,
                         enum port_status status);
 
+/*
+ * The server answered a probe outside of a real request. It is marked as
+ * working and its port as neutral, so that it can be tried again right away
+ * without becoming the active server of the service.
+ */
+void fo_set_server_recovered(struct fo_server *server);
+
 /*
  * Instruct fail-over to try next server on the next connect attempt.
  * Should be used after connection to service was unexpectedly dropped
@@ -198,6 +215,9 @@ struct resolv_hostent *fo_get_server_hostent(struct fo_server *server);
 
 bool fo_is_server_primary(struct fo_server *server);
 
+/* Neither the server nor its port are marked as not working */
+bool fo_is_server_usable(struct fo_server *server);
+
 time_t fo_get_server_hostname_last_change(struct fo_server *server);
 
 int fo_is_srv_lookup(struct fo_server *s);
@@ -212,6 +232,90 @@ struct fo_server *fo_get_active_server(struct fo_service *service);
 
 bool fo_svc_has_server(struct fo_service *service, struct fo_server *server);
 
+/*
+ * Records a round trip time measured against the server called name, e.g.
+ * by the SRV lookup plugin. The samples are smoothed and kept for the whole
+ * lifetime of the fail over context.
+ */
+errno_t fo_record_server_rtt(struct fo_ctx *ctx, const char *name,
+                             uint32_t rtt_usec);
+
+/*
+ * Returns the smoothed round trip time of the server called name or ENOENT
+ * if no time was recorded yet.
+ */
+errno_t fo_get_server_rtt(struct fo_ctx *ctx, const char *name,
+                          uint32_t *_rtt_usec);
+
+#define FO_RTT_BUCKETS 9
+
+/*
+ * The round trip times recorded for a server: the smoothed one and how many
+ * samples fell into each bucket. Bucket i counts the samples not longer than
+ * fo_rtt_bucket_limit(i) and longer than the limit of the previous bucket.
+ */
+struct fo_rtt_histogram {
+    uint32_t srtt;
+    uint64_t count;
+    uint64_t buckets[FO_RTT_BUCKETS];
+};
+
+/*
+ * Returns the upper bound of the histogram bucket in microseconds, the last
+ * bucket is unbounded and returns UINT32_MAX.
+ */
+uint32_t fo_rtt_bucket_limit(size_t bucket);
+
+/*
+ * Copies the round trip time histogram of the server called name into
+ * _histogram. Returns ENOENT if no time was recorded yet.
+ */
+errno_t fo_get_server_rtt_histogram(struct fo_ctx *ctx, const char *name,
+                                    struct fo_rtt_histogram *_histogram);
+
+/*
+ * What is known about a server: how often it was marked as working and as
+ * not working, how often it changed between the two, the smoothed share of
+ * failures in 1/1000 and the connect times.
+ */
+struct fo_server_stats {
+    const char *name;
+    uint64_t successes;
+    uint64_t failures;
+    uint64_t transitions;
+    uint32_t error_rate;
+    struct fo_rtt_histogram rtt;
+};
+
+/*
+ * Returns the statistics of every server the context knows about, the array
+ * is allocated on mem_ctx.
+ */
+errno_t fo_get_server_stats(TALLOC_CTX *mem_ctx, struct fo_ctx *ctx,
+                            struct fo_server_stats **_stats, size_t *_count);
+
+/* Writes the statistics of the servers to the debug log */
+void fo_dump_stats(struct fo_ctx *ctx);
+
+/*
+ * Makes a working primary server the active one of the service if it answers
+ * considerably faster than the current active server, according to the
+ * recorded round trip times weighted by the share of failed connections.
+ * Returns true if the active server changed, the next resolution of the
+ * service then returns the faster server. When no server is active the
+ * resolution prefers such a server over the next one in the list as well.
+ */
+bool fo_prefer_faster_server(struct fo_service *service);
+
+/*
+ * Orders the servers with the same priority by their smoothed round trip
+ * time. Servers without a recorded time keep their relative order after the
+ * measured ones. The result of every SRV lookup is sorted this way.
+ */
+void fo_sort_servers_by_rtt(struct fo_ctx *ctx,
+                            struct fo_server_info *servers,
+                            size_t num);
+
 /*
  * pvt will be talloc_stealed to ctx
  */
@@ -87,6 +87,16 @@ enum hbac_eval_result_int {
     HBAC_EVAL_UNMATCHED
 };
 
+/* Rule elements which are indexed by hbac_rule_index_create() */
+enum hbac_index_dim {
+    HBAC_INDEX_USERS,
+    HBAC_INDEX_SERVICES,
+    HBAC_INDEX_TARGETHOSTS,
+    HBAC_INDEX_DIMS
+};
+
+#define HBAC_INDEX_ALL_DIMS ((1 << HBAC_INDEX_DIMS) - 1)
+
 static bool hbac_rule_element_is_complete(struct hbac_rule_element *el)
 {
     if (el == NULL) return false;
@@ -142,17 +152,17 @@ enum hbac_eval_result_int hbac_evaluate_rule(struct hbac_rule *rule,
                                              struct hbac_eval_req *hbac_req,
                                              enum hbac_error_code *error);
 
-enum hbac_eval_result hbac_evaluate(struct hbac_rule **rules,
-                                    struct hbac_eval_req *hbac_req,
-                                    struct hbac_info **info)
+/* Evaluates the rules in order, only the rules which are indexed in all
+ * dimensions are considered if candidates is not NULL */
+static enum hbac_eval_result hbac_evaluate_rules(struct hbac_rule **rules,
+                                                 const uint8_t *candidates,
+                                                 struct hbac_eval_req *hbac_req,
+                                                 struct hbac_info **info)
 {
     enum hbac_error_code ret;
     enum hbac_eval_result result = HBAC_EVAL_DENY;
     enum hbac_eval_result_int intermediate_result;
 
-    HBAC_DEBUG(HBAC_DBG_INFO, "[< hbac_evaluate()\n");
-    hbac_req_debug_print(hbac_req);
-
     if (info) {
         *info = malloc(sizeof(struct hbac_info));
         if (!*info) {
@@ -164,6 +174,10 @@ enum hbac_eval_result hbac_evaluate(struct hbac_rule **rules,
     }
 
     for (uint32_t i = 0; rules[i]; i++) {
+        if (candidates != NULL && candidates[i] != HBAC_INDEX_ALL_DIMS) {
+            continue;
+        }
+
         hbac_rule_debug_print(rules[i]);
         intermediate_result = hbac_evaluate_rule(rules[i], hbac_req, &ret);
         if (intermediate_result == HBAC_EVAL_UNMATCHED) {
@@ -205,11 +219,379 @@ enum hbac_eval_result hbac_evaluate(struct hbac_rule **rules,
      * result to ALLOW explicitly or we'll stick with the default DENY.
      */
 done:
+    return result;
+}
+
+enum hbac_eval_result hbac_evaluate(struct hbac_rule **rules,
+                                    struct hbac_eval_req *hbac_req,
+                                    struct hbac_info **info)
+{
+    enum hbac_eval_result result;
+
+    HBAC_DEBUG(HBAC_DBG_INFO, "[< hbac_evaluate()\n");
+    hbac_req_debug_print(hbac_req);
+
+    result = hbac_evaluate_rules(rules, NULL, hbac_req, info);
 
     HBAC_DEBUG(HBAC_DBG_INFO, "hbac_evaluate() >]\n");
     return result;
 }
 
+/* The index maps the names and groups of the users, services and target
+ * hosts of the rules to the rules which contain them. A rule is a candidate
+ * for a request if it is found in every dimension, the candidates are then
+ * evaluated in order with hbac_evaluate_rule() so the result is the same as
+ * with hbac_evaluate(). Only ASCII names are indexed since a case-insensitive
+ * comparison of other UTF-8 strings can match strings of a different form,
+ * the rules with other names are candidates for every request. */
+struct hbac_index_key {
+    /* 'n' or 'g' for names and groups followed by the lowercase name */
+    char *key;
+    size_t rule;
+};
+
+struct hbac_index_table {
+    struct hbac_index_key *keys;
+    size_t num_keys;
+    size_t alloc_keys;
+
+    /* rules which are candidates for any request */
+    size_t *any;
+    size_t num_any;
+    size_t alloc_any;
+};
+
+struct hbac_rule_index {
+    struct hbac_rule **rules;
+    size_t num_rules;
+
+    struct hbac_index_table tables[HBAC_INDEX_DIMS];
+};
+
+/* Returns EINVAL if the name is not ASCII and cannot be indexed */
+static errno_t hbac_index_key(char type, const char *name, char **_key)
+{
+    size_t len;
+    char *key;
+
+    len = strlen(name);
+    key = malloc(len + 2);
+    if (key == NULL) {
+        return ENOMEM;
+    }
+
+    key[0] = type;
+    /* not tolower(), which depends on the locale */
+    for (size_t i = 0; i < len; i++) {
+        if ((unsigned char) name[i] > 0x7f) {
+            free(key);
+            return EINVAL;
+        } else if (name[i] >= 'A' && name[i] <= 'Z') {
+            key[i + 1] = name[i] - 'A' + 'a';
+        } else {
+            key[i + 1] = name[i];
+        }
+    }
+    key[len + 1] = '\0';
+
+    *_key = key;
+    return EOK;
+}
+
+static errno_t hbac_index_add_any(struct hbac_index_table *table, size_t rule)
+{
+    size_t *any;
+
+    if (table->num_any > 0 && table->any[table->num_any - 1] == rule) {
+        return EOK;
+    }
+
+    if (table->num_any == table->alloc_any) {
+        table->alloc_any = table->alloc_any ? table->alloc_any * 2 : 16;
+        any = realloc(table->any, table->alloc_any * sizeof(size_t));
+        if (any == NULL) {
+            return ENOMEM;
+        }
+        table->any = any;
+    }
+
+    table->any[table->num_any] = rule;
+    table->num_any++;
+    return EOK;
+}
+
+static errno_t hbac_index_add_names(struct hbac_index_table *table,
+                                    char type, const char **names,
+                                    size_t rule)
+{
+    struct hbac_index_key *keys;
+    char *key;
+    errno_t ret;
+
+    if (names == NULL) {
+        return EOK;
+    }
+
+    for (size_t i = 0; names[i]; i++) {
+        ret = hbac_index_key(type, names[i], &key);
+        if (ret == EINVAL) {
+            return hbac_index_add_any(table, rule);
+        } else if (ret != EOK) {
+            return ret;
+        }
+
+        if (table->num_keys == table->alloc_keys) {
+            table->alloc_keys = table->alloc_keys ? table->alloc_keys * 2 : 64;
+            keys = realloc(table->keys,
+                           table->alloc_keys * sizeof(struct hbac_index_key));
+            if (keys == NULL) {
+                free(key);
+                return ENOMEM;
+            }
+            table->keys = keys;
+        }
+
+        table->keys[table->num_keys].key = key;
+        table->keys[table->num_keys].rule = rule;
+        table->num_keys++;
+    }
+
+    return EOK;
+}
+
+static int hbac_index_key_cmp(const void *p1, const void *p2)
+{
+    const struct hbac_index_key *k1 = p1;
+    const struct hbac_index_key *k2 = p2;
+    int ret;
+
+    ret = strcmp(k1->key, k2->key);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return (k1->rule > k2->rule) - (k1->rule < k2->rule);
+}
+
+static errno_t hbac_index_add_element(struct hbac_index_table *table,
+                                      struct hbac_rule_element *el,
+                                      size_t rule)
+{
+    errno_t ret;
+
+    if (el->category & HBAC_CATEGORY_ALL) {
+        return hbac_index_add_any(table, rule);
+    }
+
+    ret = hbac_index_add_names(table, 'n', el->names, rule);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return hbac_index_add_names(table, 'g', el->groups, rule);
+}
+
+void hbac_free_rule_index(struct hbac_rule_index *index)
+{
+    struct hbac_index_table *table;
+
+    if (index == NULL) return;
+
+    for (int d = 0; d < HBAC_INDEX_DIMS; d++) {
+        table = &index->tables[d];
+        for (size_t i = 0; i < table->num_keys; i++) {
+            free(table->keys[i].key);
+        }
+        free(table->keys);
+        free(table->any);
+    }
+
+    free(index->rules);
+    free(index);
+}
+
+enum hbac_error_code hbac_rule_index_create(struct hbac_rule **rules,
+                                            struct hbac_rule_index **_index)
+{
+    struct hbac_rule_index *index;
+    struct hbac_rule_element *el[HBAC_INDEX_DIMS];
+    size_t num_rules;
+    bool complete;
+    errno_t ret;
+
+    for (num_rules = 0; rules[num_rules]; num_rules++);
+
+    index = calloc(1, sizeof(struct hbac_rule_index));
+    if (index == NULL) {
+        return HBAC_ERROR_OUT_OF_MEMORY;
+    }
+
+    index->rules = calloc(num_rules + 1, sizeof(struct hbac_rule *));
+    if (index->rules == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    memcpy(index->rules, rules, num_rules * sizeof(struct hbac_rule *));
+    index->num_rules = num_rules;
+
+    for (size_t i = 0; i < num_rules; i++) {
+        /* disabled rules never match */
+        if (!rules[i]->enabled) continue;
+
+        el[HBAC_INDEX_USERS] = rules[i]->users;
+        el[HBAC_INDEX_SERVICES] = rules[i]->services;
+        el[HBAC_INDEX_TARGETHOSTS] = rules[i]->targethosts;
+        complete = el[HBAC_INDEX_USERS] && el[HBAC_INDEX_SERVICES]
+                   && el[HBAC_INDEX_TARGETHOSTS] && rules[i]->srchosts;
+
+        for (int d = 0; d < HBAC_INDEX_DIMS; d++) {
+            /* incomplete rules are evaluated to report the error */
+            if (!complete) {
+                ret = hbac_index_add_any(&index->tables[d], i);
+            } else {
+                ret = hbac_index_add_element(&index->tables[d], el[d], i);
+            }
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+    }
+
+    for (int d = 0; d < HBAC_INDEX_DIMS; d++) {
+        if (index->tables[d].num_keys > 0) {
+            qsort(index->tables[d].keys, index->tables[d].num_keys,
+                  sizeof(struct hbac_index_key), hbac_index_key_cmp);
+        }
+    }
+
+    HBAC_DEBUG(HBAC_DBG_TRACE, "Indexed %zu HBAC rules.\n", num_rules);
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        HBAC_DEBUG(HBAC_DBG_ERROR, "Out of memory.\n");
+        hbac_free_rule_index(index);
+        return HBAC_ERROR_OUT_OF_MEMORY;
+    }
+
+    *_index = index;
+    return HBAC_SUCCESS;
+}
+
+static errno_t hbac_index_mark_name(struct hbac_index_table *table,
+                                    char type, const char *name,
+                                    uint8_t bit, uint8_t *candidates)
+{
+    struct hbac_index_key search;
+    size_t lo = 0;
+    size_t hi = table->num_keys;
+    size_t mid;
+    errno_t ret;
+
+    ret = hbac_index_key(type, name, &search.key);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    /* find the first key which is not lower */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strcmp(table->keys[mid].key, search.key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (; lo < table->num_keys
+            && strcmp(table->keys[lo].key, search.key) == 0; lo++) {
+        candidates[table->keys[lo].rule] |= bit;
+    }
+
+    free(search.key);
+    return EOK;
+}
+
+static errno_t hbac_index_mark(struct hbac_rule_index *index,
+                               int dim,
+                               struct hbac_request_element *req_el,
+                               uint8_t *candidates)
+{
+    struct hbac_index_table *table = &index->tables[dim];
+    uint8_t bit = 1 << dim;
+    errno_t ret;
+
+    for (size_t i = 0; i < table->num_any; i++) {
+        candidates[table->any[i]] |= bit;
+    }
+
+    if (req_el == NULL) {
+        return EOK;
+    }
+
+    if (req_el->name != NULL) {
+        ret = hbac_index_mark_name(table, 'n', req_el->name, bit, candidates);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    if (req_el->groups != NULL) {
+        for (size_t i = 0; req_el->groups[i]; i++) {
+            ret = hbac_index_mark_name(table, 'g', req_el->groups[i],
+                                       bit, candidates);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+    }
+
+    return EOK;
+}
+
+enum hbac_eval_result hbac_evaluate_index(struct hbac_rule_index *index,
+                                          struct hbac_eval_req *hbac_req,
+                                          struct hbac_info **info)
+{
+    enum hbac_eval_result result;
+    struct hbac_request_element *req_el[HBAC_INDEX_DIMS];
+    uint8_t *candidates;
+    errno_t ret;
+
+    HBAC_DEBUG(HBAC_DBG_INFO, "[< hbac_evaluate_index()\n");
+    hbac_req_debug_print(hbac_req);
+
+    candidates = calloc(index->num_rules + 1, sizeof(uint8_t));
+    if (candidates == NULL) {
+        HBAC_DEBUG(HBAC_DBG_ERROR, "Out of memory.\n");
+        return HBAC_EVAL_OOM;
+    }
+
+    req_el[HBAC_INDEX_USERS] = hbac_req->user;
+    req_el[HBAC_INDEX_SERVICES] = hbac_req->service;
+    req_el[HBAC_INDEX_TARGETHOSTS] = hbac_req->targethost;
+
+    for (int d = 0; d < HBAC_INDEX_DIMS; d++) {
+        ret = hbac_index_mark(index, d, req_el[d], candidates);
+        if (ret == EINVAL) {
+            /* a name which is not ASCII may match any rule */
+            for (size_t i = 0; i < index->num_rules; i++) {
+                candidates[i] |= 1 << d;
+            }
+        } else if (ret != EOK) {
+            HBAC_DEBUG(HBAC_DBG_ERROR, "Out of memory.\n");
+            free(candidates);
+            return HBAC_EVAL_OOM;
+        }
+    }
+
+    result = hbac_evaluate_rules(index->rules, candidates, hbac_req, info);
+    free(candidates);
+
+    HBAC_DEBUG(HBAC_DBG_INFO, "hbac_evaluate_index() >]\n");
+    return result;
+}
+
 static errno_t hbac_evaluate_element(struct hbac_rule_element *rule_el,
                                      struct hbac_request_element *req_el,
                                      bool *matched);
@@ -26,6 +26,7 @@
 #include <security/pam_modules.h>
 
 #include "util/util.h"
+#include "util/murmurhash3.h"
 #include "providers/ldap/sdap_async.h"
 #include "providers/ldap/sdap_access.h"
 #include "providers/ipa/ipa_common.h"
@@ -64,7 +65,7 @@ void hbac_debug_messages(const char *file, int line,
         break;
     }
 
-    if (DEBUG_IS_SET(loglevel)) {
+    if (DEBUG_IS_WANTED(loglevel)) {
         va_list ap;
 
         va_start(ap, fmt);
@@ -374,6 +375,46 @@ static void hbac_get_service_info_step(struct tevent_req *req);
 static void hbac_get_rule_info_step(struct tevent_req *req);
 static void hbac_sysdb_save (struct tevent_req *req);
 
+static uint32_t hbac_attrs_hash(uint32_t hash,
+                                size_t count,
+                                struct sysdb_attrs **list)
+{
+    struct ldb_message_element *el;
+    size_t i;
+    int j;
+    unsigned int k;
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < list[i]->num; j++) {
+            el = &list[i]->a[j];
+            hash = murmurhash3(el->name, strlen(el->name), hash);
+            for (k = 0; k < el->num_values; k++) {
+                hash = murmurhash3((const char *) el->values[k].data,
+                                   el->values[k].length, hash);
+            }
+        }
+    }
+
+    return hash;
+}
+
+/* Everything the rules are built from, except the users and groups */
+static uint32_t hbac_ctx_rule_data_hash(struct hbac_ctx *hbac_ctx)
+{
+    uint32_t hash = 0xdeadbeef;
+
+    hash = hbac_attrs_hash(hash, hbac_ctx->host_count, hbac_ctx->hosts);
+    hash = hbac_attrs_hash(hash, hbac_ctx->hostgroup_count,
+                           hbac_ctx->hostgroups);
+    hash = hbac_attrs_hash(hash, hbac_ctx->service_count,
+                           hbac_ctx->services);
+    hash = hbac_attrs_hash(hash, hbac_ctx->servicegroup_count,
+                           hbac_ctx->servicegroups);
+    hash = hbac_attrs_hash(hash, hbac_ctx->rule_count, hbac_ctx->rules);
+
+    return hash;
+}
+
 static int hbac_get_host_info_step(struct hbac_ctx *hbac_ctx)
 {
     struct be_ctx *be_ctx = be_req_get_be_ctx(hbac_ctx->be_req);
@@ -392,17 +433,22 @@ static int hbac_get_host_info_step(struct hbac_ctx *hbac_ctx)
                     "ipa_hbac_support_srchost.\n");
         sss_log(SSS_LOG_NOTICE, "WARNING: Using deprecated option "
                     "ipa_hbac_support_srchost.\n");
+
+        req = ipa_host_info_send(hbac_ctx, be_ctx->ev,
+                                 sdap_id_op_handle(hbac_ctx->sdap_op),
+                                 hbac_ctx->sdap_ctx->opts,
+                                 hostname,
+                                 hbac_ctx->access_ctx->host_map,
+                                 hbac_ctx->access_ctx->hostgroup_map,
+                                 hbac_ctx->access_ctx->host_search_bases);
     } else {
-        hostname = dp_opt_get_string(hbac_ctx->ipa_options, IPA_HOSTNAME);
+        /* the entries of the local host are shared with sudo and SELinux */
+        req = ipa_local_host_info_send(hbac_ctx, be_ctx->ev,
+                                       sdap_id_op_handle(hbac_ctx->sdap_op),
+                                       hbac_ctx->sdap_ctx->opts,
+                                       hbac_ctx->access_ctx->id_options,
+                                       true);
     }
-
-    req = ipa_host_info_send(hbac_ctx, be_ctx->ev,
-                             sdap_id_op_handle(hbac_ctx->sdap_op),
-                             hbac_ctx->sdap_ctx->opts,
-                             hostname,
-                             hbac_ctx->access_ctx->host_map,
-                             hbac_ctx->access_ctx->hostgroup_map,
-                             hbac_ctx->access_ctx->host_search_bases);
     if (req == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not get host info\n");
         return ENOMEM;
@@ -419,11 +465,19 @@ static void hbac_get_service_info_step(struct tevent_req *req)
             tevent_req_callback_data(req, struct hbac_ctx);
     struct be_ctx *be_ctx = be_req_get_be_ctx(hbac_ctx->be_req);
 
-    ret = ipa_host_info_recv(req, hbac_ctx,
-                             &hbac_ctx->host_count,
-                             &hbac_ctx->hosts,
-                             &hbac_ctx->hostgroup_count,
-                             &hbac_ctx->hostgroups);
+    if (dp_opt_get_bool(hbac_ctx->ipa_options, IPA_HBAC_SUPPORT_SRCHOST)) {
+        ret = ipa_host_info_recv(req, hbac_ctx,
+                                 &hbac_ctx->host_count,
+                                 &hbac_ctx->hosts,
+                                 &hbac_ctx->hostgroup_count,
+                                 &hbac_ctx->hostgroups);
+    } else {
+        ret = ipa_local_host_info_recv(req, hbac_ctx,
+                                       &hbac_ctx->host_count,
+                                       &hbac_ctx->hosts,
+                                       &hbac_ctx->hostgroup_count,
+                                       &hbac_ctx->hostgroups);
+    }
     talloc_zfree(req);
     if (!hbac_check_step_result(hbac_ctx, ret)) {
         return;
@@ -526,6 +580,7 @@ static void hbac_sysdb_save(struct tevent_req *req)
             talloc_get_type(be_ctx->bet_info[BET_ACCESS].pvt_bet_data,
                             struct ipa_access_ctx);
     TALLOC_CTX *tmp_ctx;
+    uint32_t hash;
 
     ret = ipa_hbac_rule_info_recv(req, hbac_ctx,
                                   &hbac_ctx->rule_count,
@@ -559,6 +614,9 @@ static void hbac_sysdb_save(struct tevent_req *req)
             return;
         }
 
+        talloc_zfree(access_ctx->rule_set);
+        access_ctx->rule_set_hash = 0;
+
         /* If no rules are found, we default to DENY */
         ipa_access_reply(hbac_ctx, PAM_PERM_DENIED);
         return;
@@ -619,6 +677,14 @@ static void hbac_sysdb_save(struct tevent_req *req)
     }
     in_transaction = false;
 
+    hash = hbac_ctx_rule_data_hash(hbac_ctx);
+    if (access_ctx->rule_set != NULL && hash != access_ctx->rule_set_hash) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "HBAC rules changed, the rule set will be rebuilt\n");
+        talloc_zfree(access_ctx->rule_set);
+    }
+    access_ctx->rule_set_hash = hash;
+
     /* We don't need the rule data any longer,
      * the rest of the processing relies on
      * sysdb lookups.
@@ -643,39 +709,156 @@ fail:
     ipa_access_reply(hbac_ctx, PAM_SYSTEM_ERR);
 }
 
-void ipa_hbac_evaluate_rules(struct hbac_ctx *hbac_ctx)
+struct ipa_hbac_rule_set {
+    struct hbac_rule **rules;
+    struct hbac_rule_index *index;
+
+    /* the cached rules contain a DENY rule */
+    bool deny;
+};
+
+static int ipa_hbac_rule_set_destructor(struct ipa_hbac_rule_set *rule_set)
+{
+    hbac_free_rule_index(rule_set->index);
+    return 0;
+}
+
+/* Members of a rule which are not in the cache yet are left out of the
+ * rule, the rule set must be built again once they are cached */
+static bool hbac_rules_users_resolved(struct hbac_ctx *hbac_ctx,
+                                      struct hbac_rule **rules)
+{
+    struct hbac_rule_element *users;
+    struct ldb_message_element *el;
+    size_t count;
+    size_t i;
+    size_t j;
+    errno_t ret;
+
+    for (i = 0; rules[i] != NULL; i++) {
+        users = rules[i]->users;
+        if (!rules[i]->enabled || users == NULL
+                || (users->category & HBAC_CATEGORY_ALL)) {
+            continue;
+        }
+
+        ret = sysdb_attrs_get_el_ext(hbac_ctx->rules[i], IPA_MEMBER_USER,
+                                     false, &el);
+        if (ret != EOK) {
+            continue;
+        }
+
+        count = 0;
+        for (j = 0; users->names != NULL && users->names[j] != NULL; j++) {
+            count++;
+        }
+        for (j = 0; users->groups != NULL && users->groups[j] != NULL; j++) {
+            count++;
+        }
+
+        if (count < el->num_values) {
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "Not all members of rule [%s] are cached\n", rules[i]->name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static errno_t ipa_hbac_get_rule_set(struct hbac_ctx *hbac_ctx,
+                                     struct ipa_hbac_rule_set **_rule_set)
 {
     struct be_ctx *be_ctx = be_req_get_be_ctx(hbac_ctx->be_req);
+    struct ipa_access_ctx *access_ctx = hbac_ctx->access_ctx;
+    struct ipa_hbac_rule_set *rule_set;
+    enum hbac_error_code code;
     errno_t ret;
-    struct hbac_rule **hbac_rules;
-    struct hbac_eval_req *eval_req;
-    enum hbac_eval_result result;
-    struct hbac_info *info;
+
+    if (access_ctx->rule_set != NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Using the HBAC rules built before\n");
+        *_rule_set = access_ctx->rule_set;
+        return EOK;
+    }
+
+    rule_set = talloc_zero(hbac_ctx, struct ipa_hbac_rule_set);
+    if (rule_set == NULL) {
+        return ENOMEM;
+    }
+    talloc_set_destructor(rule_set, ipa_hbac_rule_set_destructor);
 
     /* Get HBAC rules from the sysdb */
     ret = hbac_get_cached_rules(hbac_ctx, be_ctx->domain,
                                 &hbac_ctx->rule_count, &hbac_ctx->rules);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not retrieve rules from the cache\n");
-        ipa_access_reply(hbac_ctx, PAM_SYSTEM_ERR);
+        goto done;
     }
 
-    ret = hbac_ctx_to_rules(hbac_ctx, hbac_ctx,
-                            &hbac_rules, &eval_req);
+    ret = hbac_ctx_to_rules(rule_set, hbac_ctx, &rule_set->rules);
     if (ret == EPERM) {
+        rule_set->deny = true;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not construct HBAC rules\n");
+        goto done;
+    } else {
+        code = hbac_rule_index_create(rule_set->rules, &rule_set->index);
+        if (code != HBAC_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not index HBAC rules: [%s]\n",
+                  hbac_error_string(code));
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    if (rule_set->deny
+            || hbac_rules_users_resolved(hbac_ctx, rule_set->rules)) {
+        access_ctx->rule_set = talloc_steal(access_ctx, rule_set);
+    }
+
+    *_rule_set = rule_set;
+    ret = EOK;
+
+done:
+    hbac_ctx->rule_count = 0;
+    talloc_zfree(hbac_ctx->rules);
+    if (ret != EOK) {
+        talloc_free(rule_set);
+    }
+    return ret;
+}
+
+void ipa_hbac_evaluate_rules(struct hbac_ctx *hbac_ctx)
+{
+    errno_t ret;
+    struct ipa_hbac_rule_set *rule_set;
+    struct hbac_eval_req *eval_req;
+    enum hbac_eval_result result;
+    struct hbac_info *info;
+
+    ret = ipa_hbac_get_rule_set(hbac_ctx, &rule_set);
+    if (ret != EOK) {
+        ipa_access_reply(hbac_ctx, PAM_SYSTEM_ERR);
+        return;
+    }
+
+    if (rule_set->deny) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "DENY rules detected. Denying access to all users\n");
         ipa_access_reply(hbac_ctx, PAM_PERM_DENIED);
         return;
-    } else if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Could not construct HBAC rules\n");
+    }
+
+    ret = hbac_ctx_to_eval_request(hbac_ctx, hbac_ctx, &eval_req);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not construct eval request\n");
         ipa_access_reply(hbac_ctx, PAM_SYSTEM_ERR);
         return;
     }
 
     hbac_enable_debug(hbac_debug_messages);
 
-    result = hbac_evaluate(hbac_rules, eval_req, &info);
+    result = hbac_evaluate_index(rule_set->index, eval_req, &info);
     if (result == HBAC_EVAL_ALLOW) {
         DEBUG(SSSDBG_MINOR_FAILURE, "Access granted by HBAC rule [%s]\n",
                   info->rule_name);
@@ -32,6 +32,8 @@ enum ipa_access_mode {
     IPA_ACCESS_ALLOW
 };
 
+struct ipa_hbac_rule_set;
+
 struct ipa_access_ctx {
     struct sdap_id_ctx *sdap_ctx;
     struct dp_option *ipa_options;
@@ -39,10 +41,18 @@ struct ipa_access_ctx {
     time_t last_update;
     struct sdap_access_ctx *sdap_access_ctx;
 
+    /* HBAC rules built from the cache, kept until a refresh saves
+     * different rules, hosts or services */
+    struct ipa_hbac_rule_set *rule_set;
+    uint32_t rule_set_hash;
+
     struct sdap_attr_map *host_map;
     struct sdap_attr_map *hostgroup_map;
     struct sdap_search_base **host_search_bases;
     struct sdap_search_base **hbac_search_bases;
+
+    /* options of the id provider, they hold the cached local host */
+    struct ipa_options *id_options;
 };
 
 struct hbac_ctx {
@@ -54,6 +54,8 @@ enum ipa_basic_opt {
     IPA_SERVER_MODE,
     IPA_VIEWS_SEARCH_BASE,
     IPA_KRB5_CONFD_PATH,
+    IPA_EXTDOM_PARALLEL_REQUESTS,
+    IPA_VIEWS_PREFETCH_INTERVAL,
 
     IPA_OPTS_BASIC /* opts counter */
 };
@@ -176,6 +178,7 @@ enum ipa_sudocmd_attrs {
     IPA_AT_SUDOCMD_UUID,
     IPA_AT_SUDOCMD_CMD,
     IPA_AT_SUDOCMD_MEMBEROF,
+    IPA_AT_SUDOCMD_ENTRYUSN,
 
     IPA_OPTS_SUDOCMD
 };
@@ -189,6 +192,9 @@ struct ipa_auth_ctx {
 
 /* In server mode, each subdomain corresponds to an AD context */
 
+struct ipa_override_cache;
+struct ipa_host_cache;
+
 struct ipa_id_ctx {
     struct sdap_id_ctx *sdap_id_ctx;
     struct ipa_options *ipa_options;
@@ -206,6 +212,11 @@ struct ipa_options {
     struct sdap_attr_map *selinuxuser_map;
     struct sdap_attr_map *view_map;
     struct sdap_attr_map *override_map;
+    /* overrides of the view prefetched by the id provider, NULL if the
+     * prefetch is disabled */
+    struct ipa_override_cache *override_cache;
+    /* entries of the local host, see ipa_local_host_info_send() */
+    struct ipa_host_cache *host_cache;
 
     struct sdap_search_base **host_search_bases;
     struct sdap_search_base **hbac_search_bases;
@@ -289,6 +289,55 @@ enum hbac_eval_result hbac_evaluate(struct hbac_rule **rules,
                                     struct hbac_eval_req *hbac_req,
                                     struct hbac_info **info);
 
+/**
+ * Opaque type contained in hbac_evaluator.c
+ */
+struct hbac_rule_index;
+
+/**
+ * @brief Index a set of HBAC rules for repeated evaluation
+ *
+ * The index maps the users, services and target hosts of the rules to
+ * the rules which contain them, so that #hbac_evaluate_index only needs to
+ * check the rules which can apply to a request.
+ *
+ * @param[in] rules   A NULL-terminated list of rules to index. The rules
+ *                    are not copied, they must not be modified or freed
+ *                    while the index is in use.
+ * @param[out] index  The new index, to be freed with #hbac_free_rule_index
+ * @return
+ *  - #HBAC_SUCCESS:             The index was created
+ *  - #HBAC_ERROR_OUT_OF_MEMORY: Insufficient memory to create the index
+ */
+enum hbac_error_code hbac_rule_index_create(struct hbac_rule **rules,
+                                            struct hbac_rule_index **index);
+
+/**
+ * @brief Evaluate an authorization request against an indexed rule set
+ *
+ * The result is the same as the result of #hbac_evaluate with the rules
+ * the index was created from.
+ *
+ * @param[in] index    An index returned by #hbac_rule_index_create
+ * @param[in] hbac_req A user authorization request
+ * @param[out] info    Extended information (including the name of the
+ *                     rule that allowed access (or caused a parse error)
+ * @return
+ *  - #HBAC_EVAL_ERROR: An error occurred
+ *  - #HBAC_EVAL_ALLOW: Access is granted
+ *  - #HBAC_EVAL_DENY:  Access is denied
+ *  - #HBAC_EVAL_OOM:   Insufficient memory to complete the evaluation
+ */
+enum hbac_eval_result hbac_evaluate_index(struct hbac_rule_index *index,
+                                          struct hbac_eval_req *hbac_req,
+                                          struct hbac_info **info);
+
+/**
+ * @brief Free an index returned by #hbac_rule_index_create
+ * @param index #hbac_rule_index returned by #hbac_rule_index_create
+ */
+void hbac_free_rule_index(struct hbac_rule_index *index);
+
 /**
  * @brief Display result of hbac evaluation in human-readable form
  * @param[in] result Return value of #hbac_evaluate
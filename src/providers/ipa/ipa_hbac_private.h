@@ -79,8 +79,12 @@ replace_attribute_name(const char *old_name,
 
 errno_t hbac_ctx_to_rules(TALLOC_CTX *mem_ctx,
                           struct hbac_ctx *hbac_ctx,
-                          struct hbac_rule ***rules,
-                          struct hbac_eval_req **request);
+                          struct hbac_rule ***rules);
+
+errno_t
+hbac_ctx_to_eval_request(TALLOC_CTX *mem_ctx,
+                         struct hbac_ctx *hbac_ctx,
+                         struct hbac_eval_req **request);
 
 errno_t
 hbac_get_category(struct sysdb_attrs *attrs,
@@ -455,3 +455,320 @@ errno_t ipa_host_info_recv(struct tevent_req *req,
 
     return EOK;
 }
+
+/* Entries of the local host are shared by HBAC, sudo and SELinux. They are
+ * reused for a short time without contacting the server, afterwards only
+ * the host entry is read again and the host groups are dereferenced only
+ * if the membership of the host changed. */
+#define IPA_LOCAL_HOST_CACHE_TIMEOUT 15
+
+struct ipa_host_cache {
+    time_t expire;
+    struct sysdb_attrs *host;
+
+    bool has_hostgroups;
+    size_t hostgroup_count;
+    struct sysdb_attrs **hostgroups;
+};
+
+static struct sysdb_attrs *
+ipa_host_cache_copy(TALLOC_CTX *mem_ctx, struct sysdb_attrs *src)
+{
+    struct sysdb_attrs *dst;
+    errno_t ret;
+    size_t i;
+
+    dst = sysdb_new_attrs(mem_ctx);
+    if (dst == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < src->num; i++) {
+        ret = sysdb_attrs_copy_values(src, dst, src->a[i].name);
+        if (ret != EOK) {
+            talloc_free(dst);
+            return NULL;
+        }
+    }
+
+    return dst;
+}
+
+static bool
+ipa_host_cache_same_memberof(struct sysdb_attrs *a,
+                             struct sysdb_attrs *b,
+                             const char *memberof)
+{
+    struct ldb_message_element *el_a = NULL;
+    struct ldb_message_element *el_b = NULL;
+    unsigned int i;
+
+    if (sysdb_attrs_get_el_ext(a, memberof, false, &el_a) != EOK) {
+        el_a = NULL;
+    }
+
+    if (sysdb_attrs_get_el_ext(b, memberof, false, &el_b) != EOK) {
+        el_b = NULL;
+    }
+
+    if (el_a == NULL || el_b == NULL) {
+        return el_a == el_b;
+    }
+
+    if (el_a->num_values != el_b->num_values) {
+        return false;
+    }
+
+    for (i = 0; i < el_a->num_values; i++) {
+        if (ldb_msg_find_val(el_b, &el_a->values[i]) == NULL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct ipa_local_host_state {
+    struct tevent_context *ev;
+    struct sdap_handle *sh;
+    struct sdap_options *opts;
+    struct ipa_options *ipa_opts;
+    struct ipa_host_cache *cache;
+    const char *hostname;
+    bool want_hostgroups;
+
+    size_t host_count;
+    struct sysdb_attrs **hosts;
+    size_t hostgroup_count;
+    struct sysdb_attrs **hostgroups;
+};
+
+static void ipa_local_host_done(struct tevent_req *subreq);
+static void ipa_local_hostgroups_done(struct tevent_req *subreq);
+static errno_t ipa_local_host_from_cache(struct ipa_local_host_state *state);
+
+struct tevent_req *
+ipa_local_host_info_send(TALLOC_CTX *mem_ctx,
+                         struct tevent_context *ev,
+                         struct sdap_handle *sh,
+                         struct sdap_options *opts,
+                         struct ipa_options *ipa_opts,
+                         bool hostgroups)
+{
+    struct ipa_local_host_state *state;
+    struct tevent_req *subreq;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct ipa_local_host_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->sh = sh;
+    state->opts = opts;
+    state->ipa_opts = ipa_opts;
+    state->want_hostgroups = hostgroups;
+    state->hostname = dp_opt_get_string(ipa_opts->basic, IPA_HOSTNAME);
+
+    if (ipa_opts->host_cache == NULL) {
+        ipa_opts->host_cache = talloc_zero(ipa_opts, struct ipa_host_cache);
+        if (ipa_opts->host_cache == NULL) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+    }
+    state->cache = ipa_opts->host_cache;
+
+    if (state->cache->host != NULL && state->cache->expire > time(NULL)
+            && (!hostgroups || state->cache->has_hostgroups)) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Using cached entry of host [%s]\n",
+              state->hostname);
+        ret = ipa_local_host_from_cache(state);
+        goto immediately;
+    }
+
+    /* read just the host entry first, the host groups are only looked up
+     * again if its membership changed */
+    subreq = ipa_host_info_send(state, ev, sh, opts, state->hostname,
+                                ipa_opts->host_map, NULL,
+                                ipa_opts->host_search_bases);
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    tevent_req_set_callback(subreq, ipa_local_host_done, req);
+    return req;
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static void ipa_local_host_done(struct tevent_req *subreq)
+{
+    struct ipa_local_host_state *state;
+    struct tevent_req *req;
+    struct ipa_host_cache *cache;
+    struct sysdb_attrs **hosts;
+    size_t host_count;
+    bool same;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct ipa_local_host_state);
+    cache = state->cache;
+
+    ret = ipa_host_info_recv(subreq, state, &host_count, &hosts, NULL, NULL);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    same = cache->host != NULL && ipa_host_cache_same_memberof(cache->host,
+                hosts[0],
+                state->ipa_opts->host_map[IPA_AT_HOST_MEMBER_OF].sys_name);
+    if (!same) {
+        cache->has_hostgroups = false;
+        cache->hostgroup_count = 0;
+        talloc_zfree(cache->hostgroups);
+    }
+
+    talloc_free(cache->host);
+    cache->host = talloc_steal(cache, hosts[0]);
+    cache->expire = time(NULL) + IPA_LOCAL_HOST_CACHE_TIMEOUT;
+
+    if (state->want_hostgroups && !cache->has_hostgroups) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Looking up host groups of [%s]\n",
+              state->hostname);
+
+        subreq = ipa_host_info_send(state, state->ev, state->sh, state->opts,
+                                    state->hostname,
+                                    state->ipa_opts->host_map,
+                                    state->ipa_opts->hostgroup_map,
+                                    state->ipa_opts->host_search_bases);
+        if (subreq == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        tevent_req_set_callback(subreq, ipa_local_hostgroups_done, req);
+        return;
+    }
+
+    ret = ipa_local_host_from_cache(state);
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static void ipa_local_hostgroups_done(struct tevent_req *subreq)
+{
+    struct ipa_local_host_state *state;
+    struct tevent_req *req;
+    struct ipa_host_cache *cache;
+    struct sysdb_attrs **hostgroups;
+    struct sysdb_attrs **hosts;
+    size_t hostgroup_count;
+    size_t host_count;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct ipa_local_host_state);
+    cache = state->cache;
+
+    ret = ipa_host_info_recv(subreq, state, &host_count, &hosts,
+                             &hostgroup_count, &hostgroups);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    talloc_free(cache->host);
+    cache->host = talloc_steal(cache, hosts[0]);
+    talloc_free(cache->hostgroups);
+    cache->hostgroups = talloc_steal(cache, hostgroups);
+    cache->hostgroup_count = hostgroup_count;
+    cache->has_hostgroups = true;
+
+    ret = ipa_local_host_from_cache(state);
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static errno_t ipa_local_host_from_cache(struct ipa_local_host_state *state)
+{
+    struct ipa_host_cache *cache = state->cache;
+    size_t i;
+
+    state->hosts = talloc_array(state, struct sysdb_attrs *, 1);
+    if (state->hosts == NULL) {
+        return ENOMEM;
+    }
+
+    state->hosts[0] = ipa_host_cache_copy(state->hosts, cache->host);
+    if (state->hosts[0] == NULL) {
+        return ENOMEM;
+    }
+    state->host_count = 1;
+
+    if (!state->want_hostgroups || cache->hostgroup_count == 0) {
+        return EOK;
+    }
+
+    state->hostgroups = talloc_array(state, struct sysdb_attrs *,
+                                     cache->hostgroup_count);
+    if (state->hostgroups == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < cache->hostgroup_count; i++) {
+        state->hostgroups[i] = ipa_host_cache_copy(state->hostgroups,
+                                                   cache->hostgroups[i]);
+        if (state->hostgroups[i] == NULL) {
+            return ENOMEM;
+        }
+    }
+    state->hostgroup_count = cache->hostgroup_count;
+
+    return EOK;
+}
+
+errno_t ipa_local_host_info_recv(struct tevent_req *req,
+                                 TALLOC_CTX *mem_ctx,
+                                 size_t *host_count,
+                                 struct sysdb_attrs ***hosts,
+                                 size_t *hostgroup_count,
+                                 struct sysdb_attrs ***hostgroups)
+{
+    struct ipa_local_host_state *state =
+            tevent_req_data(req, struct ipa_local_host_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *host_count = state->host_count;
+    *hosts = talloc_steal(mem_ctx, state->hosts);
+
+    if (hostgroup_count) *hostgroup_count = state->hostgroup_count;
+    if (hostgroups) *hostgroups = talloc_steal(mem_ctx, state->hostgroups);
+
+    return EOK;
+}
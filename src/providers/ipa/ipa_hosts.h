@@ -41,4 +41,25 @@ ipa_host_info_recv(struct tevent_req *req,
                    size_t *hostgroup_count,
                    struct sysdb_attrs ***hostgroups);
 
+struct ipa_options;
+
+/* Same as ipa_host_info_send() for the host ipa_hostname with the maps and
+ * search bases of ipa_opts, the entries are cached in ipa_opts and shared
+ * by all its callers. */
+struct tevent_req *
+ipa_local_host_info_send(TALLOC_CTX *mem_ctx,
+                         struct tevent_context *ev,
+                         struct sdap_handle *sh,
+                         struct sdap_options *opts,
+                         struct ipa_options *ipa_opts,
+                         bool hostgroups);
+
+errno_t
+ipa_local_host_info_recv(struct tevent_req *req,
+                         TALLOC_CTX *mem_ctx,
+                         size_t *host_count,
+                         struct sysdb_attrs ***hosts,
+                         size_t *hostgroup_count,
+                         struct sysdb_attrs ***hostgroups);
+
 #endif /* IPA_HOSTS_H_ */
@@ -95,6 +95,12 @@ errno_t ipa_get_ad_override_recv(struct tevent_req *req, int *dp_error_out,
                                  TALLOC_CTX *mem_ctx,
                                  struct sysdb_attrs **override_attrs);
 
+/* Sets up the periodic prefetch of the overrides of the view, the requests
+ * of ipa_get_ad_override_send() are answered from memory once the first
+ * refresh is done */
+errno_t ipa_override_prefetch_init(struct be_ctx *be_ctx,
+                                   struct ipa_id_ctx *ipa_ctx);
+
 struct tevent_req *ipa_subdomain_account_send(TALLOC_CTX *memctx,
                                               struct tevent_context *ev,
                                               struct ipa_id_ctx *ipa_ctx,
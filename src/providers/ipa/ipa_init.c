@@ -256,6 +256,26 @@ int sssm_ipa_id_init(struct be_ctx *bectx,
         goto done;
     }
 
+    ret = sdap_id_conn_warmup_setup(sdap_ctx->conn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_offline_probe_setup(sdap_ctx->conn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_server_probe_setup(sdap_ctx->conn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_stats_setup(sdap_ctx->conn);
+    if (ret != EOK) {
+        goto done;
+    }
+
     ret = sdap_setup_child();
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "setup_child failed [%d][%s].\n",
@@ -388,6 +408,12 @@ int sssm_ipa_id_init(struct be_ctx *bectx,
         goto done;
     }
 
+    ret = ipa_override_prefetch_init(bectx, ipa_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Overrides will not be prefetched "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+    }
+
     *ops = &ipa_id_ops;
     *pvt_data = ipa_ctx;
     ret = EOK;
@@ -608,6 +634,7 @@ int sssm_ipa_access_init(struct be_ctx *bectx,
     ipa_access_ctx->hostgroup_map = id_ctx->ipa_options->hostgroup_map;
     ipa_access_ctx->host_search_bases = id_ctx->ipa_options->host_search_bases;
     ipa_access_ctx->hbac_search_bases = id_ctx->ipa_options->hbac_search_bases;
+    ipa_access_ctx->id_options = id_ctx->ipa_options;
 
     ret = dp_copy_options(ipa_access_ctx, ipa_options->basic,
                           IPA_OPTS_BASIC, &ipa_access_ctx->ipa_options);
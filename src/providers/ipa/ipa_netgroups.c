@@ -56,9 +56,17 @@ struct ipa_get_netgroups_state {
     hash_table_t *new_users;
     hash_table_t *new_hosts;
 
-    int current_entity;
     int entities_found;
 
+    /* Parent of the concurrent member searches */
+    TALLOC_CTX *members_ctx;
+    int pending;
+
+    /* Names of the member users and hosts by the DN of the groups they
+     * are member of, built when the first netgroup is expanded */
+    hash_table_t *user_groups;
+    hash_table_t *host_groups;
+
     struct sysdb_attrs **netgroups;
     int netgroups_count;
 };
@@ -288,7 +296,11 @@ static int ipa_netgr_fetch_users(struct ipa_get_netgroups_state *state,
                                  struct tevent_req *req);
 static int ipa_netgr_fetch_hosts(struct ipa_get_netgroups_state *state,
                                  struct tevent_req *req);
-static void ipa_netgr_members_process(struct tevent_req *subreq);
+static errno_t ipa_netgr_fetch_members(struct ipa_get_netgroups_state *state,
+                                       struct tevent_req *req);
+static void ipa_netgr_netgroups_process(struct tevent_req *subreq);
+static void ipa_netgr_users_process(struct tevent_req *subreq);
+static void ipa_netgr_hosts_process(struct tevent_req *subreq);
 
 static void ipa_get_netgroups_process(struct tevent_req *subreq)
 {
@@ -407,22 +419,79 @@ static void ipa_get_netgroups_process(struct tevent_req *subreq)
         goto done;
     }
 
+    ret = ipa_netgr_fetch_members(state, req);
+    if (ret != EOK) goto done;
+
+    return;
+done:
+    tevent_req_error(req, ret);
+    return;
+}
+
+/* The searches for member netgroups, users and hosts run concurrently,
+ * each of them walks its search bases one after the other. They are all
+ * allocated on members_ctx, so the remaining ones are cancelled if one of
+ * them fails. */
+static errno_t ipa_netgr_fetch_members(struct ipa_get_netgroups_state *state,
+                                       struct tevent_req *req)
+{
+    int ret;
+
+    state->members_ctx = talloc_new(state);
+    if (state->members_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    state->pending = 0;
+    state->netgr_base_iter = 0;
+    state->user_base_iter = 0;
+    state->host_base_iter = 0;
+
+    /* If there is a member netgroup, we always have to
+     * ask for both member users and hosts */
     if (state->entities_found & ENTITY_NG) {
-        state->netgr_base_iter = 0;
         ret = ipa_netgr_fetch_netgroups(state, req);
-        if (ret != EOK) goto done;
-    } else if (state->entities_found & ENTITY_USER) {
+        if (ret == EOK) {
+            state->pending++;
+        } else if (ret != ENOENT) {
+            goto fail;
+        }
+    }
+
+    if (state->entities_found & (ENTITY_USER | ENTITY_NG)) {
         ret = ipa_netgr_fetch_users(state, req);
-        if (ret != EOK) goto done;
-    } else if (state->entities_found & ENTITY_HOST) {
+        if (ret == EOK) {
+            state->pending++;
+        } else if (ret != ENOENT) {
+            goto fail;
+        }
+    }
+
+    if (state->entities_found & (ENTITY_HOST | ENTITY_NG)) {
         ret = ipa_netgr_fetch_hosts(state, req);
-        if (ret != EOK) goto done;
+        if (ret == EOK) {
+            state->pending++;
+        } else if (ret != ENOENT) {
+            goto fail;
+        }
     }
 
-    return;
-done:
-    tevent_req_error(req, ret);
-    return;
+    if (state->pending == 0) {
+        /* no search base to look into */
+        talloc_zfree(state->members_ctx);
+        ret = ipa_netgr_process_all(state);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        tevent_req_done(req);
+    }
+
+    return EOK;
+
+fail:
+    talloc_zfree(state->members_ctx);
+    return ret;
 }
 
 static int ipa_netgr_fetch_netgroups(struct ipa_get_netgroups_state *state,
@@ -447,18 +516,17 @@ static int ipa_netgr_fetch_netgroups(struct ipa_get_netgroups_state *state,
     if (filter == NULL)
         return ENOMEM;
 
-    subreq = sdap_get_generic_send(state, state->ev, state->opts, state->sh,
+    subreq = sdap_get_generic_send(state->members_ctx, state->ev, state->opts,
+                                   state->sh,
                                    bases[state->netgr_base_iter]->basedn,
                                    bases[state->netgr_base_iter]->scope,
                                    filter, state->attrs, state->opts->netgroup_map,
                                    IPA_OPTS_NETGROUP, state->timeout, true);
-
-    state->current_entity = ENTITY_NG;
     if (subreq == NULL) {
         return ENOMEM;
     }
 
-    tevent_req_set_callback(subreq, ipa_netgr_members_process, req);
+    tevent_req_set_callback(subreq, ipa_netgr_netgroups_process, req);
 
     return EOK;
 }
@@ -466,9 +534,7 @@ static int ipa_netgr_fetch_netgroups(struct ipa_get_netgroups_state *state,
 static int ipa_netgr_fetch_users(struct ipa_get_netgroups_state *state,
                                  struct tevent_req *req)
 {
-    const char *attrs[] = { state->opts->user_map[SDAP_AT_USER_NAME].name,
-                            state->opts->user_map[SDAP_AT_USER_MEMBEROF].name,
-                            "objectclass", NULL };
+    const char **attrs;
     char *filter;
     const char *base_filter;
     struct tevent_req *subreq;
@@ -487,21 +553,31 @@ static int ipa_netgr_fetch_users(struct ipa_get_netgroups_state *state,
     if (filter == NULL)
         return ENOMEM;
 
-    subreq = sdap_get_generic_send(state, state->ev, state->opts, state->sh,
+    /* the search keeps referring to the attributes while paging, so they
+     * must outlive this function */
+    attrs = talloc_array(filter, const char *, 4);
+    if (attrs == NULL) {
+        talloc_free(filter);
+        return ENOMEM;
+    }
+    attrs[0] = state->opts->user_map[SDAP_AT_USER_NAME].name;
+    attrs[1] = state->opts->user_map[SDAP_AT_USER_MEMBEROF].name;
+    attrs[2] = "objectclass";
+    attrs[3] = NULL;
+
+    subreq = sdap_get_generic_send(state->members_ctx, state->ev, state->opts,
+                                   state->sh,
                                    dp_opt_get_string(state->opts->basic,
                                                      SDAP_USER_SEARCH_BASE),
                                    LDAP_SCOPE_SUBTREE,
                                    filter, attrs, state->opts->user_map,
                                    state->opts->user_map_cnt,
                                    state->timeout, true);
-
-    state->current_entity = ENTITY_USER;
     if (subreq == NULL) {
-        talloc_free(attrs);
         return ENOMEM;
     }
 
-    tevent_req_set_callback(subreq, ipa_netgr_members_process, req);
+    tevent_req_set_callback(subreq, ipa_netgr_users_process, req);
 
     return EOK;
 }
@@ -536,98 +612,31 @@ static int ipa_netgr_fetch_hosts(struct ipa_get_netgroups_state *state,
         return ret;
     }
 
-    subreq = sdap_get_generic_send(state, state->ev, state->opts, state->sh,
+    subreq = sdap_get_generic_send(state->members_ctx, state->ev, state->opts,
+                                   state->sh,
                                    bases[state->host_base_iter]->basedn,
                                    bases[state->host_base_iter]->scope,
                                    filter, attrs, state->ipa_opts->host_map,
                                    IPA_OPTS_HOST, state->timeout, true);
-
-    state->current_entity = ENTITY_HOST;
     if (subreq == NULL) {
-        talloc_free(filter);
         return ENOMEM;
     }
 
-    tevent_req_set_callback(subreq, ipa_netgr_members_process, req);
+    tevent_req_set_callback(subreq, ipa_netgr_hosts_process, req);
 
     return EOK;
 }
 
-static void ipa_netgr_members_process(struct tevent_req *subreq)
+static errno_t ipa_netgr_store_members(hash_table_t *table,
+                                       struct sysdb_attrs **entities,
+                                       size_t count)
 {
-    struct tevent_req *req = tevent_req_callback_data(subreq,
-                                                      struct tevent_req);
-    struct ipa_get_netgroups_state *state = tevent_req_data(req,
-                                               struct ipa_get_netgroups_state);
-    struct sysdb_attrs **entities;
-    size_t count;
-    int ret, i;
     const char *orig_dn;
     char *orig_dn_lower;
-    hash_table_t *table;
     hash_key_t key;
     hash_value_t value;
-    int (* next_call)(struct ipa_get_netgroups_state *,
-                      struct tevent_req *);
-    bool next_batch_scheduled = false;
-
-    ret = sdap_get_generic_recv(subreq, state, &count, &entities);
-    talloc_zfree(subreq);
-    if (ret) {
-        goto fail;
-    }
-
-    DEBUG(SSSDBG_TRACE_INTERNAL, "Found %zu members in current search base\n",
-                                  count);
-
-    next_call = NULL;
-    /* While processing a batch of entities from one search base,
-     * schedule query for another search base if there is one
-     *
-     * If there is no other search base, another class of entities
-     * will be scheduled for lookup after processing of current
-     * batch. The order of lookup is: netgroups -> users -> hosts
-     */
-    if (state->current_entity == ENTITY_NG) {
-        /* We just received a batch of netgroups */
-        state->netgr_base_iter++;
-        ret = ipa_netgr_fetch_netgroups(state, req);
-        table = state->new_netgroups;
-        /* If there is a member netgroup, we always have to
-         * ask for both member users and hosts
-         * -> now schedule users
-         */
-        next_call = ipa_netgr_fetch_users;
-    } else if (state->current_entity == ENTITY_USER) {
-        /* We just received a batch of users */
-        state->user_base_iter++;
-        ret = ipa_netgr_fetch_users(state, req);
-        table = state->new_users;
-        if (state->entities_found & ENTITY_HOST ||
-            state->entities_found & ENTITY_NG) {
-            next_call = ipa_netgr_fetch_hosts;
-        }
-    } else if (state->current_entity == ENTITY_HOST) {
-        /* We just received a batch of hosts */
-        state->host_base_iter++;
-        ret = ipa_netgr_fetch_hosts(state, req);
-        table = state->new_hosts;
-    } else {
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "Invalid entity type given for processing: %d\n",
-               state->current_entity);
-        ret = EINVAL;
-        goto fail;
-    }
-
-    if (ret == EOK) {
-        /* Next search base has been scheduled for inspection,
-         * don't try to look for other type of entities
-         */
-        next_batch_scheduled = true;
-    } else if (ret != ENOENT) {
-        goto fail;
-    }
+    size_t i;
+    int ret;
 
     /* Process all member entites and store them in the designated hash table */
     key.type = HASH_KEY_STRING;
@@ -635,13 +644,12 @@ static void ipa_netgr_members_process(struct tevent_req *subreq)
     for (i = 0; i < count; i++) {
         ret = sysdb_attrs_get_string(entities[i], SYSDB_ORIG_DN, &orig_dn);
         if (ret != EOK) {
-            goto fail;
+            return ret;
         }
 
         orig_dn_lower = talloc_strdup(table, orig_dn);
         if (orig_dn_lower == NULL) {
-            ret = ENOMEM;
-            goto fail;
+            return ENOMEM;
         }
         /* Transform the DN to lower case.
          * this is important, as the member/memberof attributes
@@ -655,36 +663,109 @@ static void ipa_netgr_members_process(struct tevent_req *subreq)
         value.ptr = entities[i];
         ret = hash_enter(table, &key, &value);
         if (ret !=  HASH_SUCCESS) {
-            goto fail;
+            return EIO;
         }
     }
 
-    if (next_batch_scheduled) {
+    return EOK;
+}
+
+static void ipa_netgr_members_process(struct tevent_req *subreq,
+                                      int entity)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ipa_get_netgroups_state *state = tevent_req_data(req,
+                                               struct ipa_get_netgroups_state);
+    struct sysdb_attrs **entities;
+    hash_table_t *table;
+    size_t count;
+    int ret;
+
+    ret = sdap_get_generic_recv(subreq, state, &count, &entities);
+    talloc_zfree(subreq);
+    if (ret) {
+        goto fail;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Found %zu members in current search base\n",
+                                  count);
+
+    switch (entity) {
+    case ENTITY_NG:
+        table = state->new_netgroups;
+        break;
+    case ENTITY_USER:
+        table = state->new_users;
+        break;
+    default:
+        table = state->new_hosts;
+        break;
+    }
+
+    ret = ipa_netgr_store_members(table, entities, count);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    /* Look into the next search base of this kind of entities */
+    switch (entity) {
+    case ENTITY_NG:
+        state->netgr_base_iter++;
+        ret = ipa_netgr_fetch_netgroups(state, req);
+        break;
+    case ENTITY_USER:
+        state->user_base_iter++;
+        ret = ipa_netgr_fetch_users(state, req);
+        break;
+    default:
+        state->host_base_iter++;
+        ret = ipa_netgr_fetch_hosts(state, req);
+        break;
+    }
+
+    if (ret == EOK) {
         /* The next search base is already scheduled to be searched */
         return;
+    } else if (ret != ENOENT) {
+        goto fail;
     }
 
-    if (next_call) {
-        /* There is another class of members that has to be retrieved
-         * - schedule the lookup
-         */
-        ret = next_call(state, req);
-        if (ret != EOK) goto fail;
-    } else {
-        /* All members, that could have been fetched, were fetched */
-        ret = ipa_netgr_process_all(state);
-        if (ret != EOK) goto fail;
-
-        tevent_req_done(req);
+    state->pending--;
+    if (state->pending > 0) {
+        /* The other kinds of members are still being looked up */
+        return;
     }
 
+    /* All members, that could have been fetched, were fetched */
+    talloc_zfree(state->members_ctx);
+    ret = ipa_netgr_process_all(state);
+    if (ret != EOK) goto fail;
+
+    tevent_req_done(req);
     return;
 
 fail:
+    talloc_zfree(state->members_ctx);
     tevent_req_error(req, ret);
     return;
 }
 
+static void ipa_netgr_netgroups_process(struct tevent_req *subreq)
+{
+    ipa_netgr_members_process(subreq, ENTITY_NG);
+}
+
+static void ipa_netgr_users_process(struct tevent_req *subreq)
+{
+    ipa_netgr_members_process(subreq, ENTITY_USER);
+}
+
+static void ipa_netgr_hosts_process(struct tevent_req *subreq)
+{
+    ipa_netgr_members_process(subreq, ENTITY_HOST);
+}
+
 static bool extract_netgroups(hash_entry_t *entry, void *pvt)
 {
     struct ipa_get_netgroups_state *state;
@@ -697,51 +778,119 @@ static bool extract_netgroups(hash_entry_t *entry, void *pvt)
     return true;
 }
 
-struct extract_state {
-    const char *group;
-    const char *appropriateMemberOf;
-
-    const char **entries;
-    int entries_count;
+struct group_members {
+    const char **names;
+    size_t count;
+    size_t size;
 };
 
-static bool extract_entities(hash_entry_t *entry, void *pvt)
+static errno_t add_group_member(hash_table_t *index,
+                                const char *group,
+                                const char *name)
+{
+    struct group_members *members;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(group);
+
+    hret = hash_lookup(index, &key, &value);
+    if (hret == HASH_SUCCESS) {
+        members = talloc_get_type(value.ptr, struct group_members);
+    } else if (hret == HASH_ERROR_KEY_NOT_FOUND) {
+        members = talloc_zero(index, struct group_members);
+        if (members == NULL) {
+            return ENOMEM;
+        }
+
+        value.type = HASH_VALUE_PTR;
+        value.ptr = members;
+        hret = hash_enter(index, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            talloc_free(members);
+            return EIO;
+        }
+    } else {
+        return EIO;
+    }
+
+    if (members->count == members->size) {
+        members->size = members->size == 0 ? 8 : members->size * 2;
+        members->names = talloc_realloc(members, members->names,
+                                        const char *, members->size);
+        if (members->names == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    members->names[members->count] = name;
+    members->count++;
+
+    return EOK;
+}
+
+/* Builds the index of the names of the entities by the DNs of the groups
+ * they are member of. Member groups of a netgroup are then resolved with a
+ * single lookup instead of walking all entities for each of them. */
+static int index_group_members(TALLOC_CTX *mem_ctx,
+                               hash_table_t *lookup_table,
+                               const char *appropriateMemberOf,
+                               hash_table_t **_index)
 {
-    int ret;
-    struct extract_state *state;
-    struct sysdb_attrs *member;
     struct ldb_message_element *el;
     struct ldb_message_element *name_el;
+    struct sysdb_attrs *member;
+    hash_table_t *index;
+    hash_value_t *values;
+    unsigned long count;
+    unsigned long i;
+    unsigned int j;
+    int ret;
 
-    state = talloc_get_type(pvt, struct extract_state);
-    member = talloc_get_type(entry->value.ptr, struct sysdb_attrs);
-
-    ret = sysdb_attrs_get_el(member, state->appropriateMemberOf, &el);
+    ret = sss_hash_create(mem_ctx, 32, &index);
     if (ret != EOK) {
-        return false;
+        return ret;
     }
 
-    ret = sysdb_attrs_get_el(member, SYSDB_NAME, &name_el);
-    if (ret != EOK || name_el == NULL || name_el->num_values == 0) {
-        return false;
+    ret = hash_values(lookup_table, &count, &values);
+    if (ret != HASH_SUCCESS) {
+        talloc_free(index);
+        return EIO;
     }
 
-    for (int j = 0; j < el->num_values; j++) {
-        if (strcmp((char *)el->values[j].data, state->group) == 0) {
-            state->entries = talloc_realloc(state, state->entries,
-                                            const char *,
-                                            state->entries_count + 1);
-            if (state->entries == NULL) {
-                return false;
-            }
+    for (i = 0; i < count; i++) {
+        member = talloc_get_type(values[i].ptr, struct sysdb_attrs);
+
+        ret = sysdb_attrs_get_el(member, appropriateMemberOf, &el);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = sysdb_attrs_get_el(member, SYSDB_NAME, &name_el);
+        if (ret != EOK || name_el == NULL || name_el->num_values == 0) {
+            continue;
+        }
 
-            state->entries[state->entries_count] = (char *)name_el->values[0].data;
-            state->entries_count++;
-            break;
+        for (j = 0; j < el->num_values; j++) {
+            ret = add_group_member(index, (char *)el->values[j].data,
+                                   (char *)name_el->values[0].data);
+            if (ret != EOK) {
+                goto done;
+            }
         }
     }
 
-    return true;
+    *_index = index;
+    ret = EOK;
+
+done:
+    talloc_free(values);
+    if (ret != EOK) {
+        talloc_free(index);
+    }
+    return ret;
 }
 
 static int extract_members(TALLOC_CTX *mem_ctx,
@@ -749,88 +898,82 @@ static int extract_members(TALLOC_CTX *mem_ctx,
                            const char *member_type,
                            const char *appropriateMemberOf,
                            hash_table_t *lookup_table,
+                           hash_table_t **_group_index,
                            const char ***_ret_array,
                            int *_ret_count)
 {
-    struct extract_state *state;
+    struct group_members *group;
     struct ldb_message_element *el;
     struct sysdb_attrs *member;
     hash_key_t key;
     hash_value_t value;
-    const char **process = NULL;
     const char **ret_array = NULL;
-    int process_count = 0;
     int ret_count = 0;
-    int ret, i, pi;
+    int ret, i;
 
     key.type = HASH_KEY_STRING;
     value.type = HASH_VALUE_PTR;
 
-    state = talloc_zero(mem_ctx, struct extract_state);
-    if (state == NULL) {
-        ret = ENOMEM;
-        goto done;
-    }
-
-    state->appropriateMemberOf = appropriateMemberOf;
-
     ret = sysdb_attrs_get_el(netgroup, member_type, &el);
     if (ret != EOK && ret != ENOENT) {
         goto done;
     }
 
-    if (ret == EOK) {
+    if (ret == EOK && el->num_values > 0) {
+        ret_array = talloc_array(mem_ctx, const char *, el->num_values);
+        if (ret_array == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
         for (i = 0; i < el->num_values; i++) {
             key.str = (char *)el->values[i].data;
             ret = hash_lookup(lookup_table, &key, &value);
-            if (ret != HASH_SUCCESS && ret != HASH_ERROR_KEY_NOT_FOUND) {
+            if (ret == HASH_SUCCESS) {
+                member = talloc_get_type(value.ptr, struct sysdb_attrs);
+                ret = sysdb_attrs_get_string(member, SYSDB_NAME,
+                                             &ret_array[ret_count]);
+                if (ret != EOK) {
+                    goto done;
+                }
+                ret_count++;
+                continue;
+            } else if (ret != HASH_ERROR_KEY_NOT_FOUND) {
                 ret = ENOENT;
                 goto done;
             }
 
-            if (ret == HASH_ERROR_KEY_NOT_FOUND) {
-                process = talloc_realloc(mem_ctx, process, const char *, process_count + 1);
-                if (process == NULL) {
-                    ret = ENOMEM;
-                    goto done;
-                }
-
-                process[process_count] = (char *)el->values[i].data;
-                process_count++;
-            } else {
-                ret_array = talloc_realloc(mem_ctx, ret_array, const char *, ret_count + 1);
-                if (ret_array == NULL) {
-                    ret = ENOMEM;
-                    goto done;
-                }
-                member = talloc_get_type(value.ptr, struct sysdb_attrs);
-                ret = sysdb_attrs_get_string(member, SYSDB_NAME, &ret_array[ret_count]);
+            /* Not a direct member, it is a group the members of which
+             * belong to the netgroup */
+            if (*_group_index == NULL) {
+                ret = index_group_members(mem_ctx, lookup_table,
+                                          appropriateMemberOf, _group_index);
                 if (ret != EOK) {
                     goto done;
                 }
-                ret_count++;
             }
 
-            for (pi = 0; pi < process_count; pi++) {
-                state->group = process[pi];
-                hash_iterate(lookup_table, extract_entities, state);
-                if (state->entries_count > 0) {
-                    ret_array = talloc_realloc(mem_ctx, ret_array, const char *,
-                            ret_count + state->entries_count);
-                    if (ret_array == NULL) {
-                        ret = ENOMEM;
-                        goto done;
-                    }
-                    memcpy(&ret_array[ret_count], state->entries,
-                            state->entries_count*sizeof(const char *));
-                    ret_count += state->entries_count;
-                }
-                state->entries_count = 0;
-                talloc_zfree(state->entries);
+            ret = hash_lookup(*_group_index, &key, &value);
+            if (ret == HASH_ERROR_KEY_NOT_FOUND) {
+                continue;
+            } else if (ret != HASH_SUCCESS) {
+                ret = EIO;
+                goto done;
             }
+
+            group = talloc_get_type(value.ptr, struct group_members);
+            ret_array = talloc_realloc(mem_ctx, ret_array, const char *,
+                                       el->num_values + ret_count
+                                       + group->count);
+            if (ret_array == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            memcpy(&ret_array[ret_count], group->names,
+                   group->count * sizeof(const char *));
+            ret_count += group->count;
         }
-    } else {
-        ret_array = NULL;
     }
 
     *_ret_array = ret_array;
@@ -847,7 +990,6 @@ static int ipa_netgr_process_all(struct ipa_get_netgroups_state *state)
     const char **members;
     struct sysdb_attrs *member;
     const char *member_name;
-    struct extract_state *extract_state;
     struct ldb_message_element *external_hosts;
     const char *dash[] = {"-"};
     const char **uids = NULL;
@@ -865,12 +1007,6 @@ static int ipa_netgr_process_all(struct ipa_get_netgroups_state *state)
         return ENOMEM;
     }
 
-    extract_state = talloc_zero(state, struct extract_state);
-    if (extract_state == NULL) {
-        ret = ENOMEM;
-        goto done;
-    }
-
     key.type = HASH_KEY_STRING;
     value.type = HASH_VALUE_PTR;
 
@@ -917,7 +1053,7 @@ static int ipa_netgr_process_all(struct ipa_get_netgroups_state *state)
         ret = extract_members(state, state->netgroups[i],
                               SYSDB_ORIG_MEMBER_USER,
                               state->ipa_opts->id->user_map[SDAP_AT_USER_MEMBEROF].sys_name,
-                              state->new_users,
+                              state->new_users, &state->user_groups,
                               &uids, &uids_count);
         if (ret != EOK) {
             goto done;
@@ -928,7 +1064,7 @@ static int ipa_netgr_process_all(struct ipa_get_netgroups_state *state)
         ret = extract_members(state, state->netgroups[i],
                               SYSDB_ORIG_MEMBER_HOST,
                               state->ipa_opts->host_map[IPA_AT_HOST_MEMBER_OF].sys_name,
-                              state->new_hosts,
+                              state->new_hosts, &state->host_groups,
                               &hosts, &hosts_count);
         if (ret != EOK) {
             goto done;
@@ -884,14 +884,13 @@ done:
     return ret;
 }
 
-struct ipa_s2n_get_fqlist_state {
+struct ipa_s2n_get_fqname_state {
     struct tevent_context *ev;
     struct ipa_id_ctx *ipa_ctx;
     struct sss_domain_info *dom;
     struct sdap_handle *sh;
     struct req_input req_input;
-    char **fqname_list;
-    size_t fqname_idx;
+    const char *fqname;
     int exop_timeout;
     int entry_type;
     enum request_types request_type;
@@ -900,12 +899,13 @@ struct ipa_s2n_get_fqlist_state {
     struct sysdb_attrs *override_attrs;
 };
 
-static errno_t ipa_s2n_get_fqlist_step(struct tevent_req *req);
-static void ipa_s2n_get_fqlist_get_override_done(struct tevent_req *subreq);
-static void ipa_s2n_get_fqlist_next(struct tevent_req *subreq);
-static errno_t ipa_s2n_get_fqlist_save_step(struct tevent_req *req);
+static errno_t ipa_s2n_get_fqname_step(struct tevent_req *req);
+static void ipa_s2n_get_fqname_get_override_done(struct tevent_req *subreq);
+static void ipa_s2n_get_fqname_next(struct tevent_req *subreq);
+static errno_t ipa_s2n_get_fqname_save_step(struct tevent_req *req);
 
-static struct tevent_req *ipa_s2n_get_fqlist_send(TALLOC_CTX *mem_ctx,
+/* Looks up and saves a single object of a member list */
+static struct tevent_req *ipa_s2n_get_fqname_send(TALLOC_CTX *mem_ctx,
                                                 struct tevent_context *ev,
                                                 struct ipa_id_ctx *ipa_ctx,
                                                 struct sss_domain_info *dom,
@@ -913,13 +913,13 @@ static struct tevent_req *ipa_s2n_get_fqlist_send(TALLOC_CTX *mem_ctx,
                                                 int exop_timeout,
                                                 int entry_type,
                                                 enum request_types request_type,
-                                                char **fqname_list)
+                                                const char *fqname)
 {
     int ret;
-    struct ipa_s2n_get_fqlist_state *state;
+    struct ipa_s2n_get_fqname_state *state;
     struct tevent_req *req;
 
-    req = tevent_req_create(mem_ctx, &state, struct ipa_s2n_get_fqlist_state);
+    req = tevent_req_create(mem_ctx, &state, struct ipa_s2n_get_fqname_state);
     if (req == NULL) {
         return NULL;
     }
@@ -928,8 +928,7 @@ static struct tevent_req *ipa_s2n_get_fqlist_send(TALLOC_CTX *mem_ctx,
     state->ipa_ctx = ipa_ctx;
     state->dom = dom;
     state->sh = sh;
-    state->fqname_list = fqname_list;
-    state->fqname_idx = 0;
+    state->fqname = fqname;
     state->req_input.type = REQ_INP_NAME;
     state->req_input.inp.name = NULL;
     state->exop_timeout = exop_timeout;
@@ -938,9 +937,9 @@ static struct tevent_req *ipa_s2n_get_fqlist_send(TALLOC_CTX *mem_ctx,
     state->attrs = NULL;
     state->override_attrs = NULL;
 
-    ret = ipa_s2n_get_fqlist_step(req);
+    ret = ipa_s2n_get_fqname_step(req);
     if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqlist_step failed.\n");
+        DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqname_step failed.\n");
         goto done;
     }
 
@@ -953,11 +952,11 @@ done:
     return req;
 }
 
-static errno_t ipa_s2n_get_fqlist_step(struct tevent_req *req)
+static errno_t ipa_s2n_get_fqname_step(struct tevent_req *req)
 {
     int ret;
-    struct ipa_s2n_get_fqlist_state *state = tevent_req_data(req,
-                                               struct ipa_s2n_get_fqlist_state);
+    struct ipa_s2n_get_fqname_state *state = tevent_req_data(req,
+                                               struct ipa_s2n_get_fqname_state);
     struct berval *bv_req;
     struct tevent_req *subreq;
     struct sss_domain_info *parent_domain;
@@ -967,12 +966,10 @@ static errno_t ipa_s2n_get_fqlist_step(struct tevent_req *req)
     parent_domain = get_domains_head(state->dom);
 
     ret = sss_parse_name(state, parent_domain->names,
-                         state->fqname_list[state->fqname_idx],
-                         &domain_name, &short_name);
+                         state->fqname, &domain_name, &short_name);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to parse name '%s' [%d]: %s\n",
-                                    state->fqname_list[state->fqname_idx],
-                                    ret, sss_strerror(ret));
+                                    state->fqname, ret, sss_strerror(ret));
         return ret;
     }
 
@@ -1003,18 +1000,18 @@ static errno_t ipa_s2n_get_fqlist_step(struct tevent_req *req)
         DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_exop_send failed.\n");
         return ENOMEM;
     }
-    tevent_req_set_callback(subreq, ipa_s2n_get_fqlist_next, req);
+    tevent_req_set_callback(subreq, ipa_s2n_get_fqname_next, req);
 
     return EOK;
 }
 
-static void ipa_s2n_get_fqlist_next(struct tevent_req *subreq)
+static void ipa_s2n_get_fqname_next(struct tevent_req *subreq)
 {
     int ret;
     struct tevent_req *req = tevent_req_callback_data(subreq,
                                                       struct tevent_req);
-    struct ipa_s2n_get_fqlist_state *state = tevent_req_data(req,
-                                               struct ipa_s2n_get_fqlist_state);
+    struct ipa_s2n_get_fqname_state *state = tevent_req_data(req,
+                                               struct ipa_s2n_get_fqname_state);
     char *retoid = NULL;
     struct berval *retdata = NULL;
     const char *sid_str;
@@ -1035,11 +1032,11 @@ static void ipa_s2n_get_fqlist_next(struct tevent_req *subreq)
     }
 
     if (is_default_view(state->ipa_ctx->view_name)) {
-        ret = ipa_s2n_get_fqlist_save_step(req);
+        ret = ipa_s2n_get_fqname_save_step(req);
         if (ret == EOK) {
             tevent_req_done(req);
         } else if (ret != EAGAIN) {
-            DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqlist_save_step failed.\n");
+            DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqname_save_step failed.\n");
             goto fail;
         }
 
@@ -1071,7 +1068,7 @@ static void ipa_s2n_get_fqlist_next(struct tevent_req *subreq)
         ret = ENOMEM;
         goto fail;
     }
-    tevent_req_set_callback(subreq, ipa_s2n_get_fqlist_get_override_done, req);
+    tevent_req_set_callback(subreq, ipa_s2n_get_fqname_get_override_done, req);
 
     return;
 
@@ -1080,13 +1077,13 @@ fail:
     return;
 }
 
-static void ipa_s2n_get_fqlist_get_override_done(struct tevent_req *subreq)
+static void ipa_s2n_get_fqname_get_override_done(struct tevent_req *subreq)
 {
     int ret;
     struct tevent_req *req = tevent_req_callback_data(subreq,
                                                       struct tevent_req);
-    struct ipa_s2n_get_fqlist_state *state = tevent_req_data(req,
-                                               struct ipa_s2n_get_fqlist_state);
+    struct ipa_s2n_get_fqname_state *state = tevent_req_data(req,
+                                               struct ipa_s2n_get_fqname_state);
 
     ret = ipa_get_ad_override_recv(subreq, NULL, state, &state->override_attrs);
     talloc_zfree(subreq);
@@ -1095,11 +1092,11 @@ static void ipa_s2n_get_fqlist_get_override_done(struct tevent_req *subreq)
         goto fail;
     }
 
-    ret = ipa_s2n_get_fqlist_save_step(req);
+    ret = ipa_s2n_get_fqname_save_step(req);
     if (ret == EOK) {
         tevent_req_done(req);
     } else if (ret != EAGAIN) {
-        DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqlist_save_step failed.\n");
+        DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqname_save_step failed.\n");
         goto fail;
     }
 
@@ -1110,11 +1107,11 @@ fail:
     return;
 }
 
-static errno_t ipa_s2n_get_fqlist_save_step(struct tevent_req *req)
+static errno_t ipa_s2n_get_fqname_save_step(struct tevent_req *req)
 {
     int ret;
-    struct ipa_s2n_get_fqlist_state *state = tevent_req_data(req,
-                                               struct ipa_s2n_get_fqlist_state);
+    struct ipa_s2n_get_fqname_state *state = tevent_req_data(req,
+                                               struct ipa_s2n_get_fqname_state);
 
     ret = ipa_s2n_save_objects(state->dom, &state->req_input, state->attrs,
                                NULL, state->ipa_ctx->view_name,
@@ -1124,18 +1121,149 @@ static errno_t ipa_s2n_get_fqlist_save_step(struct tevent_req *req)
         return ret;
     }
 
-    state->fqname_idx++;
-    if (state->fqname_list[state->fqname_idx] == NULL) {
-        return EOK;
+    return EOK;
+}
+
+static int ipa_s2n_get_fqname_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+/* The objects of a member list are looked up with up to
+ * ipa_extdom_parallel_requests extended operations at a time */
+struct ipa_s2n_get_fqlist_state {
+    struct tevent_context *ev;
+    struct ipa_id_ctx *ipa_ctx;
+    struct sss_domain_info *dom;
+    struct sdap_handle *sh;
+    char **fqname_list;
+    size_t fqname_idx;
+    int exop_timeout;
+    int entry_type;
+    enum request_types request_type;
+    int num_running;
+    int max_running;
+};
+
+static errno_t ipa_s2n_get_fqlist_step(struct tevent_req *req);
+static void ipa_s2n_get_fqlist_member_done(struct tevent_req *subreq);
+
+static struct tevent_req *ipa_s2n_get_fqlist_send(TALLOC_CTX *mem_ctx,
+                                                struct tevent_context *ev,
+                                                struct ipa_id_ctx *ipa_ctx,
+                                                struct sss_domain_info *dom,
+                                                struct sdap_handle *sh,
+                                                int exop_timeout,
+                                                int entry_type,
+                                                enum request_types request_type,
+                                                char **fqname_list)
+{
+    int ret;
+    struct ipa_s2n_get_fqlist_state *state;
+    struct tevent_req *req;
+
+    req = tevent_req_create(mem_ctx, &state, struct ipa_s2n_get_fqlist_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->ipa_ctx = ipa_ctx;
+    state->dom = dom;
+    state->sh = sh;
+    state->fqname_list = fqname_list;
+    state->fqname_idx = 0;
+    state->exop_timeout = exop_timeout;
+    state->entry_type = entry_type;
+    state->request_type = request_type;
+    state->num_running = 0;
+    state->max_running = dp_opt_get_int(ipa_ctx->ipa_options->basic,
+                                        IPA_EXTDOM_PARALLEL_REQUESTS);
+    if (state->max_running < 1) {
+        state->max_running = 1;
     }
 
     ret = ipa_s2n_get_fqlist_step(req);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqlist_step failed.\n");
-        return ret;
+        goto done;
+    }
+
+    if (state->num_running == 0) {
+        /* empty list */
+        tevent_req_done(req);
+        tevent_req_post(req, ev);
+    }
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        tevent_req_post(req, ev);
+    }
+
+    return req;
+}
+
+static errno_t ipa_s2n_get_fqlist_step(struct tevent_req *req)
+{
+    struct ipa_s2n_get_fqlist_state *state = tevent_req_data(req,
+                                               struct ipa_s2n_get_fqlist_state);
+    struct tevent_req *subreq;
+
+    while (state->num_running < state->max_running
+            && state->fqname_list[state->fqname_idx] != NULL) {
+        subreq = ipa_s2n_get_fqname_send(state, state->ev, state->ipa_ctx,
+                                         state->dom, state->sh,
+                                         state->exop_timeout,
+                                         state->entry_type,
+                                         state->request_type,
+                                         state->fqname_list[state->fqname_idx]);
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqname_send failed.\n");
+            return ENOMEM;
+        }
+        tevent_req_set_callback(subreq, ipa_s2n_get_fqlist_member_done, req);
+
+        state->fqname_idx++;
+        state->num_running++;
+    }
+
+    return EOK;
+}
+
+static void ipa_s2n_get_fqlist_member_done(struct tevent_req *subreq)
+{
+    int ret;
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ipa_s2n_get_fqlist_state *state = tevent_req_data(req,
+                                               struct ipa_s2n_get_fqlist_state);
+
+    ret = ipa_s2n_get_fqname_recv(subreq);
+    talloc_zfree(subreq);
+    state->num_running--;
+    if (ret != EOK) {
+        /* freeing the state cancels the other lookups */
+        goto fail;
+    }
+
+    ret = ipa_s2n_get_fqlist_step(req);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "ipa_s2n_get_fqlist_step failed.\n");
+        goto fail;
     }
 
-    return EAGAIN;
+    if (state->num_running == 0) {
+        tevent_req_done(req);
+    }
+
+    return;
+
+fail:
+    tevent_req_error(req, ret);
+    return;
 }
 
 static int ipa_s2n_get_fqlist_recv(struct tevent_req *req)
@@ -307,8 +307,18 @@ static errno_t choose_best_seuser(TALLOC_CTX *mem_ctx,
 
 static struct tevent_req *selinux_child_send(TALLOC_CTX *mem_ctx,
                                              struct tevent_context *ev,
-                                             struct selinux_child_input *sci);
-static errno_t selinux_child_recv(struct tevent_req *req);
+                                             struct selinux_child_input **sci,
+                                             size_t count);
+static errno_t selinux_child_recv(struct tevent_req *req,
+                                  TALLOC_CTX *mem_ctx,
+                                  uint32_t **_results);
+
+static struct tevent_req *
+ipa_selinux_apply_send(TALLOC_CTX *mem_ctx,
+                       struct tevent_context *ev,
+                       struct ipa_selinux_ctx *selinux_ctx,
+                       struct selinux_child_input *sci);
+static errno_t ipa_selinux_apply_recv(struct tevent_req *req);
 
 static void ipa_selinux_child_done(struct tevent_req *child_req);
 
@@ -405,9 +415,10 @@ static void ipa_selinux_handler_done(struct tevent_req *req)
     /* Update the SELinux context in a privileged child as the back end is
      * running unprivileged
      */
-    child_req = selinux_child_send(breq, be_ctx->ev, sci);
+    child_req = ipa_selinux_apply_send(breq, be_ctx->ev, op_ctx->selinux_ctx,
+                                       sci);
     if (child_req == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "selinux_child_send() failed\n");
+        DEBUG(SSSDBG_CRIT_FAILURE, "ipa_selinux_apply_send() failed\n");
         ret = ENOMEM;
         goto fail;
     }
@@ -441,7 +452,7 @@ static void ipa_selinux_child_done(struct tevent_req *child_req)
     pd = talloc_get_type(be_req_get_data(breq), struct pam_data);
     be_ctx = be_req_get_be_ctx(breq);
 
-    ret = selinux_child_recv(child_req);
+    ret = ipa_selinux_apply_recv(child_req);
     talloc_free(child_req);
     if (ret != EOK) {
         be_req_terminate(breq, DP_ERR_FATAL, ret, NULL);
@@ -894,24 +905,31 @@ done:
     return ret;
 }
 
+/* The SELinux contexts of several users can be set by the same
+ * selinux_child, which returns a result for each of them */
 struct selinux_child_state {
-    struct selinux_child_input *sci;
     struct tevent_context *ev;
     struct io_buffer *buf;
     struct child_io_fds *io;
+
+    size_t count;
+    uint32_t *results;
 };
 
 static errno_t selinux_child_init(void);
-static errno_t selinux_child_create_buffer(struct selinux_child_state *state);
+static errno_t selinux_child_create_buffer(struct selinux_child_state *state,
+                                           struct selinux_child_input **sci);
 static errno_t selinux_fork_child(struct selinux_child_state *state);
 static void selinux_child_step(struct tevent_req *subreq);
 static void selinux_child_done(struct tevent_req *subreq);
 static errno_t selinux_child_parse_response(uint8_t *buf, ssize_t len,
-                                            uint32_t *_child_result);
+                                            size_t count,
+                                            uint32_t *child_results);
 
 static struct tevent_req *selinux_child_send(TALLOC_CTX *mem_ctx,
                                              struct tevent_context *ev,
-                                             struct selinux_child_input *sci)
+                                             struct selinux_child_input **sci,
+                                             size_t count)
 {
     struct tevent_req *req;
     struct tevent_req *subreq;
@@ -924,11 +942,12 @@ static struct tevent_req *selinux_child_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    state->sci = sci;
     state->ev = ev;
+    state->count = count;
     state->io = talloc(state, struct child_io_fds);
     state->buf = talloc(state, struct io_buffer);
-    if (state->io == NULL || state->buf == NULL) {
+    state->results = talloc_zero_array(state, uint32_t, count);
+    if (state->io == NULL || state->buf == NULL || state->results == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "talloc failed.\n");
         ret = ENOMEM;
         goto immediately;
@@ -944,7 +963,7 @@ static struct tevent_req *selinux_child_send(TALLOC_CTX *mem_ctx,
         goto immediately;
     }
 
-    ret = selinux_child_create_buffer(state);
+    ret = selinux_child_create_buffer(state, sci);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "Failed to create the send buffer\n");
         ret = ENOMEM;
@@ -979,19 +998,25 @@ static errno_t selinux_child_init(void)
     return child_debug_init(SELINUX_CHILD_LOG_FILE, &selinux_child_debug_fd);
 }
 
-static errno_t selinux_child_create_buffer(struct selinux_child_state *state)
+static size_t selinux_child_input_size(struct selinux_child_input *sci)
+{
+    return 3 * sizeof(uint32_t) + strlen(sci->seuser)
+           + strlen(sci->mls_range) + strlen(sci->username);
+}
+
+static errno_t selinux_child_create_buffer(struct selinux_child_state *state,
+                                           struct selinux_child_input **sci)
 {
     size_t rp;
     size_t seuser_len;
     size_t mls_range_len;
     size_t username_len;
+    size_t i;
 
-    seuser_len = strlen(state->sci->seuser);
-    mls_range_len = strlen(state->sci->mls_range);
-    username_len = strlen(state->sci->username);
-
-    state->buf->size = 3 * sizeof(uint32_t);
-    state->buf->size += seuser_len + mls_range_len + username_len;
+    state->buf->size = 0;
+    for (i = 0; i < state->count; i++) {
+        state->buf->size += selinux_child_input_size(sci[i]);
+    }
 
     DEBUG(SSSDBG_TRACE_ALL, "buffer size: %zu\n", state->buf->size);
 
@@ -1003,20 +1028,26 @@ static errno_t selinux_child_create_buffer(struct selinux_child_state *state)
 
     rp = 0;
 
-    /* seuser */
-    SAFEALIGN_SET_UINT32(&state->buf->data[rp], seuser_len, &rp);
-    safealign_memcpy(&state->buf->data[rp], state->sci->seuser,
-                     seuser_len, &rp);
+    for (i = 0; i < state->count; i++) {
+        seuser_len = strlen(sci[i]->seuser);
+        mls_range_len = strlen(sci[i]->mls_range);
+        username_len = strlen(sci[i]->username);
 
-    /* mls_range */
-    SAFEALIGN_SET_UINT32(&state->buf->data[rp], mls_range_len, &rp);
-    safealign_memcpy(&state->buf->data[rp], state->sci->mls_range,
-                     mls_range_len, &rp);
+        /* seuser */
+        SAFEALIGN_SET_UINT32(&state->buf->data[rp], seuser_len, &rp);
+        safealign_memcpy(&state->buf->data[rp], sci[i]->seuser,
+                         seuser_len, &rp);
 
-    /* username */
-    SAFEALIGN_SET_UINT32(&state->buf->data[rp], username_len, &rp);
-    safealign_memcpy(&state->buf->data[rp], state->sci->username,
-                     username_len, &rp);
+        /* mls_range */
+        SAFEALIGN_SET_UINT32(&state->buf->data[rp], mls_range_len, &rp);
+        safealign_memcpy(&state->buf->data[rp], sci[i]->mls_range,
+                         mls_range_len, &rp);
+
+        /* username */
+        SAFEALIGN_SET_UINT32(&state->buf->data[rp], username_len, &rp);
+        safealign_memcpy(&state->buf->data[rp], sci[i]->username,
+                         username_len, &rp);
+    }
 
     return EOK;
 }
@@ -1044,33 +1075,31 @@ static errno_t selinux_fork_child(struct selinux_child_state *state)
         return ret;
     }
 
-    pid = fork();
-
-    if (pid == 0) { /* child */
-        ret = exec_child(state,
-                         pipefd_to_child, pipefd_from_child,
-                         SELINUX_CHILD, selinux_child_debug_fd);
+    ret = spawn_child(state,
+                      pipefd_to_child, pipefd_from_child,
+                      SELINUX_CHILD, selinux_child_debug_fd, NULL, false,
+                      STDIN_FILENO, STDOUT_FILENO, &pid);
+    if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not exec selinux_child: [%d][%s].\n",
               ret, sss_strerror(ret));
-        return ret;
-    } else if (pid > 0) { /* parent */
-        state->io->read_from_child_fd = pipefd_from_child[0];
+        close(pipefd_from_child[0]);
         close(pipefd_from_child[1]);
-        state->io->write_to_child_fd = pipefd_to_child[1];
         close(pipefd_to_child[0]);
-        sss_fd_nonblocking(state->io->read_from_child_fd);
-        sss_fd_nonblocking(state->io->write_to_child_fd);
+        close(pipefd_to_child[1]);
+        return ret;
+    }
 
-        ret = child_handler_setup(state->ev, pid, NULL, NULL, NULL);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE,
-                  "Could not set up child signal handler\n");
-            return ret;
-        }
-    } else { /* error */
-        ret = errno;
+    state->io->read_from_child_fd = pipefd_from_child[0];
+    close(pipefd_from_child[1]);
+    state->io->write_to_child_fd = pipefd_to_child[1];
+    close(pipefd_to_child[0]);
+    sss_fd_nonblocking(state->io->read_from_child_fd);
+    sss_fd_nonblocking(state->io->write_to_child_fd);
+
+    ret = child_handler_setup(state->ev, pid, NULL, NULL, NULL);
+    if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE,
-              "fork failed [%d][%s].\n", errno, sss_strerror(errno));
+              "Could not set up child signal handler\n");
         return ret;
     }
 
@@ -1109,7 +1138,6 @@ static void selinux_child_done(struct tevent_req *subreq)
 {
     struct tevent_req *req;
     struct selinux_child_state *state;
-    uint32_t child_result;
     errno_t ret;
     ssize_t len;
     uint8_t *buf;
@@ -1127,19 +1155,14 @@ static void selinux_child_done(struct tevent_req *subreq)
     close(state->io->read_from_child_fd);
     state->io->read_from_child_fd = -1;
 
-    ret = selinux_child_parse_response(buf, len, &child_result);
+    ret = selinux_child_parse_response(buf, len, state->count,
+                                       state->results);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "selinux_child_parse_response failed: [%d][%s]\n",
               ret, strerror(ret));
         tevent_req_error(req, ret);
         return;
-    } else if (child_result != 0){
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "Error in selinux_child: [%d][%s]\n",
-              child_result, strerror(child_result));
-        tevent_req_error(req, ERR_SELINUX_CONTEXT);
-        return;
     }
 
     tevent_req_done(req);
@@ -1148,19 +1171,330 @@ static void selinux_child_done(struct tevent_req *subreq)
 
 static errno_t selinux_child_parse_response(uint8_t *buf,
                                             ssize_t len,
-                                            uint32_t *_child_result)
+                                            size_t count,
+                                            uint32_t *child_results)
 {
     size_t p = 0;
-    uint32_t child_result;
+    size_t i;
+
+    /* semanage retval of each user */
+    for (i = 0; i < count; i++) {
+        SAFEALIGN_COPY_UINT32_CHECK(&child_results[i], buf + p, len, &p);
+    }
+
+    return EOK;
+}
+
+static errno_t selinux_child_recv(struct tevent_req *req,
+                                  TALLOC_CTX *mem_ctx,
+                                  uint32_t **_results)
+{
+    struct selinux_child_state *state;
+
+    state = tevent_req_data(req, struct selinux_child_state);
 
-    /* semanage retval */
-    SAFEALIGN_COPY_UINT32_CHECK(&child_result, buf + p, len, &p);
+    TEVENT_REQ_RETURN_ON_ERROR(req);
 
-    *_child_result = child_result;
+    *_results = talloc_steal(mem_ctx, state->results);
     return EOK;
 }
 
-static errno_t selinux_child_recv(struct tevent_req *req)
+/* Sets the SELinux context of a user unless it was set to the same value
+ * before. While a selinux_child is running the users are queued, the next
+ * child then sets the contexts of all of them. */
+#define IPA_SELINUX_APPLY_MAX_BATCH 32
+
+struct ipa_selinux_apply_batch;
+
+struct ipa_selinux_apply_state {
+    struct ipa_selinux_apply_state *prev;
+    struct ipa_selinux_apply_state *next;
+
+    struct tevent_req *req;
+    struct ipa_selinux_ctx *selinux_ctx;
+    struct selinux_child_input *sci;
+
+    /* set once the user is handed to a child */
+    struct ipa_selinux_apply_batch *batch;
+    size_t batch_idx;
+};
+
+struct ipa_selinux_apply_batch {
+    struct ipa_selinux_ctx *selinux_ctx;
+    struct tevent_context *ev;
+
+    struct ipa_selinux_apply_state **states;
+    size_t count;
+};
+
+static void ipa_selinux_apply_next(struct ipa_selinux_ctx *selinux_ctx,
+                                   struct tevent_context *ev);
+static void ipa_selinux_apply_done(struct tevent_req *subreq);
+
+static char *ipa_selinux_context_str(TALLOC_CTX *mem_ctx,
+                                     struct selinux_child_input *sci)
+{
+    return talloc_asprintf(mem_ctx, "%s:%s", sci->seuser, sci->mls_range);
+}
+
+static bool ipa_selinux_context_applied(struct ipa_selinux_ctx *selinux_ctx,
+                                        struct selinux_child_input *sci)
+{
+    hash_key_t key;
+    hash_value_t value;
+    char *context;
+    bool applied;
+    int hret;
+
+    if (selinux_ctx->applied_contexts == NULL) {
+        return false;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(sci->username);
+
+    hret = hash_lookup(selinux_ctx->applied_contexts, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        return false;
+    }
+
+    context = ipa_selinux_context_str(NULL, sci);
+    if (context == NULL) {
+        return false;
+    }
+
+    applied = (strcmp(context, value.ptr) == 0);
+    talloc_free(context);
+
+    return applied;
+}
+
+static void ipa_selinux_context_set_applied(struct ipa_selinux_ctx *selinux_ctx,
+                                            struct selinux_child_input *sci)
+{
+    hash_key_t key;
+    hash_value_t value;
+    hash_value_t old_value;
+    bool has_old;
+    errno_t ret;
+    int hret;
+
+    if (selinux_ctx->applied_contexts == NULL) {
+        ret = sss_hash_create(selinux_ctx, 32,
+                              &selinux_ctx->applied_contexts);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "sss_hash_create failed.\n");
+            return;
+        }
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(sci->username);
+
+    has_old = (hash_lookup(selinux_ctx->applied_contexts,
+                           &key, &old_value) == HASH_SUCCESS);
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = ipa_selinux_context_str(selinux_ctx->applied_contexts, sci);
+    if (value.ptr == NULL) {
+        return;
+    }
+
+    hret = hash_enter(selinux_ctx->applied_contexts, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "hash_enter failed [%d]\n", hret);
+        talloc_free(value.ptr);
+        return;
+    }
+
+    if (has_old) {
+        talloc_free(old_value.ptr);
+    }
+}
+
+static int ipa_selinux_apply_state_destructor(struct ipa_selinux_apply_state *state)
+{
+    if (state->batch != NULL) {
+        /* the child still sets the context, the result is just dropped */
+        state->batch->states[state->batch_idx] = NULL;
+    } else {
+        DLIST_REMOVE(state->selinux_ctx->apply_queue, state);
+    }
+
+    return 0;
+}
+
+static struct tevent_req *
+ipa_selinux_apply_send(TALLOC_CTX *mem_ctx,
+                       struct tevent_context *ev,
+                       struct ipa_selinux_ctx *selinux_ctx,
+                       struct selinux_child_input *sci)
+{
+    struct tevent_req *req;
+    struct ipa_selinux_apply_state *state;
+
+    req = tevent_req_create(mem_ctx, &state, struct ipa_selinux_apply_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
+        return NULL;
+    }
+
+    state->req = req;
+    state->selinux_ctx = selinux_ctx;
+    state->sci = sci;
+
+    if (ipa_selinux_context_applied(selinux_ctx, sci)) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "SELinux context of [%s] is unchanged, not running the child\n",
+              sci->username);
+        tevent_req_done(req);
+        tevent_req_post(req, ev);
+        return req;
+    }
+
+    DLIST_ADD_END(selinux_ctx->apply_queue, state,
+                  struct ipa_selinux_apply_state *);
+    talloc_set_destructor(state, ipa_selinux_apply_state_destructor);
+
+    if (!selinux_ctx->child_running) {
+        ipa_selinux_apply_next(selinux_ctx, ev);
+    } else {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "selinux_child is running, [%s] is queued\n", sci->username);
+    }
+
+    return req;
+}
+
+static void ipa_selinux_apply_next(struct ipa_selinux_ctx *selinux_ctx,
+                                   struct tevent_context *ev)
+{
+    struct ipa_selinux_apply_batch *batch;
+    struct ipa_selinux_apply_state *state;
+    struct selinux_child_input **sci;
+    struct tevent_req *subreq;
+    size_t size = 0;
+    errno_t ret;
+
+    if (selinux_ctx->apply_queue == NULL) {
+        return;
+    }
+
+    batch = talloc_zero(selinux_ctx, struct ipa_selinux_apply_batch);
+    if (batch == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    batch->selinux_ctx = selinux_ctx;
+    batch->ev = ev;
+
+    batch->states = talloc_array(batch, struct ipa_selinux_apply_state *,
+                                 IPA_SELINUX_APPLY_MAX_BATCH);
+    sci = talloc_array(batch, struct selinux_child_input *,
+                       IPA_SELINUX_APPLY_MAX_BATCH);
+    if (batch->states == NULL || sci == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+
+    /* the input of the child is limited, the first user always fits */
+    while ((state = selinux_ctx->apply_queue) != NULL
+            && batch->count < IPA_SELINUX_APPLY_MAX_BATCH) {
+        size += selinux_child_input_size(state->sci);
+        if (batch->count > 0 && size > SELINUX_CHILD_IN_BUF_SIZE) {
+            break;
+        }
+
+        DLIST_REMOVE(selinux_ctx->apply_queue, state);
+        state->batch = batch;
+        state->batch_idx = batch->count;
+        batch->states[batch->count] = state;
+        sci[batch->count] = state->sci;
+        batch->count++;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Setting the SELinux context of %zu user(s)\n", batch->count);
+
+    subreq = selinux_child_send(batch, ev, sci, batch->count);
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    tevent_req_set_callback(subreq, ipa_selinux_apply_done, batch);
+
+    selinux_ctx->child_running = true;
+    return;
+
+fail:
+    DEBUG(SSSDBG_CRIT_FAILURE, "Cannot run selinux_child [%d]: %s\n",
+          ret, sss_strerror(ret));
+
+    /* the queued users are failed as well, the next request starts over */
+    if (batch != NULL) {
+        for (size_t i = 0; i < batch->count; i++) {
+            state = batch->states[i];
+            state->batch = NULL;
+            DLIST_ADD(selinux_ctx->apply_queue, state);
+        }
+        talloc_free(batch);
+    }
+
+    while ((state = selinux_ctx->apply_queue) != NULL) {
+        DLIST_REMOVE(selinux_ctx->apply_queue, state);
+        talloc_set_destructor(state, NULL);
+        tevent_req_error(state->req, ret);
+        tevent_req_post(state->req, ev);
+    }
+}
+
+static void ipa_selinux_apply_done(struct tevent_req *subreq)
+{
+    struct ipa_selinux_apply_batch *batch;
+    struct ipa_selinux_apply_state *state;
+    struct ipa_selinux_ctx *selinux_ctx;
+    struct tevent_context *ev;
+    uint32_t *results = NULL;
+    errno_t ret;
+    size_t i;
+
+    batch = tevent_req_callback_data(subreq, struct ipa_selinux_apply_batch);
+    selinux_ctx = batch->selinux_ctx;
+    ev = batch->ev;
+
+    ret = selinux_child_recv(subreq, batch, &results);
+    talloc_zfree(subreq);
+
+    for (i = 0; i < batch->count; i++) {
+        state = batch->states[i];
+        if (state == NULL) {
+            continue;
+        }
+
+        batch->states[i] = NULL;
+        state->batch = NULL;
+        talloc_set_destructor(state, NULL);
+
+        if (ret != EOK) {
+            tevent_req_error(state->req, ret);
+        } else if (results[i] != 0) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Error in selinux_child for [%s]: [%d][%s]\n",
+                  state->sci->username, results[i], strerror(results[i]));
+            tevent_req_error(state->req, ERR_SELINUX_CONTEXT);
+        } else {
+            ipa_selinux_context_set_applied(selinux_ctx, state->sci);
+            tevent_req_done(state->req);
+        }
+    }
+
+    talloc_free(batch);
+    selinux_ctx->child_running = false;
+
+    ipa_selinux_apply_next(selinux_ctx, ev);
+}
+
+static errno_t ipa_selinux_apply_recv(struct tevent_req *req)
 {
     TEVENT_REQ_RETURN_ON_ERROR(req);
     return EOK;
@@ -1313,13 +1647,10 @@ static void ipa_get_selinux_connect_done(struct tevent_req *subreq)
         goto fail;
     }
 
-    subreq = ipa_host_info_send(state, state->be_ctx->ev,
-                                sdap_id_op_handle(state->op),
-                                id_ctx->sdap_id_ctx->opts,
-                                hostname,
-                                id_ctx->ipa_options->host_map,
-                                NULL,
-                                state->selinux_ctx->host_search_bases);
+    subreq = ipa_local_host_info_send(state, state->be_ctx->ev,
+                                      sdap_id_op_handle(state->op),
+                                      id_ctx->sdap_id_ctx->opts,
+                                      id_ctx->ipa_options, false);
     if (subreq == NULL) {
         ret = ENOMEM;
         goto fail;
@@ -1426,8 +1757,8 @@ static void ipa_get_selinux_hosts_done(struct tevent_req *subreq)
     struct sysdb_attrs **hostgroups;
     struct sysdb_attrs **host;
 
-    ret = ipa_host_info_recv(subreq, state, &host_count, &host,
-                             &hostgroup_count, &hostgroups);
+    ret = ipa_local_host_info_recv(subreq, state, &host_count, &host,
+                                   &hostgroup_count, &hostgroups);
     talloc_free(subreq);
     if (ret != EOK) {
         goto done;
@@ -34,10 +34,19 @@
     talloc_asprintf(mem_ctx, "%s/logins/%s", selinux_policy_root(), username)
 #endif /* HAVE_SELINUX_LOGIN_DIR */
 
+struct ipa_selinux_apply_state;
+
 struct ipa_selinux_ctx {
     struct ipa_id_ctx *id_ctx;
     time_t last_update;
 
+    /* SELinux contexts set by selinux_child, keyed by the user name */
+    hash_table_t *applied_contexts;
+
+    /* Users waiting for the running selinux_child */
+    struct ipa_selinux_apply_state *apply_queue;
+    bool child_running;
+
     struct sdap_search_base **selinux_search_bases;
     struct sdap_search_base **host_search_bases;
     struct sdap_search_base **hbac_search_bases;
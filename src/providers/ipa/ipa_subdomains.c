@@ -27,6 +27,7 @@
 #include "providers/ipa/ipa_subdomains.h"
 #include "providers/ipa/ipa_common.h"
 #include "providers/ipa/ipa_id.h"
+#include "util/murmurhash3.h"
 
 #include <ctype.h>
 
@@ -81,6 +82,10 @@ struct ipa_subdomains_ctx {
     bool configured_explicit;
     time_t disabled_until;
     bool view_read_at_init;
+
+    /* hashes of the last stored ranges and trusts, 0 if unknown */
+    uint32_t ranges_hash;
+    uint32_t trusts_hash;
 };
 
 static void ipa_subdomains_done(struct ipa_subdomains_ctx *sd_ctx,
@@ -477,6 +482,43 @@ done:
     return ret;
 }
 
+/* Hashes the requested attributes of the reply independently of the order
+ * of the entries, so a refresh can detect that the server data did not
+ * change since the last time they were stored. Never returns 0. */
+static uint32_t ipa_subdom_reply_hash(struct sysdb_attrs **reply,
+                                      size_t count,
+                                      const char **attrs)
+{
+    struct ldb_message_element *el;
+    uint32_t hash = count;
+    uint32_t entry;
+    size_t c;
+    size_t i;
+    size_t j;
+    int ret;
+
+    for (c = 0; c < count; c++) {
+        entry = 0;
+        for (i = 0; attrs[i] != NULL; i++) {
+            entry = murmurhash3(attrs[i], strlen(attrs[i]) + 1, entry);
+
+            ret = sysdb_attrs_get_el_ext(reply[c], attrs[i], false, &el);
+            if (ret != EOK) {
+                continue;
+            }
+
+            for (j = 0; j < el->num_values; j++) {
+                entry = murmurhash3((const char *) el->values[j].data,
+                                    el->values[j].length, entry);
+            }
+        }
+
+        hash += entry;
+    }
+
+    return hash == 0 ? 1 : hash;
+}
+
 static void ipa_subdom_store_step(struct sss_domain_info *parent,
                                   struct ipa_id_ctx *id_ctx,
                                   struct sdap_idmap_ctx *sdap_idmap_ctx,
@@ -588,6 +630,8 @@ struct ipa_subdomains_req_ctx {
 
     size_t reply_count;
     struct sysdb_attrs **reply;
+
+    bool ranges_changed;
 };
 
 static void ipa_subdomains_get_conn_done(struct tevent_req *req);
@@ -641,6 +685,7 @@ static void ipa_subdomains_retrieve(struct ipa_subdomains_ctx *ctx, struct be_re
     req_ctx->current_filter = NULL;
     req_ctx->reply_count = 0;
     req_ctx->reply = NULL;
+    req_ctx->ranges_changed = false;
 
     req_ctx->sdap_op = sdap_id_op_create(req_ctx,
                                          ctx->sdap_id_ctx->conn->conn_cache);
@@ -1019,6 +1064,7 @@ static void ipa_subdomains_handler_done(struct tevent_req *req)
     bool refresh_has_changes = false;
     int dp_error = DP_ERR_FATAL;
     struct tevent_req *trust_req;
+    uint32_t hash;
 
     ctx = tevent_req_callback_data(req, struct ipa_subdomains_req_ctx);
     domain = ctx->sd_ctx->be_ctx->domain;
@@ -1049,11 +1095,25 @@ static void ipa_subdomains_handler_done(struct tevent_req *req)
         goto done;
     }
 
-    ret = ipa_subdomains_refresh(ctx->sd_ctx, ctx->reply_count, ctx->reply,
-                                 &refresh_has_changes);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "Failed to refresh subdomains.\n");
-        goto done;
+    hash = ipa_subdom_reply_hash(ctx->reply, ctx->reply_count,
+                    subdomain_requests[IPA_SUBDOMAINS_SLAVE].attrs);
+    if (hash == ctx->sd_ctx->trusts_hash && !ctx->ranges_changed) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Trusted domains did not change.\n");
+        ctx->sd_ctx->last_refreshed = time(NULL);
+    } else {
+        ret = ipa_subdomains_refresh(ctx->sd_ctx, ctx->reply_count,
+                                     ctx->reply, &refresh_has_changes);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to refresh subdomains.\n");
+            ctx->sd_ctx->trusts_hash = 0;
+            goto done;
+        }
+
+        /* an existing trust might have been modified as well */
+        if (ctx->sd_ctx->trusts_hash != 0) {
+            refresh_has_changes = true;
+        }
+        ctx->sd_ctx->trusts_hash = hash;
     }
 
     if (refresh_has_changes) {
@@ -1166,6 +1226,7 @@ static void ipa_subdomains_handler_ranges_done(struct tevent_req *req)
     struct range_info **range_list = NULL;
     struct sysdb_ctx *sysdb;
     struct sss_domain_info *domain;
+    uint32_t hash;
 
     ctx = tevent_req_callback_data(req, struct ipa_subdomains_req_ctx);
     domain = ctx->sd_ctx->be_ctx->domain;
@@ -1178,19 +1239,29 @@ static void ipa_subdomains_handler_ranges_done(struct tevent_req *req)
         goto done;
     }
 
-    ret = ipa_ranges_parse_results(ctx, domain->name,
-                                   reply_count, reply, &range_list);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE,
-              "ipa_ranges_parse_results request failed.\n");
-        goto done;
-    }
+    hash = ipa_subdom_reply_hash(reply, reply_count,
+                    subdomain_requests[IPA_SUBDOMAINS_RANGES].attrs);
+    if (hash == ctx->sd_ctx->ranges_hash) {
+        DEBUG(SSSDBG_TRACE_FUNC, "ID ranges did not change.\n");
+    } else {
+        ret = ipa_ranges_parse_results(ctx, domain->name,
+                                       reply_count, reply, &range_list);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "ipa_ranges_parse_results request failed.\n");
+            goto done;
+        }
 
-    ret = sysdb_update_ranges(sysdb, range_list);
-    talloc_free(range_list);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "sysdb_update_ranges failed.\n");
-        goto done;
+        ret = sysdb_update_ranges(sysdb, range_list);
+        talloc_free(range_list);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "sysdb_update_ranges failed.\n");
+            ctx->sd_ctx->ranges_hash = 0;
+            goto done;
+        }
+
+        ctx->sd_ctx->ranges_hash = hash;
+        ctx->ranges_changed = true;
     }
 
     ret = ipa_check_master(ctx);
@@ -160,20 +160,93 @@ ipa_sudo_highest_usn(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+/* Appends the original DNs of the entries to *_dns. With memberof set the
+ * DNs of the command groups the entries are member of are appended too, so
+ * a changed command is also tracked through the groups which contain it.
+ * The strings are not copied, attrs must outlive the list. */
+static errno_t
+ipa_sudo_append_changed_dns(TALLOC_CTX *mem_ctx,
+                            struct sysdb_attrs **attrs,
+                            size_t num_attrs,
+                            bool memberof,
+                            const char ***_dns,
+                            size_t *_num_dns)
+{
+    struct ldb_message_element *el;
+    const char **dns = *_dns;
+    size_t num_dns = *_num_dns;
+    const char *origdn;
+    size_t count;
+    errno_t ret;
+    size_t i;
+    size_t j;
+
+    if (num_attrs == 0) {
+        return EOK;
+    }
+
+    count = num_dns + num_attrs;
+    for (i = 0; memberof && i < num_attrs; i++) {
+        ret = sysdb_attrs_get_el_ext(attrs[i], SYSDB_MEMBEROF, false, &el);
+        if (ret == EOK) {
+            count += el->num_values;
+        } else if (ret != ENOENT) {
+            return ret;
+        }
+    }
+
+    dns = talloc_realloc(mem_ctx, dns, const char *, count);
+    if (dns == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < num_attrs; i++) {
+        ret = sysdb_attrs_get_string(attrs[i], SYSDB_ORIG_DN, &origdn);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to get original dn [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            talloc_free(dns);
+            return ERR_INTERNAL;
+        }
+
+        dns[num_dns++] = origdn;
+
+        if (!memberof) {
+            continue;
+        }
+
+        ret = sysdb_attrs_get_el_ext(attrs[i], SYSDB_MEMBEROF, false, &el);
+        if (ret == ENOENT) {
+            continue;
+        } else if (ret != EOK) {
+            talloc_free(dns);
+            return ret;
+        }
+
+        for (j = 0; j < el->num_values; j++) {
+            dns[num_dns++] = (const char *) el->values[j].data;
+        }
+    }
+
+    *_dns = dns;
+    *_num_dns = num_dns;
+
+    return EOK;
+}
+
 static errno_t
 ipa_sudo_assoc_rules_filter(TALLOC_CTX *mem_ctx,
-                            struct sysdb_attrs **cmdgroups,
-                            size_t num_cmdgroups,
+                            const char **dns,
+                            size_t num_dns,
                             char **_filter)
 {
     TALLOC_CTX *tmp_ctx;
-    const char *origdn;
     char *sanitized;
     char *filter;
     errno_t ret;
     size_t i;
 
-    if (num_cmdgroups == 0) {
+    if (num_dns == 0) {
         return ENOENT;
     }
 
@@ -188,29 +261,23 @@ ipa_sudo_assoc_rules_filter(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    for (i = 0; i < num_cmdgroups; i++) {
-        ret = sysdb_attrs_get_string(cmdgroups[i], SYSDB_ORIG_DN, &origdn);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to get original dn [%d]: %s\n",
-                  ret, sss_strerror(ret));
-            ret = ERR_INTERNAL;
-            goto done;
-        }
-
-        ret = sss_filter_sanitize(tmp_ctx, origdn, &sanitized);
+    for (i = 0; i < num_dns; i++) {
+        ret = sss_filter_sanitize(tmp_ctx, dns[i], &sanitized);
         if (ret != EOK) {
             goto done;
         }
 
-        filter = talloc_asprintf_append(filter, "(%s=%s)",
-                                        SYSDB_IPA_SUDORULE_ORIGCMD, sanitized);
+        filter = talloc_asprintf_append_buffer(filter, "(%s=%s)",
+                                               SYSDB_IPA_SUDORULE_ORIGCMD,
+                                               sanitized);
+        talloc_free(sanitized);
         if (filter == NULL) {
             ret = ENOMEM;
             goto done;
         }
     }
 
-    filter = talloc_asprintf(tmp_ctx, "(&(objectClass=%s)(|%s)))",
+    filter = talloc_asprintf(tmp_ctx, "(&(objectClass=%s)(|%s))",
                              SYSDB_SUDO_CACHE_OC, filter);
     if (filter == NULL) {
         ret = ENOMEM;
@@ -228,8 +295,8 @@ done:
 static errno_t
 ipa_sudo_assoc_rules(TALLOC_CTX *mem_ctx,
                      struct sss_domain_info *domain,
-                     struct sysdb_attrs **cmdgroups,
-                     size_t num_cmdgroups,
+                     const char **dns,
+                     size_t num_dns,
                      struct sysdb_attrs ***_rules,
                      size_t *_num_rules)
 {
@@ -246,8 +313,7 @@ ipa_sudo_assoc_rules(TALLOC_CTX *mem_ctx,
         return ENOMEM;
     }
 
-    ret = ipa_sudo_assoc_rules_filter(tmp_ctx, cmdgroups,
-                                      num_cmdgroups, &filter);
+    ret = ipa_sudo_assoc_rules_filter(tmp_ctx, dns, num_dns, &filter);
     if (ret != EOK) {
         goto done;
     }
@@ -281,13 +347,15 @@ done:
     return ret;
 }
 
+/* Builds a filter matching the cached rules which refer to any of the
+ * changed commands or command groups. */
 static errno_t
-ipa_sudo_filter_rules_bycmdgroups(TALLOC_CTX *mem_ctx,
-                                  struct sss_domain_info *domain,
-                                  struct sysdb_attrs **cmdgroups,
-                                  size_t num_cmdgroups,
-                                  struct sdap_attr_map *map_rule,
-                                  char **_filter)
+ipa_sudo_filter_rules_bydns(TALLOC_CTX *mem_ctx,
+                            struct sss_domain_info *domain,
+                            const char **dns,
+                            size_t num_dns,
+                            struct sdap_attr_map *map_rule,
+                            char **_filter)
 {
     TALLOC_CTX *tmp_ctx;
     struct sysdb_attrs **rules;
@@ -298,7 +366,7 @@ ipa_sudo_filter_rules_bycmdgroups(TALLOC_CTX *mem_ctx,
     errno_t ret;
     size_t i;
 
-    if (num_cmdgroups == 0) {
+    if (num_dns == 0) {
         *_filter = NULL;
         return EOK;
     }
@@ -308,7 +376,7 @@ ipa_sudo_filter_rules_bycmdgroups(TALLOC_CTX *mem_ctx,
         return ENOMEM;
     }
 
-    ret = ipa_sudo_assoc_rules(tmp_ctx, domain, cmdgroups, num_cmdgroups,
+    ret = ipa_sudo_assoc_rules(tmp_ctx, domain, dns, num_dns,
                                &rules, &num_rules);
     if (ret != EOK) {
         goto done;
@@ -339,7 +407,7 @@ ipa_sudo_filter_rules_bycmdgroups(TALLOC_CTX *mem_ctx,
             goto done;
         }
 
-        filter = talloc_asprintf_append(filter, "(%s=%s)",
+        filter = talloc_asprintf_append_buffer(filter, "(%s=%s)",
                     map_rule[IPA_AT_SUDORULE_NAME].name, sanitized);
         if (filter == NULL) {
             ret = ENOMEM;
@@ -381,10 +449,17 @@ struct ipa_sudo_fetch_state {
     struct sysdb_attrs **rules;
     size_t num_rules;
     char *usn;
+
+    /* DNs of the commands and command groups changed since the last
+     * refresh, the rules which refer to them are fetched as well */
+    const char **changed_dns;
+    size_t num_changed_dns;
 };
 
 static errno_t ipa_sudo_fetch_addtl_cmdgroups(struct tevent_req *req);
 static void ipa_sudo_fetch_addtl_cmdgroups_done(struct tevent_req *subreq);
+static errno_t ipa_sudo_fetch_addtl_cmds(struct tevent_req *req);
+static void ipa_sudo_fetch_addtl_cmds_done(struct tevent_req *subreq);
 static errno_t ipa_sudo_fetch_rules(struct tevent_req *req);
 static void ipa_sudo_fetch_rules_done(struct tevent_req *subreq);
 static errno_t ipa_sudo_fetch_cmdgroups(struct tevent_req *req);
@@ -444,10 +519,11 @@ ipa_sudo_fetch_send(TALLOC_CTX *mem_ctx,
     }
 
     if (state->cmdgroups_filter != NULL) {
-        /* We need to fetch additional cmdgroups that may not be revealed
-         * during normal search. Such as when using entryUSN filter in smart
-         * refresh, some command groups may have change but none rule was
-         * modified but we need to fetch associated rules anyway. */
+        /* We need to fetch additional cmdgroups and commands that may not
+         * be revealed during normal search. Such as when using entryUSN
+         * filter in smart refresh, some command groups or commands may have
+         * change but none rule was modified but we need to fetch associated
+         * rules anyway. */
         ret = ipa_sudo_fetch_addtl_cmdgroups(req);
     } else {
         ret = ipa_sudo_fetch_rules(req);
@@ -508,7 +584,6 @@ ipa_sudo_fetch_addtl_cmdgroups_done(struct tevent_req *subreq)
     struct tevent_req *req = NULL;
     struct sysdb_attrs **attrs;
     size_t num_attrs;
-    char *filter;
     errno_t ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
@@ -523,15 +598,110 @@ ipa_sudo_fetch_addtl_cmdgroups_done(struct tevent_req *subreq)
     DEBUG(SSSDBG_IMPORTANT_INFO, "Received %zu additional command groups\n",
           num_attrs);
 
-    ret = ipa_sudo_filter_rules_bycmdgroups(state, state->domain, attrs,
-                                            num_attrs, state->map_rule,
-                                            &filter);
+    ret = ipa_sudo_append_changed_dns(state, attrs, num_attrs, false,
+                                      &state->changed_dns,
+                                      &state->num_changed_dns);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = ipa_sudo_highest_usn(state, attrs, num_attrs, &state->usn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = ipa_sudo_fetch_addtl_cmds(req);
+
+done:
+    if (ret == EOK) {
+        ipa_sudo_fetch_done(req);
+    } else if (ret != EAGAIN) {
+        tevent_req_error(req, ret);
+    }
+
+    return;
+}
+
+static errno_t
+ipa_sudo_fetch_addtl_cmds(struct tevent_req *req)
+{
+    struct ipa_sudo_fetch_state *state;
+    struct tevent_req *subreq;
+    struct sdap_attr_map *map;
+    char *filter;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "About to fetch additional commands\n");
+
+    state = tevent_req_data(req, struct ipa_sudo_fetch_state);
+    map = state->map_cmd;
+
+    /* the same USN filter applies to commands and command groups */
+    filter = talloc_asprintf(state, "(&(objectClass=%s)%s)",
+                             map[IPA_OC_SUDOCMD].name,
+                             state->cmdgroups_filter);
+    if (filter == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to build filter\n");
+        return ENOMEM;
+    }
+
+    subreq = sdap_search_bases_send(state, state->ev, state->sdap_opts,
+                                    state->sh, state->sudo_sb, map, true, 0,
+                                    filter, NULL);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(subreq, ipa_sudo_fetch_addtl_cmds_done, req);
+    return EAGAIN;
+}
+
+static void
+ipa_sudo_fetch_addtl_cmds_done(struct tevent_req *subreq)
+{
+    struct ipa_sudo_fetch_state *state = NULL;
+    struct tevent_req *req = NULL;
+    struct sysdb_attrs **attrs;
+    size_t num_attrs;
+    char *filter;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct ipa_sudo_fetch_state);
+
+    ret = sdap_search_bases_recv(subreq, state, &num_attrs, &attrs);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    DEBUG(SSSDBG_IMPORTANT_INFO, "Received %zu additional commands\n",
+          num_attrs);
+
+    ret = ipa_sudo_append_changed_dns(state, attrs, num_attrs, true,
+                                      &state->changed_dns,
+                                      &state->num_changed_dns);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = ipa_sudo_highest_usn(state, attrs, num_attrs, &state->usn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = ipa_sudo_filter_rules_bydns(state, state->domain,
+                                      state->changed_dns,
+                                      state->num_changed_dns,
+                                      state->map_rule, &filter);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to construct rules filter "
               "[%d]: %s\n", ret, sss_strerror(ret));
         goto done;
     }
 
+    talloc_zfree(state->changed_dns);
+    state->num_changed_dns = 0;
+
     state->search_filter = sdap_or_filters(state, state->search_filter, filter);
     if (state->search_filter == NULL) {
         ret = ENOMEM;
@@ -775,6 +945,11 @@ ipa_sudo_fetch_cmds_done(struct tevent_req *subreq)
         goto done;
     }
 
+    ret = ipa_sudo_highest_usn(state, attrs, num_attrs, &state->usn);
+    if (ret != EOK) {
+        goto done;
+    }
+
 done:
     if (ret == EOK) {
         ipa_sudo_fetch_done(req);
@@ -952,7 +1127,6 @@ static void
 ipa_sudo_refresh_connect_done(struct tevent_req *subreq)
 {
     struct ipa_sudo_refresh_state *state;
-    const char *hostname;
     struct tevent_req *req;
     int dp_error;
     int ret;
@@ -976,14 +1150,9 @@ ipa_sudo_refresh_connect_done(struct tevent_req *subreq)
     DEBUG(SSSDBG_TRACE_FUNC, "SUDO LDAP connection successful\n");
     DEBUG(SSSDBG_TRACE_FUNC, "About to fetch host information\n");
 
-    /* Obtain host information. */
-    hostname = dp_opt_get_string(state->ipa_opts->basic, IPA_HOSTNAME);
-
-    subreq = ipa_host_info_send(state, state->ev,
-                                state->sh, state->sdap_opts, hostname,
-                                state->ipa_opts->host_map,
-                                state->ipa_opts->hostgroup_map,
-                                state->ipa_opts->host_search_bases);
+    /* Obtain host information, shared with HBAC and SELinux. */
+    subreq = ipa_local_host_info_send(state, state->ev, state->sh,
+                                      state->sdap_opts, state->ipa_opts, true);
     if (subreq == NULL) {
         state->dp_error = DP_ERR_FATAL;
         tevent_req_error(req, ENOMEM);
@@ -1011,8 +1180,9 @@ ipa_sudo_refresh_host_done(struct tevent_req *subreq)
         return;
     }
 
-    ret = ipa_host_info_recv(subreq, host, &host->num_hosts, &host->hosts,
-                             &host->num_hostgroups, &host->hostgroups);
+    ret = ipa_local_host_info_recv(subreq, host, &host->num_hosts,
+                                   &host->hosts, &host->num_hostgroups,
+                                   &host->hostgroups);
     talloc_zfree(subreq);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "Unable to retrieve host information "
@@ -46,6 +46,12 @@
 #define MATCHRDN_HOST(map)      (map)[IPA_AT_HOST_FQDN].name, "cn", "computers", "cn", "accounts"
 #define MATCHRDN_HOSTGROUP(map) (map)[IPA_AT_HOSTGROUP_NAME].name, "cn", "hostgroups", "cn", "accounts"
 
+/* A dhash table never grows past 2^(directory bits + segment bits) buckets
+ * and the bits picked for a small initial count are too few for thousands
+ * of rules and commands, the chains would grow linearly instead */
+#define IPA_SUDO_CONV_HASH_DIR_BITS 8
+#define IPA_SUDO_CONV_HASH_SEG_BITS 8
+
 struct ipa_sudo_conv {
     struct sysdb_ctx *sysdb;
 
@@ -60,6 +66,10 @@ struct ipa_sudo_conv {
     hash_table_t *rules;
     hash_table_t *cmdgroups;
     hash_table_t *cmds;
+
+    /* converted user, group and host DNs, the same members are usually
+     * referenced by many rules */
+    hash_table_t *members;
 };
 
 struct ipa_sudo_dn_list {
@@ -81,6 +91,7 @@ struct ipa_sudo_rule {
 struct ipa_sudo_cmdgroup {
     struct ipa_sudo_dn_list *cmds;
     const char **expanded;
+    size_t num_expanded;
 };
 
 static size_t
@@ -316,6 +327,16 @@ done:
     return ret;
 }
 
+static errno_t
+ipa_sudo_conv_hash_create(TALLOC_CTX *mem_ctx,
+                          hash_table_t **_table)
+{
+    return sss_hash_create_ex(mem_ctx, 0, _table,
+                              IPA_SUDO_CONV_HASH_DIR_BITS,
+                              IPA_SUDO_CONV_HASH_SEG_BITS,
+                              0, 0, NULL, NULL);
+}
+
 struct ipa_sudo_conv *
 ipa_sudo_conv_init(TALLOC_CTX *mem_ctx,
                    struct sysdb_ctx *sysdb,
@@ -344,21 +365,28 @@ ipa_sudo_conv_init(TALLOC_CTX *mem_ctx,
     conv->map_host = map_host;
     conv->map_hostgroup = map_hostgroup;
 
-    ret = sss_hash_create(conv, 20, &conv->rules);
+    ret = ipa_sudo_conv_hash_create(conv, &conv->rules);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create hash table [%d]: %s\n",
               ret, sss_strerror(ret));
         goto done;
     }
 
-    ret = sss_hash_create(conv, 20, &conv->cmdgroups);
+    ret = ipa_sudo_conv_hash_create(conv, &conv->cmdgroups);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create hash table [%d]: %s\n",
               ret, sss_strerror(ret));
         goto done;
     }
 
-    ret = sss_hash_create(conv, 20, &conv->cmds);
+    ret = ipa_sudo_conv_hash_create(conv, &conv->cmds);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create hash table [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = ipa_sudo_conv_hash_create(conv, &conv->members);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create hash table [%d]: %s\n",
               ret, sss_strerror(ret));
@@ -605,7 +633,8 @@ build_filter(TALLOC_CTX *mem_ctx,
             goto done;
         }
 
-        filter = talloc_asprintf_append(filter, "(%s=%s)", rdn_attr, safe_rdn);
+        filter = talloc_asprintf_append_buffer(filter, "(%s=%s)",
+                                               rdn_attr, safe_rdn);
         if (filter == NULL) {
             ret = ENOMEM;
             goto done;
@@ -776,6 +805,60 @@ convert_cat(TALLOC_CTX *mem_ctx,
     return value;
 }
 
+typedef const char *
+(*convert_fn)(TALLOC_CTX *mem_ctx,
+              struct ipa_sudo_conv *conv,
+              const char *value);
+
+/* The result is owned by the conversion context */
+static const char *
+convert_cached(struct ipa_sudo_conv *conv,
+               char kind,
+               convert_fn conv_fn,
+               const char *value)
+{
+    hash_key_t hkey;
+    hash_value_t hvalue;
+    const char *converted;
+    char *key;
+    errno_t ret;
+    int hret;
+
+    key = talloc_asprintf(NULL, "%c%s", kind, value);
+    if (key == NULL) {
+        return NULL;
+    }
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = key;
+
+    hret = hash_lookup(conv->members, &hkey, &hvalue);
+    if (hret == HASH_SUCCESS) {
+        talloc_free(key);
+        return hvalue.ptr;
+    } else if (hret != HASH_ERROR_KEY_NOT_FOUND) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to lookup value [%d]\n", hret);
+        talloc_free(key);
+        return NULL;
+    }
+
+    converted = conv_fn(conv, conv, value);
+    if (converted == NULL) {
+        talloc_free(key);
+        return NULL;
+    }
+
+    ret = ipa_sudo_conv_store(conv->members, key, discard_const(converted));
+    talloc_free(key);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to store converted value "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        return NULL;
+    }
+
+    return converted;
+}
+
 static errno_t
 convert_attributes(struct ipa_sudo_conv *conv,
                    struct ipa_sudo_rule *rule,
@@ -786,32 +869,32 @@ convert_attributes(struct ipa_sudo_conv *conv,
     const char *value;
     errno_t ret;
     int i, j;
+    /* the conversions of DNs are cached under their kind */
     static struct {
         const char *ipa;
         const char *sudo;
-        const char *(*conv_fn)(TALLOC_CTX *mem_ctx,
-                               struct ipa_sudo_conv *conv,
-                               const char *value);
-    } table[] = {{SYSDB_NAME,                            SYSDB_SUDO_CACHE_AT_CN         , NULL},
-                 {SYSDB_IPA_SUDORULE_HOST,               SYSDB_SUDO_CACHE_AT_HOST       , convert_host},
-                 {SYSDB_IPA_SUDORULE_USER,               SYSDB_SUDO_CACHE_AT_USER       , convert_user},
-                 {SYSDB_IPA_SUDORULE_RUNASUSER,          SYSDB_SUDO_CACHE_AT_RUNASUSER  , convert_user},
-                 {SYSDB_IPA_SUDORULE_RUNASGROUP,         SYSDB_SUDO_CACHE_AT_RUNASGROUP , convert_group},
-                 {SYSDB_IPA_SUDORULE_OPTION,             SYSDB_SUDO_CACHE_AT_OPTION     , NULL},
-                 {SYSDB_IPA_SUDORULE_NOTAFTER,           SYSDB_SUDO_CACHE_AT_NOTAFTER   , NULL},
-                 {SYSDB_IPA_SUDORULE_NOTBEFORE,          SYSDB_SUDO_CACHE_AT_NOTBEFORE  , NULL},
-                 {SYSDB_IPA_SUDORULE_SUDOORDER,          SYSDB_SUDO_CACHE_AT_ORDER      , NULL},
-                 {SYSDB_IPA_SUDORULE_CMDCATEGORY,        SYSDB_SUDO_CACHE_AT_COMMAND    , convert_cat},
-                 {SYSDB_IPA_SUDORULE_HOSTCATEGORY,       SYSDB_SUDO_CACHE_AT_HOST       , convert_cat},
-                 {SYSDB_IPA_SUDORULE_USERCATEGORY,       SYSDB_SUDO_CACHE_AT_USER       , convert_cat},
-                 {SYSDB_IPA_SUDORULE_RUNASUSERCATEGORY,  SYSDB_SUDO_CACHE_AT_RUNASUSER  , convert_cat},
-                 {SYSDB_IPA_SUDORULE_RUNASGROUPCATEGORY, SYSDB_SUDO_CACHE_AT_RUNASGROUP , convert_cat},
-                 {SYSDB_IPA_SUDORULE_RUNASEXTUSER,       SYSDB_SUDO_CACHE_AT_RUNASUSER  , NULL},
-                 {SYSDB_IPA_SUDORULE_RUNASEXTGROUP,      SYSDB_SUDO_CACHE_AT_RUNASGROUP , NULL},
-                 {SYSDB_IPA_SUDORULE_RUNASEXTUSERGROUP,  SYSDB_SUDO_CACHE_AT_RUNASUSER  , convert_runasextusergroup},
-                 {SYSDB_IPA_SUDORULE_ALLOWCMD,           SYSDB_IPA_SUDORULE_ORIGCMD     , NULL},
-                 {SYSDB_IPA_SUDORULE_DENYCMD,            SYSDB_IPA_SUDORULE_ORIGCMD     , NULL},
-                 {NULL, NULL, NULL}};
+        convert_fn conv_fn;
+        char kind;
+    } table[] = {{SYSDB_NAME,                            SYSDB_SUDO_CACHE_AT_CN         , NULL, 0},
+                 {SYSDB_IPA_SUDORULE_HOST,               SYSDB_SUDO_CACHE_AT_HOST       , convert_host, 'h'},
+                 {SYSDB_IPA_SUDORULE_USER,               SYSDB_SUDO_CACHE_AT_USER       , convert_user, 'u'},
+                 {SYSDB_IPA_SUDORULE_RUNASUSER,          SYSDB_SUDO_CACHE_AT_RUNASUSER  , convert_user, 'u'},
+                 {SYSDB_IPA_SUDORULE_RUNASGROUP,         SYSDB_SUDO_CACHE_AT_RUNASGROUP , convert_group, 'g'},
+                 {SYSDB_IPA_SUDORULE_OPTION,             SYSDB_SUDO_CACHE_AT_OPTION     , NULL, 0},
+                 {SYSDB_IPA_SUDORULE_NOTAFTER,           SYSDB_SUDO_CACHE_AT_NOTAFTER   , NULL, 0},
+                 {SYSDB_IPA_SUDORULE_NOTBEFORE,          SYSDB_SUDO_CACHE_AT_NOTBEFORE  , NULL, 0},
+                 {SYSDB_IPA_SUDORULE_SUDOORDER,          SYSDB_SUDO_CACHE_AT_ORDER      , NULL, 0},
+                 {SYSDB_IPA_SUDORULE_CMDCATEGORY,        SYSDB_SUDO_CACHE_AT_COMMAND    , convert_cat, 0},
+                 {SYSDB_IPA_SUDORULE_HOSTCATEGORY,       SYSDB_SUDO_CACHE_AT_HOST       , convert_cat, 0},
+                 {SYSDB_IPA_SUDORULE_USERCATEGORY,       SYSDB_SUDO_CACHE_AT_USER       , convert_cat, 0},
+                 {SYSDB_IPA_SUDORULE_RUNASUSERCATEGORY,  SYSDB_SUDO_CACHE_AT_RUNASUSER  , convert_cat, 0},
+                 {SYSDB_IPA_SUDORULE_RUNASGROUPCATEGORY, SYSDB_SUDO_CACHE_AT_RUNASGROUP , convert_cat, 0},
+                 {SYSDB_IPA_SUDORULE_RUNASEXTUSER,       SYSDB_SUDO_CACHE_AT_RUNASUSER  , NULL, 0},
+                 {SYSDB_IPA_SUDORULE_RUNASEXTGROUP,      SYSDB_SUDO_CACHE_AT_RUNASGROUP , NULL, 0},
+                 {SYSDB_IPA_SUDORULE_RUNASEXTUSERGROUP,  SYSDB_SUDO_CACHE_AT_RUNASUSER  , convert_runasextusergroup, 0},
+                 {SYSDB_IPA_SUDORULE_ALLOWCMD,           SYSDB_IPA_SUDORULE_ORIGCMD     , NULL, 0},
+                 {SYSDB_IPA_SUDORULE_DENYCMD,            SYSDB_IPA_SUDORULE_ORIGCMD     , NULL, 0},
+                 {NULL, NULL, NULL, 0}};
 
     tmp_ctx = talloc_new(NULL);
     if (tmp_ctx == NULL) {
@@ -830,7 +913,14 @@ convert_attributes(struct ipa_sudo_conv *conv,
         }
 
         for (j = 0; values[j] != NULL; j++) {
-            if (table[i].conv_fn != NULL) {
+            if (table[i].kind != 0) {
+                value = convert_cached(conv, table[i].kind, table[i].conv_fn,
+                                       values[j]);
+                if (value == NULL) {
+                    ret = ENOMEM;
+                    goto done;
+                }
+            } else if (table[i].conv_fn != NULL) {
                 value = table[i].conv_fn(tmp_ctx, conv, values[j]);
                 if (value == NULL) {
                     ret = ENOMEM;
@@ -856,49 +946,11 @@ done:
     return ret;
 }
 
-static const char **
-combine_cmdgroups(TALLOC_CTX *mem_ctx,
-                  struct ipa_sudo_conv *conv,
-                  struct ipa_sudo_dn_list *list)
-{
-    TALLOC_CTX *tmp_ctx;
-    struct ipa_sudo_cmdgroup *cmdgroup;
-    struct ipa_sudo_dn_list *listitem;
-    const char **values = NULL;
-    errno_t ret;
-
-    tmp_ctx = talloc_new(NULL);
-    if (tmp_ctx == NULL) {
-        return NULL;
-    }
-
-    values = talloc_zero_array(tmp_ctx, const char *, 1);
-    if (values == NULL) {
-        talloc_free(tmp_ctx);
-        return NULL;
-    }
-
-    DLIST_FOR_EACH(listitem, list) {
-        cmdgroup = ipa_sudo_conv_lookup(conv->cmdgroups, listitem->dn);
-
-        ret = add_strings_lists(mem_ctx, values, cmdgroup->expanded,
-                                false, discard_const(&values));
-        if (ret != EOK) {
-            talloc_free(tmp_ctx);
-            return NULL;
-        }
-    }
-
-    talloc_steal(mem_ctx, values);
-    talloc_free(tmp_ctx);
-
-    return values;
-}
-
 static const char **
 combine_cmds(TALLOC_CTX *mem_ctx,
              struct ipa_sudo_conv *conv,
-             struct ipa_sudo_dn_list *list)
+             struct ipa_sudo_dn_list *list,
+             size_t *_count)
 {
     struct ipa_sudo_dn_list *listitem;
     const char **values;
@@ -924,9 +976,133 @@ combine_cmds(TALLOC_CTX *mem_ctx,
         i++;
     }
 
+    *_count = i;
     return values;
 }
 
+struct unique_value {
+    const char *str;
+    size_t pos;
+};
+
+static int
+unique_value_cmp(const void *a, const void *b)
+{
+    const struct unique_value *va = a;
+    const struct unique_value *vb = b;
+    int ret;
+
+    ret = strcmp(va->str, vb->str);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return va->pos < vb->pos ? -1 : (va->pos > vb->pos);
+}
+
+/* Adds the values which are not present yet in their order, sorting them
+ * once instead of comparing every value with all values added before. */
+static errno_t
+add_unique_strings(struct sysdb_attrs *attrs,
+                   const char *name,
+                   const char **values,
+                   size_t num_values)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message_element *el;
+    struct unique_value *sorted;
+    struct ldb_val *vals;
+    struct ldb_val val;
+    bool *keep;
+    size_t num_old;
+    size_t total;
+    size_t added;
+    size_t i;
+    errno_t ret;
+
+    if (num_values == 0) {
+        return EOK;
+    }
+
+    ret = sysdb_attrs_get_el(attrs, name, &el);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    num_old = el->num_values;
+    total = num_old + num_values;
+
+    sorted = talloc_array(tmp_ctx, struct unique_value, total);
+    keep = talloc_zero_array(tmp_ctx, bool, total);
+    if (sorted == NULL || keep == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < total; i++) {
+        sorted[i].str = i < num_old ? (const char *) el->values[i].data
+                                    : values[i - num_old];
+        sorted[i].pos = i;
+    }
+
+    /* the first occurrence of each value sorts first */
+    qsort(sorted, total, sizeof(struct unique_value), unique_value_cmp);
+
+    added = 0;
+    for (i = 0; i < total; i++) {
+        if (i > 0 && strcmp(sorted[i].str, sorted[i - 1].str) == 0) {
+            continue;
+        }
+
+        if (sorted[i].pos >= num_old) {
+            keep[sorted[i].pos] = true;
+            added++;
+        }
+    }
+
+    if (added == 0) {
+        ret = EOK;
+        goto done;
+    }
+
+    vals = talloc_realloc(attrs->a, el->values, struct ldb_val,
+                          num_old + added);
+    if (vals == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    el->values = vals;
+
+    for (i = num_old; i < total; i++) {
+        if (!keep[i]) {
+            continue;
+        }
+
+        val.data = (uint8_t *) discard_const(values[i - num_old]);
+        val.length = strlen(values[i - num_old]);
+
+        vals[el->num_values] = ldb_val_dup(vals, &val);
+        if (vals[el->num_values].data == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        el->num_values++;
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Collects the expanded command groups and the commands in a single pass
+ * over the members of the rule */
 static errno_t
 build_sudocommand(struct ipa_sudo_conv *conv,
                   struct ipa_sudo_rulemember *mlist,
@@ -934,51 +1110,70 @@ build_sudocommand(struct ipa_sudo_conv *conv,
                   char prefix)
 {
     TALLOC_CTX *tmp_ctx;
-    const char **cmds[2];
+    struct ipa_sudo_cmdgroup *cmdgroup;
+    struct ipa_sudo_dn_list *listitem;
+    const char **cmds;
     const char *command;
+    size_t count;
+    size_t i;
     errno_t ret;
-    int i, j;
 
     tmp_ctx = talloc_new(NULL);
     if (tmp_ctx == NULL) {
         return ENOMEM;
     }
 
-    cmds[0] = combine_cmdgroups(tmp_ctx, conv, mlist->cmdgroups);
-    if (cmds[0] == NULL) {
-        ret = ENOMEM;
-        goto done;
+    count = ipa_sudo_dn_list_count(mlist->cmds);
+    DLIST_FOR_EACH(listitem, mlist->cmdgroups) {
+        cmdgroup = ipa_sudo_conv_lookup(conv->cmdgroups, listitem->dn);
+        if (cmdgroup != NULL) {
+            count += cmdgroup->num_expanded;
+        }
     }
 
-    cmds[1] = combine_cmds(tmp_ctx, conv, mlist->cmds);
-    if (cmds[1] == NULL) {
+    cmds = talloc_array(tmp_ctx, const char *, count);
+    if (cmds == NULL) {
         ret = ENOMEM;
         goto done;
     }
 
-    for (i = 0; i < 2; i++) {
-        for (j = 0; cmds[i][j] != NULL; j++) {
-            if (prefix == '\0') {
-                command = cmds[i][j];
-            } else {
-                command = talloc_asprintf(tmp_ctx, "%c%s", prefix, cmds[i][j]);
-                if (command == NULL) {
-                    ret = ENOMEM;
-                    goto done;
-                }
-            }
+    count = 0;
+    DLIST_FOR_EACH(listitem, mlist->cmdgroups) {
+        cmdgroup = ipa_sudo_conv_lookup(conv->cmdgroups, listitem->dn);
+        if (cmdgroup == NULL) {
+            continue;
+        }
 
-            ret = sysdb_attrs_add_string_safe(attrs,
-                        SYSDB_SUDO_CACHE_AT_COMMAND, command);
-            if (ret != EOK) {
-                DEBUG(SSSDBG_CRIT_FAILURE, "Unable to add attribute "
-                      "%s [%d]: %s\n", SYSDB_SUDO_CACHE_AT_COMMAND,
-                      ret, sss_strerror(ret));
+        for (i = 0; i < cmdgroup->num_expanded; i++) {
+            cmds[count++] = cmdgroup->expanded[i];
+        }
+    }
+
+    DLIST_FOR_EACH(listitem, mlist->cmds) {
+        command = ipa_sudo_conv_lookup(conv->cmds, listitem->dn);
+        if (command != NULL) {
+            cmds[count++] = command;
+        }
+    }
+
+    if (prefix != '\0') {
+        for (i = 0; i < count; i++) {
+            cmds[i] = talloc_asprintf(cmds, "%c%s", prefix, cmds[i]);
+            if (cmds[i] == NULL) {
+                ret = ENOMEM;
                 goto done;
             }
         }
     }
 
+    ret = add_unique_strings(attrs, SYSDB_SUDO_CACHE_AT_COMMAND, cmds, count);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to add attribute "
+              "%s [%d]: %s\n", SYSDB_SUDO_CACHE_AT_COMMAND,
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
     ret = EOK;
 
 done:
@@ -1086,7 +1281,8 @@ cmdgroups_iterator(hash_entry_t *item,
         return false;
     }
 
-    values = combine_cmds(cmdgroup, ctx->conv, cmdgroup->cmds);
+    values = combine_cmds(cmdgroup, ctx->conv, cmdgroup->cmds,
+                          &cmdgroup->num_expanded);
     if (values == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to expand commands\n");
         ctx->ret = ENOMEM;
@@ -171,11 +171,17 @@ ipa_sudo_smart_refresh_send(TALLOC_CTX *mem_ctx,
         usn = srv_opts->max_sudo_value + 1;
     }
 
-    cmdgroups_filter = talloc_asprintf(state, "(%s>=%lu)",
+    /* Changed commands and command groups are looked up with the same
+     * filter. Without a known USN every rule is downloaded anyway. */
+    if (usn == 0) {
+        cmdgroups_filter = NULL;
+    } else {
+        cmdgroups_filter = talloc_asprintf(state, "(%s>=%lu)",
             sudo_ctx->sudocmdgroup_map[IPA_AT_SUDOCMDGROUP_ENTRYUSN].name, usn);
-    if (cmdgroups_filter == NULL) {
-        ret = ENOMEM;
-        goto immediately;
+        if (cmdgroups_filter == NULL) {
+            ret = ENOMEM;
+            goto immediately;
+        }
     }
 
     search_filter = talloc_asprintf(state, "(%s>=%lu)",
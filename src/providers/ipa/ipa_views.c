@@ -24,9 +24,59 @@
 
 #include "util/util.h"
 #include "util/strtonum.h"
+#include "providers/dp_ptask.h"
 #include "providers/ldap/sdap_async.h"
 #include "providers/ipa/ipa_id.h"
 
+/* A full refresh of the prefetched overrides is done every
+ * IPA_OVERRIDE_FULL_REFRESH_ROUNDS runs, deleted overrides are not seen by
+ * the incremental ones */
+#define IPA_OVERRIDE_FULL_REFRESH_ROUNDS 12
+
+enum ipa_override_type {
+    IPA_OVERRIDE_TYPE_USER = 0,
+    IPA_OVERRIDE_TYPE_GROUP,
+
+    IPA_OVERRIDE_TYPES
+};
+
+struct ipa_override_entry {
+    enum ipa_override_type type;
+    struct sysdb_attrs *attrs;
+};
+
+struct ipa_override_match {
+    struct ipa_override_entry **entries;
+    size_t count;
+};
+
+struct ipa_override_cache {
+    struct ipa_id_ctx *ipa_ctx;
+
+    /* the override map extended with the modification timestamp */
+    struct sdap_attr_map *map;
+    const char **attrs;
+
+    /* view the overrides belong to, NULL until the first full refresh */
+    char *view_name;
+    char *max_stamp;
+    unsigned int rounds;
+
+    /* original DN -> struct ipa_override_entry */
+    TALLOC_CTX *entries_ctx;
+    hash_table_t *entries;
+
+    /* lookup key -> struct ipa_override_match */
+    TALLOC_CTX *index_ctx;
+    hash_table_t *index;
+};
+
+static errno_t ipa_override_cache_lookup(TALLOC_CTX *mem_ctx,
+                                         struct ipa_override_cache *cache,
+                                         const char *view_name,
+                                         struct be_acct_req *ar,
+                                         struct sysdb_attrs **_attrs);
+
 static errno_t be_acct_req_to_override_filter(TALLOC_CTX *mem_ctx,
                                               struct ipa_options *ipa_opts,
                                               struct be_acct_req *ar,
@@ -283,6 +333,13 @@ struct tevent_req *ipa_get_ad_override_send(TALLOC_CTX *mem_ctx,
         state->ipa_view_name = view_name;
     }
 
+    /* EAGAIN if the prefetched overrides cannot answer the request */
+    ret = ipa_override_cache_lookup(state, ipa_options->override_cache,
+                                    view_name, ar, &state->override_attrs);
+    if (ret != EAGAIN) {
+        goto done;
+    }
+
     state->sdap_op = sdap_id_op_create(state,
                                        state->sdap_id_ctx->conn->conn_cache);
     if (state->sdap_op == NULL) {
@@ -454,3 +511,867 @@ errno_t ipa_get_ad_override_recv(struct tevent_req *req, int *dp_error_out,
 
     return EOK;
 }
+
+static errno_t ipa_override_index_add(struct ipa_override_cache *cache,
+                                      const char *key_str,
+                                      struct ipa_override_entry *entry)
+{
+    struct ipa_override_match *match;
+    hash_key_t key;
+    hash_value_t value;
+    size_t i;
+    int hret;
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(key_str);
+
+    hret = hash_lookup(cache->index, &key, &value);
+    if (hret == HASH_SUCCESS) {
+        match = talloc_get_type(value.ptr, struct ipa_override_match);
+    } else if (hret == HASH_ERROR_KEY_NOT_FOUND) {
+        match = talloc_zero(cache->index_ctx, struct ipa_override_match);
+        if (match == NULL) {
+            return ENOMEM;
+        }
+
+        value.type = HASH_VALUE_PTR;
+        value.ptr = match;
+        hret = hash_enter(cache->index, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed: %s\n",
+                  hash_error_string(hret));
+            return EIO;
+        }
+    } else {
+        DEBUG(SSSDBG_OP_FAILURE, "hash_lookup failed: %s\n",
+              hash_error_string(hret));
+        return EIO;
+    }
+
+    for (i = 0; i < match->count; i++) {
+        if (match->entries[i] == entry) {
+            return EOK;
+        }
+    }
+
+    match->entries = talloc_realloc(match, match->entries,
+                                    struct ipa_override_entry *,
+                                    match->count + 1);
+    if (match->entries == NULL) {
+        return ENOMEM;
+    }
+    match->entries[match->count] = entry;
+    match->count++;
+
+    return EOK;
+}
+
+/* IDs are normalized, the names and anchors are matched case-insensitively
+ * like the server does */
+static errno_t ipa_override_index_attr(struct ipa_override_cache *cache,
+                                       struct ipa_override_entry *entry,
+                                       const char *attr_name,
+                                       const char *prefix,
+                                       bool is_id)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message_element *el;
+    const char *val;
+    char *key;
+    char *lc_val;
+    char *endptr;
+    uint32_t id;
+    unsigned int i;
+    errno_t ret;
+
+    ret = sysdb_attrs_get_el_ext(entry->attrs, attr_name, false, &el);
+    if (ret == ENOENT) {
+        return EOK;
+    } else if (ret != EOK) {
+        return ret;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < el->num_values; i++) {
+        val = (const char *) el->values[i].data;
+
+        if (is_id) {
+            errno = 0;
+            id = strtouint32(val, &endptr, 10);
+            if (errno != 0 || *endptr != '\0' || val == endptr) {
+                DEBUG(SSSDBG_MINOR_FAILURE, "Invalid id value [%s].\n", val);
+                continue;
+            }
+            key = talloc_asprintf(tmp_ctx, "%s:%"PRIu32, prefix, id);
+        } else {
+            lc_val = sss_tc_utf8_str_tolower(tmp_ctx, val);
+            if (lc_val == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            key = talloc_asprintf(tmp_ctx, "%s:%s", prefix, lc_val);
+        }
+        if (key == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = ipa_override_index_add(cache, key, entry);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* The keys follow the filters of be_acct_req_to_override_filter() */
+static errno_t ipa_override_index_entry(struct ipa_override_cache *cache,
+                                        struct ipa_override_entry *entry)
+{
+    errno_t ret;
+
+    if (entry->type == IPA_OVERRIDE_TYPE_USER) {
+        ret = ipa_override_index_attr(cache, entry, SYSDB_NAME, "un", false);
+        if (ret == EOK) {
+            ret = ipa_override_index_attr(cache, entry, SYSDB_UIDNUM,
+                                          "ui", true);
+        }
+        if (ret == EOK) {
+            ret = ipa_override_index_attr(cache, entry, SYSDB_GIDNUM,
+                                          "ug", true);
+        }
+    } else {
+        ret = ipa_override_index_attr(cache, entry, SYSDB_NAME, "gn", false);
+        if (ret == EOK) {
+            ret = ipa_override_index_attr(cache, entry, SYSDB_GIDNUM,
+                                          "gi", true);
+        }
+    }
+
+    if (ret == EOK) {
+        ret = ipa_override_index_attr(cache, entry, SYSDB_OVERRIDE_ANCHOR_UUID,
+                                      "a", false);
+    }
+
+    return ret;
+}
+
+static errno_t ipa_override_index_build(struct ipa_override_cache *cache)
+{
+    hash_value_t *values = NULL;
+    unsigned long count;
+    unsigned long i;
+    errno_t ret;
+    int hret;
+
+    talloc_zfree(cache->index_ctx);
+    cache->index = NULL;
+
+    cache->index_ctx = talloc_new(cache);
+    if (cache->index_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    hret = hash_values(cache->entries, &count, &values);
+    if (hret != HASH_SUCCESS) {
+        ret = EIO;
+        goto done;
+    }
+
+    ret = sss_hash_create(cache->index_ctx, count * 2, &cache->index);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = ipa_override_index_entry(cache, values[i].ptr);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(values);
+    if (ret != EOK) {
+        talloc_zfree(cache->index_ctx);
+        cache->index = NULL;
+    }
+    return ret;
+}
+
+/* Removes the modification timestamp which is only fetched for the
+ * incremental refresh, the overrides are stored as they are returned */
+static errno_t ipa_override_pop_stamp(TALLOC_CTX *mem_ctx,
+                                      struct sysdb_attrs *attrs,
+                                      char **_stamp)
+{
+    size_t i;
+
+    *_stamp = NULL;
+
+    for (i = 0; i < attrs->num; i++) {
+        if (strcmp(attrs->a[i].name, SYSDB_ORIG_MODSTAMP) == 0) {
+            break;
+        }
+    }
+
+    if (i == attrs->num) {
+        return EOK;
+    }
+
+    if (attrs->a[i].num_values > 0) {
+        *_stamp = talloc_strdup(mem_ctx,
+                                (const char *) attrs->a[i].values[0].data);
+        if (*_stamp == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    attrs->num--;
+    attrs->a[i] = attrs->a[attrs->num];
+
+    return EOK;
+}
+
+static errno_t ipa_override_cache_add(struct ipa_override_cache *cache,
+                                      enum ipa_override_type type,
+                                      struct sysdb_attrs *attrs)
+{
+    struct ipa_override_entry *entry;
+    const char *dn;
+    char *stamp;
+    hash_key_t key;
+    hash_value_t value;
+    errno_t ret;
+    int hret;
+
+    ret = sysdb_attrs_get_string(attrs, SYSDB_ORIG_DN, &dn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Override without a DN, skipping.\n");
+        return EOK;
+    }
+
+    entry = talloc_zero(cache->entries_ctx, struct ipa_override_entry);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+    entry->type = type;
+    entry->attrs = talloc_steal(entry, attrs);
+
+    ret = ipa_override_pop_stamp(entry, entry->attrs, &stamp);
+    if (ret != EOK) {
+        talloc_free(entry);
+        return ret;
+    }
+
+    if (stamp != NULL && (cache->max_stamp == NULL
+                            || strcmp(stamp, cache->max_stamp) > 0)) {
+        talloc_free(cache->max_stamp);
+        cache->max_stamp = talloc_steal(cache, stamp);
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(dn);
+
+    hret = hash_lookup(cache->entries, &key, &value);
+    if (hret == HASH_SUCCESS) {
+        hret = hash_delete(cache->entries, &key);
+        if (hret != HASH_SUCCESS) {
+            talloc_free(entry);
+            return EIO;
+        }
+        talloc_free(value.ptr);
+    }
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = entry;
+    hret = hash_enter(cache->entries, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed: %s\n",
+              hash_error_string(hret));
+        talloc_free(entry);
+        return EIO;
+    }
+
+    return EOK;
+}
+
+static errno_t ipa_override_cache_update(struct ipa_override_cache *cache,
+                                         const char *view_name,
+                                         bool full,
+                                         struct sysdb_attrs ***replies,
+                                         size_t *reply_counts)
+{
+    TALLOC_CTX *old_entries_ctx = NULL;
+    size_t total = 0;
+    size_t i;
+    int type;
+    errno_t ret;
+
+    if (full) {
+        old_entries_ctx = cache->entries_ctx;
+        talloc_zfree(cache->view_name);
+        talloc_zfree(cache->max_stamp);
+        cache->entries = NULL;
+
+        cache->entries_ctx = talloc_new(cache);
+        if (cache->entries_ctx == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (type = 0; type < IPA_OVERRIDE_TYPES; type++) {
+            total += reply_counts[type];
+        }
+
+        ret = sss_hash_create(cache->entries_ctx, total, &cache->entries);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    for (type = 0; type < IPA_OVERRIDE_TYPES; type++) {
+        for (i = 0; i < reply_counts[type]; i++) {
+            ret = ipa_override_cache_add(cache, type, replies[type][i]);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+    }
+
+    ret = ipa_override_index_build(cache);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (full) {
+        cache->view_name = talloc_strdup(cache, view_name);
+        if (cache->view_name == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        cache->rounds = 0;
+    } else {
+        cache->rounds++;
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(old_entries_ctx);
+    if (ret != EOK) {
+        /* the next run starts over */
+        talloc_zfree(cache->view_name);
+        talloc_zfree(cache->index_ctx);
+        cache->index = NULL;
+    }
+    return ret;
+}
+
+static errno_t ipa_override_cache_match(struct ipa_override_cache *cache,
+                                        const char *prefix,
+                                        const char *val,
+                                        struct ipa_override_entry **found,
+                                        size_t *_found_count)
+{
+    struct ipa_override_match *match;
+    hash_key_t key;
+    hash_value_t value;
+    size_t i;
+    size_t j;
+    int hret;
+
+    key.type = HASH_KEY_STRING;
+    key.str = talloc_asprintf(cache, "%s:%s", prefix, val);
+    if (key.str == NULL) {
+        return ENOMEM;
+    }
+
+    hret = hash_lookup(cache->index, &key, &value);
+    talloc_free(key.str);
+    if (hret == HASH_ERROR_KEY_NOT_FOUND) {
+        return EOK;
+    } else if (hret != HASH_SUCCESS) {
+        return EIO;
+    }
+
+    match = talloc_get_type(value.ptr, struct ipa_override_match);
+    for (i = 0; i < match->count; i++) {
+        for (j = 0; j < *_found_count; j++) {
+            if (found[j] == match->entries[i]) {
+                break;
+            }
+        }
+
+        /* two matches are enough to tell that the result is ambiguous */
+        if (j == *_found_count && *_found_count < 2) {
+            found[*_found_count] = match->entries[i];
+            (*_found_count)++;
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t ipa_override_cache_lookup(TALLOC_CTX *mem_ctx,
+                                         struct ipa_override_cache *cache,
+                                         const char *view_name,
+                                         struct be_acct_req *ar,
+                                         struct sysdb_attrs **_attrs)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ipa_override_entry *found[2];
+    struct sysdb_attrs *attrs;
+    const char *prefixes[3] = { NULL, NULL, NULL };
+    char *val = NULL;
+    char *endptr;
+    uint32_t id;
+    size_t found_count = 0;
+    size_t i;
+    errno_t ret;
+
+    if (cache == NULL || cache->view_name == NULL || cache->index == NULL
+            || strcmp(cache->view_name, view_name) != 0) {
+        return EAGAIN;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    switch (ar->filter_type) {
+    case BE_FILTER_NAME:
+        if (strchr(ar->filter_value, '*') != NULL) {
+            ret = EAGAIN;
+            goto done;
+        }
+
+        switch ((ar->entry_type & BE_REQ_TYPE_MASK)) {
+        case BE_REQ_USER:
+        case BE_REQ_INITGROUPS:
+            prefixes[0] = "un";
+            break;
+        case BE_REQ_GROUP:
+            prefixes[0] = "gn";
+            break;
+        case BE_REQ_USER_AND_GROUP:
+            prefixes[0] = "un";
+            prefixes[1] = "gn";
+            break;
+        }
+
+        val = sss_tc_utf8_str_tolower(tmp_ctx, ar->filter_value);
+        break;
+
+    case BE_FILTER_IDNUM:
+        errno = 0;
+        id = strtouint32(ar->filter_value, &endptr, 10);
+        if (errno != 0 || *endptr != '\0' || (ar->filter_value == endptr)) {
+            ret = EAGAIN;
+            goto done;
+        }
+
+        switch ((ar->entry_type & BE_REQ_TYPE_MASK)) {
+        case BE_REQ_USER:
+        case BE_REQ_INITGROUPS:
+            prefixes[0] = "ui";
+            break;
+        case BE_REQ_GROUP:
+            prefixes[0] = "gi";
+            break;
+        case BE_REQ_USER_AND_GROUP:
+            prefixes[0] = "ui";
+            prefixes[1] = "gi";
+            prefixes[2] = "ug";
+            break;
+        }
+
+        val = talloc_asprintf(tmp_ctx, "%"PRIu32, id);
+        break;
+
+    case BE_FILTER_SECID:
+        if ((ar->entry_type & BE_REQ_TYPE_MASK) == BE_REQ_BY_SECID) {
+            prefixes[0] = "a";
+            val = talloc_asprintf(tmp_ctx, ":SID:%s", ar->filter_value);
+        }
+        break;
+
+    case BE_FILTER_UUID:
+        if ((ar->entry_type & BE_REQ_TYPE_MASK) == BE_REQ_BY_UUID) {
+            prefixes[0] = "a";
+            val = talloc_asprintf(tmp_ctx, ":IPA:%s:%s",
+                                  dp_opt_get_string(
+                                      cache->ipa_ctx->ipa_options->basic,
+                                      IPA_DOMAIN),
+                                  ar->filter_value);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    /* requests the LDAP search rejects are left to it */
+    if (prefixes[0] == NULL) {
+        ret = EAGAIN;
+        goto done;
+    }
+
+    if (val == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    if (strcmp(prefixes[0], "a") == 0) {
+        val = sss_tc_utf8_str_tolower(tmp_ctx, val);
+        if (val == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    for (i = 0; i < 3 && prefixes[i] != NULL; i++) {
+        ret = ipa_override_cache_match(cache, prefixes[i], val,
+                                       found, &found_count);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    if (found_count == 0) {
+        DEBUG(SSSDBG_TRACE_ALL, "No prefetched override found for [%s].\n",
+                                ar->filter_value);
+        *_attrs = NULL;
+        ret = EOK;
+        goto done;
+    } else if (found_count > 1) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Found more than one prefetched override for [%s], "
+              "expected only 1.\n", ar->filter_value);
+        ret = EINVAL;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_ALL, "Found prefetched override for [%s].\n",
+                            ar->filter_value);
+
+    /* the caller owns the result, the cached entry might be replaced */
+    attrs = sysdb_new_attrs(tmp_ctx);
+    if (attrs == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < found[0]->attrs->num; i++) {
+        ret = sysdb_attrs_copy_values(found[0]->attrs, attrs,
+                                      found[0]->attrs->a[i].name);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    *_attrs = talloc_steal(mem_ctx, attrs);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+struct ipa_override_refresh_state {
+    struct tevent_context *ev;
+    struct ipa_override_cache *cache;
+    struct sdap_id_op *sdap_op;
+
+    const char *view_name;
+    char *search_base;
+    bool full;
+
+    int type;
+    struct sysdb_attrs **replies[IPA_OVERRIDE_TYPES];
+    size_t reply_counts[IPA_OVERRIDE_TYPES];
+};
+
+static void ipa_override_refresh_connect_done(struct tevent_req *subreq);
+static errno_t ipa_override_refresh_next(struct tevent_req *req);
+static void ipa_override_refresh_done(struct tevent_req *subreq);
+
+static struct tevent_req *
+ipa_override_refresh_send(TALLOC_CTX *mem_ctx,
+                          struct tevent_context *ev,
+                          struct be_ctx *be_ctx,
+                          struct be_ptask *be_ptask,
+                          void *pvt)
+{
+    struct ipa_override_refresh_state *state;
+    struct ipa_override_cache *cache;
+    struct tevent_req *req;
+    struct tevent_req *subreq;
+    const char *ipa_view_name;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state,
+                            struct ipa_override_refresh_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "tevent_req_create failed.\n");
+        return NULL;
+    }
+
+    cache = talloc_get_type(pvt, struct ipa_override_cache);
+    state->ev = ev;
+    state->cache = cache;
+
+    if (cache->ipa_ctx->view_name == NULL) {
+        DEBUG(SSSDBG_TRACE_ALL, "View not defined, nothing to prefetch.\n");
+        ret = EOK;
+        goto immediately;
+    }
+
+    state->view_name = talloc_strdup(state, cache->ipa_ctx->view_name);
+    if (state->view_name == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    state->full = (cache->view_name == NULL
+                    || cache->max_stamp == NULL
+                    || strcmp(cache->view_name, state->view_name) != 0
+                    || cache->rounds >= IPA_OVERRIDE_FULL_REFRESH_ROUNDS);
+
+    if (is_default_view(state->view_name)) {
+        ipa_view_name = IPA_DEFAULT_VIEW_NAME;
+    } else {
+        ipa_view_name = state->view_name;
+    }
+
+    state->search_base = talloc_asprintf(state, "cn=%s,%s", ipa_view_name,
+                       cache->ipa_ctx->ipa_options->views_search_bases[0]->basedn);
+    if (state->search_base == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    state->sdap_op = sdap_id_op_create(state,
+                                cache->ipa_ctx->sdap_id_ctx->conn->conn_cache);
+    if (state->sdap_op == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "sdap_id_op_create failed\n");
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    subreq = sdap_id_op_connect_send(state->sdap_op, state, &ret);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "sdap_id_op_connect_send failed: %d(%s).\n",
+                                  ret, strerror(ret));
+        goto immediately;
+    }
+
+    tevent_req_set_callback(subreq, ipa_override_refresh_connect_done, req);
+
+    return req;
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+
+    return req;
+}
+
+static void ipa_override_refresh_connect_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    int dp_error;
+    errno_t ret;
+
+    ret = sdap_id_op_connect_recv(subreq, &dp_error);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot connect to the IPA server: [%d](%s)\n",
+              ret, strerror(ret));
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    ret = ipa_override_refresh_next(req);
+    if (ret != EAGAIN) {
+        tevent_req_error(req, ret);
+    }
+}
+
+static errno_t ipa_override_refresh_next(struct tevent_req *req)
+{
+    struct ipa_override_refresh_state *state = tevent_req_data(req,
+                                            struct ipa_override_refresh_state);
+    struct ipa_override_cache *cache = state->cache;
+    struct sdap_id_ctx *sdap_id_ctx = cache->ipa_ctx->sdap_id_ctx;
+    struct tevent_req *subreq;
+    const char *oc;
+    char *filter;
+
+    if (state->type == IPA_OVERRIDE_TYPE_USER) {
+        oc = cache->map[IPA_OC_OVERRIDE_USER].name;
+    } else {
+        oc = cache->map[IPA_OC_OVERRIDE_GROUP].name;
+    }
+
+    if (state->full) {
+        filter = talloc_asprintf(state, "(objectClass=%s)", oc);
+    } else {
+        filter = talloc_asprintf(state, "(&(objectClass=%s)(%s>=%s))", oc,
+                                 cache->map[IPA_OPTS_OVERRIDE].name,
+                                 cache->max_stamp);
+    }
+    if (filter == NULL) {
+        return ENOMEM;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Prefetching overrides in view [%s] with filter [%s].\n",
+          state->view_name, filter);
+
+    subreq = sdap_get_generic_send(state, state->ev, sdap_id_ctx->opts,
+                                   sdap_id_op_handle(state->sdap_op),
+                                   state->search_base, LDAP_SCOPE_SUBTREE,
+                                   filter, cache->attrs,
+                                   cache->map, IPA_OPTS_OVERRIDE + 1,
+                                   dp_opt_get_int(sdap_id_ctx->opts->basic,
+                                                  SDAP_SEARCH_TIMEOUT),
+                                   true);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(subreq, ipa_override_refresh_done, req);
+    return EAGAIN;
+}
+
+static void ipa_override_refresh_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ipa_override_refresh_state *state = tevent_req_data(req,
+                                            struct ipa_override_refresh_state);
+    errno_t ret;
+
+    ret = sdap_get_generic_recv(subreq, state,
+                                &state->reply_counts[state->type],
+                                &state->replies[state->type]);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot prefetch the overrides.\n");
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    state->type++;
+    if (state->type < IPA_OVERRIDE_TYPES) {
+        ret = ipa_override_refresh_next(req);
+        if (ret != EAGAIN) {
+            tevent_req_error(req, ret);
+        }
+        return;
+    }
+
+    ret = ipa_override_cache_update(state->cache, state->view_name,
+                                    state->full, state->replies,
+                                    state->reply_counts);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot store the prefetched overrides "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "%s refresh of the overrides in view [%s] "
+          "done, %zu user and %zu group overrides fetched.\n",
+          state->full ? "Full" : "Incremental", state->view_name,
+          state->reply_counts[IPA_OVERRIDE_TYPE_USER],
+          state->reply_counts[IPA_OVERRIDE_TYPE_GROUP]);
+
+    tevent_req_done(req);
+}
+
+static errno_t ipa_override_refresh_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+errno_t ipa_override_prefetch_init(struct be_ctx *be_ctx,
+                                   struct ipa_id_ctx *ipa_ctx)
+{
+    struct ipa_options *ipa_opts = ipa_ctx->ipa_options;
+    struct ipa_override_cache *cache;
+    time_t period;
+    errno_t ret;
+
+    period = dp_opt_get_int(ipa_opts->basic, IPA_VIEWS_PREFETCH_INTERVAL);
+    if (period <= 0) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Prefetching of overrides is disabled.\n");
+        return EOK;
+    }
+
+    cache = talloc_zero(ipa_ctx, struct ipa_override_cache);
+    if (cache == NULL) {
+        return ENOMEM;
+    }
+    cache->ipa_ctx = ipa_ctx;
+
+    /* the entry after the override map is the modification timestamp */
+    cache->map = talloc_zero_array(cache, struct sdap_attr_map,
+                                   IPA_OPTS_OVERRIDE + 2);
+    if (cache->map == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    memcpy(cache->map, ipa_opts->override_map,
+           sizeof(struct sdap_attr_map) * IPA_OPTS_OVERRIDE);
+    cache->map[IPA_OPTS_OVERRIDE].opt_name = "ipa_override_modify_timestamp";
+    cache->map[IPA_OPTS_OVERRIDE].def_name = "modifyTimestamp";
+    cache->map[IPA_OPTS_OVERRIDE].sys_name = SYSDB_ORIG_MODSTAMP;
+    cache->map[IPA_OPTS_OVERRIDE].name = discard_const("modifyTimestamp");
+
+    ret = build_attrs_from_map(cache, cache->map, IPA_OPTS_OVERRIDE + 1,
+                               NULL, &cache->attrs, NULL);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = be_ptask_create(cache, be_ctx, period, 0, 0, period / 10, period,
+                          BE_PTASK_OFFLINE_SKIP, 0,
+                          ipa_override_refresh_send,
+                          ipa_override_refresh_recv,
+                          cache, "Prefetch of IPA overrides", NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "be_ptask_create failed.\n");
+        goto done;
+    }
+
+    ipa_opts->override_cache = cache;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(cache);
+    }
+    return ret;
+}
@@ -38,11 +38,14 @@ struct input_buffer {
     const char *username;
 };
 
+/* The buffer contains the input for one or more users, *_p is the offset
+ * of the next user */
 static errno_t unpack_buffer(uint8_t *buf,
                              size_t size,
+                             size_t *_p,
                              struct input_buffer *ibuf)
 {
-    size_t p = 0;
+    size_t p = *_p;
     uint32_t len;
 
     /* seuser */
@@ -90,33 +93,38 @@ static errno_t unpack_buffer(uint8_t *buf,
         p += len;
     }
 
+    *_p = p;
     return EOK;
 }
 
-static errno_t pack_buffer(struct response *r, int result)
+static errno_t pack_buffer(struct response *r, int *results, size_t count)
 {
     size_t p = 0;
+    size_t i;
 
     /* A buffer with the following structure must be created:
-     *   uint32_t status of the request (required)
+     *   uint32_t status of the request for each user (required)
      */
-    r->size =  sizeof(uint32_t);
+    r->size = count * sizeof(uint32_t);
 
     r->buf = talloc_array(r, uint8_t, r->size);
     if(r->buf == NULL) {
         return ENOMEM;
     }
 
-    DEBUG(SSSDBG_TRACE_FUNC, "result [%d]\n", result);
+    for (i = 0; i < count; i++) {
+        DEBUG(SSSDBG_TRACE_FUNC, "result [%d]\n", results[i]);
 
-    /* result */
-    SAFEALIGN_SET_UINT32(&r->buf[p], result, &p);
+        /* result */
+        SAFEALIGN_SET_UINT32(&r->buf[p], results[i], &p);
+    }
 
     return EOK;
 }
 
 static errno_t prepare_response(TALLOC_CTX *mem_ctx,
-                                int result,
+                                int *results,
+                                size_t count,
                                 struct response **rsp)
 {
     int ret;
@@ -130,7 +138,7 @@ static errno_t prepare_response(TALLOC_CTX *mem_ctx,
     r->buf = NULL;
     r->size = 0;
 
-    ret = pack_buffer(r, result);
+    ret = pack_buffer(r, results, count);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "pack_buffer failed\n");
         return ret;
@@ -201,6 +209,9 @@ int main(int argc, const char *argv[])
     struct response *resp = NULL;
     ssize_t written;
     bool needs_update;
+    size_t p;
+    int *results = NULL;
+    size_t count = 0;
 
     struct poptOption long_options[] = {
         POPT_AUTOHELP
@@ -287,22 +298,16 @@ int main(int argc, const char *argv[])
     }
     talloc_steal(main_ctx, debug_prg_name);
 
-    buf = talloc_size(main_ctx, sizeof(uint8_t)*IN_BUF_SIZE);
+    buf = talloc_size(main_ctx, sizeof(uint8_t)*SELINUX_CHILD_IN_BUF_SIZE);
     if (buf == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "talloc_size failed.\n");
         goto fail;
     }
 
-    ibuf = talloc_zero(main_ctx, struct input_buffer);
-    if (ibuf == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
-        goto fail;
-    }
-
     DEBUG(SSSDBG_TRACE_FUNC, "context initialized\n");
 
     errno = 0;
-    len = sss_atomic_read_s(STDIN_FILENO, buf, IN_BUF_SIZE);
+    len = sss_atomic_read_s(STDIN_FILENO, buf, SELINUX_CHILD_IN_BUF_SIZE);
     if (len == -1) {
         ret = errno;
         DEBUG(SSSDBG_CRIT_FAILURE, "read failed [%d][%s].\n", ret, strerror(ret));
@@ -311,25 +316,49 @@ int main(int argc, const char *argv[])
 
     close(STDIN_FILENO);
 
-    ret = unpack_buffer(buf, len, ibuf);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "unpack_buffer failed.[%d][%s].\n", ret, strerror(ret));
+    /* each user needs at least the three lengths */
+    results = talloc_array(main_ctx, int, len / (3 * sizeof(uint32_t)) + 1);
+    if (results == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_array failed.\n");
         goto fail;
     }
 
     DEBUG(SSSDBG_TRACE_FUNC, "performing selinux operations\n");
 
-    needs_update = seuser_needs_update(ibuf);
-    if (needs_update == true) {
-        ret = sc_set_seuser(ibuf->username, ibuf->seuser, ibuf->mls_range);
+    p = 0;
+    do {
+        ibuf = talloc_zero(main_ctx, struct input_buffer);
+        if (ibuf == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
+            goto fail;
+        }
+
+        ret = unpack_buffer(buf, len, &p, ibuf);
         if (ret != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "Cannot set SELinux login context.\n");
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "unpack_buffer failed.[%d][%s].\n", ret, strerror(ret));
             goto fail;
         }
-    }
 
-    ret = prepare_response(main_ctx, ret, &resp);
+        /* a failure for one user does not affect the others */
+        ret = EOK;
+        needs_update = seuser_needs_update(ibuf);
+        if (needs_update == true) {
+            ret = sc_set_seuser(ibuf->username, ibuf->seuser,
+                                ibuf->mls_range);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_CRIT_FAILURE,
+                      "Cannot set SELinux login context of [%s].\n",
+                      ibuf->username);
+            }
+        }
+
+        results[count] = ret;
+        count++;
+        talloc_free(ibuf);
+    } while (p < len);
+
+    ret = prepare_response(main_ctx, results, count, &resp);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to prepare response buffer.\n");
         goto fail;
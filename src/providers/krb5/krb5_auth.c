@@ -323,9 +323,27 @@ static errno_t krb5_auth_prepare_ccache_name(struct krb5child_req *kr,
     return EOK;
 }
 
-static void krb5_auth_store_creds(struct sss_domain_info *domain,
+static void krb5_auth_store_creds_done(struct tevent_req *req)
+{
+    errno_t ret;
+
+    ret = sysdb_cache_password_recv(req);
+    talloc_zfree(req);
+    if (ret) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Failed to cache password, offline auth may not work."
+                  " (%d)[%s]!?\n", ret, strerror(ret));
+        /* password caching failures are not fatal errors */
+    }
+}
+
+/* The hash is stored when it was computed, the reply is not delayed */
+static void krb5_auth_store_creds(TALLOC_CTX *mem_ctx,
+                                  struct tevent_context *ev,
+                                  struct sss_domain_info *domain,
                                   struct pam_data *pd)
 {
+    struct tevent_req *req;
     const char *password = NULL;
     const char *fa2;
     size_t password_len;
@@ -380,14 +398,16 @@ static void krb5_auth_store_creds(struct sss_domain_info *domain,
         return;
     }
 
-    ret = sysdb_cache_password_ex(domain, pd->user, password,
-                                  sss_authtok_get_type(pd->authtok), fa2_len);
-    if (ret) {
+    req = sysdb_cache_password_send(mem_ctx, ev, domain, pd->user, password,
+                                    sss_authtok_get_type(pd->authtok),
+                                    fa2_len);
+    if (req == NULL) {
         DEBUG(SSSDBG_OP_FAILURE,
-              "Failed to cache password, offline auth may not work."
-                  " (%d)[%s]!?\n", ret, strerror(ret));
+              "Failed to cache password, offline auth may not work.\n");
         /* password caching failures are not fatal errors */
+        return;
     }
+    tevent_req_set_callback(req, krb5_auth_store_creds_done, NULL);
 }
 
 static bool is_otp_enabled(struct ldb_message *user_msg)
@@ -640,6 +660,10 @@ struct tevent_req *krb5_auth_send(TALLOC_CTX *mem_ctx,
             DEBUG(SSSDBG_CRIT_FAILURE, "Cannot prepare ccache names!\n");
             goto done;
         }
+
+        kr->old_cc_known_valid = krb5_ccache_status_valid(krb5_ctx, pd->user,
+                                                          kr->old_ccname,
+                                                          kr->upn);
         break;
 
     default:
@@ -664,6 +688,25 @@ struct tevent_req *krb5_auth_send(TALLOC_CTX *mem_ctx,
     kr->srv = NULL;
     kr->kpasswd_srv = NULL;
 
+    /* There is no point in waiting for krb5_child to time out */
+    if ((pd->cmd == SSS_PAM_AUTHENTICATE || pd->cmd == SSS_PAM_PREAUTH)
+            && krb5_kdc_is_unreachable(state->krb5_ctx)
+            && !sss_krb5_realm_has_proxy(dp_opt_get_cstring(kr->krb5_ctx->opts,
+                                                            KRB5_REALM))) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "No KDC can be reached, proceeding offline\n");
+        kr->is_offline = true;
+
+        subreq = handle_child_send(state, state->ev, kr);
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "handle_child_send failed.\n");
+            ret = ENOMEM;
+            goto done;
+        }
+        tevent_req_set_callback(subreq, krb5_auth_done, req);
+        return req;
+    }
+
     state->search_kpasswd = false;
     subreq = be_resolve_server_send(state, state->ev, state->be_ctx,
                                     state->krb5_ctx->service->name,
@@ -722,6 +765,7 @@ static void krb5_auth_resolve_done(struct tevent_req *subreq)
              * the ccache file if we are performing auth */
             be_mark_dom_offline(state->domain, state->be_ctx);
             kr->is_offline = true;
+            krb5_kdc_set_unreachable(kr->krb5_ctx);
 
             if (kr->pd->cmd == SSS_PAM_CHAUTHTOK ||
                 kr->pd->cmd == SSS_PAM_CHAUTHTOK_PRELIM) {
@@ -787,6 +831,41 @@ done:
     }
 }
 
+/* Records how long krb5_child took with the KDC as its round trip time. Any
+ * answer counts, also a failed authentication, only network errors do not. */
+static void krb5_auth_record_kdc_time(struct krb5_auth_state *state)
+{
+    struct krb5child_req *kr = state->kr;
+    const char *name;
+    errno_t ret;
+
+    if (kr->srv == NULL || kr->is_offline) {
+        return;
+    }
+
+    /* a password change talks to the dedicated kpasswd server */
+    if (kr->kpasswd_srv != NULL &&
+        (kr->pd->cmd == SSS_PAM_CHAUTHTOK ||
+         kr->pd->cmd == SSS_PAM_CHAUTHTOK_PRELIM)) {
+        return;
+    }
+
+    name = fo_get_server_name(kr->srv);
+    if (name == NULL) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "KDC [%s] answered in %"PRIu32" us\n",
+          name, kr->child_usec);
+
+    ret = be_fo_record_server_rtt(state->be_ctx, name, kr->child_usec);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot record the response time of [%s] [%d]: %s\n",
+              name, ret, sss_strerror(ret));
+    }
+}
+
 static void krb5_auth_done(struct tevent_req *subreq)
 {
     struct tevent_req *req = tevent_req_callback_data(subreq, struct tevent_req);
@@ -911,6 +990,13 @@ static void krb5_auth_done(struct tevent_req *subreq)
         }
     }
 
+    if (res->msg_status != ERR_NETWORK_IO) {
+        krb5_auth_record_kdc_time(state);
+        if (!kr->is_offline) {
+            krb5_kdc_set_reachable(kr->krb5_ctx);
+        }
+    }
+
     /* If the child request failed, but did not return an offline error code,
      * return with the status */
     switch (res->msg_status) {
@@ -967,6 +1053,7 @@ static void krb5_auth_done(struct tevent_req *subreq)
         break;
 
     case ERR_CREDS_EXPIRED_CCACHE:
+        krb5_ccache_status_remove(kr->krb5_ctx, pd->user);
         ret = krb5_delete_ccname(state, state->sysdb, state->domain,
                 pd->user, kr->old_ccname);
         if (ret != EOK) {
@@ -981,6 +1068,7 @@ static void krb5_auth_done(struct tevent_req *subreq)
          * used. */
         if (pd->cmd == SSS_PAM_AUTHENTICATE && !kr->active_ccache) {
             if (kr->old_ccname != NULL) {
+                krb5_ccache_status_remove(kr->krb5_ctx, pd->user);
                 ret = krb5_delete_ccname(state, state->sysdb, state->domain,
                                          pd->user, kr->old_ccname);
                 if (ret != EOK) {
@@ -1048,6 +1136,10 @@ static void krb5_auth_done(struct tevent_req *subreq)
         /* found a KDC */
         be_fo_set_port_status(state->be_ctx, state->krb5_ctx->service->name,
                               kr->srv, PORT_WORKING);
+
+        /* the next requests go to a considerably faster KDC, if any */
+        be_fo_prefer_faster_server(state->be_ctx,
+                                   state->krb5_ctx->service->name);
     }
 
     /* Now only a successful authentication or password change is left.
@@ -1066,6 +1158,17 @@ static void krb5_auth_done(struct tevent_req *subreq)
         DEBUG(SSSDBG_CRIT_FAILURE, "krb5_save_ccname failed.\n");
         goto done;
     }
+
+    if (res->msg_status == ERR_OK && !kr->is_offline
+            && res->tgtt.endtime > 0
+            && (pd->cmd == SSS_PAM_AUTHENTICATE
+                || pd->cmd == SSS_CMD_RENEW
+                || pd->cmd == SSS_PAM_CHAUTHTOK)) {
+        krb5_ccache_status_set(kr->krb5_ctx, pd->user, kr->ccname, kr->upn,
+                               res->tgtt.endtime);
+    } else {
+        krb5_ccache_status_remove(kr->krb5_ctx, pd->user);
+    }
     renew_interval_str = dp_opt_get_string(kr->krb5_ctx->opts,
                          KRB5_RENEW_INTERVAL);
     if (renew_interval_str != NULL) {
@@ -1115,7 +1218,7 @@ static void krb5_auth_done(struct tevent_req *subreq)
             && (!res->otp
                 || (res->otp && sss_authtok_get_type(pd->authtok) ==
                                                        SSS_AUTHTOK_TYPE_2FA))) {
-        krb5_auth_store_creds(state->domain, pd);
+        krb5_auth_store_creds(state->be_ctx, state->ev, state->domain, pd);
     }
 
     /* The SSS_OTP message will prevent pam_sss from putting the entered
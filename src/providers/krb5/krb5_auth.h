@@ -53,10 +53,15 @@ struct krb5child_req {
     struct fo_server *kpasswd_srv;
     bool active_ccache;
     bool valid_tgt;
+    /* old_ccname held a valid TGT at the last successful request */
+    bool old_cc_known_valid;
     bool upn_from_different_realm;
     bool send_pac;
 
     const char *user;
+
+    /* how long krb5_child took to answer, in microseconds */
+    uint32_t child_usec;
 };
 
 errno_t krb5_setup(TALLOC_CTX *mem_ctx, struct pam_data *pd,
@@ -84,6 +89,11 @@ struct tevent_req *handle_child_send(TALLOC_CTX *mem_ctx,
 int handle_child_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
                       uint8_t **buf, ssize_t *len);
 
+/* Starts the krb5_child workers if krb5_child_pool_size is set, they serve
+ * the requests of handle_child_send() from then on */
+errno_t krb5_child_pool_setup(struct krb5_ctx *krb5_ctx,
+                              struct tevent_context *ev);
+
 struct krb5_child_response {
     int32_t msg_status;
     struct tgt_times tgtt;
@@ -129,4 +139,7 @@ int krb5_auth_queue_recv(struct tevent_req *req,
                          int *_pam_status,
                          int *_dp_err);
 
+void krb5_wait_queue_get_stats(struct krb5_ctx *krb5_ctx,
+                               struct krb5_wait_queue_stats *_stats);
+
 #endif /* __KRB5_AUTH_H__ */
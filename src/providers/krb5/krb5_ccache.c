@@ -446,7 +446,7 @@ done:
     return ret;
 }
 
-static errno_t sss_low_level_path_check(const char *ccname)
+errno_t sss_krb5_cc_check_path(const char *ccname)
 {
     const char *filename;
     struct stat buf;
@@ -488,7 +488,7 @@ errno_t sss_krb5_cc_verify_ccache(const char *ccname, uid_t uid, gid_t gid,
      * exists bail out immediately otherwise a following krb5_cc_resolve()
      * call may actually create paths and files we do not want to have
      * around */
-    ret = sss_low_level_path_check(ccname);
+    ret = sss_krb5_cc_check_path(ccname);
     if (ret) {
         return ret;
     }
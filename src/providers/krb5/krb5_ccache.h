@@ -43,6 +43,9 @@ errno_t sss_krb5_check_ccache_princ(krb5_context kctx,
                                     const char *ccname,
                                     krb5_principal user_princ);
 
+/* Only checks that a FILE or DIR ccache exists, other types always pass */
+errno_t sss_krb5_cc_check_path(const char *ccname);
+
 errno_t sss_krb5_cc_verify_ccache(const char *ccname, uid_t uid, gid_t gid,
                                   const char *realm, const char *principal);
 
@@ -76,6 +76,8 @@ struct krb5_req {
     char *old_ccname;
     bool old_cc_valid;
     bool old_cc_active;
+    /* the backend saw a valid TGT in old_ccname at the last request */
+    bool old_cc_known_valid;
     enum k5c_fast_opt fast_val;
 
     uid_t fast_uid;
@@ -1848,6 +1850,9 @@ static errno_t unpack_buffer(uint8_t *buf, size_t size,
             DEBUG(SSSDBG_TRACE_INTERNAL, "No old ccache\n");
         }
 
+        SAFEALIGN_COPY_UINT32_CHECK(&len, buf + p, size, &p);
+        kr->old_cc_known_valid = (len == 0) ? false : true;
+
         SAFEALIGN_COPY_UINT32_CHECK(&len, buf + p, size, &p);
         if (len > size - p) return EINVAL;
         kr->keytab = talloc_strndup(pd, (char *)(buf + p), len);
@@ -2286,9 +2291,15 @@ static errno_t old_ccache_valid(struct krb5_req *kr, bool *_valid)
 
     valid = false;
 
-    ret = sss_krb5_cc_verify_ccache(kr->old_ccname,
-                                    kr->uid, kr->gid,
-                                    kr->realm, kr->upn);
+    if (kr->old_cc_known_valid) {
+        /* the backend knows the TGT, only make sure the ccache was not
+         * removed in the meantime */
+        ret = sss_krb5_cc_check_path(kr->old_ccname);
+    } else {
+        ret = sss_krb5_cc_verify_ccache(kr->old_ccname,
+                                        kr->uid, kr->gid,
+                                        kr->realm, kr->upn);
+    }
     switch (ret) {
         case ERR_NOT_FOUND:
         case ENOENT:
@@ -2599,6 +2610,316 @@ static void try_open_krb5_conf(void)
     }
 }
 
+/* Runs one request and sends the reply to out_fd */
+static errno_t k5c_handle_request(struct krb5_req *kr, uint32_t offline,
+                                  int out_fd)
+{
+    krb5_error_code kerr;
+    errno_t ret;
+
+    kerr = privileged_krb5_setup(kr, offline);
+    if (kerr != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "privileged_krb5_setup failed.\n");
+        ret = EFAULT;
+        goto done;
+    }
+
+    kerr = become_user(kr->uid, kr->gid);
+    if (kerr != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "become_user failed.\n");
+        ret = EFAULT;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Running as [%"SPRIuid"][%"SPRIgid"].\n", geteuid(), getegid());
+    try_open_krb5_conf();
+
+    ret = k5c_setup(kr, offline);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "krb5_child_setup failed.\n");
+        goto done;
+    }
+
+    switch(kr->pd->cmd) {
+    case SSS_PAM_AUTHENTICATE:
+        /* If we are offline, we need to create an empty ccache file */
+        if (offline) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Will perform offline auth\n");
+            ret = create_empty_ccache(kr);
+        } else {
+            DEBUG(SSSDBG_TRACE_FUNC, "Will perform online auth\n");
+            ret = tgt_req_child(kr);
+        }
+        break;
+    case SSS_PAM_CHAUTHTOK:
+        DEBUG(SSSDBG_TRACE_FUNC, "Will perform password change\n");
+        ret = changepw_child(kr, false);
+        break;
+    case SSS_PAM_CHAUTHTOK_PRELIM:
+        DEBUG(SSSDBG_TRACE_FUNC, "Will perform password change checks\n");
+        ret = changepw_child(kr, true);
+        break;
+    case SSS_PAM_ACCT_MGMT:
+        DEBUG(SSSDBG_TRACE_FUNC, "Will perform account management\n");
+        ret = kuserok_child(kr);
+        break;
+    case SSS_CMD_RENEW:
+        if (offline) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Cannot renew TGT while offline\n");
+            ret = KRB5_KDC_UNREACH;
+            goto done;
+        }
+        DEBUG(SSSDBG_TRACE_FUNC, "Will perform ticket renewal\n");
+        ret = renew_tgt_child(kr);
+        break;
+    case SSS_PAM_PREAUTH:
+        DEBUG(SSSDBG_TRACE_FUNC, "Will perform pre-auth\n");
+        ret = tgt_req_child(kr);
+        break;
+    default:
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "PAM command [%d] not supported.\n", kr->pd->cmd);
+        ret = EINVAL;
+        goto done;
+    }
+
+    ret = k5c_send_data(kr, out_fd, ret);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to send reply\n");
+    }
+
+done:
+    return ret;
+}
+
+/* ==Worker-mode============================================================ */
+
+/* With --worker the back end keeps the child running and sends one request
+ * after the other, each preceded by its length. Handling a request switches
+ * to the uid of the user, so every request is run by a forked copy of the
+ * worker, which is still much cheaper than a fork and exec of the back end.
+ * The reply is passed back with its length, an empty reply means that the
+ * copy exited without sending one. */
+static errno_t k5c_worker_read_msg(int fd, uint8_t *buf, size_t size,
+                                   size_t *_len)
+{
+    uint8_t len_buf[sizeof(uint32_t)];
+    uint32_t len;
+    ssize_t ret;
+    size_t p = 0;
+
+    errno = 0;
+    ret = sss_atomic_read_s(fd, len_buf, sizeof(len_buf));
+    if (ret == -1) {
+        return errno;
+    } else if (ret == 0) {
+        return ENOENT;
+    } else if (ret != sizeof(len_buf)) {
+        return EINVAL;
+    }
+    SAFEALIGN_COPY_UINT32(&len, len_buf, &p);
+
+    if (len == 0 || len > size) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid message size %u.\n", len);
+        return EINVAL;
+    }
+
+    errno = 0;
+    ret = sss_atomic_read_s(fd, buf, len);
+    if (ret == -1) {
+        return errno;
+    } else if (ret != len) {
+        return EINVAL;
+    }
+
+    *_len = len;
+    return EOK;
+}
+
+static errno_t k5c_worker_write_msg(int fd, uint8_t *buf, size_t len)
+{
+    uint8_t len_buf[sizeof(uint32_t)];
+    ssize_t written;
+    size_t p = 0;
+
+    SAFEALIGN_SET_UINT32(len_buf, len, &p);
+
+    errno = 0;
+    written = sss_atomic_write_s(fd, len_buf, sizeof(len_buf));
+    if (written == -1) {
+        return errno;
+    } else if (written != sizeof(len_buf)) {
+        return EIO;
+    }
+
+    if (len == 0) {
+        return EOK;
+    }
+
+    errno = 0;
+    written = sss_atomic_write_s(fd, buf, len);
+    if (written == -1) {
+        return errno;
+    } else if (written != len) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Expected to write %zu bytes, wrote %zu\n",
+              len, written);
+        return EIO;
+    }
+
+    return EOK;
+}
+
+/* Runs in the forked copy of the worker */
+static errno_t k5c_worker_request(uid_t fast_uid, gid_t fast_gid,
+                                  uint8_t *buf, size_t len, int out_fd)
+{
+    struct krb5_req *kr;
+    const char *prg_name;
+    uint32_t offline;
+    errno_t ret;
+
+    prg_name = talloc_asprintf(NULL, "[sssd[krb5_child[%d]]]", getpid());
+    if (prg_name != NULL) {
+        debug_prg_name = prg_name;
+    }
+
+    kr = talloc_zero(NULL, struct krb5_req);
+    if (kr == NULL) {
+        return ENOMEM;
+    }
+    kr->fast_uid = fast_uid;
+    kr->fast_gid = fast_gid;
+
+    ret = unpack_buffer(buf, len, kr, &offline);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "unpack_buffer failed.\n");
+        goto done;
+    }
+
+    ret = k5c_handle_request(kr, offline, out_fd);
+
+done:
+    krb5_cleanup(kr);
+    talloc_free(kr);
+    return ret;
+}
+
+static errno_t k5c_worker_run(TALLOC_CTX *mem_ctx, struct krb5_req *worker,
+                              uint8_t *buf, size_t len,
+                              uint8_t **_reply, size_t *_reply_len)
+{
+    uint8_t chunk[CHILD_MSG_CHUNK];
+    uint8_t *reply = NULL;
+    size_t reply_len = 0;
+    int pipefd[2];
+    int status;
+    ssize_t size;
+    pid_t pid;
+    errno_t ret;
+
+    ret = pipe(pipefd);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "pipe failed [%d][%s].\n", ret, strerror(ret));
+        return ret;
+    }
+
+    pid = fork();
+    if (pid == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "fork failed [%d][%s].\n", ret, strerror(ret));
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return ret;
+    } else if (pid == 0) {
+        close(pipefd[0]);
+        close(STDIN_FILENO);
+        close(STDOUT_FILENO);
+
+        ret = k5c_worker_request(worker->fast_uid, worker->fast_gid,
+                                 buf, len, pipefd[1]);
+        _exit(ret == EOK ? 0 : -1);
+    }
+
+    close(pipefd[1]);
+
+    while (true) {
+        errno = 0;
+        size = sss_atomic_read_s(pipefd[0], chunk, sizeof(chunk));
+        if (size == -1) {
+            ret = errno;
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "read failed [%d][%s].\n", ret, strerror(ret));
+            break;
+        } else if (size == 0) {
+            ret = EOK;
+            break;
+        }
+
+        reply = talloc_realloc(mem_ctx, reply, uint8_t, reply_len + size);
+        if (reply == NULL) {
+            ret = ENOMEM;
+            break;
+        }
+        safealign_memcpy(&reply[reply_len], chunk, size, &reply_len);
+    }
+    close(pipefd[0]);
+
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+
+    if (ret != EOK) {
+        talloc_free(reply);
+        return ret;
+    }
+
+    *_reply = reply;
+    *_reply_len = reply_len;
+    return EOK;
+}
+
+static errno_t k5c_worker_serve(struct krb5_req *worker)
+{
+    uint8_t buf[IN_BUF_SIZE];
+    uint8_t *reply;
+    size_t reply_len;
+    size_t len;
+    errno_t ret;
+
+    while (true) {
+        ret = k5c_worker_read_msg(STDIN_FILENO, buf, sizeof(buf), &len);
+        if (ret == ENOENT) {
+            DEBUG(SSSDBG_TRACE_FUNC, "The back end closed the pipe.\n");
+            return EOK;
+        } else if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "read failed [%d][%s].\n", ret, strerror(ret));
+            return ret;
+        }
+
+        reply = NULL;
+        reply_len = 0;
+        ret = k5c_worker_run(worker, worker, buf, len, &reply, &reply_len);
+        /* the request carries the passwords, the next one must not find
+         * them on the stack */
+        safezero(buf, len);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Request failed [%d][%s].\n",
+                  ret, sss_strerror(ret));
+        }
+
+        ret = k5c_worker_write_msg(STDOUT_FILENO, reply, reply_len);
+        talloc_free(reply);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "write failed [%d][%s].\n", ret, strerror(ret));
+            return ret;
+        }
+    }
+}
+
 int main(int argc, const char *argv[])
 {
     struct krb5_req *kr = NULL;
@@ -2607,9 +2928,9 @@ int main(int argc, const char *argv[])
     poptContext pc;
     int debug_fd = -1;
     errno_t ret;
-    krb5_error_code kerr;
     uid_t fast_uid;
     gid_t fast_gid;
+    int worker = 0;
 
     struct poptOption long_options[] = {
         POPT_AUTOHELP
@@ -2628,6 +2949,8 @@ int main(int argc, const char *argv[])
           _("The user to create FAST ccache as"), NULL},
         {"fast-ccache-gid", 0, POPT_ARG_INT, &fast_gid, 0,
           _("The group to create FAST ccache as"), NULL},
+        {"worker", 0, POPT_ARG_NONE, &worker, 0,
+         _("Serve requests until the input is closed"), NULL},
         POPT_TABLEEND
     };
 
@@ -2677,84 +3000,29 @@ int main(int argc, const char *argv[])
     kr->fast_uid = fast_uid;
     kr->fast_gid = fast_gid;
 
-    ret = k5c_recv_data(kr, STDIN_FILENO, &offline);
-    if (ret != EOK) {
-        goto done;
-    }
-
-    close(STDIN_FILENO);
-
-    kerr = privileged_krb5_setup(kr, offline);
-    if (kerr != 0) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "privileged_krb5_setup failed.\n");
-        ret = EFAULT;
-        goto done;
-    }
+    if (worker) {
+        /* the back end kills the whole group when it gives up on the
+         * worker, including the copy which serves the request */
+        ret = setpgid(0, 0);
+        if (ret == -1) {
+            ret = errno;
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "setpgid failed [%d][%s].\n", ret, strerror(ret));
+            goto done;
+        }
 
-    kerr = become_user(kr->uid, kr->gid);
-    if (kerr != 0) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "become_user failed.\n");
-        ret = EFAULT;
+        ret = k5c_worker_serve(kr);
         goto done;
     }
 
-    DEBUG(SSSDBG_TRACE_INTERNAL,
-          "Running as [%"SPRIuid"][%"SPRIgid"].\n", geteuid(), getegid());
-    try_open_krb5_conf();
-
-    ret = k5c_setup(kr, offline);
+    ret = k5c_recv_data(kr, STDIN_FILENO, &offline);
     if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "krb5_child_setup failed.\n");
         goto done;
     }
 
-    switch(kr->pd->cmd) {
-    case SSS_PAM_AUTHENTICATE:
-        /* If we are offline, we need to create an empty ccache file */
-        if (offline) {
-            DEBUG(SSSDBG_TRACE_FUNC, "Will perform offline auth\n");
-            ret = create_empty_ccache(kr);
-        } else {
-            DEBUG(SSSDBG_TRACE_FUNC, "Will perform online auth\n");
-            ret = tgt_req_child(kr);
-        }
-        break;
-    case SSS_PAM_CHAUTHTOK:
-        DEBUG(SSSDBG_TRACE_FUNC, "Will perform password change\n");
-        ret = changepw_child(kr, false);
-        break;
-    case SSS_PAM_CHAUTHTOK_PRELIM:
-        DEBUG(SSSDBG_TRACE_FUNC, "Will perform password change checks\n");
-        ret = changepw_child(kr, true);
-        break;
-    case SSS_PAM_ACCT_MGMT:
-        DEBUG(SSSDBG_TRACE_FUNC, "Will perform account management\n");
-        ret = kuserok_child(kr);
-        break;
-    case SSS_CMD_RENEW:
-        if (offline) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "Cannot renew TGT while offline\n");
-            ret = KRB5_KDC_UNREACH;
-            goto done;
-        }
-        DEBUG(SSSDBG_TRACE_FUNC, "Will perform ticket renewal\n");
-        ret = renew_tgt_child(kr);
-        break;
-    case SSS_PAM_PREAUTH:
-        DEBUG(SSSDBG_TRACE_FUNC, "Will perform pre-auth\n");
-        ret = tgt_req_child(kr);
-        break;
-    default:
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "PAM command [%d] not supported.\n", kr->pd->cmd);
-        ret = EINVAL;
-        goto done;
-    }
+    close(STDIN_FILENO);
 
-    ret = k5c_send_data(kr, STDOUT_FILENO, ret);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to send reply\n");
-    }
+    ret = k5c_handle_request(kr, offline, STDOUT_FILENO);
 
 done:
     if (ret == EOK) {
@@ -36,7 +36,9 @@
 #define KRB5_CHILD_DIR SSSD_LIBEXEC_PATH
 #endif /* KRB5_CHILD_DIR */
 
+#ifndef KRB5_CHILD
 #define KRB5_CHILD KRB5_CHILD_DIR"/krb5_child"
+#endif /* KRB5_CHILD */
 
 #define TIME_T_MAX LONG_MAX
 #define int64_to_time_t(val) ((time_t)((val) < TIME_T_MAX ? val : TIME_T_MAX))
@@ -49,10 +51,19 @@ struct handle_child_state {
 
     struct tevent_timer *timeout_handler;
     pid_t child_pid;
+    struct timeval start;
 
     struct child_io_fds *io;
+
+    /* only used with the worker pool */
+    struct io_buffer *send_buf;
+    struct krb5_child_worker *worker;
+    struct krb5_child_wait *wait;
+    struct tevent_req *subreq;
 };
 
+static void krb5_child_worker_retire(struct krb5_child_worker *worker);
+
 static errno_t pack_authtok(struct io_buffer *buf, size_t *rp,
                             struct sss_auth_token *tok)
 {
@@ -149,7 +160,7 @@ static errno_t create_send_buffer(struct krb5child_req *kr,
         buf->size += 4*sizeof(uint32_t) + strlen(kr->ccname) + strlen(keytab) +
                      sss_authtok_get_size(kr->pd->authtok);
 
-        buf->size += sizeof(uint32_t);
+        buf->size += 2*sizeof(uint32_t);
         if (kr->old_ccname) {
             buf->size += strlen(kr->old_ccname);
         }
@@ -198,6 +209,8 @@ static errno_t create_send_buffer(struct krb5child_req *kr,
         } else {
             SAFEALIGN_SET_UINT32(&buf->data[rp], 0, &rp);
         }
+        SAFEALIGN_SET_UINT32(&buf->data[rp], kr->old_cc_known_valid ? 1 : 0,
+                             &rp);
 
         SAFEALIGN_SET_UINT32(&buf->data[rp], strlen(keytab), &rp);
         safealign_memcpy(&buf->data[rp], keytab, strlen(keytab), &rp);
@@ -244,10 +257,17 @@ static void krb5_child_timeout(struct tevent_context *ev,
            "is slow you may consider increasing value of krb5_auth_timeout.\n",
            state->child_pid);
 
-    ret = kill(state->child_pid, SIGKILL);
-    if (ret == -1) {
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "kill failed [%d][%s].\n", errno, strerror(errno));
+    state->timeout_handler = NULL;
+
+    if (state->worker != NULL) {
+        /* the worker is killed, a new one takes its place */
+        krb5_child_worker_retire(state->worker);
+    } else {
+        ret = kill(state->child_pid, SIGKILL);
+        if (ret == -1) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "kill failed [%d][%s].\n", errno, strerror(errno));
+        }
     }
 
     tevent_req_error(req, ETIMEDOUT);
@@ -273,20 +293,26 @@ static errno_t activate_child_timeout_handler(struct tevent_req *req,
     return EOK;
 }
 
-static errno_t fork_child(struct tevent_req *req)
+static errno_t krb5_fork_child(TALLOC_CTX *mem_ctx,
+                               struct tevent_context *ev,
+                               struct krb5_ctx *krb5_ctx,
+                               bool worker,
+                               struct child_io_fds *io,
+                               sss_child_callback_t cb, void *pvt,
+                               struct sss_child_ctx_old **_child_ctx,
+                               pid_t *_pid)
 {
     int pipefd_to_child[2];
     int pipefd_from_child[2];
     pid_t pid;
     int ret;
     errno_t err;
-    struct handle_child_state *state = tevent_req_data(req,
-                                                     struct handle_child_state);
-    const char *k5c_extra_args[3];
+    const char *k5c_extra_args[4];
 
-    k5c_extra_args[0] = talloc_asprintf(state, "--fast-ccache-uid=%"SPRIuid, getuid());
-    k5c_extra_args[1] = talloc_asprintf(state, "--fast-ccache-gid=%"SPRIgid, getgid());
-    k5c_extra_args[2] = NULL;
+    k5c_extra_args[0] = talloc_asprintf(mem_ctx, "--fast-ccache-uid=%"SPRIuid, getuid());
+    k5c_extra_args[1] = talloc_asprintf(mem_ctx, "--fast-ccache-gid=%"SPRIgid, getgid());
+    k5c_extra_args[2] = worker ? "--worker" : NULL;
+    k5c_extra_args[3] = NULL;
     if (k5c_extra_args[0] == NULL || k5c_extra_args[1] == NULL) {
         return ENOMEM;
     }
@@ -306,51 +332,474 @@ static errno_t fork_child(struct tevent_req *req)
         return err;
     }
 
-    pid = fork();
-
-    if (pid == 0) { /* child */
-        err = exec_child_ex(state,
-                            pipefd_to_child, pipefd_from_child,
-                            KRB5_CHILD, state->kr->krb5_ctx->child_debug_fd,
-                            k5c_extra_args, false, STDIN_FILENO, STDOUT_FILENO);
-        if (err != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "Could not exec KRB5 child: [%d][%s].\n",
-                      err, strerror(err));
-            return err;
-        }
-    } else if (pid > 0) { /* parent */
-        state->child_pid = pid;
-        state->io->read_from_child_fd = pipefd_from_child[0];
+    err = spawn_child(mem_ctx,
+                      pipefd_to_child, pipefd_from_child,
+                      KRB5_CHILD, krb5_ctx->child_debug_fd,
+                      k5c_extra_args, false, STDIN_FILENO, STDOUT_FILENO,
+                      &pid);
+    if (err != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not exec KRB5 child: [%d][%s].\n",
+                  err, strerror(err));
+        close(pipefd_from_child[0]);
         close(pipefd_from_child[1]);
-        state->io->write_to_child_fd = pipefd_to_child[1];
         close(pipefd_to_child[0]);
-        sss_fd_nonblocking(state->io->read_from_child_fd);
-        sss_fd_nonblocking(state->io->write_to_child_fd);
+        close(pipefd_to_child[1]);
+        return err;
+    }
 
-        ret = child_handler_setup(state->ev, pid, NULL, NULL, NULL);
+    *_pid = pid;
+    io->read_from_child_fd = pipefd_from_child[0];
+    close(pipefd_from_child[1]);
+    io->write_to_child_fd = pipefd_to_child[1];
+    close(pipefd_to_child[0]);
+    sss_fd_nonblocking(io->read_from_child_fd);
+    sss_fd_nonblocking(io->write_to_child_fd);
+
+    ret = child_handler_setup(ev, pid, cb, pvt, _child_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Could not set up child signal handler\n");
+        return ret;
+    }
+
+    return EOK;
+}
+
+static errno_t fork_child(struct tevent_req *req)
+{
+    struct handle_child_state *state = tevent_req_data(req,
+                                                     struct handle_child_state);
+    errno_t err;
+
+    err = krb5_fork_child(state, state->ev, state->kr->krb5_ctx, false,
+                          state->io, NULL, NULL, NULL, &state->child_pid);
+    if (err != EOK) {
+        return err;
+    }
+
+    err = activate_child_timeout_handler(req, state->ev,
+              dp_opt_get_int(state->kr->krb5_ctx->opts, KRB5_AUTH_TIMEOUT));
+    if (err != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "activate_child_timeout_handler failed.\n");
+    }
+
+    return EOK;
+}
+
+/* ==Worker-pool============================================================ */
+
+/* With krb5_child_pool_size set, up to that many krb5_child processes are
+ * started with --worker and kept running, each of them serves one request
+ * after the other. A request which arrives while all of them are busy
+ * waits in line. A worker which fails, exits or times out is replaced by a
+ * new one when it is needed. */
+
+/* anything larger means the pipe is out of sync */
+#define KRB5_CHILD_MAX_MSG_SIZE (1024 * 1024)
+
+struct krb5_child_worker {
+    struct krb5_child_worker *prev;
+    struct krb5_child_worker *next;
+
+    struct krb5_child_pool *pool;
+    pid_t pid;
+    struct child_io_fds *io;
+    struct sss_child_ctx_old *child_ctx;
+
+    /* the request being served */
+    struct tevent_req *active;
+};
+
+/* the requests waiting until a worker is free */
+struct krb5_child_wait {
+    struct krb5_child_wait *prev;
+    struct krb5_child_wait *next;
+
+    struct krb5_child_pool *pool;
+    struct tevent_req *req;
+};
+
+struct krb5_child_pool {
+    struct tevent_context *ev;
+    struct krb5_ctx *krb5_ctx;
+    int size;
+    int count;
+
+    struct krb5_child_worker *idle;
+    struct krb5_child_worker *busy;
+    struct krb5_child_wait *waiting;
+};
+
+static void krb5_child_worker_exited(int child_status,
+                                     struct tevent_signal *sige,
+                                     void *pvt);
+
+static int krb5_child_worker_destructor(struct krb5_child_worker *worker)
+{
+    if (worker->active != NULL) {
+        DLIST_REMOVE(worker->pool->busy, worker);
+    } else {
+        DLIST_REMOVE(worker->pool->idle, worker);
+    }
+    worker->pool->count--;
+
+    /* The worker leads its own process group. The copy it forked for the
+     * request would keep talking to the KDC after the worker is gone. */
+    if (worker->active != NULL) {
+        if (kill(-worker->pid, SIGKILL) == -1 && errno != ESRCH) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "kill failed [%d][%s].\n",
+                  errno, strerror(errno));
+        }
+    }
+
+    /* kills the worker, the handler still waits for it */
+    if (worker->child_ctx != NULL) {
+        child_handler_destroy(worker->child_ctx);
+    }
+
+    return 0;
+}
+
+static errno_t krb5_child_worker_create(struct krb5_child_pool *pool,
+                                        struct krb5_child_worker **_worker)
+{
+    struct krb5_child_worker *worker;
+    errno_t ret;
+
+    worker = talloc_zero(pool, struct krb5_child_worker);
+    if (worker == NULL) {
+        return ENOMEM;
+    }
+    worker->pool = pool;
+
+    worker->io = talloc(worker, struct child_io_fds);
+    if (worker->io == NULL) {
+        talloc_free(worker);
+        return ENOMEM;
+    }
+    worker->io->write_to_child_fd = -1;
+    worker->io->read_from_child_fd = -1;
+    talloc_set_destructor((void *) worker->io, child_io_destructor);
+
+    ret = krb5_fork_child(worker, pool->ev, pool->krb5_ctx, true, worker->io,
+                          krb5_child_worker_exited, worker,
+                          &worker->child_ctx, &worker->pid);
+    if (ret != EOK) {
+        talloc_free(worker);
+        return ret;
+    }
+
+    DLIST_ADD(pool->idle, worker);
+    pool->count++;
+    talloc_set_destructor(worker, krb5_child_worker_destructor);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Started krb5_child worker [%d], %d of %d\n",
+          worker->pid, pool->count, pool->size);
+
+    *_worker = worker;
+    return EOK;
+}
+
+static errno_t handle_child_pool_dispatch(struct tevent_req *req);
+
+/* Starts the first waiting requests while a worker is available */
+static void krb5_child_pool_next(struct krb5_child_pool *pool)
+{
+    struct handle_child_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    while (pool->waiting != NULL
+            && (pool->idle != NULL || pool->count < pool->size)) {
+        req = pool->waiting->req;
+        state = tevent_req_data(req, struct handle_child_state);
+        talloc_zfree(state->wait);
+
+        ret = handle_child_pool_dispatch(req);
         if (ret != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE,
-                  "Could not set up child signal handler\n");
-            return ret;
+            tevent_req_error(req, ret);
         }
+    }
+}
 
-        err = activate_child_timeout_handler(req, state->ev,
-                  dp_opt_get_int(state->kr->krb5_ctx->opts, KRB5_AUTH_TIMEOUT));
-        if (err != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE,
-                  "activate_child_timeout_handler failed.\n");
+/* Stops the worker without starting the waiting requests */
+static void krb5_child_worker_free(struct krb5_child_worker *worker)
+{
+    struct handle_child_state *state;
+
+    /* the pipes are closed below */
+    if (worker->active != NULL) {
+        state = tevent_req_data(worker->active, struct handle_child_state);
+        talloc_zfree(state->subreq);
+        state->worker = NULL;
+    }
+
+    talloc_free(worker);
+}
+
+static void krb5_child_worker_retire(struct krb5_child_worker *worker)
+{
+    struct krb5_child_pool *pool = worker->pool;
+
+    krb5_child_worker_free(worker);
+    krb5_child_pool_next(pool);
+}
+
+static void krb5_child_worker_release(struct krb5_child_worker *worker)
+{
+    struct krb5_child_pool *pool = worker->pool;
+    struct handle_child_state *state;
+
+    state = tevent_req_data(worker->active, struct handle_child_state);
+    state->worker = NULL;
+
+    DLIST_REMOVE(pool->busy, worker);
+    worker->active = NULL;
+    DLIST_ADD(pool->idle, worker);
+
+    krb5_child_pool_next(pool);
+}
+
+static void krb5_child_worker_exited(int child_status,
+                                     struct tevent_signal *sige,
+                                     void *pvt)
+{
+    struct krb5_child_worker *worker = talloc_get_type(pvt,
+                                                    struct krb5_child_worker);
+    struct tevent_req *active = worker->active;
+    struct handle_child_state *state;
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "krb5_child worker [%d] exited with status [%d]\n",
+          worker->pid, child_status);
+
+    /* the handler frees its context after this call */
+    worker->child_ctx = NULL;
+
+    if (active != NULL) {
+        state = tevent_req_data(active, struct handle_child_state);
+        talloc_zfree(state->timeout_handler);
+    }
+
+    krb5_child_worker_retire(worker);
+
+    if (active != NULL) {
+        tevent_req_error(active, EPIPE);
+    }
+}
+
+errno_t krb5_child_pool_setup(struct krb5_ctx *krb5_ctx,
+                              struct tevent_context *ev)
+{
+    struct krb5_child_pool *pool;
+    struct krb5_child_worker *worker;
+    int size;
+    int i;
+    errno_t ret;
+
+    size = dp_opt_get_int(krb5_ctx->opts, KRB5_CHILD_POOL_SIZE);
+    if (size <= 0) {
+        return EOK;
+    }
+
+    pool = talloc_zero(krb5_ctx, struct krb5_child_pool);
+    if (pool == NULL) {
+        return ENOMEM;
+    }
+    pool->ev = ev;
+    pool->krb5_ctx = krb5_ctx;
+    pool->size = size;
+
+    /* the workers which cannot be started now are started on demand */
+    for (i = 0; i < size; i++) {
+        ret = krb5_child_worker_create(pool, &worker);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Cannot start krb5_child worker [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            break;
         }
+    }
 
-    } else { /* error */
-        err = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "fork failed [%d][%s].\n", errno, strerror(errno));
-        return err;
+    krb5_ctx->child_pool = pool;
+    return EOK;
+}
+
+/* ==Requests-served-by-the-pool============================================ */
+
+static int handle_child_state_destructor(struct handle_child_state *state)
+{
+    /* the request was freed in the middle of the exchange */
+    if (state->worker != NULL) {
+        krb5_child_worker_retire(state->worker);
+    }
+
+    return 0;
+}
+
+static int krb5_child_wait_destructor(struct krb5_child_wait *wait)
+{
+    DLIST_REMOVE(wait->pool->waiting, wait);
+    return 0;
+}
+
+static void handle_child_pool_step(struct tevent_req *subreq);
+static void handle_child_pool_done(struct tevent_req *subreq);
+
+static void handle_child_set_time(struct handle_child_state *state)
+{
+    struct timeval now;
+    struct timeval diff;
+    uint64_t usec;
+
+    now = tevent_timeval_current();
+    diff = tevent_timeval_until(&state->start, &now);
+    usec = (uint64_t) diff.tv_sec * 1000000 + diff.tv_usec;
+
+    state->kr->child_usec = MIN(usec, UINT32_MAX);
+}
+
+static errno_t handle_child_pool_start(struct tevent_req *req,
+                                       struct krb5_child_worker *worker)
+{
+    struct handle_child_state *state = tevent_req_data(req,
+                                                    struct handle_child_state);
+    struct krb5_child_pool *pool = worker->pool;
+    errno_t ret;
+
+    DLIST_REMOVE(pool->idle, worker);
+    worker->active = req;
+    DLIST_ADD(pool->busy, worker);
+
+    /* the time spent waiting for a worker is not the time of the KDC */
+    state->start = tevent_timeval_current();
+
+    state->worker = worker;
+    state->child_pid = worker->pid;
+    talloc_set_destructor(state, handle_child_state_destructor);
+
+    ret = activate_child_timeout_handler(req, state->ev,
+                  dp_opt_get_int(state->kr->krb5_ctx->opts, KRB5_AUTH_TIMEOUT));
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "activate_child_timeout_handler failed.\n");
+        return ret;
     }
 
+    state->subreq = write_pipe_send(state, state->ev,
+                                    state->send_buf->data,
+                                    state->send_buf->size,
+                                    worker->io->write_to_child_fd);
+    if (state->subreq == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(state->subreq, handle_child_pool_step, req);
+
     return EOK;
 }
 
+static errno_t handle_child_pool_dispatch(struct tevent_req *req)
+{
+    struct handle_child_state *state = tevent_req_data(req,
+                                                    struct handle_child_state);
+    struct krb5_child_pool *pool = state->kr->krb5_ctx->child_pool;
+    struct krb5_child_worker *worker;
+    struct krb5_child_wait *wait;
+    errno_t ret;
+
+    worker = pool->idle;
+    if (worker == NULL && pool->count < pool->size) {
+        ret = krb5_child_worker_create(pool, &worker);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "krb5_child_worker_create failed.\n");
+            return ret;
+        }
+    }
+
+    if (worker == NULL) {
+        wait = talloc_zero(state, struct krb5_child_wait);
+        if (wait == NULL) {
+            return ENOMEM;
+        }
+        wait->pool = pool;
+        wait->req = req;
+
+        DLIST_ADD_END(pool->waiting, wait, struct krb5_child_wait *);
+        talloc_set_destructor(wait, krb5_child_wait_destructor);
+        state->wait = wait;
+
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "All %d krb5_child workers are busy, waiting\n", pool->count);
+        return EOK;
+    }
+
+    return handle_child_pool_start(req, worker);
+}
+
+static void handle_child_pool_fail(struct tevent_req *req, errno_t ret)
+{
+    struct handle_child_state *state = tevent_req_data(req,
+                                                    struct handle_child_state);
+
+    talloc_zfree(state->timeout_handler);
+
+    /* the pipe might be out of sync, a new worker takes over */
+    if (state->worker != NULL) {
+        krb5_child_worker_retire(state->worker);
+    }
+
+    tevent_req_error(req, ret);
+}
+
+static void handle_child_pool_step(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct handle_child_state *state = tevent_req_data(req,
+                                                    struct handle_child_state);
+    int ret;
+
+    ret = write_pipe_recv(subreq);
+    talloc_zfree(subreq);
+    state->subreq = NULL;
+    if (ret != EOK) {
+        handle_child_pool_fail(req, ret);
+        return;
+    }
+
+    state->subreq = read_pipe_msg_send(state, state->ev,
+                                   state->worker->io->read_from_child_fd,
+                                   KRB5_CHILD_MAX_MSG_SIZE);
+    if (state->subreq == NULL) {
+        handle_child_pool_fail(req, ENOMEM);
+        return;
+    }
+    tevent_req_set_callback(state->subreq, handle_child_pool_done, req);
+}
+
+static void handle_child_pool_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct handle_child_state *state = tevent_req_data(req,
+                                                    struct handle_child_state);
+    int ret;
+
+    ret = read_pipe_msg_recv(subreq, state, &state->buf, &state->len);
+    talloc_zfree(subreq);
+    state->subreq = NULL;
+    if (ret != EOK) {
+        handle_child_pool_fail(req, ret);
+        return;
+    }
+
+    talloc_zfree(state->timeout_handler);
+    krb5_child_worker_release(state->worker);
+
+    handle_child_set_time(state);
+    tevent_req_done(req);
+}
+
 static void handle_child_step(struct tevent_req *subreq);
 static void handle_child_done(struct tevent_req *subreq);
 
@@ -362,6 +811,7 @@ struct tevent_req *handle_child_send(TALLOC_CTX *mem_ctx,
     struct handle_child_state *state;
     int ret;
     struct io_buffer *buf = NULL;
+    size_t rp;
 
     req = tevent_req_create(mem_ctx, &state, struct handle_child_state);
     if (req == NULL) {
@@ -391,6 +841,35 @@ struct tevent_req *handle_child_send(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    if (kr->krb5_ctx->child_pool != NULL) {
+        /* the worker needs the length of each request */
+        state->send_buf = talloc(state, struct io_buffer);
+        if (state->send_buf == NULL) {
+            ret = ENOMEM;
+            goto fail;
+        }
+        state->send_buf->size = sizeof(uint32_t) + buf->size;
+        state->send_buf->data = talloc_size(state->send_buf,
+                                            state->send_buf->size);
+        if (state->send_buf->data == NULL) {
+            ret = ENOMEM;
+            goto fail;
+        }
+        rp = 0;
+        SAFEALIGN_SET_UINT32(&state->send_buf->data[rp], buf->size, &rp);
+        safealign_memcpy(&state->send_buf->data[rp], buf->data, buf->size,
+                         &rp);
+
+        ret = handle_child_pool_dispatch(req);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "handle_child_pool_dispatch failed.\n");
+            goto fail;
+        }
+
+        return req;
+    }
+
+    state->start = tevent_timeval_current();
     ret = fork_child(req);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "fork_child failed.\n");
@@ -459,6 +938,7 @@ static void handle_child_done(struct tevent_req *subreq)
     close(state->io->read_from_child_fd);
     state->io->read_from_child_fd = -1;
 
+    handle_child_set_time(state);
     tevent_req_done(req);
     return;
 }
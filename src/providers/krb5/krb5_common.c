@@ -1093,3 +1093,336 @@ errno_t compare_principal_realm(const char *upn, const char *realm,
 
     return EOK;
 }
+
+#define KRB5_KDC_PROBE_MIN_INTERVAL 30
+#define KRB5_KDC_PROBE_MAX_INTERVAL 300
+#define KRB5_KDC_PROBE_TIMEOUT 5
+#define KRB5_KDC_DEFAULT_PORT 88
+
+struct krb5_kdc_state {
+    struct krb5_ctx *krb5_ctx;
+    struct be_ctx *be_ctx;
+
+    bool unreachable;
+    int interval;
+    struct tevent_timer *te;
+    /* parent of the running probe and the server it uses */
+    TALLOC_CTX *probe_ctx;
+    struct fo_server *srv;
+};
+
+static void krb5_kdc_probe(struct tevent_context *ev,
+                           struct tevent_timer *te,
+                           struct timeval tv, void *pvt);
+static void krb5_kdc_probe_resolved(struct tevent_req *subreq);
+static void krb5_kdc_probe_done(struct tevent_req *subreq);
+
+static void krb5_kdc_probe_schedule(struct krb5_kdc_state *kdc, int delay)
+{
+    talloc_zfree(kdc->te);
+    talloc_zfree(kdc->probe_ctx);
+    kdc->srv = NULL;
+
+    kdc->te = tevent_add_timer(kdc->be_ctx->ev, kdc,
+                               tevent_timeval_current_ofs(delay, 0),
+                               krb5_kdc_probe, kdc);
+    if (kdc->te == NULL) {
+        /* the next request reaching a KDC clears the state */
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot schedule the KDC probe.\n");
+    }
+}
+
+static void krb5_kdc_probe_failed(struct krb5_kdc_state *kdc)
+{
+    kdc->interval = MIN(kdc->interval * 2, KRB5_KDC_PROBE_MAX_INTERVAL);
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "KDC still unreachable, probing again in %d seconds\n",
+          kdc->interval);
+    krb5_kdc_probe_schedule(kdc, kdc->interval);
+}
+
+static void krb5_kdc_probe(struct tevent_context *ev,
+                           struct tevent_timer *te,
+                           struct timeval tv, void *pvt)
+{
+    struct krb5_kdc_state *kdc = talloc_get_type(pvt, struct krb5_kdc_state);
+    struct tevent_req *subreq;
+
+    kdc->te = NULL;
+    if (!kdc->unreachable) {
+        return;
+    }
+
+    talloc_zfree(kdc->probe_ctx);
+    kdc->probe_ctx = talloc_new(kdc);
+    if (kdc->probe_ctx == NULL) {
+        krb5_kdc_probe_failed(kdc);
+        return;
+    }
+
+    subreq = be_resolve_server_send(kdc->probe_ctx, ev, kdc->be_ctx,
+                                    kdc->krb5_ctx->service->name, true);
+    if (subreq == NULL) {
+        krb5_kdc_probe_failed(kdc);
+        return;
+    }
+    tevent_req_set_callback(subreq, krb5_kdc_probe_resolved, kdc);
+}
+
+static void krb5_kdc_probe_resolved(struct tevent_req *subreq)
+{
+    struct krb5_kdc_state *kdc = tevent_req_callback_data(subreq,
+                                                        struct krb5_kdc_state);
+    struct sockaddr_storage *addr;
+    struct fo_server *srv;
+    int port;
+    errno_t ret;
+
+    ret = be_resolve_server_recv(subreq, kdc->probe_ctx, &srv);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        krb5_kdc_probe_failed(kdc);
+        return;
+    }
+    kdc->srv = srv;
+
+    port = fo_get_server_port(srv);
+    addr = resolv_get_sockaddr_address(kdc->probe_ctx,
+                                       fo_get_server_hostent(srv),
+                                       port != 0 ? port
+                                                 : KRB5_KDC_DEFAULT_PORT);
+    if (addr == NULL) {
+        krb5_kdc_probe_failed(kdc);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Probing KDC [%s]\n", fo_get_server_name(srv));
+
+    subreq = be_fo_connect_send(kdc->probe_ctx, kdc->be_ctx->ev, addr,
+                                KRB5_KDC_PROBE_TIMEOUT);
+    if (subreq == NULL) {
+        krb5_kdc_probe_failed(kdc);
+        return;
+    }
+    tevent_req_set_callback(subreq, krb5_kdc_probe_done, kdc);
+}
+
+static void krb5_kdc_probe_done(struct tevent_req *subreq)
+{
+    struct krb5_kdc_state *kdc = tevent_req_callback_data(subreq,
+                                                        struct krb5_kdc_state);
+    struct fo_server *srv = kdc->srv;
+    errno_t ret;
+
+    ret = be_fo_connect_recv(subreq);
+    talloc_zfree(subreq);
+
+    /* a refused connection still means that the KDC host answers, it may
+     * only serve UDP */
+    if (ret != EOK && ret != ECONNREFUSED) {
+        DEBUG(SSSDBG_TRACE_FUNC, "KDC probe failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        be_fo_set_port_status(kdc->be_ctx, kdc->krb5_ctx->service->name,
+                              srv, PORT_NOT_WORKING);
+        krb5_kdc_probe_failed(kdc);
+        return;
+    }
+
+    be_fo_set_port_status(kdc->be_ctx, kdc->krb5_ctx->service->name,
+                          srv, PORT_WORKING);
+    krb5_kdc_set_reachable(kdc->krb5_ctx);
+}
+
+static void krb5_kdc_online_callback(void *pvt)
+{
+    struct krb5_kdc_state *kdc = talloc_get_type(pvt, struct krb5_kdc_state);
+
+    /* the backend reached its servers again, check the KDCs now instead of
+     * waiting for the next probe */
+    if (kdc->unreachable && kdc->probe_ctx == NULL) {
+        kdc->interval = KRB5_KDC_PROBE_MIN_INTERVAL;
+        krb5_kdc_probe_schedule(kdc, 0);
+    }
+}
+
+errno_t krb5_kdc_state_setup(struct be_ctx *be_ctx,
+                             struct krb5_ctx *krb5_ctx)
+{
+    struct krb5_kdc_state *kdc;
+    errno_t ret;
+
+    if (krb5_ctx->service == NULL || krb5_ctx->service->name == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Missing KDC service name!\n");
+        return EINVAL;
+    }
+
+    kdc = talloc_zero(krb5_ctx, struct krb5_kdc_state);
+    if (kdc == NULL) {
+        return ENOMEM;
+    }
+
+    kdc->krb5_ctx = krb5_ctx;
+    kdc->be_ctx = be_ctx;
+    kdc->interval = KRB5_KDC_PROBE_MIN_INTERVAL;
+
+    ret = be_add_online_cb(kdc, be_ctx, krb5_kdc_online_callback, kdc, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "be_add_online_cb failed.\n");
+        talloc_free(kdc);
+        return ret;
+    }
+
+    krb5_ctx->kdc_state = kdc;
+    return EOK;
+}
+
+void krb5_kdc_set_unreachable(struct krb5_ctx *krb5_ctx)
+{
+    struct krb5_kdc_state *kdc = krb5_ctx->kdc_state;
+
+    if (kdc == NULL || kdc->unreachable) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "No KDC can be reached, "
+          "authenticating offline until a KDC answers again\n");
+    kdc->unreachable = true;
+    kdc->interval = KRB5_KDC_PROBE_MIN_INTERVAL;
+    krb5_kdc_probe_schedule(kdc, kdc->interval);
+}
+
+void krb5_kdc_set_reachable(struct krb5_ctx *krb5_ctx)
+{
+    struct krb5_kdc_state *kdc = krb5_ctx->kdc_state;
+
+    if (kdc == NULL || !kdc->unreachable) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "A KDC can be reached again\n");
+    kdc->unreachable = false;
+    talloc_zfree(kdc->te);
+    talloc_zfree(kdc->probe_ctx);
+    kdc->srv = NULL;
+}
+
+bool krb5_kdc_is_unreachable(struct krb5_ctx *krb5_ctx)
+{
+    return krb5_ctx->kdc_state != NULL && krb5_ctx->kdc_state->unreachable;
+}
+
+struct krb5_ccache_status {
+    char *ccname;
+    char *upn;
+    time_t endtime;
+};
+
+static void krb5_ccache_status_del_cb(hash_entry_t *entry,
+                                      hash_destroy_enum type,
+                                      void *pvt)
+{
+    if (entry->value.type == HASH_VALUE_PTR) {
+        talloc_free(entry->value.ptr);
+    }
+}
+
+void krb5_ccache_status_set(struct krb5_ctx *krb5_ctx, const char *user,
+                            const char *ccname, const char *upn,
+                            time_t endtime)
+{
+    struct krb5_ccache_status *status;
+    hash_key_t key;
+    hash_value_t value;
+    errno_t ret;
+    int hret;
+
+    if (krb5_ctx->ccache_status_table == NULL) {
+        ret = sss_hash_create_ex(krb5_ctx, 0,
+                                 &krb5_ctx->ccache_status_table, 0, 0, 0, 0,
+                                 krb5_ccache_status_del_cb, NULL);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "sss_hash_create_ex failed.\n");
+            return;
+        }
+    }
+
+    status = talloc_zero(krb5_ctx->ccache_status_table,
+                         struct krb5_ccache_status);
+    if (status == NULL) {
+        krb5_ccache_status_remove(krb5_ctx, user);
+        return;
+    }
+
+    status->ccname = talloc_strdup(status, ccname);
+    status->upn = talloc_strdup(status, upn);
+    status->endtime = endtime;
+    if (status->ccname == NULL || status->upn == NULL) {
+        talloc_free(status);
+        krb5_ccache_status_remove(krb5_ctx, user);
+        return;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(user);
+    value.type = HASH_VALUE_PTR;
+    value.ptr = status;
+
+    /* an old entry is freed by the delete callback */
+    hret = hash_enter(krb5_ctx->ccache_status_table, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "hash_enter failed [%s].\n",
+              hash_error_string(hret));
+        talloc_free(status);
+        krb5_ccache_status_remove(krb5_ctx, user);
+    }
+}
+
+bool krb5_ccache_status_valid(struct krb5_ctx *krb5_ctx, const char *user,
+                              const char *ccname, const char *upn)
+{
+    struct krb5_ccache_status *status;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    if (krb5_ctx->ccache_status_table == NULL || ccname == NULL
+            || upn == NULL) {
+        return false;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(user);
+
+    hret = hash_lookup(krb5_ctx->ccache_status_table, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        return false;
+    }
+
+    status = talloc_get_type(value.ptr, struct krb5_ccache_status);
+    if (status->endtime <= time(NULL)) {
+        krb5_ccache_status_remove(krb5_ctx, user);
+        return false;
+    }
+
+    return strcmp(status->ccname, ccname) == 0
+                && strcmp(status->upn, upn) == 0;
+}
+
+void krb5_ccache_status_remove(struct krb5_ctx *krb5_ctx, const char *user)
+{
+    hash_key_t key;
+    int hret;
+
+    if (krb5_ctx->ccache_status_table == NULL || user == NULL) {
+        return;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(user);
+
+    hret = hash_delete(krb5_ctx->ccache_status_table, &key);
+    if (hret != HASH_SUCCESS && hret != HASH_ERROR_KEY_NOT_FOUND) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "hash_delete failed [%s].\n",
+              hash_error_string(hret));
+    }
+}
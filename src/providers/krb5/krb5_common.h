@@ -68,6 +68,7 @@ enum krb5_opts {
     KRB5_USE_ENTERPRISE_PRINCIPAL,
     KRB5_USE_KDCINFO,
     KRB5_MAP_USER,
+    KRB5_CHILD_POOL_SIZE,
 
     KRB5_OPTS
 };
@@ -83,6 +84,7 @@ struct krb5_service {
 struct fo_service;
 struct deferred_auth_ctx;
 struct renew_tgt_ctx;
+struct krb5_child_pool;
 
 enum krb5_config_type {
     K5C_GENERIC,
@@ -90,6 +92,19 @@ enum krb5_config_type {
     K5C_IPA_SERVER
 };
 
+/* Counters of the per-user wait queue of the authentication requests */
+struct krb5_wait_queue_stats {
+    /* requests which started right away */
+    uint64_t immediate;
+    /* requests which waited for an earlier one */
+    uint64_t queued;
+    uint64_t total_wait_usec;
+    uint64_t max_wait_usec;
+    /* requests waiting now and the most waiting at the same time */
+    uint64_t waiting;
+    uint64_t max_waiting;
+};
+
 struct map_id_name_to_krb_primary {
     const char *id_name;
     const char* krb_primary;
@@ -132,10 +147,20 @@ struct krb5_ctx {
     bool use_fast;
 
     hash_table_t *wait_queue_hash;
+    struct krb5_wait_queue_stats wait_queue_stats;
 
     enum krb5_config_type config_type;
 
     struct map_id_name_to_krb_primary *name_to_primary;
+
+    /* the running krb5_child workers, NULL without krb5_child_pool_size */
+    struct krb5_child_pool *child_pool;
+
+    /* whether the KDCs are known to be unreachable */
+    struct krb5_kdc_state *kdc_state;
+
+    /* ccache and TGT end time of the last successful request per user */
+    hash_table_t *ccache_status_table;
 };
 
 struct remove_info_files_ctx {
@@ -181,6 +206,24 @@ errno_t krb5_install_offline_callback(struct be_ctx *be_ctx,
 errno_t krb5_install_sigterm_handler(struct tevent_context *ev,
                                      struct krb5_ctx *krb5_ctx);
 
+/* Once no KDC could be reached the KDCs are probed in the background until
+ * one answers again. Until then authentication requests are handled offline
+ * right away instead of waiting for krb5_child to time out. */
+errno_t krb5_kdc_state_setup(struct be_ctx *be_ctx,
+                             struct krb5_ctx *krb5_ctx);
+void krb5_kdc_set_unreachable(struct krb5_ctx *krb5_ctx);
+void krb5_kdc_set_reachable(struct krb5_ctx *krb5_ctx);
+bool krb5_kdc_is_unreachable(struct krb5_ctx *krb5_ctx);
+
+/* Remembers that ccname holds a TGT of upn until endtime, so krb5_child
+ * does not have to open the ccache to tell that it is still there. */
+void krb5_ccache_status_set(struct krb5_ctx *krb5_ctx, const char *user,
+                            const char *ccname, const char *upn,
+                            time_t endtime);
+bool krb5_ccache_status_valid(struct krb5_ctx *krb5_ctx, const char *user,
+                              const char *ccname, const char *upn);
+void krb5_ccache_status_remove(struct krb5_ctx *krb5_ctx, const char *user);
+
 errno_t remove_krb5_info_files(TALLOC_CTX *mem_ctx, const char *realm);
 
 errno_t krb5_get_simple_upn(TALLOC_CTX *mem_ctx, struct krb5_ctx *krb5_ctx,
@@ -30,7 +30,16 @@
 #include "providers/krb5/krb5_ccache.h"
 
 #define INITIAL_TGT_TABLE_SIZE 10
+#define INITIAL_HEAP_SIZE 16
+#define RENEW_NOT_QUEUED ((size_t) -1)
 
+/* Renewals which may run at the same time, the others wait in the heap */
+#define RENEW_MAX_RUNNING 10
+
+/* The tickets waiting for renewal are kept in a min-heap ordered by the time
+ * of the renewal, a single timer fires for the first one. Each ticket is
+ * renewed up to timer_interval later than half of its lifetime so that
+ * tickets acquired together are not renewed together. */
 struct renew_tgt_ctx {
     hash_table_t *tgt_table;
     struct be_ctx *be_ctx;
@@ -38,53 +47,250 @@ struct renew_tgt_ctx {
     struct krb5_ctx *krb5_ctx;
     time_t timer_interval;
     struct tevent_timer *te;
+    unsigned int jitter_seed;
+
+    struct renew_data **heap;
+    size_t heap_count;
+    size_t heap_size;
+    size_t running;
 };
 
 struct renew_data {
+    const char *upn;
     const char *ccfile;
     time_t start_time;
     time_t lifetime;
     time_t start_renew_at;
     struct pam_data *pd;
+
+    struct renew_tgt_ctx *renew_tgt_ctx;
+    time_t renew_at;
+    size_t heap_idx;
+    /* set while a renewal of this ticket is running */
+    struct auth_data *auth_data;
 };
 
 struct auth_data {
     struct be_ctx *be_ctx;
     struct krb5_ctx *krb5_ctx;
+    struct renew_tgt_ctx *renew_tgt_ctx;
     struct pam_data *pd;
     struct renew_data *renew_data;
     hash_table_t *table;
     hash_key_t key;
 };
 
+static void renew_heap_swap(struct renew_tgt_ctx *ctx, size_t a, size_t b)
+{
+    struct renew_data *tmp;
+
+    tmp = ctx->heap[a];
+    ctx->heap[a] = ctx->heap[b];
+    ctx->heap[b] = tmp;
+
+    ctx->heap[a]->heap_idx = a;
+    ctx->heap[b]->heap_idx = b;
+}
+
+static void renew_heap_up(struct renew_tgt_ctx *ctx, size_t idx)
+{
+    size_t parent;
+
+    while (idx > 0) {
+        parent = (idx - 1) / 2;
+        if (ctx->heap[parent]->renew_at <= ctx->heap[idx]->renew_at) {
+            break;
+        }
+        renew_heap_swap(ctx, parent, idx);
+        idx = parent;
+    }
+}
+
+static void renew_heap_down(struct renew_tgt_ctx *ctx, size_t idx)
+{
+    size_t child;
+
+    while ((child = 2 * idx + 1) < ctx->heap_count) {
+        if (child + 1 < ctx->heap_count
+                && ctx->heap[child + 1]->renew_at < ctx->heap[child]->renew_at) {
+            child++;
+        }
+        if (ctx->heap[idx]->renew_at <= ctx->heap[child]->renew_at) {
+            break;
+        }
+        renew_heap_swap(ctx, idx, child);
+        idx = child;
+    }
+}
+
+static errno_t renew_heap_push(struct renew_tgt_ctx *ctx,
+                               struct renew_data *renew_data)
+{
+    struct renew_data **heap;
+    size_t size;
+
+    if (ctx->heap_count == ctx->heap_size) {
+        size = ctx->heap_size == 0 ? INITIAL_HEAP_SIZE : 2 * ctx->heap_size;
+        heap = talloc_realloc(ctx, ctx->heap, struct renew_data *, size);
+        if (heap == NULL) {
+            return ENOMEM;
+        }
+        ctx->heap = heap;
+        ctx->heap_size = size;
+    }
+
+    renew_data->heap_idx = ctx->heap_count;
+    ctx->heap[ctx->heap_count++] = renew_data;
+    renew_heap_up(ctx, renew_data->heap_idx);
+
+    return EOK;
+}
+
+static void renew_heap_remove(struct renew_tgt_ctx *ctx,
+                              struct renew_data *renew_data)
+{
+    size_t idx = renew_data->heap_idx;
+
+    if (idx == RENEW_NOT_QUEUED) {
+        return;
+    }
+
+    renew_data->heap_idx = RENEW_NOT_QUEUED;
+    ctx->heap_count--;
+    if (idx == ctx->heap_count) {
+        return;
+    }
+
+    ctx->heap[idx] = ctx->heap[ctx->heap_count];
+    ctx->heap[idx]->heap_idx = idx;
+    renew_heap_up(ctx, idx);
+    renew_heap_down(ctx, ctx->heap[idx]->heap_idx);
+}
+
+static int renew_data_destructor(struct renew_data *renew_data)
+{
+    renew_heap_remove(renew_data->renew_tgt_ctx, renew_data);
+
+    if (renew_data->auth_data != NULL) {
+        renew_data->auth_data->renew_data = NULL;
+    }
+
+    return 0;
+}
+
+static int auth_data_destructor(struct auth_data *auth_data)
+{
+    auth_data->renew_tgt_ctx->running--;
+
+    if (auth_data->renew_data != NULL) {
+        auth_data->renew_data->auth_data = NULL;
+    }
+
+    return 0;
+}
+
+static int renew_tgt_ctx_destructor(struct renew_tgt_ctx *ctx)
+{
+    size_t c;
+
+    /* the heap might be freed before the items */
+    for (c = 0; c < ctx->heap_count; c++) {
+        ctx->heap[c]->heap_idx = RENEW_NOT_QUEUED;
+    }
+    ctx->heap_count = 0;
+
+    return 0;
+}
+
+static void renew_schedule(struct renew_tgt_ctx *renew_tgt_ctx);
+
+/* Give back the pam data to the renewal item to be able to retry after
+ * timer_interval. */
+static void renew_retry_later(struct auth_data *auth_data)
+{
+    struct renew_data *renew_data = auth_data->renew_data;
+    errno_t ret;
+
+    if (renew_data == NULL) {
+        return;
+    }
+
+    DEBUG(SSSDBG_FUNC_DATA, "Giving back pam data.\n");
+    renew_data->pd = talloc_steal(renew_data, auth_data->pd);
+    renew_data->renew_at = time(NULL) + auth_data->renew_tgt_ctx->timer_interval;
+
+    ret = renew_heap_push(auth_data->renew_tgt_ctx, renew_data);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to queue [%s] for renewal.\n", renew_data->ccfile);
+        ret = hash_delete(auth_data->table, &auth_data->key);
+        if (ret != HASH_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "hash_delete failed.\n");
+        }
+    }
+}
 
 static void renew_tgt_done(struct tevent_req *req);
-static void renew_tgt(struct tevent_context *ev, struct tevent_timer *te,
-                      struct timeval current_time, void *private_data)
+static errno_t renew_tgt(struct renew_tgt_ctx *renew_tgt_ctx,
+                         struct renew_data *renew_data)
 {
-    struct auth_data *auth_data = talloc_get_type(private_data,
-                                                  struct auth_data);
+    struct auth_data *auth_data;
     struct tevent_req *req;
 
-    req = krb5_auth_queue_send(auth_data, ev, auth_data->be_ctx, auth_data->pd,
+    auth_data = talloc_zero(renew_tgt_ctx, struct auth_data);
+    if (auth_data == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
+        return ENOMEM;
+    }
+
+    auth_data->key.type = HASH_KEY_STRING;
+    auth_data->key.str = talloc_strdup(auth_data, renew_data->upn);
+    if (auth_data->key.str == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_strdup failed.\n");
+        talloc_free(auth_data);
+        return ENOMEM;
+    }
+
+/* We need to steal the pam_data here, because a successful renewal of the
+ * ticket might add a new renewal item to the list with the same key (upn).
+ * This would delete renew_data and all its children. But we cannot be sure
+ * that adding the new renewal item is the last operation of the renewal
+ * process with access the pam_data. To be on the safe side we steal the
+ * pam_data and make it a child of auth_data which is only freed after the
+ * renewal process is finished. In the case of an error during renewal we
+ * might want to steal the pam_data back to renew_data before freeing
+ * auth_data to allow a new renewal attempt. */
+    auth_data->pd = talloc_move(auth_data, &renew_data->pd);
+    auth_data->krb5_ctx = renew_tgt_ctx->krb5_ctx;
+    auth_data->be_ctx = renew_tgt_ctx->be_ctx;
+    auth_data->renew_tgt_ctx = renew_tgt_ctx;
+    auth_data->table = renew_tgt_ctx->tgt_table;
+    auth_data->renew_data = renew_data;
+
+    renew_data->auth_data = auth_data;
+    renew_tgt_ctx->running++;
+    talloc_set_destructor(auth_data, auth_data_destructor);
+
+    req = krb5_auth_queue_send(auth_data, renew_tgt_ctx->ev,
+                               auth_data->be_ctx, auth_data->pd,
                                auth_data->krb5_ctx);
     if (req == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "krb5_auth_send failed.\n");
-/* Give back the pam data to the renewal item to be able to retry at the next
- * time the renewals re run. */
-        auth_data->renew_data->pd = talloc_steal(auth_data->renew_data,
-                                                 auth_data->pd);
+        renew_retry_later(auth_data);
         talloc_free(auth_data);
-        return;
+        return EOK;
     }
 
     tevent_req_set_callback(req, renew_tgt_done, auth_data);
+
+    return EOK;
 }
 
 static void renew_tgt_done(struct tevent_req *req)
 {
     struct auth_data *auth_data = tevent_req_callback_data(req,
                                                            struct auth_data);
+    struct renew_tgt_ctx *renew_tgt_ctx = auth_data->renew_tgt_ctx;
     int ret;
     int pam_status = PAM_SYSTEM_ERR;
     int dp_err;
@@ -94,11 +300,7 @@ static void renew_tgt_done(struct tevent_req *req)
     talloc_free(req);
     if (ret) {
         DEBUG(SSSDBG_CRIT_FAILURE, "krb5_auth request failed.\n");
-        if (auth_data->renew_data != NULL) {
-            DEBUG(SSSDBG_FUNC_DATA, "Giving back pam data.\n");
-            auth_data->renew_data->pd = talloc_steal(auth_data->renew_data,
-                                                     auth_data->pd);
-        }
+        renew_retry_later(auth_data);
     } else {
         switch (pam_status) {
             case PAM_SUCCESS:
@@ -133,16 +335,14 @@ static void renew_tgt_done(struct tevent_req *req)
                       "Cannot renewed TGT for user [%s] while offline, "
                           "will retry later.\n",
                           auth_data->pd->user);
-                if (auth_data->renew_data != NULL) {
-                    DEBUG(SSSDBG_FUNC_DATA, "Giving back pam data.\n");
-                    auth_data->renew_data->pd = talloc_steal(auth_data->renew_data,
-                                                             auth_data->pd);
-                }
+                renew_retry_later(auth_data);
                 break;
             default:
                 DEBUG(SSSDBG_CRIT_FAILURE,
                       "Failed to renew TGT for user [%s].\n",
                           auth_data->pd->user);
+                krb5_ccache_status_remove(auth_data->krb5_ctx,
+                                          auth_data->pd->user);
                 ret = hash_delete(auth_data->table, &auth_data->key);
                 if (ret != HASH_SUCCESS) {
                     DEBUG(SSSDBG_CRIT_FAILURE, "hash_delete failed.\n");
@@ -151,83 +351,9 @@ static void renew_tgt_done(struct tevent_req *req)
     }
 
     talloc_zfree(auth_data);
-}
-
-static errno_t renew_all_tgts(struct renew_tgt_ctx *renew_tgt_ctx)
-{
-    int ret;
-    hash_entry_t *entries;
-    unsigned long count;
-    size_t c;
-    time_t now;
-    struct auth_data *auth_data;
-    struct renew_data *renew_data;
-    struct tevent_timer *te = NULL;
-
-    ret = hash_entries(renew_tgt_ctx->tgt_table, &count, &entries);
-    if (ret != HASH_SUCCESS) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "hash_entries failed.\n");
-        return ENOMEM;
-    }
-
-    now = time(NULL);
-
-    for (c = 0; c < count; c++) {
-        renew_data = talloc_get_type(entries[c].value.ptr, struct renew_data);
-        DEBUG(SSSDBG_TRACE_ALL,
-              "Checking [%s] for renewal at [%.24s].\n", renew_data->ccfile,
-                  ctime(&renew_data->start_renew_at));
-        /* If renew_data->pd == NULL a renewal request for this data is
-         * currently running so we skip it. */
-        if (renew_data->start_renew_at < now && renew_data->pd != NULL) {
-            auth_data = talloc_zero(renew_tgt_ctx, struct auth_data);
-            if (auth_data == NULL) {
-                DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
-            } else {
-/* We need to steal the pam_data here, because a successful renewal of the
- * ticket might add a new renewal item to the list with the same key (upn).
- * This would delete renew_data and all its children. But we cannot be sure
- * that adding the new renewal item is the last operation of the renewal
- * process with access the pam_data. To be on the safe side we steal the
- * pam_data and make it a child of auth_data which is only freed after the
- * renewal process is finished. In the case of an error during renewal we
- * might want to steal the pam_data back to renew_data before freeing
- * auth_data to allow a new renewal attempt. */
-                auth_data->pd = talloc_move(auth_data, &renew_data->pd);
-                auth_data->krb5_ctx = renew_tgt_ctx->krb5_ctx;
-                auth_data->be_ctx = renew_tgt_ctx->be_ctx;
-                auth_data->table = renew_tgt_ctx->tgt_table;
-                auth_data->renew_data = renew_data;
-                auth_data->key.type = entries[c].key.type;
-                auth_data->key.str = talloc_strdup(auth_data,
-                                                   entries[c].key.str);
-                if (auth_data->key.str == NULL) {
-                    DEBUG(SSSDBG_CRIT_FAILURE, "talloc_strdup failed.\n");
-                } else {
-                    te = tevent_add_timer(renew_tgt_ctx->ev,
-                                          auth_data, tevent_timeval_current(),
-                                          renew_tgt, auth_data);
-                    if (te == NULL) {
-                        DEBUG(SSSDBG_CRIT_FAILURE,
-                              "tevent_add_timer failed.\n");
-                    }
-                }
-            }
-
-            if (auth_data == NULL || te == NULL) {
-                DEBUG(SSSDBG_CRIT_FAILURE,
-                      "Failed to renew TGT in [%s].\n", renew_data->ccfile);
-                ret = hash_delete(renew_tgt_ctx->tgt_table, &entries[c].key);
-                if (ret != HASH_SUCCESS) {
-                    DEBUG(SSSDBG_CRIT_FAILURE, "hash_delete failed.\n");
-                }
-            }
-        }
-    }
-
-    talloc_free(entries);
 
-    return EOK;
+    /* the renewals which were held back by RENEW_MAX_RUNNING */
+    renew_schedule(renew_tgt_ctx);
 }
 
 static void renew_handler(struct renew_tgt_ctx *renew_tgt_ctx);
@@ -263,43 +389,70 @@ static void renew_tgt_timer_handler(struct tevent_context *ev,
 
 static void renew_handler(struct renew_tgt_ctx *renew_tgt_ctx)
 {
-    struct timeval next;
+    struct renew_data *renew_data;
+    hash_key_t key;
+    time_t now;
     int ret;
 
     if (be_is_offline(renew_tgt_ctx->be_ctx)) {
         DEBUG(SSSDBG_CONF_SETTINGS, "Offline, disable renew timer.\n");
+        talloc_zfree(renew_tgt_ctx->te);
         return;
     }
 
-    ret = renew_all_tgts(renew_tgt_ctx);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "renew_all_tgts failed. "
-                  "Disabling automatic TGT renewal\n");
-        sss_log(SSS_LOG_ERR, "Disabling automatic TGT renewal.");
-        talloc_zfree(renew_tgt_ctx);
-        return;
+    now = time(NULL);
+    while (renew_tgt_ctx->heap_count > 0
+            && renew_tgt_ctx->running < RENEW_MAX_RUNNING) {
+        renew_data = renew_tgt_ctx->heap[0];
+        if (renew_data->renew_at > now) {
+            break;
+        }
+
+        DEBUG(SSSDBG_TRACE_ALL,
+              "Renewing [%s] scheduled for [%.24s].\n", renew_data->ccfile,
+                  ctime(&renew_data->renew_at));
+        renew_heap_remove(renew_tgt_ctx, renew_data);
+
+        ret = renew_tgt(renew_tgt_ctx, renew_data);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Failed to renew TGT in [%s].\n", renew_data->ccfile);
+            /* the key is only used for the lookup */
+            key.type = HASH_KEY_STRING;
+            key.str = discard_const_p(char, renew_data->upn);
+            ret = hash_delete(renew_tgt_ctx->tgt_table, &key);
+            if (ret != HASH_SUCCESS) {
+                DEBUG(SSSDBG_CRIT_FAILURE, "hash_delete failed.\n");
+            }
+        }
     }
 
-    if (renew_tgt_ctx->te != NULL) {
-        DEBUG(SSSDBG_TRACE_LIBS,
-              "There is an active renewal timer, doing nothing.\n");
+    renew_schedule(renew_tgt_ctx);
+}
+
+static void renew_schedule(struct renew_tgt_ctx *renew_tgt_ctx)
+{
+    struct timeval next;
+
+    talloc_zfree(renew_tgt_ctx->te);
+
+    /* A new ticket or a finished renewal schedules again */
+    if (renew_tgt_ctx->heap_count == 0
+            || renew_tgt_ctx->running >= RENEW_MAX_RUNNING
+            || be_is_offline(renew_tgt_ctx->be_ctx)) {
         return;
     }
 
-    DEBUG(SSSDBG_TRACE_LIBS, "Adding new renew timer.\n");
+    DEBUG(SSSDBG_TRACE_LIBS, "Next renewal at [%.24s].\n",
+          ctime(&renew_tgt_ctx->heap[0]->renew_at));
 
-    next = tevent_timeval_current_ofs(renew_tgt_ctx->timer_interval,
-                                      0);
+    next = tevent_timeval(renew_tgt_ctx->heap[0]->renew_at, 0);
     renew_tgt_ctx->te = tevent_add_timer(renew_tgt_ctx->ev, renew_tgt_ctx,
                                          next, renew_tgt_timer_handler,
                                          renew_tgt_ctx);
     if (renew_tgt_ctx->te == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
-        sss_log(SSS_LOG_ERR, "Disabling automatic TGT renewal.");
-        talloc_zfree(renew_tgt_ctx);
     }
-
-    return;
 }
 
 static void renew_del_cb(hash_entry_t *entry, hash_destroy_enum type, void *pvt)
@@ -487,7 +640,6 @@ errno_t init_renew_tgt(struct krb5_ctx *krb5_ctx, struct be_ctx *be_ctx,
                        struct tevent_context *ev, time_t renew_intv)
 {
     int ret;
-    struct timeval next;
 
     krb5_ctx->renew_tgt_ctx = talloc_zero(krb5_ctx, struct renew_tgt_ctx);
     if (krb5_ctx->renew_tgt_ctx == NULL) {
@@ -503,10 +655,13 @@ errno_t init_renew_tgt(struct krb5_ctx *krb5_ctx, struct be_ctx *be_ctx,
         goto fail;
     }
 
+    talloc_set_destructor(krb5_ctx->renew_tgt_ctx, renew_tgt_ctx_destructor);
+
     krb5_ctx->renew_tgt_ctx->be_ctx = be_ctx;
     krb5_ctx->renew_tgt_ctx->krb5_ctx = krb5_ctx;
     krb5_ctx->renew_tgt_ctx->ev = ev;
     krb5_ctx->renew_tgt_ctx->timer_interval = renew_intv;
+    krb5_ctx->renew_tgt_ctx->jitter_seed = time(NULL) * getpid();
 
     ret = check_ccache_files(krb5_ctx->renew_tgt_ctx);
     if (ret != EOK) {
@@ -514,17 +669,6 @@ errno_t init_renew_tgt(struct krb5_ctx *krb5_ctx, struct be_ctx *be_ctx,
               "Failed to read ccache files, continuing ...\n");
     }
 
-    next = tevent_timeval_current_ofs(krb5_ctx->renew_tgt_ctx->timer_interval,
-                                      0);
-    krb5_ctx->renew_tgt_ctx->te = tevent_add_timer(ev, krb5_ctx->renew_tgt_ctx,
-                                                   next, renew_tgt_timer_handler,
-                                                   krb5_ctx->renew_tgt_ctx);
-    if (krb5_ctx->renew_tgt_ctx->te == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
-        ret = ENOMEM;
-        goto fail;
-    }
-
     DEBUG(SSSDBG_TRACE_LIBS,
           "Adding offline callback to remove renewal timer.\n");
     ret = be_add_offline_cb(krb5_ctx->renew_tgt_ctx, be_ctx,
@@ -560,6 +704,8 @@ errno_t add_tgt_to_renew_table(struct krb5_ctx *krb5_ctx, const char *ccfile,
     hash_key_t key;
     hash_value_t value;
     struct renew_data *renew_data = NULL;
+    struct renew_tgt_ctx *renew_tgt_ctx;
+    time_t jitter;
 
     if (krb5_ctx->renew_tgt_ctx == NULL) {
         DEBUG(SSSDBG_TRACE_LIBS ,"Renew context not initialized, "
@@ -583,12 +729,23 @@ errno_t add_tgt_to_renew_table(struct krb5_ctx *krb5_ctx, const char *ccfile,
     key.type = HASH_KEY_STRING;
     key.str = discard_const_p(char, upn);
 
-    renew_data = talloc_zero(krb5_ctx->renew_tgt_ctx, struct renew_data);
+    renew_tgt_ctx = krb5_ctx->renew_tgt_ctx;
+    renew_data = talloc_zero(renew_tgt_ctx, struct renew_data);
     if (renew_data == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
         ret = ENOMEM;
         goto done;
     }
+    renew_data->renew_tgt_ctx = renew_tgt_ctx;
+    renew_data->heap_idx = RENEW_NOT_QUEUED;
+    talloc_set_destructor(renew_data, renew_data_destructor);
+
+    renew_data->upn = talloc_strdup(renew_data, upn);
+    if (renew_data->upn == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_strdup failed.\n");
+        ret = ENOMEM;
+        goto done;
+    }
 
     if (ccfile[0] == '/') {
         renew_data->ccfile = talloc_asprintf(renew_data, "FILE:%s", ccfile);
@@ -606,6 +763,14 @@ errno_t add_tgt_to_renew_table(struct krb5_ctx *krb5_ctx, const char *ccfile,
     renew_data->start_renew_at = (time_t) (tgtt->starttime +
                                         0.5 *(tgtt->endtime - tgtt->starttime));
 
+    /* spread the renewals, but stay well within the lifetime */
+    jitter = MIN(renew_tgt_ctx->timer_interval,
+                 (tgtt->endtime - renew_data->start_renew_at) / 2);
+    renew_data->renew_at = renew_data->start_renew_at;
+    if (jitter > 0) {
+        renew_data->renew_at += rand_r(&renew_tgt_ctx->jitter_seed) % jitter;
+    }
+
     ret = copy_pam_data(renew_data, pd, &renew_data->pd);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "copy_pam_data failed.\n");
@@ -625,16 +790,29 @@ errno_t add_tgt_to_renew_table(struct krb5_ctx *krb5_ctx, const char *ccfile,
     value.type = HASH_VALUE_PTR;
     value.ptr = renew_data;
 
-    ret = hash_enter(krb5_ctx->renew_tgt_ctx->tgt_table, &key, &value);
+    ret = hash_enter(renew_tgt_ctx->tgt_table, &key, &value);
     if (ret != HASH_SUCCESS) {
         DEBUG(SSSDBG_CRIT_FAILURE, "hash_enter failed.\n");
         ret = EFAULT;
         goto done;
     }
 
+    ret = renew_heap_push(renew_tgt_ctx, renew_data);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to queue [%s] for renewal.\n",
+              renew_data->ccfile);
+        /* frees renew_data */
+        hash_delete(renew_tgt_ctx->tgt_table, &key);
+        return ret;
+    }
+
     DEBUG(SSSDBG_TRACE_LIBS,
           "Added [%s] for renewal at [%.24s].\n", renew_data->ccfile,
-                                           ctime(&renew_data->start_renew_at));
+                                           ctime(&renew_data->renew_at));
+
+    if (renew_data->heap_idx == 0) {
+        renew_schedule(renew_tgt_ctx);
+    }
 
     ret = EOK;
 
@@ -31,15 +31,33 @@
 
 #define INIT_HASH_SIZE 5
 
+/* The requests which write the ccache of a user run one after the other,
+ * those which leave it alone may run next to each other. The requests of
+ * a user start in the order they arrive, so a stream of pre-auth requests
+ * cannot starve a waiting authentication. */
+enum queue_class {
+    QUEUE_SHARED,
+    QUEUE_EXCLUSIVE,
+};
+
 struct queue_entry {
     struct queue_entry *prev;
     struct queue_entry *next;
 
     struct be_ctx *be_ctx;
-    struct be_req *be_req;
     struct tevent_req *parent_req;
     struct pam_data *pd;
     struct krb5_ctx *krb5_ctx;
+    enum queue_class class;
+    struct timeval queued;
+};
+
+struct user_queue {
+    char *user;
+    int running_shared;
+    bool running_exclusive;
+
+    struct queue_entry *waiting;
 };
 
 static void wait_queue_auth_done(struct tevent_req *req);
@@ -47,6 +65,63 @@ static void wait_queue_auth_done(struct tevent_req *req);
 static void krb5_auth_queue_finish(struct tevent_req *req, errno_t ret,
                                    int pam_status, int dp_err);
 
+static enum queue_class wait_queue_class(struct pam_data *pd)
+{
+    switch (pd->cmd) {
+    case SSS_PAM_PREAUTH:
+    case SSS_PAM_CHAUTHTOK_PRELIM:
+    case SSS_PAM_ACCT_MGMT:
+        return QUEUE_SHARED;
+    default:
+        /* authentication, renewal and password change write the ccache */
+        return QUEUE_EXCLUSIVE;
+    }
+}
+
+static bool wait_queue_can_run(struct user_queue *queue,
+                               enum queue_class class)
+{
+    if (queue->running_exclusive) {
+        return false;
+    }
+
+    return class == QUEUE_SHARED || queue->running_shared == 0;
+}
+
+static void wait_queue_mark_running(struct user_queue *queue,
+                                    enum queue_class class)
+{
+    if (class == QUEUE_EXCLUSIVE) {
+        queue->running_exclusive = true;
+    } else {
+        queue->running_shared++;
+    }
+}
+
+static void wait_queue_stats_waited(struct krb5_ctx *krb5_ctx,
+                                    struct queue_entry *qe)
+{
+    struct krb5_wait_queue_stats *stats = &krb5_ctx->wait_queue_stats;
+    struct timeval now;
+    struct timeval diff;
+    uint64_t usec;
+
+    now = tevent_timeval_current();
+    diff = tevent_timeval_until(&qe->queued, &now);
+    usec = (uint64_t) diff.tv_sec * 1000000 + diff.tv_usec;
+
+    stats->queued++;
+    stats->total_wait_usec += usec;
+    if (usec > stats->max_wait_usec) {
+        stats->max_wait_usec = usec;
+    }
+    stats->waiting--;
+
+    DEBUG(SSSDBG_TRACE_LIBS,
+          "Request of user [%s] waited %"PRIu64" us, %"PRIu64" requests are "
+          "still waiting.\n", qe->pd->user, usec, stats->waiting);
+}
+
 static void wait_queue_auth(struct tevent_context *ev, struct tevent_timer *te,
                             struct timeval current_time, void *private_data)
 {
@@ -85,11 +160,11 @@ static void wait_queue_auth_done(struct tevent_req *req)
 static void wait_queue_del_cb(hash_entry_t *entry, hash_destroy_enum type,
                               void *pvt)
 {
-    struct queue_entry *head;
+    struct user_queue *queue;
 
     if (entry->value.type == HASH_VALUE_PTR) {
-        head = talloc_get_type(entry->value.ptr, struct queue_entry);
-        talloc_zfree(head);
+        queue = talloc_get_type(entry->value.ptr, struct user_queue);
+        talloc_zfree(queue);
         return;
     }
 
@@ -97,15 +172,17 @@ static void wait_queue_del_cb(hash_entry_t *entry, hash_destroy_enum type,
           "Unexpected value type [%d].\n", entry->value.type);
 }
 
+/* Returns ENOENT if the request can run right away */
 static errno_t add_to_wait_queue(struct be_ctx *be_ctx,
                                  struct tevent_req *parent_req,
                                  struct pam_data *pd,
-                                 struct krb5_ctx *krb5_ctx)
+                                 struct krb5_ctx *krb5_ctx,
+                                 enum queue_class class)
 {
     int ret;
     hash_key_t key;
     hash_value_t value;
-    struct queue_entry *head;
+    struct user_queue *queue;
     struct queue_entry *queue_entry;
 
     if (krb5_ctx->wait_queue_hash == NULL) {
@@ -129,35 +206,21 @@ static errno_t add_to_wait_queue(struct be_ctx *be_ctx,
                 return EINVAL;
             }
 
-            head = talloc_get_type(value.ptr, struct queue_entry);
-
-            queue_entry = talloc_zero(head, struct queue_entry);
-            if (queue_entry == NULL) {
-                DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
-                return ENOMEM;
-            }
-
-            queue_entry->be_ctx = be_ctx;
-            queue_entry->parent_req = parent_req;
-            queue_entry->pd = pd;
-            queue_entry->krb5_ctx = krb5_ctx;
-
-            DLIST_ADD_END(head, queue_entry, struct queue_entry *);
-
+            queue = talloc_get_type(value.ptr, struct user_queue);
             break;
         case HASH_ERROR_KEY_NOT_FOUND:
             value.type = HASH_VALUE_PTR;
-            head = talloc_zero(krb5_ctx->wait_queue_hash, struct queue_entry);
-            if (head == NULL) {
+            queue = talloc_zero(krb5_ctx->wait_queue_hash, struct user_queue);
+            if (queue == NULL) {
                 DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
                 return ENOMEM;
             }
-            value.ptr = head;
+            value.ptr = queue;
 
             ret = hash_enter(krb5_ctx->wait_queue_hash, &key, &value);
             if (ret != HASH_SUCCESS) {
                 DEBUG(SSSDBG_CRIT_FAILURE, "hash_enter failed.\n");
-                talloc_free(head);
+                talloc_free(queue);
                 return EIO;
             }
 
@@ -167,19 +230,44 @@ static errno_t add_to_wait_queue(struct be_ctx *be_ctx,
             return EIO;
     }
 
-    if (head->next == NULL) {
+    if (queue->waiting == NULL && wait_queue_can_run(queue, class)) {
+        wait_queue_mark_running(queue, class);
+        krb5_ctx->wait_queue_stats.immediate++;
         return ENOENT;
-    } else {
-        return EOK;
     }
+
+    queue_entry = talloc_zero(queue, struct queue_entry);
+    if (queue_entry == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
+        return ENOMEM;
+    }
+
+    queue_entry->be_ctx = be_ctx;
+    queue_entry->parent_req = parent_req;
+    queue_entry->pd = pd;
+    queue_entry->krb5_ctx = krb5_ctx;
+    queue_entry->class = class;
+    queue_entry->queued = tevent_timeval_current();
+
+    DLIST_ADD_END(queue->waiting, queue_entry, struct queue_entry *);
+
+    krb5_ctx->wait_queue_stats.waiting++;
+    if (krb5_ctx->wait_queue_stats.waiting
+            > krb5_ctx->wait_queue_stats.max_waiting) {
+        krb5_ctx->wait_queue_stats.max_waiting =
+                                        krb5_ctx->wait_queue_stats.waiting;
+    }
+
+    return EOK;
 }
 
-static void check_wait_queue(struct krb5_ctx *krb5_ctx, char *username)
+static void check_wait_queue(struct krb5_ctx *krb5_ctx, char *username,
+                             enum queue_class class)
 {
     int ret;
     hash_key_t key;
     hash_value_t value;
-    struct queue_entry *head;
+    struct user_queue *queue;
     struct queue_entry *queue_entry;
     struct tevent_timer *te;
 
@@ -200,26 +288,42 @@ static void check_wait_queue(struct krb5_ctx *krb5_ctx, char *username)
                 return;
             }
 
-            head = talloc_get_type(value.ptr, struct queue_entry);
+            queue = talloc_get_type(value.ptr, struct user_queue);
+
+            if (class == QUEUE_EXCLUSIVE) {
+                queue->running_exclusive = false;
+            } else if (queue->running_shared > 0) {
+                queue->running_shared--;
+            }
 
-            if (head->next == NULL) {
-                DEBUG(SSSDBG_TRACE_LIBS,
-                      "Wait queue for user [%s] is empty.\n", username);
-            } else {
-                queue_entry = head->next;
+            /* start the waiting requests in order as far as they can run */
+            while (queue->waiting != NULL
+                    && wait_queue_can_run(queue, queue->waiting->class)) {
+                queue_entry = queue->waiting;
 
-                DLIST_REMOVE(head, queue_entry);
+                DLIST_REMOVE(queue->waiting, queue_entry);
+                wait_queue_stats_waited(krb5_ctx, queue_entry);
 
                 te = tevent_add_timer(queue_entry->be_ctx->ev, krb5_ctx,
                                       tevent_timeval_current(), wait_queue_auth,
                                       queue_entry);
                 if (te == NULL) {
                     DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
-                } else {
-                    return;
+                    talloc_free(queue_entry);
+                    continue;
                 }
+
+                wait_queue_mark_running(queue, queue_entry->class);
+            }
+
+            if (queue->waiting != NULL || queue->running_exclusive
+                    || queue->running_shared > 0) {
+                return;
             }
 
+            DEBUG(SSSDBG_TRACE_LIBS,
+                  "Wait queue for user [%s] is empty.\n", username);
+
             ret = hash_delete(krb5_ctx->wait_queue_hash, &key);
             if (ret != HASH_SUCCESS) {
                 DEBUG(SSSDBG_CRIT_FAILURE,
@@ -239,9 +343,18 @@ static void check_wait_queue(struct krb5_ctx *krb5_ctx, char *username)
     return;
 }
 
+void krb5_wait_queue_get_stats(struct krb5_ctx *krb5_ctx,
+                               struct krb5_wait_queue_stats *_stats)
+{
+    *_stats = krb5_ctx->wait_queue_stats;
+}
+
 struct krb5_auth_queue_state {
     struct krb5_ctx *krb5_ctx;
     struct pam_data *pd;
+    enum queue_class class;
+    /* the request is counted as running in the queue of the user */
+    bool queued;
 
     int pam_status;
     int dp_err;
@@ -267,15 +380,18 @@ struct tevent_req *krb5_auth_queue_send(TALLOC_CTX *mem_ctx,
     }
     state->krb5_ctx = krb5_ctx;
     state->pd = pd;
+    state->class = wait_queue_class(pd);
 
-    ret = add_to_wait_queue(be_ctx, req, pd, krb5_ctx);
+    ret = add_to_wait_queue(be_ctx, req, pd, krb5_ctx, state->class);
     if (ret == EOK) {
+        state->queued = true;
         DEBUG(SSSDBG_TRACE_LIBS,
               "Request [%p] successfully added to wait queue "
               "of user [%s].\n", req, pd->user);
         ret = EOK;
         goto immediate;
     } else if (ret == ENOENT) {
+        state->queued = true;
         DEBUG(SSSDBG_TRACE_LIBS, "Wait queue of user [%s] is empty, "
               "running request [%p] immediately.\n", pd->user, req);
     } else {
@@ -314,7 +430,9 @@ static void krb5_auth_queue_done(struct tevent_req *subreq)
     ret = krb5_auth_recv(subreq, &state->pam_status, &state->dp_err);
     talloc_zfree(subreq);
 
-    check_wait_queue(state->krb5_ctx, state->pd->user);
+    if (state->queued) {
+        check_wait_queue(state->krb5_ctx, state->pd->user, state->class);
+    }
 
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "krb5_auth_recv failed with: %d\n", ret);
@@ -339,7 +457,9 @@ static void krb5_auth_queue_finish(struct tevent_req *req,
     struct krb5_auth_queue_state *state = \
                 tevent_req_data(req, struct krb5_auth_queue_state);
 
-    check_wait_queue(state->krb5_ctx, state->pd->user);
+    if (state->queued) {
+        check_wait_queue(state->krb5_ctx, state->pd->user, state->class);
+    }
 
     state->pam_status = pam_status;
     state->dp_err = dp_err;
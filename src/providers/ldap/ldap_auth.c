@@ -385,6 +385,8 @@ static struct tevent_req *get_user_dn_send(TALLOC_CTX *memctx,
     req = tevent_req_create(memctx, &state, struct get_user_dn_state);
     if (!req) return NULL;
 
+    sdap_op_class_set(state, SDAP_OP_CLASS_AUTH);
+
     state->username = username;
 
     ret = sss_filter_sanitize(state, username, &clean_name);
@@ -637,6 +639,8 @@ static struct tevent_req *auth_send(TALLOC_CTX *memctx,
     req = tevent_req_create(memctx, &state, struct auth_state);
     if (!req) return NULL;
 
+    sdap_op_class_set(state, SDAP_OP_CLASS_AUTH);
+
     /* The token must be a password token */
     if (sss_authtok_get_type(authtok) != SSS_AUTHTOK_TYPE_PASSWORD) {
         tevent_req_error(req, ERR_AUTH_FAILED);
@@ -1257,11 +1261,30 @@ done:
     be_req_terminate(breq, dp_err, pd->pam_status, NULL);
 }
 
+static void sdap_pam_auth_cache_done(struct tevent_req *req)
+{
+    const char *user = (const char *) tevent_req_callback_data_void(req);
+    int ret;
+
+    ret = sysdb_cache_password_recv(req);
+
+    /* password caching failures are not fatal errors */
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to cache password for %s\n", user);
+    } else {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Password successfully cached for %s\n",
+                  user);
+    }
+
+    talloc_free(req);
+}
+
 static void sdap_pam_auth_done(struct tevent_req *req)
 {
     struct sdap_pam_auth_state *state =
                     tevent_req_callback_data(req, struct sdap_pam_auth_state);
     struct be_ctx *be_ctx = be_req_get_be_ctx(state->breq);
+    struct tevent_req *subreq;
     enum pwexpire pw_expire_type;
     void *pw_expire_data;
     const char *password;
@@ -1321,17 +1344,24 @@ static void sdap_pam_auth_done(struct tevent_req *req)
 
         ret = sss_authtok_get_password(state->pd->authtok, &password, NULL);
         if (ret == EOK) {
-            ret = sysdb_cache_password(be_ctx->domain, state->pd->user,
-                                       password);
+            /* the hash is stored once it was computed */
+            subreq = sysdb_cache_password_send(be_ctx, be_ctx->ev,
+                                               be_ctx->domain,
+                                               state->pd->user, password,
+                                               SSS_AUTHTOK_TYPE_PASSWORD, 0);
+            if (subreq == NULL) {
+                ret = ENOMEM;
+            } else {
+                tevent_req_set_callback(subreq, sdap_pam_auth_cache_done,
+                                        talloc_strdup(subreq,
+                                                      state->pd->user));
+            }
         }
 
         /* password caching failures are not fatal errors */
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE, "Failed to cache password for %s\n",
                       state->pd->user);
-        } else {
-            DEBUG(SSSDBG_CONF_SETTINGS, "Password successfully cached for %s\n",
-                      state->pd->user);
         }
     }
 
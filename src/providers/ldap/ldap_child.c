@@ -498,7 +498,6 @@ static krb5_error_code ldap_child_get_tgt_sync(TALLOC_CTX *memctx,
 done:
     if (krberr != 0) KRB5_SYSLOG(krberr);
     if (keytab) krb5_kt_close(context, keytab);
-    if (context) krb5_free_context(context);
     talloc_free(tmp_ctx);
     return krberr;
 }
@@ -568,12 +567,202 @@ static krb5_error_code privileged_krb5_setup(struct input_buffer *ibuf)
     return 0;
 }
 
+/* In the persistent mode every message is preceded by its length */
+static errno_t ldap_child_read_msg(int fd, uint8_t *buf, size_t size,
+                                   size_t *_len)
+{
+    uint8_t len_buf[sizeof(uint32_t)];
+    uint32_t len;
+    ssize_t ret;
+    size_t p = 0;
+
+    errno = 0;
+    ret = sss_atomic_read_s(fd, len_buf, sizeof(len_buf));
+    if (ret == -1) {
+        return errno;
+    } else if (ret == 0) {
+        return ENOENT;
+    } else if (ret != sizeof(len_buf)) {
+        return EINVAL;
+    }
+    SAFEALIGN_COPY_UINT32(&len, len_buf, &p);
+
+    if (len == 0 || len > size) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid message size %u.\n", len);
+        return EINVAL;
+    }
+
+    errno = 0;
+    ret = sss_atomic_read_s(fd, buf, len);
+    if (ret == -1) {
+        return errno;
+    } else if (ret != len) {
+        return EINVAL;
+    }
+
+    *_len = len;
+    return EOK;
+}
+
+static errno_t ldap_child_write_msg(int fd, struct response *resp)
+{
+    uint8_t *buf;
+    size_t size;
+    ssize_t written;
+    size_t p = 0;
+
+    size = sizeof(uint32_t) + resp->size;
+    buf = talloc_size(resp, size);
+    if (buf == NULL) {
+        return ENOMEM;
+    }
+
+    SAFEALIGN_SET_UINT32(&buf[p], resp->size, &p);
+    safealign_memcpy(&buf[p], resp->buf, resp->size, &p);
+
+    errno = 0;
+    written = sss_atomic_write_s(fd, buf, size);
+    if (written == -1) {
+        return errno;
+    } else if (written != size) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Expected to write %zu bytes, wrote %zu\n",
+              size, written);
+        return EIO;
+    }
+
+    return EOK;
+}
+
+/* Serves one request after the other until the back end closes the pipe.
+ * The keytab of the first request is kept in memory because it might not
+ * be readable anymore after become_user(), the back end only sends
+ * requests for this keytab. */
+static errno_t ldap_child_serve(TALLOC_CTX *mem_ctx)
+{
+    TALLOC_CTX *req_ctx = NULL;
+    struct input_buffer *ibuf;
+    struct response *resp;
+    krb5_context context = NULL;
+    char *requested_keytab = NULL;
+    char *keytab_name = NULL;
+    const char *ccname;
+    time_t expire_time;
+    uint8_t *buf;
+    size_t len;
+    krb5_error_code kerr;
+    errno_t ret;
+
+    buf = talloc_size(mem_ctx, sizeof(uint8_t)*IN_BUF_SIZE);
+    if (buf == NULL) {
+        return ENOMEM;
+    }
+
+    while (true) {
+        ret = ldap_child_read_msg(STDIN_FILENO, buf, IN_BUF_SIZE, &len);
+        if (ret == ENOENT) {
+            DEBUG(SSSDBG_TRACE_FUNC, "The back end closed the pipe.\n");
+            ret = EOK;
+            break;
+        } else if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "read failed [%d][%s].\n", ret, strerror(ret));
+            break;
+        }
+
+        req_ctx = talloc_new(mem_ctx);
+        ibuf = talloc_zero(req_ctx, struct input_buffer);
+        if (ibuf == NULL) {
+            ret = ENOMEM;
+            break;
+        }
+
+        ret = unpack_buffer(buf, len, ibuf);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "unpack_buffer failed.[%d][%s].\n", ret, strerror(ret));
+            break;
+        }
+
+        if (context == NULL) {
+            if (ibuf->keytab_name != NULL) {
+                requested_keytab = talloc_strdup(mem_ctx, ibuf->keytab_name);
+                if (requested_keytab == NULL) {
+                    ret = ENOMEM;
+                    break;
+                }
+            }
+
+            kerr = privileged_krb5_setup(ibuf);
+            if (kerr != 0) {
+                DEBUG(SSSDBG_CRIT_FAILURE, "Privileged Krb5 setup failed.\n");
+                ret = EIO;
+                break;
+            }
+            context = ibuf->context;
+            keytab_name = talloc_steal(mem_ctx, ibuf->keytab_name);
+
+            kerr = become_user(ibuf->uid, ibuf->gid);
+            if (kerr != 0) {
+                DEBUG(SSSDBG_CRIT_FAILURE, "become_user failed.\n");
+                ret = EIO;
+                break;
+            }
+
+            DEBUG(SSSDBG_TRACE_INTERNAL,
+                  "Running as [%"SPRIuid"][%"SPRIgid"].\n",
+                  geteuid(), getegid());
+        } else if ((requested_keytab == NULL) != (ibuf->keytab_name == NULL)
+                    || (requested_keytab != NULL
+                        && strcmp(requested_keytab, ibuf->keytab_name) != 0)) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Request for another keytab, exiting.\n");
+            ret = EINVAL;
+            break;
+        }
+
+        ccname = NULL;
+        expire_time = 0;
+        DEBUG(SSSDBG_TRACE_INTERNAL, "getting TGT sync\n");
+        kerr = ldap_child_get_tgt_sync(req_ctx, context,
+                                       ibuf->realm_str, ibuf->princ_str,
+                                       keytab_name, ibuf->lifetime,
+                                       &ccname, &expire_time);
+        if (kerr != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "ldap_child_get_tgt_sync failed.\n");
+            /* Do not return, must report failure */
+        }
+
+        ret = prepare_response(req_ctx, ccname, expire_time, kerr, &resp);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "prepare_response failed. [%d][%s].\n",
+                        ret, strerror(ret));
+            break;
+        }
+
+        ret = ldap_child_write_msg(STDOUT_FILENO, resp);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "write failed [%d][%s].\n", ret,
+                        strerror(ret));
+            break;
+        }
+
+        talloc_zfree(req_ctx);
+    }
+
+    talloc_free(req_ctx);
+    if (context != NULL) {
+        krb5_free_context(context);
+    }
+    return ret;
+}
+
 int main(int argc, const char *argv[])
 {
     int ret;
     int kerr;
     int opt;
     int debug_fd = -1;
+    int persistent = 0;
     poptContext pc;
     TALLOC_CTX *main_ctx = NULL;
     uint8_t *buf = NULL;
@@ -596,6 +785,8 @@ int main(int argc, const char *argv[])
          _("An open file descriptor for the debug logs"), NULL},
         {"debug-to-stderr", 0, POPT_ARG_NONE | POPT_ARGFLAG_DOC_HIDDEN, &debug_to_stderr, 0, \
          _("Send the debug output to stderr directly."), NULL }, \
+        {"persistent", 0, POPT_ARG_NONE, &persistent, 0,
+         _("Serve requests until the input is closed"), NULL},
         POPT_TABLEEND
     };
 
@@ -641,6 +832,18 @@ int main(int argc, const char *argv[])
     }
     talloc_steal(main_ctx, debug_prg_name);
 
+    if (persistent) {
+        ret = ldap_child_serve(main_ctx);
+        if (ret != EOK) {
+            goto fail;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "ldap_child completed successfully\n");
+        close(STDOUT_FILENO);
+        talloc_free(main_ctx);
+        _exit(0);
+    }
+
     buf = talloc_size(main_ctx, sizeof(uint8_t)*IN_BUF_SIZE);
     if (buf == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "talloc_size failed.\n");
@@ -722,6 +925,7 @@ int main(int argc, const char *argv[])
 
     DEBUG(SSSDBG_TRACE_FUNC, "ldap_child completed successfully\n");
     close(STDOUT_FILENO);
+    krb5_free_context(ibuf->context);
     talloc_free(main_ctx);
     _exit(0);
 
@@ -721,19 +721,12 @@ errno_t get_sysdb_attr_name(TALLOC_CTX *mem_ctx,
                             const char *ldap_name,
                             char **sysdb_name)
 {
-    size_t i;
-
-    for (i = 0; i < map_size; i++) {
-        /* Skip map entries with no name (may depend on
-         * schema selected)
-         */
-        if (!map[i].name) continue;
-
-        /* Check if it is a mapped attribute */
-        if(strcasecmp(ldap_name, map[i].name) == 0) break;
-    }
+    int i;
 
-    if (i < map_size) {
+    /* Check if it is a mapped attribute */
+    i = sdap_attr_map_find(sdap_attr_map_get_index(map, map_size),
+                           map, map_size, ldap_name, 0);
+    if (i != -1) {
         /* We found a mapped name, return that */
         *sysdb_name = talloc_strdup(mem_ctx, map[i].sys_name);
     } else {
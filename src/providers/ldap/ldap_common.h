@@ -47,6 +47,8 @@ extern int ldap_child_debug_fd;
 
 struct sdap_id_ctx;
 
+struct users_get_batch;
+
 struct sdap_id_conn_ctx {
     struct sdap_id_ctx *id_ctx;
 
@@ -57,6 +59,8 @@ struct sdap_id_conn_ctx {
     struct sdap_id_conn_ctx *prev, *next;
     /* do not go offline, try another connection */
     bool ignore_mark_offline;
+    /* user lookups waiting to be sent as one search */
+    struct users_get_batch *user_batches;
 };
 
 struct sdap_id_ctx {
@@ -209,6 +213,15 @@ errno_t ldap_setup_cleanup(struct sdap_id_ctx *id_ctx,
 errno_t ldap_id_cleanup(struct sdap_options *opts,
                         struct sdap_domain *sdom);
 
+/* Same as ldap_id_cleanup() but deletes the entries in slices of
+ * ldap_purge_cache_batch_size entries, each in its own transaction */
+struct tevent_req *ldap_id_cleanup_send(TALLOC_CTX *mem_ctx,
+                                        struct tevent_context *ev,
+                                        struct sdap_options *opts,
+                                        struct sdap_domain *sdom);
+
+errno_t ldap_id_cleanup_recv(struct tevent_req *req);
+
 struct tevent_req *groups_get_send(TALLOC_CTX *memctx,
                                    struct tevent_context *ev,
                                    struct sdap_id_ctx *ctx,
@@ -221,6 +234,15 @@ struct tevent_req *groups_get_send(TALLOC_CTX *memctx,
                                    bool no_members);
 int groups_get_recv(struct tevent_req *req, int *dp_error_out, int *sdap_ret);
 
+struct tevent_req *groups_get_by_sids_send(TALLOC_CTX *memctx,
+                                           struct tevent_context *ev,
+                                           struct sdap_id_ctx *ctx,
+                                           struct sdap_domain *sdom,
+                                           struct sdap_id_conn_ctx *conn,
+                                           const char **sids,
+                                           size_t num_sids,
+                                           bool no_members);
+
 struct tevent_req *ldap_netgroup_get_send(TALLOC_CTX *memctx,
                                           struct tevent_context *ev,
                                           struct sdap_id_ctx *ctx,
@@ -32,6 +32,7 @@
 #include "db/sysdb.h"
 #include "providers/ldap/ldap_common.h"
 #include "providers/ldap/sdap_async.h"
+#include "providers/ldap/sdap_async_private.h"
 #include "providers/ldap/sdap_idmap.h"
 #include "providers/ldap/sdap_users.h"
 #include "providers/ad/ad_common.h"
@@ -57,13 +58,20 @@ struct users_get_state {
     int dp_error;
     int sdap_ret;
     bool noexist_delete;
+
+    /* the lookup can be merged with others into one search */
+    bool batchable;
+    struct users_get_batch_item *batch_item;
 };
 
 static int users_get_retry(struct tevent_req *req);
 static void users_get_connect_done(struct tevent_req *subreq);
 static void users_get_posix_check_done(struct tevent_req *subreq);
 static void users_get_search(struct tevent_req *req);
+static void users_get_search_single(struct tevent_req *req);
 static void users_get_done(struct tevent_req *subreq);
+static void users_get_finish(struct tevent_req *req, int ret);
+static errno_t users_get_batch_add(struct tevent_req *req);
 
 struct tevent_req *users_get_send(TALLOC_CTX *memctx,
                                   struct tevent_context *ev,
@@ -127,6 +135,7 @@ struct tevent_req *users_get_send(TALLOC_CTX *memctx,
             attr_name = ctx->opts->user_map[SDAP_AT_USER_PRINC].name;
         } else {
             attr_name = ctx->opts->user_map[SDAP_AT_USER_NAME].name;
+            state->batchable = true;
         }
         ret = sss_filter_sanitize(state, name, &clean_name);
         if (ret != EOK) {
@@ -180,6 +189,7 @@ struct tevent_req *users_get_send(TALLOC_CTX *memctx,
             if (ret != EOK) {
                 goto done;
             }
+            state->batchable = true;
         }
         break;
     case BE_FILTER_SECID:
@@ -189,6 +199,7 @@ struct tevent_req *users_get_send(TALLOC_CTX *memctx,
         if (ret != EOK) {
             goto done;
         }
+        state->batchable = true;
         break;
     case BE_FILTER_UUID:
         attr_name = ctx->opts->user_map[SDAP_AT_USER_UUID].name;
@@ -392,6 +403,25 @@ static void users_get_posix_check_done(struct tevent_req *subreq)
 }
 
 static void users_get_search(struct tevent_req *req)
+{
+    struct users_get_state *state = tevent_req_data(req,
+                                                     struct users_get_state);
+    errno_t ret;
+
+    if (state->batchable) {
+        ret = users_get_batch_add(req);
+        if (ret == EOK) {
+            return;
+        } else if (ret != EAGAIN) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Cannot merge the lookup, searching on its own\n");
+        }
+    }
+
+    users_get_search_single(req);
+}
+
+static void users_get_search_single(struct tevent_req *req)
 {
     struct users_get_state *state = tevent_req_data(req,
                                                      struct users_get_state);
@@ -424,15 +454,22 @@ static void users_get_done(struct tevent_req *subreq)
 {
     struct tevent_req *req = tevent_req_callback_data(subreq,
                                                       struct tevent_req);
+    int ret;
+
+    ret = sdap_get_users_recv(subreq, NULL, NULL);
+    talloc_zfree(subreq);
+
+    users_get_finish(req, ret);
+}
+
+/* Completes the lookup with the result of its search */
+static void users_get_finish(struct tevent_req *req, int ret)
+{
     struct users_get_state *state = tevent_req_data(req,
                                                      struct users_get_state);
     char *endptr;
     uid_t uid;
     int dp_error = DP_ERR_FATAL;
-    int ret;
-
-    ret = sdap_get_users_recv(subreq, NULL, NULL);
-    talloc_zfree(subreq);
 
     ret = sdap_id_op_done(state->op, ret, &dp_error);
     if (dp_error == DP_ERR_OK && ret != EOK) {
@@ -540,6 +577,316 @@ static void users_get_done(struct tevent_req *subreq)
     tevent_req_done(req);
 }
 
+/* Lookups of users by name or UID which arrive within
+ * ldap_lookup_batch_window are sent as one search, the OR of their filters.
+ * A lookup is answered from the result if one of the returned users matches
+ * it, if none of the users do it makes its own search. When the search
+ * returns nothing, none of the lookups found anything. */
+
+struct users_get_batch {
+    struct users_get_batch *prev, *next;
+
+    struct tevent_context *ev;
+    struct sdap_id_conn_ctx *conn;
+    struct sdap_domain *sdom;
+    int filter_type;
+
+    struct tevent_timer *timer;
+    struct users_get_batch_item *items;
+    int num_items;
+};
+
+struct users_get_batch_item {
+    struct users_get_batch_item *prev, *next;
+    struct users_get_batch *batch;
+    struct tevent_req *req;
+};
+
+static void users_get_batch_run(struct users_get_batch *batch);
+static void users_get_batch_done(struct tevent_req *subreq);
+
+static int users_get_batch_item_destructor(struct users_get_batch_item *item)
+{
+    if (item->batch != NULL) {
+        DLIST_REMOVE(item->batch->items, item);
+        item->batch->num_items--;
+    }
+
+    return 0;
+}
+
+static int users_get_batch_destructor(struct users_get_batch *batch)
+{
+    struct users_get_batch_item *item;
+
+    DLIST_FOR_EACH(item, batch->items) {
+        item->batch = NULL;
+    }
+
+    return 0;
+}
+
+static void users_get_batch_timeout(struct tevent_context *ev,
+                                    struct tevent_timer *te,
+                                    struct timeval tv, void *pvt)
+{
+    struct users_get_batch *batch = talloc_get_type(pvt,
+                                                    struct users_get_batch);
+
+    batch->timer = NULL;
+    users_get_batch_run(batch);
+}
+
+static errno_t users_get_batch_add(struct tevent_req *req)
+{
+    struct users_get_state *state = tevent_req_data(req,
+                                                    struct users_get_state);
+    struct sdap_search_base **bases = state->sdom->user_search_bases;
+    struct users_get_batch *batch;
+    struct users_get_batch_item *item;
+    struct timeval tv;
+    int window;
+    int size;
+
+    window = dp_opt_get_int(state->ctx->opts->basic, SDAP_LOOKUP_BATCH_WINDOW);
+    size = dp_opt_get_int(state->ctx->opts->basic, SDAP_LOOKUP_BATCH_SIZE);
+
+    /* with more search bases the search stops at the first base with
+     * a result */
+    if (window <= 0 || size < 2
+            || bases == NULL || bases[0] == NULL || bases[1] != NULL) {
+        return EAGAIN;
+    }
+
+    DLIST_FOR_EACH(batch, state->conn->user_batches) {
+        if (batch->sdom == state->sdom
+                && batch->filter_type == state->filter_type) {
+            break;
+        }
+    }
+
+    if (batch == NULL) {
+        batch = talloc_zero(state->conn, struct users_get_batch);
+        if (batch == NULL) {
+            return ENOMEM;
+        }
+
+        batch->ev = state->ev;
+        batch->conn = state->conn;
+        batch->sdom = state->sdom;
+        batch->filter_type = state->filter_type;
+        talloc_set_destructor(batch, users_get_batch_destructor);
+
+        tv = tevent_timeval_current_ofs(window / 1000, (window % 1000) * 1000);
+        batch->timer = tevent_add_timer(state->ev, batch, tv,
+                                        users_get_batch_timeout, batch);
+        if (batch->timer == NULL) {
+            talloc_free(batch);
+            return ENOMEM;
+        }
+
+        DLIST_ADD(state->conn->user_batches, batch);
+    }
+
+    item = talloc_zero(state, struct users_get_batch_item);
+    if (item == NULL) {
+        return ENOMEM;
+    }
+
+    item->batch = batch;
+    item->req = req;
+    DLIST_ADD_END(batch->items, item, struct users_get_batch_item *);
+    batch->num_items++;
+    talloc_set_destructor(item, users_get_batch_item_destructor);
+    state->batch_item = item;
+
+    if (batch->num_items >= size) {
+        users_get_batch_run(batch);
+    }
+
+    return EOK;
+}
+
+static bool users_get_batch_match_sid(struct users_get_state *state,
+                                      struct sysdb_attrs **users,
+                                      size_t count)
+{
+    const char *attr;
+    char *sid_str;
+    bool match;
+    size_t i;
+    errno_t ret;
+
+    attr = state->ctx->opts->user_map[SDAP_AT_USER_OBJECTSID].sys_name;
+
+    for (i = 0; i < count; i++) {
+        ret = sdap_attrs_get_sid_str(NULL, state->ctx->opts->idmap_ctx,
+                                     users[i], attr, &sid_str);
+        if (ret != EOK) {
+            continue;
+        }
+
+        match = (strcasecmp(sid_str, state->name) == 0);
+        talloc_free(sid_str);
+        if (match) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool users_get_batch_match(struct users_get_state *state,
+                                  struct sysdb_attrs **users,
+                                  size_t count)
+{
+    const char *attr;
+    struct ldb_message_element *el;
+    size_t len;
+    size_t i;
+    unsigned int j;
+    errno_t ret;
+
+    if (state->filter_type == BE_FILTER_SECID) {
+        return users_get_batch_match_sid(state, users, count);
+    } else if (state->filter_type == BE_FILTER_NAME) {
+        attr = state->ctx->opts->user_map[SDAP_AT_USER_NAME].sys_name;
+    } else {
+        attr = state->ctx->opts->user_map[SDAP_AT_USER_UID].sys_name;
+    }
+
+    len = strlen(state->name);
+    for (i = 0; i < count; i++) {
+        ret = sysdb_attrs_get_el_ext(users[i], attr, false, &el);
+        if (ret != EOK) {
+            continue;
+        }
+
+        /* the server matches the names case insensitively */
+        for (j = 0; j < el->num_values; j++) {
+            if (el->values[j].length == len
+                    && strncasecmp((const char *) el->values[j].data,
+                                   state->name, len) == 0) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* Answers the lookups from the result of the merged search, search_ret is
+ * EOK when users were found and ENOENT when nothing matched the search */
+static void users_get_batch_finish(struct users_get_batch *batch,
+                                   int search_ret,
+                                   struct sysdb_attrs **users,
+                                   size_t count)
+{
+    struct users_get_batch_item *item;
+    struct users_get_state *state;
+    struct tevent_req *req;
+
+    /* completing a lookup may free the others */
+    while ((item = batch->items) != NULL) {
+        DLIST_REMOVE(batch->items, item);
+        batch->num_items--;
+        item->batch = NULL;
+
+        req = item->req;
+        state = tevent_req_data(req, struct users_get_state);
+        talloc_zfree(state->batch_item);
+
+        if (search_ret == ENOENT) {
+            users_get_finish(req, ENOENT);
+        } else if (search_ret == EOK
+                && users_get_batch_match(state, users, count)) {
+            users_get_finish(req, EOK);
+        } else if (search_ret == EOK
+                && state->filter_type == BE_FILTER_SECID) {
+            /* SIDs are compared exactly, without a match the SID belongs
+             * to a group or to no object at all */
+            users_get_finish(req, ENOENT);
+        } else {
+            users_get_search_single(req);
+        }
+    }
+
+    talloc_free(batch);
+}
+
+static void users_get_batch_run(struct users_get_batch *batch)
+{
+    struct users_get_batch_item *item;
+    struct users_get_state *first;
+    struct users_get_state *state;
+    struct tevent_req *subreq;
+    char *filter;
+
+    DLIST_REMOVE(batch->conn->user_batches, batch);
+    talloc_zfree(batch->timer);
+
+    if (batch->num_items < 2) {
+        users_get_batch_finish(batch, EAGAIN, NULL, 0);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Merging %d user lookups\n", batch->num_items);
+
+    filter = talloc_strdup(batch, "(|");
+    DLIST_FOR_EACH(item, batch->items) {
+        state = tevent_req_data(item->req, struct users_get_state);
+        filter = talloc_strdup_append(filter, state->filter);
+    }
+    filter = talloc_strdup_append(filter, ")");
+    if (filter == NULL) {
+        users_get_batch_finish(batch, ENOMEM, NULL, 0);
+        return;
+    }
+
+    /* the search goes over the connection of the first lookup */
+    first = tevent_req_data(batch->items->req, struct users_get_state);
+    subreq = sdap_search_user_send(batch, batch->ev, first->domain,
+                                   first->ctx->opts,
+                                   first->sdom->user_search_bases,
+                                   sdap_id_op_handle(first->op),
+                                   first->attrs, filter,
+                                   dp_opt_get_int(first->ctx->opts->basic,
+                                                  SDAP_SEARCH_TIMEOUT),
+                                   SDAP_LOOKUP_SINGLE);
+    if (subreq == NULL) {
+        users_get_batch_finish(batch, ENOMEM, NULL, 0);
+        return;
+    }
+    tevent_req_set_callback(subreq, users_get_batch_done, batch);
+}
+
+static void users_get_batch_done(struct tevent_req *subreq)
+{
+    struct users_get_batch *batch = tevent_req_callback_data(subreq,
+                                                    struct users_get_batch);
+    struct users_get_state *first;
+    struct sysdb_attrs **users = NULL;
+    size_t count = 0;
+    errno_t ret;
+
+    ret = sdap_search_user_recv(batch, subreq, NULL, &users, &count);
+    talloc_zfree(subreq);
+    if (ret == EOK && batch->items != NULL) {
+        first = tevent_req_data(batch->items->req, struct users_get_state);
+        ret = sdap_save_users(batch, first->sysdb, first->domain,
+                              first->ctx->opts, users, count, NULL);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store users [%d]: %s\n",
+                  ret, sss_strerror(ret));
+        }
+    } else if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Merged user search failed [%d]: %s\n", ret, sss_strerror(ret));
+    }
+
+    users_get_batch_finish(batch, ret, users, count);
+}
+
 int users_get_recv(struct tevent_req *req, int *dp_error_out, int *sdap_ret)
 {
     struct users_get_state *state = tevent_req_data(req,
@@ -580,6 +927,8 @@ struct groups_get_state {
     int sdap_ret;
     bool noexist_delete;
     bool no_members;
+    /* the filter matches several groups */
+    bool multiple;
 };
 
 static int groups_get_retry(struct tevent_req *req);
@@ -798,6 +1147,129 @@ done:
     return tevent_req_post(req, ev);
 }
 
+/* Looks up the groups with the given SIDs with one search, the caller
+ * makes sure that all SIDs belong to the domain of sdom. Errors and the
+ * ENOENT sdap_ret when no group was found are returned by
+ * groups_get_recv(). */
+struct tevent_req *groups_get_by_sids_send(TALLOC_CTX *memctx,
+                                           struct tevent_context *ev,
+                                           struct sdap_id_ctx *ctx,
+                                           struct sdap_domain *sdom,
+                                           struct sdap_id_conn_ctx *conn,
+                                           const char **sids,
+                                           size_t num_sids,
+                                           bool no_members)
+{
+    struct tevent_req *req;
+    struct groups_get_state *state;
+    const char *attr_name;
+    const char *member_filter[2];
+    char *sid_filter;
+    char *clean_sid;
+    char *oc_list;
+    size_t i;
+    int ret;
+
+    req = tevent_req_create(memctx, &state, struct groups_get_state);
+    if (!req) return NULL;
+
+    state->ev = ev;
+    state->ctx = ctx;
+    state->sdom = sdom;
+    state->conn = conn;
+    state->dp_error = DP_ERR_FATAL;
+    state->noexist_delete = false;
+    state->no_members = no_members;
+    state->multiple = true;
+
+    state->op = sdap_id_op_create(state, state->conn->conn_cache);
+    if (!state->op) {
+        DEBUG(SSSDBG_OP_FAILURE, "sdap_id_op_create failed\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    state->domain = sdom->dom;
+    state->sysdb = sdom->dom->sysdb;
+    state->name = sids[0];
+    state->filter_type = BE_FILTER_SECID;
+
+    state->use_id_mapping = sdap_idmap_domain_has_algorithmic_mapping(
+                                                          ctx->opts->idmap_ctx,
+                                                          sdom->dom->name,
+                                                          sdom->dom->domain_id);
+
+    attr_name = ctx->opts->group_map[SDAP_AT_GROUP_OBJECTSID].name;
+    if (attr_name == NULL || num_sids == 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "Missing search attribute name.\n");
+        ret = EINVAL;
+        goto done;
+    }
+
+    sid_filter = talloc_strdup(state, "");
+    if (sid_filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_sids; i++) {
+        ret = sss_filter_sanitize(state, sids[i], &clean_sid);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        sid_filter = talloc_asprintf_append_buffer(sid_filter, "(%s=%s)",
+                                                   attr_name, clean_sid);
+        talloc_free(clean_sid);
+        if (sid_filter == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    oc_list = sdap_make_oc_list(state, ctx->opts->group_map);
+    if (oc_list == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to create objectClass list.\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    state->filter = talloc_asprintf(state, "(&(|%s)(%s)(%s=*))",
+                                    sid_filter, oc_list,
+                                    ctx->opts->group_map[SDAP_AT_GROUP_NAME].name);
+    talloc_free(sid_filter);
+    if (!state->filter) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to build filter\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    member_filter[0] = (const char *)ctx->opts->group_map[SDAP_AT_GROUP_MEMBER].name;
+    member_filter[1] = NULL;
+
+    ret = build_attrs_from_map(state, ctx->opts->group_map, SDAP_OPTS_GROUP,
+                               (state->domain->ignore_group_members
+                                    || state->no_members) ?
+                                   (const char **)member_filter : NULL,
+                               &state->attrs, NULL);
+    if (ret != EOK) goto done;
+
+    ret = groups_get_retry(req);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    return req;
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+    } else {
+        tevent_req_done(req);
+    }
+    return tevent_req_post(req, ev);
+}
+
 static int groups_get_retry(struct tevent_req *req)
 {
     struct groups_get_state *state = tevent_req_data(req,
@@ -902,7 +1374,7 @@ static void groups_get_search(struct tevent_req *req)
     struct tevent_req *subreq;
     enum sdap_entry_lookup_type lookup_type;
 
-    if (state->filter_type == BE_FILTER_WILDCARD) {
+    if (state->filter_type == BE_FILTER_WILDCARD || state->multiple) {
         lookup_type = SDAP_LOOKUP_WILDCARD;
     } else {
         lookup_type = SDAP_LOOKUP_SINGLE;
@@ -1103,6 +1575,8 @@ static struct tevent_req *groups_by_user_send(TALLOC_CTX *memctx,
     req = tevent_req_create(memctx, &state, struct groups_by_user_state);
     if (!req) return NULL;
 
+    sdap_op_class_set(state, SDAP_OP_CLASS_AUTH);
+
     state->ev = ev;
     state->ctx = ctx;
     state->dp_error = DP_ERR_FATAL;
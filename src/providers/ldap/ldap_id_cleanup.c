@@ -50,6 +50,24 @@ static errno_t ldap_cleanup_task(TALLOC_CTX *mem_ctx,
     return ldap_id_cleanup(cleanup_ctx->ctx->opts, cleanup_ctx->sdom);
 }
 
+static struct tevent_req *ldap_cleanup_task_send(TALLOC_CTX *mem_ctx,
+                                                 struct tevent_context *ev,
+                                                 struct be_ctx *be_ctx,
+                                                 struct be_ptask *be_ptask,
+                                                 void *pvt)
+{
+    struct ldap_id_cleanup_ctx *cleanup_ctx = NULL;
+
+    cleanup_ctx = talloc_get_type(pvt, struct ldap_id_cleanup_ctx);
+    return ldap_id_cleanup_send(mem_ctx, ev, cleanup_ctx->ctx->opts,
+                                cleanup_ctx->sdom);
+}
+
+static errno_t ldap_cleanup_task_recv(struct tevent_req *req)
+{
+    return ldap_id_cleanup_recv(req);
+}
+
 errno_t ldap_setup_cleanup(struct sdap_id_ctx *id_ctx,
                            struct sdap_domain *sdom)
 {
@@ -85,11 +103,20 @@ errno_t ldap_setup_cleanup(struct sdap_id_ctx *id_ctx,
         return ENOMEM;
     }
 
-    ret = be_ptask_create_sync(sdom, id_ctx->be, period, first_delay,
-                               5 /* enabled delay */, 0 /* random offset */,
-                               period /* timeout */, BE_PTASK_OFFLINE_SKIP, 0,
-                               ldap_cleanup_task, cleanup_ctx, name,
-                               &sdom->cleanup_task);
+    if (dp_opt_get_int(id_ctx->opts->basic, SDAP_PURGE_CACHE_BATCH_SIZE) > 0) {
+        ret = be_ptask_create(sdom, id_ctx->be, period, first_delay,
+                              5 /* enabled delay */, 0 /* random offset */,
+                              period /* timeout */, BE_PTASK_OFFLINE_SKIP, 0,
+                              ldap_cleanup_task_send, ldap_cleanup_task_recv,
+                              cleanup_ctx, name, &sdom->cleanup_task);
+    } else {
+        /* a single pass in one transaction */
+        ret = be_ptask_create_sync(sdom, id_ctx->be, period, first_delay,
+                                   5 /* enabled delay */, 0 /* random offset */,
+                                   period /* timeout */, BE_PTASK_OFFLINE_SKIP,
+                                   0, ldap_cleanup_task, cleanup_ctx, name,
+                                   &sdom->cleanup_task);
+    }
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "Unable to initialize cleanup periodic "
                                      "task for %s\n", sdom->dom->name);
@@ -172,20 +199,20 @@ static int cleanup_users_logged_in(hash_table_t *table,
 static errno_t expire_memberof_target_groups(struct sss_domain_info *dom,
                                              struct ldb_message *user);
 
-static int cleanup_users(struct sdap_options *opts,
-                         struct sss_domain_info *dom)
+static errno_t cleanup_users_search(TALLOC_CTX *mem_ctx,
+                                    struct sdap_options *opts,
+                                    struct sss_domain_info *dom,
+                                    size_t *_count,
+                                    struct ldb_message ***_msgs)
 {
     TALLOC_CTX *tmpctx;
     const char *attrs[] = { SYSDB_NAME, SYSDB_UIDNUM, SYSDB_MEMBEROF, NULL };
     time_t now = time(NULL);
     char *subfilter = NULL;
     int account_cache_expiration;
-    hash_table_t *uid_table;
-    struct ldb_message **msgs;
+    struct ldb_message **msgs = NULL;
     size_t count;
-    const char *name;
     int ret;
-    int i;
 
     tmpctx = talloc_new(NULL);
     if (!tmpctx) {
@@ -228,61 +255,114 @@ static int cleanup_users(struct sdap_options *opts,
     }
     DEBUG(SSSDBG_FUNC_DATA, "Found %zu expired user entries!\n", count);
 
-    if (count == 0) {
-        ret = EOK;
-        goto done;
+    *_count = count;
+    *_msgs = talloc_steal(mem_ctx, msgs);
+    ret = EOK;
+
+done:
+    talloc_zfree(tmpctx);
+    return ret;
+}
+
+static errno_t cleanup_user(struct sss_domain_info *dom,
+                            hash_table_t *uid_table,
+                            struct ldb_message *msg)
+{
+    const char *name;
+    errno_t ret;
+
+    name = ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL);
+    if (!name) {
+        DEBUG(SSSDBG_OP_FAILURE, "Entry %s has no Name Attribute ?!?\n",
+                   ldb_dn_get_linearized(msg->dn));
+        return EFAULT;
+    }
+    DEBUG(SSSDBG_TRACE_ALL, "Processing user %s\n", name);
+
+    if (uid_table) {
+        ret = cleanup_users_logged_in(uid_table, msg);
+        if (ret == EOK) {
+            /* If the user is logged in, proceed to the next one */
+            DEBUG(SSSDBG_FUNC_DATA,
+                  "User %s is still logged in or a dummy entry, "
+                      "keeping data\n", name);
+            return EOK;
+        } else if (ret != ENOENT) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Cannot check if user is logged in: %d\n", ret);
+            return ret;
+        }
+    }
+
+    /* If not logged in or cannot check the table, delete him */
+    DEBUG(SSSDBG_TRACE_ALL, "About to delete user %s\n", name);
+    ret = sysdb_delete_user(dom, name, 0);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_delete_user failed: %d\n", ret);
+        return ret;
     }
 
-    ret = get_uid_table(tmpctx, &uid_table);
+    /* Mark all groups of which user was a member as expired in cache,
+     * so that its ghost/member attributes are refreshed on next
+     * request. */
+    ret = expire_memberof_target_groups(dom, msg);
+    if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "expire_memberof_target_groups failed: [%d]:%s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
+static errno_t cleanup_users_uid_table(TALLOC_CTX *mem_ctx,
+                                       hash_table_t **_uid_table)
+{
+    errno_t ret;
+
+    *_uid_table = NULL;
+
+    ret = get_uid_table(mem_ctx, _uid_table);
     /* get_uid_table returns ENOSYS on non-Linux platforms. We proceed with
      * the cleanup in that case
      */
     if (ret != EOK && ret != ENOSYS) {
         DEBUG(SSSDBG_CRIT_FAILURE, "get_uid_table failed: %d\n", ret);
-        goto done;
+        return ret;
     }
 
-    for (i = 0; i < count; i++) {
-        name = ldb_msg_find_attr_as_string(msgs[i], SYSDB_NAME, NULL);
-        if (!name) {
-            DEBUG(SSSDBG_OP_FAILURE, "Entry %s has no Name Attribute ?!?\n",
-                       ldb_dn_get_linearized(msgs[i]->dn));
-            ret = EFAULT;
-            goto done;
-        }
-        DEBUG(SSSDBG_TRACE_ALL, "Processing user %s\n", name);
-
-        if (uid_table) {
-            ret = cleanup_users_logged_in(uid_table, msgs[i]);
-            if (ret == EOK) {
-                /* If the user is logged in, proceed to the next one */
-                DEBUG(SSSDBG_FUNC_DATA,
-                      "User %s is still logged in or a dummy entry, "
-                          "keeping data\n", name);
-                continue;
-            } else if (ret != ENOENT) {
-                DEBUG(SSSDBG_CRIT_FAILURE,
-                      "Cannot check if user is logged in: %d\n", ret);
-                goto done;
-            }
-        }
+    return EOK;
+}
 
-        /* If not logged in or cannot check the table, delete him */
-        DEBUG(SSSDBG_TRACE_ALL, "About to delete user %s\n", name);
-        ret = sysdb_delete_user(dom, name, 0);
-        if (ret) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_delete_user failed: %d\n", ret);
-            goto done;
-        }
+static int cleanup_users(struct sdap_options *opts,
+                         struct sss_domain_info *dom)
+{
+    TALLOC_CTX *tmpctx;
+    hash_table_t *uid_table;
+    struct ldb_message **msgs;
+    size_t count;
+    int ret;
+    int i;
 
-        /* Mark all groups of which user was a member as expired in cache,
-         * so that its ghost/member attributes are refreshed on next
-         * request. */
-        ret = expire_memberof_target_groups(dom, msgs[i]);
-        if (ret != EOK && ret != ENOENT) {
-            DEBUG(SSSDBG_CRIT_FAILURE,
-                  "expire_memberof_target_groups failed: [%d]:%s\n",
-                  ret, sss_strerror(ret));
+    tmpctx = talloc_new(NULL);
+    if (!tmpctx) {
+        return ENOMEM;
+    }
+
+    ret = cleanup_users_search(tmpctx, opts, dom, &count, &msgs);
+    if (ret != EOK || count == 0) {
+        goto done;
+    }
+
+    ret = cleanup_users_uid_table(tmpctx, &uid_table);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = cleanup_user(dom, uid_table, msgs[i]);
+        if (ret != EOK) {
             goto done;
         }
     }
@@ -361,24 +441,18 @@ static int cleanup_users_logged_in(hash_table_t *table,
 
 /* ==Group-Cleanup-Process================================================ */
 
-static int cleanup_groups(TALLOC_CTX *memctx,
-                          struct sysdb_ctx *sysdb,
-                          struct sss_domain_info *domain)
+static errno_t cleanup_groups_search(TALLOC_CTX *memctx,
+                                     struct sss_domain_info *domain,
+                                     size_t *_count,
+                                     struct ldb_message ***_msgs)
 {
     TALLOC_CTX *tmpctx;
     const char *attrs[] = { SYSDB_NAME, SYSDB_GIDNUM, NULL };
     time_t now = time(NULL);
     char *subfilter;
-    const char *dn;
-    gid_t gid;
-    struct ldb_message **msgs;
+    struct ldb_message **msgs = NULL;
     size_t count;
-    struct ldb_message **u_msgs;
-    size_t u_count;
     int ret;
-    int i;
-    const char *posix;
-    struct ldb_dn *base_dn;
 
     tmpctx = talloc_new(memctx);
     if (!tmpctx) {
@@ -404,93 +478,379 @@ static int cleanup_groups(TALLOC_CTX *memctx,
 
     DEBUG(SSSDBG_FUNC_DATA, "Found %zu expired group entries!\n", count);
 
-    if (count == 0) {
-        ret = EOK;
+    *_count = count;
+    *_msgs = talloc_steal(memctx, msgs);
+    ret = EOK;
+
+done:
+    talloc_zfree(tmpctx);
+    return ret;
+}
+
+/* Deletes the expired group if no user is a member */
+static errno_t cleanup_group(TALLOC_CTX *memctx,
+                             struct sysdb_ctx *sysdb,
+                             struct sss_domain_info *domain,
+                             struct ldb_message *msg)
+{
+    TALLOC_CTX *tmpctx;
+    char *subfilter;
+    const char *dn;
+    gid_t gid;
+    struct ldb_message **u_msgs;
+    size_t u_count;
+    int ret;
+    const char *posix;
+    struct ldb_dn *base_dn;
+    char *sanitized_dn;
+
+    tmpctx = talloc_new(memctx);
+    if (!tmpctx) {
+        return ENOMEM;
+    }
+
+    dn = ldb_dn_get_linearized(msg->dn);
+    if (!dn) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot linearize DN!\n");
+        ret = EFAULT;
         goto done;
     }
 
-    for (i = 0; i < count; i++) {
-        char *sanitized_dn;
+    /* sanitize dn */
+    ret = sss_filter_sanitize(tmpctx, dn, &sanitized_dn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "sss_filter_sanitize failed: %s:[%d]\n",
+              sss_strerror(ret), ret);
+        goto done;
+    }
 
-        dn = ldb_dn_get_linearized(msgs[i]->dn);
-        if (!dn) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "Cannot linearize DN!\n");
+    posix = ldb_msg_find_attr_as_string(msg, SYSDB_POSIX, NULL);
+    if (!posix || strcmp(posix, "TRUE") == 0) {
+        /* Search for users that are members of this group, or
+         * that have this group as their primary GID.
+         * Include subdomain users as well.
+         */
+        gid = (gid_t) ldb_msg_find_attr_as_uint(msg, SYSDB_GIDNUM, 0);
+        subfilter = talloc_asprintf(tmpctx, "(&(%s=%s)(|(%s=%s)(%s=%lu)))",
+                                    SYSDB_OBJECTCLASS, SYSDB_USER_CLASS,
+                                    SYSDB_MEMBEROF, sanitized_dn,
+                                    SYSDB_GIDNUM, (long unsigned) gid);
+    } else {
+        subfilter = talloc_asprintf(tmpctx, "(%s=%s)", SYSDB_MEMBEROF,
+                                    sanitized_dn);
+    }
+    talloc_zfree(sanitized_dn);
+
+    if (!subfilter) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to build filter\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    base_dn = sysdb_base_dn(sysdb, tmpctx);
+    if (base_dn == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to build base dn\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_LIBS, "Searching with: %s\n", subfilter);
+
+    ret = sysdb_search_entry(tmpctx, sysdb, base_dn,
+                             LDB_SCOPE_SUBTREE, subfilter, NULL,
+                             &u_count, &u_msgs);
+    if (ret == ENOENT) {
+        const char *name;
+
+        name = ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL);
+        if (!name) {
+            DEBUG(SSSDBG_OP_FAILURE, "Entry %s has no Name Attribute ?!?\n",
+                      ldb_dn_get_linearized(msg->dn));
             ret = EFAULT;
             goto done;
         }
 
-        /* sanitize dn */
-        ret = sss_filter_sanitize(tmpctx, dn, &sanitized_dn);
+        DEBUG(SSSDBG_TRACE_INTERNAL, "About to delete group %s\n", name);
+        ret = sysdb_delete_group(domain, name, 0);
+        if (ret) {
+            DEBUG(SSSDBG_OP_FAILURE, "Group delete returned %d (%s)\n",
+                      ret, strerror(ret));
+            goto done;
+        }
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to search sysdb using %s: [%d] %s\n",
+              subfilter, ret, sss_strerror(ret));
+        goto done;
+    }
+    talloc_zfree(u_msgs);
+
+done:
+    talloc_zfree(tmpctx);
+    return ret;
+}
+
+static int cleanup_groups(TALLOC_CTX *memctx,
+                          struct sysdb_ctx *sysdb,
+                          struct sss_domain_info *domain)
+{
+    TALLOC_CTX *tmpctx;
+    struct ldb_message **msgs;
+    size_t count;
+    int ret;
+    int i;
+
+    tmpctx = talloc_new(memctx);
+    if (!tmpctx) {
+        return ENOMEM;
+    }
+
+    ret = cleanup_groups_search(tmpctx, domain, &count, &msgs);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = cleanup_group(tmpctx, sysdb, domain, msgs[i]);
         if (ret != EOK) {
-            DEBUG(SSSDBG_MINOR_FAILURE,
-                  "sss_filter_sanitize failed: %s:[%d]\n",
-                  sss_strerror(ret), ret);
             goto done;
         }
+    }
 
-        posix = ldb_msg_find_attr_as_string(msgs[i], SYSDB_POSIX, NULL);
-        if (!posix || strcmp(posix, "TRUE") == 0) {
-            /* Search for users that are members of this group, or
-             * that have this group as their primary GID.
-             * Include subdomain users as well.
-             */
-            gid = (gid_t) ldb_msg_find_attr_as_uint(msgs[i], SYSDB_GIDNUM, 0);
-            subfilter = talloc_asprintf(tmpctx, "(&(%s=%s)(|(%s=%s)(%s=%lu)))",
-                                        SYSDB_OBJECTCLASS, SYSDB_USER_CLASS,
-                                        SYSDB_MEMBEROF, sanitized_dn,
-                                        SYSDB_GIDNUM, (long unsigned) gid);
-        } else {
-            subfilter = talloc_asprintf(tmpctx, "(%s=%s)", SYSDB_MEMBEROF,
-                                        sanitized_dn);
+done:
+    talloc_zfree(tmpctx);
+    return ret;
+}
+
+/* ==Incremental-Cleanup================================================== */
+
+/* The expired entries are collected once and then deleted in slices, each
+ * in its own transaction, so that the back end keeps serving requests in
+ * between. A slice ends after batch_size entries or when the time budget is
+ * used up, the next one starts after the same budget. */
+struct ldap_id_cleanup_state {
+    struct tevent_context *ev;
+    struct sdap_options *opts;
+    struct sdap_domain *sdom;
+    int batch_size;
+    int time_budget;
+
+    hash_table_t *uid_table;
+    struct ldb_message **msgs;
+    size_t count;
+    size_t next;
+    bool groups;
+};
+
+static errno_t ldap_id_cleanup_schedule(struct tevent_req *req,
+                                        int delay_ms);
+static void ldap_id_cleanup_step(struct tevent_context *ev,
+                                 struct tevent_timer *te,
+                                 struct timeval tv, void *pvt);
+
+struct tevent_req *ldap_id_cleanup_send(TALLOC_CTX *mem_ctx,
+                                        struct tevent_context *ev,
+                                        struct sdap_options *opts,
+                                        struct sdap_domain *sdom)
+{
+    struct ldap_id_cleanup_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct ldap_id_cleanup_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->opts = opts;
+    state->sdom = sdom;
+    state->batch_size = dp_opt_get_int(opts->basic,
+                                       SDAP_PURGE_CACHE_BATCH_SIZE);
+    state->time_budget = dp_opt_get_int(opts->basic,
+                                        SDAP_PURGE_CACHE_TIME_BUDGET);
+
+    ret = cleanup_users_search(state, opts, sdom->dom,
+                               &state->count, &state->msgs);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    if (state->count > 0) {
+        ret = cleanup_users_uid_table(state, &state->uid_table);
+        if (ret != EOK) {
+            goto immediately;
         }
-        talloc_zfree(sanitized_dn);
+    }
 
-        if (!subfilter) {
-            DEBUG(SSSDBG_OP_FAILURE, "Failed to build filter\n");
-            ret = ENOMEM;
+    ret = ldap_id_cleanup_schedule(req, 0);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    return req;
+
+immediately:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static errno_t ldap_id_cleanup_schedule(struct tevent_req *req,
+                                        int delay_ms)
+{
+    struct ldap_id_cleanup_state *state;
+    struct tevent_timer *te;
+
+    state = tevent_req_data(req, struct ldap_id_cleanup_state);
+
+    te = tevent_add_timer(state->ev, req,
+                          tevent_timeval_current_ofs(delay_ms / 1000,
+                                                     (delay_ms % 1000) * 1000),
+                          ldap_id_cleanup_step, req);
+    if (te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to schedule the next slice\n");
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static errno_t ldap_id_cleanup_slice(struct ldap_id_cleanup_state *state)
+{
+    struct sss_domain_info *dom = state->sdom->dom;
+    struct timeval deadline;
+    struct timeval now;
+    int processed = 0;
+    bool in_transaction = false;
+    errno_t ret, tret;
+
+    if (state->next == state->count) {
+        return EOK;
+    }
+
+    deadline = tevent_timeval_current_ofs(state->time_budget / 1000,
+                                          (state->time_budget % 1000) * 1000);
+
+    ret = sysdb_transaction_start(dom->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    while (state->next < state->count) {
+        if (state->groups) {
+            ret = cleanup_group(state, dom->sysdb, dom,
+                                state->msgs[state->next]);
+        } else {
+            ret = cleanup_user(dom, state->uid_table,
+                               state->msgs[state->next]);
+        }
+        /* the entry may have been removed since the search */
+        if (ret != EOK && ret != ENOENT) {
             goto done;
         }
 
-        base_dn = sysdb_base_dn(sysdb, tmpctx);
-        if (base_dn == NULL) {
-            DEBUG(SSSDBG_OP_FAILURE, "Failed to build base dn\n");
-            ret = ENOMEM;
-            goto done;
+        talloc_zfree(state->msgs[state->next]);
+        state->next++;
+        processed++;
+
+        if (state->batch_size > 0 && processed >= state->batch_size) {
+            break;
         }
 
-        DEBUG(SSSDBG_TRACE_LIBS, "Searching with: %s\n", subfilter);
+        now = tevent_timeval_current();
+        if (state->time_budget > 0
+                && tevent_timeval_compare(&now, &deadline) >= 0) {
+            break;
+        }
+    }
 
-        ret = sysdb_search_entry(tmpctx, sysdb, base_dn,
-                                 LDB_SCOPE_SUBTREE, subfilter, NULL,
-                                 &u_count, &u_msgs);
-        if (ret == ENOENT) {
-            const char *name;
+    ret = sysdb_transaction_commit(dom->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
 
-            name = ldb_msg_find_attr_as_string(msgs[i], SYSDB_NAME, NULL);
-            if (!name) {
-                DEBUG(SSSDBG_OP_FAILURE, "Entry %s has no Name Attribute ?!?\n",
-                          ldb_dn_get_linearized(msgs[i]->dn));
-                ret = EFAULT;
-                goto done;
-            }
+    DEBUG(SSSDBG_TRACE_FUNC, "Cleaned up %d %s of %s, %zu left\n",
+          processed, state->groups ? "groups" : "users", dom->name,
+          state->count - state->next);
+
+    ret = EOK;
+
+done:
+    if (in_transaction) {
+        tret = sysdb_transaction_cancel(dom->sysdb);
+        if (tret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    return ret;
+}
+
+static void ldap_id_cleanup_step(struct tevent_context *ev,
+                                 struct tevent_timer *te,
+                                 struct timeval tv, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct ldap_id_cleanup_state *state;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct ldap_id_cleanup_state);
+
+    ret = ldap_id_cleanup_slice(state);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (state->next < state->count) {
+        ret = ldap_id_cleanup_schedule(req, state->time_budget);
+        if (ret != EOK) {
+            goto done;
+        }
+        return;
+    }
+
+    if (!state->groups) {
+        /* the users are gone, the groups are only deleted if no member
+         * is left, so they are searched now */
+        talloc_zfree(state->msgs);
+        state->groups = true;
+        state->next = 0;
 
-            DEBUG(SSSDBG_TRACE_INTERNAL, "About to delete group %s\n", name);
-            ret = sysdb_delete_group(domain, name, 0);
-            if (ret) {
-                DEBUG(SSSDBG_OP_FAILURE, "Group delete returned %d (%s)\n",
-                          ret, strerror(ret));
+        ret = cleanup_groups_search(state, state->sdom->dom,
+                                    &state->count, &state->msgs);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        if (state->count > 0) {
+            ret = ldap_id_cleanup_schedule(req, state->time_budget);
+            if (ret != EOK) {
                 goto done;
             }
-        } else if (ret != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE,
-                  "Failed to search sysdb using %s: [%d] %s\n",
-                  subfilter, ret, sss_strerror(ret));
-            goto done;
+            return;
         }
-        talloc_zfree(u_msgs);
     }
 
+    state->sdom->last_purge = tevent_timeval_current();
+    ret = EOK;
+
 done:
-    talloc_zfree(tmpctx);
-    return ret;
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+errno_t ldap_id_cleanup_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
 }
@@ -220,6 +220,26 @@ int sssm_ldap_id_init(struct be_ctx *bectx,
         goto done;
     }
 
+    ret = sdap_id_conn_warmup_setup(ctx->conn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_offline_probe_setup(ctx->conn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_server_probe_setup(ctx->conn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_id_conn_stats_setup(ctx->conn);
+    if (ret != EOK) {
+        goto done;
+    }
+
     *pvt_data = ctx;
     ret = EOK;
 
@@ -389,6 +409,14 @@ int sssm_ldap_access_init(struct be_ctx *bectx,
                     ret = ENOMEM;
                     goto done;
                 }
+
+                ret = sdap_access_filter_compile(access_ctx,
+                                                 access_ctx->id_ctx->opts,
+                                                 access_ctx->filter,
+                                                 &access_ctx->compiled_filter);
+                if (ret != EOK) {
+                    goto done;
+                }
             }
         } else if (strcasecmp(order_list[c], LDAP_ACCESS_EXPIRE_NAME) == 0) {
             access_ctx->access_rule[c] = LDAP_ACCESS_EXPIRE;
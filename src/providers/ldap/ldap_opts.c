@@ -121,6 +121,27 @@ struct dp_option default_basic_opts[] = {
     { "ldap_max_id", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER},
     { "ldap_pwdlockout_dn", DP_OPT_STRING, NULL_STRING, NULL_STRING },
     { "wildcard_limit", DP_OPT_NUMBER, { .number = 1000 }, NULL_NUMBER},
+    { "ldap_connection_pool_size", DP_OPT_NUMBER, { .number = 1 }, NULL_NUMBER },
+    { "ldap_connection_pool_min", DP_OPT_NUMBER, { .number = 1 }, NULL_NUMBER },
+    { "ldap_connection_pool_idle_timeout", DP_OPT_NUMBER, { .number = 60 }, NULL_NUMBER },
+    { "ldap_max_outstanding_ops", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
+    { "ldap_lookup_batch_window", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
+    { "ldap_lookup_batch_size", DP_OPT_NUMBER, { .number = 50 }, NULL_NUMBER },
+    { "ldap_content_sync", DP_OPT_BOOL, BOOL_FALSE, BOOL_FALSE },
+    { "ldap_group_nesting_parallel_lookups", DP_OPT_NUMBER, { .number = 4 }, NULL_NUMBER },
+    { "ldap_group_nesting_memo_timeout", DP_OPT_NUMBER, { .number = 10 }, NULL_NUMBER },
+    { "ldap_range_parallel_requests", DP_OPT_NUMBER, { .number = 4 }, NULL_NUMBER },
+    { "ldap_page_size_max", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
+    { "ldap_tls_session_resumption", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
+    { "ldap_child_idle_timeout", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER },
+    { "ldap_purge_cache_batch_size", DP_OPT_NUMBER, { .number = 100 }, NULL_NUMBER },
+    { "ldap_purge_cache_time_budget", DP_OPT_NUMBER, { .number = 50 }, NULL_NUMBER },
+    { "ldap_connection_warmup", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
+    { "ldap_deref_adaptive", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
+    { "ldap_connection_stagger", DP_OPT_NUMBER, { .number = 500 }, NULL_NUMBER },
+    { "ldap_server_probe_interval", DP_OPT_NUMBER, { .number = 60 }, NULL_NUMBER },
+    { "ldap_connection_keepalive", DP_OPT_NUMBER, { .number = 0 }, NULL_NUMBER },
+    { "ldap_connection_stats_interval", DP_OPT_NUMBER, { .number = 0 }, NULL_NUMBER },
     DP_OPTION_TERMINATOR
 };
 
@@ -336,6 +357,7 @@ struct sdap_attr_map native_sudorule_map[] = {
     { "ldap_sudorule_notafter", "sudoNotAfter", SYSDB_SUDO_CACHE_AT_NOTAFTER, NULL },
     { "ldap_sudorule_order", "sudoOrder", SYSDB_SUDO_CACHE_AT_ORDER, NULL },
     { "ldap_sudorule_entry_usn", NULL, SYSDB_USN, NULL },
+    { "ldap_sudorule_modify_timestamp", "modifyTimestamp", SYSDB_ORIG_MODSTAMP, NULL },
     SDAP_ATTR_MAP_TERMINATOR
 };
 
@@ -45,12 +45,172 @@ errno_t sdap_copy_map_entry(const struct sdap_attr_map *src_map,
     return EOK;
 }
 
+/* Case-insensitive hash index of the LDAP names of a map. The names seen
+ * when building it are kept, a map whose names were changed afterwards,
+ * e.g. with the USN attributes found in the rootDSE, gets a new index. */
+struct sdap_attr_map_index {
+    int num_entries;
+    const char **names;
+
+    /* open addressing, each used slot holds the first position of a name,
+     * the other positions with the same name are chained through next */
+    unsigned int num_slots;
+    int *slots;
+    int *next;
+};
+
+static unsigned int sdap_attr_map_hash(const char *name)
+{
+    unsigned int hash = 2166136261u;
+
+    for (; *name != '\0'; name++) {
+        hash ^= (unsigned char) tolower((unsigned char) *name);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static errno_t sdap_attr_map_build_index(TALLOC_CTX *mem_ctx,
+                                         struct sdap_attr_map *map,
+                                         int num_entries)
+{
+    struct sdap_attr_map_index *index;
+    unsigned int slot;
+    int last;
+    int i;
+
+    index = talloc_zero(mem_ctx, struct sdap_attr_map_index);
+    if (index == NULL) {
+        return ENOMEM;
+    }
+
+    /* at least half of the slots stay empty */
+    index->num_entries = num_entries;
+    index->num_slots = 8;
+    while (index->num_slots < 2 * num_entries) {
+        index->num_slots *= 2;
+    }
+
+    index->names = talloc_array(index, const char *, num_entries);
+    index->slots = talloc_array(index, int, index->num_slots);
+    index->next = talloc_array(index, int, num_entries);
+    if (index->names == NULL || index->slots == NULL || index->next == NULL) {
+        talloc_free(index);
+        return ENOMEM;
+    }
+
+    for (slot = 0; slot < index->num_slots; slot++) {
+        index->slots[slot] = -1;
+    }
+
+    for (i = 0; i < num_entries; i++) {
+        index->names[i] = map[i].name;
+        index->next[i] = -1;
+
+        if (map[i].name == NULL) {
+            continue;
+        }
+
+        slot = sdap_attr_map_hash(map[i].name) & (index->num_slots - 1);
+        while (index->slots[slot] != -1
+                && strcasecmp(map[index->slots[slot]].name, map[i].name) != 0) {
+            slot = (slot + 1) & (index->num_slots - 1);
+        }
+
+        if (index->slots[slot] == -1) {
+            index->slots[slot] = i;
+        } else {
+            /* keep the chain in the order of the map */
+            for (last = index->slots[slot];
+                 index->next[last] != -1;
+                 last = index->next[last]);
+            index->next[last] = i;
+        }
+    }
+
+    talloc_free(map[num_entries].index);
+    map[num_entries].index = index;
+    return EOK;
+}
+
+struct sdap_attr_map_index *
+sdap_attr_map_get_index(struct sdap_attr_map *map, int num_entries)
+{
+    struct sdap_attr_map_index *index = map[num_entries].index;
+    errno_t ret;
+    int i;
+
+    if (index == NULL) {
+        return NULL;
+    }
+
+    if (index->num_entries == num_entries) {
+        for (i = 0; i < num_entries; i++) {
+            if (index->names[i] != map[i].name) {
+                break;
+            }
+        }
+
+        if (i == num_entries) {
+            return index;
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Attribute map changed, rebuilding index\n");
+
+    ret = sdap_attr_map_build_index(talloc_parent(index), map, num_entries);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot rebuild the index of the "
+              "attribute map [%d]: %s\n", ret, sss_strerror(ret));
+        return NULL;
+    }
+
+    return map[num_entries].index;
+}
+
+int sdap_attr_map_find(struct sdap_attr_map_index *index,
+                       struct sdap_attr_map *map,
+                       int num_entries,
+                       const char *ldap_name,
+                       int from)
+{
+    unsigned int slot;
+    int i;
+
+    if (index == NULL || index->num_entries != num_entries) {
+        for (i = from; i < num_entries; i++) {
+            if (map[i].name != NULL && strcasecmp(ldap_name, map[i].name) == 0) {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    slot = sdap_attr_map_hash(ldap_name) & (index->num_slots - 1);
+    while (index->slots[slot] != -1) {
+        i = index->slots[slot];
+        if (strcasecmp(ldap_name, map[i].name) == 0) {
+            while (i != -1 && i < from) {
+                i = index->next[i];
+            }
+            return i;
+        }
+
+        slot = (slot + 1) & (index->num_slots - 1);
+    }
+
+    return -1;
+}
+
 int sdap_copy_map(TALLOC_CTX *memctx,
                  struct sdap_attr_map *src_map,
                  int num_entries,
                  struct sdap_attr_map **_map)
 {
     struct sdap_attr_map *map;
+    errno_t ret;
     int i;
 
     map = talloc_array(memctx, struct sdap_attr_map, num_entries + 1);
@@ -59,6 +219,7 @@ int sdap_copy_map(TALLOC_CTX *memctx,
     }
 
     for (i = 0; i < num_entries; i++) {
+        map[i].index = NULL;
         map[i].opt_name = talloc_strdup(map, src_map[i].opt_name);
         map[i].sys_name = talloc_strdup(map, src_map[i].sys_name);
         if (map[i].opt_name == NULL || map[i].sys_name == NULL) {
@@ -84,6 +245,11 @@ int sdap_copy_map(TALLOC_CTX *memctx,
     /* Include the sentinel */
     memset(&map[num_entries], 0, sizeof(struct sdap_attr_map));
 
+    ret = sdap_attr_map_build_index(map, map, num_entries);
+    if (ret != EOK) {
+        return ret;
+    }
+
     *_map = map;
     return EOK;
 }
@@ -167,6 +333,9 @@ int sdap_extend_map(TALLOC_CTX *memctx,
         return ENOMEM;
     }
 
+    /* the old sentinel is overwritten */
+    talloc_zfree(map[num_entries].index);
+
     for (i = 0; extra_attrs[i]; i++) {
         ret = split_extra_attr(map, extra_attrs[i], &sysdb_attr, &ldap_attr);
         if (ret != EOK) {
@@ -181,6 +350,7 @@ int sdap_extend_map(TALLOC_CTX *memctx,
             return ERR_DUP_EXTRA_ATTR;
         }
 
+        map[num_entries+i].index = NULL;
         map[num_entries+i].name = ldap_attr;
         map[num_entries+i].sys_name = sysdb_attr;
         map[num_entries+i].opt_name = talloc_strdup(map,
@@ -199,6 +369,11 @@ int sdap_extend_map(TALLOC_CTX *memctx,
     /* Sentinel */
     memset(&map[num_entries+nextra], 0, sizeof(struct sdap_attr_map));
 
+    ret = sdap_attr_map_build_index(map, map, num_entries + nextra);
+    if (ret != EOK) {
+        return ret;
+    }
+
     *_map = map;
     *_new_size = num_entries + nextra;
     return EOK;
@@ -360,12 +535,99 @@ int sdap_get_map(TALLOC_CTX *memctx,
               map[i].name ? map[i].name : "");
     }
 
+    ret = sdap_attr_map_build_index(map, map, num_entries);
+    if (ret != EOK) {
+        talloc_zfree(map);
+        return ret;
+    }
+
     *_map = map;
     return EOK;
 }
 
 /* =Parse-msg============================================================= */
 
+/* An entry and everything stored in it is allocated from one pool sized
+ * after the encoded attributes of the LDAP entry, so that parsing does not
+ * go to the allocator for every value and the memory is released at once
+ * when the entry is freed. Allocations which do not fit the pool fall back
+ * to the heap. */
+#define SDAP_ENTRY_POOL_OBJECTS 64
+#define SDAP_ENTRY_POOL_SIZE(len) (2 * (len) + 1024)
+
+/* Copies the values of an attribute into one buffer, the values are only
+ * borrowed from the LDAP message */
+static errno_t sdap_parse_add_values(struct sysdb_attrs *attrs,
+                                     const char *name,
+                                     struct berval *vals,
+                                     bool base64)
+{
+    struct ldb_message_element *el;
+    struct ldb_val *values;
+    size_t num_values = 0;
+    size_t data_size = 0;
+    uint8_t *data = NULL;
+    errno_t ret;
+    int i;
+
+    for (i = 0; vals[i].bv_val != NULL; i++) {
+        if (vals[i].bv_len == 0) {
+            continue;
+        }
+        num_values++;
+        data_size += vals[i].bv_len + 1;
+    }
+
+    if (num_values == 0) {
+        return EOK;
+    }
+
+    ret = sysdb_attrs_get_el(attrs, name, &el);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    values = talloc_realloc(attrs->a, el->values, struct ldb_val,
+                            el->num_values + num_values);
+    if (values == NULL) {
+        return ENOMEM;
+    }
+    el->values = values;
+
+    if (!base64) {
+        data = talloc_size(values, data_size);
+        if (data == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    for (i = 0; vals[i].bv_val != NULL; i++) {
+        if (vals[i].bv_len == 0) {
+            continue;
+        }
+
+        if (base64) {
+            values[el->num_values].data = (uint8_t *) sss_base64_encode(values,
+                                   (uint8_t *) vals[i].bv_val, vals[i].bv_len);
+            if (values[el->num_values].data == NULL) {
+                return ENOMEM;
+            }
+            values[el->num_values].length =
+                            strlen((const char *) values[el->num_values].data);
+        } else {
+            memcpy(data, vals[i].bv_val, vals[i].bv_len);
+            data[vals[i].bv_len] = '\0';
+            values[el->num_values].data = data;
+            values[el->num_values].length = vals[i].bv_len;
+            data += vals[i].bv_len + 1;
+        }
+
+        el->num_values++;
+    }
+
+    return EOK;
+}
+
 static bool objectclass_matched(struct sdap_attr_map *map,
                                 const char *objcl, int len);
 int sdap_parse_entry(TALLOC_CTX *memctx,
@@ -375,16 +637,22 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
                      bool disable_range_retrieval)
 {
     struct sysdb_attrs *attrs;
+    struct sdap_attr_map_index *map_index = NULL;
     BerElement *ber = NULL;
     struct berval **vals;
-    struct ldb_val v;
-    char *str;
+    struct berval *bvals = NULL;
+    struct berval dn;
+    struct berval attr;
+    ber_len_t len;
+    const char *str;
     int lerrno;
     int i, ret, ai;
     int base_attr_idx = 0;
     const char *name;
     bool store;
     bool base64;
+    bool ranged;
+    bool has_attrs = false;
     char *base_attr;
     uint32_t range_offset;
     TALLOC_CTX *tmp_ctx = talloc_new(NULL);
@@ -397,26 +665,6 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
               sss_ldap_err2string(ret));
     }
 
-    attrs = sysdb_new_attrs(tmp_ctx);
-    if (!attrs) {
-        ret = ENOMEM;
-        goto done;
-    }
-
-    str = ldap_get_dn(sh->ldap, sm->msg);
-    if (!str) {
-        ldap_get_option(sh->ldap, LDAP_OPT_RESULT_CODE, &lerrno);
-        DEBUG(SSSDBG_CRIT_FAILURE, "ldap_get_dn failed: %d(%s)\n",
-              lerrno, sss_ldap_err2string(lerrno));
-        ret = EIO;
-        goto done;
-    }
-
-    DEBUG(SSSDBG_TRACE_LIBS, "OriginalDN: [%s].\n", str);
-    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, str);
-    ldap_memfree(str);
-    if (ret) goto done;
-
     if (map) {
         vals = ldap_get_values_len(sh->ldap, sm->msg, "objectClass");
         if (!vals) {
@@ -440,23 +688,55 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
             goto done;
         }
         ldap_value_free_len(vals);
+
+        map_index = sdap_attr_map_get_index(map, attrs_num);
     }
 
-    str = ldap_first_attribute(sh->ldap, sm->msg, &ber);
-    if (!str) {
-        ldap_get_option(sh->ldap, LDAP_OPT_RESULT_CODE, &lerrno);
-        DEBUG(lerrno == LDAP_SUCCESS
-              ? SSSDBG_TRACE_LIBS
-              : SSSDBG_MINOR_FAILURE,
-              "Entry has no attributes [%d(%s)]!?\n",
-               lerrno, sss_ldap_err2string(lerrno));
-        if (map) {
-            ret = EINVAL;
+    /* the DN, the attribute names and the values point into the message */
+    lerrno = ldap_get_dn_ber(sh->ldap, sm->msg, &ber, &dn);
+    if (lerrno != LDAP_SUCCESS || dn.bv_val == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "ldap_get_dn_ber failed: %d(%s)\n",
+              lerrno, sss_ldap_err2string(lerrno));
+        ret = EIO;
+        goto done;
+    }
+
+    if (ber_get_option(ber, LBER_OPT_REMAINING_BYTES, &len) != LBER_OPT_SUCCESS) {
+        len = 0;
+    }
+
+    attrs = talloc_pooled_object(tmp_ctx, struct sysdb_attrs,
+                                 SDAP_ENTRY_POOL_OBJECTS,
+                                 SDAP_ENTRY_POOL_SIZE(len));
+    if (!attrs) {
+        ret = ENOMEM;
+        goto done;
+    }
+    attrs->num = 0;
+    attrs->a = NULL;
+
+    DEBUG(SSSDBG_TRACE_LIBS, "OriginalDN: [%s].\n", dn.bv_val);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, dn.bv_val);
+    if (ret) goto done;
+
+    while (true) {
+        lerrno = ldap_get_attribute_ber(sh->ldap, sm->msg, ber, &attr, &bvals);
+        if (lerrno != LDAP_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "LDAP Library error: %d(%s)\n",
+                  lerrno, sss_ldap_err2string(lerrno));
+            ret = EIO;
             goto done;
         }
-    }
-    while (str) {
+
+        if (attr.bv_val == NULL) {
+            /* no more attributes */
+            break;
+        }
+        has_attrs = true;
+        str = attr.bv_val;
+
         base64 = false;
+        ranged = false;
 
         ret = sdap_parse_range(tmp_ctx, str, &base_attr, &range_offset,
                                disable_range_retrieval);
@@ -465,10 +745,11 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
             /* This attribute contained range values and needs more to
              * be retrieved
              */
-            /* TODO: return the set of attributes that need additional retrieval
-             * For now, we'll continue below and treat it as regular values.
+            /* The attribute is listed in SDAP_RANGED_ATTRS below so that
+             * the caller can fetch the remaining values.
              */
-            /* FALLTHROUGH */
+            ranged = true;
+            break;
         case ECANCELED:
             /* FALLTHROUGH */
         case EOK:
@@ -480,14 +761,10 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
         }
 
         if (map) {
-            for (i = 1; i < attrs_num; i++) {
-                /* check if this attr is valid with the chosen schema */
-                if (!map[i].name) continue;
-                /* check if it is an attr we are interested in */
-                if (strcasecmp(base_attr, map[i].name) == 0) break;
-            }
+            /* check if it is an attr we are interested in */
+            i = sdap_attr_map_find(map_index, map, attrs_num, base_attr, 1);
             /* interesting attr */
-            if (i < attrs_num) {
+            if (i != -1) {
                 store = true;
                 name = map[i].sys_name;
                 base_attr_idx = i;
@@ -509,100 +786,50 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
         }
 
         if (store) {
-            vals = ldap_get_values_len(sh->ldap, sm->msg, str);
-            if (!vals) {
-                ldap_get_option(sh->ldap, LDAP_OPT_RESULT_CODE, &lerrno);
-                if (lerrno != LDAP_SUCCESS) {
-                    DEBUG(SSSDBG_CRIT_FAILURE, "LDAP Library error: %d(%s)\n",
-                          lerrno, sss_ldap_err2string(lerrno));
-                    ret = EIO;
-                    goto done;
-                }
-
+            if (bvals == NULL || bvals[0].bv_val == NULL) {
                 DEBUG(SSSDBG_TRACE_LIBS,
                       "Attribute [%s] has no values, skipping.\n", str);
-
-            } else {
-                if (!vals[0]) {
-                    DEBUG(SSSDBG_CRIT_FAILURE,
-                          "Missing value after ldap_get_values() ??\n");
-                    ldap_value_free_len(vals);
-                    ret = EINVAL;
-                    goto done;
+            } else if (map) {
+                /* The same LDAP attr might be used for more sysdb
+                 * attrs in case there is a map. Find all that match
+                 * and copy the values
+                 */
+                for (ai = base_attr_idx; ai != -1;
+                     ai = sdap_attr_map_find(map_index, map, attrs_num,
+                                             base_attr, ai + 1)) {
+                    ret = sdap_parse_add_values(attrs, map[ai].sys_name,
+                                                bvals, base64);
+                    if (ret) goto done;
                 }
-                for (i = 0; vals[i]; i++) {
-                    if (vals[i]->bv_len == 0) {
-                        DEBUG(SSSDBG_TRACE_LIBS,
-                              "Value of attribute [%s] is empty. "
-                               "Skipping this value.\n", str);
-                        continue;
-                    }
-                    if (base64) {
-                        v.data = (uint8_t *) sss_base64_encode(attrs,
-                                 (uint8_t *) vals[i]->bv_val, vals[i]->bv_len);
-                        if (!v.data) {
-                            ldap_value_free_len(vals);
-                            ret = ENOMEM;
-                            goto done;
-                        }
-                        v.length = strlen((const char *)v.data);
-                    } else {
-                        v.data = (uint8_t *)vals[i]->bv_val;
-                        v.length = vals[i]->bv_len;
-                    }
+            } else {
+                /* No map, just store the attribute */
+                ret = sdap_parse_add_values(attrs, name, bvals, base64);
+                if (ret) goto done;
+            }
 
-                    if (map) {
-                        /* The same LDAP attr might be used for more sysdb
-                         * attrs in case there is a map. Find all that match
-                         * and copy the value
-                         */
-                        for (ai = base_attr_idx; ai < attrs_num; ai++) {
-                            /* check if this attr is valid with the chosen
-                             * schema */
-                            if (!map[ai].name) continue;
-
-                            /* check if it is an attr we are interested in */
-                            if (strcasecmp(base_attr, map[ai].name) == 0) {
-                                ret = sysdb_attrs_add_val(attrs,
-                                                          map[ai].sys_name,
-                                                          &v);
-                                if (ret) {
-                                    ldap_value_free_len(vals);
-                                    goto done;
-                                }
-                            }
-                        }
-                    } else {
-                        /* No map, just store the attribute */
-                        ret = sysdb_attrs_add_val(attrs, name, &v);
-                        if (ret) {
-                            ldap_value_free_len(vals);
-                            goto done;
-                        }
-                    }
-                }
-                ldap_value_free_len(vals);
+            if (ranged && bvals != NULL && bvals[0].bv_val != NULL) {
+                ret = sysdb_attrs_add_string(attrs, SDAP_RANGED_ATTRS, str);
+                if (ret) goto done;
             }
         }
 
-        ldap_memfree(str);
-        str = ldap_next_attribute(sh->ldap, sm->msg, ber);
+        ber_memfree(bvals);
+        bvals = NULL;
     }
-    ber_free(ber, 0);
-    ber = NULL;
 
-    ldap_get_option(sh->ldap, LDAP_OPT_RESULT_CODE, &lerrno);
-    if (lerrno) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "LDAP Library error: %d(%s)\n",
-              lerrno, sss_ldap_err2string(lerrno));
-        ret = EIO;
-        goto done;
+    if (!has_attrs) {
+        DEBUG(SSSDBG_TRACE_LIBS, "Entry has no attributes!?\n");
+        if (map) {
+            ret = EINVAL;
+            goto done;
+        }
     }
 
     *_attrs = talloc_steal(memctx, attrs);
     ret = EOK;
 
 done:
+    if (bvals) ber_memfree(bvals);
     if (ber) ber_free(ber, 0);
     talloc_free(tmp_ctx);
     return ret;
@@ -639,6 +866,7 @@ errno_t sdap_parse_deref(TALLOC_CTX *mem_ctx,
     const char *orig_dn;
     const char **ocs;
     struct sdap_attr_map *map;
+    struct sdap_attr_map_index *map_index;
     int num_attrs;
     int ret, i, a, mi;
     const char *name;
@@ -737,6 +965,8 @@ errno_t sdap_parse_deref(TALLOC_CTX *mem_ctx,
         }
         if (!map) continue;
 
+        map_index = sdap_attr_map_get_index(map, num_attrs);
+
         res[mi]->attrs = sysdb_new_attrs(res[mi]);
         if (!res[mi]->attrs) {
             ret = ENOMEM;
@@ -753,15 +983,11 @@ errno_t sdap_parse_deref(TALLOC_CTX *mem_ctx,
             DEBUG(SSSDBG_TRACE_INTERNAL,
                   "Dereferenced attribute: %s\n", dval->type);
 
-            for (a = 1; a < num_attrs; a++) {
-                /* check if this attr is valid with the chosen schema */
-                if (!map[a].name) continue;
-                /* check if it is an attr we are interested in */
-                if (strcasecmp(dval->type, map[a].name) == 0) break;
-            }
+            /* check if it is an attr we are interested in */
+            a = sdap_attr_map_find(map_index, map, num_attrs, dval->type, 1);
 
             /* interesting attr */
-            if (a < num_attrs) {
+            if (a != -1) {
                 name = map[a].sys_name;
             } else {
                 continue;
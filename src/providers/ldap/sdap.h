@@ -48,6 +48,13 @@ struct sdap_op {
     sdap_op_callback_t *callback;
     void *data;
 
+    /* counted by the scheduler as an outstanding search */
+    bool sched;
+    /* when the request was sent */
+    struct timeval start;
+    /* the be_req it was sent for, for the logs */
+    uint32_t req_id;
+
     struct tevent_context *ev;
     struct sdap_msg *list;
     struct sdap_msg *last;
@@ -72,6 +79,67 @@ struct sup_list {
     char **vals;
 };
 
+/* Classes of the searches, in the order the scheduler serves them */
+enum sdap_op_class {
+    SDAP_OP_CLASS_AUTH = 0,
+    SDAP_OP_CLASS_LOOKUP,
+    SDAP_OP_CLASS_REFRESH,
+    SDAP_OP_CLASS_ENUM,
+
+    SDAP_OP_CLASS_NUM
+};
+
+struct sdap_sched_stats {
+    int outstanding;
+    int max_outstanding;
+    /* searches waiting for a free slot now, at most and in total */
+    int queued[SDAP_OP_CLASS_NUM];
+    int max_queued[SDAP_OP_CLASS_NUM];
+    uint64_t total_queued[SDAP_OP_CLASS_NUM];
+};
+
+struct sdap_sched_wait;
+
+/* Why a connection was closed */
+enum sdap_handle_end {
+    SDAP_END_NONE = 0,
+    /* the connection or an operation over it failed */
+    SDAP_END_ERROR,
+    /* the Kerberos ticket or ldap_connection_expire_timeout expired */
+    SDAP_END_EXPIRED,
+    /* the pool had more than ldap_connection_pool_min unused connections */
+    SDAP_END_IDLE,
+    /* the server did not answer ldap_connection_keepalive */
+    SDAP_END_KEEPALIVE,
+    SDAP_END_OFFLINE,
+    /* the back end reconnects to another server */
+    SDAP_END_FAILBACK,
+
+    SDAP_END_NUM
+};
+
+/* Health of the connection, for the summaries in the debug log */
+struct sdap_handle_stats {
+    time_t created;
+    int outstanding;
+    int max_outstanding;
+    uint64_t ops;
+    /* operations which got their final result, and the time they took */
+    uint64_t results;
+    uint64_t total_usec;
+    uint64_t max_usec;
+    uint64_t entries;
+    uint64_t timeouts;
+    uint64_t bytes_read;
+    enum sdap_handle_end end;
+
+    /* for the rate since the previous summary */
+    time_t last_summary;
+    uint64_t last_results;
+};
+
+struct sdap_deref_stats;
+
 struct sdap_handle {
     LDAP *ldap;
     bool connected;
@@ -79,6 +147,8 @@ struct sdap_handle {
     time_t expire_time;
     ber_int_t page_size;
     bool disable_deref;
+    /* timings of dereference and separate searches on this server */
+    struct sdap_deref_stats *deref_stats;
 
     struct sdap_fd_events *sdap_fd_events;
 
@@ -88,6 +158,15 @@ struct sdap_handle {
 
     struct sdap_op *ops;
 
+    /* searches waiting until fewer than sched_limit searches are
+     * outstanding, one queue per class */
+    struct sdap_sched_wait *sched_queue[SDAP_OP_CLASS_NUM];
+    struct tevent_timer *sched_timer;
+    int sched_limit;
+    struct sdap_sched_stats sched_stats;
+
+    struct sdap_handle_stats stats;
+
     /* during release we need to lock access to the handler
      * from the destructor to avoid recursion */
     bool destructor_lock;
@@ -233,6 +312,27 @@ enum sdap_basic_opt {
     SDAP_MAX_ID,
     SDAP_PWDLOCKOUT_DN,
     SDAP_WILDCARD_LIMIT,
+    SDAP_CONN_POOL_SIZE,
+    SDAP_CONN_POOL_MIN,
+    SDAP_CONN_POOL_IDLE_TIMEOUT,
+    SDAP_MAX_OUTSTANDING_OPS,
+    SDAP_LOOKUP_BATCH_WINDOW,
+    SDAP_LOOKUP_BATCH_SIZE,
+    SDAP_CONTENT_SYNC,
+    SDAP_NESTING_PARALLEL_LOOKUPS,
+    SDAP_NESTING_MEMO_TIMEOUT,
+    SDAP_RANGE_PARALLEL_REQUESTS,
+    SDAP_PAGE_SIZE_MAX,
+    SDAP_TLS_SESSION_RESUMPTION,
+    SDAP_CHILD_IDLE_TIMEOUT,
+    SDAP_PURGE_CACHE_BATCH_SIZE,
+    SDAP_PURGE_CACHE_TIME_BUDGET,
+    SDAP_CONNECTION_WARMUP,
+    SDAP_DEREF_ADAPTIVE,
+    SDAP_CONNECTION_STAGGER,
+    SDAP_SERVER_PROBE_INTERVAL,
+    SDAP_CONNECTION_KEEPALIVE,
+    SDAP_CONNECTION_STATS_INTERVAL,
 
     SDAP_OPTS_BASIC /* opts counter */
 };
@@ -333,6 +433,7 @@ enum sdap_sudorule_attrs {
     SDAP_AT_SUDO_NOTAFTER,
     SDAP_AT_SUDO_ORDER,
     SDAP_AT_SUDO_USN,
+    SDAP_AT_SUDO_MODSTAMP,
 
     SDAP_OPTS_SUDO  /* attrs counter */
 };
@@ -361,13 +462,18 @@ enum sdap_autofs_entry_attrs {
     SDAP_OPTS_AUTOFS_ENTRY  /* attrs counter */
 };
 
+struct sdap_attr_map_index;
+
 struct sdap_attr_map {
     const char *opt_name;
     const char *def_name;
     const char *sys_name;
     char *name;
+    /* set in the terminator of the maps built by sdap_get_map(),
+     * sdap_copy_map() and sdap_extend_map() */
+    struct sdap_attr_map_index *index;
 };
-#define SDAP_ATTR_MAP_TERMINATOR { NULL, NULL, NULL, NULL }
+#define SDAP_ATTR_MAP_TERMINATOR { NULL, NULL, NULL, NULL, NULL }
 
 struct sdap_search_base {
     const char *basedn;
@@ -394,6 +500,8 @@ enum dc_functional_level {
     DS_BEHAVIOR_WIN2012R2 = 6
 };
 
+struct sdap_sync_ctx;
+
 struct sdap_domain {
     struct sss_domain_info *dom;
 
@@ -420,6 +528,9 @@ struct sdap_domain {
     /* cleanup loop timer */
     struct timeval last_purge;
 
+    /* content synchronization of the enumerated entries */
+    struct sdap_sync_ctx *sync_ctx;
+
     void *pvt;
 };
 
@@ -443,6 +554,8 @@ struct sdap_ext_member_ctx {
     ext_member_recv_fn_t ext_member_resolve_recv;
 };
 
+struct sdap_nested_group_memo;
+
 struct sdap_options {
     struct dp_option *basic;
     struct sdap_attr_map *gen_map;
@@ -476,6 +589,12 @@ struct sdap_options {
 
     bool support_matching_rule;
     enum dc_functional_level dc_functional_level;
+
+    /* Entries found by recent nested group lookups */
+    struct sdap_nested_group_memo *nested_group_memo;
+
+    /* Dereference timings, one entry per server URI */
+    struct sdap_deref_stats *deref_stats;
 };
 
 struct sdap_server_opts {
@@ -536,6 +655,20 @@ int sdap_get_map(TALLOC_CTX *memctx,
                  int num_entries,
                  struct sdap_attr_map **_map);
 
+/* Returns the index of the LDAP names of the map, rebuilt if the names
+ * changed since it was built, or NULL if the map has no index */
+struct sdap_attr_map_index *
+sdap_attr_map_get_index(struct sdap_attr_map *map, int num_entries);
+
+/* Returns the first position from 'from' on whose LDAP name matches
+ * 'ldap_name' case-insensitively, or -1. Without an index the map is
+ * searched linearly. */
+int sdap_attr_map_find(struct sdap_attr_map_index *index,
+                       struct sdap_attr_map *map,
+                       int num_entries,
+                       const char *ldap_name,
+                       int from);
+
 int sdap_parse_entry(TALLOC_CTX *memctx,
                      struct sdap_handle *sh, struct sdap_msg *sm,
                      struct sdap_attr_map *map, int attrs_num,
@@ -550,6 +683,16 @@ errno_t sdap_parse_deref(TALLOC_CTX *mem_ctx,
 
 errno_t setup_tls_config(struct dp_option *basic_opts);
 
+/* Makes the new TLS connections of the process resume the last session
+ * with the same server, returns ENOTSUP if libldap does not use OpenSSL.
+ * Calling it again once it is set up does nothing. */
+errno_t sdap_tls_session_cache_setup(void);
+
+/* Counts the finished handshake of ld as resumed or full */
+void sdap_tls_session_report(LDAP *ld, const char *uri);
+
+void sdap_tls_session_get_stats(uint64_t *_resumed, uint64_t *_full);
+
 int sdap_set_rootdse_supported_lists(struct sysdb_attrs *rootdse,
                                      struct sdap_handle *sh);
 bool sdap_check_sup_list(struct sup_list *l, const char *val);
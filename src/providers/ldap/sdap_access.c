@@ -140,6 +140,8 @@ sdap_access_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
+    sdap_op_class_set(state, SDAP_OP_CLASS_AUTH);
+
     state->be_ctx = be_ctx;
     state->domain = domain;
     state->pd = pd;
@@ -792,6 +794,335 @@ done:
     return ret;
 }
 
+/* Only the attributes which are cached with the values the server has can
+ * be compared locally. The name, the IDs and the principal may be rewritten
+ * on the way into the cache, the LDAP memberOf values are kept as the
+ * original memberOf. */
+static const char *sdap_access_filter_sys_name(struct sdap_options *opts,
+                                               const char *ldap_name)
+{
+    int i = SDAP_AT_USER_NAME;
+
+    while ((i = sdap_attr_map_find(NULL, opts->user_map, opts->user_map_cnt,
+                                   ldap_name, i)) != -1) {
+        switch (i) {
+        case SDAP_AT_USER_GECOS:
+        case SDAP_AT_USER_HOME:
+        case SDAP_AT_USER_SHELL:
+            return opts->user_map[i].sys_name;
+        case SDAP_AT_USER_MEMBEROF:
+            return SYSDB_ORIG_MEMBEROF;
+        default:
+            if (i >= SDAP_FIRST_EXTRA_USER_AT
+                    && opts->user_map[i].sys_name != NULL) {
+                return opts->user_map[i].sys_name;
+            }
+        }
+
+        i++;
+    }
+
+    return NULL;
+}
+
+static errno_t sdap_access_filter_map_tree(struct sdap_options *opts,
+                                           struct ldb_parse_tree *tree)
+{
+    const char **attr;
+    unsigned int i;
+    errno_t ret;
+
+    switch (tree->operation) {
+    case LDB_OP_AND:
+    case LDB_OP_OR:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            ret = sdap_access_filter_map_tree(opts, tree->u.list.elements[i]);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+        return EOK;
+    case LDB_OP_NOT:
+        /* A value missing in the cache would turn a negated term into a
+         * match where the server might not have one */
+        return ENOTSUP;
+    case LDB_OP_EQUALITY:
+        attr = &tree->u.equality.attr;
+        break;
+    case LDB_OP_GREATER:
+    case LDB_OP_LESS:
+        attr = &tree->u.comparison.attr;
+        break;
+    case LDB_OP_SUBSTRING:
+        attr = &tree->u.substring.attr;
+        break;
+    case LDB_OP_PRESENT:
+        attr = &tree->u.present.attr;
+        break;
+    default:
+        /* matching rules and approximate matches are left to the server */
+        return ENOTSUP;
+    }
+
+    *attr = sdap_access_filter_sys_name(opts, *attr);
+    if (*attr == NULL) {
+        return ENOTSUP;
+    }
+
+    return EOK;
+}
+
+errno_t sdap_access_filter_compile(TALLOC_CTX *mem_ctx,
+                                   struct sdap_options *opts,
+                                   const char *filter,
+                                   struct sdap_access_filter **_compiled)
+{
+    struct sdap_access_filter *compiled;
+    errno_t ret;
+
+    compiled = talloc_zero(mem_ctx, struct sdap_access_filter);
+    if (compiled == NULL) {
+        return ENOMEM;
+    }
+    compiled->filter = filter;
+
+    if (filter != NULL) {
+        compiled->tree = ldb_parse_tree(compiled, filter);
+    }
+
+    if (compiled->tree != NULL) {
+        ret = sdap_access_filter_map_tree(opts, compiled->tree);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Access filter [%s] can only be "
+                  "evaluated by the server\n", filter);
+            talloc_zfree(compiled->tree);
+        }
+    }
+
+    *_compiled = compiled;
+    return EOK;
+}
+
+static bool sdap_access_val_equal(const struct ldb_val *val,
+                                  const struct ldb_val *value)
+{
+    return val->length == value->length
+                && strncasecmp((const char *) val->data,
+                               (const char *) value->data,
+                               val->length) == 0;
+}
+
+/* DNs are compared component by component so that a different spelling
+ * of the same DN, e.g. with spaces after the commas or with other escaping,
+ * still matches. Both names and values are case-insensitive. */
+static bool sdap_access_dn_equal(struct ldb_context *ldb,
+                                 const struct ldb_val *val,
+                                 const struct ldb_val *value)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *dn1;
+    struct ldb_dn *dn2;
+    const struct ldb_val *v1;
+    const struct ldb_val *v2;
+    int num;
+    int i;
+    bool equal = false;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return false;
+    }
+
+    dn1 = ldb_dn_from_ldb_val(tmp_ctx, ldb, val);
+    dn2 = ldb_dn_from_ldb_val(tmp_ctx, ldb, value);
+    if (dn1 == NULL || dn2 == NULL
+            || !ldb_dn_validate(dn1) || !ldb_dn_validate(dn2)) {
+        goto done;
+    }
+
+    num = ldb_dn_get_comp_num(dn1);
+    if (num != ldb_dn_get_comp_num(dn2)) {
+        goto done;
+    }
+
+    for (i = 0; i < num; i++) {
+        if (strcasecmp(ldb_dn_get_component_name(dn1, i),
+                       ldb_dn_get_component_name(dn2, i)) != 0) {
+            goto done;
+        }
+
+        v1 = ldb_dn_get_component_val(dn1, i);
+        v2 = ldb_dn_get_component_val(dn2, i);
+        if (!sdap_access_val_equal(v1, v2)) {
+            goto done;
+        }
+    }
+
+    equal = true;
+
+done:
+    talloc_free(tmp_ctx);
+    return equal;
+}
+
+/* Integers are compared by their value, anything else as a string */
+static int sdap_access_val_cmp(const struct ldb_val *val,
+                               const struct ldb_val *value)
+{
+    long long int n1, n2;
+    char *end1, *end2;
+    int ret;
+
+    errno = 0;
+    n1 = strtoll((const char *) val->data, &end1, 10);
+    n2 = strtoll((const char *) value->data, &end2, 10);
+    if (errno == 0 && val->length > 0 && value->length > 0
+            && *end1 == '\0' && *end2 == '\0') {
+        return n1 < n2 ? -1 : (n1 > n2 ? 1 : 0);
+    }
+
+    ret = strncasecmp((const char *) val->data, (const char *) value->data,
+                      MIN(val->length, value->length));
+    if (ret == 0) {
+        ret = val->length < value->length ? -1
+                    : (val->length > value->length ? 1 : 0);
+    }
+
+    return ret;
+}
+
+static bool sdap_access_val_substring(const struct ldb_val *val,
+                                      struct ldb_parse_tree *tree)
+{
+    struct ldb_val **chunks = tree->u.substring.chunks;
+    const char *p = (const char *) val->data;
+    size_t len = val->length;
+    size_t clen;
+    size_t i = 0;
+
+    if (chunks == NULL) {
+        return true;
+    }
+
+    if (!tree->u.substring.start_with_wildcard && chunks[0] != NULL) {
+        clen = chunks[0]->length;
+        if (len < clen
+                || strncasecmp(p, (const char *) chunks[0]->data, clen) != 0) {
+            return false;
+        }
+        p += clen;
+        len -= clen;
+        i++;
+    }
+
+    for (; chunks[i] != NULL; i++) {
+        clen = chunks[i]->length;
+
+        if (chunks[i + 1] == NULL && !tree->u.substring.end_with_wildcard) {
+            /* the last chunk has to end the value */
+            return len >= clen
+                    && strncasecmp(p + len - clen,
+                                   (const char *) chunks[i]->data, clen) == 0;
+        }
+
+        while (len >= clen
+                && strncasecmp(p, (const char *) chunks[i]->data, clen) != 0) {
+            p++;
+            len--;
+        }
+        if (len < clen) {
+            return false;
+        }
+        p += clen;
+        len -= clen;
+    }
+
+    return tree->u.substring.end_with_wildcard || len == 0;
+}
+
+/* The values are compared case-insensitively just like the matching rules
+ * of nearly all directory string attributes do, the memberOf values are
+ * compared as DNs */
+bool sdap_access_filter_match(struct ldb_context *ldb,
+                              struct ldb_parse_tree *tree,
+                              struct ldb_message *entry)
+{
+    struct ldb_message_element *el;
+    unsigned int i;
+
+    switch (tree->operation) {
+    case LDB_OP_AND:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            if (!sdap_access_filter_match(ldb, tree->u.list.elements[i],
+                                          entry)) {
+                return false;
+            }
+        }
+        return true;
+    case LDB_OP_OR:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            if (sdap_access_filter_match(ldb, tree->u.list.elements[i],
+                                         entry)) {
+                return true;
+            }
+        }
+        return false;
+    case LDB_OP_PRESENT:
+        el = ldb_msg_find_element(entry, tree->u.present.attr);
+        return el != NULL && el->num_values > 0;
+    case LDB_OP_EQUALITY:
+        el = ldb_msg_find_element(entry, tree->u.equality.attr);
+        break;
+    case LDB_OP_GREATER:
+    case LDB_OP_LESS:
+        el = ldb_msg_find_element(entry, tree->u.comparison.attr);
+        break;
+    case LDB_OP_SUBSTRING:
+        el = ldb_msg_find_element(entry, tree->u.substring.attr);
+        break;
+    default:
+        return false;
+    }
+
+    if (el == NULL) {
+        return false;
+    }
+
+    for (i = 0; i < el->num_values; i++) {
+        switch (tree->operation) {
+        case LDB_OP_EQUALITY:
+            if (strcasecmp(tree->u.equality.attr, SYSDB_ORIG_MEMBEROF) == 0) {
+                if (sdap_access_dn_equal(ldb, &el->values[i],
+                                         &tree->u.equality.value)) {
+                    return true;
+                }
+            } else if (sdap_access_val_equal(&el->values[i],
+                                             &tree->u.equality.value)) {
+                return true;
+            }
+            break;
+        case LDB_OP_GREATER:
+            if (sdap_access_val_cmp(&el->values[i],
+                                    &tree->u.comparison.value) >= 0) {
+                return true;
+            }
+            break;
+        case LDB_OP_LESS:
+            if (sdap_access_val_cmp(&el->values[i],
+                                    &tree->u.comparison.value) <= 0) {
+                return true;
+            }
+            break;
+        default:
+            if (sdap_access_val_substring(&el->values[i], tree)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
 struct sdap_access_filter_req_ctx {
     const char *username;
     const char *filter;
@@ -808,6 +1139,8 @@ struct sdap_access_filter_req_ctx {
 };
 
 static errno_t sdap_access_decide_offline(bool cached_ac);
+static errno_t sdap_access_filter_decide(struct sdap_access_filter_req_ctx *state,
+                                         bool found);
 static int sdap_access_filter_retry(struct tevent_req *req);
 static void sdap_access_ppolicy_connect_done(struct tevent_req *subreq);
 static errno_t sdap_access_ppolicy_get_lockout_step(struct tevent_req *req);
@@ -862,6 +1195,20 @@ static struct tevent_req *sdap_access_filter_send(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    /* As long as the cached entry is valid it holds what the server would
+     * compare the filter with */
+    if (access_ctx->compiled_filter != NULL
+            && access_ctx->compiled_filter->tree != NULL
+            && ldb_msg_find_attr_as_uint64(user_entry, SYSDB_CACHE_EXPIRE, 0)
+                    > time(NULL)) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Checking filter against the cache\n");
+        ret = sdap_access_filter_decide(state,
+                    sdap_access_filter_match(sysdb_ctx_get_ldb(domain->sysdb),
+                                             access_ctx->compiled_filter->tree,
+                                             user_entry));
+        goto done;
+    }
+
     ret = sdap_get_basedn_user_entry(user_entry, state->username,
                                      &state->basedn);
     if (ret != EOK) {
@@ -1070,28 +1417,7 @@ static void sdap_access_filter_done(struct tevent_req *subreq)
         found = true;
     }
 
-    if (found) {
-        /* Save "allow" to the cache for future offline access checks. */
-        DEBUG(SSSDBG_TRACE_FUNC, "Access granted by online lookup\n");
-        ret = EOK;
-    }
-    else {
-        /* Save "disallow" to the cache for future offline
-         * access checks.
-         */
-        DEBUG(SSSDBG_TRACE_FUNC, "Access denied by online lookup\n");
-        ret = ERR_ACCESS_DENIED;
-    }
-
-    tret = sdap_save_user_cache_bool(state->domain, state->username,
-                                     SYSDB_LDAP_ACCESS_FILTER, found);
-    if (tret != EOK) {
-        /* Failing to save to the cache is non-fatal.
-         * Just return the result.
-         */
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to set user access attribute\n");
-        goto done;
-    }
+    ret = sdap_access_filter_decide(state, found);
 
 done:
     if (ret == EOK) {
@@ -1102,6 +1428,34 @@ done:
     }
 }
 
+static errno_t sdap_access_filter_decide(struct sdap_access_filter_req_ctx *state,
+                                         bool found)
+{
+    errno_t ret;
+
+    if (found) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Access granted by the filter\n");
+    } else {
+        DEBUG(SSSDBG_TRACE_FUNC, "Access denied by the filter\n");
+    }
+
+    /* Save the result to the cache for future offline access checks,
+     * a missing attribute means "disallow" */
+    if (found != state->cached_access) {
+        ret = sdap_save_user_cache_bool(state->domain, state->username,
+                                        SYSDB_LDAP_ACCESS_FILTER, found);
+        if (ret != EOK) {
+            /* Failing to save to the cache is non-fatal.
+             * Just return the result.
+             */
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Failed to set user access attribute\n");
+        }
+    }
+
+    return found ? EOK : ERR_ACCESS_DENIED;
+}
+
 static errno_t sdap_access_filter_recv(struct tevent_req *req)
 {
     TEVENT_REQ_RETURN_ON_ERROR(req);
@@ -69,12 +69,34 @@ enum ldap_access_rule {
     LDAP_ACCESS_LAST
 };
 
+/* An access filter prepared for the evaluation against the cached user
+ * entry. The tree uses the names of the cached attributes, it is NULL if
+ * the filter can only be evaluated by the server. */
+struct sdap_access_filter {
+    const char *filter;
+    struct ldb_parse_tree *tree;
+};
+
 struct sdap_access_ctx {
     struct sdap_id_ctx *id_ctx;
     const char *filter;
+    /* the compiled form of filter, may be NULL */
+    struct sdap_access_filter *compiled_filter;
     int access_rule[LDAP_ACCESS_LAST + 1];
 };
 
+/* The filter must already be enclosed in parentheses, it is referenced and
+ * not copied. A filter which cannot be parsed or which contains a negation
+ * is left to the server. */
+errno_t sdap_access_filter_compile(TALLOC_CTX *mem_ctx,
+                                   struct sdap_options *opts,
+                                   const char *filter,
+                                   struct sdap_access_filter **_compiled);
+
+bool sdap_access_filter_match(struct ldb_context *ldb,
+                              struct ldb_parse_tree *tree,
+                              struct ldb_message *entry);
+
 struct tevent_req *
 sdap_access_send(TALLOC_CTX *mem_ctx,
                  struct tevent_context *ev,
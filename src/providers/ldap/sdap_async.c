@@ -24,6 +24,8 @@
 #include "util/util.h"
 #include "util/strtonum.h"
 #include "providers/ldap/sdap_async_private.h"
+#include "providers/ldap/sdap_range.h"
+#include "util/probes.h"
 
 #define REPLY_REALLOC_INCREMENT 10
 
@@ -51,6 +53,8 @@ static int sdap_msg_attach(TALLOC_CTX *memctx, LDAPMessage *msg)
 
 static inline void sdap_handle_release(struct sdap_handle *sh);
 static int sdap_handle_destructor(void *mem);
+static void sdap_sched_release(struct sdap_handle *sh);
+static void sdap_sched_kick(struct sdap_handle *sh, struct tevent_context *ev);
 
 struct sdap_handle *sdap_handle_create(TALLOC_CTX *memctx)
 {
@@ -59,6 +63,9 @@ struct sdap_handle *sdap_handle_create(TALLOC_CTX *memctx)
     sh = talloc_zero(memctx, struct sdap_handle);
     if (!sh) return NULL;
 
+    sh->stats.created = time(NULL);
+    sh->stats.last_summary = sh->stats.created;
+
     talloc_set_destructor((TALLOC_CTX *)sh, sdap_handle_destructor);
 
     return sh;
@@ -105,6 +112,8 @@ static void sdap_handle_release(struct sdap_handle *sh)
         if (op == sh->ops) talloc_free(op);
     }
 
+    sdap_sched_release(sh);
+
     if (sh->ldap) {
         ldap_unbind_ext(sh->ldap, NULL, NULL);
         sh->ldap = NULL;
@@ -174,6 +183,7 @@ static void sdap_process_result(struct tevent_context *ev, void *pvt)
         ldap_get_option(sh->ldap, LDAP_OPT_RESULT_CODE, &ret);
         DEBUG(SSSDBG_OP_FAILURE,
               "ldap_result error: [%s]\n", ldap_err2string(ret));
+        sdap_handle_set_end(sh, SDAP_END_ERROR);
         sdap_handle_release(sh);
         return;
     }
@@ -251,6 +261,47 @@ static const char *sdap_ldap_result_str(int msgtype)
     return "Unknown result type!";
 }
 
+/* The counters of the back end the connection belongs to, NULL outside of
+ * a back end, e.g. in the tests */
+static struct be_ldap_stats *sdap_handle_be_stats(struct sdap_handle *sh)
+{
+    struct be_ctx *be_ctx;
+
+    be_ctx = be_ctx_find(sh);
+    return be_ctx == NULL ? NULL : &be_ctx->ldap_stats;
+}
+
+static void sdap_op_account_result(struct sdap_handle *sh, struct sdap_op *op)
+{
+    struct be_ldap_stats *be_stats;
+    struct timeval now;
+    int64_t usec;
+
+    gettimeofday(&now, NULL);
+    usec = (now.tv_sec - op->start.tv_sec) * 1000000LL
+                + now.tv_usec - op->start.tv_usec;
+    if (usec < 0) {
+        usec = 0;
+    }
+
+    sh->stats.results++;
+    sh->stats.total_usec += usec;
+    if (usec > sh->stats.max_usec) {
+        sh->stats.max_usec = usec;
+    }
+
+    be_stats = sdap_handle_be_stats(sh);
+    if (be_stats != NULL) {
+        be_stats->results++;
+        be_stats->total_usec += usec;
+        if (usec > be_stats->max_usec) {
+            be_stats->max_usec = usec;
+        }
+    }
+
+    be_req_add_ldap_op(be_req_find(op), usec);
+}
+
 /* process a messgae calling the right operation callback.
  * msg is completely taken care of (including freeeing it)
  * NOTE: this function may even end up freeing the sdap_handle
@@ -296,11 +347,17 @@ static void sdap_process_message(struct tevent_context *ev,
 
     DEBUG(SSSDBG_TRACE_ALL,
           "Message type: [%s]\n", sdap_ldap_result_str(msgtype));
+    PROBE(SDAP_OP_RESULT, op, msgid, msgtype);
 
     switch (msgtype) {
     case LDAP_RES_SEARCH_ENTRY:
     case LDAP_RES_SEARCH_REFERENCE:
-        /* go and process entry */
+        sh->stats.entries++;
+        break;
+
+    case LDAP_RES_INTERMEDIATE:
+        /* go and process entry, the final response follows the
+         * intermediate ones */
         break;
 
     case LDAP_RES_BIND:
@@ -311,9 +368,9 @@ static void sdap_process_message(struct tevent_context *ev,
     case LDAP_RES_MODDN:
     case LDAP_RES_COMPARE:
     case LDAP_RES_EXTENDED:
-    case LDAP_RES_INTERMEDIATE:
         /* no more results expected with this msgid */
         op->done = true;
+        sdap_op_account_result(sh, op);
         break;
 
     default:
@@ -403,9 +460,17 @@ static int sdap_op_destructor(void *mem)
     struct sdap_op *op = (struct sdap_op *)mem;
 
     DLIST_REMOVE(op->sh->ops, op);
+    op->sh->stats.outstanding--;
+    PROBE(SDAP_OP_DONE, op, op->msgid, op->done);
+
+    if (op->sched) {
+        op->sh->sched_stats.outstanding--;
+        sdap_sched_kick(op->sh, op->ev);
+    }
 
     if (op->done) {
-        DEBUG(SSSDBG_TRACE_INTERNAL, "Operation %d finished\n", op->msgid);
+        DEBUG(SSSDBG_TRACE_INTERNAL, "[RID#%u] Operation %d finished\n",
+              op->req_id, op->msgid);
         return 0;
     }
 
@@ -422,6 +487,7 @@ static int sdap_op_destructor(void *mem)
 static void sdap_op_timeout(struct tevent_req *req)
 {
     struct sdap_op *op = tevent_req_callback_data(req, struct sdap_op);
+    struct be_ldap_stats *be_stats;
 
     /* should never happen, but just in case */
     if (op->done) {
@@ -431,6 +497,11 @@ static void sdap_op_timeout(struct tevent_req *req)
 
     /* signal the caller that we have a timeout */
     DEBUG(SSSDBG_TRACE_LIBS, "Issuing timeout for %d\n", op->msgid);
+    op->sh->stats.timeouts++;
+    be_stats = sdap_handle_be_stats(op->sh);
+    if (be_stats != NULL) {
+        be_stats->timeouts++;
+    }
     op->callback(op, NULL, ETIMEDOUT, op->data);
 }
 
@@ -439,6 +510,7 @@ int sdap_op_add(TALLOC_CTX *memctx, struct tevent_context *ev,
                 sdap_op_callback_t *callback, void *data,
                 int timeout, struct sdap_op **_op)
 {
+    struct be_ldap_stats *be_stats;
     struct sdap_op *op;
 
     op = talloc_zero(memctx, struct sdap_op);
@@ -449,9 +521,11 @@ int sdap_op_add(TALLOC_CTX *memctx, struct tevent_context *ev,
     op->callback = callback;
     op->data = data;
     op->ev = ev;
+    gettimeofday(&op->start, NULL);
+    op->req_id = be_req_get_id(be_req_find(memctx));
 
-    DEBUG(SSSDBG_TRACE_INTERNAL,
-          "New operation %d timeout %d\n", op->msgid, timeout);
+    DEBUG(SSSDBG_TRACE_INTERNAL, "[RID#%u] New operation %d timeout %d\n",
+          op->req_id, op->msgid, timeout);
 
     /* check if we need to set a timeout */
     if (timeout) {
@@ -471,6 +545,17 @@ int sdap_op_add(TALLOC_CTX *memctx, struct tevent_context *ev,
     }
 
     DLIST_ADD(sh->ops, op);
+    PROBE(SDAP_OP_ADD, op, msgid);
+
+    sh->stats.ops++;
+    be_stats = sdap_handle_be_stats(sh);
+    if (be_stats != NULL) {
+        be_stats->ops++;
+    }
+    sh->stats.outstanding++;
+    if (sh->stats.outstanding > sh->stats.max_outstanding) {
+        sh->stats.max_outstanding = sh->stats.outstanding;
+    }
 
     talloc_set_destructor((TALLOC_CTX *)op, sdap_op_destructor);
 
@@ -478,6 +563,332 @@ int sdap_op_add(TALLOC_CTX *memctx, struct tevent_context *ev,
     return EOK;
 }
 
+/* ==Search-Scheduler===================================================== */
+
+/* When ldap_max_outstanding_ops is set, at most that many searches are sent
+ * over a connection at once. The others wait in one queue per class and are
+ * sent when an outstanding search finishes, the queue of the class with the
+ * highest priority first. Each page of a paged search waits again, so a
+ * long enumeration lets the lookups through between its pages. */
+
+typedef void (sdap_sched_fn)(void *pvt, errno_t ret);
+
+struct sdap_sched_wait {
+    struct sdap_sched_wait *prev, *next;
+    struct sdap_handle *sh;
+    enum sdap_op_class op_class;
+
+    sdap_sched_fn *fn;
+    void *pvt;
+};
+
+/* The requests which decide the class of all the searches they issue mark
+ * their state with sdap_op_class_set(). The searches of the other requests
+ * are single object lookups. */
+struct sdap_op_class_mark {
+    struct sdap_op_class_mark *prev, *next;
+    const void *ctx;
+    enum sdap_op_class op_class;
+};
+
+static struct sdap_op_class_mark *sdap_op_class_marks;
+
+static int sdap_op_class_mark_destructor(struct sdap_op_class_mark *mark)
+{
+    DLIST_REMOVE(sdap_op_class_marks, mark);
+    return 0;
+}
+
+void sdap_op_class_set(TALLOC_CTX *state, enum sdap_op_class op_class)
+{
+    struct sdap_op_class_mark *mark;
+
+    mark = talloc_zero(state, struct sdap_op_class_mark);
+    if (mark == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Out of memory, the searches are scheduled as lookups\n");
+        return;
+    }
+
+    mark->ctx = state;
+    mark->op_class = op_class;
+
+    DLIST_ADD(sdap_op_class_marks, mark);
+    talloc_set_destructor(mark, sdap_op_class_mark_destructor);
+}
+
+/* The class of the nearest marked talloc ancestor of the search request */
+static enum sdap_op_class sdap_op_class_from_ctx(TALLOC_CTX *mem_ctx)
+{
+    struct sdap_op_class_mark *mark;
+
+    if (sdap_op_class_marks == NULL) {
+        return SDAP_OP_CLASS_LOOKUP;
+    }
+
+    for (; mem_ctx != NULL; mem_ctx = talloc_parent(mem_ctx)) {
+        DLIST_FOR_EACH(mark, sdap_op_class_marks) {
+            if (mark->ctx == mem_ctx) {
+                return mark->op_class;
+            }
+        }
+    }
+
+    return SDAP_OP_CLASS_LOOKUP;
+}
+
+static int sdap_sched_wait_destructor(struct sdap_sched_wait *wait)
+{
+    if (wait->sh != NULL) {
+        DLIST_REMOVE(wait->sh->sched_queue[wait->op_class], wait);
+        wait->sh->sched_stats.queued[wait->op_class]--;
+    }
+
+    return 0;
+}
+
+/* Check whether a search of the class must wait for a free slot */
+static bool sdap_sched_must_wait(struct sdap_handle *sh,
+                                 enum sdap_op_class op_class,
+                                 int limit)
+{
+    int i;
+
+    sh->sched_limit = limit;
+    if (limit <= 0) {
+        return false;
+    }
+
+    if (sh->sched_stats.outstanding >= limit) {
+        return true;
+    }
+
+    /* do not overtake the searches which are already waiting */
+    for (i = 0; i <= op_class; i++) {
+        if (sh->sched_queue[i] != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static struct sdap_sched_wait *sdap_sched_enqueue(TALLOC_CTX *mem_ctx,
+                                                  struct sdap_handle *sh,
+                                                  enum sdap_op_class op_class,
+                                                  sdap_sched_fn *fn,
+                                                  void *pvt)
+{
+    struct sdap_sched_wait *wait;
+    struct sdap_sched_stats *stats = &sh->sched_stats;
+
+    wait = talloc_zero(mem_ctx, struct sdap_sched_wait);
+    if (wait == NULL) {
+        return NULL;
+    }
+
+    wait->sh = sh;
+    wait->op_class = op_class;
+    wait->fn = fn;
+    wait->pvt = pvt;
+
+    DLIST_ADD_END(sh->sched_queue[op_class], wait, struct sdap_sched_wait *);
+    talloc_set_destructor(wait, sdap_sched_wait_destructor);
+
+    stats->queued[op_class]++;
+    stats->total_queued[op_class]++;
+    if (stats->queued[op_class] > stats->max_queued[op_class]) {
+        stats->max_queued[op_class] = stats->queued[op_class];
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Search of class %d waits, %d outstanding, %d queued\n",
+          op_class, stats->outstanding, stats->queued[op_class]);
+
+    return wait;
+}
+
+static void sdap_sched_sent(struct sdap_handle *sh, struct sdap_op *op)
+{
+    if (sh->sched_limit <= 0) {
+        return;
+    }
+
+    op->sched = true;
+    sh->sched_stats.outstanding++;
+    if (sh->sched_stats.outstanding > sh->sched_stats.max_outstanding) {
+        sh->sched_stats.max_outstanding = sh->sched_stats.outstanding;
+    }
+}
+
+static struct sdap_sched_wait *sdap_sched_next(struct sdap_handle *sh)
+{
+    struct sdap_sched_wait *wait;
+    int i;
+
+    for (i = 0; i < SDAP_OP_CLASS_NUM; i++) {
+        wait = sh->sched_queue[i];
+        if (wait != NULL) {
+            DLIST_REMOVE(sh->sched_queue[i], wait);
+            sh->sched_stats.queued[i]--;
+            wait->sh = NULL;
+            return wait;
+        }
+    }
+
+    return NULL;
+}
+
+/* Sends one waiting search per event loop iteration, sending it may free
+ * the handle */
+static void sdap_sched_dispatch(struct tevent_context *ev,
+                                struct tevent_timer *te,
+                                struct timeval tv, void *pvt)
+{
+    struct sdap_handle *sh = talloc_get_type(pvt, struct sdap_handle);
+    struct sdap_sched_wait *wait;
+
+    sh->sched_timer = NULL;
+
+    if (sh->sched_stats.outstanding >= sh->sched_limit) {
+        return;
+    }
+
+    wait = sdap_sched_next(sh);
+    if (wait == NULL) {
+        return;
+    }
+
+    sdap_sched_kick(sh, ev);
+
+    wait->fn(wait->pvt, sh->connected ? EOK : EIO);
+}
+
+static void sdap_sched_kick(struct sdap_handle *sh, struct tevent_context *ev)
+{
+    struct timeval tv = { 0, 0 };
+    int i;
+
+    if (sh->sched_timer != NULL || sh->destructor_lock) {
+        return;
+    }
+
+    if (sh->sched_stats.outstanding >= sh->sched_limit) {
+        return;
+    }
+
+    for (i = 0; i < SDAP_OP_CLASS_NUM; i++) {
+        if (sh->sched_queue[i] != NULL) {
+            break;
+        }
+    }
+    if (i == SDAP_OP_CLASS_NUM) {
+        return;
+    }
+
+    sh->sched_timer = tevent_add_timer(ev, sh, tv, sdap_sched_dispatch, sh);
+    if (sh->sched_timer == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to add timer to send the waiting searches!\n");
+    }
+}
+
+/* Fails the waiting searches when the connection is released */
+static void sdap_sched_release(struct sdap_handle *sh)
+{
+    struct sdap_sched_stats *stats = &sh->sched_stats;
+    struct sdap_sched_wait *wait;
+
+    if (stats->max_outstanding > 0) {
+        DEBUG(SSSDBG_FUNC_DATA,
+              "Searches which waited (auth/lookup/refresh/enum): "
+              "%"PRIu64"/%"PRIu64"/%"PRIu64"/%"PRIu64", longest queues: "
+              "%d/%d/%d/%d\n",
+              stats->total_queued[SDAP_OP_CLASS_AUTH],
+              stats->total_queued[SDAP_OP_CLASS_LOOKUP],
+              stats->total_queued[SDAP_OP_CLASS_REFRESH],
+              stats->total_queued[SDAP_OP_CLASS_ENUM],
+              stats->max_queued[SDAP_OP_CLASS_AUTH],
+              stats->max_queued[SDAP_OP_CLASS_LOOKUP],
+              stats->max_queued[SDAP_OP_CLASS_REFRESH],
+              stats->max_queued[SDAP_OP_CLASS_ENUM]);
+    }
+
+    talloc_zfree(sh->sched_timer);
+
+    while ((wait = sdap_sched_next(sh)) != NULL) {
+        wait->fn(wait->pvt, EIO);
+    }
+}
+
+void sdap_sched_get_stats(struct sdap_handle *sh,
+                          struct sdap_sched_stats *stats)
+{
+    *stats = sh->sched_stats;
+}
+
+/* ==Connection-Statistics=============================================== */
+
+const char *sdap_handle_end_str(enum sdap_handle_end end)
+{
+    switch (end) {
+    case SDAP_END_NONE:
+        return "other";
+    case SDAP_END_ERROR:
+        return "error";
+    case SDAP_END_EXPIRED:
+        return "expired";
+    case SDAP_END_IDLE:
+        return "idle";
+    case SDAP_END_KEEPALIVE:
+        return "keepalive";
+    case SDAP_END_OFFLINE:
+        return "offline";
+    case SDAP_END_FAILBACK:
+        return "reconnect";
+    case SDAP_END_NUM:
+        break;
+    }
+
+    return "unknown";
+}
+
+void sdap_handle_set_end(struct sdap_handle *sh, enum sdap_handle_end end)
+{
+    /* the first reason is the one which closed it */
+    if (sh->stats.end == SDAP_END_NONE) {
+        sh->stats.end = end;
+    }
+}
+
+void sdap_handle_log_stats(struct sdap_handle *sh, int level, const char *uri)
+{
+    struct sdap_handle_stats *stats = &sh->stats;
+    time_t now = time(NULL);
+    uint64_t avg_usec;
+    double rate;
+
+    avg_usec = stats->results ? stats->total_usec / stats->results : 0;
+    rate = now > stats->last_summary
+               ? (double)(stats->results - stats->last_results)
+                     / (now - stats->last_summary)
+               : 0;
+
+    DEBUG(level, "Connection to [%s]: up %lds, %d outstanding (at most "
+          "%d), %"PRIu64" operations, %"PRIu64" results (%.2f/s), "
+          "%"PRIu64" entries, %"PRIu64" timeouts, average %"PRIu64"ms "
+          "(at most %"PRIu64"ms), %"PRIu64" bytes read%s%s\n",
+          uri ? uri : "unknown", (long)(now - stats->created),
+          stats->outstanding, stats->max_outstanding, stats->ops,
+          stats->results, rate, stats->entries, stats->timeouts,
+          avg_usec / 1000, stats->max_usec / 1000, stats->bytes_read,
+          sh->connected ? "" : ", closed: ",
+          sh->connected ? "" : sdap_handle_end_str(stats->end));
+
+    stats->last_summary = now;
+    stats->last_results = stats->results;
+}
+
 /* ==Modify-Password====================================================== */
 
 struct sdap_exop_modify_passwd_state {
@@ -1152,6 +1563,13 @@ struct sdap_get_generic_ext_state {
 
     struct berval cookie;
 
+    /* the page size grows on slow links, see
+     * sdap_get_generic_ext_adapt_page() */
+    int page_size;
+    int page_entries;
+    struct timeval page_sent;
+    struct timeval page_first;
+
     LDAPControl **serverctrls;
     int nserverctrls;
     LDAPControl **clientctrls;
@@ -1163,9 +1581,13 @@ struct sdap_get_generic_ext_state {
     void *cb_data;
 
     unsigned int flags;
+
+    enum sdap_op_class op_class;
+    struct sdap_sched_wait *wait;
 };
 
 static errno_t sdap_get_generic_ext_step(struct tevent_req *req);
+static errno_t sdap_get_generic_ext_search(struct tevent_req *req);
 
 static void sdap_get_generic_op_finished(struct sdap_op *op,
                                          struct sdap_msg *reply,
@@ -1225,6 +1647,12 @@ sdap_get_generic_ext_send(TALLOC_CTX *memctx,
     state->clientctrls = clientctrls;
     state->flags = flags;
 
+    if (dp_opt_get_int(opts->basic, SDAP_MAX_OUTSTANDING_OPS) > 0) {
+        state->op_class = sdap_op_class_from_ctx(memctx);
+    } else {
+        state->op_class = SDAP_OP_CLASS_LOOKUP;
+    }
+
     if (state->sh == NULL || state->sh->ldap == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Trying LDAP search while not connected.\n");
@@ -1232,6 +1660,7 @@ sdap_get_generic_ext_send(TALLOC_CTX *memctx,
         tevent_req_post(req, ev);
         return req;
     }
+    state->page_size = sh->page_size;
 
     sdap_print_server(sh);
 
@@ -1292,7 +1721,50 @@ sdap_get_generic_ext_send(TALLOC_CTX *memctx,
     return req;
 }
 
+static void sdap_get_generic_ext_sched_done(void *pvt, errno_t ret)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct sdap_get_generic_ext_state *state =
+            tevent_req_data(req, struct sdap_get_generic_ext_state);
+
+    talloc_zfree(state->wait);
+
+    if (ret == EOK) {
+        ret = sdap_get_generic_ext_search(req);
+    }
+
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+    }
+}
+
 static errno_t sdap_get_generic_ext_step(struct tevent_req *req)
+{
+    struct sdap_get_generic_ext_state *state =
+            tevent_req_data(req, struct sdap_get_generic_ext_state);
+    int limit;
+
+    /* Make sure to free any previous operations so
+     * if we are handling a large number of pages we
+     * don't waste memory.
+     */
+    talloc_zfree(state->op);
+
+    limit = dp_opt_get_int(state->opts->basic, SDAP_MAX_OUTSTANDING_OPS);
+    if (sdap_sched_must_wait(state->sh, state->op_class, limit)) {
+        state->wait = sdap_sched_enqueue(state, state->sh, state->op_class,
+                                         sdap_get_generic_ext_sched_done, req);
+        if (state->wait == NULL) {
+            return ENOMEM;
+        }
+
+        return EOK;
+    }
+
+    return sdap_get_generic_ext_search(req);
+}
+
+static errno_t sdap_get_generic_ext_search(struct tevent_req *req)
 {
     struct sdap_get_generic_ext_state *state =
             tevent_req_data(req, struct sdap_get_generic_ext_state);
@@ -1305,12 +1777,6 @@ static errno_t sdap_get_generic_ext_step(struct tevent_req *req)
 
     LDAPControl *page_control = NULL;
 
-    /* Make sure to free any previous operations so
-     * if we are handling a large number of pages we
-     * don't waste memory.
-     */
-    talloc_zfree(state->op);
-
     DEBUG(SSSDBG_TRACE_FUNC,
          "calling ldap_search_ext with [%s][%s].\n",
           state->filter ? state->filter : "no filter",
@@ -1333,7 +1799,7 @@ static errno_t sdap_get_generic_ext_step(struct tevent_req *req)
             && sdap_is_control_supported(state->sh,
                                          LDAP_CONTROL_PAGEDRESULTS)) {
         lret = ldap_create_page_control(state->sh->ldap,
-                                        state->sh->page_size,
+                                        state->page_size,
                                         state->cookie.bv_val ?
                                             &state->cookie :
                                             NULL,
@@ -1379,6 +1845,9 @@ static errno_t sdap_get_generic_ext_step(struct tevent_req *req)
     }
     DEBUG(SSSDBG_TRACE_INTERNAL, "ldap_search_ext called, msgid = %d\n", msgid);
 
+    state->page_sent = tevent_timeval_current();
+    state->page_entries = 0;
+
     ret = sdap_op_add(state, state->ev, state->sh, msgid,
                       sdap_get_generic_op_finished, req,
                       state->timeout,
@@ -1388,6 +1857,8 @@ static errno_t sdap_get_generic_ext_step(struct tevent_req *req)
         goto done;
     }
 
+    sdap_sched_sent(state->sh, state->op);
+
 done:
     return ret;
 }
@@ -1433,6 +1904,43 @@ sdap_get_generic_ext_add_references(struct sdap_get_generic_ext_state *state,
     return EOK;
 }
 
+static int64_t sdap_timeval_usec(struct timeval *from, struct timeval *to)
+{
+    return (int64_t)(to->tv_sec - from->tv_sec) * 1000000
+           + (to->tv_usec - from->tv_usec);
+}
+
+/* The next page of a paged search can only be requested with the cookie
+ * of the current one. When the round trip, the time until the first entry
+ * of the page arrived, took more than a quarter of the time of the page,
+ * the page size is doubled up to ldap_page_size_max. A page shorter than
+ * requested means that the server limits the page size. */
+static void
+sdap_get_generic_ext_adapt_page(struct sdap_get_generic_ext_state *state)
+{
+    struct timeval now;
+    int64_t rtt;
+    int64_t total;
+    int max;
+
+    max = dp_opt_get_int(state->opts->basic, SDAP_PAGE_SIZE_MAX);
+    if (max <= state->page_size || state->page_entries < state->page_size) {
+        return;
+    }
+
+    now = tevent_timeval_current();
+    rtt = sdap_timeval_usec(&state->page_sent, &state->page_first);
+    total = sdap_timeval_usec(&state->page_sent, &now);
+    if (rtt * 4 <= total) {
+        return;
+    }
+
+    state->page_size = state->page_size > max / 2 ? max
+                                                  : state->page_size * 2;
+    DEBUG(SSSDBG_TRACE_FUNC, "Round trip took %"PRId64" of %"PRId64" us, "
+          "increasing the page size to %d\n", rtt, total, state->page_size);
+}
+
 static void sdap_get_generic_op_finished(struct sdap_op *op,
                                          struct sdap_msg *reply,
                                          int error, void *pvt)
@@ -1484,6 +1992,10 @@ static void sdap_get_generic_op_finished(struct sdap_op *op,
         break;
 
     case LDAP_RES_SEARCH_ENTRY:
+        if (state->page_entries++ == 0) {
+            state->page_first = tevent_timeval_current();
+        }
+
         ret = state->parse_cb(state->sh, reply, state->cb_data);
         if (ret != EOK) {
             DEBUG(SSSDBG_CRIT_FAILURE, "reply parsing callback failed.\n");
@@ -1494,6 +2006,13 @@ static void sdap_get_generic_op_finished(struct sdap_op *op,
         sdap_unlock_next_reply(state->op);
         break;
 
+    case LDAP_RES_INTERMEDIATE:
+        /* the search continues with the next message, e.g. when the
+         * server sends a sync info message */
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Ignoring an intermediate response\n");
+        sdap_unlock_next_reply(state->op);
+        break;
+
     case LDAP_RES_SEARCH_RESULT:
         ret = ldap_parse_result(state->sh->ldap, reply->msg,
                                 &result, NULL, &errmsg, &refs,
@@ -1587,6 +2106,8 @@ static void sdap_get_generic_op_finished(struct sdap_op *op,
             }
             ber_memfree(cookie.bv_val);
 
+            sdap_get_generic_ext_adapt_page(state);
+
             ret = sdap_get_generic_ext_step(req);
             if (ret != EOK) {
                 tevent_req_error(req, ENOMEM);
@@ -2301,26 +2822,1346 @@ int sdap_sd_search_recv(struct tevent_req *req,
     return EOK;
 }
 
-/* ==Attribute scoped search============================================ */
-struct sdap_asq_search_state {
-    struct sdap_attr_map_info *maps;
-    int num_maps;
-    LDAPControl **ctrls;
+/* ==Content Synchronization search===================================== */
+/* A refreshAndPersist search (RFC 4533). The server sends the entries which
+ * changed since the cookie and signals the end of the refresh with a Sync
+ * Info message, then it keeps the search open and sends every change. The
+ * request only finishes when the search ends. */
+struct sdap_sync_search_state {
+    struct tevent_context *ev;
     struct sdap_options *opts;
+    struct sdap_handle *sh;
+    struct sdap_attr_map *map;
+    int map_num_attrs;
 
-    struct sdap_deref_reply dreply;
+    struct sdap_sync_handlers *handlers;
+    void *pvt;
+
+    LDAPControl **ctrls;
+    struct sdap_op *op;
 };
 
-static int sdap_asq_search_create_control(struct sdap_handle *sh,
-                                          const char *attr,
-                                          LDAPControl **ctrl);
-static int sdap_asq_search_ctrls_destructor(void *ptr);
-static errno_t sdap_asq_search_parse_entry(struct sdap_handle *sh,
-                                           struct sdap_msg *msg,
-                                           void *pvt);
-static void sdap_asq_search_done(struct tevent_req *subreq);
+static int sdap_sync_search_create_control(struct sdap_handle *sh,
+                                           struct berval *cookie,
+                                           LDAPControl **ctrl);
+static int sdap_sync_search_ctrls_destructor(void *ptr);
+static void sdap_sync_search_op_finished(struct sdap_op *op,
+                                         struct sdap_msg *reply,
+                                         int error, void *pvt);
 
-static struct tevent_req *
+struct tevent_req *
+sdap_sync_search_send(TALLOC_CTX *memctx,
+                      struct tevent_context *ev,
+                      struct sdap_options *opts,
+                      struct sdap_handle *sh,
+                      const char *search_base,
+                      int scope,
+                      const char *filter,
+                      const char **attrs,
+                      struct sdap_attr_map *map,
+                      int map_num_attrs,
+                      struct berval *cookie,
+                      struct sdap_sync_handlers *handlers,
+                      void *pvt)
+{
+    struct tevent_req *req;
+    struct sdap_sync_search_state *state;
+    int msgid;
+    int lret;
+    errno_t ret;
+
+    req = tevent_req_create(memctx, &state, struct sdap_sync_search_state);
+    if (req == NULL) return NULL;
+
+    state->ev = ev;
+    state->opts = opts;
+    state->sh = sh;
+    state->map = map;
+    state->map_num_attrs = map_num_attrs;
+    state->handlers = handlers;
+    state->pvt = pvt;
+
+    if (sh == NULL || sh->ldap == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Trying LDAP search while not connected.\n");
+        ret = EIO;
+        goto fail;
+    }
+
+    if (!sdap_is_control_supported(sh, LDAP_CONTROL_SYNC)) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "The server does not support content synchronization\n");
+        ret = ENOTSUP;
+        goto fail;
+    }
+
+    state->ctrls = talloc_zero_array(state, LDAPControl *, 2);
+    if (state->ctrls == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    talloc_set_destructor((TALLOC_CTX *) state->ctrls,
+                          sdap_sync_search_ctrls_destructor);
+
+    ret = sdap_sync_search_create_control(sh, cookie, &state->ctrls[0]);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not create the sync control\n");
+        goto fail;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Starting content synchronization of [%s][%s]%s\n",
+          filter, search_base, cookie != NULL ? " with a cookie" : "");
+
+    lret = ldap_search_ext(sh->ldap, search_base, scope, filter,
+                           discard_const(attrs), 0, state->ctrls, NULL,
+                           NULL, 0, &msgid);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "ldap_search_ext failed: %s\n", sss_ldap_err2string(lret));
+        ret = lret == LDAP_SERVER_DOWN ? ETIMEDOUT : EIO;
+        goto fail;
+    }
+
+    /* the search has no end, no timeout */
+    ret = sdap_op_add(state, ev, sh, msgid,
+                      sdap_sync_search_op_finished, req, 0, &state->op);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to set up operation!\n");
+        goto fail;
+    }
+
+    return req;
+
+fail:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static int sdap_sync_search_create_control(struct sdap_handle *sh,
+                                           struct berval *cookie,
+                                           LDAPControl **ctrl)
+{
+    struct berval *syncval;
+    BerElement *ber;
+    int ret;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    if (ber == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "ber_alloc_t failed.\n");
+        return ENOMEM;
+    }
+
+    ret = ber_printf(ber, "{e", LDAP_SYNC_REFRESH_AND_PERSIST);
+    if (ret != -1 && cookie != NULL && cookie->bv_len > 0) {
+        ret = ber_printf(ber, "O", cookie);
+    }
+    if (ret != -1) {
+        ret = ber_printf(ber, "N}");
+    }
+    if (ret == -1) {
+        DEBUG(SSSDBG_OP_FAILURE, "ber_printf failed.\n");
+        ber_free(ber, 1);
+        return EIO;
+    }
+
+    ret = ber_flatten(ber, &syncval);
+    ber_free(ber, 1);
+    if (ret == -1) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "ber_flatten failed.\n");
+        return EIO;
+    }
+
+    ret = sdap_control_create(sh, LDAP_CONTROL_SYNC, 1, syncval, 1, ctrl);
+    ber_bvfree(syncval);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_control_create failed\n");
+        return ret;
+    }
+
+    return EOK;
+}
+
+static int sdap_sync_search_ctrls_destructor(void *ptr)
+{
+    LDAPControl **ctrls = talloc_get_type(ptr, LDAPControl *);
+
+    if (ctrls && ctrls[0]) {
+        ldap_control_free(ctrls[0]);
+    }
+
+    return 0;
+}
+
+/* Reads the optional cookie of a sync value element */
+static errno_t sdap_sync_search_cookie(struct sdap_sync_search_state *state,
+                                       BerElement *ber)
+{
+    struct berval cookie;
+    ber_len_t len;
+
+    if (ber_peek_tag(ber, &len) != LDAP_TAG_SYNC_COOKIE) {
+        return EOK;
+    }
+
+    if (ber_scanf(ber, "m", &cookie) == LBER_ERROR) {
+        return EIO;
+    }
+
+    if (cookie.bv_len == 0 || state->handlers->cookie == NULL) {
+        return EOK;
+    }
+
+    return state->handlers->cookie(&cookie, state->pvt);
+}
+
+static errno_t sdap_sync_search_entry(struct sdap_sync_search_state *state,
+                                      struct sdap_msg *reply)
+{
+    TALLOC_CTX *tmp_ctx;
+    LDAPControl **ctrls = NULL;
+    LDAPControl *state_ctrl;
+    struct sysdb_attrs *attrs = NULL;
+    struct berval uuid;
+    BerElement *ber = NULL;
+    ber_int_t sync_state;
+    char *dn = NULL;
+    int lret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(state);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    lret = ldap_get_entry_controls(state->sh->ldap, reply->msg, &ctrls);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldap_get_entry_controls failed\n");
+        ret = EIO;
+        goto done;
+    }
+
+    state_ctrl = ldap_control_find(LDAP_CONTROL_SYNC_STATE, ctrls, NULL);
+    if (state_ctrl == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Entry without a sync state, ignoring\n");
+        ret = EOK;
+        goto done;
+    }
+
+    ber = ber_init(&state_ctrl->ldctl_value);
+    if (ber == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    if (ber_scanf(ber, "{em", &sync_state, &uuid) == LBER_ERROR) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot parse the sync state\n");
+        ret = EIO;
+        goto done;
+    }
+
+    dn = ldap_get_dn(state->sh->ldap, reply->msg);
+    if (dn == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Entry without a DN\n");
+        ret = EIO;
+        goto done;
+    }
+
+    switch (sync_state) {
+    case LDAP_SYNC_ADD:
+    case LDAP_SYNC_MODIFY:
+        ret = sdap_parse_entry(tmp_ctx, state->sh, reply,
+                               state->map, state->map_num_attrs, &attrs,
+                               dp_opt_get_bool(state->opts->basic,
+                                               SDAP_DISABLE_RANGE_RETRIEVAL));
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Cannot parse [%s], ignoring\n", dn);
+            ret = EOK;
+            goto done;
+        }
+        break;
+    case LDAP_SYNC_PRESENT:
+    case LDAP_SYNC_DELETE:
+        /* only the DN is sent */
+        break;
+    default:
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unknown sync state %d of [%s]\n",
+              sync_state, dn);
+        ret = EOK;
+        goto done;
+    }
+
+    ret = state->handlers->entry((enum sdap_sync_state) sync_state, dn, attrs,
+                                 state->pvt);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_sync_search_cookie(state, ber);
+
+done:
+    /* the handler may have kept attrs */
+    talloc_free(tmp_ctx);
+    ldap_memfree(dn);
+    if (ber != NULL) {
+        ber_free(ber, 1);
+    }
+    ldap_controls_free(ctrls);
+    return ret;
+}
+
+static errno_t sdap_sync_search_info(struct sdap_sync_search_state *state,
+                                     struct sdap_msg *reply)
+{
+    struct berval *data = NULL;
+    struct berval cookie;
+    char *oid = NULL;
+    BerElement *ber = NULL;
+    ber_tag_t tag;
+    ber_len_t len;
+    ber_int_t refresh_done = 1;
+    bool refreshed = false;
+    int lret;
+    errno_t ret;
+
+    lret = ldap_parse_intermediate(state->sh->ldap, reply->msg,
+                                   &oid, &data, NULL, 0);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldap_parse_intermediate failed\n");
+        return EIO;
+    }
+
+    if (oid == NULL || strcmp(oid, LDAP_SYNC_INFO) != 0 || data == NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Ignoring intermediate message [%s]\n",
+              oid ? oid : "no oid");
+        ret = EOK;
+        goto done;
+    }
+
+    ber = ber_init(data);
+    if (ber == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    tag = ber_peek_tag(ber, &len);
+    switch (tag) {
+    case LDAP_TAG_SYNC_NEW_COOKIE:
+        if (ber_scanf(ber, "m", &cookie) == LBER_ERROR) {
+            ret = EIO;
+            goto done;
+        }
+
+        if (cookie.bv_len > 0 && state->handlers->cookie != NULL) {
+            ret = state->handlers->cookie(&cookie, state->pvt);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+        break;
+    case LDAP_TAG_SYNC_REFRESH_DELETE:
+    case LDAP_TAG_SYNC_REFRESH_PRESENT:
+        if (ber_scanf(ber, "{") == LBER_ERROR) {
+            ret = EIO;
+            goto done;
+        }
+
+        ret = sdap_sync_search_cookie(state, ber);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        if (ber_peek_tag(ber, &len) == LDAP_TAG_REFRESHDONE
+                && ber_scanf(ber, "b", &refresh_done) == LBER_ERROR) {
+            ret = EIO;
+            goto done;
+        }
+        refreshed = refresh_done != 0;
+        break;
+    case LDAP_TAG_SYNC_ID_SET:
+        /* Only the entryUUIDs of the deleted or present entries are sent,
+         * the cache does not know the entries by entryUUID. The entries
+         * which are gone are removed by the cleanup task. */
+        if (ber_scanf(ber, "{") == LBER_ERROR) {
+            ret = EIO;
+            goto done;
+        }
+
+        ret = sdap_sync_search_cookie(state, ber);
+        if (ret != EOK) {
+            goto done;
+        }
+        break;
+    default:
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unknown sync info [%lu]\n",
+              (unsigned long) tag);
+        break;
+    }
+
+    if (refreshed) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Refresh phase done, persisting\n");
+        if (state->handlers->refreshed != NULL) {
+            state->handlers->refreshed(state->pvt);
+        }
+    }
+
+    ret = EOK;
+
+done:
+    if (ber != NULL) {
+        ber_free(ber, 1);
+    }
+    ldap_memfree(oid);
+    ber_bvfree(data);
+    return ret;
+}
+
+static errno_t sdap_sync_search_result(struct sdap_sync_search_state *state,
+                                       struct sdap_msg *reply)
+{
+    LDAPControl **ctrls = NULL;
+    LDAPControl *done_ctrl;
+    BerElement *ber = NULL;
+    char *errmsg = NULL;
+    int result;
+    int lret;
+    errno_t ret;
+
+    lret = ldap_parse_result(state->sh->ldap, reply->msg, &result,
+                             NULL, &errmsg, NULL, &ctrls, 0);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldap_parse_result failed\n");
+        return EIO;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Content synchronization ended: %s(%d), %s\n",
+          sss_ldap_err2string(result), result,
+          errmsg ? errmsg : "no errmsg set");
+
+    switch (result) {
+    case LDAP_SUCCESS:
+        done_ctrl = ldap_control_find(LDAP_CONTROL_SYNC_DONE, ctrls, NULL);
+        if (done_ctrl != NULL) {
+            ber = ber_init(&done_ctrl->ldctl_value);
+            if (ber != NULL && ber_scanf(ber, "{") != LBER_ERROR) {
+                ret = sdap_sync_search_cookie(state, ber);
+                if (ret != EOK) {
+                    goto done;
+                }
+            }
+        }
+        ret = EOK;
+        break;
+    case LDAP_SYNC_REFRESH_REQUIRED:
+        ret = ERR_SYNC_REFRESH_REQUIRED;
+        break;
+    case LDAP_UNAVAILABLE_CRITICAL_EXTENSION:
+        ret = ENOTSUP;
+        break;
+    default:
+        ret = EIO;
+        break;
+    }
+
+done:
+    if (ber != NULL) {
+        ber_free(ber, 1);
+    }
+    ldap_memfree(errmsg);
+    ldap_controls_free(ctrls);
+    return ret;
+}
+
+static void sdap_sync_search_op_finished(struct sdap_op *op,
+                                         struct sdap_msg *reply,
+                                         int error, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct sdap_sync_search_state *state = tevent_req_data(req,
+                                            struct sdap_sync_search_state);
+    errno_t ret;
+
+    if (error) {
+        tevent_req_error(req, error);
+        return;
+    }
+
+    switch (ldap_msgtype(reply->msg)) {
+    case LDAP_RES_SEARCH_ENTRY:
+        ret = sdap_sync_search_entry(state, reply);
+        break;
+    case LDAP_RES_INTERMEDIATE:
+        ret = sdap_sync_search_info(state, reply);
+        break;
+    case LDAP_RES_SEARCH_REFERENCE:
+        /* referrals are not followed */
+        ret = EOK;
+        break;
+    case LDAP_RES_SEARCH_RESULT:
+        ret = sdap_sync_search_result(state, reply);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+            return;
+        }
+        tevent_req_done(req);
+        return;
+    default:
+        /* what is going on here !? */
+        tevent_req_error(req, EIO);
+        return;
+    }
+
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    sdap_unlock_next_reply(state->op);
+}
+
+errno_t sdap_sync_search_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+/* ==AD Directory Synchronization search================================ */
+/* A subtree search with the AD DirSync control. The server sends the
+ * objects which changed since the cookie with only the changed attributes
+ * and the objectGUID, deleted objects are sent as tombstones. While the
+ * server has more changes the search is repeated with the new cookie. */
+struct sdap_dirsync_search_state {
+    struct tevent_context *ev;
+    struct sdap_handle *sh;
+    const char *base_dn;
+    const char *filter;
+    const char **attrs;
+    int timeout;
+    bool disable_range_retrieval;
+
+    sdap_dirsync_entry_fn entry_fn;
+    void *pvt;
+
+    struct berval cookie;
+    LDAPControl **ctrls;
+    struct sdap_op *op;
+};
+
+static errno_t sdap_dirsync_search_step(struct tevent_req *req);
+static int sdap_dirsync_search_ctrls_destructor(void *ptr);
+static void sdap_dirsync_search_op_finished(struct sdap_op *op,
+                                            struct sdap_msg *reply,
+                                            int error, void *pvt);
+
+struct tevent_req *
+sdap_dirsync_search_send(TALLOC_CTX *memctx,
+                         struct tevent_context *ev,
+                         struct sdap_options *opts,
+                         struct sdap_handle *sh,
+                         const char *base_dn,
+                         const char *filter,
+                         const char **attrs,
+                         struct berval *cookie,
+                         int timeout,
+                         sdap_dirsync_entry_fn entry_fn,
+                         void *pvt)
+{
+    struct tevent_req *req;
+    struct sdap_dirsync_search_state *state;
+    errno_t ret;
+
+    req = tevent_req_create(memctx, &state, struct sdap_dirsync_search_state);
+    if (req == NULL) return NULL;
+
+    state->ev = ev;
+    state->sh = sh;
+    state->base_dn = base_dn;
+    state->filter = filter;
+    state->attrs = attrs;
+    state->timeout = timeout;
+    state->entry_fn = entry_fn;
+    state->pvt = pvt;
+    state->disable_range_retrieval = dp_opt_get_bool(opts->basic,
+                                            SDAP_DISABLE_RANGE_RETRIEVAL);
+
+    if (sh == NULL || sh->ldap == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Trying LDAP search while not connected.\n");
+        ret = EIO;
+        goto fail;
+    }
+
+    if (!sdap_is_control_supported(sh, LDAP_SERVER_DIRSYNC_OID)) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "The server does not support directory synchronization\n");
+        ret = ENOTSUP;
+        goto fail;
+    }
+
+    if (cookie != NULL && cookie->bv_len > 0) {
+        state->cookie.bv_val = talloc_memdup(state, cookie->bv_val,
+                                             cookie->bv_len);
+        if (state->cookie.bv_val == NULL) {
+            ret = ENOMEM;
+            goto fail;
+        }
+        state->cookie.bv_len = cookie->bv_len;
+    }
+
+    ret = sdap_dirsync_search_step(req);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    return req;
+
+fail:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static int sdap_dirsync_search_create_control(struct sdap_handle *sh,
+                                              struct berval *cookie,
+                                              LDAPControl **ctrl)
+{
+    struct berval *value;
+    BerElement *ber;
+    int ret;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    if (ber == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "ber_alloc_t failed.\n");
+        return ENOMEM;
+    }
+
+    /* flags, maximum size of the reply (0 is the server limit), cookie */
+    ret = ber_printf(ber, "{iio}", LDAP_DIRSYNC_OBJECT_SECURITY, 0,
+                     cookie->bv_val ? cookie->bv_val : "", cookie->bv_len);
+    if (ret == -1) {
+        DEBUG(SSSDBG_OP_FAILURE, "ber_printf failed.\n");
+        ber_free(ber, 1);
+        return EIO;
+    }
+
+    ret = ber_flatten(ber, &value);
+    ber_free(ber, 1);
+    if (ret == -1) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "ber_flatten failed.\n");
+        return EIO;
+    }
+
+    ret = sdap_control_create(sh, LDAP_SERVER_DIRSYNC_OID, 1, value, 1, ctrl);
+    ber_bvfree(value);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_control_create failed\n");
+        return ret;
+    }
+
+    return EOK;
+}
+
+static int sdap_dirsync_search_ctrls_destructor(void *ptr)
+{
+    LDAPControl **ctrls = talloc_get_type(ptr, LDAPControl *);
+
+    if (ctrls && ctrls[0]) {
+        ldap_control_free(ctrls[0]);
+    }
+
+    return 0;
+}
+
+static errno_t sdap_dirsync_search_step(struct tevent_req *req)
+{
+    struct sdap_dirsync_search_state *state = tevent_req_data(req,
+                                            struct sdap_dirsync_search_state);
+    int msgid;
+    int lret;
+    errno_t ret;
+
+    /* the previous round is over */
+    talloc_zfree(state->op);
+    talloc_zfree(state->ctrls);
+
+    state->ctrls = talloc_zero_array(state, LDAPControl *, 2);
+    if (state->ctrls == NULL) {
+        return ENOMEM;
+    }
+    talloc_set_destructor((TALLOC_CTX *) state->ctrls,
+                          sdap_dirsync_search_ctrls_destructor);
+
+    ret = sdap_dirsync_search_create_control(state->sh, &state->cookie,
+                                             &state->ctrls[0]);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not create the DirSync control\n");
+        return ret;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Starting directory synchronization of [%s][%s]%s\n",
+          state->filter, state->base_dn,
+          state->cookie.bv_len > 0 ? " with a cookie" : "");
+
+    lret = ldap_search_ext(state->sh->ldap, state->base_dn,
+                           LDAP_SCOPE_SUBTREE, state->filter,
+                           discard_const(state->attrs), 0, state->ctrls,
+                           NULL, NULL, 0, &msgid);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "ldap_search_ext failed: %s\n", sss_ldap_err2string(lret));
+        return lret == LDAP_SERVER_DOWN ? ETIMEDOUT : EIO;
+    }
+
+    ret = sdap_op_add(state, state->ev, state->sh, msgid,
+                      sdap_dirsync_search_op_finished, req,
+                      state->timeout, &state->op);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to set up operation!\n");
+        return ret;
+    }
+
+    return EOK;
+}
+
+static errno_t sdap_dirsync_search_entry(struct sdap_dirsync_search_state *state,
+                                         struct sdap_msg *reply)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    if (state->entry_fn == NULL) {
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(state);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sdap_parse_entry(tmp_ctx, state->sh, reply, NULL, 0, &attrs,
+                           state->disable_range_retrieval);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot parse a changed entry\n");
+        goto done;
+    }
+
+    ret = state->entry_fn(attrs, state->pvt);
+
+done:
+    /* the handler may have kept attrs */
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Stores the new cookie, *_more tells if the server has more changes */
+static errno_t sdap_dirsync_search_result(struct sdap_dirsync_search_state *state,
+                                          struct sdap_msg *reply,
+                                          bool *_more)
+{
+    LDAPControl **ctrls = NULL;
+    LDAPControl *dirsync_ctrl;
+    BerElement *ber = NULL;
+    struct berval cookie;
+    ber_int_t more;
+    ber_int_t size;
+    char *errmsg = NULL;
+    int result;
+    int lret;
+    errno_t ret;
+
+    lret = ldap_parse_result(state->sh->ldap, reply->msg, &result,
+                             NULL, &errmsg, NULL, &ctrls, 0);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldap_parse_result failed\n");
+        return EIO;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Directory synchronization result: %s(%d), %s\n",
+          sss_ldap_err2string(result), result,
+          errmsg ? errmsg : "no errmsg set");
+
+    switch (result) {
+    case LDAP_SUCCESS:
+        break;
+    case LDAP_UNAVAILABLE_CRITICAL_EXTENSION:
+        ret = ENOTSUP;
+        goto done;
+    case LDAP_INSUFFICIENT_ACCESS:
+        ret = EACCES;
+        goto done;
+    case LDAP_PROTOCOL_ERROR:
+    case LDAP_UNWILLING_TO_PERFORM:
+    case LDAP_OTHER:
+        /* how AD refuses a cookie it cannot use */
+        ret = state->cookie.bv_len > 0 ? ERR_SYNC_REFRESH_REQUIRED : EIO;
+        goto done;
+    default:
+        ret = EIO;
+        goto done;
+    }
+
+    dirsync_ctrl = ldap_control_find(LDAP_SERVER_DIRSYNC_OID, ctrls, NULL);
+    if (dirsync_ctrl == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "The reply has no DirSync control\n");
+        ret = EIO;
+        goto done;
+    }
+
+    ber = ber_init(&dirsync_ctrl->ldctl_value);
+    if (ber == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    if (ber_scanf(ber, "{iim}", &more, &size, &cookie) == LBER_ERROR) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot parse the DirSync control\n");
+        ret = EIO;
+        goto done;
+    }
+
+    if (cookie.bv_len > 0) {
+        talloc_zfree(state->cookie.bv_val);
+        state->cookie.bv_val = talloc_memdup(state, cookie.bv_val,
+                                             cookie.bv_len);
+        if (state->cookie.bv_val == NULL) {
+            state->cookie.bv_len = 0;
+            ret = ENOMEM;
+            goto done;
+        }
+        state->cookie.bv_len = cookie.bv_len;
+    }
+
+    *_more = (more != 0);
+    ret = EOK;
+
+done:
+    if (ber != NULL) {
+        ber_free(ber, 1);
+    }
+    ldap_memfree(errmsg);
+    ldap_controls_free(ctrls);
+    return ret;
+}
+
+static void sdap_dirsync_search_op_finished(struct sdap_op *op,
+                                            struct sdap_msg *reply,
+                                            int error, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct sdap_dirsync_search_state *state = tevent_req_data(req,
+                                            struct sdap_dirsync_search_state);
+    bool more;
+    errno_t ret;
+
+    if (error) {
+        tevent_req_error(req, error);
+        return;
+    }
+
+    switch (ldap_msgtype(reply->msg)) {
+    case LDAP_RES_SEARCH_ENTRY:
+        ret = sdap_dirsync_search_entry(state, reply);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+            return;
+        }
+        sdap_unlock_next_reply(state->op);
+        return;
+    case LDAP_RES_SEARCH_REFERENCE:
+    case LDAP_RES_INTERMEDIATE:
+        /* referrals are not followed, intermediate responses carry
+         * nothing for a directory synchronization */
+        sdap_unlock_next_reply(state->op);
+        return;
+    case LDAP_RES_SEARCH_RESULT:
+        ret = sdap_dirsync_search_result(state, reply, &more);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+            return;
+        }
+
+        if (!more) {
+            tevent_req_done(req);
+            return;
+        }
+
+        ret = sdap_dirsync_search_step(req);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+        }
+        return;
+    default:
+        /* what is going on here !? */
+        tevent_req_error(req, EIO);
+        return;
+    }
+}
+
+errno_t sdap_dirsync_search_recv(struct tevent_req *req,
+                                 TALLOC_CTX *mem_ctx,
+                                 struct berval *_cookie)
+{
+    struct sdap_dirsync_search_state *state = tevent_req_data(req,
+                                            struct sdap_dirsync_search_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    _cookie->bv_len = state->cookie.bv_len;
+    _cookie->bv_val = talloc_steal(mem_ctx, state->cookie.bv_val);
+
+    return EOK;
+}
+
+/* ==Ranged attribute retrieval========================================= */
+/* AD returns at most MaxValRange values of an attribute in a search reply,
+ * sdap_parse_entry() then lists the incomplete attributes in
+ * SDAP_RANGED_ATTRS. The remaining ranges are requested with base searches
+ * of the entry, several ranges at once as their size is the one of the
+ * first reply. The values of each range are appended to the entry as soon
+ * as the range arrives. */
+struct sdap_get_ranged_attrs_state {
+    struct tevent_context *ev;
+    struct sdap_options *opts;
+    struct sdap_handle *sh;
+    struct sdap_attr_map *map;
+    struct sdap_attr_map_index *map_index;
+    int map_num;
+    struct sysdb_attrs *entry;
+    const char *dn;
+    int timeout;
+    int parallel;
+
+    const char **ranged;
+    size_t ranged_iter;
+
+    /* the attribute being completed */
+    char *base_attr;
+    uint32_t step;
+    uint32_t next_offset;
+    uint32_t end_offset;
+    bool end_known;
+    int active;
+
+    /* the failed range with the lowest offset */
+    errno_t error;
+    uint32_t error_offset;
+};
+
+struct sdap_get_range_ctx {
+    struct tevent_req *req;
+    uint32_t low;
+    uint32_t high;
+    /* set when the server sent less values than requested */
+    uint32_t short_offset;
+};
+
+static errno_t sdap_get_ranged_attrs_next(struct tevent_req *req);
+static errno_t sdap_get_ranged_attrs_issue(struct tevent_req *req);
+static errno_t sdap_get_range_send(struct tevent_req *req,
+                                   uint32_t low, uint32_t high);
+static errno_t sdap_get_range_parse(struct sdap_handle *sh,
+                                    struct sdap_msg *msg,
+                                    void *pvt);
+static void sdap_get_range_done(struct tevent_req *subreq);
+
+static void sdap_ranged_attrs_remove_marker(struct sysdb_attrs *entry)
+{
+    size_t i;
+
+    for (i = 0; i < entry->num; i++) {
+        if (strcmp(entry->a[i].name, SDAP_RANGED_ATTRS) == 0) {
+            entry->num--;
+            memmove(&entry->a[i], &entry->a[i + 1],
+                    (entry->num - i) * sizeof(struct ldb_message_element));
+            return;
+        }
+    }
+}
+
+bool sdap_has_ranged_attrs(struct sysdb_attrs *entry)
+{
+    struct ldb_message_element *el;
+
+    return sysdb_attrs_get_el_ext(entry, SDAP_RANGED_ATTRS,
+                                  false, &el) == EOK;
+}
+
+struct tevent_req *
+sdap_get_ranged_attrs_send(TALLOC_CTX *memctx,
+                           struct tevent_context *ev,
+                           struct sdap_options *opts,
+                           struct sdap_handle *sh,
+                           struct sdap_attr_map *map,
+                           int map_num,
+                           struct sysdb_attrs *entry,
+                           int timeout)
+{
+    struct tevent_req *req;
+    struct sdap_get_ranged_attrs_state *state;
+    errno_t ret;
+
+    req = tevent_req_create(memctx, &state,
+                            struct sdap_get_ranged_attrs_state);
+    if (req == NULL) return NULL;
+
+    state->ev = ev;
+    state->opts = opts;
+    state->sh = sh;
+    state->map = map;
+    state->map_num = map_num;
+    state->map_index = sdap_attr_map_get_index(map, map_num);
+    state->entry = entry;
+    state->timeout = timeout;
+    state->parallel = dp_opt_get_int(opts->basic,
+                                     SDAP_RANGE_PARALLEL_REQUESTS);
+    if (state->parallel < 1) {
+        state->parallel = 1;
+    }
+
+    ret = sysdb_attrs_get_string_array(entry, SDAP_RANGED_ATTRS, state,
+                                       &state->ranged);
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto immediately;
+    } else if (ret != EOK) {
+        goto immediately;
+    }
+    sdap_ranged_attrs_remove_marker(entry);
+
+    ret = sysdb_attrs_get_string(entry, SYSDB_ORIG_DN, &state->dn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "The entry has no DN\n");
+        goto immediately;
+    }
+
+    ret = sdap_get_ranged_attrs_next(req);
+    if (ret != EAGAIN) {
+        goto immediately;
+    }
+
+    return req;
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+    return req;
+}
+
+/* Returns EAGAIN while ranges are being fetched, EOK once all attributes
+ * are complete */
+static errno_t sdap_get_ranged_attrs_next(struct tevent_req *req)
+{
+    struct sdap_get_ranged_attrs_state *state =
+            tevent_req_data(req, struct sdap_get_ranged_attrs_state);
+    uint32_t offset;
+    errno_t ret;
+
+    while (state->ranged[state->ranged_iter] != NULL) {
+        talloc_zfree(state->base_attr);
+        ret = sdap_parse_range(state,
+                               state->ranged[state->ranged_iter++],
+                               &state->base_attr, &offset, false);
+        if (ret != EAGAIN) {
+            continue;
+        }
+
+        /* the first reply always starts with the range 0-(offset-1) */
+        state->step = offset;
+        state->next_offset = offset;
+        state->end_offset = UINT32_MAX;
+        state->end_known = false;
+        state->error = EOK;
+
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Fetching the values of [%s] of [%s] from offset %"PRIu32"\n",
+              state->base_attr, state->dn, offset);
+
+        ret = sdap_get_ranged_attrs_issue(req);
+        if (ret != EOK) {
+            return ret;
+        }
+        return EAGAIN;
+    }
+
+    return EOK;
+}
+
+static errno_t sdap_get_ranged_attrs_issue(struct tevent_req *req)
+{
+    struct sdap_get_ranged_attrs_state *state =
+            tevent_req_data(req, struct sdap_get_ranged_attrs_state);
+    uint32_t low;
+    errno_t ret;
+
+    while (state->active < state->parallel
+            && !state->end_known
+            && state->error == EOK) {
+        low = state->next_offset;
+        if (UINT32_MAX - low < state->step) {
+            /* the remaining values fit into the last possible range */
+            state->end_known = true;
+            return sdap_get_range_send(req, low, UINT32_MAX - 1);
+        }
+        state->next_offset += state->step;
+
+        ret = sdap_get_range_send(req, low, low + state->step - 1);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t sdap_get_range_send(struct tevent_req *req,
+                                   uint32_t low, uint32_t high)
+{
+    struct sdap_get_ranged_attrs_state *state =
+            tevent_req_data(req, struct sdap_get_ranged_attrs_state);
+    struct sdap_get_range_ctx *range;
+    struct tevent_req *subreq;
+    const char **attrs;
+
+    range = talloc_zero(state, struct sdap_get_range_ctx);
+    if (range == NULL) {
+        return ENOMEM;
+    }
+    range->req = req;
+    range->low = low;
+    range->high = high;
+
+    attrs = talloc_zero_array(range, const char *, 2);
+    if (attrs == NULL) {
+        talloc_free(range);
+        return ENOMEM;
+    }
+
+    attrs[0] = talloc_asprintf(attrs, "%s;range=%"PRIu32"-%"PRIu32,
+                               state->base_attr, low, high);
+    if (attrs[0] == NULL) {
+        talloc_free(range);
+        return ENOMEM;
+    }
+
+    subreq = sdap_get_generic_ext_send(range, state->ev, state->opts,
+                                       state->sh, state->dn, LDAP_SCOPE_BASE,
+                                       "(objectclass=*)", attrs, NULL, NULL,
+                                       0, state->timeout,
+                                       sdap_get_range_parse, range,
+                                       SDAP_SRCH_FLG_SIZELIMIT_SILENT);
+    if (subreq == NULL) {
+        talloc_free(range);
+        return ENOMEM;
+    }
+    tevent_req_set_callback(subreq, sdap_get_range_done, range);
+    state->active++;
+
+    return EOK;
+}
+
+static errno_t sdap_ranged_attrs_append(struct sdap_get_ranged_attrs_state *state,
+                                        struct ldb_message_element *values)
+{
+    struct ldb_message_element *el;
+    struct ldb_val *vals;
+    unsigned int j;
+    int i;
+    errno_t ret;
+
+    for (i = sdap_attr_map_find(state->map_index, state->map, state->map_num,
+                                state->base_attr, 0);
+         i != -1;
+         i = sdap_attr_map_find(state->map_index, state->map, state->map_num,
+                                state->base_attr, i + 1)) {
+        ret = sysdb_attrs_get_el(state->entry, state->map[i].sys_name, &el);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        vals = talloc_realloc(state->entry->a, el->values, struct ldb_val,
+                              el->num_values + values->num_values);
+        if (vals == NULL) {
+            return ENOMEM;
+        }
+        el->values = vals;
+
+        for (j = 0; j < values->num_values; j++) {
+            vals[el->num_values] = ldb_val_dup(vals, &values->values[j]);
+            if (vals[el->num_values].data == NULL
+                    && values->values[j].length != 0) {
+                return ENOMEM;
+            }
+            el->num_values++;
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t sdap_get_range_parse(struct sdap_handle *sh,
+                                    struct sdap_msg *msg,
+                                    void *pvt)
+{
+    struct sdap_get_range_ctx *range =
+            talloc_get_type(pvt, struct sdap_get_range_ctx);
+    struct sdap_get_ranged_attrs_state *state =
+            tevent_req_data(range->req, struct sdap_get_ranged_attrs_state);
+    struct ldb_message_element *values = NULL;
+    struct sysdb_attrs *attrs;
+    const char *desc;
+    char *base_attr;
+    uint32_t offset;
+    size_t i;
+    errno_t ret;
+
+    ret = sdap_parse_entry(range, sh, msg, NULL, 0, &attrs, false);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    for (i = 0; i < attrs->num; i++) {
+        if (strcasecmp(attrs->a[i].name, state->base_attr) == 0) {
+            values = &attrs->a[i];
+            break;
+        }
+    }
+
+    if (values == NULL || values->num_values == 0) {
+        /* the range starts behind the last value */
+        if (!state->end_known || range->low < state->end_offset) {
+            state->end_offset = range->low;
+        }
+        state->end_known = true;
+        ret = EOK;
+        goto done;
+    }
+
+    ret = sdap_ranged_attrs_append(state, values);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_attrs_get_string(attrs, SDAP_RANGED_ATTRS, &desc);
+    if (ret == ENOENT) {
+        /* the last range, its upper bound is '*' */
+        state->end_offset = range->low + values->num_values;
+        state->end_known = true;
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sdap_parse_range(attrs, desc, &base_attr, &offset, false);
+    if (ret == EAGAIN) {
+        if (offset <= range->high) {
+            range->short_offset = offset;
+        }
+        ret = EOK;
+    }
+
+done:
+    talloc_free(attrs);
+    return ret;
+}
+
+static void sdap_get_range_done(struct tevent_req *subreq)
+{
+    struct sdap_get_range_ctx *range =
+            tevent_req_callback_data(subreq, struct sdap_get_range_ctx);
+    struct tevent_req *req = range->req;
+    struct sdap_get_ranged_attrs_state *state =
+            tevent_req_data(req, struct sdap_get_ranged_attrs_state);
+    errno_t ret;
+
+    ret = sdap_get_generic_ext_recv(subreq, state, NULL, NULL);
+    talloc_zfree(subreq);
+    state->active--;
+    if (ret != EOK) {
+        /* ranges behind the last value might fail, this is only known once
+         * all ranges are done */
+        DEBUG(SSSDBG_TRACE_FUNC, "Range %"PRIu32"-%"PRIu32" of [%s] "
+              "failed: %d [%s]\n", range->low, range->high,
+              state->base_attr, ret, sss_strerror(ret));
+        if (state->error == EOK || range->low < state->error_offset) {
+            state->error = ret;
+            state->error_offset = range->low;
+        }
+    } else if (range->short_offset != 0
+                && !(state->end_known
+                     && range->short_offset >= state->end_offset)) {
+        /* fetch the rest of the requested range */
+        ret = sdap_get_range_send(req, range->short_offset, range->high);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+    talloc_free(range);
+
+    ret = sdap_get_ranged_attrs_issue(req);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (state->active > 0) {
+        return;
+    }
+
+    if (state->error != EOK
+            && !(state->end_known && state->error_offset >= state->end_offset)) {
+        ret = state->error;
+        goto done;
+    }
+
+    ret = sdap_get_ranged_attrs_next(req);
+    if (ret == EAGAIN) {
+        return;
+    }
+
+done:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+}
+
+errno_t sdap_get_ranged_attrs_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+/* ==Attribute scoped search============================================ */
+struct sdap_asq_search_state {
+    struct sdap_attr_map_info *maps;
+    int num_maps;
+    LDAPControl **ctrls;
+    struct sdap_options *opts;
+
+    struct sdap_deref_reply dreply;
+};
+
+static int sdap_asq_search_create_control(struct sdap_handle *sh,
+                                          const char *attr,
+                                          LDAPControl **ctrl);
+static int sdap_asq_search_ctrls_destructor(void *ptr);
+static errno_t sdap_asq_search_parse_entry(struct sdap_handle *sh,
+                                           struct sdap_msg *msg,
+                                           void *pvt);
+static void sdap_asq_search_done(struct tevent_req *subreq);
+
+static struct tevent_req *
 sdap_asq_search_send(TALLOC_CTX *memctx, struct tevent_context *ev,
                      struct sdap_options *opts, struct sdap_handle *sh,
                      const char *base_dn, const char *deref_attr,
@@ -2985,3 +4826,162 @@ bool sdap_has_deref_support(struct sdap_handle *sh, struct sdap_options *opts)
 
     return false;
 }
+
+/* Dereference is much faster than separate searches on some servers and
+ * much slower on others. Both are timed per server and kind of lookup, the
+ * lower average time per object wins. Each strategy is measured a few
+ * times first, afterwards the other one is retried now and then in case
+ * the server or the data changed. Old measurements are halved so that the
+ * recent ones count more. */
+#define SDAP_DEREF_MIN_SAMPLES 3
+#define SDAP_DEREF_PROBE_INTERVAL 50
+#define SDAP_DEREF_MAX_SAMPLES 64
+
+struct sdap_deref_timing {
+    uint64_t samples;
+    uint64_t objects;
+    uint64_t usecs;
+};
+
+struct sdap_deref_stats {
+    struct sdap_deref_stats *prev;
+    struct sdap_deref_stats *next;
+
+    char *uri;
+    /* the second index tells whether dereference was used */
+    struct sdap_deref_timing timing[SDAP_DEREF_CLASS_NUM][2];
+    uint64_t decisions[SDAP_DEREF_CLASS_NUM];
+    bool use_deref[SDAP_DEREF_CLASS_NUM];
+    bool decided[SDAP_DEREF_CLASS_NUM];
+};
+
+static const char *sdap_deref_class_str(enum sdap_deref_class cls)
+{
+    switch (cls) {
+    case SDAP_DEREF_CLASS_GROUP_MEMBERS:
+        return "group members";
+    case SDAP_DEREF_CLASS_USER_GROUPS:
+        return "user groups";
+    case SDAP_DEREF_CLASS_NUM:
+        break;
+    }
+
+    return "unknown";
+}
+
+struct sdap_deref_stats *sdap_deref_stats_get(struct sdap_options *opts,
+                                              const char *uri)
+{
+    struct sdap_deref_stats *stats;
+
+    DLIST_FOR_EACH(stats, opts->deref_stats) {
+        if (strcmp(stats->uri, uri) == 0) {
+            return stats;
+        }
+    }
+
+    stats = talloc_zero(opts, struct sdap_deref_stats);
+    if (stats == NULL) {
+        return NULL;
+    }
+
+    stats->uri = talloc_strdup(stats, uri);
+    if (stats->uri == NULL) {
+        talloc_free(stats);
+        return NULL;
+    }
+
+    DLIST_ADD(opts->deref_stats, stats);
+    return stats;
+}
+
+static uint64_t sdap_deref_timing_avg(struct sdap_deref_timing *timing)
+{
+    return timing->objects ? timing->usecs / timing->objects : 0;
+}
+
+bool sdap_deref_preferred(struct sdap_handle *sh, struct sdap_options *opts,
+                          enum sdap_deref_class cls)
+{
+    struct sdap_deref_stats *stats = sh->deref_stats;
+
+    if (stats == NULL || !dp_opt_get_bool(opts->basic, SDAP_DEREF_ADAPTIVE)) {
+        return true;
+    }
+
+    if (stats->timing[cls][1].samples < SDAP_DEREF_MIN_SAMPLES) {
+        return true;
+    } else if (stats->timing[cls][0].samples < SDAP_DEREF_MIN_SAMPLES) {
+        return false;
+    }
+
+    stats->decisions[cls]++;
+    if (stats->decisions[cls] % SDAP_DEREF_PROBE_INTERVAL == 0) {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Measuring %s of [%s] again for "
+              "the %s\n", stats->use_deref[cls] ? "separate searches"
+                                                : "dereference",
+              stats->uri, sdap_deref_class_str(cls));
+        return !stats->use_deref[cls];
+    }
+
+    return stats->use_deref[cls];
+}
+
+void sdap_deref_stats_add(struct sdap_handle *sh,
+                          enum sdap_deref_class cls,
+                          bool deref,
+                          size_t num_objects,
+                          struct timeval start)
+{
+    struct sdap_deref_stats *stats = sh->deref_stats;
+    struct sdap_deref_timing *timing;
+    struct timeval now;
+    struct timeval elapsed;
+    uint64_t avg_deref;
+    uint64_t avg_single;
+    bool use_deref;
+    int i;
+
+    if (stats == NULL || num_objects == 0) {
+        return;
+    }
+
+    now = tevent_timeval_current();
+    elapsed = tevent_timeval_until(&start, &now);
+    timing = &stats->timing[cls][deref ? 1 : 0];
+
+    if (timing->samples >= SDAP_DEREF_MAX_SAMPLES) {
+        timing->samples /= 2;
+        timing->objects /= 2;
+        timing->usecs /= 2;
+    }
+
+    timing->samples++;
+    timing->objects += num_objects;
+    timing->usecs += elapsed.tv_sec * 1000000ULL + elapsed.tv_usec;
+
+    for (i = 0; i < 2; i++) {
+        if (stats->timing[cls][i].samples < SDAP_DEREF_MIN_SAMPLES) {
+            return;
+        }
+    }
+
+    avg_deref = sdap_deref_timing_avg(&stats->timing[cls][1]);
+    avg_single = sdap_deref_timing_avg(&stats->timing[cls][0]);
+    use_deref = avg_deref <= avg_single;
+
+    if (!stats->decided[cls] || use_deref != stats->use_deref[cls]) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Using %s for the %s on [%s]: "
+              "%"PRIu64" us per object with dereference, %"PRIu64" us "
+              "with separate searches\n",
+              use_deref ? "dereference" : "separate searches",
+              sdap_deref_class_str(cls), stats->uri, avg_deref, avg_single);
+    } else {
+        DEBUG(SSSDBG_TRACE_ALL, "Dereference of %s on [%s]: %"PRIu64" us "
+              "per object, separate searches: %"PRIu64" us\n",
+              sdap_deref_class_str(cls), stats->uri, avg_deref, avg_single);
+    }
+
+    stats->use_deref[cls] = use_deref;
+    stats->decided[cls] = true;
+}
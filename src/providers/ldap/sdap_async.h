@@ -187,6 +187,15 @@ int sdap_cli_connect_recv(struct tevent_req *req,
                           struct sdap_handle **gsh,
                           struct sdap_server_opts **srv_opts);
 
+/* Connects to the standby servers of the service and reads their rootDSE,
+ * the fail over code learns which of them answer and how fast */
+struct tevent_req *sdap_server_probe_send(TALLOC_CTX *mem_ctx,
+                                          struct tevent_context *ev,
+                                          struct be_ctx *be,
+                                          struct sdap_options *opts,
+                                          struct sdap_service *service);
+errno_t sdap_server_probe_recv(struct tevent_req *req);
+
 /* Exposes all options of generic send while allowing to parse by map */
 struct tevent_req *sdap_get_and_parse_generic_send(TALLOC_CTX *memctx,
                                                    struct tevent_context *ev,
@@ -209,6 +218,24 @@ int sdap_get_and_parse_generic_recv(struct tevent_req *req,
                                     size_t *reply_count,
                                     struct sysdb_attrs ***reply);
 
+/* All the searches issued by the request with the @state, and by the
+ * requests it starts, are scheduled in @op_class instead of as lookups
+ * when ldap_max_outstanding_ops is set */
+void sdap_op_class_set(TALLOC_CTX *state, enum sdap_op_class op_class);
+
+/* Queue depths of the searches waiting for ldap_max_outstanding_ops */
+void sdap_sched_get_stats(struct sdap_handle *sh,
+                          struct sdap_sched_stats *stats);
+
+const char *sdap_handle_end_str(enum sdap_handle_end end);
+
+/* Records why the connection is closed, only the first reason is kept */
+void sdap_handle_set_end(struct sdap_handle *sh, enum sdap_handle_end end);
+
+/* Writes the statistics of the connection to the debug log, the rate of
+ * the results is the one since the previous summary */
+void sdap_handle_log_stats(struct sdap_handle *sh, int level, const char *uri);
+
 struct tevent_req *sdap_get_generic_send(TALLOC_CTX *memctx,
                                          struct tevent_context *ev,
                                          struct sdap_options *opts,
@@ -227,6 +254,32 @@ int sdap_get_generic_recv(struct tevent_req *req,
 
 bool sdap_has_deref_support(struct sdap_handle *sh, struct sdap_options *opts);
 
+/* The lookups which can use either a dereference or separate searches */
+enum sdap_deref_class {
+    SDAP_DEREF_CLASS_GROUP_MEMBERS,
+    SDAP_DEREF_CLASS_USER_GROUPS,
+
+    SDAP_DEREF_CLASS_NUM
+};
+
+/* Returns the timings of the server at uri, a new entry is created on the
+ * first connection */
+struct sdap_deref_stats *sdap_deref_stats_get(struct sdap_options *opts,
+                                              const char *uri);
+
+/* Whether a lookup already over ldap_deref_threshold should dereference,
+ * with ldap_deref_adaptive the faster strategy on this server is used */
+bool sdap_deref_preferred(struct sdap_handle *sh, struct sdap_options *opts,
+                          enum sdap_deref_class cls);
+
+/* Records how long a lookup of num_objects objects which started at start
+ * took with either strategy */
+void sdap_deref_stats_add(struct sdap_handle *sh,
+                          enum sdap_deref_class cls,
+                          bool deref,
+                          size_t num_objects,
+                          struct timeval start);
+
 enum sdap_deref_flags {
     SDAP_DEREF_FLG_SILENT = 1 << 0,     /* Do not warn if dereference fails */
 };
@@ -290,6 +343,79 @@ int sdap_sd_search_recv(struct tevent_req *req,
                         size_t *_ref_count,
                         char ***_refs);
 
+/* The states of the entries sent by a content synchronization search */
+enum sdap_sync_state {
+    SDAP_SYNC_PRESENT = LDAP_SYNC_PRESENT,
+    SDAP_SYNC_ADD = LDAP_SYNC_ADD,
+    SDAP_SYNC_MODIFY = LDAP_SYNC_MODIFY,
+    SDAP_SYNC_DELETE = LDAP_SYNC_DELETE,
+};
+
+struct sdap_sync_handlers {
+    /* An entry was added or modified, attrs are the parsed entry and the
+     * handler can steal them. For deleted and unchanged entries only the DN
+     * is known and attrs is NULL. */
+    errno_t (*entry)(enum sdap_sync_state sync_state, const char *dn,
+                     struct sysdb_attrs *attrs, void *pvt);
+    /* The refresh phase is over, the changes are sent as they happen */
+    void (*refreshed)(void *pvt);
+    /* The server sent a new cookie, optional */
+    errno_t (*cookie)(struct berval *cookie, void *pvt);
+};
+
+struct tevent_req *
+sdap_sync_search_send(TALLOC_CTX *memctx,
+                      struct tevent_context *ev,
+                      struct sdap_options *opts,
+                      struct sdap_handle *sh,
+                      const char *search_base,
+                      int scope,
+                      const char *filter,
+                      const char **attrs,
+                      struct sdap_attr_map *map,
+                      int map_num_attrs,
+                      struct berval *cookie,
+                      struct sdap_sync_handlers *handlers,
+                      void *pvt);
+errno_t sdap_sync_search_recv(struct tevent_req *req);
+
+/* Called for every changed object of a DirSync search, attrs are named
+ * like the LDAP attributes and the handler can steal them */
+typedef errno_t (*sdap_dirsync_entry_fn)(struct sysdb_attrs *attrs,
+                                         void *pvt);
+
+struct tevent_req *
+sdap_dirsync_search_send(TALLOC_CTX *memctx,
+                         struct tevent_context *ev,
+                         struct sdap_options *opts,
+                         struct sdap_handle *sh,
+                         const char *base_dn,
+                         const char *filter,
+                         const char **attrs,
+                         struct berval *cookie,
+                         int timeout,
+                         sdap_dirsync_entry_fn entry_fn,
+                         void *pvt);
+errno_t sdap_dirsync_search_recv(struct tevent_req *req,
+                                 TALLOC_CTX *mem_ctx,
+                                 struct berval *_cookie);
+
+/* Fetches the values missing from the attributes of the entry listed in
+ * SDAP_RANGED_ATTRS and appends them to the sysdb attributes they are
+ * mapped to */
+bool sdap_has_ranged_attrs(struct sysdb_attrs *entry);
+
+struct tevent_req *
+sdap_get_ranged_attrs_send(TALLOC_CTX *memctx,
+                           struct tevent_context *ev,
+                           struct sdap_options *opts,
+                           struct sdap_handle *sh,
+                           struct sdap_attr_map *map,
+                           int map_num,
+                           struct sysdb_attrs *entry,
+                           int timeout);
+errno_t sdap_get_ranged_attrs_recv(struct tevent_req *req);
+
 errno_t
 sdap_attrs_add_ldap_attr(struct sysdb_attrs *ldap_attrs,
                          const char *attr_name,
@@ -105,9 +105,22 @@ struct tevent_req *sdap_connect_send(TALLOC_CTX *memctx,
 
     state->sh->page_size = dp_opt_get_int(state->opts->basic,
                                           SDAP_PAGE_SIZE);
+    /* without the timings the threshold alone decides */
+    state->sh->deref_stats = sdap_deref_stats_get(state->opts, state->uri);
 
     timeout = dp_opt_get_int(state->opts->basic, SDAP_NETWORK_TIMEOUT);
 
+    /* the new handle takes the TLS connect callback from the global options,
+     * not fatal, the connection just uses a full handshake */
+    if (dp_opt_get_bool(state->opts->basic, SDAP_TLS_SESSION_RESUMPTION)) {
+        ret = sdap_tls_session_cache_setup();
+        if (ret != EOK && ret != ENOTSUP) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "TLS sessions will not be resumed [%d]: %s\n",
+                  ret, sss_strerror(ret));
+        }
+    }
+
     subreq = sss_ldap_init_send(state, ev, state->uri, sockaddr,
                                 sizeof(struct sockaddr_storage),
                                 timeout);
@@ -167,6 +180,10 @@ static void sdap_sys_connect_done(struct tevent_req *subreq)
         goto fail;
     }
 
+    if (ldap_is_ldaps_url(state->uri)) {
+        sdap_tls_session_report(state->sh->ldap, state->uri);
+    }
+
     /* If sss_ldap_init_recv() does not return a valid file descriptor we have
      * to assume that the connection callback will be called by internally by
      * the OpenLDAP client library. */
@@ -410,6 +427,8 @@ static void sdap_connect_done(struct sdap_op *op,
         return;
     }
 
+    sdap_tls_session_report(state->sh->ldap, state->uri);
+
     tevent_req_done(req);
 }
 
@@ -1050,12 +1069,132 @@ static errno_t sasl_bind_recv(struct tevent_req *req)
 
 /* ==Perform-Kinit-given-keytab-and-principal============================= */
 
+/* ldap_child writes the TGT to a ccache which is shared by all connections
+ * of the backend, those to the trusted domains and the Global Catalog
+ * included, and GSSAPI keeps the service and cross-realm tickets it gets
+ * in the same ccache. Every kinit replaces the ccache and throws these
+ * tickets away, so a new connection reuses the TGT of an earlier one as
+ * long as the TGT outlives the connection. */
+struct sdap_kinit_ticket {
+    struct sdap_kinit_ticket *prev;
+    struct sdap_kinit_ticket *next;
+
+    char *keytab;
+    char *principal;
+    char *realm;
+
+    char *ccname;
+    time_t expire_time;
+};
+
+static struct sdap_kinit_ticket *sdap_kinit_tickets;
+
+static bool sdap_kinit_str_equal(const char *a, const char *b)
+{
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+
+    return strcmp(a, b) == 0;
+}
+
+static struct sdap_kinit_ticket *sdap_kinit_ticket_find(const char *keytab,
+                                                        const char *principal,
+                                                        const char *realm)
+{
+    struct sdap_kinit_ticket *ticket;
+
+    DLIST_FOR_EACH(ticket, sdap_kinit_tickets) {
+        if (sdap_kinit_str_equal(ticket->keytab, keytab)
+                && sdap_kinit_str_equal(ticket->principal, principal)
+                && sdap_kinit_str_equal(ticket->realm, realm)) {
+            return ticket;
+        }
+    }
+
+    return NULL;
+}
+
+static void sdap_kinit_ticket_drop(const char *keytab,
+                                   const char *principal,
+                                   const char *realm)
+{
+    struct sdap_kinit_ticket *ticket;
+
+    ticket = sdap_kinit_ticket_find(keytab, principal, realm);
+    if (ticket != NULL) {
+        DLIST_REMOVE(sdap_kinit_tickets, ticket);
+        talloc_free(ticket);
+    }
+}
+
+static void sdap_kinit_ticket_store(const char *keytab,
+                                    const char *principal,
+                                    const char *realm,
+                                    const char *ccname,
+                                    time_t expire_time)
+{
+    struct sdap_kinit_ticket *ticket;
+    struct sdap_kinit_ticket *next;
+
+    /* a kinit of another principal which uses the same ccache has
+     * replaced the tickets of this one */
+    ticket = sdap_kinit_tickets;
+    while (ticket != NULL) {
+        next = ticket->next;
+        if (strcmp(ticket->ccname, ccname) == 0) {
+            DLIST_REMOVE(sdap_kinit_tickets, ticket);
+            talloc_free(ticket);
+        }
+        ticket = next;
+    }
+
+    ticket = talloc_zero(NULL, struct sdap_kinit_ticket);
+    if (ticket == NULL) {
+        return;
+    }
+
+    ticket->ccname = talloc_strdup(ticket, ccname);
+    if (ticket->ccname == NULL) {
+        goto fail;
+    }
+
+    if (keytab != NULL) {
+        ticket->keytab = talloc_strdup(ticket, keytab);
+        if (ticket->keytab == NULL) {
+            goto fail;
+        }
+    }
+
+    if (principal != NULL) {
+        ticket->principal = talloc_strdup(ticket, principal);
+        if (ticket->principal == NULL) {
+            goto fail;
+        }
+    }
+
+    if (realm != NULL) {
+        ticket->realm = talloc_strdup(ticket, realm);
+        if (ticket->realm == NULL) {
+            goto fail;
+        }
+    }
+
+    ticket->expire_time = expire_time;
+    DLIST_ADD(sdap_kinit_tickets, ticket);
+    return;
+
+fail:
+    talloc_free(ticket);
+}
+
 struct sdap_kinit_state {
     const char *keytab;
     const char *principal;
     const char *realm;
     int    timeout;
     int    lifetime;
+    int    child_idle_timeout;
 
     const char *krb_service_name;
     struct tevent_context *ev;
@@ -1063,6 +1202,7 @@ struct sdap_kinit_state {
 
     struct fo_server *kdc_srv;
     time_t expire_time;
+    bool reused;
 };
 
 static void sdap_kinit_done(struct tevent_req *subreq);
@@ -1080,11 +1220,14 @@ struct tevent_req *sdap_kinit_send(TALLOC_CTX *memctx,
                                    const char *principal,
                                    const char *realm,
                                    bool canonicalize,
-                                   int lifetime)
+                                   int lifetime,
+                                   int child_idle_timeout,
+                                   int min_lifetime)
 {
     struct tevent_req *req;
     struct tevent_req *subreq;
     struct sdap_kinit_state *state;
+    struct sdap_kinit_ticket *ticket;
     int ret;
 
     DEBUG(SSSDBG_TRACE_FUNC, "Attempting kinit (%s, %s, %s, %d)\n",
@@ -1106,6 +1249,7 @@ struct tevent_req *sdap_kinit_send(TALLOC_CTX *memctx,
     state->be = be;
     state->timeout = timeout;
     state->lifetime = lifetime;
+    state->child_idle_timeout = child_idle_timeout;
     state->krb_service_name = krb_service_name;
 
     if (canonicalize) {
@@ -1120,6 +1264,26 @@ struct tevent_req *sdap_kinit_send(TALLOC_CTX *memctx,
         return NULL;
     }
 
+    /* A negative minimum lifetime asks for a new TGT */
+    ticket = NULL;
+    if (min_lifetime >= 0) {
+        ticket = sdap_kinit_ticket_find(keytab, principal, realm);
+    }
+    if (ticket != NULL && ticket->expire_time > time(NULL) + min_lifetime) {
+        ret = setenv("KRB5CCNAME", ticket->ccname, 1);
+        if (ret == 0) {
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "Reusing the TGT in [%s] which expires at %ld\n",
+                  ticket->ccname, (long) ticket->expire_time);
+            state->expire_time = ticket->expire_time;
+            state->reused = true;
+            tevent_req_done(req);
+            tevent_req_post(req, ev);
+            return req;
+        }
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to set env. variable KRB5CCNAME!\n");
+    }
+
     subreq = sdap_kinit_next_kdc(req);
     if (!subreq) {
         talloc_free(req);
@@ -1173,7 +1337,8 @@ static void sdap_kinit_kdc_resolved(struct tevent_req *subreq)
 
     tgtreq = sdap_get_tgt_send(state, state->ev, state->realm,
                                state->principal, state->keytab,
-                               state->lifetime, state->timeout);
+                               state->lifetime, state->timeout,
+                               state->child_idle_timeout);
     if (!tgtreq) {
         tevent_req_error(req, ENOMEM);
         return;
@@ -1228,6 +1393,8 @@ static void sdap_kinit_done(struct tevent_req *subreq)
         }
 
         state->expire_time = expire_time;
+        sdap_kinit_ticket_store(state->keytab, state->principal, state->realm,
+                                ccname, expire_time);
         tevent_req_done(req);
         return;
     } else {
@@ -1249,7 +1416,8 @@ static void sdap_kinit_done(struct tevent_req *subreq)
 }
 
 static errno_t sdap_kinit_recv(struct tevent_req *req,
-                               time_t *expire_time)
+                               time_t *expire_time,
+                               bool *_reused)
 {
     struct sdap_kinit_state *state = tevent_req_data(req,
                                                      struct sdap_kinit_state);
@@ -1263,6 +1431,7 @@ static errno_t sdap_kinit_recv(struct tevent_req *req,
     }
 
     *expire_time = state->expire_time;
+    *_reused = state->reused;
     return EOK;
 }
 
@@ -1403,12 +1572,26 @@ struct sdap_cli_connect_state {
     struct sdap_handle *sh;
 
     struct fo_server *srv;
+    /* when the connection to srv was started */
+    struct timeval connect_start;
+    struct tevent_req *connect_req;
+
+    /* the staggered TCP connections to the other servers, the first server
+     * to answer is used */
+    TALLOC_CTX *race_ctx;
+    struct fo_server **race_servers;
+    size_t race_next;
+    bool raced;
 
     struct sdap_server_opts *srv_opts;
 
     enum connect_tls force_tls;
     bool do_auth;
     bool use_tls;
+
+    /* the TGT of an earlier connection was used for the bind */
+    bool kinit_reused;
+    bool kinit_retried;
 };
 
 static int sdap_cli_resolve_next(struct tevent_req *req);
@@ -1424,6 +1607,7 @@ static void sdap_cli_auth_done(struct tevent_req *subreq);
 static errno_t sdap_cli_auth_reconnect(struct tevent_req *subreq);
 static void sdap_cli_auth_reconnect_done(struct tevent_req *subreq);
 static void sdap_cli_rootdse_auth_done(struct tevent_req *subreq);
+static void sdap_cli_race_start(struct tevent_req *req);
 
 static errno_t
 decide_tls_usage(enum connect_tls force_tls, struct dp_option *basic,
@@ -1538,6 +1722,7 @@ static void sdap_cli_resolve_done(struct tevent_req *subreq)
         return;
     }
 
+    gettimeofday(&state->connect_start, NULL);
     subreq = sdap_connect_send(state, state->ev, state->opts,
                                state->service->uri,
                                state->service->sockaddr,
@@ -1547,6 +1732,213 @@ static void sdap_cli_resolve_done(struct tevent_req *subreq)
         return;
     }
     tevent_req_set_callback(subreq, sdap_cli_connect_done, req);
+    state->connect_req = subreq;
+
+    if (!state->raced) {
+        sdap_cli_race_start(req);
+    }
+}
+
+struct sdap_cli_race_conn {
+    struct tevent_req *req;
+    struct fo_server *srv;
+};
+
+static void sdap_cli_race_step(struct tevent_context *ev,
+                               struct tevent_timer *te,
+                               struct timeval tv, void *pvt);
+static void sdap_cli_race_done(struct tevent_req *subreq);
+
+static errno_t sdap_cli_race_schedule(struct tevent_req *req)
+{
+    struct sdap_cli_connect_state *state = tevent_req_data(req,
+                                             struct sdap_cli_connect_state);
+    struct tevent_timer *te;
+    int stagger;
+
+    stagger = dp_opt_get_int(state->opts->basic, SDAP_CONNECTION_STAGGER);
+    te = tevent_add_timer(state->ev, state->race_ctx,
+                          tevent_timeval_current_ofs(stagger / 1000,
+                                                     (stagger % 1000) * 1000),
+                          sdap_cli_race_step, req);
+    if (te == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+/* Connect to the next servers in parallel while the first one does not
+ * answer, instead of waiting for ldap_network_timeout */
+static void sdap_cli_race_start(struct tevent_req *req)
+{
+    struct sdap_cli_connect_state *state = tevent_req_data(req,
+                                             struct sdap_cli_connect_state);
+    size_t count;
+    size_t i;
+    errno_t ret;
+
+    if (dp_opt_get_int(state->opts->basic, SDAP_CONNECTION_STAGGER) <= 0) {
+        return;
+    }
+
+    state->raced = true;
+
+    state->race_ctx = talloc_new(state);
+    if (state->race_ctx == NULL) {
+        return;
+    }
+
+    ret = be_fo_get_resolved_servers(state->race_ctx, state->be,
+                                     state->service->name,
+                                     &state->race_servers, &count);
+    if (ret != EOK || count < 2) {
+        talloc_zfree(state->race_ctx);
+        return;
+    }
+
+    /* an SRV refresh must not free them while the race runs */
+    for (i = 0; i < count; i++) {
+        fo_ref_server(state->race_ctx, state->race_servers[i]);
+    }
+
+    ret = sdap_cli_race_schedule(req);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot connect to the servers in "
+              "parallel [%d]: %s\n", ret, sss_strerror(ret));
+        talloc_zfree(state->race_ctx);
+    }
+}
+
+static void sdap_cli_race_step(struct tevent_context *ev,
+                               struct tevent_timer *te,
+                               struct timeval tv, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct sdap_cli_connect_state *state = tevent_req_data(req,
+                                             struct sdap_cli_connect_state);
+    struct sdap_cli_race_conn *conn;
+    struct sockaddr_storage *addr;
+    struct tevent_req *subreq;
+    struct fo_server *srv;
+    errno_t ret;
+
+    /* the next server which the fail over code would try */
+    for (srv = state->race_servers[state->race_next];
+         srv != NULL;
+         srv = state->race_servers[++state->race_next]) {
+        if (srv != state->srv && fo_is_server_usable(srv)
+                && fo_get_server_port(srv) != 0) {
+            break;
+        }
+    }
+
+    if (srv == NULL) {
+        return;
+    }
+    state->race_next++;
+
+    addr = resolv_get_sockaddr_address(state->race_ctx,
+                                       fo_get_server_hostent(srv),
+                                       fo_get_server_port(srv));
+    conn = talloc_zero(state->race_ctx, struct sdap_cli_race_conn);
+    if (addr == NULL || conn == NULL) {
+        return;
+    }
+    conn->req = req;
+    conn->srv = srv;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "[%s] does not answer yet, connecting to [%s] "
+          "in parallel\n", fo_get_server_name(state->srv),
+          fo_get_server_name(srv));
+
+    subreq = be_fo_connect_send(conn, ev, addr,
+                                dp_opt_get_int(state->opts->basic,
+                                               SDAP_NETWORK_TIMEOUT));
+    if (subreq == NULL) {
+        talloc_free(conn);
+        return;
+    }
+    tevent_req_set_callback(subreq, sdap_cli_race_done, conn);
+
+    ret = sdap_cli_race_schedule(req);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot schedule the next parallel "
+              "connection [%d]: %s\n", ret, sss_strerror(ret));
+    }
+}
+
+static void sdap_cli_race_done(struct tevent_req *subreq)
+{
+    struct sdap_cli_race_conn *conn = tevent_req_callback_data(subreq,
+                                                struct sdap_cli_race_conn);
+    struct tevent_req *req = conn->req;
+    struct sdap_cli_connect_state *state = tevent_req_data(req,
+                                             struct sdap_cli_connect_state);
+    struct fo_server *srv = conn->srv;
+    errno_t ret;
+
+    ret = be_fo_connect_recv(subreq);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Cannot connect to [%s] [%d]: %s\n",
+              fo_get_server_name(srv), ret, sss_strerror(ret));
+        be_fo_set_port_status(state->be, state->service->name,
+                              srv, PORT_NOT_WORKING);
+        talloc_free(conn);
+        return;
+    }
+
+    DEBUG(SSSDBG_FUNC_DATA, "[%s] answered before [%s], using it\n",
+          fo_get_server_name(srv), fo_get_server_name(state->srv));
+
+    /* the winner becomes the active server of the service, the next
+     * resolution returns it */
+    be_fo_set_port_status(state->be, state->service->name,
+                          srv, PORT_WORKING);
+    if (!fo_is_server_primary(srv)) {
+        /* a backup server is only used while the primary ones fail */
+        be_fo_set_port_status(state->be, state->service->name,
+                              state->srv, PORT_NOT_WORKING);
+    }
+
+    /* close the other attempts */
+    talloc_zfree(state->connect_req);
+    talloc_zfree(state->race_ctx);
+
+    ret = sdap_cli_resolve_next(req);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+    }
+}
+
+/* The time to set up the connection, including TLS, tells how fast the
+ * server answers when the fail over code chooses between the servers */
+static void sdap_cli_record_rtt(struct sdap_cli_connect_state *state)
+{
+    struct timeval now;
+    const char *name;
+    int64_t usec;
+    errno_t ret;
+
+    name = fo_get_server_name(state->srv);
+    if (name == NULL) {
+        return;
+    }
+
+    gettimeofday(&now, NULL);
+    usec = (now.tv_sec - state->connect_start.tv_sec) * 1000000LL
+                + now.tv_usec - state->connect_start.tv_usec;
+    if (usec < 0 || usec > UINT32_MAX) {
+        return;
+    }
+
+    ret = be_fo_record_server_rtt(state->be, name, usec);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot record the response time of [%s] [%d]: %s\n",
+              name, ret, sss_strerror(ret));
+    }
 }
 
 static void sdap_cli_connect_done(struct tevent_req *subreq)
@@ -1558,6 +1950,9 @@ static void sdap_cli_connect_done(struct tevent_req *subreq)
     const char *sasl_mech;
     int ret;
 
+    state->connect_req = NULL;
+    talloc_zfree(state->race_ctx);
+
     talloc_zfree(state->sh);
     ret = sdap_connect_recv(subreq, state, &state->sh);
     talloc_zfree(subreq);
@@ -1572,6 +1967,8 @@ static void sdap_cli_connect_done(struct tevent_req *subreq)
         return;
     }
 
+    sdap_cli_record_rtt(state);
+
     if (state->use_rootdse) {
         /* fetch the rootDSE this time */
         sdap_cli_rootdse_step(req);
@@ -1724,6 +2121,14 @@ static void sdap_cli_kinit_step(struct tevent_req *req)
     struct sdap_cli_connect_state *state = tevent_req_data(req,
                                              struct sdap_cli_connect_state);
     struct tevent_req *subreq;
+    int min_lifetime;
+
+    /* the TGT is reused if it outlives the connection, unless the bind
+     * with it failed already */
+    min_lifetime = -1;
+    if (!state->kinit_retried) {
+        min_lifetime = dp_opt_get_int(state->opts->basic, SDAP_EXPIRE_TIMEOUT);
+    }
 
     subreq = sdap_kinit_send(state, state->ev,
                              state->be,
@@ -1739,7 +2144,10 @@ static void sdap_cli_kinit_step(struct tevent_req *req)
                         dp_opt_get_bool(state->opts->basic,
                                                    SDAP_KRB5_CANONICALIZE),
                         dp_opt_get_int(state->opts->basic,
-                                                   SDAP_KRB5_TICKET_LIFETIME));
+                                                   SDAP_KRB5_TICKET_LIFETIME),
+                        dp_opt_get_int(state->opts->basic,
+                                                   SDAP_CHILD_IDLE_TIMEOUT),
+                        min_lifetime);
     if (!subreq) {
         tevent_req_error(req, ENOMEM);
         return;
@@ -1756,7 +2164,7 @@ static void sdap_cli_kinit_done(struct tevent_req *subreq)
     time_t expire_time = 0;
     errno_t ret;
 
-    ret = sdap_kinit_recv(subreq, &expire_time);
+    ret = sdap_kinit_recv(subreq, &expire_time, &state->kinit_reused);
     talloc_zfree(subreq);
     if (ret != EOK) {
         /* We're not able to authenticate to the LDAP server.
@@ -1951,6 +2359,22 @@ static void sdap_cli_auth_done(struct tevent_req *subreq)
 
     ret = sdap_auth_recv(subreq, NULL, NULL);
     talloc_zfree(subreq);
+    if (ret != EOK && state->kinit_reused && !state->kinit_retried) {
+        /* The reused TGT might have been revoked, e.g. when the machine
+         * account password was changed, try once with a new one */
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Bind with the reused TGT failed, getting a new one.\n");
+        sdap_kinit_ticket_drop(dp_opt_get_string(state->opts->basic,
+                                                 SDAP_KRB5_KEYTAB),
+                               dp_opt_get_string(state->opts->basic,
+                                                 SDAP_SASL_AUTHID),
+                               sdap_gssapi_realm(state->opts->basic));
+        state->kinit_retried = true;
+        state->kinit_reused = false;
+        state->sh->expire_time = 0;
+        sdap_cli_kinit_step(req);
+        return;
+    }
     if (ret) {
         tevent_req_error(req, ret);
         return;
@@ -2071,6 +2495,227 @@ int sdap_cli_connect_recv(struct tevent_req *req,
     return EOK;
 }
 
+/* ==Probe-the-standby-servers============================================ */
+
+/* The ports which the URI callback would use when the server has none */
+#define SDAP_PROBE_LDAP_PORT 389
+#define SDAP_PROBE_LDAPS_PORT 636
+
+struct sdap_server_probe_state {
+    struct tevent_context *ev;
+    struct be_ctx *be;
+    struct sdap_options *opts;
+    struct sdap_service *service;
+
+    struct fo_server **servers;
+    size_t next;
+    const char *active;
+    bool ldaps;
+
+    struct fo_server *srv;
+    struct sdap_handle *sh;
+    struct timeval start;
+    int64_t usec;
+};
+
+static errno_t sdap_server_probe_next(struct tevent_req *req);
+static void sdap_server_probe_connect_done(struct tevent_req *subreq);
+static void sdap_server_probe_rootdse_done(struct tevent_req *subreq);
+
+/* Connects to every resolved server of the service except the active one
+ * and reads the rootDSE, one server after another. A server which answers
+ * can be used again and its round trip time is recorded. */
+struct tevent_req *sdap_server_probe_send(TALLOC_CTX *mem_ctx,
+                                          struct tevent_context *ev,
+                                          struct be_ctx *be,
+                                          struct sdap_options *opts,
+                                          struct sdap_service *service)
+{
+    struct sdap_server_probe_state *state;
+    struct tevent_req *req;
+    size_t count;
+    size_t i;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct sdap_server_probe_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->be = be;
+    state->opts = opts;
+    state->service = service;
+    state->active = be_fo_get_active_server_name(be, service->name);
+    state->ldaps = service->uri != NULL
+                   && strncasecmp(service->uri, "ldaps://", 8) == 0;
+
+    ret = be_fo_get_resolved_servers(state, be, service->name,
+                                     &state->servers, &count);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    /* an SRV refresh must not free them while they are probed */
+    for (i = 0; i < count; i++) {
+        fo_ref_server(state, state->servers[i]);
+    }
+
+    ret = sdap_server_probe_next(req);
+    if (ret == EAGAIN) {
+        return req;
+    }
+
+immediately:
+    if (ret == EOK || ret == ENOENT) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+
+    return req;
+}
+
+static errno_t sdap_server_probe_next(struct tevent_req *req)
+{
+    struct sdap_server_probe_state *state;
+    struct sockaddr_storage *sockaddr;
+    struct tevent_req *subreq;
+    const char *name = NULL;
+    char *uri;
+    int port;
+
+    state = tevent_req_data(req, struct sdap_server_probe_state);
+
+    for (state->srv = state->servers[state->next];
+         state->srv != NULL;
+         state->srv = state->servers[++state->next]) {
+        name = fo_get_server_name(state->srv);
+        if (name != NULL && (state->active == NULL
+                             || strcmp(name, state->active) != 0)) {
+            break;
+        }
+    }
+
+    if (state->srv == NULL) {
+        return EOK;
+    }
+    state->next++;
+
+    port = fo_get_server_port(state->srv);
+    if (port == 0) {
+        port = state->ldaps ? SDAP_PROBE_LDAPS_PORT : SDAP_PROBE_LDAP_PORT;
+    }
+
+    uri = talloc_asprintf(state, "%s://%s:%d", state->ldaps ? "ldaps" : "ldap",
+                          name, port);
+    sockaddr = resolv_get_sockaddr_address(state,
+                                           fo_get_server_hostent(state->srv),
+                                           port);
+    if (uri == NULL || sockaddr == NULL) {
+        return ENOMEM;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Probing the standby server %s\n", uri);
+
+    gettimeofday(&state->start, NULL);
+    subreq = sdap_connect_send(state, state->ev, state->opts, uri, sockaddr,
+                               false);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(subreq, sdap_server_probe_connect_done, req);
+    return EAGAIN;
+}
+
+static void sdap_server_probe_result(struct tevent_req *req, bool working)
+{
+    struct sdap_server_probe_state *state;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct sdap_server_probe_state);
+
+    talloc_zfree(state->sh);
+
+    /* the same measure as sdap_cli_record_rtt() takes */
+    if (working && state->usec >= 0 && state->usec <= UINT32_MAX) {
+        ret = be_fo_record_server_rtt(state->be,
+                                      fo_get_server_name(state->srv),
+                                      state->usec);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Cannot record the round trip time "
+                  "[%d]: %s\n", ret, sss_strerror(ret));
+        }
+    } else if (!working) {
+        DEBUG(SSSDBG_TRACE_FUNC, "The standby server %s does not answer\n",
+              fo_get_server_name(state->srv));
+    }
+
+    be_fo_set_server_probed(state->be, state->service->name,
+                            state->srv, working);
+
+    ret = sdap_server_probe_next(req);
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else if (ret != EAGAIN) {
+        tevent_req_error(req, ret);
+    }
+}
+
+static void sdap_server_probe_connect_done(struct tevent_req *subreq)
+{
+    struct sdap_server_probe_state *state;
+    struct tevent_req *req;
+    struct timeval now;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sdap_server_probe_state);
+
+    ret = sdap_connect_recv(subreq, state, &state->sh);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        sdap_server_probe_result(req, false);
+        return;
+    }
+
+    gettimeofday(&now, NULL);
+    state->usec = (now.tv_sec - state->start.tv_sec) * 1000000LL
+                      + now.tv_usec - state->start.tv_usec;
+
+    /* a connection alone does not tell that slapd itself answers */
+    subreq = sdap_get_rootdse_send(state, state->ev, state->opts, state->sh);
+    if (subreq == NULL) {
+        tevent_req_error(req, ENOMEM);
+        return;
+    }
+
+    tevent_req_set_callback(subreq, sdap_server_probe_rootdse_done, req);
+}
+
+static void sdap_server_probe_rootdse_done(struct tevent_req *subreq)
+{
+    struct sysdb_attrs *rootdse;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+
+    ret = sdap_get_rootdse_recv(subreq, subreq, &rootdse);
+    talloc_zfree(subreq);
+
+    sdap_server_probe_result(req, ret == EOK);
+}
+
+errno_t sdap_server_probe_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
 static int synchronous_tls_setup(LDAP *ldap)
 {
     int lret;
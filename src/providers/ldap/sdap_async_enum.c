@@ -29,6 +29,7 @@
 #include "db/sysdb.h"
 #include "providers/ldap/ldap_common.h"
 #include "providers/ldap/sdap_async.h"
+#include "providers/ldap/sdap_async_private.h"
 #include "providers/ldap/sdap_async_enum.h"
 #include "providers/ldap/sdap_idmap.h"
 
@@ -48,6 +49,14 @@ static struct tevent_req *enum_groups_send(TALLOC_CTX *memctx,
                                           bool purge);
 static errno_t enum_groups_recv(struct tevent_req *req);
 
+static struct tevent_req *sdap_sync_start_send(TALLOC_CTX *memctx,
+                                               struct tevent_context *ev,
+                                               struct sdap_id_ctx *ctx,
+                                               struct sdap_domain *sdom,
+                                               struct sdap_id_conn_ctx *conn,
+                                               bool groups);
+static errno_t sdap_sync_start_recv(struct tevent_req *req, int *_dp_error);
+
 /* ==Enumeration-Request-with-connections=================================== */
 struct sdap_dom_enum_ex_state {
     struct tevent_context *ev;
@@ -68,6 +77,13 @@ static errno_t sdap_dom_enum_ex_retry(struct tevent_req *req,
                                       struct sdap_id_op *op,
                                       tevent_req_fn tcb);
 static bool sdap_dom_enum_ex_connected(struct tevent_req *subreq);
+static errno_t sdap_dom_enum_ex_users(struct tevent_req *req);
+static errno_t sdap_dom_enum_ex_poll_users(struct tevent_req *req);
+static void sdap_dom_enum_ex_sync_users_done(struct tevent_req *subreq);
+static errno_t sdap_dom_enum_ex_groups(struct tevent_req *req);
+static errno_t sdap_dom_enum_ex_poll_groups(struct tevent_req *req);
+static void sdap_dom_enum_ex_sync_groups_done(struct tevent_req *subreq);
+static errno_t sdap_dom_enum_ex_poll_svcs(struct tevent_req *req);
 static void sdap_dom_enum_ex_get_users(struct tevent_req *subreq);
 static void sdap_dom_enum_ex_posix_check_done(struct tevent_req *subreq);
 static errno_t sdap_dom_enum_search_users(struct tevent_req *req);
@@ -94,6 +110,8 @@ sdap_dom_enum_ex_send(TALLOC_CTX *memctx,
     req = tevent_req_create(memctx, &state, struct sdap_dom_enum_ex_state);
     if (req == NULL) return NULL;
 
+    sdap_op_class_set(state, SDAP_OP_CLASS_ENUM);
+
     state->ev = ev;
     state->ctx = ctx;
     state->sdom = sdom;
@@ -107,26 +125,171 @@ sdap_dom_enum_ex_send(TALLOC_CTX *memctx,
         state->purge = true;
     }
 
-    state->user_op = sdap_id_op_create(state, user_conn->conn_cache);
+    ret = sdap_dom_enum_ex_users(req);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    return req;
+
+fail:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+/* With content synchronization the users and groups are only searched
+ * again if the synchronization ended */
+static errno_t sdap_dom_enum_ex_users(struct tevent_req *req)
+{
+    struct sdap_dom_enum_ex_state *state = tevent_req_data(req,
+                                                struct sdap_dom_enum_ex_state);
+    struct tevent_req *subreq;
+
+    if (!dp_opt_get_bool(state->ctx->opts->basic, SDAP_CONTENT_SYNC)) {
+        return sdap_dom_enum_ex_poll_users(req);
+    }
+
+    subreq = sdap_sync_start_send(state, state->ev, state->ctx, state->sdom,
+                                  state->user_conn, false);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(subreq, sdap_dom_enum_ex_sync_users_done, req);
+    return EOK;
+}
+
+static errno_t sdap_dom_enum_ex_poll_users(struct tevent_req *req)
+{
+    struct sdap_dom_enum_ex_state *state = tevent_req_data(req,
+                                                struct sdap_dom_enum_ex_state);
+    errno_t ret;
+
+    state->user_op = sdap_id_op_create(state, state->user_conn->conn_cache);
     if (state->user_op == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "sdap_id_op_create failed for users\n");
-        ret = EIO;
-        goto fail;
+        return EIO;
     }
 
     ret = sdap_dom_enum_ex_retry(req, state->user_op,
                                  sdap_dom_enum_ex_get_users);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "sdap_dom_enum_ex_retry failed\n");
-        goto fail;
+        return ret;
     }
 
-    return req;
+    return EOK;
+}
 
-fail:
-    tevent_req_error(req, ret);
-    tevent_req_post(req, ev);
-    return req;
+static void sdap_dom_enum_ex_sync_users_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    errno_t ret;
+    int dp_error;
+
+    ret = sdap_sync_start_recv(subreq, &dp_error);
+    talloc_zfree(subreq);
+    if (dp_error == DP_ERR_OFFLINE) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Backend is offline, retrying later\n");
+        tevent_req_done(req);
+        return;
+    } else if (ret != EOK) {
+        if (ret != ENOTSUP) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "User synchronization failed [%d]: %s, searching the "
+                  "users\n", ret, sss_strerror(ret));
+        }
+
+        ret = sdap_dom_enum_ex_poll_users(req);
+    } else {
+        ret = sdap_dom_enum_ex_groups(req);
+    }
+
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+}
+
+static errno_t sdap_dom_enum_ex_groups(struct tevent_req *req)
+{
+    struct sdap_dom_enum_ex_state *state = tevent_req_data(req,
+                                                struct sdap_dom_enum_ex_state);
+    struct tevent_req *subreq;
+
+    if (!dp_opt_get_bool(state->ctx->opts->basic, SDAP_CONTENT_SYNC)) {
+        return sdap_dom_enum_ex_poll_groups(req);
+    }
+
+    subreq = sdap_sync_start_send(state, state->ev, state->ctx, state->sdom,
+                                  state->group_conn, true);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(subreq, sdap_dom_enum_ex_sync_groups_done, req);
+    return EOK;
+}
+
+static errno_t sdap_dom_enum_ex_poll_groups(struct tevent_req *req)
+{
+    struct sdap_dom_enum_ex_state *state = tevent_req_data(req,
+                                                struct sdap_dom_enum_ex_state);
+
+    state->group_op = sdap_id_op_create(state, state->group_conn->conn_cache);
+    if (state->group_op == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_id_op_create failed for groups\n");
+        return EIO;
+    }
+
+    return sdap_dom_enum_ex_retry(req, state->group_op,
+                                  sdap_dom_enum_ex_get_groups);
+}
+
+static void sdap_dom_enum_ex_sync_groups_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    errno_t ret;
+    int dp_error;
+
+    ret = sdap_sync_start_recv(subreq, &dp_error);
+    talloc_zfree(subreq);
+    if (dp_error == DP_ERR_OFFLINE) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Backend is offline, retrying later\n");
+        tevent_req_done(req);
+        return;
+    } else if (ret != EOK) {
+        if (ret != ENOTSUP) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Group synchronization failed [%d]: %s, searching the "
+                  "groups\n", ret, sss_strerror(ret));
+        }
+
+        ret = sdap_dom_enum_ex_poll_groups(req);
+    } else {
+        ret = sdap_dom_enum_ex_poll_svcs(req);
+    }
+
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+}
+
+static errno_t sdap_dom_enum_ex_poll_svcs(struct tevent_req *req)
+{
+    struct sdap_dom_enum_ex_state *state = tevent_req_data(req,
+                                                struct sdap_dom_enum_ex_state);
+
+    state->svc_op = sdap_id_op_create(state, state->svc_conn->conn_cache);
+    if (state->svc_op == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_id_op_create failed for svcs\n");
+        return EIO;
+    }
+
+    return sdap_dom_enum_ex_retry(req, state->svc_op,
+                                  sdap_dom_enum_ex_get_svcs);
 }
 
 static errno_t sdap_dom_enum_ex_retry(struct tevent_req *req,
@@ -329,15 +492,7 @@ static void sdap_dom_enum_ex_users_done(struct tevent_req *subreq)
         return;
     }
 
-    state->group_op = sdap_id_op_create(state, state->group_conn->conn_cache);
-    if (state->group_op == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_id_op_create failed for groups\n");
-        tevent_req_error(req, EIO);
-        return;
-    }
-
-    ret = sdap_dom_enum_ex_retry(req, state->group_op,
-                                 sdap_dom_enum_ex_get_groups);
+    ret = sdap_dom_enum_ex_groups(req);
     if (ret != EOK) {
         tevent_req_error(req, ret);
         return;
@@ -400,16 +555,7 @@ static void sdap_dom_enum_ex_groups_done(struct tevent_req *subreq)
         return;
     }
 
-
-    state->svc_op = sdap_id_op_create(state, state->svc_conn->conn_cache);
-    if (state->svc_op == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_id_op_create failed for svcs\n");
-        tevent_req_error(req, EIO);
-        return;
-    }
-
-    ret = sdap_dom_enum_ex_retry(req, state->svc_op,
-                                 sdap_dom_enum_ex_get_svcs);
+    ret = sdap_dom_enum_ex_poll_svcs(req);
     if (ret != EOK) {
         tevent_req_error(req, ret);
         return;
@@ -531,77 +677,84 @@ struct enum_users_state {
 
 static void enum_users_done(struct tevent_req *subreq);
 
-static struct tevent_req *enum_users_send(TALLOC_CTX *memctx,
-                                          struct tevent_context *ev,
-                                          struct sdap_id_ctx *ctx,
-                                          struct sdap_domain *sdom,
-                                          struct sdap_id_op *op,
-                                          bool purge)
+/* The filter of the enumerated users, the conditions in extra are added */
+char *sdap_enum_users_filter(TALLOC_CTX *mem_ctx,
+                             struct sdap_id_ctx *ctx,
+                             struct sdap_domain *sdom,
+                             const char *extra)
 {
-    struct tevent_req *req, *subreq;
-    struct enum_users_state *state;
-    int ret;
+    char *filter;
     bool use_mapping;
 
-    req = tevent_req_create(memctx, &state, struct enum_users_state);
-    if (!req) return NULL;
-
-    state->ev = ev;
-    state->sdom = sdom;
-    state->ctx = ctx;
-    state->op = op;
-
     use_mapping = sdap_idmap_domain_has_algorithmic_mapping(
                                                         ctx->opts->idmap_ctx,
                                                         sdom->dom->name,
                                                         sdom->dom->domain_id);
 
     /* We always want to filter on objectclass and an available name */
-    state->filter = talloc_asprintf(state,
-                                  "(&(objectclass=%s)(%s=*)",
-                                  ctx->opts->user_map[SDAP_OC_USER].name,
-                                  ctx->opts->user_map[SDAP_AT_USER_NAME].name);
-    if (!state->filter) {
-        DEBUG(SSSDBG_MINOR_FAILURE,
-              "Failed to build base filter\n");
-        ret = ENOMEM;
-        goto fail;
+    filter = talloc_asprintf(mem_ctx,
+                             "(&(objectclass=%s)(%s=*)",
+                             ctx->opts->user_map[SDAP_OC_USER].name,
+                             ctx->opts->user_map[SDAP_AT_USER_NAME].name);
+    if (filter == NULL) {
+        return NULL;
     }
 
     if (use_mapping) {
         /* If we're ID-mapping, check for the objectSID as well */
-        state->filter = talloc_asprintf_append_buffer(
-                state->filter, "(%s=*)",
+        filter = talloc_asprintf_append_buffer(
+                filter, "(%s=*)",
                 ctx->opts->user_map[SDAP_AT_USER_OBJECTSID].name);
     } else {
         /* We're not ID-mapping, so make sure to only get entries
          * that have UID and GID
          */
-        state->filter = talloc_asprintf_append_buffer(
-                state->filter, "(%s=*)(%s=*)",
+        filter = talloc_asprintf_append_buffer(
+                filter, "(%s=*)(%s=*)",
                 ctx->opts->user_map[SDAP_AT_USER_UID].name,
                 ctx->opts->user_map[SDAP_AT_USER_GID].name);
     }
-    if (!state->filter) {
-        DEBUG(SSSDBG_MINOR_FAILURE,
-              "Failed to build base filter\n");
-        ret = ENOMEM;
-        goto fail;
+    if (filter == NULL) {
+        return NULL;
     }
 
+    /* Terminate the search filter */
+    return talloc_asprintf_append_buffer(filter, "%s)",
+                                         extra != NULL ? extra : "");
+}
+
+static struct tevent_req *enum_users_send(TALLOC_CTX *memctx,
+                                          struct tevent_context *ev,
+                                          struct sdap_id_ctx *ctx,
+                                          struct sdap_domain *sdom,
+                                          struct sdap_id_op *op,
+                                          bool purge)
+{
+    struct tevent_req *req, *subreq;
+    struct enum_users_state *state;
+    char *usn_filter = NULL;
+    int ret;
+
+    req = tevent_req_create(memctx, &state, struct enum_users_state);
+    if (!req) return NULL;
+
+    state->ev = ev;
+    state->sdom = sdom;
+    state->ctx = ctx;
+    state->op = op;
+
     if (ctx->srv_opts && ctx->srv_opts->max_user_value && !purge) {
         /* If we have lastUSN available and we're not doing a full
          * refresh, limit to changes with a higher entryUSN value.
          */
-        state->filter = talloc_asprintf_append_buffer(
-                state->filter,
+        usn_filter = talloc_asprintf(state,
                 "(%s>=%s)(!(%s=%s))",
                 ctx->opts->user_map[SDAP_AT_USER_USN].name,
                 ctx->srv_opts->max_user_value,
                 ctx->opts->user_map[SDAP_AT_USER_USN].name,
                 ctx->srv_opts->max_user_value);
 
-        if (!state->filter) {
+        if (!usn_filter) {
             DEBUG(SSSDBG_MINOR_FAILURE,
                   "Failed to build base filter\n");
             ret = ENOMEM;
@@ -609,8 +762,7 @@ static struct tevent_req *enum_users_send(TALLOC_CTX *memctx,
         }
     }
 
-    /* Terminate the search filter */
-    state->filter = talloc_asprintf_append_buffer(state->filter, ")");
+    state->filter = sdap_enum_users_filter(state, ctx, sdom, usn_filter);
     if (!state->filter) {
         DEBUG(SSSDBG_OP_FAILURE, "Failed to build base filter\n");
         ret = ENOMEM;
@@ -707,26 +859,15 @@ struct enum_groups_state {
 
 static void enum_groups_done(struct tevent_req *subreq);
 
-static struct tevent_req *enum_groups_send(TALLOC_CTX *memctx,
-                                          struct tevent_context *ev,
-                                          struct sdap_id_ctx *ctx,
-                                          struct sdap_domain *sdom,
-                                          struct sdap_id_op *op,
-                                          bool purge)
+/* The filter of the enumerated groups, the conditions in extra are added */
+char *sdap_enum_groups_filter(TALLOC_CTX *mem_ctx,
+                              struct sdap_id_ctx *ctx,
+                              struct sdap_domain *sdom,
+                              const char *extra)
 {
-    struct tevent_req *req, *subreq;
-    struct enum_groups_state *state;
-    int ret;
-    bool use_mapping;
+    char *filter;
     char *oc_list;
-
-    req = tevent_req_create(memctx, &state, struct enum_groups_state);
-    if (!req) return NULL;
-
-    state->ev = ev;
-    state->sdom = sdom;
-    state->ctx = ctx;
-    state->op = op;
+    bool use_mapping;
 
     use_mapping = sdap_idmap_domain_has_algorithmic_mapping(
                                                         ctx->opts->idmap_ctx,
@@ -734,52 +875,70 @@ static struct tevent_req *enum_groups_send(TALLOC_CTX *memctx,
                                                         sdom->dom->domain_id);
 
     /* We always want to filter on objectclass and an available name */
-    oc_list = sdap_make_oc_list(state, ctx->opts->group_map);
+    oc_list = sdap_make_oc_list(mem_ctx, ctx->opts->group_map);
     if (oc_list == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to create objectClass list.\n");
-        ret = ENOMEM;
-        goto fail;
+        return NULL;
     }
 
-    state->filter = talloc_asprintf(state, "(&(%s)(%s=*)", oc_list,
-                               ctx->opts->group_map[SDAP_AT_GROUP_NAME].name);
-    if (!state->filter) {
-        DEBUG(SSSDBG_MINOR_FAILURE,
-              "Failed to build base filter\n");
-        ret = ENOMEM;
-        goto fail;
+    filter = talloc_asprintf(mem_ctx, "(&(%s)(%s=*)", oc_list,
+                             ctx->opts->group_map[SDAP_AT_GROUP_NAME].name);
+    talloc_free(oc_list);
+    if (filter == NULL) {
+        return NULL;
     }
 
     if (use_mapping) {
         /* If we're ID-mapping, check for the objectSID as well */
-        state->filter = talloc_asprintf_append_buffer(
-                state->filter, "(%s=*)",
+        filter = talloc_asprintf_append_buffer(
+                filter, "(%s=*)",
                 ctx->opts->group_map[SDAP_AT_GROUP_OBJECTSID].name);
     } else {
         /* We're not ID-mapping, so make sure to only get entries
          * that have a non-zero GID.
          */
-        state->filter = talloc_asprintf_append_buffer(
-                state->filter, "(&(%s=*)(!(%s=0)))",
+        filter = talloc_asprintf_append_buffer(
+                filter, "(&(%s=*)(!(%s=0)))",
                 ctx->opts->group_map[SDAP_AT_GROUP_GID].name,
                 ctx->opts->group_map[SDAP_AT_GROUP_GID].name);
     }
-    if (!state->filter) {
-        DEBUG(SSSDBG_MINOR_FAILURE,
-              "Failed to build base filter\n");
-        ret = ENOMEM;
-        goto fail;
+    if (filter == NULL) {
+        return NULL;
     }
 
+    /* Terminate the search filter */
+    return talloc_asprintf_append_buffer(filter, "%s)",
+                                         extra != NULL ? extra : "");
+}
+
+static struct tevent_req *enum_groups_send(TALLOC_CTX *memctx,
+                                          struct tevent_context *ev,
+                                          struct sdap_id_ctx *ctx,
+                                          struct sdap_domain *sdom,
+                                          struct sdap_id_op *op,
+                                          bool purge)
+{
+    struct tevent_req *req, *subreq;
+    struct enum_groups_state *state;
+    char *usn_filter = NULL;
+    int ret;
+
+    req = tevent_req_create(memctx, &state, struct enum_groups_state);
+    if (!req) return NULL;
+
+    state->ev = ev;
+    state->sdom = sdom;
+    state->ctx = ctx;
+    state->op = op;
+
     if (ctx->srv_opts && ctx->srv_opts->max_group_value && !purge) {
-        state->filter = talloc_asprintf_append_buffer(
-                state->filter,
+        usn_filter = talloc_asprintf(state,
                 "(%s>=%s)(!(%s=%s))",
                 ctx->opts->group_map[SDAP_AT_GROUP_USN].name,
                 ctx->srv_opts->max_group_value,
                 ctx->opts->group_map[SDAP_AT_GROUP_USN].name,
                 ctx->srv_opts->max_group_value);
-        if (!state->filter) {
+        if (!usn_filter) {
             DEBUG(SSSDBG_MINOR_FAILURE,
                   "Failed to build base filter\n");
             ret = ENOMEM;
@@ -787,8 +946,7 @@ static struct tevent_req *enum_groups_send(TALLOC_CTX *memctx,
         }
     }
 
-    /* Terminate the search filter */
-    state->filter = talloc_asprintf_append_buffer(state->filter, ")");
+    state->filter = sdap_enum_groups_filter(state, ctx, sdom, usn_filter);
     if (!state->filter) {
         DEBUG(SSSDBG_MINOR_FAILURE,
               "Failed to build base filter\n");
@@ -868,3 +1026,701 @@ static errno_t enum_groups_recv(struct tevent_req *req)
 
     return EOK;
 }
+
+/* ==Content-Synchronization============================================== */
+/* The users and the groups each have a refreshAndPersist search which stays
+ * open after the enumeration. The users are stored from the entries the
+ * server sends. The groups are searched again by name, their members need
+ * the same processing as in a group enumeration. The entries are stored in
+ * chunks, after SDAP_SYNC_FLUSH_DELAY or when SDAP_SYNC_FLUSH_SIZE entries
+ * are waiting. */
+
+#define SDAP_SYNC_FLUSH_DELAY 1
+#define SDAP_SYNC_FLUSH_SIZE 100
+
+struct sdap_sync_ctx;
+
+struct sdap_sync_session {
+    struct sdap_sync_ctx *sync_ctx;
+    bool groups;
+
+    struct sdap_id_conn_ctx *conn;
+    struct sdap_id_op *op;
+    struct tevent_req *search;
+    char *filter;
+    const char **attrs;
+
+    /* the last cookie sent by the server */
+    struct berval cookie;
+    /* all the entries are sent, the groups are enumerated at the end */
+    bool full_refresh;
+    bool refreshed;
+    /* the enumeration waiting for the refresh phase */
+    struct tevent_req *start_req;
+
+    struct sysdb_attrs **pending;
+    size_t num_pending;
+    struct tevent_timer *flush_timer;
+    struct tevent_req *flush_req;
+};
+
+struct sdap_sync_ctx {
+    struct tevent_context *ev;
+    struct sdap_id_ctx *id_ctx;
+    struct sdap_domain *sdom;
+
+    struct sdap_sync_session users;
+    struct sdap_sync_session groups;
+};
+
+static errno_t sdap_sync_session_connect(struct sdap_sync_session *session);
+static void sdap_sync_session_connect_done(struct tevent_req *subreq);
+static void sdap_sync_session_done(struct tevent_req *subreq);
+static void sdap_sync_session_flush(struct sdap_sync_session *session);
+static void sdap_sync_groups_flush_done(struct tevent_req *subreq);
+
+static void sdap_sync_session_started(struct sdap_sync_session *session,
+                                      errno_t ret, int dp_error);
+
+static errno_t sdap_sync_entry(enum sdap_sync_state sync_state,
+                               const char *dn,
+                               struct sysdb_attrs *attrs,
+                               void *pvt);
+static void sdap_sync_refreshed(void *pvt);
+static errno_t sdap_sync_cookie(struct berval *cookie, void *pvt);
+
+static struct sdap_sync_handlers sdap_sync_session_handlers = {
+    .entry = sdap_sync_entry,
+    .refreshed = sdap_sync_refreshed,
+    .cookie = sdap_sync_cookie,
+};
+
+static struct sdap_sync_ctx *sdap_sync_ctx_get(struct tevent_context *ev,
+                                               struct sdap_id_ctx *id_ctx,
+                                               struct sdap_domain *sdom)
+{
+    struct sdap_sync_ctx *sync_ctx;
+
+    if (sdom->sync_ctx != NULL) {
+        return sdom->sync_ctx;
+    }
+
+    sync_ctx = talloc_zero(sdom, struct sdap_sync_ctx);
+    if (sync_ctx == NULL) {
+        return NULL;
+    }
+
+    sync_ctx->ev = ev;
+    sync_ctx->id_ctx = id_ctx;
+    sync_ctx->sdom = sdom;
+    sync_ctx->users.sync_ctx = sync_ctx;
+    sync_ctx->groups.sync_ctx = sync_ctx;
+    sync_ctx->groups.groups = true;
+
+    sdom->sync_ctx = sync_ctx;
+    return sync_ctx;
+}
+
+struct sdap_sync_start_state {
+    struct sdap_sync_session *session;
+    int dp_error;
+};
+
+static int sdap_sync_start_state_destructor(struct sdap_sync_start_state *state)
+{
+    if (state->session != NULL) {
+        state->session->start_req = NULL;
+    }
+
+    return 0;
+}
+
+/* Starts the synchronization of the users or groups unless it is running
+ * already, finishes when the refresh phase is over */
+static struct tevent_req *sdap_sync_start_send(TALLOC_CTX *memctx,
+                                               struct tevent_context *ev,
+                                               struct sdap_id_ctx *ctx,
+                                               struct sdap_domain *sdom,
+                                               struct sdap_id_conn_ctx *conn,
+                                               bool groups)
+{
+    struct tevent_req *req;
+    struct sdap_sync_start_state *state;
+    struct sdap_search_base **bases;
+    struct sdap_sync_ctx *sync_ctx;
+    struct sdap_sync_session *session;
+    errno_t ret;
+
+    req = tevent_req_create(memctx, &state, struct sdap_sync_start_state);
+    if (req == NULL) return NULL;
+
+    state->dp_error = DP_ERR_FATAL;
+
+    /* the search would only return the entries of the first base */
+    bases = groups ? sdom->group_search_bases : sdom->user_search_bases;
+    if (bases == NULL || bases[0] == NULL || bases[1] != NULL) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "Content synchronization needs a single search base\n");
+        ret = ENOTSUP;
+        goto immediately;
+    }
+
+    sync_ctx = sdap_sync_ctx_get(ev, ctx, sdom);
+    if (sync_ctx == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    session = groups ? &sync_ctx->groups : &sync_ctx->users;
+    if (session->op != NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "The %s are being synchronized\n",
+              groups ? "groups" : "users");
+        state->dp_error = DP_ERR_OK;
+        ret = EOK;
+        goto immediately;
+    }
+
+    session->conn = conn;
+    session->start_req = req;
+    state->session = session;
+    talloc_set_destructor(state, sdap_sync_start_state_destructor);
+
+    ret = sdap_sync_session_connect(session);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    return req;
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static errno_t sdap_sync_start_recv(struct tevent_req *req, int *_dp_error)
+{
+    struct sdap_sync_start_state *state = tevent_req_data(req,
+                                                struct sdap_sync_start_state);
+
+    *_dp_error = state->dp_error;
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+static void sdap_sync_session_started(struct sdap_sync_session *session,
+                                      errno_t ret, int dp_error)
+{
+    struct tevent_req *req = session->start_req;
+    struct sdap_sync_start_state *state;
+
+    if (req == NULL) {
+        return;
+    }
+
+    state = tevent_req_data(req, struct sdap_sync_start_state);
+    state->session = NULL;
+    state->dp_error = dp_error;
+    session->start_req = NULL;
+
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+}
+
+static errno_t sdap_sync_session_connect(struct sdap_sync_session *session)
+{
+    struct tevent_req *subreq;
+    errno_t ret;
+
+    if (session->op == NULL) {
+        session->op = sdap_id_op_create(session->sync_ctx,
+                                        session->conn->conn_cache);
+        if (session->op == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "sdap_id_op_create failed\n");
+            return ENOMEM;
+        }
+    }
+
+    subreq = sdap_id_op_connect_send(session->op, session->sync_ctx, &ret);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "sdap_id_op_connect_send failed: %d\n", ret);
+        talloc_zfree(session->op);
+        return ret;
+    }
+
+    tevent_req_set_callback(subreq, sdap_sync_session_connect_done, session);
+    return EOK;
+}
+
+static void sdap_sync_session_connect_done(struct tevent_req *subreq)
+{
+    struct sdap_sync_session *session = tevent_req_callback_data(subreq,
+                                                    struct sdap_sync_session);
+    struct sdap_sync_ctx *sync_ctx = session->sync_ctx;
+    struct sdap_options *opts = sync_ctx->id_ctx->opts;
+    struct sdap_search_base *base;
+    struct sdap_attr_map *map;
+    int map_num_attrs;
+    char *filter;
+    int dp_error;
+    errno_t ret;
+
+    ret = sdap_id_op_connect_recv(subreq, &dp_error);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Content synchronization failed to connect: (%d)[%s]\n",
+              ret, sss_strerror(ret));
+        goto fail;
+    }
+
+    if (session->groups) {
+        base = sync_ctx->sdom->group_search_bases[0];
+        map = opts->group_map;
+        map_num_attrs = SDAP_OPTS_GROUP;
+    } else {
+        base = sync_ctx->sdom->user_search_bases[0];
+        map = opts->user_map;
+        map_num_attrs = opts->user_map_cnt;
+    }
+
+    if (session->filter == NULL) {
+        if (session->groups) {
+            filter = sdap_enum_groups_filter(sync_ctx, sync_ctx->id_ctx,
+                                             sync_ctx->sdom, NULL);
+        } else {
+            filter = sdap_enum_users_filter(sync_ctx, sync_ctx->id_ctx,
+                                            sync_ctx->sdom, NULL);
+        }
+        if (filter == NULL) {
+            ret = ENOMEM;
+            goto fail;
+        }
+
+        session->filter = sdap_combine_filters(sync_ctx, filter,
+                                               base->filter);
+        talloc_free(filter);
+        if (session->filter == NULL) {
+            ret = ENOMEM;
+            goto fail;
+        }
+
+        ret = build_attrs_from_map(sync_ctx, map, map_num_attrs,
+                                   NULL, &session->attrs, NULL);
+        if (ret != EOK) {
+            talloc_zfree(session->filter);
+            goto fail;
+        }
+    }
+
+    session->full_refresh = session->cookie.bv_len == 0;
+    session->refreshed = false;
+
+    subreq = sdap_sync_search_send(sync_ctx, sync_ctx->ev, opts,
+                                   sdap_id_op_handle(session->op),
+                                   base->basedn, base->scope,
+                                   session->filter, session->attrs,
+                                   map, map_num_attrs,
+                                   session->full_refresh ?
+                                        NULL : &session->cookie,
+                                   &sdap_sync_session_handlers, session);
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    tevent_req_set_callback(subreq, sdap_sync_session_done, session);
+    session->search = subreq;
+    return;
+
+fail:
+    talloc_zfree(session->op);
+    sdap_sync_session_started(session, ret, dp_error);
+}
+
+static void sdap_sync_session_done(struct tevent_req *subreq)
+{
+    struct sdap_sync_session *session = tevent_req_callback_data(subreq,
+                                                    struct sdap_sync_session);
+    int dp_error;
+    errno_t ret;
+
+    ret = sdap_sync_search_recv(subreq);
+    talloc_zfree(subreq);
+    session->search = NULL;
+
+    DEBUG(ret == ENOTSUP ? SSSDBG_CONF_SETTINGS : SSSDBG_MINOR_FAILURE,
+          "Content synchronization of the %s ended [%d]: %s\n",
+          session->groups ? "groups" : "users", ret, sss_strerror(ret));
+
+    /* store what was received */
+    sdap_sync_session_flush(session);
+
+    if (ret == ERR_SYNC_REFRESH_REQUIRED) {
+        /* the cookie is too old, start over */
+        talloc_zfree(session->cookie.bv_val);
+        session->cookie.bv_len = 0;
+
+        sdap_id_op_done(session->op, EOK, &dp_error);
+        ret = sdap_sync_session_connect(session);
+        if (ret == EOK) {
+            return;
+        }
+    } else {
+        ret = sdap_id_op_done(session->op, ret, &dp_error);
+        if (dp_error == DP_ERR_OK && ret != EOK) {
+            /* the connection was lost */
+            ret = sdap_sync_session_connect(session);
+            if (ret == EOK) {
+                return;
+            }
+        }
+    }
+
+    talloc_zfree(session->op);
+    sdap_sync_session_started(session, ret == EOK ? EIO : ret, dp_error);
+}
+
+static errno_t sdap_sync_cookie(struct berval *cookie, void *pvt)
+{
+    struct sdap_sync_session *session = pvt;
+    char *val;
+
+    val = talloc_memdup(session->sync_ctx, cookie->bv_val, cookie->bv_len);
+    if (val == NULL) {
+        return ENOMEM;
+    }
+
+    talloc_free(session->cookie.bv_val);
+    session->cookie.bv_val = val;
+    session->cookie.bv_len = cookie->bv_len;
+    return EOK;
+}
+
+static void sdap_sync_refreshed(void *pvt)
+{
+    struct sdap_sync_session *session = pvt;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "The %s are synchronized\n",
+          session->groups ? "groups" : "users");
+    session->refreshed = true;
+
+    sdap_sync_session_flush(session);
+    if (session->flush_req == NULL) {
+        sdap_sync_session_started(session, EOK, DP_ERR_OK);
+    }
+}
+
+static void sdap_sync_flush_timeout(struct tevent_context *ev,
+                                    struct tevent_timer *te,
+                                    struct timeval tv, void *pvt)
+{
+    struct sdap_sync_session *session = pvt;
+
+    session->flush_timer = NULL;
+    sdap_sync_session_flush(session);
+}
+
+static errno_t sdap_sync_queue(struct sdap_sync_session *session,
+                               struct sysdb_attrs *attrs)
+{
+    struct sysdb_attrs **pending;
+    struct timeval tv;
+
+    /* the full refresh of the groups is one group enumeration */
+    if (session->groups && session->full_refresh && !session->refreshed) {
+        return EOK;
+    }
+
+    pending = talloc_realloc(session->sync_ctx, session->pending,
+                             struct sysdb_attrs *, session->num_pending + 1);
+    if (pending == NULL) {
+        return ENOMEM;
+    }
+    pending[session->num_pending] = talloc_steal(pending, attrs);
+    session->pending = pending;
+    session->num_pending++;
+
+    if (session->num_pending >= SDAP_SYNC_FLUSH_SIZE) {
+        sdap_sync_session_flush(session);
+    } else if (session->flush_timer == NULL) {
+        tv = tevent_timeval_current_ofs(SDAP_SYNC_FLUSH_DELAY, 0);
+        session->flush_timer = tevent_add_timer(session->sync_ctx->ev,
+                                                session->sync_ctx, tv,
+                                                sdap_sync_flush_timeout,
+                                                session);
+        if (session->flush_timer == NULL) {
+            sdap_sync_session_flush(session);
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t sdap_sync_delete(struct sdap_sync_session *session,
+                                const char *dn)
+{
+    struct sss_domain_info *dom = session->sync_ctx->sdom->dom;
+    const char *attrs[] = { SYSDB_NAME, NULL };
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message **msgs;
+    size_t count;
+    const char *name;
+    char *clean_dn;
+    char *filter;
+    size_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_filter_sanitize(tmp_ctx, dn, &clean_dn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    filter = talloc_asprintf(tmp_ctx, "(%s=%s)", SYSDB_ORIG_DN, clean_dn);
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    if (session->groups) {
+        ret = sysdb_search_groups(tmp_ctx, dom, filter, attrs,
+                                  &count, &msgs);
+    } else {
+        ret = sysdb_search_users(tmp_ctx, dom, filter, attrs,
+                                 &count, &msgs);
+    }
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        name = ldb_msg_find_attr_as_string(msgs[i], SYSDB_NAME, NULL);
+        if (name == NULL) {
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "[%s] was deleted on the server\n", name);
+        if (session->groups) {
+            ret = sysdb_delete_group(dom, name, 0);
+        } else {
+            ret = sysdb_delete_user(dom, name, 0);
+        }
+        if (ret != EOK && ret != ENOENT) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Cannot delete [%s] [%d]: %s\n",
+                  name, ret, sss_strerror(ret));
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t sdap_sync_entry(enum sdap_sync_state sync_state,
+                               const char *dn,
+                               struct sysdb_attrs *attrs,
+                               void *pvt)
+{
+    struct sdap_sync_session *session = pvt;
+
+    switch (sync_state) {
+    case SDAP_SYNC_ADD:
+    case SDAP_SYNC_MODIFY:
+        return sdap_sync_queue(session, attrs);
+    case SDAP_SYNC_DELETE:
+        if (!session->groups) {
+            /* keep the order of the changes */
+            sdap_sync_session_flush(session);
+        }
+        return sdap_sync_delete(session, dn);
+    case SDAP_SYNC_PRESENT:
+        /* unchanged */
+        break;
+    }
+
+    return EOK;
+}
+
+/* The filter of the groups waiting to be stored, at most
+ * SDAP_SYNC_FLUSH_SIZE of them */
+static char *sdap_sync_groups_filter(TALLOC_CTX *mem_ctx,
+                                     struct sdap_sync_session *session,
+                                     size_t *_num)
+{
+    struct sdap_options *opts = session->sync_ctx->id_ctx->opts;
+    struct ldb_message_element *el;
+    char *names;
+    char *clean_name;
+    char *filter;
+    size_t num;
+    size_t i;
+    unsigned int j;
+    errno_t ret;
+
+    num = MIN(session->num_pending, SDAP_SYNC_FLUSH_SIZE);
+
+    names = talloc_strdup(mem_ctx, "(|");
+    if (names == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < num; i++) {
+        ret = sysdb_attrs_get_el_ext(session->pending[i],
+                                     opts->group_map[SDAP_AT_GROUP_NAME].sys_name,
+                                     false, &el);
+        if (ret != EOK) {
+            continue;
+        }
+
+        for (j = 0; j < el->num_values; j++) {
+            ret = sss_filter_sanitize(mem_ctx,
+                                      (const char *) el->values[j].data,
+                                      &clean_name);
+            if (ret != EOK) {
+                talloc_free(names);
+                return NULL;
+            }
+
+            names = talloc_asprintf_append_buffer(names, "(%s=%s)",
+                               opts->group_map[SDAP_AT_GROUP_NAME].name,
+                               clean_name);
+            talloc_free(clean_name);
+            if (names == NULL) {
+                return NULL;
+            }
+        }
+    }
+
+    names = talloc_strdup_append_buffer(names, ")");
+    if (names == NULL) {
+        return NULL;
+    }
+
+    filter = sdap_enum_groups_filter(mem_ctx, session->sync_ctx->id_ctx,
+                                     session->sync_ctx->sdom, names);
+    talloc_free(names);
+
+    *_num = num;
+    return filter;
+}
+
+static void sdap_sync_session_flush(struct sdap_sync_session *session)
+{
+    struct sdap_sync_ctx *sync_ctx = session->sync_ctx;
+    struct sdap_options *opts = sync_ctx->id_ctx->opts;
+    struct tevent_req *subreq;
+    char *filter;
+    size_t num = 0;
+    size_t i;
+    errno_t ret;
+
+    talloc_zfree(session->flush_timer);
+
+    if (!session->groups) {
+        if (session->num_pending == 0) {
+            return;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Storing %zu synchronized users\n",
+              session->num_pending);
+        ret = sdap_save_users(sync_ctx, sync_ctx->sdom->dom->sysdb,
+                              sync_ctx->sdom->dom, opts,
+                              session->pending, session->num_pending, NULL);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store users [%d]: %s\n",
+                  ret, sss_strerror(ret));
+        }
+
+        talloc_zfree(session->pending);
+        session->num_pending = 0;
+        return;
+    }
+
+    /* the groups are searched over the connection of the synchronization */
+    if (session->flush_req != NULL || session->search == NULL) {
+        return;
+    }
+
+    if (session->full_refresh && session->refreshed) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Enumerating the synchronized groups\n");
+        session->full_refresh = false;
+        filter = session->filter;
+    } else if (session->num_pending > 0) {
+        filter = sdap_sync_groups_filter(sync_ctx, session, &num);
+        if (filter == NULL) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to build the group filter\n");
+            return;
+        }
+        DEBUG(SSSDBG_TRACE_FUNC, "Refreshing %zu synchronized groups\n", num);
+    } else {
+        return;
+    }
+
+    subreq = sdap_get_groups_send(sync_ctx, sync_ctx->ev, sync_ctx->sdom,
+                                  opts, sdap_id_op_handle(session->op),
+                                  session->attrs, filter,
+                                  dp_opt_get_int(opts->basic,
+                                                 SDAP_ENUM_SEARCH_TIMEOUT),
+                                  SDAP_LOOKUP_ENUMERATE, false);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to refresh the groups\n");
+        if (filter != session->filter) {
+            talloc_free(filter);
+        }
+        return;
+    }
+    if (filter != session->filter) {
+        talloc_steal(subreq, filter);
+    }
+    tevent_req_set_callback(subreq, sdap_sync_groups_flush_done, session);
+    session->flush_req = subreq;
+
+    for (i = 0; i < num; i++) {
+        talloc_free(session->pending[i]);
+    }
+    memmove(session->pending, session->pending + num,
+            (session->num_pending - num) * sizeof(struct sysdb_attrs *));
+    session->num_pending -= num;
+}
+
+static void sdap_sync_groups_flush_done(struct tevent_req *subreq)
+{
+    struct sdap_sync_session *session = tevent_req_callback_data(subreq,
+                                                    struct sdap_sync_session);
+    errno_t ret;
+
+    ret = sdap_get_groups_recv(subreq, NULL, NULL);
+    talloc_zfree(subreq);
+    session->flush_req = NULL;
+    if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to refresh the groups [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
+    if (session->num_pending > 0) {
+        sdap_sync_session_flush(session);
+    }
+
+    if (session->refreshed && session->flush_req == NULL) {
+        sdap_sync_session_started(session, EOK, DP_ERR_OK);
+    }
+}
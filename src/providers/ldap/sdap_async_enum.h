@@ -46,4 +46,16 @@ sdap_dom_enum_send(TALLOC_CTX *memctx,
 
 errno_t sdap_dom_enum_recv(struct tevent_req *req);
 
+/* The filters of the enumerated users and groups, the conditions in extra
+ * are added */
+char *sdap_enum_users_filter(TALLOC_CTX *mem_ctx,
+                             struct sdap_id_ctx *ctx,
+                             struct sdap_domain *sdom,
+                             const char *extra);
+
+char *sdap_enum_groups_filter(TALLOC_CTX *mem_ctx,
+                              struct sdap_id_ctx *ctx,
+                              struct sdap_domain *sdom,
+                              const char *extra);
+
 #endif /* _SDAP_ASYNC_ENUM_H_ */
@@ -340,38 +340,6 @@ done:
     /* FIXME: support non legacy */
     /* FIXME: support storing additional attributes */
 
-static errno_t
-sdap_store_group_with_gid(struct sss_domain_info *domain,
-                          const char *name,
-                          gid_t gid,
-                          struct sysdb_attrs *group_attrs,
-                          uint64_t cache_timeout,
-                          bool posix_group,
-                          time_t now)
-{
-    errno_t ret;
-
-    /* make sure that non-posix (empty or explicit gid=0) groups have the
-     * gidNumber set to zero even if updating existing group */
-    if (!posix_group) {
-        ret = sysdb_attrs_add_uint32(group_attrs, SYSDB_GIDNUM, 0);
-        if (ret) {
-            DEBUG(SSSDBG_OP_FAILURE,
-                  "Could not set explicit GID 0 for %s\n", name);
-            return ret;
-        }
-    }
-
-    ret = sysdb_store_group(domain, name, gid, group_attrs,
-                            cache_timeout, now);
-    if (ret) {
-        DEBUG(SSSDBG_OP_FAILURE, "Could not store group %s\n", name);
-        return ret;
-    }
-
-    return ret;
-}
-
 static errno_t
 sdap_process_ghost_members(struct sysdb_attrs *attrs,
                            struct sdap_options *opts,
@@ -491,15 +459,20 @@ sdap_process_ghost_members(struct sysdb_attrs *attrs,
     return EOK;
 }
 
-static int sdap_save_group(TALLOC_CTX *memctx,
-                           struct sdap_options *opts,
-                           struct sss_domain_info *dom,
-                           struct sysdb_attrs *attrs,
-                           bool populate_members,
-                           bool store_original_member,
-                           hash_table_t *ghosts,
-                           char **_usn_value,
-                           time_t now)
+/* Converts the LDAP attributes of a group into the arguments of
+ * sysdb_store_groups_bulk(). The group belongs to *_dom, which is a
+ * subdomain of dom if the SID of the group says so. Built-in groups are
+ * not stored, then group->name is NULL and EOK is returned. */
+static int sdap_prepare_group(TALLOC_CTX *memctx,
+                              struct sdap_options *opts,
+                              struct sss_domain_info *dom,
+                              struct sysdb_attrs *attrs,
+                              bool populate_members,
+                              bool store_original_member,
+                              hash_table_t *ghosts,
+                              struct sss_domain_info **_dom,
+                              struct sysdb_bulk_group *group,
+                              char **_usn_value)
 {
     struct ldb_message_element *el;
     struct sysdb_attrs *group_attrs;
@@ -514,6 +487,8 @@ static int sdap_save_group(TALLOC_CTX *memctx,
     char *sid_str;
     struct sss_domain_info *subdomain;
 
+    memset(group, 0, sizeof(*group));
+
     tmpctx = talloc_new(NULL);
     if (!tmpctx) {
         ret = ENOMEM;
@@ -745,21 +720,26 @@ static int sdap_save_group(TALLOC_CTX *memctx,
     }
     DEBUG(SSSDBG_TRACE_FUNC, "Storing info for group %s\n", group_name);
 
-    ret = sdap_store_group_with_gid(dom, group_name, gid, group_attrs,
-                                    dom->group_timeout,
-                                    posix_group, now);
-    if (ret) {
-        DEBUG(SSSDBG_MINOR_FAILURE,
-              "Could not store group with GID: [%s]\n",
-               sss_strerror(ret));
-        goto done;
+    /* make sure that non-posix (empty or explicit gid=0) groups have the
+     * gidNumber set to zero even if updating existing group */
+    if (!posix_group) {
+        ret = sysdb_attrs_add_uint32(group_attrs, SYSDB_GIDNUM, 0);
+        if (ret) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Could not set explicit GID 0 for %s\n", group_name);
+            goto done;
+        }
     }
 
+    group->name = talloc_steal(memctx, group_name);
+    group->gid = gid;
+    group->attrs = talloc_steal(memctx, group_attrs);
+    *_dom = dom;
+
     if (_usn_value) {
         *_usn_value = talloc_steal(memctx, usn_value);
     }
 
-    talloc_steal(memctx, group_attrs);
     ret = EOK;
 
 done:
@@ -1001,6 +981,93 @@ fail:
 
 /* ==Generic-Function-to-save-multiple-groups============================= */
 
+/* groups stored in one sysdb_store_groups_bulk() call */
+#define SDAP_SAVE_GROUPS_BATCH 1000
+
+struct sdap_save_groups_batch {
+    /* the data of each prepared group */
+    TALLOC_CTX **mem_ctxs;
+    struct sss_domain_info *dom;
+    struct sysdb_bulk_group *groups;
+    /* the LDAP attributes the groups were prepared from */
+    struct sysdb_attrs **ldap_attrs;
+    char **usn_values;
+    size_t num;
+};
+
+static void sdap_save_groups_higher_usn(char **_higher_usn, char *usn_value)
+{
+    char *higher_usn = *_higher_usn;
+
+    if (higher_usn) {
+        if ((strlen(usn_value) > strlen(higher_usn)) ||
+            (strcmp(usn_value, higher_usn) > 0)) {
+            talloc_zfree(higher_usn);
+            higher_usn = usn_value;
+        } else {
+            talloc_zfree(usn_value);
+        }
+    } else {
+        higher_usn = usn_value;
+    }
+
+    *_higher_usn = higher_usn;
+}
+
+static errno_t sdap_save_groups_flush(TALLOC_CTX *usn_ctx,
+                                      struct sdap_save_groups_batch *batch,
+                                      time_t now,
+                                      struct sysdb_attrs **saved_groups,
+                                      int *_nsaved_groups,
+                                      char **_higher_usn)
+{
+    errno_t ret;
+    size_t i;
+
+    if (batch->num == 0) {
+        return EOK;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Storing %zu groups of [%s]\n",
+          batch->num, batch->dom->name);
+
+    ret = sysdb_store_groups_bulk(batch->dom, batch->groups, batch->num,
+                                  batch->dom->group_timeout, now);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store groups\n");
+        return ret;
+    }
+
+    for (i = 0; i < batch->num; i++) {
+        /* Do not fail completely on errors.
+         * Just report the failure to save and go on */
+        if (batch->groups[i].ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store group [%s]. Ignoring.\n",
+                  batch->groups[i].name);
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_ALL, "Group [%s] processed!\n",
+              batch->groups[i].name);
+        if (saved_groups != NULL) {
+            saved_groups[*_nsaved_groups] = batch->ldap_attrs[i];
+            (*_nsaved_groups)++;
+        }
+
+        if (batch->usn_values[i] != NULL) {
+            sdap_save_groups_higher_usn(_higher_usn,
+                                        talloc_steal(usn_ctx,
+                                                     batch->usn_values[i]));
+        }
+    }
+
+    for (i = 0; i < batch->num; i++) {
+        talloc_zfree(batch->mem_ctxs[i]);
+    }
+    batch->num = 0;
+    return EOK;
+}
+
 static int sdap_save_groups(TALLOC_CTX *memctx,
                             struct sysdb_ctx *sysdb,
                             struct sss_domain_info *dom,
@@ -1013,6 +1080,7 @@ static int sdap_save_groups(TALLOC_CTX *memctx,
                             char **_usn_value)
 {
     TALLOC_CTX *tmpctx;
+    TALLOC_CTX *group_ctx;
     char *higher_usn = NULL;
     char *usn_value;
     bool twopass;
@@ -1020,6 +1088,10 @@ static int sdap_save_groups(TALLOC_CTX *memctx,
     int ret;
     errno_t sret;
     int i;
+    struct sdap_save_groups_batch batch;
+    struct sysdb_bulk_group group;
+    struct sss_domain_info *group_dom;
+    size_t batch_size;
     struct sysdb_attrs **saved_groups = NULL;
     int nsaved_groups = 0;
     time_t now;
@@ -1041,11 +1113,27 @@ static int sdap_save_groups(TALLOC_CTX *memctx,
         return EINVAL;
     }
 
+    if (num_groups == 0) {
+        return EOK;
+    }
+
     tmpctx = talloc_new(memctx);
     if (!tmpctx) {
         return ENOMEM;
     }
 
+    batch_size = MIN(num_groups, SDAP_SAVE_GROUPS_BATCH);
+    memset(&batch, 0, sizeof(batch));
+    batch.groups = talloc_array(tmpctx, struct sysdb_bulk_group, batch_size);
+    batch.ldap_attrs = talloc_array(tmpctx, struct sysdb_attrs *, batch_size);
+    batch.usn_values = talloc_array(tmpctx, char *, batch_size);
+    batch.mem_ctxs = talloc_array(tmpctx, TALLOC_CTX *, batch_size);
+    if (!batch.groups || !batch.ldap_attrs || !batch.usn_values
+            || !batch.mem_ctxs) {
+        ret = ENOMEM;
+        goto done;
+    }
+
     ret = sysdb_transaction_start(sysdb);
     if (ret) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
@@ -1064,40 +1152,62 @@ static int sdap_save_groups(TALLOC_CTX *memctx,
 
     now = time(NULL);
     for (i = 0; i < num_groups; i++) {
+        group_ctx = talloc_new(tmpctx);
+        if (!group_ctx) {
+            ret = ENOMEM;
+            goto done;
+        }
+
         usn_value = NULL;
 
         /* if 2 pass savemembers = false */
-        ret = sdap_save_group(tmpctx, opts, dom, groups[i],
-                              populate_members,
-                              has_nesting && save_orig_member,
-                              ghosts, &usn_value, now);
+        ret = sdap_prepare_group(group_ctx, opts, dom, groups[i],
+                                 populate_members,
+                                 has_nesting && save_orig_member,
+                                 ghosts, &group_dom, &group, &usn_value);
 
         /* Do not fail completely on errors.
          * Just report the failure to save and go on */
         if (ret) {
             DEBUG(SSSDBG_OP_FAILURE,
                   "Failed to store group %d. Ignoring.\n", i);
-        } else {
+            talloc_free(group_ctx);
+            continue;
+        }
+
+        if (group.name == NULL) {
+            /* a built-in group, it is not stored */
             DEBUG(SSSDBG_TRACE_ALL, "Group %d processed!\n", i);
-            if (twopass && !populate_members) {
+            if (saved_groups != NULL) {
                 saved_groups[nsaved_groups] = groups[i];
                 nsaved_groups++;
             }
+            talloc_free(group_ctx);
+            continue;
         }
 
-        if (usn_value) {
-            if (higher_usn) {
-                if ((strlen(usn_value) > strlen(higher_usn)) ||
-                    (strcmp(usn_value, higher_usn) > 0)) {
-                    talloc_zfree(higher_usn);
-                    higher_usn = usn_value;
-                } else {
-                    talloc_zfree(usn_value);
-                }
-            } else {
-                higher_usn = usn_value;
+        /* the groups of one bulk store must share the domain */
+        if (batch.num == batch_size
+                || (batch.num > 0 && group_dom != batch.dom)) {
+            ret = sdap_save_groups_flush(tmpctx, &batch, now, saved_groups,
+                                         &nsaved_groups, &higher_usn);
+            if (ret != EOK) {
+                goto done;
             }
         }
+
+        batch.dom = group_dom;
+        batch.mem_ctxs[batch.num] = group_ctx;
+        batch.groups[batch.num] = group;
+        batch.ldap_attrs[batch.num] = groups[i];
+        batch.usn_values[batch.num] = usn_value;
+        batch.num++;
+    }
+
+    ret = sdap_save_groups_flush(tmpctx, &batch, now, saved_groups,
+                                 &nsaved_groups, &higher_usn);
+    if (ret != EOK) {
+        goto done;
     }
 
     if (twopass && !populate_members) {
@@ -1768,11 +1878,16 @@ struct sdap_get_groups_state {
 
     struct sdap_handle *ldap_sh;
     struct sdap_id_op *op;
+
+    size_t ranged_iter;
 };
 
 static errno_t sdap_get_groups_next_base(struct tevent_req *req);
 static void sdap_get_groups_ldap_connect_done(struct tevent_req *subreq);
 static void sdap_get_groups_process(struct tevent_req *subreq);
+static void sdap_get_groups_ranged_step(struct tevent_req *req);
+static void sdap_get_groups_ranged_done(struct tevent_req *subreq);
+static void sdap_get_groups_members(struct tevent_req *req);
 static void sdap_get_groups_done(struct tevent_req *subreq);
 
 struct tevent_req *sdap_get_groups_send(TALLOC_CTX *memctx,
@@ -1947,7 +2062,6 @@ static void sdap_get_groups_process(struct tevent_req *subreq)
     struct sdap_get_groups_state *state =
                         tevent_req_data(req, struct sdap_get_groups_state);
     int ret;
-    int i;
     bool next_base = false;
     size_t count;
     struct sysdb_attrs **groups;
@@ -2032,6 +2146,88 @@ static void sdap_get_groups_process(struct tevent_req *subreq)
         return;
     }
 
+    /* Groups with more members than the server returns at once are
+     * completed first */
+    state->ranged_iter = 0;
+    sdap_get_groups_ranged_step(req);
+}
+
+/* Whether the members of the group are resolved by sdap_nested_group_send(),
+ * which completes the member list itself, with ASQ on AD */
+static bool sdap_get_groups_nested(struct sdap_get_groups_state *state)
+{
+    return state->lookup_type == SDAP_LOOKUP_SINGLE
+            && state->opts->schema_type != SDAP_SCHEMA_RFC2307
+            && dp_opt_get_int(state->opts->basic, SDAP_NESTING_LEVEL) != 0
+            && !dp_opt_get_bool(state->opts->basic,
+                                SDAP_AD_MATCHING_RULE_GROUPS);
+}
+
+static void sdap_get_groups_ranged_step(struct tevent_req *req)
+{
+    struct sdap_get_groups_state *state =
+                        tevent_req_data(req, struct sdap_get_groups_state);
+    struct tevent_req *subreq;
+
+    for (; state->ranged_iter < state->count; state->ranged_iter++) {
+        if (!sdap_has_ranged_attrs(state->groups[state->ranged_iter])) {
+            continue;
+        }
+
+        /* the nested group code reads the members from state->sh */
+        if (state->ranged_iter == 0 && state->ldap_sh == NULL
+                && sdap_get_groups_nested(state)) {
+            continue;
+        }
+
+        /* the ranges must be read from the server which sent the group */
+        subreq = sdap_get_ranged_attrs_send(state, state->ev, state->opts,
+                                            state->ldap_sh != NULL ?
+                                                state->ldap_sh : state->sh,
+                                            state->opts->group_map,
+                                            SDAP_OPTS_GROUP,
+                                            state->groups[state->ranged_iter],
+                                            state->timeout);
+        if (subreq == NULL) {
+            tevent_req_error(req, ENOMEM);
+            return;
+        }
+        tevent_req_set_callback(subreq, sdap_get_groups_ranged_done, req);
+        return;
+    }
+
+    sdap_get_groups_members(req);
+}
+
+static void sdap_get_groups_ranged_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req =
+                        tevent_req_callback_data(subreq, struct tevent_req);
+    struct sdap_get_groups_state *state =
+                        tevent_req_data(req, struct sdap_get_groups_state);
+    errno_t ret;
+
+    ret = sdap_get_ranged_attrs_recv(subreq);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot fetch all members of a group "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    state->ranged_iter++;
+    sdap_get_groups_ranged_step(req);
+}
+
+static void sdap_get_groups_members(struct tevent_req *req)
+{
+    struct sdap_get_groups_state *state =
+                        tevent_req_data(req, struct sdap_get_groups_state);
+    struct tevent_req *subreq;
+    int ret;
+    int i;
+
     /* Check whether we need to do nested searches
      * for RFC2307bis/FreeIPA/ActiveDirectory
      * We don't need to do this for enumeration,
@@ -2041,21 +2237,17 @@ static void sdap_get_groups_process(struct tevent_req *subreq)
      * LDAP_MATCHING_RULE_IN_CHAIN available in
      * AD 2008 and later
      */
-    if (state->lookup_type == SDAP_LOOKUP_SINGLE) {
-        if ((state->opts->schema_type != SDAP_SCHEMA_RFC2307)
-                && (dp_opt_get_int(state->opts->basic, SDAP_NESTING_LEVEL) != 0)
-                && !dp_opt_get_bool(state->opts->basic, SDAP_AD_MATCHING_RULE_GROUPS)) {
-            subreq = sdap_nested_group_send(state, state->ev, state->sdom,
-                                            state->opts, state->sh,
-                                            state->groups[0]);
-            if (!subreq) {
-                tevent_req_error(req, EIO);
-                return;
-            }
-
-            tevent_req_set_callback(subreq, sdap_nested_done, req);
+    if (sdap_get_groups_nested(state)) {
+        subreq = sdap_nested_group_send(state, state->ev, state->sdom,
+                                        state->opts, state->sh,
+                                        state->groups[0]);
+        if (!subreq) {
+            tevent_req_error(req, EIO);
             return;
         }
+
+        tevent_req_set_callback(subreq, sdap_nested_done, req);
+        return;
     }
 
     /* We have all of the groups. Save them to the sysdb */
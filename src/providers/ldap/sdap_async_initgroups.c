@@ -755,6 +755,11 @@ struct sdap_initgr_nested_state {
 
     struct sysdb_attrs **groups;
     int groups_cur;
+
+    /* the lookup could have used dereference, its time is measured */
+    bool measure;
+    bool deref;
+    struct timeval start;
 };
 
 static errno_t sdap_initgr_nested_deref_search(struct tevent_req *req);
@@ -814,8 +819,13 @@ static struct tevent_req *sdap_initgr_nested_send(TALLOC_CTX *memctx,
 
     deref_threshold = dp_opt_get_int(state->opts->basic,
                                      SDAP_DEREF_THRESHOLD);
-    if (sdap_has_deref_support(state->sh, state->opts) &&
-        deref_threshold < state->memberof->num_values) {
+    state->measure = sdap_has_deref_support(state->sh, state->opts) &&
+                     deref_threshold < state->memberof->num_values;
+    state->start = tevent_timeval_current();
+    if (state->measure
+            && sdap_deref_preferred(state->sh, state->opts,
+                                    SDAP_DEREF_CLASS_USER_GROUPS)) {
+        state->deref = true;
         ret = sysdb_attrs_get_string(user, SYSDB_ORIG_DN,
                                      &state->orig_dn);
         if (ret != EOK) goto immediate;
@@ -955,6 +965,8 @@ static void sdap_initgr_nested_deref_done(struct tevent_req *subreq)
                                  &deref_result);
     talloc_zfree(subreq);
     if (ret == ENOTSUP) {
+        state->measure = false;
+        state->deref = false;
         ret = sdap_initgr_nested_noderef_search(req);
         if (ret != EAGAIN) {
             if (ret == EOK) {
@@ -1051,6 +1063,12 @@ static void sdap_initgr_nested_store(struct tevent_req *req)
 
     state = tevent_req_data(req, struct sdap_initgr_nested_state);
 
+    if (state->measure) {
+        sdap_deref_stats_add(state->sh, SDAP_DEREF_CLASS_USER_GROUPS,
+                             state->deref, state->memberof->num_values,
+                             state->start);
+    }
+
     ret = sysdb_transaction_start(state->sysdb);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
@@ -377,7 +377,8 @@ static void sdap_get_ad_tokengroups_done(struct tevent_req *subreq)
     struct sysdb_attrs **users = NULL;
     struct ldb_message_element *el = NULL;
     enum idmap_error_code err;
-    char *sid_str = NULL;
+    struct sss_idmap_sid sid;
+    char sid_str[SSS_IDMAP_SID_STR_MAX];
     size_t num_users;
     size_t i;
     errno_t ret;
@@ -425,8 +426,11 @@ static void sdap_get_ad_tokengroups_done(struct tevent_req *subreq)
 
     /* convert binary sid to string */
     for (i = 0; i < el->num_values; i++) {
-        err = sss_idmap_bin_sid_to_sid(state->idmap_ctx, el->values[i].data,
-                                       el->values[i].length, &sid_str);
+        err = sss_idmap_bin_sid_parse(el->values[i].data,
+                                      el->values[i].length, &sid);
+        if (err == IDMAP_SUCCESS) {
+            err = sss_idmap_sid_format(&sid, sid_str, sizeof(sid_str));
+        }
         if (err != IDMAP_SUCCESS) {
             DEBUG(SSSDBG_MINOR_FAILURE,
                   "Could not convert binary SID to string: [%s]. Skipping\n",
@@ -434,7 +438,11 @@ static void sdap_get_ad_tokengroups_done(struct tevent_req *subreq)
             continue;
         }
 
-        state->sids[i] = talloc_move(state->sids, &sid_str);
+        state->sids[state->num_sids] = talloc_strdup(state->sids, sid_str);
+        if (state->sids[state->num_sids] == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
         state->num_sids++;
     }
 
@@ -530,6 +538,18 @@ done:
     return ret;
 }
 
+/* The SIDs are resolved by searches for up to ldap_lookup_batch_size
+ * groups of the same domain, SDAP_AD_RESOLVE_SIDS_PARALLEL of them are
+ * sent at once */
+#define SDAP_AD_RESOLVE_SIDS_PARALLEL 4
+
+struct sdap_ad_resolve_sids_batch {
+    struct tevent_req *req;
+    struct sdap_domain *sdom;
+    const char **sids;
+    size_t num_sids;
+};
+
 struct sdap_ad_resolve_sids_state {
     struct tevent_context *ev;
     struct sdap_id_ctx *id_ctx;
@@ -538,10 +558,14 @@ struct sdap_ad_resolve_sids_state {
     struct sss_domain_info *domain;
     char **sids;
 
-    const char *current_sid;
-    int index;
+    struct sdap_ad_resolve_sids_batch **batches;
+    size_t num_batches;
+    size_t index;
+    int active;
+    errno_t error;
 };
 
+static errno_t sdap_ad_resolve_sids_batch(struct tevent_req *req);
 static errno_t sdap_ad_resolve_sids_step(struct tevent_req *req);
 static void sdap_ad_resolve_sids_done(struct tevent_req *subreq);
 
@@ -578,6 +602,11 @@ sdap_ad_resolve_sids_send(TALLOC_CTX *mem_ctx,
         goto immediately;
     }
 
+    ret = sdap_ad_resolve_sids_batch(req);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
     ret = sdap_ad_resolve_sids_step(req);
     if (ret != EAGAIN) {
         goto immediately;
@@ -596,84 +625,158 @@ immediately:
     return req;
 }
 
-static errno_t sdap_ad_resolve_sids_step(struct tevent_req *req)
+/* Splits the SIDs into batches of the same domain */
+static errno_t sdap_ad_resolve_sids_batch(struct tevent_req *req)
 {
     struct sdap_ad_resolve_sids_state *state = NULL;
-    struct tevent_req *subreq = NULL;
+    struct sdap_ad_resolve_sids_batch *batch = NULL;
     struct sdap_domain *sdap_domain = NULL;
     struct sss_domain_info *domain = NULL;
+    size_t num_sids;
+    size_t batch_size;
+    size_t i;
+    size_t j;
 
     state = tevent_req_data(req, struct sdap_ad_resolve_sids_state);
 
-    do {
-        state->current_sid = state->sids[state->index];
-        if (state->current_sid == NULL) {
-            return EOK;
-        }
-        state->index++;
+    batch_size = dp_opt_get_int(state->opts->basic, SDAP_LOOKUP_BATCH_SIZE);
+    if (batch_size < 1) {
+        batch_size = 1;
+    }
 
-        domain = sss_get_domain_by_sid_ldap_fallback(state->domain,
-                                                     state->current_sid);
+    for (num_sids = 0; state->sids[num_sids] != NULL; num_sids++);
 
+    state->batches = talloc_zero_array(state,
+                                       struct sdap_ad_resolve_sids_batch *,
+                                       num_sids);
+    if (state->batches == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < num_sids; i++) {
+        domain = sss_get_domain_by_sid_ldap_fallback(state->domain,
+                                                     state->sids[i]);
         if (domain == NULL) {
             DEBUG(SSSDBG_MINOR_FAILURE, "SID %s does not belong to any known "
-                                         "domain\n", state->current_sid);
+                                         "domain\n", state->sids[i]);
+            continue;
         }
-    } while (domain == NULL);
 
-    sdap_domain = sdap_domain_get(state->opts, domain);
-    if (sdap_domain == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "SDAP domain does not exist?\n");
-        return ERR_INTERNAL;
+        sdap_domain = sdap_domain_get(state->opts, domain);
+        if (sdap_domain == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "SDAP domain does not exist?\n");
+            return ERR_INTERNAL;
+        }
+
+        /* only the last batch of a domain may have room left */
+        batch = NULL;
+        for (j = state->num_batches; j > 0; j--) {
+            if (state->batches[j - 1]->sdom == sdap_domain) {
+                batch = state->batches[j - 1];
+                break;
+            }
+        }
+
+        if (batch == NULL || batch->num_sids == batch_size) {
+            batch = talloc_zero(state->batches,
+                                struct sdap_ad_resolve_sids_batch);
+            if (batch == NULL) {
+                return ENOMEM;
+            }
+
+            batch->req = req;
+            batch->sdom = sdap_domain;
+            batch->sids = talloc_zero_array(batch, const char *,
+                                            MIN(batch_size, num_sids - i));
+            if (batch->sids == NULL) {
+                return ENOMEM;
+            }
+            state->batches[state->num_batches++] = batch;
+        }
+
+        batch->sids[batch->num_sids++] = state->sids[i];
     }
 
-    subreq = groups_get_send(state, state->ev, state->id_ctx, sdap_domain,
-                             state->conn, state->current_sid,
-                             BE_FILTER_SECID, BE_ATTR_CORE, false, true);
-    if (subreq == NULL) {
-        return ENOMEM;
+    return EOK;
+}
+
+static errno_t sdap_ad_resolve_sids_step(struct tevent_req *req)
+{
+    struct sdap_ad_resolve_sids_state *state = NULL;
+    struct sdap_ad_resolve_sids_batch *batch = NULL;
+    struct tevent_req *subreq = NULL;
+
+    state = tevent_req_data(req, struct sdap_ad_resolve_sids_state);
+
+    while (state->active < SDAP_AD_RESOLVE_SIDS_PARALLEL
+            && state->index < state->num_batches
+            && state->error == EOK) {
+        batch = state->batches[state->index++];
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Resolving %zu SIDs of domain %s\n",
+              batch->num_sids, batch->sdom->dom->name);
+
+        subreq = groups_get_by_sids_send(batch, state->ev, state->id_ctx,
+                                         batch->sdom, state->conn,
+                                         batch->sids, batch->num_sids, true);
+        if (subreq == NULL) {
+            state->error = ENOMEM;
+            break;
+        }
+
+        tevent_req_set_callback(subreq, sdap_ad_resolve_sids_done, batch);
+        state->active++;
     }
 
-    tevent_req_set_callback(subreq, sdap_ad_resolve_sids_done, req);
+    if (state->active > 0) {
+        return EAGAIN;
+    }
 
-    return EAGAIN;
+    return state->error;
 }
 
 static void sdap_ad_resolve_sids_done(struct tevent_req *subreq)
 {
     struct sdap_ad_resolve_sids_state *state = NULL;
+    struct sdap_ad_resolve_sids_batch *batch = NULL;
     struct tevent_req *req = NULL;
     int dp_error;
     int sdap_error;
     errno_t ret;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
+    batch = tevent_req_callback_data(subreq,
+                                     struct sdap_ad_resolve_sids_batch);
+    req = batch->req;
     state = tevent_req_data(req, struct sdap_ad_resolve_sids_state);
 
     ret = groups_get_recv(subreq, &dp_error, &sdap_error);
     talloc_zfree(subreq);
+    state->active--;
 
     if (ret == EOK && sdap_error == ENOENT && dp_error == DP_ERR_OK) {
-        /* Group was not found, we will ignore the error and continue with
-         * next group. This may happen for example if the group is built-in,
-         * but a custom search base is provided. */
+        /* No group was found, we will ignore the error and continue with
+         * next groups. This may happen for example if the groups are
+         * built-in, but a custom search base is provided. */
         DEBUG(SSSDBG_CRIT_FAILURE,
-              "Unable to resolve SID %s - will try next sid.\n",
-              state->current_sid);
+              "Unable to resolve %zu SIDs starting with %s - will try "
+              "next sids.\n", batch->num_sids, batch->sids[0]);
     } else if (ret != EOK || sdap_error != EOK || dp_error != DP_ERR_OK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to resolve SID %s [dp_error: %d, "
-              "sdap_error: %d, ret: %d]: %s\n", state->current_sid, dp_error,
-              sdap_error, ret, strerror(ret));
-        goto done;
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to resolve %zu SIDs starting with "
+              "%s [dp_error: %d, sdap_error: %d, ret: %d]: %s\n",
+              batch->num_sids, batch->sids[0], dp_error, sdap_error, ret,
+              strerror(ret));
+        if (state->error == EOK) {
+            state->error = ret != EOK ? ret : EIO;
+        }
     }
+    talloc_free(batch);
 
     ret = sdap_ad_resolve_sids_step(req);
     if (ret == EAGAIN) {
-        /* continue with next SID */
+        /* continue with next SIDs */
         return;
     }
 
-done:
     if (ret != EOK) {
         tevent_req_error(req, ret);
         return;
@@ -63,6 +63,21 @@ struct sdap_external_missing_member {
     size_t parent_dn_idx;
 };
 
+/* Users and groups found by the nested group requests of the backend,
+ * requests which meet the same subgroups reuse them until they expire */
+struct sdap_nested_group_memo {
+    hash_table_t *entries;
+    time_t next_purge;
+};
+
+struct sdap_nested_group_memo_entry {
+    enum sdap_nested_group_dn_type type;
+    struct sysdb_attrs *attrs;
+    time_t expire;
+};
+
+struct sdap_nested_group_single_state;
+
 struct sdap_nested_group_ctx {
     struct sss_domain_info *domain;
     struct sdap_options *opts;
@@ -75,6 +90,17 @@ struct sdap_nested_group_ctx {
     bool try_deref;
     int deref_treshold;
     int max_nesting_level;
+
+    /* Member lookups of the whole request run in parallel up to this
+     * limit, member lists which could not start all their lookups wait
+     * for a free slot */
+    int max_lookups;
+    int num_lookups;
+    struct sdap_nested_group_single_state *waiting;
+
+    /* NULL if the memo is disabled */
+    struct sdap_nested_group_memo *memo;
+    int memo_timeout;
 };
 
 static struct tevent_req *
@@ -385,6 +411,177 @@ static errno_t sdap_nested_group_external_add(hash_table_t *table,
     return EOK;
 }
 
+static errno_t sdap_nested_group_copy_attrs(TALLOC_CTX *mem_ctx,
+                                            struct sysdb_attrs *src,
+                                            struct sysdb_attrs **_dst)
+{
+    struct sysdb_attrs *dst;
+    errno_t ret;
+    int i;
+
+    dst = sysdb_new_attrs(mem_ctx);
+    if (dst == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < src->num; i++) {
+        ret = sysdb_attrs_copy_values(src, dst, src->a[i].name);
+        if (ret != EOK) {
+            talloc_free(dst);
+            return ret;
+        }
+    }
+
+    *_dst = dst;
+    return EOK;
+}
+
+static void sdap_nested_group_memo_purge(struct sdap_nested_group_memo *memo,
+                                         int timeout)
+{
+    struct sdap_nested_group_memo_entry *entry;
+    hash_entry_t *entries;
+    unsigned long count;
+    unsigned long i;
+    time_t now;
+    int hret;
+
+    now = time(NULL);
+    if (now < memo->next_purge) {
+        return;
+    }
+    memo->next_purge = now + timeout;
+
+    hret = hash_entries(memo->entries, &count, &entries);
+    if (hret != HASH_SUCCESS) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        entry = talloc_get_type(entries[i].value.ptr,
+                                struct sdap_nested_group_memo_entry);
+        if (entry->expire <= now) {
+            hash_delete(memo->entries, &entries[i].key);
+            talloc_free(entry);
+        }
+    }
+
+    talloc_free(entries);
+}
+
+/* The memo is only an optimization, the lookups are done without it
+ * if it cannot be created */
+static struct sdap_nested_group_memo *
+sdap_nested_group_memo_get(struct sdap_options *opts, int timeout)
+{
+    struct sdap_nested_group_memo *memo;
+    errno_t ret;
+
+    if (timeout <= 0) {
+        talloc_zfree(opts->nested_group_memo);
+        return NULL;
+    }
+
+    memo = opts->nested_group_memo;
+    if (memo == NULL) {
+        memo = talloc_zero(opts, struct sdap_nested_group_memo);
+        if (memo == NULL) {
+            return NULL;
+        }
+
+        ret = sss_hash_create(memo, 32, &memo->entries);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Unable to create hash table "
+                  "[%d]: %s\n", ret, sss_strerror(ret));
+            talloc_free(memo);
+            return NULL;
+        }
+
+        opts->nested_group_memo = memo;
+    }
+
+    sdap_nested_group_memo_purge(memo, timeout);
+
+    return memo;
+}
+
+static struct sdap_nested_group_memo_entry *
+sdap_nested_group_memo_lookup(struct sdap_nested_group_memo *memo,
+                              const char *dn)
+{
+    struct sdap_nested_group_memo_entry *entry;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(dn);
+
+    hret = hash_lookup(memo->entries, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        return NULL;
+    }
+
+    entry = talloc_get_type(value.ptr, struct sdap_nested_group_memo_entry);
+    if (entry->expire <= time(NULL)) {
+        hash_delete(memo->entries, &key);
+        talloc_free(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+static void sdap_nested_group_memo_add(struct sdap_nested_group_ctx *group_ctx,
+                                       const char *dn,
+                                       enum sdap_nested_group_dn_type type,
+                                       struct sysdb_attrs *attrs)
+{
+    struct sdap_nested_group_memo *memo = group_ctx->memo;
+    struct sdap_nested_group_memo_entry *entry;
+    hash_key_t key;
+    hash_value_t value;
+    errno_t ret;
+    int hret;
+
+    if (memo == NULL) {
+        return;
+    }
+
+    entry = talloc_zero(memo, struct sdap_nested_group_memo_entry);
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->type = type;
+    entry->expire = time(NULL) + group_ctx->memo_timeout;
+    ret = sdap_nested_group_copy_attrs(entry, attrs, &entry->attrs);
+    if (ret != EOK) {
+        talloc_free(entry);
+        return;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(dn);
+
+    /* a concurrent request may have fetched the entry as well */
+    hret = hash_lookup(memo->entries, &key, &value);
+    if (hret == HASH_SUCCESS) {
+        talloc_free(value.ptr);
+    }
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = entry;
+
+    hret = hash_enter(memo->entries, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to remember [%s]: %s\n",
+              dn, hash_error_string(hret));
+        hash_delete(memo->entries, &key);
+        talloc_free(entry);
+    }
+}
+
 static errno_t sdap_nested_group_sysdb_search(struct sss_domain_info *domain,
                                               const char *filter,
                                               bool user)
@@ -834,6 +1031,15 @@ sdap_nested_group_send(TALLOC_CTX *mem_ctx,
                                                       SDAP_DEREF_THRESHOLD);
     state->group_ctx->max_nesting_level = dp_opt_get_int(opts->basic,
                                                          SDAP_NESTING_LEVEL);
+    state->group_ctx->max_lookups = dp_opt_get_int(opts->basic,
+                                                SDAP_NESTING_PARALLEL_LOOKUPS);
+    if (state->group_ctx->max_lookups < 1) {
+        state->group_ctx->max_lookups = 1;
+    }
+    state->group_ctx->memo_timeout = dp_opt_get_int(opts->basic,
+                                                    SDAP_NESTING_MEMO_TIMEOUT);
+    state->group_ctx->memo = sdap_nested_group_memo_get(opts,
+                                            state->group_ctx->memo_timeout);
     state->group_ctx->domain = sdom->dom;
     state->group_ctx->opts = opts;
     state->group_ctx->user_search_bases = sdom->user_search_bases;
@@ -986,12 +1192,26 @@ struct sdap_nested_group_process_state {
     int num_missing_groups;
     struct ldb_message_element *ext_members;
     int nesting_level;
+    struct sysdb_attrs *group;
     char *group_dn;
     bool deref;
 };
 
+static errno_t sdap_nested_group_process_members(struct tevent_req *req);
+static errno_t sdap_nested_group_process_ranged(struct tevent_req *req);
+static void sdap_nested_group_process_ranged_done(struct tevent_req *subreq);
 static void sdap_nested_group_process_done(struct tevent_req *subreq);
 
+/* AD returns the members of a large group in ranges. ASQ returns all of
+ * them in one paged search, the ranges are only read when it cannot be
+ * used. */
+static bool sdap_nested_group_use_asq(struct sdap_nested_group_ctx *group_ctx)
+{
+    return group_ctx->try_deref
+                && sdap_is_control_supported(group_ctx->sh,
+                                             LDAP_SERVER_ASQ_OID);
+}
+
 static struct tevent_req *
 sdap_nested_group_process_send(TALLOC_CTX *mem_ctx,
                                struct tevent_context *ev,
@@ -1000,10 +1220,7 @@ sdap_nested_group_process_send(TALLOC_CTX *mem_ctx,
                                struct sysdb_attrs *group)
 {
     struct sdap_nested_group_process_state *state = NULL;
-    struct sdap_attr_map *group_map = NULL;
     struct tevent_req *req = NULL;
-    struct tevent_req *subreq = NULL;
-    struct ldb_message_element *members = NULL;
     const char *orig_dn = NULL;
     errno_t ret;
 
@@ -1017,7 +1234,6 @@ sdap_nested_group_process_send(TALLOC_CTX *mem_ctx,
     state->ev = ev;
     state->group_ctx = group_ctx;
     state->nesting_level = nesting_level;
-    group_map = state->group_ctx->opts->group_map;
 
     /* get original dn */
     ret = sysdb_attrs_get_string(group, SYSDB_ORIG_DN, &orig_dn);
@@ -1035,23 +1251,70 @@ sdap_nested_group_process_send(TALLOC_CTX *mem_ctx,
 
     DEBUG(SSSDBG_TRACE_INTERNAL, "About to process group [%s]\n", orig_dn);
 
+    state->group = group;
+
     /* get member list, both direct and external */
     state->ext_members = sdap_nested_group_ext_members(state->group_ctx->opts,
                                                        group);
 
-    ret = sysdb_attrs_get_el_ext(group, group_map[SDAP_AT_GROUP_MEMBER].sys_name,
-                                 false, &members);
-    if (ret == ENOENT && state->ext_members == NULL) {
-        ret = EOK; /* no members, direct or external */
+    ret = sdap_nested_group_add_ext_members(state,
+                                            state->group_ctx,
+                                            group,
+                                            state->ext_members);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split external member list "
+                                    "[%d]: %s\n", ret, sss_strerror(ret));
         goto immediately;
+    }
+
+    if (sdap_has_ranged_attrs(group) && !sdap_nested_group_use_asq(group_ctx)) {
+        ret = sdap_nested_group_process_ranged(req);
+    } else {
+        ret = sdap_nested_group_process_members(req);
+    }
+    if (ret == EAGAIN) {
+        return req;
+    }
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+
+    return req;
+}
+
+static errno_t sdap_nested_group_process_members(struct tevent_req *req)
+{
+    struct sdap_nested_group_process_state *state = NULL;
+    struct sdap_nested_group_ctx *group_ctx = NULL;
+    struct ldb_message_element *members = NULL;
+    struct tevent_req *subreq = NULL;
+    bool incomplete;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct sdap_nested_group_process_state);
+    group_ctx = state->group_ctx;
+
+    ret = sysdb_attrs_get_el_ext(state->group,
+                    group_ctx->opts->group_map[SDAP_AT_GROUP_MEMBER].sys_name,
+                    false, &members);
+    if (ret == ENOENT && state->ext_members == NULL) {
+        return EOK; /* no members, direct or external */
     } else if (ret != EOK && ret != ENOENT) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to retrieve member list "
                                     "[%d]: %s\n", ret, strerror(ret));
-        goto immediately;
+        return ret;
     }
 
+    /* the ranges were not read because ASQ returns all members */
+    incomplete = sdap_has_ranged_attrs(state->group);
+
     /* get members that need to be refreshed */
-    ret = sdap_nested_group_split_members(state, state->group_ctx,
+    ret = sdap_nested_group_split_members(state, group_ctx,
                                           state->nesting_level, members,
                                           &state->missing,
                                           &state->num_missing_total,
@@ -1059,23 +1322,12 @@ sdap_nested_group_process_send(TALLOC_CTX *mem_ctx,
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split member list "
                                     "[%d]: %s\n", ret, sss_strerror(ret));
-        goto immediately;
-    }
-
-    ret = sdap_nested_group_add_ext_members(state,
-                                            state->group_ctx,
-                                            group,
-                                            state->ext_members);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split external member list "
-                                    "[%d]: %s\n", ret, sss_strerror(ret));
-        goto immediately;
+        return ret;
     }
 
-    if (state->num_missing_total == 0
-            && hash_count(state->group_ctx->missing_external) == 0) {
-        ret = EOK; /* we're done */
-        goto immediately;
+    if (!incomplete && state->num_missing_total == 0
+            && hash_count(group_ctx->missing_external) == 0) {
+        return EOK; /* we're done */
     }
 
     /* If there are only indirect members of the group, it's still safe to
@@ -1085,45 +1337,90 @@ sdap_nested_group_process_send(TALLOC_CTX *mem_ctx,
     DEBUG(SSSDBG_TRACE_INTERNAL, "Looking up %d/%d members of group [%s]\n",
                                  state->num_missing_total,
                                  members ? members->num_values : 0,
-                                 orig_dn);
+                                 state->group_dn);
 
     /* process members */
     if (group_ctx->try_deref
-            && state->num_missing_total > group_ctx->deref_treshold) {
+            && (incomplete
+                || (state->num_missing_total > group_ctx->deref_treshold
+                    && sdap_deref_preferred(group_ctx->sh, group_ctx->opts,
+                                        SDAP_DEREF_CLASS_GROUP_MEMBERS)))) {
         DEBUG(SSSDBG_TRACE_INTERNAL, "Dereferencing members of group [%s]\n",
-                                      orig_dn);
+                                      state->group_dn);
         state->deref = true;
-        subreq = sdap_nested_group_deref_send(state, ev, group_ctx, members,
-                                              orig_dn,
+        subreq = sdap_nested_group_deref_send(state, state->ev, group_ctx,
+                                              members, state->group_dn,
                                               state->nesting_level);
     } else {
         DEBUG(SSSDBG_TRACE_INTERNAL, "Members of group [%s] will be "
-                                      "processed individually\n", orig_dn);
+                                      "processed individually\n",
+                                      state->group_dn);
         state->deref = false;
-        subreq = sdap_nested_group_single_send(state, ev, group_ctx,
+        subreq = sdap_nested_group_single_send(state, state->ev, group_ctx,
                                                state->missing,
                                                state->num_missing_total,
                                                state->num_missing_groups,
                                                state->nesting_level);
     }
     if (subreq == NULL) {
-        ret = ENOMEM;
-        goto immediately;
+        return ENOMEM;
     }
 
     tevent_req_set_callback(subreq, sdap_nested_group_process_done, req);
 
-    return req;
+    return EAGAIN;
+}
 
-immediately:
+static errno_t sdap_nested_group_process_ranged(struct tevent_req *req)
+{
+    struct sdap_nested_group_process_state *state = NULL;
+    struct sdap_options *opts = NULL;
+    struct tevent_req *subreq = NULL;
+
+    state = tevent_req_data(req, struct sdap_nested_group_process_state);
+    opts = state->group_ctx->opts;
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Reading the remaining members of group "
+          "[%s]\n", state->group_dn);
+
+    subreq = sdap_get_ranged_attrs_send(state, state->ev, opts,
+                                        state->group_ctx->sh,
+                                        opts->group_map, SDAP_OPTS_GROUP,
+                                        state->group,
+                                        dp_opt_get_int(opts->basic,
+                                                       SDAP_SEARCH_TIMEOUT));
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(subreq, sdap_nested_group_process_ranged_done,
+                            req);
+
+    return EAGAIN;
+}
+
+static void sdap_nested_group_process_ranged_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = NULL;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+
+    ret = sdap_get_ranged_attrs_recv(subreq);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot fetch all members of a group "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    ret = sdap_nested_group_process_members(req);
     if (ret == EOK) {
         tevent_req_done(req);
-    } else {
+    } else if (ret != EAGAIN) {
         tevent_req_error(req, ret);
     }
-    tevent_req_post(req, ev);
-
-    return req;
 }
 
 static void sdap_nested_group_process_done(struct tevent_req *subreq)
@@ -1143,6 +1440,11 @@ static void sdap_nested_group_process_done(struct tevent_req *subreq)
             state->group_ctx->try_deref = false;
             state->deref = false;
 
+            if (sdap_has_ranged_attrs(state->group)) {
+                ret = sdap_nested_group_process_ranged(req);
+                goto done;
+            }
+
             DEBUG(SSSDBG_TRACE_INTERNAL, "Members of group [%s] will be "
                   "processed individually\n", state->group_dn);
 
@@ -1189,6 +1491,7 @@ struct sdap_nested_group_recurse_state {
     struct sysdb_attrs **groups;
     int num_groups;
     int index;
+    int num_running;
     int nesting_level;
 };
 
@@ -1219,9 +1522,10 @@ sdap_nested_group_recurse_send(TALLOC_CTX *mem_ctx,
     state->groups = nested_groups;
     state->num_groups = num_groups;
     state->index = 0;
+    state->num_running = 0;
     state->nesting_level = nesting_level;
 
-    /* process each group individually */
+    /* process the groups, several at once */
     ret = sdap_nested_group_recurse_step(req);
     if (ret != EAGAIN) {
         goto immediately;
@@ -1247,34 +1551,42 @@ static errno_t sdap_nested_group_recurse_step(struct tevent_req *req)
 
     state = tevent_req_data(req, struct sdap_nested_group_recurse_state);
 
-    if (state->index >= state->num_groups) {
-        /* we're done */
-        return EOK;
-    }
+    while (state->index < state->num_groups
+            && state->num_running < state->group_ctx->max_lookups) {
+        subreq = sdap_nested_group_process_send(state, state->ev,
+                                                state->group_ctx,
+                                                state->nesting_level,
+                                                state->groups[state->index]);
+        if (subreq == NULL) {
+            return ENOMEM;
+        }
 
-    subreq = sdap_nested_group_process_send(state, state->ev, state->group_ctx,
-                                            state->nesting_level,
-                                            state->groups[state->index]);
-    if (subreq == NULL) {
-        return ENOMEM;
-    }
+        tevent_req_set_callback(subreq, sdap_nested_group_recurse_done, req);
 
-    tevent_req_set_callback(subreq, sdap_nested_group_recurse_done, req);
+        state->index++;
+        state->num_running++;
+    }
 
-    state->index++;
+    if (state->num_running == 0) {
+        /* we're done */
+        return EOK;
+    }
 
     return EAGAIN;
 }
 
 static void sdap_nested_group_recurse_done(struct tevent_req *subreq)
 {
+    struct sdap_nested_group_recurse_state *state = NULL;
     struct tevent_req *req = NULL;
     errno_t ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sdap_nested_group_recurse_state);
 
     ret = sdap_nested_group_process_recv(subreq);
     talloc_zfree(subreq);
+    state->num_running--;
     if (ret != EOK) {
         goto done;
     }
@@ -1299,23 +1611,51 @@ static errno_t sdap_nested_group_recurse_recv(struct tevent_req *req)
 }
 
 struct sdap_nested_group_single_state {
+    struct tevent_req *req;
     struct tevent_context *ev;
     struct sdap_nested_group_ctx *group_ctx;
     struct sdap_nested_group_member *members;
     int nesting_level;
 
-    struct sdap_nested_group_member *current_member;
     int num_members;
     int member_index;
+    int num_pending;
 
     struct sysdb_attrs **nested_groups;
     int num_groups;
+
+    /* the lookup could have used dereference, its time is measured */
+    bool measure;
+    struct timeval start;
+
+    /* waiting for a free lookup slot */
+    bool waiting;
+    struct sdap_nested_group_single_state *prev;
+    struct sdap_nested_group_single_state *next;
+};
+
+/* a member lookup in flight */
+struct sdap_nested_group_single_lookup {
+    struct tevent_req *req;
+    struct sdap_nested_group_member *member;
 };
 
 static errno_t sdap_nested_group_single_step(struct tevent_req *req);
+static void sdap_nested_group_single_next(struct tevent_req *req);
 static void sdap_nested_group_single_step_done(struct tevent_req *subreq);
 static void sdap_nested_group_single_done(struct tevent_req *subreq);
 
+static int
+sdap_nested_group_single_state_destructor(struct sdap_nested_group_single_state *state)
+{
+    if (state->waiting) {
+        DLIST_REMOVE(state->group_ctx->waiting, state);
+    }
+    state->group_ctx->num_lookups -= state->num_pending;
+
+    return 0;
+}
+
 static struct tevent_req *
 sdap_nested_group_single_send(TALLOC_CTX *mem_ctx,
                               struct tevent_context *ev,
@@ -1336,13 +1676,17 @@ sdap_nested_group_single_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
+    state->req = req;
     state->ev = ev;
     state->group_ctx = group_ctx;
     state->members = members;
     state->nesting_level = nesting_level;
-    state->current_member = NULL;
     state->num_members = num_members;
     state->member_index = 0;
+    state->num_pending = 0;
+    state->measure = group_ctx->try_deref
+                     && num_members > group_ctx->deref_treshold;
+    state->start = tevent_timeval_current();
     state->nested_groups = talloc_zero_array(state, struct sysdb_attrs *,
                                              num_groups_max);
     if (state->nested_groups == NULL) {
@@ -1350,8 +1694,9 @@ sdap_nested_group_single_send(TALLOC_CTX *mem_ctx,
         goto immediately;
     }
     state->num_groups = 0; /* we will count exact number of the groups */
+    talloc_set_destructor(state, sdap_nested_group_single_state_destructor);
 
-    /* process each member individually */
+    /* look up the members, several at once */
     ret = sdap_nested_group_single_step(req);
     if (ret != EAGAIN) {
         goto immediately;
@@ -1370,89 +1715,155 @@ immediately:
     return req;
 }
 
-static errno_t sdap_nested_group_single_step(struct tevent_req *req)
-{
-    struct sdap_nested_group_single_state *state = NULL;
-    struct tevent_req *subreq = NULL;
+static errno_t
+sdap_nested_group_single_save(struct sdap_nested_group_single_state *state,
+                              enum sdap_nested_group_dn_type type,
+                              bool check_level,
+                              struct sysdb_attrs *entry);
 
-    state = tevent_req_data(req, struct sdap_nested_group_single_state);
+/* Takes the member from the memo, returns ENOENT if it is not there */
+static errno_t
+sdap_nested_group_single_memo(struct sdap_nested_group_single_state *state,
+                              struct sdap_nested_group_member *member)
+{
+    struct sdap_nested_group_memo_entry *memo_entry;
+    struct sysdb_attrs *entry;
+    bool check_level;
+    errno_t ret;
 
-    if (state->member_index >= state->num_members) {
-        /* we're done */
-        return EOK;
+    if (state->group_ctx->memo == NULL) {
+        return ENOENT;
     }
 
-    state->current_member = &state->members[state->member_index];
-    state->member_index++;
+    memo_entry = sdap_nested_group_memo_lookup(state->group_ctx->memo,
+                                               member->dn);
+    if (memo_entry == NULL) {
+        return ENOENT;
+    }
 
-    switch (state->current_member->type) {
-    case SDAP_NESTED_GROUP_DN_USER:
-        subreq = sdap_nested_group_lookup_user_send(state, state->ev,
-                                                    state->group_ctx,
-                                                    state->current_member);
-        break;
-    case SDAP_NESTED_GROUP_DN_GROUP:
-        subreq = sdap_nested_group_lookup_group_send(state, state->ev,
-                                                     state->group_ctx,
-                                                     state->current_member);
-        break;
-    case SDAP_NESTED_GROUP_DN_UNKNOWN:
-        subreq = sdap_nested_group_lookup_unknown_send(state, state->ev,
-                                                   state->group_ctx,
-                                                   state->current_member);
-        break;
+    /* the member is known to be of another type, look it up */
+    if (member->type != SDAP_NESTED_GROUP_DN_UNKNOWN
+            && member->type != memo_entry->type) {
+        return ENOENT;
     }
 
-    if (subreq == NULL) {
-        return ENOMEM;
+    DEBUG(SSSDBG_TRACE_ALL, "[%s] found in nested group memo\n", member->dn);
+
+    ret = sdap_nested_group_copy_attrs(state, memo_entry->attrs, &entry);
+    if (ret != EOK) {
+        return ret;
     }
 
-    tevent_req_set_callback(subreq, sdap_nested_group_single_step_done, req);
+    check_level = member->type == SDAP_NESTED_GROUP_DN_UNKNOWN;
+    member->type = memo_entry->type;
 
-    return EAGAIN;
+    return sdap_nested_group_single_save(state, member->type, check_level,
+                                         entry);
 }
 
-static errno_t
-sdap_nested_group_single_step_process(struct tevent_req *subreq)
+static errno_t sdap_nested_group_single_step(struct tevent_req *req)
 {
     struct sdap_nested_group_single_state *state = NULL;
-    struct tevent_req *req = NULL;
-    struct sysdb_attrs *entry = NULL;
-    enum sdap_nested_group_dn_type type = SDAP_NESTED_GROUP_DN_UNKNOWN;
-    const char *orig_dn = NULL;
+    struct sdap_nested_group_single_lookup *lookup = NULL;
+    struct sdap_nested_group_member *member = NULL;
+    struct tevent_req *subreq = NULL;
     errno_t ret;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct sdap_nested_group_single_state);
 
-    /* set correct type if possible */
-    if (state->current_member->type == SDAP_NESTED_GROUP_DN_UNKNOWN) {
-        ret = sdap_nested_group_lookup_unknown_recv(state, subreq,
-                                                    &entry, &type);
-        if (ret != EOK) {
-            goto done;
+    if (state->waiting) {
+        DLIST_REMOVE(state->group_ctx->waiting, state);
+        state->waiting = false;
+    }
+
+    while (state->member_index < state->num_members) {
+        member = &state->members[state->member_index];
+
+        ret = sdap_nested_group_single_memo(state, member);
+        if (ret == EOK) {
+            state->member_index++;
+            continue;
+        } else if (ret != ENOENT) {
+            return ret;
         }
 
-        if (entry != NULL) {
-            state->current_member->type = type;
+        if (state->group_ctx->num_lookups >= state->group_ctx->max_lookups) {
+            /* resumed by sdap_nested_group_single_wake() */
+            DLIST_ADD_END(state->group_ctx->waiting, state,
+                          struct sdap_nested_group_single_state *);
+            state->waiting = true;
+            return EAGAIN;
         }
-    }
 
-    switch (state->current_member->type) {
-    case SDAP_NESTED_GROUP_DN_USER:
-        if (entry == NULL) {
-            /* type was not unknown, receive data */
-            ret = sdap_nested_group_lookup_user_recv(state, subreq, &entry);
-            if (ret != EOK) {
-                goto done;
-            }
+        switch (member->type) {
+        case SDAP_NESTED_GROUP_DN_USER:
+            subreq = sdap_nested_group_lookup_user_send(state, state->ev,
+                                                        state->group_ctx,
+                                                        member);
+            break;
+        case SDAP_NESTED_GROUP_DN_GROUP:
+            subreq = sdap_nested_group_lookup_group_send(state, state->ev,
+                                                         state->group_ctx,
+                                                         member);
+            break;
+        case SDAP_NESTED_GROUP_DN_UNKNOWN:
+            subreq = sdap_nested_group_lookup_unknown_send(state, state->ev,
+                                                           state->group_ctx,
+                                                           member);
+            break;
+        }
 
-            if (entry == NULL) {
-                /* user not found, continue */
-                break;
-            }
+        if (subreq == NULL) {
+            return ENOMEM;
+        }
+
+        lookup = talloc_zero(subreq, struct sdap_nested_group_single_lookup);
+        if (lookup == NULL) {
+            talloc_free(subreq);
+            return ENOMEM;
         }
+        lookup->req = req;
+        lookup->member = member;
+
+        tevent_req_set_callback(subreq, sdap_nested_group_single_step_done,
+                                lookup);
+
+        state->member_index++;
+        state->num_pending++;
+        state->group_ctx->num_lookups++;
+    }
+
+    if (state->num_pending > 0) {
+        return EAGAIN;
+    }
+
+    return EOK;
+}
+
+/* Lets the waiting member lists use the free lookup slots */
+static void sdap_nested_group_single_wake(struct sdap_nested_group_ctx *group_ctx)
+{
+    struct sdap_nested_group_single_state *state = NULL;
 
+    while (group_ctx->waiting != NULL
+            && group_ctx->num_lookups < group_ctx->max_lookups) {
+        state = group_ctx->waiting;
+        sdap_nested_group_single_next(state->req);
+    }
+}
+
+/* Remembers a direct member found by the lookup or in the memo */
+static errno_t
+sdap_nested_group_single_save(struct sdap_nested_group_single_state *state,
+                              enum sdap_nested_group_dn_type type,
+                              bool check_level,
+                              struct sysdb_attrs *entry)
+{
+    const char *orig_dn = NULL;
+    errno_t ret;
+
+    switch (type) {
+    case SDAP_NESTED_GROUP_DN_USER:
         /* save user in hash table */
         ret = sdap_nested_group_hash_user(state->group_ctx, entry);
         if (ret == EEXIST) {
@@ -1467,33 +1878,21 @@ sdap_nested_group_single_step_process(struct tevent_req *subreq)
         }
         break;
     case SDAP_NESTED_GROUP_DN_GROUP:
-        if (entry == NULL) {
-            /* type was not unknown, receive data */
-            ret = sdap_nested_group_lookup_group_recv(state, subreq, &entry);
+        /* the type was unknown so we had to pull the group,
+         * but we don't want to process it if we have reached
+         * the nesting level */
+        if (check_level
+                && state->nesting_level >= state->group_ctx->max_nesting_level) {
+            ret = sysdb_attrs_get_string(entry, SYSDB_ORIG_DN, &orig_dn);
             if (ret != EOK) {
-                goto done;
+                DEBUG(SSSDBG_MINOR_FAILURE,
+                      "The entry has no originalDN\n");
+                orig_dn = "invalid";
             }
 
-            if (entry == NULL) {
-                /* group not found, continue */
-                break;
-            }
-        } else {
-            /* the type was unknown so we had to pull the group,
-             * but we don't want to process it if we have reached
-             * the nesting level */
-            if (state->nesting_level >= state->group_ctx->max_nesting_level) {
-                ret = sysdb_attrs_get_string(entry, SYSDB_ORIG_DN, &orig_dn);
-                if (ret != EOK) {
-                    DEBUG(SSSDBG_MINOR_FAILURE,
-                          "The entry has no originalDN\n");
-                    orig_dn = "invalid";
-                }
-
-                DEBUG(SSSDBG_TRACE_ALL, "[%s] is outside nesting limit "
-                      "(level %d), skipping\n", orig_dn, state->nesting_level);
-                break;
-            }
+            DEBUG(SSSDBG_TRACE_ALL, "[%s] is outside nesting limit "
+                  "(level %d), skipping\n", orig_dn, state->nesting_level);
+            break;
         }
 
         /* save group in hash table */
@@ -1525,26 +1924,106 @@ done:
     return ret;
 }
 
+static errno_t
+sdap_nested_group_single_step_process(struct tevent_req *subreq)
+{
+    struct sdap_nested_group_single_state *state = NULL;
+    struct sdap_nested_group_single_lookup *lookup = NULL;
+    struct tevent_req *req = NULL;
+    struct sysdb_attrs *entry = NULL;
+    enum sdap_nested_group_dn_type type = SDAP_NESTED_GROUP_DN_UNKNOWN;
+    bool check_level = false;
+    errno_t ret;
+
+    lookup = tevent_req_callback_data(subreq,
+                                      struct sdap_nested_group_single_lookup);
+    req = lookup->req;
+    state = tevent_req_data(req, struct sdap_nested_group_single_state);
+
+    switch (lookup->member->type) {
+    case SDAP_NESTED_GROUP_DN_USER:
+        ret = sdap_nested_group_lookup_user_recv(state, subreq, &entry);
+        break;
+    case SDAP_NESTED_GROUP_DN_GROUP:
+        ret = sdap_nested_group_lookup_group_recv(state, subreq, &entry);
+        break;
+    case SDAP_NESTED_GROUP_DN_UNKNOWN:
+        /* set correct type if possible */
+        ret = sdap_nested_group_lookup_unknown_recv(state, subreq,
+                                                    &entry, &type);
+        if (ret == EOK && entry != NULL) {
+            lookup->member->type = type;
+            check_level = true;
+        }
+        break;
+    default:
+        ret = EINVAL;
+        break;
+    }
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (entry == NULL) {
+        /* not found, continue */
+        return EOK;
+    }
+
+    sdap_nested_group_memo_add(state->group_ctx, lookup->member->dn,
+                               lookup->member->type, entry);
+
+    return sdap_nested_group_single_save(state, lookup->member->type,
+                                         check_level, entry);
+}
+
 static void sdap_nested_group_single_step_done(struct tevent_req *subreq)
 {
     struct sdap_nested_group_single_state *state = NULL;
+    struct sdap_nested_group_single_lookup *lookup = NULL;
+    struct sdap_nested_group_ctx *group_ctx = NULL;
     struct tevent_req *req = NULL;
     errno_t ret;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
+    lookup = tevent_req_callback_data(subreq,
+                                      struct sdap_nested_group_single_lookup);
+    req = lookup->req;
     state = tevent_req_data(req, struct sdap_nested_group_single_state);
+    group_ctx = state->group_ctx;
 
     /* process direct members */
     ret = sdap_nested_group_single_step_process(subreq);
     talloc_zfree(subreq);
+    state->num_pending--;
+    group_ctx->num_lookups--;
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Error processing direct membership "
                                     "[%d]: %s\n", ret, strerror(ret));
-        goto done;
+        tevent_req_error(req, ret);
+        return;
     }
 
+    sdap_nested_group_single_next(req);
+
+    /* the lookup slot is free for the other member lists */
+    sdap_nested_group_single_wake(group_ctx);
+}
+
+static void sdap_nested_group_single_next(struct tevent_req *req)
+{
+    struct sdap_nested_group_single_state *state = NULL;
+    struct tevent_req *subreq = NULL;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct sdap_nested_group_single_state);
+
     ret = sdap_nested_group_single_step(req);
     if (ret == EOK) {
+        if (state->measure) {
+            sdap_deref_stats_add(state->group_ctx->sh,
+                                 SDAP_DEREF_CLASS_GROUP_MEMBERS, false,
+                                 state->num_members, state->start);
+        }
+
         /* we have processed all direct members,
          * now recurse and process nested groups */
         subreq = sdap_nested_group_recurse_send(state, state->ev,
@@ -1567,11 +2046,7 @@ static void sdap_nested_group_single_step_done(struct tevent_req *subreq)
     ret = EAGAIN;
 
 done:
-    if (ret == EOK) {
-        /* tevent_req_error() cannot cope with EOK */
-        DEBUG(SSSDBG_CRIT_FAILURE, "We should not get here with EOK\n");
-        tevent_req_error(req, EINVAL);
-    } else if (ret != EAGAIN) {
+    if (ret != EAGAIN) {
         tevent_req_error(req, ret);
     }
 
@@ -2131,6 +2606,8 @@ struct sdap_nested_group_deref_state {
 
     struct sysdb_attrs **nested_groups;
     int num_groups;
+
+    struct timeval start;
 };
 
 static void sdap_nested_group_deref_direct_done(struct tevent_req *subreq);
@@ -2166,6 +2643,7 @@ sdap_nested_group_deref_send(TALLOC_CTX *mem_ctx,
     state->members = members;
     state->nesting_level = nesting_level;
     state->num_groups = 0; /* we will count exact number of the groups */
+    state->start = tevent_timeval_current();
 
     maps = talloc_array(state, struct sdap_attr_map_info, num_maps);
     if (maps == NULL) {
@@ -2221,6 +2699,48 @@ immediately:
     return req;
 }
 
+/* The lowercased DNs of the members, a deref reply of a large group is
+ * looked up in it */
+static errno_t
+sdap_nested_group_member_hash(TALLOC_CTX *mem_ctx,
+                              struct ldb_message_element *members,
+                              hash_table_t **_table)
+{
+    hash_table_t *table = NULL;
+    hash_key_t key;
+    hash_value_t value;
+    unsigned int i;
+    errno_t ret;
+    int hret;
+
+    ret = sss_hash_create(mem_ctx, members->num_values, &table);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    key.type = HASH_KEY_STRING;
+    value.type = HASH_VALUE_UNDEF;
+
+    for (i = 0; i < members->num_values; i++) {
+        key.str = sss_tc_utf8_str_tolower(table,
+                                    (const char *) members->values[i].data);
+        if (key.str == NULL) {
+            talloc_free(table);
+            return ENOMEM;
+        }
+
+        hret = hash_enter(table, &key, &value);
+        talloc_free(key.str);
+        if (hret != HASH_SUCCESS) {
+            talloc_free(table);
+            return EIO;
+        }
+    }
+
+    *_table = table;
+    return EOK;
+}
+
 static errno_t
 sdap_nested_group_deref_direct_process(struct tevent_req *subreq)
 {
@@ -2229,10 +2749,11 @@ sdap_nested_group_deref_direct_process(struct tevent_req *subreq)
     struct sdap_options *opts = NULL;
     struct sdap_deref_attrs **entries = NULL;
     struct ldb_message_element *members = NULL;
+    hash_table_t *known = NULL;
     const char *orig_dn = NULL;
-    const char *member_dn = NULL;
+    hash_key_t key;
     size_t num_entries = 0;
-    size_t i, j;
+    size_t i;
     bool member_found;
     errno_t ret;
 
@@ -2250,6 +2771,12 @@ sdap_nested_group_deref_direct_process(struct tevent_req *subreq)
     DEBUG(SSSDBG_TRACE_INTERNAL, "Received %zu dereference results, "
           "about to process them\n", num_entries);
 
+    ret = sdap_nested_group_member_hash(state, members, &known);
+    if (ret != EOK) {
+        goto done;
+    }
+    key.type = HASH_KEY_STRING;
+
     /*
      * We don't have any knowledge about possible number of groups when
      * dereferencing. We expect that every member is a group and we will
@@ -2275,15 +2802,13 @@ sdap_nested_group_deref_direct_process(struct tevent_req *subreq)
          * from deref/asq than we got from the initial lookup, as is the case
          * with Active Directory and its range retrieval mechanism.
          */
-        member_found = false;
-        for (j = 0; j < members->num_values; j++) {
-            /* FIXME: This is inefficient for very large sets of groups */
-            member_dn = (const char *)members->values[j].data;
-            if (strcasecmp(orig_dn, member_dn) == 0) {
-                member_found = true;
-                break;
-            }
+        key.str = sss_tc_utf8_str_tolower(state, orig_dn);
+        if (key.str == NULL) {
+            ret = ENOMEM;
+            goto done;
         }
+        member_found = hash_has_key(known, &key);
+        talloc_free(key.str);
 
         if (!member_found) {
             /* Append newly found member to member list.
@@ -2381,6 +2906,7 @@ sdap_nested_group_deref_direct_process(struct tevent_req *subreq)
     ret = EOK;
 
 done:
+    talloc_free(known);
     return ret;
 }
 
@@ -2402,6 +2928,10 @@ static void sdap_nested_group_deref_direct_done(struct tevent_req *subreq)
         goto done;
     }
 
+    sdap_deref_stats_add(state->group_ctx->sh,
+                         SDAP_DEREF_CLASS_GROUP_MEMBERS, true,
+                         state->members->num_values, state->start);
+
     /* we have processed all direct members,
      * now recurse and process nested groups */
     subreq = sdap_nested_group_recurse_send(state, state->ev,
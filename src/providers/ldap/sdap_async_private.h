@@ -73,13 +73,17 @@ errno_t deref_string_to_val(const char *str, int *val);
 
 /* from sdap_child_helpers.c */
 
+/* With a positive idle_timeout the ticket is requested from a persistent
+ * ldap_child which is stopped after idle_timeout seconds without requests,
+ * otherwise a new child is forked for this request. */
 struct tevent_req *sdap_get_tgt_send(TALLOC_CTX *mem_ctx,
                                      struct tevent_context *ev,
                                      const char *realm_str,
                                      const char *princ_str,
                                      const char *keytab_name,
                                      int32_t lifetime,
-                                     int timeout);
+                                     int timeout,
+                                     int idle_timeout);
 
 int sdap_get_tgt_recv(struct tevent_req *req,
                       TALLOC_CTX *mem_ctx,
@@ -287,6 +287,13 @@ struct sdap_sudo_refresh_state {
 
     const char *search_filter;
     const char *delete_filter;
+    bool update_modstamp;
+    bool check_deleted;
+
+    struct sysdb_attrs **rules;
+    size_t rules_count;
+    struct sysdb_attrs **names;
+    size_t names_count;
 
     int dp_error;
     size_t num_rules;
@@ -297,11 +304,16 @@ static void sdap_sudo_refresh_connect_done(struct tevent_req *subreq);
 static void sdap_sudo_refresh_hostinfo_done(struct tevent_req *subreq);
 static errno_t sdap_sudo_refresh_sudoers(struct tevent_req *req);
 static void sdap_sudo_refresh_done(struct tevent_req *subreq);
+static errno_t sdap_sudo_refresh_names(struct tevent_req *req);
+static void sdap_sudo_refresh_names_done(struct tevent_req *subreq);
+static void sdap_sudo_refresh_store(struct tevent_req *req, errno_t ret);
 
 struct tevent_req *sdap_sudo_refresh_send(TALLOC_CTX *mem_ctx,
                                           struct sdap_sudo_ctx *sudo_ctx,
                                           const char *search_filter,
-                                          const char *delete_filter)
+                                          const char *delete_filter,
+                                          bool update_modstamp,
+                                          bool check_deleted)
 {
     struct tevent_req *req;
     struct sdap_sudo_refresh_state *state;
@@ -324,6 +336,8 @@ struct tevent_req *sdap_sudo_refresh_send(TALLOC_CTX *mem_ctx,
     state->opts = id_ctx->opts;
     state->domain = id_ctx->be->domain;
     state->sysdb = id_ctx->be->domain->sysdb;
+    state->update_modstamp = update_modstamp;
+    state->check_deleted = check_deleted;
     state->dp_error = DP_ERR_FATAL;
 
     state->sdap_op = sdap_id_op_create(state, id_ctx->conn->conn_cache);
@@ -496,20 +510,99 @@ static void sdap_sudo_refresh_done(struct tevent_req *subreq)
 {
     struct tevent_req *req;
     struct sdap_sudo_refresh_state *state;
-    struct sysdb_attrs **rules = NULL;
-    size_t rules_count = 0;
-    char *usn = NULL;
-    int dp_error;
     int ret;
-    errno_t sret;
-    bool in_transaction = false;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct sdap_sudo_refresh_state);
 
-    ret = sdap_sudo_load_sudoers_recv(subreq, state, &rules_count, &rules);
+    talloc_zfree(state->rules);
+    ret = sdap_sudo_load_sudoers_recv(subreq, state, &state->rules_count,
+                                      &state->rules);
+    talloc_zfree(subreq);
+
+    if (ret == EOK && state->check_deleted) {
+        ret = sdap_sudo_refresh_names(req);
+        if (ret == EAGAIN) {
+            return;
+        }
+    }
+
+    sdap_sudo_refresh_store(req, ret);
+}
+
+/* A modifyTimestamp filter does not return deleted rules. Download only
+ * the names of all rules so that the missing ones can be removed. */
+static errno_t sdap_sudo_refresh_names(struct tevent_req *req)
+{
+    struct sdap_sudo_refresh_state *state;
+    struct tevent_req *subreq;
+    struct sdap_attr_map *map;
+    const char **attrs;
+    char *filter;
+    char *class_filter;
+
+    state = tevent_req_data(req, struct sdap_sudo_refresh_state);
+    map = state->opts->sudorule_map;
+
+    attrs = talloc_zero_array(state, const char *, 2);
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+    attrs[0] = map[SDAP_AT_SUDO_NAME].name;
+
+    class_filter = talloc_asprintf(state, SDAP_SUDO_FILTER_CLASS,
+                                   map[SDAP_OC_SUDORULE].name);
+    if (class_filter == NULL) {
+        return ENOMEM;
+    }
+
+    filter = sdap_sudo_get_filter(state, map, state->sudo_ctx, class_filter);
+    talloc_free(class_filter);
+    if (filter == NULL) {
+        return ENOMEM;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Fetching names of sudo rules\n");
+
+    subreq = sdap_search_bases_send(state, state->ev, state->opts,
+                                    sdap_id_op_handle(state->sdap_op),
+                                    state->opts->sdom->sudo_search_bases,
+                                    map, true, 0, filter, attrs);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(subreq, sdap_sudo_refresh_names_done, req);
+
+    return EAGAIN;
+}
+
+static void sdap_sudo_refresh_names_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req;
+    struct sdap_sudo_refresh_state *state;
+    int ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sdap_sudo_refresh_state);
+
+    talloc_zfree(state->names);
+    ret = sdap_search_bases_recv(subreq, state, &state->names_count,
+                                 &state->names);
     talloc_zfree(subreq);
 
+    sdap_sudo_refresh_store(req, ret);
+}
+
+static void sdap_sudo_refresh_store(struct tevent_req *req, errno_t ret)
+{
+    struct sdap_sudo_refresh_state *state;
+    char *usn = NULL;
+    size_t num_deleted = 0;
+    int dp_error;
+
+    state = tevent_req_data(req, struct sdap_sudo_refresh_state);
+
     ret = sdap_id_op_done(state->sdap_op, ret, &dp_error);
     if (dp_error == DP_ERR_OK && ret != EOK) {
         /* retry */
@@ -523,41 +616,29 @@ static void sdap_sudo_refresh_done(struct tevent_req *subreq)
         return;
     }
 
-    DEBUG(SSSDBG_TRACE_FUNC, "Received %zu rules\n", rules_count);
-
-    /* start transaction */
-    ret = sysdb_transaction_start(state->sysdb);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
-        goto done;
-    }
-    in_transaction = true;
+    DEBUG(SSSDBG_TRACE_FUNC, "Received %zu rules\n", state->rules_count);
 
-    /* purge cache */
-    ret = sysdb_sudo_purge(state->domain, state->delete_filter,
-                           rules, rules_count);
+    /* store rules, unchanged rules are not rewritten */
+    ret = sysdb_sudo_store_changed(state->domain, state->delete_filter,
+                                   state->rules, state->rules_count, NULL);
     if (ret != EOK) {
         goto done;
     }
 
-    /* store rules */
-    ret = sysdb_sudo_store(state->domain, rules, rules_count);
-    if (ret != EOK) {
-        goto done;
-    }
+    if (state->check_deleted) {
+        ret = sysdb_sudo_purge_missing(state->domain, state->names,
+                                       state->names_count, &num_deleted);
+        if (ret != EOK) {
+            goto done;
+        }
 
-    /* commit transaction */
-    ret = sysdb_transaction_commit(state->sysdb);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
-        goto done;
+        DEBUG(SSSDBG_TRACE_FUNC, "Removed %zu deleted rules\n", num_deleted);
     }
-    in_transaction = false;
 
     DEBUG(SSSDBG_TRACE_FUNC, "Sudoers is successfuly stored in cache\n");
 
     /* remember new usn */
-    ret = sysdb_get_highest_usn(state, rules, rules_count, &usn);
+    ret = sysdb_get_highest_usn(state, state->rules, state->rules_count, &usn);
     if (ret == EOK) {
         sdap_sudo_set_usn(state->srv_opts, usn);
     } else {
@@ -565,17 +646,15 @@ static void sdap_sudo_refresh_done(struct tevent_req *subreq)
               ret, sss_strerror(ret));
     }
 
+    if (state->update_modstamp) {
+        sdap_sudo_set_modstamp(state->sudo_ctx, &state->sudo_ctx->max_modstamp,
+                               state->rules, state->rules_count);
+    }
+
     ret = EOK;
-    state->num_rules = rules_count;
+    state->num_rules = state->rules_count;
 
 done:
-    if (in_transaction) {
-        sret = sysdb_transaction_cancel(state->sysdb);
-        if (sret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE, "Could not cancel transaction\n");
-        }
-    }
-
     state->dp_error = dp_error;
     if (ret == EOK) {
         tevent_req_done(req);
@@ -111,13 +111,16 @@ done:
     return ret;
 }
 
-/* FIXME: support storing additional attributes */
-int sdap_save_user(TALLOC_CTX *memctx,
-                   struct sdap_options *opts,
-                   struct sss_domain_info *dom,
-                   struct sysdb_attrs *attrs,
-                   char **_usn_value,
-                   time_t now)
+/* Convert the LDAP attributes of a user to the arguments of the sysdb
+ * store functions. The user belongs to *_dom, which can be a subdomain of
+ * @dom. user->name is left NULL if the user is not to be stored. */
+static int sdap_prepare_user(TALLOC_CTX *memctx,
+                             struct sdap_options *opts,
+                             struct sss_domain_info *dom,
+                             struct sysdb_attrs *attrs,
+                             struct sss_domain_info **_dom,
+                             struct sysdb_bulk_user *user,
+                             char **_usn_value)
 {
     struct ldb_message_element *el;
     int ret;
@@ -133,7 +136,6 @@ int sdap_save_user(TALLOC_CTX *memctx,
     struct sysdb_attrs *user_attrs;
     char *upn = NULL;
     size_t i;
-    int cache_timeout;
     char *usn_value = NULL;
     char **missing = NULL;
     TALLOC_CTX *tmpctx = NULL;
@@ -144,6 +146,8 @@ int sdap_save_user(TALLOC_CTX *memctx,
 
     DEBUG(SSSDBG_TRACE_FUNC, "Save user\n");
 
+    memset(user, 0, sizeof(*user));
+
     tmpctx = talloc_new(NULL);
     if (!tmpctx) {
         ret = ENOMEM;
@@ -464,8 +468,6 @@ int sdap_save_user(TALLOC_CTX *memctx,
         }
     }
 
-    cache_timeout = dom->user_timeout;
-
     ret = sdap_save_all_names(user_name, attrs, dom, user_attrs);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to save user names\n");
@@ -481,18 +483,23 @@ int sdap_save_user(TALLOC_CTX *memctx,
         goto done;
     }
 
-    DEBUG(SSSDBG_TRACE_FUNC, "Storing info for user %s\n", user_name);
-
-    ret = sysdb_store_user(dom, user_name, pwd, uid, gid,
-                           gecos, homedir, shell, orig_dn,
-                           user_attrs, missing, cache_timeout, now);
-    if (ret) goto done;
+    user->name = user_name;
+    user->pwd = pwd;
+    user->uid = uid;
+    user->gid = gid;
+    user->gecos = gecos;
+    user->homedir = homedir;
+    user->shell = shell;
+    user->orig_dn = orig_dn;
+    /* the missing attributes are allocated on user_attrs */
+    user->attrs = talloc_steal(memctx, user_attrs);
+    user->remove_attrs = missing;
 
     if (_usn_value) {
         *_usn_value = talloc_steal(memctx, usn_value);
     }
 
-    talloc_steal(memctx, user_attrs);
+    *_dom = dom;
     ret = EOK;
 
 done:
@@ -505,9 +512,133 @@ done:
     return ret;
 }
 
+/* FIXME: support storing additional attributes */
+int sdap_save_user(TALLOC_CTX *memctx,
+                   struct sdap_options *opts,
+                   struct sss_domain_info *dom,
+                   struct sysdb_attrs *attrs,
+                   char **_usn_value,
+                   time_t now)
+{
+    TALLOC_CTX *tmpctx;
+    struct sysdb_bulk_user user;
+    char *usn_value = NULL;
+    int ret;
+
+    tmpctx = talloc_new(NULL);
+    if (!tmpctx) {
+        return ENOMEM;
+    }
+
+    ret = sdap_prepare_user(tmpctx, opts, dom, attrs, &dom, &user,
+                            &usn_value);
+    if (ret != EOK || user.name == NULL) {
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Storing info for user %s\n", user.name);
+
+    ret = sysdb_store_user(dom, user.name, user.pwd, user.uid, user.gid,
+                           user.gecos, user.homedir, user.shell, user.orig_dn,
+                           user.attrs, user.remove_attrs, dom->user_timeout,
+                           now);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to save user [%s]\n", user.name);
+        goto done;
+    }
+
+    if (_usn_value) {
+        *_usn_value = talloc_steal(memctx, usn_value);
+    }
+
+    talloc_steal(memctx, user.attrs);
+
+done:
+    talloc_free(tmpctx);
+    return ret;
+}
+
 
 /* ==Generic-Function-to-save-multiple-users============================= */
 
+/* users stored in one sysdb_store_users_bulk() call */
+#define SDAP_SAVE_USERS_BATCH 1000
+
+struct sdap_save_users_batch {
+    /* the data of each prepared user */
+    TALLOC_CTX **mem_ctxs;
+    struct sss_domain_info *dom;
+    struct sysdb_bulk_user *users;
+    char **usn_values;
+    size_t num;
+};
+
+static void sdap_save_users_higher_usn(char **_higher_usn, char *usn_value)
+{
+    char *higher_usn = *_higher_usn;
+
+    if (higher_usn) {
+        if ((strlen(usn_value) > strlen(higher_usn)) ||
+            (strcmp(usn_value, higher_usn) > 0)) {
+            talloc_zfree(higher_usn);
+            higher_usn = usn_value;
+        } else {
+            talloc_zfree(usn_value);
+        }
+    } else {
+        higher_usn = usn_value;
+    }
+
+    *_higher_usn = higher_usn;
+}
+
+static errno_t sdap_save_users_flush(TALLOC_CTX *usn_ctx,
+                                     struct sdap_save_users_batch *batch,
+                                     time_t now,
+                                     char **_higher_usn)
+{
+    errno_t ret;
+    size_t i;
+
+    if (batch->num == 0) {
+        return EOK;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Storing %zu users of [%s]\n",
+          batch->num, batch->dom->name);
+
+    ret = sysdb_store_users_bulk(batch->dom, batch->users, batch->num,
+                                 batch->dom->user_timeout, now);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store users\n");
+        return ret;
+    }
+
+    for (i = 0; i < batch->num; i++) {
+        /* Do not fail completely on errors.
+         * Just report the failure to save and go on */
+        if (batch->users[i].ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store user [%s]. Ignoring.\n",
+                  batch->users[i].name);
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_ALL, "User [%s] processed!\n",
+              batch->users[i].name);
+        if (batch->usn_values[i] != NULL) {
+            sdap_save_users_higher_usn(_higher_usn,
+                                       talloc_steal(usn_ctx,
+                                                    batch->usn_values[i]));
+        }
+    }
+
+    for (i = 0; i < batch->num; i++) {
+        talloc_zfree(batch->mem_ctxs[i]);
+    }
+    batch->num = 0;
+    return EOK;
+}
+
 int sdap_save_users(TALLOC_CTX *memctx,
                     struct sysdb_ctx *sysdb,
                     struct sss_domain_info *dom,
@@ -517,8 +648,13 @@ int sdap_save_users(TALLOC_CTX *memctx,
                     char **_usn_value)
 {
     TALLOC_CTX *tmpctx;
+    TALLOC_CTX *user_ctx;
     char *higher_usn = NULL;
     char *usn_value;
+    struct sdap_save_users_batch batch;
+    struct sysdb_bulk_user user;
+    struct sss_domain_info *user_dom;
+    size_t batch_size;
     int ret;
     errno_t sret;
     int i;
@@ -535,6 +671,16 @@ int sdap_save_users(TALLOC_CTX *memctx,
         return ENOMEM;
     }
 
+    batch_size = MIN(num_users, SDAP_SAVE_USERS_BATCH);
+    memset(&batch, 0, sizeof(batch));
+    batch.users = talloc_array(tmpctx, struct sysdb_bulk_user, batch_size);
+    batch.usn_values = talloc_array(tmpctx, char *, batch_size);
+    batch.mem_ctxs = talloc_array(tmpctx, TALLOC_CTX *, batch_size);
+    if (!batch.users || !batch.usn_values || !batch.mem_ctxs) {
+        ret = ENOMEM;
+        goto done;
+    }
+
     ret = sysdb_transaction_start(sysdb);
     if (ret) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
@@ -544,31 +690,45 @@ int sdap_save_users(TALLOC_CTX *memctx,
 
     now = time(NULL);
     for (i = 0; i < num_users; i++) {
-        usn_value = NULL;
-
-        ret = sdap_save_user(tmpctx, opts, dom, users[i], &usn_value, now);
+        user_ctx = talloc_new(tmpctx);
+        if (!user_ctx) {
+            ret = ENOMEM;
+            goto done;
+        }
 
-        /* Do not fail completely on errors.
-         * Just report the failure to save and go on */
-        if (ret) {
-            DEBUG(SSSDBG_OP_FAILURE, "Failed to store user %d. Ignoring.\n", i);
-        } else {
-            DEBUG(SSSDBG_TRACE_ALL, "User %d processed!\n", i);
+        usn_value = NULL;
+        ret = sdap_prepare_user(user_ctx, opts, dom, users[i],
+                                &user_dom, &user, &usn_value);
+        if (ret != EOK || user.name == NULL) {
+            /* Do not fail completely on errors.
+             * Just report the failure to save and go on */
+            if (ret) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "Failed to store user %d. Ignoring.\n", i);
+            }
+            talloc_free(user_ctx);
+            continue;
         }
 
-        if (usn_value) {
-            if (higher_usn) {
-                if ((strlen(usn_value) > strlen(higher_usn)) ||
-                    (strcmp(usn_value, higher_usn) > 0)) {
-                    talloc_zfree(higher_usn);
-                    higher_usn = usn_value;
-                } else {
-                    talloc_zfree(usn_value);
-                }
-            } else {
-                higher_usn = usn_value;
+        /* the users of one bulk store must share the domain */
+        if (batch.num == batch_size
+                || (batch.num > 0 && user_dom != batch.dom)) {
+            ret = sdap_save_users_flush(tmpctx, &batch, now, &higher_usn);
+            if (ret != EOK) {
+                goto done;
             }
         }
+
+        batch.dom = user_dom;
+        batch.mem_ctxs[batch.num] = user_ctx;
+        batch.users[batch.num] = user;
+        batch.usn_values[batch.num] = usn_value;
+        batch.num++;
+    }
+
+    ret = sdap_save_users_flush(tmpctx, &batch, now, &higher_usn);
+    if (ret != EOK) {
+        goto done;
     }
 
     ret = sysdb_transaction_commit(sysdb);
@@ -837,16 +997,20 @@ int sdap_search_user_recv(TALLOC_CTX *memctx, struct tevent_req *req,
 
 /* ==Search-And-Save-Users-with-filter============================================= */
 struct sdap_get_users_state {
+    struct tevent_context *ev;
     struct sysdb_ctx *sysdb;
     struct sdap_options *opts;
     struct sss_domain_info *dom;
+    enum sdap_entry_lookup_type lookup_type;
 
     char *higher_usn;
     struct sysdb_attrs **users;
     size_t count;
+    size_t saved;
 };
 
 static void sdap_get_users_done(struct tevent_req *subreq);
+static errno_t sdap_get_users_save_step(struct tevent_req *req);
 
 struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
                                        struct tevent_context *ev,
@@ -868,9 +1032,11 @@ struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
     req = tevent_req_create(memctx, &state, struct sdap_get_users_state);
     if (!req) return NULL;
 
+    state->ev = ev;
     state->sysdb = sysdb;
     state->opts = opts;
     state->dom = dom;
+    state->lookup_type = lookup_type;
 
     subreq = sdap_search_user_send(state, ev, dom, opts, search_bases,
                                    sh, attrs, filter, timeout, lookup_type);
@@ -907,6 +1073,18 @@ static void sdap_get_users_done(struct tevent_req *subreq)
         return;
     }
 
+    if (state->lookup_type == SDAP_LOOKUP_ENUMERATE
+            && state->count > SDAP_SAVE_USERS_BATCH) {
+        /* Converting and storing a whole enumeration at once would block
+         * the back end for a long time, store it batch by batch instead */
+        state->saved = 0;
+        ret = sdap_get_users_save_step(req);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+        }
+        return;
+    }
+
     ret = sdap_save_users(state, state->sysdb,
                           state->dom, state->opts,
                           state->users, state->count,
@@ -923,6 +1101,79 @@ static void sdap_get_users_done(struct tevent_req *subreq)
     tevent_req_done(req);
 }
 
+static void sdap_get_users_save_next(struct tevent_context *ev,
+                                     struct tevent_timer *te,
+                                     struct timeval tv, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct sdap_get_users_state *state = tevent_req_data(req,
+                                            struct sdap_get_users_state);
+    char *usn_value = NULL;
+    size_t num;
+    errno_t ret;
+
+    num = MIN(state->count - state->saved, SDAP_SAVE_USERS_BATCH);
+
+    /* every batch is stored in its own transaction so that the cache is not
+     * locked while the other requests are served */
+    ret = sdap_save_users(state, state->sysdb,
+                          state->dom, state->opts,
+                          state->users + state->saved, num,
+                          &usn_value);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to store users [%d][%s].\n",
+              ret, sss_strerror(ret));
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    if (usn_value != NULL) {
+        sdap_save_users_higher_usn(&state->higher_usn, usn_value);
+    }
+
+    /* the converted entries are not needed anymore */
+    while (num > 0) {
+        talloc_zfree(state->users[state->saved]);
+        state->saved++;
+        num--;
+    }
+
+    if (state->saved == state->count) {
+        DEBUG(SSSDBG_TRACE_ALL, "Saving %zu Users - Done\n", state->count);
+        tevent_req_done(req);
+        return;
+    }
+
+    ret = sdap_get_users_save_step(req);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+    }
+}
+
+static errno_t sdap_get_users_save_step(struct tevent_req *req)
+{
+    struct sdap_get_users_state *state = tevent_req_data(req,
+                                            struct sdap_get_users_state);
+    struct tevent_timer *te;
+    struct timeval tv;
+
+    /* A timer which is already due would be run before the file descriptors
+     * are polled again, schedule the next batch slightly in the future as
+     * sdap_unlock_next_reply() does so that pending replies and requests
+     * of the clients are served in between. */
+    tv = tevent_timeval_current_ofs(0, 5);
+
+    te = tevent_add_timer(state->ev, state, tv,
+                          sdap_get_users_save_next, req);
+    if (te == NULL) {
+        return ENOMEM;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Saved %zu of %zu users\n",
+          state->saved, state->count);
+    return EOK;
+}
+
 int sdap_get_users_recv(struct tevent_req *req,
                         TALLOC_CTX *mem_ctx, char **usn_value)
 {
@@ -70,7 +70,10 @@ static void sdap_close_fd(int *fd)
 }
 
 static errno_t sdap_fork_child(struct tevent_context *ev,
-                               struct sdap_child *child)
+                               struct sdap_child *child,
+                               const char *extra_argv[],
+                               sss_child_callback_t cb, void *pvt,
+                               struct sss_child_ctx_old **_child_ctx)
 {
     int pipefd_to_child[2];
     int pipefd_from_child[2];
@@ -93,34 +96,32 @@ static errno_t sdap_fork_child(struct tevent_context *ev,
         return err;
     }
 
-    pid = fork();
-
-    if (pid == 0) { /* child */
-        err = exec_child(child,
-                         pipefd_to_child, pipefd_from_child,
-                         LDAP_CHILD, ldap_child_debug_fd);
+    err = spawn_child(child,
+                      pipefd_to_child, pipefd_from_child,
+                      LDAP_CHILD, ldap_child_debug_fd,
+                      extra_argv, false,
+                      STDIN_FILENO, STDOUT_FILENO, &pid);
+    if (err != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not exec LDAP child: [%d][%s].\n",
                                     err, strerror(err));
-        return err;
-    } else if (pid > 0) { /* parent */
-        child->pid = pid;
-        child->io->read_from_child_fd = pipefd_from_child[0];
+        close(pipefd_from_child[0]);
         close(pipefd_from_child[1]);
-        child->io->write_to_child_fd = pipefd_to_child[1];
         close(pipefd_to_child[0]);
-        sss_fd_nonblocking(child->io->read_from_child_fd);
-        sss_fd_nonblocking(child->io->write_to_child_fd);
+        close(pipefd_to_child[1]);
+        return err;
+    }
 
-        ret = child_handler_setup(ev, pid, NULL, NULL, NULL);
-        if (ret != EOK) {
-            return ret;
-        }
+    child->pid = pid;
+    child->io->read_from_child_fd = pipefd_from_child[0];
+    close(pipefd_from_child[1]);
+    child->io->write_to_child_fd = pipefd_to_child[1];
+    close(pipefd_to_child[0]);
+    sss_fd_nonblocking(child->io->read_from_child_fd);
+    sss_fd_nonblocking(child->io->write_to_child_fd);
 
-    } else { /* error */
-        err = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "fork failed [%d][%s].\n", err, strerror(err));
-        return err;
+    ret = child_handler_setup(ev, pid, cb, pvt, _child_ctx);
+    if (ret != EOK) {
+        return ret;
     }
 
     return EOK;
@@ -131,6 +132,7 @@ static errno_t create_tgt_req_send_buffer(TALLOC_CTX *mem_ctx,
                                           const char *princ_str,
                                           const char *keytab_name,
                                           int32_t lifetime,
+                                          bool framed,
                                           struct io_buffer **io_buf)
 {
     struct io_buffer *buf;
@@ -143,6 +145,9 @@ static errno_t create_tgt_req_send_buffer(TALLOC_CTX *mem_ctx,
     }
 
     buf->size = 6 * sizeof(uint32_t);
+    if (framed) {
+        buf->size += sizeof(uint32_t);
+    }
     if (realm_str) {
         buf->size += strlen(realm_str);
     }
@@ -164,6 +169,12 @@ static errno_t create_tgt_req_send_buffer(TALLOC_CTX *mem_ctx,
 
     rp = 0;
 
+    /* the persistent child needs the length of each request */
+    if (framed) {
+        SAFEALIGN_SET_UINT32(&buf->data[rp], buf->size - sizeof(uint32_t),
+                             &rp);
+    }
+
     /* realm */
     if (realm_str) {
         SAFEALIGN_SET_UINT32(&buf->data[rp], strlen(realm_str), &rp);
@@ -245,6 +256,286 @@ static int parse_child_response(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+/* ==Persistent-child====================================================== */
+
+/* A long-lived ldap_child serves the requests one after the other, so a
+ * reconnect only costs a message exchange instead of a fork of the back
+ * end. The child keeps the keytab of its first request in memory, it is
+ * replaced by a new one after any failure and stopped when it was idle
+ * for idle_timeout seconds. */
+struct sdap_child_server {
+    struct tevent_context *ev;
+    struct sdap_child *child;
+    struct sss_child_ctx_old *child_ctx;
+
+    char *keytab_name;
+    char *canonicalize;
+
+    int idle_timeout;
+    struct tevent_timer *idle_timer;
+
+    /* the request being served */
+    struct tevent_req *active;
+};
+
+/* the requests waiting until the shared child is free */
+struct sdap_child_wait {
+    struct sdap_child_wait *prev;
+    struct sdap_child_wait *next;
+
+    struct tevent_req *req;
+};
+
+static struct sdap_child_server *sdap_child_srv;
+static struct sdap_child_wait *sdap_child_waiting;
+
+static const char *sdap_child_persistent_argv[] = { "--persistent", NULL };
+
+static void sdap_child_server_retire(struct sdap_child_server *srv);
+
+static int sdap_child_server_destructor(struct sdap_child_server *srv)
+{
+    if (sdap_child_srv == srv) {
+        sdap_child_srv = NULL;
+    }
+
+    /* kills the child, the handler still waits for it */
+    if (srv->child_ctx != NULL) {
+        child_handler_destroy(srv->child_ctx);
+    }
+
+    return 0;
+}
+
+static void sdap_child_server_exited(int child_status,
+                                     struct tevent_signal *sige,
+                                     void *pvt);
+
+static errno_t sdap_child_server_create(struct tevent_context *ev,
+                                        const char *keytab_name,
+                                        int idle_timeout,
+                                        struct sdap_child_server **_srv)
+{
+    struct sdap_child_server *srv;
+    const char *canonicalize;
+    errno_t ret;
+
+    srv = talloc_zero(ev, struct sdap_child_server);
+    if (srv == NULL) {
+        return ENOMEM;
+    }
+    talloc_set_destructor(srv, sdap_child_server_destructor);
+
+    srv->ev = ev;
+    srv->idle_timeout = idle_timeout;
+
+    if (keytab_name != NULL) {
+        srv->keytab_name = talloc_strdup(srv, keytab_name);
+        if (srv->keytab_name == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    /* read by the child from the environment it got at fork time */
+    canonicalize = getenv("KRB5_CANONICALIZE");
+    if (canonicalize != NULL) {
+        srv->canonicalize = talloc_strdup(srv, canonicalize);
+        if (srv->canonicalize == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    srv->child = talloc_zero(srv, struct sdap_child);
+    if (srv->child == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    srv->child->io = talloc(srv->child, struct child_io_fds);
+    if (srv->child->io == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    srv->child->io->read_from_child_fd = -1;
+    srv->child->io->write_to_child_fd = -1;
+    talloc_set_destructor((TALLOC_CTX *) srv->child->io, child_io_destructor);
+
+    ret = sdap_fork_child(ev, srv->child, sdap_child_persistent_argv,
+                          sdap_child_server_exited, srv, &srv->child_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_fork_child failed.\n");
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Started persistent ldap_child [%d]\n", srv->child->pid);
+
+    *_srv = srv;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(srv);
+    }
+    return ret;
+}
+
+static bool sdap_child_server_matches(struct sdap_child_server *srv,
+                                      const char *keytab_name)
+{
+    const char *canonicalize = getenv("KRB5_CANONICALIZE");
+
+    if ((srv->keytab_name == NULL) != (keytab_name == NULL)
+            || (keytab_name != NULL
+                && strcmp(srv->keytab_name, keytab_name) != 0)) {
+        return false;
+    }
+
+    if ((srv->canonicalize == NULL) != (canonicalize == NULL)
+            || (canonicalize != NULL
+                && strcmp(srv->canonicalize, canonicalize) != 0)) {
+        return false;
+    }
+
+    return true;
+}
+
+static void sdap_child_server_idle(struct tevent_context *ev,
+                                   struct tevent_timer *te,
+                                   struct timeval tv, void *pvt)
+{
+    struct sdap_child_server *srv = talloc_get_type(pvt,
+                                                    struct sdap_child_server);
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Stopping idle ldap_child [%d]\n", srv->child->pid);
+
+    srv->idle_timer = NULL;
+    sdap_child_server_retire(srv);
+}
+
+/* ==Framed-child-messages================================================= */
+
+/* the responses are small, anything larger means the pipe is out of sync */
+#define SDAP_CHILD_MAX_MSG_SIZE 65536
+
+struct sdap_child_read_msg_state {
+    int fd;
+    uint8_t len_buf[sizeof(uint32_t)];
+    size_t len_read;
+    uint8_t *buf;
+    size_t len;
+    size_t read;
+};
+
+static void sdap_child_read_msg_handler(struct tevent_context *ev,
+                                        struct tevent_fd *fde,
+                                        uint16_t flags, void *pvt);
+
+static struct tevent_req *sdap_child_read_msg_send(TALLOC_CTX *mem_ctx,
+                                                   struct tevent_context *ev,
+                                                   int fd)
+{
+    struct tevent_req *req;
+    struct sdap_child_read_msg_state *state;
+    struct tevent_fd *fde;
+
+    req = tevent_req_create(mem_ctx, &state, struct sdap_child_read_msg_state);
+    if (req == NULL) return NULL;
+
+    state->fd = fd;
+
+    fde = tevent_add_fd(ev, state, fd, TEVENT_FD_READ,
+                        sdap_child_read_msg_handler, req);
+    if (fde == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_fd failed.\n");
+        talloc_zfree(req);
+        return NULL;
+    }
+
+    return req;
+}
+
+static void sdap_child_read_msg_handler(struct tevent_context *ev,
+                                        struct tevent_fd *fde,
+                                        uint16_t flags, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct sdap_child_read_msg_state *state = tevent_req_data(req,
+                                        struct sdap_child_read_msg_state);
+    uint32_t len;
+    ssize_t size;
+    size_t p = 0;
+    errno_t ret;
+
+    /* the length first, then the message itself */
+    if (state->buf == NULL) {
+        size = read(state->fd, state->len_buf + state->len_read,
+                    sizeof(state->len_buf) - state->len_read);
+    } else {
+        size = read(state->fd, state->buf + state->read,
+                    state->len - state->read);
+    }
+
+    if (size == -1) {
+        ret = errno;
+        if (ret == EAGAIN || ret == EINTR) {
+            return;
+        }
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "read failed [%d][%s].\n", ret, strerror(ret));
+        tevent_req_error(req, ret);
+        return;
+    } else if (size == 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldap_child closed the pipe.\n");
+        tevent_req_error(req, EPIPE);
+        return;
+    }
+
+    if (state->buf == NULL) {
+        state->len_read += size;
+        if (state->len_read < sizeof(state->len_buf)) {
+            return;
+        }
+
+        SAFEALIGN_COPY_UINT32(&len, state->len_buf, &p);
+        if (len == 0 || len > SDAP_CHILD_MAX_MSG_SIZE) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Invalid message size %u.\n", len);
+            tevent_req_error(req, EINVAL);
+            return;
+        }
+
+        state->buf = talloc_size(state, len);
+        if (state->buf == NULL) {
+            tevent_req_error(req, ENOMEM);
+            return;
+        }
+        state->len = len;
+        return;
+    }
+
+    state->read += size;
+    if (state->read == state->len) {
+        tevent_req_done(req);
+    }
+}
+
+static errno_t sdap_child_read_msg_recv(struct tevent_req *req,
+                                        TALLOC_CTX *mem_ctx,
+                                        uint8_t **_buf, ssize_t *_len)
+{
+    struct sdap_child_read_msg_state *state = tevent_req_data(req,
+                                        struct sdap_child_read_msg_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_buf = talloc_steal(mem_ctx, state->buf);
+    *_len = state->len;
+    return EOK;
+}
+
 /* ==The-public-async-interface============================================*/
 
 struct sdap_get_tgt_state {
@@ -252,6 +543,16 @@ struct sdap_get_tgt_state {
     struct sdap_child *child;
     ssize_t len;
     uint8_t *buf;
+    struct tevent_timer *timeout_te;
+
+    /* only used with the persistent child */
+    const char *keytab_name;
+    int timeout;
+    int idle_timeout;
+    struct io_buffer *send_buf;
+    struct sdap_child_server *server;
+    struct sdap_child_wait *wait;
+    struct tevent_req *subreq;
 };
 
 static errno_t set_tgt_child_timeout(struct tevent_req *req,
@@ -259,6 +560,7 @@ static errno_t set_tgt_child_timeout(struct tevent_req *req,
                                      int timeout);
 static void sdap_get_tgt_step(struct tevent_req *subreq);
 static void sdap_get_tgt_done(struct tevent_req *subreq);
+static errno_t sdap_get_tgt_dispatch(struct tevent_req *req);
 
 struct tevent_req *sdap_get_tgt_send(TALLOC_CTX *mem_ctx,
                                      struct tevent_context *ev,
@@ -266,7 +568,8 @@ struct tevent_req *sdap_get_tgt_send(TALLOC_CTX *mem_ctx,
                                      const char *princ_str,
                                      const char *keytab_name,
                                      int32_t lifetime,
-                                     int timeout)
+                                     int timeout,
+                                     int idle_timeout)
 {
     struct tevent_req *req, *subreq;
     struct sdap_get_tgt_state *state;
@@ -280,6 +583,34 @@ struct tevent_req *sdap_get_tgt_send(TALLOC_CTX *mem_ctx,
 
     state->ev = ev;
 
+    if (idle_timeout > 0) {
+        state->timeout = timeout;
+        state->idle_timeout = idle_timeout;
+
+        if (keytab_name != NULL) {
+            state->keytab_name = talloc_strdup(state, keytab_name);
+            if (state->keytab_name == NULL) {
+                ret = ENOMEM;
+                goto fail;
+            }
+        }
+
+        ret = create_tgt_req_send_buffer(state,
+                                         realm_str, princ_str, keytab_name,
+                                         lifetime, true, &state->send_buf);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "create_tgt_req_send_buffer failed.\n");
+            goto fail;
+        }
+
+        ret = sdap_get_tgt_dispatch(req);
+        if (ret != EOK) {
+            goto fail;
+        }
+
+        return req;
+    }
+
     state->child = talloc_zero(state, struct sdap_child);
     if (!state->child) {
         ret = ENOMEM;
@@ -298,13 +629,13 @@ struct tevent_req *sdap_get_tgt_send(TALLOC_CTX *mem_ctx,
     /* prepare the data to pass to child */
     ret = create_tgt_req_send_buffer(state,
                                      realm_str, princ_str, keytab_name, lifetime,
-                                     &buf);
+                                     false, &buf);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "create_tgt_req_send_buffer failed.\n");
         goto fail;
     }
 
-    ret = sdap_fork_child(state->ev, state->child);
+    ret = sdap_fork_child(state->ev, state->child, NULL, NULL, NULL, NULL);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "sdap_fork_child failed.\n");
         goto fail;
@@ -378,6 +709,284 @@ static void sdap_get_tgt_done(struct tevent_req *subreq)
     tevent_req_done(req);
 }
 
+/* Starts the first waiting requests while the shared child is free */
+static void sdap_child_server_next(void)
+{
+    struct sdap_get_tgt_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    while (sdap_child_waiting != NULL
+            && (sdap_child_srv == NULL || sdap_child_srv->active == NULL)) {
+        req = sdap_child_waiting->req;
+        state = tevent_req_data(req, struct sdap_get_tgt_state);
+        talloc_zfree(state->wait);
+
+        ret = sdap_get_tgt_dispatch(req);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+        }
+    }
+}
+
+/* Stops the child without starting the waiting requests */
+static void sdap_child_server_free(struct sdap_child_server *srv)
+{
+    struct sdap_get_tgt_state *state;
+
+    if (sdap_child_srv == srv) {
+        sdap_child_srv = NULL;
+    }
+
+    /* the pipes are closed below */
+    if (srv->active != NULL) {
+        state = tevent_req_data(srv->active, struct sdap_get_tgt_state);
+        talloc_zfree(state->subreq);
+        state->server = NULL;
+        srv->active = NULL;
+    }
+
+    talloc_free(srv);
+}
+
+static void sdap_child_server_retire(struct sdap_child_server *srv)
+{
+    sdap_child_server_free(srv);
+    sdap_child_server_next();
+}
+
+static void sdap_child_server_release(struct sdap_child_server *srv)
+{
+    struct timeval tv;
+
+    srv->active = NULL;
+
+    if (srv != sdap_child_srv) {
+        /* a child of its own for another keytab */
+        talloc_free(srv);
+        return;
+    }
+
+    sdap_child_server_next();
+    if (srv != sdap_child_srv || srv->active != NULL) {
+        return;
+    }
+
+    tv = tevent_timeval_current_ofs(srv->idle_timeout, 0);
+    srv->idle_timer = tevent_add_timer(srv->ev, srv, tv,
+                                       sdap_child_server_idle, srv);
+    if (srv->idle_timer == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "tevent_add_timer failed.\n");
+        sdap_child_server_retire(srv);
+    }
+}
+
+static void sdap_child_server_exited(int child_status,
+                                     struct tevent_signal *sige,
+                                     void *pvt)
+{
+    struct sdap_child_server *srv = talloc_get_type(pvt,
+                                                    struct sdap_child_server);
+    struct tevent_req *active = srv->active;
+    struct sdap_get_tgt_state *state;
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Persistent ldap_child [%d] exited with status [%d]\n",
+          srv->child->pid, child_status);
+
+    /* the handler frees its context after this call */
+    srv->child_ctx = NULL;
+
+    if (active != NULL) {
+        state = tevent_req_data(active, struct sdap_get_tgt_state);
+        talloc_zfree(state->timeout_te);
+    }
+
+    sdap_child_server_retire(srv);
+
+    if (active != NULL) {
+        tevent_req_error(active, EPIPE);
+    }
+}
+
+static int sdap_get_tgt_state_destructor(struct sdap_get_tgt_state *state)
+{
+    /* the request was freed in the middle of the exchange */
+    if (state->server != NULL) {
+        sdap_child_server_retire(state->server);
+    }
+
+    return 0;
+}
+
+static void sdap_get_tgt_persistent_step(struct tevent_req *subreq);
+static void sdap_get_tgt_persistent_done(struct tevent_req *subreq);
+
+static errno_t sdap_get_tgt_start(struct tevent_req *req,
+                                  struct sdap_child_server *srv)
+{
+    struct sdap_get_tgt_state *state = tevent_req_data(req,
+                                                  struct sdap_get_tgt_state);
+    errno_t ret;
+
+    talloc_zfree(srv->idle_timer);
+    srv->active = req;
+    state->server = srv;
+    talloc_set_destructor(state, sdap_get_tgt_state_destructor);
+
+    ret = set_tgt_child_timeout(req, state->ev, state->timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "activate_child_timeout_handler failed.\n");
+        return ret;
+    }
+
+    state->subreq = write_pipe_send(state, state->ev,
+                                    state->send_buf->data,
+                                    state->send_buf->size,
+                                    srv->child->io->write_to_child_fd);
+    if (state->subreq == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(state->subreq, sdap_get_tgt_persistent_step, req);
+
+    return EOK;
+}
+
+static int sdap_child_wait_destructor(struct sdap_child_wait *wait)
+{
+    DLIST_REMOVE(sdap_child_waiting, wait);
+    return 0;
+}
+
+static errno_t sdap_get_tgt_dispatch(struct tevent_req *req)
+{
+    struct sdap_get_tgt_state *state = tevent_req_data(req,
+                                                  struct sdap_get_tgt_state);
+    struct sdap_child_server *srv = sdap_child_srv;
+    struct sdap_child_wait *wait;
+    errno_t ret;
+
+    if (srv != NULL && !sdap_child_server_matches(srv, state->keytab_name)) {
+        if (srv->active != NULL) {
+            /* the shared child is busy with another keytab */
+            ret = sdap_child_server_create(state->ev, state->keytab_name,
+                                           0, &srv);
+            if (ret != EOK) {
+                return ret;
+            }
+            return sdap_get_tgt_start(req, srv);
+        }
+
+        sdap_child_server_free(srv);
+        srv = NULL;
+    }
+
+    if (srv == NULL) {
+        ret = sdap_child_server_create(state->ev, state->keytab_name,
+                                       state->idle_timeout, &srv);
+        if (ret != EOK) {
+            return ret;
+        }
+        sdap_child_srv = srv;
+    } else if (srv->active != NULL) {
+        wait = talloc_zero(state, struct sdap_child_wait);
+        if (wait == NULL) {
+            return ENOMEM;
+        }
+        wait->req = req;
+
+        DLIST_ADD_END(sdap_child_waiting, wait, struct sdap_child_wait *);
+        talloc_set_destructor(wait, sdap_child_wait_destructor);
+        state->wait = wait;
+
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "ldap_child [%d] is busy, waiting\n", srv->child->pid);
+        return EOK;
+    }
+
+    return sdap_get_tgt_start(req, srv);
+}
+
+static void sdap_get_tgt_persistent_fail(struct tevent_req *req,
+                                         errno_t ret)
+{
+    struct sdap_get_tgt_state *state = tevent_req_data(req,
+                                                  struct sdap_get_tgt_state);
+
+    talloc_zfree(state->timeout_te);
+
+    /* the pipe might be out of sync, start over with a new child */
+    if (state->server != NULL) {
+        sdap_child_server_retire(state->server);
+    }
+
+    tevent_req_error(req, ret);
+}
+
+static void sdap_get_tgt_persistent_step(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct sdap_get_tgt_state *state = tevent_req_data(req,
+                                                  struct sdap_get_tgt_state);
+    int ret;
+
+    ret = write_pipe_recv(subreq);
+    talloc_zfree(subreq);
+    state->subreq = NULL;
+    if (ret != EOK) {
+        sdap_get_tgt_persistent_fail(req, ret);
+        return;
+    }
+
+    subreq = sdap_child_read_msg_send(state, state->ev,
+                            state->server->child->io->read_from_child_fd);
+    if (subreq == NULL) {
+        sdap_get_tgt_persistent_fail(req, ENOMEM);
+        return;
+    }
+    tevent_req_set_callback(subreq, sdap_get_tgt_persistent_done, req);
+    state->subreq = subreq;
+}
+
+static void sdap_get_tgt_persistent_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct sdap_get_tgt_state *state = tevent_req_data(req,
+                                                  struct sdap_get_tgt_state);
+    struct sdap_child_server *srv;
+    uint32_t res = EINVAL;
+    size_t p = 0;
+    int ret;
+
+    ret = sdap_child_read_msg_recv(subreq, state, &state->buf, &state->len);
+    talloc_zfree(subreq);
+    state->subreq = NULL;
+    if (ret != EOK) {
+        sdap_get_tgt_persistent_fail(req, ret);
+        return;
+    }
+
+    talloc_zfree(state->timeout_te);
+    srv = state->server;
+    state->server = NULL;
+
+    if (state->len >= sizeof(uint32_t)) {
+        SAFEALIGN_COPY_UINT32(&res, state->buf, &p);
+    }
+
+    /* A failure might be caused by a changed keytab, the child only has
+     * the copy it read for its first request */
+    if (res != EOK) {
+        sdap_child_server_retire(srv);
+    } else {
+        sdap_child_server_release(srv);
+    }
+
+    tevent_req_done(req);
+}
+
 int sdap_get_tgt_recv(struct tevent_req *req,
                       TALLOC_CTX *mem_ctx,
                       int  *result,
@@ -423,6 +1032,17 @@ static void get_tgt_timeout_handler(struct tevent_context *ev,
                                             struct sdap_get_tgt_state);
     int ret;
 
+    state->timeout_te = NULL;
+
+    if (state->server != NULL) {
+        DEBUG(SSSDBG_TRACE_ALL, "timeout for persistent tgt child [%d] "
+              "reached.\n", state->server->child->pid);
+
+        sdap_child_server_retire(state->server);
+        tevent_req_error(req, ETIMEDOUT);
+        return;
+    }
+
     DEBUG(SSSDBG_TRACE_ALL,
           "timeout for tgt child [%d] reached.\n", state->child->pid);
 
@@ -439,7 +1059,8 @@ static errno_t set_tgt_child_timeout(struct tevent_req *req,
                                      struct tevent_context *ev,
                                      int timeout)
 {
-    struct tevent_timer *te;
+    struct sdap_get_tgt_state *state = tevent_req_data(req,
+                                            struct sdap_get_tgt_state);
     struct timeval tv;
 
     DEBUG(SSSDBG_TRACE_FUNC,
@@ -447,8 +1068,9 @@ static errno_t set_tgt_child_timeout(struct tevent_req *req,
 
     tv = tevent_timeval_current_ofs(timeout, 0);
 
-    te = tevent_add_timer(ev, req, tv, get_tgt_timeout_handler, req);
-    if (te == NULL) {
+    state->timeout_te = tevent_add_timer(ev, req, tv,
+                                         get_tgt_timeout_handler, req);
+    if (state->timeout_te == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
         return ENOMEM;
     }
@@ -81,6 +81,54 @@ static int remove_connection_callback(TALLOC_CTX *mem_ctx)
     return EOK;
 }
 
+/* A sockbuf layer right above the socket counts the bytes the server sent,
+ * including the TLS overhead */
+static int sdap_sbio_count_setup(Sockbuf_IO_Desc *sbiod, void *arg)
+{
+    sbiod->sbiod_pvt = arg;
+    return 0;
+}
+
+static int sdap_sbio_count_remove(Sockbuf_IO_Desc *sbiod)
+{
+    sbiod->sbiod_pvt = NULL;
+    return 0;
+}
+
+static int sdap_sbio_count_ctrl(Sockbuf_IO_Desc *sbiod, int opt, void *arg)
+{
+    return LBER_SBIOD_CTRL_NEXT(sbiod, opt, arg);
+}
+
+static ber_slen_t sdap_sbio_count_read(Sockbuf_IO_Desc *sbiod,
+                                       void *buf, ber_len_t len)
+{
+    struct sdap_handle *sh = sbiod->sbiod_pvt;
+    ber_slen_t ret;
+
+    ret = LBER_SBIOD_READ_NEXT(sbiod, buf, len);
+    if (ret > 0 && sh != NULL) {
+        sh->stats.bytes_read += ret;
+    }
+
+    return ret;
+}
+
+static ber_slen_t sdap_sbio_count_write(Sockbuf_IO_Desc *sbiod,
+                                        void *buf, ber_len_t len)
+{
+    return LBER_SBIOD_WRITE_NEXT(sbiod, buf, len);
+}
+
+static Sockbuf_IO sdap_sbio_count = {
+    .sbi_setup = sdap_sbio_count_setup,
+    .sbi_remove = sdap_sbio_count_remove,
+    .sbi_ctrl = sdap_sbio_count_ctrl,
+    .sbi_read = sdap_sbio_count_read,
+    .sbi_write = sdap_sbio_count_write,
+    .sbi_close = NULL,
+};
+
 static int sdap_ldap_connect_callback_add(LDAP *ld, Sockbuf *sb,
                                           LDAPURLDesc *srv,
                                           struct sockaddr *addr,
@@ -130,6 +178,13 @@ static int sdap_ldap_connect_callback_add(LDAP *ld, Sockbuf *sb,
 
     DLIST_ADD(cb_data->fd_list, fd_event_item);
 
+    ret = ber_sockbuf_add_io(sb, &sdap_sbio_count, LBER_SBIOD_LEVEL_PROVIDER,
+                             cb_data->sh);
+    if (ret != 0) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot count the bytes read from "
+              "fd [%d].\n", ber_fd);
+    }
+
     return LDAP_SUCCESS;
 }
 
@@ -32,8 +32,10 @@ struct sdap_id_conn_cache {
 
     /* list of all open connections */
     struct sdap_id_conn_data *connections;
-    /* cached (current) connection */
-    struct sdap_id_conn_data *cached_connection;
+    /* number of connections new operations can be assigned to */
+    int num_pooled;
+    /* number of connections closed so far, by the reason */
+    uint64_t ended[SDAP_END_NUM];
 };
 
 /* LDAP async operation tracker:
@@ -72,10 +74,19 @@ struct sdap_id_conn_data {
     int notify_lock;
     /* list of operations using connect */
     struct sdap_id_op *ops;
+    /* number of operations in the list */
+    int num_ops;
     /* A flag which is signalizing that this
      * connection will be disconnected and should
      * not be used any more */
     bool disconnecting;
+    /* new operations can be assigned to the connection */
+    bool pooled;
+    /* timer closing the connection after it was unused for a while */
+    struct tevent_timer *idle_timer;
+    /* timer and search checking an unused connection */
+    struct tevent_timer *keepalive_timer;
+    struct tevent_req *keepalive_req;
 };
 
 static void sdap_id_conn_cache_be_offline_cb(void *pvt);
@@ -90,6 +101,9 @@ static void sdap_id_conn_data_expire_handler(struct tevent_context *ev,
                                              struct timeval current_time,
                                              void *pvt);
 static int sdap_id_conn_data_set_expire_timer(struct sdap_id_conn_data *conn_data);
+static void sdap_id_conn_data_set_idle_timer(struct sdap_id_conn_data *conn_data);
+static void sdap_id_conn_data_set_keepalive_timer(struct sdap_id_conn_data *conn_data);
+static void sdap_id_conn_warmup(struct sdap_id_conn_cache *conn_cache);
 
 static void sdap_id_op_hook_conn_data(struct sdap_id_op *op, struct sdap_id_conn_data *conn_data);
 static int sdap_id_op_destroy(void *pvt);
@@ -140,16 +154,124 @@ fail:
     return ret;
 }
 
+static int sdap_id_conn_pool_size(struct sdap_id_conn_cache *conn_cache)
+{
+    int size;
+
+    size = dp_opt_get_int(conn_cache->id_conn->id_ctx->opts->basic,
+                          SDAP_CONN_POOL_SIZE);
+    return size < 1 ? 1 : size;
+}
+
+static void sdap_id_conn_pool_add(struct sdap_id_conn_data *conn_data)
+{
+    if (!conn_data->pooled) {
+        conn_data->pooled = true;
+        conn_data->conn_cache->num_pooled++;
+    }
+}
+
+static void sdap_id_conn_data_set_end(struct sdap_id_conn_data *conn_data,
+                                      enum sdap_handle_end end)
+{
+    if (conn_data->sh != NULL) {
+        sdap_handle_set_end(conn_data->sh, end);
+    }
+}
+
+/* Stop assigning new operations to the connection, the caller releases it */
+static void sdap_id_conn_pool_remove(struct sdap_id_conn_data *conn_data)
+{
+    if (conn_data->pooled) {
+        conn_data->pooled = false;
+        conn_data->conn_cache->num_pooled--;
+    }
+}
+
+/* Check whether another established connection is in the pool */
+static bool sdap_id_conn_pool_is_connected(struct sdap_id_conn_cache *conn_cache,
+                                           struct sdap_id_conn_data *except)
+{
+    struct sdap_id_conn_data *conn_data;
+
+    DLIST_FOR_EACH(conn_data, conn_cache->connections) {
+        if (conn_data != except && conn_data->pooled
+                && conn_data->connect_req == NULL
+                && conn_data->sh != NULL && conn_data->sh->connected) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int sdap_id_conn_cache_release(struct sdap_id_conn_cache *conn_cache)
+{
+    struct sdap_id_conn_data *conn_data;
+    struct sdap_id_conn_data *next;
+    int released = 0;
+
+    for (conn_data = conn_cache->connections; conn_data; conn_data = next) {
+        next = conn_data->next;
+        if (conn_data->pooled) {
+            sdap_id_conn_pool_remove(conn_data);
+            sdap_id_release_conn_data(conn_data);
+            released++;
+        }
+    }
+
+    return released;
+}
+
+/* Give up a connection which is still being set up, the operations waiting
+ * for it are told that the back end is offline */
+static void sdap_id_conn_data_abort(struct sdap_id_conn_data *conn_data)
+{
+    struct sdap_id_op *op;
+
+    talloc_zfree(conn_data->connect_req);
+
+    conn_data->notify_lock++;
+    sdap_id_conn_pool_remove(conn_data);
+
+    for (;;) {
+        DLIST_FOR_EACH(op, conn_data->ops) {
+            if (op->connect_req) {
+                break;
+            }
+        }
+
+        if (!op) {
+            break;
+        }
+
+        sdap_id_op_connect_req_complete(op, DP_ERR_OFFLINE, EAGAIN);
+    }
+
+    conn_data->notify_lock--;
+    sdap_id_release_conn_data(conn_data);
+}
+
 /* Callback on BE going offline */
 static void sdap_id_conn_cache_be_offline_cb(void *pvt)
 {
     struct sdap_id_conn_cache *conn_cache = talloc_get_type(pvt, struct sdap_id_conn_cache);
-    struct sdap_id_conn_data *cached_connection = conn_cache->cached_connection;
+    struct sdap_id_conn_data *conn_data;
+    struct sdap_id_conn_data *next;
+
+    DLIST_FOR_EACH(conn_data, conn_cache->connections) {
+        sdap_id_conn_data_set_end(conn_data, SDAP_END_OFFLINE);
+    }
 
     /* Release any cached connection on going offline */
-    if (cached_connection != NULL) {
-        conn_cache->cached_connection = NULL;
-        sdap_id_release_conn_data(cached_connection);
+    sdap_id_conn_cache_release(conn_cache);
+
+    /* and do not wait for the network timeouts of those being set up */
+    for (conn_data = conn_cache->connections; conn_data; conn_data = next) {
+        next = conn_data->next;
+        if (conn_data->connect_req != NULL) {
+            sdap_id_conn_data_abort(conn_data);
+        }
     }
 }
 
@@ -157,11 +279,14 @@ static void sdap_id_conn_cache_be_offline_cb(void *pvt)
 static void sdap_id_conn_cache_fo_reconnect_cb(void *pvt)
 {
     struct sdap_id_conn_cache *conn_cache = talloc_get_type(pvt, struct sdap_id_conn_cache);
-    struct sdap_id_conn_data *cached_connection = conn_cache->cached_connection;
+    struct sdap_id_conn_data *conn_data;
 
     /* Release any cached connection on going offline */
-    if (cached_connection != NULL) {
-        cached_connection->disconnecting = true;
+    DLIST_FOR_EACH(conn_data, conn_cache->connections) {
+        if (conn_data->pooled) {
+            sdap_id_conn_data_set_end(conn_data, SDAP_END_FAILBACK);
+            conn_data->disconnecting = true;
+        }
     }
 }
 
@@ -175,12 +300,20 @@ static void sdap_id_release_conn_data(struct sdap_id_conn_data *conn_data)
     }
 
     conn_cache = conn_data->conn_cache;
-    if (conn_data == conn_cache->cached_connection) {
+    if (conn_data->pooled) {
+        sdap_id_conn_data_set_idle_timer(conn_data);
+        sdap_id_conn_data_set_keepalive_timer(conn_data);
         return;
     }
 
     DEBUG(SSSDBG_TRACE_ALL, "releasing unused connection\n");
 
+    if (conn_data->sh != NULL) {
+        conn_cache->ended[conn_data->sh->stats.end]++;
+        sdap_handle_log_stats(conn_data->sh, SSSDBG_FUNC_DATA,
+                              conn_cache->id_conn->service->uri);
+    }
+
     DLIST_REMOVE(conn_cache->connections, conn_data);
     talloc_zfree(conn_data);
 }
@@ -275,18 +408,173 @@ static void sdap_id_conn_data_expire_handler(struct tevent_context *ev,
 {
     struct sdap_id_conn_data *conn_data = talloc_get_type(pvt,
                                                           struct sdap_id_conn_data);
-    struct sdap_id_conn_cache *conn_cache = conn_data->conn_cache;
 
     DEBUG(SSSDBG_MINOR_FAILURE,
           "connection is about to expire, releasing it\n");
 
-    if (conn_cache->cached_connection == conn_data) {
-        conn_cache->cached_connection = NULL;
+    if (conn_data->pooled) {
+        sdap_id_conn_data_set_end(conn_data, SDAP_END_EXPIRED);
+        sdap_id_conn_pool_remove(conn_data);
 
         sdap_id_release_conn_data(conn_data);
     }
 }
 
+static void sdap_id_conn_data_idle_handler(struct tevent_context *ev,
+                                           struct tevent_timer *te,
+                                           struct timeval current_time,
+                                           void *pvt)
+{
+    struct sdap_id_conn_data *conn_data = talloc_get_type(pvt,
+                                                          struct sdap_id_conn_data);
+    struct sdap_id_conn_cache *conn_cache = conn_data->conn_cache;
+    int pool_min;
+
+    conn_data->idle_timer = NULL;
+
+    pool_min = dp_opt_get_int(conn_cache->id_conn->id_ctx->opts->basic,
+                              SDAP_CONN_POOL_MIN);
+    if (!conn_data->pooled || conn_data->ops || conn_data->notify_lock
+            || conn_cache->num_pooled <= pool_min) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "closing idle connection\n");
+
+    sdap_id_conn_data_set_end(conn_data, SDAP_END_IDLE);
+    sdap_id_conn_pool_remove(conn_data);
+    sdap_id_release_conn_data(conn_data);
+}
+
+/* Close an unused connection after a while if the pool has more than the
+ * minimal number of connections */
+static void sdap_id_conn_data_set_idle_timer(struct sdap_id_conn_data *conn_data)
+{
+    struct sdap_id_conn_cache *conn_cache = conn_data->conn_cache;
+    struct timeval tv;
+    int pool_min;
+    int timeout;
+
+    pool_min = dp_opt_get_int(conn_cache->id_conn->id_ctx->opts->basic,
+                              SDAP_CONN_POOL_MIN);
+    timeout = dp_opt_get_int(conn_cache->id_conn->id_ctx->opts->basic,
+                             SDAP_CONN_POOL_IDLE_TIMEOUT);
+    if (conn_data->connect_req || timeout <= 0
+            || conn_cache->num_pooled <= pool_min) {
+        return;
+    }
+
+    talloc_zfree(conn_data->idle_timer);
+
+    tv = tevent_timeval_current_ofs(timeout, 0);
+    conn_data->idle_timer =
+              tevent_add_timer(conn_cache->id_conn->id_ctx->be->ev,
+                               conn_data, tv,
+                               sdap_id_conn_data_idle_handler,
+                               conn_data);
+    if (!conn_data->idle_timer) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot set the idle timer\n");
+    }
+}
+
+static void sdap_id_conn_data_keepalive_done(struct tevent_req *subreq);
+
+/* Reads the rootDSE over the unused connection, the middle boxes see it is
+ * in use and a connection which they dropped is noticed before an operation
+ * would wait for it */
+static void sdap_id_conn_data_keepalive_handler(struct tevent_context *ev,
+                                                struct tevent_timer *te,
+                                                struct timeval current_time,
+                                                void *pvt)
+{
+    struct sdap_id_conn_data *conn_data = talloc_get_type(pvt,
+                                                          struct sdap_id_conn_data);
+    struct sdap_options *opts = conn_data->conn_cache->id_conn->id_ctx->opts;
+    const char *attrs[] = { "supportedLDAPVersion", NULL };
+
+    conn_data->keepalive_timer = NULL;
+
+    if (!sdap_can_reuse_connection(conn_data) || conn_data->keepalive_req) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_ALL, "checking unused connection\n");
+
+    conn_data->keepalive_req = sdap_get_generic_send(conn_data, ev, opts,
+                                                     conn_data->sh, "",
+                                                     LDAP_SCOPE_BASE,
+                                                     "(objectclass=*)", attrs,
+                                                     NULL, 0,
+                                                     dp_opt_get_int(opts->basic,
+                                                                    SDAP_OPT_TIMEOUT),
+                                                     false);
+    if (conn_data->keepalive_req == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot check the unused connection\n");
+        return;
+    }
+
+    tevent_req_set_callback(conn_data->keepalive_req,
+                            sdap_id_conn_data_keepalive_done, conn_data);
+}
+
+static void sdap_id_conn_data_keepalive_done(struct tevent_req *subreq)
+{
+    struct sdap_id_conn_data *conn_data = tevent_req_callback_data(subreq,
+                                                struct sdap_id_conn_data);
+    struct sdap_id_conn_cache *conn_cache = conn_data->conn_cache;
+    struct sysdb_attrs **reply;
+    size_t count;
+    int ret;
+
+    ret = sdap_get_generic_recv(subreq, subreq, &count, &reply);
+    talloc_zfree(subreq);
+    conn_data->keepalive_req = NULL;
+
+    if (ret == EOK) {
+        if (conn_data->ops == NULL) {
+            sdap_id_conn_data_set_keepalive_timer(conn_data);
+        }
+        return;
+    }
+
+    DEBUG(SSSDBG_MINOR_FAILURE, "unused connection does not answer "
+          "[%d]: %s, replacing it\n", ret, sss_strerror(ret));
+
+    /* operations which use it by now see the failure themselves */
+    sdap_id_conn_data_set_end(conn_data, SDAP_END_KEEPALIVE);
+    conn_data->disconnecting = true;
+    sdap_id_conn_pool_remove(conn_data);
+    sdap_id_release_conn_data(conn_data);
+
+    sdap_id_conn_warmup(conn_cache);
+}
+
+/* Check an unused connection every ldap_connection_keepalive seconds */
+static void sdap_id_conn_data_set_keepalive_timer(struct sdap_id_conn_data *conn_data)
+{
+    struct sdap_id_conn_cache *conn_cache = conn_data->conn_cache;
+    struct timeval tv;
+    int interval;
+
+    interval = dp_opt_get_int(conn_cache->id_conn->id_ctx->opts->basic,
+                              SDAP_CONNECTION_KEEPALIVE);
+    if (conn_data->connect_req || interval <= 0) {
+        return;
+    }
+
+    talloc_zfree(conn_data->keepalive_timer);
+
+    tv = tevent_timeval_current_ofs(interval, 0);
+    conn_data->keepalive_timer =
+              tevent_add_timer(conn_cache->id_conn->id_ctx->be->ev,
+                               conn_data, tv,
+                               sdap_id_conn_data_keepalive_handler,
+                               conn_data);
+    if (!conn_data->keepalive_timer) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot set the keepalive timer\n");
+    }
+}
+
 /* Create an operation object */
 struct sdap_id_op *sdap_id_op_create(TALLOC_CTX *memctx, struct sdap_id_conn_cache *conn_cache)
 {
@@ -316,12 +604,16 @@ static void sdap_id_op_hook_conn_data(struct sdap_id_op *op, struct sdap_id_conn
 
     if (current) {
         DLIST_REMOVE(current->ops, op);
+        current->num_ops--;
     }
 
     op->conn_data = conn_data;
 
     if (conn_data) {
         DLIST_ADD_END(conn_data->ops, op, struct sdap_id_op*);
+        conn_data->num_ops++;
+        talloc_zfree(conn_data->idle_timer);
+        talloc_zfree(conn_data->keepalive_timer);
     }
 
     if (current) {
@@ -458,26 +750,53 @@ static int sdap_id_op_connect_step(struct tevent_req *req)
 
     int ret = EOK;
     struct sdap_id_conn_data *conn_data;
+    struct sdap_id_conn_data *next;
+    struct sdap_id_conn_data *least_used = NULL;
+    struct sdap_id_conn_data *connecting = NULL;
     struct tevent_req *subreq = NULL;
 
-    /* Try to reuse context cached connection */
-    conn_data = conn_cache->cached_connection;
-    if (conn_data) {
+    /* Try to reuse a cached connection, an unused one first, then one which
+     * is being established. A new connection is only opened when all the
+     * connections in the pool are busy and the pool is not full. */
+    for (conn_data = conn_cache->connections; conn_data; conn_data = next) {
+        next = conn_data->next;
+        if (!conn_data->pooled) {
+            continue;
+        }
+
         if (conn_data->connect_req) {
-            DEBUG(SSSDBG_TRACE_ALL, "waiting for connection to complete\n");
-            sdap_id_op_hook_conn_data(op, conn_data);
-            goto done;
+            if (connecting == NULL) {
+                connecting = conn_data;
+            }
+        } else if (!sdap_can_reuse_connection(conn_data)) {
+            DEBUG(SSSDBG_TRACE_ALL, "releasing expired cached connection\n");
+            sdap_id_conn_pool_remove(conn_data);
+            sdap_id_release_conn_data(conn_data);
+            continue;
         }
 
-        if (sdap_can_reuse_connection(conn_data)) {
-            DEBUG(SSSDBG_TRACE_ALL, "reusing cached connection\n");
-            sdap_id_op_hook_conn_data(op, conn_data);
-            goto done;
+        if (least_used == NULL || conn_data->num_ops < least_used->num_ops) {
+            least_used = conn_data;
         }
+    }
 
-        DEBUG(SSSDBG_TRACE_ALL, "releasing expired cached connection\n");
-        conn_cache->cached_connection = NULL;
-        sdap_id_release_conn_data(conn_data);
+    if (least_used != NULL && least_used->num_ops > 0) {
+        if (connecting != NULL) {
+            least_used = connecting;
+        } else if (conn_cache->num_pooled < sdap_id_conn_pool_size(conn_cache)) {
+            least_used = NULL;
+        }
+    }
+
+    if (least_used != NULL) {
+        if (least_used->connect_req) {
+            DEBUG(SSSDBG_TRACE_ALL, "waiting for connection to complete\n");
+        } else {
+            DEBUG(SSSDBG_TRACE_ALL, "reusing cached connection\n");
+        }
+        sdap_id_op_hook_conn_data(op, least_used);
+        conn_data = NULL;
+        goto done;
     }
 
     DEBUG(SSSDBG_TRACE_ALL, "beginning to connect\n");
@@ -506,7 +825,7 @@ static int sdap_id_op_connect_step(struct tevent_req *req)
     conn_data->connect_req = subreq;
 
     DLIST_ADD(conn_cache->connections, conn_data);
-    conn_cache->cached_connection = conn_data;
+    sdap_id_conn_pool_add(conn_data);
 
     sdap_id_op_hook_conn_data(op, conn_data);
 
@@ -643,9 +962,7 @@ static void sdap_id_op_connect_done(struct tevent_req *subreq)
             bool retry = false;
 
             /* drop connection from cache now */
-            if (conn_cache->cached_connection == conn_data) {
-                conn_cache->cached_connection = NULL;
-            }
+            sdap_id_conn_pool_remove(conn_data);
 
             if (can_retry) {
                 /* determining whether retry is possible */
@@ -708,16 +1025,19 @@ static void sdap_id_op_connect_done(struct tevent_req *subreq)
         !be_is_offline(conn_cache->id_conn->id_ctx->be)) {
         DEBUG(SSSDBG_TRACE_ALL,
               "caching successful connection after %d notifies\n", notify_count);
-        conn_cache->cached_connection = conn_data;
+        sdap_id_conn_pool_add(conn_data);
 
-        /* Run any post-connection routines */
-        be_run_unconditional_online_cb(conn_cache->id_conn->id_ctx->be);
-        be_run_online_cb(conn_cache->id_conn->id_ctx->be);
+        /* Run any post-connection routines, the additional connections
+         * of the pool go to a server which is already known to be online */
+        if (!sdap_id_conn_pool_is_connected(conn_cache, conn_data)) {
+            be_run_unconditional_online_cb(conn_cache->id_conn->id_ctx->be);
+            be_run_online_cb(conn_cache->id_conn->id_ctx->be);
+        }
 
+        /* the notified operations may have finished already */
+        sdap_id_release_conn_data(conn_data);
     } else {
-        if (conn_cache->cached_connection == conn_data) {
-            conn_cache->cached_connection = NULL;
-        }
+        sdap_id_conn_pool_remove(conn_data);
 
         sdap_id_release_conn_data(conn_data);
     }
@@ -819,10 +1139,14 @@ int sdap_id_op_done(struct sdap_id_op *op, int retval, int *dp_err_out)
             break;
     }
 
-    if (communication_error && current_conn != 0
-            && current_conn == op->conn_cache->cached_connection) {
+    if (communication_error && current_conn != 0 && current_conn->pooled
+            && !current_conn->disconnecting) {
         /* do not reuse failed connection */
-        op->conn_cache->cached_connection = NULL;
+        sdap_id_conn_data_set_end(current_conn, SDAP_END_ERROR);
+        sdap_id_conn_pool_remove(current_conn);
+
+        /* the other connections of the pool go to the same server */
+        sdap_id_conn_cache_fo_reconnect_cb(op->conn_cache);
 
         DEBUG(SSSDBG_FUNC_DATA,
               "communication error on cached connection, moving to next server\n");
@@ -877,3 +1201,265 @@ struct sdap_handle *sdap_id_op_handle(struct sdap_id_op *op)
 {
     return op && op->conn_data ? op->conn_data->sh : NULL;
 }
+
+/* Connection warm-up: the first lookup after the start or after going
+ * online would otherwise wait for the server resolution, the connect, TLS,
+ * the bind and the rootDSE. The established connection stays in the pool
+ * for the following operations. */
+static void sdap_id_conn_warmup_done(struct tevent_req *subreq);
+
+static void sdap_id_conn_warmup(struct sdap_id_conn_cache *conn_cache)
+{
+    struct sdap_id_conn_ctx *id_conn = conn_cache->id_conn;
+    struct tevent_req *subreq;
+    struct sdap_id_op *op;
+    int ret;
+
+    if (be_is_offline(id_conn->id_ctx->be) || conn_cache->connections) {
+        /* a connection is already there or being established */
+        return;
+    }
+
+    op = sdap_id_op_create(conn_cache, conn_cache);
+    if (op == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "sdap_id_op_create failed\n");
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Connecting to %s in advance\n",
+          id_conn->service->name);
+
+    subreq = sdap_id_op_connect_send(op, op, &ret);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "sdap_id_op_connect_send failed: "
+              "%d [%s]\n", ret, sss_strerror(ret));
+        talloc_free(op);
+        return;
+    }
+
+    tevent_req_set_callback(subreq, sdap_id_conn_warmup_done, op);
+}
+
+static void sdap_id_conn_warmup_done(struct tevent_req *subreq)
+{
+    struct sdap_id_op *op = tevent_req_callback_data(subreq,
+                                                     struct sdap_id_op);
+    int dp_error;
+    int ret;
+
+    ret = sdap_id_op_connect_recv(subreq, &dp_error);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Cannot connect to %s in advance: "
+              "%d [%s]\n", op->conn_cache->id_conn->service->name,
+              ret, sss_strerror(ret));
+    }
+
+    /* releasing the operation keeps the connection in the pool */
+    talloc_free(op);
+}
+
+static void sdap_id_conn_warmup_online_cb(void *pvt)
+{
+    struct sdap_id_conn_cache *conn_cache;
+
+    conn_cache = talloc_get_type(pvt, struct sdap_id_conn_cache);
+    sdap_id_conn_warmup(conn_cache);
+}
+
+static void sdap_id_conn_warmup_handler(struct tevent_context *ev,
+                                        struct tevent_timer *te,
+                                        struct timeval current_time,
+                                        void *pvt)
+{
+    struct sdap_id_conn_cache *conn_cache;
+
+    conn_cache = talloc_get_type(pvt, struct sdap_id_conn_cache);
+    sdap_id_conn_warmup(conn_cache);
+}
+
+static void sdap_id_conn_unreachable_cb(void *pvt)
+{
+    struct sdap_id_conn_ctx *id_conn;
+    struct be_ctx *be;
+
+    id_conn = talloc_get_type(pvt, struct sdap_id_conn_ctx);
+    be = id_conn->id_ctx->be;
+
+    if (id_conn->ignore_mark_offline || be_is_offline(be)) {
+        return;
+    }
+
+    DEBUG(SSSDBG_OP_FAILURE, "No server of %s can be reached, "
+          "going offline\n", id_conn->service->name);
+    be_mark_offline(be);
+}
+
+errno_t sdap_id_conn_offline_probe_setup(struct sdap_id_conn_ctx *id_conn)
+{
+    errno_t ret;
+
+    ret = be_fo_set_unreachable_probe(id_conn->id_ctx->be,
+                                      id_conn->service->name,
+                                      sdap_id_conn_unreachable_cb, id_conn);
+    if (ret == EEXIST) {
+        /* another connection uses the same service */
+        return EOK;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot probe the servers of %s "
+              "[%d]: %s\n", id_conn->service->name, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
+static struct tevent_req *
+sdap_id_conn_server_probe_send(TALLOC_CTX *mem_ctx,
+                               struct tevent_context *ev,
+                               struct be_ctx *be_ctx,
+                               struct be_ptask *be_ptask,
+                               void *pvt)
+{
+    struct sdap_id_conn_ctx *id_conn;
+
+    id_conn = talloc_get_type(pvt, struct sdap_id_conn_ctx);
+
+    return sdap_server_probe_send(mem_ctx, ev, be_ctx, id_conn->id_ctx->opts,
+                                  id_conn->service);
+}
+
+static errno_t sdap_id_conn_server_probe_recv(struct tevent_req *req)
+{
+    return sdap_server_probe_recv(req);
+}
+
+errno_t sdap_id_conn_server_probe_setup(struct sdap_id_conn_ctx *id_conn)
+{
+    struct be_ctx *be = id_conn->id_ctx->be;
+    const char *name;
+    time_t period;
+    errno_t ret;
+
+    period = dp_opt_get_int(id_conn->id_ctx->opts->basic,
+                            SDAP_SERVER_PROBE_INTERVAL);
+    if (period <= 0) {
+        return EOK;
+    }
+
+    name = talloc_asprintf(id_conn, "Server probe of %s",
+                           id_conn->service->name);
+    if (name == NULL) {
+        return ENOMEM;
+    }
+
+    ret = be_ptask_create(id_conn, be, period, period,
+                          0 /* enabled delay */, period / 10 /* random offset */,
+                          period /* timeout */, BE_PTASK_OFFLINE_SKIP, 0,
+                          sdap_id_conn_server_probe_send,
+                          sdap_id_conn_server_probe_recv,
+                          id_conn, name, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot probe the servers of %s "
+              "[%d]: %s\n", id_conn->service->name, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
+static errno_t sdap_id_conn_stats_log(TALLOC_CTX *mem_ctx,
+                                      struct tevent_context *ev,
+                                      struct be_ctx *be_ctx,
+                                      struct be_ptask *be_ptask,
+                                      void *pvt)
+{
+    struct sdap_id_conn_cache *conn_cache;
+    struct sdap_id_conn_data *conn_data;
+    const char *uri;
+    uint64_t *ended;
+
+    conn_cache = talloc_get_type(pvt, struct sdap_id_conn_cache);
+    uri = conn_cache->id_conn->service->uri;
+    ended = conn_cache->ended;
+
+    DLIST_FOR_EACH(conn_data, conn_cache->connections) {
+        if (conn_data->sh != NULL && conn_data->sh->connected) {
+            sdap_handle_log_stats(conn_data->sh, SSSDBG_IMPORTANT_INFO, uri);
+        }
+    }
+
+    DEBUG(SSSDBG_IMPORTANT_INFO, "Connections of %s closed (error/expired/"
+          "idle/keepalive/offline/reconnect/other): %"PRIu64"/%"PRIu64"/"
+          "%"PRIu64"/%"PRIu64"/%"PRIu64"/%"PRIu64"/%"PRIu64"\n",
+          conn_cache->id_conn->service->name,
+          ended[SDAP_END_ERROR], ended[SDAP_END_EXPIRED],
+          ended[SDAP_END_IDLE], ended[SDAP_END_KEEPALIVE],
+          ended[SDAP_END_OFFLINE], ended[SDAP_END_FAILBACK],
+          ended[SDAP_END_NONE]);
+
+    return EOK;
+}
+
+errno_t sdap_id_conn_stats_setup(struct sdap_id_conn_ctx *id_conn)
+{
+    const char *name;
+    time_t period;
+    errno_t ret;
+
+    period = dp_opt_get_int(id_conn->id_ctx->opts->basic,
+                            SDAP_CONNECTION_STATS_INTERVAL);
+    if (period <= 0) {
+        return EOK;
+    }
+
+    name = talloc_asprintf(id_conn, "Connection statistics of %s",
+                           id_conn->service->name);
+    if (name == NULL) {
+        return ENOMEM;
+    }
+
+    ret = be_ptask_create_sync(id_conn, id_conn->id_ctx->be, period, period,
+                               0 /* enabled delay */, 0 /* random offset */,
+                               period /* timeout */, BE_PTASK_OFFLINE_EXECUTE,
+                               0, sdap_id_conn_stats_log, id_conn->conn_cache,
+                               name, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot log the statistics of %s "
+              "[%d]: %s\n", id_conn->service->name, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
+errno_t sdap_id_conn_warmup_setup(struct sdap_id_conn_ctx *id_conn)
+{
+    struct sdap_id_conn_cache *conn_cache = id_conn->conn_cache;
+    struct be_ctx *be = id_conn->id_ctx->be;
+    struct tevent_timer *te;
+    errno_t ret;
+
+    if (!dp_opt_get_bool(id_conn->id_ctx->opts->basic,
+                         SDAP_CONNECTION_WARMUP)) {
+        return EOK;
+    }
+
+    ret = be_add_online_cb(conn_cache, be, sdap_id_conn_warmup_online_cb,
+                           conn_cache, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "be_add_online_cb failed.\n");
+        return ret;
+    }
+
+    /* the connections of all services are set up in parallel once the
+     * back end enters the main loop */
+    te = tevent_add_timer(be->ev, conn_cache, tevent_timeval_current_ofs(0, 0),
+                          sdap_id_conn_warmup_handler, conn_cache);
+    if (te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot schedule the connection warm-up\n");
+        return ENOMEM;
+    }
+
+    return EOK;
+}
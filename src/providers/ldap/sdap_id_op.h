@@ -41,6 +41,27 @@ int sdap_id_conn_cache_create(TALLOC_CTX *memctx,
                               struct sdap_id_conn_ctx *id_conn,
                               struct sdap_id_conn_cache** conn_cache_out);
 
+/* Connect the connection of id_conn in advance, as soon as the back end
+ * runs and whenever it goes online, if ldap_connection_warmup is set */
+errno_t sdap_id_conn_warmup_setup(struct sdap_id_conn_ctx *id_conn);
+
+/* Go offline right away when a server of id_conn failed or did not answer
+ * within offline_probe_timeout and none of the servers can be reached */
+errno_t sdap_id_conn_offline_probe_setup(struct sdap_id_conn_ctx *id_conn);
+
+/* Connect to the standby servers of id_conn every
+ * ldap_server_probe_interval seconds so that the fail over code knows which
+ * of them work again, see sdap_server_probe_send() */
+errno_t sdap_id_conn_server_probe_setup(struct sdap_id_conn_ctx *id_conn);
+
+/* Write the statistics of the connections of id_conn to the debug log
+ * every ldap_connection_stats_interval seconds */
+errno_t sdap_id_conn_stats_setup(struct sdap_id_conn_ctx *id_conn);
+
+/* Close all connections of the cache once their operations are finished,
+ * returns the number of connections which were open */
+int sdap_id_conn_cache_release(struct sdap_id_conn_cache *conn_cache);
+
 /* Create an operation object */
 struct sdap_id_op *sdap_id_op_create(TALLOC_CTX *memctx, struct sdap_id_conn_cache *cache);
 
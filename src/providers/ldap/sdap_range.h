@@ -25,6 +25,10 @@
 
 #include "src/util/util.h"
 
+/* Lists the descriptions of the attributes whose values were returned only
+ * partially, e.g. "member;range=0-1499" */
+#define SDAP_RANGED_ATTRS "sdapRangedAttributes"
+
 errno_t sdap_parse_range(TALLOC_CTX *mem_ctx,
                          const char *attr_desc,
                          char **base_attr,
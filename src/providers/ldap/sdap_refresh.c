@@ -23,6 +23,7 @@
 
 #include "providers/ldap/sdap.h"
 #include "providers/ldap/ldap_common.h"
+#include "providers/ldap/sdap_async.h"
 
 struct sdap_refresh_state {
     struct tevent_context *ev;
@@ -57,6 +58,8 @@ static struct tevent_req *sdap_refresh_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
+    sdap_op_class_set(state, SDAP_OP_CLASS_REFRESH);
+
     if (names == NULL) {
         ret = EOK;
         goto immediately;
@@ -35,6 +35,9 @@ struct sdap_sudo_ctx {
 
     bool full_refresh_done;
 
+    /* highest modifyTimestamp seen, used when the server has no USN */
+    char *max_modstamp;
+
     bool run_hostinfo;
 };
 
@@ -49,7 +52,9 @@ int sdap_sudo_init(struct be_ctx *be_ctx,
 struct tevent_req *sdap_sudo_refresh_send(TALLOC_CTX *mem_ctx,
                                           struct sdap_sudo_ctx *sudo_ctx,
                                           const char *ldap_filter,
-                                          const char *sysdb_filter);
+                                          const char *sysdb_filter,
+                                          bool update_modstamp,
+                                          bool check_deleted);
 
 int sdap_sudo_refresh_recv(TALLOC_CTX *mem_ctx,
                            struct tevent_req *req,
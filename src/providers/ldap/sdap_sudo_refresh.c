@@ -26,6 +26,7 @@
 #include "providers/dp_ptask.h"
 #include "providers/ldap/sdap_sudo.h"
 #include "providers/ldap/sdap_sudo_shared.h"
+#include "providers/ldap/sdap_async.h"
 #include "db/sysdb_sudo.h"
 
 struct sdap_sudo_full_refresh_state {
@@ -55,6 +56,8 @@ struct tevent_req *sdap_sudo_full_refresh_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
+    sdap_op_class_set(state, SDAP_OP_CLASS_ENUM);
+
     state->sudo_ctx = sudo_ctx;
     state->id_ctx = id_ctx;
     state->sysdb = id_ctx->be->domain->sysdb;
@@ -79,7 +82,7 @@ struct tevent_req *sdap_sudo_full_refresh_send(TALLOC_CTX *mem_ctx,
     DEBUG(SSSDBG_TRACE_FUNC, "Issuing a full refresh of sudo rules\n");
 
     subreq = sdap_sudo_refresh_send(state, sudo_ctx, search_filter,
-                                    delete_filter);
+                                    delete_filter, true, false);
     if (subreq == NULL) {
         ret = ENOMEM;
         goto immediately;
@@ -167,6 +170,8 @@ struct tevent_req *sdap_sudo_smart_refresh_send(TALLOC_CTX *mem_ctx,
     struct sdap_server_opts *srv_opts = id_ctx->srv_opts;
     struct sdap_sudo_smart_refresh_state *state = NULL;
     char *search_filter = NULL;
+    char *delete_filter = NULL;
+    bool check_deleted = false;
     unsigned long usn;
     int ret;
 
@@ -176,32 +181,56 @@ struct tevent_req *sdap_sudo_smart_refresh_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
+    sdap_op_class_set(state, SDAP_OP_CLASS_REFRESH);
+
     state->id_ctx = id_ctx;
     state->sysdb = id_ctx->be->domain->sysdb;
 
-    /* Download all rules from LDAP that are newer than usn */
-    if (srv_opts == NULL || srv_opts->max_sudo_value == 0) {
-        DEBUG(SSSDBG_TRACE_FUNC, "USN value is unknown, assuming zero.\n");
-        usn = 0;
-    } else {
+    if (map[SDAP_AT_SUDO_USN].name != NULL
+            && srv_opts != NULL && srv_opts->max_sudo_value != 0) {
+        /* Download all rules from LDAP that are newer than usn */
         usn = srv_opts->max_sudo_value + 1;
+        search_filter = talloc_asprintf(state, "(&(objectclass=%s)(%s>=%lu))",
+                                        map[SDAP_OC_SUDORULE].name,
+                                        map[SDAP_AT_SUDO_USN].name, usn);
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Issuing a smart refresh of sudo rules "
+                                 "(USN > %lu)\n", usn);
+    } else if (map[SDAP_AT_SUDO_MODSTAMP].name != NULL
+            && sudo_ctx->max_modstamp != NULL) {
+        /* Download all rules that were modified since the last refresh.
+         * Deleted rules are found by comparing the names of all rules. */
+        search_filter = talloc_asprintf(state, "(&(objectclass=%s)(%s>=%s))",
+                                        map[SDAP_OC_SUDORULE].name,
+                                        map[SDAP_AT_SUDO_MODSTAMP].name,
+                                        sudo_ctx->max_modstamp);
+        check_deleted = true;
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Issuing a smart refresh of sudo rules "
+                                 "(modifyTimestamp >= %s)\n",
+                                 sudo_ctx->max_modstamp);
+    } else {
+        /* Neither USN nor modifyTimestamp is known, download all rules. */
+        search_filter = talloc_asprintf(state, SDAP_SUDO_FILTER_CLASS,
+                                        map[SDAP_OC_SUDORULE].name);
+        delete_filter = talloc_asprintf(state, "(%s=%s)", SYSDB_OBJECTCLASS,
+                                        SYSDB_SUDO_CACHE_OC);
+        if (delete_filter == NULL) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "USN and modifyTimestamp values are "
+                                 "unknown, downloading all sudo rules\n");
     }
 
-    search_filter = talloc_asprintf(state, "(&(objectclass=%s)(%s>=%lu))",
-                                    map[SDAP_OC_SUDORULE].name,
-                                    map[SDAP_AT_SUDO_USN].name, usn);
     if (search_filter == NULL) {
         ret = ENOMEM;
         goto immediately;
     }
 
-    /* Do not remove any rules that are already in the sysdb
-     * sysdb_filter = NULL; */
-
-    DEBUG(SSSDBG_TRACE_FUNC, "Issuing a smart refresh of sudo rules "
-                             "(USN > %lu)\n", usn);
-
-    subreq = sdap_sudo_refresh_send(state, sudo_ctx, search_filter, NULL);
+    subreq = sdap_sudo_refresh_send(state, sudo_ctx, search_filter,
+                                    delete_filter, true, check_deleted);
     if (subreq == NULL) {
         ret = ENOMEM;
         goto immediately;
@@ -351,7 +380,7 @@ struct tevent_req *sdap_sudo_rules_refresh_send(TALLOC_CTX *mem_ctx,
     }
 
     subreq = sdap_sudo_refresh_send(req, sudo_ctx, search_filter,
-                                    delete_filter);
+                                    delete_filter, false, false);
     if (subreq == NULL) {
         ret = ENOMEM;
         goto immediately;
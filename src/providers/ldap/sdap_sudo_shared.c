@@ -161,3 +161,44 @@ sdap_sudo_set_usn(struct sdap_server_opts *srv_opts,
     DEBUG(SSSDBG_FUNC_DATA, "SUDO higher USN value: [%lu]\n",
                              srv_opts->max_sudo_value);
 }
+
+void
+sdap_sudo_set_modstamp(TALLOC_CTX *mem_ctx,
+                       char **_max_modstamp,
+                       struct sysdb_attrs **rules,
+                       size_t num_rules)
+{
+    const char *max = *_max_modstamp;
+    const char *modstamp;
+    char *dup;
+    size_t i;
+    errno_t ret;
+
+    for (i = 0; i < num_rules; i++) {
+        ret = sysdb_attrs_get_string(rules[i], SYSDB_ORIG_MODSTAMP, &modstamp);
+        if (ret != EOK) {
+            continue;
+        }
+
+        /* generalized time values of the same format compare as strings */
+        if (max == NULL || strcmp(modstamp, max) > 0) {
+            max = modstamp;
+        }
+    }
+
+    if (max == NULL || max == *_max_modstamp) {
+        return;
+    }
+
+    dup = talloc_strdup(mem_ctx, max);
+    if (dup == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to store modifyTimestamp\n");
+        return;
+    }
+
+    talloc_free(*_max_modstamp);
+    *_max_modstamp = dup;
+
+    DEBUG(SSSDBG_FUNC_DATA, "SUDO higher modifyTimestamp value: [%s]\n",
+                             *_max_modstamp);
+}
@@ -37,4 +37,10 @@ void
 sdap_sudo_set_usn(struct sdap_server_opts *srv_opts,
                   const char *usn);
 
+void
+sdap_sudo_set_modstamp(TALLOC_CTX *mem_ctx,
+                       char **_max_modstamp,
+                       struct sysdb_attrs **rules,
+                       size_t num_rules);
+
 #endif /* _SDAP_SUDO_SHARED_H_ */
@@ -0,0 +1,265 @@
+/*
+    SSSD
+
+    Resumption of the TLS sessions of LDAP connections
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/util.h"
+#include "providers/ldap/sdap.h"
+
+#ifdef HAVE_LDAP_TLS_SESSION_CACHE
+
+#include <openssl/ssl.h>
+
+/* The SSL context is owned by libldap and shared by all connections of the
+ * process, so is the cache. OpenSSL only resumes a client session which is
+ * handed to the new connection explicitly, the connect callback of libldap
+ * is the only place where this can be done before the handshake starts.
+ * There is one entry per server URI which is never removed. */
+
+struct sdap_tls_session {
+    struct sdap_tls_session *prev;
+    struct sdap_tls_session *next;
+
+    char *uri;
+    SSL_SESSION *session;
+};
+
+struct sdap_tls_session_cache {
+    struct sdap_tls_session *sessions;
+    int ex_index;
+
+    uint64_t resumed;
+    uint64_t full;
+};
+
+static struct sdap_tls_session_cache *sdap_tls_cache;
+static bool sdap_tls_cache_unsupported;
+
+static int sdap_tls_session_destructor(struct sdap_tls_session *entry)
+{
+    if (entry->session != NULL) {
+        SSL_SESSION_free(entry->session);
+    }
+
+    return 0;
+}
+
+static struct sdap_tls_session *sdap_tls_session_get(const char *uri)
+{
+    struct sdap_tls_session *entry;
+
+    DLIST_FOR_EACH(entry, sdap_tls_cache->sessions) {
+        if (strcmp(entry->uri, uri) == 0) {
+            return entry;
+        }
+    }
+
+    entry = talloc_zero(sdap_tls_cache, struct sdap_tls_session);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->uri = talloc_strdup(entry, uri);
+    if (entry->uri == NULL) {
+        talloc_free(entry);
+        return NULL;
+    }
+
+    talloc_set_destructor(entry, sdap_tls_session_destructor);
+    DLIST_ADD(sdap_tls_cache->sessions, entry);
+
+    return entry;
+}
+
+/* Called by OpenSSL for every session the server hands out, with TLS 1.3
+ * this happens after the handshake when the ticket arrives */
+static int sdap_tls_session_new_cb(SSL *ssl, SSL_SESSION *session)
+{
+    struct sdap_tls_session *entry;
+
+    entry = SSL_get_ex_data(ssl, sdap_tls_cache->ex_index);
+    if (entry == NULL) {
+        return 0;
+    }
+
+    if (entry->session != NULL) {
+        SSL_SESSION_free(entry->session);
+    }
+
+    /* returning 1 keeps the reference of the caller */
+    entry->session = session;
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Stored a new TLS session for [%s]\n", entry->uri);
+
+    return 1;
+}
+
+static int sdap_tls_session_connect_cb(LDAP *ld, void *ssl_ptr,
+                                       void *ctx_ptr, void *arg)
+{
+    SSL *ssl = (SSL *) ssl_ptr;
+    SSL_CTX *ctx = (SSL_CTX *) ctx_ptr;
+    struct sdap_tls_session *entry;
+    char *uri = NULL;
+    int lret;
+
+    /* libldap creates a new context whenever the TLS options change, so
+     * the context is set up again for every connection */
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT
+                                        | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, sdap_tls_session_new_cb);
+
+    lret = ldap_get_option(ld, LDAP_OPT_URI, &uri);
+    if (lret != LDAP_OPT_SUCCESS || uri == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot get the URI of the connection, "
+              "the TLS session will not be cached.\n");
+        return 0;
+    }
+
+    entry = sdap_tls_session_get(uri);
+    if (entry == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot cache the TLS session of [%s]\n",
+              uri);
+        goto done;
+    }
+
+    SSL_set_ex_data(ssl, sdap_tls_cache->ex_index, entry);
+
+    /* A session which expired or is not accepted by the server anymore just
+     * results in a full handshake */
+    if (entry->session != NULL
+            && SSL_set_session(ssl, entry->session) != 1) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot resume the TLS session of [%s]\n", uri);
+    }
+
+done:
+    ldap_memfree(uri);
+    return 0;
+}
+
+errno_t sdap_tls_session_cache_setup(void)
+{
+    char *package = NULL;
+    bool openssl;
+    int lret;
+
+    if (sdap_tls_cache != NULL) {
+        return EOK;
+    } else if (sdap_tls_cache_unsupported) {
+        return ENOTSUP;
+    }
+
+    lret = ldap_get_option(NULL, LDAP_OPT_X_TLS_PACKAGE, &package);
+    openssl = (lret == LDAP_OPT_SUCCESS && package != NULL
+                    && strcasecmp(package, "OpenSSL") == 0);
+    if (!openssl) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "The TLS sessions of [%s] cannot be resumed.\n",
+              package ? package : "unknown");
+        ldap_memfree(package);
+        sdap_tls_cache_unsupported = true;
+        return ENOTSUP;
+    }
+    ldap_memfree(package);
+
+    sdap_tls_cache = talloc_zero(NULL, struct sdap_tls_session_cache);
+    if (sdap_tls_cache == NULL) {
+        return ENOMEM;
+    }
+
+    sdap_tls_cache->ex_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+    if (sdap_tls_cache->ex_index == -1) {
+        talloc_zfree(sdap_tls_cache);
+        return EIO;
+    }
+
+    /* as a global option the callback is inherited by all new handles */
+    lret = ldap_set_option(NULL, LDAP_OPT_X_TLS_CONNECT_CB,
+                           (void *) sdap_tls_session_connect_cb);
+    if (lret != LDAP_OPT_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "ldap_set_option failed: %s\n", sss_ldap_err2string(lret));
+        talloc_zfree(sdap_tls_cache);
+        return EIO;
+    }
+
+    return EOK;
+}
+
+void sdap_tls_session_report(LDAP *ld, const char *uri)
+{
+    SSL *ssl = NULL;
+    int lret;
+
+    if (sdap_tls_cache == NULL) {
+        return;
+    }
+
+    lret = ldap_get_option(ld, LDAP_OPT_X_TLS_SSL_CTX, &ssl);
+    if (lret != LDAP_OPT_SUCCESS || ssl == NULL) {
+        return;
+    }
+
+    if (SSL_session_reused(ssl)) {
+        sdap_tls_cache->resumed++;
+    } else {
+        sdap_tls_cache->full++;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "TLS session with [%s] %s, %"PRIu64" resumed and "
+          "%"PRIu64" full handshakes so far\n", uri,
+          SSL_session_reused(ssl) ? "resumed" : "negotiated",
+          sdap_tls_cache->resumed, sdap_tls_cache->full);
+}
+
+void sdap_tls_session_get_stats(uint64_t *_resumed, uint64_t *_full)
+{
+    *_resumed = sdap_tls_cache ? sdap_tls_cache->resumed : 0;
+    *_full = sdap_tls_cache ? sdap_tls_cache->full : 0;
+}
+
+#else /* HAVE_LDAP_TLS_SESSION_CACHE */
+
+errno_t sdap_tls_session_cache_setup(void)
+{
+    static bool reported;
+
+    if (!reported) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "The TLS sessions cannot be resumed with this build.\n");
+        reported = true;
+    }
+    return ENOTSUP;
+}
+
+void sdap_tls_session_report(LDAP *ld, const char *uri)
+{
+    return;
+}
+
+void sdap_tls_session_get_stats(uint64_t *_resumed, uint64_t *_full)
+{
+    *_resumed = 0;
+    *_full = 0;
+}
+
+#endif /* HAVE_LDAP_TLS_SESSION_CACHE */
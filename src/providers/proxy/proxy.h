@@ -94,11 +94,39 @@ struct authtok_conv {
     bool sent_old;
 };
 
+enum proxy_enum_map {
+    PROXY_ENUM_USERS,
+    PROXY_ENUM_GROUPS,
+
+    PROXY_ENUM_SENTINEL
+};
+
+struct proxy_enum_waiter;
+struct proxy_files_ctx;
+
+/* The module has a single cursor for each map, so the requests enumerating
+ * a map while it is enumerated wait for the running enumeration */
+struct proxy_enum {
+    struct tevent_req *req;
+    struct proxy_enum_waiter *waiters;
+};
+
 struct proxy_id_ctx {
     struct be_ctx *be;
     bool fast_alias;
     struct proxy_nss_ops ops;
     void *handle;
+
+    /* the buffer sizes the largest entries needed so far, the next lookups
+     * start with them */
+    size_t pw_buflen;
+    size_t gr_buflen;
+    size_t svc_buflen;
+
+    struct proxy_enum enums[PROXY_ENUM_SENTINEL];
+
+    /* set if the local files are mirrored into the cache */
+    struct proxy_files_ctx *files;
 };
 
 struct proxy_auth_ctx {
@@ -144,6 +172,26 @@ struct pc_init_ctx {
 /* From proxy_id.c */
 void proxy_get_account_info(struct be_req *breq);
 
+/* Allocates a lookup buffer of at least the size of the hint */
+char *proxy_alloc_buffer(TALLOC_CTX *mem_ctx, size_t hint, size_t *_buflen);
+
+/* Doubles the buffer up to MAX_BUF_SIZE and raises the hint to its new size,
+ * returns ERANGE if it cannot grow any more */
+errno_t proxy_grow_buffer(TALLOC_CTX *mem_ctx,
+                          char **buffer, size_t *buflen,
+                          size_t *hint);
+
+/* Enumerates the map into the cache of the domain in the background, or
+ * lets the enumeration which is already running do it */
+errno_t proxy_enum_start(struct proxy_id_ctx *ctx, enum proxy_enum_map map);
+
+/* From proxy_files.c */
+errno_t proxy_files_init(struct proxy_id_ctx *ctx);
+
+void proxy_files_enumerated(struct proxy_files_ctx *fctx,
+                            enum proxy_enum_map map,
+                            errno_t ret);
+
 /* From proxy_auth.c */
 void proxy_pam_handler(struct be_req *req);
 
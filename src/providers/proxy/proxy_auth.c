@@ -731,6 +731,21 @@ static int proxy_child_recv(struct tevent_req *req,
     return EOK;
 }
 
+static void proxy_cache_password_done(struct tevent_req *req)
+{
+    int ret;
+
+    ret = sysdb_cache_password_recv(req);
+    talloc_zfree(req);
+
+    /* password caching failures are not fatal errors */
+    /* so we just log it any return */
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to cache password (%d)[%s]!?\n",
+                  ret, strerror(ret));
+    }
+}
+
 static void proxy_child_done(struct tevent_req *req)
 {
     struct proxy_client_ctx *client_ctx =
@@ -780,14 +795,15 @@ static void proxy_child_done(struct tevent_req *req)
             goto done;
         }
 
-        ret = sysdb_cache_password(be_ctx->domain, pd->user, password);
-
-        /* password caching failures are not fatal errors */
-        /* so we just log it any return */
-        if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE, "Failed to cache password (%d)[%s]!?\n",
-                      ret, strerror(ret));
+        /* the hash is stored once it was computed */
+        req = sysdb_cache_password_send(be_ctx, be_ctx->ev, be_ctx->domain,
+                                        pd->user, password,
+                                        SSS_AUTHTOK_TYPE_PASSWORD, 0);
+        if (req == NULL) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to cache password\n");
+            goto done;
         }
+        tevent_req_set_callback(req, proxy_cache_password_done, NULL);
     }
 
 done:
@@ -0,0 +1,578 @@
+/*
+    SSSD
+
+    Mirror of the local passwd and group files in the cache
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include "providers/proxy/proxy.h"
+#include "providers/data_provider.h"
+#include "providers/data_provider_iface_generated.h"
+
+/* With proxy_lib_name = files the files module reads /etc/passwd and
+ * /etc/group, so the back end can keep all of them in the cache: both maps
+ * are loaded when it starts and loaded again whenever one of the files
+ * changes. The NSS responder then answers for the local accounts from the
+ * cache and its fast memory cache like for any other domain.
+ *
+ * A refresh of a map expires its cached entries, lets the NSS responder
+ * drop them from the fast memory cache, removes the entries which are not
+ * in the file any more and enumerates the file again. The lookups in the
+ * meantime go to the module and see the new file.
+ *
+ * The tools replace the files rather than write them in place, so the
+ * directory is watched instead of the files. Without inotify the files
+ * are polled. */
+
+#define PROXY_FILES_DIR "/etc"
+
+/* the tools write several files in turn, the changes of a moment are
+ * loaded together */
+#define PROXY_FILES_DELAY 1
+#define PROXY_FILES_POLL_INTERVAL 5
+#define PROXY_FILES_NSS_TIMEOUT 10000
+
+static const char *proxy_files_names[PROXY_ENUM_SENTINEL] = {
+    "passwd", "group"
+};
+
+struct proxy_files_ctx {
+    struct proxy_id_ctx *id_ctx;
+    struct tevent_timer *te;
+    int inotify_fd;
+
+    /* changed since they were loaded */
+    bool dirty[PROXY_ENUM_SENTINEL];
+    /* being loaded */
+    bool refreshing[PROXY_ENUM_SENTINEL];
+    /* waiting for the NSS responder to drop the expired entries */
+    bool nss_pending;
+
+    /* what the polling saw last */
+    time_t mtime[PROXY_ENUM_SENTINEL];
+    ino_t ino[PROXY_ENUM_SENTINEL];
+};
+
+static void proxy_files_process(struct tevent_context *ev,
+                                struct tevent_timer *te,
+                                struct timeval tv, void *pvt);
+
+static void proxy_files_schedule(struct proxy_files_ctx *fctx)
+{
+    struct timeval tv;
+
+    if (fctx->te != NULL) {
+        return;
+    }
+
+    tv = tevent_timeval_current_ofs(PROXY_FILES_DELAY, 0);
+    fctx->te = tevent_add_timer(fctx->id_ctx->be->ev, fctx, tv,
+                                proxy_files_process, fctx);
+    if (fctx->te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to schedule the refresh of the local files\n");
+    }
+}
+
+static void proxy_files_changed(struct proxy_files_ctx *fctx,
+                                enum proxy_enum_map map)
+{
+    DEBUG(SSSDBG_TRACE_FUNC, "%s/%s changed\n",
+          PROXY_FILES_DIR, proxy_files_names[map]);
+
+    fctx->dirty[map] = true;
+    proxy_files_schedule(fctx);
+}
+
+/* Removes the cached entries of the map which the module does not know
+ * any more. This runs before the file is enumerated again, so that a
+ * renamed entry does not clash with its old name. */
+static errno_t proxy_files_purge(struct proxy_files_ctx *fctx,
+                                 enum proxy_enum_map map)
+{
+    struct proxy_id_ctx *ctx = fctx->id_ctx;
+    struct sss_domain_info *dom = ctx->be->domain;
+    const char *attrs[] = { SYSDB_NAME, NULL };
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message **msgs;
+    struct passwd pwd;
+    struct group grp;
+    enum nss_status status;
+    const char *name;
+    size_t *hint;
+    size_t count;
+    size_t buflen;
+    size_t purged = 0;
+    char *buffer;
+    size_t i;
+    int err;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    if (map == PROXY_ENUM_USERS) {
+        ret = sysdb_search_users(tmp_ctx, dom, "("SYSDB_NAME"=*)", attrs,
+                                 &count, &msgs);
+        hint = &ctx->pw_buflen;
+    } else {
+        ret = sysdb_search_groups(tmp_ctx, dom, "("SYSDB_NAME"=*)", attrs,
+                                  &count, &msgs);
+        hint = &ctx->gr_buflen;
+    }
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    buffer = proxy_alloc_buffer(tmp_ctx, *hint, &buflen);
+    if (buffer == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        name = ldb_msg_find_attr_as_string(msgs[i], SYSDB_NAME, NULL);
+        if (name == NULL) {
+            continue;
+        }
+
+        do {
+            if (map == PROXY_ENUM_USERS) {
+                status = ctx->ops.getpwnam_r(name, &pwd, buffer, buflen, &err);
+            } else {
+                status = ctx->ops.getgrnam_r(name, &grp, buffer, buflen, &err);
+            }
+
+            if (status == NSS_STATUS_TRYAGAIN) {
+                ret = proxy_grow_buffer(tmp_ctx, &buffer, &buflen, hint);
+                if (ret != EOK) {
+                    goto done;
+                }
+            }
+        } while (status == NSS_STATUS_TRYAGAIN);
+
+        if (status == NSS_STATUS_UNAVAIL) {
+            DEBUG(SSSDBG_OP_FAILURE, "The files module is not available\n");
+            ret = ENXIO;
+            goto done;
+        } else if (status != NSS_STATUS_NOTFOUND) {
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "%s is not in %s/%s any more, deleting\n",
+              name, PROXY_FILES_DIR, proxy_files_names[map]);
+
+        if (map == PROXY_ENUM_USERS) {
+            ret = sysdb_delete_user(dom, name, 0);
+        } else {
+            ret = sysdb_delete_group(dom, name, 0);
+        }
+        if (ret != EOK && ret != ENOENT) {
+            DEBUG(SSSDBG_OP_FAILURE, "Unable to delete %s [%d]: %s\n",
+                  name, ret, sss_strerror(ret));
+            continue;
+        }
+        purged++;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Deleted %zu of %zu cached %s\n",
+          purged, count, proxy_files_names[map]);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static void proxy_files_load(struct proxy_files_ctx *fctx)
+{
+    enum proxy_enum_map map;
+    errno_t ret;
+
+    for (map = 0; map < PROXY_ENUM_SENTINEL; map++) {
+        if (!fctx->refreshing[map]) {
+            continue;
+        }
+
+        ret = proxy_files_purge(fctx, map);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Unable to remove the stale %s [%d]: %s\n",
+                  proxy_files_names[map], ret, sss_strerror(ret));
+        }
+
+        ret = proxy_enum_start(fctx->id_ctx, map);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to load %s/%s [%d]: %s\n",
+                  PROXY_FILES_DIR, proxy_files_names[map],
+                  ret, sss_strerror(ret));
+            fctx->refreshing[map] = false;
+            fctx->dirty[map] = true;
+        }
+    }
+
+    /* the changes made while the NSS responder was asked */
+    for (map = 0; map < PROXY_ENUM_SENTINEL; map++) {
+        if (fctx->dirty[map] && !fctx->refreshing[map]) {
+            proxy_files_schedule(fctx);
+        }
+    }
+}
+
+static void proxy_files_nss_done(DBusPendingCall *pending, void *ptr)
+{
+    struct proxy_files_ctx *fctx = talloc_get_type(ptr,
+                                                   struct proxy_files_ctx);
+
+    dbus_pending_call_unref(pending);
+
+    fctx->nss_pending = false;
+    proxy_files_load(fctx);
+}
+
+/* Lets the NSS responder drop the expired entries from the fast memory
+ * cache. Returns EOK if it will tell when it is done. */
+static errno_t proxy_files_update_nss(struct proxy_files_ctx *fctx)
+{
+    struct be_ctx *be_ctx = fctx->id_ctx->be;
+    DBusMessage *msg;
+    errno_t ret;
+
+    if (be_ctx->nss_cli == NULL || be_ctx->nss_cli->conn == NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "NSS responder is not connected\n");
+        return ENOTCONN;
+    }
+
+    msg = dbus_message_new_method_call(NULL,
+                                       DP_PATH,
+                                       DATA_PROVIDER_REV_IFACE,
+                                       DATA_PROVIDER_REV_IFACE_UPDATECACHE);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sbus_conn_send(be_ctx->nss_cli->conn, msg, PROXY_FILES_NSS_TIMEOUT,
+                         proxy_files_nss_done, fctx, NULL);
+    dbus_message_unref(msg);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Error contacting NSS responder: %d [%s]\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    fctx->nss_pending = true;
+    return EOK;
+}
+
+static errno_t proxy_files_expire(struct proxy_files_ctx *fctx,
+                                  enum proxy_enum_map map)
+{
+    struct sss_domain_info *dom = fctx->id_ctx->be->domain;
+    struct ldb_dn *base_dn;
+    size_t count;
+    errno_t ret;
+
+    if (map == PROXY_ENUM_USERS) {
+        base_dn = sysdb_user_base_dn(NULL, dom);
+    } else {
+        base_dn = sysdb_group_base_dn(NULL, dom);
+    }
+    if (base_dn == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_invalidate_cache_entries(dom, base_dn,
+                                         map == PROXY_ENUM_USERS ?
+                                            "("SYSDB_UC")" : "("SYSDB_GC")",
+                                         map == PROXY_ENUM_USERS, &count);
+    talloc_free(base_dn);
+    if (ret == ENOENT) {
+        return EOK;
+    } else if (ret != EOK) {
+        return ret;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Expired %zu cached %s\n",
+          count, proxy_files_names[map]);
+    return EOK;
+}
+
+static void proxy_files_process(struct tevent_context *ev,
+                                struct tevent_timer *te,
+                                struct timeval tv, void *pvt)
+{
+    struct proxy_files_ctx *fctx = talloc_get_type(pvt,
+                                                   struct proxy_files_ctx);
+    enum proxy_enum_map map;
+    bool refresh = false;
+    errno_t ret;
+
+    fctx->te = NULL;
+
+    for (map = 0; map < PROXY_ENUM_SENTINEL; map++) {
+        /* a map which is being loaded is loaded again when it is done */
+        if (!fctx->dirty[map] || fctx->refreshing[map] || fctx->nss_pending) {
+            continue;
+        }
+
+        DEBUG(SSSDBG_FUNC_DATA, "Loading %s/%s\n",
+              PROXY_FILES_DIR, proxy_files_names[map]);
+
+        fctx->dirty[map] = false;
+        fctx->refreshing[map] = true;
+        refresh = true;
+
+        ret = proxy_files_expire(fctx, map);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Unable to expire the cached %s [%d]: %s\n",
+                  proxy_files_names[map], ret, sss_strerror(ret));
+        }
+    }
+
+    if (!refresh) {
+        return;
+    }
+
+    ret = proxy_files_update_nss(fctx);
+    if (ret != EOK) {
+        proxy_files_load(fctx);
+    }
+}
+
+void proxy_files_enumerated(struct proxy_files_ctx *fctx,
+                            enum proxy_enum_map map,
+                            errno_t ret)
+{
+    if (!fctx->refreshing[map] || fctx->nss_pending) {
+        /* an enumeration the clients asked for */
+        return;
+    }
+    fctx->refreshing[map] = false;
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to load %s/%s [%d]: %s\n",
+              PROXY_FILES_DIR, proxy_files_names[map],
+              ret, sss_strerror(ret));
+        fctx->dirty[map] = true;
+    } else {
+        DEBUG(SSSDBG_TRACE_FUNC, "Loaded %s/%s\n",
+              PROXY_FILES_DIR, proxy_files_names[map]);
+    }
+
+    if (fctx->dirty[map]) {
+        proxy_files_schedule(fctx);
+    }
+}
+
+/* Returns true if the file was modified or replaced since the last call */
+static bool proxy_files_stat(struct proxy_files_ctx *fctx,
+                             enum proxy_enum_map map)
+{
+    struct stat st;
+    char *path;
+    int ret;
+
+    path = talloc_asprintf(fctx, "%s/%s",
+                           PROXY_FILES_DIR, proxy_files_names[map]);
+    if (path == NULL) {
+        return false;
+    }
+
+    ret = stat(path, &st);
+    talloc_free(path);
+    if (ret != 0) {
+        return false;
+    }
+
+    if (st.st_mtime == fctx->mtime[map] && st.st_ino == fctx->ino[map]) {
+        return false;
+    }
+
+    fctx->mtime[map] = st.st_mtime;
+    fctx->ino[map] = st.st_ino;
+    return true;
+}
+
+static void proxy_files_poll(struct tevent_context *ev,
+                             struct tevent_timer *te,
+                             struct timeval tv, void *pvt)
+{
+    struct proxy_files_ctx *fctx = talloc_get_type(pvt,
+                                                   struct proxy_files_ctx);
+    enum proxy_enum_map map;
+
+    for (map = 0; map < PROXY_ENUM_SENTINEL; map++) {
+        if (proxy_files_stat(fctx, map)) {
+            proxy_files_changed(fctx, map);
+        }
+    }
+
+    tv = tevent_timeval_current_ofs(PROXY_FILES_POLL_INTERVAL, 0);
+    te = tevent_add_timer(ev, fctx, tv, proxy_files_poll, fctx);
+    if (te == NULL) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "The local files are no longer watched for changes!\n");
+    }
+}
+
+#ifdef HAVE_INOTIFY
+static void proxy_files_inotify_read(struct tevent_context *ev,
+                                     struct tevent_fd *fde,
+                                     uint16_t flags, void *data)
+{
+    struct proxy_files_ctx *fctx = talloc_get_type(data,
+                                                   struct proxy_files_ctx);
+    char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *in_event;
+    enum proxy_enum_map map;
+    ssize_t len;
+    char *ptr;
+
+    while (true) {
+        len = read(fctx->inotify_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            /* EAGAIN once all the events are read */
+            break;
+        }
+
+        for (ptr = buf; ptr < buf + len;
+             ptr += sizeof(struct inotify_event) + in_event->len) {
+            in_event = (const struct inotify_event *) ptr;
+
+            if (in_event->mask & IN_Q_OVERFLOW) {
+                for (map = 0; map < PROXY_ENUM_SENTINEL; map++) {
+                    proxy_files_changed(fctx, map);
+                }
+                continue;
+            }
+
+            if (in_event->len == 0) {
+                continue;
+            }
+
+            for (map = 0; map < PROXY_ENUM_SENTINEL; map++) {
+                if (strcmp(in_event->name, proxy_files_names[map]) == 0) {
+                    proxy_files_changed(fctx, map);
+                }
+            }
+        }
+    }
+}
+
+static errno_t proxy_files_inotify(struct proxy_files_ctx *fctx)
+{
+    struct tevent_fd *tfd;
+    int fd;
+    int wd;
+    errno_t ret;
+
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Could not initialize inotify, error [%d:%s]\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    wd = inotify_add_watch(fd, PROXY_FILES_DIR,
+                           IN_CLOSE_WRITE | IN_MOVED_TO |
+                           IN_CREATE | IN_DELETE);
+    if (wd < 0) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Could not add inotify watch for [%s]. Error [%d:%s]\n",
+              PROXY_FILES_DIR, ret, sss_strerror(ret));
+        close(fd);
+        return ret;
+    }
+
+    tfd = tevent_add_fd(fctx->id_ctx->be->ev, fctx, fd, TEVENT_FD_READ,
+                        proxy_files_inotify_read, fctx);
+    if (tfd == NULL) {
+        close(fd);
+        return ENOMEM;
+    }
+    tevent_fd_set_auto_close(tfd);
+    fctx->inotify_fd = fd;
+
+    return EOK;
+}
+#else
+static errno_t proxy_files_inotify(struct proxy_files_ctx *fctx)
+{
+    return ENOSYS;
+}
+#endif /* HAVE_INOTIFY */
+
+errno_t proxy_files_init(struct proxy_id_ctx *ctx)
+{
+    struct proxy_files_ctx *fctx;
+    enum proxy_enum_map map;
+    struct timeval tv;
+    struct tevent_timer *te;
+    errno_t ret;
+
+    fctx = talloc_zero(ctx, struct proxy_files_ctx);
+    if (fctx == NULL) {
+        return ENOMEM;
+    }
+    fctx->id_ctx = ctx;
+
+    ret = proxy_files_inotify(fctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "Polling %s for changes of the local files\n", PROXY_FILES_DIR);
+
+        for (map = 0; map < PROXY_ENUM_SENTINEL; map++) {
+            proxy_files_stat(fctx, map);
+        }
+
+        tv = tevent_timeval_current_ofs(PROXY_FILES_POLL_INTERVAL, 0);
+        te = tevent_add_timer(ctx->be->ev, fctx, tv, proxy_files_poll, fctx);
+        if (te == NULL) {
+            talloc_free(fctx);
+            return ENOMEM;
+        }
+    }
+
+    /* load both maps once the back end is running */
+    for (map = 0; map < PROXY_ENUM_SENTINEL; map++) {
+        fctx->dirty[map] = true;
+    }
+    proxy_files_schedule(fctx);
+
+    ctx->files = fctx;
+    return EOK;
+}
@@ -27,6 +27,49 @@
 #include "util/sss_format.h"
 #include "util/strtonum.h"
 #include "providers/proxy/proxy.h"
+#include "util/dlinklist.h"
+
+/* =Buffer-utilities======================================================*/
+
+/* Lookups start with the size the largest entry of the map needed so far,
+ * which saves a large group several calls to the module every time */
+char *proxy_alloc_buffer(TALLOC_CTX *mem_ctx, size_t hint, size_t *_buflen)
+{
+    *_buflen = hint > DEFAULT_BUFSIZE ? hint : DEFAULT_BUFSIZE;
+    return talloc_size(mem_ctx, *_buflen);
+}
+
+errno_t proxy_grow_buffer(TALLOC_CTX *mem_ctx,
+                          char **buffer, size_t *buflen,
+                          size_t *hint)
+{
+    char *newbuf;
+    size_t newlen;
+
+    if (*buflen >= MAX_BUF_SIZE) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "The entry does not fit into %zu bytes\n", *buflen);
+        return ERANGE;
+    }
+
+    newlen = *buflen * 2;
+    if (newlen > MAX_BUF_SIZE) {
+        newlen = MAX_BUF_SIZE;
+    }
+
+    newbuf = talloc_realloc_size(mem_ctx, *buffer, newlen);
+    if (newbuf == NULL) {
+        return ENOMEM;
+    }
+    *buffer = newbuf;
+    *buflen = newlen;
+
+    if (newlen > *hint) {
+        *hint = newlen;
+    }
+
+    return EOK;
+}
 
 /* =Getpwnam-wrapper======================================================*/
 
@@ -42,13 +85,45 @@ static int
 delete_user(struct sss_domain_info *domain,
             const char *name, uid_t uid);
 
+/* Looks the user up by name or, without a name, by uid */
+static errno_t proxy_getpw(TALLOC_CTX *mem_ctx,
+                           struct proxy_id_ctx *ctx,
+                           struct sss_domain_info *dom,
+                           const char *name, uid_t uid,
+                           struct passwd *pwd,
+                           char **buffer, size_t *buflen,
+                           bool *del_user)
+{
+    enum nss_status status;
+    errno_t ret;
+
+    do {
+        memset(pwd, 0, sizeof(struct passwd));
+
+        if (name != NULL) {
+            status = ctx->ops.getpwnam_r(name, pwd, *buffer, *buflen, &ret);
+        } else {
+            status = ctx->ops.getpwuid_r(uid, pwd, *buffer, *buflen, &ret);
+        }
+
+        ret = handle_getpw_result(status, pwd, dom, del_user);
+        if (ret == EAGAIN) {
+            ret = proxy_grow_buffer(mem_ctx, buffer, buflen, &ctx->pw_buflen);
+            if (ret == EOK) {
+                ret = EAGAIN;
+            }
+        }
+    } while (ret == EAGAIN);
+
+    return ret;
+}
+
 static int get_pw_name(struct proxy_id_ctx *ctx,
                        struct sss_domain_info *dom,
                        const char *name)
 {
     TALLOC_CTX *tmpctx;
     struct passwd *pwd;
-    enum nss_status status;
     char *buffer;
     size_t buflen;
     int ret;
@@ -70,8 +145,7 @@ static int get_pw_name(struct proxy_id_ctx *ctx,
         goto done;
     }
 
-    buflen = DEFAULT_BUFSIZE;
-    buffer = talloc_size(tmpctx, buflen);
+    buffer = proxy_alloc_buffer(tmpctx, ctx->pw_buflen, &buflen);
     if (!buffer) {
         ret = ENOMEM;
         goto done;
@@ -79,8 +153,8 @@ static int get_pw_name(struct proxy_id_ctx *ctx,
 
     /* FIXME: should we move this call outside the transaction to keep the
      * transaction as short as possible ? */
-    status = ctx->ops.getpwnam_r(name, pwd, buffer, buflen, &ret);
-    ret = handle_getpw_result(status, pwd, dom, &del_user);
+    ret = proxy_getpw(tmpctx, ctx, dom, name, 0, pwd,
+                      &buffer, &buflen, &del_user);
     if (ret) {
         DEBUG(SSSDBG_OP_FAILURE,
               "getpwnam failed [%d]: %s\n", ret, strerror(ret));
@@ -116,8 +190,8 @@ static int get_pw_name(struct proxy_id_ctx *ctx,
     if (real_name == NULL) {
         memset(buffer, 0, buflen);
 
-        status = ctx->ops.getpwuid_r(uid, pwd, buffer, buflen, &ret);
-        ret = handle_getpw_result(status, pwd, dom, &del_user);
+        ret = proxy_getpw(tmpctx, ctx, dom, NULL, uid, pwd,
+                          &buffer, &buflen, &del_user);
         if (ret) {
             DEBUG(SSSDBG_OP_FAILURE,
                 "getpwuid failed [%d]: %s\n", ret, strerror(ret));
@@ -158,6 +232,11 @@ handle_getpw_result(enum nss_status status, struct passwd *pwd,
     *del_user = false;
 
     switch (status) {
+    case NSS_STATUS_TRYAGAIN:
+        DEBUG(SSSDBG_MINOR_FAILURE, "Buffer too small\n");
+        ret = EAGAIN;
+        break;
+
     case NSS_STATUS_NOTFOUND:
 
         DEBUG(SSSDBG_MINOR_FAILURE, "User not found.\n");
@@ -213,35 +292,50 @@ delete_user(struct sss_domain_info *domain,
     return ret;
 }
 
-static int save_user(struct sss_domain_info *domain,
-                     bool lowercase, struct passwd *pwd, const char *real_name,
-                     const char *alias, uint64_t cache_timeout)
+/* Fills user with copies of the data in pwd, since the buffer of pwd is
+ * reused for the next entry while enumerating. */
+static int prepare_user(TALLOC_CTX *mem_ctx,
+                        bool lowercase, struct passwd *pwd,
+                        const char *real_name, const char *alias,
+                        struct sysdb_bulk_user *user)
 {
-    const char *shell;
-    const char *gecos;
     struct sysdb_attrs *attrs = NULL;
     errno_t ret;
     const char *cased_alias;
     const char *lc_pw_name = NULL;
 
+    memset(user, 0, sizeof(*user));
+
+    user->name = talloc_strdup(mem_ctx, real_name);
+    user->pwd = talloc_strdup(mem_ctx, pwd->pw_passwd);
+    user->homedir = talloc_strdup(mem_ctx, pwd->pw_dir);
+    if (user->name == NULL
+            || (pwd->pw_passwd != NULL && user->pwd == NULL)
+            || (pwd->pw_dir != NULL && user->homedir == NULL)) {
+        return ENOMEM;
+    }
+    user->uid = pwd->pw_uid;
+    user->gid = pwd->pw_gid;
+
     if (pwd->pw_shell && pwd->pw_shell[0] != '\0') {
-        shell = pwd->pw_shell;
-    } else {
-        shell = NULL;
+        user->shell = talloc_strdup(mem_ctx, pwd->pw_shell);
+        if (user->shell == NULL) {
+            return ENOMEM;
+        }
     }
 
     if (pwd->pw_gecos && pwd->pw_gecos[0] != '\0') {
-        gecos = pwd->pw_gecos;
-    } else {
-        gecos = NULL;
+        user->gecos = talloc_strdup(mem_ctx, pwd->pw_gecos);
+        if (user->gecos == NULL) {
+            return ENOMEM;
+        }
     }
 
     if (lowercase || alias) {
-        attrs = sysdb_new_attrs(NULL);
+        attrs = sysdb_new_attrs(mem_ctx);
         if (!attrs) {
             DEBUG(SSSDBG_CRIT_FAILURE, "Allocation error ?!\n");
-            ret = ENOMEM;
-            goto done;
+            return ENOMEM;
         }
     }
 
@@ -249,15 +343,13 @@ static int save_user(struct sss_domain_info *domain,
         lc_pw_name = sss_tc_utf8_str_tolower(attrs, pwd->pw_name);
         if (lc_pw_name == NULL) {
             DEBUG(SSSDBG_OP_FAILURE, "Cannot convert name to lowercase.\n");
-            ret = ENOMEM;
-            goto done;
+            return ENOMEM;
         }
 
         ret = sysdb_attrs_add_string(attrs, SYSDB_NAME_ALIAS, lc_pw_name);
         if (ret) {
             DEBUG(SSSDBG_OP_FAILURE, "Could not add name alias\n");
-            ret = ENOMEM;
-            goto done;
+            return ENOMEM;
         }
 
     }
@@ -265,8 +357,7 @@ static int save_user(struct sss_domain_info *domain,
     if (alias) {
         cased_alias = sss_get_cased_name(attrs, alias, !lowercase);
         if (!cased_alias) {
-            ret = ENOMEM;
-            goto done;
+            return ENOMEM;
         }
 
         /* Add the alias only if it differs from lowercased pw_name */
@@ -274,21 +365,43 @@ static int save_user(struct sss_domain_info *domain,
             ret = sysdb_attrs_add_string(attrs, SYSDB_NAME_ALIAS, cased_alias);
             if (ret) {
                 DEBUG(SSSDBG_OP_FAILURE, "Could not add name alias\n");
-                goto done;
+                return ret;
             }
         }
     }
 
+    user->attrs = attrs;
+    return EOK;
+}
+
+static int save_user(struct sss_domain_info *domain,
+                     bool lowercase, struct passwd *pwd, const char *real_name,
+                     const char *alias, uint64_t cache_timeout)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_bulk_user user;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = prepare_user(tmp_ctx, lowercase, pwd, real_name, alias, &user);
+    if (ret != EOK) {
+        goto done;
+    }
+
     ret = sysdb_store_user(domain,
-                           real_name,
-                           pwd->pw_passwd,
-                           pwd->pw_uid,
-                           pwd->pw_gid,
-                           gecos,
-                           pwd->pw_dir,
-                           shell,
+                           user.name,
+                           user.pwd,
+                           user.uid,
+                           user.gid,
+                           user.gecos,
+                           user.homedir,
+                           user.shell,
                            NULL,
-                           attrs,
+                           user.attrs,
                            NULL,
                            cache_timeout,
                            0);
@@ -298,7 +411,7 @@ static int save_user(struct sss_domain_info *domain,
     }
 
 done:
-    talloc_zfree(attrs);
+    talloc_free(tmp_ctx);
     return ret;
 }
 
@@ -310,7 +423,6 @@ static int get_pw_uid(struct proxy_id_ctx *ctx,
 {
     TALLOC_CTX *tmpctx;
     struct passwd *pwd;
-    enum nss_status status;
     char *buffer;
     size_t buflen;
     bool del_user = false;
@@ -329,15 +441,14 @@ static int get_pw_uid(struct proxy_id_ctx *ctx,
         goto done;
     }
 
-    buflen = DEFAULT_BUFSIZE;
-    buffer = talloc_size(tmpctx, buflen);
+    buffer = proxy_alloc_buffer(tmpctx, ctx->pw_buflen, &buflen);
     if (!buffer) {
         ret = ENOMEM;
         goto done;
     }
 
-    status = ctx->ops.getpwuid_r(uid, pwd, buffer, buflen, &ret);
-    ret = handle_getpw_result(status, pwd, dom, &del_user);
+    ret = proxy_getpw(tmpctx, ctx, dom, NULL, uid, pwd,
+                      &buffer, &buflen, &del_user);
     if (ret) {
         DEBUG(SSSDBG_OP_FAILURE,
               "getpwuid failed [%d]: %s\n", ret, strerror(ret));
@@ -364,148 +475,40 @@ done:
 
 /* =Getpwent-wrapper======================================================*/
 
-static int enum_users(TALLOC_CTX *mem_ctx,
-                      struct proxy_id_ctx *ctx,
-                      struct sysdb_ctx *sysdb,
-                      struct sss_domain_info *dom)
-{
-    TALLOC_CTX *tmpctx;
-    bool in_transaction = false;
-    struct passwd *pwd;
-    enum nss_status status;
-    size_t buflen;
-    char *buffer;
-    char *newbuf;
-    int ret;
-    errno_t sret;
-    bool again;
-
-    DEBUG(SSSDBG_TRACE_LIBS, "Enumerating users\n");
-
-    tmpctx = talloc_new(mem_ctx);
-    if (!tmpctx) {
-        return ENOMEM;
-    }
-
-    pwd = talloc_zero(tmpctx, struct passwd);
-    if (!pwd) {
-        ret = ENOMEM;
-        goto done;
-    }
+/* users stored in one sysdb_store_users_bulk() call */
+#define ENUM_USERS_BATCH 1000
 
-    buflen = DEFAULT_BUFSIZE;
-    buffer = talloc_size(tmpctx, buflen);
-    if (!buffer) {
-        ret = ENOMEM;
-        goto done;
-    }
+static errno_t enum_users_flush(struct sss_domain_info *dom,
+                                TALLOC_CTX *batch_ctx,
+                                struct sysdb_bulk_user *users,
+                                size_t *_num_users)
+{
+    errno_t ret;
+    size_t i;
 
-    ret = sysdb_transaction_start(sysdb);
-    if (ret) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
-        goto done;
+    if (*_num_users == 0) {
+        return EOK;
     }
-    in_transaction = true;
 
-    status = ctx->ops.setpwent();
-    if (status != NSS_STATUS_SUCCESS) {
-        ret = EIO;
-        goto done;
+    ret = sysdb_store_users_bulk(dom, users, *_num_users,
+                                 dom->user_timeout, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store users\n");
+        return ret;
     }
 
-    do {
-        again = false;
-
-        /* always zero out the pwd structure */
-        memset(pwd, 0, sizeof(struct passwd));
-
-        /* get entry */
-        status = ctx->ops.getpwent_r(pwd, buffer, buflen, &ret);
-
-        switch (status) {
-            case NSS_STATUS_TRYAGAIN:
-                /* buffer too small ? */
-                if (buflen < MAX_BUF_SIZE) {
-                    buflen *= 2;
-                }
-                if (buflen > MAX_BUF_SIZE) {
-                    buflen = MAX_BUF_SIZE;
-                }
-                newbuf = talloc_realloc_size(tmpctx, buffer, buflen);
-                if (!newbuf) {
-                    ret = ENOMEM;
-                    goto done;
-                }
-                buffer = newbuf;
-                again = true;
-                break;
-
-            case NSS_STATUS_NOTFOUND:
-
-                /* we are done here */
-                DEBUG(SSSDBG_TRACE_LIBS, "Enumeration completed.\n");
-
-                ret = sysdb_transaction_commit(sysdb);
-                if (ret != EOK) {
-                    DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
-                    goto done;
-                }
-                in_transaction = false;
-                break;
-
-            case NSS_STATUS_SUCCESS:
-
-                DEBUG(SSSDBG_TRACE_LIBS,
-                      "User found (%s, %"SPRIuid", %"SPRIgid")\n",
-                       pwd->pw_name, pwd->pw_uid, pwd->pw_gid);
-
-                /* uid=0 or gid=0 are invalid values */
-                /* also check that the id is in the valid range for this domain
-                 */
-                if (OUT_OF_ID_RANGE(pwd->pw_uid, dom->id_min, dom->id_max) ||
-                    OUT_OF_ID_RANGE(pwd->pw_gid, dom->id_min, dom->id_max)) {
-
-                    DEBUG(SSSDBG_OP_FAILURE, "User [%s] filtered out! (id out"
-                        " of range)\n", pwd->pw_name);
-
-                    again = true;
-                    break;
-                }
-
-                ret = save_user(dom, !dom->case_sensitive, pwd,
-                        pwd->pw_name, NULL, dom->user_timeout);
-                if (ret) {
-                    /* Do not fail completely on errors.
-                     * Just report the failure to save and go on */
-                    DEBUG(SSSDBG_OP_FAILURE, "Failed to store user %s."
-                                " Ignoring.\n", pwd->pw_name);
-                }
-                again = true;
-                break;
-
-            case NSS_STATUS_UNAVAIL:
-                /* "remote" backend unavailable. Enter offline mode */
-                ret = ENXIO;
-                break;
-
-            default:
-                ret = EIO;
-                DEBUG(SSSDBG_OP_FAILURE, "proxy -> getpwent_r failed (%d)[%s]"
-                            "\n", ret, strerror(ret));
-                break;
-        }
-    } while (again);
-
-done:
-    talloc_zfree(tmpctx);
-    if (in_transaction) {
-        sret = sysdb_transaction_cancel(sysdb);
-        if (sret != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "Failed to cancel transaction\n");
+    for (i = 0; i < *_num_users; i++) {
+        if (users[i].ret != EOK) {
+            /* Do not fail completely on errors.
+             * Just report the failure to save and go on */
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store user %s."
+                        " Ignoring.\n", users[i].name);
         }
     }
-    ctx->ops.endpwent();
-    return ret;
+
+    talloc_free_children(batch_ctx);
+    *_num_users = 0;
+    return EOK;
 }
 
 /* =Save-group-utilities=================================================*/
@@ -711,31 +714,6 @@ done:
 }
 
 /* =Getgrnam-wrapper======================================================*/
-static char *
-grow_group_buffer(TALLOC_CTX *mem_ctx,
-                  char **buffer, size_t *buflen)
-{
-    char *newbuf;
-
-    if (*buflen == 0) {
-        *buflen = DEFAULT_BUFSIZE;
-    }
-    if (*buflen < MAX_BUF_SIZE) {
-        *buflen *= 2;
-    }
-    if (*buflen > MAX_BUF_SIZE) {
-        *buflen = MAX_BUF_SIZE;
-    }
-
-    newbuf = talloc_realloc_size(mem_ctx, *buffer, *buflen);
-    if (!newbuf) {
-        return NULL;
-    }
-    *buffer = newbuf;
-
-    return *buffer;
-}
-
 static errno_t
 handle_getgr_result(enum nss_status status, struct group *grp,
                     struct sss_domain_info *dom,
@@ -810,18 +788,26 @@ static int get_gr_name(struct proxy_id_ctx *ctx,
         goto done;
     }
 
+    buffer = proxy_alloc_buffer(tmpctx, ctx->gr_buflen, &buflen);
+    if (!buffer) {
+        ret = ENOMEM;
+        goto done;
+    }
+
     do {
         /* always zero out the grp structure */
         memset(grp, 0, sizeof(struct group));
-        buffer = grow_group_buffer(tmpctx, &buffer, &buflen);
-        if (!buffer) {
-            ret = ENOMEM;
-            goto done;
-        }
 
         status = ctx->ops.getgrnam_r(name, grp, buffer, buflen, &ret);
 
         ret = handle_getgr_result(status, grp, dom, &delete_group);
+        if (ret == EAGAIN) {
+            ret = proxy_grow_buffer(tmpctx, &buffer, &buflen,
+                                    &ctx->gr_buflen);
+            if (ret == EOK) {
+                ret = EAGAIN;
+            }
+        }
     } while (ret == EAGAIN);
 
     if (ret != EOK) {
@@ -851,20 +837,19 @@ static int get_gr_name(struct proxy_id_ctx *ctx,
     }
 
     if (real_name == NULL) {
-        talloc_zfree(buffer);
-        buflen = 0;
-
         do {
             memset(grp, 0, sizeof(struct group));
-            buffer = grow_group_buffer(tmpctx, &buffer, &buflen);
-            if (!buffer) {
-                ret = ENOMEM;
-                goto done;
-            }
 
             status = ctx->ops.getgrgid_r(gid, grp, buffer, buflen, &ret);
 
             ret = handle_getgr_result(status, grp, dom, &delete_group);
+            if (ret == EAGAIN) {
+                ret = proxy_grow_buffer(tmpctx, &buffer, &buflen,
+                                        &ctx->gr_buflen);
+                if (ret == EOK) {
+                    ret = EAGAIN;
+                }
+            }
         } while (ret == EAGAIN);
 
         if (ret != EOK) {
@@ -906,18 +891,22 @@ done:
 }
 
 /* =Getgrgid-wrapper======================================================*/
-static int get_gr_gid(TALLOC_CTX *mem_ctx,
-                      struct proxy_id_ctx *ctx,
-                      struct sysdb_ctx *sysdb,
-                      struct sss_domain_info *dom,
-                      gid_t gid,
-                      time_t now)
+
+/* Looks the group up with the buffer of the caller, which grows if the
+ * group does not fit, so that the lookups of many groups share one */
+static int get_gr_gid_buf(TALLOC_CTX *mem_ctx,
+                          struct proxy_id_ctx *ctx,
+                          struct sysdb_ctx *sysdb,
+                          struct sss_domain_info *dom,
+                          gid_t gid,
+                          char **_buffer,
+                          size_t *_buflen)
 {
     TALLOC_CTX *tmpctx;
     struct group *grp;
     enum nss_status status;
-    char *buffer = NULL;
-    size_t buflen = 0;
+    char *buffer = *_buffer;
+    size_t buflen = *_buflen;
     bool delete_group = false;
     int ret;
 
@@ -937,15 +926,17 @@ static int get_gr_gid(TALLOC_CTX *mem_ctx,
     do {
         /* always zero out the grp structure */
         memset(grp, 0, sizeof(struct group));
-        buffer = grow_group_buffer(tmpctx, &buffer, &buflen);
-        if (!buffer) {
-            ret = ENOMEM;
-            goto done;
-        }
 
         status = ctx->ops.getgrgid_r(gid, grp, buffer, buflen, &ret);
 
         ret = handle_getgr_result(status, grp, dom, &delete_group);
+        if (ret == EAGAIN) {
+            ret = proxy_grow_buffer(mem_ctx, &buffer, &buflen,
+                                    &ctx->gr_buflen);
+            if (ret == EOK) {
+                ret = EAGAIN;
+            }
+        }
     } while (ret == EAGAIN);
 
     if (ret != EOK) {
@@ -975,6 +966,8 @@ static int get_gr_gid(TALLOC_CTX *mem_ctx,
 
 done:
     talloc_zfree(tmpctx);
+    *_buffer = buffer;
+    *_buflen = buflen;
     if (ret) {
         DEBUG(SSSDBG_OP_FAILURE,
               "proxy -> getgrgid_r failed for '%"SPRIgid"' <%d>: %s\n",
@@ -983,148 +976,452 @@ done:
     return ret;
 }
 
-/* =Getgrent-wrapper======================================================*/
-
-static int enum_groups(TALLOC_CTX *mem_ctx,
-                       struct proxy_id_ctx *ctx,
-                       struct sysdb_ctx *sysdb,
-                       struct sss_domain_info *dom)
+static int get_gr_gid(TALLOC_CTX *mem_ctx,
+                      struct proxy_id_ctx *ctx,
+                      struct sysdb_ctx *sysdb,
+                      struct sss_domain_info *dom,
+                      gid_t gid)
 {
-    TALLOC_CTX *tmpctx;
-    bool in_transaction = false;
-    struct group *grp;
-    enum nss_status status;
-    size_t buflen;
     char *buffer;
-    char *newbuf;
+    size_t buflen;
     int ret;
-    errno_t sret;
-    bool again;
-
-    DEBUG(SSSDBG_TRACE_LIBS, "Enumerating groups\n");
 
-    tmpctx = talloc_new(mem_ctx);
-    if (!tmpctx) {
+    buffer = proxy_alloc_buffer(mem_ctx, ctx->gr_buflen, &buflen);
+    if (!buffer) {
         return ENOMEM;
     }
 
-    grp = talloc(tmpctx, struct group);
-    if (!grp) {
-        ret = ENOMEM;
-        goto done;
+    ret = get_gr_gid_buf(mem_ctx, ctx, sysdb, dom, gid, &buffer, &buflen);
+    talloc_free(buffer);
+    return ret;
+}
+
+
+/* =Enumeration==========================================================*/
+
+/* groups saved in one transaction before the enumeration lets the other
+ * requests in, their members make them much larger than the users */
+#define ENUM_GROUPS_CHUNK 100
+
+struct proxy_enum_waiter {
+    struct proxy_enum_waiter *prev;
+    struct proxy_enum_waiter *next;
+
+    struct proxy_enum *e;
+    struct be_req *breq;
+};
+
+struct proxy_enum_state {
+    struct tevent_context *ev;
+    struct proxy_id_ctx *ctx;
+    struct sss_domain_info *dom;
+    enum proxy_enum_map map;
+    bool started;
+    struct tevent_immediate *imm;
+
+    char *buffer;
+    size_t buflen;
+    struct passwd *pwd;
+    struct group *grp;
+
+    TALLOC_CTX *batch_ctx;
+    struct sysdb_bulk_user *users;
+    size_t num_users;
+};
+
+static const char *proxy_enum_map_str(enum proxy_enum_map map)
+{
+    return map == PROXY_ENUM_USERS ? "users" : "groups";
+}
+
+static int proxy_enum_state_destructor(struct proxy_enum_state *state)
+{
+    if (state->started) {
+        if (state->map == PROXY_ENUM_USERS) {
+            state->ctx->ops.endpwent();
+        } else {
+            state->ctx->ops.endgrent();
+        }
     }
+    return 0;
+}
 
-    buflen = DEFAULT_BUFSIZE;
-    buffer = talloc_size(tmpctx, buflen);
-    if (!buffer) {
-        ret = ENOMEM;
-        goto done;
+static void proxy_enum_step(struct tevent_context *ev,
+                            struct tevent_immediate *imm,
+                            void *pvt);
+
+static struct tevent_req *proxy_enum_send(TALLOC_CTX *mem_ctx,
+                                          struct tevent_context *ev,
+                                          struct proxy_id_ctx *ctx,
+                                          struct sss_domain_info *dom,
+                                          enum proxy_enum_map map)
+{
+    struct proxy_enum_state *state;
+    struct tevent_req *req;
+    enum nss_status status;
+    size_t hint;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct proxy_enum_state);
+    if (req == NULL) {
+        return NULL;
     }
+    state->ev = ev;
+    state->ctx = ctx;
+    state->dom = dom;
+    state->map = map;
+    talloc_set_destructor(state, proxy_enum_state_destructor);
 
-    ret = sysdb_transaction_start(sysdb);
-    if (ret) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
-        goto done;
+    DEBUG(SSSDBG_TRACE_LIBS, "Enumerating %s\n", proxy_enum_map_str(map));
+
+    if (map == PROXY_ENUM_USERS) {
+        state->pwd = talloc_zero(state, struct passwd);
+        state->users = talloc_array(state, struct sysdb_bulk_user,
+                                    ENUM_USERS_BATCH);
+        state->batch_ctx = talloc_new(state);
+        if (!state->pwd || !state->users || !state->batch_ctx) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+        hint = ctx->pw_buflen;
+    } else {
+        state->grp = talloc_zero(state, struct group);
+        if (!state->grp) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+        hint = ctx->gr_buflen;
+    }
+
+    state->buffer = proxy_alloc_buffer(state, hint, &state->buflen);
+    state->imm = tevent_create_immediate(state);
+    if (!state->buffer || !state->imm) {
+        ret = ENOMEM;
+        goto immediately;
     }
-    in_transaction = true;
 
-    status = ctx->ops.setgrent();
+    if (map == PROXY_ENUM_USERS) {
+        status = ctx->ops.setpwent();
+    } else {
+        status = ctx->ops.setgrent();
+    }
     if (status != NSS_STATUS_SUCCESS) {
         ret = EIO;
-        goto done;
+        goto immediately;
     }
+    state->started = true;
 
-    do {
-        again = false;
+    tevent_schedule_immediate(state->imm, ev, proxy_enum_step, req);
+    return req;
 
-        /* always zero out the grp structure */
-        memset(grp, 0, sizeof(struct group));
+immediately:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
 
-        /* get entry */
-        status = ctx->ops.getgrent_r(grp, buffer, buflen, &ret);
+/* Reads the next user into the batch. Returns EAGAIN if the buffer had to
+ * grow and the same entry has to be read again, ENOENT at the end */
+static errno_t proxy_enum_next_user(struct proxy_enum_state *state)
+{
+    struct proxy_id_ctx *ctx = state->ctx;
+    struct sss_domain_info *dom = state->dom;
+    struct passwd *pwd = state->pwd;
+    enum nss_status status;
+    errno_t ret;
 
-        switch (status) {
-            case NSS_STATUS_TRYAGAIN:
-                /* buffer too small ? */
-                if (buflen < MAX_BUF_SIZE) {
-                    buflen *= 2;
-                }
-                if (buflen > MAX_BUF_SIZE) {
-                    buflen = MAX_BUF_SIZE;
-                }
-                newbuf = talloc_realloc_size(tmpctx, buffer, buflen);
-                if (!newbuf) {
-                    ret = ENOMEM;
-                    goto done;
-                }
-                buffer = newbuf;
-                again = true;
-                break;
+    /* always zero out the pwd structure */
+    memset(pwd, 0, sizeof(struct passwd));
 
-            case NSS_STATUS_NOTFOUND:
+    status = ctx->ops.getpwent_r(pwd, state->buffer, state->buflen, &ret);
 
-                /* we are done here */
-                DEBUG(SSSDBG_TRACE_LIBS, "Enumeration completed.\n");
+    switch (status) {
+    case NSS_STATUS_TRYAGAIN:
+        ret = proxy_grow_buffer(state, &state->buffer, &state->buflen,
+                                &ctx->pw_buflen);
+        return ret == EOK ? EAGAIN : ret;
 
-                ret = sysdb_transaction_commit(sysdb);
-                if (ret != EOK) {
-                    DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
-                    goto done;
-                }
-                in_transaction = false;
-                break;
+    case NSS_STATUS_NOTFOUND:
+        DEBUG(SSSDBG_TRACE_LIBS, "Enumeration completed.\n");
+        return ENOENT;
 
-            case NSS_STATUS_SUCCESS:
+    case NSS_STATUS_SUCCESS:
+        DEBUG(SSSDBG_TRACE_LIBS,
+              "User found (%s, %"SPRIuid", %"SPRIgid")\n",
+               pwd->pw_name, pwd->pw_uid, pwd->pw_gid);
 
-                DEBUG(SSSDBG_OP_FAILURE, "Group found (%s, %"SPRIgid")\n",
-                            grp->gr_name, grp->gr_gid);
+        /* uid=0 or gid=0 are invalid values */
+        /* also check that the id is in the valid range for this domain */
+        if (OUT_OF_ID_RANGE(pwd->pw_uid, dom->id_min, dom->id_max) ||
+            OUT_OF_ID_RANGE(pwd->pw_gid, dom->id_min, dom->id_max)) {
 
-                /* gid=0 is an invalid value */
-                /* also check that the id is in the valid range for this domain
-                 */
-                if (OUT_OF_ID_RANGE(grp->gr_gid, dom->id_min, dom->id_max)) {
+            DEBUG(SSSDBG_OP_FAILURE, "User [%s] filtered out! (id out"
+                " of range)\n", pwd->pw_name);
+            return EOK;
+        }
 
-                    DEBUG(SSSDBG_OP_FAILURE, "Group [%s] filtered out! (id"
-                        "out of range)\n", grp->gr_name);
+        ret = prepare_user(state->batch_ctx, !dom->case_sensitive, pwd,
+                           pwd->pw_name, NULL,
+                           &state->users[state->num_users]);
+        if (ret) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Failed to prepare user %s\n",
+                  pwd->pw_name);
+            return ret;
+        }
+        state->num_users++;
+        return EOK;
 
-                    again = true;
-                    break;
-                }
+    case NSS_STATUS_UNAVAIL:
+        /* "remote" backend unavailable. Enter offline mode */
+        return ENXIO;
 
-                ret = save_group(sysdb, dom, grp, grp->gr_name,
-                        NULL, dom->group_timeout);
-                if (ret) {
-                    /* Do not fail completely on errors.
-                     * Just report the failure to save and go on */
-                    DEBUG(SSSDBG_OP_FAILURE, "Failed to store group."
-                                "Ignoring\n");
-                }
-                again = true;
-                break;
-
-            case NSS_STATUS_UNAVAIL:
-                /* "remote" backend unavailable. Enter offline mode */
-                ret = ENXIO;
-                break;
-
-            default:
-                ret = EIO;
-                DEBUG(SSSDBG_OP_FAILURE, "proxy -> getgrent_r failed (%d)[%s]"
-                            "\n", ret, strerror(ret));
-                break;
+    default:
+        DEBUG(SSSDBG_OP_FAILURE, "proxy -> getpwent_r failed (%d)[%s]\n",
+              ret, strerror(ret));
+        return EIO;
+    }
+}
+
+/* Reads and saves the next group, returns like proxy_enum_next_user() */
+static errno_t proxy_enum_next_group(struct proxy_enum_state *state)
+{
+    struct proxy_id_ctx *ctx = state->ctx;
+    struct sss_domain_info *dom = state->dom;
+    struct group *grp = state->grp;
+    enum nss_status status;
+    errno_t ret;
+
+    /* always zero out the grp structure */
+    memset(grp, 0, sizeof(struct group));
+
+    status = ctx->ops.getgrent_r(grp, state->buffer, state->buflen, &ret);
+
+    switch (status) {
+    case NSS_STATUS_TRYAGAIN:
+        ret = proxy_grow_buffer(state, &state->buffer, &state->buflen,
+                                &ctx->gr_buflen);
+        return ret == EOK ? EAGAIN : ret;
+
+    case NSS_STATUS_NOTFOUND:
+        DEBUG(SSSDBG_TRACE_LIBS, "Enumeration completed.\n");
+        return ENOENT;
+
+    case NSS_STATUS_SUCCESS:
+        DEBUG(SSSDBG_TRACE_LIBS, "Group found (%s, %"SPRIgid")\n",
+              grp->gr_name, grp->gr_gid);
+
+        /* gid=0 is an invalid value */
+        /* also check that the id is in the valid range for this domain */
+        if (OUT_OF_ID_RANGE(grp->gr_gid, dom->id_min, dom->id_max)) {
+
+            DEBUG(SSSDBG_OP_FAILURE, "Group [%s] filtered out! (id"
+                "out of range)\n", grp->gr_name);
+            return EOK;
+        }
+
+        ret = save_group(dom->sysdb, dom, grp, grp->gr_name,
+                         NULL, dom->group_timeout);
+        if (ret) {
+            /* Do not fail completely on errors.
+             * Just report the failure to save and go on */
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store group."
+                        "Ignoring\n");
         }
-    } while (again);
+        return EOK;
+
+    case NSS_STATUS_UNAVAIL:
+        /* "remote" backend unavailable. Enter offline mode */
+        return ENXIO;
+
+    default:
+        DEBUG(SSSDBG_OP_FAILURE, "proxy -> getgrent_r failed (%d)[%s]\n",
+              ret, strerror(ret));
+        return EIO;
+    }
+}
+
+/* Saves one chunk of the map in a transaction and gives the event loop
+ * back to the other requests before the next one */
+static void proxy_enum_step(struct tevent_context *ev,
+                            struct tevent_immediate *imm,
+                            void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct proxy_enum_state *state = tevent_req_data(req,
+                                                     struct proxy_enum_state);
+    struct sysdb_ctx *sysdb = state->dom->sysdb;
+    bool in_transaction = false;
+    bool finished = false;
+    size_t chunk;
+    size_t count = 0;
+    errno_t sret;
+    errno_t ret;
+
+    chunk = state->map == PROXY_ENUM_USERS ? ENUM_USERS_BATCH
+                                           : ENUM_GROUPS_CHUNK;
+
+    ret = sysdb_transaction_start(sysdb);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    while (count < chunk) {
+        if (state->map == PROXY_ENUM_USERS) {
+            ret = proxy_enum_next_user(state);
+        } else {
+            ret = proxy_enum_next_group(state);
+        }
+
+        if (ret == ENOENT) {
+            finished = true;
+            break;
+        } else if (ret == EOK) {
+            count++;
+        } else if (ret != EAGAIN) {
+            goto done;
+        }
+    }
+
+    if (state->map == PROXY_ENUM_USERS) {
+        ret = enum_users_flush(state->dom, state->batch_ctx,
+                               state->users, &state->num_users);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = sysdb_transaction_commit(sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    if (!finished) {
+        DEBUG(SSSDBG_TRACE_ALL, "Saved %zu %s, continuing\n",
+              count, proxy_enum_map_str(state->map));
+        tevent_schedule_immediate(imm, ev, proxy_enum_step, req);
+        return;
+    }
 
 done:
-    talloc_zfree(tmpctx);
     if (in_transaction) {
         sret = sysdb_transaction_cancel(sysdb);
         if (sret != EOK) {
             DEBUG(SSSDBG_CRIT_FAILURE, "Failed to cancel transaction\n");
         }
     }
-    ctx->ops.endgrent();
-    return ret;
+
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+    tevent_req_done(req);
+}
+
+static errno_t proxy_enum_recv(struct tevent_req *req,
+                               enum proxy_enum_map *_map)
+{
+    struct proxy_enum_state *state = tevent_req_data(req,
+                                                     struct proxy_enum_state);
+
+    *_map = state->map;
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+static int proxy_enum_waiter_destructor(struct proxy_enum_waiter *waiter)
+{
+    DLIST_REMOVE(waiter->e->waiters, waiter);
+    return 0;
+}
+
+static void proxy_enum_done(struct tevent_req *req)
+{
+    struct proxy_id_ctx *ctx = tevent_req_callback_data(req,
+                                                        struct proxy_id_ctx);
+    struct proxy_enum_waiter *waiter;
+    enum proxy_enum_map map;
+    struct proxy_enum *e;
+    errno_t ret;
+
+    ret = proxy_enum_recv(req, &map);
+    /* ends the enumeration in the module as well */
+    talloc_zfree(req);
+
+    e = &ctx->enums[map];
+    e->req = NULL;
+
+    if (ret == ENXIO) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "proxy returned UNAVAIL error, going offline!\n");
+        be_mark_offline(ctx->be);
+    }
+
+    while ((waiter = e->waiters) != NULL) {
+        DLIST_REMOVE(e->waiters, waiter);
+        talloc_set_destructor(waiter, NULL);
+
+        if (ret != EOK) {
+            be_req_terminate(waiter->breq, DP_ERR_FATAL, ret, NULL);
+        } else {
+            be_req_terminate(waiter->breq, DP_ERR_OK, EOK, NULL);
+        }
+    }
+
+    if (ctx->files != NULL) {
+        proxy_files_enumerated(ctx->files, map, ret);
+    }
+}
+
+errno_t proxy_enum_start(struct proxy_id_ctx *ctx, enum proxy_enum_map map)
+{
+    struct proxy_enum *e = &ctx->enums[map];
+
+    if (e->req != NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Joining the running enumeration of %s\n",
+              proxy_enum_map_str(map));
+        return EOK;
+    }
+
+    e->req = proxy_enum_send(ctx, ctx->be->ev, ctx, ctx->be->domain, map);
+    if (e->req == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(e->req, proxy_enum_done, ctx);
+
+    return EOK;
+}
+
+/* Terminates breq once the map is enumerated. The requests which arrive
+ * during an enumeration of the map wait for its result */
+static void proxy_enum(struct be_req *breq,
+                       struct proxy_id_ctx *ctx,
+                       enum proxy_enum_map map)
+{
+    struct proxy_enum *e = &ctx->enums[map];
+    struct proxy_enum_waiter *waiter;
+    errno_t ret;
+
+    waiter = talloc_zero(breq, struct proxy_enum_waiter);
+    if (waiter == NULL) {
+        return be_req_terminate(breq, DP_ERR_FATAL, ENOMEM, NULL);
+    }
+    waiter->e = e;
+    waiter->breq = breq;
+
+    ret = proxy_enum_start(ctx, map);
+    if (ret != EOK) {
+        talloc_free(waiter);
+        return be_req_terminate(breq, DP_ERR_FATAL, ret, NULL);
+    }
+
+    DLIST_ADD_END(e->waiters, waiter, struct proxy_enum_waiter *);
+    talloc_set_destructor(waiter, proxy_enum_waiter_destructor);
 }
 
 
@@ -1145,7 +1442,6 @@ static int get_initgr(TALLOC_CTX *mem_ctx,
     TALLOC_CTX *tmpctx;
     bool in_transaction = false;
     struct passwd *pwd;
-    enum nss_status status;
     char *buffer;
     size_t buflen;
     int ret;
@@ -1166,8 +1462,7 @@ static int get_initgr(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
-    buflen = DEFAULT_BUFSIZE;
-    buffer = talloc_size(tmpctx, buflen);
+    buffer = proxy_alloc_buffer(tmpctx, ctx->pw_buflen, &buflen);
     if (!buffer) {
         ret = ENOMEM;
         goto fail;
@@ -1182,8 +1477,8 @@ static int get_initgr(TALLOC_CTX *mem_ctx,
 
     /* FIXME: should we move this call outside the transaction to keep the
      * transaction as short as possible ? */
-    status = ctx->ops.getpwnam_r(name, pwd, buffer, buflen, &ret);
-    ret = handle_getpw_result(status, pwd, dom, &del_user);
+    ret = proxy_getpw(tmpctx, ctx, dom, name, 0, pwd,
+                      &buffer, &buflen, &del_user);
     if (ret) {
         DEBUG(SSSDBG_OP_FAILURE,
               "getpwnam failed [%d]: %s\n", ret, strerror(ret));
@@ -1223,8 +1518,8 @@ static int get_initgr(TALLOC_CTX *mem_ctx,
     if (real_name == NULL) {
         memset(buffer, 0, buflen);
 
-        status = ctx->ops.getpwuid_r(uid, pwd, buffer, buflen, &ret);
-        ret = handle_getpw_result(status, pwd, dom, &del_user);
+        ret = proxy_getpw(tmpctx, ctx, dom, NULL, uid, pwd,
+                          &buffer, &buflen, &del_user);
         if (ret) {
             DEBUG(SSSDBG_OP_FAILURE,
                 "getpwuid failed [%d]: %s\n", ret, strerror(ret));
@@ -1287,9 +1582,10 @@ static int get_initgr_groups_process(TALLOC_CTX *memctx,
     long int num;
     long int num_gids;
     gid_t *gids;
+    char *buffer;
+    size_t buflen;
     int ret;
     int i;
-    time_t now;
 
     num_gids = 0;
     limit = 4096;
@@ -1339,13 +1635,20 @@ static int get_initgr_groups_process(TALLOC_CTX *memctx,
         DEBUG(SSSDBG_CONF_SETTINGS, "User [%s] appears to be member of %lu "
               "groups\n", pwd->pw_name, num_gids);
 
-        now = time(NULL);
+        /* one buffer for all the groups */
+        buffer = proxy_alloc_buffer(memctx, ctx->gr_buflen, &buflen);
+        if (!buffer) {
+            return ENOMEM;
+        }
+
         for (i = 0; i < num_gids; i++) {
-            ret = get_gr_gid(memctx, ctx, sysdb, dom, gids[i], now);
+            ret = get_gr_gid_buf(memctx, ctx, sysdb, dom, gids[i],
+                                 &buffer, &buflen);
             if (ret) {
                 return ret;
             }
         }
+        talloc_free(buffer);
         ret = EOK;
 
         break;
@@ -1399,8 +1702,7 @@ void proxy_get_account_info(struct be_req *breq)
     case BE_REQ_USER: /* user */
         switch (ar->filter_type) {
         case BE_FILTER_ENUM:
-            ret = enum_users(breq, ctx, sysdb, domain);
-            break;
+            return proxy_enum(breq, ctx, PROXY_ENUM_USERS);
 
         case BE_FILTER_NAME:
             ret = get_pw_name(ctx, domain, ar->filter_value);
@@ -1423,8 +1725,7 @@ void proxy_get_account_info(struct be_req *breq)
     case BE_REQ_GROUP: /* group */
         switch (ar->filter_type) {
         case BE_FILTER_ENUM:
-            ret = enum_groups(breq, ctx, sysdb, domain);
-            break;
+            return proxy_enum(breq, ctx, PROXY_ENUM_GROUPS);
         case BE_FILTER_NAME:
             ret = get_gr_name(ctx, sysdb, domain, ar->filter_value);
             break;
@@ -1434,7 +1735,7 @@ void proxy_get_account_info(struct be_req *breq)
                 return be_req_terminate(breq, DP_ERR_FATAL,
                                    EINVAL, "Invalid attr type");
             }
-            ret = get_gr_gid(breq, ctx, sysdb, domain, gid, 0);
+            ret = get_gr_gid(breq, ctx, sysdb, domain, gid);
             break;
         default:
             return be_req_terminate(breq, DP_ERR_FATAL,
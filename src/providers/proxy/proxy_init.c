@@ -94,6 +94,7 @@ int sssm_proxy_id_init(struct be_ctx *bectx,
     struct proxy_id_ctx *ctx;
     char *libname;
     char *libpath;
+    bool mirror_files;
     int ret;
 
     ctx = talloc_zero(bectx, struct proxy_id_ctx);
@@ -114,6 +115,10 @@ int sssm_proxy_id_init(struct be_ctx *bectx,
                           CONFDB_PROXY_FAST_ALIAS, false, &ctx->fast_alias);
     if (ret != EOK) goto done;
 
+    ret = confdb_get_bool(bectx->cdb, bectx->conf_path,
+                          CONFDB_PROXY_MIRROR_FILES, false, &mirror_files);
+    if (ret != EOK) goto done;
+
     libpath = talloc_asprintf(ctx, "libnss_%s.so.2", libname);
     if (!libpath) {
         ret = ENOMEM;
@@ -306,6 +311,22 @@ int sssm_proxy_id_init(struct be_ctx *bectx,
                dlerror());
     }
 
+    if (mirror_files) {
+        if (strcmp(libname, "files") != 0) {
+            DEBUG(SSSDBG_CONF_SETTINGS, "%s is only supported with "
+                  "%s = files, ignoring it\n",
+                  CONFDB_PROXY_MIRROR_FILES, CONFDB_PROXY_LIBNAME);
+        } else {
+            ret = proxy_files_init(ctx);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_FATAL_FAILURE,
+                      "Unable to mirror the local files [%d]: %s\n",
+                      ret, sss_strerror(ret));
+                goto done;
+            }
+        }
+    }
+
     *ops = &proxy_id_ops;
     *pvt_data = ctx;
     ret = EOK;
@@ -212,7 +212,6 @@ enum_services(struct proxy_id_ctx *ctx,
     enum nss_status status;
     size_t buflen;
     char *buffer;
-    char *newbuf;
     errno_t ret, sret;
     time_t now = time(NULL);
     const char **protocols;
@@ -232,8 +231,7 @@ enum_services(struct proxy_id_ctx *ctx,
         goto done;
     }
 
-    buflen = DEFAULT_BUFSIZE;
-    buffer = talloc_size(tmpctx, buflen);
+    buffer = proxy_alloc_buffer(tmpctx, ctx->svc_buflen, &buflen);
     if (!buffer) {
         ret = ENOMEM;
         goto done;
@@ -270,18 +268,11 @@ enum_services(struct proxy_id_ctx *ctx,
         switch (status) {
             case NSS_STATUS_TRYAGAIN:
                 /* buffer too small ? */
-                if (buflen < MAX_BUF_SIZE) {
-                    buflen *= 2;
-                }
-                if (buflen > MAX_BUF_SIZE) {
-                    buflen = MAX_BUF_SIZE;
-                }
-                newbuf = talloc_realloc_size(tmpctx, buffer, buflen);
-                if (!newbuf) {
-                    ret = ENOMEM;
+                ret = proxy_grow_buffer(tmpctx, &buffer, &buflen,
+                                        &ctx->svc_buflen);
+                if (ret != EOK) {
                     goto done;
                 }
-                buffer = newbuf;
                 again = true;
                 break;
 
@@ -58,6 +58,12 @@
 #define DNS_HEADER_ANCOUNT(h)           DNS__16BIT((h) + 6)
 #define DNS_RR_LEN(r)                   DNS__16BIT((r) + 8)
 #define DNS_RR_TTL(r)                   DNS__32BIT((r) + 4)
+#define DNS_RR_SET_TTL(r, v) do { \
+    (r)[4] = ((v) >> 24) & 0xff; \
+    (r)[5] = ((v) >> 16) & 0xff; \
+    (r)[6] = ((v) >> 8) & 0xff; \
+    (r)[7] = (v) & 0xff; \
+} while (0)
 
 #define RESOLV_TIMEOUTMS  2000
 
@@ -86,6 +92,12 @@ struct resolv_ctx {
      * if our pending requests didn't timeout. */
     int pending_requests;
     struct tevent_timer *timeout_watcher;
+
+    /* The answers of the DNS server, shared by all users of the context */
+    struct resolv_cache_entry *cache;
+    size_t cache_count;
+
+    struct resolv_stats stats;
 };
 
 struct request_watch {
@@ -489,6 +501,503 @@ void
 resolv_reread_configuration(struct resolv_ctx *ctx)
 {
     recreate_ares_channel(ctx);
+
+    /* the answers may come from the servers which were just replaced */
+    resolv_cache_flush(ctx);
+}
+
+/* Reads the lowest TTL of the answers, the TTLs over max_ttl are lowered
+ * to it in abuf */
+static bool
+resolv_walk_ttl(unsigned char *abuf, const int alen, uint32_t *_ttl,
+                uint32_t max_ttl)
+{
+    unsigned char *aptr;
+    int ret;
+    char *name = NULL;
+    long len;
+    uint32_t ttl = 0;
+    uint32_t rr_ttl;
+    unsigned int rr_len;
+    unsigned int ancount;
+    unsigned int i;
+
+    /* Read the number of RRs and then skip past the header */
+    if (alen < NS_HFIXEDSZ) {
+        return false;
+    }
+
+    ancount = DNS_HEADER_ANCOUNT(abuf);
+    if (ancount == 0) {
+        return false;
+    }
+
+    aptr = abuf + NS_HFIXEDSZ;
+
+    /* We only care about len from the question data,
+     * so that we can move past hostname */
+    ret = ares_expand_name(aptr, abuf, alen, &name, &len);
+    ares_free_string(name);
+    if (ret != ARES_SUCCESS) {
+        return false;
+    }
+
+    /* Skip past the question */
+    aptr += len + NS_QFIXEDSZ;
+    if (aptr > abuf + alen) {
+        return false;
+    }
+
+    /* Examine each RR in turn and read the lowest TTL */
+    for (i = 0; i < ancount; i++) {
+        /* Decode the RR up to the data field. */
+        ret = ares_expand_name(aptr, abuf, alen, &name, &len);
+        ares_free_string(name);
+        if (ret != ARES_SUCCESS) {
+            return false;
+        }
+
+        aptr += len;
+        if (aptr + NS_RRFIXEDSZ > abuf + alen) {
+            return false;
+        }
+
+        rr_len = DNS_RR_LEN(aptr);
+        rr_ttl = DNS_RR_TTL(aptr);
+        if (aptr + rr_len > abuf + alen) {
+            return false;
+        }
+
+        if (rr_ttl > max_ttl) {
+            DNS_RR_SET_TTL(aptr, max_ttl);
+            rr_ttl = max_ttl;
+        }
+        aptr += NS_RRFIXEDSZ + rr_len;
+
+        if (ttl > 0) {
+            ttl = MIN(ttl, rr_ttl);
+        } else {
+            ttl = rr_ttl; /* special-case for first TTL */
+        }
+    }
+
+    *_ttl = ttl;
+    return true;
+}
+
+static bool
+resolv_get_ttl(const unsigned char *abuf, const int alen, uint32_t *_ttl)
+{
+    return resolv_walk_ttl(discard_const(abuf), alen, _ttl, UINT32_MAX);
+}
+
+/*******************************************************************
+ * Answer cache.                                                   *
+ *******************************************************************/
+
+/* The answers are kept for their lowest TTL, but not longer than
+ * RESOLV_CACHE_MAX_TTL. A name which does not exist is remembered for
+ * RESOLV_CACHE_NEGATIVE_TTL seconds. Once RESOLV_CACHE_REFRESH_PERCENT of
+ * the TTL passed, a query goes to the DNS server again, so that the consumers
+ * which refresh their data shortly before it expires get a fresh answer. */
+#define RESOLV_CACHE_MAX_TTL 3600
+#define RESOLV_CACHE_NEGATIVE_TTL 30
+#define RESOLV_CACHE_REFRESH_PERCENT 90
+#define RESOLV_CACHE_MAX_ENTRIES 256
+
+struct resolv_cache_entry {
+    struct resolv_cache_entry *prev;
+    struct resolv_cache_entry *next;
+
+    char *name;
+    int type;
+    bool search;
+
+    int status;
+    unsigned char *abuf;
+    int alen;
+    time_t refresh;
+    time_t expire;
+};
+
+/* A query which is sent to the DNS server, its answer is cached before it
+ * is passed to callback */
+struct resolv_cache_query {
+    struct resolv_ctx *ctx;
+    char *name;
+    int type;
+    bool search;
+    struct timeval start;
+
+    ares_callback callback;
+    void *arg;
+};
+
+static void
+resolv_cache_remove(struct resolv_ctx *ctx, struct resolv_cache_entry *entry)
+{
+    DLIST_REMOVE(ctx->cache, entry);
+    ctx->cache_count--;
+    talloc_free(entry);
+}
+
+void
+resolv_cache_flush(struct resolv_ctx *ctx)
+{
+    DEBUG(SSSDBG_TRACE_FUNC, "Flushing %zu cached DNS answers\n",
+          ctx->cache_count);
+
+    while (ctx->cache != NULL) {
+        resolv_cache_remove(ctx, ctx->cache);
+    }
+}
+
+static struct resolv_cache_entry *
+resolv_cache_get(struct resolv_ctx *ctx, const char *name, int type,
+                 bool search, time_t now)
+{
+    struct resolv_cache_entry *entry;
+    struct resolv_cache_entry *next;
+
+    for (entry = ctx->cache; entry != NULL; entry = next) {
+        next = entry->next;
+
+        if (entry->expire <= now) {
+            resolv_cache_remove(ctx, entry);
+            continue;
+        }
+
+        if (entry->type == type && entry->search == search
+                && strcasecmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+resolv_cache_store(struct resolv_cache_query *query, int status,
+                   unsigned char *abuf, int alen)
+{
+    struct resolv_ctx *ctx = query->ctx;
+    struct resolv_cache_entry *entry;
+    struct resolv_cache_entry *oldest;
+    uint32_t ttl;
+    time_t now;
+
+    if (status == ARES_SUCCESS) {
+        if (abuf == NULL || !resolv_get_ttl(abuf, alen, &ttl) || ttl == 0) {
+            return;
+        }
+        ttl = MIN(ttl, RESOLV_CACHE_MAX_TTL);
+    } else if (status == ARES_ENOTFOUND || status == ARES_ENODATA) {
+        ttl = RESOLV_CACHE_NEGATIVE_TTL;
+    } else {
+        /* a failure of the DNS server says nothing about the name */
+        return;
+    }
+
+    now = time(NULL);
+
+    /* drops the expired answers and a stale copy of this one */
+    entry = resolv_cache_get(ctx, query->name, query->type, query->search,
+                             now);
+    if (entry != NULL) {
+        resolv_cache_remove(ctx, entry);
+    }
+
+    if (ctx->cache_count >= RESOLV_CACHE_MAX_ENTRIES) {
+        for (oldest = ctx->cache; oldest->next != NULL; oldest = oldest->next);
+        resolv_cache_remove(ctx, oldest);
+    }
+
+    entry = talloc_zero(ctx, struct resolv_cache_entry);
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->name = talloc_strdup(entry, query->name);
+    if (entry->name == NULL) {
+        talloc_free(entry);
+        return;
+    }
+
+    if (status == ARES_SUCCESS) {
+        entry->abuf = talloc_memdup(entry, abuf, alen);
+        if (entry->abuf == NULL) {
+            talloc_free(entry);
+            return;
+        }
+        entry->alen = alen;
+    }
+
+    entry->type = query->type;
+    entry->search = query->search;
+    entry->status = status;
+    entry->expire = now + ttl;
+    entry->refresh = status == ARES_SUCCESS
+                        ? now + ttl * RESOLV_CACHE_REFRESH_PERCENT / 100
+                        : entry->expire;
+
+    DLIST_ADD(ctx->cache, entry);
+    ctx->cache_count++;
+}
+
+/*******************************************************************
+ * Query statistics.                                               *
+ *******************************************************************/
+
+uint64_t
+resolv_stats_bucket_limit(int bucket)
+{
+    return UINT64_C(1) << bucket;
+}
+
+const char *
+resolv_stats_type_str(enum resolv_stats_type type)
+{
+    switch (type) {
+    case RESOLV_STATS_TYPE_A:
+        return "A";
+    case RESOLV_STATS_TYPE_AAAA:
+        return "AAAA";
+    case RESOLV_STATS_TYPE_SRV:
+        return "SRV";
+    case RESOLV_STATS_TYPE_TXT:
+        return "TXT";
+    case RESOLV_STATS_TYPE_OTHER:
+    case RESOLV_STATS_TYPES:
+        break;
+    }
+
+    return "other";
+}
+
+const char *
+resolv_stats_outcome_str(enum resolv_stats_outcome outcome)
+{
+    switch (outcome) {
+    case RESOLV_STATS_SUCCESS:
+        return "success";
+    case RESOLV_STATS_NOT_FOUND:
+        return "not found";
+    case RESOLV_STATS_TIMEOUT:
+        return "timeout";
+    case RESOLV_STATS_FAILURE:
+    case RESOLV_STATS_OUTCOMES:
+        break;
+    }
+
+    return "failure";
+}
+
+static enum resolv_stats_type
+resolv_stats_type(int type)
+{
+    switch (type) {
+    case ns_t_a:
+        return RESOLV_STATS_TYPE_A;
+    case ns_t_aaaa:
+        return RESOLV_STATS_TYPE_AAAA;
+    case ns_t_srv:
+        return RESOLV_STATS_TYPE_SRV;
+    case ns_t_txt:
+        return RESOLV_STATS_TYPE_TXT;
+    }
+
+    return RESOLV_STATS_TYPE_OTHER;
+}
+
+static enum resolv_stats_outcome
+resolv_stats_outcome(int status)
+{
+    switch (status) {
+    case ARES_SUCCESS:
+        return RESOLV_STATS_SUCCESS;
+    case ARES_ENOTFOUND:
+    case ARES_ENODATA:
+        return RESOLV_STATS_NOT_FOUND;
+    case ARES_ETIMEOUT:
+        return RESOLV_STATS_TIMEOUT;
+    }
+
+    return RESOLV_STATS_FAILURE;
+}
+
+/* start is NULL for the answers from the cache */
+static void
+resolv_stats_record(struct resolv_ctx *ctx, int type, int status,
+                    struct timeval *start)
+{
+    struct resolv_stats *stats = &ctx->stats;
+    enum resolv_stats_type stype = resolv_stats_type(type);
+    enum resolv_stats_outcome outcome = resolv_stats_outcome(status);
+    struct timeval now;
+    struct timeval elapsed;
+    uint64_t msec;
+    int bucket;
+
+    if (start == NULL) {
+        stats->cached[stype][outcome]++;
+        return;
+    }
+
+    now = tevent_timeval_current();
+    elapsed = tevent_timeval_until(start, &now);
+    msec = (uint64_t) elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000;
+
+    for (bucket = 0; bucket < RESOLV_STATS_BUCKETS - 1; bucket++) {
+        if (msec < resolv_stats_bucket_limit(bucket)) {
+            break;
+        }
+    }
+
+    stats->network[stype][outcome]++;
+    stats->total_msec += msec;
+    stats->max_msec = MAX(stats->max_msec, msec);
+    stats->buckets[bucket]++;
+}
+
+void
+resolv_get_stats(struct resolv_ctx *ctx, struct resolv_stats *_stats)
+{
+    *_stats = ctx->stats;
+}
+
+void
+resolv_dump_stats(struct resolv_ctx *ctx)
+{
+    struct resolv_stats *stats = &ctx->stats;
+    uint64_t queries = 0;
+    char buf[256];
+    size_t pos;
+    int type;
+    int outcome;
+    int bucket;
+    int ret;
+
+    for (type = 0; type < RESOLV_STATS_TYPES; type++) {
+        pos = 0;
+        buf[0] = '\0';
+        for (outcome = 0; outcome < RESOLV_STATS_OUTCOMES; outcome++) {
+            ret = snprintf(buf + pos, sizeof(buf) - pos,
+                           " %s:%"PRIu64"/%"PRIu64,
+                           resolv_stats_outcome_str(outcome),
+                           stats->network[type][outcome],
+                           stats->cached[type][outcome]);
+            if (ret < 0 || (size_t) ret >= sizeof(buf) - pos) {
+                break;
+            }
+            pos += ret;
+            queries += stats->network[type][outcome];
+        }
+
+        DEBUG(SSSDBG_IMPORTANT_INFO, "DNS %s queries (network/cached):%s\n",
+              resolv_stats_type_str(type), buf);
+    }
+
+    pos = 0;
+    buf[0] = '\0';
+    for (bucket = 0; bucket < RESOLV_STATS_BUCKETS; bucket++) {
+        if (bucket == RESOLV_STATS_BUCKETS - 1) {
+            ret = snprintf(buf + pos, sizeof(buf) - pos, " inf:%"PRIu64,
+                           stats->buckets[bucket]);
+        } else {
+            ret = snprintf(buf + pos, sizeof(buf) - pos, " %"PRIu64"ms:%"PRIu64,
+                           resolv_stats_bucket_limit(bucket),
+                           stats->buckets[bucket]);
+        }
+        if (ret < 0 || (size_t) ret >= sizeof(buf) - pos) {
+            break;
+        }
+        pos += ret;
+    }
+
+    DEBUG(SSSDBG_IMPORTANT_INFO, "DNS latency, mean %"PRIu64" ms, max %"PRIu64
+          " ms:%s\n", queries ? stats->total_msec / queries : 0,
+          stats->max_msec, buf);
+}
+
+static void
+resolv_cache_query_done(void *arg, int status, int timeouts,
+                        unsigned char *abuf, int alen)
+{
+    struct resolv_cache_query *query = talloc_get_type(arg,
+                                                struct resolv_cache_query);
+
+    resolv_cache_store(query, status, abuf, alen);
+    resolv_stats_record(query->ctx, query->type, status, &query->start);
+
+    query->callback(query->arg, status, timeouts, abuf, alen);
+    talloc_free(query);
+}
+
+/* Answers the query from the cache or sends it to the DNS server, callback
+ * is called with the answer in both cases */
+static void
+resolv_query(struct resolv_ctx *ctx, const char *name, int type, bool search,
+             ares_callback callback, void *arg)
+{
+    struct resolv_cache_entry *entry;
+    struct resolv_cache_query *query;
+    unsigned char *abuf = NULL;
+    uint32_t ttl;
+    time_t now;
+
+    now = time(NULL);
+    entry = resolv_cache_get(ctx, name, type, search, now);
+    if (entry != NULL && entry->refresh <= now) {
+        DEBUG(SSSDBG_TRACE_LIBS, "The cached answer for '%s' is about to "
+              "expire, asking the DNS server\n", name);
+        entry = NULL;
+    }
+
+    if (entry != NULL) {
+        DEBUG(SSSDBG_TRACE_LIBS, "Answering the query for '%s' from the "
+              "cache\n", name);
+
+        if (entry->abuf != NULL) {
+            /* the consumers see the time which is left */
+            abuf = talloc_memdup(ctx, entry->abuf, entry->alen);
+            if (abuf == NULL) {
+                goto send;
+            }
+            resolv_walk_ttl(abuf, entry->alen, &ttl, entry->expire - now);
+        }
+
+        resolv_stats_record(ctx, type, entry->status, NULL);
+        callback(arg, entry->status, 0, abuf, entry->alen);
+        talloc_free(abuf);
+        return;
+    }
+
+send:
+    query = talloc_zero(ctx, struct resolv_cache_query);
+    if (query != NULL) {
+        query->name = talloc_strdup(query, name);
+    }
+    if (query == NULL || query->name == NULL) {
+        talloc_free(query);
+        /* the answer is just not cached */
+        query = NULL;
+    } else {
+        query->ctx = ctx;
+        query->type = type;
+        query->search = search;
+        query->callback = callback;
+        query->arg = arg;
+        query->start = tevent_timeval_current();
+
+        callback = resolv_cache_query_done;
+        arg = query;
+    }
+
+    if (search) {
+        ares_search(ctx->channel, name, ns_c_in, type, callback, arg);
+    } else {
+        ares_query(ctx->channel, name, ns_c_in, type, callback, arg);
+    }
 }
 
 static errno_t
@@ -868,10 +1377,9 @@ resolv_gethostbyname_dns_query(struct tevent_req *req,
         return;
     }
 
-    ares_search(state->resolv_ctx->channel,
-                state->name, ns_c_in,
-                (state->family == AF_INET) ? ns_t_a : ns_t_aaaa,
-                resolv_gethostbyname_dns_query_done, rreq);
+    resolv_query(state->resolv_ctx, state->name,
+                 (state->family == AF_INET) ? ns_t_a : ns_t_aaaa, true,
+                 resolv_gethostbyname_dns_query_done, rreq);
 }
 
 static void
@@ -1034,6 +1542,11 @@ resolv_gethostbyname_dns_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
  * Get host by name.                                               *
  *******************************************************************/
 
+/* With IPV4_FIRST or IPV6_FIRST, DNS is asked for both address families at
+ * once. An answer for the other family is used when the preferred one did
+ * not answer RESOLV_FAMILY_RACE_DELAY milliseconds later, or failed. */
+#define RESOLV_FAMILY_RACE_DELAY 50
+
 struct gethostbyname_state {
     struct resolv_ctx *resolv_ctx;
     struct tevent_context *ev;
@@ -1055,6 +1568,17 @@ struct gethostbyname_state {
     int status;
     int timeouts;
     int retrying;
+
+    /* The DNS query of the preferred family and the one racing it */
+    struct tevent_req *dns_req;
+    errno_t dns_ret;
+    struct tevent_req *race_req;
+    struct tevent_timer *race_te;
+    int race_family;
+    errno_t race_ret;
+    struct resolv_hostent *race_rhostent;
+    int race_status;
+    int race_timeouts;
 };
 
 static errno_t
@@ -1274,6 +1798,54 @@ resolv_gethostbyname_next(struct gethostbyname_state *state)
 
 static void
 resolv_gethostbyname_done(struct tevent_req *subreq);
+static void
+resolv_gethostbyname_race_done(struct tevent_req *subreq);
+
+static void
+resolv_gethostbyname_race_reset(struct gethostbyname_state *state)
+{
+    talloc_zfree(state->race_req);
+    talloc_zfree(state->race_te);
+    talloc_zfree(state->race_rhostent);
+    state->race_family = 0;
+}
+
+/* Starts the query of the other address family next to the preferred one */
+static void
+resolv_gethostbyname_race_start(struct tevent_req *req)
+{
+    struct gethostbyname_state *state = tevent_req_data(req,
+                                                struct gethostbyname_state);
+    struct tevent_req *subreq;
+
+    if (state->family_order != IPV4_FIRST
+            && state->family_order != IPV6_FIRST) {
+        return;
+    }
+
+    if (state->family != resolv_gethostbyname_family_init(
+                                                    state->family_order)) {
+        /* the other family is being tried already */
+        return;
+    }
+
+    state->race_family = state->family == AF_INET ? AF_INET6 : AF_INET;
+    state->race_ret = EAGAIN;
+
+    subreq = resolv_gethostbyname_dns_send(state, state->ev,
+                                           state->resolv_ctx, state->name,
+                                           state->race_family);
+    if (subreq == NULL) {
+        /* the families are just tried one after another */
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to query both address "
+              "families at once\n");
+        state->race_family = 0;
+        return;
+    }
+
+    tevent_req_set_callback(subreq, resolv_gethostbyname_race_done, req);
+    state->race_req = subreq;
+}
 
 static errno_t
 resolv_gethostbyname_step(struct tevent_req *req)
@@ -1296,6 +1868,10 @@ resolv_gethostbyname_step(struct tevent_req *req)
                                                    state->resolv_ctx,
                                                    state->name,
                                                    state->family);
+            if (subreq != NULL) {
+                state->dns_req = subreq;
+                resolv_gethostbyname_race_start(req);
+            }
             break;
         default:
             DEBUG(SSSDBG_CRIT_FAILURE, "Invalid hosts database\n");
@@ -1310,6 +1886,86 @@ resolv_gethostbyname_step(struct tevent_req *req)
     return EOK;
 }
 
+static void
+resolv_gethostbyname_race_use(struct tevent_req *req)
+{
+    struct gethostbyname_state *state = tevent_req_data(req,
+                                                struct gethostbyname_state);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Using the answer for the %s addresses of "
+          "[%s]\n", state->race_family == AF_INET ? "IPv4" : "IPv6",
+          state->name);
+
+    talloc_zfree(state->dns_req);
+    talloc_zfree(state->rhostent);
+    state->rhostent = state->race_rhostent;
+    state->race_rhostent = NULL;
+    state->status = state->race_status;
+    state->timeouts = state->race_timeouts;
+    state->family = state->race_family;
+
+    resolv_gethostbyname_race_reset(state);
+    tevent_req_done(req);
+}
+
+static void
+resolv_gethostbyname_race_timeout(struct tevent_context *ev,
+                                  struct tevent_timer *te,
+                                  struct timeval tv, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct gethostbyname_state *state = tevent_req_data(req,
+                                                struct gethostbyname_state);
+
+    state->race_te = NULL;
+    resolv_gethostbyname_race_use(req);
+}
+
+static void
+resolv_gethostbyname_result(struct tevent_req *req, errno_t ret);
+
+static void
+resolv_gethostbyname_race_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct gethostbyname_state *state = tevent_req_data(req,
+                                                struct gethostbyname_state);
+    struct timeval tv;
+
+    state->race_req = NULL;
+    state->race_ret = resolv_gethostbyname_dns_recv(subreq, state,
+                                                    &state->race_status,
+                                                    &state->race_timeouts,
+                                                    &state->race_rhostent);
+    talloc_zfree(subreq);
+
+    if (state->dns_req == NULL) {
+        /* the preferred family failed already */
+        if (state->race_ret == EOK) {
+            resolv_gethostbyname_race_use(req);
+            return;
+        }
+
+        state->family = state->race_family;
+        resolv_gethostbyname_race_reset(state);
+        resolv_gethostbyname_result(req, state->dns_ret);
+        return;
+    }
+
+    if (state->race_ret != EOK) {
+        /* wait for the preferred family */
+        return;
+    }
+
+    tv = tevent_timeval_current_ofs(0, RESOLV_FAMILY_RACE_DELAY * 1000);
+    state->race_te = tevent_add_timer(state->ev, state, tv,
+                                      resolv_gethostbyname_race_timeout, req);
+    if (state->race_te == NULL) {
+        resolv_gethostbyname_race_use(req);
+    }
+}
+
 static void
 resolv_gethostbyname_done(struct tevent_req *subreq)
 {
@@ -1328,6 +1984,7 @@ resolv_gethostbyname_done(struct tevent_req *subreq)
             state->timeouts = 0;
             break;
         case DB_DNS:
+            state->dns_req = NULL;
             ret = resolv_gethostbyname_dns_recv(subreq, state,
                                                 &state->status, &state->timeouts,
                                                 &state->rhostent);
@@ -1340,6 +1997,32 @@ resolv_gethostbyname_done(struct tevent_req *subreq)
 
     talloc_zfree(subreq);
 
+    if (state->race_family != 0) {
+        if (ret == EOK) {
+            resolv_gethostbyname_race_reset(state);
+        } else if (state->race_req != NULL) {
+            /* the other family may still answer */
+            state->dns_ret = ret;
+            return;
+        } else if (state->race_ret == EOK) {
+            resolv_gethostbyname_race_use(req);
+            return;
+        } else {
+            /* both families failed, do not ask for the other one again */
+            state->family = state->race_family;
+            resolv_gethostbyname_race_reset(state);
+        }
+    }
+
+    resolv_gethostbyname_result(req, ret);
+}
+
+static void
+resolv_gethostbyname_result(struct tevent_req *req, errno_t ret)
+{
+    struct gethostbyname_state *state = tevent_req_data(req,
+                                                struct gethostbyname_state);
+
     if (ret == ENOENT) {
         ret = resolv_gethostbyname_next(state);
         if (ret == EOK) {
@@ -1635,77 +2318,6 @@ resolv_getsrv_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
  *  On success, returns true and sets the TTL in the _ttl parameter. On
  *  failure, returns false and _ttl is undefined.
  */
-static bool
-resolv_get_ttl(const unsigned char *abuf, const int alen, uint32_t *_ttl)
-{
-    const unsigned char *aptr;
-    int ret;
-    char *name = NULL;
-    long len;
-    uint32_t ttl = 0;
-    uint32_t rr_ttl;
-    unsigned int rr_len;
-    unsigned int ancount;
-    unsigned int i;
-
-    /* Read the number of RRs and then skip past the header */
-    if (alen < NS_HFIXEDSZ) {
-        return false;
-    }
-
-    ancount = DNS_HEADER_ANCOUNT(abuf);
-    if (ancount == 0) {
-        return false;
-    }
-
-    aptr = abuf + NS_HFIXEDSZ;
-
-    /* We only care about len from the question data,
-     * so that we can move past hostname */
-    ret = ares_expand_name(aptr, abuf, alen, &name, &len);
-    ares_free_string(name);
-    if (ret != ARES_SUCCESS) {
-        return false;
-    }
-
-    /* Skip past the question */
-    aptr += len + NS_QFIXEDSZ;
-    if (aptr > abuf + alen) {
-        return false;
-    }
-
-    /* Examine each RR in turn and read the lowest TTL */
-    for (i = 0; i < ancount; i++) {
-        /* Decode the RR up to the data field. */
-        ret = ares_expand_name(aptr, abuf, alen, &name, &len);
-        ares_free_string(name);
-        if (ret != ARES_SUCCESS) {
-            return false;
-        }
-
-        aptr += len;
-        if (aptr + NS_RRFIXEDSZ > abuf + alen) {
-            return false;
-        }
-
-        rr_len = DNS_RR_LEN(aptr);
-        rr_ttl = DNS_RR_TTL(aptr);
-        if (aptr + rr_len > abuf + alen) {
-            return false;
-        }
-        aptr += NS_RRFIXEDSZ + rr_len;
-
-        if (ttl > 0) {
-            ttl = MIN(ttl, rr_ttl);
-        } else {
-            ttl = rr_ttl; /* special-case for first TTL */
-        }
-    }
-
-    *_ttl = ttl;
-    return true;
-}
-
 static void
 resolv_getsrv_done(void *arg, int status, int timeouts, unsigned char *abuf, int alen)
 {
@@ -1826,8 +2438,8 @@ resolv_getsrv_query(struct tevent_req *req,
         return;
     }
 
-    ares_query(state->resolv_ctx->channel, state->query,
-               ns_c_in, ns_t_srv, resolv_getsrv_done, rreq);
+    resolv_query(state->resolv_ctx, state->query, ns_t_srv, false,
+                 resolv_getsrv_done, rreq);
 }
 
 /* TXT parsing is not used anywhere in the code yet, so we disable it
@@ -2068,8 +2680,8 @@ resolv_gettxt_query(struct tevent_req *req,
         return;
     }
 
-    ares_query(state->resolv_ctx->channel, state->query,
-               ns_c_in, ns_t_txt, resolv_gettxt_done, rreq);
+    resolv_query(state->resolv_ctx, state->query, ns_t_txt, false,
+                 resolv_gettxt_done, rreq);
 }
 
 #endif
@@ -54,8 +54,59 @@ struct resolv_ctx;
 int resolv_init(TALLOC_CTX *mem_ctx, struct tevent_context *ev_ctx,
                 int timeout, struct resolv_ctx **ctxp);
 
+/* Also flushes the cached answers */
 void resolv_reread_configuration(struct resolv_ctx *ctx);
 
+/* Forget the cached DNS answers of the context */
+void resolv_cache_flush(struct resolv_ctx *ctx);
+
+/** Statistics of the DNS queries **/
+enum resolv_stats_type {
+    RESOLV_STATS_TYPE_A,
+    RESOLV_STATS_TYPE_AAAA,
+    RESOLV_STATS_TYPE_SRV,
+    RESOLV_STATS_TYPE_TXT,
+    RESOLV_STATS_TYPE_OTHER,
+
+    RESOLV_STATS_TYPES
+};
+
+enum resolv_stats_outcome {
+    RESOLV_STATS_SUCCESS,
+    RESOLV_STATS_NOT_FOUND,
+    RESOLV_STATS_TIMEOUT,
+    RESOLV_STATS_FAILURE,
+
+    RESOLV_STATS_OUTCOMES
+};
+
+#define RESOLV_STATS_BUCKETS 12
+
+/*
+ * The queries answered by the DNS server and by the answer cache, by record
+ * type and outcome. The latency histogram only counts the queries sent to
+ * the DNS server; bucket i holds those which took less than
+ * resolv_stats_bucket_limit(i) milliseconds, the last bucket is unbounded.
+ */
+struct resolv_stats {
+    uint64_t network[RESOLV_STATS_TYPES][RESOLV_STATS_OUTCOMES];
+    uint64_t cached[RESOLV_STATS_TYPES][RESOLV_STATS_OUTCOMES];
+    uint64_t total_msec;
+    uint64_t max_msec;
+    uint64_t buckets[RESOLV_STATS_BUCKETS];
+};
+
+uint64_t resolv_stats_bucket_limit(int bucket);
+
+const char *resolv_stats_type_str(enum resolv_stats_type type);
+
+const char *resolv_stats_outcome_str(enum resolv_stats_outcome outcome);
+
+void resolv_get_stats(struct resolv_ctx *ctx, struct resolv_stats *_stats);
+
+/* Writes the statistics to the debug log */
+void resolv_dump_stats(struct resolv_ctx *ctx);
+
 const char *resolv_strerror(int ares_code);
 
 struct resolv_hostent *
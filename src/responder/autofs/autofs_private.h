@@ -31,6 +31,9 @@ struct autofs_ctx {
     int neg_timeout;
 
     hash_table_t *maps;
+
+    /* map entries shared with the clients */
+    struct sss_mc_ctx *mc_ctx;
 };
 
 struct autofs_cmd_ctx {
@@ -69,8 +72,10 @@ struct autofs_map_ctx {
 
     /* map entry */
     struct ldb_message *map;
-    size_t entry_count;
-    struct ldb_message **entries;
+
+    /* the entries are read from the cache of the domain a page at a time */
+    struct sss_domain_info *domain;
+    struct sysdb_enum_cursor *cursor;
 };
 
 struct sss_cmd_table *get_autofs_cmds(void);
@@ -28,8 +28,10 @@
 #include "responder/common/responder.h"
 #include "providers/data_provider.h"
 #include "responder/autofs/autofs_private.h"
+#include "responder/nss/nsssrv_mmap_cache.h"
 
 static int autofs_clean_hash_table(struct sbus_request *dbus_req, void *data);
+static int autofs_clear_memcache(struct sbus_request *dbus_req, void *data);
 
 struct mon_cli_iface monitor_autofs_methods = {
     { &mon_cli_iface_meta, 0 },
@@ -39,9 +41,11 @@ struct mon_cli_iface monitor_autofs_methods = {
     .goOffline = NULL,
     .resetOffline = NULL,
     .rotateLogs = responder_logrotate,
-    .clearMemcache = NULL,
+    .clearMemcache = autofs_clear_memcache,
     .clearEnumCache = autofs_clean_hash_table,
     .sysbusReconnect = NULL,
+    .memReport = monitor_common_mem_report,
+    .startupTimes = monitor_common_startup_times,
 };
 
 static struct data_provider_iface autofs_dp_methods = {
@@ -113,6 +117,48 @@ static int autofs_clean_hash_table(struct sbus_request *dbus_req, void *data)
         return ret;
     }
 
+    /* the clients must not use the entries of the orphaned maps either */
+    if (actx->mc_ctx != NULL) {
+        sss_mmap_cache_reset(actx->mc_ctx);
+    }
+
+    return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
+}
+
+static int autofs_clear_memcache(struct sbus_request *dbus_req, void *data)
+{
+    struct resp_ctx *rctx = talloc_get_type(data, struct resp_ctx);
+    struct autofs_ctx *actx =
+            talloc_get_type(rctx->pvt_ctx, struct autofs_ctx);
+    int memcache_timeout;
+    errno_t ret;
+
+    /* the cache file may have been invalidated by sss_cache, the NSS
+     * responder takes care of the flag file */
+    if (actx->mc_ctx == NULL) {
+        goto done;
+    }
+
+    ret = confdb_get_int(rctx->cdb,
+                         CONFDB_NSS_CONF_ENTRY,
+                         CONFDB_MEMCACHE_TIMEOUT,
+                         300, &memcache_timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Unable to get memory cache entry timeout.\n");
+        return ret;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Clearing the autofs memory cache.\n");
+
+    ret = sss_mmap_cache_reinit(actx, SSS_MC_CACHE_ELEMENTS,
+                                (time_t)memcache_timeout, &actx->mc_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "autofs mmap cache invalidation failed\n");
+        return ret;
+    }
+
+done:
     return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
 }
 
@@ -128,6 +174,7 @@ autofs_process_init(TALLOC_CTX *mem_ctx,
     int ret;
     int hret;
     int max_retries;
+    int memcache_timeout;
 
     autofs_cmds = get_autofs_cmds();
     ret = sss_process_init(mem_ctx, ev, cdb,
@@ -187,6 +234,25 @@ autofs_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    /* Share the map entries with the clients, using the timeout of the
+     * other memory caches */
+    ret = confdb_get_int(autofs_ctx->rctx->cdb,
+                         CONFDB_NSS_CONF_ENTRY,
+                         CONFDB_MEMCACHE_TIMEOUT,
+                         300, &memcache_timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Failed to get 'memcache_timeout' option from confdb.\n");
+        goto fail;
+    }
+
+    ret = sss_mmap_cache_init(autofs_ctx, "autofs", SSS_MC_AUTOFS,
+                              SSS_MC_CACHE_ELEMENTS,
+                              (time_t)memcache_timeout, &autofs_ctx->mc_ctx);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "autofs mmap cache is DISABLED\n");
+    }
+
     ret = schedule_get_domains_task(rctx, rctx->ev, rctx, NULL);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "schedule_get_domains_tasks failed.\n");
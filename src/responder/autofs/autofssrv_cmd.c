@@ -29,6 +29,12 @@
 #include "db/sysdb.h"
 #include "db/sysdb_autofs.h"
 #include "confdb/confdb.h"
+#include "util/mmap_cache.h"
+#include "responder/nss/nsssrv_mmap_cache.h"
+
+/* Upper bound of the entries read from the cache for one getautomntent
+ * call, whatever the client asks for */
+#define AUTOFS_MAX_PAGE_ENTRIES 4096
 
 static int autofs_cmd_send_error(struct autofs_cmd_ctx *cmdctx, int err)
 {
@@ -406,6 +412,76 @@ setautomntent_get_autofs_map(struct autofs_ctx *actx,
                              char *mapname,
                              struct autofs_map_ctx **map);
 
+static void
+autofs_mc_store(struct autofs_ctx *actx,
+                const char *keystr,
+                const char *valuestr)
+{
+    struct sized_string key;
+    struct sized_string value;
+    errno_t ret;
+
+    to_sized_string(&key, keystr);
+    to_sized_string(&value, valuestr);
+
+    ret = sss_mmap_cache_autofs_store(&actx->mc_ctx, &key, &value);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Failed to store [%s] in the memory cache [%d]: %s\n",
+              keystr, ret, sss_strerror(ret));
+    }
+}
+
+/* Lets the clients skip setautomntent for this map */
+static void
+autofs_mc_store_map(struct autofs_ctx *actx, const char *mapname)
+{
+    char *mckey;
+
+    if (actx->mc_ctx == NULL) {
+        return;
+    }
+
+    mckey = talloc_asprintf(NULL, "%c:%s", SSS_MC_AUTOFS_MAP_PREFIX, mapname);
+    if (mckey == NULL) {
+        return;
+    }
+
+    autofs_mc_store(actx, mckey, "");
+    talloc_free(mckey);
+}
+
+/* Shares an entry sent to a client so that the following getautomntbyname
+ * calls do not need to contact us */
+static void
+autofs_mc_store_entry(struct autofs_ctx *actx,
+                      const char *mapname,
+                      struct ldb_message *entry)
+{
+    const char *key;
+    const char *value;
+    char *mckey;
+
+    if (actx->mc_ctx == NULL) {
+        return;
+    }
+
+    key = ldb_msg_find_attr_as_string(entry, SYSDB_AUTOFS_ENTRY_KEY, NULL);
+    value = ldb_msg_find_attr_as_string(entry, SYSDB_AUTOFS_ENTRY_VALUE, NULL);
+    if (key == NULL || value == NULL) {
+        return;
+    }
+
+    mckey = talloc_asprintf(NULL, "%c:%zu:%s:%s", SSS_MC_AUTOFS_ENTRY_PREFIX,
+                            strlen(mapname), mapname, key);
+    if (mckey == NULL) {
+        return;
+    }
+
+    autofs_mc_store(actx, mckey, value);
+    talloc_free(mckey);
+}
+
 static struct tevent_req *
 setautomntent_send(TALLOC_CTX *mem_ctx,
                    const char *rawname,
@@ -699,11 +775,12 @@ lookup_automntmap_step(struct setautomntent_lookup_ctx *lookup_ctx)
         }
 
         /* OK, the map is in cache and valid.
-         * Let's get all members and return it
+         * Let's remember where its members are, they are streamed to the
+         * clients from the cache
          */
-        ret = sysdb_autofs_entries_by_map(map, dom, map->mapname,
-                                          &map->entry_count,
-                                          &map->entries);
+        talloc_zfree(map->cursor);
+        ret = sysdb_autofs_entries_cursor(map, dom, map->mapname,
+                                          &map->cursor);
         if (ret != EOK && ret != ENOENT) {
             DEBUG(SSSDBG_OP_FAILURE,
                   "Error looking automount map entries [%d]: %s\n",
@@ -715,6 +792,9 @@ lookup_automntmap_step(struct setautomntent_lookup_ctx *lookup_ctx)
         }
 
         map->map = talloc_steal(map, dctx->map);
+        map->domain = dom;
+
+        autofs_mc_store_map(lookup_ctx->actx, map->mapname);
 
         DEBUG(SSSDBG_TRACE_FUNC,
               "setautomntent done for map %s\n", lookup_ctx->mapname);
@@ -1055,13 +1135,16 @@ getautomntent_process(struct autofs_cmd_ctx *cmdctx,
                       uint32_t cursor, uint32_t max_entries)
 {
     struct cli_ctx *client = cmdctx->cctx;
+    struct autofs_ctx *actx;
     errno_t ret;
-    struct ldb_message *entry;
+    struct ldb_result *page;
     size_t rp;
-    uint32_t i, stop, left, nentries;
+    uint32_t i, nentries;
     uint8_t *body;
     size_t blen;
 
+    actx = talloc_get_type(client->rctx->pvt_ctx, struct autofs_ctx);
+
     /* create response packet */
     ret = sss_packet_new(client->creq, 0,
                          sss_packet_get_cmd(client->creq->in),
@@ -1070,8 +1153,8 @@ getautomntent_process(struct autofs_cmd_ctx *cmdctx,
         return ret;
     }
 
-    if (!map->map || !map->entries || !map->entries[0] ||
-        cursor >= map->entry_count) {
+    if (!map->map || !map->cursor ||
+        cursor >= sysdb_enum_cursor_count(map->cursor)) {
         DEBUG(SSSDBG_MINOR_FAILURE, "No entries found\n");
         ret = sss_cmd_empty_packet(client->creq->out);
         if (ret != EOK) {
@@ -1089,22 +1172,30 @@ getautomntent_process(struct autofs_cmd_ctx *cmdctx,
 
     rp = sizeof(uint32_t);  /* We'll write the number of entries here */
 
-    left = map->entry_count - cursor;
-    stop = max_entries < left ? max_entries : left;
+    /* Only the requested page is read from the cache, entries removed
+     * since setautomntent are skipped */
+    max_entries = MIN(max_entries, AUTOFS_MAX_PAGE_ENTRIES);
+    ret = sysdb_enum_cursor_read(cmdctx, map->cursor, cursor, max_entries,
+                                 &page);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot read entries of map %s [%d]: %s\n",
+              map->mapname, ret, sss_strerror(ret));
+        goto done;
+    }
 
     nentries = 0;
-    for (i=0; i < stop; i++) {
-        entry = map->entries[cursor];
-        cursor++;
-
-        ret = fill_autofs_entry(entry, client->creq->out, &rp);
+    for (i=0; i < page->count; i++) {
+        ret = fill_autofs_entry(page->msgs[i], client->creq->out, &rp);
         if (ret != EOK) {
             DEBUG(SSSDBG_MINOR_FAILURE,
-                  "Cannot fill entry %d/%d, skipping\n", i, stop);
+                  "Cannot fill entry %d/%d, skipping\n", i, page->count);
             continue;
         }
+        autofs_mc_store_entry(actx, map->mapname, page->msgs[i]);
         nentries++;
     }
+    talloc_free(page);
 
     /* packet grows in fill_autofs_entry, body pointer may change,
      * thus we have to obtain it here */
@@ -1353,10 +1444,10 @@ getautomntbyname_process(struct autofs_cmd_ctx *cmdctx,
                          const char *key)
 {
     struct cli_ctx *client = cmdctx->cctx;
+    struct autofs_ctx *actx;
     errno_t ret;
-    size_t i;
-    const char *k;
     const char *value;
+    struct ldb_message *entry = NULL;
     size_t valuelen;
     size_t len;
     uint8_t *body;
@@ -1370,7 +1461,8 @@ getautomntbyname_process(struct autofs_cmd_ctx *cmdctx,
         return ret;
     }
 
-    if (!map->map || !map->entries || !map->entries[0]) {
+    if (!map->map || !map->cursor ||
+        sysdb_enum_cursor_count(map->cursor) == 0) {
         DEBUG(SSSDBG_MINOR_FAILURE, "No entries found\n");
         ret = sss_cmd_empty_packet(client->creq->out);
         if (ret != EOK) {
@@ -1379,21 +1471,16 @@ getautomntbyname_process(struct autofs_cmd_ctx *cmdctx,
         goto done;
     }
 
-    for (i=0; i < map->entry_count; i++) {
-        k = ldb_msg_find_attr_as_string(map->entries[i],
-                                        SYSDB_AUTOFS_ENTRY_KEY, NULL);
-        if (!k) {
-            DEBUG(SSSDBG_MINOR_FAILURE, "Skipping incomplete entry\n");
-            continue;
-        }
-
-        if (strcmp(k, key) == 0) {
-            DEBUG(SSSDBG_TRACE_INTERNAL, "Found key [%s]\n", key);
-            break;
-        }
+    ret = sysdb_get_autofsentry(cmdctx, map->domain, map->mapname, key,
+                                &entry);
+    if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot look up key [%s] [%d]: %s\n",
+              key, ret, sss_strerror(ret));
+        goto done;
     }
 
-    if (i >= map->entry_count) {
+    if (entry == NULL) {
         DEBUG(SSSDBG_MINOR_FAILURE, "No key named [%s] found\n", key);
         ret = sss_cmd_empty_packet(client->creq->out);
         if (ret != EOK) {
@@ -1402,8 +1489,17 @@ getautomntbyname_process(struct autofs_cmd_ctx *cmdctx,
         goto done;
     }
 
-    value = ldb_msg_find_attr_as_string(map->entries[i],
-                                        SYSDB_AUTOFS_ENTRY_VALUE, NULL);
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Found key [%s]\n", key);
+
+    value = ldb_msg_find_attr_as_string(entry, SYSDB_AUTOFS_ENTRY_VALUE, NULL);
+    if (value == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Incomplete entry\n");
+        ret = EINVAL;
+        goto done;
+    }
+
+    actx = talloc_get_type(client->rctx->pvt_ctx, struct autofs_ctx);
+    autofs_mc_store_entry(actx, map->mapname, entry);
 
     valuelen = 1 + strlen(value);
     len = sizeof(uint32_t) + sizeof(uint32_t) + valuelen;
@@ -23,627 +23,1052 @@
 #include "confdb/confdb.h"
 #include "responder/common/responder.h"
 #include "responder/common/negcache.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <ctype.h>
 #include <time.h>
-#include "tdb.h"
-
-#define NC_ENTRY_PREFIX "NCE/"
-#define NC_USER_PREFIX NC_ENTRY_PREFIX"USER"
-#define NC_GROUP_PREFIX NC_ENTRY_PREFIX"GROUP"
-#define NC_NETGROUP_PREFIX NC_ENTRY_PREFIX"NETGR"
-#define NC_SERVICE_PREFIX NC_ENTRY_PREFIX"SERVICE"
-#define NC_UID_PREFIX NC_ENTRY_PREFIX"UID"
-#define NC_GID_PREFIX NC_ENTRY_PREFIX"GID"
-#define NC_SID_PREFIX NC_ENTRY_PREFIX"SID"
-#define NC_CERT_PREFIX NC_ENTRY_PREFIX"CERT"
 
-struct sss_nc_ctx {
-    struct tdb_context *tdb;
+/* Entries are kept in two hash tables keyed by (type, domain, value).
+ * Permanent entries, mostly the filter_users and filter_groups lists, live
+ * in their own table with a bloom filter in front of it, so the common case
+ * of an object which is not filtered is answered from a few bits. Checking
+ * an entry does not allocate memory unless the name has to be lowercased
+ * and is not plain ASCII. */
+
+#define NC_TABLE_INITIAL_SIZE 64
+/* bits of the bloom filter per bucket of the permanent table */
+#define NC_BLOOM_BITS_PER_BUCKET 16
+#define NC_BLOOM_HASHES 3
+
+/* Temporary entries can also be shared with the other responders through
+ * a file mapped by all of them. It only holds hashes of the keys, which
+ * are looked up in a fixed number of slots, and the time the entry was
+ * added; each responder applies its own timeout. Permanent entries depend
+ * on the configuration of the responder and are never shared. Writers
+ * acquire a slot by making its sequence number odd, readers ignore slots
+ * that are being written or were changed while reading. */
+#define NC_SHARED_MAGIC 0x4e435348 /* NCSH */
+#define NC_SHARED_VERSION 1
+#define NC_SHARED_SLOTS 32768
+/* slots probed for a key */
+#define NC_SHARED_PROBES 8
+
+struct sss_nc_shared_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t reserved;
 };
 
-typedef int (*ncache_set_byname_fn_t)(struct sss_nc_ctx *, bool,
-                                      const char *, const char *);
+struct sss_nc_shared_slot {
+    uint32_t seq;
+    uint32_t hash;
+    uint64_t check;
+    /* 0 for an empty slot */
+    int64_t timestamp;
+};
 
-static int sss_ncache_set_ent(struct sss_nc_ctx *ctx, bool permanent,
-                              struct sss_domain_info *dom, const char *name,
-                              ncache_set_byname_fn_t setter);
+#define NC_SHARED_SIZE(slots) (sizeof(struct sss_nc_shared_header) \
+                               + (slots) * sizeof(struct sss_nc_shared_slot))
+
+enum sss_nc_type {
+    SSS_NC_USER,
+    SSS_NC_GROUP,
+    SSS_NC_NETGROUP,
+    SSS_NC_SERVICE,
+    SSS_NC_UID,
+    SSS_NC_GID,
+    SSS_NC_SID,
+    SSS_NC_CERT,
+};
 
-static int string_to_tdb_data(char *str, TDB_DATA *ret)
-{
-    if (!str || !ret) return EINVAL;
+static const char *sss_nc_type_names[] = {
+    "USER", "GROUP", "NETGR", "SERVICE", "UID", "GID", "SID", "CERT"
+};
 
-    ret->dptr = (uint8_t *)str;
-    ret->dsize = strlen(str)+1;
+struct sss_nc_key {
+    enum sss_nc_type type;
+    /* NULL if the entry is not specific to a domain */
+    const char *domain;
+    /* NULL for entries keyed by an ID */
+    const char *value;
+    /* protocol of a service, NULL for any */
+    const char *value2;
+    uint32_t id;
+    /* value and value2 are compared ignoring case */
+    bool fold;
+};
 
-    return EOK;
-}
+struct sss_nc_entry {
+    struct sss_nc_entry *next;
+    uint32_t hash;
 
-int sss_ncache_init(TALLOC_CTX *memctx, struct sss_nc_ctx **_ctx)
-{
-    struct sss_nc_ctx *ctx;
+    enum sss_nc_type type;
+    char *domain;
+    char *value;
+    char *value2;
+    uint32_t id;
 
-    ctx = talloc_zero(memctx, struct sss_nc_ctx);
-    if (!ctx) return ENOMEM;
+    /* 0 for permanent entries */
+    time_t timestamp;
+};
 
-    errno = 0;
-    /* open a memory only tdb with default hash size */
-    ctx->tdb = tdb_open("memcache", 0, TDB_INTERNAL, O_RDWR|O_CREAT, 0);
-    if (!ctx->tdb) return errno;
+struct sss_nc_table {
+    struct sss_nc_entry **buckets;
+    uint32_t size;
+    uint32_t count;
+};
 
-    *_ctx = ctx;
-    return EOK;
+struct sss_nc_ctx {
+    struct sss_nc_table temporary;
+    struct sss_nc_table permanent;
+
+    uint8_t *bloom;
+    uint32_t bloom_bits;
+
+    /* shared with the other responders, may be NULL */
+    struct sss_nc_shared_slot *shared_slots;
+    uint32_t shared_num_slots;
+    void *shared_map;
+    size_t shared_size;
+
+    /* hits and misses, may be NULL */
+    struct sss_cmd_stats *stats;
 };
 
-static int sss_ncache_check_str(struct sss_nc_ctx *ctx, char *str, int ttl)
+/* FNV-1a, ASCII letters are hashed lowercase so that a case insensitive
+ * key does not have to be copied to be hashed */
+static uint32_t sss_nc_hash_str(uint32_t hash, const char *str)
 {
-    TDB_DATA key;
-    TDB_DATA data;
-    unsigned long long int timestamp;
-    bool expired = false;
-    char *ep;
-    int ret;
+    if (str == NULL) {
+        return hash * 16777619;
+    }
 
-    DEBUG(SSSDBG_TRACE_INTERNAL, "Checking negative cache for [%s]\n", str);
+    for (; *str != '\0'; str++) {
+        hash ^= (uint8_t)tolower((unsigned char)*str);
+        hash *= 16777619;
+    }
 
-    data.dptr = NULL;
+    /* the terminator separates the strings */
+    return hash * 16777619;
+}
 
-    ret = string_to_tdb_data(str, &key);
-    if (ret != EOK) goto done;
+static uint32_t sss_nc_key_hash(struct sss_nc_key *key)
+{
+    uint32_t hash = 2166136261U;
+    int i;
 
-    data = tdb_fetch(ctx->tdb, key);
+    hash ^= key->type;
+    hash *= 16777619;
 
-    if (!data.dptr) {
-        ret = ENOENT;
-        goto done;
+    for (i = 0; i < 4; i++) {
+        hash ^= (key->id >> (i * 8)) & 0xff;
+        hash *= 16777619;
     }
 
-    if (ttl == -1) {
-        /* a negative ttl means: never expires */
-        ret = EEXIST;
-        goto done;
-    }
+    hash = sss_nc_hash_str(hash, key->domain);
+    hash = sss_nc_hash_str(hash, key->value);
+    hash = sss_nc_hash_str(hash, key->value2);
 
-    errno = 0;
-    timestamp = strtoull((const char *)data.dptr, &ep, 10);
-    if (errno != 0 || *ep != '\0') {
-        /* Malformed entry, remove it and return no entry */
-        expired = true;
-        goto done;
+    return hash;
+}
+
+/* 64-bit FNV-1a of the same data, used to tell apart keys in the shared
+ * cache which only stores hashes. Unlike sss_nc_hash_str() it has to hash
+ * exactly what sss_nc_key_matches() compares, so ASCII letters are only
+ * lowercased if @fold is set. */
+static uint64_t sss_nc_hash_str64(uint64_t hash, const char *str, bool fold)
+{
+    if (str != NULL) {
+        for (; *str != '\0'; str++) {
+            if (fold) {
+                hash ^= (uint8_t)tolower((unsigned char)*str);
+            } else {
+                hash ^= (uint8_t)*str;
+            }
+            hash *= 1099511628211ULL;
+        }
     }
 
-    if (timestamp == 0) {
-        /* a 0 timestamp means this is a permanent entry */
-        ret = EEXIST;
-        goto done;
+    return hash * 1099511628211ULL;
+}
+
+static uint64_t sss_nc_key_check_hash(struct sss_nc_key *key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    int i;
+
+    hash ^= key->type;
+    hash *= 1099511628211ULL;
+
+    for (i = 0; i < 4; i++) {
+        hash ^= (key->id >> (i * 8)) & 0xff;
+        hash *= 1099511628211ULL;
     }
 
-    if (timestamp + ttl >= time(NULL)) {
-        /* still valid */
-        ret = EEXIST;
-        goto done;
+    hash = sss_nc_hash_str64(hash, key->domain, false);
+    hash = sss_nc_hash_str64(hash, key->value, key->fold);
+    hash = sss_nc_hash_str64(hash, key->value2, key->fold);
+
+    return hash;
+}
+
+/* @entry_str is lowercase already if @fold is set */
+static bool sss_nc_str_equal(const char *entry_str, const char *str,
+                             bool fold)
+{
+    if (entry_str == NULL || str == NULL) {
+        return entry_str == str;
     }
 
-    expired = true;
+    if (!fold) {
+        return strcmp(entry_str, str) == 0;
+    }
 
-done:
-    if (expired) {
-        /* expired, remove and return no entry */
-        tdb_delete(ctx->tdb, key);
-        ret = ENOENT;
+    for (; *str != '\0'; str++, entry_str++) {
+        if ((unsigned char)*entry_str != tolower((unsigned char)*str)) {
+            return false;
+        }
     }
 
-    free(data.dptr);
-    return ret;
+    return *entry_str == '\0';
 }
 
-static int sss_ncache_set_str(struct sss_nc_ctx *ctx,
-                              char *str, bool permanent)
+static bool sss_nc_key_matches(struct sss_nc_entry *entry,
+                               struct sss_nc_key *key, uint32_t hash)
 {
-    TDB_DATA key;
-    TDB_DATA data;
-    char *timest;
-    int ret;
+    return entry->hash == hash
+           && entry->type == key->type
+           && entry->id == key->id
+           && sss_nc_str_equal(entry->domain, key->domain, false)
+           && sss_nc_str_equal(entry->value, key->value, key->fold)
+           && sss_nc_str_equal(entry->value2, key->value2, key->fold);
+}
 
-    ret = string_to_tdb_data(str, &key);
-    if (ret != EOK) return ret;
+static bool sss_nc_is_ascii(const char *str)
+{
+    if (str == NULL) {
+        return true;
+    }
 
-    if (permanent) {
-        timest = talloc_strdup(ctx, "0");
-    } else {
-        timest = talloc_asprintf(ctx, "%llu",
-                                 (unsigned long long int)time(NULL));
+    for (; *str != '\0'; str++) {
+        if ((unsigned char)*str >= 0x80) {
+            return false;
+        }
     }
-    if (!timest) return ENOMEM;
 
-    ret = string_to_tdb_data(timest, &data);
-    if (ret != EOK) goto done;
+    return true;
+}
 
-    DEBUG(SSSDBG_TRACE_FUNC, "Adding [%s] to negative cache%s\n",
-              str, permanent?" permanently":"");
+static void sss_nc_key_debug(const char *action, struct sss_nc_key *key)
+{
+    if (key->value != NULL) {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "%s negative cache for %s [%s%s%s] "
+              "in [%s]\n", action, sss_nc_type_names[key->type], key->value,
+              key->value2 != NULL ? ":" : "",
+              key->value2 != NULL ? key->value2 : "",
+              key->domain != NULL ? key->domain : "");
+    } else {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "%s negative cache for %s [%"PRIu32
+              "%s%s] in [%s]\n", action, sss_nc_type_names[key->type],
+              key->id, key->value2 != NULL ? ":" : "",
+              key->value2 != NULL ? key->value2 : "",
+              key->domain != NULL ? key->domain : "");
+    }
+}
 
-    ret = tdb_store(ctx->tdb, key, data, TDB_REPLACE);
-    if (ret != 0) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Negative cache failed to set entry: [%s]\n",
-                  tdb_errorstr(ctx->tdb));
-        ret = EFAULT;
+static errno_t sss_nc_table_init(TALLOC_CTX *mem_ctx,
+                                 struct sss_nc_table *table)
+{
+    table->buckets = talloc_zero_array(mem_ctx, struct sss_nc_entry *,
+                                       NC_TABLE_INITIAL_SIZE);
+    if (table->buckets == NULL) {
+        return ENOMEM;
     }
+    table->size = NC_TABLE_INITIAL_SIZE;
+    table->count = 0;
 
-done:
-    talloc_free(timest);
-    return ret;
+    return EOK;
 }
 
-static int sss_ncache_check_user_int(struct sss_nc_ctx *ctx, int ttl,
-                                     const char *domain, const char *name)
+static struct sss_nc_entry **sss_nc_table_find(struct sss_nc_table *table,
+                                               struct sss_nc_key *key,
+                                               uint32_t hash)
 {
-    char *str;
-    int ret;
+    struct sss_nc_entry **link;
 
-    if (!name || !*name) return EINVAL;
+    for (link = &table->buckets[hash & (table->size - 1)];
+         *link != NULL;
+         link = &(*link)->next) {
+        if (sss_nc_key_matches(*link, key, hash)) {
+            return link;
+        }
+    }
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_USER_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+    return NULL;
+}
 
-    ret = sss_ncache_check_str(ctx, str, ttl);
+static void sss_nc_table_remove(struct sss_nc_table *table,
+                                struct sss_nc_entry **link)
+{
+    struct sss_nc_entry *entry = *link;
 
-    talloc_free(str);
-    return ret;
+    *link = entry->next;
+    table->count--;
+    talloc_free(entry);
 }
 
-static int sss_ncache_check_group_int(struct sss_nc_ctx *ctx, int ttl,
-                                      const char *domain, const char *name)
+/* Returns true if the table was resized */
+static bool sss_nc_table_add(TALLOC_CTX *mem_ctx,
+                             struct sss_nc_table *table,
+                             struct sss_nc_entry *entry)
 {
-    char *str;
-    int ret;
+    struct sss_nc_entry **buckets;
+    struct sss_nc_entry *iter;
+    struct sss_nc_entry *next;
+    uint32_t size;
+    uint32_t i;
+    uint32_t slot;
+    bool grown = false;
+
+    if (table->count >= table->size) {
+        size = table->size * 2;
+        buckets = talloc_zero_array(mem_ctx, struct sss_nc_entry *, size);
+        if (buckets != NULL) {
+            for (i = 0; i < table->size; i++) {
+                for (iter = table->buckets[i]; iter != NULL; iter = next) {
+                    next = iter->next;
+                    slot = iter->hash & (size - 1);
+                    iter->next = buckets[slot];
+                    buckets[slot] = iter;
+                }
+            }
+            talloc_free(table->buckets);
+            table->buckets = buckets;
+            table->size = size;
+            grown = true;
+        }
+        /* else keep the longer chains, it still works */
+    }
 
-    if (!name || !*name) return EINVAL;
+    slot = entry->hash & (table->size - 1);
+    entry->next = table->buckets[slot];
+    table->buckets[slot] = entry;
+    table->count++;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_GROUP_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+    return grown;
+}
 
-    ret = sss_ncache_check_str(ctx, str, ttl);
+static void sss_nc_bloom_add(struct sss_nc_ctx *ctx, uint32_t hash)
+{
+    uint32_t h2 = (hash >> 16 | hash << 16) | 1;
+    uint32_t bit;
+    int i;
 
-    talloc_free(str);
-    return ret;
+    for (i = 0; i < NC_BLOOM_HASHES; i++) {
+        bit = (hash + i * h2) & (ctx->bloom_bits - 1);
+        ctx->bloom[bit / 8] |= 1 << (bit % 8);
+    }
 }
 
-static int sss_ncache_check_netgr_int(struct sss_nc_ctx *ctx, int ttl,
-                                      const char *domain, const char *name)
+static bool sss_nc_bloom_check(struct sss_nc_ctx *ctx, uint32_t hash)
 {
-    char *str;
-    int ret;
+    uint32_t h2 = (hash >> 16 | hash << 16) | 1;
+    uint32_t bit;
+    int i;
 
-    if (!name || !*name) return EINVAL;
+    if (ctx->bloom == NULL) {
+        /* unable to build it, check the table */
+        return true;
+    }
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_NETGROUP_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+    for (i = 0; i < NC_BLOOM_HASHES; i++) {
+        bit = (hash + i * h2) & (ctx->bloom_bits - 1);
+        if ((ctx->bloom[bit / 8] & (1 << (bit % 8))) == 0) {
+            return false;
+        }
+    }
 
-    ret = sss_ncache_check_str(ctx, str, ttl);
+    return true;
+}
 
-    talloc_free(str);
-    return ret;
+/* Size the bloom filter to the permanent table and fill it again, which
+ * also drops the bits of removed entries */
+static void sss_nc_bloom_rebuild(struct sss_nc_ctx *ctx)
+{
+    struct sss_nc_entry *iter;
+    uint32_t i;
+
+    talloc_zfree(ctx->bloom);
+
+    ctx->bloom_bits = ctx->permanent.size * NC_BLOOM_BITS_PER_BUCKET;
+    ctx->bloom = talloc_zero_array(ctx, uint8_t, ctx->bloom_bits / 8);
+    if (ctx->bloom == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to allocate the negative cache bloom filter\n");
+        return;
+    }
+
+    for (i = 0; i < ctx->permanent.size; i++) {
+        for (iter = ctx->permanent.buckets[i]; iter != NULL;
+             iter = iter->next) {
+            sss_nc_bloom_add(ctx, iter->hash);
+        }
+    }
 }
 
-static int sss_ncache_check_service_int(struct sss_nc_ctx *ctx,
-                                        int ttl,
-                                        const char *domain,
-                                        const char *name)
+static bool sss_nc_shared_check(struct sss_nc_ctx *ctx, int ttl,
+                                uint32_t hash, uint64_t check)
 {
-    char *str;
-    int ret;
+    struct sss_nc_shared_slot *slot;
+    uint32_t seq;
+    uint32_t slot_hash;
+    uint64_t slot_check;
+    int64_t timestamp;
+    int i;
 
-    if (!name || !*name) return EINVAL;
+    if (ctx->shared_slots == NULL) {
+        return false;
+    }
 
-    str = talloc_asprintf(ctx, "%s/%s/%s",
-                          NC_SERVICE_PREFIX,
-                          domain,
-                          name);
-    if (!str) return ENOMEM;
+    for (i = 0; i < NC_SHARED_PROBES; i++) {
+        slot = &ctx->shared_slots[(hash + i) % ctx->shared_num_slots];
 
-    ret = sss_ncache_check_str(ctx, str, ttl);
+        seq = slot->seq;
+        if (seq & 1) {
+            /* being written */
+            continue;
+        }
+        __sync_synchronize();
+        slot_hash = slot->hash;
+        slot_check = slot->check;
+        timestamp = slot->timestamp;
+        __sync_synchronize();
+        if (slot->seq != seq) {
+            continue;
+        }
 
-    talloc_free(str);
-    return ret;
+        if (timestamp == 0 || slot_hash != hash || slot_check != check) {
+            continue;
+        }
+
+        return ttl == -1 || timestamp + ttl >= time(NULL);
+    }
+
+    return false;
 }
 
-typedef int (*ncache_check_byname_fn_t)(struct sss_nc_ctx *, int,
-                                        const char *, const char *);
+static void sss_nc_shared_set(struct sss_nc_ctx *ctx,
+                              uint32_t hash, uint64_t check,
+                              time_t timestamp)
+{
+    struct sss_nc_shared_slot *slot;
+    struct sss_nc_shared_slot *victim = NULL;
+    uint32_t seq;
+    int i;
+
+    if (ctx->shared_slots == NULL) {
+        return;
+    }
+
+    /* reuse the slot of the key, otherwise replace the oldest entry */
+    for (i = 0; i < NC_SHARED_PROBES; i++) {
+        slot = &ctx->shared_slots[(hash + i) % ctx->shared_num_slots];
+
+        if (slot->hash == hash && slot->check == check) {
+            victim = slot;
+            break;
+        }
+        if (victim == NULL || slot->timestamp < victim->timestamp) {
+            victim = slot;
+        }
+    }
+
+    seq = victim->seq;
+    if ((seq & 1)
+            || !__sync_bool_compare_and_swap(&victim->seq, seq, seq + 1)) {
+        /* another responder is writing it, the entry is not shared */
+        return;
+    }
+
+    victim->hash = hash;
+    victim->check = check;
+    victim->timestamp = timestamp;
+
+    __sync_synchronize();
+    victim->seq = seq + 2;
+}
 
-static int sss_cache_check_ent(struct sss_nc_ctx *ctx, int ttl,
-                               struct sss_domain_info *dom, const char *name,
-                               ncache_check_byname_fn_t checker)
+/* Creates a complete cache file under @path, fails with EEXIST if the
+ * file exists */
+static errno_t sss_nc_shared_create(const char *path)
 {
-    char *lower;
+    struct sss_nc_shared_header header = { 0 };
+    char *tmp_path;
     errno_t ret;
+    int fd;
 
-    if (dom->case_sensitive == false) {
-        lower = sss_tc_utf8_str_tolower(ctx, name);
-        if (!lower) return ENOMEM;
-        ret = checker(ctx, ttl, dom->name, lower);
-        talloc_free(lower);
-    } else {
-        ret = checker(ctx, ttl, dom->name, name);
+    tmp_path = talloc_asprintf(NULL, "%s.XXXXXX", path);
+    if (tmp_path == NULL) {
+        return ENOMEM;
+    }
+
+    fd = sss_unique_file(NULL, tmp_path, &ret);
+    if (fd == -1) {
+        talloc_free(tmp_path);
+        return ret;
+    }
+
+    ret = ftruncate(fd, NC_SHARED_SIZE(NC_SHARED_SLOTS));
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    header.magic = NC_SHARED_MAGIC;
+    header.version = NC_SHARED_VERSION;
+    header.num_slots = NC_SHARED_SLOTS;
+
+    ret = sss_atomic_write_s(fd, &header, sizeof(header));
+    if (ret != sizeof(header)) {
+        ret = ret == -1 ? errno : EIO;
+        goto done;
+    }
+
+    /* unlike rename(), link() does not replace a file created meanwhile
+     * by another responder */
+    ret = link(tmp_path, path);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
     }
 
+    ret = EOK;
+
+done:
+    close(fd);
+    unlink(tmp_path);
+    talloc_free(tmp_path);
     return ret;
 }
 
-int sss_ncache_check_user(struct sss_nc_ctx *ctx, int ttl,
-                          struct sss_domain_info *dom, const char *name)
+static errno_t sss_nc_shared_map(struct sss_nc_ctx *ctx, const char *path)
 {
-    return sss_cache_check_ent(ctx, ttl, dom, name,
-                               sss_ncache_check_user_int);
-}
+    struct sss_nc_shared_header *header;
+    struct stat st;
+    void *map;
+    errno_t ret;
+    int fd;
 
-int sss_ncache_check_group(struct sss_nc_ctx *ctx, int ttl,
-                           struct sss_domain_info *dom, const char *name)
-{
-    return sss_cache_check_ent(ctx, ttl, dom, name,
-                               sss_ncache_check_group_int);
+    fd = sss_open_cloexec(path, O_RDWR, &ret);
+    if (fd == -1) {
+        return ret;
+    }
+
+    ret = fstat(fd, &st);
+    if (ret == -1) {
+        ret = errno;
+        close(fd);
+        return ret;
+    }
+
+    if (st.st_size < NC_SHARED_SIZE(0)) {
+        close(fd);
+        return EINVAL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ret = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        return ret;
+    }
+
+    header = (struct sss_nc_shared_header *)map;
+    if (header->magic != NC_SHARED_MAGIC
+            || header->version != NC_SHARED_VERSION
+            || header->num_slots == 0
+            || NC_SHARED_SIZE(header->num_slots) > st.st_size) {
+        munmap(map, st.st_size);
+        return EINVAL;
+    }
+
+    ctx->shared_map = map;
+    ctx->shared_size = st.st_size;
+    ctx->shared_num_slots = header->num_slots;
+    ctx->shared_slots = (struct sss_nc_shared_slot *)(header + 1);
+
+    return EOK;
 }
 
-int sss_ncache_check_netgr(struct sss_nc_ctx *ctx, int ttl,
-                           struct sss_domain_info *dom, const char *name)
+static int sss_nc_ctx_destructor(struct sss_nc_ctx *ctx)
 {
-    return sss_cache_check_ent(ctx, ttl, dom, name,
-                               sss_ncache_check_netgr_int);
+    if (ctx->shared_map != NULL) {
+        munmap(ctx->shared_map, ctx->shared_size);
+    }
+
+    return 0;
 }
 
-static int sss_ncache_set_service_int(struct sss_nc_ctx *ctx, bool permanent,
-                                      const char *domain, const char *name)
+errno_t sss_ncache_share(struct sss_nc_ctx *ctx, const char *path)
 {
-    char *str;
-    int ret;
+    errno_t ret;
+    int i;
 
-    if (!name || !*name) return EINVAL;
+    if (ctx->shared_map != NULL) {
+        return EOK;
+    }
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_SERVICE_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+    for (i = 0; i < 2; i++) {
+        ret = sss_nc_shared_map(ctx, path);
+        if (ret == EOK) {
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "Sharing the negative cache through [%s]\n", path);
+            return EOK;
+        } else if (ret == EINVAL) {
+            /* left by an incompatible version, the responders which still
+             * map it keep using it */
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Replacing invalid shared negative cache [%s]\n", path);
+            unlink(path);
+        } else if (ret != ENOENT) {
+            break;
+        }
 
-    ret = sss_ncache_set_str(ctx, str, permanent);
+        ret = sss_nc_shared_create(path);
+        if (ret != EOK && ret != EEXIST) {
+            break;
+        }
+    }
 
-    talloc_free(str);
+    DEBUG(SSSDBG_OP_FAILURE,
+          "Unable to share the negative cache through [%s] [%d]: %s\n",
+          path, ret, sss_strerror(ret));
     return ret;
 }
 
-int sss_ncache_set_service_name(struct sss_nc_ctx *ctx, bool permanent,
-                                struct sss_domain_info *dom,
-                                const char *name, const char *proto)
+void sss_ncache_set_stats(struct sss_nc_ctx *ctx, struct sss_cmd_stats *stats)
 {
-    int ret;
-    char *service_and_protocol = talloc_asprintf(ctx, "%s:%s",
-                                                 name,
-                                                 proto ? proto : "<ANY>");
-    if (!service_and_protocol) return ENOMEM;
-
-    ret = sss_ncache_set_ent(ctx, permanent, dom,
-                             service_and_protocol,
-                             sss_ncache_set_service_int);
-    talloc_free(service_and_protocol);
-    return ret;
+    ctx->stats = stats;
 }
 
-int sss_ncache_check_service(struct sss_nc_ctx *ctx, int ttl,
-                             struct sss_domain_info *dom,
-                             const char *name,
-                             const char *proto)
+int sss_ncache_init(TALLOC_CTX *memctx, struct sss_nc_ctx **_ctx)
 {
-    int ret;
-    char *service_and_protocol = talloc_asprintf(ctx, "%s:%s",
-                                                 name,
-                                                 proto ? proto : "<ANY>");
-    if (!service_and_protocol) return ENOMEM;
-
-    ret = sss_cache_check_ent(ctx, ttl, dom, service_and_protocol,
-                              sss_ncache_check_service_int);
-    talloc_free(service_and_protocol);
-    return ret;
-}
+    struct sss_nc_ctx *ctx;
+    errno_t ret;
 
-int sss_ncache_set_service_port(struct sss_nc_ctx *ctx, bool permanent,
-                                struct sss_domain_info *dom,
-                                uint16_t port, const char *proto)
-{
-    int ret;
-    char *service_and_protocol = talloc_asprintf(ctx, "%ul:%s",
-                                                 port,
-                                                 proto ? proto : "<ANY>");
-    if (!service_and_protocol) return ENOMEM;
-
-    ret = sss_ncache_set_ent(ctx, permanent, dom,
-                             service_and_protocol,
-                             sss_ncache_set_service_int);
-    talloc_free(service_and_protocol);
+    ctx = talloc_zero(memctx, struct sss_nc_ctx);
+    if (!ctx) return ENOMEM;
+
+    ret = sss_nc_table_init(ctx, &ctx->temporary);
+    if (ret != EOK) goto fail;
+
+    ret = sss_nc_table_init(ctx, &ctx->permanent);
+    if (ret != EOK) goto fail;
+
+    sss_nc_bloom_rebuild(ctx);
+
+    talloc_set_destructor(ctx, sss_nc_ctx_destructor);
+
+    *_ctx = ctx;
+    return EOK;
+
+fail:
+    talloc_free(ctx);
     return ret;
-}
+};
 
-int sss_ncache_check_service_port(struct sss_nc_ctx *ctx, int ttl,
-                                  struct sss_domain_info *dom,
-                                  uint16_t port,
-                                  const char *proto)
+static int sss_ncache_check_key(struct sss_nc_ctx *ctx, int ttl,
+                                struct sss_nc_key *key)
 {
+    struct sss_nc_entry **link;
+    char *lower = NULL;
+    char *lower2 = NULL;
+    uint32_t hash;
     int ret;
-    char *service_and_protocol = talloc_asprintf(ctx, "%ul:%s",
-                                                 port,
-                                                 proto ? proto : "<ANY>");
-    if (!service_and_protocol) return ENOMEM;
-
-    ret = sss_cache_check_ent(ctx, ttl, dom, service_and_protocol,
-                              sss_ncache_check_service_int);
-    talloc_free(service_and_protocol);
-    return ret;
-}
 
+    if (key->fold && !(sss_nc_is_ascii(key->value)
+                       && sss_nc_is_ascii(key->value2))) {
+        /* stored lowercase, only ASCII can be compared in place */
+        if (key->value != NULL) {
+            lower = sss_tc_utf8_str_tolower(ctx, key->value);
+            if (lower == NULL) return ENOMEM;
+            key->value = lower;
+        }
+        if (key->value2 != NULL) {
+            lower2 = sss_tc_utf8_str_tolower(ctx, key->value2);
+            if (lower2 == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            key->value2 = lower2;
+        }
+    }
 
+    sss_nc_key_debug("Checking", key);
 
-int sss_ncache_check_uid(struct sss_nc_ctx *ctx, int ttl,
-                         struct sss_domain_info *dom, uid_t uid)
-{
-    char *str;
-    int ret;
+    hash = sss_nc_key_hash(key);
 
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%"SPRIuid, NC_UID_PREFIX, dom->name,
-                              uid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%"SPRIuid, NC_UID_PREFIX, uid);
+    if (sss_nc_bloom_check(ctx, hash)
+            && sss_nc_table_find(&ctx->permanent, key, hash) != NULL) {
+        /* a permanent entry never expires */
+        ret = EEXIST;
+        goto done;
+    }
+
+    link = sss_nc_table_find(&ctx->temporary, key, hash);
+    if (link == NULL) {
+        /* maybe another responder found out */
+        if (sss_nc_shared_check(ctx, ttl, hash, sss_nc_key_check_hash(key))) {
+            ret = EEXIST;
+        } else {
+            ret = ENOENT;
+        }
+        goto done;
+    }
+
+    if (ttl == -1) {
+        /* a negative ttl means: never expires */
+        ret = EEXIST;
+        goto done;
+    }
+
+    if ((*link)->timestamp + ttl >= time(NULL)) {
+        /* still valid */
+        ret = EEXIST;
+        goto done;
     }
-    if (!str) return ENOMEM;
 
-    ret = sss_ncache_check_str(ctx, str, ttl);
+    /* expired, remove and return no entry */
+    sss_nc_table_remove(&ctx->temporary, link);
+    ret = ENOENT;
 
-    talloc_free(str);
+done:
+    if (ret == EEXIST) {
+        sss_cmd_stats_count(ctx->stats, SSS_CACHE_NCACHE_HIT);
+    } else if (ret == ENOENT) {
+        sss_cmd_stats_count(ctx->stats, SSS_CACHE_NCACHE_MISS);
+    }
+    talloc_free(lower);
+    talloc_free(lower2);
     return ret;
 }
 
-int sss_ncache_check_gid(struct sss_nc_ctx *ctx, int ttl,
-                         struct sss_domain_info *dom, gid_t gid)
+static int sss_ncache_set_key(struct sss_nc_ctx *ctx, bool permanent,
+                              struct sss_nc_key *key)
 {
-    char *str;
-    int ret;
+    struct sss_nc_entry **link;
+    struct sss_nc_entry *entry;
+    uint32_t hash;
+    bool grown;
+
+    entry = talloc_zero(ctx, struct sss_nc_entry);
+    if (!entry) return ENOMEM;
+
+    entry->type = key->type;
+    entry->id = key->id;
+    entry->timestamp = permanent ? 0 : time(NULL);
+
+    if (key->domain != NULL) {
+        entry->domain = talloc_strdup(entry, key->domain);
+        if (!entry->domain) goto fail;
+    }
+
+    if (key->value != NULL) {
+        entry->value = key->fold ? sss_tc_utf8_str_tolower(entry, key->value)
+                                 : talloc_strdup(entry, key->value);
+        if (!entry->value) goto fail;
+    }
+
+    if (key->value2 != NULL) {
+        entry->value2 = key->fold
+                            ? sss_tc_utf8_str_tolower(entry, key->value2)
+                            : talloc_strdup(entry, key->value2);
+        if (!entry->value2) goto fail;
+    }
+
+    /* look the entry up as stored */
+    key->value = entry->value;
+    key->value2 = entry->value2;
+    key->fold = false;
+    hash = sss_nc_key_hash(key);
+    entry->hash = hash;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Adding %s [%s%s%s] to negative cache%s\n",
+          sss_nc_type_names[key->type],
+          key->value != NULL ? key->value : "",
+          key->value2 != NULL ? ":" : "",
+          key->value2 != NULL ? key->value2 : "",
+          permanent ? " permanently" : "");
+
+    /* the new entry replaces an existing one, permanent or not */
+    link = sss_nc_table_find(&ctx->permanent, key, hash);
+    if (link != NULL) {
+        /* its bits stay in the bloom filter until it is rebuilt */
+        sss_nc_table_remove(&ctx->permanent, link);
+    }
+    link = sss_nc_table_find(&ctx->temporary, key, hash);
+    if (link != NULL) {
+        sss_nc_table_remove(&ctx->temporary, link);
+    }
+
+    if (!permanent) {
+        sss_nc_table_add(ctx, &ctx->temporary, entry);
+        sss_nc_shared_set(ctx, hash, sss_nc_key_check_hash(key),
+                          entry->timestamp);
+        return EOK;
+    }
 
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%"SPRIgid, NC_GID_PREFIX, dom->name,
-                              gid);
+    grown = sss_nc_table_add(ctx, &ctx->permanent, entry);
+    if (grown || ctx->bloom == NULL) {
+        sss_nc_bloom_rebuild(ctx);
     } else {
-        str = talloc_asprintf(ctx, "%s/%"SPRIgid, NC_GID_PREFIX, gid);
+        sss_nc_bloom_add(ctx, hash);
     }
-    if (!str) return ENOMEM;
 
-    ret = sss_ncache_check_str(ctx, str, ttl);
+    return EOK;
 
-    talloc_free(str);
-    return ret;
+fail:
+    talloc_free(entry);
+    return ENOMEM;
 }
 
-int sss_ncache_check_sid(struct sss_nc_ctx *ctx, int ttl, const char *sid)
+static int sss_ncache_check_name(struct sss_nc_ctx *ctx, int ttl,
+                                 enum sss_nc_type type,
+                                 struct sss_domain_info *dom,
+                                 const char *name, const char *proto)
 {
-    char *str;
-    int ret;
+    struct sss_nc_key key = { 0 };
 
-    str = talloc_asprintf(ctx, "%s/%s", NC_SID_PREFIX, sid);
-    if (!str) return ENOMEM;
+    if (!name || !*name) return EINVAL;
 
-    ret = sss_ncache_check_str(ctx, str, ttl);
+    key.type = type;
+    key.domain = dom->name;
+    key.value = name;
+    key.value2 = proto;
+    key.fold = !dom->case_sensitive;
 
-    talloc_free(str);
-    return ret;
+    return sss_ncache_check_key(ctx, ttl, &key);
 }
 
-int sss_ncache_check_cert(struct sss_nc_ctx *ctx, int ttl, const char *cert)
+static int sss_ncache_set_name(struct sss_nc_ctx *ctx, bool permanent,
+                               enum sss_nc_type type,
+                               struct sss_domain_info *dom,
+                               const char *name, const char *proto)
 {
-    char *str;
-    int ret;
+    struct sss_nc_key key = { 0 };
 
-    str = talloc_asprintf(ctx, "%s/%s", NC_CERT_PREFIX, cert);
-    if (!str) return ENOMEM;
+    if (!name || !*name) return EINVAL;
 
-    ret = sss_ncache_check_str(ctx, str, ttl);
+    key.type = type;
+    key.domain = dom->name;
+    key.value = name;
+    key.value2 = proto;
+    key.fold = !dom->case_sensitive;
 
-    talloc_free(str);
-    return ret;
+    return sss_ncache_set_key(ctx, permanent, &key);
 }
 
+static int sss_ncache_check_id(struct sss_nc_ctx *ctx, int ttl,
+                               enum sss_nc_type type,
+                               struct sss_domain_info *dom,
+                               uint32_t id, const char *proto, bool fold)
+{
+    struct sss_nc_key key = { 0 };
+
+    key.type = type;
+    key.domain = dom != NULL ? dom->name : NULL;
+    key.id = id;
+    key.value2 = proto;
+    key.fold = fold;
 
-static int sss_ncache_set_user_int(struct sss_nc_ctx *ctx, bool permanent,
-                                   const char *domain, const char *name)
+    return sss_ncache_check_key(ctx, ttl, &key);
+}
+
+static int sss_ncache_set_id(struct sss_nc_ctx *ctx, bool permanent,
+                             enum sss_nc_type type,
+                             struct sss_domain_info *dom,
+                             uint32_t id, const char *proto, bool fold)
 {
-    char *str;
-    int ret;
+    struct sss_nc_key key = { 0 };
 
-    if (!name || !*name) return EINVAL;
+    key.type = type;
+    key.domain = dom != NULL ? dom->name : NULL;
+    key.id = id;
+    key.value2 = proto;
+    key.fold = fold;
+
+    return sss_ncache_set_key(ctx, permanent, &key);
+}
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_USER_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+static int sss_ncache_check_global(struct sss_nc_ctx *ctx, int ttl,
+                                   enum sss_nc_type type, const char *value)
+{
+    struct sss_nc_key key = { 0 };
 
-    ret = sss_ncache_set_str(ctx, str, permanent);
+    if (!value) return EINVAL;
 
-    talloc_free(str);
-    return ret;
+    key.type = type;
+    key.value = value;
+
+    return sss_ncache_check_key(ctx, ttl, &key);
 }
 
-static int sss_ncache_set_group_int(struct sss_nc_ctx *ctx, bool permanent,
-                                    const char *domain, const char *name)
+static int sss_ncache_set_global(struct sss_nc_ctx *ctx, bool permanent,
+                                 enum sss_nc_type type, const char *value)
 {
-    char *str;
-    int ret;
+    struct sss_nc_key key = { 0 };
 
-    if (!name || !*name) return EINVAL;
+    if (!value) return EINVAL;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_GROUP_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+    key.type = type;
+    key.value = value;
 
-    ret = sss_ncache_set_str(ctx, str, permanent);
+    return sss_ncache_set_key(ctx, permanent, &key);
+}
 
-    talloc_free(str);
-    return ret;
+int sss_ncache_check_user(struct sss_nc_ctx *ctx, int ttl,
+                          struct sss_domain_info *dom, const char *name)
+{
+    return sss_ncache_check_name(ctx, ttl, SSS_NC_USER, dom, name, NULL);
 }
 
-static int sss_ncache_set_netgr_int(struct sss_nc_ctx *ctx, bool permanent,
-                                    const char *domain, const char *name)
+int sss_ncache_check_group(struct sss_nc_ctx *ctx, int ttl,
+                           struct sss_domain_info *dom, const char *name)
 {
-    char *str;
-    int ret;
+    return sss_ncache_check_name(ctx, ttl, SSS_NC_GROUP, dom, name, NULL);
+}
 
-    if (!name || !*name) return EINVAL;
+int sss_ncache_check_netgr(struct sss_nc_ctx *ctx, int ttl,
+                           struct sss_domain_info *dom, const char *name)
+{
+    return sss_ncache_check_name(ctx, ttl, SSS_NC_NETGROUP, dom, name, NULL);
+}
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_NETGROUP_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+int sss_ncache_set_service_name(struct sss_nc_ctx *ctx, bool permanent,
+                                struct sss_domain_info *dom,
+                                const char *name, const char *proto)
+{
+    return sss_ncache_set_name(ctx, permanent, SSS_NC_SERVICE, dom,
+                               name, proto);
+}
 
-    ret = sss_ncache_set_str(ctx, str, permanent);
+int sss_ncache_check_service(struct sss_nc_ctx *ctx, int ttl,
+                             struct sss_domain_info *dom,
+                             const char *name,
+                             const char *proto)
+{
+    return sss_ncache_check_name(ctx, ttl, SSS_NC_SERVICE, dom, name, proto);
+}
 
-    talloc_free(str);
-    return ret;
+int sss_ncache_set_service_port(struct sss_nc_ctx *ctx, bool permanent,
+                                struct sss_domain_info *dom,
+                                uint16_t port, const char *proto)
+{
+    return sss_ncache_set_id(ctx, permanent, SSS_NC_SERVICE, dom, port,
+                             proto, !dom->case_sensitive);
 }
 
-static int sss_ncache_set_ent(struct sss_nc_ctx *ctx, bool permanent,
-                              struct sss_domain_info *dom, const char *name,
-                              ncache_set_byname_fn_t setter)
+int sss_ncache_check_service_port(struct sss_nc_ctx *ctx, int ttl,
+                                  struct sss_domain_info *dom,
+                                  uint16_t port,
+                                  const char *proto)
 {
-    char *lower;
-    errno_t ret;
+    return sss_ncache_check_id(ctx, ttl, SSS_NC_SERVICE, dom, port,
+                               proto, !dom->case_sensitive);
+}
 
-    if (dom->case_sensitive == false) {
-        lower = sss_tc_utf8_str_tolower(ctx, name);
-        if (!lower) return ENOMEM;
-        ret = setter(ctx, permanent, dom->name, lower);
-        talloc_free(lower);
-    } else {
-        ret = setter(ctx, permanent, dom->name, name);
-    }
+int sss_ncache_check_uid(struct sss_nc_ctx *ctx, int ttl,
+                         struct sss_domain_info *dom, uid_t uid)
+{
+    return sss_ncache_check_id(ctx, ttl, SSS_NC_UID, dom, uid, NULL, false);
+}
 
-    return ret;
+int sss_ncache_check_gid(struct sss_nc_ctx *ctx, int ttl,
+                         struct sss_domain_info *dom, gid_t gid)
+{
+    return sss_ncache_check_id(ctx, ttl, SSS_NC_GID, dom, gid, NULL, false);
+}
+
+int sss_ncache_check_sid(struct sss_nc_ctx *ctx, int ttl, const char *sid)
+{
+    return sss_ncache_check_global(ctx, ttl, SSS_NC_SID, sid);
 }
 
+int sss_ncache_check_cert(struct sss_nc_ctx *ctx, int ttl, const char *cert)
+{
+    return sss_ncache_check_global(ctx, ttl, SSS_NC_CERT, cert);
+}
 
 int sss_ncache_set_user(struct sss_nc_ctx *ctx, bool permanent,
                         struct sss_domain_info *dom, const char *name)
 {
-    return sss_ncache_set_ent(ctx, permanent, dom, name, sss_ncache_set_user_int);
+    return sss_ncache_set_name(ctx, permanent, SSS_NC_USER, dom, name, NULL);
 }
 
 int sss_ncache_set_group(struct sss_nc_ctx *ctx, bool permanent,
                          struct sss_domain_info *dom, const char *name)
 {
-    return sss_ncache_set_ent(ctx, permanent, dom, name, sss_ncache_set_group_int);
+    return sss_ncache_set_name(ctx, permanent, SSS_NC_GROUP, dom, name, NULL);
 }
 
 int sss_ncache_set_netgr(struct sss_nc_ctx *ctx, bool permanent,
                          struct sss_domain_info *dom, const char *name)
 {
-    return sss_ncache_set_ent(ctx, permanent, dom, name, sss_ncache_set_netgr_int);
+    return sss_ncache_set_name(ctx, permanent, SSS_NC_NETGROUP, dom,
+                               name, NULL);
 }
 
 int sss_ncache_set_uid(struct sss_nc_ctx *ctx, bool permanent,
                        struct sss_domain_info *dom, uid_t uid)
 {
-    char *str;
-    int ret;
-
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%"SPRIuid, NC_UID_PREFIX, dom->name,
-                              uid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%"SPRIuid, NC_UID_PREFIX, uid);
-    }
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_ncache_set_id(ctx, permanent, SSS_NC_UID, dom, uid,
+                             NULL, false);
 }
 
 int sss_ncache_set_gid(struct sss_nc_ctx *ctx, bool permanent,
                        struct sss_domain_info *dom, gid_t gid)
 {
-    char *str;
-    int ret;
-
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%"SPRIgid, NC_GID_PREFIX, dom->name,
-                              gid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%"SPRIgid, NC_GID_PREFIX, gid);
-    }
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_ncache_set_id(ctx, permanent, SSS_NC_GID, dom, gid,
+                             NULL, false);
 }
 
 int sss_ncache_set_sid(struct sss_nc_ctx *ctx, bool permanent, const char *sid)
 {
-    char *str;
-    int ret;
-
-    str = talloc_asprintf(ctx, "%s/%s", NC_SID_PREFIX, sid);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_ncache_set_global(ctx, permanent, SSS_NC_SID, sid);
 }
 
 int sss_ncache_set_cert(struct sss_nc_ctx *ctx, bool permanent,
                         const char *cert)
 {
-    char *str;
-    int ret;
-
-    str = talloc_asprintf(ctx, "%s/%s", NC_CERT_PREFIX, cert);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_ncache_set_global(ctx, permanent, SSS_NC_CERT, cert);
 }
 
-static int delete_permanent(struct tdb_context *tdb,
-                            TDB_DATA key, TDB_DATA data, void *state)
+int sss_ncache_reset_permanent(struct sss_nc_ctx *ctx)
 {
-    unsigned long long int timestamp;
-    bool remove_key = false;
-    char *ep;
-
-    if (strncmp((char *)key.dptr,
-                NC_ENTRY_PREFIX, sizeof(NC_ENTRY_PREFIX) - 1) != 0) {
-        /* not interested in this key */
-        return 0;
-    }
-
-    errno = 0;
-    timestamp = strtoull((const char *)data.dptr, &ep, 10);
-    if (errno != 0 || *ep != '\0') {
-        /* Malformed entry, remove it */
-        remove_key = true;
-        goto done;
-    }
+    struct sss_nc_table table;
+    struct sss_nc_entry *iter;
+    struct sss_nc_entry *next;
+    uint32_t i;
+    errno_t ret;
 
-    if (timestamp == 0) {
-        /* a 0 timestamp means this is a permanent entry */
-        remove_key = true;
+    ret = sss_nc_table_init(ctx, &table);
+    if (ret != EOK) {
+        return ret;
     }
 
-done:
-    if (remove_key) {
-        return tdb_delete(tdb, key);
+    for (i = 0; i < ctx->permanent.size; i++) {
+        for (iter = ctx->permanent.buckets[i]; iter != NULL; iter = next) {
+            next = iter->next;
+            talloc_free(iter);
+        }
     }
+    talloc_free(ctx->permanent.buckets);
+    ctx->permanent = table;
 
-    return 0;
-}
-
-int sss_ncache_reset_permanent(struct sss_nc_ctx *ctx)
-{
-    int ret;
-
-    ret = tdb_traverse(ctx->tdb, delete_permanent, NULL);
-    if (ret < 0)
-        return EIO;
+    sss_nc_bloom_rebuild(ctx);
 
     return EOK;
 }
@@ -24,9 +24,20 @@
 
 struct sss_nc_ctx;
 
+/* file through which the responders share their negative caches */
+#define SSS_NCACHE_SHARED_FILE DB_PATH"/negcache"
+
 /* init the in memory negative cache */
 int sss_ncache_init(TALLOC_CTX *memctx, struct sss_nc_ctx **_ctx);
 
+/* share the temporary entries with the other responders through the file
+ * @path, which is created if it does not exist yet */
+errno_t sss_ncache_share(struct sss_nc_ctx *ctx, const char *path);
+
+/* count the hits and misses of the checks in the statistics of the
+ * responder, @stats may be NULL */
+void sss_ncache_set_stats(struct sss_nc_ctx *ctx, struct sss_cmd_stats *stats);
+
 /* check if the user is expired according to the passed in time to live */
 int sss_ncache_check_user(struct sss_nc_ctx *ctx, int ttl,
                           struct sss_domain_info *dom, const char *name);
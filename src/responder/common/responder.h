@@ -59,6 +59,18 @@ struct cli_request {
 
     /* reply data */
     struct sss_packet *out;
+
+    /* for the command statistics, see sss_cmd_execute() */
+    enum sss_cli_command cmd;
+    struct timeval start;
+    enum sss_cmd_source source;
+
+    /* the id of the request in the logs of the responder and of the data
+     * provider, and the stages of a slow request, see client_log_slow() */
+    uint32_t id;
+    struct timeval exec;
+    struct timeval reply;
+    uint64_t dp_usec;
 };
 
 struct cli_protocol_version {
@@ -68,6 +80,11 @@ struct cli_protocol_version {
 };
 
 struct resp_ctx;
+struct cli_ctx;
+struct sss_objcache;
+struct sss_hotlist;
+struct sss_dp_fast_conn;
+struct cli_sched;
 
 struct be_conn {
     struct be_conn *next;
@@ -80,6 +97,8 @@ struct be_conn {
 
     char *sbus_address;
     struct sbus_connection *conn;
+    /* the socket of the account requests, see responder_dp_fast.c */
+    struct sss_dp_fast_conn *fast;
 };
 
 struct resp_ctx {
@@ -98,12 +117,30 @@ struct resp_ctx {
     struct sss_domain_info *domains;
     int domains_timeout;
     int client_idle_timeout;
+    bool dp_fast_transport;
+    /* look up unqualified names in all domains at once */
+    bool parallel_domain_lookup;
 
     struct sss_cmd_table *sss_cmds;
     const char *sss_pipe_name;
     const char *confdb_service_path;
 
     hash_table_t *dp_request_table;
+    /* cache lookups in progress, see responder_cache_req.c */
+    hash_table_t *cache_req_table;
+    /* recently looked up objects, see responder_objcache.c */
+    struct sss_objcache *obj_cache;
+    /* popular objects to refresh early, see responder_hotlist.c */
+    struct sss_hotlist *hotlist;
+    /* latency of the replies, may be NULL */
+    struct sss_cmd_stats *cmd_stats;
+    /* the requests slower than that many ms are logged, 0 to disable */
+    int slow_request_threshold;
+    uint32_t last_req_id;
+    /* bulk requests waiting to be executed, see responder_common.c */
+    struct cli_sched *sched;
+    /* talloc pool of each client request, see client_recv() */
+    struct sss_pool_size cmd_pool;
 
     struct timeval get_domains_last_call;
 
@@ -115,6 +152,11 @@ struct resp_ctx {
 
     void *pvt_ctx;
 
+    /* called once the reply to a client request was sent, right before
+     * the request is freed */
+    void (*reply_sent_fn)(struct cli_ctx *cctx, void *pvt);
+    void *reply_sent_pvt;
+
     bool shutting_down;
 };
 
@@ -147,11 +189,23 @@ struct cli_ctx {
     char *automntmap_name;
 
     struct tevent_timer *idle;
+
+    /* connection of a helper process of the responder, never idle */
+    bool helper;
+};
+
+/* Building the reply to a bulk command, e.g. an enumeration, may keep the
+ * responder busy for a long time. Such commands are executed one at a time
+ * and only after the interactive requests that are ready were served. */
+enum sss_cmd_class {
+    SSS_CMD_INTERACTIVE = 0,
+    SSS_CMD_BULK
 };
 
 struct sss_cmd_table {
     enum sss_cli_command cmd;
     int (*fn)(struct cli_ctx *cctx);
+    enum sss_cmd_class cmd_class;
 };
 
 /* from generated code */
@@ -163,6 +217,8 @@ struct mon_cli_iface;
  * NOTE: We would like to use more strong typing for the @dp_vtable argument
  * but can't since it accepts either a struct data_provider_iface
  * or struct data_provider_rev_iface. So pass the base struct: sbus_vtable
+ *
+ * If @monitor_intf is NULL the responder does not register with the monitor.
  */
 int sss_process_init(TALLOC_CTX *mem_ctx,
                      struct tevent_context *ev,
@@ -190,6 +246,37 @@ errno_t responder_get_domain_by_id(struct resp_ctx *rctx, const char *id,
 
 int create_pipe_fd(const char *sock_name, int *_fd, mode_t umaskval);
 
+/* Serve requests received on fd, a connected socket, as if it was a client
+ * accepted on the public pipe. The connection is not subject to the client
+ * idle timeout. */
+errno_t sss_responder_add_helper_client(struct resp_ctx *rctx, int fd);
+
+/* responder_objcache.c */
+
+/* The cache is disabled, i.e. rctx->obj_cache is left NULL, if either
+ * @max_entries or @timeout is 0. */
+errno_t sss_objcache_init(struct resp_ctx *rctx,
+                          unsigned int max_entries,
+                          time_t timeout);
+
+/* Returns a copy of the cached result of the lookup @key or ENOENT. */
+errno_t sss_objcache_get(TALLOC_CTX *mem_ctx,
+                         struct resp_ctx *rctx,
+                         const char *key,
+                         struct ldb_result **_result);
+
+/* Caches a copy of @result, found in @domain by the lookup @key. */
+void sss_objcache_set(struct resp_ctx *rctx,
+                      struct sss_domain_info *domain,
+                      const char *key,
+                      struct ldb_result *result);
+
+void sss_objcache_remove(struct resp_ctx *rctx, const char *key);
+
+/* Drops all objects of @domain, or of all domains if @domain is NULL. */
+void sss_objcache_invalidate(struct resp_ctx *rctx,
+                             struct sss_domain_info *domain);
+
 /* responder_cmd.c */
 int sss_cmd_empty_packet(struct sss_packet *packet);
 int sss_cmd_send_empty(struct cli_ctx *cctx, TALLOC_CTX *freectx);
@@ -199,6 +286,16 @@ int sss_cmd_get_version(struct cli_ctx *cctx);
 int sss_cmd_execute(struct cli_ctx *cctx,
                     enum sss_cli_command cmd,
                     struct sss_cmd_table *sss_cmds);
+/* Record where the data for the reply to the client request @mem_ctx
+ * belongs to came from. A data provider round trip is never overridden. */
+void sss_cmd_mark_source(TALLOC_CTX *mem_ctx, enum sss_cmd_source source);
+/* Add @usec the client request @mem_ctx belongs to waited for the data
+ * provider to its latency */
+void sss_cmd_add_dp_time(TALLOC_CTX *mem_ctx, uint64_t usec);
+/* The id of the client request @mem_ctx belongs to, 0 if none */
+uint32_t sss_cmd_get_req_id(TALLOC_CTX *mem_ctx);
+/* Write the command statistics of the responder to the debug log */
+void sss_cmd_stats_dump(struct resp_ctx *rctx);
 struct cli_protocol_version *register_cli_protocol_version(void);
 
 struct setent_req_list;
@@ -259,6 +356,9 @@ struct sss_dp_req_state {
     dbus_uint16_t dp_err;
     dbus_uint32_t dp_ret;
     char *err_msg;
+
+    /* when the request was issued, see sss_dp_issue_request() */
+    struct timeval start;
 };
 
 /* The _recv functions of provider specific requests usually need to
@@ -308,6 +408,52 @@ sss_dp_get_account_recv(TALLOC_CTX *mem_ctx,
                         dbus_uint32_t *err_min,
                         char **err_msg);
 
+/* responder_hotlist.c */
+
+/* Refresh-ahead is disabled, i.e. rctx->hotlist is left NULL, if @top is 0.
+ * Otherwise up to @top popular objects are refreshed before they expire
+ * on every check. */
+errno_t sss_hotlist_init(struct resp_ctx *rctx, unsigned int top);
+
+/* Counts a request for the valid cached object @key which expires at
+ * @expire. The remaining arguments are passed to sss_dp_get_account_send()
+ * to refresh it. */
+void sss_hotlist_hit(struct resp_ctx *rctx,
+                     struct sss_domain_info *domain,
+                     const char *key,
+                     enum sss_dp_acct_type dp_type,
+                     const char *name,
+                     uint32_t id,
+                     const char *extra,
+                     time_t expire);
+
+/* Refreshes the most popular objects which expire soon after @now, run
+ * periodically. Returns the number of requests sent to the data provider. */
+unsigned int sss_hotlist_refresh(struct resp_ctx *rctx, time_t now);
+
+/* responder_dp_fast.c */
+
+/* Returns true if account requests can be sent to @be_conn with
+ * sss_dp_fast_send(), connecting to the back end if needed */
+bool sss_dp_fast_connect(struct be_conn *be_conn);
+
+/* Sends the arguments of a getAccountInfo method call, the reply is the
+ * same as the one of the D-Bus method */
+struct tevent_req *sss_dp_fast_send(TALLOC_CTX *mem_ctx,
+                                    struct tevent_context *ev,
+                                    struct be_conn *be_conn,
+                                    uint32_t type,
+                                    uint32_t attrs,
+                                    const char *filter,
+                                    const char *domain,
+                                    uint32_t req_id);
+
+errno_t sss_dp_fast_recv(TALLOC_CTX *mem_ctx,
+                         struct tevent_req *req,
+                         dbus_uint16_t *_dp_err,
+                         dbus_uint32_t *_dp_ret,
+                         char **_err_msg);
+
 bool sss_utf8_check(const uint8_t *s, size_t n);
 
 void responder_set_fd_limit(rlim_t fd_limit);
@@ -27,6 +27,7 @@
 #include "db/sysdb.h"
 #include "responder/common/responder_cache_req.h"
 #include "providers/data_provider.h"
+#include "util/probes.h"
 
 static errno_t updated_users_by_filter(TALLOC_CTX *mem_ctx,
                                        struct sss_domain_info *domain,
@@ -209,6 +210,50 @@ cache_req_input_set_name(struct cache_req_input *input,
     return EOK;
 }
 
+static struct cache_req_input *
+cache_req_input_copy(TALLOC_CTX *mem_ctx,
+                     struct cache_req_input *input)
+{
+    struct cache_req_input *copy;
+
+    copy = talloc_zero(mem_ctx, struct cache_req_input);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    copy->type = input->type;
+    copy->id = input->id;
+    copy->dp_type = input->dp_type;
+    copy->req_start = input->req_start;
+
+    if (input->orig_name != NULL) {
+        copy->orig_name = talloc_strdup(copy, input->orig_name);
+        if (copy->orig_name == NULL) {
+            goto fail;
+        }
+    }
+
+    if (input->name != NULL) {
+        copy->name = talloc_strdup(copy, input->name);
+        if (copy->name == NULL) {
+            goto fail;
+        }
+    }
+
+    if (input->cert != NULL) {
+        copy->cert = talloc_strdup(copy, input->cert);
+        if (copy->cert == NULL) {
+            goto fail;
+        }
+    }
+
+    return copy;
+
+fail:
+    talloc_free(copy);
+    return NULL;
+}
+
 static errno_t
 cache_req_input_set_domain(struct cache_req_input *input,
                            struct sss_domain_info *domain,
@@ -568,6 +613,18 @@ static bool cache_req_bypass_cache(struct cache_req_input *input)
     return false;
 }
 
+static time_t cache_req_expire(struct cache_req_input *input,
+                               struct ldb_result *result)
+{
+    if (input->type == CACHE_REQ_INITGROUPS) {
+        return ldb_msg_find_attr_as_uint64(result->msgs[0],
+                                           SYSDB_INITGR_EXPIRE, 0);
+    }
+
+    return ldb_msg_find_attr_as_uint64(result->msgs[0],
+                                       SYSDB_CACHE_EXPIRE, 0);
+}
+
 static errno_t cache_req_expiration_status(struct cache_req_input *input,
                                            struct ldb_result *result,
                                            time_t cache_refresh_percent)
@@ -578,13 +635,7 @@ static errno_t cache_req_expiration_status(struct cache_req_input *input,
         return ENOENT;
     }
 
-    if (input->type == CACHE_REQ_INITGROUPS) {
-        expire = ldb_msg_find_attr_as_uint64(result->msgs[0],
-                                             SYSDB_INITGR_EXPIRE, 0);
-    } else {
-        expire = ldb_msg_find_attr_as_uint64(result->msgs[0],
-                                             SYSDB_CACHE_EXPIRE, 0);
-    }
+    expire = cache_req_expire(input, result);
 
     return sss_cmd_check_cache(result->msgs[0], cache_refresh_percent, expire);
 }
@@ -686,6 +737,28 @@ static void cache_req_dpreq_params(TALLOC_CTX *mem_ctx,
     *_id = id;
 }
 
+/* Lookups of the same object in the same domain that are in progress at
+ * the same time share one cache search and one data provider request. The
+ * first one leads, the others wait for its result. */
+struct cache_req_waiter;
+
+struct cache_req_inflight {
+    struct tevent_context *ev;
+    struct resp_ctx *rctx;
+    hash_key_t key;
+    bool in_table;
+
+    struct cache_req_waiter *waiters;
+};
+
+struct cache_req_waiter {
+    struct cache_req_waiter *prev;
+    struct cache_req_waiter *next;
+
+    struct cache_req_inflight *inflight;
+    struct tevent_req *req;
+};
+
 struct cache_req_cache_state {
     /* input data */
     struct tevent_context *ev;
@@ -695,10 +768,260 @@ struct cache_req_cache_state {
     int cache_refresh_percent;
     struct cache_req_input *input;
 
+    /* work data */
+    char *key;
+    bool from_objcache;
+    struct cache_req_inflight *inflight;
+    struct cache_req_waiter *waiter;
+
     /* output data */
     struct ldb_result *result;
 };
 
+static char *cache_req_inflight_key(TALLOC_CTX *mem_ctx,
+                                    struct cache_req_input *input)
+{
+    switch (input->type) {
+    case CACHE_REQ_USER_BY_NAME:
+    case CACHE_REQ_USER_BY_UPN:
+    case CACHE_REQ_GROUP_BY_NAME:
+    case CACHE_REQ_INITGROUPS:
+    case CACHE_REQ_INITGROUPS_BY_UPN:
+        if (input->dom_objname == NULL) {
+            return NULL;
+        }
+        return talloc_asprintf(mem_ctx, "%d:%s:%s", input->type,
+                               input->domain->name, input->dom_objname);
+    case CACHE_REQ_USER_BY_ID:
+    case CACHE_REQ_GROUP_BY_ID:
+        return talloc_asprintf(mem_ctx, "%d:%s:%"PRIu32, input->type,
+                               input->domain->name, input->id);
+    case CACHE_REQ_USER_BY_CERT:
+        return talloc_asprintf(mem_ctx, "%d:%s:%s", input->type,
+                               input->domain->name, input->cert);
+    case CACHE_REQ_USER_BY_FILTER:
+    case CACHE_REQ_GROUP_BY_FILTER:
+        /* the result depends on the time the request started */
+        return NULL;
+    }
+
+    return NULL;
+}
+
+static struct ldb_result *cache_req_copy_result(TALLOC_CTX *mem_ctx,
+                                                struct ldb_result *result)
+{
+    struct ldb_result *copy;
+    unsigned int i;
+
+    copy = talloc_zero(mem_ctx, struct ldb_result);
+    if (copy == NULL || result == NULL) {
+        return copy;
+    }
+
+    copy->msgs = talloc_zero_array(copy, struct ldb_message *,
+                                   result->count + 1);
+    if (copy->msgs == NULL) {
+        talloc_free(copy);
+        return NULL;
+    }
+
+    for (i = 0; i < result->count; i++) {
+        copy->msgs[i] = ldb_msg_copy(copy->msgs, result->msgs[i]);
+        if (copy->msgs[i] == NULL) {
+            talloc_free(copy);
+            return NULL;
+        }
+    }
+    copy->count = result->count;
+
+    return copy;
+}
+
+static void cache_req_inflight_remove(struct cache_req_inflight *inflight)
+{
+    int hret;
+
+    if (!inflight->in_table) {
+        return;
+    }
+
+    hret = hash_delete(inflight->rctx->cache_req_table, &inflight->key);
+    if (hret != HASH_SUCCESS) {
+        /* This should never happen */
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "BUG: Could not remove [%s] from in-flight lookups: [%s]\n",
+              inflight->key.str, hash_error_string(hret));
+    }
+    inflight->in_table = false;
+}
+
+static void cache_req_waiter_restart(struct tevent_context *ev,
+                                     struct tevent_timer *te,
+                                     struct timeval tv,
+                                     void *pvt);
+
+static int cache_req_inflight_destructor(struct cache_req_inflight *inflight)
+{
+    struct cache_req_cache_state *state;
+    struct cache_req_waiter *waiter;
+    struct tevent_timer *te;
+
+    cache_req_inflight_remove(inflight);
+
+    if (inflight->rctx->shutting_down) {
+        return 0;
+    }
+
+    /* The leading lookup was freed before it finished, e.g. because its
+     * client went away. The waiting ones start over on their own. */
+    while ((waiter = inflight->waiters) != NULL) {
+        DLIST_REMOVE(inflight->waiters, waiter);
+        waiter->inflight = NULL;
+
+        state = tevent_req_data(waiter->req, struct cache_req_cache_state);
+        te = tevent_add_timer(inflight->ev, state, tevent_timeval_zero(),
+                              cache_req_waiter_restart, waiter->req);
+        if (te == NULL) {
+            tevent_req_error(waiter->req, ENOMEM);
+        }
+    }
+
+    return 0;
+}
+
+static int cache_req_waiter_destructor(struct cache_req_waiter *waiter)
+{
+    if (waiter->inflight != NULL) {
+        DLIST_REMOVE(waiter->inflight->waiters, waiter);
+    }
+
+    return 0;
+}
+
+static struct cache_req_inflight *
+cache_req_inflight_lookup(struct resp_ctx *rctx, char *key)
+{
+    hash_key_t hkey;
+    hash_value_t value;
+    int hret;
+
+    if (rctx->cache_req_table == NULL || key == NULL) {
+        return NULL;
+    }
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = key;
+
+    hret = hash_lookup(rctx->cache_req_table, &hkey, &value);
+    if (hret != HASH_SUCCESS) {
+        return NULL;
+    }
+
+    return talloc_get_type(value.ptr, struct cache_req_inflight);
+}
+
+static void cache_req_inflight_register(struct tevent_req *req,
+                                        const char *key)
+{
+    struct cache_req_cache_state *state = NULL;
+    struct cache_req_inflight *inflight;
+    hash_value_t value;
+    int hret;
+
+    state = tevent_req_data(req, struct cache_req_cache_state);
+
+    if (state->rctx->cache_req_table == NULL || key == NULL) {
+        return;
+    }
+
+    inflight = talloc_zero(state, struct cache_req_inflight);
+    if (inflight == NULL) {
+        /* non-fatal, the lookup is just not shared */
+        return;
+    }
+    inflight->ev = state->ev;
+    inflight->rctx = state->rctx;
+    inflight->key.type = HASH_KEY_STRING;
+    inflight->key.str = talloc_strdup(inflight, key);
+    if (inflight->key.str == NULL) {
+        talloc_free(inflight);
+        return;
+    }
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = inflight;
+
+    hret = hash_enter(state->rctx->cache_req_table, &inflight->key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to track in-flight lookup [%s]: [%s]\n",
+              key, hash_error_string(hret));
+        talloc_free(inflight);
+        return;
+    }
+    inflight->in_table = true;
+
+    talloc_set_destructor(inflight, cache_req_inflight_destructor);
+    state->inflight = inflight;
+}
+
+static errno_t cache_req_inflight_join(struct tevent_req *req,
+                                       struct cache_req_inflight *inflight)
+{
+    struct cache_req_cache_state *state = NULL;
+    struct cache_req_waiter *waiter;
+
+    state = tevent_req_data(req, struct cache_req_cache_state);
+
+    waiter = talloc_zero(state, struct cache_req_waiter);
+    if (waiter == NULL) {
+        return ENOMEM;
+    }
+
+    waiter->inflight = inflight;
+    waiter->req = req;
+    DLIST_ADD_END(inflight->waiters, waiter, struct cache_req_waiter *);
+    talloc_set_destructor(waiter, cache_req_waiter_destructor);
+
+    state->waiter = waiter;
+
+    return EOK;
+}
+
+static void cache_req_inflight_finish(struct cache_req_inflight *inflight,
+                                      struct ldb_result *result,
+                                      errno_t error)
+{
+    struct cache_req_cache_state *state;
+    struct cache_req_waiter *waiter;
+
+    /* new lookups of the object will search the updated cache */
+    cache_req_inflight_remove(inflight);
+
+    while ((waiter = inflight->waiters) != NULL) {
+        DLIST_REMOVE(inflight->waiters, waiter);
+        waiter->inflight = NULL;
+
+        if (error != EOK) {
+            tevent_req_error(waiter->req, error);
+            continue;
+        }
+
+        state = tevent_req_data(waiter->req, struct cache_req_cache_state);
+        state->result = cache_req_copy_result(state, result);
+        if (state->result == NULL) {
+            tevent_req_error(waiter->req, ENOMEM);
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Returning info for [%s]\n",
+              state->input->debug_fqn);
+        tevent_req_done(waiter->req);
+    }
+}
+
+static errno_t cache_req_cache_lookup(struct tevent_req *req);
 static errno_t cache_req_cache_search(struct tevent_req *req);
 static errno_t cache_req_cache_check(struct tevent_req *req);
 static void cache_req_cache_done(struct tevent_req *subreq);
@@ -732,13 +1055,12 @@ static struct tevent_req *cache_req_cache_send(TALLOC_CTX *mem_ctx,
     ret = cache_req_check_ncache(state->input, state->ncache,
                                  state->neg_timeout);
     if (ret == EEXIST) {
+        sss_cmd_mark_source(req, SSS_CMD_SRC_MEMORY);
         ret = ENOENT;
         goto immediately;
     }
 
-    /* We will first search the cache. If we get cache miss or the entry
-     * is expired we will contact data provider and then search again. */
-    ret = cache_req_cache_search(req);
+    ret = cache_req_cache_lookup(req);
     if (ret != EAGAIN) {
         goto immediately;
     }
@@ -756,20 +1078,93 @@ immediately:
     return req;
 }
 
-static errno_t cache_req_cache_search(struct tevent_req *req)
+static void cache_req_waiter_restart(struct tevent_context *ev,
+                                     struct tevent_timer *te,
+                                     struct timeval tv,
+                                     void *pvt)
 {
     struct cache_req_cache_state *state = NULL;
+    struct tevent_req *req = NULL;
     errno_t ret;
 
+    req = talloc_get_type(pvt, struct tevent_req);
     state = tevent_req_data(req, struct cache_req_cache_state);
 
-    ret = cache_req_get_object(state, state->input, &state->result);
-    if (ret != EOK && ret != ENOENT) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to make request to our cache "
-              "[%d]: %s\n", ret, sss_strerror(ret));
+    talloc_zfree(state->waiter);
+
+    ret = cache_req_cache_lookup(req);
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else if (ret != EAGAIN) {
+        tevent_req_error(req, ret);
+    }
+}
+
+static errno_t cache_req_cache_lookup(struct tevent_req *req)
+{
+    struct cache_req_cache_state *state = NULL;
+    struct cache_req_inflight *inflight;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct cache_req_cache_state);
+
+    /* If the same object is already being looked up, wait for its
+     * result instead of searching the cache and asking the data provider
+     * again. */
+    if (state->key == NULL) {
+        state->key = cache_req_inflight_key(state, state->input);
+    }
+    inflight = cache_req_inflight_lookup(state->rctx, state->key);
+    if (inflight != NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Lookup of [%s] is already in progress, "
+              "waiting for its result\n", state->input->debug_fqn);
+
+        ret = cache_req_inflight_join(req, inflight);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        sss_cmd_stats_count(state->rctx->cmd_stats, SSS_CACHE_INFLIGHT_JOIN);
+        return EAGAIN;
+    }
+
+    /* We will first search the cache. If we get cache miss or the entry
+     * is expired we will contact data provider and then search again. */
+    ret = cache_req_cache_search(req);
+    if (ret != EAGAIN) {
         return ret;
     }
 
+    /* later lookups of the object will wait for this one */
+    cache_req_inflight_register(req, state->key);
+
+    return EAGAIN;
+}
+
+static errno_t cache_req_cache_search(struct tevent_req *req)
+{
+    struct cache_req_cache_state *state = NULL;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct cache_req_cache_state);
+
+    /* Objects looked up recently do not need to be searched in sysdb. */
+    ret = sss_objcache_get(state, state->rctx, state->key, &state->result);
+    if (ret == EOK) {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Found [%s] in the object cache\n",
+              state->input->debug_fqn);
+        state->from_objcache = true;
+        sss_cmd_mark_source(req, SSS_CMD_SRC_MEMORY);
+        sss_cmd_stats_count(state->rctx->cmd_stats, SSS_CACHE_OBJCACHE_HIT);
+    } else {
+        ret = cache_req_get_object(state, state->input, &state->result);
+        if (ret != EOK && ret != ENOENT) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Failed to make request to our cache "
+                  "[%d]: %s\n", ret, sss_strerror(ret));
+            return ret;
+        }
+    }
+
     /* Verify that the cache is up to date. */
     ret = cache_req_cache_check(req);
     if (req != EOK) {
@@ -802,12 +1197,25 @@ static errno_t cache_req_cache_check(struct tevent_req *req)
     switch (ret) {
     case EOK:
         DEBUG(SSSDBG_TRACE_FUNC, "Cached entry is valid, returning...\n");
+        if (!state->from_objcache) {
+            sss_objcache_set(state->rctx, state->input->domain, state->key,
+                             state->result);
+            sss_cmd_stats_count(state->rctx->cmd_stats, SSS_CACHE_SYSDB_HIT);
+        }
+        sss_hotlist_hit(state->rctx, state->input->domain, state->key,
+                        state->input->dp_type, search_str, search_id,
+                        extra_flag, cache_req_expire(state->input,
+                                                     state->result));
         return EOK;
     case EAGAIN:
         /* Out of band update. The calling function will return the cached
          * entry immediately. No callback is required. */
 
         DEBUG(SSSDBG_TRACE_FUNC, "Performing midpoint cache update\n");
+        sss_cmd_stats_count(state->rctx->cmd_stats, SSS_CACHE_SYSDB_MIDPOINT);
+
+        /* the next lookup has to see the updated entry */
+        sss_objcache_remove(state->rctx, state->key);
 
         subreq = sss_dp_get_account_send(state, state->rctx,
                                          state->input->domain, true,
@@ -825,6 +1233,8 @@ static errno_t cache_req_cache_check(struct tevent_req *req)
     case ENOENT:
         /* Cache miss or the cache is expired. We need to get the updated
          * information before returning it. */
+        sss_objcache_remove(state->rctx, state->key);
+        sss_cmd_stats_count(state->rctx->cmd_stats, SSS_CACHE_DP_LOOKUP);
 
         subreq = sss_dp_get_account_send(state, state->rctx,
                                          state->input->domain, true,
@@ -881,6 +1291,14 @@ static void cache_req_cache_done(struct tevent_req *subreq)
     } else if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to make request to our cache "
               "[%d]: %s\n", ret, sss_strerror(ret));
+    } else {
+        sss_objcache_set(state->rctx, state->input->domain, state->key,
+                         state->result);
+    }
+
+    if (state->inflight != NULL) {
+        cache_req_inflight_finish(state->inflight, state->result, ret);
+        talloc_zfree(state->inflight);
     }
 
     if (ret != EOK) {
@@ -924,6 +1342,26 @@ struct cache_req_state {
     struct sss_domain_info *domain;
     struct sss_domain_info *selected_domain;
     bool check_next;
+
+    /* lookups in all domains at once, in the order of the domains */
+    struct cache_req_fan_out *fan_out;
+    size_t num_fan_out;
+};
+
+/* With parallel_domain_lookup the domains are not searched one after
+ * another, each domain gets its own lookup and all of them are started
+ * together. The result of the first domain in the domain order that has the
+ * object is returned, i.e. the result is the same as with the serial
+ * search. */
+struct cache_req_fan_out {
+    struct tevent_req *req;
+    struct tevent_req *subreq;
+    struct cache_req_input *input;
+    struct sss_domain_info *domain;
+
+    bool done;
+    errno_t ret;
+    struct ldb_result *result;
 };
 
 static void cache_req_input_parsed(struct tevent_req *subreq);
@@ -961,6 +1399,7 @@ struct tevent_req *cache_req_send(TALLOC_CTX *mem_ctx,
     state->neg_timeout = neg_timeout;
     state->cache_refresh_percent = cache_refresh_percent;
     state->input = input;
+    PROBE(CACHE_REQ_SEND, req, input->type, input->orig_name, input->id);
 
     if (state->input->orig_name != NULL && domain == NULL) {
         /* Parse input name first, since it may contain domain name. */
@@ -1064,6 +1503,155 @@ static errno_t cache_req_select_domains(struct tevent_req *req,
     return cache_req_next_domain(req);
 }
 
+static bool cache_req_can_fan_out(struct cache_req_state *state)
+{
+    if (!state->rctx->parallel_domain_lookup || !state->check_next) {
+        return false;
+    }
+
+    /* Only the unqualified names are looked up in each domain separately,
+     * UPNs, IDs and certificates must be unique among all domains. */
+    switch (state->input->type) {
+    case CACHE_REQ_USER_BY_NAME:
+    case CACHE_REQ_GROUP_BY_NAME:
+    case CACHE_REQ_INITGROUPS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void cache_req_fan_out_done(struct tevent_req *subreq);
+
+static errno_t cache_req_fan_out_send(struct tevent_req *req)
+{
+    struct cache_req_state *state = NULL;
+    struct cache_req_fan_out *lookup;
+    struct sss_domain_info *dom;
+    size_t num = 0;
+    size_t i;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct cache_req_state);
+
+    for (dom = state->domain; dom != NULL; dom = get_next_domain(dom, 0)) {
+        if (!dom->fqnames) {
+            num++;
+        }
+    }
+
+    if (num == 0) {
+        return ENOENT;
+    }
+
+    state->fan_out = talloc_zero_array(state, struct cache_req_fan_out, num);
+    if (state->fan_out == NULL) {
+        return ENOMEM;
+    }
+    state->num_fan_out = num;
+
+    i = 0;
+    for (dom = state->domain; dom != NULL; dom = get_next_domain(dom, 0)) {
+        /* skip domains that require fully qualified names */
+        if (dom->fqnames) {
+            continue;
+        }
+
+        lookup = &state->fan_out[i++];
+        lookup->req = req;
+        lookup->domain = dom;
+
+        lookup->input = cache_req_input_copy(state->fan_out, state->input);
+        if (lookup->input == NULL) {
+            return ENOMEM;
+        }
+
+        ret = cache_req_input_set_domain(lookup->input, dom, state->rctx);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        lookup->subreq = cache_req_cache_send(state->fan_out, state->ev,
+                                              state->rctx, state->ncache,
+                                              state->neg_timeout,
+                                              state->cache_refresh_percent,
+                                              lookup->input);
+        if (lookup->subreq == NULL) {
+            return ENOMEM;
+        }
+
+        tevent_req_set_callback(lookup->subreq, cache_req_fan_out_done,
+                                lookup);
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Looking up [%s] in %zu domains at once\n",
+          state->input->name, num);
+
+    state->domain = NULL;
+    return EAGAIN;
+}
+
+static void cache_req_fan_out_done(struct tevent_req *subreq)
+{
+    struct cache_req_fan_out *lookup;
+    struct cache_req_state *state = NULL;
+    struct tevent_req *req = NULL;
+    size_t i;
+    errno_t ret;
+
+    lookup = tevent_req_callback_data(subreq, struct cache_req_fan_out);
+    req = lookup->req;
+    state = tevent_req_data(req, struct cache_req_state);
+
+    lookup->ret = cache_req_cache_recv(state->fan_out, subreq,
+                                       &lookup->result);
+    talloc_zfree(subreq);
+    lookup->subreq = NULL;
+    lookup->done = true;
+
+    /* The result of a domain can only be used when all the domains before
+     * it are known not to have the object. */
+    for (i = 0; i < state->num_fan_out; i++) {
+        lookup = &state->fan_out[i];
+
+        if (!lookup->done) {
+            return;
+        }
+
+        if (lookup->ret == EOK) {
+            break;
+        }
+    }
+
+    if (i == state->num_fan_out) {
+        talloc_zfree(state->fan_out);
+        state->num_fan_out = 0;
+
+        cache_req_add_to_ncache_global(state->input, state->ncache);
+        tevent_req_error(req, ENOENT);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Returning [%s] from domain [%s]\n",
+          state->input->name, lookup->domain->name);
+
+    ret = cache_req_input_set_domain(state->input, lookup->domain,
+                                     state->rctx);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    state->selected_domain = lookup->domain;
+    state->result = talloc_steal(state, lookup->result);
+
+    /* the lookups in the following domains are not needed anymore */
+    talloc_zfree(state->fan_out);
+    state->num_fan_out = 0;
+
+    tevent_req_done(req);
+}
+
 static errno_t cache_req_next_domain(struct tevent_req *req)
 {
     struct cache_req_state *state = NULL;
@@ -1072,6 +1660,10 @@ static errno_t cache_req_next_domain(struct tevent_req *req)
 
     state = tevent_req_data(req, struct cache_req_state);
 
+    if (cache_req_can_fan_out(state)) {
+        return cache_req_fan_out_send(req);
+    }
+
     while (state->domain != NULL) {
        /* If it is a domainless search, skip domains that require fully
         * qualified names instead. */
@@ -1168,11 +1760,18 @@ errno_t cache_req_recv(TALLOC_CTX *mem_ctx,
                        char **_name)
 {
     struct cache_req_state *state = NULL;
+    enum tevent_req_state req_state;
+    uint64_t err;
     char *name;
 
     state = tevent_req_data(req, struct cache_req_state);
 
-    TEVENT_REQ_RETURN_ON_ERROR(req);
+    if (tevent_req_is_error(req, &req_state, &err)) {
+        err = req_state == TEVENT_REQ_USER_ERROR ? err : ERR_INTERNAL;
+        PROBE(CACHE_REQ_DONE, req, state->input->type, (int) err);
+        return err;
+    }
+    PROBE(CACHE_REQ_DONE, req, state->input->type, EOK);
 
     if (_name != NULL) {
         if (state->input->dom_objname == NULL) {
@@ -23,6 +23,8 @@
 #include "util/util.h"
 #include "responder/common/responder.h"
 #include "responder/common/responder_packet.h"
+#include "util/sss_cli_cmd.h"
+#include "util/probes.h"
 
 int sss_cmd_send_error(struct cli_ctx *cctx, int err)
 {
@@ -88,6 +90,11 @@ void sss_cmd_done(struct cli_ctx *cctx, void *freectx)
     /* now that the packet is in place, unlock queue
      * making the event writable */
     TEVENT_FD_WRITEABLE(cctx->cfde);
+    cctx->creq->reply = tevent_timeval_current();
+
+    /* the reply and the data it was built from are all still allocated,
+     * this is about the most memory the request needed */
+    sss_pool_size_update(&cctx->rctx->cmd_pool, cctx->creq);
 
     /* free all request related data through the talloc hierarchy */
     talloc_free(freectx);
@@ -156,6 +163,31 @@ int sss_cmd_execute(struct cli_ctx *cctx,
 {
     int i;
 
+    /* the latency is measured until the reply was sent, unless the
+     * request says otherwise it is served from the cache; the start is
+     * already set if the request was queued */
+    cctx->creq->cmd = cmd;
+    if (tevent_timeval_is_zero(&cctx->creq->start)) {
+        cctx->creq->start = tevent_timeval_current();
+    }
+    cctx->creq->source = SSS_CMD_SRC_SYSDB;
+    cctx->creq->exec = tevent_timeval_current();
+
+    /* the ids are seeded with the pid so that the requests of different
+     * responders can be told apart in the logs of the data provider */
+    if (cctx->rctx->last_req_id == 0) {
+        cctx->rctx->last_req_id = (uint32_t) getpid() << 16;
+    }
+    cctx->rctx->last_req_id++;
+    if (cctx->rctx->last_req_id == 0) {
+        cctx->rctx->last_req_id++;
+    }
+    cctx->creq->id = cctx->rctx->last_req_id;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "[RID#%u] Received command [%s]\n",
+          cctx->creq->id, sss_cmd2str(cmd));
+    PROBE(SSS_CMD_START, cctx, cmd);
+
     for (i = 0; sss_cmds[i].cmd != SSS_CLI_NULL; i++) {
         if (cmd == sss_cmds[i].cmd) {
             return sss_cmds[i].fn(cctx);
@@ -164,6 +196,122 @@ int sss_cmd_execute(struct cli_ctx *cctx,
 
     return EINVAL;
 }
+
+static struct cli_request *sss_cmd_find_creq(TALLOC_CTX *mem_ctx)
+{
+    struct cli_ctx *cctx;
+
+    if (mem_ctx == NULL) {
+        return NULL;
+    }
+
+    /* requests of clients are allocated below the client context */
+    cctx = talloc_find_parent_bytype(mem_ctx, struct cli_ctx);
+    if (cctx == NULL) {
+        return NULL;
+    }
+
+    return cctx->creq;
+}
+
+void sss_cmd_mark_source(TALLOC_CTX *mem_ctx, enum sss_cmd_source source)
+{
+    struct cli_request *creq;
+
+    creq = sss_cmd_find_creq(mem_ctx);
+    if (creq == NULL) {
+        return;
+    }
+
+    if (creq->source != SSS_CMD_SRC_DP) {
+        creq->source = source;
+    }
+}
+
+void sss_cmd_add_dp_time(TALLOC_CTX *mem_ctx, uint64_t usec)
+{
+    struct cli_request *creq;
+
+    creq = sss_cmd_find_creq(mem_ctx);
+    if (creq == NULL) {
+        return;
+    }
+
+    creq->dp_usec += usec;
+}
+
+uint32_t sss_cmd_get_req_id(TALLOC_CTX *mem_ctx)
+{
+    struct cli_request *creq;
+
+    creq = sss_cmd_find_creq(mem_ctx);
+    if (creq == NULL) {
+        return 0;
+    }
+
+    return creq->id;
+}
+
+void sss_cmd_stats_dump(struct resp_ctx *rctx)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sss_cmd_stats_entry *entries;
+    size_t count;
+    size_t i;
+    char *histogram;
+    int j;
+    errno_t ret;
+
+    if (rctx->cmd_stats == NULL) {
+        return;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return;
+    }
+
+    ret = sss_cmd_stats_get(tmp_ctx, rctx->cmd_stats, &entries, &count);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        histogram = talloc_strdup(tmp_ctx, "");
+        for (j = 0; j < SSS_CMD_STATS_BUCKETS && histogram != NULL; j++) {
+            if (entries[i].buckets[j] == 0) {
+                continue;
+            }
+
+            if (j == SSS_CMD_STATS_BUCKETS - 1) {
+                histogram = talloc_asprintf_append(histogram,
+                                    " >=%"PRIu64"us:%"PRIu64,
+                                    sss_cmd_stats_bucket_limit(j - 1),
+                                    entries[i].buckets[j]);
+            } else {
+                histogram = talloc_asprintf_append(histogram,
+                                    " <%"PRIu64"us:%"PRIu64,
+                                    sss_cmd_stats_bucket_limit(j),
+                                    entries[i].buckets[j]);
+            }
+        }
+        if (histogram == NULL) {
+            goto done;
+        }
+
+        DEBUG(SSSDBG_IMPORTANT_INFO,
+              "%s from %s: %"PRIu64" replies, average %"PRIu64"us, "
+              "max %"PRIu64"us,%s\n",
+              sss_cmd2str(entries[i].cmd),
+              sss_cmd_source_names[entries[i].source],
+              entries[i].count,
+              entries[i].total_usec / entries[i].count,
+              entries[i].max_usec, histogram);
+    }
+
+done:
+    talloc_free(tmp_ctx);
+}
 struct setent_req_list {
     struct setent_req_list *prev;
     struct setent_req_list *next;
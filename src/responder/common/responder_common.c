@@ -43,6 +43,8 @@
 #include "monitor/monitor_interfaces.h"
 #include "sbus/sbus_client.h"
 #include "util/util_creds.h"
+#include "util/sss_cli_cmd.h"
+#include "util/probes.h"
 
 static errno_t set_close_on_exec(int fd)
 {
@@ -238,6 +240,71 @@ done:
 }
 
 
+static void client_record_stats(struct cli_ctx *cctx)
+{
+    struct timeval now;
+    struct timeval elapsed;
+
+    if (cctx->rctx->cmd_stats == NULL) {
+        return;
+    }
+
+    now = tevent_timeval_current();
+    elapsed = tevent_timeval_until(&cctx->creq->start, &now);
+
+    sss_cmd_stats_add(cctx->rctx->cmd_stats, cctx->creq->cmd,
+                      cctx->creq->source,
+                      (uint64_t)elapsed.tv_sec * 1000000 + elapsed.tv_usec);
+}
+
+static uint64_t client_usec_between(struct timeval *from,
+                                    struct timeval *to)
+{
+    struct timeval elapsed;
+
+    if (tevent_timeval_is_zero(from) || tevent_timeval_compare(from, to) > 0) {
+        return 0;
+    }
+
+    elapsed = tevent_timeval_until(from, to);
+    return (uint64_t) elapsed.tv_sec * 1000000 + elapsed.tv_usec;
+}
+
+/* The latency of a slow request is split into the time it waited to be
+ * executed, the time the responder and the data provider spent on it and
+ * the time it took the client to read the reply. */
+static void client_log_slow(struct cli_ctx *cctx)
+{
+    struct cli_request *creq = cctx->creq;
+    struct timeval now;
+    uint64_t total;
+    uint64_t queued;
+    uint64_t reply;
+    uint64_t work;
+
+    if (cctx->rctx->slow_request_threshold <= 0) {
+        return;
+    }
+
+    now = tevent_timeval_current();
+    total = client_usec_between(&creq->start, &now);
+    if (total < (uint64_t) cctx->rctx->slow_request_threshold * 1000) {
+        return;
+    }
+
+    queued = client_usec_between(&creq->start, &creq->exec);
+    reply = client_usec_between(&creq->reply, &now);
+    work = total - queued - reply;
+    work = work > creq->dp_usec ? work - creq->dp_usec : 0;
+
+    DEBUG(SSSDBG_IMPORTANT_INFO,
+          "[RID#%u] Slow request [%s] took %"PRIu64" ms: "
+          "queued %"PRIu64" ms, responder %"PRIu64" ms, "
+          "data provider %"PRIu64" ms, reply %"PRIu64" ms\n",
+          creq->id, sss_cmd2str(creq->cmd), total / 1000, queued / 1000,
+          work / 1000, creq->dp_usec / 1000, reply / 1000);
+}
+
 static void client_send(struct cli_ctx *cctx)
 {
     int ret;
@@ -256,6 +323,12 @@ static void client_send(struct cli_ctx *cctx)
     /* ok all sent */
     TEVENT_FD_NOT_WRITEABLE(cctx->cfde);
     TEVENT_FD_READABLE(cctx->cfde);
+    PROBE(SSS_CMD_DONE, cctx, cctx->creq->cmd, cctx->creq->source);
+    client_record_stats(cctx);
+    client_log_slow(cctx);
+    if (cctx->rctx->reply_sent_fn != NULL) {
+        cctx->rctx->reply_sent_fn(cctx, cctx->rctx->reply_sent_pvt);
+    }
     talloc_free(cctx->creq);
     cctx->creq = NULL;
     return;
@@ -269,18 +342,259 @@ static int client_cmd_execute(struct cli_ctx *cctx, struct sss_cmd_table *sss_cm
     return sss_cmd_execute(cctx, cmd, sss_cmds);
 }
 
+/* Bulk requests are executed from a timer, one at a time. While interactive
+ * requests are in progress, the next one is not started before at least as
+ * much time as the previous one took has passed, so that the event loop
+ * serves those clients in between and gets at least half of the time for
+ * them. Without interactive requests the queue is drained back to back. */
+#define CLI_SCHED_MIN_GAP_USEC 1000
+
+struct cli_sched_item {
+    struct cli_sched_item *prev;
+    struct cli_sched_item *next;
+
+    struct cli_sched *sched;
+    struct cli_ctx *cctx;
+};
+
+/* hangs off an interactive request until it is answered */
+struct cli_sched_mark {
+    struct cli_sched_mark *prev;
+    struct cli_sched_mark *next;
+
+    struct cli_sched *sched;
+};
+
+struct cli_sched {
+    struct resp_ctx *rctx;
+    struct cli_sched_item *queue;
+    struct tevent_timer *te;
+    struct timeval next_slot;
+
+    /* the interactive requests in progress */
+    struct cli_sched_mark *interactive;
+};
+
+static void client_sched_run(struct tevent_context *ev,
+                             struct tevent_timer *te,
+                             struct timeval current_time,
+                             void *pvt);
+
+static int client_sched_destructor(struct cli_sched *sched)
+{
+    struct cli_sched_item *item;
+    struct cli_sched_mark *mark;
+
+    /* the clients may be freed after the queue */
+    for (item = sched->queue; item != NULL; item = item->next) {
+        talloc_set_destructor(item, NULL);
+    }
+    for (mark = sched->interactive; mark != NULL; mark = mark->next) {
+        talloc_set_destructor(mark, NULL);
+    }
+
+    return 0;
+}
+
+static errno_t client_sched_init(struct resp_ctx *rctx)
+{
+    struct cli_sched *sched;
+
+    sched = talloc_zero(rctx, struct cli_sched);
+    if (sched == NULL) {
+        return ENOMEM;
+    }
+    sched->rctx = rctx;
+    talloc_set_destructor(sched, client_sched_destructor);
+
+    rctx->sched = sched;
+    return EOK;
+}
+
+static enum sss_cmd_class client_cmd_class(struct cli_ctx *cctx)
+{
+    struct sss_cmd_table *sss_cmds = cctx->rctx->sss_cmds;
+    enum sss_cli_command cmd;
+    int i;
+
+    cmd = sss_packet_get_cmd(cctx->creq->in);
+    for (i = 0; sss_cmds[i].cmd != SSS_CLI_NULL; i++) {
+        if (cmd == sss_cmds[i].cmd) {
+            return sss_cmds[i].cmd_class;
+        }
+    }
+
+    return SSS_CMD_INTERACTIVE;
+}
+
+static void client_sched_arm(struct cli_sched *sched)
+{
+    struct timeval tv;
+
+    if (sched->te != NULL || sched->queue == NULL) {
+        return;
+    }
+
+    tv = tevent_timeval_current();
+    if (tevent_timeval_compare(&sched->next_slot, &tv) > 0) {
+        tv = sched->next_slot;
+    }
+
+    sched->te = tevent_add_timer(sched->rctx->ev, sched, tv,
+                                 client_sched_run, sched);
+    if (sched->te == NULL) {
+        /* the queue is retried with the next bulk request */
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not schedule bulk requests\n");
+    }
+}
+
+static int client_sched_item_destructor(struct cli_sched_item *item)
+{
+    DLIST_REMOVE(item->sched->queue, item);
+    return 0;
+}
+
+static int client_sched_mark_destructor(struct cli_sched_mark *mark)
+{
+    struct cli_sched *sched = mark->sched;
+
+    DLIST_REMOVE(sched->interactive, mark);
+
+    /* the bulk request waiting for its slot does not have to wait anymore */
+    if (sched->interactive == NULL && sched->te != NULL) {
+        talloc_zfree(sched->te);
+        sched->next_slot = tevent_timeval_zero();
+        client_sched_arm(sched);
+    }
+
+    return 0;
+}
+
+static errno_t client_sched_mark(struct cli_ctx *cctx)
+{
+    struct cli_sched *sched = cctx->rctx->sched;
+    struct cli_sched_mark *mark;
+
+    /* freed with the request once the reply was sent */
+    mark = talloc_zero(cctx->creq, struct cli_sched_mark);
+    if (mark == NULL) {
+        return ENOMEM;
+    }
+    mark->sched = sched;
+
+    DLIST_ADD(sched->interactive, mark);
+    talloc_set_destructor(mark, client_sched_mark_destructor);
+
+    return EOK;
+}
+
+static errno_t client_sched_queue(struct cli_ctx *cctx)
+{
+    struct cli_sched *sched = cctx->rctx->sched;
+    struct cli_sched_item *item;
+
+    /* freed together with the client if it goes away meanwhile */
+    item = talloc_zero(cctx, struct cli_sched_item);
+    if (item == NULL) {
+        return ENOMEM;
+    }
+    item->sched = sched;
+    item->cctx = cctx;
+
+    /* the time spent in the queue is part of the latency */
+    cctx->creq->start = tevent_timeval_current();
+
+    DLIST_ADD_END(sched->queue, item, struct cli_sched_item *);
+    talloc_set_destructor(item, client_sched_item_destructor);
+
+    client_sched_arm(sched);
+    return EOK;
+}
+
+static void client_sched_run(struct tevent_context *ev,
+                             struct tevent_timer *te,
+                             struct timeval current_time,
+                             void *pvt)
+{
+    struct cli_sched *sched = talloc_get_type(pvt, struct cli_sched);
+    struct cli_sched_item *item;
+    struct cli_ctx *cctx;
+    struct timeval start;
+    struct timeval elapsed;
+    int ret;
+
+    sched->te = NULL;
+
+    item = sched->queue;
+    if (item == NULL) {
+        return;
+    }
+    cctx = item->cctx;
+    talloc_free(item);
+
+    start = tevent_timeval_current();
+
+    ret = client_cmd_execute(cctx, sched->rctx->sss_cmds);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Failed to execute request, aborting client!\n");
+        talloc_free(cctx);
+    }
+
+    if (sched->interactive == NULL) {
+        sched->next_slot = tevent_timeval_zero();
+    } else {
+        elapsed = tevent_timeval_current();
+        elapsed = tevent_timeval_until(&start, &elapsed);
+        if (elapsed.tv_sec == 0 && elapsed.tv_usec < CLI_SCHED_MIN_GAP_USEC) {
+            elapsed.tv_usec = CLI_SCHED_MIN_GAP_USEC;
+        }
+        sched->next_slot = tevent_timeval_current_ofs(elapsed.tv_sec,
+                                                      elapsed.tv_usec);
+    }
+
+    client_sched_arm(sched);
+}
+
+static int client_dispatch(struct cli_ctx *cctx)
+{
+    errno_t ret;
+
+    if (cctx->rctx->sched != NULL) {
+        if (client_cmd_class(cctx) == SSS_CMD_BULK) {
+            return client_sched_queue(cctx);
+        }
+
+        ret = client_sched_mark(cctx);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return client_cmd_execute(cctx, cctx->rctx->sss_cmds);
+}
+
+/* A lookup by name with its cache search result takes a few kilobytes,
+ * large groups are allowed to overflow the pool */
+#define CLI_REQ_POOL_MIN_SIZE (8 * 1024)
+#define CLI_REQ_POOL_MAX_SIZE (128 * 1024)
+
 static void client_recv(struct cli_ctx *cctx)
 {
     int ret;
 
     if (!cctx->creq) {
-        cctx->creq = talloc_zero(cctx, struct cli_request);
+        /* the packets and the command contexts are allocated from the pool
+         * of the request and freed with it at once */
+        cctx->creq = talloc_pooled_object(cctx, struct cli_request, 0,
+                                          cctx->rctx->cmd_pool.size);
         if (!cctx->creq) {
             DEBUG(SSSDBG_FATAL_FAILURE,
                   "Failed to alloc request, aborting client!\n");
             talloc_free(cctx);
             return;
         }
+        memset(cctx->creq, 0, sizeof(struct cli_request));
     }
 
     if (!cctx->creq->in) {
@@ -299,8 +613,8 @@ static void client_recv(struct cli_ctx *cctx)
     case EOK:
         /* do not read anymore */
         TEVENT_FD_NOT_READABLE(cctx->cfde);
-        /* execute command */
-        ret = client_cmd_execute(cctx, cctx->rctx->sss_cmds);
+        /* execute command, or queue it behind the interactive ones */
+        ret = client_dispatch(cctx);
         if (ret != EOK) {
             DEBUG(SSSDBG_FATAL_FAILURE,
                   "Failed to execute request, aborting client!\n");
@@ -424,7 +738,14 @@ static void accept_fd_handler(struct tevent_context *ev,
     len = sizeof(cctx->addr);
     cctx->cfd = accept(fd, (struct sockaddr *)&cctx->addr, &len);
     if (cctx->cfd == -1) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Accept failed [%s]\n", strerror(errno));
+        ret = errno;
+        if (ret == EAGAIN || ret == EWOULDBLOCK) {
+            /* the pipe can be shared by several processes, another one
+             * accepted the connection first */
+            DEBUG(SSSDBG_TRACE_ALL, "No connection to accept\n");
+        } else {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Accept failed [%s]\n", strerror(ret));
+        }
         talloc_free(cctx);
         return;
     }
@@ -496,11 +817,52 @@ static void accept_fd_handler(struct tevent_context *ev,
     return;
 }
 
+errno_t sss_responder_add_helper_client(struct resp_ctx *rctx, int fd)
+{
+    struct cli_ctx *cctx;
+    errno_t ret;
+
+    cctx = talloc_zero(rctx, struct cli_ctx);
+    if (cctx == NULL) {
+        return ENOMEM;
+    }
+
+    cctx->cfd = fd;
+    cctx->ev = rctx->ev;
+    cctx->rctx = rctx;
+    cctx->helper = true;
+
+    ret = get_client_cred(cctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "get_client_cred failed, "
+                  "client cred may not be available.\n");
+    }
+
+    cctx->cfde = tevent_add_fd(rctx->ev, cctx, cctx->cfd,
+                               TEVENT_FD_READ, client_fd_handler, cctx);
+    if (cctx->cfde == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to queue helper client handler\n");
+        /* the caller still owns the fd */
+        talloc_free(cctx);
+        return ENOMEM;
+    }
+
+    talloc_set_destructor(cctx, client_destructor);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Helper client connected!\n");
+
+    return EOK;
+}
+
 static errno_t reset_idle_timer(struct cli_ctx *cctx)
 {
     struct timeval tv =
             tevent_timeval_current_ofs(cctx->rctx->client_idle_timeout, 0);
 
+    if (cctx->helper) {
+        return EOK;
+    }
+
     talloc_zfree(cctx->idle);
 
     cctx->idle = tevent_add_timer(cctx->ev, cctx, tv, idle_handler, cctx);
@@ -771,6 +1133,8 @@ int sss_process_init(TALLOC_CTX *mem_ctx,
 {
     struct resp_ctx *rctx;
     struct sss_domain_info *dom;
+    int obj_cache_size;
+    int obj_cache_timeout;
     int ret;
     char *tmp = NULL;
 
@@ -788,6 +1152,9 @@ int sss_process_init(TALLOC_CTX *mem_ctx,
     rctx->priv_lfd = priv_pipe_fd;
     rctx->confdb_service_path = confdb_service_path;
     rctx->shutting_down = false;
+    rctx->cmd_pool = (struct sss_pool_size) SSS_POOL_SIZE_INIT(
+                                                        CLI_REQ_POOL_MIN_SIZE,
+                                                        CLI_REQ_POOL_MAX_SIZE);
 
     talloc_set_destructor((TALLOC_CTX*)rctx, sss_responder_ctx_destructor);
 
@@ -807,6 +1174,36 @@ int sss_process_init(TALLOC_CTX *mem_ctx,
         rctx->client_idle_timeout = 10;
     }
 
+    ret = confdb_get_bool(rctx->cdb, rctx->confdb_service_path,
+                          CONFDB_RESPONDER_DP_FAST_TRANSPORT, false,
+                          &rctx->dp_fast_transport);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot get the data provider transport [%d]: %s\n",
+               ret, sss_strerror(ret));
+        goto fail;
+    }
+
+    ret = confdb_get_bool(rctx->cdb, rctx->confdb_service_path,
+                          CONFDB_RESPONDER_PARALLEL_DOMAIN_LOOKUP, false,
+                          &rctx->parallel_domain_lookup);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot get the parallel domain lookup setting [%d]: %s\n",
+               ret, sss_strerror(ret));
+        goto fail;
+    }
+
+    ret = confdb_get_int(rctx->cdb, rctx->confdb_service_path,
+                         CONFDB_RESPONDER_SLOW_REQUEST_THRESHOLD, 0,
+                         &rctx->slow_request_threshold);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot get the slow request threshold [%d]: %s\n",
+               ret, sss_strerror(ret));
+        goto fail;
+    }
+
     ret = confdb_get_int(rctx->cdb, rctx->confdb_service_path,
                          CONFDB_RESPONDER_GET_DOMAINS_TIMEOUT,
                          GET_DOMAINS_DEFAULT_TIMEOUT, &rctx->domains_timeout);
@@ -858,12 +1255,14 @@ int sss_process_init(TALLOC_CTX *mem_ctx,
         rctx->override_space = tmp[0];
     }
 
-    ret = sss_monitor_init(rctx, rctx->ev, monitor_intf,
-                           svc_name, svc_version, rctx,
-                           &rctx->mon_conn);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_FATAL_FAILURE, "fatal error setting up message bus\n");
-        goto fail;
+    if (monitor_intf != NULL) {
+        ret = sss_monitor_init(rctx, rctx->ev, monitor_intf,
+                               svc_name, svc_version, rctx,
+                               &rctx->mon_conn);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE, "fatal error setting up message bus\n");
+            goto fail;
+        }
     }
 
     for (dom = rctx->domains; dom; dom = get_next_domain(dom, 0)) {
@@ -888,12 +1287,18 @@ int sss_process_init(TALLOC_CTX *mem_ctx,
         }
     }
 
+    server_startup_begin(STARTUP_PHASE_SYSDB);
     ret = sysdb_init(rctx, rctx->domains, false);
     if (ret != EOK) {
         SYSDB_VERSION_ERROR_DAEMON(ret);
         DEBUG(SSSDBG_FATAL_FAILURE, "fatal error initializing resp_ctx\n");
         goto fail;
     }
+    server_startup_end(STARTUP_PHASE_SYSDB);
+
+    for (dom = rctx->domains; dom; dom = get_next_domain(dom, 0)) {
+        sysdb_set_snapshot_reader(dom->sysdb, dom->cache_snapshot_interval);
+    }
 
     /* after all initializations we are ready to listen on our socket */
     ret = set_unix_socket(rctx);
@@ -910,7 +1315,56 @@ int sss_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    ret = sss_hash_create(rctx, 30, &rctx->cache_req_table);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Could not create hash table for in-flight cache lookups\n");
+        goto fail;
+    }
+
+    ret = confdb_get_int(rctx->cdb, rctx->confdb_service_path,
+                         CONFDB_RESPONDER_OBJECT_CACHE_SIZE,
+                         CONFDB_RESPONDER_OBJECT_CACHE_DEFAULT_SIZE,
+                         &obj_cache_size);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot get the object cache size [%d]: %s\n",
+               ret, sss_strerror(ret));
+        goto fail;
+    }
+
+    ret = confdb_get_int(rctx->cdb, rctx->confdb_service_path,
+                         CONFDB_RESPONDER_OBJECT_CACHE_TIMEOUT,
+                         CONFDB_RESPONDER_OBJECT_CACHE_DEFAULT_TIMEOUT,
+                         &obj_cache_timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot get the object cache timeout [%d]: %s\n",
+               ret, sss_strerror(ret));
+        goto fail;
+    }
+
+    if (obj_cache_size < 0 || obj_cache_timeout < 0) {
+        obj_cache_size = 0;
+    }
+
+    ret = sss_objcache_init(rctx, obj_cache_size, obj_cache_timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Could not create the object cache\n");
+        goto fail;
+    }
+
+    /* non-fatal, the replies are just not measured */
+    sss_cmd_stats_open(rctx, svc_name, &rctx->cmd_stats);
+
+    ret = client_sched_init(rctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Could not create the request queue\n");
+        goto fail;
+    }
+
     DEBUG(SSSDBG_TRACE_FUNC, "Responder Initialization complete\n");
+    server_startup_ready();
 
     *responder_ctx = rctx;
     return EOK;
@@ -1021,6 +1475,11 @@ int responder_logrotate(struct sbus_request *dbus_req, void *data)
     errno_t ret;
     struct resp_ctx *rctx = talloc_get_type(data, struct resp_ctx);
 
+    /* sss_cache sends SIGHUP to the monitor after invalidating entries */
+    sss_objcache_invalidate(rctx, NULL);
+
+    sss_cmd_stats_dump(rctx);
+
     ret = server_common_rotate_logs(rctx->cdb, rctx->confdb_service_path);
     if (ret != EOK) return ret;
 
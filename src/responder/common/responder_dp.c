@@ -260,6 +260,7 @@ sss_dp_issue_request(TALLOC_CTX *mem_ctx, struct resp_ctx *rctx,
     hash_key_t *key;
     struct tevent_req *sidereq;
     struct sss_dp_req *sdp_req;
+    struct sss_dp_req_state *state;
     struct sss_dp_callback *cb;
     struct tevent_timer *te;
     struct timeval tv;
@@ -293,7 +294,8 @@ sss_dp_issue_request(TALLOC_CTX *mem_ctx, struct resp_ctx *rctx,
     case HASH_SUCCESS:
         /* Request already in progress */
         DEBUG(SSSDBG_TRACE_FUNC,
-              "Identical request in progress: [%s]\n", key->str);
+              "[RID#%u] Identical request in progress: [%s]\n",
+              sss_cmd_get_req_id(mem_ctx), key->str);
         break;
 
     case HASH_ERROR_KEY_NOT_FOUND:
@@ -366,6 +368,11 @@ sss_dp_issue_request(TALLOC_CTX *mem_ctx, struct resp_ctx *rctx,
     cb->req = nreq;
     cb->sdp_req = sdp_req;
 
+    /* the wait for the data provider is part of the latency of the client
+     * request, see sss_dp_req_recv() */
+    state = tevent_req_data(nreq, struct sss_dp_req_state);
+    state->start = tevent_timeval_current();
+
     /* Add it to the list of requests to call */
     DLIST_ADD_END(sdp_req->cb_list, cb,
                   struct sss_dp_callback *);
@@ -397,6 +404,17 @@ sss_dp_req_recv(TALLOC_CTX *mem_ctx,
 
     enum tevent_req_state TRROEstate;
     uint64_t TRROEerr;
+    struct timeval elapsed;
+    struct timeval now;
+
+    /* the client waited for the data provider */
+    sss_cmd_mark_source(sidereq, SSS_CMD_SRC_DP);
+    if (!tevent_timeval_is_zero(&state->start)) {
+        now = tevent_timeval_current();
+        elapsed = tevent_timeval_until(&state->start, &now);
+        sss_cmd_add_dp_time(sidereq, (uint64_t) elapsed.tv_sec * 1000000
+                                     + elapsed.tv_usec);
+    }
 
     *dp_err = state->dp_err;
     *dp_ret = state->dp_ret;
@@ -431,6 +449,9 @@ struct sss_dp_account_info {
     const char *opt_name;
     const char *extra;
     uint32_t opt_id;
+
+    /* the client request which needs the lookup, for the logs */
+    uint32_t req_id;
 };
 
 struct tevent_req *
@@ -472,6 +493,7 @@ sss_dp_get_account_send(TALLOC_CTX *mem_ctx,
     info->opt_id = opt_id;
     info->extra = extra;
     info->dom = dom;
+    info->req_id = sss_cmd_get_req_id(mem_ctx);
 
     if (opt_name) {
         if (extra) {
@@ -620,14 +642,16 @@ sss_dp_get_account_msg(void *pvt)
 
     /* create the message */
     DEBUG(SSSDBG_TRACE_FUNC,
-          "Creating request for [%s][%#x][%s][%d][%s]\n",
-           info->dom->name, be_type, be_req2str(be_type), attrs, filter);
+          "[RID#%u] Creating request for [%s][%#x][%s][%d][%s]\n",
+           info->req_id, info->dom->name, be_type, be_req2str(be_type),
+           attrs, filter);
 
     dbret = dbus_message_append_args(msg,
                                      DBUS_TYPE_UINT32, &be_type,
                                      DBUS_TYPE_UINT32, &attrs,
                                      DBUS_TYPE_STRING, &filter,
                                      DBUS_TYPE_STRING, &info->dom->name,
+                                     DBUS_TYPE_UINT32, &info->req_id,
                                      DBUS_TYPE_INVALID);
     talloc_free(filter);
     if (!dbret) {
@@ -658,6 +682,59 @@ struct dp_internal_get_state {
 };
 
 static void sss_dp_internal_get_done(DBusPendingCall *pending, void *ptr);
+static void sss_dp_internal_get_fast_done(struct tevent_req *subreq);
+
+/* Sends a getAccountInfo message over the socket of responder_dp_fast.c
+ * instead of D-Bus. Returns false if the message must be sent over D-Bus. */
+static bool sss_dp_internal_get_fast(struct tevent_req *req,
+                                     struct be_conn *be_conn,
+                                     DBusMessage *msg)
+{
+    struct dp_internal_get_state *state;
+    struct tevent_req *subreq;
+    DBusError dbus_error;
+    dbus_bool_t dbret;
+    dbus_uint32_t type;
+    dbus_uint32_t attrs;
+    const char *filter;
+    const char *domain;
+    dbus_uint32_t req_id;
+
+    state = tevent_req_data(req, struct dp_internal_get_state);
+
+    if (!state->rctx->dp_fast_transport
+            || !dbus_message_is_method_call(msg, DATA_PROVIDER_IFACE,
+                                      DATA_PROVIDER_IFACE_GETACCOUNTINFO)) {
+        return false;
+    }
+
+    if (!sss_dp_fast_connect(be_conn)) {
+        return false;
+    }
+
+    dbus_error_init(&dbus_error);
+    dbret = dbus_message_get_args(msg, &dbus_error,
+                                  DBUS_TYPE_UINT32, &type,
+                                  DBUS_TYPE_UINT32, &attrs,
+                                  DBUS_TYPE_STRING, &filter,
+                                  DBUS_TYPE_STRING, &domain,
+                                  DBUS_TYPE_UINT32, &req_id,
+                                  DBUS_TYPE_INVALID);
+    if (!dbret) {
+        if (dbus_error_is_set(&dbus_error)) dbus_error_free(&dbus_error);
+        return false;
+    }
+
+    /* freed with the sdp_req, which drops the reply */
+    subreq = sss_dp_fast_send(state->sdp_req, state->rctx->ev, be_conn,
+                              type, attrs, filter, domain, req_id);
+    if (subreq == NULL) {
+        return false;
+    }
+    tevent_req_set_callback(subreq, sss_dp_internal_get_fast_done, req);
+
+    return true;
+}
 
 static struct tevent_req *
 sss_dp_internal_get_send(struct resp_ctx *rctx,
@@ -712,11 +789,15 @@ sss_dp_internal_get_send(struct resp_ctx *rctx,
         goto error;
     }
 
-    ret = sbus_conn_send(be_conn->conn, msg,
-                         SSS_CLI_SOCKET_TIMEOUT / 2,
-                         sss_dp_internal_get_done,
-                         req,
-                         &state->sdp_req->pending_reply);
+    if (sss_dp_internal_get_fast(req, be_conn, msg)) {
+        ret = EOK;
+    } else {
+        ret = sbus_conn_send(be_conn->conn, msg,
+                             SSS_CLI_SOCKET_TIMEOUT / 2,
+                             sss_dp_internal_get_done,
+                             req,
+                             &state->sdp_req->pending_reply);
+    }
     if (ret != EOK) {
         /*
          * Critical Failure
@@ -752,14 +833,14 @@ error:
     return req;
 }
 
+static void sss_dp_internal_get_finish(struct tevent_req *req, int ret);
+
 static void sss_dp_internal_get_done(DBusPendingCall *pending, void *ptr)
 {
     int ret;
     struct tevent_req *req;
     struct sss_dp_req *sdp_req;
-    struct sss_dp_callback *cb;
     struct dp_internal_get_state *state;
-    struct sss_dp_req_state *cb_state;
 
     req = talloc_get_type(ptr, struct tevent_req);
     state = tevent_req_data(req, struct dp_internal_get_state);
@@ -772,6 +853,42 @@ static void sss_dp_internal_get_done(DBusPendingCall *pending, void *ptr)
                            &sdp_req->dp_err,
                            &sdp_req->dp_ret,
                            &sdp_req->err_msg);
+    sss_dp_internal_get_finish(req, ret);
+}
+
+static void sss_dp_internal_get_fast_done(struct tevent_req *subreq)
+{
+    int ret;
+    struct tevent_req *req;
+    struct sss_dp_req *sdp_req;
+    struct dp_internal_get_state *state;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct dp_internal_get_state);
+    sdp_req = state->sdp_req;
+
+    ret = sss_dp_fast_recv(sdp_req, subreq,
+                           &sdp_req->dp_err,
+                           &sdp_req->dp_ret,
+                           &sdp_req->err_msg);
+    talloc_zfree(subreq);
+    if (ret == ETIMEDOUT) {
+        ret = ETIME;
+    }
+
+    sss_dp_internal_get_finish(req, ret);
+}
+
+static void sss_dp_internal_get_finish(struct tevent_req *req, int ret)
+{
+    struct sss_dp_req *sdp_req;
+    struct sss_dp_callback *cb;
+    struct dp_internal_get_state *state;
+    struct sss_dp_req_state *cb_state;
+
+    state = tevent_req_data(req, struct dp_internal_get_state);
+    sdp_req = state->sdp_req;
+
     if (ret != EOK) {
         if (ret == ETIME) {
             sdp_req->dp_err = DP_ERR_TIMEOUT;
@@ -787,6 +904,14 @@ static void sss_dp_internal_get_done(DBusPendingCall *pending, void *ptr)
         }
     }
 
+    /* the callbacks read what the back end wrote from the cache, the
+     * request may have changed other objects of the domain as well, e.g.
+     * the members of the groups of a user */
+    if (state->dom != NULL) {
+        sysdb_snapshot_invalidate(state->dom->sysdb);
+    }
+    sss_objcache_invalidate(state->rctx, state->dom);
+
     /* Check whether we need to issue any callbacks */
     while ((cb = sdp_req->cb_list) != NULL) {
         cb_state = tevent_req_data(cb->req, struct sss_dp_req_state);
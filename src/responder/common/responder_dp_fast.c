@@ -0,0 +1,484 @@
+/*
+   SSSD
+
+   Framed binary transport of the account requests, responder side
+
+   Copyright (C) 2016 Red Hat
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <talloc.h>
+#include <tevent.h>
+
+#include "util/util.h"
+#include "responder/common/responder.h"
+#include "providers/data_provider.h"
+
+/* The account requests are sent over the socket of the back end described
+ * in data_provider.h if it is available. The connection is opened when the
+ * first request is sent. If it fails the requests are sent over D-Bus and
+ * the connection is retried after SSS_DP_FAST_RETRY seconds. */
+
+#define SSS_DP_FAST_RETRY 30
+
+struct sss_dp_fast_state;
+
+struct sss_dp_fast_conn {
+    struct be_conn *be_conn;
+    int fd;
+    struct tevent_fd *fde;
+    time_t retry;
+
+    uint32_t last_id;
+    struct sss_dp_fast_state *pending;
+
+    uint8_t *in;
+    size_t in_len;
+
+    uint8_t *out;
+    size_t out_len;
+};
+
+struct sss_dp_fast_state {
+    struct sss_dp_fast_state *prev;
+    struct sss_dp_fast_state *next;
+
+    /* NULL once the request is not pending any more */
+    struct sss_dp_fast_conn *conn;
+    struct tevent_req *req;
+    uint32_t id;
+
+    dbus_uint16_t dp_err;
+    dbus_uint32_t dp_ret;
+    char *err_msg;
+};
+
+static void sss_dp_fast_disconnect(struct sss_dp_fast_conn *conn)
+{
+    struct sss_dp_fast_state *state;
+
+    DEBUG(SSSDBG_MINOR_FAILURE, "Lost the fast connection to [%s], "
+          "using D-Bus for the next %d seconds\n",
+          conn->be_conn->domain->name, SSS_DP_FAST_RETRY);
+
+    talloc_zfree(conn->fde);
+    if (conn->fd != -1) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    conn->retry = time(NULL) + SSS_DP_FAST_RETRY;
+    conn->in_len = 0;
+    conn->out_len = 0;
+
+    while ((state = conn->pending) != NULL) {
+        DLIST_REMOVE(conn->pending, state);
+        state->conn = NULL;
+        tevent_req_error(state->req, EIO);
+    }
+}
+
+static int sss_dp_fast_conn_destructor(struct sss_dp_fast_conn *conn)
+{
+    struct sss_dp_fast_state *state;
+
+    talloc_zfree(conn->fde);
+    if (conn->fd != -1) {
+        close(conn->fd);
+    }
+
+    /* the requests are freed together with the responder */
+    while ((state = conn->pending) != NULL) {
+        DLIST_REMOVE(conn->pending, state);
+        state->conn = NULL;
+    }
+
+    return 0;
+}
+
+static errno_t sss_dp_fast_reply(struct sss_dp_fast_conn *conn,
+                                 uint8_t *body, size_t len)
+{
+    struct sss_dp_fast_state *state;
+    uint32_t id;
+    uint32_t dp_err;
+    uint32_t dp_ret;
+    uint32_t msg_len;
+    size_t p = 0;
+
+    SAFEALIGN_COPY_UINT32_CHECK(&id, body, len, &p);
+    SAFEALIGN_COPY_UINT32_CHECK(&dp_err, &body[p], len, &p);
+    SAFEALIGN_COPY_UINT32_CHECK(&dp_ret, &body[p], len, &p);
+    SAFEALIGN_COPY_UINT32_CHECK(&msg_len, &body[p], len, &p);
+    if (msg_len > len - p) {
+        return EINVAL;
+    }
+
+    DLIST_FOR_EACH(state, conn->pending) {
+        if (state->id == id) {
+            break;
+        }
+    }
+
+    if (state == NULL) {
+        /* the request was freed in the meantime */
+        return EOK;
+    }
+
+    DLIST_REMOVE(conn->pending, state);
+    state->conn = NULL;
+
+    state->dp_err = dp_err;
+    state->dp_ret = dp_ret;
+    state->err_msg = talloc_strndup(state, (char *) &body[p], msg_len);
+    if (state->err_msg == NULL) {
+        tevent_req_error(state->req, ENOMEM);
+        return EOK;
+    }
+
+    DEBUG(SSSDBG_TRACE_LIBS,
+          "Got fast reply from Data Provider - "
+          "DP error code: %u errno: %u error message: %s\n",
+          (unsigned int) dp_err, (unsigned int) dp_ret, state->err_msg);
+
+    tevent_req_done(state->req);
+    return EOK;
+}
+
+static errno_t sss_dp_fast_read(struct sss_dp_fast_conn *conn)
+{
+    uint32_t frame_len;
+    size_t used = 0;
+    size_t p;
+    ssize_t len;
+    errno_t ret;
+
+    len = read(conn->fd, &conn->in[conn->in_len],
+               sizeof(uint32_t) + DP_FAST_MAX_FRAME - conn->in_len);
+    if (len == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return EOK;
+        }
+        return errno;
+    } else if (len == 0) {
+        /* the back end was restarted */
+        return ENOTCONN;
+    }
+    conn->in_len += len;
+
+    while (conn->in_len - used >= sizeof(uint32_t)) {
+        p = used;
+        SAFEALIGN_COPY_UINT32(&frame_len, &conn->in[p], &p);
+        if (frame_len > DP_FAST_MAX_FRAME) {
+            return EIO;
+        }
+
+        if (conn->in_len - p < frame_len) {
+            break;
+        }
+
+        ret = sss_dp_fast_reply(conn, &conn->in[p], frame_len);
+        if (ret != EOK) {
+            return ret;
+        }
+        used = p + frame_len;
+    }
+
+    memmove(conn->in, &conn->in[used], conn->in_len - used);
+    conn->in_len -= used;
+
+    return EOK;
+}
+
+static errno_t sss_dp_fast_write(struct sss_dp_fast_conn *conn)
+{
+    ssize_t len;
+
+    len = write(conn->fd, conn->out, conn->out_len);
+    if (len == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return EOK;
+        }
+        return errno;
+    }
+
+    memmove(conn->out, &conn->out[len], conn->out_len - len);
+    conn->out_len -= len;
+
+    if (conn->out_len == 0) {
+        TEVENT_FD_NOT_WRITEABLE(conn->fde);
+    }
+
+    return EOK;
+}
+
+static void sss_dp_fast_handler(struct tevent_context *ev,
+                                struct tevent_fd *fde,
+                                uint16_t flags, void *pvt)
+{
+    struct sss_dp_fast_conn *conn;
+    errno_t ret = EOK;
+
+    conn = talloc_get_type(pvt, struct sss_dp_fast_conn);
+
+    if (flags & TEVENT_FD_WRITE) {
+        ret = sss_dp_fast_write(conn);
+    }
+
+    if (ret == EOK && (flags & TEVENT_FD_READ)) {
+        ret = sss_dp_fast_read(conn);
+    }
+
+    if (ret != EOK) {
+        sss_dp_fast_disconnect(conn);
+    }
+}
+
+static errno_t sss_dp_fast_open(struct sss_dp_fast_conn *conn)
+{
+    struct sockaddr_un addr;
+    char *path;
+    int flags;
+    errno_t ret;
+    int fd;
+
+    ret = dp_get_fast_address(conn, &path, conn->be_conn->domain->name);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        talloc_free(path);
+        return ENAMETOOLONG;
+    }
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    talloc_free(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return errno;
+    }
+
+    flags = fcntl(fd, F_GETFD, 0);
+    if (flags == -1 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
+        ret = errno;
+        goto fail;
+    }
+
+    /* a unix socket connects at once or not at all */
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        ret = errno;
+        goto fail;
+    }
+
+    ret = sss_fd_nonblocking(fd);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    conn->fde = tevent_add_fd(conn->be_conn->rctx->ev, conn, fd,
+                              TEVENT_FD_READ, sss_dp_fast_handler, conn);
+    if (conn->fde == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    conn->fd = fd;
+
+    return EOK;
+
+fail:
+    close(fd);
+    return ret;
+}
+
+bool sss_dp_fast_connect(struct be_conn *be_conn)
+{
+    struct sss_dp_fast_conn *conn = be_conn->fast;
+    errno_t ret;
+
+    if (conn == NULL) {
+        conn = talloc_zero(be_conn, struct sss_dp_fast_conn);
+        if (conn == NULL) {
+            return false;
+        }
+        conn->in = talloc_size(conn, sizeof(uint32_t) + DP_FAST_MAX_FRAME);
+        if (conn->in == NULL) {
+            talloc_free(conn);
+            return false;
+        }
+        conn->be_conn = be_conn;
+        conn->fd = -1;
+        talloc_set_destructor(conn, sss_dp_fast_conn_destructor);
+        be_conn->fast = conn;
+    }
+
+    if (conn->fd != -1) {
+        return true;
+    }
+
+    if (conn->retry > time(NULL)) {
+        return false;
+    }
+
+    ret = sss_dp_fast_open(conn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Cannot connect to the fast socket of [%s] [%d]: %s\n",
+              be_conn->domain->name, ret, sss_strerror(ret));
+        conn->retry = time(NULL) + SSS_DP_FAST_RETRY;
+        return false;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Connected to the fast socket of [%s]\n",
+          be_conn->domain->name);
+    return true;
+}
+
+static int sss_dp_fast_state_destructor(struct sss_dp_fast_state *state)
+{
+    /* the reply is dropped when it arrives */
+    if (state->conn != NULL) {
+        DLIST_REMOVE(state->conn->pending, state);
+        state->conn = NULL;
+    }
+
+    return 0;
+}
+
+static errno_t sss_dp_fast_queue(struct sss_dp_fast_conn *conn,
+                                 uint32_t id,
+                                 uint32_t type,
+                                 uint32_t attrs,
+                                 const char *filter,
+                                 const char *domain,
+                                 uint32_t req_id)
+{
+    uint32_t filter_len = strlen(filter);
+    uint32_t domain_len = strlen(domain);
+    uint32_t frame_len;
+    uint8_t *out;
+    size_t p;
+
+    frame_len = 6 * sizeof(uint32_t) + filter_len + domain_len;
+    if (frame_len > DP_FAST_MAX_FRAME) {
+        return EINVAL;
+    }
+
+    out = talloc_realloc(conn, conn->out, uint8_t,
+                         conn->out_len + sizeof(uint32_t) + frame_len);
+    if (out == NULL) {
+        return ENOMEM;
+    }
+    conn->out = out;
+
+    p = conn->out_len;
+    SAFEALIGN_SET_UINT32(&out[p], frame_len, &p);
+    SAFEALIGN_SET_UINT32(&out[p], id, &p);
+    SAFEALIGN_SET_UINT32(&out[p], type, &p);
+    SAFEALIGN_SET_UINT32(&out[p], attrs, &p);
+    SAFEALIGN_SET_UINT32(&out[p], filter_len, &p);
+    safealign_memcpy(&out[p], filter, filter_len, &p);
+    SAFEALIGN_SET_UINT32(&out[p], domain_len, &p);
+    safealign_memcpy(&out[p], domain, domain_len, &p);
+    SAFEALIGN_SET_UINT32(&out[p], req_id, &p);
+    conn->out_len = p;
+
+    TEVENT_FD_WRITEABLE(conn->fde);
+    return EOK;
+}
+
+struct tevent_req *sss_dp_fast_send(TALLOC_CTX *mem_ctx,
+                                    struct tevent_context *ev,
+                                    struct be_conn *be_conn,
+                                    uint32_t type,
+                                    uint32_t attrs,
+                                    const char *filter,
+                                    const char *domain,
+                                    uint32_t req_id)
+{
+    struct sss_dp_fast_conn *conn = be_conn->fast;
+    struct sss_dp_fast_state *state;
+    struct tevent_req *req;
+    struct timeval tv;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct sss_dp_fast_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->req = req;
+
+    if (conn == NULL || conn->fd == -1) {
+        ret = ENOTCONN;
+        goto immediately;
+    }
+
+    /* 0 is the id of the replies which are never sent */
+    conn->last_id++;
+    if (conn->last_id == 0) {
+        conn->last_id++;
+    }
+    state->id = conn->last_id;
+
+    ret = sss_dp_fast_queue(conn, state->id, type, attrs, filter, domain,
+                            req_id);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    /* the same timeout as the D-Bus method call */
+    tv = tevent_timeval_current_ofs(SSS_CLI_SOCKET_TIMEOUT / 2000, 0);
+    if (!tevent_req_set_endtime(req, ev, tv)) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    state->conn = conn;
+    DLIST_ADD_END(conn->pending, state, struct sss_dp_fast_state *);
+    talloc_set_destructor(state, sss_dp_fast_state_destructor);
+
+    return req;
+
+immediately:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+errno_t sss_dp_fast_recv(TALLOC_CTX *mem_ctx,
+                         struct tevent_req *req,
+                         dbus_uint16_t *_dp_err,
+                         dbus_uint32_t *_dp_ret,
+                         char **_err_msg)
+{
+    struct sss_dp_fast_state *state;
+
+    state = tevent_req_data(req, struct sss_dp_fast_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_dp_err = state->dp_err;
+    *_dp_ret = state->dp_ret;
+    *_err_msg = talloc_steal(mem_ctx, state->err_msg);
+
+    return EOK;
+}
@@ -0,0 +1,343 @@
+/*
+   SSSD
+
+   Refresh-ahead of frequently requested objects
+
+   Copyright (C) 2016 Red Hat
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <talloc.h>
+#include <tevent.h>
+#include <dhash.h>
+#include <time.h>
+
+#include "util/util.h"
+#include "responder/common/responder.h"
+
+/* The responder counts how often the valid cached objects are requested.
+ * Every SSS_HOTLIST_INTERVAL seconds the most requested objects which are
+ * going to expire before the next check but one are refreshed by the data
+ * provider, so their lookups never have to wait for it. The counters are
+ * halved on every check and objects which are not requested any more are
+ * forgotten. */
+
+#define SSS_HOTLIST_INTERVAL 30
+
+struct sss_hotlist_entry {
+    struct sss_hotlist *list;
+    hash_key_t key;
+
+    char *domain;
+    enum sss_dp_acct_type dp_type;
+    char *name;
+    uint32_t id;
+    char *extra;
+
+    time_t expire;
+    /* the expiration time of the object when it was last refreshed */
+    time_t refreshed;
+    unsigned long hits;
+};
+
+struct sss_hotlist {
+    struct resp_ctx *rctx;
+    hash_table_t *table;
+    struct tevent_timer *te;
+
+    unsigned int count;
+    unsigned int max_entries;
+    unsigned int top;
+};
+
+static int sss_hotlist_entry_destructor(struct sss_hotlist_entry *entry)
+{
+    int hret;
+
+    hret = hash_delete(entry->list->table, &entry->key);
+    if (hret != HASH_SUCCESS) {
+        /* This should never happen */
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "BUG: Could not remove [%s] from the hot list: [%s]\n",
+              entry->key.str, hash_error_string(hret));
+    }
+    entry->list->count--;
+
+    return 0;
+}
+
+static struct sss_hotlist_entry *
+sss_hotlist_find(struct sss_hotlist *list, const char *key)
+{
+    hash_key_t hkey;
+    hash_value_t value;
+    int hret;
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = discard_const(key);
+
+    hret = hash_lookup(list->table, &hkey, &value);
+    if (hret != HASH_SUCCESS) {
+        return NULL;
+    }
+
+    return talloc_get_type(value.ptr, struct sss_hotlist_entry);
+}
+
+static void sss_hotlist_timer(struct tevent_context *ev,
+                              struct tevent_timer *te,
+                              struct timeval tv, void *pvt);
+
+static void sss_hotlist_schedule(struct sss_hotlist *list)
+{
+    struct timeval tv;
+
+    tv = tevent_timeval_current_ofs(SSS_HOTLIST_INTERVAL, 0);
+    list->te = tevent_add_timer(list->rctx->ev, list, tv,
+                                sss_hotlist_timer, list);
+    if (list->te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Cannot schedule the refresh of popular objects\n");
+    }
+}
+
+static void sss_hotlist_timer(struct tevent_context *ev,
+                              struct tevent_timer *te,
+                              struct timeval tv, void *pvt)
+{
+    struct sss_hotlist *list = talloc_get_type(pvt, struct sss_hotlist);
+
+    list->te = NULL;
+    sss_hotlist_refresh(list->rctx, time(NULL));
+    sss_hotlist_schedule(list);
+}
+
+errno_t sss_hotlist_init(struct resp_ctx *rctx, unsigned int top)
+{
+    struct sss_hotlist *list;
+    errno_t ret;
+
+    if (top == 0) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Refresh-ahead is disabled\n");
+        return EOK;
+    }
+
+    list = talloc_zero(rctx, struct sss_hotlist);
+    if (list == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_hash_create(list, 10, &list->table);
+    if (ret != EOK) {
+        talloc_free(list);
+        return ret;
+    }
+
+    list->rctx = rctx;
+    list->top = top;
+    /* leaves room for the objects which are becoming popular */
+    list->max_entries = top * 8;
+
+    sss_hotlist_schedule(list);
+    rctx->hotlist = list;
+
+    return EOK;
+}
+
+void sss_hotlist_hit(struct resp_ctx *rctx,
+                     struct sss_domain_info *domain,
+                     const char *key,
+                     enum sss_dp_acct_type dp_type,
+                     const char *name,
+                     uint32_t id,
+                     const char *extra,
+                     time_t expire)
+{
+    struct sss_hotlist *list = rctx->hotlist;
+    struct sss_hotlist_entry *entry;
+    hash_value_t value;
+    int hret;
+
+    if (list == NULL || key == NULL || expire <= 0) {
+        return;
+    }
+
+    entry = sss_hotlist_find(list, key);
+    if (entry != NULL) {
+        entry->expire = expire;
+        entry->hits++;
+        return;
+    }
+
+    if (list->count >= list->max_entries) {
+        /* there is room again once the counters decayed */
+        return;
+    }
+
+    entry = talloc_zero(list, struct sss_hotlist_entry);
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->list = list;
+    entry->key.type = HASH_KEY_STRING;
+    entry->key.str = talloc_strdup(entry, key);
+    entry->domain = talloc_strdup(entry, domain->name);
+    entry->dp_type = dp_type;
+    entry->id = id;
+    if (name != NULL) {
+        entry->name = talloc_strdup(entry, name);
+    }
+    if (extra != NULL) {
+        entry->extra = talloc_strdup(entry, extra);
+    }
+    if (entry->key.str == NULL || entry->domain == NULL
+            || (name != NULL && entry->name == NULL)
+            || (extra != NULL && entry->extra == NULL)) {
+        talloc_free(entry);
+        return;
+    }
+    entry->expire = expire;
+    entry->hits = 1;
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = entry;
+
+    hret = hash_enter(list->table, &entry->key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to add [%s] to the hot list: [%s]\n",
+              key, hash_error_string(hret));
+        talloc_free(entry);
+        return;
+    }
+
+    list->count++;
+    talloc_set_destructor(entry, sss_hotlist_entry_destructor);
+}
+
+static int sss_hotlist_cmp(const void *a, const void *b)
+{
+    const struct sss_hotlist_entry *ea = *(struct sss_hotlist_entry **) a;
+    const struct sss_hotlist_entry *eb = *(struct sss_hotlist_entry **) b;
+
+    if (ea->hits == eb->hits) {
+        return 0;
+    }
+
+    /* the most requested first */
+    return ea->hits > eb->hits ? -1 : 1;
+}
+
+static void sss_hotlist_refresh_done(struct tevent_req *subreq)
+{
+    dbus_uint16_t err_maj;
+    dbus_uint32_t err_min;
+    char *err_msg = NULL;
+    errno_t ret;
+
+    ret = sss_dp_get_account_recv(subreq, subreq, &err_maj, &err_min,
+                                  &err_msg);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Refresh-ahead failed [%d]: %s\n", ret, sss_strerror(ret));
+    }
+    talloc_free(subreq);
+}
+
+unsigned int sss_hotlist_refresh(struct resp_ctx *rctx, time_t now)
+{
+    struct sss_hotlist *list = rctx->hotlist;
+    struct sss_hotlist_entry **candidates;
+    struct sss_hotlist_entry *entry;
+    struct sss_domain_info *dom;
+    struct tevent_req *subreq;
+    hash_value_t *values;
+    unsigned long count;
+    unsigned long num = 0;
+    unsigned long i;
+    unsigned int sent = 0;
+    int hret;
+
+    if (list == NULL || list->count == 0) {
+        return 0;
+    }
+
+    hret = hash_values(list->table, &count, &values);
+    if (hret != HASH_SUCCESS) {
+        return 0;
+    }
+
+    candidates = talloc_zero_array(list, struct sss_hotlist_entry *, count);
+    if (candidates == NULL) {
+        talloc_free(values);
+        return 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        entry = talloc_get_type(values[i].ptr, struct sss_hotlist_entry);
+        if (entry->expire > now
+                && entry->expire <= now + 2 * SSS_HOTLIST_INTERVAL
+                && entry->expire != entry->refreshed) {
+            candidates[num++] = entry;
+        }
+    }
+
+    qsort(candidates, num, sizeof(struct sss_hotlist_entry *),
+          sss_hotlist_cmp);
+
+    for (i = 0; i < num && sent < list->top; i++) {
+        entry = candidates[i];
+
+        dom = responder_get_domain(rctx, entry->domain);
+        if (dom == NULL) {
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Refreshing [%s] before it expires, it was requested %lu "
+              "times recently\n", entry->key.str, entry->hits);
+
+        subreq = sss_dp_get_account_send(list, rctx, dom, true,
+                                         entry->dp_type, entry->name,
+                                         entry->id, entry->extra);
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory sending refresh-ahead "
+                                       "data provider request\n");
+            break;
+        }
+        tevent_req_set_callback(subreq, sss_hotlist_refresh_done, NULL);
+
+        entry->refreshed = entry->expire;
+        /* the next lookup has to see the updated object */
+        sss_objcache_remove(rctx, entry->key.str);
+        sent++;
+    }
+
+    /* only the recent requests count */
+    for (i = 0; i < count; i++) {
+        entry = talloc_get_type(values[i].ptr, struct sss_hotlist_entry);
+        entry->hits /= 2;
+        if (entry->hits == 0) {
+            talloc_free(entry);
+        }
+    }
+
+    talloc_free(candidates);
+    talloc_free(values);
+
+    return sent;
+}
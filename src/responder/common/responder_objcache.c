@@ -0,0 +1,289 @@
+/*
+   SSSD
+
+   Responder object cache
+
+   Copyright (C) 2016 Red Hat
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <ldb.h>
+#include <dhash.h>
+#include <time.h>
+
+#include "util/util.h"
+#include "responder/common/responder.h"
+
+/* The object cache keeps the results of recent sysdb lookups of single
+ * objects, so that repeated lookups do not search and unpack the ldb
+ * messages again. Entries are kept only for a short time since the data
+ * provider updates the sysdb without notifying the responders, and the
+ * least recently used entry is dropped when the cache is full. */
+
+struct sss_objcache_entry {
+    struct sss_objcache_entry *prev;
+    struct sss_objcache_entry *next;
+
+    struct sss_objcache *cache;
+    hash_key_t key;
+    char *domain;
+    time_t expire;
+
+    struct ldb_result *result;
+};
+
+struct sss_objcache {
+    hash_table_t *table;
+    /* most recently used first */
+    struct sss_objcache_entry *entries;
+    struct sss_objcache_entry *last;
+
+    unsigned int count;
+    unsigned int max_entries;
+    time_t timeout;
+};
+
+static struct ldb_result *sss_objcache_copy_result(TALLOC_CTX *mem_ctx,
+                                                   struct ldb_result *result)
+{
+    struct ldb_result *copy;
+    unsigned int i;
+
+    copy = talloc_zero(mem_ctx, struct ldb_result);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    copy->msgs = talloc_zero_array(copy, struct ldb_message *,
+                                   result->count + 1);
+    if (copy->msgs == NULL) {
+        talloc_free(copy);
+        return NULL;
+    }
+
+    for (i = 0; i < result->count; i++) {
+        copy->msgs[i] = ldb_msg_copy(copy->msgs, result->msgs[i]);
+        if (copy->msgs[i] == NULL) {
+            talloc_free(copy);
+            return NULL;
+        }
+    }
+    copy->count = result->count;
+
+    return copy;
+}
+
+static int sss_objcache_entry_destructor(struct sss_objcache_entry *entry)
+{
+    struct sss_objcache *cache = entry->cache;
+    int hret;
+
+    if (cache->last == entry) {
+        cache->last = entry->prev;
+    }
+    DLIST_REMOVE(cache->entries, entry);
+    cache->count--;
+
+    hret = hash_delete(cache->table, &entry->key);
+    if (hret != HASH_SUCCESS) {
+        /* This should never happen */
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "BUG: Could not remove [%s] from the object cache: [%s]\n",
+              entry->key.str, hash_error_string(hret));
+    }
+
+    return 0;
+}
+
+static struct sss_objcache_entry *
+sss_objcache_find(struct sss_objcache *cache, const char *key)
+{
+    hash_key_t hkey;
+    hash_value_t value;
+    int hret;
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = discard_const(key);
+
+    hret = hash_lookup(cache->table, &hkey, &value);
+    if (hret != HASH_SUCCESS) {
+        return NULL;
+    }
+
+    return talloc_get_type(value.ptr, struct sss_objcache_entry);
+}
+
+errno_t sss_objcache_init(struct resp_ctx *rctx,
+                          unsigned int max_entries,
+                          time_t timeout)
+{
+    struct sss_objcache *cache;
+    errno_t ret;
+
+    if (max_entries == 0 || timeout <= 0) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "The object cache is disabled\n");
+        return EOK;
+    }
+
+    cache = talloc_zero(rctx, struct sss_objcache);
+    if (cache == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_hash_create(cache, 10, &cache->table);
+    if (ret != EOK) {
+        talloc_free(cache);
+        return ret;
+    }
+
+    cache->max_entries = max_entries;
+    cache->timeout = timeout;
+
+    rctx->obj_cache = cache;
+
+    return EOK;
+}
+
+errno_t sss_objcache_get(TALLOC_CTX *mem_ctx,
+                         struct resp_ctx *rctx,
+                         const char *key,
+                         struct ldb_result **_result)
+{
+    struct sss_objcache *cache = rctx->obj_cache;
+    struct sss_objcache_entry *entry;
+    struct ldb_result *result;
+
+    if (cache == NULL || key == NULL) {
+        return ENOENT;
+    }
+
+    entry = sss_objcache_find(cache, key);
+    if (entry == NULL) {
+        return ENOENT;
+    }
+
+    if (entry->expire < time(NULL)) {
+        talloc_free(entry);
+        return ENOENT;
+    }
+
+    /* the caller may modify the result, never hand out the cached one */
+    result = sss_objcache_copy_result(mem_ctx, entry->result);
+    if (result == NULL) {
+        return ENOMEM;
+    }
+
+    if (cache->entries != entry) {
+        if (cache->last == entry) {
+            cache->last = entry->prev;
+        }
+        DLIST_PROMOTE(cache->entries, entry);
+    }
+
+    *_result = result;
+    return EOK;
+}
+
+void sss_objcache_set(struct resp_ctx *rctx,
+                      struct sss_domain_info *domain,
+                      const char *key,
+                      struct ldb_result *result)
+{
+    struct sss_objcache *cache = rctx->obj_cache;
+    struct sss_objcache_entry *entry;
+    hash_value_t value;
+    int hret;
+
+    if (cache == NULL || key == NULL || result == NULL
+            || result->count == 0) {
+        return;
+    }
+
+    entry = sss_objcache_find(cache, key);
+    talloc_free(entry);
+
+    if (cache->count >= cache->max_entries) {
+        talloc_free(cache->last);
+    }
+
+    entry = talloc_zero(cache, struct sss_objcache_entry);
+    if (entry == NULL) {
+        /* non-fatal, the object is just not cached */
+        return;
+    }
+
+    entry->cache = cache;
+    entry->expire = time(NULL) + cache->timeout;
+    entry->key.type = HASH_KEY_STRING;
+    entry->key.str = talloc_strdup(entry, key);
+    entry->domain = talloc_strdup(entry, domain->name);
+    entry->result = sss_objcache_copy_result(entry, result);
+    if (entry->key.str == NULL || entry->domain == NULL
+            || entry->result == NULL) {
+        talloc_free(entry);
+        return;
+    }
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = entry;
+
+    hret = hash_enter(cache->table, &entry->key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to add [%s] to the object cache: [%s]\n",
+              key, hash_error_string(hret));
+        talloc_free(entry);
+        return;
+    }
+
+    DLIST_ADD(cache->entries, entry);
+    if (cache->last == NULL) {
+        cache->last = entry;
+    }
+    cache->count++;
+    talloc_set_destructor(entry, sss_objcache_entry_destructor);
+}
+
+void sss_objcache_remove(struct resp_ctx *rctx, const char *key)
+{
+    if (rctx->obj_cache == NULL || key == NULL) {
+        return;
+    }
+
+    talloc_free(sss_objcache_find(rctx->obj_cache, key));
+}
+
+void sss_objcache_invalidate(struct resp_ctx *rctx,
+                             struct sss_domain_info *domain)
+{
+    struct sss_objcache *cache = rctx->obj_cache;
+    struct sss_objcache_entry *entry;
+    struct sss_objcache_entry *next;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Invalidating the object cache of [%s]\n",
+          domain == NULL ? "all domains" : domain->name);
+
+    for (entry = cache->entries; entry != NULL; entry = next) {
+        next = entry->next;
+        if (domain == NULL || strcasecmp(entry->domain, domain->name) == 0) {
+            talloc_free(entry);
+        }
+    }
+}
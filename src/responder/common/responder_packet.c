@@ -30,8 +30,27 @@
 
 #define SSSSRV_PACKET_MEM_SIZE 512
 
+/* Packet buffers are recycled through a pool of power of two size classes,
+ * from SSSSRV_PACKET_MEM_SIZE to SSSSRV_PACKET_MEM_SIZE << (classes - 1).
+ * Larger buffers are allocated and freed as needed. */
+#define SSS_PACKET_POOL_CLASSES 8
+/* how many free buffers of each class are kept around */
+#define SSS_PACKET_POOL_DEPTH 16
+
+#define SSS_PACKET_POOL_CLASS_SIZE(c) ((size_t)SSSSRV_PACKET_MEM_SIZE << (c))
+
+/* responders are single threaded, one pool per process is enough */
+static struct sss_packet_pool {
+    TALLOC_CTX *ctx;
+    uint8_t *free[SSS_PACKET_POOL_CLASSES][SSS_PACKET_POOL_DEPTH];
+    size_t num_free[SSS_PACKET_POOL_CLASSES];
+} sss_packet_pool;
+
 struct sss_packet {
+    /* usable size of the packet */
     size_t memsize;
+    /* size actually allocated for buffer, at least memsize */
+    size_t bufsize;
 
     /* Structure of the buffer:
     * Bytes    Content
@@ -59,6 +78,89 @@ static void sss_packet_set_cmd(struct sss_packet *packet,
                                enum sss_cli_command cmd);
 static uint32_t sss_packet_get_len(struct sss_packet *packet);
 
+static int sss_packet_pool_class(size_t size)
+{
+    int c;
+
+    for (c = 0; c < SSS_PACKET_POOL_CLASSES; c++) {
+        if (size <= SSS_PACKET_POOL_CLASS_SIZE(c)) {
+            return c;
+        }
+    }
+
+    return -1;
+}
+
+/* get a buffer of at least size bytes owned by mem_ctx */
+static uint8_t *sss_packet_buffer_get(TALLOC_CTX *mem_ctx, size_t size,
+                                      size_t *_bufsize)
+{
+    uint8_t *buf;
+    int c;
+
+    c = sss_packet_pool_class(size);
+    if (c == -1) {
+        buf = talloc_size(mem_ctx, size);
+        if (buf != NULL) {
+            *_bufsize = size;
+        }
+        return buf;
+    }
+
+    if (sss_packet_pool.num_free[c] > 0) {
+        sss_packet_pool.num_free[c]--;
+        buf = sss_packet_pool.free[c][sss_packet_pool.num_free[c]];
+        talloc_steal(mem_ctx, buf);
+    } else {
+        /* not from a talloc pool mem_ctx may be part of, once recycled the
+         * buffer would keep the whole pool allocated */
+        buf = talloc_size(NULL, SSS_PACKET_POOL_CLASS_SIZE(c));
+        if (buf == NULL) {
+            return NULL;
+        }
+        talloc_steal(mem_ctx, buf);
+    }
+
+    *_bufsize = SSS_PACKET_POOL_CLASS_SIZE(c);
+    return buf;
+}
+
+/* return a buffer to the pool, or free it if the pool is full */
+static void sss_packet_buffer_put(uint8_t *buf, size_t bufsize)
+{
+    int c;
+
+    if (buf == NULL) {
+        return;
+    }
+
+    c = sss_packet_pool_class(bufsize);
+    if (c == -1 || bufsize != SSS_PACKET_POOL_CLASS_SIZE(c)
+            || sss_packet_pool.num_free[c] == SSS_PACKET_POOL_DEPTH) {
+        talloc_free(buf);
+        return;
+    }
+
+    if (sss_packet_pool.ctx == NULL) {
+        sss_packet_pool.ctx = talloc_named_const(NULL, 0, "sss_packet_pool");
+        if (sss_packet_pool.ctx == NULL) {
+            talloc_free(buf);
+            return;
+        }
+    }
+
+    talloc_steal(sss_packet_pool.ctx, buf);
+    sss_packet_pool.free[c][sss_packet_pool.num_free[c]] = buf;
+    sss_packet_pool.num_free[c]++;
+}
+
+static int sss_packet_destructor(struct sss_packet *packet)
+{
+    sss_packet_buffer_put(packet->buffer, packet->bufsize);
+    packet->buffer = NULL;
+    return 0;
+}
+
 /*
  * Allocate a new packet structure
  *
@@ -81,11 +183,13 @@ int sss_packet_new(TALLOC_CTX *mem_ctx, size_t size,
         packet->memsize = SSSSRV_PACKET_MEM_SIZE;
     }
 
-    packet->buffer = talloc_size(packet, packet->memsize);
+    packet->buffer = sss_packet_buffer_get(packet, packet->memsize,
+                                           &packet->bufsize);
     if (!packet->buffer) {
         talloc_free(packet);
         return ENOMEM;
     }
+    talloc_set_destructor(packet, sss_packet_destructor);
     memset(packet->buffer, 0, SSS_NSS_HEADER_SIZE);
 
     sss_packet_set_len(packet, size + SSS_NSS_HEADER_SIZE);
@@ -98,12 +202,41 @@ int sss_packet_new(TALLOC_CTX *mem_ctx, size_t size,
     return EOK;
 }
 
+/* move the packet to a buffer of at least size bytes, keeping its data */
+static int sss_packet_resize_buffer(struct sss_packet *packet, size_t size)
+{
+    size_t bufsize;
+    uint8_t *newmem;
+
+    if (sss_packet_pool_class(size) == -1
+            && sss_packet_pool_class(packet->bufsize) == -1) {
+        /* neither buffer belongs to the pool */
+        newmem = talloc_realloc_size(packet, packet->buffer, size);
+        if (!newmem) {
+            return ENOMEM;
+        }
+        bufsize = size;
+    } else {
+        newmem = sss_packet_buffer_get(packet, size, &bufsize);
+        if (!newmem) {
+            return ENOMEM;
+        }
+        memcpy(newmem, packet->buffer, sss_packet_get_len(packet));
+        sss_packet_buffer_put(packet->buffer, packet->bufsize);
+    }
+
+    packet->buffer = newmem;
+    packet->bufsize = bufsize;
+
+    return EOK;
+}
+
 /* grows a packet size only in SSSSRV_PACKET_MEM_SIZE chunks */
 int sss_packet_grow(struct sss_packet *packet, size_t size)
 {
     size_t totlen, len;
-    uint8_t *newmem;
     uint32_t packet_len;
+    int ret;
 
     if (size == 0) {
         return EOK;
@@ -121,20 +254,21 @@ int sss_packet_grow(struct sss_packet *packet, size_t size)
         if (totlen < len) {
             return EINVAL;
         }
+        if (len <= packet->bufsize && totlen > packet->bufsize) {
+            /* still fits in what was allocated or reserved */
+            totlen = packet->bufsize;
+        }
     }
 
-    if (totlen > packet->memsize) {
-        newmem = talloc_realloc_size(packet, packet->buffer, totlen);
-        if (!newmem) {
-            return ENOMEM;
+    if (totlen > packet->bufsize) {
+        ret = sss_packet_resize_buffer(packet, totlen);
+        if (ret != EOK) {
+            return ret;
         }
+    }
 
+    if (totlen > packet->memsize) {
         packet->memsize = totlen;
-
-        /* re-set pointers if realloc had to move memory */
-        if (newmem != packet->buffer) {
-            packet->buffer = newmem;
-        }
     }
 
     packet_len += size;
@@ -144,6 +278,24 @@ int sss_packet_grow(struct sss_packet *packet, size_t size)
     return 0;
 }
 
+/* Make sure the packet can grow by size bytes without being reallocated,
+ * for callers that know how big the reply is going to be */
+int sss_packet_reserve(struct sss_packet *packet, size_t size)
+{
+    size_t len;
+
+    len = sss_packet_get_len(packet) + size;
+    if (len < size) {
+        return EINVAL;
+    }
+
+    if (len <= packet->bufsize) {
+        return EOK;
+    }
+
+    return sss_packet_resize_buffer(packet, len);
+}
+
 /* reclaim backet previously resrved space in the packet
  * usually done in functione recovering from not fatal erros */
 int sss_packet_shrink(struct sss_packet *packet, size_t size)
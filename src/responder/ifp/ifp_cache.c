@@ -20,6 +20,7 @@
 
 #include <talloc.h>
 #include <tevent.h>
+#include <dhash.h>
 
 #include "db/sysdb.h"
 #include "util/util.h"
@@ -342,3 +343,250 @@ int ifp_cache_object_remove(struct sbus_request *sbus_req,
 
     return EOK;
 }
+
+/* Changes reported by the back ends are collected for a moment and each
+ * object is announced once in a single signal per interface. */
+#define IFP_CACHE_NOTIFY_DELAY 1
+
+struct ifp_cache_notify {
+    struct ifp_ctx *ifp_ctx;
+
+    /* object paths of the changed objects by ifp_cache_type */
+    hash_table_t *users;
+    hash_table_t *groups;
+};
+
+static void ifp_cache_notify_emit(struct ifp_ctx *ifp_ctx,
+                                  hash_table_t *table,
+                                  const char *path,
+                                  const char *iface,
+                                  const char *signal_name)
+{
+    DBusMessage *msg = NULL;
+    hash_key_t *keys = NULL;
+    const char **paths = NULL;
+    unsigned long count;
+    unsigned long i;
+    dbus_bool_t dbret;
+    int num_paths;
+    int hret;
+
+    hret = hash_keys(table, &count, &keys);
+    if (hret != HASH_SUCCESS || count == 0) {
+        goto done;
+    }
+
+    paths = talloc_zero_array(NULL, const char *, count);
+    if (paths == NULL) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        paths[i] = keys[i].str;
+    }
+    num_paths = count;
+
+    msg = dbus_message_new_signal(path, iface, signal_name);
+    if (msg == NULL) {
+        goto done;
+    }
+
+    dbret = dbus_message_append_args(msg,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_OBJECT_PATH,
+                                     &paths, num_paths,
+                                     DBUS_TYPE_INVALID);
+    if (!dbret) {
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Emitting %s.%s for %d objects\n",
+          iface, signal_name, num_paths);
+
+    sbus_conn_send_reply(ifp_ctx->sysbus->conn, msg);
+
+done:
+    if (msg != NULL) {
+        dbus_message_unref(msg);
+    }
+    talloc_free(paths);
+    talloc_free(keys);
+}
+
+static void ifp_cache_notify_send(struct tevent_context *ev,
+                                  struct tevent_timer *te,
+                                  struct timeval tv, void *pvt)
+{
+    struct ifp_cache_notify *notify;
+    struct ifp_ctx *ifp_ctx;
+
+    notify = talloc_get_type(pvt, struct ifp_cache_notify);
+    ifp_ctx = notify->ifp_ctx;
+    ifp_ctx->cache_notify = NULL;
+
+    /* the system bus may have gone away in the meantime */
+    if (ifp_ctx->sysbus != NULL) {
+        ifp_cache_notify_emit(ifp_ctx, notify->users, IFP_PATH_USERS,
+                              IFACE_IFP_USERS, IFACE_IFP_USERS_CHANGED);
+        ifp_cache_notify_emit(ifp_ctx, notify->groups, IFP_PATH_GROUPS,
+                              IFACE_IFP_GROUPS, IFACE_IFP_GROUPS_CHANGED);
+    }
+
+    talloc_free(notify);
+}
+
+static struct ifp_cache_notify *ifp_cache_notify_get(struct ifp_ctx *ifp_ctx)
+{
+    struct ifp_cache_notify *notify;
+    struct tevent_timer *te;
+    struct timeval tv;
+    errno_t ret;
+
+    if (ifp_ctx->cache_notify != NULL) {
+        return ifp_ctx->cache_notify;
+    }
+
+    notify = talloc_zero(ifp_ctx, struct ifp_cache_notify);
+    if (notify == NULL) {
+        return NULL;
+    }
+    notify->ifp_ctx = ifp_ctx;
+
+    ret = sss_hash_create(notify, 0, &notify->users);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    ret = sss_hash_create(notify, 0, &notify->groups);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    tv = tevent_timeval_current_ofs(IFP_CACHE_NOTIFY_DELAY, 0);
+    te = tevent_add_timer(ifp_ctx->rctx->ev, notify, tv,
+                          ifp_cache_notify_send, notify);
+    if (te == NULL) {
+        goto fail;
+    }
+
+    ifp_ctx->cache_notify = notify;
+    return notify;
+
+fail:
+    talloc_free(notify);
+    return NULL;
+}
+
+static errno_t ifp_cache_notify_add(struct ifp_ctx *ifp_ctx,
+                                    enum ifp_cache_type type,
+                                    struct sss_domain_info *domain,
+                                    uint32_t id)
+{
+    struct ifp_cache_notify *notify;
+    hash_table_t *table = NULL;
+    const char *base = NULL;
+    hash_key_t key;
+    hash_value_t value;
+    char id_str[32];
+    int hret;
+
+    notify = ifp_cache_notify_get(ifp_ctx);
+    if (notify == NULL) {
+        return ENOMEM;
+    }
+
+    switch (type) {
+    case IFP_CACHE_USER:
+        table = notify->users;
+        base = IFP_PATH_USERS;
+        break;
+    case IFP_CACHE_GROUP:
+        table = notify->groups;
+        base = IFP_PATH_GROUPS;
+        break;
+    }
+
+    snprintf(id_str, sizeof(id_str), "%"PRIu32, id);
+
+    /* same path as the one built from the cached object */
+    key.type = HASH_KEY_STRING;
+    key.str = sbus_opath_compose(notify, base, domain->name, id_str);
+    if (key.str == NULL) {
+        return ENOMEM;
+    }
+
+    value.type = HASH_VALUE_UNDEF;
+    hret = hash_enter(table, &key, &value);
+    talloc_free(key.str);
+    if (hret != HASH_SUCCESS) {
+        return EIO;
+    }
+
+    return EOK;
+}
+
+int ifp_cache_objects_changed(struct sbus_request *dbus_req, void *data)
+{
+    struct resp_ctx *rctx = talloc_get_type(data, struct resp_ctx);
+    struct sss_domain_info *domain;
+    struct ifp_ctx *ifp_ctx;
+    enum ifp_cache_type type;
+    char **domains;
+    uint32_t *types;
+    uint32_t *ids;
+    int num_domains;
+    int num_types;
+    int num_ids;
+    errno_t ret;
+    int i;
+
+    if (!sbus_request_parse_or_finish(dbus_req,
+                                      DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                      &domains, &num_domains,
+                                      DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32,
+                                      &types, &num_types,
+                                      DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32,
+                                      &ids, &num_ids,
+                                      DBUS_TYPE_INVALID)) {
+        return EOK; /* handled */
+    }
+
+    ifp_ctx = talloc_get_type(rctx->pvt_ctx, struct ifp_ctx);
+    if (ifp_ctx == NULL || ifp_ctx->sysbus == NULL) {
+        /* nobody is listening */
+        goto done;
+    }
+
+    if (num_domains != num_types || num_domains != num_ids) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Malformed list of changed objects\n");
+        goto done;
+    }
+
+    for (i = 0; i < num_domains; i++) {
+        domain = find_domain_by_name(rctx->domains, domains[i], true);
+        if (domain == NULL) {
+            continue;
+        }
+
+        switch (types[i]) {
+        case BE_REQ_USER:
+            type = IFP_CACHE_USER;
+            break;
+        case BE_REQ_GROUP:
+            type = IFP_CACHE_GROUP;
+            break;
+        default:
+            continue;
+        }
+
+        ret = ifp_cache_notify_add(ifp_ctx, type, domain, ids[i]);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Unable to queue change signal "
+                  "[%d]: %s\n", ret, sss_strerror(ret));
+            break;
+        }
+    }
+
+done:
+    /* the back end does not expect a reply */
+    return sbus_request_finish(dbus_req, NULL);
+}
@@ -56,4 +56,8 @@ int ifp_cache_object_remove(struct sbus_request *sbus_req,
                             struct sss_domain_info *domain,
                             struct ldb_dn *dn);
 
+/* org.freedesktop.sssd.dataprovider_rev, emits the Changed signals */
+
+int ifp_cache_objects_changed(struct sbus_request *dbus_req, void *data);
+
 #endif /* IFP_CACHE_H_ */
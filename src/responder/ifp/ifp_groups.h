@@ -54,6 +54,19 @@ int ifp_groups_list_by_domain_and_name(struct sbus_request *sbus_req,
                                        const char *filter,
                                        uint32_t limit);
 
+int ifp_groups_list_by_name_paged(struct sbus_request *sbus_req,
+                                  void *data,
+                                  const char *filter,
+                                  uint32_t offset,
+                                  uint32_t limit);
+
+int ifp_groups_list_by_domain_and_name_paged(struct sbus_request *sbus_req,
+                                             void *data,
+                                             const char *domain,
+                                             const char *filter,
+                                             uint32_t offset,
+                                             uint32_t limit);
+
 /* org.freedesktop.sssd.infopipe.Groups.Group */
 
 int ifp_groups_group_update_member_list(struct sbus_request *sbus_req,
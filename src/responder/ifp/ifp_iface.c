@@ -40,9 +40,15 @@ struct iface_ifp iface_ifp = {
     .FindBackendByName = ifp_find_backend_by_name,
 
     .GetUserAttr = ifp_user_get_attr,
+    .GetUsersAttr = ifp_users_get_attr,
     .GetUserGroups = ifp_user_get_groups,
     .ListDomains = ifp_list_domains,
     .FindDomainByName = ifp_find_domain_by_name,
+    .GetMemoryCacheStats = ifp_get_memory_cache_stats,
+    .GetCommandStats = ifp_get_command_stats,
+    .GetTaskStats = ifp_get_task_stats,
+    .GetResolverStats = ifp_get_resolver_stats,
+    .GetCacheMetrics = ifp_get_cache_metrics,
 };
 
 struct iface_ifp_components iface_ifp_components = {
@@ -84,7 +90,9 @@ struct iface_ifp_users iface_ifp_users = {
     .FindByID = ifp_users_find_by_id,
     .FindByCertificate = ifp_users_find_by_cert,
     .ListByName = ifp_users_list_by_name,
-    .ListByDomainAndName = ifp_users_list_by_domain_and_name
+    .ListByDomainAndName = ifp_users_list_by_domain_and_name,
+    .ListByNamePaged = ifp_users_list_by_name_paged,
+    .ListByDomainAndNamePaged = ifp_users_list_by_domain_and_name_paged
 };
 
 struct iface_ifp_users_user iface_ifp_users_user = {
@@ -105,7 +113,9 @@ struct iface_ifp_groups iface_ifp_groups = {
     .FindByName = ifp_groups_find_by_name,
     .FindByID = ifp_groups_find_by_id,
     .ListByName = ifp_groups_list_by_name,
-    .ListByDomainAndName = ifp_groups_list_by_domain_and_name
+    .ListByDomainAndName = ifp_groups_list_by_domain_and_name,
+    .ListByNamePaged = ifp_groups_list_by_name_paged,
+    .ListByDomainAndNamePaged = ifp_groups_list_by_domain_and_name_paged
 };
 
 struct iface_ifp_groups_group iface_ifp_groups_group = {
@@ -18,6 +18,12 @@ static int invoke_su_method(struct sbus_request *dbus_req, void *function_ptr);
 /* invokes a handler with a 'ssu' DBus signature */
 static int invoke_ssu_method(struct sbus_request *dbus_req, void *function_ptr);
 
+/* invokes a handler with a 'suu' DBus signature */
+static int invoke_suu_method(struct sbus_request *dbus_req, void *function_ptr);
+
+/* invokes a handler with a 'ssuu' DBus signature */
+static int invoke_ssuu_method(struct sbus_request *dbus_req, void *function_ptr);
+
 /* arguments for org.freedesktop.sssd.infopipe.ListComponents */
 const struct sbus_arg_meta iface_ifp_ListComponents__out[] = {
     { "components", "ao" },
@@ -121,6 +127,19 @@ const struct sbus_arg_meta iface_ifp_GetUserAttr__out[] = {
     { NULL, }
 };
 
+/* arguments for org.freedesktop.sssd.infopipe.GetUsersAttr */
+const struct sbus_arg_meta iface_ifp_GetUsersAttr__in[] = {
+    { "users", "as" },
+    { "attr", "as" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.GetUsersAttr */
+const struct sbus_arg_meta iface_ifp_GetUsersAttr__out[] = {
+    { "values", "a{sa{sv}}" },
+    { NULL, }
+};
+
 /* arguments for org.freedesktop.sssd.infopipe.GetUserGroups */
 const struct sbus_arg_meta iface_ifp_GetUserGroups__in[] = {
     { "user", "s" },
@@ -172,6 +191,165 @@ int iface_ifp_ListDomains_finish(struct sbus_request *req, const char *arg_domai
                                          DBUS_TYPE_INVALID);
 }
 
+/* arguments for org.freedesktop.sssd.infopipe.GetMemoryCacheStats */
+const struct sbus_arg_meta iface_ifp_GetMemoryCacheStats__in[] = {
+    { "map", "s" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.GetMemoryCacheStats */
+const struct sbus_arg_meta iface_ifp_GetMemoryCacheStats__out[] = {
+    { "stores", "t" },
+    { "evictions", "t" },
+    { "invalidations", "t" },
+    { "grows", "t" },
+    { "used_slots", "u" },
+    { "total_slots", "u" },
+    { NULL, }
+};
+
+int iface_ifp_GetMemoryCacheStats_finish(struct sbus_request *req, uint64_t arg_stores, uint64_t arg_evictions, uint64_t arg_invalidations, uint64_t arg_grows, uint32_t arg_used_slots, uint32_t arg_total_slots)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_UINT64, &arg_stores,
+                                         DBUS_TYPE_UINT64, &arg_evictions,
+                                         DBUS_TYPE_UINT64, &arg_invalidations,
+                                         DBUS_TYPE_UINT64, &arg_grows,
+                                         DBUS_TYPE_UINT32, &arg_used_slots,
+                                         DBUS_TYPE_UINT32, &arg_total_slots,
+                                         DBUS_TYPE_INVALID);
+}
+
+/* arguments for org.freedesktop.sssd.infopipe.GetCommandStats */
+const struct sbus_arg_meta iface_ifp_GetCommandStats__in[] = {
+    { "responder", "s" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.GetCommandStats */
+const struct sbus_arg_meta iface_ifp_GetCommandStats__out[] = {
+    { "commands", "au" },
+    { "sources", "as" },
+    { "replies", "at" },
+    { "total_usec", "at" },
+    { "max_usec", "at" },
+    { "bucket_limits", "at" },
+    { "histograms", "at" },
+    { NULL, }
+};
+
+int iface_ifp_GetCommandStats_finish(struct sbus_request *req, uint32_t arg_commands[], int len_commands, const char *arg_sources[], int len_sources, uint64_t arg_replies[], int len_replies, uint64_t arg_total_usec[], int len_total_usec, uint64_t arg_max_usec[], int len_max_usec, uint64_t arg_bucket_limits[], int len_bucket_limits, uint64_t arg_histograms[], int len_histograms)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &arg_commands, len_commands,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &arg_sources, len_sources,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_replies, len_replies,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_total_usec, len_total_usec,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_max_usec, len_max_usec,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_bucket_limits, len_bucket_limits,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_histograms, len_histograms,
+                                         DBUS_TYPE_INVALID);
+}
+
+/* arguments for org.freedesktop.sssd.infopipe.GetTaskStats */
+const struct sbus_arg_meta iface_ifp_GetTaskStats__in[] = {
+    { "domain", "s" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.GetTaskStats */
+const struct sbus_arg_meta iface_ifp_GetTaskStats__out[] = {
+    { "tasks", "as" },
+    { "runs", "at" },
+    { "failures", "at" },
+    { "timeouts", "at" },
+    { "skips", "at" },
+    { "overlaps", "at" },
+    { "total_msec", "at" },
+    { "max_msec", "at" },
+    { "bucket_limits", "at" },
+    { "histograms", "at" },
+    { NULL, }
+};
+
+int iface_ifp_GetTaskStats_finish(struct sbus_request *req, const char *arg_tasks[], int len_tasks, uint64_t arg_runs[], int len_runs, uint64_t arg_failures[], int len_failures, uint64_t arg_timeouts[], int len_timeouts, uint64_t arg_skips[], int len_skips, uint64_t arg_overlaps[], int len_overlaps, uint64_t arg_total_msec[], int len_total_msec, uint64_t arg_max_msec[], int len_max_msec, uint64_t arg_bucket_limits[], int len_bucket_limits, uint64_t arg_histograms[], int len_histograms)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &arg_tasks, len_tasks,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_runs, len_runs,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_failures, len_failures,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_timeouts, len_timeouts,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_skips, len_skips,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_overlaps, len_overlaps,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_total_msec, len_total_msec,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_max_msec, len_max_msec,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_bucket_limits, len_bucket_limits,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_histograms, len_histograms,
+                                         DBUS_TYPE_INVALID);
+}
+
+/* arguments for org.freedesktop.sssd.infopipe.GetResolverStats */
+const struct sbus_arg_meta iface_ifp_GetResolverStats__in[] = {
+    { "domain", "s" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.GetResolverStats */
+const struct sbus_arg_meta iface_ifp_GetResolverStats__out[] = {
+    { "types", "as" },
+    { "outcomes", "as" },
+    { "network", "at" },
+    { "cached", "at" },
+    { "total_msec", "t" },
+    { "max_msec", "t" },
+    { "latency_limits", "at" },
+    { "latency_buckets", "at" },
+    { "servers", "as" },
+    { "successes", "at" },
+    { "failures", "at" },
+    { "transitions", "at" },
+    { "srtt_usec", "at" },
+    { "connect_limits", "at" },
+    { "connect_histograms", "at" },
+    { NULL, }
+};
+
+int iface_ifp_GetResolverStats_finish(struct sbus_request *req, const char *arg_types[], int len_types, const char *arg_outcomes[], int len_outcomes, uint64_t arg_network[], int len_network, uint64_t arg_cached[], int len_cached, uint64_t arg_total_msec, uint64_t arg_max_msec, uint64_t arg_latency_limits[], int len_latency_limits, uint64_t arg_latency_buckets[], int len_latency_buckets, const char *arg_servers[], int len_servers, uint64_t arg_successes[], int len_successes, uint64_t arg_failures[], int len_failures, uint64_t arg_transitions[], int len_transitions, uint64_t arg_srtt_usec[], int len_srtt_usec, uint64_t arg_connect_limits[], int len_connect_limits, uint64_t arg_connect_histograms[], int len_connect_histograms)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &arg_types, len_types,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &arg_outcomes, len_outcomes,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_network, len_network,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_cached, len_cached,
+                                         DBUS_TYPE_UINT64, &arg_total_msec,
+                                         DBUS_TYPE_UINT64, &arg_max_msec,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_latency_limits, len_latency_limits,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_latency_buckets, len_latency_buckets,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &arg_servers, len_servers,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_successes, len_successes,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_failures, len_failures,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_transitions, len_transitions,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_srtt_usec, len_srtt_usec,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_connect_limits, len_connect_limits,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_connect_histograms, len_connect_histograms,
+                                         DBUS_TYPE_INVALID);
+}
+
+/* arguments for org.freedesktop.sssd.infopipe.GetCacheMetrics */
+const struct sbus_arg_meta iface_ifp_GetCacheMetrics__out[] = {
+    { "names", "as" },
+    { "values", "at" },
+    { NULL, }
+};
+
+int iface_ifp_GetCacheMetrics_finish(struct sbus_request *req, const char *arg_names[], int len_names, uint64_t arg_values[], int len_values)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &arg_names, len_names,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &arg_values, len_values,
+                                         DBUS_TYPE_INVALID);
+}
+
 /* methods for org.freedesktop.sssd.infopipe */
 const struct sbus_method_meta iface_ifp__methods[] = {
     {
@@ -230,6 +408,13 @@ const struct sbus_method_meta iface_ifp__methods[] = {
         offsetof(struct iface_ifp, GetUserAttr),
         NULL, /* no invoker */
     },
+    {
+        "GetUsersAttr", /* name */
+        iface_ifp_GetUsersAttr__in,
+        iface_ifp_GetUsersAttr__out,
+        offsetof(struct iface_ifp, GetUsersAttr),
+        NULL, /* no invoker */
+    },
     {
         "GetUserGroups", /* name */
         iface_ifp_GetUserGroups__in,
@@ -251,6 +436,41 @@ const struct sbus_method_meta iface_ifp__methods[] = {
         offsetof(struct iface_ifp, ListDomains),
         NULL, /* no invoker */
     },
+    {
+        "GetMemoryCacheStats", /* name */
+        iface_ifp_GetMemoryCacheStats__in,
+        iface_ifp_GetMemoryCacheStats__out,
+        offsetof(struct iface_ifp, GetMemoryCacheStats),
+        invoke_s_method,
+    },
+    {
+        "GetCommandStats", /* name */
+        iface_ifp_GetCommandStats__in,
+        iface_ifp_GetCommandStats__out,
+        offsetof(struct iface_ifp, GetCommandStats),
+        invoke_s_method,
+    },
+    {
+        "GetTaskStats", /* name */
+        iface_ifp_GetTaskStats__in,
+        iface_ifp_GetTaskStats__out,
+        offsetof(struct iface_ifp, GetTaskStats),
+        invoke_s_method,
+    },
+    {
+        "GetResolverStats", /* name */
+        iface_ifp_GetResolverStats__in,
+        iface_ifp_GetResolverStats__out,
+        offsetof(struct iface_ifp, GetResolverStats),
+        invoke_s_method,
+    },
+    {
+        "GetCacheMetrics", /* name */
+        NULL, /* no in_args */
+        iface_ifp_GetCacheMetrics__out,
+        offsetof(struct iface_ifp, GetCacheMetrics),
+        NULL, /* no invoker */
+    },
     { NULL, }
 };
 
@@ -745,6 +965,53 @@ int iface_ifp_users_ListByDomainAndName_finish(struct sbus_request *req, const c
                                          DBUS_TYPE_INVALID);
 }
 
+/* arguments for org.freedesktop.sssd.infopipe.Users.ListByNamePaged */
+const struct sbus_arg_meta iface_ifp_users_ListByNamePaged__in[] = {
+    { "name_filter", "s" },
+    { "offset", "u" },
+    { "limit", "u" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.Users.ListByNamePaged */
+const struct sbus_arg_meta iface_ifp_users_ListByNamePaged__out[] = {
+    { "result", "ao" },
+    { "next_offset", "u" },
+    { NULL, }
+};
+
+int iface_ifp_users_ListByNamePaged_finish(struct sbus_request *req, const char *arg_result[], int len_result, uint32_t arg_next_offset)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_OBJECT_PATH, &arg_result, len_result,
+                                         DBUS_TYPE_UINT32, &arg_next_offset,
+                                         DBUS_TYPE_INVALID);
+}
+
+/* arguments for org.freedesktop.sssd.infopipe.Users.ListByDomainAndNamePaged */
+const struct sbus_arg_meta iface_ifp_users_ListByDomainAndNamePaged__in[] = {
+    { "domain_name", "s" },
+    { "name_filter", "s" },
+    { "offset", "u" },
+    { "limit", "u" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.Users.ListByDomainAndNamePaged */
+const struct sbus_arg_meta iface_ifp_users_ListByDomainAndNamePaged__out[] = {
+    { "result", "ao" },
+    { "next_offset", "u" },
+    { NULL, }
+};
+
+int iface_ifp_users_ListByDomainAndNamePaged_finish(struct sbus_request *req, const char *arg_result[], int len_result, uint32_t arg_next_offset)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_OBJECT_PATH, &arg_result, len_result,
+                                         DBUS_TYPE_UINT32, &arg_next_offset,
+                                         DBUS_TYPE_INVALID);
+}
+
 /* methods for org.freedesktop.sssd.infopipe.Users */
 const struct sbus_method_meta iface_ifp_users__methods[] = {
     {
@@ -782,6 +1049,35 @@ const struct sbus_method_meta iface_ifp_users__methods[] = {
         offsetof(struct iface_ifp_users, ListByDomainAndName),
         invoke_ssu_method,
     },
+    {
+        "ListByNamePaged", /* name */
+        iface_ifp_users_ListByNamePaged__in,
+        iface_ifp_users_ListByNamePaged__out,
+        offsetof(struct iface_ifp_users, ListByNamePaged),
+        invoke_suu_method,
+    },
+    {
+        "ListByDomainAndNamePaged", /* name */
+        iface_ifp_users_ListByDomainAndNamePaged__in,
+        iface_ifp_users_ListByDomainAndNamePaged__out,
+        offsetof(struct iface_ifp_users, ListByDomainAndNamePaged),
+        invoke_ssuu_method,
+    },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.Users.Changed */
+const struct sbus_arg_meta iface_ifp_users_Changed__args[] = {
+    { "users", "ao" },
+    { NULL, }
+};
+
+/* signals for org.freedesktop.sssd.infopipe.Users */
+const struct sbus_signal_meta iface_ifp_users__signals[] = {
+    {
+        "Changed", /* name */
+        iface_ifp_users_Changed__args
+    },
     { NULL, }
 };
 
@@ -789,7 +1085,7 @@ const struct sbus_method_meta iface_ifp_users__methods[] = {
 const struct sbus_interface_meta iface_ifp_users_meta = {
     "org.freedesktop.sssd.infopipe.Users", /* name */
     iface_ifp_users__methods,
-    NULL, /* no signals */
+    iface_ifp_users__signals,
     NULL, /* no properties */
     sbus_invoke_get_all, /* GetAll invoker */
 };
@@ -977,6 +1273,53 @@ int iface_ifp_groups_ListByDomainAndName_finish(struct sbus_request *req, const
                                          DBUS_TYPE_INVALID);
 }
 
+/* arguments for org.freedesktop.sssd.infopipe.Groups.ListByNamePaged */
+const struct sbus_arg_meta iface_ifp_groups_ListByNamePaged__in[] = {
+    { "name_filter", "s" },
+    { "offset", "u" },
+    { "limit", "u" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.Groups.ListByNamePaged */
+const struct sbus_arg_meta iface_ifp_groups_ListByNamePaged__out[] = {
+    { "result", "ao" },
+    { "next_offset", "u" },
+    { NULL, }
+};
+
+int iface_ifp_groups_ListByNamePaged_finish(struct sbus_request *req, const char *arg_result[], int len_result, uint32_t arg_next_offset)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_OBJECT_PATH, &arg_result, len_result,
+                                         DBUS_TYPE_UINT32, &arg_next_offset,
+                                         DBUS_TYPE_INVALID);
+}
+
+/* arguments for org.freedesktop.sssd.infopipe.Groups.ListByDomainAndNamePaged */
+const struct sbus_arg_meta iface_ifp_groups_ListByDomainAndNamePaged__in[] = {
+    { "domain_name", "s" },
+    { "name_filter", "s" },
+    { "offset", "u" },
+    { "limit", "u" },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.Groups.ListByDomainAndNamePaged */
+const struct sbus_arg_meta iface_ifp_groups_ListByDomainAndNamePaged__out[] = {
+    { "result", "ao" },
+    { "next_offset", "u" },
+    { NULL, }
+};
+
+int iface_ifp_groups_ListByDomainAndNamePaged_finish(struct sbus_request *req, const char *arg_result[], int len_result, uint32_t arg_next_offset)
+{
+   return sbus_request_return_and_finish(req,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_OBJECT_PATH, &arg_result, len_result,
+                                         DBUS_TYPE_UINT32, &arg_next_offset,
+                                         DBUS_TYPE_INVALID);
+}
+
 /* methods for org.freedesktop.sssd.infopipe.Groups */
 const struct sbus_method_meta iface_ifp_groups__methods[] = {
     {
@@ -1007,6 +1350,35 @@ const struct sbus_method_meta iface_ifp_groups__methods[] = {
         offsetof(struct iface_ifp_groups, ListByDomainAndName),
         invoke_ssu_method,
     },
+    {
+        "ListByNamePaged", /* name */
+        iface_ifp_groups_ListByNamePaged__in,
+        iface_ifp_groups_ListByNamePaged__out,
+        offsetof(struct iface_ifp_groups, ListByNamePaged),
+        invoke_suu_method,
+    },
+    {
+        "ListByDomainAndNamePaged", /* name */
+        iface_ifp_groups_ListByDomainAndNamePaged__in,
+        iface_ifp_groups_ListByDomainAndNamePaged__out,
+        offsetof(struct iface_ifp_groups, ListByDomainAndNamePaged),
+        invoke_ssuu_method,
+    },
+    { NULL, }
+};
+
+/* arguments for org.freedesktop.sssd.infopipe.Groups.Changed */
+const struct sbus_arg_meta iface_ifp_groups_Changed__args[] = {
+    { "groups", "ao" },
+    { NULL, }
+};
+
+/* signals for org.freedesktop.sssd.infopipe.Groups */
+const struct sbus_signal_meta iface_ifp_groups__signals[] = {
+    {
+        "Changed", /* name */
+        iface_ifp_groups_Changed__args
+    },
     { NULL, }
 };
 
@@ -1014,7 +1386,7 @@ const struct sbus_method_meta iface_ifp_groups__methods[] = {
 const struct sbus_interface_meta iface_ifp_groups_meta = {
     "org.freedesktop.sssd.infopipe.Groups", /* name */
     iface_ifp_groups__methods,
-    NULL, /* no signals */
+    iface_ifp_groups__signals,
     NULL, /* no properties */
     sbus_invoke_get_all, /* GetAll invoker */
 };
@@ -1159,3 +1531,50 @@ static int invoke_su_method(struct sbus_request *dbus_req, void *function_ptr)
                      arg_0,
                      arg_1);
 }
+
+/* invokes a handler with a 'suu' DBus signature */
+static int invoke_suu_method(struct sbus_request *dbus_req, void *function_ptr)
+{
+    const char * arg_0;
+    uint32_t arg_1;
+    uint32_t arg_2;
+    int (*handler)(struct sbus_request *, void *, const char *, uint32_t, uint32_t) = function_ptr;
+
+    if (!sbus_request_parse_or_finish(dbus_req,
+                               DBUS_TYPE_STRING, &arg_0,
+                               DBUS_TYPE_UINT32, &arg_1,
+                               DBUS_TYPE_UINT32, &arg_2,
+                               DBUS_TYPE_INVALID)) {
+         return EOK; /* request handled */
+    }
+
+    return (handler)(dbus_req, dbus_req->intf->handler_data,
+                     arg_0,
+                     arg_1,
+                     arg_2);
+}
+
+/* invokes a handler with a 'ssuu' DBus signature */
+static int invoke_ssuu_method(struct sbus_request *dbus_req, void *function_ptr)
+{
+    const char * arg_0;
+    const char * arg_1;
+    uint32_t arg_2;
+    uint32_t arg_3;
+    int (*handler)(struct sbus_request *, void *, const char *, const char *, uint32_t, uint32_t) = function_ptr;
+
+    if (!sbus_request_parse_or_finish(dbus_req,
+                               DBUS_TYPE_STRING, &arg_0,
+                               DBUS_TYPE_STRING, &arg_1,
+                               DBUS_TYPE_UINT32, &arg_2,
+                               DBUS_TYPE_UINT32, &arg_3,
+                               DBUS_TYPE_INVALID)) {
+         return EOK; /* request handled */
+    }
+
+    return (handler)(dbus_req, dbus_req->intf->handler_data,
+                     arg_0,
+                     arg_1,
+                     arg_2,
+                     arg_3);
+}
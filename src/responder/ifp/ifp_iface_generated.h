@@ -21,9 +21,15 @@
 #define IFACE_IFP_FINDRESPONDERBYNAME "FindResponderByName"
 #define IFACE_IFP_FINDBACKENDBYNAME "FindBackendByName"
 #define IFACE_IFP_GETUSERATTR "GetUserAttr"
+#define IFACE_IFP_GETUSERSATTR "GetUsersAttr"
 #define IFACE_IFP_GETUSERGROUPS "GetUserGroups"
 #define IFACE_IFP_FINDDOMAINBYNAME "FindDomainByName"
 #define IFACE_IFP_LISTDOMAINS "ListDomains"
+#define IFACE_IFP_GETMEMORYCACHESTATS "GetMemoryCacheStats"
+#define IFACE_IFP_GETCOMMANDSTATS "GetCommandStats"
+#define IFACE_IFP_GETTASKSTATS "GetTaskStats"
+#define IFACE_IFP_GETRESOLVERSTATS "GetResolverStats"
+#define IFACE_IFP_GETCACHEMETRICS "GetCacheMetrics"
 
 /* constants for org.freedesktop.sssd.infopipe.Components */
 #define IFACE_IFP_COMPONENTS "org.freedesktop.sssd.infopipe.Components"
@@ -71,6 +77,9 @@
 #define IFACE_IFP_USERS_FINDBYCERTIFICATE "FindByCertificate"
 #define IFACE_IFP_USERS_LISTBYNAME "ListByName"
 #define IFACE_IFP_USERS_LISTBYDOMAINANDNAME "ListByDomainAndName"
+#define IFACE_IFP_USERS_LISTBYNAMEPAGED "ListByNamePaged"
+#define IFACE_IFP_USERS_LISTBYDOMAINANDNAMEPAGED "ListByDomainAndNamePaged"
+#define IFACE_IFP_USERS_CHANGED "Changed"
 
 /* constants for org.freedesktop.sssd.infopipe.Users.User */
 #define IFACE_IFP_USERS_USER "org.freedesktop.sssd.infopipe.Users.User"
@@ -90,6 +99,9 @@
 #define IFACE_IFP_GROUPS_FINDBYID "FindByID"
 #define IFACE_IFP_GROUPS_LISTBYNAME "ListByName"
 #define IFACE_IFP_GROUPS_LISTBYDOMAINANDNAME "ListByDomainAndName"
+#define IFACE_IFP_GROUPS_LISTBYNAMEPAGED "ListByNamePaged"
+#define IFACE_IFP_GROUPS_LISTBYDOMAINANDNAMEPAGED "ListByDomainAndNamePaged"
+#define IFACE_IFP_GROUPS_CHANGED "Changed"
 
 /* constants for org.freedesktop.sssd.infopipe.Groups.Group */
 #define IFACE_IFP_GROUPS_GROUP "org.freedesktop.sssd.infopipe.Groups.Group"
@@ -128,9 +140,15 @@ struct iface_ifp {
     int (*FindResponderByName)(struct sbus_request *req, void *data, const char *arg_name);
     int (*FindBackendByName)(struct sbus_request *req, void *data, const char *arg_name);
     sbus_msg_handler_fn GetUserAttr;
+    sbus_msg_handler_fn GetUsersAttr;
     int (*GetUserGroups)(struct sbus_request *req, void *data, const char *arg_user);
     int (*FindDomainByName)(struct sbus_request *req, void *data, const char *arg_name);
     int (*ListDomains)(struct sbus_request *req, void *data);
+    int (*GetMemoryCacheStats)(struct sbus_request *req, void *data, const char *arg_map);
+    int (*GetCommandStats)(struct sbus_request *req, void *data, const char *arg_responder);
+    int (*GetTaskStats)(struct sbus_request *req, void *data, const char *arg_domain);
+    int (*GetResolverStats)(struct sbus_request *req, void *data, const char *arg_domain);
+    int (*GetCacheMetrics)(struct sbus_request *req, void *data);
 };
 
 /* finish function for ListComponents */
@@ -160,6 +178,21 @@ int iface_ifp_FindDomainByName_finish(struct sbus_request *req, const char *arg_
 /* finish function for ListDomains */
 int iface_ifp_ListDomains_finish(struct sbus_request *req, const char *arg_domain[], int len_domain);
 
+/* finish function for GetMemoryCacheStats */
+int iface_ifp_GetMemoryCacheStats_finish(struct sbus_request *req, uint64_t arg_stores, uint64_t arg_evictions, uint64_t arg_invalidations, uint64_t arg_grows, uint32_t arg_used_slots, uint32_t arg_total_slots);
+
+/* finish function for GetCommandStats */
+int iface_ifp_GetCommandStats_finish(struct sbus_request *req, uint32_t arg_commands[], int len_commands, const char *arg_sources[], int len_sources, uint64_t arg_replies[], int len_replies, uint64_t arg_total_usec[], int len_total_usec, uint64_t arg_max_usec[], int len_max_usec, uint64_t arg_bucket_limits[], int len_bucket_limits, uint64_t arg_histograms[], int len_histograms);
+
+/* finish function for GetTaskStats */
+int iface_ifp_GetTaskStats_finish(struct sbus_request *req, const char *arg_tasks[], int len_tasks, uint64_t arg_runs[], int len_runs, uint64_t arg_failures[], int len_failures, uint64_t arg_timeouts[], int len_timeouts, uint64_t arg_skips[], int len_skips, uint64_t arg_overlaps[], int len_overlaps, uint64_t arg_total_msec[], int len_total_msec, uint64_t arg_max_msec[], int len_max_msec, uint64_t arg_bucket_limits[], int len_bucket_limits, uint64_t arg_histograms[], int len_histograms);
+
+/* finish function for GetResolverStats */
+int iface_ifp_GetResolverStats_finish(struct sbus_request *req, const char *arg_types[], int len_types, const char *arg_outcomes[], int len_outcomes, uint64_t arg_network[], int len_network, uint64_t arg_cached[], int len_cached, uint64_t arg_total_msec, uint64_t arg_max_msec, uint64_t arg_latency_limits[], int len_latency_limits, uint64_t arg_latency_buckets[], int len_latency_buckets, const char *arg_servers[], int len_servers, uint64_t arg_successes[], int len_successes, uint64_t arg_failures[], int len_failures, uint64_t arg_transitions[], int len_transitions, uint64_t arg_srtt_usec[], int len_srtt_usec, uint64_t arg_connect_limits[], int len_connect_limits, uint64_t arg_connect_histograms[], int len_connect_histograms);
+
+/* finish function for GetCacheMetrics */
+int iface_ifp_GetCacheMetrics_finish(struct sbus_request *req, const char *arg_names[], int len_names, uint64_t arg_values[], int len_values);
+
 /* vtable for org.freedesktop.sssd.infopipe.Components */
 struct iface_ifp_components {
     struct sbus_vtable vtable; /* derive from sbus_vtable */
@@ -239,6 +272,8 @@ struct iface_ifp_users {
     int (*FindByCertificate)(struct sbus_request *req, void *data, const char *arg_pem_cert);
     int (*ListByName)(struct sbus_request *req, void *data, const char *arg_name_filter, uint32_t arg_limit);
     int (*ListByDomainAndName)(struct sbus_request *req, void *data, const char *arg_domain_name, const char *arg_name_filter, uint32_t arg_limit);
+    int (*ListByNamePaged)(struct sbus_request *req, void *data, const char *arg_name_filter, uint32_t arg_offset, uint32_t arg_limit);
+    int (*ListByDomainAndNamePaged)(struct sbus_request *req, void *data, const char *arg_domain_name, const char *arg_name_filter, uint32_t arg_offset, uint32_t arg_limit);
 };
 
 /* finish function for FindByName */
@@ -256,6 +291,12 @@ int iface_ifp_users_ListByName_finish(struct sbus_request *req, const char *arg_
 /* finish function for ListByDomainAndName */
 int iface_ifp_users_ListByDomainAndName_finish(struct sbus_request *req, const char *arg_result[], int len_result);
 
+/* finish function for ListByNamePaged */
+int iface_ifp_users_ListByNamePaged_finish(struct sbus_request *req, const char *arg_result[], int len_result, uint32_t arg_next_offset);
+
+/* finish function for ListByDomainAndNamePaged */
+int iface_ifp_users_ListByDomainAndNamePaged_finish(struct sbus_request *req, const char *arg_result[], int len_result, uint32_t arg_next_offset);
+
 /* vtable for org.freedesktop.sssd.infopipe.Users.User */
 struct iface_ifp_users_user {
     struct sbus_vtable vtable; /* derive from sbus_vtable */
@@ -280,6 +321,8 @@ struct iface_ifp_groups {
     int (*FindByID)(struct sbus_request *req, void *data, uint32_t arg_id);
     int (*ListByName)(struct sbus_request *req, void *data, const char *arg_name_filter, uint32_t arg_limit);
     int (*ListByDomainAndName)(struct sbus_request *req, void *data, const char *arg_domain_name, const char *arg_name_filter, uint32_t arg_limit);
+    int (*ListByNamePaged)(struct sbus_request *req, void *data, const char *arg_name_filter, uint32_t arg_offset, uint32_t arg_limit);
+    int (*ListByDomainAndNamePaged)(struct sbus_request *req, void *data, const char *arg_domain_name, const char *arg_name_filter, uint32_t arg_offset, uint32_t arg_limit);
 };
 
 /* finish function for FindByName */
@@ -294,6 +337,12 @@ int iface_ifp_groups_ListByName_finish(struct sbus_request *req, const char *arg
 /* finish function for ListByDomainAndName */
 int iface_ifp_groups_ListByDomainAndName_finish(struct sbus_request *req, const char *arg_result[], int len_result);
 
+/* finish function for ListByNamePaged */
+int iface_ifp_groups_ListByNamePaged_finish(struct sbus_request *req, const char *arg_result[], int len_result, uint32_t arg_next_offset);
+
+/* finish function for ListByDomainAndNamePaged */
+int iface_ifp_groups_ListByDomainAndNamePaged_finish(struct sbus_request *req, const char *arg_result[], int len_result, uint32_t arg_next_offset);
+
 /* vtable for org.freedesktop.sssd.infopipe.Groups.Group */
 struct iface_ifp_groups_group {
     struct sbus_vtable vtable; /* derive from sbus_vtable */
@@ -36,6 +36,8 @@ struct sysbus_ctx {
     char *introspect_xml;
 };
 
+struct ifp_cache_notify;
+
 struct ifp_ctx {
     struct resp_ctx *rctx;
     struct sss_names_ctx *snctx;
@@ -45,6 +47,12 @@ struct ifp_ctx {
     struct sysbus_ctx *sysbus;
     const char **user_whitelist;
     uint32_t wildcard_limit;
+
+    /* open cursors of paged list calls */
+    hash_table_t *list_cursors;
+
+    /* changed objects not announced on the system bus yet */
+    struct ifp_cache_notify *cache_notify;
 };
 
 errno_t ifp_register_sbus_interface(struct sbus_connection *conn,
@@ -58,9 +66,29 @@ int ifp_ping(struct sbus_request *dbus_req, void *data);
 
 int ifp_user_get_attr(struct sbus_request *dbus_req, void *data);
 
+int ifp_users_get_attr(struct sbus_request *dbus_req, void *data);
+
 int ifp_user_get_groups(struct sbus_request *req,
                         void *data, const char *arg_user);
 
+int ifp_get_memory_cache_stats(struct sbus_request *dbus_req,
+                               void *data,
+                               const char *arg_map);
+
+int ifp_get_command_stats(struct sbus_request *dbus_req,
+                          void *data,
+                          const char *arg_responder);
+
+int ifp_get_task_stats(struct sbus_request *dbus_req,
+                       void *data,
+                       const char *arg_domain);
+
+int ifp_get_resolver_stats(struct sbus_request *dbus_req,
+                           void *data,
+                           const char *arg_domain);
+
+int ifp_get_cache_metrics(struct sbus_request *dbus_req, void *data);
+
 /* == Utility functions == */
 struct ifp_req {
     struct sbus_request *dbus_req;
@@ -96,6 +124,10 @@ struct ifp_list_ctx {
 
     const char **paths;
     size_t path_count;
+
+    /* set for paged list calls */
+    struct ifp_list_cursor *cursor;
+    uint32_t offset;
 };
 
 struct ifp_list_ctx *ifp_list_ctx_new(struct sbus_request *sbus_req,
@@ -106,4 +138,59 @@ struct ifp_list_ctx *ifp_list_ctx_new(struct sbus_request *sbus_req,
 size_t ifp_list_ctx_remaining_capacity(struct ifp_list_ctx *list_ctx,
                                        size_t entries);
 
+/* Used for paged list calls. The complete result of a lookup is kept for a
+ * while so that the following pages are served without searching again. */
+#define IFP_LIST_CURSOR_TIMEOUT 60
+#define IFP_LIST_CURSOR_MAX 256
+
+struct ifp_list_cursor {
+    struct ifp_ctx *ctx;
+    hash_key_t key;
+    bool in_table;
+    struct tevent_timer *timeout;
+
+    const char **paths;
+    size_t path_count;
+};
+
+typedef char *(*ifp_list_build_path_fn)(TALLOC_CTX *mem_ctx,
+                                        struct sss_domain_info *domain,
+                                        struct ldb_message *msg);
+
+struct ifp_list_cursor *ifp_list_cursor_new(TALLOC_CTX *mem_ctx,
+                                            struct ifp_ctx *ctx,
+                                            struct sbus_request *sbus_req,
+                                            const char *method,
+                                            const char *domain,
+                                            const char *filter);
+
+struct ifp_list_cursor *ifp_list_cursor_lookup(struct ifp_ctx *ctx,
+                                               const char *key);
+
+void ifp_list_cursor_register(struct ifp_list_cursor *cursor);
+
+errno_t ifp_list_cursor_add(struct ifp_list_cursor *cursor,
+                            struct sss_domain_info *dom,
+                            struct ldb_result *result,
+                            ifp_list_build_path_fn build_path);
+
+const char **ifp_list_cursor_page(struct ifp_list_cursor *cursor,
+                                  uint32_t offset,
+                                  uint32_t limit,
+                                  size_t *_count,
+                                  uint32_t *_next_offset);
+
+typedef int (*ifp_list_paged_finish_fn)(struct sbus_request *sbus_req,
+                                        const char *arg_result[],
+                                        int len_result,
+                                        uint32_t arg_next_offset);
+
+/* Replies with the page at @offset and keeps the cursor open if more
+ * entries follow. The last page closes the cursor. */
+void ifp_list_cursor_finish(struct sbus_request *sbus_req,
+                            struct ifp_list_cursor *cursor,
+                            uint32_t offset,
+                            uint32_t limit,
+                            ifp_list_paged_finish_fn finish);
+
 #endif /* _IFPSRV_PRIVATE_H_ */
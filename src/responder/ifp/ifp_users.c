@@ -314,6 +314,11 @@ static int ifp_users_list_copy(struct ifp_list_ctx *list_ctx,
 {
     size_t copy_count, i;
 
+    if (list_ctx->cursor != NULL) {
+        return ifp_list_cursor_add(list_ctx->cursor, list_ctx->dom, result,
+                                   ifp_users_build_path_from_msg);
+    }
+
     copy_count = ifp_list_ctx_remaining_capacity(list_ctx, result->count);
 
     for (i = 0; i < copy_count; i++) {
@@ -388,21 +393,21 @@ static void ifp_users_list_by_name_done(struct tevent_req *req)
 
     ret = cache_req_user_by_name_recv(sbus_req, req, &result, &domain, NULL);
     talloc_zfree(req);
-    if (ret != EOK && ret != ENOENT) {
+    if (ret == EOK) {
+        ret = ifp_users_list_copy(list_ctx, result);
+        if (ret != EOK) {
+            error = sbus_error_new(sbus_req, SBUS_ERROR_INTERNAL,
+                                   "Failed to copy domain result");
+            sbus_request_fail_and_finish(sbus_req, error);
+            return;
+        }
+    } else if (ret != ENOENT) {
         error = sbus_error_new(sbus_req, DBUS_ERROR_FAILED, "Failed to fetch "
                                "users by filter [%d]: %s\n", ret, sss_strerror(ret));
         sbus_request_fail_and_finish(sbus_req, error);
         return;
     }
 
-    ret = ifp_users_list_copy(list_ctx, result);
-    if (ret != EOK) {
-        error = sbus_error_new(sbus_req, SBUS_ERROR_INTERNAL,
-                               "Failed to copy domain result");
-        sbus_request_fail_and_finish(sbus_req, error);
-        return;
-    }
-
     list_ctx->dom = get_next_domain(list_ctx->dom, SSS_GND_DESCEND);
     if (list_ctx->dom == NULL) {
         return ifp_users_list_by_name_reply(list_ctx);
@@ -419,11 +424,60 @@ static void ifp_users_list_by_name_done(struct tevent_req *req)
 
 static void ifp_users_list_by_name_reply(struct ifp_list_ctx *list_ctx)
 {
+    if (list_ctx->cursor != NULL) {
+        ifp_list_cursor_finish(list_ctx->sbus_req, list_ctx->cursor,
+                               list_ctx->offset, list_ctx->limit,
+                               iface_ifp_users_ListByNamePaged_finish);
+        return;
+    }
+
     iface_ifp_users_ListByName_finish(list_ctx->sbus_req,
                                       list_ctx->paths,
                                       list_ctx->path_count);
 }
 
+int ifp_users_list_by_name_paged(struct sbus_request *sbus_req,
+                                 void *data,
+                                 const char *filter,
+                                 uint32_t offset,
+                                 uint32_t limit)
+{
+    struct ifp_ctx *ctx;
+    struct ifp_list_ctx *list_ctx;
+    struct ifp_list_cursor *cursor;
+
+    ctx = talloc_get_type(data, struct ifp_ctx);
+    if (ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid pointer!\n");
+        return ERR_INTERNAL;
+    }
+
+    list_ctx = ifp_list_ctx_new(sbus_req, ctx, filter, limit);
+    if (list_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    list_ctx->cursor = ifp_list_cursor_new(list_ctx, ctx, sbus_req,
+                                           IFACE_IFP_USERS "."
+                                           IFACE_IFP_USERS_LISTBYNAMEPAGED,
+                                           NULL, filter);
+    if (list_ctx->cursor == NULL) {
+        return ENOMEM;
+    }
+    list_ctx->offset = offset;
+
+    if (offset != 0) {
+        cursor = ifp_list_cursor_lookup(ctx, list_ctx->cursor->key.str);
+        if (cursor != NULL) {
+            ifp_list_cursor_finish(sbus_req, cursor, offset, list_ctx->limit,
+                                   iface_ifp_users_ListByNamePaged_finish);
+            return EOK;
+        }
+    }
+
+    return ifp_users_list_by_name_step(list_ctx);
+}
+
 static void ifp_users_list_by_domain_and_name_done(struct tevent_req *req);
 
 int ifp_users_list_by_domain_and_name(struct sbus_request *sbus_req,
@@ -483,6 +537,21 @@ static void ifp_users_list_by_domain_and_name_done(struct tevent_req *req)
         goto done;
     }
 
+    if (list_ctx->cursor != NULL) {
+        ret = ifp_list_cursor_add(list_ctx->cursor, domain, result,
+                                  ifp_users_build_path_from_msg);
+        if (ret != EOK) {
+            error = sbus_error_new(sbus_req, SBUS_ERROR_INTERNAL,
+                                   "Failed to compose object path");
+            goto done;
+        }
+
+        ifp_list_cursor_finish(sbus_req, list_ctx->cursor,
+                               list_ctx->offset, list_ctx->limit,
+                               iface_ifp_users_ListByDomainAndNamePaged_finish);
+        return;
+    }
+
     copy_count = ifp_list_ctx_remaining_capacity(list_ctx, result->count);
 
     for (i = 0; i < copy_count; i++) {
@@ -510,6 +579,58 @@ done:
     return;
 }
 
+int ifp_users_list_by_domain_and_name_paged(struct sbus_request *sbus_req,
+                                            void *data,
+                                            const char *domain,
+                                            const char *filter,
+                                            uint32_t offset,
+                                            uint32_t limit)
+{
+    struct tevent_req *req;
+    struct ifp_ctx *ctx;
+    struct ifp_list_ctx *list_ctx;
+    struct ifp_list_cursor *cursor;
+
+    ctx = talloc_get_type(data, struct ifp_ctx);
+    if (ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid pointer!\n");
+        return ERR_INTERNAL;
+    }
+
+    list_ctx = ifp_list_ctx_new(sbus_req, ctx, filter, limit);
+    if (list_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    list_ctx->cursor = ifp_list_cursor_new(list_ctx, ctx, sbus_req,
+                                           IFACE_IFP_USERS "."
+                                           IFACE_IFP_USERS_LISTBYDOMAINANDNAMEPAGED,
+                                           domain, filter);
+    if (list_ctx->cursor == NULL) {
+        return ENOMEM;
+    }
+    list_ctx->offset = offset;
+
+    if (offset != 0) {
+        cursor = ifp_list_cursor_lookup(ctx, list_ctx->cursor->key.str);
+        if (cursor != NULL) {
+            ifp_list_cursor_finish(sbus_req, cursor, offset, list_ctx->limit,
+                                   iface_ifp_users_ListByDomainAndNamePaged_finish);
+            return EOK;
+        }
+    }
+
+    req = cache_req_user_by_filter_send(list_ctx, ctx->rctx->ev, ctx->rctx,
+                                        domain, filter);
+    if (req == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(req,
+                            ifp_users_list_by_domain_and_name_done, list_ctx);
+
+    return EOK;
+}
+
 static errno_t
 ifp_users_user_get(struct sbus_request *sbus_req,
                    struct ifp_ctx *ifp_ctx,
@@ -58,6 +58,19 @@ int ifp_users_list_by_domain_and_name(struct sbus_request *sbus_req,
                                       const char *filter,
                                       uint32_t limit);
 
+int ifp_users_list_by_name_paged(struct sbus_request *sbus_req,
+                                 void *data,
+                                 const char *filter,
+                                 uint32_t offset,
+                                 uint32_t limit);
+
+int ifp_users_list_by_domain_and_name_paged(struct sbus_request *sbus_req,
+                                            void *data,
+                                            const char *domain,
+                                            const char *filter,
+                                            uint32_t offset,
+                                            uint32_t limit);
+
 /* org.freedesktop.sssd.infopipe.Users.User */
 
 int ifp_users_user_update_groups_list(struct sbus_request *req,
@@ -41,6 +41,7 @@
 #include "responder/ifp/ifp_private.h"
 #include "responder/ifp/ifp_domains.h"
 #include "responder/ifp/ifp_components.h"
+#include "responder/ifp/ifp_cache.h"
 #include "responder/common/responder_sbus.h"
 
 #define DEFAULT_ALLOWED_UIDS "0"
@@ -56,17 +57,15 @@ struct mon_cli_iface monitor_ifp_methods = {
     .resetOffline = NULL,
     .rotateLogs = responder_logrotate,
     .sysbusReconnect = ifp_sysbus_reconnect,
+    .memReport = monitor_common_mem_report,
+    .startupTimes = monitor_common_startup_times,
 };
 
-static struct data_provider_iface ifp_dp_methods = {
-    { &data_provider_iface_meta, 0 },
-    .RegisterService = NULL,
-    .pamHandler = NULL,
-    .sudoHandler = NULL,
-    .autofsHandler = NULL,
-    .hostHandler = NULL,
-    .getDomains = NULL,
-    .getAccountInfo = NULL,
+static struct data_provider_rev_iface ifp_dp_methods = {
+    { &data_provider_rev_iface_meta, 0 },
+    .updateCache = NULL,
+    .initgrCheck = NULL,
+    .objectsChanged = ifp_cache_objects_changed,
 };
 
 struct sss_cmd_table *get_ifp_cmds(void)
@@ -296,6 +295,10 @@ int ifp_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    /* not fatal, the cache is then private to this responder */
+    sss_ncache_share(ifp_ctx->ncache, SSS_NCACHE_SHARED_FILE);
+    sss_ncache_set_stats(ifp_ctx->ncache, rctx->cmd_stats);
+
     ret = confdb_get_string(ifp_ctx->rctx->cdb, ifp_ctx->rctx,
                             CONFDB_IFP_CONF_ENTRY, CONFDB_IFP_USER_ATTR_LIST,
                             NULL, &attr_list_str);
@@ -344,6 +347,13 @@ int ifp_process_init(TALLOC_CTX *mem_ctx,
         }
     }
 
+    ret = sss_hash_create(ifp_ctx, 0, &ifp_ctx->list_cursors);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Failed to create the table of list cursors\n");
+        goto fail;
+    }
+
     for (iter = ifp_ctx->rctx->be_conns; iter; iter = iter->next) {
         sbus_reconnect_init(iter->conn, max_retries,
                             ifp_dp_reconnect_init, iter);
@@ -101,14 +101,47 @@ int ifp_user_get_attr(struct sbus_request *dbus_req, void *data)
     return EOK;
 }
 
+static const char **
+ifp_user_get_attr_filter(TALLOC_CTX *mem_ctx,
+                         const char **whitelist,
+                         char **attrs,
+                         int nattrs)
+{
+    const char **allowed;
+    int i, ai;
+
+    /* Copy the attributes to maintain memory hierarchy with talloc */
+    allowed = talloc_zero_array(mem_ctx, const char *, nattrs+1);
+    if (allowed == NULL) {
+        return NULL;
+    }
+
+    ai = 0;
+    for (i = 0; i < nattrs; i++) {
+        if (ifp_attr_allowed(whitelist, attrs[i]) == false) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Attribute %s not present in the whitelist, skipping\n",
+                  attrs[i]);
+            continue;
+        }
+
+        allowed[ai] = talloc_strdup(allowed, attrs[i]);
+        if (allowed[ai] == NULL) {
+            talloc_free(allowed);
+            return NULL;
+        }
+        ai++;
+    }
+
+    return allowed;
+}
+
 static errno_t
 ifp_user_get_attr_unpack_msg(struct ifp_attr_req *attr_req)
 {
     bool parsed;
     char **attrs;
     int nattrs;
-    int i, ai;
-    const char **whitelist = attr_req->ireq->ifp_ctx->user_whitelist;
 
     parsed = sbus_request_parse_or_finish(attr_req->ireq->dbus_req,
                                           DBUS_TYPE_STRING, &attr_req->name,
@@ -120,28 +153,13 @@ ifp_user_get_attr_unpack_msg(struct ifp_attr_req *attr_req)
         return EOK; /* handled */
     }
 
-    /* Copy the attributes to maintain memory hierarchy with talloc */
-    attr_req->attrs = talloc_zero_array(attr_req, const char *, nattrs+1);
+    attr_req->attrs = ifp_user_get_attr_filter(attr_req,
+                                    attr_req->ireq->ifp_ctx->user_whitelist,
+                                    attrs, nattrs);
     if (attr_req->attrs == NULL) {
         return ENOMEM;
     }
 
-    ai = 0;
-    for (i = 0; i < nattrs; i++) {
-        if (ifp_attr_allowed(whitelist, attrs[i]) == false) {
-            DEBUG(SSSDBG_MINOR_FAILURE,
-                  "Attribute %s not present in the whitelist, skipping\n",
-                  attrs[i]);
-            continue;
-        }
-
-        attr_req->attrs[ai] = talloc_strdup(attr_req->attrs, attrs[i]);
-        if (attr_req->attrs[ai] == NULL) {
-            return ENOMEM;
-        }
-        ai++;
-    }
-
     return EOK;
 }
 
@@ -201,37 +219,29 @@ ifp_user_get_attr_replace_space(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+/* Appends the a{sv} dictionary of the requested attributes of the user */
 static errno_t
-ifp_user_get_attr_handle_reply(struct sss_domain_info *domain,
-                               struct ifp_req *ireq,
-                               const char **attrs,
-                               struct ldb_result *res)
+ifp_user_get_attr_append_dict(DBusMessageIter *iter,
+                              struct sss_domain_info *domain,
+                              struct ifp_req *ireq,
+                              const char **attrs,
+                              struct ldb_result *res)
 {
     errno_t ret;
     dbus_bool_t dbret;
-    DBusMessage *reply;
-    DBusMessageIter iter;
     DBusMessageIter iter_dict;
     struct ldb_message_element *el;
     int ai;
 
-    /* Construct a reply */
-    reply = dbus_message_new_method_return(ireq->dbus_req->message);
-    if (!reply) {
-        return sbus_request_finish(ireq->dbus_req, NULL);
-    }
-
-    dbus_message_iter_init_append(reply, &iter);
-
     dbret = dbus_message_iter_open_container(
-                                      &iter, DBUS_TYPE_ARRAY,
+                                      iter, DBUS_TYPE_ARRAY,
                                       DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
                                       DBUS_TYPE_STRING_AS_STRING
                                       DBUS_TYPE_VARIANT_AS_STRING
                                       DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
                                       &iter_dict);
     if (!dbret) {
-        return sbus_request_finish(ireq->dbus_req, NULL);
+        return ENOMEM;
     }
 
     if (res->count > 0) {
@@ -266,14 +276,291 @@ ifp_user_get_attr_handle_reply(struct sss_domain_info *domain,
         }
     }
 
-    dbret = dbus_message_iter_close_container(&iter, &iter_dict);
+    dbret = dbus_message_iter_close_container(iter, &iter_dict);
     if (!dbret) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static errno_t
+ifp_user_get_attr_handle_reply(struct sss_domain_info *domain,
+                               struct ifp_req *ireq,
+                               const char **attrs,
+                               struct ldb_result *res)
+{
+    errno_t ret;
+    DBusMessage *reply;
+    DBusMessageIter iter;
+
+    /* Construct a reply */
+    reply = dbus_message_new_method_return(ireq->dbus_req->message);
+    if (!reply) {
+        return sbus_request_finish(ireq->dbus_req, NULL);
+    }
+
+    dbus_message_iter_init_append(reply, &iter);
+
+    ret = ifp_user_get_attr_append_dict(&iter, domain, ireq, attrs, res);
+    if (ret != EOK) {
+        dbus_message_unref(reply);
         return sbus_request_finish(ireq->dbus_req, NULL);
     }
 
     return sbus_request_finish(ireq->dbus_req, reply);
 }
 
+/* Number of users of a GetUsersAttr call looked up at the same time */
+#define IFP_USERS_ATTR_PARALLEL 32
+
+struct ifp_users_attr_req;
+
+struct ifp_users_attr_entry {
+    struct ifp_users_attr_req *batch;
+    const char *name;
+
+    struct ldb_result *res;
+    struct sss_domain_info *dom;
+};
+
+struct ifp_users_attr_req {
+    struct ifp_req *ireq;
+    const char **attrs;
+
+    struct ifp_users_attr_entry *entries;
+    int num_entries;
+    int next;
+    int pending;
+};
+
+static errno_t ifp_users_get_attr_step(struct ifp_users_attr_req *batch);
+static void ifp_users_get_attr_done(struct tevent_req *req);
+static void ifp_users_get_attr_reply(struct ifp_users_attr_req *batch);
+
+int ifp_users_get_attr(struct sbus_request *dbus_req, void *data)
+{
+    struct ifp_users_attr_req *batch;
+    struct ifp_ctx *ifp_ctx;
+    struct ifp_req *ireq;
+    char **users;
+    int nusers;
+    char **attrs;
+    int nattrs;
+    bool parsed;
+    errno_t ret;
+    int i;
+
+    ifp_ctx = talloc_get_type(data, struct ifp_ctx);
+    if (ifp_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid pointer!\n");
+        return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
+    }
+
+    ret = ifp_req_create(dbus_req, ifp_ctx, &ireq);
+    if (ret != EOK) {
+        return ifp_req_create_handle_failure(dbus_req, ret);
+    }
+
+    parsed = sbus_request_parse_or_finish(dbus_req,
+                                          DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                          &users, &nusers,
+                                          DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                          &attrs, &nattrs,
+                                          DBUS_TYPE_INVALID);
+    if (parsed == false) {
+        DEBUG(SSSDBG_OP_FAILURE, "Could not parse arguments\n");
+        return EOK; /* handled */
+    }
+
+    batch = talloc_zero(ireq, struct ifp_users_attr_req);
+    if (batch == NULL) {
+        return sbus_request_finish(dbus_req, NULL);
+    }
+    batch->ireq = ireq;
+
+    batch->attrs = ifp_user_get_attr_filter(batch, ifp_ctx->user_whitelist,
+                                            attrs, nattrs);
+    if (batch->attrs == NULL) {
+        return sbus_request_finish(dbus_req, NULL);
+    }
+
+    batch->entries = talloc_zero_array(batch, struct ifp_users_attr_entry,
+                                       nusers);
+    if (batch->entries == NULL) {
+        return sbus_request_finish(dbus_req, NULL);
+    }
+    batch->num_entries = nusers;
+
+    for (i = 0; i < nusers; i++) {
+        batch->entries[i].batch = batch;
+        /* the string arrays are owned by the request */
+        batch->entries[i].name = users[i];
+    }
+
+    DEBUG(SSSDBG_FUNC_DATA,
+          "Looking up attributes of %d users on behalf of %"PRIi64"\n",
+          nusers, dbus_req->client);
+
+    ret = ifp_users_get_attr_step(batch);
+    if (ret != EOK) {
+        return sbus_request_finish(dbus_req, NULL);
+    }
+
+    if (batch->pending == 0) {
+        /* nothing to look up */
+        ifp_users_get_attr_reply(batch);
+    }
+
+    return EOK;
+}
+
+/* Keeps up to IFP_USERS_ATTR_PARALLEL lookups running. The same user asked
+ * for more than once, or by other clients at the same time, is only looked
+ * up once by the cache request. */
+static errno_t ifp_users_get_attr_step(struct ifp_users_attr_req *batch)
+{
+    struct ifp_ctx *ifp_ctx = batch->ireq->ifp_ctx;
+    struct ifp_users_attr_entry *entry;
+    struct tevent_req *req;
+
+    while (batch->pending < IFP_USERS_ATTR_PARALLEL
+            && batch->next < batch->num_entries) {
+        entry = &batch->entries[batch->next];
+
+        req = ifp_user_get_attr_send(batch, ifp_ctx->rctx,
+                                     ifp_ctx->ncache, ifp_ctx->neg_timeout,
+                                     SSS_DP_USER,
+                                     entry->name, batch->attrs);
+        if (req == NULL) {
+            return ENOMEM;
+        }
+        tevent_req_set_callback(req, ifp_users_get_attr_done, entry);
+
+        batch->next++;
+        batch->pending++;
+    }
+
+    return EOK;
+}
+
+static void ifp_users_get_attr_done(struct tevent_req *req)
+{
+    struct ifp_users_attr_entry *entry;
+    struct ifp_users_attr_req *batch;
+    errno_t ret;
+
+    entry = tevent_req_callback_data(req, struct ifp_users_attr_entry);
+    batch = entry->batch;
+
+    ret = ifp_user_get_attr_recv(batch->entries, req, &entry->res,
+                                 &entry->dom);
+    talloc_zfree(req);
+    batch->pending--;
+    if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC, "No such user [%s]\n", entry->name);
+    } else if (ret != EOK) {
+        /* users which cannot be read are left out of the reply */
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Failed to read attributes of user [%s] [%d]: %s\n",
+              entry->name, ret, sss_strerror(ret));
+    }
+
+    ret = ifp_users_get_attr_step(batch);
+    if (ret != EOK) {
+        sbus_request_finish(batch->ireq->dbus_req, NULL);
+        return;
+    }
+
+    if (batch->pending == 0) {
+        ifp_users_get_attr_reply(batch);
+    }
+}
+
+static void ifp_users_get_attr_reply(struct ifp_users_attr_req *batch)
+{
+    struct sbus_request *dbus_req = batch->ireq->dbus_req;
+    struct ifp_users_attr_entry *entry;
+    DBusMessage *reply;
+    DBusMessageIter iter;
+    DBusMessageIter iter_users;
+    DBusMessageIter iter_entry;
+    dbus_bool_t dbret;
+    errno_t ret;
+    int i;
+
+    reply = dbus_message_new_method_return(dbus_req->message);
+    if (reply == NULL) {
+        goto fail;
+    }
+
+    dbus_message_iter_init_append(reply, &iter);
+
+    dbret = dbus_message_iter_open_container(
+                                      &iter, DBUS_TYPE_ARRAY,
+                                      DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                                      DBUS_TYPE_STRING_AS_STRING
+                                      DBUS_TYPE_ARRAY_AS_STRING
+                                      DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                                      DBUS_TYPE_STRING_AS_STRING
+                                      DBUS_TYPE_VARIANT_AS_STRING
+                                      DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+                                      DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+                                      &iter_users);
+    if (!dbret) {
+        goto fail;
+    }
+
+    /* users are reported in the order they were asked for */
+    for (i = 0; i < batch->num_entries; i++) {
+        entry = &batch->entries[i];
+        if (entry->res == NULL) {
+            continue;
+        }
+
+        dbret = dbus_message_iter_open_container(&iter_users,
+                                                 DBUS_TYPE_DICT_ENTRY,
+                                                 NULL, &iter_entry);
+        if (!dbret) {
+            goto fail;
+        }
+
+        dbret = dbus_message_iter_append_basic(&iter_entry, DBUS_TYPE_STRING,
+                                               &entry->name);
+        if (!dbret) {
+            goto fail;
+        }
+
+        ret = ifp_user_get_attr_append_dict(&iter_entry, entry->dom,
+                                            batch->ireq, batch->attrs,
+                                            entry->res);
+        if (ret != EOK) {
+            goto fail;
+        }
+
+        dbret = dbus_message_iter_close_container(&iter_users, &iter_entry);
+        if (!dbret) {
+            goto fail;
+        }
+    }
+
+    dbret = dbus_message_iter_close_container(&iter, &iter_users);
+    if (!dbret) {
+        goto fail;
+    }
+
+    sbus_request_finish(dbus_req, reply);
+    dbus_message_unref(reply);
+    return;
+
+fail:
+    DEBUG(SSSDBG_CRIT_FAILURE, "Failed to build a reply\n");
+    if (reply != NULL) {
+        dbus_message_unref(reply);
+    }
+    sbus_request_finish(dbus_req, NULL);
+}
+
 static void ifp_user_get_groups_process(struct tevent_req *req);
 static errno_t ifp_user_get_groups_reply(struct sss_domain_info *domain,
                                          struct ifp_req *ireq,
@@ -603,6 +890,771 @@ struct cli_protocol_version *register_cli_protocol_version(void)
     return ssh_cli_protocol_version;
 }
 
+int ifp_get_memory_cache_stats(struct sbus_request *dbus_req,
+                               void *data,
+                               const char *arg_map)
+{
+    struct ifp_ctx *ifp_ctx;
+    struct ifp_req *ireq;
+    struct sss_mc_usage usage;
+    DBusError *error;
+    errno_t ret;
+
+    ifp_ctx = talloc_get_type(data, struct ifp_ctx);
+    if (ifp_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid pointer!\n");
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Invalid ifp context!");
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    ret = ifp_req_create(dbus_req, ifp_ctx, &ireq);
+    if (ret != EOK) {
+        return ifp_req_create_handle_failure(dbus_req, ret);
+    }
+
+    ret = sss_mc_get_usage(arg_map, &usage);
+    switch (ret) {
+    case EOK:
+        break;
+    case EINVAL:
+        error = sbus_error_new(dbus_req, DBUS_ERROR_INVALID_ARGS,
+                               "Unknown memory cache map %s", arg_map);
+        return sbus_request_fail_and_finish(dbus_req, error);
+    default:
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Unable to read memory cache map %s: %s",
+                               arg_map, sss_strerror(ret));
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    return iface_ifp_GetMemoryCacheStats_finish(dbus_req,
+                                                usage.stores,
+                                                usage.evictions,
+                                                usage.invalidations,
+                                                usage.grows,
+                                                usage.used_slots,
+                                                usage.total_slots);
+}
+
+int ifp_get_command_stats(struct sbus_request *dbus_req,
+                          void *data,
+                          const char *arg_responder)
+{
+    struct ifp_ctx *ifp_ctx;
+    struct ifp_req *ireq;
+    struct sss_cmd_stats_entry *entries;
+    uint32_t *commands;
+    const char **sources;
+    uint64_t *replies;
+    uint64_t *total_usec;
+    uint64_t *max_usec;
+    uint64_t limits[SSS_CMD_STATS_BUCKETS];
+    uint64_t *histograms;
+    DBusError *error;
+    size_t count;
+    size_t i;
+    int j;
+    errno_t ret;
+
+    ifp_ctx = talloc_get_type(data, struct ifp_ctx);
+    if (ifp_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid pointer!\n");
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Invalid ifp context!");
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    ret = ifp_req_create(dbus_req, ifp_ctx, &ireq);
+    if (ret != EOK) {
+        return ifp_req_create_handle_failure(dbus_req, ret);
+    }
+
+    ret = sss_cmd_stats_read(ireq, arg_responder, &entries, &count);
+    switch (ret) {
+    case EOK:
+        break;
+    case ENOENT:
+        /* the responder did not run yet */
+        count = 0;
+        break;
+    case EINVAL:
+        error = sbus_error_new(dbus_req, DBUS_ERROR_INVALID_ARGS,
+                               "Invalid responder name %s", arg_responder);
+        return sbus_request_fail_and_finish(dbus_req, error);
+    default:
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Unable to read the statistics of %s: %s",
+                               arg_responder, sss_strerror(ret));
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    commands = talloc_zero_array(ireq, uint32_t, count + 1);
+    sources = talloc_zero_array(ireq, const char *, count + 1);
+    replies = talloc_zero_array(ireq, uint64_t, count + 1);
+    total_usec = talloc_zero_array(ireq, uint64_t, count + 1);
+    max_usec = talloc_zero_array(ireq, uint64_t, count + 1);
+    histograms = talloc_zero_array(ireq, uint64_t,
+                                   count * SSS_CMD_STATS_BUCKETS + 1);
+    if (commands == NULL || sources == NULL || replies == NULL
+            || total_usec == NULL || max_usec == NULL || histograms == NULL) {
+        return sbus_request_finish(dbus_req, NULL);
+    }
+
+    for (i = 0; i < count; i++) {
+        commands[i] = entries[i].cmd;
+        sources[i] = sss_cmd_source_names[entries[i].source];
+        replies[i] = entries[i].count;
+        total_usec[i] = entries[i].total_usec;
+        max_usec[i] = entries[i].max_usec;
+        memcpy(&histograms[i * SSS_CMD_STATS_BUCKETS], entries[i].buckets,
+               sizeof(entries[i].buckets));
+    }
+
+    /* the last bucket is unbounded */
+    for (j = 0; j < SSS_CMD_STATS_BUCKETS - 1; j++) {
+        limits[j] = sss_cmd_stats_bucket_limit(j);
+    }
+    limits[j] = UINT64_MAX;
+
+    return iface_ifp_GetCommandStats_finish(dbus_req,
+                                            commands, count,
+                                            sources, count,
+                                            replies, count,
+                                            total_usec, count,
+                                            max_usec, count,
+                                            limits, SSS_CMD_STATS_BUCKETS,
+                                            histograms,
+                                            count * SSS_CMD_STATS_BUCKETS);
+}
+
+/* The statistics of a back end are asked for by a call to its data provider
+ * interface, the reply is forwarded to the caller */
+struct ifp_be_stats_state {
+    struct sbus_request *dbus_req;
+    DBusPendingCall *pending;
+};
+
+static int ifp_be_stats_state_destructor(struct ifp_be_stats_state *state)
+{
+    if (state->pending != NULL) {
+        dbus_pending_call_cancel(state->pending);
+        dbus_pending_call_unref(state->pending);
+        state->pending = NULL;
+    }
+
+    return 0;
+}
+
+static int ifp_be_stats_send(struct sbus_request *dbus_req,
+                             void *data,
+                             const char *arg_domain,
+                             const char *method,
+                             DBusPendingCallNotifyFunction done)
+{
+    struct ifp_be_stats_state *state;
+    struct ifp_ctx *ifp_ctx;
+    struct sss_domain_info *dom;
+    struct be_conn *be_conn;
+    DBusMessage *msg;
+    DBusError *error;
+    errno_t ret;
+
+    ifp_ctx = talloc_get_type(data, struct ifp_ctx);
+    if (ifp_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid pointer!\n");
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Invalid ifp context!");
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    dom = find_domain_by_name(ifp_ctx->rctx->domains, arg_domain, true);
+    if (dom == NULL || !NEED_CHECK_PROVIDER(dom->provider)) {
+        error = sbus_error_new(dbus_req, DBUS_ERROR_INVALID_ARGS,
+                               "Unknown domain %s", arg_domain);
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    ret = sss_dp_get_domain_conn(ifp_ctx->rctx, dom->conn_name, &be_conn);
+    if (ret != EOK) {
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "The back end of %s is not connected",
+                               arg_domain);
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    state = talloc_zero(dbus_req, struct ifp_be_stats_state);
+    if (state == NULL) {
+        return sbus_request_finish(dbus_req, NULL);
+    }
+    state->dbus_req = dbus_req;
+
+    msg = dbus_message_new_method_call(NULL,
+                                       DP_PATH,
+                                       DATA_PROVIDER_IFACE,
+                                       method);
+    if (msg == NULL) {
+        return sbus_request_finish(dbus_req, NULL);
+    }
+
+    ret = sbus_conn_send(be_conn->conn, msg, SSS_CLI_SOCKET_TIMEOUT / 2,
+                         done, state, &state->pending);
+    dbus_message_unref(msg);
+    if (ret != EOK) {
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Unable to contact the back end of %s",
+                               arg_domain);
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    talloc_set_destructor(state, ifp_be_stats_state_destructor);
+    return EOK;
+}
+
+/* Returns the reply of the back end or NULL if the request was failed */
+static DBusMessage *ifp_be_stats_reply(DBusPendingCall *pending,
+                                       struct ifp_be_stats_state *state)
+{
+    struct sbus_request *dbus_req = state->dbus_req;
+    DBusMessage *reply;
+    DBusError *error;
+
+    /* the reply arrived, there is nothing to cancel */
+    talloc_set_destructor(state, NULL);
+    state->pending = NULL;
+
+    reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+    if (reply == NULL) {
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "No reply from the back end");
+        sbus_request_fail_and_finish(dbus_req, error);
+        return NULL;
+    }
+
+    if (dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "The back end returned an error [%s]",
+                               dbus_message_get_error_name(reply));
+        sbus_request_fail_and_finish(dbus_req, error);
+        dbus_message_unref(reply);
+        return NULL;
+    }
+
+    return reply;
+}
+
+static void ifp_get_task_stats_done(DBusPendingCall *pending, void *ptr);
+
+int ifp_get_task_stats(struct sbus_request *dbus_req,
+                       void *data,
+                       const char *arg_domain)
+{
+    return ifp_be_stats_send(dbus_req, data, arg_domain,
+                             DATA_PROVIDER_IFACE_GETTASKSTATS,
+                             ifp_get_task_stats_done);
+}
+
+static void ifp_get_task_stats_done(DBusPendingCall *pending, void *ptr)
+{
+    struct ifp_be_stats_state *state;
+    struct sbus_request *dbus_req;
+    DBusMessage *reply;
+    DBusError dbus_error;
+    DBusError *error;
+    const char **tasks = NULL;
+    uint64_t *runs;
+    uint64_t *failures;
+    uint64_t *timeouts;
+    uint64_t *skips;
+    uint64_t *overlaps;
+    uint64_t *total_msec;
+    uint64_t *max_msec;
+    uint64_t *limits;
+    uint64_t *histograms;
+    int len_tasks;
+    int len_runs;
+    int len_failures;
+    int len_timeouts;
+    int len_skips;
+    int len_overlaps;
+    int len_total_msec;
+    int len_max_msec;
+    int len_limits;
+    int len_histograms;
+    dbus_bool_t dbret;
+
+    state = talloc_get_type(ptr, struct ifp_be_stats_state);
+    dbus_req = state->dbus_req;
+
+    dbus_error_init(&dbus_error);
+
+    reply = ifp_be_stats_reply(pending, state);
+    if (reply == NULL) {
+        return;
+    }
+
+    dbret = dbus_message_get_args(reply, &dbus_error,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &tasks, &len_tasks,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &runs, &len_runs,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &failures, &len_failures,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &timeouts, &len_timeouts,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &skips, &len_skips,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &overlaps, &len_overlaps,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &total_msec, &len_total_msec,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &max_msec, &len_max_msec,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &limits, &len_limits,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &histograms, &len_histograms,
+                DBUS_TYPE_INVALID);
+    if (!dbret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to parse message\n");
+        if (dbus_error_is_set(&dbus_error)) dbus_error_free(&dbus_error);
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Invalid reply from the back end");
+        sbus_request_fail_and_finish(dbus_req, error);
+        goto done;
+    }
+
+    /* the reply owns the arrays of the basic types */
+    iface_ifp_GetTaskStats_finish(dbus_req,
+                                  tasks, len_tasks,
+                                  runs, len_runs,
+                                  failures, len_failures,
+                                  timeouts, len_timeouts,
+                                  skips, len_skips,
+                                  overlaps, len_overlaps,
+                                  total_msec, len_total_msec,
+                                  max_msec, len_max_msec,
+                                  limits, len_limits,
+                                  histograms, len_histograms);
+    dbus_free_string_array((char **) tasks);
+
+done:
+    dbus_message_unref(reply);
+}
+
+static void ifp_get_resolver_stats_done(DBusPendingCall *pending, void *ptr);
+
+int ifp_get_resolver_stats(struct sbus_request *dbus_req,
+                           void *data,
+                           const char *arg_domain)
+{
+    return ifp_be_stats_send(dbus_req, data, arg_domain,
+                             DATA_PROVIDER_IFACE_GETRESOLVERSTATS,
+                             ifp_get_resolver_stats_done);
+}
+
+static void ifp_get_resolver_stats_done(DBusPendingCall *pending, void *ptr)
+{
+    struct ifp_be_stats_state *state;
+    struct sbus_request *dbus_req;
+    DBusMessage *reply;
+    DBusError dbus_error;
+    DBusError *error;
+    const char **types = NULL;
+    const char **outcomes = NULL;
+    const char **servers = NULL;
+    uint64_t *network;
+    uint64_t *cached;
+    uint64_t total_msec;
+    uint64_t max_msec;
+    uint64_t *latency_limits;
+    uint64_t *latency_buckets;
+    uint64_t *successes;
+    uint64_t *failures;
+    uint64_t *transitions;
+    uint64_t *srtt_usec;
+    uint64_t *connect_limits;
+    uint64_t *connect_histograms;
+    int len_types;
+    int len_outcomes;
+    int len_servers;
+    int len_network;
+    int len_cached;
+    int len_latency_limits;
+    int len_latency_buckets;
+    int len_successes;
+    int len_failures;
+    int len_transitions;
+    int len_srtt_usec;
+    int len_connect_limits;
+    int len_connect_histograms;
+    dbus_bool_t dbret;
+
+    state = talloc_get_type(ptr, struct ifp_be_stats_state);
+    dbus_req = state->dbus_req;
+
+    dbus_error_init(&dbus_error);
+
+    reply = ifp_be_stats_reply(pending, state);
+    if (reply == NULL) {
+        return;
+    }
+
+    dbret = dbus_message_get_args(reply, &dbus_error,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &types, &len_types,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &outcomes, &len_outcomes,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &network, &len_network,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &cached, &len_cached,
+                DBUS_TYPE_UINT64, &total_msec,
+                DBUS_TYPE_UINT64, &max_msec,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &latency_limits,
+                                                   &len_latency_limits,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &latency_buckets,
+                                                   &len_latency_buckets,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &servers, &len_servers,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &successes, &len_successes,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &failures, &len_failures,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &transitions,
+                                                   &len_transitions,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &srtt_usec, &len_srtt_usec,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &connect_limits,
+                                                   &len_connect_limits,
+                DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &connect_histograms,
+                                                   &len_connect_histograms,
+                DBUS_TYPE_INVALID);
+    if (!dbret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to parse message\n");
+        if (dbus_error_is_set(&dbus_error)) dbus_error_free(&dbus_error);
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Invalid reply from the back end");
+        sbus_request_fail_and_finish(dbus_req, error);
+        goto done;
+    }
+
+    /* the reply owns the arrays of the basic types */
+    iface_ifp_GetResolverStats_finish(dbus_req,
+                                      types, len_types,
+                                      outcomes, len_outcomes,
+                                      network, len_network,
+                                      cached, len_cached,
+                                      total_msec,
+                                      max_msec,
+                                      latency_limits, len_latency_limits,
+                                      latency_buckets, len_latency_buckets,
+                                      servers, len_servers,
+                                      successes, len_successes,
+                                      failures, len_failures,
+                                      transitions, len_transitions,
+                                      srtt_usec, len_srtt_usec,
+                                      connect_limits, len_connect_limits,
+                                      connect_histograms,
+                                      len_connect_histograms);
+    dbus_free_string_array((char **) types);
+    dbus_free_string_array((char **) outcomes);
+    dbus_free_string_array((char **) servers);
+
+done:
+    dbus_message_unref(reply);
+}
+
+/* The cache metrics are read from the files of the responders and asked for
+ * from every back end at the same time, the reply is sent when the last
+ * back end answered */
+struct ifp_metrics_state {
+    struct sbus_request *dbus_req;
+    const char **names;
+    uint64_t *values;
+    size_t count;
+    errno_t error;
+    int pending;
+};
+
+struct ifp_metrics_be_call {
+    struct ifp_metrics_state *state;
+    const char *domain;
+    DBusPendingCall *pending;
+};
+
+static void ifp_metrics_add(struct ifp_metrics_state *state, uint64_t value,
+                            const char *format, ...) SSS_ATTRIBUTE_PRINTF(3, 4);
+
+static void ifp_metrics_add(struct ifp_metrics_state *state, uint64_t value,
+                            const char *format, ...)
+{
+    const char **names;
+    uint64_t *values;
+    va_list ap;
+
+    if (state->error != EOK) {
+        return;
+    }
+
+    names = talloc_realloc(state, state->names, const char *,
+                           state->count + 1);
+    values = talloc_realloc(state, state->values, uint64_t,
+                            state->count + 1);
+    if (names == NULL || values == NULL) {
+        state->error = ENOMEM;
+        return;
+    }
+    state->names = names;
+    state->values = values;
+
+    va_start(ap, format);
+    names[state->count] = talloc_vasprintf(names, format, ap);
+    va_end(ap);
+    if (names[state->count] == NULL) {
+        state->error = ENOMEM;
+        return;
+    }
+
+    values[state->count] = value;
+    state->count++;
+}
+
+static void ifp_metrics_add_mmap_cache(struct ifp_metrics_state *state)
+{
+    struct sss_mc_usage usage;
+    errno_t ret;
+    int i;
+
+    for (i = 0; sss_mc_map_names[i] != NULL; i++) {
+        ret = sss_mc_get_usage(sss_mc_map_names[i], &usage);
+        if (ret != EOK) {
+            /* not created or being reset */
+            continue;
+        }
+
+        ifp_metrics_add(state, usage.stores, "mmap_cache.%s.stores",
+                        sss_mc_map_names[i]);
+        ifp_metrics_add(state, usage.evictions, "mmap_cache.%s.evictions",
+                        sss_mc_map_names[i]);
+        ifp_metrics_add(state, usage.invalidations,
+                        "mmap_cache.%s.invalidations", sss_mc_map_names[i]);
+        ifp_metrics_add(state, usage.grows, "mmap_cache.%s.grows",
+                        sss_mc_map_names[i]);
+        ifp_metrics_add(state, usage.used_slots, "mmap_cache.%s.used_slots",
+                        sss_mc_map_names[i]);
+        ifp_metrics_add(state, usage.total_slots, "mmap_cache.%s.total_slots",
+                        sss_mc_map_names[i]);
+    }
+}
+
+static void ifp_metrics_add_responders(struct ifp_metrics_state *state)
+{
+    const char * const *svc = get_known_services();
+    uint64_t counters[SSS_CACHE_COUNTER_SENTINEL];
+    uint64_t replies[SSS_CMD_SRC_SENTINEL];
+    struct sss_cmd_stats_entry *entries;
+    size_t count;
+    size_t i;
+    size_t k;
+    errno_t ret;
+    int j;
+
+    for (i = 0; svc[i] != NULL; i++) {
+        ret = sss_cmd_stats_read_counters(svc[i], counters);
+        if (ret != EOK) {
+            /* the responder did not run yet */
+            continue;
+        }
+
+        for (j = 0; j < SSS_CACHE_COUNTER_SENTINEL; j++) {
+            ifp_metrics_add(state, counters[j], "responder.%s.%s",
+                            svc[i], sss_cache_counter_names[j]);
+        }
+
+        ret = sss_cmd_stats_read(state, svc[i], &entries, &count);
+        if (ret != EOK) {
+            continue;
+        }
+
+        /* where the replies of all commands came from */
+        memset(replies, 0, sizeof(replies));
+        for (k = 0; k < count; k++) {
+            replies[entries[k].source] += entries[k].count;
+        }
+        talloc_free(entries);
+
+        for (j = 0; j < SSS_CMD_SRC_SENTINEL; j++) {
+            ifp_metrics_add(state, replies[j], "responder.%s.replies.%s",
+                            svc[i], sss_cmd_source_names[j]);
+        }
+    }
+}
+
+static void ifp_metrics_finish(struct ifp_metrics_state *state)
+{
+    DBusError *error;
+
+    if (state->error != EOK) {
+        error = sbus_error_new(state->dbus_req, DBUS_ERROR_FAILED,
+                               "Unable to collect the metrics: %s",
+                               sss_strerror(state->error));
+        sbus_request_fail_and_finish(state->dbus_req, error);
+        return;
+    }
+
+    iface_ifp_GetCacheMetrics_finish(state->dbus_req,
+                                     state->names, state->count,
+                                     state->values, state->count);
+}
+
+static int ifp_metrics_be_call_destructor(struct ifp_metrics_be_call *call)
+{
+    if (call->pending != NULL) {
+        dbus_pending_call_cancel(call->pending);
+        dbus_pending_call_unref(call->pending);
+        call->pending = NULL;
+    }
+
+    return 0;
+}
+
+static void ifp_metrics_be_done(DBusPendingCall *pending, void *ptr)
+{
+    struct ifp_metrics_be_call *call;
+    struct ifp_metrics_state *state;
+    DBusMessage *reply;
+    DBusError dbus_error;
+    const char **names = NULL;
+    uint64_t *values;
+    int len_names;
+    int len_values;
+    dbus_bool_t dbret = FALSE;
+    int i;
+
+    call = talloc_get_type(ptr, struct ifp_metrics_be_call);
+    state = call->state;
+
+    /* the reply arrived, there is nothing to cancel */
+    talloc_set_destructor(call, NULL);
+    call->pending = NULL;
+
+    dbus_error_init(&dbus_error);
+
+    reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+    if (reply != NULL
+            && dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+        dbret = dbus_message_get_args(reply, &dbus_error,
+                    DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &names, &len_names,
+                    DBUS_TYPE_ARRAY, DBUS_TYPE_UINT64, &values, &len_values,
+                    DBUS_TYPE_INVALID);
+        if (dbus_error_is_set(&dbus_error)) dbus_error_free(&dbus_error);
+    }
+
+    if (dbret && len_names == len_values) {
+        ifp_metrics_add(state, 1, "backend.%s.up", call->domain);
+        for (i = 0; i < len_names; i++) {
+            ifp_metrics_add(state, values[i], "backend.%s.%s",
+                            call->domain, names[i]);
+        }
+    } else {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "No metrics from the back end of %s\n", call->domain);
+        ifp_metrics_add(state, 0, "backend.%s.up", call->domain);
+    }
+
+    if (names != NULL) {
+        dbus_free_string_array((char **) names);
+    }
+    if (reply != NULL) {
+        dbus_message_unref(reply);
+    }
+    talloc_free(call);
+
+    state->pending--;
+    if (state->pending == 0) {
+        ifp_metrics_finish(state);
+    }
+}
+
+static void ifp_metrics_be_send(struct ifp_metrics_state *state,
+                                struct resp_ctx *rctx,
+                                struct sss_domain_info *dom)
+{
+    struct ifp_metrics_be_call *call;
+    struct be_conn *be_conn;
+    DBusMessage *msg;
+    errno_t ret;
+
+    ret = sss_dp_get_domain_conn(rctx, dom->conn_name, &be_conn);
+    if (ret != EOK) {
+        ifp_metrics_add(state, 0, "backend.%s.up", dom->name);
+        return;
+    }
+
+    call = talloc_zero(state, struct ifp_metrics_be_call);
+    if (call == NULL) {
+        state->error = ENOMEM;
+        return;
+    }
+    call->state = state;
+    call->domain = dom->name;
+
+    msg = dbus_message_new_method_call(NULL,
+                                       DP_PATH,
+                                       DATA_PROVIDER_IFACE,
+                                       DATA_PROVIDER_IFACE_GETCACHEMETRICS);
+    if (msg == NULL) {
+        talloc_free(call);
+        state->error = ENOMEM;
+        return;
+    }
+
+    ret = sbus_conn_send(be_conn->conn, msg, SSS_CLI_SOCKET_TIMEOUT / 2,
+                         ifp_metrics_be_done, call, &call->pending);
+    dbus_message_unref(msg);
+    if (ret != EOK) {
+        talloc_free(call);
+        ifp_metrics_add(state, 0, "backend.%s.up", dom->name);
+        return;
+    }
+
+    talloc_set_destructor(call, ifp_metrics_be_call_destructor);
+    state->pending++;
+}
+
+int ifp_get_cache_metrics(struct sbus_request *dbus_req, void *data)
+{
+    struct ifp_metrics_state *state;
+    struct ifp_ctx *ifp_ctx;
+    struct ifp_req *ireq;
+    struct sss_domain_info *dom;
+    DBusError *error;
+    errno_t ret;
+
+    ifp_ctx = talloc_get_type(data, struct ifp_ctx);
+    if (ifp_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid pointer!\n");
+        error = sbus_error_new(dbus_req, DBUS_ERROR_FAILED,
+                               "Invalid ifp context!");
+        return sbus_request_fail_and_finish(dbus_req, error);
+    }
+
+    ret = ifp_req_create(dbus_req, ifp_ctx, &ireq);
+    if (ret != EOK) {
+        return ifp_req_create_handle_failure(dbus_req, ret);
+    }
+
+    state = talloc_zero(dbus_req, struct ifp_metrics_state);
+    if (state == NULL) {
+        return sbus_request_finish(dbus_req, NULL);
+    }
+    state->dbus_req = dbus_req;
+
+    ifp_metrics_add_mmap_cache(state);
+    ifp_metrics_add_responders(state);
+
+    /* the subdomains are served by the back end of their parent */
+    for (dom = ifp_ctx->rctx->domains; dom != NULL;
+            dom = get_next_domain(dom, 0)) {
+        if (!NEED_CHECK_PROVIDER(dom->provider)) {
+            continue;
+        }
+
+        ifp_metrics_be_send(state, ifp_ctx->rctx, dom);
+    }
+
+    if (state->pending == 0) {
+        ifp_metrics_finish(state);
+    }
+
+    return EOK;
+}
+
 /* This is a throwaway method to ease the review of the patch.
  * It will be removed later */
 int ifp_ping(struct sbus_request *dbus_req, void *data)
@@ -300,7 +300,8 @@ struct ifp_list_ctx *ifp_list_ctx_new(struct sbus_request *sbus_req,
     list_ctx->ctx = ctx;
     list_ctx->dom = ctx->rctx->domains;
     list_ctx->filter = filter;
-    list_ctx->paths = talloc_zero_array(list_ctx, const char *, limit);
+    list_ctx->paths = talloc_zero_array(list_ctx, const char *,
+                                        list_ctx->limit);
     if (list_ctx->paths == NULL) {
         talloc_free(list_ctx);
         return NULL;
@@ -323,3 +324,256 @@ size_t ifp_list_ctx_remaining_capacity(struct ifp_list_ctx *list_ctx,
         return entries;
     }
 }
+
+static void ifp_list_cursor_timeout(struct tevent_context *ev,
+                                    struct tevent_timer *te,
+                                    struct timeval tv,
+                                    void *pvt)
+{
+    struct ifp_list_cursor *cursor;
+
+    cursor = talloc_get_type(pvt, struct ifp_list_cursor);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "List cursor [%s] expired\n", cursor->key.str);
+    cursor->timeout = NULL;
+    talloc_free(cursor);
+}
+
+static int ifp_list_cursor_destructor(struct ifp_list_cursor *cursor)
+{
+    int hret;
+
+    if (!cursor->in_table) {
+        return 0;
+    }
+
+    hret = hash_delete(cursor->ctx->list_cursors, &cursor->key);
+    if (hret != HASH_SUCCESS) {
+        /* This should never happen */
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "BUG: Could not remove list cursor [%s]: [%s]\n",
+              cursor->key.str, hash_error_string(hret));
+    }
+    cursor->in_table = false;
+
+    return 0;
+}
+
+static errno_t ifp_list_cursor_arm(struct ifp_list_cursor *cursor)
+{
+    struct timeval tv;
+
+    talloc_zfree(cursor->timeout);
+
+    tv = tevent_timeval_current_ofs(IFP_LIST_CURSOR_TIMEOUT, 0);
+    cursor->timeout = tevent_add_timer(cursor->ctx->rctx->ev, cursor, tv,
+                                       ifp_list_cursor_timeout, cursor);
+    if (cursor->timeout == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+struct ifp_list_cursor *ifp_list_cursor_new(TALLOC_CTX *mem_ctx,
+                                            struct ifp_ctx *ctx,
+                                            struct sbus_request *sbus_req,
+                                            const char *method,
+                                            const char *domain,
+                                            const char *filter)
+{
+    struct ifp_list_cursor *cursor;
+    const char *sender = NULL;
+
+    cursor = talloc_zero(mem_ctx, struct ifp_list_cursor);
+    if (cursor == NULL) {
+        return NULL;
+    }
+
+    if (sbus_req->message != NULL) {
+        sender = dbus_message_get_sender(sbus_req->message);
+    }
+
+    /* The cursor is only ever handed back to the same client asking for
+     * the same list. */
+    cursor->ctx = ctx;
+    cursor->key.type = HASH_KEY_STRING;
+    if (sender != NULL) {
+        cursor->key.str = talloc_asprintf(cursor, "%s:%s:%s:%s", sender,
+                                          method, domain ? domain : "",
+                                          filter);
+    } else {
+        cursor->key.str = talloc_asprintf(cursor, "%"PRIi64":%s:%s:%s",
+                                          sbus_req->client, method,
+                                          domain ? domain : "", filter);
+    }
+    if (cursor->key.str == NULL) {
+        talloc_free(cursor);
+        return NULL;
+    }
+
+    talloc_set_destructor(cursor, ifp_list_cursor_destructor);
+
+    return cursor;
+}
+
+struct ifp_list_cursor *ifp_list_cursor_lookup(struct ifp_ctx *ctx,
+                                               const char *key)
+{
+    struct ifp_list_cursor *cursor;
+    hash_key_t hkey;
+    hash_value_t value;
+    int hret;
+
+    if (ctx->list_cursors == NULL) {
+        return NULL;
+    }
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = discard_const(key);
+
+    hret = hash_lookup(ctx->list_cursors, &hkey, &value);
+    if (hret != HASH_SUCCESS) {
+        return NULL;
+    }
+
+    cursor = talloc_get_type(value.ptr, struct ifp_list_cursor);
+    if (cursor == NULL) {
+        return NULL;
+    }
+
+    /* the client is still paging through the list, keep it around */
+    if (ifp_list_cursor_arm(cursor) != EOK) {
+        talloc_free(cursor);
+        return NULL;
+    }
+
+    return cursor;
+}
+
+void ifp_list_cursor_register(struct ifp_list_cursor *cursor)
+{
+    struct ifp_list_cursor *old;
+    hash_value_t value;
+    int hret;
+
+    if (cursor->ctx->list_cursors == NULL || cursor->in_table) {
+        return;
+    }
+
+    /* A new lookup of the same list replaces the previous cursor. */
+    hret = hash_lookup(cursor->ctx->list_cursors, &cursor->key, &value);
+    if (hret == HASH_SUCCESS) {
+        old = talloc_get_type(value.ptr, struct ifp_list_cursor);
+        talloc_free(old);
+    }
+
+    /* non-fatal from here on, following pages just search the cache again */
+    if (hash_count(cursor->ctx->list_cursors) >= IFP_LIST_CURSOR_MAX) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Too many open list cursors, not keeping [%s]\n",
+              cursor->key.str);
+        return;
+    }
+
+    if (ifp_list_cursor_arm(cursor) != EOK) {
+        return;
+    }
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = cursor;
+
+    hret = hash_enter(cursor->ctx->list_cursors, &cursor->key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to keep list cursor [%s]: [%s]\n",
+              cursor->key.str, hash_error_string(hret));
+        talloc_zfree(cursor->timeout);
+        return;
+    }
+    cursor->in_table = true;
+
+    talloc_steal(cursor->ctx, cursor);
+}
+
+errno_t ifp_list_cursor_add(struct ifp_list_cursor *cursor,
+                            struct sss_domain_info *dom,
+                            struct ldb_result *result,
+                            ifp_list_build_path_fn build_path)
+{
+    const char **paths;
+    size_t i;
+
+    if (result == NULL || result->count == 0) {
+        return EOK;
+    }
+
+    paths = talloc_realloc(cursor, cursor->paths, const char *,
+                           cursor->path_count + result->count);
+    if (paths == NULL) {
+        return ENOMEM;
+    }
+    cursor->paths = paths;
+
+    for (i = 0; i < result->count; i++) {
+        paths[cursor->path_count] = build_path(paths, dom, result->msgs[i]);
+        if (paths[cursor->path_count] == NULL) {
+            return ENOMEM;
+        }
+        cursor->path_count++;
+    }
+
+    return EOK;
+}
+
+const char **ifp_list_cursor_page(struct ifp_list_cursor *cursor,
+                                  uint32_t offset,
+                                  uint32_t limit,
+                                  size_t *_count,
+                                  uint32_t *_next_offset)
+{
+    size_t count;
+
+    if (offset >= cursor->path_count) {
+        *_count = 0;
+        *_next_offset = 0;
+        return NULL;
+    }
+
+    count = cursor->path_count - offset;
+    if (limit != 0 && count > limit) {
+        count = limit;
+    }
+
+    *_count = count;
+    /* zero is never a valid offset of a following page */
+    *_next_offset = offset + count < cursor->path_count ? offset + count : 0;
+    return cursor->paths + offset;
+}
+
+void ifp_list_cursor_finish(struct sbus_request *sbus_req,
+                            struct ifp_list_cursor *cursor,
+                            uint32_t offset,
+                            uint32_t limit,
+                            ifp_list_paged_finish_fn finish)
+{
+    const char **paths;
+    size_t count;
+    uint32_t next_offset;
+    bool release;
+
+    paths = ifp_list_cursor_page(cursor, offset, limit, &count, &next_offset);
+    if (next_offset != 0) {
+        ifp_list_cursor_register(cursor);
+    }
+
+    /* A cursor which is not kept is owned by the request and goes away
+     * together with it. */
+    release = next_offset == 0 && cursor->in_table;
+
+    finish(sbus_req, paths, count, next_offset);
+
+    if (release) {
+        talloc_free(cursor);
+    }
+}
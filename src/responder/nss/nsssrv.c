@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <signal.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -57,6 +58,7 @@
 
 static int nss_clear_memcache(struct sbus_request *dbus_req, void *data);
 static int nss_clear_netgroup_hash_table(struct sbus_request *dbus_req, void *data);
+static int nss_logrotate(struct sbus_request *dbus_req, void *data);
 
 struct mon_cli_iface monitor_nss_methods = {
     { &mon_cli_iface_meta, 0 },
@@ -65,10 +67,12 @@ struct mon_cli_iface monitor_nss_methods = {
     .shutDown = NULL,
     .goOffline = NULL,
     .resetOffline = NULL,
-    .rotateLogs = responder_logrotate,
+    .rotateLogs = nss_logrotate,
     .clearMemcache = nss_clear_memcache,
     .clearEnumCache = nss_clear_netgroup_hash_table,
     .sysbusReconnect = NULL,
+    .memReport = monitor_common_mem_report,
+    .startupTimes = monitor_common_startup_times,
 };
 
 static int nss_clear_memcache(struct sbus_request *dbus_req, void *data)
@@ -106,6 +110,7 @@ static int nss_clear_memcache(struct sbus_request *dbus_req, void *data)
 
     /* TODO: read cache sizes from configuration */
     DEBUG(SSSDBG_TRACE_FUNC, "Clearing memory caches.\n");
+    sss_objcache_invalidate(rctx, NULL);
     ret = sss_mmap_cache_reinit(nctx, SSS_MC_CACHE_ELEMENTS,
                                 (time_t) memcache_timeout,
                                 &nctx->pwd_mc_ctx);
@@ -133,6 +138,33 @@ static int nss_clear_memcache(struct sbus_request *dbus_req, void *data)
         return ret;
     }
 
+    ret = sss_mmap_cache_reinit(nctx, SSS_MC_CACHE_ELEMENTS,
+                                (time_t)memcache_timeout,
+                                &nctx->netgr_mc_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "netgroup mmap cache invalidation failed\n");
+        return ret;
+    }
+
+    ret = sss_mmap_cache_reinit(nctx, SSS_MC_CACHE_ELEMENTS,
+                                (time_t)memcache_timeout,
+                                &nctx->sid_mc_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "sid mmap cache invalidation failed\n");
+        return ret;
+    }
+
+    ret = sss_mmap_cache_reinit(nctx, SSS_MC_CACHE_ELEMENTS,
+                                (time_t)memcache_timeout,
+                                &nctx->svc_mc_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "services mmap cache invalidation failed\n");
+        return ret;
+    }
+
 done:
     return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
 }
@@ -153,6 +185,18 @@ static int nss_clear_netgroup_hash_table(struct sbus_request *dbus_req, void *da
     return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
 }
 
+static int nss_logrotate(struct sbus_request *dbus_req, void *data)
+{
+    struct resp_ctx *rctx = talloc_get_type(data, struct resp_ctx);
+    struct nss_ctx *nctx = (struct nss_ctx*) rctx->pvt_ctx;
+
+    /* the workers are not connected to the monitor, they rotate their
+     * logs on SIGHUP */
+    nss_workers_signal(nctx, SIGHUP);
+
+    return responder_logrotate(dbus_req, data);
+}
+
 static errno_t nss_get_etc_shells(TALLOC_CTX *mem_ctx, char ***_shells)
 {
     int i = 0;
@@ -223,6 +267,7 @@ static int nss_get_config(struct nss_ctx *nctx,
                           struct confdb_ctx *cdb)
 {
     int ret;
+    int refresh_ahead;
     char *tmp_str;
 
     ret = confdb_get_int(cdb, CONFDB_NSS_CONF_ENTRY,
@@ -230,6 +275,11 @@ static int nss_get_config(struct nss_ctx *nctx,
                          &nctx->enum_cache_timeout);
     if (ret != EOK) goto done;
 
+    ret = confdb_get_bool(cdb, CONFDB_NSS_CONF_ENTRY,
+                          CONFDB_NSS_ENUM_CURSOR, false,
+                          &nctx->enum_cursor);
+    if (ret != EOK) goto done;
+
     ret = confdb_get_int(cdb, CONFDB_NSS_CONF_ENTRY,
                          CONFDB_NSS_ENTRY_NEG_TIMEOUT, 15,
                          &nctx->neg_timeout);
@@ -252,6 +302,17 @@ static int nss_get_config(struct nss_ctx *nctx,
         nctx->cache_refresh_percent = 0;
     }
 
+    ret = confdb_get_int(cdb, CONFDB_NSS_CONF_ENTRY,
+                         CONFDB_NSS_REFRESH_AHEAD_ENTRIES, 20,
+                         &refresh_ahead);
+    if (ret != EOK) goto done;
+
+    ret = sss_hotlist_init(nctx->rctx, refresh_ahead > 0 ? refresh_ahead : 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Could not set up the refresh-ahead\n");
+        goto done;
+    }
+
     ret = sss_ncache_prepopulate(nctx->ncache, cdb, nctx->rctx);
     if (ret != EOK) {
         goto done;
@@ -339,8 +400,10 @@ static int nss_update_memcache(struct sbus_request *dbus_req, void *data)
 
     nss_update_pw_memcache(nctx);
     nss_update_gr_memcache(nctx);
+    sss_objcache_invalidate(rctx, NULL);
 
-    return EOK;
+    /* the back end may wait until the expired entries are gone */
+    return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
 }
 
 static int nss_memcache_initgr_check(struct sbus_request *dbus_req, void *data)
@@ -387,7 +450,7 @@ static void nss_dp_reconnect_init(struct sbus_connection *conn,
         /* Identify ourselves to the data provider */
         ret = dp_common_send_id(be_conn->conn,
                                 DATA_PROVIDER_VERSION,
-                                "NSS");
+                                be_conn->cli_name);
         /* all fine */
         if (ret == EOK) {
             handle_requests_after_reconnect(be_conn->rctx);
@@ -403,9 +466,26 @@ static void nss_dp_reconnect_init(struct sbus_connection *conn,
     /* nss_shutdown(rctx); */
 }
 
+/* Names of case insensitive domains are hashed case folded in the passwd
+ * cache so that clients find them whatever case they were asked with */
+static bool nss_needs_fold_case(struct resp_ctx *rctx)
+{
+    struct sss_domain_info *dom;
+
+    for (dom = rctx->domains; dom; dom = get_next_domain(dom, 0)) {
+        if (!dom->case_sensitive) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 int nss_process_init(TALLOC_CTX *mem_ctx,
                      struct tevent_context *ev,
-                     struct confdb_ctx *cdb)
+                     struct confdb_ctx *cdb,
+                     int worker_listen_fd,
+                     int worker_writer_fd)
 {
     struct resp_ctx *rctx;
     struct sss_cmd_table *nss_cmds;
@@ -416,17 +496,26 @@ int nss_process_init(TALLOC_CTX *mem_ctx,
     enum idmap_error_code err;
     int hret;
     int fd_limit;
+    int num_workers;
+    bool is_worker;
 
     nss_cmds = get_nss_cmds();
 
+    /* workers accept clients on the pipe of the main process, which is
+     * the only one registered with the monitor */
+    is_worker = (worker_listen_fd != -1 && worker_writer_fd != -1);
+
     ret = sss_process_init(mem_ctx, ev, cdb,
                            nss_cmds,
-                           SSS_NSS_SOCKET_NAME, -1, NULL, -1,
+                           SSS_NSS_SOCKET_NAME,
+                           is_worker ? worker_listen_fd : -1,
+                           NULL, -1,
                            CONFDB_NSS_CONF_ENTRY,
                            NSS_SBUS_SERVICE_NAME,
                            NSS_SBUS_SERVICE_VERSION,
-                           &monitor_nss_methods,
-                           "NSS", &nss_dp_methods.vtable,
+                           is_worker ? NULL : &monitor_nss_methods,
+                           is_worker ? "NSS worker" : "NSS",
+                           &nss_dp_methods.vtable,
                            &rctx);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "sss_process_init() failed\n");
@@ -447,6 +536,10 @@ int nss_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    /* not fatal, the cache is then private to this responder */
+    sss_ncache_share(nctx->ncache, SSS_NCACHE_SHARED_FILE);
+    sss_ncache_set_stats(nctx->ncache, rctx->cmd_stats);
+
     nctx->rctx = rctx;
     nctx->rctx->pvt_ctx = nctx;
 
@@ -490,6 +583,16 @@ int nss_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    if (is_worker) {
+        ret = nss_worker_init(nctx, worker_writer_fd);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE,
+                  "Unable to connect to the main NSS responder.\n");
+            goto fail;
+        }
+        goto done_mmap;
+    }
+
     /* create mmap caches */
     /* Remove the CLEAR_MC_FLAG file if exists. */
     ret = unlink(SSS_NSS_MCACHE_DIR"/"CLEAR_MC_FLAG);
@@ -517,6 +620,9 @@ int nss_process_init(TALLOC_CTX *mem_ctx,
                               &nctx->pwd_mc_ctx);
     if (ret) {
         DEBUG(SSSDBG_CRIT_FAILURE, "passwd mmap cache is DISABLED\n");
+    } else {
+        sss_mmap_cache_set_fold_case(nctx->pwd_mc_ctx,
+                                     nss_needs_fold_case(rctx));
     }
 
     ret = sss_mmap_cache_init(nctx, "group", SSS_MC_GROUP,
@@ -533,6 +639,29 @@ int nss_process_init(TALLOC_CTX *mem_ctx,
         DEBUG(SSSDBG_CRIT_FAILURE, "inigroups mmap cache is DISABLED\n");
     }
 
+    ret = sss_mmap_cache_init(nctx, "netgroup", SSS_MC_NETGROUP,
+                              SSS_MC_CACHE_ELEMENTS, (time_t)memcache_timeout,
+                              &nctx->netgr_mc_ctx);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "netgroup mmap cache is DISABLED\n");
+    }
+
+    ret = sss_mmap_cache_init(nctx, "sid", SSS_MC_SID,
+                              SSS_MC_CACHE_ELEMENTS, (time_t)memcache_timeout,
+                              &nctx->sid_mc_ctx);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sid mmap cache is DISABLED\n");
+    }
+
+    ret = sss_mmap_cache_init(nctx, "services", SSS_MC_SERVICES,
+                              SSS_MC_CACHE_ELEMENTS, (time_t)memcache_timeout,
+                              &nctx->svc_mc_ctx);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "services mmap cache is DISABLED\n");
+    }
+
+done_mmap:
+
     /* Set up file descriptor limits */
     ret = confdb_get_int(nctx->rctx->cdb,
                          CONFDB_NSS_CONF_ENTRY,
@@ -558,6 +687,27 @@ int nss_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    if (!is_worker) {
+        ret = confdb_get_int(nctx->rctx->cdb,
+                             CONFDB_NSS_CONF_ENTRY,
+                             CONFDB_NSS_WORKER_PROCESSES,
+                             1, &num_workers);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE,
+                  "Failed to get 'worker_processes' option from confdb.\n");
+            goto fail;
+        }
+
+        if (num_workers > 1) {
+            ret = nss_workers_start(nctx, num_workers - 1);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_CRIT_FAILURE,
+                      "Unable to start NSS worker processes, lookups are "
+                      "served by the main process only\n");
+            }
+        }
+    }
+
     DEBUG(SSSDBG_TRACE_FUNC, "NSS Initialization complete\n");
 
     return EOK;
@@ -575,11 +725,19 @@ int main(int argc, const char *argv[])
     int ret;
     uid_t uid;
     gid_t gid;
+    int worker_listen_fd = -1;
+    int worker_writer_fd = -1;
 
     struct poptOption long_options[] = {
         POPT_AUTOHELP
         SSSD_MAIN_OPTS
         SSSD_SERVER_OPTS(uid, gid)
+        {"worker-listen-fd", 0, POPT_ARG_INT | POPT_ARGFLAG_DOC_HIDDEN,
+         &worker_listen_fd, 0,
+         _("The pipe a worker process accepts clients on"), NULL},
+        {"worker-writer-fd", 0, POPT_ARG_INT | POPT_ARGFLAG_DOC_HIDDEN,
+         &worker_writer_fd, 0,
+         _("The connection of a worker process to the main responder"), NULL},
         POPT_TABLEEND
     };
 
@@ -619,7 +777,9 @@ int main(int argc, const char *argv[])
 
     ret = nss_process_init(main_ctx,
                            main_ctx->event_ctx,
-                           main_ctx->confdb_ctx);
+                           main_ctx->confdb_ctx,
+                           worker_listen_fd,
+                           worker_writer_fd);
     if (ret != EOK) return 3;
 
     /* loop on main */
@@ -40,6 +40,7 @@
 
 struct getent_ctx;
 struct sss_mc_ctx;
+struct nss_workers_ctx;
 
 struct nss_ctx {
     struct resp_ctx *rctx;
@@ -50,6 +51,8 @@ struct nss_ctx {
     int cache_refresh_percent;
 
     int enum_cache_timeout;
+    /* read the enumerated objects a page at a time */
+    bool enum_cursor;
 
     struct getent_ctx *pctx;
     struct getent_ctx *gctx;
@@ -73,15 +76,26 @@ struct nss_ctx {
     struct sss_mc_ctx *pwd_mc_ctx;
     struct sss_mc_ctx *grp_mc_ctx;
     struct sss_mc_ctx *initgr_mc_ctx;
+    struct sss_mc_ctx *netgr_mc_ctx;
+    struct sss_mc_ctx *sid_mc_ctx;
+    struct sss_mc_ctx *svc_mc_ctx;
 
     struct sss_idmap_ctx *idmap_ctx;
     struct sss_names_ctx *global_names;
 
     const char **extra_attributes;
+
+    /* worker processes, only set in the main responder process */
+    struct nss_workers_ctx *workers;
 };
 
 struct nss_packet;
 
 struct sss_cmd_table *get_nss_cmds(void);
 
+/* from nsssrv_workers.c */
+errno_t nss_workers_start(struct nss_ctx *nctx, int num_workers);
+void nss_workers_signal(struct nss_ctx *nctx, int signum);
+errno_t nss_worker_init(struct nss_ctx *nctx, int writer_fd);
+
 #endif /* __NSSSRV_H__ */
@@ -28,6 +28,7 @@
 #include "responder/nss/nsssrv_services.h"
 #include "responder/nss/nsssrv_mmap_cache.h"
 #include "responder/common/negcache.h"
+#include "responder/common/responder_cache_req.h"
 #include "providers/data_provider.h"
 #include "confdb/confdb.h"
 #include "db/sysdb.h"
@@ -118,6 +119,39 @@ static int nss_reset_negcache(struct resp_ctx *rctx)
     return sss_ncache_reset_repopulate_permanent(rctx, nss_ctx->ncache);
 }
 
+/* The SID map answers sss_nss_getidsbysids() and friends, its records must
+ * go together with the passwd and group ones they were built from. */
+static void nss_invalidate_sid_memcache(struct nss_ctx *nctx,
+                                        struct ldb_message *msg,
+                                        uint32_t id)
+{
+    struct sized_string sid;
+    const char *sid_str;
+    errno_t ret;
+
+    if (nctx->sid_mc_ctx == NULL) {
+        return;
+    }
+
+    sid_str = ldb_msg_find_attr_as_string(msg, SYSDB_SID_STR, NULL);
+    if (sid_str != NULL) {
+        to_sized_string(&sid, sid_str);
+        ret = sss_mmap_cache_sid_invalidate(nctx->sid_mc_ctx, &sid);
+        if (ret != EOK && ret != ENOENT) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Internal failure in memory cache code: %d [%s]\n",
+                  ret, strerror(ret));
+        }
+    }
+
+    ret = sss_mmap_cache_sid_invalidate_id(nctx->sid_mc_ctx, id);
+    if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Internal failure in memory cache code: %d [%s]\n",
+              ret, strerror(ret));
+    }
+}
+
 /****************************************************************************
  * PASSWD db related functions
  ***************************************************************************/
@@ -176,6 +210,10 @@ void nss_update_pw_memcache(struct nss_ctx *nctx)
                       "Internal failure in memory cache code: %d [%s]\n",
                       ret, strerror(ret));
             }
+
+            nss_invalidate_sid_memcache(nctx, res->msgs[i],
+                    sss_view_ldb_msg_find_attr_as_uint64(dom, res->msgs[i],
+                                                         SYSDB_UIDNUM, 0));
         }
 
         talloc_zfree(res);
@@ -525,7 +563,8 @@ static int fill_pwent(struct sss_packet *packet,
             ret = sss_mmap_cache_pw_store(&nctx->pwd_mc_ctx,
                                           &fullname, &pwfield,
                                           uid, gid,
-                                          &gecos, &homedir, &shell);
+                                          &gecos, &homedir, &shell,
+                                          !dom->case_sensitive);
             if (ret != EOK && ret != ENOMEM) {
                 DEBUG(SSSDBG_CRIT_FAILURE,
                       "Failed to store user %s(%s) in mmap cache!\n",
@@ -939,6 +978,15 @@ static int delete_entry_from_memcache(struct sss_domain_info *dom, char *name,
             goto done;
         }
         break;
+    case SSS_MC_SID:
+        ret = sss_mmap_cache_sid_invalidate_name(mc_ctx, &delete_name);
+        if (ret != EOK && ret != ENOENT) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Internal failure in memory cache code: %d [%s]\n",
+                  ret, strerror(ret));
+            goto done;
+        }
+        break;
     default:
         ret = EINVAL;
         goto done;
@@ -1109,6 +1157,7 @@ static int nss_cmd_getpwnam_search(struct nss_dom_ctx *dctx)
             DEBUG(SSSDBG_OP_FAILURE, "No results for getpwnam call\n");
 
             /* User not found in ldb -> delete user from memory cache. */
+            sss_objcache_invalidate(nctx->rctx, dctx->domain);
             ret = delete_entry_from_memcache(dctx->domain, name,
                                              nctx->pwd_mc_ctx, SSS_MC_PASSWD);
             if (ret != EOK) {
@@ -1124,6 +1173,13 @@ static int nss_cmd_getpwnam_search(struct nss_dom_ctx *dctx)
                       "Deleting user from memcache failed.\n");
             }
 
+            ret = delete_entry_from_memcache(dctx->domain, name,
+                                             nctx->sid_mc_ctx, SSS_MC_SID);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_MINOR_FAILURE,
+                      "Deleting user from memcache failed.\n");
+            }
+
             return ENOENT;
         }
 
@@ -1492,7 +1548,8 @@ static int nss_cmd_getbynam(enum sss_cli_command cmd, struct cli_ctx *cctx)
         return EINVAL;
     }
 
-    cmdctx = talloc_zero(cctx, struct nss_cmd_ctx);
+    /* freed by nss_cmd_done() before the request itself */
+    cmdctx = talloc_zero(cctx->creq, struct nss_cmd_ctx);
     if (!cmdctx) {
         return ENOMEM;
     }
@@ -1921,7 +1978,8 @@ static int nss_cmd_getbyid(enum sss_cli_command cmd, struct cli_ctx *cctx)
 
     nctx = talloc_get_type(cctx->rctx->pvt_ctx, struct nss_ctx);
 
-    cmdctx = talloc_zero(cctx, struct nss_cmd_ctx);
+    /* freed by nss_cmd_done() before the request itself */
+    cmdctx = talloc_zero(cctx->creq, struct nss_cmd_ctx);
     if (!cmdctx) {
         return ENOMEM;
     }
@@ -2296,6 +2354,8 @@ static errno_t nss_cmd_setpwent_step(struct setent_step_ctx *step_ctx)
     struct getent_ctx *pctx = step_ctx->getent_ctx;
     struct nss_ctx *nctx = step_ctx->nctx;
     struct ldb_result *res;
+    struct sysdb_enum_cursor *cursor;
+    size_t count;
     struct timeval tv;
     struct tevent_timer *te;
     struct tevent_req *dpreq;
@@ -2358,7 +2418,13 @@ static errno_t nss_cmd_setpwent_step(struct setent_step_ctx *step_ctx)
             }
         }
 
-        ret = sysdb_enumpwent_with_views(dctx, dom, &res);
+        res = NULL;
+        cursor = NULL;
+        if (nctx->enum_cursor) {
+            ret = sysdb_enumpwent_cursor(dctx, dom, &cursor);
+        } else {
+            ret = sysdb_enumpwent_with_views(dctx, dom, &res);
+        }
         if (ret != EOK) {
             DEBUG(SSSDBG_CRIT_FAILURE,
                   "Enum from cache failed, skipping domain [%s]\n",
@@ -2367,7 +2433,8 @@ static errno_t nss_cmd_setpwent_step(struct setent_step_ctx *step_ctx)
             continue;
         }
 
-        if (res->count == 0) {
+        count = cursor != NULL ? sysdb_enum_cursor_count(cursor) : res->count;
+        if (count == 0) {
             DEBUG(SSSDBG_CONF_SETTINGS,
                   "Domain [%s] has no users, skipping.\n", dom->name);
             dom = get_next_domain(dom, SSS_GND_DESCEND);
@@ -2384,6 +2451,7 @@ static errno_t nss_cmd_setpwent_step(struct setent_step_ctx *step_ctx)
 
         nctx->pctx->doms[pctx->num].domain = dctx->domain;
         nctx->pctx->doms[pctx->num].res = talloc_steal(pctx->doms, res);
+        nctx->pctx->doms[pctx->num].cursor = talloc_steal(pctx->doms, cursor);
 
         nctx->pctx->num++;
 
@@ -2558,13 +2626,24 @@ static int nss_cmd_getpwent_immediate(struct nss_cmd_ctx *cmdctx)
     return EOK;
 }
 
+static int nss_dom_ctx_count(struct dom_ctx *dom)
+{
+    if (dom->cursor != NULL) {
+        return sysdb_enum_cursor_count(dom->cursor);
+    }
+
+    return dom->res->count;
+}
+
 static int nss_cmd_retpwent(struct cli_ctx *cctx, int num)
 {
     struct nss_ctx *nctx;
     struct getent_ctx *pctx;
     struct ldb_message **msgs = NULL;
+    struct ldb_result *page = NULL;
     struct dom_ctx *pdom = NULL;
     int n = 0;
+    int k;
     int ret = ENOENT;
 
     nctx = talloc_get_type(cctx->rctx->pvt_ctx, struct nss_ctx);
@@ -2577,11 +2656,11 @@ static int nss_cmd_retpwent(struct cli_ctx *cctx, int num)
 
         pdom = &pctx->doms[cctx->pwent_dom_idx];
 
-        n = pdom->res->count - cctx->pwent_cur;
+        n = nss_dom_ctx_count(pdom) - cctx->pwent_cur;
         if (n <= 0 && (cctx->pwent_dom_idx+1 < pctx->num)) {
             cctx->pwent_dom_idx++;
             pdom = &pctx->doms[cctx->pwent_dom_idx];
-            n = pdom->res->count;
+            n = nss_dom_ctx_count(pdom);
             cctx->pwent_cur = 0;
         }
 
@@ -2589,7 +2668,8 @@ static int nss_cmd_retpwent(struct cli_ctx *cctx, int num)
 
         if (n < 0) {
             DEBUG(SSSDBG_CRIT_FAILURE, "BUG: Negative difference"
-                  "[%d - %d = %d]\n", pdom->res->count, cctx->pwent_cur, n);
+                  "[%d - %d = %d]\n", nss_dom_ctx_count(pdom),
+                  cctx->pwent_cur, n);
             DEBUG(SSSDBG_CRIT_FAILURE, "Domain: %d (total %d)\n",
                                         cctx->pwent_dom_idx, pctx->num);
             break;
@@ -2597,12 +2677,27 @@ static int nss_cmd_retpwent(struct cli_ctx *cctx, int num)
 
         if (n > num) n = num;
 
-        msgs = &(pdom->res->msgs[cctx->pwent_cur]);
+        if (pdom->cursor != NULL) {
+            /* only the current page is kept in memory */
+            ret = sysdb_enum_cursor_read(cctx->creq, pdom->cursor,
+                                         cctx->pwent_cur, n, &page);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE, "Unable to read enumerated users "
+                      "of [%s]\n", pdom->domain->name);
+                break;
+            }
+            msgs = page->msgs;
+            k = page->count;
+        } else {
+            msgs = &(pdom->res->msgs[cctx->pwent_cur]);
+            k = n;
+        }
 
         ret = fill_pwent(cctx->creq->out, pdom->domain, nctx,
-                         true, false, msgs, &n);
+                         true, false, msgs, &k);
+        talloc_zfree(page);
 
-        cctx->pwent_cur += n;
+        cctx->pwent_cur += pdom->cursor != NULL ? n : k;
     }
 
 none:
@@ -2724,6 +2819,10 @@ void nss_update_gr_memcache(struct nss_ctx *nctx)
                       "Internal failure in memory cache code: %d [%s]\n",
                        ret, strerror(ret));
             }
+
+            nss_invalidate_sid_memcache(nctx, res->msgs[i],
+                    sss_view_ldb_msg_find_attr_as_uint64(dom, res->msgs[i],
+                                                         SYSDB_GIDNUM, 0));
         }
         talloc_zfree(res);
     }
@@ -2796,6 +2895,7 @@ static int fill_members(struct sss_packet *packet,
     TALLOC_CTX *tmp_ctx = NULL;
 
     int nlen = 0;
+    size_t reserve;
 
     uint8_t *body;
     size_t blen;
@@ -2809,6 +2909,20 @@ static int fill_members(struct sss_packet *packet,
         return ENOMEM;
     }
 
+    /* make room for all the members at once instead of growing the
+     * packet name by name, large groups would be copied over and over */
+    reserve = 0;
+    for (i = 0; i < el->num_values; i++) {
+        reserve += el->values[i].length + 1;
+        if (dom->fqnames) {
+            reserve += strlen(domain) + 1;
+        }
+    }
+    ret = sss_packet_reserve(packet, reserve);
+    if (ret != EOK) {
+        goto done;
+    }
+
     sss_packet_get_body(packet, &body, &blen);
     for (i = 0; i < el->num_values; i++) {
         tmpstr = sss_get_cased_name(tmp_ctx, (char *)el->values[i].data,
@@ -3287,6 +3401,7 @@ static int nss_cmd_getgrnam_search(struct nss_dom_ctx *dctx)
             DEBUG(SSSDBG_OP_FAILURE, "No results for getgrnam call\n");
 
             /* Group not found in ldb -> delete group from memory cache. */
+            sss_objcache_invalidate(nctx->rctx, dctx->domain);
             ret = delete_entry_from_memcache(dctx->domain, name,
                                              nctx->grp_mc_ctx, SSS_MC_GROUP);
             if (ret != EOK) {
@@ -3294,6 +3409,13 @@ static int nss_cmd_getgrnam_search(struct nss_dom_ctx *dctx)
                       "Deleting group from memcache failed.\n");
             }
 
+            ret = delete_entry_from_memcache(dctx->domain, name,
+                                             nctx->sid_mc_ctx, SSS_MC_SID);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_MINOR_FAILURE,
+                      "Deleting group from memcache failed.\n");
+            }
+
 
             return ENOENT;
         }
@@ -3659,6 +3781,8 @@ static errno_t nss_cmd_setgrent_step(struct setent_step_ctx *step_ctx)
     struct getent_ctx *gctx = step_ctx->getent_ctx;
     struct nss_ctx *nctx = step_ctx->nctx;
     struct ldb_result *res;
+    struct sysdb_enum_cursor *cursor;
+    size_t count;
     struct timeval tv;
     struct tevent_timer *te;
     struct tevent_req *dpreq;
@@ -3721,7 +3845,13 @@ static errno_t nss_cmd_setgrent_step(struct setent_step_ctx *step_ctx)
             }
         }
 
-        ret = sysdb_enumgrent_with_views(dctx, dom, &res);
+        res = NULL;
+        cursor = NULL;
+        if (nctx->enum_cursor) {
+            ret = sysdb_enumgrent_cursor(dctx, dom, &cursor);
+        } else {
+            ret = sysdb_enumgrent_with_views(dctx, dom, &res);
+        }
         if (ret != EOK) {
             DEBUG(SSSDBG_CRIT_FAILURE,
                   "Enum from cache failed, skipping domain [%s]\n",
@@ -3730,7 +3860,8 @@ static errno_t nss_cmd_setgrent_step(struct setent_step_ctx *step_ctx)
             continue;
         }
 
-        if (res->count == 0) {
+        count = cursor != NULL ? sysdb_enum_cursor_count(cursor) : res->count;
+        if (count == 0) {
             DEBUG(SSSDBG_CONF_SETTINGS,
                   "Domain [%s] has no groups, skipping.\n", dom->name);
             dom = get_next_domain(dom, SSS_GND_DESCEND);
@@ -3747,6 +3878,7 @@ static errno_t nss_cmd_setgrent_step(struct setent_step_ctx *step_ctx)
 
         nctx->gctx->doms[gctx->num].domain = dctx->domain;
         nctx->gctx->doms[gctx->num].res = talloc_steal(gctx->doms, res);
+        nctx->gctx->doms[gctx->num].cursor = talloc_steal(gctx->doms, cursor);
 
         nctx->gctx->num++;
 
@@ -3851,13 +3983,82 @@ static void nss_cmd_setgrent_done(struct tevent_req *req)
     nss_cmd_done(cmdctx, ret);
 }
 
+/* Groups with many members make a getgrent reply expensive to build, the
+ * number of groups returned at once is limited so that the client asks for
+ * the next ones in a new request and other requests are served meanwhile. */
+#define NSS_GRENT_SLICE_MEMBERS 10000
+
+static int nss_grent_slice(struct sss_domain_info *dom,
+                           struct ldb_message **msgs, int num)
+{
+    struct ldb_message_element *el;
+    unsigned int members = 0;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        el = sss_view_ldb_msg_find_element(dom, msgs[i], SYSDB_MEMBERUID);
+        if (el != NULL) {
+            members += el->num_values;
+        }
+        el = ldb_msg_find_element(msgs[i], SYSDB_GHOST);
+        if (el != NULL) {
+            members += el->num_values;
+        }
+
+        if (members > NSS_GRENT_SLICE_MEMBERS) {
+            break;
+        }
+    }
+
+    /* always return at least one group */
+    return i > 0 ? i : 1;
+}
+
+/* Read the next page of groups through the cursor, @_n is the number of
+ * groups to read and is reduced to the number of groups consumed if the
+ * page has to be sliced. */
+static errno_t nss_grent_read_page(TALLOC_CTX *mem_ctx,
+                                   struct dom_ctx *gdom,
+                                   int cur, int *_n,
+                                   struct ldb_result **_page)
+{
+    struct ldb_result *page;
+    int n = *_n;
+    int k;
+    errno_t ret;
+
+    ret = sysdb_enum_cursor_read(mem_ctx, gdom->cursor, cur, n, &page);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    k = nss_grent_slice(gdom->domain, page->msgs, page->count);
+    if ((unsigned int)k < page->count) {
+        /* groups removed from the cache meanwhile are missing in the page,
+         * so read the first k entries of the cursor again to know exactly
+         * how far it advanced */
+        talloc_free(page);
+        n = k;
+        ret = sysdb_enum_cursor_read(mem_ctx, gdom->cursor, cur, n, &page);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    *_n = n;
+    *_page = page;
+    return EOK;
+}
+
 static int nss_cmd_retgrent(struct cli_ctx *cctx, int num)
 {
     struct nss_ctx *nctx;
     struct getent_ctx *gctx;
     struct ldb_message **msgs = NULL;
+    struct ldb_result *page = NULL;
     struct dom_ctx *gdom = NULL;
     int n = 0;
+    int k;
     int ret = ENOENT;
 
     nctx = talloc_get_type(cctx->rctx->pvt_ctx, struct nss_ctx);
@@ -3870,11 +4071,11 @@ static int nss_cmd_retgrent(struct cli_ctx *cctx, int num)
 
         gdom = &gctx->doms[cctx->grent_dom_idx];
 
-        n = gdom->res->count - cctx->grent_cur;
+        n = nss_dom_ctx_count(gdom) - cctx->grent_cur;
         if (n <= 0 && (cctx->grent_dom_idx+1 < gctx->num)) {
             cctx->grent_dom_idx++;
             gdom = &gctx->doms[cctx->grent_dom_idx];
-            n = gdom->res->count;
+            n = nss_dom_ctx_count(gdom);
             cctx->grent_cur = 0;
         }
 
@@ -3882,13 +4083,28 @@ static int nss_cmd_retgrent(struct cli_ctx *cctx, int num)
 
         if (n > num) n = num;
 
-        msgs = &(gdom->res->msgs[cctx->grent_cur]);
+        if (gdom->cursor != NULL) {
+            ret = nss_grent_read_page(cctx->creq, gdom, cctx->grent_cur,
+                                      &n, &page);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE, "Unable to read enumerated groups "
+                      "of [%s]\n", gdom->domain->name);
+                break;
+            }
+            msgs = page->msgs;
+            k = page->count;
+        } else {
+            msgs = &(gdom->res->msgs[cctx->grent_cur]);
+            n = nss_grent_slice(gdom->domain, msgs, n);
+            k = n;
+        }
 
         ret = fill_grent(cctx->creq->out,
                          gdom->domain,
-                         nctx, true, false, msgs, &n);
+                         nctx, true, false, msgs, &k);
+        talloc_zfree(page);
 
-        cctx->grent_cur += n;
+        cctx->grent_cur += gdom->cursor != NULL ? n : k;
     }
 
 none:
@@ -4055,6 +4271,9 @@ void nss_update_initgr_memcache(struct nss_ctx *nctx,
         return;
     }
 
+    /* the groups of the user were changed by the provider */
+    sss_objcache_invalidate(nctx->rctx, dom);
+
     tmp_ctx = talloc_new(NULL);
 
     ret = sysdb_initgroups(tmp_ctx, dom, name, &res);
@@ -4079,6 +4298,14 @@ void nss_update_initgr_memcache(struct nss_ctx *nctx,
                   ret, strerror(ret));
         }
 
+        ret = sss_mmap_cache_sid_invalidate_name(nctx->sid_mc_ctx,
+                                                 &delete_name);
+        if (ret != EOK && ret != ENOENT && ret != EINVAL) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Internal failure in memory cache code: %d [%s]\n",
+                  ret, strerror(ret));
+        }
+
         /* Also invalidate his groups */
         changed = true;
     } else {
@@ -4132,6 +4359,13 @@ void nss_update_initgr_memcache(struct nss_ctx *nctx,
                       "Internal failure in memory cache code: %d [%s]\n",
                        ret, strerror(ret));
             }
+
+            ret = sss_mmap_cache_sid_invalidate_id(nctx->sid_mc_ctx, id);
+            if (ret != EOK && ret != ENOENT && ret != EINVAL) {
+                DEBUG(SSSDBG_CRIT_FAILURE,
+                      "Internal failure in memory cache code: %d [%s]\n",
+                       ret, strerror(ret));
+            }
         }
 
         to_sized_string(&delete_name, fq_name);
@@ -4148,113 +4382,182 @@ done:
     talloc_free(tmp_ctx);
 }
 
-/* FIXME: what about mpg, should we return the user's GID ? */
-/* FIXME: should we filter out GIDs ? */
-static int fill_initgr(struct sss_packet *packet,
-                       struct sss_domain_info *dom,
-                       struct ldb_result *res,
-                       struct nss_ctx *nctx,
-                       const char *mc_name,
-                       const char *name)
+static int nss_gid_cmp(const void *a, const void *b)
 {
-    uint8_t *body;
-    size_t blen;
+    uint32_t ga = *(const uint32_t *)a;
+    uint32_t gb = *(const uint32_t *)b;
+
+    return (ga > gb) - (ga < gb);
+}
+
+/* Sorts the GIDs and removes the duplicates in place, returns the new number
+ * of GIDs */
+static size_t nss_sort_uniq_gids(uint32_t *gids, size_t num)
+{
+    size_t i;
+    size_t n;
+
+    if (num < 2) {
+        return num;
+    }
+
+    qsort(gids, num, sizeof(uint32_t), nss_gid_cmp);
+
+    for (i = 1, n = 1; i < num; i++) {
+        if (gids[i] != gids[n - 1]) {
+            gids[n++] = gids[i];
+        }
+    }
+
+    return n;
+}
+
+/* Extracts the GIDs of the groups of the user into a single array which is
+ * used for both the reply and the memory cache. The GID of the original
+ * primary group is added unless it is the current primary GID, the result
+ * is sorted and free of duplicates. */
+static errno_t nss_initgr_get_gids(TALLOC_CTX *mem_ctx,
+                                   struct sss_domain_info *dom,
+                                   struct ldb_result *res,
+                                   const gid_t *initgr_gids,
+                                   size_t num_initgr_gids,
+                                   uint32_t **_gids,
+                                   size_t *_num_gids)
+{
+    uint32_t *gids;
+    size_t num;
+    size_t n = 0;
+    size_t i;
     gid_t gid;
-    int ret, i;
-    uint32_t num;
-    size_t bindex;
-    int skipped = 0;
-    const char *posix;
     gid_t orig_primary_gid;
-    struct sized_string rawname;
-    uint8_t *gids;
+    const char *posix;
 
-    if (res->count == 0) {
-        return ENOENT;
+    if (initgr_gids != NULL) {
+        num = num_initgr_gids;
+    } else {
+        /* one less, the first one is the user entry */
+        num = res->count - 1;
+    }
+
+    /* room for the original primary GID as well */
+    gids = talloc_array(mem_ctx, uint32_t, num + 1);
+    if (gids == NULL) {
+        return ENOMEM;
     }
 
-    /* one less, the first one is the user entry */
-    num = res->count -1;
+    if (initgr_gids != NULL) {
+        /* only the POSIX groups are stored */
+        if (sizeof(gid_t) == sizeof(uint32_t)) {
+            memcpy(gids, initgr_gids, num * sizeof(uint32_t));
+        } else {
+            for (i = 0; i < num; i++) {
+                gids[i] = initgr_gids[i];
+            }
+        }
+        n = num;
+    } else {
+        for (i = 0; i < num; i++) {
+            /* skip first entry, it's the user entry */
+            gid = sss_view_ldb_msg_find_attr_as_uint64(dom, res->msgs[i + 1],
+                                                       SYSDB_GIDNUM, 0);
+            if (gid == 0) {
+                posix = ldb_msg_find_attr_as_string(res->msgs[i + 1],
+                                                    SYSDB_POSIX, NULL);
+                if (posix != NULL && strcmp(posix, "FALSE") == 0) {
+                    continue;
+                }
 
-    ret = sss_packet_grow(packet, (2 + res->count) * sizeof(uint32_t));
-    if (ret != EOK) {
-        return ret;
+                DEBUG(SSSDBG_CRIT_FAILURE,
+                      "Incomplete group object for initgroups! Aborting\n");
+                talloc_free(gids);
+                return EFAULT;
+            }
+            gids[n++] = gid;
+        }
     }
-    sss_packet_get_body(packet, &body, &blen);
 
     orig_primary_gid = sss_view_ldb_msg_find_attr_as_uint64(dom, res->msgs[0],
                                                      SYSDB_PRIMARY_GROUP_GIDNUM,
                                                      0);
 
     /* If the GID of the original primary group is available but equal to the
-    * current primary GID it must not be added. */
+     * current primary GID it must not be added. If the user is an explicit
+     * member of the group it is removed with the other duplicates. */
     if (orig_primary_gid != 0) {
         gid = sss_view_ldb_msg_find_attr_as_uint64(dom, res->msgs[0],
                                                    SYSDB_GIDNUM, 0);
-
-        if (orig_primary_gid == gid) {
-            orig_primary_gid = 0;
+        if (orig_primary_gid != gid) {
+            gids[n++] = orig_primary_gid;
         }
     }
 
-    /* 0-3: 32bit unsigned number of results
-     * 4-7: 32bit unsigned (reserved/padding) */
-    bindex = 2 * sizeof(uint32_t);
-    gids = body + bindex;
+    *_num_gids = nss_sort_uniq_gids(gids, n);
+    *_gids = gids;
+    return EOK;
+}
 
-    /* skip first entry, it's the user entry */
-    for (i = 0; i < num; i++) {
-        gid = sss_view_ldb_msg_find_attr_as_uint64(dom, res->msgs[i + 1],
-                                                   SYSDB_GIDNUM, 0);
-        posix = ldb_msg_find_attr_as_string(res->msgs[i + 1],
-                                            SYSDB_POSIX, NULL);
-        if (!gid) {
-            if (posix && strcmp(posix, "FALSE") == 0) {
-                skipped++;
-                continue;
-            } else {
-                DEBUG(SSSDBG_CRIT_FAILURE,
-                      "Incomplete group object for initgroups! Aborting\n");
-                return EFAULT;
-            }
-        }
-        SAFEALIGN_COPY_UINT32(body + bindex, &gid, &bindex);
+/* FIXME: what about mpg, should we return the user's GID ? */
+/* FIXME: should we filter out GIDs ? */
+static int fill_initgr(struct sss_packet *packet,
+                       struct sss_domain_info *dom,
+                       struct ldb_result *res,
+                       const gid_t *initgr_gids,
+                       size_t num_initgr_gids,
+                       struct nss_ctx *nctx,
+                       const char *mc_name,
+                       const char *name)
+{
+    TALLOC_CTX *tmp_ctx;
+    uint8_t *body;
+    size_t blen;
+    int ret;
+    uint32_t *gids;
+    size_t num;
+    struct sized_string rawname;
+    struct sized_string unique_name;
+    char *fq_name;
 
-        /* do not add the GID of the original primary group is the user is
-         * already and explicit member of the group. */
-        if (orig_primary_gid == gid) {
-            orig_primary_gid = 0;
-        }
+    if (res->count == 0) {
+        return ENOENT;
     }
 
-    if (orig_primary_gid != 0) {
-        SAFEALIGN_COPY_UINT32(body + bindex, &orig_primary_gid, &bindex);
-        num++;
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
     }
 
-    SAFEALIGN_SETMEM_UINT32(body, num - skipped, NULL); /* num results */
-    SAFEALIGN_SETMEM_UINT32(body + sizeof(uint32_t), 0, NULL); /* reserved */
-    blen = bindex;
-    ret = sss_packet_set_size(packet, blen);
+    ret = nss_initgr_get_gids(tmp_ctx, dom, res, initgr_gids,
+                              num_initgr_gids, &gids, &num);
     if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE,
-              "Could not set packet size to value:%zu\n", blen);
-        return ret;
+        goto done;
     }
 
+    /* 0-3: 32bit unsigned number of results
+     * 4-7: 32bit unsigned (reserved/padding) */
+    ret = sss_packet_grow(packet, (2 + num) * sizeof(uint32_t));
+    if (ret != EOK) {
+        goto done;
+    }
+    sss_packet_get_body(packet, &body, &blen);
+
+    SAFEALIGN_SETMEM_UINT32(body, num, NULL); /* num results */
+    SAFEALIGN_SETMEM_UINT32(body + sizeof(uint32_t), 0, NULL); /* reserved */
+    memcpy(body + 2 * sizeof(uint32_t), gids, num * sizeof(uint32_t));
+
     if (nctx->initgr_mc_ctx) {
-        struct sized_string unique_name;
-        char *fq_name = sss_tc_fqname(packet, dom->names, dom, name);
+        fq_name = sss_tc_fqname(tmp_ctx, dom->names, dom, name);
         if (!fq_name) {
             DEBUG(SSSDBG_CRIT_FAILURE,
                   "Could not create fq name\n");
-            return ENOMEM;
+            ret = ENOMEM;
+            goto done;
         }
 
         to_sized_string(&rawname, mc_name);
         to_sized_string(&unique_name, fq_name);
         ret = sss_mmap_cache_initgr_store(&nctx->initgr_mc_ctx, &rawname,
-                                          &unique_name, num - skipped, gids);
+                                          &unique_name, num,
+                                          (uint8_t *) gids);
         if (ret != EOK && ret != ENOMEM) {
             DEBUG(SSSDBG_CRIT_FAILURE,
                   "Failed to store user %s(%s) in mmap cache!\n",
@@ -4262,7 +4565,11 @@ static int fill_initgr(struct sss_packet *packet,
         }
     }
 
-    return EOK;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
 }
 
 static int nss_cmd_initgr_send_reply(struct nss_dom_ctx *dctx)
@@ -4281,7 +4588,8 @@ static int nss_cmd_initgr_send_reply(struct nss_dom_ctx *dctx)
         return EFAULT;
     }
 
-    ret = fill_initgr(cctx->creq->out, dctx->domain, dctx->res, nctx,
+    ret = fill_initgr(cctx->creq->out, dctx->domain, dctx->res,
+                      dctx->initgr_gids, dctx->num_initgr_gids, nctx,
                       dctx->mc_name, cmdctx->normalized_name);
     if (ret) {
         return ret;
@@ -4370,6 +4678,9 @@ static int nss_cmd_initgroups_search(struct nss_dom_ctx *dctx)
             return EIO;
         }
 
+        talloc_zfree(dctx->initgr_gids);
+        dctx->num_initgr_gids = 0;
+
         if (cmdctx->name_is_upn) {
             ret = sysdb_search_user_by_upn(cmdctx, dom, name, user_attrs, &msg);
             if (ret == ENOENT) {
@@ -4407,7 +4718,15 @@ static int nss_cmd_initgroups_search(struct nss_dom_ctx *dctx)
                 }
             }
         } else {
-            ret = sysdb_initgroups_with_views(cmdctx, dom, name, &dctx->res);
+            /* a single read of the user entry if the provider stored the
+             * groups with it */
+            ret = sysdb_initgroups_gids(cmdctx, dom, name, &dctx->res,
+                                        &dctx->initgr_gids,
+                                        &dctx->num_initgr_gids);
+            if (ret == ENOENT) {
+                ret = sysdb_initgroups_with_views(cmdctx, dom, name,
+                                                  &dctx->res);
+            }
         }
         if (ret != EOK) {
             DEBUG(SSSDBG_CRIT_FAILURE,
@@ -5140,22 +5459,16 @@ done:
     return ret;
 }
 
-static errno_t fill_name(struct sss_packet *packet,
-                         struct sss_domain_info *dom,
-                         enum sss_id_type id_type,
-                         bool apply_no_view,
-                         struct ldb_message *msg)
+static errno_t get_reply_name(TALLOC_CTX *mem_ctx,
+                              struct sss_domain_info *dom,
+                              bool apply_no_view,
+                              struct ldb_message *msg,
+                              const char **_name)
 {
-    int ret;
-    TALLOC_CTX *tmp_ctx = NULL;
     const char *orig_name = NULL;
     const char *cased_name;
     const char *fq_name;
-    struct sized_string name;
     bool add_domain = (!IS_SUBDOMAIN(dom) && dom->fqnames);
-    uint8_t *body;
-    size_t blen;
-    size_t pctr = 0;
 
     if (apply_no_view) {
         orig_name = ldb_msg_find_attr_as_string(msg,
@@ -5181,41 +5494,62 @@ static errno_t fill_name(struct sss_packet *packet,
         return EINVAL;
     }
 
-    tmp_ctx = talloc_new(NULL);
-    if (tmp_ctx == NULL) {
-        DEBUG(SSSDBG_OP_FAILURE, "talloc_new failed.\n");
-        return ENOMEM;
-    }
-
-    cased_name= sss_get_cased_name(tmp_ctx, orig_name, dom->case_sensitive);
+    cased_name= sss_get_cased_name(mem_ctx, orig_name, dom->case_sensitive);
     if (cased_name == NULL) {
         DEBUG(SSSDBG_OP_FAILURE, "sss_get_cased_name failed.\n");
-        ret = ENOMEM;
-        goto done;
+        return ENOMEM;
     }
 
     if (add_domain) {
-        fq_name = sss_tc_fqname(tmp_ctx, dom->names, dom, cased_name);
+        fq_name = sss_tc_fqname(mem_ctx, dom->names, dom, cased_name);
         if (fq_name == NULL) {
             DEBUG(SSSDBG_OP_FAILURE, "talloc_asprintf failed.\n");
-            ret = ENOMEM;
-            goto done;
+            return ENOMEM;
         }
-        to_sized_string(&name, fq_name);
+        *_name = fq_name;
     } else {
-        to_sized_string(&name, cased_name);
+        *_name = cased_name;
     }
 
-    ret = sss_packet_grow(packet, name.len + 3 * sizeof(uint32_t));
-    if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "sss_packet_grow failed.\n");
-        goto done;
-    }
+    return EOK;
+}
 
-    sss_packet_get_body(packet, &body, &blen);
-    SAFEALIGN_SETMEM_UINT32(body, 1, &pctr); /* Num results */
-    SAFEALIGN_SETMEM_UINT32(body + pctr, 0, &pctr); /* reserved */
-    SAFEALIGN_COPY_UINT32(body + pctr, &id_type, &pctr);
+static errno_t fill_name(struct sss_packet *packet,
+                         struct sss_domain_info *dom,
+                         enum sss_id_type id_type,
+                         bool apply_no_view,
+                         struct ldb_message *msg)
+{
+    int ret;
+    TALLOC_CTX *tmp_ctx = NULL;
+    const char *reply_name;
+    struct sized_string name;
+    uint8_t *body;
+    size_t blen;
+    size_t pctr = 0;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "talloc_new failed.\n");
+        return ENOMEM;
+    }
+
+    ret = get_reply_name(tmp_ctx, dom, apply_no_view, msg, &reply_name);
+    if (ret != EOK) {
+        goto done;
+    }
+    to_sized_string(&name, reply_name);
+
+    ret = sss_packet_grow(packet, name.len + 3 * sizeof(uint32_t));
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "sss_packet_grow failed.\n");
+        goto done;
+    }
+
+    sss_packet_get_body(packet, &body, &blen);
+    SAFEALIGN_SETMEM_UINT32(body, 1, &pctr); /* Num results */
+    SAFEALIGN_SETMEM_UINT32(body + pctr, 0, &pctr); /* reserved */
+    SAFEALIGN_COPY_UINT32(body + pctr, &id_type, &pctr);
     memcpy(&body[pctr], name.str, name.len);
 
 
@@ -5227,16 +5561,11 @@ done:
     return ret;
 }
 
-static errno_t fill_id(struct sss_packet *packet,
-                       enum sss_id_type id_type,
-                       struct ldb_message *msg)
+static errno_t get_reply_id(enum sss_id_type id_type,
+                            struct ldb_message *msg,
+                            uint32_t *_id)
 {
-    int ret;
-    uint8_t *body;
-    size_t blen;
-    size_t pctr = 0;
     uint64_t tmp_id;
-    uint32_t id;
 
     if (id_type == SSS_ID_TYPE_GID) {
         tmp_id = ldb_msg_find_attr_as_uint64(msg, SYSDB_GIDNUM, 0);
@@ -5245,10 +5574,28 @@ static errno_t fill_id(struct sss_packet *packet,
     }
 
     if (tmp_id == 0 || tmp_id >= UINT32_MAX) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid POSIX ID.\n");
         return EINVAL;
     }
-    id = (uint32_t) tmp_id;
+
+    *_id = (uint32_t) tmp_id;
+    return EOK;
+}
+
+static errno_t fill_id(struct sss_packet *packet,
+                       enum sss_id_type id_type,
+                       struct ldb_message *msg)
+{
+    int ret;
+    uint8_t *body;
+    size_t blen;
+    size_t pctr = 0;
+    uint32_t id;
+
+    ret = get_reply_id(id_type, msg, &id);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid POSIX ID.\n");
+        return ret;
+    }
 
     ret = sss_packet_grow(packet, 4 * sizeof(uint32_t));
     if (ret != EOK) {
@@ -5265,10 +5612,94 @@ static errno_t fill_id(struct sss_packet *packet,
     return EOK;
 }
 
+/* Store the translation in the SID memory cache so that libsss_nss_idmap
+ * can resolve it without contacting the responder. Only objects whose
+ * name resolves back to the same object are stored: with views or when the
+ * original AD name differs the name returned by GETNAMEBYSID would not be
+ * the one expected by GETSIDBYNAME, and short names are only unambiguous in
+ * the first domain, which is always searched first. */
+static void nss_update_sid_memcache(struct nss_ctx *nctx,
+                                    struct sss_domain_info *dom,
+                                    enum sss_cli_command cmd,
+                                    struct ldb_message *msg,
+                                    enum sss_id_type id_type)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char *sid_str;
+    const char *name_str;
+    const char *view_name;
+    struct sized_string sid;
+    struct sized_string name;
+    uint32_t id;
+    errno_t ret;
+
+    if (nctx->sid_mc_ctx == NULL) {
+        return;
+    }
+
+    if (DOM_HAS_VIEWS(dom)) {
+        return;
+    }
+
+    if (!IS_SUBDOMAIN(dom) && !dom->fqnames && dom != nctx->rctx->domains) {
+        return;
+    }
+
+    sid_str = ldb_msg_find_attr_as_string(msg, SYSDB_SID_STR, NULL);
+    if (sid_str == NULL) {
+        return;
+    }
+
+    ret = get_reply_id(id_type, msg, &id);
+    if (ret != EOK) {
+        /* not a POSIX object */
+        return;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return;
+    }
+
+    ret = get_reply_name(tmp_ctx, dom, true, msg, &name_str);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = get_reply_name(tmp_ctx, dom, false, msg, &view_name);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (strcmp(name_str, view_name) != 0) {
+        goto done;
+    }
+
+    to_sized_string(&sid, sid_str);
+    to_sized_string(&name, name_str);
+
+    ret = sss_mmap_cache_sid_store(&nctx->sid_mc_ctx, &sid, &name, id,
+                                   id_type, false);
+    if (ret == EOK && cmd == SSS_NSS_GETSIDBYID) {
+        /* the ID was resolved with the responder's precedence, it is safe
+         * to answer the same lookup from the cache */
+        ret = sss_mmap_cache_sid_store(&nctx->sid_mc_ctx, &sid, &name, id,
+                                       id_type, true);
+    }
+    if (ret != EOK && ret != ENOMEM) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to store SID %s in mmap cache!\n", sid_str);
+    }
+
+done:
+    talloc_free(tmp_ctx);
+}
+
 static errno_t nss_cmd_getbysid_send_reply(struct nss_dom_ctx *dctx)
 {
     struct nss_cmd_ctx *cmdctx = dctx->cmdctx;
     struct cli_ctx *cctx = cmdctx->cctx;
+    struct nss_ctx *nctx;
     int ret;
     enum sss_id_type id_type;
 
@@ -5318,17 +5749,54 @@ static errno_t nss_cmd_getbysid_send_reply(struct nss_dom_ctx *dctx)
         return ret;
     }
 
+    if (cmdctx->cmd != SSS_NSS_GETORIGBYNAME) {
+        nctx = talloc_get_type(cctx->rctx->pvt_ctx, struct nss_ctx);
+        nss_update_sid_memcache(nctx, dctx->domain, cmdctx->cmd,
+                                dctx->res->msgs[0], id_type);
+    }
+
     sss_packet_set_error(cctx->creq->out, EOK);
     sss_cmd_done(cctx, cmdctx);
     return EOK;
 }
 
-static int nss_check_well_known_sid(struct nss_cmd_ctx *cmdctx)
+/* Returns ENOENT if the SID is not a Well-Known SID */
+static errno_t nss_well_known_sid_name(TALLOC_CTX *mem_ctx,
+                                       struct nss_ctx *nctx,
+                                       const char *sid,
+                                       const char **_name)
 {
     const char *wk_name;
     const char *wk_dom_name;
+    char *fq_name;
+    errno_t ret;
+
+    ret = well_known_sid_to_name(sid, &wk_dom_name, &wk_name);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_TRACE_ALL, "SID [%s] is not a Well-Known SID.\n", sid);
+        return ret;
+    }
+
+    if (wk_dom_name == NULL) {
+        *_name = wk_name;
+        return EOK;
+    }
+
+    fq_name = sss_tc_fqname2(mem_ctx, nctx->global_names,
+                             wk_dom_name, wk_dom_name, wk_name);
+    if (fq_name == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "sss_tc_fqname2 failed.\n");
+        return ENOMEM;
+    }
+
+    *_name = fq_name;
+    return EOK;
+}
+
+static int nss_check_well_known_sid(struct nss_cmd_ctx *cmdctx)
+{
+    const char *wk_name;
     int ret;
-    char *fq_name = NULL;
     struct sized_string name;
     uint8_t *body;
     size_t blen;
@@ -5336,10 +5804,11 @@ static int nss_check_well_known_sid(struct nss_cmd_ctx *cmdctx)
     struct nss_ctx *nss_ctx;
     size_t pctr = 0;
 
-    ret = well_known_sid_to_name(cmdctx->secid, &wk_dom_name, &wk_name);
+    cctx = cmdctx->cctx;
+    nss_ctx = talloc_get_type(cctx->rctx->pvt_ctx, struct nss_ctx);
+
+    ret = nss_well_known_sid_name(cmdctx, nss_ctx, cmdctx->secid, &wk_name);
     if (ret != EOK) {
-        DEBUG(SSSDBG_TRACE_ALL, "SID [%s] is not a Well-Known SID.\n",
-                                 cmdctx->secid);
         return ret;
     }
 
@@ -5349,25 +5818,12 @@ static int nss_check_well_known_sid(struct nss_cmd_ctx *cmdctx)
         return EINVAL;
     }
 
-    if (wk_dom_name != NULL) {
-        nss_ctx = talloc_get_type(cmdctx->cctx->rctx->pvt_ctx, struct nss_ctx);
-        fq_name = sss_tc_fqname2(cmdctx, nss_ctx->global_names,
-                                 wk_dom_name, wk_dom_name, wk_name);
-        if (fq_name == NULL) {
-            DEBUG(SSSDBG_OP_FAILURE, "sss_tc_fqname2 failed.\n");
-            return ENOMEM;
-        }
-        to_sized_string(&name, fq_name);
-    } else {
-        to_sized_string(&name, wk_name);
-    }
+    to_sized_string(&name, wk_name);
 
-    cctx = cmdctx->cctx;
     ret = sss_packet_new(cctx->creq, name.len + 3 * sizeof(uint32_t),
                          sss_packet_get_cmd(cctx->creq->in),
                          &cctx->creq->out);
     if (ret != EOK) {
-        talloc_free(fq_name);
         return ENOMEM;
     }
 
@@ -5403,7 +5859,8 @@ static int nss_cmd_getbysid(enum sss_cli_command cmd, struct cli_ctx *cctx)
         return EINVAL;
     }
 
-    cmdctx = talloc_zero(cctx, struct nss_cmd_ctx);
+    /* freed by nss_cmd_done() before the request itself */
+    cmdctx = talloc_zero(cctx->creq, struct nss_cmd_ctx);
     if (!cmdctx) {
         return ENOMEM;
     }
@@ -5521,6 +5978,621 @@ static int nss_cmd_getorigbyname(struct cli_ctx *cctx)
     return nss_cmd_getbynam(SSS_NSS_GETORIGBYNAME, cctx);
 }
 
+/****************************************************************************
+ * Batched lookups
+ ***************************************************************************/
+
+struct nss_batch_ctx;
+
+struct nss_batch_item {
+    struct nss_batch_ctx *batch;
+
+    enum sss_cli_command cmd;
+    const char *name;           /* name or SID */
+    uint32_t id;
+
+    errno_t ret;
+    struct ldb_result *result;
+    struct sss_domain_info *domain;
+    const char *wk_name;        /* name of a Well-Known SID */
+};
+
+struct nss_batch_ctx {
+    struct cli_ctx *cctx;
+    struct nss_ctx *nctx;
+
+    struct nss_batch_item *items;
+    uint32_t num_items;
+    uint32_t pending;
+};
+
+static void nss_cmd_getbatch_done(struct tevent_req *req);
+static void nss_cmd_getbatch_sid_done(struct tevent_req *req);
+static errno_t nss_cmd_getbatch_send_reply(struct nss_batch_ctx *batch);
+
+/* Looks up an object by SID the way nss_cmd_getbysid() does, but without
+ * replying to the client, so that many of them can run in parallel. */
+struct nss_batch_sid_state {
+    struct nss_ctx *nctx;
+    const char *sid;
+    struct sss_domain_info *domain;
+    struct ldb_result *result;
+};
+
+static void nss_batch_sid_dp_done(struct tevent_req *subreq);
+
+static errno_t nss_batch_sid_search(struct nss_batch_sid_state *state)
+{
+    errno_t ret;
+
+    talloc_zfree(state->result);
+    ret = sysdb_search_object_by_sid(state, state->domain, state->sid, NULL,
+                                     &state->result);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (state->result->count > 1) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "getbysid call returned more than one result !?!\n");
+        return ENOENT;
+    }
+
+    return EOK;
+}
+
+static struct tevent_req *nss_batch_sid_send(TALLOC_CTX *mem_ctx,
+                                             struct tevent_context *ev,
+                                             struct nss_ctx *nctx,
+                                             const char *sid)
+{
+    struct nss_batch_sid_state *state;
+    struct tevent_req *req;
+    struct tevent_req *subreq;
+    uint64_t cache_expire;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct nss_batch_sid_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->nctx = nctx;
+    state->sid = sid;
+
+    ret = responder_get_domain_by_id(nctx->rctx, sid, &state->domain);
+    if (ret == EAGAIN) {
+        /* unknown subdomains are only looked up by single requests */
+        ret = ENOENT;
+    }
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    ret = sss_ncache_check_sid(nctx->ncache, nctx->neg_timeout, sid);
+    if (ret == EEXIST) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "SID [%s] does not exist! (negative cache)\n", sid);
+        ret = ENOENT;
+        goto immediately;
+    }
+
+    ret = nss_batch_sid_search(state);
+    if (ret != EOK && ret != ENOENT) {
+        goto immediately;
+    }
+
+    if (!NEED_CHECK_PROVIDER(state->domain->provider)) {
+        goto immediately;
+    }
+
+    if (ret == EOK) {
+        cache_expire = ldb_msg_find_attr_as_uint64(state->result->msgs[0],
+                                                   SYSDB_CACHE_EXPIRE, 0);
+        ret = sss_cmd_check_cache(state->result->msgs[0],
+                                  nctx->cache_refresh_percent, cache_expire);
+        if (ret == EAGAIN) {
+            /* midpoint refresh, nobody waits for it */
+            subreq = sss_dp_get_account_send(nctx, nctx->rctx,
+                                             state->domain, true,
+                                             SSS_DP_SECID, sid, 0, NULL);
+            talloc_free(subreq);
+            ret = EOK;
+        }
+        if (ret != ENOENT) {
+            goto immediately;
+        }
+    }
+
+    subreq = sss_dp_get_account_send(state, nctx->rctx, state->domain, true,
+                                     SSS_DP_SECID, sid, 0, NULL);
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+    tevent_req_set_callback(subreq, nss_batch_sid_dp_done, req);
+
+    return req;
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+
+    return req;
+}
+
+static void nss_batch_sid_dp_done(struct tevent_req *subreq)
+{
+    struct nss_batch_sid_state *state;
+    struct tevent_req *req;
+    dbus_uint16_t err_maj;
+    dbus_uint32_t err_min;
+    char *err_msg;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct nss_batch_sid_state);
+
+    ret = sss_dp_get_account_recv(state, subreq, &err_maj, &err_min,
+                                  &err_msg);
+    talloc_zfree(subreq);
+    if (ret != EOK || err_maj != DP_ERR_OK) {
+        /* the backend may be offline, use the cached data if there is any */
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Unable to get information from Data Provider for SID "
+              "[%s]\n", state->sid);
+    }
+
+    ret = nss_batch_sid_search(state);
+    if (ret == ENOENT) {
+        ret = sss_ncache_set_sid(state->nctx->ncache, false, state->sid);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Cannot set negative cache for %s\n", state->sid);
+        }
+        ret = ENOENT;
+    }
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static errno_t nss_batch_sid_recv(TALLOC_CTX *mem_ctx,
+                                  struct tevent_req *req,
+                                  struct ldb_result **_result,
+                                  struct sss_domain_info **_domain)
+{
+    struct nss_batch_sid_state *state;
+
+    state = tevent_req_data(req, struct nss_batch_sid_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    if (state->result == NULL || state->result->count == 0) {
+        return ENOENT;
+    }
+
+    *_result = talloc_steal(mem_ctx, state->result);
+    *_domain = state->domain;
+
+    return EOK;
+}
+
+static errno_t nss_cmd_getbatch_parse(struct nss_batch_ctx *batch,
+                                      uint8_t *body, size_t blen)
+{
+    struct nss_batch_item *item;
+    size_t pctr = 0;
+    size_t name_len;
+    uint32_t num_items;
+    uint32_t cmd;
+    uint32_t i;
+
+    if (blen < sizeof(uint32_t)) {
+        return EINVAL;
+    }
+    SAFEALIGN_COPY_UINT32(&num_items, body, &pctr);
+
+    if (num_items == 0 || num_items > SSS_NSS_MAX_BATCH_ENTRIES) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Invalid number of batched lookups [%"PRIu32"].\n", num_items);
+        return EINVAL;
+    }
+
+    batch->items = talloc_zero_array(batch, struct nss_batch_item, num_items);
+    if (batch->items == NULL) {
+        return ENOMEM;
+    }
+    batch->num_items = num_items;
+
+    for (i = 0; i < num_items; i++) {
+        item = &batch->items[i];
+        item->batch = batch;
+
+        if (blen - pctr < sizeof(uint32_t)) {
+            return EINVAL;
+        }
+        SAFEALIGN_COPY_UINT32(&cmd, body + pctr, &pctr);
+        item->cmd = cmd;
+
+        switch (item->cmd) {
+        case SSS_NSS_GETPWNAM:
+        case SSS_NSS_GETGRNAM:
+        case SSS_NSS_GETNAMEBYSID:
+        case SSS_NSS_GETIDBYSID:
+            name_len = strnlen((const char *)body + pctr, blen - pctr);
+            if (name_len == 0 || name_len == blen - pctr) {
+                /* empty or not zero terminated */
+                return EINVAL;
+            }
+            item->name = (const char *)body + pctr;
+            pctr += name_len + 1;
+            break;
+        case SSS_NSS_GETPWUID:
+        case SSS_NSS_GETGRGID:
+            if (blen - pctr < sizeof(uint32_t)) {
+                return EINVAL;
+            }
+            SAFEALIGN_COPY_UINT32(&item->id, body + pctr, &pctr);
+            break;
+        default:
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Command [%d][%s] cannot be batched.\n",
+                  item->cmd, sss_cmd2str(item->cmd));
+            return EINVAL;
+        }
+    }
+
+    if (pctr != blen) {
+        return EINVAL;
+    }
+
+    return EOK;
+}
+
+static int nss_cmd_getbatch(struct cli_ctx *cctx)
+{
+    struct nss_batch_ctx *batch;
+    struct nss_batch_item *item;
+    struct nss_ctx *nctx;
+    struct tevent_req *req;
+    uint8_t *body;
+    size_t blen;
+    uint32_t i;
+    int ret;
+
+    nctx = talloc_get_type(cctx->rctx->pvt_ctx, struct nss_ctx);
+
+    batch = talloc_zero(cctx, struct nss_batch_ctx);
+    if (batch == NULL) {
+        return ENOMEM;
+    }
+    batch->cctx = cctx;
+    batch->nctx = nctx;
+
+    sss_packet_get_body(cctx->creq->in, &body, &blen);
+
+    ret = nss_cmd_getbatch_parse(batch, body, blen);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Running %"PRIu32" batched lookups.\n",
+          batch->num_items);
+
+    /* all lookups run in parallel, the names are copied by cache_req */
+    for (i = 0; i < batch->num_items; i++) {
+        item = &batch->items[i];
+
+        if (item->cmd == SSS_NSS_GETNAMEBYSID
+                || item->cmd == SSS_NSS_GETIDBYSID) {
+            item->name = talloc_strdup(batch, item->name);
+            if (item->name == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            ret = nss_well_known_sid_name(batch, nctx, item->name,
+                                          &item->wk_name);
+            if (ret == EOK) {
+                /* answered right away, like by nss_check_well_known_sid() */
+                item->ret = (item->cmd == SSS_NSS_GETNAMEBYSID) ? EOK
+                                                                : EINVAL;
+                continue;
+            } else if (ret != ENOENT) {
+                goto done;
+            }
+
+            req = nss_batch_sid_send(batch, cctx->ev, nctx, item->name);
+            if (req == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            tevent_req_set_callback(req, nss_cmd_getbatch_sid_done, item);
+            batch->pending++;
+            continue;
+        }
+
+        switch (item->cmd) {
+        case SSS_NSS_GETPWNAM:
+            req = cache_req_user_by_name_send(batch, cctx->ev, cctx->rctx,
+                                              nctx->ncache, nctx->neg_timeout,
+                                              nctx->cache_refresh_percent,
+                                              NULL, item->name);
+            break;
+        case SSS_NSS_GETPWUID:
+            req = cache_req_user_by_id_send(batch, cctx->ev, cctx->rctx,
+                                            nctx->ncache, nctx->neg_timeout,
+                                            nctx->cache_refresh_percent,
+                                            NULL, item->id);
+            break;
+        case SSS_NSS_GETGRNAM:
+            req = cache_req_group_by_name_send(batch, cctx->ev, cctx->rctx,
+                                               nctx->ncache,
+                                               nctx->neg_timeout,
+                                               nctx->cache_refresh_percent,
+                                               NULL, item->name);
+            break;
+        case SSS_NSS_GETGRGID:
+            req = cache_req_group_by_id_send(batch, cctx->ev, cctx->rctx,
+                                             nctx->ncache, nctx->neg_timeout,
+                                             nctx->cache_refresh_percent,
+                                             NULL, item->id);
+            break;
+        default:
+            ret = EINVAL;
+            goto done;
+        }
+        if (req == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        tevent_req_set_callback(req, nss_cmd_getbatch_done, item);
+        batch->pending++;
+    }
+
+    if (batch->pending == 0) {
+        /* only Well-Known SIDs */
+        ret = nss_cmd_getbatch_send_reply(batch);
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        ret = sss_cmd_send_error(cctx, ret);
+        if (ret != EOK) {
+            talloc_free(batch);
+            return EFAULT;
+        }
+        sss_cmd_done(cctx, batch);
+    }
+
+    return EOK;
+}
+
+static void nss_cmd_getbatch_item_done(struct nss_batch_item *item);
+
+static void nss_cmd_getbatch_done(struct tevent_req *req)
+{
+    struct nss_batch_item *item;
+
+    item = tevent_req_callback_data(req, struct nss_batch_item);
+
+    item->ret = cache_req_recv(item->batch, req, &item->result,
+                               &item->domain, NULL);
+    talloc_zfree(req);
+
+    nss_cmd_getbatch_item_done(item);
+}
+
+static void nss_cmd_getbatch_sid_done(struct tevent_req *req)
+{
+    struct nss_batch_item *item;
+
+    item = tevent_req_callback_data(req, struct nss_batch_item);
+
+    item->ret = nss_batch_sid_recv(item->batch, req, &item->result,
+                                   &item->domain);
+    talloc_zfree(req);
+
+    nss_cmd_getbatch_item_done(item);
+}
+
+static void nss_cmd_getbatch_item_done(struct nss_batch_item *item)
+{
+    struct nss_batch_ctx *batch = item->batch;
+    errno_t ret;
+
+    /* a failed lookup does not fail the whole batch */
+    if (item->ret != EOK && item->ret != ENOENT) {
+        DEBUG(SSSDBG_OP_FAILURE, "Batched lookup failed [%d]: %s\n",
+              item->ret, sss_strerror(item->ret));
+    }
+
+    batch->pending--;
+    if (batch->pending > 0) {
+        return;
+    }
+
+    ret = nss_cmd_getbatch_send_reply(batch);
+    if (ret != EOK) {
+        ret = sss_cmd_send_error(batch->cctx, ret);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Cannot send the batch reply.\n");
+        }
+        sss_cmd_done(batch->cctx, batch);
+    }
+}
+
+/* Format a single result exactly as the corresponding command would */
+static errno_t nss_cmd_getbatch_fill_item(TALLOC_CTX *mem_ctx,
+                                          struct nss_batch_ctx *batch,
+                                          struct nss_batch_item *item,
+                                          struct sss_packet **_packet)
+{
+    struct sss_packet *packet;
+    struct sized_string name;
+    enum sss_id_type id_type;
+    uint8_t *body;
+    size_t blen;
+    size_t pctr = 0;
+    int count;
+    errno_t ret;
+
+    ret = sss_packet_new(mem_ctx, 0, item->cmd, &packet);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (item->wk_name != NULL) {
+        to_sized_string(&name, item->wk_name);
+
+        ret = sss_packet_grow(packet, name.len + 3 * sizeof(uint32_t));
+        if (ret != EOK) {
+            return ret;
+        }
+
+        sss_packet_get_body(packet, &body, &blen);
+        SAFEALIGN_SETMEM_UINT32(body, 1, &pctr); /* num results */
+        SAFEALIGN_SETMEM_UINT32(body + pctr, 0, &pctr); /* reserved */
+        SAFEALIGN_SETMEM_UINT32(body + pctr, SSS_ID_TYPE_GID, &pctr);
+        memcpy(&body[pctr], name.str, name.len);
+
+        *_packet = packet;
+        return EOK;
+    }
+
+    count = item->result->count;
+
+    switch (item->cmd) {
+    case SSS_NSS_GETPWNAM:
+    case SSS_NSS_GETPWUID:
+        ret = fill_pwent(packet, item->domain, batch->nctx,
+                         item->cmd == SSS_NSS_GETPWUID, true,
+                         item->result->msgs, &count);
+        break;
+    case SSS_NSS_GETGRNAM:
+    case SSS_NSS_GETGRGID:
+        ret = fill_grent(packet, item->domain, batch->nctx,
+                         item->cmd == SSS_NSS_GETGRGID, true,
+                         item->result->msgs, &count);
+        break;
+    case SSS_NSS_GETNAMEBYSID:
+    case SSS_NSS_GETIDBYSID:
+        ret = find_sss_id_type(item->result->msgs[0], item->domain->mpg,
+                               &id_type);
+        if (ret != EOK) {
+            break;
+        }
+
+        if (item->cmd == SSS_NSS_GETNAMEBYSID) {
+            ret = fill_name(packet, item->domain, id_type, true,
+                            item->result->msgs[0]);
+        } else {
+            ret = fill_id(packet, id_type, item->result->msgs[0]);
+        }
+        if (ret == EOK) {
+            nss_update_sid_memcache(batch->nctx, item->domain, item->cmd,
+                                    item->result->msgs[0], id_type);
+        }
+        break;
+    default:
+        ret = EINVAL;
+        break;
+    }
+    if (ret != EOK) {
+        return ret;
+    }
+
+    *_packet = packet;
+    return EOK;
+}
+
+static errno_t nss_cmd_getbatch_send_reply(struct nss_batch_ctx *batch)
+{
+    struct cli_ctx *cctx = batch->cctx;
+    struct nss_batch_item *item;
+    struct sss_packet *item_packet;
+    TALLOC_CTX *tmp_ctx;
+    uint8_t *item_body;
+    size_t item_blen;
+    uint32_t item_len;
+    uint32_t status;
+    uint8_t *body;
+    size_t blen;
+    size_t rp;
+    uint32_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_packet_new(cctx->creq, 2 * sizeof(uint32_t), SSS_NSS_GETBATCH,
+                         &cctx->creq->out);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < batch->num_items; i++) {
+        item = &batch->items[i];
+        item_body = NULL;
+        item_blen = 0;
+
+        status = item->ret;
+        if (status == EOK) {
+            ret = nss_cmd_getbatch_fill_item(tmp_ctx, batch, item,
+                                             &item_packet);
+            if (ret == EOK) {
+                sss_packet_get_body(item_packet, &item_body, &item_blen);
+                /* skip the number of results and the reserved field */
+                item_body += 2 * sizeof(uint32_t);
+                item_blen -= 2 * sizeof(uint32_t);
+            }
+            status = ret;
+        }
+        item_len = item_blen;
+
+        ret = sss_packet_grow(cctx->creq->out,
+                              3 * sizeof(uint32_t) + item_len);
+        if (ret != EOK) {
+            goto done;
+        }
+        sss_packet_get_body(cctx->creq->out, &body, &blen);
+
+        rp = blen - (3 * sizeof(uint32_t) + item_len);
+        SAFEALIGN_SET_UINT32(&body[rp], item->cmd, &rp);
+        SAFEALIGN_SET_UINT32(&body[rp], status, &rp);
+        SAFEALIGN_SET_UINT32(&body[rp], item_len, &rp);
+        if (item_len > 0) {
+            memcpy(&body[rp], item_body, item_len);
+        }
+    }
+
+    sss_packet_get_body(cctx->creq->out, &body, &blen);
+    SAFEALIGN_SETMEM_UINT32(body, batch->num_items, NULL); /* num results */
+    SAFEALIGN_SETMEM_UINT32(body + sizeof(uint32_t), 0, NULL); /* reserved */
+
+    sss_packet_set_error(cctx->creq->out, EOK);
+    sss_cmd_done(cctx, batch);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 struct cli_protocol_version *register_cli_protocol_version(void)
 {
     static struct cli_protocol_version nss_cli_protocol_version[] = {
@@ -5535,28 +6607,29 @@ static struct sss_cmd_table nss_cmds[] = {
     {SSS_GET_VERSION, sss_cmd_get_version},
     {SSS_NSS_GETPWNAM, nss_cmd_getpwnam},
     {SSS_NSS_GETPWUID, nss_cmd_getpwuid},
-    {SSS_NSS_SETPWENT, nss_cmd_setpwent},
-    {SSS_NSS_GETPWENT, nss_cmd_getpwent},
+    {SSS_NSS_SETPWENT, nss_cmd_setpwent, SSS_CMD_BULK},
+    {SSS_NSS_GETPWENT, nss_cmd_getpwent, SSS_CMD_BULK},
     {SSS_NSS_ENDPWENT, nss_cmd_endpwent},
     {SSS_NSS_GETGRNAM, nss_cmd_getgrnam},
     {SSS_NSS_GETGRGID, nss_cmd_getgrgid},
-    {SSS_NSS_SETGRENT, nss_cmd_setgrent},
-    {SSS_NSS_GETGRENT, nss_cmd_getgrent},
+    {SSS_NSS_SETGRENT, nss_cmd_setgrent, SSS_CMD_BULK},
+    {SSS_NSS_GETGRENT, nss_cmd_getgrent, SSS_CMD_BULK},
     {SSS_NSS_ENDGRENT, nss_cmd_endgrent},
     {SSS_NSS_INITGR, nss_cmd_initgroups},
-    {SSS_NSS_SETNETGRENT, nss_cmd_setnetgrent},
-    {SSS_NSS_GETNETGRENT, nss_cmd_getnetgrent},
+    {SSS_NSS_SETNETGRENT, nss_cmd_setnetgrent, SSS_CMD_BULK},
+    {SSS_NSS_GETNETGRENT, nss_cmd_getnetgrent, SSS_CMD_BULK},
     {SSS_NSS_ENDNETGRENT, nss_cmd_endnetgrent},
     {SSS_NSS_GETSERVBYNAME, nss_cmd_getservbyname},
     {SSS_NSS_GETSERVBYPORT, nss_cmd_getservbyport},
-    {SSS_NSS_SETSERVENT, nss_cmd_setservent},
-    {SSS_NSS_GETSERVENT, nss_cmd_getservent},
+    {SSS_NSS_SETSERVENT, nss_cmd_setservent, SSS_CMD_BULK},
+    {SSS_NSS_GETSERVENT, nss_cmd_getservent, SSS_CMD_BULK},
     {SSS_NSS_ENDSERVENT, nss_cmd_endservent},
     {SSS_NSS_GETSIDBYNAME, nss_cmd_getsidbyname},
     {SSS_NSS_GETSIDBYID, nss_cmd_getsidbyid},
     {SSS_NSS_GETNAMEBYSID, nss_cmd_getnamebysid},
     {SSS_NSS_GETIDBYSID, nss_cmd_getidbysid},
     {SSS_NSS_GETORIGBYNAME, nss_cmd_getorigbyname},
+    {SSS_NSS_GETBATCH, nss_cmd_getbatch, SSS_CMD_BULK},
     {SSS_CLI_NULL, NULL}
 };
 
@@ -31,8 +31,28 @@
 #define SSS_AVG_PASSWD_PAYLOAD (MC_SLOT_SIZE * 4)
 /* short group name and no gids (private user group */
 #define SSS_AVG_GROUP_PAYLOAD (MC_SLOT_SIZE * 3)
+/* groups with at least this many members are stored compacted */
+#define SSS_MC_GRP_COMPACT_MIN_MEMBERS 16
 /* average place for 40 supplementary groups + 2 names */
 #define SSS_AVG_INITGROUP_PAYLOAD (MC_SLOT_SIZE * 5)
+/* a name and a handful of triples */
+#define SSS_AVG_NETGROUP_PAYLOAD (MC_SLOT_SIZE * 8)
+/* a SID and a fully qualified name */
+#define SSS_AVG_SID_PAYLOAD (MC_SLOT_SIZE * 4)
+/* two keys, a short name, the protocol and an alias or two */
+#define SSS_AVG_SERVICES_PAYLOAD (MC_SLOT_SIZE * 3)
+/* a few rules with a handful of attributes each */
+#define SSS_AVG_SUDO_PAYLOAD (MC_SLOT_SIZE * 16)
+/* a mount point and a mount location */
+#define SSS_AVG_AUTOFS_PAYLOAD (MC_SLOT_SIZE * 2)
+
+/* The cache is grown online (doubling the number of slots) when either the
+ * share of used slots or the number of still valid records that had to be
+ * evicted to make room for new ones crosses these thresholds. */
+#define SSS_MC_GROW_OCCUPANCY_PCT 90
+#define SSS_MC_GROW_EVICTIONS(slots) ((slots) / 16)
+/* never grow past this multiple of the configured number of elements */
+#define SSS_MC_MAX_GROW_FACTOR 8
 
 #define MC_NEXT_BARRIER(val) ((((val) + 1) & 0x00ffffff) | 0xf0000000)
 
@@ -58,6 +78,7 @@ struct sss_mc_ctx {
     int fd;                 /* file descriptor */
 
     uint32_t seed;          /* pseudo-random seed to avoid collision attacks */
+    bool fold_case;         /* keys are hashed case folded */
     time_t valid_time_slot; /* maximum time the entry is valid in seconds */
 
     void *mmap_base;        /* base address of mmap */
@@ -70,8 +91,16 @@ struct sss_mc_ctx {
     uint32_t ft_size;       /* size of free table */
     uint32_t next_slot;     /* the next slot after last allocation */
 
+    uint8_t *ref_table;     /* clock reference bits, one per slot, set on
+                             * the first slot of recently requested records;
+                             * private to the responder, not in the mmap */
+
     uint8_t *data_table;    /* data table address (in mmap) */
     uint32_t dt_size;       /* size of data table */
+
+    uint32_t used_slots;    /* number of slots marked as used */
+    uint32_t evictions;     /* valid records evicted to make room */
+    size_t max_elems;       /* upper bound for online growth */
 };
 
 #define MC_FIND_BIT(base, num) \
@@ -95,6 +124,12 @@ struct sss_mc_ctx {
     else used = false; \
 } while (0)
 
+/* usage counters in the mmapped header, see struct sss_mc_stats */
+static inline struct sss_mc_stats *sss_mc_stats(struct sss_mc_ctx *mcc)
+{
+    return &((struct sss_mc_header *)mcc->mmap_base)->stats;
+}
+
 static inline
 uint32_t sss_mc_next_slot_with_hash(struct sss_mc_rec *rec,
                                     uint32_t hash)
@@ -197,6 +232,11 @@ done:
 static uint32_t sss_mc_hash(struct sss_mc_ctx *mcc,
                             const char *key, size_t len)
 {
+    if (mcc->fold_case) {
+        return murmurhash3_fold(key, len, mcc->seed)
+                    % MC_HT_ELEMS(mcc->ht_size);
+    }
+
     return murmurhash3(key, len, mcc->seed) % MC_HT_ELEMS(mcc->ht_size);
 }
 
@@ -288,6 +328,13 @@ static void sss_mc_free_slots(struct sss_mc_ctx *mcc, struct sss_mc_rec *rec)
     for (i = 0; i < num; i++) {
         MC_CLEAR_BIT(mcc->free_table, slot + i);
     }
+    MC_CLEAR_BIT(mcc->ref_table, slot);
+
+    if (mcc->used_slots >= num) {
+        mcc->used_slots -= num;
+    } else {
+        mcc->used_slots = 0;
+    }
 }
 
 static void sss_mc_invalidate_rec(struct sss_mc_ctx *mcc,
@@ -374,18 +421,22 @@ static bool sss_mc_is_valid_rec(struct sss_mc_ctx *mcc, struct sss_mc_rec *rec)
     return true;
 }
 
-/* FIXME: This is a very simplistic, inefficient, memory allocator,
- * it will just free the oldest entries regardless of expiration if it
- * cycled the whole freebits map and found no empty slot */
+/* Simple allocator: look for a run of free slots first, if the whole
+ * freebits map is full use a clock (second chance) policy, starting from
+ * next_slot, to pick the records to throw away. Records requested again
+ * since the hand last passed over them are spared once. */
 static errno_t sss_mc_find_free_slots(struct sss_mc_ctx *mcc,
                                       int num_slots, uint32_t *free_slot)
 {
     struct sss_mc_rec *rec;
     uint32_t tot_slots;
+    uint32_t rec_slots = 0;
+    uint32_t scanned;
     uint32_t cur;
     uint32_t i;
     uint32_t t;
     bool used;
+    bool referenced;
 
     tot_slots = mcc->ft_size * 8;
 
@@ -435,12 +486,58 @@ static errno_t sss_mc_find_free_slots(struct sss_mc_ctx *mcc,
         }
     }
 
-    /* no free slots found, free occupied slots after next_slot */
+    /* no free slots found, move the clock hand from next_slot until we find
+     * num_slots slots not occupied by recently referenced records */
     if ((mcc->next_slot + num_slots) > tot_slots) {
         cur = 0;
     } else {
         cur = mcc->next_slot;
     }
+    for (scanned = 0; scanned < tot_slots; ) {
+        if ((cur + num_slots) > tot_slots) {
+            scanned += tot_slots - cur;
+            cur = 0;
+            continue;
+        }
+
+        referenced = false;
+        for (i = 0; i < num_slots; i++) {
+            MC_PROBE_BIT(mcc->free_table, cur + i, used);
+            if (!used) {
+                continue;
+            }
+            rec = MC_SLOT_TO_PTR(mcc->data_table, cur + i, struct sss_mc_rec);
+            if (!sss_mc_is_valid_rec(mcc, rec)) {
+                /* this is a fatal error, the caller should probaly just
+                 * invalidate the whole cache */
+                return EFAULT;
+            }
+            rec_slots = MC_SIZE_TO_SLOTS(rec->len);
+
+            MC_PROBE_BIT(mcc->ref_table, cur + i, referenced);
+            if (referenced) {
+                /* second chance, it will be evicted on the next pass
+                 * unless it is requested again */
+                MC_CLEAR_BIT(mcc->ref_table, cur + i);
+                break;
+            }
+            i += rec_slots - 1;
+        }
+        if (!referenced) {
+            break;
+        }
+
+        /* skip past the referenced record */
+        scanned += i + rec_slots;
+        cur += i + rec_slots;
+        if (cur >= tot_slots) {
+            cur = 0;
+        }
+    }
+    if ((cur + num_slots) > tot_slots) {
+        cur = 0;
+    }
+
     for (i = 0; i < num_slots; i++) {
         MC_PROBE_BIT(mcc->free_table, cur + i, used);
         if (used) {
@@ -455,6 +552,12 @@ static errno_t sss_mc_find_free_slots(struct sss_mc_ctx *mcc,
             /* next loop skip the whole record */
             i += MC_SIZE_TO_SLOTS(rec->len) - 1;
 
+            if ((time_t)rec->expire > time(NULL)) {
+                /* record was still valid, remember we had to throw it away */
+                mcc->evictions++;
+                sss_mc_stats(mcc)->evictions++;
+            }
+
             /* finally invalidate record completely */
             sss_mc_invalidate_rec(mcc, rec);
         }
@@ -478,6 +581,21 @@ static errno_t sss_mc_get_strs_offset(struct sss_mc_ctx *mcc,
     case SSS_MC_INITGROUPS:
         *_offset = offsetof(struct sss_mc_initgr_data, gids);
         return EOK;
+    case SSS_MC_NETGROUP:
+        *_offset = offsetof(struct sss_mc_netgr_data, strs);
+        return EOK;
+    case SSS_MC_SID:
+        *_offset = offsetof(struct sss_mc_sid_data, strs);
+        return EOK;
+    case SSS_MC_SERVICES:
+        *_offset = offsetof(struct sss_mc_svc_data, strs);
+        return EOK;
+    case SSS_MC_SUDO:
+        *_offset = offsetof(struct sss_mc_sudo_data, strs);
+        return EOK;
+    case SSS_MC_AUTOFS:
+        *_offset = offsetof(struct sss_mc_autofs_data, strs);
+        return EOK;
     default:
         DEBUG(SSSDBG_FATAL_FAILURE, "Unknown memory cache type.\n");
         return EINVAL;
@@ -498,6 +616,21 @@ static errno_t sss_mc_get_strs_len(struct sss_mc_ctx *mcc,
     case SSS_MC_INITGROUPS:
         *_len = ((struct sss_mc_initgr_data *)&rec->data)->data_len;
         return EOK;
+    case SSS_MC_NETGROUP:
+        *_len = ((struct sss_mc_netgr_data *)&rec->data)->strs_len;
+        return EOK;
+    case SSS_MC_SID:
+        *_len = ((struct sss_mc_sid_data *)&rec->data)->strs_len;
+        return EOK;
+    case SSS_MC_SERVICES:
+        *_len = ((struct sss_mc_svc_data *)&rec->data)->strs_len;
+        return EOK;
+    case SSS_MC_SUDO:
+        *_len = ((struct sss_mc_sudo_data *)&rec->data)->strs_len;
+        return EOK;
+    case SSS_MC_AUTOFS:
+        *_len = ((struct sss_mc_autofs_data *)&rec->data)->strs_len;
+        return EOK;
     default:
         DEBUG(SSSDBG_FATAL_FAILURE, "Unknown memory cache type.\n");
         return EINVAL;
@@ -559,7 +692,11 @@ static struct sss_mc_rec *sss_mc_find_record(struct sss_mc_ctx *mcc,
         }
 
         t_key = (char *)rec->data + name_ptr;
-        if (strcmp(key->str, t_key) == 0) {
+        if (rec->flags & SSS_MC_REC_FOLD_CASE) {
+            if (strcasecmp(key->str, t_key) == 0) {
+                break;
+            }
+        } else if (strcmp(key->str, t_key) == 0) {
             break;
         }
 
@@ -573,6 +710,30 @@ static struct sss_mc_rec *sss_mc_find_record(struct sss_mc_ctx *mcc,
     return rec;
 }
 
+static errno_t sss_mc_grow(struct sss_mc_ctx **_mcc);
+
+static bool sss_mc_needs_growth(struct sss_mc_ctx *mcc)
+{
+    uint32_t tot_slots;
+
+    tot_slots = mcc->ft_size * 8;
+    if (tot_slots * 2 > mcc->max_elems) {
+        /* already at maximum size */
+        return false;
+    }
+
+    if (((uint64_t)mcc->used_slots * 100)
+            >= ((uint64_t)tot_slots * SSS_MC_GROW_OCCUPANCY_PCT)) {
+        return true;
+    }
+
+    if (mcc->evictions >= SSS_MC_GROW_EVICTIONS(tot_slots)) {
+        return true;
+    }
+
+    return false;
+}
+
 static errno_t sss_mc_get_record(struct sss_mc_ctx **_mcc,
                                  size_t rec_len,
                                  struct sized_string *key,
@@ -587,13 +748,33 @@ static errno_t sss_mc_get_record(struct sss_mc_ctx **_mcc,
     errno_t ret;
     int i;
 
+    bool hot = false;
+
+    if (sss_mc_needs_growth(mcc)) {
+        ret = sss_mc_grow(_mcc);
+        if (ret != EOK) {
+            /* not fatal, keep using the current cache */
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Failed to grow mmap cache %s [%d]: %s\n",
+                  mcc->name, ret, sss_strerror(ret));
+            /* avoid retrying on every single store */
+            mcc->max_elems = mcc->ft_size * 8;
+        }
+        mcc = *_mcc;
+    }
+
     num_slots = MC_SIZE_TO_SLOTS(rec_len);
 
     old_rec = sss_mc_find_record(mcc, key);
     if (old_rec) {
+        /* the record was requested again, protect it from eviction */
+        hot = true;
         old_slots = MC_SIZE_TO_SLOTS(old_rec->len);
 
         if (old_slots == num_slots) {
+            MC_SET_BIT(mcc->ref_table,
+                       MC_PTR_TO_SLOT(mcc->data_table, old_rec));
+            sss_mc_stats(mcc)->stores++;
             *_rec = old_rec;
             return EOK;
         }
@@ -621,13 +802,18 @@ static errno_t sss_mc_get_record(struct sss_mc_ctx **_mcc,
     rec->len = rec_len;
     rec->next1 = MC_INVALID_VAL;
     rec->next2 = MC_INVALID_VAL;
-    rec->padding = MC_INVALID_VAL;
+    rec->flags = 0;
     MC_LOWER_BARRIER(rec);
 
     /* and now mark slots as used */
     for (i = 0; i < num_slots; i++) {
         MC_SET_BIT(mcc->free_table, base_slot + i);
     }
+    mcc->used_slots += num_slots;
+    if (hot) {
+        MC_SET_BIT(mcc->ref_table, base_slot);
+    }
+    sss_mc_stats(mcc)->stores++;
 
     *_rec = rec;
     return EOK;
@@ -675,6 +861,7 @@ static errno_t sss_mmap_cache_invalidate(struct sss_mc_ctx *mcc,
     }
 
     sss_mc_invalidate_rec(mcc, rec);
+    sss_mc_stats(mcc)->invalidations++;
 
     return EOK;
 }
@@ -689,7 +876,8 @@ errno_t sss_mmap_cache_pw_store(struct sss_mc_ctx **_mcc,
                                 uid_t uid, gid_t gid,
                                 struct sized_string *gecos,
                                 struct sized_string *homedir,
-                                struct sized_string *shell)
+                                struct sized_string *shell,
+                                bool case_insensitive)
 {
     struct sss_mc_ctx *mcc = *_mcc;
     struct sss_mc_rec *rec;
@@ -724,6 +912,8 @@ errno_t sss_mmap_cache_pw_store(struct sss_mc_ctx **_mcc,
     if (ret != EOK) {
         return ret;
     }
+    /* the cache might have been grown in the meantime */
+    mcc = *_mcc;
 
     data = (struct sss_mc_pwd_data *)rec->data;
     pos = 0;
@@ -733,6 +923,11 @@ errno_t sss_mmap_cache_pw_store(struct sss_mc_ctx **_mcc,
     /* header */
     sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
                             name->str, name->len, uidkey.str, uidkey.len);
+    if (case_insensitive && mcc->fold_case) {
+        rec->flags |= SSS_MC_REC_FOLD_CASE;
+    } else {
+        rec->flags &= ~SSS_MC_REC_FOLD_CASE;
+    }
 
     /* passwd struct */
     data->name = MC_PTR_DIFF(data->strs, data);
@@ -816,6 +1011,7 @@ errno_t sss_mmap_cache_pw_invalidate_uid(struct sss_mc_ctx *mcc, uid_t uid)
     }
 
     sss_mc_invalidate_rec(mcc, rec);
+    sss_mc_stats(mcc)->invalidations++;
 
     ret = EOK;
 
@@ -828,6 +1024,77 @@ done:
  * group map
  ***************************************************************************/
 
+/* Encode the member names as described at SSS_MC_GRP_COMPACT_MEMBERS.
+ * Returns ENOSPC if the result would not be smaller than the plain names. */
+static errno_t sss_mc_compact_members(TALLOC_CTX *mem_ctx,
+                                      size_t memnum,
+                                      const char *membuf, size_t memsize,
+                                      char **_buf, size_t *_len)
+{
+    const char *prev = "";
+    size_t prev_len = 0;
+    const char *cur;
+    size_t cur_len;
+    size_t prefix;
+    size_t suffix;
+    size_t max;
+    size_t pos = 0;
+    size_t len = 0;
+    size_t i;
+    char *buf;
+
+    /* never longer than the plain names plus the two length bytes */
+    buf = talloc_size(mem_ctx, memsize + 2 * memnum);
+    if (buf == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < memnum; i++) {
+        if (pos >= memsize) {
+            talloc_free(buf);
+            return EINVAL;
+        }
+        cur = membuf + pos;
+        cur_len = strnlen(cur, memsize - pos);
+        if (cur_len == memsize - pos) {
+            talloc_free(buf);
+            return EINVAL;
+        }
+        pos += cur_len + 1;
+
+        max = MIN(MIN(cur_len, prev_len), UINT8_MAX);
+        for (prefix = 0; prefix < max; prefix++) {
+            if (cur[prefix] != prev[prefix]) {
+                break;
+            }
+        }
+        max = MIN(MIN(cur_len, prev_len) - prefix, UINT8_MAX);
+        for (suffix = 0; suffix < max; suffix++) {
+            if (cur[cur_len - suffix - 1] != prev[prev_len - suffix - 1]) {
+                break;
+            }
+        }
+
+        buf[len++] = prefix;
+        buf[len++] = suffix;
+        memcpy(&buf[len], cur + prefix, cur_len - prefix - suffix);
+        len += cur_len - prefix - suffix;
+        buf[len++] = '\0';
+
+        prev = cur;
+        prev_len = cur_len;
+    }
+
+    if (len >= memsize) {
+        talloc_free(buf);
+        return ENOSPC;
+    }
+
+    *_buf = buf;
+    *_len = len;
+    return EOK;
+}
+
 int sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
                             struct sized_string *name,
                             struct sized_string *pw,
@@ -839,6 +1106,9 @@ int sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
     struct sss_mc_grp_data *data;
     struct sized_string gidkey;
     char gidstr[11];
+    char *compact = NULL;
+    size_t compact_len;
+    uint32_t members = memnum;
     size_t data_len;
     size_t rec_len;
     size_t pos;
@@ -855,18 +1125,37 @@ int sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
     }
     to_sized_string(&gidkey, gidstr);
 
+    if (memnum >= SSS_MC_GRP_COMPACT_MIN_MEMBERS
+            && memnum < SSS_MC_GRP_COMPACT_MEMBERS) {
+        /* not allocated on mcc, it is freed when the cache is grown */
+        ret = sss_mc_compact_members(NULL, memnum, membuf, memsize,
+                                     &compact, &compact_len);
+        if (ret == EOK) {
+            membuf = compact;
+            memsize = compact_len;
+            members |= SSS_MC_GRP_COMPACT_MEMBERS;
+        } else if (ret != ENOSPC) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Failed to compact the members of group %s, "
+                  "storing them as they are\n", name->str);
+        }
+    }
+
     data_len = name->len + pw->len + memsize;
     rec_len = sizeof(struct sss_mc_rec) +
               sizeof(struct sss_mc_grp_data) +
               data_len;
     if (rec_len > mcc->dt_size) {
-        return ENOMEM;
+        ret = ENOMEM;
+        goto done;
     }
 
     ret = sss_mc_get_record(_mcc, rec_len, name, &rec);
     if (ret != EOK) {
-        return ret;
+        goto done;
     }
+    /* the cache might have been grown in the meantime */
+    mcc = *_mcc;
 
     data = (struct sss_mc_grp_data *)rec->data;
     pos = 0;
@@ -880,7 +1169,7 @@ int sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
     /* group struct */
     data->name = MC_PTR_DIFF(data->strs, data);
     data->gid = gid;
-    data->members = memnum;
+    data->members = members;
     data->strs_len = data_len;
     memcpy(&data->strs[pos], name->str, name->len);
     pos += name->len;
@@ -894,7 +1183,11 @@ int sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
     /* finally chain the rec in the hash table */
     sss_mmap_chain_in_rec(mcc, rec);
 
-    return EOK;
+    ret = EOK;
+
+done:
+    talloc_free(compact);
+    return ret;
 }
 
 errno_t sss_mmap_cache_gr_invalidate(struct sss_mc_ctx *mcc,
@@ -955,6 +1248,7 @@ errno_t sss_mmap_cache_gr_invalidate_gid(struct sss_mc_ctx *mcc, gid_t gid)
     }
 
     sss_mc_invalidate_rec(mcc, rec);
+    sss_mc_stats(mcc)->invalidations++;
 
     ret = EOK;
 
@@ -995,6 +1289,8 @@ errno_t sss_mmap_cache_initgr_store(struct sss_mc_ctx **_mcc,
     if (ret != EOK) {
         return ret;
     }
+    /* the cache might have been grown in the meantime */
+    mcc = *_mcc;
 
     data = (struct sss_mc_initgr_data *)rec->data;
     pos = 0;
@@ -1037,128 +1333,565 @@ errno_t sss_mmap_cache_initgr_invalidate(struct sss_mc_ctx *mcc,
 }
 
 /***************************************************************************
- * initialization
+ * netgroup map
  ***************************************************************************/
 
-/* Copy of sss_mc_set_recycled is present in the src/tools/tools_mc_util.c.
- * If you modify this function, you should modify the duplicated function
- * too. */
-static errno_t sss_mc_set_recycled(int fd)
+errno_t sss_mmap_cache_netgr_store(struct sss_mc_ctx **_mcc,
+                                   struct sized_string *name,
+                                   uint32_t num_entries,
+                                   uint8_t *entries_buf,
+                                   size_t entries_len)
 {
-    uint32_t w = SSS_MC_HEADER_RECYCLED;
-    struct sss_mc_header h;
-    off_t offset;
-    off_t pos;
-    ssize_t written;
-
-    offset = MC_PTR_DIFF(&h.status, &h);
+    struct sss_mc_ctx *mcc = *_mcc;
+    struct sss_mc_rec *rec;
+    struct sss_mc_netgr_data *data;
+    size_t data_len;
+    size_t rec_len;
+    int ret;
 
-    pos = lseek(fd, offset, SEEK_SET);
-    if (pos == -1) {
-        /* What do we do now ? */
-        return errno;
+    if (mcc == NULL) {
+        /* cache not initialized ? */
+        return EINVAL;
     }
 
-    errno = 0;
-    written = sss_atomic_write_s(fd, (uint8_t *)&w, sizeof(h.status));
-    if (written == -1) {
-        return errno;
+    data_len = name->len + entries_len;
+    rec_len = sizeof(struct sss_mc_rec) +
+              sizeof(struct sss_mc_netgr_data) +
+              data_len;
+    if (rec_len > mcc->dt_size) {
+        return ENOMEM;
     }
 
-    if (written != sizeof(h.status)) {
-        /* Write error */
-        return EIO;
+    ret = sss_mc_get_record(_mcc, rec_len, name, &rec);
+    if (ret != EOK) {
+        return ret;
     }
+    /* the cache might have been grown in the meantime */
+    mcc = *_mcc;
+
+    data = (struct sss_mc_netgr_data *)rec->data;
+
+    MC_RAISE_BARRIER(rec);
+
+    /* netgroups have only one key, use the name twice */
+    sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
+                            name->str, name->len, name->str, name->len);
+
+    /* netgroup struct */
+    data->name = MC_PTR_DIFF(data->strs, data);
+    data->num_entries = num_entries;
+    data->reserved = MC_INVALID_VAL32;
+    data->strs_len = data_len;
+    memcpy(data->strs, name->str, name->len);
+    memcpy(&data->strs[name->len], entries_buf, entries_len);
+
+    MC_LOWER_BARRIER(rec);
+
+    /* finally chain the rec in the hash table */
+    sss_mmap_chain_in_rec(mcc, rec);
 
     return EOK;
 }
 
-/*
- * When we (re)create a new file we must mark the current file as recycled
- * so active clients will abandon its use asap.
- * We unlink the current file and make a new one
- */
-static errno_t sss_mc_create_file(struct sss_mc_ctx *mc_ctx)
+errno_t sss_mmap_cache_netgr_invalidate(struct sss_mc_ctx *mcc,
+                                        struct sized_string *name)
 {
-    mode_t old_mask;
-    int ofd;
-    int ret, uret;
-    useconds_t t = 50000;
-    int retries = 3;
+    return sss_mmap_cache_invalidate(mcc, name);
+}
 
-    ofd = open(mc_ctx->file, O_RDWR);
-    if (ofd != -1) {
-        ret = sss_br_lock_file(ofd, 0, 1, retries, t);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_FATAL_FAILURE,
-                  "Failed to lock file %s.\n", mc_ctx->file);
-        }
-        ret = sss_mc_set_recycled(ofd);
-        if (ret) {
-            DEBUG(SSSDBG_FATAL_FAILURE, "Failed to mark mmap file %s as"
-                                         " recycled: %d(%s)\n",
-                                         mc_ctx->file, ret, strerror(ret));
-        }
+/***************************************************************************
+ * SID map
+ ***************************************************************************/
 
-        close(ofd);
-    } else if (errno != ENOENT) {
-        ret = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "Failed to open old memory cache file %s: %d(%s).\n",
-               mc_ctx->file, ret, strerror(ret));
+/* Records are keyed by SID string and by name. When by_id is true the record
+ * answers lookups by POSIX ID instead, and its only key is the decimal ID.
+ * The two kinds are kept apart because the responder resolves an ID to the
+ * user first, so a group record cannot answer a lookup of the same ID. */
+errno_t sss_mmap_cache_sid_store(struct sss_mc_ctx **_mcc,
+                                 struct sized_string *sid,
+                                 struct sized_string *name,
+                                 uint32_t id,
+                                 uint32_t id_type,
+                                 bool by_id)
+{
+    struct sss_mc_ctx *mcc = *_mcc;
+    struct sss_mc_rec *rec;
+    struct sss_mc_sid_data *data;
+    struct sized_string key;
+    char idkey[11];
+    size_t data_len;
+    size_t rec_len;
+    size_t pos;
+    int ret;
+
+    if (mcc == NULL) {
+        /* cache not initialized ? */
+        return EINVAL;
     }
 
-    errno = 0;
-    ret = unlink(mc_ctx->file);
-    if (ret == -1 && errno != ENOENT) {
-        ret = errno;
-        DEBUG(SSSDBG_TRACE_FUNC, "Failed to rm mmap file %s: %d(%s)\n",
-                                  mc_ctx->file, ret, strerror(ret));
+    if (by_id) {
+        ret = snprintf(idkey, 11, "%ld", (long)id);
+        if (ret > 10) {
+            return EINVAL;
+        }
+        to_sized_string(&key, idkey);
+    } else {
+        key = *sid;
     }
 
-    /* temporarily relax umask as we need the file to be readable
-     * by everyone for now */
-    old_mask = umask(0022);
+    data_len = sid->len + name->len + (by_id ? key.len : 0);
+    rec_len = sizeof(struct sss_mc_rec) +
+              sizeof(struct sss_mc_sid_data) +
+              data_len;
+    if (rec_len > mcc->dt_size) {
+        return ENOMEM;
+    }
 
-    errno = 0;
-    mc_ctx->fd = open(mc_ctx->file, O_CREAT | O_EXCL | O_RDWR, 0644);
-    umask(old_mask);
-    if (mc_ctx->fd == -1) {
-        ret = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to open mmap file %s: %d(%s)\n",
-                                    mc_ctx->file, ret, strerror(ret));
+    ret = sss_mc_get_record(_mcc, rec_len, &key, &rec);
+    if (ret != EOK) {
         return ret;
     }
+    /* the cache might have been grown in the meantime */
+    mcc = *_mcc;
 
-    ret = sss_br_lock_file(mc_ctx->fd, 0, 1, retries, t);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_FATAL_FAILURE,
-              "Failed to lock file %s.\n", mc_ctx->file);
-        close(mc_ctx->fd);
-        mc_ctx->fd = -1;
+    data = (struct sss_mc_sid_data *)rec->data;
+    pos = 0;
 
-        /* Report on unlink failures but don't overwrite the errno
-         * from sss_br_lock_file
-         */
-        errno = 0;
-        uret = unlink(mc_ctx->file);
-        if (uret == -1) {
-            uret = errno;
-            DEBUG(SSSDBG_TRACE_FUNC, "Failed to rm mmap file %s: %d(%s)\n",
-                                    mc_ctx->file, uret, strerror(uret));
-        }
+    MC_RAISE_BARRIER(rec);
 
-        return ret;
+    if (by_id) {
+        sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
+                                key.str, key.len, key.str, key.len);
+    } else {
+        sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
+                                sid->str, sid->len, name->str, name->len);
     }
 
-    return ret;
+    /* sid struct */
+    data->key = MC_PTR_DIFF(data->strs, data);
+    if (by_id) {
+        memcpy(&data->strs[pos], key.str, key.len);
+        pos += key.len;
+    }
+    data->sid = data->key + pos;
+    memcpy(&data->strs[pos], sid->str, sid->len);
+    pos += sid->len;
+    data->name = data->key + pos;
+    memcpy(&data->strs[pos], name->str, name->len);
+    data->id = id;
+    data->id_type = id_type;
+    data->strs_len = data_len;
+
+    MC_LOWER_BARRIER(rec);
+
+    /* finally chain the rec in the hash table */
+    sss_mmap_chain_in_rec(mcc, rec);
+
+    return EOK;
 }
 
-static void sss_mc_header_update(struct sss_mc_ctx *mc_ctx, int status)
+errno_t sss_mmap_cache_sid_invalidate(struct sss_mc_ctx *mcc,
+                                      struct sized_string *sid)
 {
-    struct sss_mc_header *h;
+    return sss_mmap_cache_invalidate(mcc, sid);
+}
 
-    /* update header using barriers */
+errno_t sss_mmap_cache_sid_invalidate_id(struct sss_mc_ctx *mcc, uint32_t id)
+{
+    struct sized_string key;
+    char idkey[11];
+    int ret;
+
+    ret = snprintf(idkey, 11, "%ld", (long)id);
+    if (ret > 10) {
+        return EINVAL;
+    }
+    to_sized_string(&key, idkey);
+
+    return sss_mmap_cache_invalidate(mcc, &key);
+}
+
+/* The records stored for lookups by SID are found by name through their
+ * second key, the generic invalidation only compares the first one. */
+errno_t sss_mmap_cache_sid_invalidate_name(struct sss_mc_ctx *mcc,
+                                           struct sized_string *name)
+{
+    struct sss_mc_rec *rec;
+    struct sss_mc_sid_data *data;
+    uint32_t hash;
+    uint32_t slot;
+    uint32_t next;
+    char *t_name;
+    errno_t ret = ENOENT;
+
+    if (mcc == NULL) {
+        /* cache not initialized ? */
+        return EINVAL;
+    }
+
+    hash = sss_mc_hash(mcc, name->str, name->len);
+
+    slot = mcc->hash_table[hash];
+    if (!MC_SLOT_WITHIN_BOUNDS(slot, mcc->dt_size)) {
+        return ENOENT;
+    }
+
+    while (slot != MC_INVALID_VAL) {
+        if (!MC_SLOT_WITHIN_BOUNDS(slot, mcc->dt_size)) {
+            DEBUG(SSSDBG_FATAL_FAILURE, "Corrupted fastcache.\n");
+            sss_mc_save_corrupted(mcc);
+            sss_mmap_cache_reset(mcc);
+            return ENOENT;
+        }
+
+        rec = MC_SLOT_TO_PTR(mcc->data_table, slot, struct sss_mc_rec);
+        data = (struct sss_mc_sid_data *)(&rec->data);
+        next = sss_mc_next_slot_with_hash(rec, hash);
+
+        if (rec->hash2 == hash && data->key == data->sid
+                && data->name < data->key + data->strs_len) {
+            t_name = (char *)data + data->name;
+            if (strcmp(name->str, t_name) == 0) {
+                /* a user and a group may share the name, keep walking */
+                sss_mc_invalidate_rec(mcc, rec);
+                sss_mc_stats(mcc)->invalidations++;
+                ret = EOK;
+            }
+        }
+
+        slot = next;
+    }
+
+    return ret;
+}
+
+/***************************************************************************
+ * services map
+ ***************************************************************************/
+
+errno_t sss_mmap_cache_svc_store(struct sss_mc_ctx **_mcc,
+                                 struct sized_string *key,
+                                 struct sized_string *alt_key,
+                                 struct sized_string *name,
+                                 struct sized_string *proto,
+                                 uint32_t port,
+                                 uint32_t num_aliases,
+                                 uint8_t *aliases_buf,
+                                 size_t aliases_len)
+{
+    struct sss_mc_ctx *mcc = *_mcc;
+    struct sss_mc_rec *rec;
+    struct sss_mc_svc_data *data;
+    bool same_keys;
+    size_t data_len;
+    size_t rec_len;
+    size_t pos;
+    int ret;
+
+    if (mcc == NULL) {
+        /* cache not initialized ? */
+        return EINVAL;
+    }
+
+    same_keys = (alt_key->len == key->len
+                 && memcmp(alt_key->str, key->str, key->len) == 0);
+
+    data_len = key->len + (same_keys ? 0 : alt_key->len)
+               + name->len + proto->len + aliases_len;
+    rec_len = sizeof(struct sss_mc_rec) +
+              sizeof(struct sss_mc_svc_data) +
+              data_len;
+    if (rec_len > mcc->dt_size) {
+        return ENOMEM;
+    }
+
+    ret = sss_mc_get_record(_mcc, rec_len, key, &rec);
+    if (ret != EOK) {
+        return ret;
+    }
+    /* the cache might have been grown in the meantime */
+    mcc = *_mcc;
+
+    data = (struct sss_mc_svc_data *)rec->data;
+    pos = 0;
+
+    MC_RAISE_BARRIER(rec);
+
+    sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
+                            key->str, key->len, alt_key->str, alt_key->len);
+
+    /* services struct */
+    data->key = MC_PTR_DIFF(data->strs, data);
+    memcpy(&data->strs[pos], key->str, key->len);
+    pos += key->len;
+    if (same_keys) {
+        data->alt_key = data->key;
+    } else {
+        data->alt_key = data->key + pos;
+        memcpy(&data->strs[pos], alt_key->str, alt_key->len);
+        pos += alt_key->len;
+    }
+    data->name = data->key + pos;
+    memcpy(&data->strs[pos], name->str, name->len);
+    pos += name->len;
+    data->proto = data->key + pos;
+    memcpy(&data->strs[pos], proto->str, proto->len);
+    pos += proto->len;
+    memcpy(&data->strs[pos], aliases_buf, aliases_len);
+    data->port = port;
+    data->aliases = num_aliases;
+    data->strs_len = data_len;
+
+    MC_LOWER_BARRIER(rec);
+
+    /* finally chain the rec in the hash table */
+    sss_mmap_chain_in_rec(mcc, rec);
+
+    return EOK;
+}
+
+/***************************************************************************
+ * sudo map
+ ***************************************************************************/
+
+errno_t sss_mmap_cache_sudo_store(struct sss_mc_ctx **_mcc,
+                                  struct sized_string *key,
+                                  uint32_t num_rules,
+                                  uint8_t *reply_buf,
+                                  size_t reply_len)
+{
+    struct sss_mc_ctx *mcc = *_mcc;
+    struct sss_mc_rec *rec;
+    struct sss_mc_sudo_data *data;
+    size_t data_len;
+    size_t rec_len;
+    int ret;
+
+    if (mcc == NULL) {
+        /* cache not initialized ? */
+        return EINVAL;
+    }
+
+    data_len = key->len + reply_len;
+    rec_len = sizeof(struct sss_mc_rec) +
+              sizeof(struct sss_mc_sudo_data) +
+              data_len;
+    if (rec_len > mcc->dt_size) {
+        return ENOMEM;
+    }
+
+    ret = sss_mc_get_record(_mcc, rec_len, key, &rec);
+    if (ret != EOK) {
+        return ret;
+    }
+    /* the cache might have been grown in the meantime */
+    mcc = *_mcc;
+
+    data = (struct sss_mc_sudo_data *)rec->data;
+
+    MC_RAISE_BARRIER(rec);
+
+    /* sudo records have only one key, use it twice */
+    sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
+                            key->str, key->len, key->str, key->len);
+
+    /* sudo struct */
+    data->key = MC_PTR_DIFF(data->strs, data);
+    data->num_rules = num_rules;
+    data->reply_len = reply_len;
+    data->strs_len = data_len;
+    memcpy(data->strs, key->str, key->len);
+    memcpy(&data->strs[key->len], reply_buf, reply_len);
+
+    MC_LOWER_BARRIER(rec);
+
+    /* finally chain the rec in the hash table */
+    sss_mmap_chain_in_rec(mcc, rec);
+
+    return EOK;
+}
+
+/***************************************************************************
+ * autofs map
+ ***************************************************************************/
+
+errno_t sss_mmap_cache_autofs_store(struct sss_mc_ctx **_mcc,
+                                    struct sized_string *key,
+                                    struct sized_string *value)
+{
+    struct sss_mc_ctx *mcc = *_mcc;
+    struct sss_mc_rec *rec;
+    struct sss_mc_autofs_data *data;
+    size_t data_len;
+    size_t rec_len;
+    int ret;
+
+    if (mcc == NULL) {
+        /* cache not initialized ? */
+        return EINVAL;
+    }
+
+    data_len = key->len + value->len;
+    rec_len = sizeof(struct sss_mc_rec) +
+              sizeof(struct sss_mc_autofs_data) +
+              data_len;
+    if (rec_len > mcc->dt_size) {
+        return ENOMEM;
+    }
+
+    ret = sss_mc_get_record(_mcc, rec_len, key, &rec);
+    if (ret != EOK) {
+        return ret;
+    }
+    /* the cache might have been grown in the meantime */
+    mcc = *_mcc;
+
+    data = (struct sss_mc_autofs_data *)rec->data;
+
+    MC_RAISE_BARRIER(rec);
+
+    /* autofs records have only one key, use it twice */
+    sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
+                            key->str, key->len, key->str, key->len);
+
+    /* autofs struct */
+    data->key = MC_PTR_DIFF(data->strs, data);
+    data->value_len = value->len;
+    data->strs_len = data_len;
+    memcpy(data->strs, key->str, key->len);
+    memcpy(&data->strs[key->len], value->str, value->len);
+
+    MC_LOWER_BARRIER(rec);
+
+    /* finally chain the rec in the hash table */
+    sss_mmap_chain_in_rec(mcc, rec);
+
+    return EOK;
+}
+
+/***************************************************************************
+ * initialization
+ ***************************************************************************/
+
+/* Copy of sss_mc_set_recycled is present in the src/tools/tools_mc_util.c.
+ * If you modify this function, you should modify the duplicated function
+ * too. */
+static errno_t sss_mc_set_recycled(int fd)
+{
+    uint32_t w = SSS_MC_HEADER_RECYCLED;
+    struct sss_mc_header h;
+    off_t offset;
+    off_t pos;
+    ssize_t written;
+
+    offset = MC_PTR_DIFF(&h.status, &h);
+
+    pos = lseek(fd, offset, SEEK_SET);
+    if (pos == -1) {
+        /* What do we do now ? */
+        return errno;
+    }
+
+    errno = 0;
+    written = sss_atomic_write_s(fd, (uint8_t *)&w, sizeof(h.status));
+    if (written == -1) {
+        return errno;
+    }
+
+    if (written != sizeof(h.status)) {
+        /* Write error */
+        return EIO;
+    }
+
+    return EOK;
+}
+
+/*
+ * When we (re)create a new file we must mark the current file as recycled
+ * so active clients will abandon its use asap.
+ * We unlink the current file and make a new one
+ */
+static errno_t sss_mc_create_file(struct sss_mc_ctx *mc_ctx)
+{
+    mode_t old_mask;
+    int ofd;
+    int ret, uret;
+    useconds_t t = 50000;
+    int retries = 3;
+
+    ofd = open(mc_ctx->file, O_RDWR);
+    if (ofd != -1) {
+        ret = sss_br_lock_file(ofd, 0, 1, retries, t);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE,
+                  "Failed to lock file %s.\n", mc_ctx->file);
+        }
+        ret = sss_mc_set_recycled(ofd);
+        if (ret) {
+            DEBUG(SSSDBG_FATAL_FAILURE, "Failed to mark mmap file %s as"
+                                         " recycled: %d(%s)\n",
+                                         mc_ctx->file, ret, strerror(ret));
+        }
+
+        close(ofd);
+    } else if (errno != ENOENT) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to open old memory cache file %s: %d(%s).\n",
+               mc_ctx->file, ret, strerror(ret));
+    }
+
+    errno = 0;
+    ret = unlink(mc_ctx->file);
+    if (ret == -1 && errno != ENOENT) {
+        ret = errno;
+        DEBUG(SSSDBG_TRACE_FUNC, "Failed to rm mmap file %s: %d(%s)\n",
+                                  mc_ctx->file, ret, strerror(ret));
+    }
+
+    /* temporarily relax umask as we need the file to be readable
+     * by everyone for now */
+    old_mask = umask(0022);
+
+    errno = 0;
+    mc_ctx->fd = open(mc_ctx->file, O_CREAT | O_EXCL | O_RDWR, 0644);
+    umask(old_mask);
+    if (mc_ctx->fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to open mmap file %s: %d(%s)\n",
+                                    mc_ctx->file, ret, strerror(ret));
+        return ret;
+    }
+
+    ret = sss_br_lock_file(mc_ctx->fd, 0, 1, retries, t);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Failed to lock file %s.\n", mc_ctx->file);
+        close(mc_ctx->fd);
+        mc_ctx->fd = -1;
+
+        /* Report on unlink failures but don't overwrite the errno
+         * from sss_br_lock_file
+         */
+        errno = 0;
+        uret = unlink(mc_ctx->file);
+        if (uret == -1) {
+            uret = errno;
+            DEBUG(SSSDBG_TRACE_FUNC, "Failed to rm mmap file %s: %d(%s)\n",
+                                    mc_ctx->file, uret, strerror(uret));
+        }
+
+        return ret;
+    }
+
+    return ret;
+}
+
+static void sss_mc_header_update(struct sss_mc_ctx *mc_ctx, int status)
+{
+    struct sss_mc_header *h;
+
+    /* update header using barriers */
     h = (struct sss_mc_header *)mc_ctx->mmap_base;
     MC_RAISE_BARRIER(h);
     if (status == SSS_MC_HEADER_ALIVE) {
@@ -1173,7 +1906,7 @@ static void sss_mc_header_update(struct sss_mc_ctx *mc_ctx, int status)
         h->major_vno = SSS_MC_MAJOR_VNO;
         h->minor_vno = SSS_MC_MINOR_VNO;
         h->seed = mc_ctx->seed;
-        h->reserved = 0;
+        h->flags = mc_ctx->fold_case ? SSS_MC_HEADER_FOLD_CASE : 0;
     }
     h->status = status;
     MC_LOWER_BARRIER(h);
@@ -1209,14 +1942,12 @@ static int mc_ctx_destructor(struct sss_mc_ctx *mc_ctx)
     return 0;
 }
 
-errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
-                            enum sss_mc_type type, size_t n_elem,
-                            time_t timeout, struct sss_mc_ctx **mcc)
+static errno_t sss_mc_ctx_new(TALLOC_CTX *mem_ctx, const char *name,
+                              enum sss_mc_type type, size_t n_elem,
+                              time_t timeout, struct sss_mc_ctx **_mc_ctx)
 {
     struct sss_mc_ctx *mc_ctx = NULL;
-    unsigned int rseed;
     int payload;
-    int ret, dret;
 
     switch (type) {
     case SSS_MC_PASSWD:
@@ -1228,6 +1959,21 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
     case SSS_MC_INITGROUPS:
         payload = SSS_AVG_INITGROUP_PAYLOAD;
         break;
+    case SSS_MC_NETGROUP:
+        payload = SSS_AVG_NETGROUP_PAYLOAD;
+        break;
+    case SSS_MC_SID:
+        payload = SSS_AVG_SID_PAYLOAD;
+        break;
+    case SSS_MC_SERVICES:
+        payload = SSS_AVG_SERVICES_PAYLOAD;
+        break;
+    case SSS_MC_SUDO:
+        payload = SSS_AVG_SUDO_PAYLOAD;
+        break;
+    case SSS_MC_AUTOFS:
+        payload = SSS_AVG_AUTOFS_PAYLOAD;
+        break;
     default:
         return EINVAL;
     }
@@ -1241,8 +1987,8 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
 
     mc_ctx->name = talloc_strdup(mc_ctx, name);
     if (!mc_ctx->name) {
-        ret = ENOMEM;
-        goto done;
+        talloc_free(mc_ctx);
+        return ENOMEM;
     }
 
     mc_ctx->type = type;
@@ -1252,8 +1998,8 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
     mc_ctx->file = talloc_asprintf(mc_ctx, "%s/%s",
                                    SSS_NSS_MCACHE_DIR, name);
     if (!mc_ctx->file) {
-        ret = ENOMEM;
-        goto done;
+        talloc_free(mc_ctx);
+        return ENOMEM;
     }
 
     /* elements must always be multiple of 8 to make things easier to handle,
@@ -1270,21 +2016,29 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
                         MC_ALIGN64(mc_ctx->dt_size) +
                         MC_ALIGN64(mc_ctx->ft_size) +
                         MC_ALIGN64(mc_ctx->ht_size);
+    mc_ctx->max_elems = n_elem * SSS_MC_MAX_GROW_FACTOR;
 
+    mc_ctx->ref_table = talloc_zero_array(mc_ctx, uint8_t, mc_ctx->ft_size);
+    if (!mc_ctx->ref_table) {
+        talloc_free(mc_ctx);
+        return ENOMEM;
+    }
 
-    /* for now ALWAYS create a new file on restart */
+    *_mc_ctx = mc_ctx;
+    return EOK;
+}
 
-    ret = sss_mc_create_file(mc_ctx);
-    if (ret) {
-        goto done;
-    }
+/* Size the already opened file and map the tables into memory */
+static errno_t sss_mc_map_file(struct sss_mc_ctx *mc_ctx, const char *file)
+{
+    int ret;
 
     ret = ftruncate(mc_ctx->fd, mc_ctx->mmap_size);
     if (ret == -1) {
         ret = errno;
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to resize file %s: %d(%s)\n",
-                                    mc_ctx->file, ret, strerror(ret));
-        goto done;
+                                    file, ret, strerror(ret));
+        return ret;
     }
 
     mc_ctx->mmap_base = mmap(NULL, mc_ctx->mmap_size,
@@ -1293,9 +2047,10 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
     if (mc_ctx->mmap_base == MAP_FAILED) {
         ret = errno;
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to mmap file %s(%zu): %d(%s)\n",
-                                    mc_ctx->file, mc_ctx->mmap_size,
+                                    file, mc_ctx->mmap_size,
                                     ret, strerror(ret));
-        goto done;
+        mc_ctx->mmap_base = NULL;
+        return ret;
     }
 
     mc_ctx->data_table = MC_PTR_ADD(mc_ctx->mmap_base, MC_HEADER_SIZE);
@@ -1308,6 +2063,34 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
     memset(mc_ctx->free_table, 0x00, mc_ctx->ft_size);
     memset(mc_ctx->hash_table, 0xff, mc_ctx->ht_size);
 
+    return EOK;
+}
+
+errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
+                            enum sss_mc_type type, size_t n_elem,
+                            time_t timeout, struct sss_mc_ctx **mcc)
+{
+    struct sss_mc_ctx *mc_ctx = NULL;
+    unsigned int rseed;
+    int ret, dret;
+
+    ret = sss_mc_ctx_new(mem_ctx, name, type, n_elem, timeout, &mc_ctx);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    /* for now ALWAYS create a new file on restart */
+
+    ret = sss_mc_create_file(mc_ctx);
+    if (ret) {
+        goto done;
+    }
+
+    ret = sss_mc_map_file(mc_ctx, mc_ctx->file);
+    if (ret) {
+        goto done;
+    }
+
     /* generate a pseudo-random seed.
      * Needed to fend off dictionary based collision attacks */
     rseed = time(NULL) * getpid();
@@ -1338,6 +2121,314 @@ done:
     return ret;
 }
 
+/* Recompute the hashes of a record copied from a cache of different size.
+ * Returns false if the keys cannot be safely extracted from the record. */
+static bool sss_mc_rehash_rec(struct sss_mc_ctx *mcc, struct sss_mc_rec *rec)
+{
+    struct sss_mc_pwd_data *pwd_data;
+    struct sss_mc_grp_data *grp_data;
+    struct sss_mc_initgr_data *initgr_data;
+    struct sss_mc_netgr_data *netgr_data;
+    struct sss_mc_sid_data *sid_data;
+    struct sss_mc_svc_data *svc_data;
+    struct sss_mc_sudo_data *sudo_data;
+    struct sss_mc_autofs_data *autofs_data;
+    size_t data_len;
+    char idstr[11];
+    const char *key1;
+    const char *key2 = NULL;
+    size_t key1_len;
+    size_t key2_len = 0;
+    int ret;
+
+    data_len = rec->len - sizeof(struct sss_mc_rec);
+
+    switch (mcc->type) {
+    case SSS_MC_PASSWD:
+        pwd_data = (struct sss_mc_pwd_data *)rec->data;
+        if (pwd_data->name >= data_len) {
+            return false;
+        }
+        key1 = (const char *)pwd_data + pwd_data->name;
+        key1_len = strnlen(key1, data_len - pwd_data->name) + 1;
+        ret = snprintf(idstr, sizeof(idstr), "%ld", (long)pwd_data->uid);
+        break;
+    case SSS_MC_GROUP:
+        grp_data = (struct sss_mc_grp_data *)rec->data;
+        if (grp_data->name >= data_len) {
+            return false;
+        }
+        key1 = (const char *)grp_data + grp_data->name;
+        key1_len = strnlen(key1, data_len - grp_data->name) + 1;
+        ret = snprintf(idstr, sizeof(idstr), "%ld", (long)grp_data->gid);
+        break;
+    case SSS_MC_INITGROUPS:
+        initgr_data = (struct sss_mc_initgr_data *)rec->data;
+        if (initgr_data->name >= data_len
+                || initgr_data->unique_name >= data_len) {
+            return false;
+        }
+        key1 = (const char *)initgr_data + initgr_data->name;
+        key1_len = strnlen(key1, data_len - initgr_data->name) + 1;
+        key2 = (const char *)initgr_data + initgr_data->unique_name;
+        key2_len = strnlen(key2,  data_len - initgr_data->unique_name) + 1;
+        ret = 0;
+        break;
+    case SSS_MC_NETGROUP:
+        netgr_data = (struct sss_mc_netgr_data *)rec->data;
+        if (netgr_data->name >= data_len) {
+            return false;
+        }
+        /* the name is the only key */
+        key1 = key2 = (const char *)netgr_data + netgr_data->name;
+        key1_len = key2_len = strnlen(key1, data_len - netgr_data->name) + 1;
+        ret = 0;
+        break;
+    case SSS_MC_SID:
+        sid_data = (struct sss_mc_sid_data *)rec->data;
+        if (sid_data->key >= data_len || sid_data->name >= data_len) {
+            return false;
+        }
+        key1 = (const char *)sid_data + sid_data->key;
+        key1_len = strnlen(key1, data_len - sid_data->key) + 1;
+        if (sid_data->key == sid_data->sid) {
+            key2 = (const char *)sid_data + sid_data->name;
+            key2_len = strnlen(key2, data_len - sid_data->name) + 1;
+        } else {
+            /* records stored for lookups by ID have only one key */
+            key2 = key1;
+            key2_len = key1_len;
+        }
+        ret = 0;
+        break;
+    case SSS_MC_SERVICES:
+        svc_data = (struct sss_mc_svc_data *)rec->data;
+        if (svc_data->key >= data_len || svc_data->alt_key >= data_len) {
+            return false;
+        }
+        key1 = (const char *)svc_data + svc_data->key;
+        key1_len = strnlen(key1, data_len - svc_data->key) + 1;
+        key2 = (const char *)svc_data + svc_data->alt_key;
+        key2_len = strnlen(key2, data_len - svc_data->alt_key) + 1;
+        ret = 0;
+        break;
+    case SSS_MC_SUDO:
+        sudo_data = (struct sss_mc_sudo_data *)rec->data;
+        if (sudo_data->key >= data_len) {
+            return false;
+        }
+        /* the key is the only one */
+        key1 = key2 = (const char *)sudo_data + sudo_data->key;
+        key1_len = key2_len = strnlen(key1, data_len - sudo_data->key) + 1;
+        ret = 0;
+        break;
+    case SSS_MC_AUTOFS:
+        autofs_data = (struct sss_mc_autofs_data *)rec->data;
+        if (autofs_data->key >= data_len) {
+            return false;
+        }
+        /* the key is the only one */
+        key1 = key2 = (const char *)autofs_data + autofs_data->key;
+        key1_len = key2_len = strnlen(key1,
+                                      data_len - autofs_data->key) + 1;
+        ret = 0;
+        break;
+    default:
+        return false;
+    }
+
+    if (ret < 0 || ret >= (int)sizeof(idstr)) {
+        return false;
+    }
+
+    if (mcc->type == SSS_MC_PASSWD || mcc->type == SSS_MC_GROUP) {
+        key2 = idstr;
+        key2_len = ret + 1;
+    }
+
+    rec->hash1 = sss_mc_hash(mcc, key1, key1_len);
+    rec->hash2 = sss_mc_hash(mcc, key2, key2_len);
+    return true;
+}
+
+/* Copy all valid and not yet expired records from one cache to another.
+ * The destination must be empty and at least as big as the source. */
+static void sss_mc_copy_records(struct sss_mc_ctx *src,
+                                struct sss_mc_ctx *dst)
+{
+    struct sss_mc_rec *rec;
+    struct sss_mc_rec *new_rec;
+    uint32_t tot_slots;
+    uint32_t num_slots;
+    uint32_t slot;
+    uint32_t dst_slot = 0;
+    uint32_t copied = 0;
+    uint32_t i;
+    time_t now;
+    bool used;
+
+    now = time(NULL);
+    tot_slots = src->ft_size * 8;
+
+    for (slot = 0; slot < tot_slots; slot++) {
+        MC_PROBE_BIT(src->free_table, slot, used);
+        if (!used) {
+            continue;
+        }
+
+        rec = MC_SLOT_TO_PTR(src->data_table, slot, struct sss_mc_rec);
+        if (!sss_mc_is_valid_rec(src, rec)) {
+            continue;
+        }
+
+        num_slots = MC_SIZE_TO_SLOTS(rec->len);
+        if ((time_t)rec->expire <= now) {
+            /* expired, not worth copying */
+            slot += num_slots - 1;
+            continue;
+        }
+
+        if (dst_slot + num_slots > dst->ft_size * 8
+                || rec->len > dst->dt_size - (dst_slot * MC_SLOT_SIZE)) {
+            break;
+        }
+
+        new_rec = MC_SLOT_TO_PTR(dst->data_table, dst_slot,
+                                 struct sss_mc_rec);
+        memcpy(new_rec, rec, rec->len);
+        new_rec->next1 = MC_INVALID_VAL;
+        new_rec->next2 = MC_INVALID_VAL;
+        if (!sss_mc_rehash_rec(dst, new_rec)) {
+            memset(new_rec, 0xff, rec->len);
+            slot += num_slots - 1;
+            continue;
+        }
+
+        for (i = 0; i < num_slots; i++) {
+            MC_SET_BIT(dst->free_table, dst_slot + i);
+        }
+        dst->used_slots += num_slots;
+        MC_PROBE_BIT(src->ref_table, slot, used);
+        if (used) {
+            MC_SET_BIT(dst->ref_table, dst_slot);
+        }
+        sss_mmap_chain_in_rec(dst, new_rec);
+
+        dst_slot += num_slots;
+        slot += num_slots - 1;
+        copied++;
+    }
+
+    dst->next_slot = dst_slot;
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Copied %"PRIu32" records into the grown mmap cache %s\n",
+          copied, dst->name);
+}
+
+/* Grow the cache without throwing away its content. A bigger file is built
+ * next to the current one, filled with the live records and then atomically
+ * renamed over it. Finally the old file is marked as recycled so clients
+ * switch to the new file on their next lookup. */
+static errno_t sss_mc_grow(struct sss_mc_ctx **_mcc)
+{
+    struct sss_mc_ctx *old_ctx = *_mcc;
+    struct sss_mc_ctx *new_ctx = NULL;
+    char *tmp_file = NULL;
+    mode_t old_mask;
+    size_t n_elem;
+    errno_t ret;
+
+    n_elem = old_ctx->ft_size * 8 * 2;
+    if (n_elem > old_ctx->max_elems) {
+        return ERANGE;
+    }
+
+    ret = sss_mc_ctx_new(talloc_parent(old_ctx), old_ctx->name, old_ctx->type,
+                         n_elem, old_ctx->valid_time_slot, &new_ctx);
+    if (ret != EOK) {
+        return ret;
+    }
+    new_ctx->max_elems = old_ctx->max_elems;
+
+    tmp_file = talloc_asprintf(new_ctx, "%s.grow", new_ctx->file);
+    if (tmp_file == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* leftover from a previous failed attempt */
+    errno = 0;
+    ret = unlink(tmp_file);
+    if (ret == -1 && errno != ENOENT) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to rm mmap file %s: %d(%s)\n",
+                                    tmp_file, ret, strerror(ret));
+        goto done;
+    }
+
+    /* same permissions as in sss_mc_create_file() */
+    old_mask = umask(0022);
+    errno = 0;
+    new_ctx->fd = open(tmp_file, O_CREAT | O_EXCL | O_RDWR, 0644);
+    umask(old_mask);
+    if (new_ctx->fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to open mmap file %s: %d(%s)\n",
+                                    tmp_file, ret, strerror(ret));
+        goto done;
+    }
+
+    ret = sss_br_lock_file(new_ctx->fd, 0, 1, 3, 50000);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to lock file %s.\n", tmp_file);
+        goto done;
+    }
+
+    ret = sss_mc_map_file(new_ctx, tmp_file);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    new_ctx->seed = old_ctx->seed;
+    new_ctx->fold_case = old_ctx->fold_case;
+    sss_mc_copy_records(old_ctx, new_ctx);
+    *sss_mc_stats(new_ctx) = *sss_mc_stats(old_ctx);
+    sss_mc_stats(new_ctx)->grows++;
+    sss_mc_header_update(new_ctx, SSS_MC_HEADER_ALIVE);
+
+    ret = rename(tmp_file, new_ctx->file);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to rename %s to %s: %d(%s)\n",
+                                    tmp_file, new_ctx->file,
+                                    ret, strerror(ret));
+        goto done;
+    }
+
+    DEBUG(SSSDBG_CONF_SETTINGS,
+          "Grew mmap cache %s from %"PRIu32" to %zu elements\n",
+          new_ctx->name, old_ctx->ft_size * 8, n_elem);
+
+    /* clients still using the old file must move to the new one */
+    sss_mc_header_update(old_ctx, SSS_MC_HEADER_RECYCLED);
+    talloc_free(old_ctx);
+    *_mcc = new_ctx;
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        if (new_ctx->fd != -1) {
+            unlink(tmp_file);
+        }
+        talloc_free(new_ctx);
+    } else {
+        talloc_free(tmp_file);
+    }
+    return ret;
+}
+
 errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx, size_t n_elem,
                               time_t timeout, struct sss_mc_ctx **mc_ctx)
 {
@@ -1345,6 +2436,7 @@ errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx, size_t n_elem,
     TALLOC_CTX* tmp_ctx = NULL;
     char *name;
     enum sss_mc_type type;
+    bool fold_case;
 
     if (mc_ctx == NULL || (*mc_ctx) == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE,
@@ -1366,6 +2458,7 @@ errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx, size_t n_elem,
     }
 
     type = (*mc_ctx)->type;
+    fold_case = (*mc_ctx)->fold_case;
 
     if (n_elem == (size_t)-1) {
         n_elem = (*mc_ctx)->ft_size * 8;
@@ -1386,6 +2479,10 @@ errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx, size_t n_elem,
         goto done;
     }
 
+    if (fold_case) {
+        sss_mmap_cache_set_fold_case(*mc_ctx, true);
+    }
+
 done:
     talloc_free(tmp_ctx);
     return ret;
@@ -1407,6 +2504,20 @@ void sss_mmap_cache_reset(struct sss_mc_ctx *mc_ctx)
     memset(mc_ctx->data_table, 0xff, mc_ctx->dt_size);
     memset(mc_ctx->free_table, 0x00, mc_ctx->ft_size);
     memset(mc_ctx->hash_table, 0xff, mc_ctx->ht_size);
+    memset(mc_ctx->ref_table, 0x00, mc_ctx->ft_size);
+    mc_ctx->used_slots = 0;
+    mc_ctx->evictions = 0;
 
     sss_mc_header_update(mc_ctx, SSS_MC_HEADER_ALIVE);
 }
+
+void sss_mmap_cache_set_fold_case(struct sss_mc_ctx *mc_ctx, bool fold_case)
+{
+    if (mc_ctx == NULL || mc_ctx->fold_case == fold_case) {
+        return;
+    }
+
+    /* the stored records were hashed the other way, start over */
+    mc_ctx->fold_case = fold_case;
+    sss_mmap_cache_reset(mc_ctx);
+}
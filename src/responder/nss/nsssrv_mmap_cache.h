@@ -23,6 +23,8 @@
 #define _NSSSRV_MMAP_CACHE_H_
 
 #define SSS_MC_CACHE_ELEMENTS 50000
+/* only the users that run sudo get records in the sudo cache */
+#define SSS_MC_SUDO_CACHE_ELEMENTS 5000
 
 struct sss_mc_ctx;
 
@@ -31,6 +33,11 @@ enum sss_mc_type {
     SSS_MC_PASSWD,
     SSS_MC_GROUP,
     SSS_MC_INITGROUPS,
+    SSS_MC_NETGROUP,
+    SSS_MC_SID,
+    SSS_MC_SERVICES,
+    SSS_MC_SUDO,
+    SSS_MC_AUTOFS,
 };
 
 errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
@@ -43,7 +50,8 @@ errno_t sss_mmap_cache_pw_store(struct sss_mc_ctx **_mcc,
                                 uid_t uid, gid_t gid,
                                 struct sized_string *gecos,
                                 struct sized_string *homedir,
-                                struct sized_string *shell);
+                                struct sized_string *shell,
+                                bool case_insensitive);
 
 errno_t sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
                                 struct sized_string *name,
@@ -57,6 +65,39 @@ errno_t sss_mmap_cache_initgr_store(struct sss_mc_ctx **_mcc,
                                     uint32_t num_groups,
                                     uint8_t *gids_buf);
 
+errno_t sss_mmap_cache_netgr_store(struct sss_mc_ctx **_mcc,
+                                   struct sized_string *name,
+                                   uint32_t num_entries,
+                                   uint8_t *entries_buf,
+                                   size_t entries_len);
+
+errno_t sss_mmap_cache_sid_store(struct sss_mc_ctx **_mcc,
+                                 struct sized_string *sid,
+                                 struct sized_string *name,
+                                 uint32_t id,
+                                 uint32_t id_type,
+                                 bool by_id);
+
+errno_t sss_mmap_cache_svc_store(struct sss_mc_ctx **_mcc,
+                                 struct sized_string *key,
+                                 struct sized_string *alt_key,
+                                 struct sized_string *name,
+                                 struct sized_string *proto,
+                                 uint32_t port,
+                                 uint32_t num_aliases,
+                                 uint8_t *aliases_buf,
+                                 size_t aliases_len);
+
+errno_t sss_mmap_cache_sudo_store(struct sss_mc_ctx **_mcc,
+                                  struct sized_string *key,
+                                  uint32_t num_rules,
+                                  uint8_t *reply_buf,
+                                  size_t reply_len);
+
+errno_t sss_mmap_cache_autofs_store(struct sss_mc_ctx **_mcc,
+                                    struct sized_string *key,
+                                    struct sized_string *value);
+
 errno_t sss_mmap_cache_pw_invalidate(struct sss_mc_ctx *mcc,
                                      struct sized_string *name);
 
@@ -70,9 +111,25 @@ errno_t sss_mmap_cache_gr_invalidate_gid(struct sss_mc_ctx *mcc, gid_t gid);
 errno_t sss_mmap_cache_initgr_invalidate(struct sss_mc_ctx *mcc,
                                          struct sized_string *name);
 
+errno_t sss_mmap_cache_netgr_invalidate(struct sss_mc_ctx *mcc,
+                                        struct sized_string *name);
+
+errno_t sss_mmap_cache_sid_invalidate(struct sss_mc_ctx *mcc,
+                                      struct sized_string *sid);
+
+errno_t sss_mmap_cache_sid_invalidate_id(struct sss_mc_ctx *mcc, uint32_t id);
+
+errno_t sss_mmap_cache_sid_invalidate_name(struct sss_mc_ctx *mcc,
+                                           struct sized_string *name);
+
 errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx, size_t n_elem,
                               time_t timeout, struct sss_mc_ctx **mc_ctx);
 
 void sss_mmap_cache_reset(struct sss_mc_ctx *mc_ctx);
 
+/* Hash the keys case folded so that names of case insensitive domains can
+ * be found by clients regardless of their case. Changing it empties the
+ * cache. */
+void sss_mmap_cache_set_fold_case(struct sss_mc_ctx *mc_ctx, bool fold_case);
+
 #endif /* _NSSSRV_MMAP_CACHE_H_ */
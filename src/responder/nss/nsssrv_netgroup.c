@@ -27,6 +27,7 @@
 #include "responder/nss/nsssrv.h"
 #include "responder/nss/nsssrv_private.h"
 #include "responder/nss/nsssrv_netgroup.h"
+#include "responder/nss/nsssrv_mmap_cache.h"
 #include "responder/common/negcache.h"
 #include "confdb/confdb.h"
 #include "db/sysdb.h"
@@ -429,6 +430,27 @@ static void set_netgr_lifetime(uint32_t lifetime,
     }
 }
 
+/* The netgroup is gone, clients must not iterate over it from the memory
+ * cache anymore */
+static void nss_invalidate_netgr_memcache(struct nss_ctx *nctx,
+                                          const char *name)
+{
+    struct sized_string key;
+    errno_t ret;
+
+    if (nctx->netgr_mc_ctx == NULL) {
+        return;
+    }
+
+    to_sized_string(&key, name);
+    ret = sss_mmap_cache_netgr_invalidate(nctx->netgr_mc_ctx, &key);
+    if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Internal failure in memory cache code: %d [%s]\n",
+              ret, strerror(ret));
+    }
+}
+
 /* Create dummy netgroup to speed up repeated negative queries */
 static errno_t create_negcache_netgr(struct setent_step_ctx *step_ctx)
 {
@@ -467,6 +489,7 @@ static errno_t create_negcache_netgr(struct setent_step_ctx *step_ctx)
     netgr->found = false;
 
     set_netgr_lifetime(step_ctx->nctx->neg_timeout, step_ctx, netgr);
+    nss_invalidate_netgr_memcache(step_ctx->nctx, step_ctx->name);
 
     ret = EOK;
 
@@ -478,6 +501,9 @@ done:
     return ret;
 }
 
+static void nss_update_netgr_memcache(struct nss_ctx *nctx,
+                                      struct getent_ctx *netgr);
+
 static errno_t lookup_netgr_step(struct setent_step_ctx *step_ctx)
 {
     errno_t ret;
@@ -586,6 +612,7 @@ static errno_t lookup_netgr_step(struct setent_step_ctx *step_ctx)
             netgr->ready = true;
             netgr->found = false;
             set_netgr_lifetime(step_ctx->nctx->neg_timeout, step_ctx, netgr);
+            nss_invalidate_netgr_memcache(step_ctx->nctx, netgr->name);
             ret = EIO;
             goto done;
         }
@@ -622,6 +649,8 @@ static errno_t lookup_netgr_step(struct setent_step_ctx *step_ctx)
         if (lifetime < 10) lifetime = 10;
         set_netgr_lifetime(lifetime, step_ctx, netgr);
 
+        nss_update_netgr_memcache(step_ctx->nctx, netgr);
+
         ret = EOK;
         goto done;
     }
@@ -945,15 +974,75 @@ done:
     return EOK;
 }
 
+/* Returns the space needed to serialize the entry or 0 if the entry is not
+ * valid and must be skipped */
+static size_t netgr_entry_len(struct sysdb_netgroup_ctx *entry)
+{
+    size_t len;
+
+    if (entry->type == SYSDB_NETGROUP_TRIPLE_VAL) {
+        len = sizeof(uint32_t) + 3;
+        if (entry->value.triple.hostname) {
+            len += strlen(entry->value.triple.hostname);
+        }
+        if (entry->value.triple.username) {
+            len += strlen(entry->value.triple.username);
+        }
+        if (entry->value.triple.domainname) {
+            len += strlen(entry->value.triple.domainname);
+        }
+        return len;
+    } else if (entry->type == SYSDB_NETGROUP_GROUP_VAL) {
+        if (entry->value.groupname == NULL ||
+            entry->value.groupname[0] == '\0') {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Empty netgroup member. Please check your cache.\n");
+            return 0;
+        }
+        return sizeof(uint32_t) + strlen(entry->value.groupname) + 1;
+    }
+
+    DEBUG(SSSDBG_CRIT_FAILURE,
+          "Unexpected value type for netgroup entry. "
+              "Please check your cache.\n");
+    return 0;
+}
+
+static void netgr_pack_str(uint8_t *body, size_t *rp, const char *str)
+{
+    size_t len;
+
+    if (str == NULL) {
+        body[*rp] = '\0';
+        *rp += 1;
+        return;
+    }
+
+    len = strlen(str) + 1;
+    memcpy(&body[*rp], str, len);
+    *rp += len;
+}
+
+/* Serialize an entry whose length was computed by netgr_entry_len() */
+static void netgr_entry_pack(struct sysdb_netgroup_ctx *entry,
+                             uint8_t *body, size_t *rp)
+{
+    if (entry->type == SYSDB_NETGROUP_TRIPLE_VAL) {
+        SAFEALIGN_SET_UINT32(&body[*rp], SSS_NETGR_REP_TRIPLE, rp);
+        netgr_pack_str(body, rp, entry->value.triple.hostname);
+        netgr_pack_str(body, rp, entry->value.triple.username);
+        netgr_pack_str(body, rp, entry->value.triple.domainname);
+    } else {
+        SAFEALIGN_SET_UINT32(&body[*rp], SSS_NETGR_REP_GROUP, rp);
+        netgr_pack_str(body, rp, entry->value.groupname);
+    }
+}
+
 static errno_t nss_cmd_retnetgrent(struct cli_ctx *client,
                                    struct sysdb_netgroup_ctx **entries,
                                    int count)
 {
     size_t len;
-    size_t hostlen = 0;
-    size_t userlen = 0;
-    size_t domainlen = 0;
-    size_t grouplen = 0;
     uint8_t *body;
     size_t blen, rp;
     errno_t ret;
@@ -969,102 +1058,88 @@ static errno_t nss_cmd_retnetgrent(struct cli_ctx *client,
     num = 0;
     while (entries[client->netgrent_cur] &&
            (client->netgrent_cur - start) < count) {
-        if (entries[client->netgrent_cur]->type == SYSDB_NETGROUP_TRIPLE_VAL) {
-            hostlen = 1;
-            if (entries[client->netgrent_cur]->value.triple.hostname) {
-                hostlen += strlen(entries[client->netgrent_cur]->value.triple.hostname);
-            }
+        len = netgr_entry_len(entries[client->netgrent_cur]);
+        if (len == 0) {
+            client->netgrent_cur++;
+            continue;
+        }
 
-            userlen = 1;
-            if (entries[client->netgrent_cur]->value.triple.username) {
-                userlen += strlen(entries[client->netgrent_cur]->value.triple.username);
-            }
+        ret = sss_packet_grow(packet, len);
+        if (ret != EOK) {
+            return ret;
+        }
+        sss_packet_get_body(packet, &body, &blen);
 
-            domainlen = 1;
-            if (entries[client->netgrent_cur]->value.triple.domainname) {
-                domainlen += strlen(entries[client->netgrent_cur]->value.triple.domainname);
-            }
+        netgr_entry_pack(entries[client->netgrent_cur], body, &rp);
 
-            len = sizeof(uint32_t) + hostlen + userlen + domainlen;
-            ret = sss_packet_grow(packet, len);
-            if (ret != EOK) {
-                return ret;
-            }
-            sss_packet_get_body(packet, &body, &blen);
+        num++;
+        client->netgrent_cur++;
+    }
 
-            SAFEALIGN_SET_UINT32(&body[rp], SSS_NETGR_REP_TRIPLE, &rp);
+    sss_packet_get_body(packet, &body, &blen);
 
-            if (hostlen == 1) {
-                body[rp] = '\0';
-            } else {
-                memcpy(&body[rp],
-                       entries[client->netgrent_cur]->value.triple.hostname,
-                       hostlen);
-            }
-            rp += hostlen;
+    /* num results */
+    SAFEALIGN_COPY_UINT32(body, &num, NULL);
 
-            if (userlen == 1) {
-                body[rp] = '\0';
-            } else {
-                memcpy(&body[rp],
-                       entries[client->netgrent_cur]->value.triple.username,
-                       userlen);
-            }
-            rp += userlen;
+    /* reserved */
+    SAFEALIGN_SETMEM_UINT32(body + sizeof(uint32_t), 0, NULL);
 
-            if (domainlen == 1) {
-                body[rp] = '\0';
-            } else {
-                memcpy(&body[rp],
-                       entries[client->netgrent_cur]->value.triple.domainname,
-                       domainlen);
-            }
-            rp += domainlen;
-        } else if (entries[client->netgrent_cur]->type == SYSDB_NETGROUP_GROUP_VAL) {
-            if (entries[client->netgrent_cur]->value.groupname == NULL ||
-                entries[client->netgrent_cur]->value.groupname[0] == '\0') {
-                DEBUG(SSSDBG_CRIT_FAILURE,
-                      "Empty netgroup member. Please check your cache.\n");
-                continue;
-            }
+    return EOK;
+}
 
-            grouplen = 1 + strlen(entries[client->netgrent_cur]->value.groupname);
+/* Store all entries of a resolved netgroup in the memory cache so that
+ * clients can iterate over it without contacting the responder */
+static void nss_update_netgr_memcache(struct nss_ctx *nctx,
+                                      struct getent_ctx *netgr)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sized_string name;
+    uint8_t *buf;
+    size_t buf_len = 0;
+    size_t rp = 0;
+    uint32_t num = 0;
+    size_t len;
+    int i;
+    errno_t ret;
 
-            len = sizeof(uint32_t) + grouplen;
+    if (nctx->netgr_mc_ctx == NULL || netgr->entries == NULL) {
+        return;
+    }
 
-            ret = sss_packet_grow(packet, len);
-            if (ret != EOK) {
-                return ret;
-            }
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return;
+    }
 
-            sss_packet_get_body(packet, &body, &blen);
+    for (i = 0; netgr->entries[i] != NULL; i++) {
+        buf_len += netgr_entry_len(netgr->entries[i]);
+    }
 
-            SAFEALIGN_SET_UINT32(&body[rp], SSS_NETGR_REP_GROUP, &rp);
+    buf = talloc_size(tmp_ctx, buf_len);
+    if (buf == NULL) {
+        goto done;
+    }
 
-            memcpy(&body[rp],
-                   entries[client->netgrent_cur]->value.groupname,
-                   grouplen);
-            rp += grouplen;
-        } else {
-            DEBUG(SSSDBG_CRIT_FAILURE,
-                  "Unexpected value type for netgroup entry. "
-                      "Please check your cache.\n");
+    for (i = 0; netgr->entries[i] != NULL; i++) {
+        len = netgr_entry_len(netgr->entries[i]);
+        if (len == 0) {
             continue;
         }
-
+        netgr_entry_pack(netgr->entries[i], buf, &rp);
         num++;
-        client->netgrent_cur++;
     }
 
-    sss_packet_get_body(packet, &body, &blen);
-
-    /* num results */
-    SAFEALIGN_COPY_UINT32(body, &num, NULL);
-
-    /* reserved */
-    SAFEALIGN_SETMEM_UINT32(body + sizeof(uint32_t), 0, NULL);
+    to_sized_string(&name, netgr->name);
+    ret = sss_mmap_cache_netgr_store(&nctx->netgr_mc_ctx, &name,
+                                     num, buf, rp);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Failed to store netgroup %s in mmap cache [%d]: %s\n",
+              netgr->name, ret, sss_strerror(ret));
+    }
 
-    return EOK;
+done:
+    talloc_free(tmp_ctx);
 }
 
 int nss_cmd_endnetgrent(struct cli_ctx *client)
@@ -1127,6 +1202,8 @@ errno_t nss_orphan_netgroups(struct nss_ctx *nctx)
 
     DEBUG(SSSDBG_TRACE_FUNC, "Removing netgroups from memory cache.\n");
 
+    sss_mmap_cache_reset(nctx->netgr_mc_ctx);
+
     for (i = 0; i < mcount; i++) {
         /* netgroup entry will be deleted by setnetgrent_result_timeout */
         hret = hash_delete(nctx->netgroups, &netgroups[i]);
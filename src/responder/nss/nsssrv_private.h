@@ -46,7 +46,9 @@ struct nss_cmd_ctx {
 
 struct dom_ctx {
     struct sss_domain_info *domain;
+    /* either the whole result or a cursor over it, see enum_cursor */
     struct ldb_result *res;
+    struct sysdb_enum_cursor *cursor;
 };
 
 struct getent_ctx {
@@ -75,11 +77,16 @@ struct nss_dom_ctx {
     /* cache results */
     struct ldb_result *res;
 
+    /* precomputed initgroups result, res holds only the user then */
+    gid_t *initgr_gids;
+    size_t num_initgr_gids;
+
     /* Netgroup-specific */
     struct getent_ctx *netgr;
 
     /* Service-specific */
     const char *protocol;
+    const char *svc_mc_key;
 
     const char *mc_name;
 };
@@ -27,6 +27,8 @@
 #include "responder/nss/nsssrv_private.h"
 #include "responder/nss/nsssrv_services.h"
 #include "responder/common/negcache.h"
+#include "util/mmap_cache.h"
+#include "responder/nss/nsssrv_mmap_cache.h"
 #include "confdb/confdb.h"
 #include "db/sysdb.h"
 #include "db/sysdb_services.h"
@@ -777,6 +779,115 @@ done:
 
     return ret;
 }
+/* Build the memory cache key of a lookup, see struct sss_mc_svc_data.
+ * Returns NULL if the lookup cannot be cached because the key would be
+ * ambiguous. */
+static char *nss_svc_mc_key(TALLOC_CTX *mem_ctx,
+                            const char *name, uint16_t port,
+                            const char *protocol)
+{
+    if (protocol == NULL) {
+        protocol = "";
+    } else if (strchr(protocol, '/') != NULL) {
+        return NULL;
+    }
+
+    if (name == NULL) {
+        return talloc_asprintf(mem_ctx, "%c%"PRIu16"/%s",
+                               SSS_MC_SVC_PORT_KEY_PREFIX, port, protocol);
+    }
+
+    if (name[0] == SSS_MC_SVC_PORT_KEY_PREFIX || strchr(name, '/') != NULL) {
+        return NULL;
+    }
+
+    return talloc_asprintf(mem_ctx, "%s/%s", name, protocol);
+}
+
+/* Store a single result reply in the services memory cache, for both the
+ * lookup that was done and, when a protocol was given, the lookup by the
+ * other key of the service */
+static void nss_update_svc_memcache(struct nss_dom_ctx *dctx)
+{
+    struct cli_ctx *cctx = dctx->cmdctx->cctx;
+    struct nss_ctx *nctx;
+    struct sized_string key;
+    struct sized_string alt_key;
+    struct sized_string name;
+    struct sized_string proto;
+    uint32_t num_results;
+    uint32_t port;
+    uint32_t num_aliases;
+    char *alt_key_str;
+    uint8_t *body;
+    size_t blen;
+    size_t pos;
+    errno_t ret;
+
+    if (dctx->svc_mc_key == NULL) {
+        return;
+    }
+
+    nctx = talloc_get_type(cctx->rctx->pvt_ctx, struct nss_ctx);
+    if (nctx->svc_mc_ctx == NULL) {
+        return;
+    }
+
+    sss_packet_get_body(cctx->creq->out, &body, &blen);
+    if (blen < 4 * sizeof(uint32_t)) {
+        return;
+    }
+
+    /* clients only accept replies with exactly one result */
+    SAFEALIGN_COPY_UINT32(&num_results, body, NULL);
+    if (num_results != 1) {
+        return;
+    }
+
+    pos = 2 * sizeof(uint32_t);
+    SAFEALIGN_COPY_UINT32(&port, body + pos, &pos);
+    SAFEALIGN_COPY_UINT32(&num_aliases, body + pos, &pos);
+
+    name.str = (const char *)body + pos;
+    name.len = strnlen(name.str, blen - pos) + 1;
+    pos += name.len;
+    if (pos >= blen) {
+        return;
+    }
+    proto.str = (const char *)body + pos;
+    proto.len = strnlen(proto.str, blen - pos) + 1;
+    pos += proto.len;
+    if (pos > blen) {
+        return;
+    }
+
+    if (dctx->protocol == NULL) {
+        alt_key_str = talloc_strdup(dctx, dctx->svc_mc_key);
+    } else if (sss_packet_get_cmd(cctx->creq->in) == SSS_NSS_GETSERVBYNAME) {
+        alt_key_str = nss_svc_mc_key(dctx, NULL, ntohs((uint16_t)port),
+                                     dctx->protocol);
+    } else {
+        alt_key_str = nss_svc_mc_key(dctx, name.str, 0, dctx->protocol);
+    }
+    if (alt_key_str == NULL) {
+        return;
+    }
+
+    to_sized_string(&key, dctx->svc_mc_key);
+    to_sized_string(&alt_key, alt_key_str);
+
+    ret = sss_mmap_cache_svc_store(&nctx->svc_mc_ctx, &key, &alt_key,
+                                   &name, &proto, port, num_aliases,
+                                   body + pos, blen - pos);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Failed to store service %s in the memory cache [%d]: %s\n",
+              name.str, ret, sss_strerror(ret));
+    }
+
+    talloc_free(alt_key_str);
+}
+
 /*****************
  * getservbyname *
  *****************/
@@ -837,6 +948,8 @@ int nss_cmd_getservbyname(struct cli_ctx *cctx)
     }
 
     dctx->protocol = service_protocol;
+    dctx->svc_mc_key = nss_svc_mc_key(dctx, (const char *)body, 0,
+                                      service_protocol);
 
     DEBUG(SSSDBG_TRACE_FUNC,
           "Requesting info for service [%s:%s] from [%s]\n",
@@ -1020,6 +1133,9 @@ nss_cmd_getserv_done(struct tevent_req *req)
                                dctx->protocol,
                                dctx->res->msgs,
                                &i);
+            if (ret == EOK) {
+                nss_update_svc_memcache(dctx);
+            }
         }
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE,
@@ -1148,6 +1264,7 @@ int nss_cmd_getservbyport(struct cli_ctx *cctx)
     }
 
     dctx->protocol = service_protocol;
+    dctx->svc_mc_key = nss_svc_mc_key(dctx, NULL, port, service_protocol);
 
     DEBUG(SSSDBG_TRACE_FUNC,
           "Requesting info for service on port [%"PRIu16"/%s]\n",
@@ -0,0 +1,620 @@
+/*
+   SSSD
+
+   NSS Responder - worker processes
+
+   Copyright (C) Red Hat 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The NSS responder can run additional worker processes which accept
+ * clients on the same pipe. Only the main process owns the memory caches,
+ * so the workers forward every lookup they answered successfully to it
+ * over a private connection. The main process serves these like any other
+ * client request, from the now up to date cache, which stores the result
+ * in the memory caches. The replies are discarded by the workers.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include "util/util.h"
+#include "util/child_common.h"
+#include "responder/nss/nsssrv.h"
+
+#ifndef NSS_WORKER_BINARY
+#define NSS_WORKER_BINARY SSSD_LIBEXEC_PATH"/sssd_nss"
+#endif /* NSS_WORKER_BINARY */
+
+/* how long to wait before restarting a worker that exited */
+#define NSS_WORKER_RESTART_DELAY 1
+/* lookups waiting to be forwarded before new ones are dropped */
+#define NSS_WORKER_MAX_FORWARDS 1024
+
+/* main process side */
+
+struct nss_worker {
+    struct nss_workers_ctx *wctx;
+    int idx;
+    pid_t pid;
+    struct sss_child_ctx *child_ctx;
+    struct tevent_timer *restart_te;
+};
+
+struct nss_workers_ctx {
+    struct nss_ctx *nctx;
+    struct sss_sigchild_ctx *sigchld_ctx;
+    int num_workers;
+    struct nss_worker *workers;
+};
+
+static errno_t nss_worker_spawn(struct nss_worker *worker);
+
+static errno_t nss_worker_clear_cloexec(int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFD, 0);
+    if (flags == -1 || fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC) == -1) {
+        return errno;
+    }
+
+    return EOK;
+}
+
+static errno_t nss_worker_argv(TALLOC_CTX *mem_ctx, int listen_fd,
+                               int writer_fd, char ***_argv)
+{
+    char **argv;
+    int argc = 0;
+
+    /* binary, uid, gid, up to four debug options, two fds and NULL */
+    argv = talloc_zero_array(mem_ctx, char *, 11);
+    if (argv == NULL) {
+        return ENOMEM;
+    }
+
+    argv[argc++] = talloc_strdup(argv, NSS_WORKER_BINARY);
+    argv[argc++] = talloc_asprintf(argv, "--uid=%"SPRIuid, geteuid());
+    argv[argc++] = talloc_asprintf(argv, "--gid=%"SPRIgid, getegid());
+    argv[argc++] = talloc_asprintf(argv, "--debug-level=%#.4x", debug_level);
+    if (debug_to_file) {
+        argv[argc++] = talloc_strdup(argv, "--debug-to-files");
+    } else if (debug_to_stderr) {
+        argv[argc++] = talloc_strdup(argv, "--debug-to-stderr");
+    }
+    argv[argc++] = talloc_asprintf(argv, "--debug-timestamps=%d",
+                                   debug_timestamps);
+    argv[argc++] = talloc_asprintf(argv, "--debug-microseconds=%d",
+                                   debug_microseconds);
+    argv[argc++] = talloc_asprintf(argv, "--worker-listen-fd=%d", listen_fd);
+    argv[argc++] = talloc_asprintf(argv, "--worker-writer-fd=%d", writer_fd);
+
+    while (argc > 0) {
+        if (argv[--argc] == NULL) {
+            talloc_free(argv);
+            return ENOMEM;
+        }
+    }
+
+    *_argv = argv;
+    return EOK;
+}
+
+static void nss_worker_restart(struct tevent_context *ev,
+                               struct tevent_timer *te,
+                               struct timeval current_time,
+                               void *pvt)
+{
+    struct nss_worker *worker = talloc_get_type(pvt, struct nss_worker);
+    errno_t ret;
+
+    worker->restart_te = NULL;
+
+    ret = nss_worker_spawn(worker);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to restart NSS worker %d [%d]: %s\n",
+              worker->idx, ret, sss_strerror(ret));
+    }
+}
+
+static void nss_worker_exited(int pid, int wait_status, void *pvt)
+{
+    struct nss_worker *worker = talloc_get_type(pvt, struct nss_worker);
+    struct tevent_context *ev = worker->wctx->nctx->rctx->ev;
+    struct timeval tv;
+
+    if (WIFEXITED(wait_status)) {
+        DEBUG(SSSDBG_OP_FAILURE, "NSS worker %d [%d] exited with status %d\n",
+              worker->idx, pid, WEXITSTATUS(wait_status));
+    } else if (WIFSIGNALED(wait_status)) {
+        DEBUG(SSSDBG_OP_FAILURE, "NSS worker %d [%d] was killed by signal "
+              "%d\n", worker->idx, pid, WTERMSIG(wait_status));
+    }
+
+    worker->pid = 0;
+
+    if (worker->wctx->nctx->rctx->shutting_down) {
+        return;
+    }
+
+    /* the helper connection was closed together with the worker, restart
+     * it a little later so a worker failing at start does not spin */
+    tv = tevent_timeval_current_ofs(NSS_WORKER_RESTART_DELAY, 0);
+    worker->restart_te = tevent_add_timer(ev, worker, tv,
+                                          nss_worker_restart, worker);
+    if (worker->restart_te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to schedule the restart of NSS worker %d\n",
+              worker->idx);
+    }
+}
+
+static errno_t nss_worker_spawn(struct nss_worker *worker)
+{
+    struct resp_ctx *rctx = worker->wctx->nctx->rctx;
+    char **argv = NULL;
+    int sv[2] = { -1, -1 };
+    pid_t pid;
+    errno_t ret;
+
+    /* the previous process, if any, is gone */
+    talloc_zfree(worker->child_ctx);
+
+    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "socketpair failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = nss_worker_argv(worker, rctx->lfd, sv[1], &argv);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        /* child */
+        close(sv[0]);
+
+        ret = nss_worker_clear_cloexec(rctx->lfd);
+        if (ret == EOK) {
+            ret = nss_worker_clear_cloexec(sv[1]);
+        }
+        if (ret == EOK) {
+            execv(NSS_WORKER_BINARY, argv);
+            ret = errno;
+        }
+
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to start NSS worker [%d]: %s\n",
+              ret, sss_strerror(ret));
+        _exit(1);
+    } else if (pid == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "fork failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    /* parent */
+    close(sv[1]);
+    sv[1] = -1;
+
+    worker->pid = pid;
+
+    ret = sss_child_register(worker, worker->wctx->sigchld_ctx, pid,
+                             nss_worker_exited, worker, &worker->child_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to watch NSS worker %d [%d]: %s\n",
+              worker->idx, ret, sss_strerror(ret));
+        kill(pid, SIGTERM);
+        goto done;
+    }
+
+    ret = sss_fd_nonblocking(sv[0]);
+    if (ret != EOK) {
+        kill(pid, SIGTERM);
+        goto done;
+    }
+
+    ret = sss_responder_add_helper_client(rctx, sv[0]);
+    if (ret != EOK) {
+        kill(pid, SIGTERM);
+        goto done;
+    }
+    /* owned by the client context now */
+    sv[0] = -1;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Started NSS worker %d [%d]\n", worker->idx, pid);
+
+    ret = EOK;
+
+done:
+    if (sv[0] != -1) {
+        close(sv[0]);
+    }
+    if (sv[1] != -1) {
+        close(sv[1]);
+    }
+    talloc_free(argv);
+    return ret;
+}
+
+errno_t nss_workers_start(struct nss_ctx *nctx, int num_workers)
+{
+    struct nss_workers_ctx *wctx;
+    errno_t ret;
+    int i;
+
+    wctx = talloc_zero(nctx, struct nss_workers_ctx);
+    if (wctx == NULL) {
+        return ENOMEM;
+    }
+    wctx->nctx = nctx;
+    wctx->num_workers = num_workers;
+
+    ret = sss_sigchld_init(wctx, nctx->rctx->ev, &wctx->sigchld_ctx);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    wctx->workers = talloc_zero_array(wctx, struct nss_worker, num_workers);
+    if (wctx->workers == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+
+    for (i = 0; i < num_workers; i++) {
+        wctx->workers[i].wctx = wctx;
+        wctx->workers[i].idx = i + 1;
+
+        ret = nss_worker_spawn(&wctx->workers[i]);
+        if (ret != EOK) {
+            /* keep the workers that did start */
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Unable to start NSS worker %d [%d]: %s\n",
+                  i + 1, ret, sss_strerror(ret));
+        }
+    }
+
+    nctx->workers = wctx;
+    return EOK;
+
+fail:
+    talloc_free(wctx);
+    return ret;
+}
+
+void nss_workers_signal(struct nss_ctx *nctx, int signum)
+{
+    int i;
+
+    if (nctx->workers == NULL) {
+        return;
+    }
+
+    for (i = 0; i < nctx->workers->num_workers; i++) {
+        if (nctx->workers->workers[i].pid > 0) {
+            kill(nctx->workers->workers[i].pid, signum);
+        }
+    }
+}
+
+/* worker side */
+
+struct nss_forward {
+    struct nss_forward *prev;
+    struct nss_forward *next;
+
+    uint8_t *buf;
+    size_t len;
+};
+
+struct nss_cache_writer {
+    int fd;
+    struct tevent_fd *fde;
+
+    struct nss_forward *queue;
+    size_t queue_len;
+
+    /* progress of the first queued lookup */
+    size_t sent;
+    bool waiting;
+    uint8_t reply_hdr[SSS_NSS_HEADER_SIZE];
+    size_t hdr_read;
+    size_t reply_left;
+};
+
+static bool nss_worker_forwarded_cmd(enum sss_cli_command cmd)
+{
+    switch (cmd) {
+    case SSS_NSS_GETPWNAM:
+    case SSS_NSS_GETPWUID:
+    case SSS_NSS_GETGRNAM:
+    case SSS_NSS_GETGRGID:
+    case SSS_NSS_INITGR:
+    case SSS_NSS_GETSERVBYNAME:
+    case SSS_NSS_GETSERVBYPORT:
+    case SSS_NSS_GETSIDBYNAME:
+    case SSS_NSS_GETSIDBYID:
+    case SSS_NSS_GETNAMEBYSID:
+    case SSS_NSS_GETIDBYSID:
+    case SSS_NSS_GETBATCH:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void nss_cache_writer_next(struct nss_cache_writer *writer)
+{
+    struct nss_forward *fwd = writer->queue;
+
+    DLIST_REMOVE(writer->queue, fwd);
+    writer->queue_len--;
+    talloc_free(fwd);
+
+    writer->sent = 0;
+    writer->waiting = false;
+    writer->hdr_read = 0;
+    writer->reply_left = 0;
+
+    if (writer->queue != NULL) {
+        TEVENT_FD_WRITEABLE(writer->fde);
+    }
+}
+
+static void nss_cache_writer_send(struct nss_cache_writer *writer)
+{
+    struct nss_forward *fwd = writer->queue;
+    ssize_t len;
+
+    if (fwd == NULL || writer->waiting) {
+        TEVENT_FD_NOT_WRITEABLE(writer->fde);
+        return;
+    }
+
+    errno = 0;
+    len = send(writer->fd, fwd->buf + writer->sent,
+               fwd->len - writer->sent, 0);
+    if (len == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return;
+        }
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to forward a lookup to the NSS responder [%d]: %s\n",
+              errno, sss_strerror(errno));
+        orderly_shutdown(1);
+        return;
+    }
+
+    writer->sent += len;
+    if (writer->sent == fwd->len) {
+        /* wait for the reply before sending the next lookup */
+        writer->waiting = true;
+        TEVENT_FD_NOT_WRITEABLE(writer->fde);
+    }
+}
+
+static void nss_cache_writer_recv(struct nss_cache_writer *writer)
+{
+    uint8_t discard[1024];
+    uint32_t reply_len;
+    ssize_t len;
+
+    errno = 0;
+    if (writer->hdr_read < SSS_NSS_HEADER_SIZE) {
+        len = recv(writer->fd, writer->reply_hdr + writer->hdr_read,
+                   SSS_NSS_HEADER_SIZE - writer->hdr_read, 0);
+    } else {
+        len = recv(writer->fd, discard,
+                   MIN(writer->reply_left, sizeof(discard)), 0);
+    }
+    if (len == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return;
+        }
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to read from the NSS responder [%d]: %s\n",
+              errno, sss_strerror(errno));
+        orderly_shutdown(1);
+        return;
+    } else if (len == 0) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "The NSS responder closed the connection, exiting\n");
+        orderly_shutdown(0);
+        return;
+    }
+
+    if (!writer->waiting || writer->queue == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unexpected data from the NSS responder, exiting\n");
+        orderly_shutdown(1);
+        return;
+    }
+
+    if (writer->hdr_read < SSS_NSS_HEADER_SIZE) {
+        writer->hdr_read += len;
+        if (writer->hdr_read < SSS_NSS_HEADER_SIZE) {
+            return;
+        }
+
+        SAFEALIGN_COPY_UINT32(&reply_len, writer->reply_hdr, NULL);
+        if (reply_len < SSS_NSS_HEADER_SIZE) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Invalid reply from the NSS responder, exiting\n");
+            orderly_shutdown(1);
+            return;
+        }
+        writer->reply_left = reply_len - SSS_NSS_HEADER_SIZE;
+    } else {
+        writer->reply_left -= len;
+    }
+
+    if (writer->reply_left == 0) {
+        nss_cache_writer_next(writer);
+    }
+}
+
+static void nss_cache_writer_handler(struct tevent_context *ev,
+                                     struct tevent_fd *fde,
+                                     uint16_t flags, void *pvt)
+{
+    struct nss_cache_writer *writer =
+            talloc_get_type(pvt, struct nss_cache_writer);
+
+    if (flags & TEVENT_FD_READ) {
+        nss_cache_writer_recv(writer);
+        return;
+    }
+    if (flags & TEVENT_FD_WRITE) {
+        nss_cache_writer_send(writer);
+        return;
+    }
+}
+
+static void nss_worker_reply_sent(struct cli_ctx *cctx, void *pvt)
+{
+    struct nss_cache_writer *writer =
+            talloc_get_type(pvt, struct nss_cache_writer);
+    struct nss_forward *fwd;
+    enum sss_cli_command cmd;
+    uint32_t num_results;
+    uint8_t *body;
+    size_t blen;
+    size_t pos;
+
+    if (cctx->creq == NULL || cctx->creq->in == NULL
+            || cctx->creq->out == NULL) {
+        return;
+    }
+
+    cmd = sss_packet_get_cmd(cctx->creq->in);
+    if (!nss_worker_forwarded_cmd(cmd)) {
+        return;
+    }
+
+    /* lookups that found nothing do not update the memory caches */
+    if (sss_packet_get_status(cctx->creq->out) != EOK) {
+        return;
+    }
+    sss_packet_get_body(cctx->creq->out, &body, &blen);
+    if (blen < sizeof(uint32_t)) {
+        return;
+    }
+    SAFEALIGN_COPY_UINT32(&num_results, body, NULL);
+    if (num_results == 0) {
+        return;
+    }
+
+    if (writer->queue_len >= NSS_WORKER_MAX_FORWARDS) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Too many lookups waiting to be forwarded, dropping one\n");
+        return;
+    }
+
+    sss_packet_get_body(cctx->creq->in, &body, &blen);
+
+    fwd = talloc_zero(writer, struct nss_forward);
+    if (fwd == NULL) {
+        return;
+    }
+    fwd->len = SSS_NSS_HEADER_SIZE + blen;
+    fwd->buf = talloc_size(fwd, fwd->len);
+    if (fwd->buf == NULL) {
+        talloc_free(fwd);
+        return;
+    }
+
+    /* length, command, status and reserved, then the request body */
+    pos = 0;
+    SAFEALIGN_SET_UINT32(fwd->buf, fwd->len, &pos);
+    SAFEALIGN_SET_UINT32(fwd->buf + pos, cmd, &pos);
+    SAFEALIGN_SET_UINT32(fwd->buf + pos, 0, &pos);
+    SAFEALIGN_SET_UINT32(fwd->buf + pos, 0, &pos);
+    memcpy(fwd->buf + pos, body, blen);
+
+    DLIST_ADD_END(writer->queue, fwd, struct nss_forward *);
+    writer->queue_len++;
+
+    if (!writer->waiting) {
+        TEVENT_FD_WRITEABLE(writer->fde);
+    }
+}
+
+static void nss_worker_hup(struct tevent_context *ev,
+                           struct tevent_signal *se,
+                           int signum,
+                           int count,
+                           void *siginfo,
+                           void *private_data)
+{
+    struct nss_ctx *nctx = talloc_get_type(private_data, struct nss_ctx);
+
+    /* the logs are rotated by the generic handler of the server, the
+     * main process forwards SIGHUP when sss_cache invalidated entries */
+    sss_objcache_invalidate(nctx->rctx, NULL);
+}
+
+errno_t nss_worker_init(struct nss_ctx *nctx, int writer_fd)
+{
+    struct nss_cache_writer *writer;
+    struct tevent_signal *tes;
+    errno_t ret;
+
+    writer = talloc_zero(nctx, struct nss_cache_writer);
+    if (writer == NULL) {
+        return ENOMEM;
+    }
+    writer->fd = writer_fd;
+
+    ret = sss_fd_nonblocking(writer_fd);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    writer->fde = tevent_add_fd(nctx->rctx->ev, writer, writer_fd,
+                                TEVENT_FD_READ, nss_cache_writer_handler,
+                                writer);
+    if (writer->fde == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    tevent_fd_set_auto_close(writer->fde);
+
+    tes = tevent_add_signal(nctx->rctx->ev, writer, SIGHUP, 0,
+                            nss_worker_hup, nctx);
+    if (tes == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+
+    nctx->rctx->reply_sent_fn = nss_worker_reply_sent;
+    nctx->rctx->reply_sent_pvt = writer;
+
+    return EOK;
+
+fail:
+    talloc_free(writer);
+    return ret;
+}
@@ -59,6 +59,8 @@ struct mon_cli_iface monitor_pac_methods = {
     .clearMemcache = NULL,
     .clearEnumCache = NULL,
     .sysbusReconnect = NULL,
+    .memReport = monitor_common_mem_report,
+    .startupTimes = monitor_common_startup_times,
 };
 
 static struct data_provider_iface pac_dp_methods = {
@@ -182,6 +184,23 @@ int pac_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    ret = confdb_get_int(pac_ctx->rctx->cdb,
+                         CONFDB_PAC_CONF_ENTRY,
+                         CONFDB_PAC_LIFETIME,
+                         300, &pac_ctx->pac_lifetime);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to get PAC lifetime.\n");
+        goto fail;
+    }
+
+    if (pac_ctx->pac_lifetime > 0) {
+        ret = sss_hash_create(pac_ctx, 0, &pac_ctx->pac_cache);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE, "Failed to create PAC cache.\n");
+            goto fail;
+        }
+    }
+
     /* Set up file descriptor limits */
     ret = confdb_get_int(pac_ctx->rctx->cdb,
                          CONFDB_PAC_CONF_ENTRY,
@@ -55,6 +55,15 @@ struct pac_ctx {
     struct sss_idmap_ctx *idmap_ctx;
     struct dom_sid *my_dom_sid;
     struct local_mapping_ranges *range_map;
+
+    /* user SID -> struct pac_cache_entry of the last evaluated PAC */
+    hash_table_t *pac_cache;
+    int pac_lifetime;
+};
+
+struct pac_cache_entry {
+    char *fingerprint;
+    time_t expire;
 };
 
 struct grp_info {
@@ -64,6 +73,21 @@ struct grp_info {
 
 struct sss_cmd_table *get_pac_cmds(void);
 
+struct pac_cached_obj {
+    struct sss_domain_info *dom;
+    struct ldb_message *msg;
+};
+
+errno_t pac_search_sids(TALLOC_CTX *mem_ctx,
+                        struct pac_ctx *pac_ctx,
+                        const char **sids,
+                        size_t count,
+                        const char **attrs,
+                        hash_table_t **_objs);
+
+errno_t pac_sid_table_fill_ids(struct pac_ctx *pac_ctx,
+                               hash_table_t *sid_table);
+
 errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
                           struct pac_ctx *pac_ctx,
                           struct PAC_LOGON_INFO *logon_info,
@@ -71,6 +95,12 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
                           char **_primary_group_sid_str,
                           hash_table_t **_sid_table);
 
+errno_t get_pac_fingerprint(TALLOC_CTX *mem_ctx,
+                            struct pac_ctx *pac_ctx,
+                            const char *user_dom_sid_str,
+                            struct PAC_LOGON_INFO *logon_info,
+                            char **_fingerprint);
+
 errno_t get_data_from_pac(TALLOC_CTX *mem_ctx,
                           uint8_t *pac_blob, size_t pac_len,
                           struct PAC_LOGON_INFO **_logon_info);
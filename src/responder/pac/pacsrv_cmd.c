@@ -68,6 +68,10 @@ struct pac_req_ctx {
     char *user_sid_str;
     char *user_dom_sid_str;
     char *primary_group_sid_str;
+
+    /* PAC cache key and data, NULL if the cache is disabled */
+    char *cache_key;
+    char *fingerprint;
 };
 
 static errno_t pac_resolve_sids_next(struct pac_req_ctx *pr_ctx);
@@ -93,9 +97,123 @@ static errno_t pac_store_membership(struct pac_req_ctx *pr_ctx,
                                     struct ldb_dn *user_dn,
                                     const char *grp_sid_str,
                                     struct sss_domain_info *grp_dom);
+static errno_t pac_store_membership_msg(struct pac_req_ctx *pr_ctx,
+                                        struct ldb_dn *user_dn,
+                                        const char *grp_sid_str,
+                                        struct sss_domain_info *grp_dom,
+                                        struct ldb_message *group);
 struct tevent_req *pac_save_memberships_send(struct pac_req_ctx *pr_ctx);
 static void pac_save_memberships_done(struct tevent_req *req);
 
+static errno_t pac_cache_prepare(struct pac_req_ctx *pr_ctx)
+{
+    struct pac_ctx *pac_ctx = pr_ctx->pac_ctx;
+    errno_t ret;
+
+    if (pac_ctx->pac_cache == NULL) {
+        return EOK;
+    }
+
+    pr_ctx->cache_key = talloc_asprintf(pr_ctx, "%s-%lu",
+                            pr_ctx->user_dom_sid_str,
+                            (unsigned long) pr_ctx->logon_info->info3.base.rid);
+    if (pr_ctx->cache_key == NULL) {
+        return ENOMEM;
+    }
+
+    ret = get_pac_fingerprint(pr_ctx, pac_ctx, pr_ctx->user_dom_sid_str,
+                              pr_ctx->logon_info, &pr_ctx->fingerprint);
+    if (ret != EOK) {
+        talloc_zfree(pr_ctx->cache_key);
+        return ret;
+    }
+
+    return EOK;
+}
+
+/* Returns true if the same logon information was evaluated for the user
+ * recently and the user is still cached, nothing has to be updated then. */
+static bool pac_cache_is_fresh(struct pac_req_ctx *pr_ctx)
+{
+    const char *attrs[] = { SYSDB_NAME, NULL };
+    struct pac_cache_entry *entry;
+    struct ldb_message *msg;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+    errno_t ret;
+
+    if (pr_ctx->cache_key == NULL) {
+        return false;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = pr_ctx->cache_key;
+    hret = hash_lookup(pr_ctx->pac_ctx->pac_cache, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        return false;
+    }
+
+    entry = talloc_get_type(value.ptr, struct pac_cache_entry);
+    if (entry->expire < time(NULL)
+            || strcmp(entry->fingerprint, pr_ctx->fingerprint) != 0) {
+        return false;
+    }
+
+    ret = sysdb_search_user_by_sid_str(pr_ctx, pr_ctx->dom, pr_ctx->cache_key,
+                                       attrs, &msg);
+    if (ret != EOK) {
+        /* removed from the cache meanwhile */
+        return false;
+    }
+    talloc_free(msg);
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "PAC of [%s] unchanged, skipping the update.\n", pr_ctx->user_name);
+    return true;
+}
+
+static void pac_cache_store(struct pac_req_ctx *pr_ctx)
+{
+    hash_table_t *table = pr_ctx->pac_ctx->pac_cache;
+    struct pac_cache_entry *entry;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    if (pr_ctx->cache_key == NULL) {
+        return;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = pr_ctx->cache_key;
+
+    hret = hash_lookup(table, &key, &value);
+    if (hret == HASH_SUCCESS) {
+        entry = talloc_get_type(value.ptr, struct pac_cache_entry);
+        talloc_free(entry->fingerprint);
+    } else {
+        entry = talloc_zero(table, struct pac_cache_entry);
+        if (entry == NULL) {
+            return;
+        }
+
+        value.type = HASH_VALUE_PTR;
+        value.ptr = entry;
+        hret = hash_enter(table, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "hash_enter failed [%d][%s].\n",
+                                        hret, hash_error_string(hret));
+            talloc_free(entry);
+            return;
+        }
+    }
+
+    entry->fingerprint = talloc_steal(entry, pr_ctx->fingerprint);
+    pr_ctx->fingerprint = NULL;
+    entry->expire = time(NULL) + pr_ctx->pac_ctx->pac_lifetime;
+}
+
 
 static errno_t pac_add_pac_user(struct cli_ctx *cctx)
 {
@@ -163,6 +281,12 @@ static errno_t pac_add_pac_user(struct cli_ctx *cctx)
 
     talloc_steal(pr_ctx, pr_ctx->user_dom_sid_str);
 
+    ret = pac_cache_prepare(pr_ctx);
+    if (ret != EOK) {
+        /* not fatal, the PAC is just evaluated */
+        DEBUG(SSSDBG_MINOR_FAILURE, "pac_cache_prepare failed.\n");
+    }
+
     ret = responder_get_domain_by_id(cctx->rctx, pr_ctx->user_dom_sid_str,
                                      &pr_ctx->dom);
     if (ret == EAGAIN || ret == ENOENT) {
@@ -225,6 +349,10 @@ static errno_t pac_resolve_sids_next(struct pac_req_ctx *pr_ctx)
     int ret;
     struct tevent_req *req;
 
+    if (pac_cache_is_fresh(pr_ctx)) {
+        return EOK;
+    }
+
     ret = get_sids_from_pac(pr_ctx, pr_ctx->pac_ctx, pr_ctx->logon_info,
                             &pr_ctx->user_sid_str,
                             &pr_ctx->primary_group_sid_str,
@@ -254,14 +382,6 @@ static void pac_lookup_sids_done(struct tevent_req *req)
     struct pac_req_ctx *pr_ctx = tevent_req_callback_data(req, struct pac_req_ctx);
     struct cli_ctx *cctx = pr_ctx->cctx;
     errno_t ret;
-    unsigned long count;
-    hash_entry_t *entries;
-    hash_key_t key;
-    hash_value_t value;
-    size_t c;
-    struct sss_domain_info *dom;
-    uint64_t id;
-    struct ldb_result *msg;
 
     ret = pac_lookup_sids_recv(req);
     talloc_zfree(req);
@@ -272,76 +392,15 @@ static void pac_lookup_sids_done(struct tevent_req *req)
         return;
     }
 
-    key.type = HASH_KEY_STRING;
-    value.type = HASH_VALUE_ULONG;
-
-    ret = hash_entries(pr_ctx->sid_table, &count, &entries);
-    if (ret != HASH_SUCCESS) {
-        DEBUG(SSSDBG_OP_FAILURE, "hash_entries failed [%d][%s].\n",
-                                 ret, hash_error_string(ret));
+    /* pick up the IDs of the objects the data provider just stored */
+    ret = pac_sid_table_fill_ids(pr_ctx->pac_ctx, pr_ctx->sid_table);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "pac_sid_table_fill_ids failed.\n");
         talloc_free(pr_ctx);
         pac_cmd_done(cctx, ret);
         return;
     }
 
-    for (c = 0; c < count; c++) {
-        if (entries[c].value.ul == 0) {
-            ret =responder_get_domain_by_id(cctx->rctx,
-                                            entries[c].key.str, &dom);
-            if (ret != EOK) {
-                DEBUG(SSSDBG_OP_FAILURE, "No domain found for SID [%s].\n",
-                                          entries[c].key.str);
-                continue;
-            }
-
-            msg = NULL;
-            ret = sysdb_search_object_by_sid(pr_ctx, dom, entries[c].key.str,
-                                             NULL, &msg);
-            if (ret == ENOENT) {
-                DEBUG(SSSDBG_OP_FAILURE, "No entry found for SID [%s].\n",
-                      entries[c].key.str);
-                continue;
-            } else if (ret != EOK) {
-                DEBUG(SSSDBG_OP_FAILURE,
-                      "sysdb_search_object_by_sid failed.\n");
-                continue;
-            }
-
-            if (msg->count > 1) {
-                DEBUG(SSSDBG_CRIT_FAILURE, "More then one result returned " \
-                                            "for SID [%s].\n",
-                                            entries[c].key.str);
-                talloc_free(msg);
-                pac_cmd_done(cctx, EINVAL);
-                return;
-            }
-
-            id = ldb_msg_find_attr_as_uint64(msg->msgs[0],
-                                             SYSDB_UIDNUM, 0);
-            if (id == 0) {
-                id = ldb_msg_find_attr_as_uint64(msg->msgs[0],
-                                                 SYSDB_GIDNUM, 0);
-            }
-
-            if (id == 0) {
-                DEBUG(SSSDBG_OP_FAILURE, "No ID found in entry.\n");
-                talloc_free(msg);
-                continue;
-            }
-
-            key.str = entries[c].key.str;
-            value.ul = id;
-
-            ret = hash_enter(pr_ctx->sid_table, &key, &value);
-            if (ret != HASH_SUCCESS) {
-                DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%d][%s].\n",
-                                          ret, hash_error_string(ret));
-                continue;
-            }
-            talloc_free(msg);
-        }
-    }
-
     pac_add_user_next(pr_ctx);
 }
 
@@ -624,11 +683,17 @@ struct pac_save_memberships_state {
     size_t sid_iter;
     struct ldb_dn *user_dn;
 
+    /* groups which are not cached yet */
+    const char **missing_sids;
+    size_t missing_count;
+
     struct pac_req_ctx *pr_ctx;
 };
 
 static errno_t
 pac_save_memberships_delete(struct pac_save_memberships_state *state);
+static errno_t
+pac_save_memberships_add(struct pac_save_memberships_state *state);
 
 struct tevent_req *pac_save_memberships_send(struct pac_req_ctx *pr_ctx)
 {
@@ -669,6 +734,12 @@ struct tevent_req *pac_save_memberships_send(struct pac_req_ctx *pr_ctx)
         goto done;
     }
 
+    ret = pac_save_memberships_add(state);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "pac_save_memberships_add failed.\n");
+        goto done;
+    }
+
     ret = pac_save_memberships_next(req);
     if (ret == EOK) {
         tevent_req_done(req);
@@ -780,17 +851,27 @@ done:
     return ret;
 }
 
-static errno_t pac_save_memberships_next(struct tevent_req *req)
+/* Adds the memberships of all groups which are already cached in a single
+ * transaction, the other are looked up one by one afterwards. */
+static errno_t
+pac_save_memberships_add(struct pac_save_memberships_state *state)
 {
+    const char *group_attrs[] = { SYSDB_ORIG_DN, SYSDB_OBJECTCLASS,
+                                  SYSDB_SID_STR, NULL };
+    struct pac_req_ctx *pr_ctx = state->pr_ctx;
+    struct sysdb_ctx *sysdb = pr_ctx->dom->sysdb;
+    struct pac_cached_obj *obj;
+    TALLOC_CTX *tmp_ctx;
+    hash_table_t *objs;
+    hash_key_t key;
+    hash_value_t value;
+    bool in_transaction = false;
+    size_t c;
+    int hret;
+    int sret;
     errno_t ret;
-    char *sid;
-    struct sss_domain_info *grp_dom;
-    struct tevent_req *subreq;
-    struct pac_save_memberships_state *state;
-    struct pac_req_ctx *pr_ctx;
 
-    state = tevent_req_data(req, struct pac_save_memberships_state);
-    pr_ctx = state->pr_ctx;
+    state->missing_count = 0;
 
     if (pr_ctx->add_sid_count == 0) {
         return EOK;
@@ -801,8 +882,98 @@ static errno_t pac_save_memberships_next(struct tevent_req *req)
         return EINVAL;
     }
 
-    while (state->sid_iter < pr_ctx->add_sid_count) {
-        sid = pr_ctx->add_sids[state->sid_iter];
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "talloc_new failed.\n");
+        return ENOMEM;
+    }
+
+    state->missing_sids = talloc_array(state, const char *,
+                                       pr_ctx->add_sid_count);
+    if (state->missing_sids == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = pac_search_sids(tmp_ctx, pr_ctx->pac_ctx,
+                          discard_const(pr_ctx->add_sids),
+                          pr_ctx->add_sid_count, group_attrs, &objs);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "pac_search_sids failed.\n");
+        goto done;
+    }
+
+    ret = sysdb_transaction_start(sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "sysdb_transaction_start failed.\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    key.type = HASH_KEY_STRING;
+    for (c = 0; c < pr_ctx->add_sid_count; c++) {
+        key.str = pr_ctx->add_sids[c];
+        hret = hash_lookup(objs, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            state->missing_sids[state->missing_count] = pr_ctx->add_sids[c];
+            state->missing_count++;
+            continue;
+        }
+        obj = talloc_get_type(value.ptr, struct pac_cached_obj);
+
+        if (obj->dom->sysdb != sysdb) {
+            /* cannot be part of the transaction, handle it later */
+            state->missing_sids[state->missing_count] = pr_ctx->add_sids[c];
+            state->missing_count++;
+            continue;
+        }
+
+        /* If there is a failure for one group we still try to add the
+         * remaining groups. */
+        ret = pac_store_membership_msg(pr_ctx, state->user_dn,
+                                       pr_ctx->add_sids[c], obj->dom,
+                                       obj->msg);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "pac_store_membership_msg failed, "
+                                      "trying next group.\n");
+        }
+    }
+
+    ret = sysdb_transaction_commit(sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "sysdb_transaction_commit failed.\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    ret = EOK;
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "sysdb_transaction_cancel failed.\n");
+        }
+    }
+
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t pac_save_memberships_next(struct tevent_req *req)
+{
+    errno_t ret;
+    char *sid;
+    struct sss_domain_info *grp_dom;
+    struct tevent_req *subreq;
+    struct pac_save_memberships_state *state;
+    struct pac_req_ctx *pr_ctx;
+
+    state = tevent_req_data(req, struct pac_save_memberships_state);
+    pr_ctx = state->pr_ctx;
+
+    while (state->sid_iter < state->missing_count) {
+        sid = discard_const(state->missing_sids[state->sid_iter]);
         ret = responder_get_domain_by_id(pr_ctx->pac_ctx->rctx, sid, &grp_dom);
         if (ret != EOK) {
             DEBUG(SSSDBG_MINOR_FAILURE, "responder_get_domain_by_id failed, " \
@@ -864,7 +1035,7 @@ static void pac_get_group_done(struct tevent_req *subreq)
         goto error;
     }
 
-    sid = pr_ctx->add_sids[state->sid_iter];
+    sid = discard_const(state->missing_sids[state->sid_iter]);
     ret = responder_get_domain_by_id(pr_ctx->pac_ctx->rctx,sid, &grp_dom);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "responder_get_domain_by_id failed.\n");
@@ -898,12 +1069,9 @@ pac_store_membership(struct pac_req_ctx *pr_ctx,
                      struct sss_domain_info *grp_dom)
 {
     TALLOC_CTX *tmp_ctx;
-    struct sysdb_attrs *user_attrs;
     struct ldb_result *group;
     errno_t ret;
-    const char *orig_group_dn;
     const char *group_attrs[] = { SYSDB_ORIG_DN, SYSDB_OBJECTCLASS, NULL };
-    const char *oc;
 
     tmp_ctx = talloc_new(NULL);
     if (tmp_ctx == NULL) {
@@ -928,7 +1096,33 @@ pac_store_membership(struct pac_req_ctx *pr_ctx,
         goto done;
     }
 
-    oc = ldb_msg_find_attr_as_string(group->msgs[0], SYSDB_OBJECTCLASS, NULL);
+    ret = pac_store_membership_msg(pr_ctx, user_dn, grp_sid_str, grp_dom,
+                                   group->msgs[0]);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t
+pac_store_membership_msg(struct pac_req_ctx *pr_ctx,
+                         struct ldb_dn *user_dn,
+                         const char *grp_sid_str,
+                         struct sss_domain_info *grp_dom,
+                         struct ldb_message *group)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_attrs *user_attrs;
+    errno_t ret;
+    const char *orig_group_dn;
+    const char *oc;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    oc = ldb_msg_find_attr_as_string(group, SYSDB_OBJECTCLASS, NULL);
     if (oc == NULL || strcmp(oc, SYSDB_GROUP_CLASS) != 0) {
         DEBUG(SSSDBG_OP_FAILURE, "Return object does not have group " \
                                   "objectclass.\n");
@@ -938,18 +1132,18 @@ pac_store_membership(struct pac_req_ctx *pr_ctx,
 
     DEBUG(SSSDBG_TRACE_ALL, "Adding user [%s] to group [%s][%s].\n",
                              ldb_dn_get_linearized(user_dn), grp_sid_str,
-                             ldb_dn_get_linearized(group->msgs[0]->dn));
-    ret = sysdb_mod_group_member(grp_dom, user_dn, group->msgs[0]->dn,
+                             ldb_dn_get_linearized(group->dn));
+    ret = sysdb_mod_group_member(grp_dom, user_dn, group->dn,
                                  LDB_FLAG_MOD_ADD);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "sysdb_mod_group_member failed user [%s] " \
                                   "group [%s].\n",
                                   ldb_dn_get_linearized(user_dn),
-                                  ldb_dn_get_linearized(group->msgs[0]->dn));
+                                  ldb_dn_get_linearized(group->dn));
         goto done;
     }
 
-    orig_group_dn = ldb_msg_find_attr_as_string(group->msgs[0], SYSDB_ORIG_DN,
+    orig_group_dn = ldb_msg_find_attr_as_string(group, SYSDB_ORIG_DN,
                                                 NULL);
     if (orig_group_dn != NULL) {
         DEBUG(SSSDBG_TRACE_ALL, "Adding original group DN [%s] to user [%s].\n",
@@ -978,7 +1172,7 @@ pac_store_membership(struct pac_req_ctx *pr_ctx,
     } else {
         DEBUG(SSSDBG_MINOR_FAILURE, "Original DN not available for group " \
                                      "[%s][%s].\n", grp_sid_str,
-                                     ldb_dn_get_linearized(group->msgs[0]->dn));
+                                     ldb_dn_get_linearized(group->dn));
     }
 
 done:
@@ -1002,6 +1196,10 @@ static void pac_save_memberships_done(struct tevent_req *req)
     ret = pac_save_memberships_recv(req);
     talloc_zfree(req);
 
+    if (ret == EOK) {
+        pac_cache_store(pr_ctx);
+    }
+
     talloc_free(pr_ctx);
     pac_cmd_done(cctx, ret);
 }
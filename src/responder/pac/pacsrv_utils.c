@@ -26,6 +26,228 @@
 #include "util/util.h"
 #include "responder/pac/pacsrv.h"
 
+struct pac_dom_sids {
+    struct sss_domain_info *dom;
+    const char **sids;
+    size_t count;
+};
+
+/**
+ * Look up the users and groups with the given SIDs, the cache of each domain
+ * is searched once for all SIDs belonging to it. SIDs of unknown domains or
+ * not in the cache are missing from the returned table.
+ */
+errno_t pac_search_sids(TALLOC_CTX *mem_ctx,
+                        struct pac_ctx *pac_ctx,
+                        const char **sids,
+                        size_t count,
+                        const char **attrs,
+                        hash_table_t **_objs)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct pac_dom_sids *doms = NULL;
+    size_t num_doms = 0;
+    struct sss_domain_info *dom;
+    struct pac_cached_obj *obj;
+    struct ldb_result *res;
+    hash_table_t *objs;
+    hash_key_t key;
+    hash_value_t value;
+    const char *sid;
+    size_t c;
+    size_t d;
+    int hret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_hash_create(tmp_ctx, count, &objs);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    /* sort the SIDs by domain */
+    for (c = 0; c < count; c++) {
+        ret = responder_get_domain_by_id(pac_ctx->rctx, sids[c], &dom);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_TRACE_INTERNAL, "No domain found for SID [%s].\n",
+                                         sids[c]);
+            continue;
+        }
+
+        for (d = 0; d < num_doms && doms[d].dom != dom; d++);
+        if (d == num_doms) {
+            doms = talloc_realloc(tmp_ctx, doms, struct pac_dom_sids,
+                                  num_doms + 1);
+            if (doms == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            doms[d].dom = dom;
+            doms[d].sids = talloc_array(doms, const char *, count);
+            if (doms[d].sids == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            doms[d].count = 0;
+            num_doms++;
+        }
+
+        doms[d].sids[doms[d].count] = sids[c];
+        doms[d].count++;
+    }
+
+    key.type = HASH_KEY_STRING;
+    value.type = HASH_VALUE_PTR;
+
+    for (d = 0; d < num_doms; d++) {
+        ret = sysdb_search_objects_by_sids(objs, doms[d].dom, doms[d].sids,
+                                           doms[d].count, attrs, &res);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "sysdb_search_objects_by_sids failed [%d][%s].\n",
+                  ret, sss_strerror(ret));
+            goto done;
+        }
+
+        for (c = 0; c < res->count; c++) {
+            sid = ldb_msg_find_attr_as_string(res->msgs[c], SYSDB_SID_STR,
+                                              NULL);
+            if (sid == NULL) {
+                continue;
+            }
+
+            key.str = discard_const(sid);
+            if (hash_has_key(objs, &key)) {
+                DEBUG(SSSDBG_CRIT_FAILURE, "More then one result returned " \
+                                           "for SID [%s].\n", sid);
+                continue;
+            }
+
+            obj = talloc_zero(res, struct pac_cached_obj);
+            if (obj == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            obj->dom = doms[d].dom;
+            obj->msg = res->msgs[c];
+
+            value.ptr = obj;
+            hret = hash_enter(objs, &key, &value);
+            if (hret != HASH_SUCCESS) {
+                DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%d][%s].\n",
+                                         hret, hash_error_string(hret));
+                ret = EIO;
+                goto done;
+            }
+        }
+    }
+
+    *_objs = talloc_steal(mem_ctx, objs);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/**
+ * Set the POSIX IDs of the SIDs without an ID in the table.
+ */
+errno_t pac_sid_table_fill_ids(struct pac_ctx *pac_ctx,
+                               hash_table_t *sid_table)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char *attrs[] = { SYSDB_SID_STR, SYSDB_UIDNUM, SYSDB_GIDNUM, NULL };
+    const char **sids;
+    size_t num_sids = 0;
+    struct pac_cached_obj *obj;
+    hash_table_t *objs;
+    unsigned long count;
+    hash_entry_t *entries = NULL;
+    hash_key_t key;
+    hash_value_t value;
+    uint64_t id;
+    size_t c;
+    int hret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    hret = hash_entries(sid_table, &count, &entries);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "hash_entries failed [%d][%s].\n",
+                                 hret, hash_error_string(hret));
+        ret = EIO;
+        goto done;
+    }
+    talloc_steal(tmp_ctx, entries);
+
+    sids = talloc_array(tmp_ctx, const char *, count + 1);
+    if (sids == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (c = 0; c < count; c++) {
+        if (entries[c].value.ul == 0) {
+            sids[num_sids] = entries[c].key.str;
+            num_sids++;
+        }
+    }
+
+    if (num_sids == 0) {
+        ret = EOK;
+        goto done;
+    }
+
+    ret = pac_search_sids(tmp_ctx, pac_ctx, sids, num_sids, attrs, &objs);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (c = 0; c < num_sids; c++) {
+        key.type = HASH_KEY_STRING;
+        key.str = discard_const(sids[c]);
+        hret = hash_lookup(objs, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            continue;
+        }
+        obj = talloc_get_type(value.ptr, struct pac_cached_obj);
+
+        id = ldb_msg_find_attr_as_uint64(obj->msg, SYSDB_UIDNUM, 0);
+        if (id == 0) {
+            id = ldb_msg_find_attr_as_uint64(obj->msg, SYSDB_GIDNUM, 0);
+        }
+        if (id == 0) {
+            DEBUG(SSSDBG_OP_FAILURE, "No ID found in entry.\n");
+            continue;
+        }
+
+        value.type = HASH_VALUE_ULONG;
+        value.ul = id;
+        hret = hash_enter(sid_table, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%d][%s].\n",
+                                     hret, hash_error_string(hret));
+            ret = EIO;
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
                           struct pac_ctx *pac_ctx,
                           struct PAC_LOGON_INFO *logon_info,
@@ -37,9 +259,9 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
     size_t s;
     struct netr_SamInfo3 *info3;
     struct sss_domain_info *user_dom;
-    struct sss_domain_info *group_dom;
     char *sid_str = NULL;
-    char *msid_str = NULL;
+    struct sss_idmap_sid msid;
+    char msid_str[SSS_IDMAP_SID_STR_MAX];
     char *user_dom_sid_str = NULL;
     size_t user_dom_sid_str_len;
     enum idmap_error_code err;
@@ -47,7 +269,6 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
     hash_key_t key;
     hash_value_t value;
     char *rid_start;
-    struct ldb_result *msg = NULL;
     char *user_sid_str = NULL;
     char *primary_group_sid_str = NULL;
 
@@ -115,12 +336,6 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
     key.str = sid_str;
     value.ul = 0;
 
-    ret = sysdb_search_object_by_sid(mem_ctx, user_dom, sid_str, NULL, &msg);
-    if (ret == EOK && msg->count == 1) {
-        value.ul = ldb_msg_find_attr_as_uint64(msg->msgs[0], SYSDB_UIDNUM, 0);
-    }
-    talloc_zfree(msg);
-
     ret = hash_enter(sid_table, &key, &value);
     if (ret != HASH_SUCCESS) {
         DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%d][%s].\n",
@@ -149,12 +364,6 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
     key.str = sid_str;
     value.ul = 0;
 
-    ret = sysdb_search_object_by_sid(mem_ctx, user_dom, sid_str, NULL, &msg);
-    if (ret == EOK && msg->count == 1) {
-        value.ul = ldb_msg_find_attr_as_uint64(msg->msgs[0], SYSDB_GIDNUM, 0);
-    }
-    talloc_zfree(msg);
-
     ret = hash_enter(sid_table, &key, &value);
     if (ret != HASH_SUCCESS) {
         DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%d][%s].\n",
@@ -177,14 +386,6 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
         key.str = sid_str;
         value.ul = 0;
 
-        ret = sysdb_search_object_by_sid(mem_ctx, user_dom, sid_str,
-                                         NULL, &msg);
-        if (ret == EOK && msg->count == 1) {
-            value.ul = ldb_msg_find_attr_as_uint64(msg->msgs[0],
-                                                   SYSDB_GIDNUM, 0);
-        }
-        talloc_zfree(msg);
-
         ret = hash_enter(sid_table, &key, &value);
         if (ret != HASH_SUCCESS) {
             DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%d][%s].\n",
@@ -196,10 +397,13 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
     }
 
     for(s = 0; s < info3->sidcount; s++) {
-        err = sss_idmap_smb_sid_to_sid(pac_ctx->idmap_ctx, info3->sids[s].sid,
-                                       &msid_str);
+        /* hash_enter() copies the key, a buffer on the stack is enough */
+        err = sss_idmap_smb_sid_parse(info3->sids[s].sid, &msid);
+        if (err == IDMAP_SUCCESS) {
+            err = sss_idmap_sid_format(&msid, msid_str, sizeof(msid_str));
+        }
         if (err != IDMAP_SUCCESS) {
-            DEBUG(SSSDBG_OP_FAILURE, "sss_idmap_smb_sid_to_sid failed.\n");
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot convert SID of the PAC.\n");
             ret = EFAULT;
             goto done;
         }
@@ -207,19 +411,7 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
         key.str = msid_str;
         value.ul = 0;
 
-        ret = responder_get_domain_by_id(pac_ctx->rctx, msid_str, &group_dom);
-        if (ret == EOK) {
-            ret = sysdb_search_object_by_sid(mem_ctx, group_dom, msid_str,
-                                             NULL, &msg);
-            if (ret == EOK && msg->count == 1 ) {
-                value.ul = ldb_msg_find_attr_as_uint64(msg->msgs[0],
-                                                       SYSDB_GIDNUM, 0);
-            }
-            talloc_zfree(msg);
-        }
-
         ret = hash_enter(sid_table, &key, &value);
-        sss_idmap_free_sid(pac_ctx->idmap_ctx, msid_str);
         if (ret != HASH_SUCCESS) {
             DEBUG(SSSDBG_OP_FAILURE, "hash_enter failed [%d][%s].\n",
                                       ret, hash_error_string(ret));
@@ -228,7 +420,12 @@ errno_t get_sids_from_pac(TALLOC_CTX *mem_ctx,
         }
     }
 
-    ret = EOK;
+    /* the IDs of all SIDs known to the cache at once */
+    ret = pac_sid_table_fill_ids(pac_ctx, sid_table);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "pac_sid_table_fill_ids failed.\n");
+        goto done;
+    }
 
 done:
     talloc_free(sid_str);
@@ -247,6 +444,67 @@ done:
     return ret;
 }
 
+/**
+ * Build a string out of the logon info data the responder evaluates. Two
+ * PACs with the same fingerprint result in the same cache updates, the
+ * logon times and the other per-ticket data are not part of it.
+ */
+errno_t get_pac_fingerprint(TALLOC_CTX *mem_ctx,
+                            struct pac_ctx *pac_ctx,
+                            const char *user_dom_sid_str,
+                            struct PAC_LOGON_INFO *logon_info,
+                            char **_fingerprint)
+{
+    struct netr_SamInfo3 *info3 = &logon_info->info3;
+    enum idmap_error_code err;
+    struct sss_idmap_sid msid;
+    char msid_str[SSS_IDMAP_SID_STR_MAX];
+    char *fp;
+    uint32_t s;
+
+    fp = talloc_asprintf(mem_ctx, "%s:%lu:%lu:%s:%s:%s:",
+                         user_dom_sid_str,
+                         (unsigned long) info3->base.rid,
+                         (unsigned long) info3->base.primary_gid,
+                         info3->base.account_name.string != NULL
+                            ? info3->base.account_name.string : "",
+                         info3->base.full_name.string != NULL
+                            ? info3->base.full_name.string : "",
+                         info3->base.logon_domain.string != NULL
+                            ? info3->base.logon_domain.string : "");
+
+    for (s = 0; s < info3->base.groups.count && fp != NULL; s++) {
+        fp = talloc_asprintf_append(fp, "%lu,",
+                                (unsigned long) info3->base.groups.rids[s].rid);
+    }
+
+    if (fp != NULL) {
+        fp = talloc_strdup_append(fp, ":");
+    }
+
+    for (s = 0; s < info3->sidcount && fp != NULL; s++) {
+        err = sss_idmap_smb_sid_parse(info3->sids[s].sid, &msid);
+        if (err == IDMAP_SUCCESS) {
+            err = sss_idmap_sid_format(&msid, msid_str, sizeof(msid_str));
+        }
+        if (err != IDMAP_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot convert SID of the PAC.\n");
+            talloc_free(fp);
+            return EFAULT;
+        }
+
+        fp = talloc_asprintf_append(fp, "%s,", msid_str);
+    }
+
+    if (fp == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "talloc_asprintf failed.\n");
+        return ENOMEM;
+    }
+
+    *_fingerprint = fp;
+    return EOK;
+}
+
 /**
  * Extract the PAC logon data from an NDR blob.
  */
@@ -154,3 +154,365 @@ errno_t pam_initgr_check_timeout(hash_table_t *id_table,
     return EOK;
 }
 
+
+struct pam_preauth_entry {
+    hash_table_t *table;
+    char *key;
+    int pam_status;
+    struct response_data *resp_list;
+};
+
+static void pam_preauth_cache_expire(struct tevent_context *ev,
+                                     struct tevent_timer *te,
+                                     struct timeval tv,
+                                     void *pvt)
+{
+    struct pam_preauth_entry *entry =
+            talloc_get_type(pvt, struct pam_preauth_entry);
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Preauth response of [%s] expired\n", entry->key);
+    pam_preauth_cache_remove(entry->table, entry->key);
+}
+
+static struct response_data *
+pam_preauth_copy_responses(TALLOC_CTX *mem_ctx, struct response_data *list,
+                           struct response_data *tail)
+{
+    struct response_data *head = tail;
+    struct response_data **last = &head;
+    struct response_data *new;
+
+    for (; list != NULL; list = list->next) {
+        if (list->do_not_send_to_client) {
+            continue;
+        }
+
+        new = talloc_zero(mem_ctx, struct response_data);
+        if (new == NULL) {
+            return NULL;
+        }
+
+        new->type = list->type;
+        new->len = list->len;
+        new->data = talloc_memdup(mem_ctx, list->data, list->len);
+        if (new->data == NULL) {
+            return NULL;
+        }
+
+        new->next = tail;
+        *last = new;
+        last = &new->next;
+    }
+
+    return head;
+}
+
+errno_t pam_preauth_cache_set(struct tevent_context *ev,
+                              hash_table_t *table,
+                              const char *key,
+                              long timeout,
+                              struct pam_data *pd)
+{
+    struct pam_preauth_entry *entry;
+    struct tevent_timer *te;
+    hash_key_t hkey;
+    hash_value_t hval;
+    errno_t ret;
+    int hret;
+
+    pam_preauth_cache_remove(table, key);
+
+    entry = talloc_zero(table, struct pam_preauth_entry);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    entry->table = table;
+    entry->pam_status = pd->pam_status;
+    entry->key = talloc_strdup(entry, key);
+    if (entry->key == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    if (pd->resp_list != NULL) {
+        entry->resp_list = pam_preauth_copy_responses(entry, pd->resp_list,
+                                                      NULL);
+        if (entry->resp_list == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    te = tevent_add_timer(ev, entry, tevent_timeval_current_ofs(timeout, 0),
+                          pam_preauth_cache_expire, entry);
+    if (te == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = entry->key;
+    hval.type = HASH_VALUE_PTR;
+    hval.ptr = entry;
+
+    hret = hash_enter(table, &hkey, &hval);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Could not cache the preauth response of [%s]: [%s]\n",
+              key, hash_error_string(hret));
+        ret = EIO;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Preauth response of [%s] cached for %ld seconds\n", key, timeout);
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(entry);
+    }
+    return ret;
+}
+
+errno_t pam_preauth_cache_get(hash_table_t *table,
+                              const char *key,
+                              struct pam_data *pd)
+{
+    struct pam_preauth_entry *entry;
+    struct response_data *list;
+    hash_key_t hkey;
+    hash_value_t hval;
+    int hret;
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = discard_const(key);
+
+    hret = hash_lookup(table, &hkey, &hval);
+    if (hret == HASH_ERROR_KEY_NOT_FOUND) {
+        return ENOENT;
+    } else if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Error searching the preauth response of [%s]: [%s]\n",
+              key, hash_error_string(hret));
+        return EIO;
+    }
+
+    entry = talloc_get_type(hval.ptr, struct pam_preauth_entry);
+
+    if (entry->resp_list != NULL) {
+        list = pam_preauth_copy_responses(pd, entry->resp_list, pd->resp_list);
+        if (list == NULL) {
+            return ENOMEM;
+        }
+        pd->resp_list = list;
+    }
+    pd->pam_status = entry->pam_status;
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Using the cached preauth response of [%s]\n", key);
+    return EOK;
+}
+
+void pam_preauth_cache_remove(hash_table_t *table, const char *key)
+{
+    hash_key_t hkey;
+    hash_value_t hval;
+    int hret;
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = discard_const(key);
+
+    hret = hash_lookup(table, &hkey, &hval);
+    if (hret != HASH_SUCCESS) {
+        return;
+    }
+
+    hret = hash_delete(table, &hkey);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Could not remove the preauth response of [%s]: [%s]\n",
+              key, hash_error_string(hret));
+    }
+
+    talloc_free(hval.ptr);
+}
+
+struct pam_id_snapshot {
+    hash_table_t *table;
+    char *key;
+    char *domain;
+    char *user;
+    struct tevent_timer *te;
+};
+
+static void pam_id_snapshot_expire(struct tevent_context *ev,
+                                   struct tevent_timer *te,
+                                   struct timeval tv,
+                                   void *pvt)
+{
+    struct pam_id_snapshot *snapshot =
+            talloc_get_type(pvt, struct pam_id_snapshot);
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Identity snapshot of [%s] expired\n", snapshot->key);
+    snapshot->te = NULL;
+    pam_id_snapshot_remove(snapshot->table, snapshot->key);
+}
+
+static errno_t pam_id_snapshot_arm(struct tevent_context *ev,
+                                   struct pam_id_snapshot *snapshot,
+                                   long timeout)
+{
+    talloc_zfree(snapshot->te);
+
+    snapshot->te = tevent_add_timer(ev, snapshot,
+                                    tevent_timeval_current_ofs(timeout, 0),
+                                    pam_id_snapshot_expire, snapshot);
+    if (snapshot->te == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+errno_t pam_id_snapshot_set(struct tevent_context *ev,
+                            hash_table_t *table,
+                            const char *key,
+                            long timeout,
+                            const char *domain,
+                            const char *user)
+{
+    struct pam_id_snapshot *snapshot;
+    hash_key_t hkey;
+    hash_value_t hval;
+    errno_t ret;
+    int hret;
+
+    pam_id_snapshot_remove(table, key);
+
+    snapshot = talloc_zero(table, struct pam_id_snapshot);
+    if (snapshot == NULL) {
+        return ENOMEM;
+    }
+
+    snapshot->table = table;
+    snapshot->key = talloc_strdup(snapshot, key);
+    snapshot->domain = talloc_strdup(snapshot, domain);
+    snapshot->user = talloc_strdup(snapshot, user);
+    if (snapshot->key == NULL || snapshot->domain == NULL
+            || snapshot->user == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = pam_id_snapshot_arm(ev, snapshot, timeout);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = snapshot->key;
+    hval.type = HASH_VALUE_PTR;
+    hval.ptr = snapshot;
+
+    hret = hash_enter(table, &hkey, &hval);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Could not save the identity snapshot of [%s]: [%s]\n",
+              key, hash_error_string(hret));
+        ret = EIO;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Identity snapshot of [%s] saved as [%s@%s]\n", key, user, domain);
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(snapshot);
+    }
+    return ret;
+}
+
+errno_t pam_id_snapshot_get(TALLOC_CTX *mem_ctx,
+                            struct tevent_context *ev,
+                            hash_table_t *table,
+                            const char *key,
+                            long timeout,
+                            char **_domain,
+                            char **_user)
+{
+    struct pam_id_snapshot *snapshot;
+    hash_key_t hkey;
+    hash_value_t hval;
+    char *domain;
+    char *user;
+    errno_t ret;
+    int hret;
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = discard_const(key);
+
+    hret = hash_lookup(table, &hkey, &hval);
+    if (hret == HASH_ERROR_KEY_NOT_FOUND) {
+        return ENOENT;
+    } else if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Error searching the identity snapshot of [%s]: [%s]\n",
+              key, hash_error_string(hret));
+        return EIO;
+    }
+
+    snapshot = talloc_get_type(hval.ptr, struct pam_id_snapshot);
+
+    domain = talloc_strdup(mem_ctx, snapshot->domain);
+    user = talloc_strdup(mem_ctx, snapshot->user);
+    if (domain == NULL || user == NULL) {
+        talloc_free(domain);
+        talloc_free(user);
+        return ENOMEM;
+    }
+
+    /* every phase of the conversation extends the window */
+    ret = pam_id_snapshot_arm(ev, snapshot, timeout);
+    if (ret != EOK) {
+        talloc_free(domain);
+        talloc_free(user);
+        pam_id_snapshot_remove(table, key);
+        return ret;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Using the identity snapshot of [%s]\n", key);
+    *_domain = domain;
+    *_user = user;
+    return EOK;
+}
+
+void pam_id_snapshot_remove(hash_table_t *table, const char *key)
+{
+    hash_key_t hkey;
+    hash_value_t hval;
+    int hret;
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = discard_const(key);
+
+    hret = hash_lookup(table, &hkey, &hval);
+    if (hret != HASH_SUCCESS) {
+        return;
+    }
+
+    hret = hash_delete(table, &hkey);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Could not remove the identity snapshot of [%s]: [%s]\n",
+              key, hash_error_string(hret));
+    }
+
+    talloc_free(hval.ptr);
+}
@@ -24,6 +24,7 @@
 #define PAM_HELPERS_H_
 
 #include "util/util.h"
+#include "providers/data_provider.h"
 
 errno_t pam_initgr_cache_set(struct tevent_context *ev,
                              hash_table_t *id_table,
@@ -37,4 +38,42 @@ errno_t pam_initgr_cache_set(struct tevent_context *ev,
 errno_t pam_initgr_check_timeout(hash_table_t *id_table,
                                  char *name);
 
+/* Keeps a copy of the status and of the responses of a successful
+ * preauthentication request for timeout seconds. */
+errno_t pam_preauth_cache_set(struct tevent_context *ev,
+                              hash_table_t *table,
+                              const char *key,
+                              long timeout,
+                              struct pam_data *pd);
+
+/* Returns EOK and adds the cached responses to pd if there is an entry
+ * Returns ENOENT if there is no entry or it is expired
+ */
+errno_t pam_preauth_cache_get(hash_table_t *table,
+                              const char *key,
+                              struct pam_data *pd);
+
+void pam_preauth_cache_remove(hash_table_t *table, const char *key);
+
+/* The domain and the canonical name found by the authentication of a PAM
+ * conversation, reused by its later phases. Each lookup restarts the
+ * timeout. */
+errno_t pam_id_snapshot_set(struct tevent_context *ev,
+                            hash_table_t *table,
+                            const char *key,
+                            long timeout,
+                            const char *domain,
+                            const char *user);
+
+/* Returns ENOENT if there is no snapshot or it is expired */
+errno_t pam_id_snapshot_get(TALLOC_CTX *mem_ctx,
+                            struct tevent_context *ev,
+                            hash_table_t *table,
+                            const char *key,
+                            long timeout,
+                            char **_domain,
+                            char **_user);
+
+void pam_id_snapshot_remove(hash_table_t *table, const char *key);
+
 #endif /* PAM_HELPERS_H_ */
@@ -64,6 +64,8 @@ struct mon_cli_iface monitor_pam_methods = {
     .clearMemcache = NULL,
     .clearEnumCache = NULL,
     .sysbusReconnect = NULL,
+    .memReport = monitor_common_mem_report,
+    .startupTimes = monitor_common_startup_times,
 };
 
 static struct data_provider_iface pam_dp_methods = {
@@ -192,7 +194,9 @@ static int pam_process_init(TALLOC_CTX *mem_ctx,
     struct pam_ctx *pctx;
     int ret, max_retries;
     int id_timeout;
+    int preauth_timeout;
     int fd_limit;
+    bool p11_child_persistent;
 
     pam_cmds = get_pam_cmds();
     ret = sss_process_init(mem_ctx, ev, cdb,
@@ -264,6 +268,14 @@ static int pam_process_init(TALLOC_CTX *mem_ctx,
 
     pctx->id_timeout = (size_t)id_timeout;
 
+    /* Set up the timeout of the cached preauth responses */
+    ret = confdb_get_int(cdb, CONFDB_PAM_CONF_ENTRY,
+                         CONFDB_PAM_PREAUTH_CACHE_TIMEOUT, 5,
+                         &preauth_timeout);
+    if (ret != EOK) goto done;
+
+    pctx->preauth_timeout = preauth_timeout > 0 ? preauth_timeout : 0;
+
     ret = sss_ncache_init(pctx, &pctx->ncache);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE,
@@ -271,6 +283,10 @@ static int pam_process_init(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    /* not fatal, the cache is then private to this responder */
+    sss_ncache_share(pctx->ncache, SSS_NCACHE_SHARED_FILE);
+    sss_ncache_set_stats(pctx->ncache, rctx->cmd_stats);
+
     ret = sss_ncache_prepopulate(pctx->ncache, cdb, pctx->rctx);
     if (ret != EOK) {
         goto done;
@@ -285,6 +301,24 @@ static int pam_process_init(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    /* Create table for the identity snapshots of PAM conversations */
+    ret = sss_hash_create(pctx, 10, &pctx->id_snapshot_table);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Could not create identity snapshot hash table: [%s]\n",
+              strerror(ret));
+        goto done;
+    }
+
+    /* Create table for preauth responses */
+    ret = sss_hash_create(pctx, 10, &pctx->preauth_table);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Could not create preauth hash table: [%s]\n",
+              strerror(ret));
+        goto done;
+    }
+
     /* Set up file descriptor limits */
     ret = confdb_get_int(pctx->rctx->cdb,
                          CONFDB_PAM_CONF_ENTRY,
@@ -334,6 +368,27 @@ static int pam_process_init(TALLOC_CTX *mem_ctx,
                   "enabled or not.\n");
             goto done;
         }
+
+        ret = confdb_get_bool(pctx->rctx->cdb,
+                              CONFDB_PAM_CONF_ENTRY,
+                              CONFDB_PAM_P11_CHILD_PERSISTENT,
+                              false, &p11_child_persistent);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE,
+                  "Failed to read p11_child_persistent from confdb.\n");
+            goto done;
+        }
+
+        if (p11_child_persistent) {
+            ret = p11_child_worker_setup(pctx, rctx->ev,
+                                         pctx->p11_child_debug_fd,
+                                         &pctx->p11_worker);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_FATAL_FAILURE,
+                      "p11_child_worker_setup failed.\n");
+                goto done;
+            }
+        }
     }
 
     ret = EOK;
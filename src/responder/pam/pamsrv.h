@@ -37,6 +37,11 @@ struct pam_ctx {
     int neg_timeout;
     time_t id_timeout;
     hash_table_t *id_table;
+    /* identity found by the authentication of each PAM conversation */
+    hash_table_t *id_snapshot_table;
+    /* preauth responses per user, disabled if preauth_timeout is 0 */
+    time_t preauth_timeout;
+    hash_table_t *preauth_table;
     size_t trusted_uids_count;
     uid_t *trusted_uids;
 
@@ -47,6 +52,8 @@ struct pam_ctx {
     bool cert_auth;
     int p11_child_debug_fd;
     char *nss_db;
+    /* NULL unless p11_child_persistent is set */
+    struct p11_child_worker *p11_worker;
 };
 
 struct pam_auth_dp_req {
@@ -65,6 +72,8 @@ struct pam_auth_req {
     bool check_provider;
     void *data;
     bool use_cached_auth;
+    /* use_cached_auth while the cached credentials are checked */
+    bool saved_use_cached_auth;
     /* whether cached authentication was tried and failed */
     bool cached_auth_failed;
 
@@ -82,8 +91,17 @@ int LOCAL_pam_handler(struct pam_auth_req *preq);
 
 errno_t p11_child_init(struct pam_ctx *pctx);
 
+struct p11_child_worker;
+
+errno_t p11_child_worker_setup(TALLOC_CTX *mem_ctx,
+                               struct tevent_context *ev,
+                               int child_debug_fd,
+                               struct p11_child_worker **_worker);
+
+/* If worker is not NULL the request is served by the persistent p11_child */
 struct tevent_req *pam_check_cert_send(TALLOC_CTX *mem_ctx,
                                        struct tevent_context *ev,
+                                       struct p11_child_worker *worker,
                                        int child_debug_fd,
                                        const char *nss_db,
                                        time_t timeout,
@@ -582,6 +582,82 @@ static int pam_forwarder(struct cli_ctx *cctx, int pam_cmd);
 static void pam_handle_cached_login(struct pam_auth_req *preq, int ret,
                                     time_t expire_date, time_t delayed_until, bool cached_auth);
 
+static void pam_cache_auth_done(struct tevent_req *req);
+
+static char *pam_preauth_cache_key(TALLOC_CTX *mem_ctx,
+                                   struct pam_auth_req *preq)
+{
+    if (preq->domain == NULL || preq->pd->user == NULL) {
+        return NULL;
+    }
+
+    return talloc_asprintf(mem_ctx, "%s@%s", preq->pd->user,
+                           preq->domain->name);
+}
+
+static void pam_preauth_cache_drop(struct pam_ctx *pctx,
+                                   struct pam_auth_req *preq)
+{
+    char *key;
+
+    if (pctx->preauth_table == NULL) {
+        return;
+    }
+
+    key = pam_preauth_cache_key(preq, preq);
+    if (key == NULL) {
+        return;
+    }
+
+    pam_preauth_cache_remove(pctx->preauth_table, key);
+    talloc_free(key);
+}
+
+/* A PAM conversation is identified by the client process and the service */
+static char *pam_id_snapshot_key(TALLOC_CTX *mem_ctx, struct pam_data *pd)
+{
+    if (pd->logon_name == NULL) {
+        return NULL;
+    }
+
+    return talloc_asprintf(mem_ctx, "%"PRIu32":%s:%s", pd->cli_pid,
+                           pd->service != NULL ? pd->service : "",
+                           pd->logon_name);
+}
+
+static void pam_id_snapshot_update(struct pam_ctx *pctx,
+                                   struct pam_auth_req *preq)
+{
+    struct pam_data *pd = preq->pd;
+    char *key;
+    errno_t ret;
+
+    if (pctx->id_snapshot_table == NULL) {
+        return;
+    }
+
+    key = pam_id_snapshot_key(preq, pd);
+    if (key == NULL) {
+        return;
+    }
+
+    if (pd->pam_status == PAM_SUCCESS && preq->domain != NULL
+            && pd->user != NULL) {
+        ret = pam_id_snapshot_set(pctx->rctx->ev, pctx->id_snapshot_table,
+                                  key, pctx->id_timeout, preq->domain->name,
+                                  pd->user);
+        if (ret != EOK) {
+            /* not fatal, the later phases look the user up again */
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Could not save the identity snapshot.\n");
+        }
+    } else {
+        pam_id_snapshot_remove(pctx->id_snapshot_table, key);
+    }
+
+    talloc_free(key);
+}
+
 static void pam_reply(struct pam_auth_req *preq)
 {
     struct cli_ctx *cctx;
@@ -597,8 +673,7 @@ static void pam_reply(struct pam_auth_req *preq)
     struct pam_data *pd;
     struct pam_ctx *pctx;
     uint32_t user_info_type;
-    time_t exp_date = -1;
-    time_t delay_until = -1;
+    struct tevent_req *req;
     char* pam_account_expired_message;
     char* pam_account_locked_message;
     int pam_verbosity;
@@ -627,10 +702,9 @@ static void pam_reply(struct pam_auth_req *preq)
                 (preq->domain->cache_credentials == true) &&
                 (pd->offline_auth == false)) {
                 const char *password = NULL;
-                bool use_cached_auth;
 
                 /* backup value of preq->use_cached_auth*/
-                use_cached_auth = preq->use_cached_auth;
+                preq->saved_use_cached_auth = preq->use_cached_auth;
                 /* set to false to avoid entering this branch when pam_reply()
                  * is recursively called from pam_handle_cached_login() */
                 preq->use_cached_auth = false;
@@ -652,13 +726,15 @@ static void pam_reply(struct pam_auth_req *preq)
                     goto done;
                 }
 
-                ret = sysdb_cache_auth(preq->domain,
-                                       pd->user, password,
-                                       pctx->rctx->cdb, false,
-                                       &exp_date, &delay_until);
-
-                pam_handle_cached_login(preq, ret, exp_date, delay_until,
-                                        use_cached_auth);
+                req = sysdb_cache_auth_send(preq, cctx->ev, preq->domain,
+                                            pd->user, password,
+                                            pctx->rctx->cdb, false);
+                if (req == NULL) {
+                    DEBUG(SSSDBG_CRIT_FAILURE,
+                          "sysdb_cache_auth_send failed.\n");
+                    goto done;
+                }
+                tevent_req_set_callback(req, pam_cache_auth_done, preq);
                 return;
             }
             break;
@@ -692,6 +768,18 @@ static void pam_reply(struct pam_auth_req *preq)
         }
     }
 
+    /* The next conversation has to ask the backend again what the user
+     * can authenticate with */
+    if ((pd->cmd == SSS_PAM_AUTHENTICATE && pd->pam_status != PAM_SUCCESS)
+            || (pd->cmd == SSS_PAM_CHAUTHTOK
+                    && pd->pam_status == PAM_SUCCESS)) {
+        pam_preauth_cache_drop(pctx, preq);
+    }
+
+    if (pd->cmd == SSS_PAM_AUTHENTICATE) {
+        pam_id_snapshot_update(pctx, preq);
+    }
+
     if (pd->pam_status == PAM_SUCCESS && pd->cmd == SSS_PAM_CHAUTHTOK) {
         ret = pam_null_last_online_auth_with_curr_token(preq->domain,
                                                         pd->user);
@@ -843,6 +931,22 @@ done:
 
 static void pam_dom_forwarder(struct pam_auth_req *preq);
 
+static void pam_cache_auth_done(struct tevent_req *req)
+{
+    struct pam_auth_req *preq;
+    time_t exp_date = -1;
+    time_t delay_until = -1;
+    errno_t ret;
+
+    preq = tevent_req_callback_data(req, struct pam_auth_req);
+
+    ret = sysdb_cache_auth_recv(req, &exp_date, &delay_until);
+    talloc_zfree(req);
+
+    pam_handle_cached_login(preq, ret, exp_date, delay_until,
+                            preq->saved_use_cached_auth);
+}
+
 static void pam_handle_cached_login(struct pam_auth_req *preq, int ret,
                                     time_t expire_date, time_t delayed_until,
                                     bool use_cached_auth)
@@ -1069,7 +1173,8 @@ static errno_t check_cert(TALLOC_CTX *mctx,
         return ret;
     }
 
-    req = pam_check_cert_send(mctx, ev, pctx->p11_child_debug_fd,
+    req = pam_check_cert_send(mctx, ev, pctx->p11_worker,
+                              pctx->p11_child_debug_fd,
                               pctx->nss_db, p11_child_timeout,
                               cert_verification_opts, pd);
     if (req == NULL) {
@@ -1092,7 +1197,8 @@ static int pam_forwarder(struct cli_ctx *cctx, int pam_cmd)
             talloc_get_type(cctx->rctx->pvt_ctx, struct pam_ctx);
     struct tevent_req *req;
 
-    preq = talloc_zero(cctx, struct pam_auth_req);
+    /* freed by sss_cmd_done() before the request itself */
+    preq = talloc_zero(cctx->creq, struct pam_auth_req);
     if (!preq) {
         return ENOMEM;
     }
@@ -1340,6 +1446,63 @@ done:
     pam_check_user_done(preq, ret);
 }
 
+/* The phases after the authentication reuse the user found by it instead
+ * of looking the user up and refreshing the identity again */
+static bool pam_use_id_snapshot(struct pam_ctx *pctx,
+                                struct pam_auth_req *preq)
+{
+    struct sss_domain_info *dom;
+    char *domain;
+    char *user;
+    char *key;
+    errno_t ret;
+
+    if (pctx->id_snapshot_table == NULL) {
+        return false;
+    }
+
+    switch (preq->pd->cmd) {
+    case SSS_PAM_ACCT_MGMT:
+    case SSS_PAM_SETCRED:
+    case SSS_PAM_OPEN_SESSION:
+    case SSS_PAM_CLOSE_SESSION:
+        break;
+    default:
+        return false;
+    }
+
+    key = pam_id_snapshot_key(preq, preq->pd);
+    if (key == NULL) {
+        return false;
+    }
+
+    ret = pam_id_snapshot_get(preq, pctx->rctx->ev, pctx->id_snapshot_table,
+                              key, pctx->id_timeout, &domain, &user);
+    talloc_free(key);
+    if (ret != EOK) {
+        return false;
+    }
+
+    if (preq->pd->domain != NULL && strcmp(preq->pd->domain, domain) != 0) {
+        return false;
+    }
+
+    dom = responder_get_domain(pctx->rctx, domain);
+    if (dom == NULL) {
+        return false;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Reusing the identity of [%s@%s] found by the authentication\n",
+          user, domain);
+
+    preq->domain = dom;
+    preq->check_provider = NEED_CHECK_PROVIDER(dom->provider);
+    talloc_free(preq->pd->user);
+    preq->pd->user = talloc_steal(preq->pd, user);
+    return true;
+}
+
 static void pam_forwarder_cb(struct tevent_req *req)
 {
     struct pam_auth_req *preq = tevent_req_callback_data(req,
@@ -1393,6 +1556,12 @@ static void pam_forwarder_cb(struct tevent_req *req)
         goto done;
     }
 
+    if (pam_use_id_snapshot(pctx, preq)) {
+        pam_dom_forwarder(preq);
+        ret = EOK;
+        goto done;
+    }
+
     ret = pam_check_user_search(preq);
     if (ret == EOK) {
         pam_dom_forwarder(preq);
@@ -1775,6 +1944,55 @@ static bool pam_can_user_cache_auth(struct sss_domain_info *domain,
     return result;
 }
 
+/* Saves the response of a preauth request of the backend before it is sent
+ * to the client */
+static void pam_preauth_cache_cb(struct pam_auth_req *preq)
+{
+    struct pam_ctx *pctx =
+            talloc_get_type(preq->cctx->rctx->pvt_ctx, struct pam_ctx);
+    char *key;
+    errno_t ret;
+
+    if (preq->pd->pam_status == PAM_SUCCESS) {
+        key = pam_preauth_cache_key(preq, preq);
+        if (key != NULL) {
+            ret = pam_preauth_cache_set(pctx->rctx->ev, pctx->preauth_table,
+                                        key, pctx->preauth_timeout, preq->pd);
+            if (ret != EOK) {
+                /* not fatal, the next preauth goes to the backend */
+                DEBUG(SSSDBG_MINOR_FAILURE,
+                      "Could not cache the preauth response.\n");
+            }
+            talloc_free(key);
+        }
+    }
+
+    pam_reply(preq);
+}
+
+/* Returns true if the request was answered from the preauth cache */
+static bool pam_preauth_from_cache(struct pam_ctx *pctx,
+                                   struct pam_auth_req *preq)
+{
+    char *key;
+    errno_t ret;
+
+    key = pam_preauth_cache_key(preq, preq);
+    if (key == NULL) {
+        return false;
+    }
+
+    ret = pam_preauth_cache_get(pctx->preauth_table, key, preq->pd);
+    talloc_free(key);
+    if (ret != EOK) {
+        return false;
+    }
+
+    preq->callback = pam_reply;
+    pam_reply(preq);
+    return true;
+}
+
 static void pam_dom_forwarder(struct pam_auth_req *preq)
 {
     int ret;
@@ -1866,6 +2084,17 @@ static void pam_dom_forwarder(struct pam_auth_req *preq)
         preq->callback = pam_reply;
         ret = LOCAL_pam_handler(preq);
     }
+    else if (preq->pd->cmd == SSS_PAM_PREAUTH
+                && pctx->preauth_table != NULL
+                && pctx->preauth_timeout > 0) {
+        if (pam_preauth_from_cache(pctx, preq)) {
+            return;
+        }
+
+        preq->callback = pam_preauth_cache_cb;
+        ret = pam_dp_send_req(preq, SSS_CLI_SOCKET_TIMEOUT/2);
+        DEBUG(SSSDBG_CONF_SETTINGS, "pam_dp_send_req returned %d\n", ret);
+    }
     else {
         preq->callback = pam_reply;
         ret = pam_dp_send_req(preq, SSS_CLI_SOCKET_TIMEOUT/2);
@@ -35,6 +35,9 @@
 #define P11_CHILD_LOG_FILE "p11_child"
 #define P11_CHILD_PATH SSSD_LIBEXEC_PATH"/p11_child"
 
+/* anything larger means the pipe is out of sync */
+#define P11_CHILD_MAX_MSG_SIZE (64 * 1024)
+
 errno_t p11_child_init(struct pam_ctx *pctx)
 {
     return child_debug_init(P11_CHILD_LOG_FILE, &pctx->p11_child_debug_fd);
@@ -223,6 +226,15 @@ struct pam_check_cert_state {
     int read_from_child_fd;
     char *cert;
     char *token_name;
+
+    /* only used with the persistent p11_child */
+    const char *nss_db;
+    const char *verify_opts;
+    uint8_t *send_buf;
+    size_t send_len;
+    struct p11_child_worker *worker;
+    struct p11_child_wait *wait;
+    struct tevent_req *subreq;
 };
 
 static void p11_child_write_done(struct tevent_req *subreq);
@@ -231,8 +243,491 @@ static void p11_child_timeout(struct tevent_context *ev,
                               struct tevent_timer *te,
                               struct timeval tv, void *pvt);
 
+/* ==Persistent-p11_child=================================================== */
+
+/* With p11_child_persistent a single p11_child is started with --worker and
+ * kept running, so the PKCS#11 modules and the certificate DB are loaded
+ * only once. It serves one request after the other, smart card operations
+ * are serialized by the reader anyway. A request which arrives while the
+ * child is busy waits in line. A child which fails, exits or times out is
+ * replaced by a new one when it is needed, also if the NSS DB or the
+ * verification options changed. */
+
+struct p11_child_wait {
+    struct p11_child_wait *prev;
+    struct p11_child_wait *next;
+
+    struct p11_child_worker *worker;
+    struct tevent_req *req;
+};
+
+struct p11_child_worker {
+    struct tevent_context *ev;
+    int debug_fd;
+
+    /* the arguments the running child was started with */
+    char *nss_db;
+    char *verify_opts;
+
+    pid_t pid;
+    struct child_io_fds *io;
+    /* NULL if no child is running */
+    struct sss_child_ctx_old *child_ctx;
+
+    /* the request being served */
+    struct tevent_req *active;
+    struct p11_child_wait *waiting;
+};
+
+static void p11_child_worker_exited(int child_status,
+                                    struct tevent_signal *sige,
+                                    void *pvt);
+
+/* Kills the child, a request it was serving is left to the caller */
+static void p11_child_worker_stop(struct p11_child_worker *worker)
+{
+    struct pam_check_cert_state *state;
+
+    if (worker->active != NULL) {
+        state = tevent_req_data(worker->active, struct pam_check_cert_state);
+        talloc_zfree(state->subreq);
+        state->worker = NULL;
+        worker->active = NULL;
+    }
+
+    if (worker->child_ctx != NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Stopping p11_child [%d].\n", worker->pid);
+        /* kills the child, the handler still waits for it */
+        child_handler_destroy(worker->child_ctx);
+        worker->child_ctx = NULL;
+    }
+
+    talloc_zfree(worker->io);
+    talloc_zfree(worker->nss_db);
+    talloc_zfree(worker->verify_opts);
+}
+
+static int p11_child_worker_destructor(struct p11_child_worker *worker)
+{
+    p11_child_worker_stop(worker);
+    return 0;
+}
+
+errno_t p11_child_worker_setup(TALLOC_CTX *mem_ctx,
+                               struct tevent_context *ev,
+                               int child_debug_fd,
+                               struct p11_child_worker **_worker)
+{
+    struct p11_child_worker *worker;
+
+    worker = talloc_zero(mem_ctx, struct p11_child_worker);
+    if (worker == NULL) {
+        return ENOMEM;
+    }
+
+    worker->ev = ev;
+    worker->debug_fd = child_debug_fd == -1 ? STDERR_FILENO : child_debug_fd;
+    talloc_set_destructor(worker, p11_child_worker_destructor);
+
+    *_worker = worker;
+    return EOK;
+}
+
+static errno_t p11_child_worker_start(struct p11_child_worker *worker,
+                                      const char *nss_db,
+                                      const char *verify_opts)
+{
+    int pipefd_to_child[2];
+    int pipefd_from_child[2];
+    const char *extra_args[6] = { NULL };
+    size_t arg_c;
+    pid_t child_pid;
+    errno_t ret;
+
+    worker->nss_db = talloc_strdup(worker, nss_db);
+    if (worker->nss_db == NULL) {
+        return ENOMEM;
+    }
+
+    if (verify_opts != NULL) {
+        worker->verify_opts = talloc_strdup(worker, verify_opts);
+        if (worker->verify_opts == NULL) {
+            ret = ENOMEM;
+            goto fail;
+        }
+    }
+
+    worker->io = talloc(worker, struct child_io_fds);
+    if (worker->io == NULL) {
+        ret = ENOMEM;
+        goto fail;
+    }
+    worker->io->write_to_child_fd = -1;
+    worker->io->read_from_child_fd = -1;
+    talloc_set_destructor((void *) worker->io, child_io_destructor);
+
+    /* extra_args are added in revers order */
+    arg_c = 0;
+    extra_args[arg_c++] = worker->nss_db;
+    extra_args[arg_c++] = "--nssdb";
+    if (worker->verify_opts != NULL) {
+        extra_args[arg_c++] = worker->verify_opts;
+        extra_args[arg_c++] = "--verify";
+    }
+    extra_args[arg_c++] = "--worker";
+
+    ret = pipe(pipefd_from_child);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "pipe failed [%d][%s].\n", ret, strerror(ret));
+        goto fail;
+    }
+    ret = pipe(pipefd_to_child);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "pipe failed [%d][%s].\n", ret, strerror(ret));
+        close(pipefd_from_child[0]);
+        close(pipefd_from_child[1]);
+        goto fail;
+    }
+
+    ret = spawn_child(worker, pipefd_to_child, pipefd_from_child,
+                      P11_CHILD_PATH, worker->debug_fd, extra_args,
+                      false, STDIN_FILENO, STDOUT_FILENO, &child_pid);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not exec p11 child: [%d][%s].\n",
+                                   ret, strerror(ret));
+        close(pipefd_from_child[0]);
+        close(pipefd_from_child[1]);
+        close(pipefd_to_child[0]);
+        close(pipefd_to_child[1]);
+        goto fail;
+    }
+
+    worker->pid = child_pid;
+    worker->io->read_from_child_fd = pipefd_from_child[0];
+    close(pipefd_from_child[1]);
+    sss_fd_nonblocking(worker->io->read_from_child_fd);
+
+    worker->io->write_to_child_fd = pipefd_to_child[1];
+    close(pipefd_to_child[0]);
+    sss_fd_nonblocking(worker->io->write_to_child_fd);
+
+    ret = child_handler_setup(worker->ev, child_pid, p11_child_worker_exited,
+                              worker, &worker->child_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Could not set up child handlers [%d]: %s\n",
+              ret, sss_strerror(ret));
+        kill(child_pid, SIGKILL);
+        goto fail;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Started persistent p11_child [%d].\n",
+                             child_pid);
+    return EOK;
+
+fail:
+    p11_child_worker_stop(worker);
+    return ret;
+}
+
+static void p11_child_worker_step(struct tevent_req *subreq);
+static void p11_child_worker_done(struct tevent_req *subreq);
+
+static errno_t p11_child_worker_serve(struct tevent_req *req)
+{
+    struct pam_check_cert_state *state = tevent_req_data(req,
+                                                   struct pam_check_cert_state);
+    struct p11_child_worker *worker = state->worker;
+    errno_t ret;
+
+    if (worker->child_ctx != NULL
+            && (strcmp(worker->nss_db, state->nss_db) != 0
+                || (worker->verify_opts == NULL) != (state->verify_opts == NULL)
+                || (worker->verify_opts != NULL
+                        && strcmp(worker->verify_opts,
+                                  state->verify_opts) != 0))) {
+        DEBUG(SSSDBG_TRACE_FUNC, "The p11_child options changed.\n");
+        p11_child_worker_stop(worker);
+    }
+
+    if (worker->child_ctx == NULL) {
+        ret = p11_child_worker_start(worker, state->nss_db, state->verify_opts);
+        if (ret != EOK) {
+            return ERR_P11_CHILD;
+        }
+    }
+
+    worker->active = req;
+
+    state->subreq = write_pipe_send(state, state->ev,
+                                    state->send_buf, state->send_len,
+                                    worker->io->write_to_child_fd);
+    if (state->subreq == NULL) {
+        worker->active = NULL;
+        return ENOMEM;
+    }
+    tevent_req_set_callback(state->subreq, p11_child_worker_step, req);
+
+    return EOK;
+}
+
+/* Serves the waiting requests while the child is free */
+static void p11_child_worker_next(struct p11_child_worker *worker)
+{
+    struct pam_check_cert_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    while (worker->active == NULL && worker->waiting != NULL) {
+        req = worker->waiting->req;
+        state = tevent_req_data(req, struct pam_check_cert_state);
+        talloc_zfree(state->wait);
+
+        ret = p11_child_worker_serve(req);
+        if (ret != EOK) {
+            state->worker = NULL;
+            talloc_zfree(state->timeout_handler);
+            tevent_req_error(req, ret);
+        }
+    }
+}
+
+static int p11_child_wait_destructor(struct p11_child_wait *wait)
+{
+    DLIST_REMOVE(wait->worker->waiting, wait);
+    return 0;
+}
+
+static errno_t p11_child_worker_dispatch(struct tevent_req *req)
+{
+    struct pam_check_cert_state *state = tevent_req_data(req,
+                                                   struct pam_check_cert_state);
+    struct p11_child_worker *worker = state->worker;
+    struct p11_child_wait *wait;
+
+    if (worker->active == NULL) {
+        return p11_child_worker_serve(req);
+    }
+
+    wait = talloc_zero(state, struct p11_child_wait);
+    if (wait == NULL) {
+        return ENOMEM;
+    }
+    wait->worker = worker;
+    wait->req = req;
+
+    DLIST_ADD_END(worker->waiting, wait, struct p11_child_wait *);
+    talloc_set_destructor(wait, p11_child_wait_destructor);
+    state->wait = wait;
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "p11_child is busy, waiting.\n");
+    return EOK;
+}
+
+static void p11_child_worker_fail(struct tevent_req *req, errno_t ret)
+{
+    struct pam_check_cert_state *state = tevent_req_data(req,
+                                                   struct pam_check_cert_state);
+    struct p11_child_worker *worker = state->worker;
+
+    talloc_zfree(state->timeout_handler);
+
+    /* the pipe might be out of sync, a new child takes over */
+    if (worker != NULL) {
+        p11_child_worker_stop(worker);
+    }
+
+    tevent_req_error(req, ret);
+
+    if (worker != NULL) {
+        p11_child_worker_next(worker);
+    }
+}
+
+static void p11_child_worker_step(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct pam_check_cert_state *state = tevent_req_data(req,
+                                                   struct pam_check_cert_state);
+    int ret;
+
+    ret = write_pipe_recv(subreq);
+    talloc_zfree(subreq);
+    state->subreq = NULL;
+    safezero(state->send_buf, state->send_len);
+    if (ret != EOK) {
+        p11_child_worker_fail(req, ret);
+        return;
+    }
+
+    state->subreq = read_pipe_msg_send(state, state->ev,
+                                   state->worker->io->read_from_child_fd,
+                                   P11_CHILD_MAX_MSG_SIZE);
+    if (state->subreq == NULL) {
+        p11_child_worker_fail(req, ENOMEM);
+        return;
+    }
+    tevent_req_set_callback(state->subreq, p11_child_worker_done, req);
+}
+
+static void p11_child_worker_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct pam_check_cert_state *state = tevent_req_data(req,
+                                                   struct pam_check_cert_state);
+    struct p11_child_worker *worker = state->worker;
+    uint8_t *buf;
+    ssize_t buf_len;
+    int ret;
+
+    ret = read_pipe_msg_recv(subreq, state, &buf, &buf_len);
+    talloc_zfree(subreq);
+    state->subreq = NULL;
+    if (ret != EOK) {
+        p11_child_worker_fail(req, ret);
+        return;
+    }
+
+    talloc_zfree(state->timeout_handler);
+    worker->active = NULL;
+    state->worker = NULL;
+
+    ret = parse_p11_child_response(state, buf, buf_len, &state->cert,
+                                   &state->token_name);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "parse_p11_child_respose failed.\n");
+        tevent_req_error(req, ret);
+    } else {
+        tevent_req_done(req);
+    }
+
+    p11_child_worker_next(worker);
+}
+
+static void p11_child_worker_exited(int child_status,
+                                    struct tevent_signal *sige,
+                                    void *pvt)
+{
+    struct p11_child_worker *worker = talloc_get_type(pvt,
+                                                    struct p11_child_worker);
+    struct tevent_req *active = worker->active;
+    struct pam_check_cert_state *state;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "p11_child [%d] exited with status [%d].\n",
+          worker->pid, child_status);
+
+    /* the handler frees its context after this call */
+    worker->child_ctx = NULL;
+    p11_child_worker_stop(worker);
+
+    if (active != NULL) {
+        state = tevent_req_data(active, struct pam_check_cert_state);
+        talloc_zfree(state->timeout_handler);
+        tevent_req_error(active, ERR_P11_CHILD);
+    }
+
+    p11_child_worker_next(worker);
+}
+
+static int pam_check_cert_state_destructor(struct pam_check_cert_state *state)
+{
+    struct p11_child_worker *worker = state->worker;
+
+    /* the request was freed in the middle of the exchange */
+    if (worker != NULL && worker->active != NULL
+            && tevent_req_data(worker->active,
+                               struct pam_check_cert_state) == state) {
+        p11_child_worker_stop(worker);
+        p11_child_worker_next(worker);
+    }
+
+    return 0;
+}
+
+static errno_t p11_child_worker_send(struct tevent_req *req,
+                                     struct p11_child_worker *worker,
+                                     const char *nss_db,
+                                     const char *verify_opts,
+                                     time_t timeout,
+                                     struct pam_data *pd)
+{
+    struct pam_check_cert_state *state = tevent_req_data(req,
+                                                   struct pam_check_cert_state);
+    uint8_t *pin_buf = NULL;
+    size_t pin_len = 0;
+    struct timeval tv;
+    size_t rp;
+    errno_t ret;
+
+    state->nss_db = talloc_strdup(state, nss_db);
+    if (state->nss_db == NULL) {
+        return ENOMEM;
+    }
+
+    if (verify_opts != NULL) {
+        state->verify_opts = talloc_strdup(state, verify_opts);
+        if (state->verify_opts == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    if (pd->cmd == SSS_PAM_AUTHENTICATE) {
+        ret = get_p11_child_write_buffer(state, pd, &pin_buf, &pin_len);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "get_p11_child_write_buffer failed.\n");
+            return ret;
+        }
+    }
+
+    /* the length of the request, the PAM command and the PIN */
+    state->send_len = 3 * sizeof(uint32_t) + pin_len;
+    state->send_buf = talloc_size(state, state->send_len);
+    if (state->send_buf == NULL) {
+        if (pin_buf != NULL) {
+            safezero(pin_buf, pin_len);
+        }
+        return ENOMEM;
+    }
+
+    rp = 0;
+    SAFEALIGN_SET_UINT32(&state->send_buf[rp], state->send_len
+                                                    - sizeof(uint32_t), &rp);
+    SAFEALIGN_SET_UINT32(&state->send_buf[rp], pd->cmd, &rp);
+    SAFEALIGN_SET_UINT32(&state->send_buf[rp], pin_len, &rp);
+    if (pin_len != 0) {
+        safealign_memcpy(&state->send_buf[rp], pin_buf, pin_len, &rp);
+        safezero(pin_buf, pin_len);
+    }
+    talloc_free(pin_buf);
+
+    tv = tevent_timeval_current_ofs(timeout, 0);
+    state->timeout_handler = tevent_add_timer(state->ev, req, tv,
+                                              p11_child_timeout, req);
+    if (state->timeout_handler == NULL) {
+        return ERR_P11_CHILD;
+    }
+
+    state->worker = worker;
+    talloc_set_destructor(state, pam_check_cert_state_destructor);
+
+    ret = p11_child_worker_dispatch(req);
+    if (ret != EOK) {
+        state->worker = NULL;
+        talloc_zfree(state->timeout_handler);
+        return ret;
+    }
+
+    return EOK;
+}
+
 struct tevent_req *pam_check_cert_send(TALLOC_CTX *mem_ctx,
                                        struct tevent_context *ev,
+                                       struct p11_child_worker *worker,
                                        int child_debug_fd,
                                        const char *nss_db,
                                        time_t timeout,
@@ -300,6 +795,12 @@ struct tevent_req *pam_check_cert_send(TALLOC_CTX *mem_ctx,
     state->cert = NULL;
     state->token_name = NULL;
 
+    if (worker != NULL) {
+        ret = p11_child_worker_send(req, worker, nss_db, verify_opts, timeout,
+                                    pd);
+        goto done;
+    }
+
     ret = pipe(pipefd_from_child);
     if (ret == -1) {
         ret = errno;
@@ -319,83 +820,78 @@ struct tevent_req *pam_check_cert_send(TALLOC_CTX *mem_ctx,
         child_debug_fd = STDERR_FILENO;
     }
 
-    child_pid = fork();
-    if (child_pid == 0) { /* child */
-        ret = exec_child_ex(state, pipefd_to_child, pipefd_from_child,
-                            P11_CHILD_PATH, child_debug_fd, extra_args, false,
-                            STDIN_FILENO, STDOUT_FILENO);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_CRIT_FAILURE, "Could not exec p11 child: [%d][%s].\n",
-                                       ret, strerror(ret));
-            goto done;
-        }
-    } else if (child_pid > 0) { /* parent */
-
-        state->read_from_child_fd = pipefd_from_child[0];
+    ret = spawn_child(state, pipefd_to_child, pipefd_from_child,
+                      P11_CHILD_PATH, child_debug_fd, extra_args, false,
+                      STDIN_FILENO, STDOUT_FILENO, &child_pid);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not exec p11 child: [%d][%s].\n",
+                                   ret, strerror(ret));
+        close(pipefd_from_child[0]);
         close(pipefd_from_child[1]);
-        sss_fd_nonblocking(state->read_from_child_fd);
-
-        state->write_to_child_fd = pipefd_to_child[1];
         close(pipefd_to_child[0]);
-        sss_fd_nonblocking(state->write_to_child_fd);
+        close(pipefd_to_child[1]);
+        goto done;
+    }
+
+    state->read_from_child_fd = pipefd_from_child[0];
+    close(pipefd_from_child[1]);
+    sss_fd_nonblocking(state->read_from_child_fd);
+
+    state->write_to_child_fd = pipefd_to_child[1];
+    close(pipefd_to_child[0]);
+    sss_fd_nonblocking(state->write_to_child_fd);
 
-        /* Set up SIGCHLD handler */
-        ret = child_handler_setup(ev, child_pid, NULL, NULL, &state->child_ctx);
+    /* Set up SIGCHLD handler */
+    ret = child_handler_setup(ev, child_pid, NULL, NULL, &state->child_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Could not set up child handlers [%d]: %s\n",
+            ret, sss_strerror(ret));
+        ret = ERR_P11_CHILD;
+        goto done;
+    }
+
+    /* Set up timeout handler */
+    tv = tevent_timeval_current_ofs(timeout, 0);
+    state->timeout_handler = tevent_add_timer(ev, req, tv,
+                                              p11_child_timeout, req);
+    if(state->timeout_handler == NULL) {
+        ret = ERR_P11_CHILD;
+        goto done;
+    }
+
+    if (pd->cmd == SSS_PAM_AUTHENTICATE) {
+        ret = get_p11_child_write_buffer(state, pd, &write_buf,
+                                         &write_buf_len);
         if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE, "Could not set up child handlers [%d]: %s\n",
-                ret, sss_strerror(ret));
-            ret = ERR_P11_CHILD;
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "get_p11_child_write_buffer failed.\n");
             goto done;
         }
+    }
 
-        /* Set up timeout handler */
-        tv = tevent_timeval_current_ofs(timeout, 0);
-        state->timeout_handler = tevent_add_timer(ev, req, tv,
-                                                  p11_child_timeout, req);
-        if(state->timeout_handler == NULL) {
+    if (write_buf_len != 0) {
+        subreq = write_pipe_send(state, ev, write_buf, write_buf_len,
+                                 state->write_to_child_fd);
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_OP_FAILURE, "write_pipe_send failed.\n");
             ret = ERR_P11_CHILD;
             goto done;
         }
-
-        if (pd->cmd == SSS_PAM_AUTHENTICATE) {
-            ret = get_p11_child_write_buffer(state, pd, &write_buf,
-                                             &write_buf_len);
-            if (ret != EOK) {
-                DEBUG(SSSDBG_OP_FAILURE,
-                      "get_p11_child_write_buffer failed.\n");
-                goto done;
-            }
-        }
-
-        if (write_buf_len != 0) {
-            subreq = write_pipe_send(state, ev, write_buf, write_buf_len,
-                                     state->write_to_child_fd);
-            if (subreq == NULL) {
-                DEBUG(SSSDBG_OP_FAILURE, "write_pipe_send failed.\n");
-                ret = ERR_P11_CHILD;
-                goto done;
-            }
-            tevent_req_set_callback(subreq, p11_child_write_done, req);
-        } else {
-            subreq = read_pipe_send(state, ev, state->read_from_child_fd);
-            if (subreq == NULL) {
-                DEBUG(SSSDBG_OP_FAILURE, "read_pipe_send failed.\n");
-                ret = ERR_P11_CHILD;
-                goto done;
-            }
-            tevent_req_set_callback(subreq, p11_child_done, req);
+        tevent_req_set_callback(subreq, p11_child_write_done, req);
+    } else {
+        subreq = read_pipe_send(state, ev, state->read_from_child_fd);
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_OP_FAILURE, "read_pipe_send failed.\n");
+            ret = ERR_P11_CHILD;
+            goto done;
         }
-
-        /* Now either wait for the timeout to fire or the child
-         * to finish
-         */
-    } else { /* error */
-        ret = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE, "fork failed [%d][%s].\n",
-                                   ret, sss_strerror(ret));
-        goto done;
+        tevent_req_set_callback(subreq, p11_child_done, req);
     }
 
+    /* Now either wait for the timeout to fire or the child
+     * to finish
+     */
+
     ret = EOK;
 
 done:
@@ -475,9 +971,20 @@ static void p11_child_timeout(struct tevent_context *ev,
                               tevent_req_data(req, struct pam_check_cert_state);
 
     DEBUG(SSSDBG_CRIT_FAILURE, "Timeout reached for p11_child.\n");
-    child_handler_destroy(state->child_ctx);
-    state->child_ctx = NULL;
+    state->timeout_handler = NULL;
     state->child_status = ETIMEDOUT;
+
+    if (state->wait != NULL) {
+        /* the persistent p11_child did not get to this request */
+        talloc_zfree(state->wait);
+    } else if (state->worker != NULL) {
+        p11_child_worker_fail(req, ERR_P11_CHILD);
+        return;
+    } else {
+        child_handler_destroy(state->child_ctx);
+        state->child_ctx = NULL;
+    }
+
     tevent_req_error(req, ERR_P11_CHILD);
 }
 
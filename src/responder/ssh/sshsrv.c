@@ -25,6 +25,7 @@
 #include "monitor/monitor_interfaces.h"
 #include "responder/common/responder.h"
 #include "responder/common/responder_sbus.h"
+#include "responder/common/negcache.h"
 #include "responder/ssh/sshsrv_private.h"
 #include "providers/data_provider.h"
 
@@ -39,6 +40,8 @@ struct mon_cli_iface monitor_ssh_methods = {
     .clearMemcache = NULL,
     .clearEnumCache = NULL,
     .sysbusReconnect = NULL,
+    .memReport = monitor_common_mem_report,
+    .startupTimes = monitor_common_startup_times,
 };
 
 static struct data_provider_iface ssh_dp_methods = {
@@ -172,7 +175,42 @@ int ssh_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
-    ret = schedule_get_domains_task(rctx, rctx->ev, rctx, NULL);
+    /* Set up the negative cache */
+    ret = confdb_get_int(ssh_ctx->rctx->cdb,
+                         CONFDB_NSS_CONF_ENTRY, CONFDB_NSS_ENTRY_NEG_TIMEOUT,
+                         15, &ssh_ctx->neg_timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Error reading from confdb (%d) [%s]\n",
+              ret, strerror(ret));
+        goto fail;
+    }
+
+    ret = sss_ncache_init(ssh_ctx, &ssh_ctx->ncache);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "fatal error initializing negative cache\n");
+        goto fail;
+    }
+
+    /* not fatal, the cache is then private to this responder */
+    sss_ncache_share(ssh_ctx->ncache, SSS_NCACHE_SHARED_FILE);
+    sss_ncache_set_stats(ssh_ctx->ncache, rctx->cmd_stats);
+
+    ret = sss_ncache_prepopulate(ssh_ctx->ncache, ssh_ctx->rctx->cdb, rctx);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    /* Create table for the formatted user public keys */
+    ret = sss_hash_create(ssh_ctx, 0, &ssh_ctx->user_keys);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Could not create user keys hash table: [%s]\n",
+              strerror(ret));
+        goto fail;
+    }
+
+    ret = schedule_get_domains_task(rctx, rctx->ev, rctx, ssh_ctx->ncache);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "schedule_get_domains_tasks failed.\n");
         goto fail;
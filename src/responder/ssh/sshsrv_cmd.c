@@ -172,10 +172,32 @@ ssh_user_pubkeys_search(struct ssh_cmd_ctx *cmd_ctx)
 {
     struct tevent_req *req;
     struct dp_callback_ctx *cb_ctx;
+    struct ssh_ctx *ssh_ctx = talloc_get_type(cmd_ctx->cctx->rctx->pvt_ctx,
+                                              struct ssh_ctx);
+    int ncret;
+
+    while (cmd_ctx->domain) {
+        /* if it is a domainless search, skip domains that require fully
+         * qualified names instead */
+        if (cmd_ctx->check_next && cmd_ctx->domain->fqnames) {
+            cmd_ctx->domain = get_next_domain(cmd_ctx->domain, false);
+            continue;
+        }
+
+        /* unknown users do not go to the data provider again */
+        ncret = sss_ncache_check_user(ssh_ctx->ncache, ssh_ctx->neg_timeout,
+                                      cmd_ctx->domain, cmd_ctx->name);
+        if (ncret != EEXIST) {
+            break;
+        }
 
-    /* if it is a domainless search, skip domains that require fully
-     * qualified names instead */
-    while (cmd_ctx->domain && cmd_ctx->check_next && cmd_ctx->domain->fqnames) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "User [%s@%s] filtered out (negative cache)\n",
+               cmd_ctx->name, cmd_ctx->domain->name);
+
+        if (!cmd_ctx->check_next) {
+            return ENOENT;
+        }
         cmd_ctx->domain = get_next_domain(cmd_ctx->domain, false);
     }
 
@@ -219,6 +241,8 @@ ssh_user_pubkeys_search(struct ssh_cmd_ctx *cmd_ctx)
 static errno_t
 ssh_user_pubkeys_search_next(struct ssh_cmd_ctx *cmd_ctx)
 {
+    struct ssh_ctx *ssh_ctx = talloc_get_type(cmd_ctx->cctx->rctx->pvt_ctx,
+                                              struct ssh_ctx);
     errno_t ret;
     const char *attrs[] = { SYSDB_NAME, SYSDB_SSH_PUBKEY, SYSDB_USER_CERT,
                             NULL };
@@ -250,6 +274,14 @@ ssh_user_pubkeys_search_next(struct ssh_cmd_ctx *cmd_ctx)
     }
 
     if (!res->count) {
+        ret = sss_ncache_set_user(ssh_ctx->ncache, false, cmd_ctx->domain,
+                                  cmd_ctx->name);
+        if (ret != EOK) {
+            /* Should not be fatal, just slower next time */
+            DEBUG(SSSDBG_MINOR_FAILURE, "Cannot set ncache for [%s@%s]\n",
+                  cmd_ctx->name, cmd_ctx->domain->name);
+        }
+
         /* if a multidomain search, try with next */
         if (cmd_ctx->check_next) {
             cmd_ctx->domain = get_next_domain(cmd_ctx->domain, false);
@@ -401,264 +433,6 @@ ssh_host_pubkeys_search_dp_callback(uint16_t err_maj,
     ssh_cmd_get_host_pubkeys_done(cmd_ctx, ret);
 }
 
-static char *
-ssh_host_pubkeys_format_known_host_plain(TALLOC_CTX *mem_ctx,
-                                         struct sss_ssh_ent *ent)
-{
-    TALLOC_CTX *tmp_ctx;
-    errno_t ret;
-    char *name, *pubkey;
-    char *result = NULL;
-    size_t i;
-
-    tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
-        return NULL;
-    }
-
-    name = talloc_strdup(tmp_ctx, ent->name);
-    if (!name) {
-        goto done;
-    }
-
-    for (i = 0; i < ent->num_aliases; i++) {
-        name = talloc_asprintf_append(name, ",%s", ent->aliases[i]);
-        if (!name) {
-            goto done;
-        }
-    }
-
-    result = talloc_strdup(tmp_ctx, "");
-    if (!result) {
-        goto done;
-    }
-
-    for (i = 0; i < ent->num_pubkeys; i++) {
-        ret = sss_ssh_format_pubkey(tmp_ctx, &ent->pubkeys[i], &pubkey);
-        if (ret != EOK) {
-            result = NULL;
-            goto done;
-        }
-
-        result = talloc_asprintf_append(result, "%s %s\n", name, pubkey);
-        if (!result) {
-            goto done;
-        }
-
-        talloc_free(pubkey);
-    }
-
-    talloc_steal(mem_ctx, result);
-
-done:
-    talloc_free(tmp_ctx);
-
-    return result;
-}
-
-static char *
-ssh_host_pubkeys_format_known_host_hashed(TALLOC_CTX *mem_ctx,
-                                          struct sss_ssh_ent *ent)
-{
-    TALLOC_CTX *tmp_ctx;
-    errno_t ret;
-    char *name, *pubkey, *saltstr, *hashstr, *result;
-    unsigned char salt[SSS_SHA1_LENGTH], hash[SSS_SHA1_LENGTH];
-    size_t i, j, k;
-
-    tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
-        return NULL;
-    }
-
-    result = talloc_strdup(tmp_ctx, "");
-    if (!result) {
-        goto done;
-    }
-
-    for (i = 0; i < ent->num_pubkeys; i++) {
-        ret = sss_ssh_format_pubkey(tmp_ctx, &ent->pubkeys[i], &pubkey);
-        if (ret != EOK) {
-            result = NULL;
-            goto done;
-        }
-
-        for (j = 0; j <= ent->num_aliases; j++) {
-            name = (j == 0 ? ent->name : ent->aliases[j-1]);
-
-            for (k = 0; k < SSS_SHA1_LENGTH; k++) {
-                salt[k] = rand();
-            }
-
-            ret = sss_hmac_sha1(salt, SSS_SHA1_LENGTH,
-                                (unsigned char *)name, strlen(name),
-                                hash);
-            if (ret != EOK) {
-                DEBUG(SSSDBG_OP_FAILURE,
-                      "sss_hmac_sha1() failed (%d): %s\n",
-                       ret, strerror(ret));
-                result = NULL;
-                goto done;
-            }
-
-            saltstr = sss_base64_encode(tmp_ctx, salt, SSS_SHA1_LENGTH);
-            if (!saltstr) {
-                result = NULL;
-                goto done;
-            }
-
-            hashstr = sss_base64_encode(tmp_ctx, hash, SSS_SHA1_LENGTH);
-            if (!hashstr) {
-                result = NULL;
-                goto done;
-            }
-
-            result = talloc_asprintf_append(result, "|1|%s|%s %s\n",
-                                            saltstr, hashstr, pubkey);
-            if (!result) {
-                goto done;
-            }
-
-            talloc_free(saltstr);
-            talloc_free(hashstr);
-        }
-
-        talloc_free(pubkey);
-    }
-
-    talloc_steal(mem_ctx, result);
-
-done:
-    talloc_free(tmp_ctx);
-
-    return result;
-}
-
-static errno_t
-ssh_host_pubkeys_update_known_hosts(struct ssh_cmd_ctx *cmd_ctx)
-{
-    TALLOC_CTX *tmp_ctx;
-    errno_t ret;
-    const char *attrs[] = {
-        SYSDB_NAME,
-        SYSDB_NAME_ALIAS,
-        SYSDB_SSH_PUBKEY,
-        NULL
-    };
-    struct cli_ctx *cctx = cmd_ctx->cctx;
-    struct sss_domain_info *dom = cctx->rctx->domains;
-    struct ssh_ctx *ssh_ctx = (struct ssh_ctx *)cctx->rctx->pvt_ctx;
-    struct sysdb_ctx *sysdb;
-    time_t now = time(NULL);
-    struct ldb_message **hosts;
-    size_t num_hosts, i;
-    struct sss_ssh_ent *ent;
-    int fd = -1;
-    char *filename = NULL;
-    char *entstr;
-    ssize_t wret;
-
-    tmp_ctx = talloc_new(NULL);
-    if (!tmp_ctx) {
-        return ENOMEM;
-    }
-
-    if (cmd_ctx->domain) {
-        ret = sysdb_update_ssh_known_host_expire(cmd_ctx->domain,
-                                                 cmd_ctx->name, now,
-                                                 ssh_ctx->known_hosts_timeout);
-        if (ret != EOK && ret != ENOENT) {
-            goto done;
-        }
-    }
-
-    /* write known_hosts file */
-    filename = talloc_strdup(tmp_ctx, SSS_SSH_KNOWN_HOSTS_TEMP_TMPL);
-    if (!filename) {
-        ret = ENOMEM;
-        goto done;
-    }
-
-    fd = sss_unique_file_ex(tmp_ctx, filename, 0133, &ret);
-    if (fd == -1) {
-        filename = NULL;
-        goto done;
-    }
-
-    for (; dom; dom = get_next_domain(dom, false)) {
-        sysdb = dom->sysdb;
-        if (sysdb == NULL) {
-            DEBUG(SSSDBG_FATAL_FAILURE,
-                  "Fatal: Sysdb CTX not found for this domain!\n");
-            ret = EFAULT;
-            goto done;
-        }
-
-        ret = sysdb_get_ssh_known_hosts(tmp_ctx, dom, now, attrs,
-                                        &hosts, &num_hosts);
-        if (ret != EOK) {
-            if (ret != ENOENT) {
-                DEBUG(SSSDBG_OP_FAILURE,
-                      "Host search failed for domain [%s]\n", dom->name);
-            }
-            continue;
-        }
-
-        for (i = 0; i < num_hosts; i++) {
-            ret = sss_ssh_make_ent(tmp_ctx, hosts[i], &ent);
-            if (ret != EOK) {
-                DEBUG(SSSDBG_OP_FAILURE,
-                      "Failed to get SSH host public keys\n");
-                continue;
-            }
-
-            if (ssh_ctx->hash_known_hosts) {
-                entstr = ssh_host_pubkeys_format_known_host_hashed(ent, ent);
-            } else {
-                entstr = ssh_host_pubkeys_format_known_host_plain(ent, ent);
-            }
-            if (!entstr) {
-                DEBUG(SSSDBG_OP_FAILURE,
-                      "Failed to format known_hosts data for [%s]\n",
-                       ent->name);
-                continue;
-            }
-
-            wret = sss_atomic_write_s(fd, entstr, strlen(entstr));
-            if (wret == -1) {
-                ret = errno;
-                goto done;
-            }
-
-            talloc_free(ent);
-        }
-
-        talloc_free(hosts);
-    }
-
-    ret = fchmod(fd, 0644);
-    if (ret == -1) {
-        ret = errno;
-        goto done;
-    }
-
-    ret = rename(filename, SSS_SSH_KNOWN_HOSTS_PATH);
-    if (ret == -1) {
-        ret = errno;
-        goto done;
-    }
-
-    ret = EOK;
-
-done:
-    if (fd != -1) {
-        close(fd);
-    }
-    talloc_free(tmp_ctx);
-
-    return ret;
-}
-
 static errno_t
 ssh_cmd_parse_request(struct ssh_cmd_ctx *cmd_ctx)
 {
@@ -875,6 +649,150 @@ done:
     return ret;
 }
 
+/* A formatted reply to a user key lookup. It is reused as long as the
+ * attributes it was built from are the same. */
+struct ssh_user_keys {
+    uint8_t *src;
+    size_t src_len;
+    uint8_t *body;
+    size_t body_len;
+    time_t expire;
+};
+
+static errno_t
+ssh_user_keys_add_src(TALLOC_CTX *mem_ctx,
+                      struct ldb_message_element *el,
+                      uint8_t **_src,
+                      size_t *_src_len)
+{
+    uint8_t *src = *_src;
+    size_t c = *_src_len;
+    size_t len;
+    unsigned int i;
+
+    len = sizeof(uint32_t);
+    if (el != NULL) {
+        for (i = 0; i < el->num_values; i++) {
+            len += sizeof(uint32_t) + el->values[i].length;
+        }
+    }
+
+    src = talloc_realloc(mem_ctx, src, uint8_t, c + len);
+    if (src == NULL) {
+        return ENOMEM;
+    }
+
+    SAFEALIGN_SETMEM_UINT32(src + c, el != NULL ? el->num_values : 0, &c);
+    if (el != NULL) {
+        for (i = 0; i < el->num_values; i++) {
+            SAFEALIGN_SETMEM_UINT32(src + c, el->values[i].length, &c);
+            safealign_memcpy(src + c, el->values[i].data,
+                             el->values[i].length, &c);
+        }
+    }
+
+    *_src = src;
+    *_src_len = c;
+
+    return EOK;
+}
+
+static errno_t
+ssh_user_keys_key(TALLOC_CTX *mem_ctx,
+                  struct ssh_cmd_ctx *cmd_ctx,
+                  hash_key_t *key)
+{
+    key->type = HASH_KEY_STRING;
+    key->str = talloc_asprintf(mem_ctx, "%s:%s", cmd_ctx->domain->name,
+                               cmd_ctx->name);
+    if (key->str == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static struct ssh_user_keys *
+ssh_user_keys_lookup(struct ssh_ctx *ssh_ctx,
+                     struct ssh_cmd_ctx *cmd_ctx,
+                     uint8_t *src,
+                     size_t src_len)
+{
+    struct ssh_user_keys *keys;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    if (ssh_user_keys_key(cmd_ctx, cmd_ctx, &key) != EOK) {
+        return NULL;
+    }
+
+    hret = hash_lookup(ssh_ctx->user_keys, &key, &value);
+    talloc_free(key.str);
+    if (hret != HASH_SUCCESS) {
+        return NULL;
+    }
+
+    keys = talloc_get_type(value.ptr, struct ssh_user_keys);
+    if (keys->expire < time(NULL)
+            || keys->src_len != src_len
+            || memcmp(keys->src, src, src_len) != 0) {
+        return NULL;
+    }
+
+    return keys;
+}
+
+static void
+ssh_user_keys_store(struct ssh_ctx *ssh_ctx,
+                    struct ssh_cmd_ctx *cmd_ctx,
+                    uint8_t *src,
+                    size_t src_len)
+{
+    struct cli_ctx *cctx = cmd_ctx->cctx;
+    struct ssh_user_keys *keys;
+    hash_key_t key;
+    hash_value_t value;
+    uint8_t *body;
+    size_t body_len;
+    int hret;
+
+    keys = talloc_zero(ssh_ctx->user_keys, struct ssh_user_keys);
+    if (keys == NULL) {
+        return;
+    }
+
+    sss_packet_get_body(cctx->creq->out, &body, &body_len);
+
+    keys->src = talloc_memdup(keys, src, src_len);
+    keys->body = talloc_memdup(keys, body, body_len);
+    if (keys->src == NULL || keys->body == NULL
+            || ssh_user_keys_key(keys, cmd_ctx, &key) != EOK) {
+        talloc_free(keys);
+        return;
+    }
+    keys->src_len = src_len;
+    keys->body_len = body_len;
+    /* keys derived from certificates are verified again after the
+     * entry cache timeout */
+    keys->expire = time(NULL) + cmd_ctx->domain->user_timeout;
+
+    if (hash_lookup(ssh_ctx->user_keys, &key, &value) == HASH_SUCCESS) {
+        hash_delete(ssh_ctx->user_keys, &key);
+        talloc_free(value.ptr);
+    }
+
+    value.type = HASH_VALUE_PTR;
+    value.ptr = keys;
+
+    hret = hash_enter(ssh_ctx->user_keys, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to cache keys of [%s@%s]\n",
+              cmd_ctx->name, cmd_ctx->domain->name);
+        talloc_free(keys);
+    }
+}
+
 static errno_t
 ssh_cmd_build_reply(struct ssh_cmd_ctx *cmd_ctx)
 {
@@ -893,6 +811,9 @@ ssh_cmd_build_reply(struct ssh_cmd_ctx *cmd_ctx)
     uint32_t fqname_len;
     struct ssh_ctx *ssh_ctx = talloc_get_type(cctx->rctx->pvt_ctx,
                                               struct ssh_ctx);
+    struct ssh_user_keys *keys;
+    uint8_t *src = NULL;
+    size_t src_len = 0;
 
     ret = sss_packet_new(cctx->creq, 0,
                          sss_packet_get_cmd(cctx->creq->in),
@@ -926,6 +847,40 @@ ssh_cmd_build_reply(struct ssh_cmd_ctx *cmd_ctx)
         count += el_user_cert->num_values;
     }
 
+    if (cmd_ctx->is_user && count > 0) {
+        /* decoding the keys and verifying the certificates is expensive,
+         * reuse the previous reply if the attributes did not change */
+        ret = ssh_user_keys_add_src(cmd_ctx, el, &src, &src_len);
+        if (ret == EOK) {
+            ret = ssh_user_keys_add_src(cmd_ctx, el_orig, &src, &src_len);
+        }
+        if (ret == EOK) {
+            ret = ssh_user_keys_add_src(cmd_ctx, el_override, &src, &src_len);
+        }
+        if (ret == EOK) {
+            ret = ssh_user_keys_add_src(cmd_ctx, el_user_cert, &src,
+                                        &src_len);
+        }
+        if (ret != EOK) {
+            return ret;
+        }
+
+        keys = ssh_user_keys_lookup(ssh_ctx, cmd_ctx, src, src_len);
+        if (keys != NULL) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Using cached SSH keys of [%s@%s]\n",
+                  cmd_ctx->name, cmd_ctx->domain->name);
+
+            ret = sss_packet_grow(cctx->creq->out, keys->body_len);
+            if (ret != EOK) {
+                return ret;
+            }
+            sss_packet_get_body(cctx->creq->out, &body, &body_len);
+            memcpy(body, keys->body, keys->body_len);
+
+            return EOK;
+        }
+    }
+
     ret = sss_packet_grow(cctx->creq->out, 2*sizeof(uint32_t));
     if (ret != EOK) {
         return ret;
@@ -983,6 +938,10 @@ ssh_cmd_build_reply(struct ssh_cmd_ctx *cmd_ctx)
         return ret;
     }
 
+    if (src != NULL) {
+        ssh_user_keys_store(ssh_ctx, cmd_ctx, src, src_len);
+    }
+
     return EOK;
 }
 
@@ -1062,7 +1021,8 @@ ssh_cmd_get_host_pubkeys_done(struct ssh_cmd_ctx *cmd_ctx,
                               errno_t ret)
 {
     if (ret == EOK || ret == ENOENT) {
-        ssh_host_pubkeys_update_known_hosts(cmd_ctx);
+        ssh_known_hosts_update(cmd_ctx->cctx->rctx->pvt_ctx, cmd_ctx->domain,
+                               cmd_ctx->name);
     }
 
     return ssh_cmd_done(cmd_ctx, ret);
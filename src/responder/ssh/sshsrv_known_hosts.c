@@ -0,0 +1,630 @@
+/*
+    Authors:
+        Jan Cholasta <jcholast@redhat.com>
+
+    Copyright (C) 2012 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <talloc.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <dhash.h>
+
+#include "util/util.h"
+#include "util/crypto/sss_crypto.h"
+#include "util/sss_ssh.h"
+#include "db/sysdb.h"
+#include "db/sysdb_ssh.h"
+#include "responder/ssh/sshsrv_private.h"
+
+/* The known_hosts file is generated from an in-memory copy of the formatted
+ * entries. The copy is loaded from sysdb once, after that only the host
+ * that was looked up is read from sysdb. The file is rewritten only when an
+ * entry changed or expired, new hosts are appended. */
+
+struct ssh_known_host {
+    struct ssh_known_host *prev;
+    struct ssh_known_host *next;
+
+    struct ssh_known_hosts *kh;
+    char *key;
+    /* plain format, used to detect changes since hashed entries
+     * are salted randomly */
+    char *plain;
+    char *entstr;
+    time_t expire;
+};
+
+struct ssh_known_hosts {
+    hash_table_t *table;
+    struct ssh_known_host *list;
+    time_t next_expire;
+};
+
+static const char *ssh_known_hosts_attrs[] = {
+    SYSDB_NAME,
+    SYSDB_NAME_ALIAS,
+    SYSDB_SSH_PUBKEY,
+    SYSDB_CACHE_EXPIRE,
+    SYSDB_SSH_KNOWN_HOSTS_EXPIRE,
+    NULL
+};
+
+static char *
+ssh_host_pubkeys_format_known_host_plain(TALLOC_CTX *mem_ctx,
+                                         struct sss_ssh_ent *ent)
+{
+    TALLOC_CTX *tmp_ctx;
+    errno_t ret;
+    char *name, *pubkey;
+    char *result = NULL;
+    size_t i;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return NULL;
+    }
+
+    name = talloc_strdup(tmp_ctx, ent->name);
+    if (!name) {
+        goto done;
+    }
+
+    for (i = 0; i < ent->num_aliases; i++) {
+        name = talloc_asprintf_append(name, ",%s", ent->aliases[i]);
+        if (!name) {
+            goto done;
+        }
+    }
+
+    result = talloc_strdup(tmp_ctx, "");
+    if (!result) {
+        goto done;
+    }
+
+    for (i = 0; i < ent->num_pubkeys; i++) {
+        ret = sss_ssh_format_pubkey(tmp_ctx, &ent->pubkeys[i], &pubkey);
+        if (ret != EOK) {
+            result = NULL;
+            goto done;
+        }
+
+        result = talloc_asprintf_append(result, "%s %s\n", name, pubkey);
+        if (!result) {
+            goto done;
+        }
+
+        talloc_free(pubkey);
+    }
+
+    talloc_steal(mem_ctx, result);
+
+done:
+    talloc_free(tmp_ctx);
+
+    return result;
+}
+
+static char *
+ssh_host_pubkeys_format_known_host_hashed(TALLOC_CTX *mem_ctx,
+                                          struct sss_ssh_ent *ent)
+{
+    TALLOC_CTX *tmp_ctx;
+    errno_t ret;
+    char *name, *pubkey, *saltstr, *hashstr, *result;
+    unsigned char salt[SSS_SHA1_LENGTH], hash[SSS_SHA1_LENGTH];
+    size_t i, j, k;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return NULL;
+    }
+
+    result = talloc_strdup(tmp_ctx, "");
+    if (!result) {
+        goto done;
+    }
+
+    for (i = 0; i < ent->num_pubkeys; i++) {
+        ret = sss_ssh_format_pubkey(tmp_ctx, &ent->pubkeys[i], &pubkey);
+        if (ret != EOK) {
+            result = NULL;
+            goto done;
+        }
+
+        for (j = 0; j <= ent->num_aliases; j++) {
+            name = (j == 0 ? ent->name : ent->aliases[j-1]);
+
+            for (k = 0; k < SSS_SHA1_LENGTH; k++) {
+                salt[k] = rand();
+            }
+
+            ret = sss_hmac_sha1(salt, SSS_SHA1_LENGTH,
+                                (unsigned char *)name, strlen(name),
+                                hash);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "sss_hmac_sha1() failed (%d): %s\n",
+                       ret, strerror(ret));
+                result = NULL;
+                goto done;
+            }
+
+            saltstr = sss_base64_encode(tmp_ctx, salt, SSS_SHA1_LENGTH);
+            if (!saltstr) {
+                result = NULL;
+                goto done;
+            }
+
+            hashstr = sss_base64_encode(tmp_ctx, hash, SSS_SHA1_LENGTH);
+            if (!hashstr) {
+                result = NULL;
+                goto done;
+            }
+
+            result = talloc_asprintf_append(result, "|1|%s|%s %s\n",
+                                            saltstr, hashstr, pubkey);
+            if (!result) {
+                goto done;
+            }
+
+            talloc_free(saltstr);
+            talloc_free(hashstr);
+        }
+
+        talloc_free(pubkey);
+    }
+
+    talloc_steal(mem_ctx, result);
+
+done:
+    talloc_free(tmp_ctx);
+
+    return result;
+}
+
+static int
+ssh_known_host_destructor(struct ssh_known_host *host)
+{
+    hash_key_t key;
+
+    key.type = HASH_KEY_STRING;
+    key.str = host->key;
+    hash_delete(host->kh->table, &key);
+
+    DLIST_REMOVE(host->kh->list, host);
+
+    return 0;
+}
+
+static char *
+ssh_known_host_key(TALLOC_CTX *mem_ctx,
+                   struct sss_domain_info *domain,
+                   const char *name)
+{
+    return talloc_asprintf(mem_ctx, "%s:%s", domain->name, name);
+}
+
+static struct ssh_known_host *
+ssh_known_host_lookup(struct ssh_known_hosts *kh,
+                      const char *key_str)
+{
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(key_str);
+
+    hret = hash_lookup(kh->table, &key, &value);
+    if (hret != HASH_SUCCESS) {
+        return NULL;
+    }
+
+    return talloc_get_type(value.ptr, struct ssh_known_host);
+}
+
+static time_t
+ssh_known_host_get_expire(struct ldb_message *msg)
+{
+    time_t expire;
+    time_t cache_expire;
+
+    expire = ldb_msg_find_attr_as_uint64(msg, SYSDB_SSH_KNOWN_HOSTS_EXPIRE, 0);
+    cache_expire = ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0);
+    if (cache_expire != 0 && cache_expire < expire) {
+        expire = cache_expire;
+    }
+
+    return expire;
+}
+
+/* Formats the host and stores it in the table. Returns EEXIST if the host
+ * is already known with the same keys. */
+static errno_t
+ssh_known_host_set(struct ssh_ctx *ssh_ctx,
+                   struct sss_domain_info *domain,
+                   struct ldb_message *msg,
+                   struct ssh_known_host **_host,
+                   bool *_added)
+{
+    struct ssh_known_hosts *kh = ssh_ctx->known_hosts;
+    struct ssh_known_host *host;
+    struct sss_ssh_ent *ent;
+    hash_key_t key;
+    hash_value_t value;
+    char *key_str;
+    char *plain;
+    char *entstr;
+    errno_t ret;
+    int hret;
+
+    ret = sss_ssh_make_ent(NULL, msg, &ent);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to get SSH host public keys\n");
+        return ret;
+    }
+
+    key_str = ssh_known_host_key(ent, domain, ent->name);
+    plain = ssh_host_pubkeys_format_known_host_plain(ent, ent);
+    if (key_str == NULL || plain == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Failed to format known_hosts data for [%s]\n", ent->name);
+        ret = ENOMEM;
+        goto done;
+    }
+
+    host = ssh_known_host_lookup(kh, key_str);
+    *_added = host == NULL;
+    if (host != NULL && strcmp(host->plain, plain) == 0) {
+        host->expire = ssh_known_host_get_expire(msg);
+        *_host = host;
+        ret = EEXIST;
+        goto done;
+    }
+
+    if (ssh_ctx->hash_known_hosts) {
+        entstr = ssh_host_pubkeys_format_known_host_hashed(ent, ent);
+    } else {
+        entstr = talloc_strdup(ent, plain);
+    }
+    if (entstr == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Failed to format known_hosts data for [%s]\n", ent->name);
+        ret = ENOMEM;
+        goto done;
+    }
+
+    if (host == NULL) {
+        host = talloc_zero(kh, struct ssh_known_host);
+        if (host == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        host->kh = kh;
+        host->key = talloc_steal(host, key_str);
+
+        key.type = HASH_KEY_STRING;
+        key.str = host->key;
+        value.type = HASH_VALUE_PTR;
+        value.ptr = host;
+
+        hret = hash_enter(kh->table, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            talloc_free(host);
+            ret = EIO;
+            goto done;
+        }
+
+        DLIST_ADD(kh->list, host);
+        talloc_set_destructor(host, ssh_known_host_destructor);
+    } else {
+        talloc_free(host->plain);
+        talloc_free(host->entstr);
+    }
+
+    host->plain = talloc_steal(host, plain);
+    host->entstr = talloc_steal(host, entstr);
+    host->expire = ssh_known_host_get_expire(msg);
+    if (kh->next_expire == 0 || host->expire < kh->next_expire) {
+        kh->next_expire = host->expire;
+    }
+
+    *_host = host;
+    ret = EOK;
+
+done:
+    talloc_free(ent);
+    return ret;
+}
+
+static errno_t
+ssh_known_hosts_load(struct ssh_ctx *ssh_ctx, time_t now)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sss_domain_info *dom;
+    struct ssh_known_host *host;
+    struct ldb_message **hosts;
+    size_t num_hosts, i;
+    bool added;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ssh_ctx->known_hosts = talloc_zero(ssh_ctx, struct ssh_known_hosts);
+    if (ssh_ctx->known_hosts == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_hash_create(ssh_ctx->known_hosts, 0,
+                          &ssh_ctx->known_hosts->table);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (dom = ssh_ctx->rctx->domains; dom; dom = get_next_domain(dom, false)) {
+        if (dom->sysdb == NULL) {
+            DEBUG(SSSDBG_FATAL_FAILURE,
+                  "Fatal: Sysdb CTX not found for this domain!\n");
+            ret = EFAULT;
+            goto done;
+        }
+
+        ret = sysdb_get_ssh_known_hosts(tmp_ctx, dom, now,
+                                        ssh_known_hosts_attrs,
+                                        &hosts, &num_hosts);
+        if (ret != EOK) {
+            if (ret != ENOENT) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "Host search failed for domain [%s]\n", dom->name);
+            }
+            continue;
+        }
+
+        for (i = 0; i < num_hosts; i++) {
+            ret = ssh_known_host_set(ssh_ctx, dom, hosts[i], &host, &added);
+            if (ret == ENOMEM || ret == EIO) {
+                goto done;
+            }
+        }
+
+        talloc_free(hosts);
+    }
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_zfree(ssh_ctx->known_hosts);
+    }
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
+
+/* Drops expired entries, only walks the table once the earliest
+ * expiration time has passed. */
+static bool
+ssh_known_hosts_expire(struct ssh_known_hosts *kh, time_t now)
+{
+    struct ssh_known_host *host;
+    struct ssh_known_host *next;
+    time_t next_expire = 0;
+    bool removed = false;
+
+    if (kh->next_expire != 0 && now < kh->next_expire) {
+        return false;
+    }
+
+    for (host = kh->list; host != NULL; host = next) {
+        next = host->next;
+
+        if (host->expire <= now) {
+            talloc_free(host);
+            removed = true;
+            continue;
+        }
+
+        if (next_expire == 0 || host->expire < next_expire) {
+            next_expire = host->expire;
+        }
+    }
+
+    kh->next_expire = next_expire;
+
+    return removed;
+}
+
+static errno_t
+ssh_known_hosts_write(struct ssh_known_hosts *kh)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ssh_known_host *host;
+    char *filename;
+    int fd = -1;
+    ssize_t wret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    filename = talloc_strdup(tmp_ctx, SSS_SSH_KNOWN_HOSTS_TEMP_TMPL);
+    if (!filename) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    fd = sss_unique_file_ex(tmp_ctx, filename, 0133, &ret);
+    if (fd == -1) {
+        goto done;
+    }
+
+    DLIST_FOR_EACH(host, kh->list) {
+        wret = sss_atomic_write_s(fd, host->entstr, strlen(host->entstr));
+        if (wret == -1) {
+            ret = errno;
+            goto done;
+        }
+    }
+
+    ret = fchmod(fd, 0644);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = rename(filename, SSS_SSH_KNOWN_HOSTS_PATH);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    if (fd != -1) {
+        close(fd);
+    }
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
+
+static errno_t
+ssh_known_hosts_append(struct ssh_known_host *host)
+{
+    ssize_t wret;
+    errno_t ret;
+    int fd;
+
+    fd = open(SSS_SSH_KNOWN_HOSTS_PATH, O_WRONLY | O_APPEND);
+    if (fd == -1) {
+        return errno;
+    }
+
+    /* a single write, readers see either the old or the new content */
+    wret = sss_atomic_write_s(fd, host->entstr, strlen(host->entstr));
+    if (wret == -1) {
+        ret = errno;
+    } else {
+        ret = EOK;
+    }
+
+    close(fd);
+    return ret;
+}
+
+errno_t
+ssh_known_hosts_update(struct ssh_ctx *ssh_ctx,
+                       struct sss_domain_info *domain,
+                       const char *name)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ssh_known_host *host = NULL;
+    struct ldb_message *msg;
+    time_t now = time(NULL);
+    bool rewrite = false;
+    bool added = false;
+    char *key;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return ENOMEM;
+    }
+
+    if (domain) {
+        ret = sysdb_update_ssh_known_host_expire(domain, name, now,
+                                                 ssh_ctx->known_hosts_timeout);
+        if (ret != EOK && ret != ENOENT) {
+            goto done;
+        }
+    }
+
+    if (ssh_ctx->known_hosts == NULL) {
+        ret = ssh_known_hosts_load(ssh_ctx, now);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ssh_known_hosts_expire(ssh_ctx->known_hosts, now);
+        ret = ssh_known_hosts_write(ssh_ctx->known_hosts);
+        goto done;
+    }
+
+    if (domain) {
+        ret = sysdb_get_ssh_host(tmp_ctx, domain, name,
+                                 ssh_known_hosts_attrs, &msg);
+        if (ret == EOK) {
+            ret = ssh_known_host_set(ssh_ctx, domain, msg, &host, &added);
+            if (ret == EOK) {
+                /* a new host can be appended, changed keys need
+                 * the old line to go away */
+                rewrite = !added;
+            } else if (ret == EEXIST) {
+                host = NULL;
+            } else {
+                goto done;
+            }
+        } else if (ret == ENOENT) {
+            key = ssh_known_host_key(tmp_ctx, domain, name);
+            if (key == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            host = ssh_known_host_lookup(ssh_ctx->known_hosts, key);
+            if (host != NULL) {
+                talloc_free(host);
+                host = NULL;
+                rewrite = true;
+            }
+        } else {
+            goto done;
+        }
+    }
+
+    if (ssh_known_hosts_expire(ssh_ctx->known_hosts, now)) {
+        rewrite = true;
+    }
+
+    if (rewrite) {
+        ret = ssh_known_hosts_write(ssh_ctx->known_hosts);
+    } else if (host != NULL) {
+        ret = ssh_known_hosts_append(host);
+        if (ret != EOK) {
+            ret = ssh_known_hosts_write(ssh_ctx->known_hosts);
+        }
+    } else {
+        ret = EOK;
+    }
+
+done:
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
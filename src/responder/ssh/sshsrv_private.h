@@ -33,6 +33,15 @@ struct ssh_ctx {
     bool hash_known_hosts;
     int known_hosts_timeout;
     char *ca_db;
+
+    /* formatted known_hosts entries, loaded on first host lookup */
+    struct ssh_known_hosts *known_hosts;
+
+    struct sss_nc_ctx *ncache;
+    int neg_timeout;
+
+    /* replies to user key lookups, reused while the keys do not change */
+    hash_table_t *user_keys;
 };
 
 struct ssh_cmd_ctx {
@@ -50,6 +59,11 @@ struct ssh_cmd_ctx {
 
 struct sss_cmd_table *get_ssh_cmds(void);
 
+errno_t
+ssh_known_hosts_update(struct ssh_ctx *ssh_ctx,
+                       struct sss_domain_info *domain,
+                       const char *name);
+
 struct tevent_req *
 sss_dp_get_ssh_host_send(TALLOC_CTX *mem_ctx,
                          struct resp_ctx *rctx,
@@ -28,6 +28,9 @@
 #include "responder/sudo/sudosrv_private.h"
 #include "providers/data_provider.h"
 #include "responder/common/negcache.h"
+#include "responder/nss/nsssrv_mmap_cache.h"
+
+static int sudo_clear_memcache(struct sbus_request *dbus_req, void *data);
 
 struct mon_cli_iface monitor_sudo_methods = {
     { &mon_cli_iface_meta, 0 },
@@ -37,11 +40,51 @@ struct mon_cli_iface monitor_sudo_methods = {
     .goOffline = NULL,
     .resetOffline = NULL,
     .rotateLogs = responder_logrotate,
-    .clearMemcache = NULL,
+    .clearMemcache = sudo_clear_memcache,
     .clearEnumCache = NULL,
     .sysbusReconnect = NULL,
+    .memReport = monitor_common_mem_report,
+    .startupTimes = monitor_common_startup_times,
 };
 
+static int sudo_clear_memcache(struct sbus_request *dbus_req, void *data)
+{
+    struct resp_ctx *rctx = talloc_get_type(data, struct resp_ctx);
+    struct sudo_ctx *sudo_ctx = talloc_get_type(rctx->pvt_ctx,
+                                                struct sudo_ctx);
+    int memcache_timeout;
+    errno_t ret;
+
+    /* the cache file may have been invalidated by sss_cache, the NSS
+     * responder takes care of the flag file */
+    if (sudo_ctx->mc_ctx == NULL) {
+        goto done;
+    }
+
+    ret = confdb_get_int(rctx->cdb,
+                         CONFDB_NSS_CONF_ENTRY,
+                         CONFDB_MEMCACHE_TIMEOUT,
+                         300, &memcache_timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Unable to get memory cache entry timeout.\n");
+        return ret;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Clearing the sudo memory cache.\n");
+
+    ret = sss_mmap_cache_reinit(sudo_ctx, SSS_MC_SUDO_CACHE_ELEMENTS,
+                                (time_t)memcache_timeout,
+                                &sudo_ctx->mc_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sudo mmap cache invalidation failed\n");
+        return ret;
+    }
+
+done:
+    return sbus_request_return_and_finish(dbus_req, DBUS_TYPE_INVALID);
+}
+
 static struct data_provider_iface sudo_dp_methods = {
     { &data_provider_iface_meta, 0 },
     .RegisterService = NULL,
@@ -90,6 +133,7 @@ int sudo_process_init(TALLOC_CTX *mem_ctx,
     struct be_conn *iter;
     int ret;
     int max_retries;
+    int memcache_timeout;
 
     sudo_cmds = get_sudo_cmds();
     ret = sss_process_init(mem_ctx, ev, cdb,
@@ -121,6 +165,10 @@ int sudo_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    /* not fatal, the cache is then private to this responder */
+    sss_ncache_share(sudo_ctx->ncache, SSS_NCACHE_SHARED_FILE);
+    sss_ncache_set_stats(sudo_ctx->ncache, rctx->cmd_stats);
+
     sudo_ctx->rctx = rctx;
     sudo_ctx->rctx->pvt_ctx = sudo_ctx;
 
@@ -178,6 +226,25 @@ int sudo_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    /* Share the replies with the clients, using the timeout of the other
+     * memory caches */
+    ret = confdb_get_int(sudo_ctx->rctx->cdb,
+                         CONFDB_NSS_CONF_ENTRY,
+                         CONFDB_MEMCACHE_TIMEOUT,
+                         300, &memcache_timeout);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Failed to get 'memcache_timeout' option from confdb.\n");
+        goto fail;
+    }
+
+    ret = sss_mmap_cache_init(sudo_ctx, "sudo", SSS_MC_SUDO,
+                              SSS_MC_SUDO_CACHE_ELEMENTS,
+                              (time_t)memcache_timeout, &sudo_ctx->mc_ctx);
+    if (ret) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sudo mmap cache is DISABLED\n");
+    }
+
     ret = schedule_get_domains_task(rctx, rctx->ev, rctx, NULL);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "schedule_get_domains_tasks failed.\n");
@@ -23,12 +23,15 @@
 #include <talloc.h>
 
 #include "util/util.h"
+#include "util/sss_format.h"
 #include "responder/common/responder.h"
 #include "responder/common/responder_packet.h"
 #include "responder/sudo/sudosrv_private.h"
 #include "db/sysdb_sudo.h"
 #include "sss_client/sss_cli.h"
 #include "responder/common/negcache.h"
+#include "util/mmap_cache.h"
+#include "responder/nss/nsssrv_mmap_cache.h"
 
 static errno_t sudosrv_cmd_send_reply(struct sudo_cmd_ctx *cmd_ctx,
                                       uint8_t *response_body,
@@ -95,6 +98,40 @@ static errno_t sudosrv_cmd_send_error(TALLOC_CTX *mem_ctx,
     return sudosrv_cmd_send_reply(cmd_ctx, response_body, response_len);
 }
 
+static void sudosrv_mc_store(struct sudo_cmd_ctx *cmd_ctx,
+                             uint32_t num_rules,
+                             uint8_t *response_body,
+                             size_t response_len)
+{
+    struct sized_string key;
+    char *keystr;
+    char prefix;
+    errno_t ret;
+
+    if (cmd_ctx->sudo_ctx->mc_ctx == NULL || cmd_ctx->rawname == NULL) {
+        return;
+    }
+
+    prefix = cmd_ctx->type == SSS_SUDO_DEFAULTS ? SSS_MC_SUDO_DEFAULTS_PREFIX
+                                                : SSS_MC_SUDO_RULES_PREFIX;
+    keystr = talloc_asprintf(cmd_ctx, "%c:%"SPRIuid":%s", prefix,
+                             cmd_ctx->uid, cmd_ctx->rawname);
+    if (keystr == NULL) {
+        return;
+    }
+    to_sized_string(&key, keystr);
+
+    ret = sss_mmap_cache_sudo_store(&cmd_ctx->sudo_ctx->mc_ctx, &key,
+                                    num_rules, response_body, response_len);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Failed to store the sudo rules of [%s] in the memory cache "
+              "[%d]: %s\n", cmd_ctx->rawname, ret, sss_strerror(ret));
+    }
+
+    talloc_free(keystr);
+}
+
 errno_t sudosrv_cmd_done(struct sudo_cmd_ctx *cmd_ctx, int ret)
 {
     uint8_t *response_body = NULL;
@@ -132,6 +169,12 @@ errno_t sudosrv_cmd_done(struct sudo_cmd_ctx *cmd_ctx, int ret)
             return EFAULT;
         }
 
+        /* the result of the time filter may change before the record
+         * expires */
+        if (!cmd_ctx->sudo_ctx->timed) {
+            sudosrv_mc_store(cmd_ctx, num_rules, response_body, response_len);
+        }
+
         ret = sudosrv_cmd_send_reply(cmd_ctx, response_body, response_len);
         break;
 
@@ -246,7 +289,8 @@ static void sudosrv_cmd_parse_query_done(struct tevent_req *req)
     cmd_ctx = tevent_req_callback_data(req, struct sudo_cmd_ctx);
 
     ret = sudosrv_parse_query_recv(cmd_ctx, req, &cmd_ctx->uid,
-                                   &cmd_ctx->username, &cmd_ctx->domain);
+                                   &cmd_ctx->rawname, &cmd_ctx->username,
+                                   &cmd_ctx->domain);
     talloc_zfree(req);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Invalid query [%d]: %s\n",
@@ -0,0 +1,543 @@
+/*
+    SSSD
+
+    Sudo responder: in-memory index of the cached sudo rules
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+#include <dhash.h>
+
+#include "util/util.h"
+#include "db/sysdb_sudo.h"
+#include "responder/sudo/sudosrv_private.h"
+#include "responder/nss/nsssrv_mmap_cache.h"
+
+/* All the rules of a domain are read from the cache once, sorted by
+ * sudoOrder and indexed by their sudoUser values. The index is built again
+ * when the generation of the rules changed, that is when rules were stored,
+ * changed or removed since. Writes to users and groups do not affect it,
+ * the groups of a user are read from the cache with each request. */
+
+/* The positions of the rules which match a sudoUser value, ascending */
+struct sudosrv_index_entry {
+    size_t *pos;
+    size_t count;
+};
+
+struct sudosrv_index {
+    struct sudosrv_index *prev, *next;
+    struct sss_domain_info *domain;
+
+    bool valid;
+    uint64_t generation;
+
+    /* everything below is allocated on data */
+    TALLOC_CTX *data;
+    struct sysdb_attrs **rules;
+    const char **names;
+    /* SUDOSRV_INDEX_NO_EXPIRE if the rule has no expiration time */
+    uint64_t *expire;
+    size_t num_rules;
+
+    hash_table_t *by_user;
+    struct sudosrv_index_entry all;
+    struct sudosrv_index_entry netgroups;
+    struct sudosrv_index_entry defaults;
+};
+
+#define SUDOSRV_INDEX_NO_EXPIRE UINT64_MAX
+
+/* The attributes which are sent to the client */
+static const char *sudosrv_rule_attrs[] = { SYSDB_OBJECTCLASS,
+                                            SYSDB_SUDO_CACHE_AT_CN,
+                                            SYSDB_SUDO_CACHE_AT_USER,
+                                            SYSDB_SUDO_CACHE_AT_HOST,
+                                            SYSDB_SUDO_CACHE_AT_COMMAND,
+                                            SYSDB_SUDO_CACHE_AT_OPTION,
+                                            SYSDB_SUDO_CACHE_AT_RUNAS,
+                                            SYSDB_SUDO_CACHE_AT_RUNASUSER,
+                                            SYSDB_SUDO_CACHE_AT_RUNASGROUP,
+                                            SYSDB_SUDO_CACHE_AT_NOTBEFORE,
+                                            SYSDB_SUDO_CACHE_AT_NOTAFTER,
+                                            SYSDB_SUDO_CACHE_AT_ORDER,
+                                            NULL };
+
+static errno_t sudosrv_index_entry_add(TALLOC_CTX *mem_ctx,
+                                       struct sudosrv_index_entry *entry,
+                                       size_t pos)
+{
+    size_t *tmp;
+
+    /* a rule may list the same value twice */
+    if (entry->count > 0 && entry->pos[entry->count - 1] == pos) {
+        return EOK;
+    }
+
+    tmp = talloc_realloc(mem_ctx, entry->pos, size_t, entry->count + 1);
+    if (tmp == NULL) {
+        return ENOMEM;
+    }
+
+    tmp[entry->count] = pos;
+    entry->pos = tmp;
+    entry->count++;
+
+    return EOK;
+}
+
+static errno_t sudosrv_index_add_user(struct sudosrv_index *idx,
+                                      const char *value,
+                                      size_t pos)
+{
+    struct sudosrv_index_entry *entry;
+    hash_key_t key;
+    hash_value_t val;
+    int hret;
+
+    if (strcmp(value, "ALL") == 0) {
+        return sudosrv_index_entry_add(idx->data, &idx->all, pos);
+    } else if (value[0] == '+') {
+        /* netgroups are evaluated by sudo itself */
+        return sudosrv_index_entry_add(idx->data, &idx->netgroups, pos);
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(value);
+
+    hret = hash_lookup(idx->by_user, &key, &val);
+    if (hret == HASH_SUCCESS) {
+        entry = talloc_get_type(val.ptr, struct sudosrv_index_entry);
+        return sudosrv_index_entry_add(idx->data, entry, pos);
+    } else if (hret != HASH_ERROR_KEY_NOT_FOUND) {
+        return EIO;
+    }
+
+    entry = talloc_zero(idx->data, struct sudosrv_index_entry);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    val.type = HASH_VALUE_PTR;
+    val.ptr = entry;
+
+    hret = hash_enter(idx->by_user, &key, &val);
+    if (hret != HASH_SUCCESS) {
+        return EIO;
+    }
+
+    return sudosrv_index_entry_add(idx->data, entry, pos);
+}
+
+static uint32_t sudosrv_msg_order(struct ldb_message *msg)
+{
+    /* man sudoers-ldap: If the sudoOrder attribute is not present,
+     * a value of 0 is assumed */
+    return ldb_msg_find_attr_as_uint(msg, SYSDB_SUDO_CACHE_AT_ORDER, 0);
+}
+
+static int sudo_order_low_cmp_fn(const void *a, const void *b)
+{
+    uint32_t o1 = sudosrv_msg_order(*(struct ldb_message * const *) a);
+    uint32_t o2 = sudosrv_msg_order(*(struct ldb_message * const *) b);
+
+    /* The lowest value takes priority. Original wrong SSSD behaviour. */
+    return o1 < o2 ? -1 : (o1 > o2 ? 1 : 0);
+}
+
+static int sudo_order_high_cmp_fn(const void *a, const void *b)
+{
+    uint32_t o1 = sudosrv_msg_order(*(struct ldb_message * const *) a);
+    uint32_t o2 = sudosrv_msg_order(*(struct ldb_message * const *) b);
+
+    /* The higher value takes priority. Standard LDAP behaviour. */
+    return o1 > o2 ? -1 : (o1 < o2 ? 1 : 0);
+}
+
+static errno_t sudosrv_index_add_rule(struct sudosrv_index *idx,
+                                      struct ldb_message *msg,
+                                      size_t pos)
+{
+    struct ldb_message_element *el;
+    const char *value;
+    unsigned int i;
+    errno_t ret;
+
+    value = ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL);
+    if (value == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "A sudo rule with no name?\n");
+        return EINVAL;
+    }
+
+    idx->names[pos] = talloc_strdup(idx->names, value);
+    if (idx->names[pos] == NULL) {
+        return ENOMEM;
+    }
+
+    if (strcmp(value, "defaults") == 0) {
+        ret = sudosrv_index_entry_add(idx->data, &idx->defaults, pos);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    idx->expire[pos] = ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE,
+                                                   SUDOSRV_INDEX_NO_EXPIRE);
+
+    el = ldb_msg_find_element(msg, SYSDB_SUDO_CACHE_AT_USER);
+    for (i = 0; el != NULL && i < el->num_values; i++) {
+        ret = sudosrv_index_add_user(idx, (const char *) el->values[i].data,
+                                     pos);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    /* the client only gets the attributes it asked for before */
+    ldb_msg_remove_attr(msg, SYSDB_NAME);
+    ldb_msg_remove_attr(msg, SYSDB_CACHE_EXPIRE);
+
+    return EOK;
+}
+
+static errno_t sudosrv_index_build(struct sudosrv_index *idx,
+                                   bool inverse_order,
+                                   uint64_t generation)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message **msgs = NULL;
+    const char **attrs;
+    const char *filter;
+    size_t count = 0;
+    size_t num;
+    size_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    talloc_zfree(idx->data);
+    idx->valid = false;
+    idx->rules = NULL;
+    idx->num_rules = 0;
+    memset(&idx->all, 0, sizeof(idx->all));
+    memset(&idx->netgroups, 0, sizeof(idx->netgroups));
+    memset(&idx->defaults, 0, sizeof(idx->defaults));
+
+    num = sizeof(sudosrv_rule_attrs) / sizeof(sudosrv_rule_attrs[0]);
+    attrs = talloc_array(tmp_ctx, const char *, num + 2);
+    if (attrs == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    memcpy(attrs, sudosrv_rule_attrs, sizeof(sudosrv_rule_attrs));
+    attrs[num - 1] = SYSDB_NAME;
+    attrs[num] = SYSDB_CACHE_EXPIRE;
+    attrs[num + 1] = NULL;
+
+    filter = talloc_asprintf(tmp_ctx, "(%s=%s)", SYSDB_OBJECTCLASS,
+                             SYSDB_SUDO_CACHE_OC);
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_search_custom(tmp_ctx, idx->domain, filter, SUDORULE_SUBDIR,
+                              attrs, &count, &msgs);
+    if (ret == ENOENT) {
+        count = 0;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Error looking up SUDO rules\n");
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Indexing %zu sudo rules of [%s]\n",
+          count, idx->domain->name);
+
+    if (inverse_order) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Sorting rules with lower-wins logic\n");
+        qsort(msgs, count, sizeof(struct ldb_message *),
+              sudo_order_low_cmp_fn);
+    } else {
+        DEBUG(SSSDBG_TRACE_FUNC, "Sorting rules with higher-wins logic\n");
+        qsort(msgs, count, sizeof(struct ldb_message *),
+              sudo_order_high_cmp_fn);
+    }
+
+    idx->data = talloc_new(idx);
+    if (idx->data == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    idx->names = talloc_zero_array(idx->data, const char *, count + 1);
+    idx->expire = talloc_zero_array(idx->data, uint64_t, count + 1);
+    if (idx->names == NULL || idx->expire == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_hash_create(idx->data, count, &idx->by_user);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = sudosrv_index_add_rule(idx, msgs[i], i);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = sysdb_msg2attrs(idx->data, count, msgs, &idx->rules);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    idx->num_rules = count;
+    idx->generation = generation;
+    idx->valid = true;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot index the sudo rules [%d]: %s\n",
+              ret, sss_strerror(ret));
+        talloc_zfree(idx->data);
+        idx->rules = NULL;
+        idx->num_rules = 0;
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t sudosrv_index_get(struct sudo_ctx *sudo_ctx,
+                                 struct sss_domain_info *domain,
+                                 struct sudosrv_index **_idx)
+{
+    struct sudosrv_index *idx;
+    uint64_t generation;
+    errno_t ret;
+
+    if (IS_SUBDOMAIN(domain)) {
+        /* rules are stored inside parent domain tree */
+        domain = domain->parent;
+    }
+
+    DLIST_FOR_EACH(idx, sudo_ctx->indexes) {
+        if (idx->domain == domain) {
+            break;
+        }
+    }
+
+    if (idx == NULL) {
+        idx = talloc_zero(sudo_ctx, struct sudosrv_index);
+        if (idx == NULL) {
+            return ENOMEM;
+        }
+        idx->domain = domain;
+        DLIST_ADD(sudo_ctx->indexes, idx);
+    }
+
+    ret = sysdb_sudo_get_generation(domain, &generation);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot read the generation of the sudo "
+              "rules [%d]: %s\n", ret, sss_strerror(ret));
+        return ret;
+    }
+
+    *_idx = idx;
+    if (idx->valid && idx->generation == generation) {
+        return EOK;
+    }
+
+    if (idx->valid) {
+        /* the replies in the memory cache were built from the old rules */
+        DEBUG(SSSDBG_TRACE_FUNC, "Sudo rules of [%s] changed, resetting the "
+              "sudo memory cache\n", domain->name);
+        sss_mmap_cache_reset(sudo_ctx->mc_ctx);
+    }
+
+    return sudosrv_index_build(idx, sudo_ctx->inverse_order, generation);
+}
+
+static void sudosrv_index_mark(bool *match,
+                               struct sudosrv_index_entry *entry)
+{
+    size_t i;
+
+    for (i = 0; i < entry->count; i++) {
+        match[entry->pos[i]] = true;
+    }
+}
+
+static void sudosrv_index_mark_user(struct sudosrv_index *idx,
+                                    bool *match,
+                                    const char *value)
+{
+    hash_key_t key;
+    hash_value_t val;
+    int hret;
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(value);
+
+    hret = hash_lookup(idx->by_user, &key, &val);
+    if (hret == HASH_SUCCESS) {
+        sudosrv_index_mark(match,
+                           talloc_get_type(val.ptr,
+                                           struct sudosrv_index_entry));
+    }
+}
+
+errno_t sudosrv_index_get_rules(TALLOC_CTX *mem_ctx,
+                                struct sudo_ctx *sudo_ctx,
+                                struct sss_domain_info *domain,
+                                unsigned int flags,
+                                const char *username,
+                                uid_t uid,
+                                char **groupnames,
+                                struct sysdb_attrs ***_rules,
+                                uint32_t *_count)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sudosrv_index *idx;
+    struct sysdb_attrs **rules;
+    char *value;
+    bool *match;
+    bool filtered = false;
+    uint64_t now;
+    size_t count = 0;
+    size_t i;
+    errno_t ret;
+
+    ret = sudosrv_index_get(sudo_ctx, domain, &idx);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    match = talloc_zero_array(tmp_ctx, bool, idx->num_rules + 1);
+    if (match == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* the same rules the filter of sysdb_get_sudo_filter() matches */
+    if (flags & SYSDB_SUDO_FILTER_INCLUDE_ALL) {
+        sudosrv_index_mark(match, &idx->all);
+        filtered = true;
+    }
+
+    if (flags & SYSDB_SUDO_FILTER_INCLUDE_DFL) {
+        sudosrv_index_mark(match, &idx->defaults);
+        filtered = true;
+    }
+
+    if ((flags & SYSDB_SUDO_FILTER_USERNAME) && username != NULL) {
+        sudosrv_index_mark_user(idx, match, username);
+        filtered = true;
+    }
+
+    if ((flags & SYSDB_SUDO_FILTER_UID) && uid != 0) {
+        filtered = true;
+        value = talloc_asprintf(tmp_ctx, "#%llu", (unsigned long long) uid);
+        if (value == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        sudosrv_index_mark_user(idx, match, value);
+    }
+
+    if ((flags & SYSDB_SUDO_FILTER_GROUPS) && groupnames != NULL) {
+        for (i = 0; groupnames[i] != NULL; i++) {
+            filtered = true;
+            value = talloc_asprintf(tmp_ctx, "%%%s", groupnames[i]);
+            if (value == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            sudosrv_index_mark_user(idx, match, value);
+        }
+    }
+
+    if (flags & SYSDB_SUDO_FILTER_NGRS) {
+        sudosrv_index_mark(match, &idx->netgroups);
+        filtered = true;
+    }
+
+    if (!filtered) {
+        /* like the filter, which has no alternatives then */
+        for (i = 0; i < idx->num_rules; i++) {
+            match[i] = true;
+        }
+    }
+
+    rules = talloc_array(tmp_ctx, struct sysdb_attrs *, idx->num_rules + 1);
+    if (rules == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    now = time(NULL);
+    for (i = 0; i < idx->num_rules; i++) {
+        if (!match[i]) {
+            continue;
+        }
+
+        if (!(flags & SYSDB_SUDO_FILTER_ONLY_EXPIRED)) {
+            /* the rules stay owned by the index */
+            rules[count++] = idx->rules[i];
+            continue;
+        }
+
+        if (idx->expire[i] > now) {
+            continue;
+        }
+
+        /* the data provider only needs the names of the expired rules */
+        rules[count] = sysdb_new_attrs(rules);
+        if (rules[count] == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sysdb_attrs_add_string(rules[count], SYSDB_NAME, idx->names[i]);
+        if (ret != EOK) {
+            goto done;
+        }
+        count++;
+    }
+    rules[count] = NULL;
+
+    *_rules = talloc_steal(mem_ctx, rules);
+    *_count = count;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
@@ -51,6 +51,12 @@ struct sudo_ctx {
      */
     bool timed;
     bool inverse_order;
+
+    /* sorted sudo rules of each domain, see sudosrv_index.c */
+    struct sudosrv_index *indexes;
+
+    /* replies shared with the clients, NULL if disabled */
+    struct sss_mc_ctx *mc_ctx;
 };
 
 struct sudo_cmd_ctx {
@@ -60,6 +66,7 @@ struct sudo_cmd_ctx {
 
     /* input data */
     uid_t uid;
+    char *rawname;
     char *username;
     const char *orig_username;
     const char *cased_username;
@@ -92,6 +99,19 @@ errno_t sudosrv_get_sudorules(struct sudo_dom_ctx *dctx);
 
 errno_t sudosrv_get_rules(struct sudo_cmd_ctx *cmd_ctx);
 
+/* Returns the cached rules of the domain which match the filter flags of
+ * sysdb_get_sudo_filter(), already sorted by sudoOrder. The rules are owned
+ * by the index and stay valid until the next lookup. */
+errno_t sudosrv_index_get_rules(TALLOC_CTX *mem_ctx,
+                                struct sudo_ctx *sudo_ctx,
+                                struct sss_domain_info *domain,
+                                unsigned int flags,
+                                const char *username,
+                                uid_t uid,
+                                char **groupnames,
+                                struct sysdb_attrs ***_rules,
+                                uint32_t *_count);
+
 struct tevent_req *sudosrv_parse_query_send(TALLOC_CTX *mem_ctx,
                                             struct resp_ctx *rctx,
                                             uint8_t *query_body,
@@ -100,6 +120,7 @@ struct tevent_req *sudosrv_parse_query_send(TALLOC_CTX *mem_ctx,
 errno_t sudosrv_parse_query_recv(TALLOC_CTX *mem_ctx,
                                  struct tevent_req *req,
                                  uid_t *_uid,
+                                 char **_rawname,
                                  char **_username,
                                  struct sss_domain_info **_domain);
 
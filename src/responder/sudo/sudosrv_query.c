@@ -373,6 +373,7 @@ static void sudosrv_parse_query_done(struct tevent_req *subreq)
 errno_t sudosrv_parse_query_recv(TALLOC_CTX *mem_ctx,
                                  struct tevent_req *req,
                                  uid_t *_uid,
+                                 char **_rawname,
                                  char **_username,
                                  struct sss_domain_info **_domain)
 {
@@ -421,6 +422,14 @@ errno_t sudosrv_parse_query_recv(TALLOC_CTX *mem_ctx,
         }
     }
 
+    if (_rawname != NULL) {
+        /* the query lives in the client packet */
+        *_rawname = talloc_strdup(mem_ctx, state->rawname);
+        if (*_rawname == NULL) {
+            return ENOMEM;
+        }
+    }
+
     *_uid = state->uid;
     *_username = talloc_steal(mem_ctx, username);
     *_domain = domain; /* do not steal on mem_ctx */
@@ -31,7 +31,7 @@
 #define MAX_AUTOMNTKEYNAME_LEN  PATH_MAX
 
 /* How many entries shall _sss_getautomntent_r retreive at once */
-#define GETAUTOMNTENT_MAX_ENTRIES   512
+#define GETAUTOMNTENT_MAX_ENTRIES   4096
 
 struct automtent {
     char *mapname;
@@ -86,6 +86,14 @@ _sss_setautomntent(const char *mapname, void **context)
     }
     strncpy(name, mapname, name_len + 1);
 
+    /* The map was shared in the memory cache, no need to ask the responder.
+     * getautomntent and getautomntbyname will look the map up themselves
+     * should the responder not know it anymore. */
+    ret = sss_autofs_mc_has_map(name);
+    if (ret == 0) {
+        goto done;
+    }
+
     rd.data = name;
     rd.len = name_len + 1;
 
@@ -109,6 +117,7 @@ _sss_setautomntent(const char *mapname, void **context)
     }
     free(repbuf);
 
+done:
     ctx = malloc(sizeof(struct automtent));
     if (!ctx) {
         free(name);
@@ -381,6 +390,11 @@ _sss_getautomntbyname_r(const char *key, char **value, void *context)
         goto out;
     }
 
+    ret = sss_autofs_mc_get_entry(ctx->mapname, key, value);
+    if (ret == 0) {
+        goto out;
+    }
+    /* Any error means the entry is not shared, ask the responder */
 
     data_len = sizeof(uint32_t) +            /* mapname len */
                name_len + 1 +                /* mapname\0   */
@@ -0,0 +1,243 @@
+/*
+    SSSD
+
+    Autofs client library: lookups in the autofs memory cache
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "sss_client/nss_mc.h"
+#include "sss_client/sss_cli.h"
+#include "sss_client/autofs/sss_autofs_private.h"
+
+struct sss_cli_mc_ctx autofs_mc_ctx = { UNINITIALIZED, -1, 0, 0, NULL, 0,
+                                        NULL, 0, NULL, 0, 0 };
+
+static errno_t sss_autofs_mc_parse_result(struct sss_mc_rec *rec,
+                                          uint32_t barrier,
+                                          const size_t key_len,
+                                          char **_value)
+{
+    struct sss_mc_autofs_data *data;
+    time_t expire;
+    uint32_t value_len;
+    uint32_t strs_len;
+    char *value = NULL;
+    int ret;
+
+    data = (struct sss_mc_autofs_data *)rec->data;
+
+    /* the record is read in place, take a snapshot of what we need and
+     * validate it only after checking the record was not modified */
+    expire = rec->expire;
+    value_len = data->value_len;
+    strs_len = data->strs_len;
+
+    if (strs_len < key_len + 1
+            || value_len == 0
+            || value_len != strs_len - (key_len + 1)
+            || !sss_nss_mc_within_data_table(&autofs_mc_ctx,
+                                             data->strs, strs_len)) {
+        ret = EINVAL;
+    } else {
+        /* the value follows the key */
+        value = malloc(value_len);
+        if (value == NULL) {
+            ret = ENOMEM;
+        } else {
+            memcpy(value, data->strs + key_len + 1, value_len);
+            value[value_len - 1] = '\0';
+            ret = 0;
+        }
+    }
+
+    if (sss_nss_mc_record_changed(rec, barrier)) {
+        ret = EAGAIN;
+        goto done;
+    }
+    if (ret) {
+        goto done;
+    }
+
+    if (expire < time(NULL)) {
+        /* entry is now invalid */
+        ret = EINVAL;
+        goto done;
+    }
+
+    *_value = value;
+    ret = 0;
+
+done:
+    if (ret) {
+        free(value);
+    }
+    return ret;
+}
+
+static int sss_autofs_mc_get(const char *key, char **_value)
+{
+    struct sss_mc_rec *rec = NULL;
+    struct sss_mc_autofs_data *data;
+    char *rec_key;
+    uint32_t barrier;
+    uint32_t hash;
+    uint32_t slot;
+    uint32_t key_ptr;
+    uint32_t strs_len;
+    uint32_t rec_len;
+    size_t key_len;
+    int retries = SSS_NSS_MC_READ_RETRIES;
+    int ret;
+    const size_t strs_offset = offsetof(struct sss_mc_autofs_data, strs);
+    size_t data_size;
+
+    key_len = strlen(key);
+
+    ret = sss_nss_mc_get_ctx("autofs", &autofs_mc_ctx);
+    if (ret) {
+        return ret;
+    }
+
+    /* Get max size of data table. */
+    data_size = autofs_mc_ctx.dt_size;
+
+    /* hashes are calculated including the NULL terminator */
+    hash = sss_nss_mc_hash(&autofs_mc_ctx, key, key_len + 1);
+
+again:
+    slot = autofs_mc_ctx.hash_table[hash];
+
+    /* If slot is not within the bounds of mmaped region and
+     * it's value is not MC_INVALID_VAL, then the cache is
+     * probbably corrupted. */
+    while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = sss_nss_mc_get_record(&autofs_mc_ctx, slot, &rec, &barrier);
+        if (ret) {
+            goto done;
+        }
+
+        /* check record matches what we are searching for */
+        if (hash != rec->hash1) {
+            /* if key hash does not match we can skip this immediately */
+            slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            continue;
+        }
+
+        data = (struct sss_mc_autofs_data *)rec->data;
+        key_ptr = data->key;
+        strs_len = data->strs_len;
+        rec_len = rec->len;
+        /* Integrity check
+         * - key_len cannot be longer than all strings
+         * - data->key cannot point outside strings
+         * - all strings must be within the record
+         * - size of record must be lower that data table size */
+        if (key_len > strs_len
+            || (key_ptr + key_len) > (strs_offset + strs_len)
+            || strs_len > rec_len
+            || rec_len > data_size
+            || !sss_nss_mc_within_data_table(&autofs_mc_ctx,
+                                             (char *)data + key_ptr,
+                                             key_len + 1)) {
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            ret = ENOENT;
+            goto done;
+        }
+
+        rec_key = (char *)data + key_ptr;
+        if (strncmp(key, rec_key, key_len + 1) == 0) {
+            break;
+        }
+
+        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
+    }
+
+    if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    ret = sss_autofs_mc_parse_result(rec, barrier, key_len, _value);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
+
+done:
+    __sync_sub_and_fetch(&autofs_mc_ctx.active_threads, 1);
+    return ret;
+
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
+}
+
+int sss_autofs_mc_has_map(const char *mapname)
+{
+    char *key = NULL;
+    char *value = NULL;
+    int ret;
+
+    /* same key as built by the responder */
+    ret = asprintf(&key, "%c:%s", SSS_MC_AUTOFS_MAP_PREFIX, mapname);
+    if (ret < 0) {
+        return ENOMEM;
+    }
+
+    ret = sss_autofs_mc_get(key, &value);
+    free(key);
+    free(value);
+    return ret;
+}
+
+int sss_autofs_mc_get_entry(const char *mapname,
+                            const char *entry_key,
+                            char **_value)
+{
+    char *key = NULL;
+    int ret;
+
+    /* same key as built by the responder */
+    ret = asprintf(&key, "%c:%zu:%s:%s", SSS_MC_AUTOFS_ENTRY_PREFIX,
+                   strlen(mapname), mapname, entry_key);
+    if (ret < 0) {
+        return ENOMEM;
+    }
+
+    ret = sss_autofs_mc_get(key, _value);
+    free(key);
+    return ret;
+}
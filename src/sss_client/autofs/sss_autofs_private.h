@@ -43,3 +43,12 @@ _sss_getautomntbyname_r(const char *key, char **value, void *context);
  */
 errno_t _sss_endautomntent(void **context);
 
+/* Returns 0 if the responder shared the map in the memory cache */
+int sss_autofs_mc_has_map(const char *mapname);
+
+/* Returns a malloc'ed copy of the value of the map entry the responder
+ * stored in the memory cache, ENOENT if there is none */
+int sss_autofs_mc_get_entry(const char *mapname,
+                            const char *entry_key,
+                            char **_value);
+
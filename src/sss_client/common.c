@@ -63,18 +63,38 @@
 
 /* common functions */
 
-int sss_cli_sd = -1; /* the sss client socket descriptor */
-struct stat sss_cli_sb; /* the sss client stat buffer */
+/* A connection to one of the responder sockets. The process-wide
+ * connection is shared by all threads and serialized by the callers'
+ * locks; with per-thread sockets enabled each thread owns one NSS
+ * connection of its own (see sss_cli_thread_conn()). */
+struct sss_cli_conn {
+    int sd;             /* the sss client socket descriptor */
+    struct stat sb;     /* the sss client stat buffer */
+    pid_t pid;          /* the process the descriptor was opened in */
+
+    /* only used by per-thread connections */
+    bool in_use;
+    time_t last_used;
+    struct sss_cli_conn *prev;
+    struct sss_cli_conn *next;
+};
+
+static struct sss_cli_conn sss_cli_global_conn = { .sd = -1 };
+
+static void sss_cli_conn_close(struct sss_cli_conn *conn)
+{
+    if (conn->sd != -1) {
+        close(conn->sd);
+        conn->sd = -1;
+    }
+}
 
 #if HAVE_FUNCTION_ATTRIBUTE_DESTRUCTOR
 __attribute__((destructor))
 #endif
 static void sss_cli_close_socket(void)
 {
-    if (sss_cli_sd != -1) {
-        close(sss_cli_sd);
-        sss_cli_sd = -1;
-    }
+    sss_cli_conn_close(&sss_cli_global_conn);
 }
 
 /* Requests:
@@ -85,7 +105,8 @@ static void sss_cli_close_socket(void)
  * byte 12-15: 32bit unsigned (reserved)
  * byte 16-X: (optional) request structure associated to the command code used
  */
-static enum sss_status sss_cli_send_req(enum sss_cli_command cmd,
+static enum sss_status sss_cli_send_req(struct sss_cli_conn *conn,
+                                        enum sss_cli_command cmd,
                                         struct sss_cli_req_data *rd,
                                         int *errnop)
 {
@@ -105,7 +126,7 @@ static enum sss_status sss_cli_send_req(enum sss_cli_command cmd,
         int res, error;
 
         *errnop = 0;
-        pfd.fd = sss_cli_sd;
+        pfd.fd = conn->sd;
         pfd.events = POLLOUT;
 
         do {
@@ -139,19 +160,19 @@ static enum sss_status sss_cli_send_req(enum sss_cli_command cmd,
             break;
         }
         if (*errnop) {
-            sss_cli_close_socket();
+            sss_cli_conn_close(conn);
             return SSS_STATUS_UNAVAIL;
         }
 
         errno = 0;
         if (datasent < SSS_NSS_HEADER_SIZE) {
-            res = send(sss_cli_sd,
+            res = send(conn->sd,
                        (char *)header + datasent,
                        SSS_NSS_HEADER_SIZE - datasent,
                        SSS_DEFAULT_WRITE_FLAGS);
         } else {
             rdsent = datasent - SSS_NSS_HEADER_SIZE;
-            res = send(sss_cli_sd,
+            res = send(conn->sd,
                        (const char *)rd->data + rdsent,
                        rd->len - rdsent,
                        SSS_DEFAULT_WRITE_FLAGS);
@@ -167,7 +188,7 @@ static enum sss_status sss_cli_send_req(enum sss_cli_command cmd,
             }
 
             /* Write failed */
-            sss_cli_close_socket();
+            sss_cli_conn_close(conn);
             *errnop = error;
             return SSS_STATUS_UNAVAIL;
         }
@@ -187,7 +208,8 @@ static enum sss_status sss_cli_send_req(enum sss_cli_command cmd,
  * byte 16-X: (optional) reply structure associated to the command code used
  */
 
-static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
+static enum sss_status sss_cli_recv_rep(struct sss_cli_conn *conn,
+                                        enum sss_cli_command cmd,
                                         uint8_t **_buf, int *_len,
                                         int *errnop)
 {
@@ -213,7 +235,7 @@ static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
         int bufrecv;
         int res, error;
 
-        pfd.fd = sss_cli_sd;
+        pfd.fd = conn->sd;
         pfd.events = POLLIN;
 
         do {
@@ -250,19 +272,19 @@ static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
             break;
         }
         if (*errnop) {
-            sss_cli_close_socket();
+            sss_cli_conn_close(conn);
             ret = SSS_STATUS_UNAVAIL;
             goto failed;
         }
 
         errno = 0;
         if (datarecv < SSS_NSS_HEADER_SIZE) {
-            res = read(sss_cli_sd,
+            res = read(conn->sd,
                        (char *)header + datarecv,
                        SSS_NSS_HEADER_SIZE - datarecv);
         } else {
             bufrecv = datarecv - SSS_NSS_HEADER_SIZE;
-            res = read(sss_cli_sd,
+            res = read(conn->sd,
                        (char *) buf + bufrecv,
                        header[0] - datarecv);
         }
@@ -281,7 +303,7 @@ static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
              * since the transaction has failed half way
              * through. */
 
-            sss_cli_close_socket();
+            sss_cli_conn_close(conn);
             *errnop = error;
             ret = SSS_STATUS_UNAVAIL;
             goto failed;
@@ -295,7 +317,7 @@ static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
              * been read, do checks and proceed */
             if (header[2] != 0) {
                 /* server side error */
-                sss_cli_close_socket();
+                sss_cli_conn_close(conn);
                 *errnop = header[2];
                 if (*errnop == EAGAIN) {
                     ret = SSS_STATUS_TRYAGAIN;
@@ -307,7 +329,7 @@ static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
             }
             if (header[1] != cmd) {
                 /* wrong command id */
-                sss_cli_close_socket();
+                sss_cli_conn_close(conn);
                 *errnop = EBADMSG;
                 ret = SSS_STATUS_UNAVAIL;
                 goto failed;
@@ -316,7 +338,7 @@ static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
                 len = header[0] - SSS_NSS_HEADER_SIZE;
                 buf = malloc(len);
                 if (!buf) {
-                    sss_cli_close_socket();
+                    sss_cli_conn_close(conn);
                     *errnop = ENOMEM;
                     ret = SSS_STATUS_UNAVAIL;
                     goto failed;
@@ -326,7 +348,7 @@ static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
     }
 
     if (pollhup) {
-        sss_cli_close_socket();
+        sss_cli_conn_close(conn);
     }
 
     *_len = len;
@@ -342,6 +364,7 @@ failed:
 /* this function will check command codes match and returned length is ok */
 /* repbuf and replen report only the data section not the header */
 static enum sss_status sss_cli_make_request_nochecks(
+                                       struct sss_cli_conn *conn,
                                        enum sss_cli_command cmd,
                                        struct sss_cli_req_data *rd,
                                        uint8_t **repbuf, size_t *replen,
@@ -352,13 +375,13 @@ static enum sss_status sss_cli_make_request_nochecks(
     int len = 0;
 
     /* send data */
-    ret = sss_cli_send_req(cmd, rd, errnop);
+    ret = sss_cli_send_req(conn, cmd, rd, errnop);
     if (ret != SSS_STATUS_SUCCESS) {
         return ret;
     }
 
     /* data sent, now get reply */
-    ret = sss_cli_recv_rep(cmd, &buf, &len, errnop);
+    ret = sss_cli_recv_rep(conn, cmd, &buf, &len, errnop);
     if (ret != SSS_STATUS_SUCCESS) {
         return ret;
     }
@@ -384,7 +407,8 @@ static enum sss_status sss_cli_make_request_nochecks(
  * 0-3: 32bit unsigned version number
  */
 
-static bool sss_cli_check_version(const char *socket_name)
+static bool sss_cli_check_version(struct sss_cli_conn *conn,
+                                  const char *socket_name)
 {
     uint8_t *repbuf = NULL;
     size_t replen;
@@ -414,7 +438,7 @@ static bool sss_cli_check_version(const char *socket_name)
     req.len = sizeof(expected_version);
     req.data = &expected_version;
 
-    nret = sss_cli_make_request_nochecks(SSS_GET_VERSION, &req,
+    nret = sss_cli_make_request_nochecks(conn, SSS_GET_VERSION, &req,
                                          &repbuf, &replen, &errnop);
     if (nret != SSS_STATUS_SUCCESS) {
         return false;
@@ -524,7 +548,8 @@ static int make_safe_fd(int fd)
     return new_fd;
 }
 
-static int sss_cli_open_socket(int *errnop, const char *socket_name)
+static int sss_cli_open_socket(int *errnop, const char *socket_name,
+                               struct stat *sb)
 {
     struct sockaddr_un nssaddr;
     bool inprogress = true;
@@ -615,7 +640,7 @@ static int sss_cli_open_socket(int *errnop, const char *socket_name)
         return -1;
     }
 
-    ret = fstat(sd, &sss_cli_sb);
+    ret = fstat(sd, sb);
     if (ret != 0) {
         close(sd);
         return -1;
@@ -624,33 +649,43 @@ static int sss_cli_open_socket(int *errnop, const char *socket_name)
     return sd;
 }
 
-static enum sss_status sss_cli_check_socket(int *errnop, const char *socket_name)
+/* After a fork() the child must not share the parent's connection:
+ * close our copy of the descriptor if it still refers to the socket we
+ * opened and forget about it. */
+static void sss_cli_conn_check_fork(struct sss_cli_conn *conn)
 {
-    static pid_t mypid;
     struct stat mysb;
-    int mysd;
     int ret;
 
-    if (getpid() != mypid) {
-        ret = fstat(sss_cli_sd, &mysb);
+    if (getpid() != conn->pid) {
+        ret = fstat(conn->sd, &mysb);
         if (ret == 0) {
             if (S_ISSOCK(mysb.st_mode) &&
-                mysb.st_dev == sss_cli_sb.st_dev &&
-                mysb.st_ino == sss_cli_sb.st_ino) {
-                sss_cli_close_socket();
+                mysb.st_dev == conn->sb.st_dev &&
+                mysb.st_ino == conn->sb.st_ino) {
+                sss_cli_conn_close(conn);
             }
         }
-        sss_cli_sd = -1;
-        mypid = getpid();
+        conn->sd = -1;
+        conn->pid = getpid();
     }
+}
+
+static enum sss_status sss_cli_conn_check_socket(struct sss_cli_conn *conn,
+                                                 int *errnop,
+                                                 const char *socket_name)
+{
+    int mysd;
+
+    sss_cli_conn_check_fork(conn);
 
     /* check if the socket has been closed on the other side */
-    if (sss_cli_sd != -1) {
+    if (conn->sd != -1) {
         struct pollfd pfd;
         int res, error;
 
         *errnop = 0;
-        pfd.fd = sss_cli_sd;
+        pfd.fd = conn->sd;
         pfd.events = POLLIN | POLLOUT;
 
         do {
@@ -687,42 +722,274 @@ static enum sss_status sss_cli_check_socket(int *errnop, const char *socket_name
             return SSS_STATUS_SUCCESS;
         }
 
-        sss_cli_close_socket();
+        sss_cli_conn_close(conn);
     }
 
-    mysd = sss_cli_open_socket(errnop, socket_name);
+    mysd = sss_cli_open_socket(errnop, socket_name, &conn->sb);
     if (mysd == -1) {
         return SSS_STATUS_UNAVAIL;
     }
 
-    sss_cli_sd = mysd;
+    conn->sd = mysd;
 
-    if (sss_cli_check_version(socket_name)) {
+    if (sss_cli_check_version(conn, socket_name)) {
         return SSS_STATUS_SUCCESS;
     }
 
-    sss_cli_close_socket();
+    sss_cli_conn_close(conn);
     *errnop = EFAULT;
     return SSS_STATUS_UNAVAIL;
 }
 
-/* this function will check command codes match and returned length is ok */
-/* repbuf and replen report only the data section not the header */
-enum nss_status sss_nss_make_request(enum sss_cli_command cmd,
-                      struct sss_cli_req_data *rd,
-                      uint8_t **repbuf, size_t *replen,
-                      int *errnop)
+static enum sss_status sss_cli_check_socket(int *errnop,
+                                            const char *socket_name)
+{
+    return sss_cli_conn_check_socket(&sss_cli_global_conn,
+                                     errnop, socket_name);
+}
+
+#if HAVE_PTHREAD
+/* Per-thread NSS connections
+ *
+ * When SSS_NSS_PER_THREAD_SOCKET=YES is set in the environment every
+ * thread talks to the NSS responder over a connection of its own, so
+ * lookups issued by different threads are no longer serialized on the
+ * process-wide socket. All per-thread connections are linked in a list;
+ * whenever a thread picks up its connection it also closes the ones that
+ * were left unused for more than SSS_CLI_THREAD_CONN_IDLE seconds, which
+ * keeps the number of open descriptors bounded in processes with many
+ * mostly idle threads. A reaped connection is simply reopened by its
+ * owner on the next lookup, the same way a connection closed by the
+ * responder is. */
+
+#define SSS_CLI_THREAD_CONN_IDLE 60
+
+static pthread_once_t sss_cli_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t sss_cli_thread_key;
+static pthread_mutex_t sss_cli_thread_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct sss_cli_conn *sss_cli_thread_conns;
+static time_t sss_cli_thread_last_reap;
+static bool sss_cli_thread_enabled;
+
+/* must be called with sss_cli_thread_mtx held */
+static void sss_cli_thread_conn_unlink(struct sss_cli_conn *conn)
+{
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else if (sss_cli_thread_conns == conn) {
+        sss_cli_thread_conns = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    conn->prev = NULL;
+    conn->next = NULL;
+}
+
+/* thread-specific data destructor, runs when the owning thread exits */
+static void sss_cli_thread_conn_free(void *ptr)
+{
+    struct sss_cli_conn *conn = (struct sss_cli_conn *) ptr;
+
+    pthread_mutex_lock(&sss_cli_thread_mtx);
+    sss_cli_thread_conn_unlink(conn);
+    pthread_mutex_unlock(&sss_cli_thread_mtx);
+
+    sss_cli_conn_check_fork(conn);
+    sss_cli_conn_close(conn);
+    free(conn);
+}
+
+static void sss_cli_thread_atfork_prepare(void)
+{
+    pthread_mutex_lock(&sss_cli_thread_mtx);
+}
+
+static void sss_cli_thread_atfork_parent(void)
+{
+    pthread_mutex_unlock(&sss_cli_thread_mtx);
+}
+
+/* Only the forking thread exists in the child. The connections of all the
+ * other threads are inherited copies nobody will ever use again, so drop
+ * them. The connection of the forking thread is handled by the usual
+ * fork check on its next use. */
+static void sss_cli_thread_atfork_child(void)
+{
+    struct sss_cli_conn *self;
+    struct sss_cli_conn *conn;
+    struct sss_cli_conn *next;
+
+    self = (struct sss_cli_conn *) pthread_getspecific(sss_cli_thread_key);
+
+    for (conn = sss_cli_thread_conns; conn != NULL; conn = next) {
+        next = conn->next;
+        if (conn == self) {
+            continue;
+        }
+
+        sss_cli_thread_conn_unlink(conn);
+        sss_cli_conn_close(conn);
+        free(conn);
+    }
+
+    pthread_mutex_unlock(&sss_cli_thread_mtx);
+}
+
+static void sss_cli_thread_init(void)
 {
-    enum sss_status ret;
     char *envval;
 
-    /* avoid looping in the nss daemon */
-    envval = getenv("_SSS_LOOPS");
-    if (envval && strcmp(envval, "NO") == 0) {
-        return NSS_STATUS_NOTFOUND;
+    envval = getenv("SSS_NSS_PER_THREAD_SOCKET");
+    if (envval == NULL || strcmp(envval, "YES") != 0) {
+        return;
+    }
+
+    if (pthread_key_create(&sss_cli_thread_key,
+                           sss_cli_thread_conn_free) != 0) {
+        return;
+    }
+
+    if (pthread_atfork(sss_cli_thread_atfork_prepare,
+                       sss_cli_thread_atfork_parent,
+                       sss_cli_thread_atfork_child) != 0) {
+        pthread_key_delete(sss_cli_thread_key);
+        return;
+    }
+
+    sss_cli_thread_enabled = true;
+}
+
+static bool sss_cli_thread_sockets_enabled(void)
+{
+    pthread_once(&sss_cli_thread_once, sss_cli_thread_init);
+    return sss_cli_thread_enabled;
+}
+
+/* must be called with sss_cli_thread_mtx held */
+static void sss_cli_thread_reap_idle(time_t now)
+{
+    struct sss_cli_conn *conn;
+
+    if (now - sss_cli_thread_last_reap < SSS_CLI_THREAD_CONN_IDLE) {
+        return;
+    }
+    sss_cli_thread_last_reap = now;
+
+    for (conn = sss_cli_thread_conns; conn != NULL; conn = conn->next) {
+        if (!conn->in_use && conn->sd != -1
+                && now - conn->last_used >= SSS_CLI_THREAD_CONN_IDLE) {
+            sss_cli_conn_close(conn);
+        }
+    }
+}
+
+/* Returns the connection of the calling thread marked as in use, so that
+ * it cannot be reaped while a request is in flight, or NULL on memory
+ * allocation failure. */
+static struct sss_cli_conn *sss_cli_thread_conn_get(void)
+{
+    struct sss_cli_conn *conn;
+
+    conn = (struct sss_cli_conn *) pthread_getspecific(sss_cli_thread_key);
+    if (conn == NULL) {
+        conn = (struct sss_cli_conn *) calloc(1, sizeof(struct sss_cli_conn));
+        if (conn == NULL) {
+            return NULL;
+        }
+        conn->sd = -1;
+        conn->pid = getpid();
+
+        if (pthread_setspecific(sss_cli_thread_key, conn) != 0) {
+            free(conn);
+            return NULL;
+        }
+
+        pthread_mutex_lock(&sss_cli_thread_mtx);
+        conn->next = sss_cli_thread_conns;
+        if (conn->next != NULL) {
+            conn->next->prev = conn;
+        }
+        sss_cli_thread_conns = conn;
+        pthread_mutex_unlock(&sss_cli_thread_mtx);
+    }
+
+    pthread_mutex_lock(&sss_cli_thread_mtx);
+    conn->in_use = true;
+    sss_cli_thread_reap_idle(time(NULL));
+    pthread_mutex_unlock(&sss_cli_thread_mtx);
+
+    return conn;
+}
+
+static void sss_cli_thread_conn_put(struct sss_cli_conn *conn)
+{
+    pthread_mutex_lock(&sss_cli_thread_mtx);
+    conn->in_use = false;
+    conn->last_used = time(NULL);
+    pthread_mutex_unlock(&sss_cli_thread_mtx);
+}
+
+/* The responder keeps the state of an enumeration per connection. All steps
+ * of an enumeration have to use the same connection, no matter which thread
+ * issues them and whether the thread's connection was reaped in between, so
+ * they always go over the process-wide one. The callers hold the NSS mutex
+ * for them. */
+static bool sss_nss_cmd_is_stateful(enum sss_cli_command cmd)
+{
+    switch (cmd) {
+    case SSS_NSS_SETPWENT:
+    case SSS_NSS_GETPWENT:
+    case SSS_NSS_ENDPWENT:
+    case SSS_NSS_SETGRENT:
+    case SSS_NSS_GETGRENT:
+    case SSS_NSS_ENDGRENT:
+    case SSS_NSS_SETNETGRENT:
+    case SSS_NSS_GETNETGRENT:
+    case SSS_NSS_ENDNETGRENT:
+    /* saves and restores the netgroup enumeration of the connection */
+    case SSS_NSS_SETSERVENT:
+    case SSS_NSS_GETSERVENT:
+    case SSS_NSS_ENDSERVENT:
+        return true;
+    default:
+        return false;
     }
+}
+#endif /* HAVE_PTHREAD */
+
+/* Returns the connection a command has to be sent over, NULL on memory
+ * allocation failure */
+static struct sss_cli_conn *sss_nss_conn_get(enum sss_cli_command cmd)
+{
+#if HAVE_PTHREAD
+    if (!sss_nss_cmd_is_stateful(cmd) && sss_cli_thread_sockets_enabled()) {
+        return sss_cli_thread_conn_get();
+    }
+#endif
+
+    return &sss_cli_global_conn;
+}
+
+static void sss_nss_conn_put(struct sss_cli_conn *conn)
+{
+#if HAVE_PTHREAD
+    if (conn != &sss_cli_global_conn) {
+        sss_cli_thread_conn_put(conn);
+    }
+#endif
+}
+
+static enum nss_status sss_nss_conn_make_request(struct sss_cli_conn *conn,
+                                                 enum sss_cli_command cmd,
+                                                 struct sss_cli_req_data *rd,
+                                                 uint8_t **repbuf,
+                                                 size_t *replen,
+                                                 int *errnop)
+{
+    enum sss_status ret;
 
-    ret = sss_cli_check_socket(errnop, SSS_NSS_SOCKET_NAME);
+    ret = sss_cli_conn_check_socket(conn, errnop, SSS_NSS_SOCKET_NAME);
     if (ret != SSS_STATUS_SUCCESS) {
 #ifdef NONSTANDARD_SSS_NSS_BEHAVIOUR
         *errnop = 0;
@@ -733,7 +1000,8 @@ enum nss_status sss_nss_make_request(enum sss_cli_command cmd,
 #endif
     }
 
-    ret = sss_cli_make_request_nochecks(cmd, rd, repbuf, replen, errnop);
+    ret = sss_cli_make_request_nochecks(conn, cmd, rd, repbuf, replen,
+                                        errnop);
     switch (ret) {
     case SSS_STATUS_TRYAGAIN:
         return NSS_STATUS_TRYAGAIN;
@@ -751,6 +1019,149 @@ enum nss_status sss_nss_make_request(enum sss_cli_command cmd,
     }
 }
 
+/* this function will check command codes match and returned length is ok */
+/* repbuf and replen report only the data section not the header */
+enum nss_status sss_nss_make_request(enum sss_cli_command cmd,
+                      struct sss_cli_req_data *rd,
+                      uint8_t **repbuf, size_t *replen,
+                      int *errnop)
+{
+    enum nss_status nret;
+    char *envval;
+    struct sss_cli_conn *conn;
+
+    /* avoid looping in the nss daemon */
+    envval = getenv("_SSS_LOOPS");
+    if (envval && strcmp(envval, "NO") == 0) {
+        return NSS_STATUS_NOTFOUND;
+    }
+
+    conn = sss_nss_conn_get(cmd);
+    if (conn == NULL) {
+        *errnop = ENOMEM;
+        return NSS_STATUS_TRYAGAIN;
+    }
+
+    nret = sss_nss_conn_make_request(conn, cmd, rd, repbuf, replen, errnop);
+    sss_nss_conn_put(conn);
+    return nret;
+}
+
+enum nss_status sss_nss_make_batch_request(const struct sss_cli_batch_req *reqs,
+                                           size_t num_reqs,
+                                           uint8_t **repbuf, size_t *replen,
+                                           int *errnop)
+{
+    struct sss_cli_req_data rd;
+    enum nss_status nret;
+    uint8_t *data;
+    size_t data_len;
+    size_t name_len;
+    size_t pctr;
+    size_t i;
+    errno_t ret;
+
+    if (reqs == NULL || num_reqs == 0
+            || num_reqs > SSS_NSS_MAX_BATCH_ENTRIES) {
+        *errnop = EINVAL;
+        return NSS_STATUS_UNAVAIL;
+    }
+
+    data_len = sizeof(uint32_t);
+    for (i = 0; i < num_reqs; i++) {
+        data_len += sizeof(uint32_t);
+
+        switch (reqs[i].cmd) {
+        case SSS_NSS_GETPWNAM:
+        case SSS_NSS_GETGRNAM:
+        case SSS_NSS_GETNAMEBYSID:
+        case SSS_NSS_GETIDBYSID:
+            ret = sss_strnlen(reqs[i].name, SSS_NAME_MAX, &name_len);
+            if (ret != 0 || name_len == 0) {
+                *errnop = EINVAL;
+                return NSS_STATUS_UNAVAIL;
+            }
+            data_len += name_len + 1;
+            break;
+        case SSS_NSS_GETPWUID:
+        case SSS_NSS_GETGRGID:
+            data_len += sizeof(uint32_t);
+            break;
+        default:
+            *errnop = EINVAL;
+            return NSS_STATUS_UNAVAIL;
+        }
+    }
+
+    data = malloc(data_len);
+    if (data == NULL) {
+        *errnop = ENOMEM;
+        return NSS_STATUS_TRYAGAIN;
+    }
+
+    pctr = 0;
+    SAFEALIGN_SETMEM_UINT32(data, num_reqs, &pctr);
+    for (i = 0; i < num_reqs; i++) {
+        SAFEALIGN_SETMEM_UINT32(data + pctr, reqs[i].cmd, &pctr);
+
+        switch (reqs[i].cmd) {
+        case SSS_NSS_GETPWNAM:
+        case SSS_NSS_GETGRNAM:
+        case SSS_NSS_GETNAMEBYSID:
+        case SSS_NSS_GETIDBYSID:
+            name_len = strlen(reqs[i].name) + 1;
+            memcpy(data + pctr, reqs[i].name, name_len);
+            pctr += name_len;
+            break;
+        default:
+            SAFEALIGN_SETMEM_UINT32(data + pctr, reqs[i].id, &pctr);
+            break;
+        }
+    }
+
+    rd.len = data_len;
+    rd.data = data;
+
+    nret = sss_nss_make_request(SSS_NSS_GETBATCH, &rd, repbuf, replen, errnop);
+    free(data);
+
+    return nret;
+}
+
+errno_t sss_nss_batch_next_result(uint8_t *repbuf, size_t replen,
+                                  size_t *pos, uint32_t *_cmd,
+                                  uint32_t *_status,
+                                  uint8_t **_data, size_t *_data_len)
+{
+    size_t pctr;
+    uint32_t data_len;
+
+    /* skip the number of results and the reserved field */
+    pctr = (*pos == 0) ? 2 * sizeof(uint32_t) : *pos;
+
+    if (pctr == replen) {
+        return ENOENT;
+    }
+
+    if (pctr > replen || replen - pctr < 3 * sizeof(uint32_t)) {
+        return EBADMSG;
+    }
+
+    SAFEALIGN_COPY_UINT32(_cmd, repbuf + pctr, &pctr);
+    SAFEALIGN_COPY_UINT32(_status, repbuf + pctr, &pctr);
+    SAFEALIGN_COPY_UINT32(&data_len, repbuf + pctr, &pctr);
+
+    if (data_len > replen - pctr) {
+        return EBADMSG;
+    }
+
+    *_data = repbuf + pctr;
+    *_data_len = data_len;
+    *pos = pctr + data_len;
+
+    return 0;
+}
+
 int sss_pac_check_and_open(void)
 {
     enum sss_status ret;
@@ -783,7 +1194,8 @@ int sss_pac_make_request(enum sss_cli_command cmd,
         return NSS_STATUS_UNAVAIL;
     }
 
-    ret = sss_cli_make_request_nochecks(cmd, rd, repbuf, replen, errnop);
+    ret = sss_cli_make_request_nochecks(&sss_cli_global_conn, cmd, rd,
+                                        repbuf, replen, errnop);
     switch (ret) {
     case SSS_STATUS_TRYAGAIN:
         return NSS_STATUS_TRYAGAIN;
@@ -878,7 +1290,7 @@ int sss_pam_make_request(enum sss_cli_command cmd,
         goto out;
     }
 
-    error = check_server_cred(sss_cli_sd);
+    error = check_server_cred(sss_cli_global_conn.sd);
     if (error != 0) {
         sss_cli_close_socket();
         *errnop = error;
@@ -886,7 +1298,8 @@ int sss_pam_make_request(enum sss_cli_command cmd,
         goto out;
     }
 
-    status = sss_cli_make_request_nochecks(cmd, rd, repbuf, replen, errnop);
+    status = sss_cli_make_request_nochecks(&sss_cli_global_conn, cmd, rd,
+                                        repbuf, replen, errnop);
     if (status == SSS_STATUS_SUCCESS) {
         ret = PAM_SUCCESS;
     } else {
@@ -902,10 +1315,7 @@ void sss_pam_close_fd(void)
 {
     sss_pam_lock();
 
-    if (sss_cli_sd != -1) {
-        close(sss_cli_sd);
-        sss_cli_sd = -1;
-    }
+    sss_cli_close_socket();
 
     sss_pam_unlock();
 }
@@ -922,7 +1332,8 @@ int sss_sudo_make_request(enum sss_cli_command cmd,
         return SSS_STATUS_UNAVAIL;
     }
 
-    ret = sss_cli_make_request_nochecks(cmd, rd, repbuf, replen, errnop);
+    ret = sss_cli_make_request_nochecks(&sss_cli_global_conn, cmd, rd,
+                                        repbuf, replen, errnop);
 
     return ret;
 }
@@ -939,7 +1350,8 @@ int sss_autofs_make_request(enum sss_cli_command cmd,
         return SSS_STATUS_UNAVAIL;
     }
 
-    ret = sss_cli_make_request_nochecks(cmd, rd, repbuf, replen, errnop);
+    ret = sss_cli_make_request_nochecks(&sss_cli_global_conn, cmd, rd,
+                                        repbuf, replen, errnop);
 
     return ret;
 }
@@ -956,7 +1368,8 @@ int sss_ssh_make_request(enum sss_cli_command cmd,
         return SSS_STATUS_UNAVAIL;
     }
 
-    ret = sss_cli_make_request_nochecks(cmd, rd, repbuf, replen, errnop);
+    ret = sss_cli_make_request_nochecks(&sss_cli_global_conn, cmd, rd,
+                                        repbuf, replen, errnop);
 
     return ret;
 }
@@ -1115,6 +1528,21 @@ void sss_nss_unlock(void)
     sss_mt_unlock(&sss_nss_mtx);
 }
 
+/* Lookups that don't touch any state shared by the client library only
+ * need to be serialized while all threads share the process-wide socket */
+void sss_nss_lookup_lock(void)
+{
+    if (!sss_cli_thread_sockets_enabled()) {
+        sss_nss_lock();
+    }
+}
+void sss_nss_lookup_unlock(void)
+{
+    if (!sss_cli_thread_sockets_enabled()) {
+        sss_nss_unlock();
+    }
+}
+
 /* NSS mutex wrappers */
 static void sss_pam_mt_init(void)
 {
@@ -1148,6 +1576,8 @@ void sss_nss_mc_unlock(void)
 /* sorry no mutexes available */
 void sss_nss_lock(void) { return; }
 void sss_nss_unlock(void) { return; }
+void sss_nss_lookup_lock(void) { return; }
+void sss_nss_lookup_unlock(void) { return; }
 void sss_pam_lock(void) { return; }
 void sss_pam_unlock(void) { return; }
 void sss_nss_mc_lock(void) { return; }
@@ -27,10 +27,10 @@
 #include <nss.h>
 
 #include "sss_client/sss_cli.h"
+#include "sss_client/nss_mc.h"
 #include "sss_client/idmap/sss_nss_idmap.h"
 #include "util/strtonum.h"
 
-#define DATA_START (3 * sizeof(uint32_t))
 union input {
     const char *str;
     uint32_t id;
@@ -138,6 +138,100 @@ done:
     return ret;
 }
 
+static int sss_nss_mc_getyyybyxxx(union input inp, size_t inp_len,
+                                  enum sss_cli_command cmd,
+                                  struct output *out)
+{
+    int ret;
+    uint32_t type;
+
+    switch (cmd) {
+    case SSS_NSS_GETSIDBYNAME:
+        ret = sss_nss_mc_getsidbyname(inp.str, inp_len, &out->d.str, &type);
+        break;
+    case SSS_NSS_GETNAMEBYSID:
+        ret = sss_nss_mc_getbysid(inp.str, inp_len, &out->d.str, NULL, &type);
+        break;
+    case SSS_NSS_GETIDBYSID:
+        ret = sss_nss_mc_getbysid(inp.str, inp_len, NULL, &out->d.id, &type);
+        break;
+    case SSS_NSS_GETSIDBYID:
+        ret = sss_nss_mc_getsidbyid(inp.id, &out->d.str, &type);
+        break;
+    default:
+        return ENOENT;
+    }
+
+    if (ret == 0) {
+        out->type = type;
+    }
+
+    return ret;
+}
+
+/* Parses the reply of a single lookup starting with the type of the object,
+ * i.e. after the number of results and the reserved field */
+static int sss_nss_parse_reply(enum sss_cli_command cmd,
+                               uint8_t *buf, size_t buf_len,
+                               struct output *out)
+{
+    int ret;
+    char *str;
+    size_t data_len;
+    uint32_t c;
+    struct sss_nss_kv *kv_list;
+
+    if (buf_len < sizeof(uint32_t)) {
+        return EBADMSG;
+    }
+
+    SAFEALIGN_COPY_UINT32(&out->type, buf, NULL);
+
+    data_len = buf_len - sizeof(uint32_t);
+
+    switch(cmd) {
+    case SSS_NSS_GETSIDBYID:
+    case SSS_NSS_GETSIDBYNAME:
+    case SSS_NSS_GETNAMEBYSID:
+        if (data_len <= 1 || buf[buf_len - 1] != '\0') {
+            return EBADMSG;
+        }
+
+        str = malloc(sizeof(char) * data_len);
+        if (str == NULL) {
+            return ENOMEM;
+        }
+
+        strncpy(str, (char *) buf + sizeof(uint32_t), data_len);
+
+        out->d.str = str;
+
+        break;
+    case SSS_NSS_GETIDBYSID:
+        if (data_len != sizeof(uint32_t)) {
+            return EBADMSG;
+        }
+
+        SAFEALIGN_COPY_UINT32(&c, buf + sizeof(uint32_t), NULL);
+        out->d.id = c;
+
+        break;
+    case SSS_NSS_GETORIGBYNAME:
+        ret = buf_to_kv_list(buf + sizeof(uint32_t), data_len, &kv_list);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        out->d.kv_list = kv_list;
+
+        break;
+    default:
+        return EINVAL;
+    }
+
+    return EOK;
+}
+
 static int sss_nss_getyyybyxxx(union input inp, enum sss_cli_command cmd ,
                                struct output *out)
 {
@@ -149,10 +243,8 @@ static int sss_nss_getyyybyxxx(union input inp, enum sss_cli_command cmd ,
     int errnop;
     enum nss_status nret;
     uint32_t num_results;
-    char *str = NULL;
-    size_t data_len;
-    uint32_t c;
-    struct sss_nss_kv *kv_list;
+
+    inp_len = 0;
 
     switch (cmd) {
     case SSS_NSS_GETSIDBYNAME:
@@ -177,6 +269,13 @@ static int sss_nss_getyyybyxxx(union input inp, enum sss_cli_command cmd ,
         return EINVAL;
     }
 
+    /* translations are served from the memory cache when possible, on any
+     * error fall through and ask the responder */
+    ret = sss_nss_mc_getyyybyxxx(inp, inp_len, cmd, out);
+    if (ret == 0) {
+        return EOK;
+    }
+
     sss_nss_lock();
 
     nret = sss_nss_make_request(cmd, &rd, &repbuf, &replen, &errnop);
@@ -201,51 +300,9 @@ static int sss_nss_getyyybyxxx(union input inp, enum sss_cli_command cmd ,
 
     /* Skip first two 32 bit values (number of results and
      * reserved padding) */
-    SAFEALIGN_COPY_UINT32(&out->type, repbuf + 2 * sizeof(uint32_t), NULL);
-
-    data_len = replen - DATA_START;
-
-    switch(cmd) {
-    case SSS_NSS_GETSIDBYID:
-    case SSS_NSS_GETSIDBYNAME:
-    case SSS_NSS_GETNAMEBYSID:
-        if (data_len <= 1 || repbuf[replen - 1] != '\0') {
-            ret = EBADMSG;
-            goto done;
-        }
-
-        str = malloc(sizeof(char) * data_len);
-        if (str == NULL) {
-            ret = ENOMEM;
-            goto done;
-        }
-
-        strncpy(str, (char *) repbuf + DATA_START, data_len);
-
-        out->d.str = str;
-
-        break;
-    case SSS_NSS_GETIDBYSID:
-        if (data_len != sizeof(uint32_t)) {
-            ret = EBADMSG;
-            goto done;
-        }
-
-        SAFEALIGN_COPY_UINT32(&c, repbuf + DATA_START, NULL);
-        out->d.id = c;
-
-        break;
-    case SSS_NSS_GETORIGBYNAME:
-        ret = buf_to_kv_list(repbuf + DATA_START, data_len, &kv_list);
-        if (ret != EOK) {
-            goto done;
-        }
-
-        out->d.kv_list = kv_list;
-
-        break;
-    default:
-        ret = EINVAL;
+    ret = sss_nss_parse_reply(cmd, repbuf + 2 * sizeof(uint32_t),
+                              replen - 2 * sizeof(uint32_t), out);
+    if (ret != EOK) {
         goto done;
     }
 
@@ -254,9 +311,6 @@ static int sss_nss_getyyybyxxx(union input inp, enum sss_cli_command cmd ,
 done:
     sss_nss_unlock();
     free(repbuf);
-    if (ret != EOK) {
-        free(str);
-    }
 
     return ret;
 }
@@ -368,3 +422,221 @@ int sss_nss_getorigbyname(const char *fq_name, struct sss_nss_kv **kv_list,
 
     return ret;
 }
+
+/* Sends the lookups which were not answered by the memory cache in one
+ * SSS_NSS_GETBATCH request, idx maps the requests to the input SIDs */
+static int sss_nss_getyyybysids_batch(const char *const *sids,
+                                      const size_t *idx, size_t num,
+                                      enum sss_cli_command cmd,
+                                      struct output *outs, int *rets)
+{
+    int ret;
+    struct sss_cli_batch_req *reqs;
+    uint8_t *repbuf = NULL;
+    size_t replen;
+    int errnop;
+    enum nss_status nret;
+    size_t pos = 0;
+    uint32_t rep_cmd;
+    uint32_t status;
+    uint8_t *data;
+    size_t data_len;
+    size_t c;
+
+    reqs = calloc(num, sizeof(struct sss_cli_batch_req));
+    if (reqs == NULL) {
+        return ENOMEM;
+    }
+
+    for (c = 0; c < num; c++) {
+        reqs[c].cmd = cmd;
+        reqs[c].name = sids[idx[c]];
+    }
+
+    sss_nss_lock();
+
+    nret = sss_nss_make_batch_request(reqs, num, &repbuf, &replen, &errnop);
+    if (nret != NSS_STATUS_SUCCESS) {
+        ret = nss_status_to_errno(nret);
+        goto done;
+    }
+
+    /* results come in the order of the request */
+    for (c = 0; c < num; c++) {
+        ret = sss_nss_batch_next_result(repbuf, replen, &pos, &rep_cmd,
+                                        &status, &data, &data_len);
+        if (ret != EOK || rep_cmd != cmd) {
+            ret = EBADMSG;
+            goto done;
+        }
+
+        if (status != EOK) {
+            rets[idx[c]] = status;
+            continue;
+        }
+
+        rets[idx[c]] = sss_nss_parse_reply(cmd, data, data_len,
+                                           &outs[idx[c]]);
+    }
+
+    ret = EOK;
+
+done:
+    sss_nss_unlock();
+    free(repbuf);
+    free(reqs);
+
+    if (ret != EOK) {
+        /* do not hand out the results of a partially parsed reply */
+        for (c = 0; c < num; c++) {
+            if (rets[idx[c]] == EOK && cmd == SSS_NSS_GETNAMEBYSID) {
+                free(outs[idx[c]].d.str);
+            }
+            rets[idx[c]] = ret;
+        }
+    }
+
+    return ret;
+}
+
+static int sss_nss_getyyybysids(const char *const *sids, size_t num_sids,
+                                enum sss_cli_command cmd,
+                                struct output *outs, int *rets)
+{
+    int ret;
+    union input inp;
+    size_t inp_len;
+    size_t *idx;
+    size_t num_idx = 0;
+    size_t c;
+    size_t b;
+    size_t chunk;
+
+    idx = calloc(num_sids, sizeof(size_t));
+    if (idx == NULL) {
+        return ENOMEM;
+    }
+
+    for (c = 0; c < num_sids; c++) {
+        if (sids[c] == NULL || *sids[c] == '\0') {
+            rets[c] = EINVAL;
+            continue;
+        }
+
+        ret = sss_strnlen(sids[c], SSS_NAME_MAX, &inp_len);
+        if (ret != EOK) {
+            rets[c] = EINVAL;
+            continue;
+        }
+
+        inp.str = sids[c];
+        rets[c] = sss_nss_mc_getyyybyxxx(inp, inp_len, cmd, &outs[c]);
+        if (rets[c] != 0) {
+            idx[num_idx++] = c;
+        }
+    }
+
+    for (b = 0; b < num_idx; b += SSS_NSS_MAX_BATCH_ENTRIES) {
+        chunk = num_idx - b;
+        if (chunk > SSS_NSS_MAX_BATCH_ENTRIES) {
+            chunk = SSS_NSS_MAX_BATCH_ENTRIES;
+        }
+
+        ret = sss_nss_getyyybysids_batch(sids, idx + b, chunk, cmd,
+                                         outs, rets);
+        if (ret == EOK) {
+            continue;
+        }
+
+        /* e.g. an older responder which does not know SSS_NSS_GETBATCH,
+         * fall back to one request per SID */
+        for (c = b; c < b + chunk; c++) {
+            inp.str = sids[idx[c]];
+            rets[idx[c]] = sss_nss_getyyybyxxx(inp, cmd, &outs[idx[c]]);
+        }
+    }
+
+    free(idx);
+
+    return EOK;
+}
+
+int sss_nss_getnamesbysids(const char *const *sids, size_t num_sids,
+                           char **fq_names, enum sss_id_type *types,
+                           int *rets)
+{
+    int ret;
+    struct output *outs;
+    size_t c;
+
+    if (sids == NULL || fq_names == NULL || types == NULL || rets == NULL) {
+        return EINVAL;
+    }
+
+    if (num_sids == 0) {
+        return EOK;
+    }
+
+    outs = calloc(num_sids, sizeof(struct output));
+    if (outs == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_nss_getyyybysids(sids, num_sids, SSS_NSS_GETNAMEBYSID,
+                               outs, rets);
+    if (ret == EOK) {
+        for (c = 0; c < num_sids; c++) {
+            if (rets[c] == EOK) {
+                fq_names[c] = outs[c].d.str;
+                types[c] = outs[c].type;
+            } else {
+                fq_names[c] = NULL;
+                types[c] = SSS_ID_TYPE_NOT_SPECIFIED;
+            }
+        }
+    }
+
+    free(outs);
+
+    return ret;
+}
+
+int sss_nss_getidsbysids(const char *const *sids, size_t num_sids,
+                         uint32_t *ids, enum sss_id_type *id_types,
+                         int *rets)
+{
+    int ret;
+    struct output *outs;
+    size_t c;
+
+    if (sids == NULL || ids == NULL || id_types == NULL || rets == NULL) {
+        return EINVAL;
+    }
+
+    if (num_sids == 0) {
+        return EOK;
+    }
+
+    outs = calloc(num_sids, sizeof(struct output));
+    if (outs == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_nss_getyyybysids(sids, num_sids, SSS_NSS_GETIDBYSID,
+                               outs, rets);
+    if (ret == EOK) {
+        for (c = 0; c < num_sids; c++) {
+            if (rets[c] == EOK) {
+                ids[c] = outs[c].d.id;
+                id_types[c] = outs[c].type;
+            } else {
+                ids[c] = 0;
+                id_types[c] = SSS_ID_TYPE_NOT_SPECIFIED;
+            }
+        }
+    }
+
+    free(outs);
+
+    return ret;
+}
@@ -26,6 +26,7 @@
 #define SSS_NSS_IDMAP_H_
 
 #include <stdint.h>
+#include <stddef.h>
 
 /**
  * Object types
@@ -123,6 +124,50 @@ int sss_nss_getidbysid(const char *sid, uint32_t *id,
 int sss_nss_getorigbyname(const char *fq_name, struct sss_nss_kv **kv_list,
                           enum sss_id_type *type);
 
+/**
+ * @brief Return the fully qualified names for a list of SIDs
+ *
+ * SIDs which are not in the memory cache are sent to SSSD together in as
+ * few requests as possible.
+ *
+ * @param[in] sids      Array of string representations of SIDs
+ * @param[in] num_sids  Number of elements of sids
+ * @param[out] fq_names Array of num_sids fully qualified names, each name
+ *                      must be freed by the caller, NULL if the lookup of
+ *                      the related SID failed
+ * @param[out] types    Array of num_sids types of the objects
+ * @param[out] rets     Array of num_sids results of the single lookups,
+ *                      see #sss_nss_getsidbyname for the possible values
+ *
+ * @return
+ *  - 0 (EOK): all SIDs were looked up, see rets for the single results
+ *  - EINVAL: invalid input
+ *  - ENOMEM: memory allocation failed
+ */
+int sss_nss_getnamesbysids(const char *const *sids, size_t num_sids,
+                           char **fq_names, enum sss_id_type *types,
+                           int *rets);
+
+/**
+ * @brief Return the POSIX IDs for a list of SIDs
+ *
+ * SIDs which are not in the memory cache are sent to SSSD together in as
+ * few requests as possible.
+ *
+ * @param[in] sids      Array of string representations of SIDs
+ * @param[in] num_sids  Number of elements of sids
+ * @param[out] ids      Array of num_sids POSIX IDs
+ * @param[out] id_types Array of num_sids types of the objects
+ * @param[out] rets     Array of num_sids results of the single lookups,
+ *                      see #sss_nss_getsidbyname for the possible values
+ *
+ * @return
+ *  - see #sss_nss_getnamesbysids
+ */
+int sss_nss_getidsbysids(const char *const *sids, size_t num_sids,
+                         uint32_t *ids, enum sss_id_type *id_types,
+                         int *rets);
+
 /**
  * @brief Free key-value list returned by sss_nss_getorigbyname()
  *
@@ -21,6 +21,8 @@
 
 /* Required Headers */
 
+#include <errno.h>
+
 #include "sss_client/idmap/sss_nss_idmap.h"
 
 #include "libwbclient.h"
@@ -165,41 +167,78 @@ wbcErr wbcSidsToUnixIds(const struct wbcDomainSid *sids, uint32_t num_sids,
             struct wbcUnixId *ids)
 {
     int ret;
-    char *sid_str;
-    uint32_t id;
-    enum sss_id_type type;
+    char **sid_strs = NULL;
+    uint32_t *id_list = NULL;
+    enum sss_id_type *types = NULL;
+    int *rets = NULL;
     size_t c;
     wbcErr wbc_status;
 
+    if (num_sids == 0) {
+        return WBC_ERR_SUCCESS;
+    }
+
+    sid_strs = calloc(num_sids, sizeof(char *));
+    id_list = calloc(num_sids, sizeof(uint32_t));
+    types = calloc(num_sids, sizeof(enum sss_id_type));
+    rets = calloc(num_sids, sizeof(int));
+    if (sid_strs == NULL || id_list == NULL || types == NULL || rets == NULL) {
+        wbc_status = WBC_ERR_NO_MEMORY;
+        goto done;
+    }
+
     for (c = 0; c < num_sids; c++) {
-        wbc_status = wbcSidToString(&sids[c], &sid_str);
+        wbc_status = wbcSidToString(&sids[c], &sid_strs[c]);
         if (!WBC_ERROR_IS_OK(wbc_status)) {
-            return wbc_status;
+            goto done;
         }
+    }
 
-        ret = sss_nss_getidbysid(sid_str, &id, &type);
-        wbcFreeMemory(sid_str);
-        if (ret != 0) {
-            return WBC_ERR_UNKNOWN_FAILURE;
+    /* all SIDs are resolved with as few requests to SSSD as possible */
+    ret = sss_nss_getidsbysids((const char *const *) sid_strs, num_sids,
+                               id_list, types, rets);
+    if (ret != 0) {
+        wbc_status = (ret == ENOMEM) ? WBC_ERR_NO_MEMORY
+                                     : WBC_ERR_UNKNOWN_FAILURE;
+        goto done;
+    }
+
+    for (c = 0; c < num_sids; c++) {
+        if (rets[c] != 0) {
+            wbc_status = WBC_ERR_UNKNOWN_FAILURE;
+            goto done;
         }
 
-        switch (type) {
+        switch (types[c]) {
         case SSS_ID_TYPE_UID:
             ids[c].type = WBC_ID_TYPE_UID;
-            ids[c].id.uid = (uid_t) id;
+            ids[c].id.uid = (uid_t) id_list[c];
             break;
         case SSS_ID_TYPE_GID:
             ids[c].type = WBC_ID_TYPE_GID;
-            ids[c].id.gid = (gid_t) id;
+            ids[c].id.gid = (gid_t) id_list[c];
             break;
         case SSS_ID_TYPE_BOTH:
             ids[c].type = WBC_ID_TYPE_BOTH;
-            ids[c].id.uid = (uid_t) id;
+            ids[c].id.uid = (uid_t) id_list[c];
             break;
         default:
             ids[c].type = WBC_ID_TYPE_NOT_SPECIFIED;
         }
     }
 
-    return WBC_ERR_SUCCESS;
+    wbc_status = WBC_ERR_SUCCESS;
+
+done:
+    if (sid_strs != NULL) {
+        for (c = 0; c < num_sids; c++) {
+            wbcFreeMemory(sid_strs[c]);
+        }
+    }
+    free(sid_strs);
+    free(id_list);
+    free(types);
+    free(rets);
+
+    return wbc_status;
 }
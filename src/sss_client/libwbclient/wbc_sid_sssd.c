@@ -155,11 +155,226 @@ done:
     return wbc_status;
 }
 
+static void wbcDomainInfoListDestructor(void *ptr)
+{
+    struct wbcDomainInfo *i = (struct wbcDomainInfo *)ptr;
+
+    while (i->short_name != NULL) {
+        free(i->short_name);
+        free(i->dns_name);
+        i++;
+    }
+}
+
+static void wbcTranslatedNamesDestructor(void *ptr)
+{
+    struct wbcTranslatedName *n = (struct wbcTranslatedName *)ptr;
+
+    while (n->name != NULL) {
+        free(n->name);
+        n++;
+    }
+}
+
+static bool wbcDomainSidEqual(const struct wbcDomainSid *a,
+                              const struct wbcDomainSid *b)
+{
+    int c;
+
+    if (a->sid_rev_num != b->sid_rev_num || a->num_auths != b->num_auths
+            || memcmp(a->id_auth, b->id_auth, sizeof(a->id_auth)) != 0) {
+        return false;
+    }
+
+    for (c = 0; c < a->num_auths; c++) {
+        if (a->sub_auths[c] != b->sub_auths[c]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Returns the index of the domain of the given SID in domains, the domain
+ * is added if it is not in the list yet */
+static int wbcLookupSidsDomain(const struct wbcDomainSid *sid,
+                               const char *domain_name,
+                               struct wbcDomainInfo *domains,
+                               int *num_domains)
+{
+    struct wbcDomainSid dom_sid;
+    char *short_name;
+    char *dns_name;
+    int d;
+
+    dom_sid = *sid;
+    if (dom_sid.num_auths > 0) {
+        dom_sid.num_auths--;
+        dom_sid.sub_auths[dom_sid.num_auths] = 0;
+    }
+
+    for (d = 0; d < *num_domains; d++) {
+        if (wbcDomainSidEqual(&domains[d].sid, &dom_sid)) {
+            break;
+        }
+    }
+
+    if (d == *num_domains) {
+        domains[d].sid = dom_sid;
+        domains[d].short_name = strdup("");
+        domains[d].dns_name = strdup("");
+        if (domains[d].short_name == NULL || domains[d].dns_name == NULL) {
+            free(domains[d].short_name);
+            free(domains[d].dns_name);
+            domains[d].short_name = NULL;
+            domains[d].dns_name = NULL;
+            return -1;
+        }
+        (*num_domains)++;
+    }
+
+    /* the domain might have been added for an unknown SID first */
+    if (domain_name != NULL && *domains[d].short_name == '\0') {
+        short_name = strdup(domain_name);
+        dns_name = strdup(domain_name);
+        if (short_name == NULL || dns_name == NULL) {
+            free(short_name);
+            free(dns_name);
+            return -1;
+        }
+
+        free(domains[d].short_name);
+        free(domains[d].dns_name);
+        domains[d].short_name = short_name;
+        domains[d].dns_name = dns_name;
+    }
+
+    return d;
+}
+
 wbcErr wbcLookupSids(const struct wbcDomainSid *sids, int num_sids,
              struct wbcDomainInfo **pdomains, int *pnum_domains,
              struct wbcTranslatedName **pnames)
 {
-    WBC_SSSD_NOT_IMPLEMENTED;
+    char **sid_strs = NULL;
+    char **fq_names = NULL;
+    enum sss_id_type *types = NULL;
+    int *rets = NULL;
+    struct wbcDomainInfo *domains = NULL;
+    struct wbcTranslatedName *names = NULL;
+    int num_domains = 0;
+    char *domain_name;
+    char *p;
+    int ret;
+    int c;
+    wbcErr wbc_status;
+
+    if (num_sids < 0 || pdomains == NULL || pnum_domains == NULL
+            || pnames == NULL) {
+        return WBC_ERR_INVALID_PARAM;
+    }
+
+    /* the lists are terminated by an element without a name */
+    domains = wbcAllocateMemory(num_sids + 1, sizeof(struct wbcDomainInfo),
+                                wbcDomainInfoListDestructor);
+    names = wbcAllocateMemory(num_sids + 1, sizeof(struct wbcTranslatedName),
+                              wbcTranslatedNamesDestructor);
+    if (domains == NULL || names == NULL) {
+        wbc_status = WBC_ERR_NO_MEMORY;
+        goto done;
+    }
+
+    if (num_sids == 0) {
+        goto done_ok;
+    }
+
+    sid_strs = calloc(num_sids, sizeof(char *));
+    fq_names = calloc(num_sids, sizeof(char *));
+    types = calloc(num_sids, sizeof(enum sss_id_type));
+    rets = calloc(num_sids, sizeof(int));
+    if (sid_strs == NULL || fq_names == NULL || types == NULL
+            || rets == NULL) {
+        wbc_status = WBC_ERR_NO_MEMORY;
+        goto done;
+    }
+
+    for (c = 0; c < num_sids; c++) {
+        wbc_status = wbcSidToString(&sids[c], &sid_strs[c]);
+        if (!WBC_ERROR_IS_OK(wbc_status)) {
+            goto done;
+        }
+    }
+
+    /* all SIDs are resolved with as few requests to SSSD as possible */
+    ret = sss_nss_getnamesbysids((const char *const *) sid_strs, num_sids,
+                                 fq_names, types, rets);
+    if (ret != 0) {
+        wbc_status = (ret == ENOMEM) ? WBC_ERR_NO_MEMORY
+                                     : WBC_ERR_UNKNOWN_FAILURE;
+        goto done;
+    }
+
+    for (c = 0; c < num_sids; c++) {
+        domain_name = NULL;
+        p = NULL;
+
+        if (rets[c] == 0) {
+            ret = sss_id_type_to_wbcSidType(types[c], &names[c].type);
+            if (ret == 0) {
+                p = strchr(fq_names[c], '@');
+            }
+        }
+
+        if (p != NULL) {
+            *p = '\0';
+            domain_name = p + 1;
+            names[c].name = strdup(fq_names[c]);
+        } else {
+            /* SIDs which cannot be resolved are not an error of the whole
+             * lookup but are returned as unknown */
+            names[c].type = WBC_SID_NAME_UNKNOWN;
+            names[c].name = strdup("");
+        }
+        if (names[c].name == NULL) {
+            wbc_status = WBC_ERR_NO_MEMORY;
+            goto done;
+        }
+
+        names[c].domain_index = wbcLookupSidsDomain(&sids[c], domain_name,
+                                                    domains, &num_domains);
+        if (names[c].domain_index < 0) {
+            wbc_status = WBC_ERR_NO_MEMORY;
+            goto done;
+        }
+    }
+
+done_ok:
+    *pdomains = domains;
+    *pnum_domains = num_domains;
+    *pnames = names;
+    domains = NULL;
+    names = NULL;
+    wbc_status = WBC_ERR_SUCCESS;
+
+done:
+    if (sid_strs != NULL) {
+        for (c = 0; c < num_sids; c++) {
+            wbcFreeMemory(sid_strs[c]);
+        }
+    }
+    if (fq_names != NULL) {
+        for (c = 0; c < num_sids; c++) {
+            free(fq_names[c]);
+        }
+    }
+    free(sid_strs);
+    free(fq_names);
+    free(types);
+    free(rets);
+    wbcFreeMemory(domains);
+    wbcFreeMemory(names);
+
+    return wbc_status;
 }
 
 /* Translate a collection of RIDs within a domain to names */
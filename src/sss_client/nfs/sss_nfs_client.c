@@ -27,6 +27,8 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <nfsidmap.h>
 #include "nfsidmap_internal.h"
@@ -39,18 +41,45 @@
 #define PLUGIN_NAME                 "sss_nfs"
 #define CONF_SECTION                "sss_nfs"
 #define CONF_USE_MC                 "memcache"
+#define CONF_LRU_TIMEOUT            "lru_timeout"
 #define REPLY_ID_OFFSET             (8)
 #define REPLY_NAME_OFFSET           (REPLY_ID_OFFSET + 8)
 #define BUF_LEN                     (4096)
 #define USE_MC_DEFAULT              true
+#define LRU_TIMEOUT_DEFAULT         (5)
+#define LRU_SIZE                    (32)
 
 
 /*. . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . .*/
 static char sss_nfs_plugin_name[]   = PLUGIN_NAME;
 static char nfs_conf_sect[]         = CONF_SECTION;
 static char nfs_conf_use_mc[]       = CONF_USE_MC;
+static char nfs_conf_lru_timeout[]  = CONF_LRU_TIMEOUT;
 
 static bool nfs_use_mc              = USE_MC_DEFAULT;
+static int nfs_lru_timeout          = LRU_TIMEOUT_DEFAULT;
+
+
+/*. . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . .*/
+/* Recently translated names and IDs. Listing a directory translates the
+ * same few owners over and over, these are answered without even looking
+ * into the memcache. Entries are kept only for a few seconds so that
+ * changes still show up quickly. */
+struct lru_entry {
+    time_t expire;                  /* 0 if the entry is unused */
+    unsigned int last_use;
+    id_t id;
+    char name[SSS_NAME_MAX + 1];
+};
+
+struct lru {
+    struct lru_entry entries[LRU_SIZE];
+    unsigned int tick;
+};
+
+static pthread_mutex_t lru_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct lru user_lru;
+static struct lru group_lru;
 
 
 /*. . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . .*/
@@ -61,6 +90,101 @@ static int reply_to_id(id_t *idp, uint8_t *rep, size_t rep_len);
 static int reply_to_name(char *name, size_t len, uint8_t *rep, size_t rep_len);
 
 
+/*. . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . .*/
+/* LRU functions, must be called with lru_mtx held */
+static struct lru_entry *lru_find(struct lru *lru, const char *name, id_t id)
+{
+    struct lru_entry *entry;
+    time_t now;
+    int i;
+
+    now = time(NULL);
+    for (i = 0; i < LRU_SIZE; i++) {
+        entry = &lru->entries[i];
+        if (entry->expire <= now) {
+            continue;
+        }
+        if (name != NULL ? strcmp(entry->name, name) == 0 : entry->id == id) {
+            entry->last_use = ++lru->tick;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void lru_add(struct lru *lru, const char *name, id_t id)
+{
+    struct lru_entry *entry;
+    struct lru_entry *victim;
+    size_t len;
+    int i;
+
+    if (nfs_lru_timeout <= 0
+            || sss_strnlen(name, SSS_NAME_MAX + 1, &len) != 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&lru_mtx);
+
+    /* reuse the entry of the same name or else the least recently used */
+    victim = &lru->entries[0];
+    for (i = 0; i < LRU_SIZE; i++) {
+        entry = &lru->entries[i];
+        if (entry->expire != 0 && strcmp(entry->name, name) == 0) {
+            victim = entry;
+            break;
+        }
+        if (entry->expire == 0 || entry->last_use < victim->last_use) {
+            victim = entry;
+        }
+    }
+
+    memcpy(victim->name, name, len + 1);
+    victim->id = id;
+    victim->last_use = ++lru->tick;
+    victim->expire = time(NULL) + nfs_lru_timeout;
+
+    pthread_mutex_unlock(&lru_mtx);
+}
+
+static int get_id_from_lru(struct lru *lru, id_t *id, const char *name)
+{
+    struct lru_entry *entry;
+    int rc = ENOENT;
+
+    pthread_mutex_lock(&lru_mtx);
+    entry = lru_find(lru, name, 0);
+    if (entry != NULL) {
+        *id = entry->id;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&lru_mtx);
+
+    return rc;
+}
+
+static int get_name_from_lru(struct lru *lru, char *name, size_t len, id_t id)
+{
+    struct lru_entry *entry;
+    size_t name_len;
+    int rc = ENOENT;
+
+    pthread_mutex_lock(&lru_mtx);
+    entry = lru_find(lru, NULL, id);
+    if (entry != NULL) {
+        name_len = strlen(entry->name) + 1;
+        if (name_len <= len) {
+            memcpy(name, entry->name, name_len);
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&lru_mtx);
+
+    return rc;
+}
+
+
 /*. . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . .*/
 /* get from memcache functions */
 static int get_uid_from_mc(id_t *uid, const char *name)
@@ -166,6 +290,7 @@ static int get_user_from_mc(char *name, size_t len, uid_t uid)
             IDMAP_LOG(0, ("%s: reply too long; pw_name_len=%lu, len=%lu",
                           __func__, pw_name_len, len));
             rc = ENOBUFS;
+            goto done;
         }
         IDMAP_LOG(1, ("found uid %i in memcache", uid));
         memcpy(name, pwd.pw_name, pw_name_len);
@@ -207,6 +332,7 @@ static int get_group_from_mc(char *name, size_t len, id_t gid)
             IDMAP_LOG(0, ("%s: reply too long; gr_name_len=%lu, len=%lu",
                           __func__, gr_name_len, len));
             rc = ENOBUFS;
+            goto done;
         }
         IDMAP_LOG(1, ("found gid %i in memcache", gid));
         memcpy(name, grp.gr_name, gr_name_len);
@@ -399,6 +525,27 @@ static int nfs_conf_get_bool(char *sect, char *attr, int def)
     return res;
 }
 
+static int nfs_conf_get_int(char *sect, char *attr, int def)
+{
+    int res;
+    char *val;
+    char *end;
+    long num;
+
+    res = def;
+    val = conf_get_str(sect, attr);
+    if (val) {
+        errno = 0;
+        num = strtol(val, &end, 10);
+        if (errno == 0 && *val != '\0' && *end == '\0'
+                && num >= 0 && num <= INT_MAX) {
+            res = num;
+        }
+    }
+
+    return res;
+}
+
 
 /*. . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . . .*/
 /* libnfsidmap return-code aids */
@@ -433,6 +580,9 @@ static int sss_nfs_init(void)
     nfs_use_mc = nfs_conf_get_bool(nfs_conf_sect, nfs_conf_use_mc,
                                    USE_MC_DEFAULT);
     IDMAP_LOG(1, ("%s: use memcache: %i", __func__, nfs_use_mc));
+    nfs_lru_timeout = nfs_conf_get_int(nfs_conf_sect, nfs_conf_lru_timeout,
+                                       LRU_TIMEOUT_DEFAULT);
+    IDMAP_LOG(1, ("%s: lru timeout: %i", __func__, nfs_lru_timeout));
 
     return 0;
 }
@@ -464,11 +614,21 @@ static int sss_nfs_name_to_uid(char *name, uid_t *uid)
         return -rc;
     }
 
+    rc = get_id_from_lru(&user_lru, uid, name);
+    if (rc == 0) {
+        IDMAP_LOG(1, ("found %s in lru", name));
+        goto done;
+    }
+
     rc = get_uid_from_mc(uid, name);
     if (rc != 0) {
         rc = name_to_id(name, uid, SSS_NSS_GETPWNAM);
     }
+    if (rc == 0) {
+        lru_add(&user_lru, name, *uid);
+    }
 
+done:
     log_actual_rc(__func__, rc);
     rc = normalise_rc(rc);
 
@@ -495,11 +655,21 @@ static int sss_nfs_name_to_gid(char *name, gid_t *gid)
         return -rc;
     }
 
+    rc = get_id_from_lru(&group_lru, gid, name);
+    if (rc == 0) {
+        IDMAP_LOG(1, ("found %s in lru", name));
+        goto done;
+    }
+
     rc = get_gid_from_mc(gid, name);
     if (rc != 0) {
         rc = name_to_id(name, gid, SSS_NSS_GETGRNAM);
     }
+    if (rc == 0) {
+        lru_add(&group_lru, name, *gid);
+    }
 
+done:
     log_actual_rc(__func__, rc);
     rc = normalise_rc(rc);
 
@@ -515,11 +685,21 @@ static int sss_nfs_uid_to_name(uid_t uid, char *domain, char *name, size_t len)
         return -EINVAL;
     }
 
+    rc = get_name_from_lru(&user_lru, name, len, uid);
+    if (rc == 0) {
+        IDMAP_LOG(1, ("found uid %i in lru", uid));
+        goto done;
+    }
+
     rc = get_user_from_mc(name, len, uid);
     if (rc != 0) {
         rc = id_to_name(name, len, uid, SSS_NSS_GETPWUID);
     }
+    if (rc == 0) {
+        lru_add(&user_lru, name, uid);
+    }
 
+done:
     log_actual_rc(__func__, rc);
     rc = normalise_rc(rc);
 
@@ -535,11 +715,21 @@ static int sss_nfs_gid_to_name(gid_t gid, char *domain, char *name, size_t len)
         return -EINVAL;
     }
 
+    rc = get_name_from_lru(&group_lru, name, len, gid);
+    if (rc == 0) {
+        IDMAP_LOG(1, ("found gid %i in lru", gid));
+        goto done;
+    }
+
     rc = get_group_from_mc(name, len, gid);
     if (rc != 0) {
         rc = id_to_name(name, len, gid, SSS_NSS_GETGRGID);
     }
+    if (rc == 0) {
+        lru_add(&group_lru, name, gid);
+    }
 
+done:
     log_actual_rc(__func__, rc);
     rc = normalise_rc(rc);
 
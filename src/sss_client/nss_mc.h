@@ -26,8 +26,13 @@
 #include <stdbool.h>
 #include <pwd.h>
 #include <grp.h>
+#include <netdb.h>
 #include "util/mmap_cache.h"
 
+/* how many times a lookup is restarted when the record it was reading
+ * gets modified by the responder at the same time */
+#define SSS_NSS_MC_READ_RETRIES 5
+
 #ifndef HAVE_ERRNO_T
 #define HAVE_ERRNO_T
 typedef int errno_t;
@@ -45,6 +50,7 @@ struct sss_cli_mc_ctx {
     int fd;
 
     uint32_t seed;          /* seed from the tables header */
+    uint32_t flags;         /* SSS_MC_HEADER_* flags from the header */
 
     void *mmap_base;        /* base address of mmap */
     size_t mmap_size;       /* total size of mmap */
@@ -63,7 +69,11 @@ errno_t sss_nss_check_header(struct sss_cli_mc_ctx *ctx);
 uint32_t sss_nss_mc_hash(struct sss_cli_mc_ctx *ctx,
                          const char *key, size_t len);
 errno_t sss_nss_mc_get_record(struct sss_cli_mc_ctx *ctx,
-                              uint32_t slot, struct sss_mc_rec **_rec);
+                              uint32_t slot, struct sss_mc_rec **_rec,
+                              uint32_t *_barrier);
+bool sss_nss_mc_record_changed(struct sss_mc_rec *rec, uint32_t barrier);
+bool sss_nss_mc_within_data_table(struct sss_cli_mc_ctx *ctx,
+                                  const void *ptr, size_t len);
 errno_t sss_nss_str_ptr_from_buffer(char **str, void **cookie,
                                     char *buf, size_t len);
 uint32_t sss_nss_mc_next_slot_with_hash(struct sss_mc_rec *rec,
@@ -90,4 +100,32 @@ errno_t sss_nss_mc_initgroups_dyn(const char *name, size_t name_len,
                                   gid_t group, long int *start, long int *size,
                                   gid_t **groups, long int limit);
 
+/* netgroup db */
+/* size of the header (number of entries and a reserved field) at the start
+ * of the buffer returned by sss_nss_mc_getnetgr() */
+#define SSS_NSS_MC_NETGR_HDR_LEN (2 * sizeof(uint32_t))
+/* Returns a malloc'ed buffer laid out like a SSS_NSS_GETNETGRENT reply
+ * holding all the entries of the netgroup */
+errno_t sss_nss_mc_getnetgr(const char *name, size_t name_len,
+                            uint8_t **_buf, size_t *_buf_len);
+
+/* SID db */
+/* Strings are returned malloc'ed, any output pointer can be NULL */
+errno_t sss_nss_mc_getsidbyname(const char *name, size_t name_len,
+                                char **_sid, uint32_t *_id_type);
+errno_t sss_nss_mc_getbysid(const char *sid, size_t sid_len,
+                            char **_name, uint32_t *_id, uint32_t *_id_type);
+errno_t sss_nss_mc_getsidbyid(uint32_t id,
+                              char **_sid, uint32_t *_id_type);
+
+/* services db */
+errno_t sss_nss_mc_getservbyname(const char *name, size_t name_len,
+                                 const char *protocol, size_t proto_len,
+                                 struct servent *result,
+                                 char *buffer, size_t buflen);
+/* port is in network byte order */
+errno_t sss_nss_mc_getservbyport(int port, const char *protocol,
+                                 struct servent *result,
+                                 char *buffer, size_t buflen);
+
 #endif /* _NSS_MC_H_ */
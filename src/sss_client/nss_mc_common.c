@@ -37,8 +37,6 @@
 /* FIXME: hook up to library destructor to avoid leaks */
 /* FIXME: temporarily open passwd file on our own, later we will probably
  * use socket passing from the main process */
-/* FIXME: handle name upper/lower casing ? Maybe a flag passed down by
- * sssd or a flag in sss_mc_header ? per domain ? */
 
 #define MEMCPY_WITH_BARRIERS(res, dest, src, len) \
 do { \
@@ -87,12 +85,14 @@ errno_t sss_nss_check_header(struct sss_cli_mc_ctx *ctx)
     /* first time we check the header, let's fill our own struct */
     if (ctx->data_table == NULL) {
         ctx->seed = h.seed;
+        ctx->flags = h.flags;
         ctx->data_table = MC_PTR_ADD(ctx->mmap_base, h.data_table);
         ctx->hash_table = MC_PTR_ADD(ctx->mmap_base, h.hash_table);
         ctx->dt_size = h.dt_size;
         ctx->ht_size = h.ht_size;
     } else {
         if (ctx->seed != h.seed ||
+            ctx->flags != h.flags ||
             ctx->data_table != MC_PTR_ADD(ctx->mmap_base, h.data_table) ||
             ctx->hash_table != MC_PTR_ADD(ctx->mmap_base, h.hash_table) ||
             ctx->dt_size != h.dt_size ||
@@ -198,13 +198,17 @@ errno_t sss_nss_mc_get_ctx(const char *name, struct sss_cli_mc_ctx *ctx)
 {
     char *envval;
     int ret;
-    bool need_decrement = false;
+    bool need_decrement;
+    bool was_mapped = false;
+    bool retried = false;
 
     envval = getenv("SSS_NSS_USE_MEMCACHE");
     if (envval && strcasecmp(envval, "NO") == 0) {
         return EPERM;
     }
 
+again:
+    need_decrement = false;
     switch (ctx->initialized) {
     case UNINITIALIZED:
         __sync_add_and_fetch(&ctx->active_threads, 1);
@@ -232,6 +236,13 @@ errno_t sss_nss_mc_get_ctx(const char *name, struct sss_cli_mc_ctx *ctx)
         if (ctx->initialized == INITIALIZED) {
             ctx->initialized = RECYCLED;
         }
+        if (ctx->initialized == RECYCLED) {
+            was_mapped = true;
+        }
+        if (need_decrement) {
+            /* In case of error, we will not touch mmapped area => decrement */
+            __sync_sub_and_fetch(&ctx->active_threads, 1);
+        }
         if (ctx->initialized == RECYCLED && ctx->active_threads == 0) {
             /* just one thread should call munmap */
             sss_nss_mc_lock();
@@ -240,9 +251,12 @@ errno_t sss_nss_mc_get_ctx(const char *name, struct sss_cli_mc_ctx *ctx)
             }
             sss_nss_mc_unlock();
         }
-        if (need_decrement) {
-            /* In case of error, we will not touch mmapped area => decrement */
-            __sync_sub_and_fetch(&ctx->active_threads, 1);
+        if (was_mapped && !retried && ctx->initialized == UNINITIALIZED) {
+            /* The responder replaced the file (e.g. when the cache was
+             * grown), follow it right away instead of falling back to
+             * the socket. This is attempted only once. */
+            retried = true;
+            goto again;
         }
     }
     return ret;
@@ -251,77 +265,76 @@ errno_t sss_nss_mc_get_ctx(const char *name, struct sss_cli_mc_ctx *ctx)
 uint32_t sss_nss_mc_hash(struct sss_cli_mc_ctx *ctx,
                          const char *key, size_t len)
 {
+    if (ctx->flags & SSS_MC_HEADER_FOLD_CASE) {
+        return murmurhash3_fold(key, len, ctx->seed)
+                    % MC_HT_ELEMS(ctx->ht_size);
+    }
+
     return murmurhash3(key, len, ctx->seed) % MC_HT_ELEMS(ctx->ht_size);
 }
 
+/*
+ * Returns a pointer to the record directly in the mapped area, the record
+ * is not copied. The barrier seen while fetching the record is returned in
+ * _barrier: all data needed must be read out of the record first and then
+ * sss_nss_mc_record_changed() must be used to verify the record has not
+ * been modified by the responder in the meantime, in which case the data
+ * must be thrown away and the lookup retried.
+ */
 errno_t sss_nss_mc_get_record(struct sss_cli_mc_ctx *ctx,
-                              uint32_t slot, struct sss_mc_rec **_rec)
+                              uint32_t slot, struct sss_mc_rec **_rec,
+                              uint32_t *_barrier)
 {
     struct sss_mc_rec *rec;
-    struct sss_mc_rec *copy_rec = NULL;
-    size_t buf_size = 0;
-    size_t rec_len;
     uint32_t b1;
     uint32_t b2;
-    bool copy_ok;
     int count;
-    int ret;
+
+    rec = MC_SLOT_TO_PTR(ctx->data_table, slot, struct sss_mc_rec);
 
     /* try max 5 times */
     for (count = 5; count > 0; count--) {
-        rec = MC_SLOT_TO_PTR(ctx->data_table, slot, struct sss_mc_rec);
-
-        /* fetch record length */
         b1 = rec->b1;
         __sync_synchronize();
-        rec_len = rec->len;
-        __sync_synchronize();
-        b2 = rec->b2;
-        if (!MC_VALID_BARRIER(b1) || b1 != b2) {
-            /* record is inconsistent, retry */
-            continue;
-        }
-
         if (!MC_CHECK_RECORD_LENGTH(ctx, rec)) {
-            /* record has invalid length */
-            free(copy_rec);
-            return EINVAL;
-        }
-
-        if (rec_len > buf_size) {
-            free(copy_rec);
-            copy_rec = malloc(rec_len);
-            if (!copy_rec) {
-                ret = ENOMEM;
-                goto done;
+            __sync_synchronize();
+            b2 = rec->b2;
+            if (MC_VALID_BARRIER(b1) && b1 == b2) {
+                /* record is consistent but has invalid length */
+                return EINVAL;
             }
-            buf_size = rec_len;
+            /* being modified, retry */
+            continue;
         }
-        /* we cannot access data directly, we must copy data and then
-         * access the copy */
-        MEMCPY_WITH_BARRIERS(copy_ok, copy_rec, rec, rec_len);
-
-        /* we must check data is consistent again after the copy */
-        if (copy_ok && b1 == copy_rec->b2) {
+        __sync_synchronize();
+        b2 = rec->b2;
+        if (MC_VALID_BARRIER(b1) && b1 == b2) {
             /* record is consistent, use it */
-            break;
+            *_rec = rec;
+            *_barrier = b1;
+            return 0;
         }
     }
-    if (count == 0) {
-        /* couldn't successfully read header we have to give up */
-        ret = EIO;
-        goto done;
-    }
 
-    *_rec = copy_rec;
-    ret = 0;
+    /* couldn't successfully read header we have to give up */
+    return EIO;
+}
 
-done:
-    if (ret) {
-        free(copy_rec);
-        *_rec = NULL;
-    }
-    return ret;
+bool sss_nss_mc_record_changed(struct sss_mc_rec *rec, uint32_t barrier)
+{
+    /* the responder raises b2 before it starts to modify a record */
+    __sync_synchronize();
+    return (rec->b2 != barrier);
+}
+
+bool sss_nss_mc_within_data_table(struct sss_cli_mc_ctx *ctx,
+                                  const void *ptr, size_t len)
+{
+    const uint8_t *p = ptr;
+
+    return (p >= ctx->data_table
+            && len <= ctx->dt_size
+            && p - ctx->data_table <= ctx->dt_size - len);
 }
 
 /*
@@ -29,10 +29,69 @@
 #include "nss_mc.h"
 #include "util/util_safealign.h"
 
-struct sss_cli_mc_ctx gr_mc_ctx = { UNINITIALIZED, -1, 0, NULL, 0, NULL, 0,
-                                    NULL, 0, 0 };
+struct sss_cli_mc_ctx gr_mc_ctx = { UNINITIALIZED, -1, 0, 0, NULL, 0,
+                                    NULL, 0, NULL, 0, 0 };
+
+/* Expand members stored as described at SSS_MC_GRP_COMPACT_MEMBERS,
+ * each member is decoded from the previous one already written to dst */
+static errno_t sss_nss_mc_expand_members(const char *src, size_t src_len,
+                                         uint32_t members,
+                                         char *dst, size_t dst_len,
+                                         size_t *_used)
+{
+    const char *prev = "";
+    size_t prev_len = 0;
+    size_t prefix;
+    size_t suffix;
+    size_t mid_len;
+    size_t spos = 0;
+    size_t dpos = 0;
+    size_t len;
+    uint32_t i;
+
+    for (i = 0; i < members; i++) {
+        if (src_len - spos < 3) {
+            return EINVAL;
+        }
+        prefix = (uint8_t)src[spos];
+        suffix = (uint8_t)src[spos + 1];
+        spos += 2;
+        if (prefix + suffix > prev_len) {
+            return EINVAL;
+        }
+
+        mid_len = strnlen(src + spos, src_len - spos);
+        if (mid_len == src_len - spos) {
+            return EINVAL;
+        }
+
+        len = prefix + mid_len + suffix;
+        if (len + 1 > dst_len - dpos) {
+            return ERANGE;
+        }
+
+        memcpy(dst + dpos, prev, prefix);
+        memcpy(dst + dpos + prefix, src + spos, mid_len);
+        memcpy(dst + dpos + prefix + mid_len,
+               prev + prev_len - suffix, suffix);
+        dst[dpos + len] = '\0';
+        spos += mid_len + 1;
+
+        prev = dst + dpos;
+        prev_len = len;
+        dpos += len + 1;
+    }
+
+    if (spos != src_len) {
+        return EINVAL;
+    }
+
+    *_used = dpos;
+    return 0;
+}
 
 static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
+                                       uint32_t barrier,
                                        struct group *result,
                                        char *buffer, size_t buflen)
 {
@@ -41,31 +100,82 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
     void *cookie;
     char *membuf;
     size_t memsize;
+    size_t hdr_len;
+    size_t used = 0;
+    uint32_t members;
+    uint32_t strs_len;
+    bool compact;
+    gid_t gid;
     int ret;
     int i;
 
-    /* additional checks before filling result*/
+    data = (struct sss_mc_grp_data *)rec->data;
+
+    /* the record is read in place, take a snapshot of what we need and
+     * validate it only after checking the record was not modified */
     expire = rec->expire;
-    if (expire < time(NULL)) {
-        /* entry is now invalid */
-        return EINVAL;
+    gid = data->gid;
+    members = data->members;
+    strs_len = data->strs_len;
+
+    compact = (members & SSS_MC_GRP_COMPACT_MEMBERS) != 0;
+    members &= ~SSS_MC_GRP_COMPACT_MEMBERS;
+
+    memsize = (members + 1) * sizeof(char *);
+    if (members > strs_len) {
+        ret = EINVAL;
+    } else if (!compact && strs_len + memsize > buflen) {
+        ret = ERANGE;
+    } else if (compact && memsize > buflen) {
+        ret = ERANGE;
+    } else if (!sss_nss_mc_within_data_table(&gr_mc_ctx,
+                                             data->strs, strs_len)) {
+        ret = EINVAL;
+    } else if (!compact) {
+        /* copy in buffer */
+        membuf = buffer + memsize;
+        memcpy(membuf, data->strs, strs_len);
+        ret = 0;
+    } else {
+        /* copy the name and passwd, then expand the members after them */
+        membuf = buffer + memsize;
+        hdr_len = strnlen(data->strs, strs_len) + 1;
+        if (hdr_len < strs_len) {
+            hdr_len += strnlen(data->strs + hdr_len, strs_len - hdr_len) + 1;
+        }
+        if (hdr_len > strs_len) {
+            ret = EINVAL;
+        } else if (hdr_len > buflen - memsize) {
+            ret = ERANGE;
+        } else {
+            memcpy(membuf, data->strs, hdr_len);
+            ret = sss_nss_mc_expand_members(data->strs + hdr_len,
+                                            strs_len - hdr_len, members,
+                                            membuf + hdr_len,
+                                            buflen - memsize - hdr_len,
+                                            &used);
+            /* from now on strs_len is the length of the expanded strings */
+            strs_len = hdr_len + used;
+        }
     }
 
-    data = (struct sss_mc_grp_data *)rec->data;
+    if (sss_nss_mc_record_changed(rec, barrier)) {
+        return EAGAIN;
+    }
+    if (ret) {
+        return ret;
+    }
 
-    memsize = (data->members + 1) * sizeof(char *);
-    if (data->strs_len + memsize > buflen) {
-        return ERANGE;
+    /* additional checks before filling result*/
+    if (expire < time(NULL)) {
+        /* entry is now invalid */
+        return EINVAL;
     }
 
     /* fill in glibc provided structs */
 
-    /* copy in buffer */
-    membuf = buffer + memsize;
-    memcpy(membuf, data->strs, data->strs_len);
-
     /* fill in group */
-    result->gr_gid = data->gid;
+    result->gr_gid = gid;
 
     /* The address &buffer[0] must be aligned to sizeof(char *) */
     if (!IS_ALIGNED(buffer, char *)) {
@@ -74,23 +184,23 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
     }
 
     result->gr_mem = DISCARD_ALIGN(buffer, char **);
-    result->gr_mem[data->members] = NULL;
+    result->gr_mem[members] = NULL;
 
     cookie = NULL;
     ret = sss_nss_str_ptr_from_buffer(&result->gr_name, &cookie,
-                                      membuf, data->strs_len);
+                                      membuf, strs_len);
     if (ret) {
         return ret;
     }
     ret = sss_nss_str_ptr_from_buffer(&result->gr_passwd, &cookie,
-                                      membuf, data->strs_len);
+                                      membuf, strs_len);
     if (ret) {
         return ret;
     }
 
-    for (i = 0; i < data->members; i++) {
+    for (i = 0; i < members; i++) {
         ret = sss_nss_str_ptr_from_buffer(&result->gr_mem[i], &cookie,
-                                          membuf, data->strs_len);
+                                          membuf, strs_len);
         if (ret) {
             return ret;
         }
@@ -109,8 +219,13 @@ errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
     struct sss_mc_rec *rec = NULL;
     struct sss_mc_grp_data *data;
     char *rec_name;
+    uint32_t barrier;
     uint32_t hash;
     uint32_t slot;
+    uint32_t name_ptr;
+    uint32_t strs_len;
+    uint32_t rec_len;
+    int retries = SSS_NSS_MC_READ_RETRIES;
     int ret;
     const size_t strs_offset = offsetof(struct sss_mc_grp_data, strs);
     size_t data_size;
@@ -125,17 +240,15 @@ errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&gr_mc_ctx, name, name_len + 1);
+
+again:
     slot = gr_mc_ctx.hash_table[hash];
 
     /* If slot is not within the bounds of mmaped region and
      * it's value is not MC_INVALID_VAL, then the cache is
      * probbably corrupted. */
     while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
-
-        ret = sss_nss_mc_get_record(&gr_mc_ctx, slot, &rec);
+        ret = sss_nss_mc_get_record(&gr_mc_ctx, slot, &rec, &barrier);
         if (ret) {
             goto done;
         }
@@ -144,29 +257,44 @@ errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
         if (hash != rec->hash1) {
             /* if name hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
             continue;
         }
 
         data = (struct sss_mc_grp_data *)rec->data;
+        name_ptr = data->name;
+        strs_len = data->strs_len;
+        rec_len = rec->len;
         /* Integrity check
          * - name_len cannot be longer than all strings
          * - data->name cannot point outside strings
-         * - all strings must be within copy of record
+         * - all strings must be within the record
          * - size of record must be lower that data table size */
-        if (name_len > data->strs_len
-            || (data->name + name_len) > (strs_offset + data->strs_len)
-            || data->strs_len > rec->len
-            || rec->len > data_size) {
+        if (name_len > strs_len
+            || (name_ptr + name_len) > (strs_offset + strs_len)
+            || strs_len > rec_len
+            || rec_len > data_size
+            || !sss_nss_mc_within_data_table(&gr_mc_ctx,
+                                             (char *)data + name_ptr,
+                                             name_len + 1)) {
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
             ret = ENOENT;
             goto done;
         }
 
-        rec_name = (char *)data + data->name;
-        if (strcmp(name, rec_name) == 0) {
+        rec_name = (char *)data + name_ptr;
+        if (strncmp(name, rec_name, name_len + 1) == 0) {
             break;
         }
 
         slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
@@ -174,12 +302,21 @@ errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
         goto done;
     }
 
-    ret = sss_nss_mc_parse_result(rec, result, buffer, buflen);
+    ret = sss_nss_mc_parse_result(rec, barrier, result, buffer, buflen);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
 
 done:
-    free(rec);
     __sync_sub_and_fetch(&gr_mc_ctx.active_threads, 1);
     return ret;
+
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
 }
 
 errno_t sss_nss_mc_getgrgid(gid_t gid,
@@ -189,8 +326,10 @@ errno_t sss_nss_mc_getgrgid(gid_t gid,
     struct sss_mc_rec *rec = NULL;
     struct sss_mc_grp_data *data;
     char gidstr[11];
+    uint32_t barrier;
     uint32_t hash;
     uint32_t slot;
+    int retries = SSS_NSS_MC_READ_RETRIES;
     int len;
     int ret;
 
@@ -207,17 +346,15 @@ errno_t sss_nss_mc_getgrgid(gid_t gid,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&gr_mc_ctx, gidstr, len+1);
+
+again:
     slot = gr_mc_ctx.hash_table[hash];
 
     /* If slot is not within the bounds of mmaped region and
      * it's value is not MC_INVALID_VAL, then the cache is
      * probbably corrupted. */
     while (MC_SLOT_WITHIN_BOUNDS(slot, gr_mc_ctx.dt_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
-
-        ret = sss_nss_mc_get_record(&gr_mc_ctx, slot, &rec);
+        ret = sss_nss_mc_get_record(&gr_mc_ctx, slot, &rec, &barrier);
         if (ret) {
             goto done;
         }
@@ -226,6 +363,9 @@ errno_t sss_nss_mc_getgrgid(gid_t gid,
         if (hash != rec->hash2) {
             /* if uid hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
             continue;
         }
 
@@ -235,6 +375,9 @@ errno_t sss_nss_mc_getgrgid(gid_t gid,
         }
 
         slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, gr_mc_ctx.dt_size)) {
@@ -242,11 +385,19 @@ errno_t sss_nss_mc_getgrgid(gid_t gid,
         goto done;
     }
 
-    ret = sss_nss_mc_parse_result(rec, result, buffer, buflen);
+    ret = sss_nss_mc_parse_result(rec, barrier, result, buffer, buflen);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
 
 done:
-    free(rec);
     __sync_sub_and_fetch(&gr_mc_ctx.active_threads, 1);
     return ret;
-}
 
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
+}
@@ -32,10 +32,11 @@
 #include "nss_mc.h"
 #include "util/util_safealign.h"
 
-struct sss_cli_mc_ctx initgr_mc_ctx = { UNINITIALIZED, -1, 0, NULL, 0, NULL, 0,
-                                        NULL, 0, 0 };
+struct sss_cli_mc_ctx initgr_mc_ctx = { UNINITIALIZED, -1, 0, 0, NULL, 0,
+                                        NULL, 0, NULL, 0, 0 };
 
 static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
+                                       uint32_t barrier,
                                        long int *start, long int *size,
                                        gid_t **groups, long int limit)
 {
@@ -45,17 +46,22 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
     uint32_t num_groups;
     long int max_ret;
 
-    /* additional checks before filling result*/
-    expire = rec->expire;
-    if (expire < time(NULL)) {
-        /* entry is now invalid */
-        return EINVAL;
-    }
-
     data = (struct sss_mc_initgr_data *)rec->data;
+
+    /* the record is read in place, take a snapshot of what we need and
+     * validate it only after checking the record was not modified */
+    expire = rec->expire;
     num_groups = data->num_groups;
     max_ret = num_groups;
 
+    if (!sss_nss_mc_within_data_table(&initgr_mc_ctx, data->gids,
+                                      num_groups * sizeof(uint32_t))) {
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            return EAGAIN;
+        }
+        return EINVAL;
+    }
+
     /* check we have enough space in the buffer */
     if ((*size - *start) < num_groups) {
         long int newsize;
@@ -75,11 +81,23 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
         *size = newsize;
     }
 
+    /* *start is only moved once we know the gids were consistent */
     for (i = 0; i < max_ret; i++) {
-        SAFEALIGN_COPY_UINT32(&(*groups)[*start], data->gids + i, NULL);
-        *start += 1;
+        SAFEALIGN_COPY_UINT32(&(*groups)[*start + i], data->gids + i, NULL);
+    }
+
+    if (sss_nss_mc_record_changed(rec, barrier)) {
+        return EAGAIN;
+    }
+
+    /* additional checks before filling result*/
+    if (expire < time(NULL)) {
+        /* entry is now invalid */
+        return EINVAL;
     }
 
+    *start += max_ret;
+
     return 0;
 }
 
@@ -90,8 +108,15 @@ errno_t sss_nss_mc_initgroups_dyn(const char *name, size_t name_len,
     struct sss_mc_rec *rec = NULL;
     struct sss_mc_initgr_data *data;
     char *rec_name;
+    uint32_t barrier;
     uint32_t hash;
     uint32_t slot;
+    uint32_t name_ptr;
+    uint32_t strs_ptr;
+    uint32_t strs_len;
+    uint32_t data_len;
+    uint32_t rec_len;
+    int retries = SSS_NSS_MC_READ_RETRIES;
     int ret;
     const size_t data_offset = offsetof(struct sss_mc_initgr_data, gids);
     size_t data_size;
@@ -106,17 +131,15 @@ errno_t sss_nss_mc_initgroups_dyn(const char *name, size_t name_len,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&initgr_mc_ctx, name, name_len + 1);
+
+again:
     slot = initgr_mc_ctx.hash_table[hash];
 
     /* If slot is not within the bounds of mmaped region and
      * it's value is not MC_INVALID_VAL, then the cache is
      * probbably corrupted. */
     while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
-
-        ret = sss_nss_mc_get_record(&initgr_mc_ctx, slot, &rec);
+        ret = sss_nss_mc_get_record(&initgr_mc_ctx, slot, &rec, &barrier);
         if (ret) {
             goto done;
         }
@@ -125,30 +148,47 @@ errno_t sss_nss_mc_initgroups_dyn(const char *name, size_t name_len,
         if (hash != rec->hash1) {
             /* if name hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
             continue;
         }
 
         data = (struct sss_mc_initgr_data *)rec->data;
-        rec_name = (char *)data + data->name;
+        name_ptr = data->name;
+        strs_ptr = data->strs;
+        strs_len = data->strs_len;
+        data_len = data->data_len;
+        rec_len = rec->len;
         /* Integrity check
          * - name_len cannot be longer than all strings or data
-         * - all data must be within copy of record
+         * - all data must be within the record
          * - size of record must be lower that data table size
          * - data->strs cannot point outside strings */
-        if (name_len > data->strs_len
-            || data->strs_len > data->data_len
-            || data->data_len > rec->len
-            || rec->len > data_size
-            || (data->strs + name_len) > (data_offset + data->data_len)) {
+        if (name_len > strs_len
+            || strs_len > data_len
+            || data_len > rec_len
+            || rec_len > data_size
+            || (strs_ptr + name_len) > (data_offset + data_len)
+            || !sss_nss_mc_within_data_table(&initgr_mc_ctx,
+                                             (char *)data + name_ptr,
+                                             name_len + 1)) {
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
             ret = ENOENT;
             goto done;
         }
 
-        if (strcmp(name, rec_name) == 0) {
+        rec_name = (char *)data + name_ptr;
+        if (strncmp(name, rec_name, name_len + 1) == 0) {
             break;
         }
 
         slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
@@ -156,10 +196,19 @@ errno_t sss_nss_mc_initgroups_dyn(const char *name, size_t name_len,
         goto done;
     }
 
-    ret = sss_nss_mc_parse_result(rec, start, size, groups, limit);
+    ret = sss_nss_mc_parse_result(rec, barrier, start, size, groups, limit);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
 
 done:
-    free(rec);
     __sync_sub_and_fetch(&initgr_mc_ctx.active_threads, 1);
     return ret;
+
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
 }
@@ -0,0 +1,214 @@
+/*
+ * System Security Services Daemon. NSS client interface
+ *
+ * Copyright (C) 2016 Red Hat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* NETGROUP database NSS interface using mmap cache */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "nss_mc.h"
+#include "util/util_safealign.h"
+
+struct sss_cli_mc_ctx netgr_mc_ctx = { UNINITIALIZED, -1, 0, 0, NULL, 0,
+                                       NULL, 0, NULL, 0, 0 };
+
+static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
+                                       uint32_t barrier,
+                                       const size_t name_len,
+                                       uint8_t **_buf, size_t *_buf_len)
+{
+    struct sss_mc_netgr_data *data;
+    time_t expire;
+    uint32_t num_entries;
+    uint32_t strs_len;
+    size_t entries_len;
+    uint8_t *buf = NULL;
+    size_t buf_len;
+    int ret;
+
+    data = (struct sss_mc_netgr_data *)rec->data;
+
+    /* the record is read in place, take a snapshot of what we need and
+     * validate it only after checking the record was not modified */
+    expire = rec->expire;
+    num_entries = data->num_entries;
+    strs_len = data->strs_len;
+
+    if (strs_len < name_len + 1
+            || !sss_nss_mc_within_data_table(&netgr_mc_ctx,
+                                             data->strs, strs_len)) {
+        ret = EINVAL;
+    } else {
+        /* entries follow the name */
+        entries_len = strs_len - (name_len + 1);
+        buf_len = SSS_NSS_MC_NETGR_HDR_LEN + entries_len;
+        buf = malloc(buf_len);
+        if (buf == NULL) {
+            ret = ENOMEM;
+        } else {
+            memcpy(buf + SSS_NSS_MC_NETGR_HDR_LEN,
+                   data->strs + name_len + 1, entries_len);
+            ret = 0;
+        }
+    }
+
+    if (sss_nss_mc_record_changed(rec, barrier)) {
+        ret = EAGAIN;
+        goto done;
+    }
+    if (ret) {
+        goto done;
+    }
+
+    /* additional checks before filling result*/
+    if (expire < time(NULL)) {
+        /* entry is now invalid */
+        ret = EINVAL;
+        goto done;
+    }
+
+    if (num_entries == 0) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    /* same header as a SSS_NSS_GETNETGRENT reply */
+    SAFEALIGN_SETMEM_UINT32(buf, num_entries, NULL);
+    SAFEALIGN_SETMEM_UINT32(buf + sizeof(uint32_t), 0, NULL);
+
+    *_buf = buf;
+    *_buf_len = buf_len;
+    ret = 0;
+
+done:
+    if (ret) {
+        free(buf);
+    }
+    return ret;
+}
+
+errno_t sss_nss_mc_getnetgr(const char *name, size_t name_len,
+                            uint8_t **_buf, size_t *_buf_len)
+{
+    struct sss_mc_rec *rec = NULL;
+    struct sss_mc_netgr_data *data;
+    char *rec_name;
+    uint32_t barrier;
+    uint32_t hash;
+    uint32_t slot;
+    uint32_t name_ptr;
+    uint32_t strs_len;
+    uint32_t rec_len;
+    int retries = SSS_NSS_MC_READ_RETRIES;
+    int ret;
+    const size_t strs_offset = offsetof(struct sss_mc_netgr_data, strs);
+    size_t data_size;
+
+    ret = sss_nss_mc_get_ctx("netgroup", &netgr_mc_ctx);
+    if (ret) {
+        return ret;
+    }
+
+    /* Get max size of data table. */
+    data_size = netgr_mc_ctx.dt_size;
+
+    /* hashes are calculated including the NULL terminator */
+    hash = sss_nss_mc_hash(&netgr_mc_ctx, name, name_len + 1);
+
+again:
+    slot = netgr_mc_ctx.hash_table[hash];
+
+    /* If slot is not within the bounds of mmaped region and
+     * it's value is not MC_INVALID_VAL, then the cache is
+     * probbably corrupted. */
+    while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = sss_nss_mc_get_record(&netgr_mc_ctx, slot, &rec, &barrier);
+        if (ret) {
+            goto done;
+        }
+
+        /* check record matches what we are searching for */
+        if (hash != rec->hash1) {
+            /* if name hash does not match we can skip this immediately */
+            slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            continue;
+        }
+
+        data = (struct sss_mc_netgr_data *)rec->data;
+        name_ptr = data->name;
+        strs_len = data->strs_len;
+        rec_len = rec->len;
+        /* Integrity check
+         * - name_len cannot be longer than all strings
+         * - data->name cannot point outside strings
+         * - all strings must be within the record
+         * - size of record must be lower that data table size */
+        if (name_len > strs_len
+            || (name_ptr + name_len) > (strs_offset + strs_len)
+            || strs_len > rec_len
+            || rec_len > data_size
+            || !sss_nss_mc_within_data_table(&netgr_mc_ctx,
+                                             (char *)data + name_ptr,
+                                             name_len + 1)) {
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            ret = ENOENT;
+            goto done;
+        }
+
+        rec_name = (char *)data + name_ptr;
+        if (strncmp(name, rec_name, name_len + 1) == 0) {
+            break;
+        }
+
+        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
+    }
+
+    if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    ret = sss_nss_mc_parse_result(rec, barrier, name_len, _buf, _buf_len);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
+
+done:
+    __sync_sub_and_fetch(&netgr_mc_ctx.active_threads, 1);
+    return ret;
+
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
+}
@@ -22,69 +22,91 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <sys/mman.h>
 #include <time.h>
 #include "nss_mc.h"
 
-struct sss_cli_mc_ctx pw_mc_ctx = { UNINITIALIZED, -1, 0, NULL, 0, NULL, 0,
-                                    NULL, 0, 0 };
+struct sss_cli_mc_ctx pw_mc_ctx = { UNINITIALIZED, -1, 0, 0, NULL, 0,
+                                    NULL, 0, NULL, 0, 0 };
 
 static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
+                                       uint32_t barrier,
                                        struct passwd *result,
                                        char *buffer, size_t buflen)
 {
     struct sss_mc_pwd_data *data;
     time_t expire;
+    uint32_t strs_len;
+    uid_t uid;
+    gid_t gid;
     void *cookie;
     int ret;
 
-    /* additional checks before filling result*/
+    data = (struct sss_mc_pwd_data *)rec->data;
+
+    /* the record is read in place, take a snapshot of what we need and
+     * validate it only after checking the record was not modified */
     expire = rec->expire;
-    if (expire < time(NULL)) {
-        /* entry is now invalid */
-        return EINVAL;
+    uid = data->uid;
+    gid = data->gid;
+    strs_len = data->strs_len;
+
+    if (strs_len > buflen) {
+        ret = ERANGE;
+    } else if (!sss_nss_mc_within_data_table(&pw_mc_ctx,
+                                             data->strs, strs_len)) {
+        ret = EINVAL;
+    } else {
+        /* copy in buffer */
+        memcpy(buffer, data->strs, strs_len);
+        ret = 0;
     }
 
-    data = (struct sss_mc_pwd_data *)rec->data;
+    if (sss_nss_mc_record_changed(rec, barrier)) {
+        return EAGAIN;
+    }
+    if (ret) {
+        return ret;
+    }
 
-    if (data->strs_len > buflen) {
-        return ERANGE;
+    /* additional checks before filling result*/
+    if (expire < time(NULL)) {
+        /* entry is now invalid */
+        return EINVAL;
     }
 
     /* fill in glibc provided structs */
 
-    /* copy in buffer */
-    memcpy(buffer, data->strs, data->strs_len);
-
     /* fill in passwd */
-    result->pw_uid = data->uid;
-    result->pw_gid = data->gid;
+    result->pw_uid = uid;
+    result->pw_gid = gid;
 
     cookie = NULL;
     ret = sss_nss_str_ptr_from_buffer(&result->pw_name, &cookie,
-                                      buffer, data->strs_len);
+                                      buffer, strs_len);
     if (ret) {
         return ret;
     }
     ret = sss_nss_str_ptr_from_buffer(&result->pw_passwd, &cookie,
-                                      buffer, data->strs_len);
+                                      buffer, strs_len);
     if (ret) {
         return ret;
     }
     ret = sss_nss_str_ptr_from_buffer(&result->pw_gecos, &cookie,
-                                      buffer, data->strs_len);
+                                      buffer, strs_len);
     if (ret) {
         return ret;
     }
     ret = sss_nss_str_ptr_from_buffer(&result->pw_dir, &cookie,
-                                      buffer, data->strs_len);
+                                      buffer, strs_len);
     if (ret) {
         return ret;
     }
     ret = sss_nss_str_ptr_from_buffer(&result->pw_shell, &cookie,
-                                      buffer, data->strs_len);
+                                      buffer, strs_len);
     if (ret) {
         return ret;
     }
@@ -102,8 +124,13 @@ errno_t sss_nss_mc_getpwnam(const char *name, size_t name_len,
     struct sss_mc_rec *rec = NULL;
     struct sss_mc_pwd_data *data;
     char *rec_name;
+    uint32_t barrier;
     uint32_t hash;
     uint32_t slot;
+    uint32_t name_ptr;
+    uint32_t strs_len;
+    uint32_t rec_len;
+    int retries = SSS_NSS_MC_READ_RETRIES;
     int ret;
     const size_t strs_offset = offsetof(struct sss_mc_pwd_data, strs);
     size_t data_size;
@@ -118,17 +145,15 @@ errno_t sss_nss_mc_getpwnam(const char *name, size_t name_len,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&pw_mc_ctx, name, name_len + 1);
+
+again:
     slot = pw_mc_ctx.hash_table[hash];
 
     /* If slot is not within the bounds of mmaped region and
      * it's value is not MC_INVALID_VAL, then the cache is
      * probbably corrupted. */
     while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
-
-        ret = sss_nss_mc_get_record(&pw_mc_ctx, slot, &rec);
+        ret = sss_nss_mc_get_record(&pw_mc_ctx, slot, &rec, &barrier);
         if (ret) {
             goto done;
         }
@@ -137,29 +162,48 @@ errno_t sss_nss_mc_getpwnam(const char *name, size_t name_len,
         if (hash != rec->hash1) {
             /* if name hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
             continue;
         }
 
         data = (struct sss_mc_pwd_data *)rec->data;
+        name_ptr = data->name;
+        strs_len = data->strs_len;
+        rec_len = rec->len;
         /* Integrity check
          * - name_len cannot be longer than all strings
          * - data->name cannot point outside strings
-         * - all strings must be within copy of record
+         * - all strings must be within the record
          * - size of record must be lower that data table size */
-        if (name_len > data->strs_len
-            || (data->name + name_len) > (strs_offset + data->strs_len)
-            || data->strs_len > rec->len
-            || rec->len > data_size) {
+        if (name_len > strs_len
+            || (name_ptr + name_len) > (strs_offset + strs_len)
+            || strs_len > rec_len
+            || rec_len > data_size
+            || !sss_nss_mc_within_data_table(&pw_mc_ctx,
+                                             (char *)data + name_ptr,
+                                             name_len + 1)) {
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
             ret = ENOENT;
             goto done;
         }
 
-        rec_name = (char *)data + data->name;
-        if (strcmp(name, rec_name) == 0) {
+        rec_name = (char *)data + name_ptr;
+        if (rec->flags & SSS_MC_REC_FOLD_CASE) {
+            if (strncasecmp(name, rec_name, name_len + 1) == 0) {
+                break;
+            }
+        } else if (strncmp(name, rec_name, name_len + 1) == 0) {
             break;
         }
 
         slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
@@ -167,12 +211,21 @@ errno_t sss_nss_mc_getpwnam(const char *name, size_t name_len,
         goto done;
     }
 
-    ret = sss_nss_mc_parse_result(rec, result, buffer, buflen);
+    ret = sss_nss_mc_parse_result(rec, barrier, result, buffer, buflen);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
 
 done:
-    free(rec);
     __sync_sub_and_fetch(&pw_mc_ctx.active_threads, 1);
     return ret;
+
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
 }
 
 errno_t sss_nss_mc_getpwuid(uid_t uid,
@@ -182,8 +235,10 @@ errno_t sss_nss_mc_getpwuid(uid_t uid,
     struct sss_mc_rec *rec = NULL;
     struct sss_mc_pwd_data *data;
     char uidstr[11];
+    uint32_t barrier;
     uint32_t hash;
     uint32_t slot;
+    int retries = SSS_NSS_MC_READ_RETRIES;
     int len;
     int ret;
 
@@ -200,17 +255,15 @@ errno_t sss_nss_mc_getpwuid(uid_t uid,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&pw_mc_ctx, uidstr, len+1);
+
+again:
     slot = pw_mc_ctx.hash_table[hash];
 
     /* If slot is not within the bounds of mmaped region and
      * it's value is not MC_INVALID_VAL, then the cache is
      * probbably corrupted. */
     while (MC_SLOT_WITHIN_BOUNDS(slot, pw_mc_ctx.dt_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
-
-        ret = sss_nss_mc_get_record(&pw_mc_ctx, slot, &rec);
+        ret = sss_nss_mc_get_record(&pw_mc_ctx, slot, &rec, &barrier);
         if (ret) {
             goto done;
         }
@@ -219,6 +272,9 @@ errno_t sss_nss_mc_getpwuid(uid_t uid,
         if (hash != rec->hash2) {
             /* if uid hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
             continue;
         }
 
@@ -228,6 +284,9 @@ errno_t sss_nss_mc_getpwuid(uid_t uid,
         }
 
         slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, pw_mc_ctx.dt_size)) {
@@ -235,11 +294,19 @@ errno_t sss_nss_mc_getpwuid(uid_t uid,
         goto done;
     }
 
-    ret = sss_nss_mc_parse_result(rec, result, buffer, buflen);
+    ret = sss_nss_mc_parse_result(rec, barrier, result, buffer, buflen);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
 
 done:
-    free(rec);
     __sync_sub_and_fetch(&pw_mc_ctx.active_threads, 1);
     return ret;
-}
 
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
+}
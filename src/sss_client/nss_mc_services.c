@@ -0,0 +1,313 @@
+/*
+ * System Security Services Daemon. NSS client interface
+ *
+ * Copyright (C) 2016 Red Hat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* SERVICES database NSS interface using mmap cache */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include "sss_cli.h"
+#include "nss_mc.h"
+#include "util/util_safealign.h"
+
+/* "#65535/" plus the protocol and the terminator */
+#define SVC_PORT_KEY_LEN (7 + SSS_NAME_MAX + 1)
+
+struct sss_cli_mc_ctx svc_mc_ctx = { UNINITIALIZED, -1, 0, 0, NULL, 0,
+                                     NULL, 0, NULL, 0, 0 };
+
+static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
+                                       uint32_t barrier,
+                                       struct servent *result,
+                                       char *buffer, size_t buflen)
+{
+    struct sss_mc_svc_data *data;
+    const size_t strs_offset = offsetof(struct sss_mc_svc_data, strs);
+    time_t expire;
+    void *cookie;
+    char *strbuf;
+    size_t aliassize;
+    uint32_t aliases;
+    uint32_t strs_len;
+    uint32_t name_ptr;
+    uint32_t port;
+    uint32_t len = 0;
+    int ret;
+    int i;
+
+    data = (struct sss_mc_svc_data *)rec->data;
+
+    /* the record is read in place, take a snapshot of what we need and
+     * validate it only after checking the record was not modified */
+    expire = rec->expire;
+    port = data->port;
+    aliases = data->aliases;
+    strs_len = data->strs_len;
+    name_ptr = data->name;
+
+    /* only the name, protocol and aliases are copied, the keys are
+     * stored in front of them */
+    if (name_ptr < strs_offset || name_ptr - strs_offset > strs_len
+            || aliases > strs_len) {
+        ret = EINVAL;
+    } else {
+        len = strs_len - (name_ptr - strs_offset);
+        aliassize = (aliases + 1) * sizeof(char *);
+        if (len + aliassize > buflen) {
+            ret = ERANGE;
+        } else if (!sss_nss_mc_within_data_table(&svc_mc_ctx,
+                                                 (char *)data + name_ptr,
+                                                 len)) {
+            ret = EINVAL;
+        } else {
+            /* copy in buffer */
+            strbuf = buffer + aliassize;
+            memcpy(strbuf, (char *)data + name_ptr, len);
+            ret = 0;
+        }
+    }
+
+    if (sss_nss_mc_record_changed(rec, barrier)) {
+        return EAGAIN;
+    }
+    if (ret) {
+        return ret;
+    }
+
+    /* additional checks before filling result*/
+    if (expire < time(NULL)) {
+        /* entry is now invalid */
+        return EINVAL;
+    }
+
+    /* fill in glibc provided structs */
+
+    /* fill in servent */
+    result->s_port = (uint16_t)port;
+
+    /* The address &buffer[0] must be aligned to sizeof(char *) */
+    if (!IS_ALIGNED(buffer, char *)) {
+        /* The buffer is not properly aligned. */
+        return EFAULT;
+    }
+
+    result->s_aliases = DISCARD_ALIGN(buffer, char **);
+    result->s_aliases[aliases] = NULL;
+
+    cookie = NULL;
+    ret = sss_nss_str_ptr_from_buffer(&result->s_name, &cookie,
+                                      strbuf, len);
+    if (ret) {
+        return ret;
+    }
+    ret = sss_nss_str_ptr_from_buffer(&result->s_proto, &cookie,
+                                      strbuf, len);
+    if (ret) {
+        return ret;
+    }
+
+    for (i = 0; i < aliases; i++) {
+        ret = sss_nss_str_ptr_from_buffer(&result->s_aliases[i], &cookie,
+                                          strbuf, len);
+        if (ret) {
+            return ret;
+        }
+    }
+    if (cookie != NULL) {
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static bool sss_nss_mc_svc_key_matches(struct sss_mc_svc_data *data,
+                                       rel_ptr_t key_ptr,
+                                       uint32_t strs_len,
+                                       const char *key, size_t key_len)
+{
+    const size_t strs_offset = offsetof(struct sss_mc_svc_data, strs);
+
+    /* the key must be within the strings of the record */
+    if (key_ptr < strs_offset
+            || key_len >= strs_len
+            || (key_ptr + key_len + 1) > (strs_offset + strs_len)
+            || !sss_nss_mc_within_data_table(&svc_mc_ctx,
+                                             (char *)data + key_ptr,
+                                             key_len + 1)) {
+        return false;
+    }
+
+    return strncmp(key, (char *)data + key_ptr, key_len + 1) == 0;
+}
+
+static errno_t sss_nss_mc_getserv(const char *key, size_t key_len,
+                                  struct servent *result,
+                                  char *buffer, size_t buflen)
+{
+    struct sss_mc_rec *rec = NULL;
+    struct sss_mc_svc_data *data;
+    uint32_t barrier;
+    uint32_t hash;
+    uint32_t slot;
+    uint32_t strs_len;
+    uint32_t rec_len;
+    int retries = SSS_NSS_MC_READ_RETRIES;
+    int ret;
+    size_t data_size;
+
+    ret = sss_nss_mc_get_ctx("services", &svc_mc_ctx);
+    if (ret) {
+        return ret;
+    }
+
+    /* Get max size of data table. */
+    data_size = svc_mc_ctx.dt_size;
+
+    /* hashes are calculated including the NULL terminator */
+    hash = sss_nss_mc_hash(&svc_mc_ctx, key, key_len + 1);
+
+again:
+    slot = svc_mc_ctx.hash_table[hash];
+
+    /* If slot is not within the bounds of mmaped region and
+     * it's value is not MC_INVALID_VAL, then the cache is
+     * probbably corrupted. */
+    while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = sss_nss_mc_get_record(&svc_mc_ctx, slot, &rec, &barrier);
+        if (ret) {
+            goto done;
+        }
+
+        /* a record can be found by either of its keys */
+        if (hash != rec->hash1 && hash != rec->hash2) {
+            slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            continue;
+        }
+
+        data = (struct sss_mc_svc_data *)rec->data;
+        strs_len = data->strs_len;
+        rec_len = rec->len;
+        /* Integrity check
+         * - all strings must be within the record
+         * - size of record must be lower that data table size */
+        if (strs_len > rec_len || rec_len > data_size) {
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            ret = ENOENT;
+            goto done;
+        }
+
+        if (sss_nss_mc_svc_key_matches(data, data->key, strs_len,
+                                       key, key_len)
+                || sss_nss_mc_svc_key_matches(data, data->alt_key, strs_len,
+                                              key, key_len)) {
+            break;
+        }
+
+        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
+    }
+
+    if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    ret = sss_nss_mc_parse_result(rec, barrier, result, buffer, buflen);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
+
+done:
+    __sync_sub_and_fetch(&svc_mc_ctx.active_threads, 1);
+    return ret;
+
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
+}
+
+errno_t sss_nss_mc_getservbyname(const char *name, size_t name_len,
+                                 const char *protocol, size_t proto_len,
+                                 struct servent *result,
+                                 char *buffer, size_t buflen)
+{
+    char *key;
+    size_t key_len;
+    int ret;
+
+    /* such names are never stored, see struct sss_mc_svc_data */
+    if (name[0] == SSS_MC_SVC_PORT_KEY_PREFIX
+            || memchr(name, '/', name_len) != NULL
+            || (protocol != NULL && memchr(protocol, '/', proto_len) != NULL)) {
+        return ENOENT;
+    }
+
+    key_len = name_len + 1 + proto_len;
+    key = malloc(key_len + 1);
+    if (key == NULL) {
+        return ENOMEM;
+    }
+
+    memcpy(key, name, name_len);
+    key[name_len] = '/';
+    if (protocol != NULL) {
+        memcpy(key + name_len + 1, protocol, proto_len);
+    }
+    key[key_len] = '\0';
+
+    ret = sss_nss_mc_getserv(key, key_len, result, buffer, buflen);
+    free(key);
+    return ret;
+}
+
+errno_t sss_nss_mc_getservbyport(int port, const char *protocol,
+                                 struct servent *result,
+                                 char *buffer, size_t buflen)
+{
+    char key[SVC_PORT_KEY_LEN];
+    int len;
+
+    if (protocol != NULL && strchr(protocol, '/') != NULL) {
+        return ENOENT;
+    }
+
+    len = snprintf(key, sizeof(key), "%c%u/%s", SSS_MC_SVC_PORT_KEY_PREFIX,
+                   (unsigned int)ntohs((uint16_t)port),
+                   protocol != NULL ? protocol : "");
+    if (len < 0 || (size_t)len >= sizeof(key)) {
+        return EINVAL;
+    }
+
+    return sss_nss_mc_getserv(key, len, result, buffer, buflen);
+}
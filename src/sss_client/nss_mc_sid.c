@@ -0,0 +1,294 @@
+/*
+ * System Security Services Daemon. NSS client interface
+ *
+ * Copyright (C) 2016 Red Hat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* SID-name-ID translations using mmap cache */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "nss_mc.h"
+
+struct sss_cli_mc_ctx sid_mc_ctx = { UNINITIALIZED, -1, 0, 0, NULL, 0,
+                                     NULL, 0, NULL, 0, 0 };
+
+enum sss_nss_mc_sid_key {
+    SSS_NSS_MC_SID_KEY,     /* SID string or decimal ID, first hash */
+    SSS_NSS_MC_SID_NAME,    /* fq name, second hash */
+};
+
+/* Copy a string out of the record, it is validated only later together
+ * with the barrier */
+static errno_t sss_nss_mc_sid_dup_str(struct sss_mc_sid_data *data,
+                                      rel_ptr_t ptr, uint32_t strs_len,
+                                      char **_str)
+{
+    const size_t strs_offset = offsetof(struct sss_mc_sid_data, strs);
+    const char *str;
+    size_t max_len;
+    size_t len;
+    char *copy;
+
+    if (ptr < strs_offset || ptr >= strs_offset + strs_len) {
+        return EINVAL;
+    }
+
+    str = (const char *)data + ptr;
+    max_len = strs_offset + strs_len - ptr;
+    len = strnlen(str, max_len);
+    if (len == max_len) {
+        return EINVAL;
+    }
+
+    copy = malloc(len + 1);
+    if (copy == NULL) {
+        return ENOMEM;
+    }
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    *_str = copy;
+    return 0;
+}
+
+static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
+                                       uint32_t barrier,
+                                       char **_sid, char **_name,
+                                       uint32_t *_id, uint32_t *_id_type)
+{
+    struct sss_mc_sid_data *data;
+    time_t expire;
+    uint32_t strs_len;
+    rel_ptr_t sid_ptr;
+    rel_ptr_t name_ptr;
+    uint32_t id;
+    uint32_t id_type;
+    char *sid = NULL;
+    char *name = NULL;
+    int ret;
+
+    data = (struct sss_mc_sid_data *)rec->data;
+
+    /* the record is read in place, take a snapshot of what we need and
+     * validate it only after checking the record was not modified */
+    expire = rec->expire;
+    strs_len = data->strs_len;
+    sid_ptr = data->sid;
+    name_ptr = data->name;
+    id = data->id;
+    id_type = data->id_type;
+
+    if (!sss_nss_mc_within_data_table(&sid_mc_ctx, data->strs, strs_len)) {
+        ret = EINVAL;
+    } else {
+        ret = 0;
+        if (_sid != NULL) {
+            ret = sss_nss_mc_sid_dup_str(data, sid_ptr, strs_len, &sid);
+        }
+        if (ret == 0 && _name != NULL) {
+            ret = sss_nss_mc_sid_dup_str(data, name_ptr, strs_len, &name);
+        }
+    }
+
+    if (sss_nss_mc_record_changed(rec, barrier)) {
+        ret = EAGAIN;
+        goto done;
+    }
+    if (ret) {
+        goto done;
+    }
+
+    /* additional checks before filling result*/
+    if (expire < time(NULL)) {
+        /* entry is now invalid */
+        ret = EINVAL;
+        goto done;
+    }
+
+    if (_sid != NULL) {
+        *_sid = sid;
+        sid = NULL;
+    }
+    if (_name != NULL) {
+        *_name = name;
+        name = NULL;
+    }
+    if (_id != NULL) {
+        *_id = id;
+    }
+    if (_id_type != NULL) {
+        *_id_type = id_type;
+    }
+    ret = 0;
+
+done:
+    free(sid);
+    free(name);
+    return ret;
+}
+
+static errno_t sss_nss_mc_sid_lookup(const char *key, size_t key_len,
+                                     enum sss_nss_mc_sid_key key_type,
+                                     char **_sid, char **_name,
+                                     uint32_t *_id, uint32_t *_id_type)
+{
+    struct sss_mc_rec *rec = NULL;
+    struct sss_mc_sid_data *data;
+    char *rec_key;
+    uint32_t barrier;
+    uint32_t hash;
+    uint32_t rec_hash;
+    uint32_t slot;
+    rel_ptr_t key_ptr;
+    rel_ptr_t sid_ptr;
+    uint32_t strs_len;
+    uint32_t rec_len;
+    int retries = SSS_NSS_MC_READ_RETRIES;
+    int ret;
+    const size_t strs_offset = offsetof(struct sss_mc_sid_data, strs);
+    size_t data_size;
+
+    ret = sss_nss_mc_get_ctx("sid", &sid_mc_ctx);
+    if (ret) {
+        return ret;
+    }
+
+    /* Get max size of data table. */
+    data_size = sid_mc_ctx.dt_size;
+
+    /* hashes are calculated including the NULL terminator */
+    hash = sss_nss_mc_hash(&sid_mc_ctx, key, key_len + 1);
+
+again:
+    slot = sid_mc_ctx.hash_table[hash];
+
+    /* If slot is not within the bounds of mmaped region and
+     * it's value is not MC_INVALID_VAL, then the cache is
+     * probbably corrupted. */
+    while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = sss_nss_mc_get_record(&sid_mc_ctx, slot, &rec, &barrier);
+        if (ret) {
+            goto done;
+        }
+
+        rec_hash = (key_type == SSS_NSS_MC_SID_KEY) ? rec->hash1 : rec->hash2;
+
+        /* check record matches what we are searching for */
+        if (hash != rec_hash) {
+            /* if key hash does not match we can skip this immediately */
+            slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            continue;
+        }
+
+        data = (struct sss_mc_sid_data *)rec->data;
+        key_ptr = (key_type == SSS_NSS_MC_SID_KEY) ? data->key : data->name;
+        sid_ptr = data->sid;
+        strs_len = data->strs_len;
+        rec_len = rec->len;
+        /* Integrity check
+         * - key_len cannot be longer than all strings
+         * - key cannot point outside strings
+         * - all strings must be within the record
+         * - size of record must be lower that data table size */
+        if (key_len > strs_len
+            || key_ptr < strs_offset
+            || (key_ptr + key_len) > (strs_offset + strs_len)
+            || strs_len > rec_len
+            || rec_len > data_size
+            || !sss_nss_mc_within_data_table(&sid_mc_ctx,
+                                             (char *)data + key_ptr,
+                                             key_len + 1)) {
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            ret = ENOENT;
+            goto done;
+        }
+
+        /* records stored for lookups by ID cannot answer lookups by name */
+        rec_key = (char *)data + key_ptr;
+        if ((key_type == SSS_NSS_MC_SID_KEY || data->key == sid_ptr)
+                && strncmp(key, rec_key, key_len + 1) == 0) {
+            break;
+        }
+
+        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
+    }
+
+    if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    ret = sss_nss_mc_parse_result(rec, barrier, _sid, _name, _id, _id_type);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
+
+done:
+    __sync_sub_and_fetch(&sid_mc_ctx.active_threads, 1);
+    return ret;
+
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
+}
+
+errno_t sss_nss_mc_getsidbyname(const char *name, size_t name_len,
+                                char **_sid, uint32_t *_id_type)
+{
+    return sss_nss_mc_sid_lookup(name, name_len, SSS_NSS_MC_SID_NAME,
+                                 _sid, NULL, NULL, _id_type);
+}
+
+errno_t sss_nss_mc_getbysid(const char *sid, size_t sid_len,
+                            char **_name, uint32_t *_id, uint32_t *_id_type)
+{
+    /* SIDs never start with a digit, so they cannot clash with the keys of
+     * the records stored for lookups by ID */
+    return sss_nss_mc_sid_lookup(sid, sid_len, SSS_NSS_MC_SID_KEY,
+                                 NULL, _name, _id, _id_type);
+}
+
+errno_t sss_nss_mc_getsidbyid(uint32_t id,
+                              char **_sid, uint32_t *_id_type)
+{
+    char idstr[11];
+    int len;
+
+    len = snprintf(idstr, 11, "%ld", (long)id);
+    if (len > 10) {
+        return EINVAL;
+    }
+
+    return sss_nss_mc_sid_lookup(idstr, len, SSS_NSS_MC_SID_KEY,
+                                 _sid, NULL, NULL, _id_type);
+}
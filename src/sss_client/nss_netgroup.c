@@ -32,6 +32,7 @@
 #include <string.h>
 #include "sss_cli.h"
 #include "nss_compat.h"
+#include "nss_mc.h"
 
 #define CLEAR_NETGRENT_DATA(netgrent) do { \
         free(netgrent->data); \
@@ -53,6 +54,25 @@
  *  ... repeated N times
  */
 #define NETGR_METADATA_COUNT 2 * sizeof(uint32_t)
+
+/* Value stored in the reserved field of result->data when all the entries
+ * were read from the memory cache. In that case the responder holds no
+ * state for this enumeration and must not be contacted on exhaustion or on
+ * endnetgrent. */
+#define NETGR_MC_DATA 0x4d43
+
+static bool sss_nss_netgr_from_mc(struct __netgrent *result)
+{
+    uint32_t reserved;
+
+    if (result->data == NULL || result->data_size < NETGR_METADATA_COUNT) {
+        return false;
+    }
+
+    SAFEALIGN_COPY_UINT32(&reserved,
+                          (uint8_t *)result->data + sizeof(uint32_t), NULL);
+    return reserved == NETGR_MC_DATA;
+}
 struct sss_nss_netgr_rep {
     struct __netgrent *result;
     char *buffer;
@@ -188,6 +208,20 @@ enum nss_status _nss_sss_setnetgrent(const char *netgroup,
     }
     strncpy(name, netgroup, name_len + 1);
 
+    ret = sss_nss_mc_getnetgr(name, name_len, &repbuf, &replen);
+    if (ret == 0) {
+        free(name);
+        SAFEALIGN_SETMEM_UINT32(repbuf + sizeof(uint32_t), NETGR_MC_DATA, NULL);
+        result->data = (char *) repbuf;
+        result->data_size = replen;
+        /* skip metadata fields */
+        result->idx.position = NETGR_METADATA_COUNT;
+        nret = NSS_STATUS_SUCCESS;
+        goto out;
+    }
+    /* otherwise fall through, we need to actively ask the parent
+     * if no entry is found */
+
     rd.data = name;
     rd.len = name_len + 1;
 
@@ -257,6 +291,12 @@ static enum nss_status internal_getnetgrent_r(struct __netgrent *result,
         return NSS_STATUS_SUCCESS;
     }
 
+    /* All the entries were already returned from the memory cache, there
+     * is nothing more to ask to the responder */
+    if (sss_nss_netgr_from_mc(result)) {
+        return NSS_STATUS_RETURN;
+    }
+
     /* Release memory, if any */
     CLEAR_NETGRENT_DATA(result);
 
@@ -306,18 +346,28 @@ enum nss_status _nss_sss_endnetgrent(struct __netgrent *result)
 {
     enum nss_status nret;
     int errnop;
+    bool from_mc;
 
     sss_nss_lock();
 
+    from_mc = sss_nss_netgr_from_mc(result);
+
     /* make sure we do not have leftovers, and release memory */
     CLEAR_NETGRENT_DATA(result);
 
+    if (from_mc) {
+        /* the responder was never involved in this enumeration */
+        nret = NSS_STATUS_SUCCESS;
+        goto out;
+    }
+
     nret = sss_nss_make_request(SSS_NSS_ENDNETGRENT,
                                 NULL, NULL, NULL, &errnop);
     if (nret != NSS_STATUS_SUCCESS) {
         errno = errnop;
     }
 
+out:
     sss_nss_unlock();
     return nret;
 }
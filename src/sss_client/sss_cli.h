@@ -255,6 +255,24 @@ SSS_NSS_GETORIGBYNAME = 0x0115, /**< Takes a zero terminated fully qualified
                                      second the value. Hence the list should
                                      have an even number of strings, if not
                                      the whole list is invalid. */
+
+/* batched NSS calls */
+SSS_NSS_GETBATCH = 0x0121, /**< Takes an unsigned 32bit number of lookups
+                                followed by the lookups themselves, each an
+                                unsigned 32bit command (SSS_NSS_GETPWNAM,
+                                SSS_NSS_GETPWUID, SSS_NSS_GETGRNAM,
+                                SSS_NSS_GETGRGID, SSS_NSS_GETNAMEBYSID or
+                                SSS_NSS_GETIDBYSID) followed by the zero
+                                terminated name or SID or the unsigned
+                                32bit ID.
+                                Returns the number of results, a reserved
+                                field and, in the order of the request, for
+                                each lookup the command, the unsigned 32bit
+                                errno-style status, the length of the entry
+                                data and the entry data. The entry data is
+                                what the single command would have returned
+                                after the number of results and the
+                                reserved field. */
 };
 
 /**
@@ -341,6 +359,7 @@ enum pam_item_type {
 };
 
 #define SSS_NSS_MAX_ENTRIES 256
+#define SSS_NSS_MAX_BATCH_ENTRIES 256
 #define SSS_NSS_HEADER_SIZE (sizeof(uint32_t) * 4)
 struct sss_cli_req_data {
     size_t len;
@@ -538,6 +557,32 @@ enum nss_status sss_nss_make_request(enum sss_cli_command cmd,
                                      uint8_t **repbuf, size_t *replen,
                                      int *errnop);
 
+/* A single lookup of a SSS_NSS_GETBATCH request */
+struct sss_cli_batch_req {
+    enum sss_cli_command cmd;   /* SSS_NSS_GETPWNAM, SSS_NSS_GETPWUID,
+                                 * SSS_NSS_GETGRNAM, SSS_NSS_GETGRGID,
+                                 * SSS_NSS_GETNAMEBYSID or
+                                 * SSS_NSS_GETIDBYSID */
+    const char *name;           /* name or SID for lookups by name or SID */
+    uint32_t id;                /* ID for lookups by ID */
+};
+
+/* Sends up to SSS_NSS_MAX_BATCH_ENTRIES lookups in a single request, must
+ * be called with the NSS lock held as sss_nss_make_request() */
+enum nss_status sss_nss_make_batch_request(const struct sss_cli_batch_req *reqs,
+                                           size_t num_reqs,
+                                           uint8_t **repbuf, size_t *replen,
+                                           int *errnop);
+
+/* Iterates over the results of a SSS_NSS_GETBATCH reply, *pos must be 0 on
+ * the first call. _data points into repbuf to the entry as it would be
+ * returned by the single command after the number of results and the
+ * reserved field. Returns ENOENT when there are no more results. */
+errno_t sss_nss_batch_next_result(uint8_t *repbuf, size_t replen,
+                                  size_t *pos, uint32_t *_cmd,
+                                  uint32_t *_status,
+                                  uint8_t **_data, size_t *_data_len);
+
 int sss_pam_make_request(enum sss_cli_command cmd,
                          struct sss_cli_req_data *rd,
                          uint8_t **repbuf, size_t *replen,
@@ -600,6 +645,8 @@ errno_t sss_strnlen(const char *str, size_t maxlen, size_t *len);
 
 void sss_nss_lock(void);
 void sss_nss_unlock(void);
+void sss_nss_lookup_lock(void);
+void sss_nss_lookup_unlock(void);
 void sss_pam_lock(void);
 void sss_pam_unlock(void);
 void sss_nss_mc_lock(void);
@@ -56,6 +56,22 @@ static int sss_sudo_send_recv_generic(enum sss_cli_command command,
     int errnop = 0;
     int ret = 0;
 
+    /* try the memory cache first */
+
+    ret = sss_sudo_mc_get(command, uid, username, &reply_buf, &reply_len);
+    if (ret == EOK) {
+        ret = sss_sudo_parse_response((const char*)reply_buf, reply_len,
+                                      _domainname, _result, _error);
+        if (ret == EOK) {
+            goto done;
+        }
+
+        /* ask the responder if the record cannot be used */
+        free(reply_buf);
+        reply_buf = NULL;
+        reply_len = 0;
+    }
+
     /* create query */
 
     ret = sss_sudo_create_query(uid, username, &query_buf, &query_len);
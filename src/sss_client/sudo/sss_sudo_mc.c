@@ -0,0 +1,228 @@
+/*
+    SSSD
+
+    Sudo client library: lookups in the sudo memory cache
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "sss_client/nss_mc.h"
+#include "sss_client/sss_cli.h"
+#include "sss_client/sudo/sss_sudo_private.h"
+
+struct sss_cli_mc_ctx sudo_mc_ctx = { UNINITIALIZED, -1, 0, 0, NULL, 0,
+                                      NULL, 0, NULL, 0, 0 };
+
+static errno_t sss_sudo_mc_parse_result(struct sss_mc_rec *rec,
+                                        uint32_t barrier,
+                                        const size_t key_len,
+                                        uint8_t **_buf, size_t *_buf_len)
+{
+    struct sss_mc_sudo_data *data;
+    time_t expire;
+    uint32_t reply_len;
+    uint32_t strs_len;
+    uint8_t *buf = NULL;
+    int ret;
+
+    data = (struct sss_mc_sudo_data *)rec->data;
+
+    /* the record is read in place, take a snapshot of what we need and
+     * validate it only after checking the record was not modified */
+    expire = rec->expire;
+    reply_len = data->reply_len;
+    strs_len = data->strs_len;
+
+    if (strs_len < key_len + 1
+            || reply_len != strs_len - (key_len + 1)
+            || !sss_nss_mc_within_data_table(&sudo_mc_ctx,
+                                             data->strs, strs_len)) {
+        ret = EINVAL;
+    } else {
+        /* the reply follows the key */
+        buf = malloc(reply_len);
+        if (buf == NULL) {
+            ret = ENOMEM;
+        } else {
+            memcpy(buf, data->strs + key_len + 1, reply_len);
+            ret = 0;
+        }
+    }
+
+    if (sss_nss_mc_record_changed(rec, barrier)) {
+        ret = EAGAIN;
+        goto done;
+    }
+    if (ret) {
+        goto done;
+    }
+
+    if (expire < time(NULL)) {
+        /* entry is now invalid */
+        ret = EINVAL;
+        goto done;
+    }
+
+    *_buf = buf;
+    *_buf_len = reply_len;
+    ret = 0;
+
+done:
+    if (ret) {
+        free(buf);
+    }
+    return ret;
+}
+
+int sss_sudo_mc_get(enum sss_cli_command command,
+                    uid_t uid,
+                    const char *username,
+                    uint8_t **_buf, size_t *_buf_len)
+{
+    struct sss_mc_rec *rec = NULL;
+    struct sss_mc_sudo_data *data;
+    char *key = NULL;
+    char *rec_key;
+    char prefix;
+    uint32_t barrier;
+    uint32_t hash;
+    uint32_t slot;
+    uint32_t key_ptr;
+    uint32_t strs_len;
+    uint32_t rec_len;
+    size_t key_len;
+    int retries = SSS_NSS_MC_READ_RETRIES;
+    int ret;
+    const size_t strs_offset = offsetof(struct sss_mc_sudo_data, strs);
+    size_t data_size;
+
+    switch (command) {
+    case SSS_SUDO_GET_SUDORULES:
+        prefix = SSS_MC_SUDO_RULES_PREFIX;
+        break;
+    case SSS_SUDO_GET_DEFAULTS:
+        prefix = SSS_MC_SUDO_DEFAULTS_PREFIX;
+        break;
+    default:
+        return EINVAL;
+    }
+
+    /* same key as built by the responder */
+    ret = asprintf(&key, "%c:%lu:%s", prefix, (unsigned long)uid, username);
+    if (ret < 0) {
+        return ENOMEM;
+    }
+    key_len = ret;
+
+    ret = sss_nss_mc_get_ctx("sudo", &sudo_mc_ctx);
+    if (ret) {
+        free(key);
+        return ret;
+    }
+
+    /* Get max size of data table. */
+    data_size = sudo_mc_ctx.dt_size;
+
+    /* hashes are calculated including the NULL terminator */
+    hash = sss_nss_mc_hash(&sudo_mc_ctx, key, key_len + 1);
+
+again:
+    slot = sudo_mc_ctx.hash_table[hash];
+
+    /* If slot is not within the bounds of mmaped region and
+     * it's value is not MC_INVALID_VAL, then the cache is
+     * probbably corrupted. */
+    while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = sss_nss_mc_get_record(&sudo_mc_ctx, slot, &rec, &barrier);
+        if (ret) {
+            goto done;
+        }
+
+        /* check record matches what we are searching for */
+        if (hash != rec->hash1) {
+            /* if key hash does not match we can skip this immediately */
+            slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            continue;
+        }
+
+        data = (struct sss_mc_sudo_data *)rec->data;
+        key_ptr = data->key;
+        strs_len = data->strs_len;
+        rec_len = rec->len;
+        /* Integrity check
+         * - key_len cannot be longer than all strings
+         * - data->key cannot point outside strings
+         * - all strings must be within the record
+         * - size of record must be lower that data table size */
+        if (key_len > strs_len
+            || (key_ptr + key_len) > (strs_offset + strs_len)
+            || strs_len > rec_len
+            || rec_len > data_size
+            || !sss_nss_mc_within_data_table(&sudo_mc_ctx,
+                                             (char *)data + key_ptr,
+                                             key_len + 1)) {
+            if (sss_nss_mc_record_changed(rec, barrier)) {
+                goto retry;
+            }
+            ret = ENOENT;
+            goto done;
+        }
+
+        rec_key = (char *)data + key_ptr;
+        if (strncmp(key, rec_key, key_len + 1) == 0) {
+            break;
+        }
+
+        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        if (sss_nss_mc_record_changed(rec, barrier)) {
+            goto retry;
+        }
+    }
+
+    if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    ret = sss_sudo_mc_parse_result(rec, barrier, key_len, _buf, _buf_len);
+    if (ret == EAGAIN) {
+        goto retry;
+    }
+
+done:
+    __sync_sub_and_fetch(&sudo_mc_ctx.active_threads, 1);
+    free(key);
+    return ret;
+
+retry:
+    if (--retries > 0) {
+        goto again;
+    }
+    ret = EAGAIN;
+    goto done;
+}
@@ -22,6 +22,8 @@
 #define SSS_SUDO_PRIVATE_H_
 
 #include <stdint.h>
+#include <sys/types.h>
+#include "sss_client/sss_cli.h"
 #include "sss_client/sudo/sss_sudo.h"
 
 int sss_sudo_parse_response(const char *message,
@@ -30,4 +32,11 @@ int sss_sudo_parse_response(const char *message,
                             struct sss_sudo_result **_result,
                             uint32_t *_error);
 
+/* Returns a malloc'ed copy of the reply to command the responder stored in
+ * the memory cache, ENOENT if there is none */
+int sss_sudo_mc_get(enum sss_cli_command command,
+                    uid_t uid,
+                    const char *username,
+                    uint8_t **_buf, size_t *_buf_len);
+
 #endif /* SSS_SUDO_PRIVATE_H_ */
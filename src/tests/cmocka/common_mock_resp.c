@@ -42,6 +42,12 @@ mock_rctx(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
+    ret = sss_hash_create(rctx, 30, &rctx->cache_req_table);
+    if (ret != EOK) {
+        talloc_free(rctx);
+        return NULL;
+    }
+
     rctx->ev = ev;
     rctx->domains = domains;
     rctx->pvt_ctx = pvt_ctx;
@@ -23,6 +23,7 @@
 #include "util/util.h"
 #include "providers/ldap/ldap_common.h"
 #include "providers/ldap/sdap.h"
+#include "providers/ldap/sdap_async.h"
 #include "tests/cmocka/common_mock.h"
 
 struct sdap_id_ctx *mock_sdap_id_ctx(TALLOC_CTX *mem_ctx,
@@ -81,6 +82,46 @@ bool sdap_has_deref_support(struct sdap_handle *sh, struct sdap_options *opts)
     return sss_mock_type(bool);
 }
 
+bool sdap_deref_preferred(struct sdap_handle *sh, struct sdap_options *opts,
+                          enum sdap_deref_class cls)
+{
+    return true;
+}
+
+void sdap_deref_stats_add(struct sdap_handle *sh,
+                          enum sdap_deref_class cls,
+                          bool deref,
+                          size_t num_objects,
+                          struct timeval start)
+{
+    return;
+}
+
+bool sdap_has_ranged_attrs(struct sysdb_attrs *entry)
+{
+    return false;
+}
+
+struct tevent_req *
+sdap_get_ranged_attrs_send(TALLOC_CTX *memctx,
+                           struct tevent_context *ev,
+                           struct sdap_options *opts,
+                           struct sdap_handle *sh,
+                           struct sdap_attr_map *map,
+                           int map_num,
+                           struct sysdb_attrs *entry,
+                           int timeout)
+{
+    return test_req_succeed_send(memctx, ev);
+}
+
+errno_t sdap_get_ranged_attrs_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
 struct tevent_req *sdap_get_generic_send(TALLOC_CTX *mem_ctx,
                                          struct tevent_context *ev,
                                          struct sdap_options *opts,
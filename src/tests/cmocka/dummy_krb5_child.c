@@ -0,0 +1,167 @@
+/*
+    SSSD
+
+    Tests -- a krb5_child worker which echoes the requests back
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <popt.h>
+
+#include "util/util.h"
+#include "util/child_common.h"
+
+/* Speaks the protocol of krb5_child --worker: every request and reply is
+ * prefixed with its length and every request is handled by a forked copy.
+ * TEST_CHILD_ACTION selects what happens to a request:
+ *  echo - the request is sent back as the reply (default)
+ *  hang - the copy never finishes
+ *  exit - the worker exits without a reply */
+
+static errno_t read_msg(uint8_t *buf, size_t size, uint32_t *_len)
+{
+    uint32_t len;
+    ssize_t ret;
+
+    ret = sss_atomic_read_s(STDIN_FILENO, &len, sizeof(len));
+    if (ret == 0) {
+        return ENOENT;
+    } else if (ret != sizeof(len) || len == 0 || len > size) {
+        return EINVAL;
+    }
+
+    ret = sss_atomic_read_s(STDIN_FILENO, buf, len);
+    if (ret != len) {
+        return EINVAL;
+    }
+
+    *_len = len;
+    return EOK;
+}
+
+static errno_t write_msg(uint8_t *buf, uint32_t len)
+{
+    ssize_t ret;
+
+    ret = sss_atomic_write_s(STDOUT_FILENO, &len, sizeof(len));
+    if (ret != sizeof(len)) {
+        return EIO;
+    }
+
+    ret = sss_atomic_write_s(STDOUT_FILENO, buf, len);
+    if (ret != len) {
+        return EIO;
+    }
+
+    return EOK;
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    int debug_fd = -1;
+    int fast_uid;
+    int fast_gid;
+    int worker = 0;
+    poptContext pc;
+    uint8_t buf[IN_BUF_SIZE];
+    const char *action;
+    uint32_t len;
+    pid_t pid;
+    errno_t ret;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        {"debug-level", 'd', POPT_ARG_INT, &debug_level, 0,
+         _("Debug level"), NULL},
+        {"debug-timestamps", 0, POPT_ARG_INT, &debug_timestamps, 0,
+         _("Add debug timestamps"), NULL},
+        {"debug-microseconds", 0, POPT_ARG_INT, &debug_microseconds, 0,
+         _("Show timestamps with microseconds"), NULL},
+        {"debug-fd", 0, POPT_ARG_INT, &debug_fd, 0,
+         _("An open file descriptor for the debug logs"), NULL},
+        {"debug-to-stderr", 0, POPT_ARG_NONE | POPT_ARGFLAG_DOC_HIDDEN,
+         &debug_to_stderr, 0,
+         _("Send the debug output to stderr directly."), NULL },
+        {"fast-ccache-uid", 0, POPT_ARG_INT, &fast_uid, 0,
+          _("The user to create FAST ccache as"), NULL},
+        {"fast-ccache-gid", 0, POPT_ARG_INT, &fast_gid, 0,
+          _("The group to create FAST ccache as"), NULL},
+        {"worker", 0, POPT_ARG_NONE, &worker, 0,
+         _("Serve requests until the input is closed"), NULL},
+        POPT_TABLEEND
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+        fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                  poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            poptFreeContext(pc);
+            _exit(1);
+        }
+    }
+    poptFreeContext(pc);
+
+    if (!worker || setpgid(0, 0) == -1) {
+        _exit(1);
+    }
+
+    action = getenv("TEST_CHILD_ACTION");
+    if (action == NULL) {
+        action = "echo";
+    }
+
+    while (true) {
+        ret = read_msg(buf, sizeof(buf), &len);
+        if (ret == ENOENT) {
+            _exit(0);
+        } else if (ret != EOK) {
+            _exit(1);
+        }
+
+        if (strcasecmp(action, "exit") == 0) {
+            _exit(1);
+        }
+
+        pid = fork();
+        if (pid == -1) {
+            _exit(1);
+        } else if (pid == 0) {
+            if (strcasecmp(action, "hang") == 0) {
+                while (true) {
+                    pause();
+                }
+            }
+            _exit(0);
+        }
+        while (waitpid(pid, NULL, 0) == -1 && errno == EINTR);
+
+        ret = write_msg(buf, len);
+        if (ret != EOK) {
+            _exit(1);
+        }
+    }
+}
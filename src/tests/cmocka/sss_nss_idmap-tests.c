@@ -146,12 +146,51 @@ void test_getorigbyname(void **state)
     sss_nss_free_kv(kv_list);
 }
 
+void test_getidsbysids(void **state)
+{
+    int ret;
+    const char *sids[] = { "S-1-5-21-1-2-3-1000", "S-1-5-21-1-2-3-1001" };
+    uint32_t ids[2];
+    enum sss_id_type types[2];
+    int rets[2];
+    uint8_t buf[8 * sizeof(uint32_t) + 2 * sizeof(uint32_t)];
+    size_t pctr = 0;
+    struct sss_nss_make_request_test_data d = {buf, sizeof(buf), 0,
+                                               NSS_STATUS_SUCCESS};
+
+    /* one SSS_NSS_GETBATCH reply with a found and a missing SID */
+    SAFEALIGN_SETMEM_UINT32(buf, 2, &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, 0, &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, SSS_NSS_GETIDBYSID, &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, EOK, &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, 2 * sizeof(uint32_t), &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, SSS_ID_TYPE_UID, &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, 1000, &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, SSS_NSS_GETIDBYSID, &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, ENOENT, &pctr);
+    SAFEALIGN_SETMEM_UINT32(buf + pctr, 0, &pctr);
+    assert_int_equal(pctr, sizeof(buf));
+
+    ret = sss_nss_getidsbysids(NULL, 2, ids, types, rets);
+    assert_int_equal(ret, EINVAL);
+
+    will_return(sss_nss_make_request, &d);
+    ret = sss_nss_getidsbysids(sids, 2, ids, types, rets);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(rets[0], EOK);
+    assert_int_equal(ids[0], 1000);
+    assert_int_equal(types[0], SSS_ID_TYPE_UID);
+    assert_int_equal(rets[1], ENOENT);
+    assert_int_equal(types[1], SSS_ID_TYPE_NOT_SPECIFIED);
+}
+
 int main(int argc, const char *argv[])
 {
 
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_getsidbyname),
         cmocka_unit_test(test_getorigbyname),
+        cmocka_unit_test(test_getidsbysids),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
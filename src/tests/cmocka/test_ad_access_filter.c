@@ -33,6 +33,7 @@
 #include "providers/ad/ad_access.c"
 
 #include "tests/cmocka/common_mock.h"
+#include "providers/ad/ad_opts.h"
 
 #define DOM_NAME "parent_dom"
 
@@ -154,6 +155,83 @@ void test_filter_no_match(void **state)
     test_parse_filter_generic("anotherdom:(name=bla)?yetanother:(name=foo)", &expected);
 }
 
+static struct ad_access_ctx *test_access_ctx(TALLOC_CTX *mem_ctx,
+                                             const char *filter,
+                                             bool enable_gc)
+{
+    struct ad_access_ctx *ctx;
+    struct sdap_options *opts;
+    errno_t ret;
+
+    ctx = talloc_zero(mem_ctx, struct ad_access_ctx);
+    assert_non_null(ctx);
+
+    ctx->ad_id_ctx = talloc_zero(ctx, struct ad_id_ctx);
+    assert_non_null(ctx->ad_id_ctx);
+    ctx->ad_id_ctx->ad_options = talloc_zero(ctx, struct ad_options);
+    assert_non_null(ctx->ad_id_ctx->ad_options);
+
+    ret = dp_copy_defaults(ctx, ad_basic_opts, AD_OPTS_BASIC,
+                           &ctx->ad_id_ctx->ad_options->basic);
+    assert_int_equal(ret, EOK);
+    ret = dp_opt_set_bool(ctx->ad_id_ctx->ad_options->basic, AD_ENABLE_GC,
+                          enable_gc);
+    assert_int_equal(ret, EOK);
+
+    opts = talloc_zero(ctx, struct sdap_options);
+    assert_non_null(opts);
+    ret = sdap_copy_map(opts, ad_2008r2_user_map, SDAP_OPTS_USER,
+                        &opts->user_map);
+    assert_int_equal(ret, EOK);
+    opts->user_map_cnt = SDAP_OPTS_USER;
+
+    ctx->sdap_access_ctx = talloc_zero(ctx, struct sdap_access_ctx);
+    assert_non_null(ctx->sdap_access_ctx);
+    ctx->sdap_access_ctx->filter = filter;
+    ctx->sdap_access_ctx->id_ctx = talloc_zero(ctx, struct sdap_id_ctx);
+    assert_non_null(ctx->sdap_access_ctx->id_ctx);
+    ctx->sdap_access_ctx->id_ctx->opts = opts;
+
+    return ctx;
+}
+
+/* Entries read from the Global Catalog have only a partial memberOf, the
+ * filter must then always go to the server */
+void test_filter_compiled_gc(void **state)
+{
+    struct ad_access_ctx *ctx;
+    struct sdap_access_filter *compiled;
+    struct sdap_access_filter *again;
+    errno_t ret;
+
+    ctx = test_access_ctx(test_ctx, "(memberOf=cn=a,dc=example,dc=com)",
+                          true);
+    ret = ad_get_access_filter(ctx, test_ctx->dom, &compiled);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(compiled->filter, "(memberOf=cn=a,dc=example,dc=com)");
+    assert_null(compiled->tree);
+    talloc_free(ctx);
+
+    ctx = test_access_ctx(test_ctx, "(memberOf=cn=a,dc=example,dc=com)",
+                          false);
+    ret = ad_get_access_filter(ctx, test_ctx->dom, &compiled);
+    assert_int_equal(ret, EOK);
+    assert_non_null(compiled->tree);
+
+    /* the filter of the domain is compiled only once */
+    ret = ad_get_access_filter(ctx, test_ctx->dom, &again);
+    assert_int_equal(ret, EOK);
+    assert_ptr_equal(compiled, again);
+    talloc_free(ctx);
+
+    /* negations are never evaluated locally */
+    ctx = test_access_ctx(test_ctx, "(!(memberOf=cn=a,dc=example,dc=com))",
+                          false);
+    ret = ad_get_access_filter(ctx, test_ctx->dom, &compiled);
+    assert_int_equal(ret, EOK);
+    assert_null(compiled->tree);
+    talloc_free(ctx);
+}
 
 int parse_test_setup(void **state)
 {
@@ -336,6 +414,10 @@ int main(int argc, const char *argv[])
                                         ad_access_filter_test_setup,
                                         ad_access_filter_test_teardown),
 
+        cmocka_unit_test_setup_teardown(test_filter_compiled_gc,
+                                        ad_access_filter_test_setup,
+                                        ad_access_filter_test_teardown),
+
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
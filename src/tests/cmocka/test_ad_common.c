@@ -365,6 +365,48 @@ void test_ad_get_dom_ldap_conn(void **state)
     assert_true(conn == test_ctx->subdom_ad_ctx->ldap_ctx);
 }
 
+static errno_t test_subdom_id_ctx_get(void *pvt, struct sdap_domain *sdom)
+{
+    struct ad_common_test_ctx *test_ctx = talloc_get_type(pvt,
+                                                     struct ad_common_test_ctx);
+
+    if (sdom->pvt == NULL) {
+        sdom->pvt = test_ctx->subdom_ad_ctx;
+    }
+
+    return EOK;
+}
+
+void test_ad_get_dom_ldap_conn_lazy(void **state)
+{
+    struct sdap_id_conn_ctx *conn;
+    struct sdap_domain *sdom;
+
+    struct ad_common_test_ctx *test_ctx = talloc_get_type(*state,
+                                                     struct ad_common_test_ctx);
+    assert_non_null(test_ctx);
+
+    sdom = sdap_domain_get(test_ctx->ad_ctx->sdap_id_ctx->opts,
+                           test_ctx->subdom);
+    assert_non_null(sdom);
+    sdom->pvt = NULL;
+
+    /* without the subdomains provider there is no context to use */
+    conn = ad_get_dom_ldap_conn(test_ctx->ad_ctx, test_ctx->subdom);
+    assert_null(conn);
+
+    test_ctx->ad_ctx->subdom_id_ctx_fn = test_subdom_id_ctx_get;
+    test_ctx->ad_ctx->subdom_id_ctx_pvt = test_ctx;
+
+    conn = ad_get_dom_ldap_conn(test_ctx->ad_ctx, test_ctx->subdom);
+    assert_true(conn == test_ctx->subdom_ad_ctx->ldap_ctx);
+    assert_true(sdom->pvt == test_ctx->subdom_ad_ctx);
+
+    /* the parent domain is never created lazily */
+    conn = ad_get_dom_ldap_conn(test_ctx->ad_ctx, test_ctx->dom);
+    assert_true(conn == test_ctx->ad_ctx->ldap_ctx);
+}
+
 void test_gc_conn_list(void **state)
 {
     struct sdap_id_conn_ctx **conn_list;
@@ -496,6 +538,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_ad_get_dom_ldap_conn,
                                         test_ldap_conn_setup,
                                         test_ldap_conn_teardown),
+        cmocka_unit_test_setup_teardown(test_ad_get_dom_ldap_conn_lazy,
+                                        test_ldap_conn_setup,
+                                        test_ldap_conn_teardown),
         cmocka_unit_test_setup_teardown(test_gc_conn_list,
                                         test_ldap_conn_setup,
                                         test_ldap_conn_teardown),
@@ -275,6 +275,7 @@ static void test_ad_gpo_ace_includes_client_sid(const char *user_sid,
     errno_t ret;
     enum idmap_error_code err;
     struct sss_idmap_ctx *idmap_ctx;
+    struct ad_gpo_sids *sids;
     bool includes_client_sid;
     TALLOC_CTX *tmp_ctx;
 
@@ -286,10 +287,14 @@ static void test_ad_gpo_ace_includes_client_sid(const char *user_sid,
                          &idmap_ctx);
     assert_int_equal(err, IDMAP_SUCCESS);
 
-    ret = ad_gpo_ace_includes_client_sid(user_sid, group_sids, group_size,
-                                         ace_dom_sid, idmap_ctx,
+    ret = ad_gpo_create_sids(tmp_ctx, user_sid, group_sids, group_size,
+                             &sids);
+    assert_int_equal(ret, EOK);
+
+    ret = ad_gpo_ace_includes_client_sid(sids, ace_dom_sid, idmap_ctx,
                                          &includes_client_sid);
     talloc_free(idmap_ctx);
+    talloc_free(sids);
 
     assert_int_equal(ret, EOK);
 
@@ -329,6 +334,48 @@ void test_ad_gpo_ace_includes_client_sid_false(void **state)
                                         ace_dom_sid, false);
 }
 
+void test_ad_gpo_ace_includes_client_sid_user(void **state)
+{
+    /* ace_dom_sid represents "S-1-5-21-2-3-4" */
+    struct dom_sid ace_dom_sid = {1, 4, {0, 0, 0, 0, 0, 5}, {21, 2, 3, 4}};
+
+    const char *user_sid = "S-1-5-21-2-3-4";
+
+    int group_size = 1;
+    const char *group_sids[] = {"S-1-5-21-2-3-5"};
+
+    test_ad_gpo_ace_includes_client_sid(user_sid, group_sids, group_size,
+                                        ace_dom_sid, true);
+}
+
+void test_ad_gpo_cached_version_matches(void **state)
+{
+    struct gp_gpo gpo = { 0 };
+    char policy_file[] = "/tmp/test_ad_gpo_XXXXXX";
+    int fd;
+
+    fd = mkstemp(policy_file);
+    assert_true(fd >= 0);
+    close(fd);
+
+    gpo.gpo_guid = "{31B2F340-016D-11D2-945F-00C04FB984F9}";
+    gpo.policy_filename = policy_file;
+
+    gpo.gpo_version = 5;
+    assert_true(ad_gpo_cached_version_matches(&gpo, 5));
+    assert_false(ad_gpo_cached_version_matches(&gpo, 4));
+    assert_false(ad_gpo_cached_version_matches(&gpo, -1));
+
+    /* the version is not known */
+    gpo.gpo_version = -1;
+    assert_false(ad_gpo_cached_version_matches(&gpo, -1));
+
+    /* the policy file is not cached anymore */
+    gpo.gpo_version = 5;
+    assert_int_equal(unlink(policy_file), 0);
+    assert_false(ad_gpo_cached_version_matches(&gpo, 5));
+}
+
 int main(int argc, const char *argv[])
 {
     poptContext pc;
@@ -364,6 +411,12 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_ad_gpo_ace_includes_client_sid_false,
                                         ad_gpo_test_setup,
                                         ad_gpo_test_teardown),
+        cmocka_unit_test_setup_teardown(test_ad_gpo_ace_includes_client_sid_user,
+                                        ad_gpo_test_setup,
+                                        ad_gpo_test_teardown),
+        cmocka_unit_test_setup_teardown(test_ad_gpo_cached_version_matches,
+                                        ad_gpo_test_setup,
+                                        ad_gpo_test_teardown),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
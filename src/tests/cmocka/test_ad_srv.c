@@ -0,0 +1,446 @@
+/*
+    SSSD
+
+    Tests of the detection of the AD site with CLDAP pings
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the site detection */
+#include "providers/ad/ad_srv.c"
+#include "providers/ldap/ldap_opts.h"
+
+#define TEST_AD_DOMAIN "ad.test"
+#define TEST_SITE "Test-Site"
+#define TEST_MAX_CONNECTS 8
+
+struct test_connect {
+    struct tevent_req *req;
+    bool freed;
+    const char *protocol;
+    const char *host;
+    int port;
+
+    struct sdap_handle *sh;
+    struct tevent_req *search_req;
+};
+
+struct ad_srv_test_ctx {
+    struct tevent_context *ev;
+    struct ad_srv_plugin_ctx *ctx;
+    struct fo_server_info *dcs;
+
+    struct test_connect connects[TEST_MAX_CONNECTS];
+    int num_connects;
+
+    /* the servers whose round trip time went to the fail over */
+    const char *recorded[TEST_MAX_CONNECTS];
+    int num_recorded;
+};
+
+static struct ad_srv_test_ctx *test_ctx;
+
+struct test_req_state {
+    struct test_connect *conn;
+    struct sysdb_attrs **reply;
+    size_t reply_count;
+};
+
+static int test_req_state_destructor(struct test_req_state *state)
+{
+    if (state->conn != NULL) {
+        state->conn->freed = true;
+    }
+    return 0;
+}
+
+struct tevent_req *__wrap_sdap_connect_host_send(TALLOC_CTX *mem_ctx,
+                                           struct tevent_context *ev,
+                                           struct sdap_options *opts,
+                                           struct resolv_ctx *resolv_ctx,
+                                           enum restrict_family family_order,
+                                           enum host_database *host_db,
+                                           const char *protocol,
+                                           const char *host,
+                                           int port,
+                                           bool use_start_tls)
+{
+    struct test_connect *conn;
+    struct test_req_state *state;
+    struct tevent_req *req;
+
+    assert_true(test_ctx->num_connects < TEST_MAX_CONNECTS);
+
+    req = tevent_req_create(mem_ctx, &state, struct test_req_state);
+    assert_non_null(req);
+
+    conn = &test_ctx->connects[test_ctx->num_connects];
+    test_ctx->num_connects++;
+
+    conn->req = req;
+    conn->protocol = protocol;
+    conn->host = host;
+    conn->port = port;
+
+    state->conn = conn;
+    talloc_set_destructor(state, test_req_state_destructor);
+    return req;
+}
+
+errno_t __wrap_sdap_connect_host_recv(TALLOC_CTX *mem_ctx,
+                                      struct tevent_req *req,
+                                      struct sdap_handle **_sh)
+{
+    struct test_req_state *state = tevent_req_data(req,
+                                                   struct test_req_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    state->conn->sh = talloc_zero(mem_ctx, struct sdap_handle);
+    assert_non_null(state->conn->sh);
+
+    *_sh = state->conn->sh;
+    return EOK;
+}
+
+struct tevent_req *__wrap_sdap_get_generic_send(TALLOC_CTX *memctx,
+                                                struct tevent_context *ev,
+                                                struct sdap_options *opts,
+                                                struct sdap_handle *sh,
+                                                const char *search_base,
+                                                int scope,
+                                                const char *filter,
+                                                const char **attrs,
+                                                struct sdap_attr_map *map,
+                                                int map_num_attrs,
+                                                int timeout,
+                                                bool allow_paging)
+{
+    struct test_req_state *state;
+    struct tevent_req *req;
+    int i;
+
+    assert_int_equal(scope, LDAP_SCOPE_BASE);
+    assert_non_null(strstr(filter, TEST_AD_DOMAIN));
+
+    req = tevent_req_create(memctx, &state, struct test_req_state);
+    assert_non_null(req);
+
+    for (i = 0; i < test_ctx->num_connects; i++) {
+        if (test_ctx->connects[i].sh == sh) {
+            break;
+        }
+    }
+    assert_true(i < test_ctx->num_connects);
+
+    test_ctx->connects[i].search_req = req;
+    state->conn = &test_ctx->connects[i];
+    talloc_set_destructor(state, test_req_state_destructor);
+    return req;
+}
+
+int __wrap_sdap_get_generic_recv(struct tevent_req *req,
+                                 TALLOC_CTX *mem_ctx, size_t *reply_count,
+                                 struct sysdb_attrs ***reply_list)
+{
+    struct test_req_state *state = tevent_req_data(req,
+                                                   struct test_req_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *reply_count = state->reply_count;
+    *reply_list = talloc_steal(mem_ctx, state->reply);
+    return EOK;
+}
+
+errno_t __wrap_be_fo_record_server_rtt(struct be_ctx *ctx,
+                                       const char *server_name,
+                                       uint32_t rtt_usec)
+{
+    assert_true(test_ctx->num_recorded < TEST_MAX_CONNECTS);
+
+    test_ctx->recorded[test_ctx->num_recorded] = server_name;
+    test_ctx->num_recorded++;
+    return EOK;
+}
+
+static int ad_srv_test_setup(void **state)
+{
+    struct ad_srv_plugin_ctx *ctx;
+    errno_t ret;
+    int i;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct ad_srv_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->ev = tevent_context_init(test_ctx);
+    assert_non_null(test_ctx->ev);
+
+    ctx = talloc_zero(test_ctx, struct ad_srv_plugin_ctx);
+    assert_non_null(ctx);
+    ctx->be_ctx = talloc_zero(ctx, struct be_ctx);
+    assert_non_null(ctx->be_ctx);
+    ctx->be_res = talloc_zero(ctx, struct be_resolv_ctx);
+    assert_non_null(ctx->be_res);
+    ctx->host_dbs = default_host_dbs;
+    ctx->ad_domain = TEST_AD_DOMAIN;
+
+    ctx->opts = talloc_zero(ctx, struct sdap_options);
+    assert_non_null(ctx->opts);
+    ret = dp_copy_defaults(ctx->opts, default_basic_opts,
+                           SDAP_OPTS_BASIC, &ctx->opts->basic);
+    assert_int_equal(ret, EOK);
+    test_ctx->ctx = ctx;
+
+    /* the SRV records name the port of the Global Catalog */
+    test_ctx->dcs = talloc_zero_array(test_ctx, struct fo_server_info, 3);
+    assert_non_null(test_ctx->dcs);
+    for (i = 0; i < 3; i++) {
+        test_ctx->dcs[i].host = talloc_asprintf(test_ctx->dcs,
+                                                "dc%d." TEST_AD_DOMAIN, i);
+        assert_non_null(test_ctx->dcs[i].host);
+        test_ctx->dcs[i].port = 3268;
+    }
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int ad_srv_test_teardown(void **state)
+{
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+/* The netlogon attribute of a domain controller in TEST_AD_DOMAIN */
+static struct sysdb_attrs **netlogon_reply(TALLOC_CTX *mem_ctx,
+                                           const char *client_site)
+{
+    struct netlogon_samlogon_response response;
+    struct NETLOGON_SAM_LOGON_RESPONSE_EX *ex;
+    struct sysdb_attrs **reply;
+    enum ndr_err_code ndr_err;
+    DATA_BLOB blob;
+    errno_t ret;
+
+    ZERO_STRUCT(response);
+    response.ntver = NETLOGON_NT_VERSION_5EX
+                        | NETLOGON_NT_VERSION_WITH_CLOSEST_SITE;
+
+    ex = &response.data.nt5_ex;
+    ex->command = LOGON_SAM_LOGON_RESPONSE_EX;
+    ex->forest = TEST_AD_DOMAIN;
+    ex->dns_domain = TEST_AD_DOMAIN;
+    ex->pdc_dns_name = "dc0." TEST_AD_DOMAIN;
+    ex->domain_name = "AD";
+    ex->pdc_name = "DC0";
+    ex->user_name = "";
+    ex->server_site = TEST_SITE;
+    ex->client_site = client_site;
+    ex->next_closest_site = "";
+    ex->nt_version = NETLOGON_NT_VERSION_1 | response.ntver;
+    ex->lmnt_token = 0xFFFF;
+    ex->lm20_token = 0xFFFF;
+
+    ndr_err = ndr_push_struct_blob(&blob, mem_ctx, &response,
+                (ndr_push_flags_fn_t) ndr_push_netlogon_samlogon_response);
+    assert_true(NDR_ERR_CODE_IS_SUCCESS(ndr_err));
+
+    reply = talloc_zero_array(mem_ctx, struct sysdb_attrs *, 1);
+    assert_non_null(reply);
+    reply[0] = sysdb_new_attrs(reply);
+    assert_non_null(reply[0]);
+
+    ret = sysdb_attrs_add_mem(reply[0], AD_AT_NETLOGON,
+                              blob.data, blob.length);
+    assert_int_equal(ret, EOK);
+    talloc_free(blob.data);
+
+    return reply;
+}
+
+static void finish_connect(int idx, errno_t ret)
+{
+    struct test_connect *conn = &test_ctx->connects[idx];
+
+    assert_true(idx < test_ctx->num_connects);
+    assert_false(conn->freed);
+
+    if (ret != EOK) {
+        tevent_req_error(conn->req, ret);
+        return;
+    }
+
+    tevent_req_done(conn->req);
+    assert_non_null(conn->search_req);
+}
+
+static void finish_search(int idx, const char *client_site)
+{
+    struct test_connect *conn = &test_ctx->connects[idx];
+    struct test_req_state *state;
+
+    assert_non_null(conn->search_req);
+    assert_false(conn->freed);
+
+    state = tevent_req_data(conn->search_req, struct test_req_state);
+    state->reply = netlogon_reply(state, client_site);
+    state->reply_count = 1;
+
+    tevent_req_done(conn->search_req);
+}
+
+static struct tevent_req *get_client_site(size_t num_dcs)
+{
+    struct tevent_req *req;
+
+    req = ad_get_client_site_send(test_ctx, test_ctx->ev, test_ctx->ctx,
+                                  TEST_AD_DOMAIN, test_ctx->dcs, num_dcs);
+    assert_non_null(req);
+
+    return req;
+}
+
+static void assert_site(struct tevent_req *req)
+{
+    const char *site;
+    const char *forest;
+    errno_t ret;
+
+    assert_false(tevent_req_is_in_progress(req));
+
+    ret = ad_get_client_site_recv(test_ctx, req, &site, &forest);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(site, TEST_SITE);
+    assert_string_equal(forest, TEST_AD_DOMAIN);
+}
+
+/* All domain controllers are pinged at once over CLDAP, the first answer
+ * with the site finishes the detection */
+void test_client_site_first_answer(void **state)
+{
+    struct tevent_req *req;
+    int i;
+
+    req = get_client_site(3);
+
+    assert_int_equal(test_ctx->num_connects, 3);
+    for (i = 0; i < 3; i++) {
+        assert_string_equal(test_ctx->connects[i].protocol, "cldap");
+        assert_int_equal(test_ctx->connects[i].port, AD_CLDAP_PORT);
+    }
+
+    finish_connect(0, EOK);
+    finish_connect(1, EOK);
+    assert_true(tevent_req_is_in_progress(req));
+
+    /* an answer without the site does not finish it */
+    finish_search(0, "");
+    assert_true(tevent_req_is_in_progress(req));
+    assert_int_equal(test_ctx->num_recorded, 1);
+
+    finish_search(1, TEST_SITE);
+    assert_site(req);
+
+    /* only the servers which answered are recorded, the others are
+     * dropped */
+    assert_int_equal(test_ctx->num_recorded, 2);
+    assert_string_equal(test_ctx->recorded[1], test_ctx->dcs[1].host);
+    assert_true(test_ctx->connects[2].freed);
+    assert_int_equal(test_ctx->num_connects, 3);
+
+    talloc_free(req);
+}
+
+/* When no domain controller answers the CLDAP ping, they are asked one
+ * by one over LDAP */
+void test_client_site_fallback(void **state)
+{
+    struct tevent_req *req;
+
+    req = get_client_site(2);
+    assert_int_equal(test_ctx->num_connects, 2);
+
+    finish_connect(0, EIO);
+    finish_connect(1, ETIMEDOUT);
+    assert_int_equal(test_ctx->num_recorded, 2);
+
+    assert_int_equal(test_ctx->num_connects, 3);
+    assert_string_equal(test_ctx->connects[2].protocol, "ldap");
+    assert_string_equal(test_ctx->connects[2].host, test_ctx->dcs[0].host);
+    assert_int_equal(test_ctx->connects[2].port, test_ctx->dcs[0].port);
+
+    finish_connect(2, EIO);
+    assert_int_equal(test_ctx->num_connects, 4);
+    assert_string_equal(test_ctx->connects[3].protocol, "ldap");
+    assert_string_equal(test_ctx->connects[3].host, test_ctx->dcs[1].host);
+
+    finish_connect(3, EOK);
+    finish_search(3, TEST_SITE);
+    assert_site(req);
+
+    talloc_free(req);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_client_site_first_answer,
+                                        ad_srv_test_setup,
+                                        ad_srv_test_teardown),
+        cmocka_unit_test_setup_teardown(test_client_site_fallback,
+                                        ad_srv_test_setup,
+                                        ad_srv_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -534,6 +534,8 @@ void test_be_ptask_offline_skip(void **state)
     assert_true(next_execution + PERIOD <= ptask->next_execution);
     assert_true(ptask->enabled);
     assert_non_null(ptask->timer);
+    assert_int_equal(ptask->stats.skips, 1);
+    assert_int_equal(ptask->stats.runs, 0);
 
     be_ptask_destroy(&ptask);
     assert_null(ptask);
@@ -714,6 +716,9 @@ void test_be_ptask_reschedule_timeout(void **state)
     assert_false(test_ctx->done);
     assert_true(now + PERIOD <= ptask->next_execution);
     assert_non_null(ptask->timer);
+    assert_int_equal(ptask->stats.timeouts, 1);
+    assert_int_equal(ptask->stats.runs, 1);
+    assert_true(ptask->stats.max_msec >= 1000);
 
     be_ptask_destroy(&ptask);
     assert_null(ptask);
@@ -776,6 +781,198 @@ void test_be_ptask_reschedule_backoff(void **state)
     assert_null(ptask);
 }
 
+void test_be_ptask_stats(void **state)
+{
+    struct test_ctx *test_ctx = (struct test_ctx *)(*state);
+    struct be_ptask *ptask = NULL;
+    struct be_ptask *other = NULL;
+    struct be_ptask_stats stats;
+    struct be_ptask_stats *all;
+    const char **names;
+    size_t count;
+    errno_t ret;
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, PERIOD, 0, 0, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_error_recv, test_ctx, "Test ptask",
+                          &ptask);
+    assert_int_equal(ret, ERR_OK);
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, PERIOD, DELAY, 0, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Other ptask",
+                          &other);
+    assert_int_equal(ret, ERR_OK);
+
+    while (!test_ctx->done) {
+        tevent_loop_once(test_ctx->be_ctx->ev);
+    }
+
+    be_ptask_get_stats(ptask, &stats);
+    assert_int_equal(stats.runs, 1);
+    assert_int_equal(stats.failures, 1);
+    assert_int_equal(stats.timeouts, 0);
+    assert_int_equal(stats.skips, 0);
+    assert_int_equal(stats.overlaps, 0);
+    assert_int_equal(stats.buckets[0], 1);
+
+    ret = be_ptask_get_all_stats(test_ctx, test_ctx->be_ctx, &names, &all,
+                                 &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 2);
+    assert_string_equal(names[0], "Other ptask");
+    assert_int_equal(all[0].runs, 0);
+    assert_string_equal(names[1], "Test ptask");
+    assert_int_equal(all[1].runs, 1);
+    talloc_free(names);
+    talloc_free(all);
+
+    be_ptask_destroy(&other);
+    be_ptask_destroy(&ptask);
+
+    ret = be_ptask_get_all_stats(test_ctx, test_ctx->be_ctx, &names, &all,
+                                 &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 0);
+    talloc_free(names);
+    talloc_free(all);
+}
+
+void test_be_ptask_spread_heavy(void **state)
+{
+    struct test_ctx *test_ctx = (struct test_ctx *)(*state);
+    struct be_ptask *ptask = NULL;
+    struct be_ptask *other = NULL;
+    struct be_ptask *light = NULL;
+    errno_t ret;
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, 100, 10, 10, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Test ptask", &ptask);
+    assert_int_equal(ret, ERR_OK);
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, 100, 10, 10, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Other ptask",
+                          &other);
+    assert_int_equal(ret, ERR_OK);
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, 100, 10, 10, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Light ptask",
+                          &light);
+    assert_int_equal(ret, ERR_OK);
+
+    /* the runs of the first two took five seconds */
+    ptask->stats.runs = 1;
+    ptask->stats.total_msec = 5000;
+    other->stats.runs = 1;
+    other->stats.total_msec = 5000;
+    light->stats.runs = 1;
+    light->stats.total_msec = 10;
+
+    /* a light task is not moved */
+    be_ptask_disable(light);
+    be_ptask_enable(light);
+    assert_true(light->next_execution < ptask->next_execution + 5);
+
+    /* a heavy one starts after the other has finished */
+    be_ptask_disable(other);
+    be_ptask_enable(other);
+    assert_int_equal(other->next_execution, ptask->next_execution + 5);
+
+    /* but never later than half of the period */
+    ptask->stats.total_msec = 100000;
+    be_ptask_disable(other);
+    be_ptask_enable(other);
+    assert_true(other->next_execution < ptask->next_execution + 50);
+
+    be_ptask_destroy(&light);
+    be_ptask_destroy(&other);
+    be_ptask_destroy(&ptask);
+}
+
+void test_be_ptask_stagger(void **state)
+{
+    struct test_ctx *test_ctx = (struct test_ctx *)(*state);
+    struct be_ptask *ptask = NULL;
+    struct be_ptask *other = NULL;
+    struct be_ptask *third = NULL;
+    time_t diff;
+    errno_t ret;
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, 80, DELAY, 0, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Test ptask", &ptask);
+    assert_int_equal(ret, ERR_OK);
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, 80, DELAY, 0, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Other ptask",
+                          &other);
+    assert_int_equal(ret, ERR_OK);
+
+    /* a task with another period is not moved */
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, 90, DELAY, 0, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Third ptask",
+                          &third);
+    assert_int_equal(ret, ERR_OK);
+
+    diff = other->next_execution - ptask->next_execution;
+    assert_true(diff >= 10 && diff <= 11);
+    diff = third->next_execution - ptask->next_execution;
+    assert_true(diff >= 0 && diff <= 1);
+
+    be_ptask_destroy(&third);
+    be_ptask_destroy(&other);
+    be_ptask_destroy(&ptask);
+}
+
+void test_be_ptask_max_heavy(void **state)
+{
+    struct test_ctx *test_ctx = (struct test_ctx *)(*state);
+    struct be_ptask *ptask = NULL;
+    struct be_ptask *other = NULL;
+    time_t now;
+    errno_t ret;
+
+    test_ctx->be_ctx->ptask_max_heavy = 1;
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, 100, 100, 0, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Other ptask",
+                          &other);
+    assert_int_equal(ret, ERR_OK);
+
+    ret = be_ptask_create(test_ctx, test_ctx->be_ctx, PERIOD, 0, 0, 0, 0,
+                          BE_PTASK_OFFLINE_SKIP, 0, test_be_ptask_send,
+                          test_be_ptask_recv, test_ctx, "Test ptask", &ptask);
+    assert_int_equal(ret, ERR_OK);
+
+    /* the other heavy task is running since now and takes five seconds */
+    now = get_current_time();
+    other->req = (struct tevent_req *) test_ctx;
+    other->last_execution = now;
+    other->stats.runs = 1;
+    other->stats.total_msec = 5000;
+    ptask->stats.runs = 1;
+    ptask->stats.total_msec = 2000;
+
+    while (ptask->next_execution < now + 5) {
+        tevent_loop_once(test_ctx->be_ctx->ev);
+    }
+
+    assert_int_equal(ptask->next_execution, now + 5);
+    assert_int_equal(ptask->last_execution, 0);
+    assert_non_null(ptask->timer);
+    assert_false(test_ctx->done);
+
+    other->req = NULL;
+    be_ptask_destroy(&other);
+    be_ptask_destroy(&ptask);
+}
+
 void test_be_ptask_get_period(void **state)
 {
     struct test_ctx *test_ctx = (struct test_ctx *)(*state);
@@ -990,6 +1187,10 @@ int main(int argc, const char *argv[])
         new_test(be_ptask_reschedule_error),
         new_test(be_ptask_reschedule_timeout),
         new_test(be_ptask_reschedule_backoff),
+        new_test(be_ptask_stats),
+        new_test(be_ptask_spread_heavy),
+        new_test(be_ptask_stagger),
+        new_test(be_ptask_max_heavy),
         new_test(be_ptask_get_period),
         new_test(be_ptask_get_timeout),
         new_test(be_ptask_create_sync),
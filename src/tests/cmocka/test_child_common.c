@@ -373,6 +373,69 @@ void test_exec_child_echo(void **state)
     assert_int_equal(ret, EOK);
 }
 
+/* The same as test_exec_child_echo but without fork() */
+void test_spawn_child_echo(void **state)
+{
+    errno_t ret;
+    pid_t child_pid;
+    struct child_test_ctx *child_tctx = talloc_get_type(*state,
+                                                        struct child_test_ctx);
+    struct tevent_req *req;
+    struct child_io_fds *io_fds;
+
+    setenv("TEST_CHILD_ACTION", "echo", 1);
+
+    io_fds = talloc(child_tctx, struct child_io_fds);
+    assert_non_null(io_fds);
+    io_fds->read_from_child_fd = -1;
+    io_fds->write_to_child_fd = -1;
+    talloc_set_destructor((void *) io_fds, child_io_destructor);
+
+    ret = spawn_child(child_tctx,
+                      child_tctx->pipefd_to_child,
+                      child_tctx->pipefd_from_child,
+                      CHILD_DIR"/"TEST_BIN, 2, NULL, false,
+                      STDIN_FILENO, 3, &child_pid);
+    assert_int_equal(ret, EOK);
+
+    DEBUG(SSSDBG_FUNC_DATA, "Spawned %d\n", child_pid);
+
+    io_fds->read_from_child_fd = child_tctx->pipefd_from_child[0];
+    close(child_tctx->pipefd_from_child[1]);
+    io_fds->write_to_child_fd = child_tctx->pipefd_to_child[1];
+    close(child_tctx->pipefd_to_child[0]);
+
+    sss_fd_nonblocking(io_fds->write_to_child_fd);
+    sss_fd_nonblocking(io_fds->read_from_child_fd);
+
+    ret = child_handler_setup(child_tctx->test_ctx->ev, child_pid,
+                              NULL, NULL, NULL);
+    assert_int_equal(ret, EOK);
+
+    req = echo_child_write_send(child_tctx, child_tctx, io_fds, ECHO_STR);
+    assert_non_null(req);
+
+    ret = test_ev_loop(child_tctx->test_ctx);
+    talloc_free(io_fds);
+    assert_int_equal(ret, EOK);
+}
+
+/* A missing binary is reported to the parent */
+void test_spawn_child_neg(void **state)
+{
+    errno_t ret;
+    pid_t child_pid;
+    struct child_test_ctx *child_tctx = talloc_get_type(*state,
+                                                        struct child_test_ctx);
+
+    ret = spawn_child(child_tctx,
+                      child_tctx->pipefd_to_child,
+                      child_tctx->pipefd_from_child,
+                      CHILD_DIR"/no-such-child", 2, NULL, false,
+                      STDIN_FILENO, STDOUT_FILENO, &child_pid);
+    assert_int_equal(ret, ENOENT);
+}
+
 struct test_exec_echo_state {
     struct child_io_fds *io_fds;
     struct io_buffer buf;
@@ -456,6 +519,150 @@ static void echo_child_read_done(struct tevent_req *subreq)
     echo_state->child_test_ctx->test_ctx->done = true;
 }
 
+/* larger than a few buffer sizes of read_pipe_send() but small enough to
+ * fit in the pipe without a reader */
+#define TEST_PIPE_DATA_LEN 40000
+#define TEST_PIPE_MSG_LEN 3000
+
+static void test_read_pipe_done(struct tevent_req *subreq)
+{
+    struct child_test_ctx *child_tctx;
+    uint8_t *buf;
+    ssize_t len;
+    ssize_t i;
+    errno_t ret;
+
+    child_tctx = tevent_req_callback_data(subreq, struct child_test_ctx);
+
+    ret = read_pipe_recv(subreq, child_tctx, &buf, &len);
+    talloc_zfree(subreq);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(len, TEST_PIPE_DATA_LEN);
+    assert_int_equal(talloc_get_size(buf), TEST_PIPE_DATA_LEN);
+    for (i = 0; i < len; i++) {
+        assert_int_equal(buf[i], i % 251);
+    }
+    talloc_free(buf);
+
+    child_tctx->test_ctx->done = true;
+}
+
+/* A reply larger than the buffer of read_pipe_send() is read whole */
+void test_read_pipe_large(void **state)
+{
+    struct child_test_ctx *child_tctx = talloc_get_type(*state,
+                                                        struct child_test_ctx);
+    struct tevent_req *req;
+    uint8_t *data;
+    ssize_t written;
+    size_t i;
+    errno_t ret;
+
+    data = talloc_size(child_tctx, TEST_PIPE_DATA_LEN);
+    assert_non_null(data);
+    for (i = 0; i < TEST_PIPE_DATA_LEN; i++) {
+        data[i] = i % 251;
+    }
+
+    written = sss_atomic_write_s(child_tctx->pipefd_from_child[1],
+                                 data, TEST_PIPE_DATA_LEN);
+    assert_int_equal(written, TEST_PIPE_DATA_LEN);
+    close(child_tctx->pipefd_from_child[1]);
+    talloc_free(data);
+
+    fd_nonblocking(child_tctx->pipefd_from_child[0]);
+    req = read_pipe_send(child_tctx, child_tctx->test_ctx->ev,
+                         child_tctx->pipefd_from_child[0]);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_read_pipe_done, child_tctx);
+
+    ret = test_ev_loop(child_tctx->test_ctx);
+    assert_int_equal(ret, EOK);
+
+    close(child_tctx->pipefd_from_child[0]);
+}
+
+struct test_pipe_msg_ctx {
+    struct child_test_ctx *child_tctx;
+    int num_read;
+};
+
+static void test_read_pipe_msg_done(struct tevent_req *subreq)
+{
+    struct test_pipe_msg_ctx *msg_ctx;
+    struct child_test_ctx *child_tctx;
+    uint8_t *buf;
+    ssize_t len;
+    errno_t ret;
+
+    msg_ctx = tevent_req_callback_data(subreq, struct test_pipe_msg_ctx);
+    child_tctx = msg_ctx->child_tctx;
+
+    ret = read_pipe_msg_recv(subreq, msg_ctx, &buf, &len);
+    talloc_zfree(subreq);
+    assert_int_equal(ret, EOK);
+    msg_ctx->num_read++;
+
+    if (msg_ctx->num_read == 2) {
+        /* the empty message */
+        assert_int_equal(len, 0);
+        assert_null(buf);
+        child_tctx->test_ctx->done = true;
+        return;
+    }
+
+    assert_int_equal(len, TEST_PIPE_MSG_LEN);
+    assert_int_equal(buf[0], 'x');
+    assert_int_equal(buf[TEST_PIPE_MSG_LEN - 1], 'x');
+    talloc_free(buf);
+
+    subreq = read_pipe_msg_send(msg_ctx, child_tctx->test_ctx->ev,
+                                child_tctx->pipefd_from_child[0],
+                                TEST_PIPE_MSG_LEN);
+    assert_non_null(subreq);
+    tevent_req_set_callback(subreq, test_read_pipe_msg_done, msg_ctx);
+}
+
+/* Messages written by sss_atomic_write_msg_s() are read one at a time */
+void test_read_pipe_msg(void **state)
+{
+    struct child_test_ctx *child_tctx = talloc_get_type(*state,
+                                                        struct child_test_ctx);
+    struct test_pipe_msg_ctx *msg_ctx;
+    struct tevent_req *req;
+    char msg[TEST_PIPE_MSG_LEN];
+    ssize_t written;
+    errno_t ret;
+
+    msg_ctx = talloc_zero(child_tctx, struct test_pipe_msg_ctx);
+    assert_non_null(msg_ctx);
+    msg_ctx->child_tctx = child_tctx;
+
+    memset(msg, 'x', sizeof(msg));
+
+    written = sss_atomic_write_msg_s(child_tctx->pipefd_from_child[1],
+                                     msg, sizeof(msg));
+    assert_int_equal(written, sizeof(msg));
+    written = sss_atomic_write_msg_s(child_tctx->pipefd_from_child[1],
+                                     NULL, 0);
+    assert_int_equal(written, 0);
+
+    fd_nonblocking(child_tctx->pipefd_from_child[0]);
+    req = read_pipe_msg_send(msg_ctx, child_tctx->test_ctx->ev,
+                             child_tctx->pipefd_from_child[0],
+                             TEST_PIPE_MSG_LEN);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_read_pipe_msg_done, msg_ctx);
+
+    ret = test_ev_loop(child_tctx->test_ctx);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(msg_ctx->num_read, 2);
+
+    talloc_free(msg_ctx);
+    close(child_tctx->pipefd_from_child[0]);
+    close(child_tctx->pipefd_from_child[1]);
+}
+
 void sss_child_cb(int pid, int wait_status, void *pvt);
 
 /* Just make sure the exec works. The child does nothing but exits */
@@ -534,9 +741,21 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_exec_child_echo,
                                         child_test_setup,
                                         child_test_teardown),
+        cmocka_unit_test_setup_teardown(test_spawn_child_echo,
+                                        child_test_setup,
+                                        child_test_teardown),
+        cmocka_unit_test_setup_teardown(test_spawn_child_neg,
+                                        child_test_setup,
+                                        child_test_teardown),
         cmocka_unit_test_setup_teardown(test_sss_child,
                                         child_test_setup,
                                         child_test_teardown),
+        cmocka_unit_test_setup_teardown(test_read_pipe_large,
+                                        child_test_setup,
+                                        child_test_teardown),
+        cmocka_unit_test_setup_teardown(test_read_pipe_msg,
+                                        child_test_setup,
+                                        child_test_teardown),
         cmocka_unit_test_setup_teardown(test_exec_child_only_extra_args,
                                         only_extra_args_setup,
                                         only_extra_args_teardown),
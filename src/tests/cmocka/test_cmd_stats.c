@@ -0,0 +1,301 @@
+/*
+    SSSD
+
+    Tests of the latency histograms of the responder commands
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_SERVICE "test"
+#define TEST_STATS_FILE TESTS_PATH"/cmdstats_"TEST_SERVICE
+
+/* In order to access the buckets, the statistics are kept in TESTS_PATH */
+#undef DB_PATH
+#define DB_PATH TESTS_PATH
+#include "util/cmd_stats.c"
+
+static int test_cmd_stats_setup(void **state)
+{
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    ret = mkdir(TESTS_PATH, 0700);
+    assert_true(ret == 0 || errno == EEXIST);
+
+    return 0;
+}
+
+static int test_cmd_stats_teardown(void **state)
+{
+    unlink(TEST_STATS_FILE);
+    rmdir(TESTS_PATH);
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static struct sss_cmd_stats_entry *get_entries(struct sss_cmd_stats *stats,
+                                               size_t expected)
+{
+    struct sss_cmd_stats_entry *entries;
+    size_t count;
+    errno_t ret;
+
+    ret = sss_cmd_stats_get(global_talloc_context, stats, &entries, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, expected);
+
+    return entries;
+}
+
+/* Every sample ends in the bucket whose limit is above it */
+void test_cmd_stats_buckets(void **state)
+{
+    uint64_t limit;
+    int i;
+
+    assert_int_equal(sss_cmd_stats_bucket(0), 0);
+
+    for (i = 0; i < SSS_CMD_STATS_BUCKETS - 1; i++) {
+        limit = sss_cmd_stats_bucket_limit(i);
+        assert_int_equal(sss_cmd_stats_bucket(limit - 1), i);
+        assert_int_equal(sss_cmd_stats_bucket(limit), i + 1);
+    }
+
+    /* the last bucket takes everything above */
+    assert_int_equal(sss_cmd_stats_bucket(UINT64_MAX),
+                     SSS_CMD_STATS_BUCKETS - 1);
+}
+
+/* Samples are counted by command and source */
+void test_cmd_stats_record(void **state)
+{
+    struct sss_cmd_stats *stats;
+    struct sss_cmd_stats_entry *entries;
+    errno_t ret;
+
+    ret = sss_cmd_stats_open(global_talloc_context, TEST_SERVICE, &stats);
+    assert_int_equal(ret, EOK);
+
+    /* nothing was recorded yet */
+    entries = get_entries(stats, 0);
+    talloc_free(entries);
+
+    sss_cmd_stats_add(stats, SSS_NSS_GETPWNAM, SSS_CMD_SRC_MEMORY, 10);
+    sss_cmd_stats_add(stats, SSS_NSS_GETPWNAM, SSS_CMD_SRC_MEMORY, 20);
+    sss_cmd_stats_add(stats, SSS_NSS_GETPWNAM, SSS_CMD_SRC_SYSDB, 1000);
+    sss_cmd_stats_add(stats, SSS_NSS_GETGRNAM, SSS_CMD_SRC_DP, 50000);
+
+    /* ignored */
+    sss_cmd_stats_add(stats, 0, SSS_CMD_SRC_MEMORY, 10);
+    sss_cmd_stats_add(stats, SSS_NSS_GETPWNAM, SSS_CMD_SRC_SENTINEL, 10);
+    sss_cmd_stats_add(NULL, SSS_NSS_GETPWNAM, SSS_CMD_SRC_MEMORY, 10);
+
+    entries = get_entries(stats, 3);
+
+    assert_int_equal(entries[0].cmd, SSS_NSS_GETPWNAM);
+    assert_int_equal(entries[0].source, SSS_CMD_SRC_MEMORY);
+    assert_int_equal(entries[0].count, 2);
+    assert_int_equal(entries[0].total_usec, 30);
+    assert_int_equal(entries[0].max_usec, 20);
+    assert_int_equal(entries[0].buckets[sss_cmd_stats_bucket(10)], 1);
+    assert_int_equal(entries[0].buckets[sss_cmd_stats_bucket(20)], 1);
+
+    assert_int_equal(entries[1].cmd, SSS_NSS_GETPWNAM);
+    assert_int_equal(entries[1].source, SSS_CMD_SRC_SYSDB);
+    assert_int_equal(entries[1].count, 1);
+    assert_int_equal(entries[1].max_usec, 1000);
+    assert_int_equal(entries[1].buckets[sss_cmd_stats_bucket(1000)], 1);
+
+    assert_int_equal(entries[2].cmd, SSS_NSS_GETGRNAM);
+    assert_int_equal(entries[2].source, SSS_CMD_SRC_DP);
+    assert_int_equal(entries[2].count, 1);
+    assert_int_equal(entries[2].total_usec, 50000);
+
+    talloc_free(entries);
+    talloc_free(stats);
+}
+
+/* All processes of a responder add to the same file */
+void test_cmd_stats_shared(void **state)
+{
+    struct sss_cmd_stats *stats;
+    struct sss_cmd_stats *worker_stats;
+    struct sss_cmd_stats_entry *entries;
+    uint64_t counters[SSS_CACHE_COUNTER_SENTINEL];
+    size_t count;
+    errno_t ret;
+
+    ret = sss_cmd_stats_open(global_talloc_context, TEST_SERVICE, &stats);
+    assert_int_equal(ret, EOK);
+    ret = sss_cmd_stats_open(global_talloc_context, TEST_SERVICE,
+                             &worker_stats);
+    assert_int_equal(ret, EOK);
+
+    sss_cmd_stats_add(stats, SSS_NSS_GETPWUID, SSS_CMD_SRC_SYSDB, 100);
+    sss_cmd_stats_add(worker_stats, SSS_NSS_GETPWUID, SSS_CMD_SRC_SYSDB, 300);
+    sss_cmd_stats_count(stats, SSS_CACHE_SYSDB_HIT);
+    sss_cmd_stats_count(worker_stats, SSS_CACHE_SYSDB_HIT);
+    sss_cmd_stats_count(worker_stats, SSS_CACHE_DP_LOOKUP);
+
+    /* read back by another process, e.g. InfoPipe */
+    ret = sss_cmd_stats_read(global_talloc_context, TEST_SERVICE,
+                             &entries, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 1);
+    assert_int_equal(entries[0].cmd, SSS_NSS_GETPWUID);
+    assert_int_equal(entries[0].count, 2);
+    assert_int_equal(entries[0].total_usec, 400);
+    assert_int_equal(entries[0].max_usec, 300);
+    talloc_free(entries);
+
+    ret = sss_cmd_stats_read_counters(TEST_SERVICE, counters);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(counters[SSS_CACHE_SYSDB_HIT], 2);
+    assert_int_equal(counters[SSS_CACHE_DP_LOOKUP], 1);
+    assert_int_equal(counters[SSS_CACHE_NCACHE_HIT], 0);
+
+    talloc_free(worker_stats);
+
+    /* the samples survive a restart of the responder */
+    talloc_free(stats);
+    ret = sss_cmd_stats_open(global_talloc_context, TEST_SERVICE, &stats);
+    assert_int_equal(ret, EOK);
+    entries = get_entries(stats, 1);
+    assert_int_equal(entries[0].count, 2);
+    talloc_free(entries);
+    talloc_free(stats);
+}
+
+/* A file which is not valid anymore is reset to empty histograms */
+void test_cmd_stats_reset(void **state)
+{
+    struct sss_cmd_stats *stats;
+    struct sss_cmd_stats_entry *entries;
+    uint32_t version = CMD_STATS_VERSION + 1;
+    size_t count;
+    errno_t ret;
+    int fd;
+
+    ret = sss_cmd_stats_open(global_talloc_context, TEST_SERVICE, &stats);
+    assert_int_equal(ret, EOK);
+    sss_cmd_stats_add(stats, SSS_NSS_GETPWNAM, SSS_CMD_SRC_MEMORY, 10);
+    talloc_free(stats);
+
+    /* left by another version */
+    fd = open(TEST_STATS_FILE, O_WRONLY);
+    assert_true(fd != -1);
+    assert_int_equal(pwrite(fd, &version, sizeof(version),
+                            offsetof(struct sss_cmd_stats_header, version)),
+                     sizeof(version));
+    close(fd);
+
+    ret = sss_cmd_stats_read(global_talloc_context, TEST_SERVICE,
+                             &entries, &count);
+    assert_int_equal(ret, EINVAL);
+
+    ret = sss_cmd_stats_open(global_talloc_context, TEST_SERVICE, &stats);
+    assert_int_equal(ret, EOK);
+    entries = get_entries(stats, 0);
+    talloc_free(entries);
+
+    sss_cmd_stats_add(stats, SSS_NSS_GETPWNAM, SSS_CMD_SRC_MEMORY, 10);
+    entries = get_entries(stats, 1);
+    assert_int_equal(entries[0].count, 1);
+    talloc_free(entries);
+    talloc_free(stats);
+
+    /* truncated */
+    ret = truncate(TEST_STATS_FILE, sizeof(struct sss_cmd_stats_header));
+    assert_int_equal(ret, 0);
+
+    ret = sss_cmd_stats_open(global_talloc_context, TEST_SERVICE, &stats);
+    assert_int_equal(ret, EOK);
+    entries = get_entries(stats, 0);
+    talloc_free(entries);
+    talloc_free(stats);
+}
+
+/* The name of the responder becomes part of the path */
+void test_cmd_stats_bad_service(void **state)
+{
+    struct sss_cmd_stats *stats;
+    errno_t ret;
+
+    ret = sss_cmd_stats_open(global_talloc_context, "../test", &stats);
+    assert_int_equal(ret, EINVAL);
+
+    ret = sss_cmd_stats_open(global_talloc_context, "", &stats);
+    assert_int_equal(ret, EINVAL);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_cmd_stats_buckets),
+        cmocka_unit_test_setup_teardown(test_cmd_stats_record,
+                                        test_cmd_stats_setup,
+                                        test_cmd_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_cmd_stats_shared,
+                                        test_cmd_stats_setup,
+                                        test_cmd_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_cmd_stats_reset,
+                                        test_cmd_stats_setup,
+                                        test_cmd_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_cmd_stats_bad_service,
+                                        test_cmd_stats_setup,
+                                        test_cmd_stats_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
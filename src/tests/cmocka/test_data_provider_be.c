@@ -33,6 +33,7 @@
 
 #define OFFLINE_TIMEOUT 2
 #define AS_STR(param) (#param)
+#define TEST_MAX_ACCT_REQS 8
 
 static TALLOC_CTX *global_mock_context = NULL;
 static bool global_timer_added;
@@ -60,6 +61,55 @@ struct tevent_timer *__wrap__tevent_add_timer(struct tevent_context *ev,
                                     location);
 }
 
+/* The lookups the provider got and the reply sent to the responder */
+struct test_acct_ctx {
+    struct be_req *reqs[TEST_MAX_ACCT_REQS];
+    const char *filters[TEST_MAX_ACCT_REQS];
+    int num_reqs;
+
+    int num_replies;
+    dbus_uint16_t err_maj;
+    dbus_uint32_t err_min;
+};
+
+static struct test_acct_ctx global_acct;
+
+int __wrap_sbus_request_return_and_finish(struct sbus_request *dbus_req,
+                                          int first_arg_type,
+                                          ...)
+{
+    va_list va;
+
+    assert_int_equal(first_arg_type, DBUS_TYPE_UINT16);
+
+    va_start(va, first_arg_type);
+    global_acct.err_maj = *va_arg(va, dbus_uint16_t *);
+    assert_int_equal(va_arg(va, int), DBUS_TYPE_UINT32);
+    global_acct.err_min = *va_arg(va, dbus_uint32_t *);
+    va_end(va);
+
+    global_acct.num_replies++;
+    talloc_free(dbus_req);
+    return EOK;
+}
+
+static void test_acct_handler(struct be_req *be_req)
+{
+    struct be_acct_req *ar = be_req_get_data(be_req);
+
+    assert_true(global_acct.num_reqs < TEST_MAX_ACCT_REQS);
+
+    global_acct.reqs[global_acct.num_reqs] = be_req;
+    global_acct.filters[global_acct.num_reqs] = ar->filter_value;
+    global_acct.num_reqs++;
+}
+
+/* the methods of the back end on the bus */
+extern struct data_provider_iface be_methods;
+
+static struct bet_ops test_acct_ops = {
+    .handler = test_acct_handler,
+};
 
 struct test_ctx {
     struct sss_test_ctx *tctx;
@@ -199,6 +249,125 @@ static void test_mark_subdom_offline_disabled(void **state)
                         DOM_DISABLED);
 }
 
+static void test_acct_setup(struct test_ctx *test_ctx)
+{
+    memset(&global_acct, 0, sizeof(global_acct));
+
+    test_ctx->be_ctx->bet_info[BET_ID].bet_ops = &test_acct_ops;
+    /* no negative cache of the back end */
+    test_ctx->be_ctx->domain->provider_neg_timeout = 0;
+}
+
+/* Sends a getAccountInfoMulti message for the users */
+static void test_acct_multi_send(struct test_ctx *test_ctx,
+                                 const char **filters, int num_filters)
+{
+    struct be_client *becli;
+    struct sbus_request *dbus_req;
+    DBusMessage *msg;
+    dbus_uint32_t type = BE_REQ_USER;
+    dbus_uint32_t attr_type = BE_ATTR_CORE;
+    const char *domain = TEST_DOM_NAME;
+    dbus_bool_t dbret;
+    int ret;
+
+    becli = talloc_zero(test_ctx, struct be_client);
+    assert_non_null(becli);
+    becli->bectx = test_ctx->be_ctx;
+
+    msg = dbus_message_new_method_call(NULL, DP_PATH,
+                                       DATA_PROVIDER_IFACE,
+                                       DATA_PROVIDER_IFACE_GETACCOUNTINFOMULTI);
+    assert_non_null(msg);
+    dbret = dbus_message_append_args(msg,
+                                     DBUS_TYPE_UINT32, &type,
+                                     DBUS_TYPE_UINT32, &attr_type,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                     &filters, num_filters,
+                                     DBUS_TYPE_STRING, &domain,
+                                     DBUS_TYPE_INVALID);
+    assert_true(dbret);
+
+    dbus_req = talloc_zero(becli, struct sbus_request);
+    assert_non_null(dbus_req);
+    dbus_req->message = msg;
+
+    ret = be_methods.getAccountInfoMulti(dbus_req, becli);
+    assert_int_equal(ret, EOK);
+
+    dbus_message_unref(msg);
+}
+
+static void test_acct_wait_reqs(struct test_ctx *test_ctx, int num_reqs)
+{
+    while (global_acct.num_reqs < num_reqs) {
+        assert_int_equal(tevent_loop_once(test_ctx->tctx->ev), 0);
+    }
+}
+
+/* All lookups are handed to the provider, the reply waits for the last */
+static void test_acct_multi(void **state)
+{
+    struct test_ctx *test_ctx = talloc_get_type(*state, struct test_ctx);
+    const char *filters[] = { "name=alice", "name=bob", "idnumber=1003" };
+
+    test_acct_setup(test_ctx);
+    test_acct_multi_send(test_ctx, filters, 3);
+
+    test_acct_wait_reqs(test_ctx, 3);
+    assert_string_equal(global_acct.filters[0], "alice");
+    assert_string_equal(global_acct.filters[1], "bob");
+    assert_string_equal(global_acct.filters[2], "1003");
+
+    be_req_terminate(global_acct.reqs[0], DP_ERR_OK, EOK, NULL);
+    be_req_terminate(global_acct.reqs[2], DP_ERR_OK, EOK, NULL);
+    assert_int_equal(global_acct.num_replies, 0);
+
+    be_req_terminate(global_acct.reqs[1], DP_ERR_OK, EOK, NULL);
+    assert_int_equal(global_acct.num_replies, 1);
+    assert_int_equal(global_acct.err_maj, DP_ERR_OK);
+    assert_int_equal(global_acct.err_min, EOK);
+}
+
+/* The reply is that of the lookup which failed */
+static void test_acct_multi_failed(void **state)
+{
+    struct test_ctx *test_ctx = talloc_get_type(*state, struct test_ctx);
+    const char *filters[] = { "name=alice", "name=bob" };
+
+    test_acct_setup(test_ctx);
+    test_acct_multi_send(test_ctx, filters, 2);
+
+    test_acct_wait_reqs(test_ctx, 2);
+    be_req_terminate(global_acct.reqs[0], DP_ERR_FATAL, EIO, NULL);
+    assert_int_equal(global_acct.num_replies, 0);
+
+    be_req_terminate(global_acct.reqs[1], DP_ERR_OK, EOK, NULL);
+    assert_int_equal(global_acct.num_replies, 1);
+    assert_int_equal(global_acct.err_maj, DP_ERR_FATAL);
+    assert_int_equal(global_acct.err_min, EIO);
+}
+
+/* One invalid filter rejects the whole message */
+static void test_acct_multi_invalid(void **state)
+{
+    struct test_ctx *test_ctx = talloc_get_type(*state, struct test_ctx);
+    const char *filters[] = { "name=alice", "bogus" };
+
+    test_acct_setup(test_ctx);
+    test_acct_multi_send(test_ctx, filters, 2);
+
+    assert_int_equal(global_acct.num_replies, 1);
+    assert_int_equal(global_acct.err_maj, DP_ERR_FATAL);
+    assert_int_equal(global_acct.err_min, EINVAL);
+    assert_null(test_ctx->be_ctx->dispatch);
+
+    test_acct_multi_send(test_ctx, filters, 0);
+    assert_int_equal(global_acct.num_replies, 2);
+    assert_int_equal(global_acct.err_min, EINVAL);
+    assert_int_equal(global_acct.num_reqs, 0);
+}
+
 int main(int argc, const char *argv[])
 {
     poptContext pc;
@@ -223,6 +392,15 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_mark_subdom_offline_disabled,
                                         test_setup,
                                         test_teardown),
+        cmocka_unit_test_setup_teardown(test_acct_multi,
+                                        test_setup,
+                                        test_teardown),
+        cmocka_unit_test_setup_teardown(test_acct_multi_failed,
+                                        test_setup,
+                                        test_teardown),
+        cmocka_unit_test_setup_teardown(test_acct_multi_invalid,
+                                        test_setup,
+                                        test_teardown),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
@@ -26,6 +26,7 @@
 #include "tests/cmocka/common_mock.h"
 #include "tests/cmocka/common_mock_resp.h"
 #include "responder/ifp/ifp_private.h"
+#include "responder/common/responder_cache_req.h"
 #include "sbus/sssd_dbus_private.h"
 
 /* dbus library checks for valid object paths when unit testing, we don't
@@ -354,6 +355,395 @@ void test_attr_allowed(void **state)
     assert_false(ifp_attr_allowed(NULL, "name"));
 }
 
+static char *test_list_build_path(TALLOC_CTX *mem_ctx,
+                                  struct sss_domain_info *domain,
+                                  struct ldb_message *msg)
+{
+    return talloc_strdup(mem_ctx,
+                         ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL));
+}
+
+void test_list_cursor(void **state)
+{
+    struct ifp_ctx *ifp_ctx;
+    struct sbus_request *sr;
+    struct ifp_list_cursor *cursor;
+    struct ifp_list_cursor *cursor2;
+    struct ldb_result *result;
+    const char **paths;
+    size_t count;
+    uint32_t next_offset;
+    errno_t ret;
+    int i;
+
+    ifp_ctx = mock_ifp_ctx(global_talloc_context);
+    assert_non_null(ifp_ctx);
+
+    ifp_ctx->rctx->ev = tevent_context_init(ifp_ctx);
+    assert_non_null(ifp_ctx->rctx->ev);
+
+    ret = sss_hash_create(ifp_ctx, 0, &ifp_ctx->list_cursors);
+    assert_int_equal(ret, EOK);
+
+    sr = mock_sbus_request(ifp_ctx, geteuid());
+    assert_non_null(sr);
+
+    result = talloc_zero(sr, struct ldb_result);
+    assert_non_null(result);
+    result->count = 5;
+    result->msgs = talloc_zero_array(result, struct ldb_message *,
+                                     result->count);
+    assert_non_null(result->msgs);
+    for (i = 0; i < result->count; i++) {
+        result->msgs[i] = ldb_msg_new(result->msgs);
+        assert_non_null(result->msgs[i]);
+        ret = ldb_msg_add_string(result->msgs[i], SYSDB_NAME,
+                                 talloc_asprintf(result->msgs[i],
+                                                 "user%d", i));
+        assert_int_equal(ret, EOK);
+    }
+
+    cursor = ifp_list_cursor_new(sr, ifp_ctx, sr, "test.List", NULL, "user*");
+    assert_non_null(cursor);
+
+    ret = ifp_list_cursor_add(cursor, NULL, result, test_list_build_path);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(cursor->path_count, 5);
+
+    paths = ifp_list_cursor_page(cursor, 0, 2, &count, &next_offset);
+    assert_int_equal(count, 2);
+    assert_int_equal(next_offset, 2);
+    assert_string_equal(paths[0], "user0");
+    assert_string_equal(paths[1], "user1");
+
+    paths = ifp_list_cursor_page(cursor, 4, 2, &count, &next_offset);
+    assert_int_equal(count, 1);
+    assert_int_equal(next_offset, 0);
+    assert_string_equal(paths[0], "user4");
+
+    paths = ifp_list_cursor_page(cursor, 5, 2, &count, &next_offset);
+    assert_int_equal(count, 0);
+    assert_int_equal(next_offset, 0);
+
+    /* no limit returns everything left */
+    paths = ifp_list_cursor_page(cursor, 1, 0, &count, &next_offset);
+    assert_int_equal(count, 4);
+    assert_int_equal(next_offset, 0);
+
+    /* a cursor which is kept is owned by the responder */
+    assert_null(ifp_list_cursor_lookup(ifp_ctx, cursor->key.str));
+    ifp_list_cursor_register(cursor);
+    assert_true(cursor->in_table);
+    assert_ptr_equal(talloc_parent(cursor), ifp_ctx);
+    assert_ptr_equal(ifp_list_cursor_lookup(ifp_ctx, cursor->key.str),
+                     cursor);
+    assert_non_null(cursor->timeout);
+
+    /* a different list of the same client gets its own cursor */
+    cursor2 = ifp_list_cursor_new(sr, ifp_ctx, sr, "test.List", NULL, "adm*");
+    assert_non_null(cursor2);
+    assert_null(ifp_list_cursor_lookup(ifp_ctx, cursor2->key.str));
+    talloc_free(cursor2);
+
+    /* a new lookup of the same list replaces the previous cursor */
+    cursor2 = ifp_list_cursor_new(sr, ifp_ctx, sr, "test.List", NULL, "user*");
+    assert_non_null(cursor2);
+    ifp_list_cursor_register(cursor2);
+    assert_true(cursor2->in_table);
+    assert_ptr_equal(ifp_list_cursor_lookup(ifp_ctx, cursor2->key.str),
+                     cursor2);
+    assert_int_equal(hash_count(ifp_ctx->list_cursors), 1);
+
+    talloc_free(cursor2);
+    assert_int_equal(hash_count(ifp_ctx->list_cursors), 0);
+
+    dbus_message_unref(sr->message);
+    talloc_free(ifp_ctx);
+}
+
+/* Mocked lookups of GetUsersAttr, answered in the order they were sent */
+#define TEST_USERS_ATTR_PARALLEL 32 /* IFP_USERS_ATTR_PARALLEL */
+#define TEST_USERS_ATTR_MAX 40
+
+struct ifp_test_users_ctx {
+    struct sss_domain_info *dom;
+    DBusMessage *reply;
+    int in_flight;
+    int max_in_flight;
+};
+
+static struct ifp_test_users_ctx *users_ctx;
+
+struct tevent_req *__wrap_cache_req_send(TALLOC_CTX *mem_ctx,
+                                         struct tevent_context *ev,
+                                         struct resp_ctx *rctx,
+                                         struct sss_nc_ctx *ncache,
+                                         int neg_timeout,
+                                         int cache_refresh_percent,
+                                         const char *domain,
+                                         struct cache_req_input *input)
+{
+    users_ctx->in_flight++;
+    users_ctx->max_in_flight = MAX(users_ctx->max_in_flight,
+                                   users_ctx->in_flight);
+
+    return test_request_send(mem_ctx, ev, sss_mock_type(errno_t));
+}
+
+errno_t __wrap_cache_req_recv(TALLOC_CTX *mem_ctx,
+                              struct tevent_req *req,
+                              struct ldb_result **_result,
+                              struct sss_domain_info **_domain,
+                              char **_name)
+{
+    users_ctx->in_flight--;
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_result = talloc_zero(mem_ctx, struct ldb_result);
+    assert_non_null(*_result);
+    *_domain = users_ctx->dom;
+    return EOK;
+}
+
+/* Returns every requested attribute, the reply must only carry the
+ * whitelisted ones */
+int __wrap_sysdb_get_user_attr_with_views(TALLOC_CTX *mem_ctx,
+                                          struct sss_domain_info *domain,
+                                          const char *name,
+                                          const char **attributes,
+                                          struct ldb_result **_res)
+{
+    struct ldb_result *res;
+    int ret;
+
+    assert_ptr_equal(domain, users_ctx->dom);
+
+    res = talloc_zero(mem_ctx, struct ldb_result);
+    assert_non_null(res);
+    res->count = 1;
+    res->msgs = talloc_zero_array(res, struct ldb_message *, 1);
+    assert_non_null(res->msgs);
+    res->msgs[0] = ldb_msg_new(res->msgs);
+    assert_non_null(res->msgs[0]);
+
+    ret = ldb_msg_add_string(res->msgs[0], SYSDB_NAME, name);
+    assert_int_equal(ret, EOK);
+    ret = ldb_msg_add_string(res->msgs[0], SYSDB_UIDNUM, "1000");
+    assert_int_equal(ret, EOK);
+    ret = ldb_msg_add_string(res->msgs[0], "secret", "hidden");
+    assert_int_equal(ret, EOK);
+
+    *_res = res;
+    return EOK;
+}
+
+int __wrap_sbus_request_finish(struct sbus_request *dbus_req,
+                               DBusMessage *reply)
+{
+    assert_non_null(reply);
+    assert_null(users_ctx->reply);
+    users_ctx->reply = reply;
+    return EOK;
+}
+
+static void users_attr_call(struct sbus_request *sr,
+                            const char **users, int nusers,
+                            const char **attrs, int nattrs)
+{
+    dbus_bool_t dbret;
+
+    dbret = dbus_message_append_args(sr->message,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                     &users, nusers,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                     &attrs, nattrs,
+                                     DBUS_TYPE_INVALID);
+    assert_true(dbret == TRUE);
+}
+
+/* Checks the a{sa{sv}} reply, every user has its name and the UID */
+static void assert_users_reply(DBusMessage *reply,
+                               const char **expected, int nexpected)
+{
+    DBusMessageIter iter;
+    DBusMessageIter iter_users;
+    DBusMessageIter iter_entry;
+    DBusMessageIter iter_dict;
+    DBusMessageIter iter_attr;
+    DBusMessageIter iter_val;
+    const char *user;
+    const char *attr;
+    const char *val;
+    int i;
+
+    assert_true(dbus_message_iter_init(reply, &iter));
+    assert_int_equal(dbus_message_iter_get_arg_type(&iter), DBUS_TYPE_ARRAY);
+    dbus_message_iter_recurse(&iter, &iter_users);
+
+    for (i = 0; i < nexpected; i++) {
+        assert_int_equal(dbus_message_iter_get_arg_type(&iter_users),
+                         DBUS_TYPE_DICT_ENTRY);
+        dbus_message_iter_recurse(&iter_users, &iter_entry);
+        dbus_message_iter_get_basic(&iter_entry, &user);
+        assert_string_equal(user, expected[i]);
+
+        assert_true(dbus_message_iter_next(&iter_entry));
+        dbus_message_iter_recurse(&iter_entry, &iter_dict);
+
+        dbus_message_iter_recurse(&iter_dict, &iter_attr);
+        dbus_message_iter_get_basic(&iter_attr, &attr);
+        assert_string_equal(attr, SYSDB_NAME);
+        assert_true(dbus_message_iter_next(&iter_attr));
+        dbus_message_iter_recurse(&iter_attr, &iter_val);
+        dbus_message_iter_recurse(&iter_val, &iter_val);
+        dbus_message_iter_get_basic(&iter_val, &val);
+        assert_string_equal(val, expected[i]);
+
+        assert_true(dbus_message_iter_next(&iter_dict));
+        dbus_message_iter_recurse(&iter_dict, &iter_attr);
+        dbus_message_iter_get_basic(&iter_attr, &attr);
+        assert_string_equal(attr, SYSDB_UIDNUM);
+
+        /* "secret" is not in the whitelist */
+        assert_false(dbus_message_iter_next(&iter_dict));
+
+        dbus_message_iter_next(&iter_users);
+    }
+
+    assert_int_equal(dbus_message_iter_get_arg_type(&iter_users),
+                     DBUS_TYPE_INVALID);
+}
+
+static struct sbus_request *users_attr_setup(struct ifp_ctx **_ifp_ctx)
+{
+    struct ifp_ctx *ifp_ctx;
+    struct sbus_request *sr;
+
+    users_ctx = talloc_zero(global_talloc_context,
+                            struct ifp_test_users_ctx);
+    assert_non_null(users_ctx);
+    users_ctx->dom = talloc_zero(users_ctx, struct sss_domain_info);
+    assert_non_null(users_ctx->dom);
+
+    ifp_ctx = mock_ifp_ctx(users_ctx);
+    assert_non_null(ifp_ctx);
+    ifp_ctx->rctx->ev = tevent_context_init(ifp_ctx);
+    assert_non_null(ifp_ctx->rctx->ev);
+    ifp_ctx->user_whitelist = ifp_parse_user_attr_list(ifp_ctx, NULL);
+    assert_non_null(ifp_ctx->user_whitelist);
+
+    sr = mock_sbus_request(ifp_ctx, geteuid());
+    assert_non_null(sr);
+
+    *_ifp_ctx = ifp_ctx;
+    return sr;
+}
+
+static void users_attr_wait(struct ifp_ctx *ifp_ctx)
+{
+    while (users_ctx->reply == NULL) {
+        assert_int_equal(tevent_loop_once(ifp_ctx->rctx->ev), 0);
+    }
+}
+
+static void users_attr_teardown(struct sbus_request *sr)
+{
+    dbus_message_unref(users_ctx->reply);
+    dbus_message_unref(sr->message);
+    talloc_zfree(users_ctx);
+}
+
+/* Users which are not found are left out, the others are reported in the
+ * order they were asked for with the whitelisted attributes only */
+void test_users_get_attr(void **state)
+{
+    struct ifp_ctx *ifp_ctx;
+    struct sbus_request *sr;
+    const char *users[] = { "alice", "missing", "bob" };
+    const char *attrs[] = { SYSDB_NAME, "secret", SYSDB_UIDNUM };
+    const char *expected[] = { "alice", "bob" };
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    sr = users_attr_setup(&ifp_ctx);
+    users_attr_call(sr, users, 3, attrs, 3);
+
+    mock_parse_inp("alice", NULL, EOK);
+    mock_parse_inp("missing", NULL, EOK);
+    mock_parse_inp("bob", NULL, EOK);
+    will_return(__wrap_cache_req_send, EOK);
+    will_return(__wrap_cache_req_send, ENOENT);
+    will_return(__wrap_cache_req_send, EOK);
+
+    ret = ifp_users_get_attr(sr, ifp_ctx);
+    assert_int_equal(ret, EOK);
+    users_attr_wait(ifp_ctx);
+
+    assert_users_reply(users_ctx->reply, expected, 2);
+    assert_int_equal(users_ctx->in_flight, 0);
+
+    users_attr_teardown(sr);
+    assert_true(leak_check_teardown());
+}
+
+/* Only a limited number of users is looked up at the same time */
+void test_users_get_attr_many(void **state)
+{
+    struct ifp_ctx *ifp_ctx;
+    struct sbus_request *sr;
+    const char *users[TEST_USERS_ATTR_MAX];
+    const char *attrs[] = { SYSDB_NAME, SYSDB_UIDNUM };
+    errno_t ret;
+    int i;
+
+    assert_true(leak_check_setup());
+
+    sr = users_attr_setup(&ifp_ctx);
+
+    for (i = 0; i < TEST_USERS_ATTR_MAX; i++) {
+        users[i] = talloc_asprintf(users_ctx, "user%d", i);
+        assert_non_null(users[i]);
+        mock_parse_inp(users[i], NULL, EOK);
+        will_return(__wrap_cache_req_send, EOK);
+    }
+    users_attr_call(sr, users, TEST_USERS_ATTR_MAX, attrs, 2);
+
+    ret = ifp_users_get_attr(sr, ifp_ctx);
+    assert_int_equal(ret, EOK);
+    users_attr_wait(ifp_ctx);
+
+    assert_users_reply(users_ctx->reply, users, TEST_USERS_ATTR_MAX);
+    assert_int_equal(users_ctx->max_in_flight, TEST_USERS_ATTR_PARALLEL);
+
+    users_attr_teardown(sr);
+    assert_true(leak_check_teardown());
+}
+
+/* An empty list of users gets an empty reply right away */
+void test_users_get_attr_empty(void **state)
+{
+    struct ifp_ctx *ifp_ctx;
+    struct sbus_request *sr;
+    const char *users[] = { NULL };
+    const char *attrs[] = { SYSDB_NAME };
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    sr = users_attr_setup(&ifp_ctx);
+    users_attr_call(sr, users, 0, attrs, 1);
+
+    ret = ifp_users_get_attr(sr, ifp_ctx);
+    assert_int_equal(ret, EOK);
+    assert_non_null(users_ctx->reply);
+    assert_users_reply(users_ctx->reply, NULL, 0);
+    assert_int_equal(users_ctx->max_in_flight, 0);
+
+    users_attr_teardown(sr);
+    assert_true(leak_check_teardown());
+}
+
 struct ifp_test_req_ctx {
     struct ifp_req *ireq;
     struct sbus_request *sr;
@@ -417,6 +807,10 @@ int main(int argc, const char *argv[])
         cmocka_unit_test(test_attr_acl),
         cmocka_unit_test(test_attr_acl_ex),
         cmocka_unit_test(test_attr_allowed),
+        cmocka_unit_test(test_list_cursor),
+        cmocka_unit_test(test_users_get_attr),
+        cmocka_unit_test(test_users_get_attr_many),
+        cmocka_unit_test(test_users_get_attr_empty),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
@@ -0,0 +1,427 @@
+/*
+    SSSD
+
+    Unit tests and a benchmark of the conversion of IPA sudo rules
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <errno.h>
+#include <popt.h>
+#include <time.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_sudo.h"
+#include "providers/ipa/ipa_sudo.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_ipa_sudo_conversion_conf.ldb"
+#define TEST_DOM_NAME "ipa_sudo_conversion_test"
+#define TEST_ID_PROVIDER "ipa"
+
+#define TEST_BASE "dc=example,dc=com"
+#define TEST_CMD_DN(uuid) "ipaUniqueID=" uuid ",cn=sudocmds,cn=sudo," TEST_BASE
+#define TEST_CMDGROUP_DN(name) "cn=" name ",cn=sudocmdgroups,cn=sudo," TEST_BASE
+
+#define BENCH_RULES 2000
+#define BENCH_CMDS 5000
+#define BENCH_CMDGROUPS 100
+#define BENCH_CMDGROUP_MEMBERS 50
+#define BENCH_RULE_CMDGROUPS 3
+#define BENCH_RULE_CMDS 10
+#define BENCH_RULE_USERS 20
+
+struct ipa_sudo_conv_test_ctx {
+    struct sss_test_ctx *tctx;
+
+    struct sdap_attr_map map_rule[IPA_OPTS_SUDORULE + 1];
+    struct sdap_attr_map map_cmdgroup[IPA_OPTS_SUDOCMDGROUP + 1];
+    struct sdap_attr_map map_cmd[IPA_OPTS_SUDOCMD + 1];
+    struct sdap_attr_map map_user[SDAP_OPTS_USER + 1];
+    struct sdap_attr_map map_group[SDAP_OPTS_GROUP + 1];
+    struct sdap_attr_map map_host[IPA_OPTS_HOST + 1];
+    struct sdap_attr_map map_hostgroup[IPA_OPTS_HOSTGROUP + 1];
+
+    struct ipa_sudo_conv *conv;
+};
+
+static int ipa_sudo_conv_test_setup(void **state)
+{
+    struct ipa_sudo_conv_test_ctx *test_ctx;
+
+    test_ctx = talloc_zero(NULL, struct ipa_sudo_conv_test_ctx);
+    assert_non_null(test_ctx);
+    *state = test_ctx;
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME,
+                                         TEST_ID_PROVIDER, NULL);
+    assert_non_null(test_ctx->tctx);
+
+    /* only the names the conversion uses */
+    test_ctx->map_cmdgroup[IPA_OC_SUDOCMDGROUP].name = discard_const("ipasudocmdgrp");
+    test_ctx->map_cmdgroup[IPA_AT_SUDOCMDGROUP_NAME].name = discard_const("cn");
+    test_ctx->map_cmd[IPA_OC_SUDOCMD].name = discard_const("ipasudocmd");
+    test_ctx->map_cmd[IPA_AT_SUDOCMD_UUID].name = discard_const("ipaUniqueID");
+    test_ctx->map_user[SDAP_AT_USER_NAME].name = discard_const("uid");
+    test_ctx->map_group[SDAP_AT_GROUP_NAME].name = discard_const("cn");
+    test_ctx->map_host[IPA_AT_HOST_FQDN].name = discard_const("fqdn");
+    test_ctx->map_hostgroup[IPA_AT_HOSTGROUP_NAME].name = discard_const("cn");
+
+    test_ctx->conv = ipa_sudo_conv_init(test_ctx, test_ctx->tctx->sysdb,
+                                        test_ctx->map_rule,
+                                        test_ctx->map_cmdgroup,
+                                        test_ctx->map_cmd,
+                                        test_ctx->map_user,
+                                        test_ctx->map_group,
+                                        test_ctx->map_host,
+                                        test_ctx->map_hostgroup);
+    assert_non_null(test_ctx->conv);
+
+    return 0;
+}
+
+static int ipa_sudo_conv_test_teardown(void **state)
+{
+    talloc_zfree(*state);
+    return 0;
+}
+
+static struct sysdb_attrs *
+mock_rule(TALLOC_CTX *mem_ctx, const char *name)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(mem_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_NAME, name);
+    assert_int_equal(ret, EOK);
+
+    return attrs;
+}
+
+static struct sysdb_attrs *
+mock_cmd(TALLOC_CTX *mem_ctx, const char *dn, const char *cmd)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(mem_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, dn);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_IPA_SUDOCMD_SUDOCMD, cmd);
+    assert_int_equal(ret, EOK);
+
+    return attrs;
+}
+
+static struct sysdb_attrs *
+mock_cmdgroup(TALLOC_CTX *mem_ctx, const char *dn, const char **members)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+    int i;
+
+    attrs = sysdb_new_attrs(mem_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, dn);
+    assert_int_equal(ret, EOK);
+
+    for (i = 0; members[i] != NULL; i++) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_MEMBER, members[i]);
+        assert_int_equal(ret, EOK);
+    }
+
+    return attrs;
+}
+
+static void assert_values(struct sysdb_attrs *attrs,
+                          const char *name,
+                          const char **expected)
+{
+    struct ldb_message_element *el;
+    unsigned int i;
+    errno_t ret;
+
+    ret = sysdb_attrs_get_el_ext(attrs, name, false, &el);
+    assert_int_equal(ret, EOK);
+
+    for (i = 0; expected[i] != NULL; i++) {
+        assert_true(i < el->num_values);
+        assert_string_equal((const char *) el->values[i].data, expected[i]);
+    }
+    assert_int_equal(el->num_values, i);
+}
+
+static void test_conv_commands(void **state)
+{
+    struct ipa_sudo_conv_test_ctx *test_ctx;
+    struct sysdb_attrs *rule;
+    struct sysdb_attrs *cmds[3];
+    struct sysdb_attrs *cmdgroup;
+    struct sysdb_attrs **result;
+    size_t num_result;
+    const char *members[] = { TEST_CMD_DN("1"), TEST_CMD_DN("2"), NULL };
+    const char *expected[] = { "ALL", "/bin/b", "/bin/a", "!/bin/c", NULL };
+    errno_t ret;
+
+    test_ctx = talloc_get_type_abort(*state, struct ipa_sudo_conv_test_ctx);
+
+    rule = mock_rule(test_ctx, "rule1");
+    ret = sysdb_attrs_add_string(rule, SYSDB_IPA_SUDORULE_CMDCATEGORY, "all");
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, SYSDB_IPA_SUDORULE_ALLOWCMD,
+                                 TEST_CMDGROUP_DN("group1"));
+    assert_int_equal(ret, EOK);
+    /* already a member of the command group */
+    ret = sysdb_attrs_add_string(rule, SYSDB_IPA_SUDORULE_ALLOWCMD,
+                                 TEST_CMD_DN("1"));
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, SYSDB_IPA_SUDORULE_DENYCMD,
+                                 TEST_CMD_DN("3"));
+    assert_int_equal(ret, EOK);
+
+    ret = ipa_sudo_conv_rules(test_ctx->conv, &rule, 1);
+    assert_int_equal(ret, EOK);
+
+    cmdgroup = mock_cmdgroup(test_ctx, TEST_CMDGROUP_DN("group1"), members);
+    ret = ipa_sudo_conv_cmdgroups(test_ctx->conv, &cmdgroup, 1);
+    assert_int_equal(ret, EOK);
+
+    cmds[0] = mock_cmd(test_ctx, TEST_CMD_DN("1"), "/bin/a");
+    cmds[1] = mock_cmd(test_ctx, TEST_CMD_DN("2"), "/bin/b");
+    cmds[2] = mock_cmd(test_ctx, TEST_CMD_DN("3"), "/bin/c");
+    ret = ipa_sudo_conv_cmds(test_ctx->conv, cmds, 3);
+    assert_int_equal(ret, EOK);
+
+    ret = ipa_sudo_conv_result(test_ctx, test_ctx->conv, &result, &num_result);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(num_result, 1);
+
+    /* the members are kept in a list which is built in reverse */
+    assert_values(result[0], SYSDB_SUDO_CACHE_AT_COMMAND, expected);
+}
+
+static void test_conv_members(void **state)
+{
+    struct ipa_sudo_conv_test_ctx *test_ctx;
+    struct sysdb_attrs *rules[2];
+    struct sysdb_attrs **result;
+    size_t num_result;
+    const char *exp_users[] = { "user1", "%group1", NULL };
+    const char *exp_hosts[] = { "host1.example.com", "+hostgroup1", NULL };
+    size_t i;
+    errno_t ret;
+
+    test_ctx = talloc_get_type_abort(*state, struct ipa_sudo_conv_test_ctx);
+
+    /* both rules hit the same converted values */
+    for (i = 0; i < 2; i++) {
+        rules[i] = mock_rule(test_ctx, i == 0 ? "rule1" : "rule2");
+
+        ret = sysdb_attrs_add_string(rules[i], SYSDB_IPA_SUDORULE_USER,
+                            "uid=user1,cn=users,cn=accounts," TEST_BASE);
+        assert_int_equal(ret, EOK);
+        ret = sysdb_attrs_add_string(rules[i], SYSDB_IPA_SUDORULE_USER,
+                            "cn=group1,cn=groups,cn=accounts," TEST_BASE);
+        assert_int_equal(ret, EOK);
+        ret = sysdb_attrs_add_string(rules[i], SYSDB_IPA_SUDORULE_HOST,
+                "fqdn=host1.example.com,cn=computers,cn=accounts," TEST_BASE);
+        assert_int_equal(ret, EOK);
+        ret = sysdb_attrs_add_string(rules[i], SYSDB_IPA_SUDORULE_HOST,
+                "cn=hostgroup1,cn=hostgroups,cn=accounts," TEST_BASE);
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = ipa_sudo_conv_rules(test_ctx->conv, rules, 2);
+    assert_int_equal(ret, EOK);
+
+    ret = ipa_sudo_conv_result(test_ctx, test_ctx->conv, &result, &num_result);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(num_result, 2);
+
+    for (i = 0; i < num_result; i++) {
+        assert_values(result[i], SYSDB_SUDO_CACHE_AT_USER, exp_users);
+        assert_values(result[i], SYSDB_SUDO_CACHE_AT_HOST, exp_hosts);
+    }
+}
+
+static void test_conv_bench(void **state)
+{
+    struct ipa_sudo_conv_test_ctx *test_ctx;
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_attrs **rules;
+    struct sysdb_attrs **cmdgroups;
+    struct sysdb_attrs **cmds;
+    struct sysdb_attrs **result;
+    struct timespec start;
+    struct timespec end;
+    size_t num_result;
+    const char **members;
+    char *dn;
+    char *value;
+    size_t i;
+    size_t j;
+    errno_t ret;
+
+    test_ctx = talloc_get_type_abort(*state, struct ipa_sudo_conv_test_ctx);
+
+    tmp_ctx = talloc_new(test_ctx);
+    assert_non_null(tmp_ctx);
+
+    rules = talloc_array(tmp_ctx, struct sysdb_attrs *, BENCH_RULES);
+    cmdgroups = talloc_array(tmp_ctx, struct sysdb_attrs *, BENCH_CMDGROUPS);
+    cmds = talloc_array(tmp_ctx, struct sysdb_attrs *, BENCH_CMDS);
+    members = talloc_zero_array(tmp_ctx, const char *,
+                                BENCH_CMDGROUP_MEMBERS + 1);
+    assert_non_null(rules);
+    assert_non_null(cmdgroups);
+    assert_non_null(cmds);
+    assert_non_null(members);
+
+    for (i = 0; i < BENCH_RULES; i++) {
+        value = talloc_asprintf(tmp_ctx, "rule%zu", i);
+        rules[i] = mock_rule(tmp_ctx, value);
+
+        for (j = 0; j < BENCH_RULE_CMDGROUPS; j++) {
+            dn = talloc_asprintf(tmp_ctx, TEST_CMDGROUP_DN("group%zu"),
+                                 (i + j) % BENCH_CMDGROUPS);
+            ret = sysdb_attrs_add_string(rules[i], SYSDB_IPA_SUDORULE_ALLOWCMD,
+                                         dn);
+            assert_int_equal(ret, EOK);
+        }
+
+        for (j = 0; j < BENCH_RULE_CMDS; j++) {
+            dn = talloc_asprintf(tmp_ctx, TEST_CMD_DN("%zu"),
+                                 (i * BENCH_RULE_CMDS + j) % BENCH_CMDS);
+            ret = sysdb_attrs_add_string(rules[i], j % 2 == 0
+                                            ? SYSDB_IPA_SUDORULE_ALLOWCMD
+                                            : SYSDB_IPA_SUDORULE_DENYCMD, dn);
+            assert_int_equal(ret, EOK);
+        }
+
+        for (j = 0; j < BENCH_RULE_USERS; j++) {
+            dn = talloc_asprintf(tmp_ctx,
+                                 "uid=user%zu,cn=users,cn=accounts," TEST_BASE,
+                                 (i + j) % 100);
+            ret = sysdb_attrs_add_string(rules[i], SYSDB_IPA_SUDORULE_USER, dn);
+            assert_int_equal(ret, EOK);
+        }
+    }
+
+    for (i = 0; i < BENCH_CMDGROUPS; i++) {
+        for (j = 0; j < BENCH_CMDGROUP_MEMBERS; j++) {
+            members[j] = talloc_asprintf(members, TEST_CMD_DN("%zu"),
+                                (i * BENCH_CMDGROUP_MEMBERS + j) % BENCH_CMDS);
+        }
+
+        dn = talloc_asprintf(tmp_ctx, TEST_CMDGROUP_DN("group%zu"), i);
+        cmdgroups[i] = mock_cmdgroup(tmp_ctx, dn, members);
+    }
+
+    for (i = 0; i < BENCH_CMDS; i++) {
+        dn = talloc_asprintf(tmp_ctx, TEST_CMD_DN("%zu"), i);
+        value = talloc_asprintf(tmp_ctx, "/usr/bin/cmd%zu", i);
+        cmds[i] = mock_cmd(tmp_ctx, dn, value);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ret = ipa_sudo_conv_rules(test_ctx->conv, rules, BENCH_RULES);
+    assert_int_equal(ret, EOK);
+
+    ret = ipa_sudo_conv_cmdgroups(test_ctx->conv, cmdgroups, BENCH_CMDGROUPS);
+    assert_int_equal(ret, EOK);
+
+    ret = ipa_sudo_conv_cmds(test_ctx->conv, cmds, BENCH_CMDS);
+    assert_int_equal(ret, EOK);
+
+    ret = ipa_sudo_conv_result(tmp_ctx, test_ctx->conv, &result, &num_result);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(num_result, BENCH_RULES);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    print_message("Converted %d rules with %d commands in %.3f seconds\n",
+                  BENCH_RULES, BENCH_CMDS,
+                  (end.tv_sec - start.tv_sec)
+                      + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    talloc_free(tmp_ctx);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_conv_commands,
+                                        ipa_sudo_conv_test_setup,
+                                        ipa_sudo_conv_test_teardown),
+        cmocka_unit_test_setup_teardown(test_conv_members,
+                                        ipa_sudo_conv_test_setup,
+                                        ipa_sudo_conv_test_teardown),
+        cmocka_unit_test_setup_teardown(test_conv_bench,
+                                        ipa_sudo_conv_test_setup,
+                                        ipa_sudo_conv_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
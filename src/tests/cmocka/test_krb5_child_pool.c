@@ -0,0 +1,311 @@
+/*
+    SSSD
+
+    Kerberos 5 Backend Module - Tests of the pool of krb5_child workers
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <poll.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "providers/krb5/krb5_opts.h"
+
+/* In order to access the pool and to build the requests, KRB5_CHILD points
+ * to dummy-krb5-child */
+#include "providers/krb5/krb5_child_handler.c"
+
+#define TEST_UPN "user@TEST.REALM"
+#define TEST_USER "user"
+#define TEST_KEYTAB "/etc/krb5.keytab"
+
+struct pool_test_ctx {
+    struct tevent_context *ev;
+    struct krb5_ctx *krb5_ctx;
+    int done;
+
+    /* inherited by the workers and their copies, the read end sees EOF
+     * once all of them are gone */
+    int hold_fd[2];
+};
+
+struct pool_test_req {
+    struct pool_test_ctx *tctx;
+    struct krb5child_req *kr;
+    uint8_t *buf;
+    ssize_t len;
+    errno_t ret;
+};
+
+static int test_pool_setup(void **state)
+{
+    struct pool_test_ctx *tctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    tctx = talloc_zero(global_talloc_context, struct pool_test_ctx);
+    assert_non_null(tctx);
+
+    tctx->ev = tevent_context_init(tctx);
+    assert_non_null(tctx->ev);
+
+    tctx->krb5_ctx = talloc_zero(tctx, struct krb5_ctx);
+    assert_non_null(tctx->krb5_ctx);
+    tctx->krb5_ctx->child_debug_fd = -1;
+
+    ret = dp_copy_defaults(tctx->krb5_ctx, default_krb5_opts, KRB5_OPTS,
+                           &tctx->krb5_ctx->opts);
+    assert_int_equal(ret, EOK);
+
+    ret = dp_opt_set_string(tctx->krb5_ctx->opts, KRB5_KEYTAB, TEST_KEYTAB);
+    assert_int_equal(ret, EOK);
+
+    ret = pipe(tctx->hold_fd);
+    assert_int_equal(ret, 0);
+
+    *state = tctx;
+    return 0;
+}
+
+static int test_pool_teardown(void **state)
+{
+    struct pool_test_ctx *tctx = talloc_get_type(*state,
+                                                 struct pool_test_ctx);
+
+    assert_non_null(tctx);
+
+    if (tctx->hold_fd[1] != -1) {
+        close(tctx->hold_fd[1]);
+    }
+    close(tctx->hold_fd[0]);
+
+    talloc_free(tctx);
+    unsetenv("TEST_CHILD_ACTION");
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void start_pool(struct pool_test_ctx *tctx, const char *action,
+                       int size, int timeout)
+{
+    errno_t ret;
+
+    ret = setenv("TEST_CHILD_ACTION", action, 1);
+    assert_int_equal(ret, 0);
+
+    ret = dp_opt_set_int(tctx->krb5_ctx->opts, KRB5_CHILD_POOL_SIZE, size);
+    assert_int_equal(ret, EOK);
+    ret = dp_opt_set_int(tctx->krb5_ctx->opts, KRB5_AUTH_TIMEOUT, timeout);
+    assert_int_equal(ret, EOK);
+
+    ret = krb5_child_pool_setup(tctx->krb5_ctx, tctx->ev);
+    assert_int_equal(ret, EOK);
+    assert_non_null(tctx->krb5_ctx->child_pool);
+    assert_int_equal(tctx->krb5_ctx->child_pool->count, size);
+
+    /* only the workers hold it from now on */
+    close(tctx->hold_fd[1]);
+    tctx->hold_fd[1] = -1;
+}
+
+static void pool_test_done(struct tevent_req *req)
+{
+    struct pool_test_req *preq = tevent_req_callback_data(req,
+                                                       struct pool_test_req);
+
+    preq->ret = handle_child_recv(req, preq, &preq->buf, &preq->len);
+    talloc_free(req);
+    preq->tctx->done++;
+}
+
+static struct pool_test_req *send_request(struct pool_test_ctx *tctx)
+{
+    struct pool_test_req *preq;
+    struct krb5child_req *kr;
+    struct tevent_req *req;
+
+    preq = talloc_zero(tctx, struct pool_test_req);
+    assert_non_null(preq);
+    preq->tctx = tctx;
+    preq->ret = EINPROGRESS;
+
+    kr = talloc_zero(preq, struct krb5child_req);
+    assert_non_null(kr);
+    kr->krb5_ctx = tctx->krb5_ctx;
+    kr->upn = talloc_strdup(kr, TEST_UPN);
+    assert_non_null(kr->upn);
+
+    kr->pd = talloc_zero(kr, struct pam_data);
+    assert_non_null(kr->pd);
+    kr->pd->cmd = SSS_PAM_ACCT_MGMT;
+    kr->pd->user = talloc_strdup(kr->pd, TEST_USER);
+    assert_non_null(kr->pd->user);
+    preq->kr = kr;
+
+    req = handle_child_send(preq, tctx->ev, kr);
+    assert_non_null(req);
+    tevent_req_set_callback(req, pool_test_done, preq);
+
+    return preq;
+}
+
+static void wait_for_requests(struct pool_test_ctx *tctx, int num)
+{
+    while (tctx->done < num) {
+        assert_int_equal(tevent_loop_once(tctx->ev), 0);
+    }
+}
+
+static void assert_echoed(struct pool_test_req *preq)
+{
+    struct io_buffer *buf;
+    errno_t ret;
+
+    assert_int_equal(preq->ret, EOK);
+
+    ret = create_send_buffer(preq->kr, &buf);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(preq->len, buf->size);
+    assert_memory_equal(preq->buf, buf->data, buf->size);
+}
+
+/* The second request waits until the only worker is done with the first */
+void test_pool_dispatch(void **state)
+{
+    struct pool_test_ctx *tctx = talloc_get_type(*state,
+                                                 struct pool_test_ctx);
+    struct krb5_child_pool *pool;
+    struct pool_test_req *first;
+    struct pool_test_req *second;
+
+    start_pool(tctx, "echo", 1, 10);
+    pool = tctx->krb5_ctx->child_pool;
+
+    first = send_request(tctx);
+    second = send_request(tctx);
+    assert_non_null(pool->busy);
+    assert_null(pool->idle);
+    assert_non_null(pool->waiting);
+
+    wait_for_requests(tctx, 2);
+    assert_echoed(first);
+    assert_echoed(second);
+
+    /* the same worker served both */
+    assert_int_equal(pool->count, 1);
+    assert_non_null(pool->idle);
+    assert_null(pool->busy);
+    assert_null(pool->waiting);
+}
+
+/* A worker which exits fails its request and is replaced on demand */
+void test_pool_worker_exit(void **state)
+{
+    struct pool_test_ctx *tctx = talloc_get_type(*state,
+                                                 struct pool_test_ctx);
+    struct krb5_child_pool *pool;
+    struct pool_test_req *preq;
+    int ret;
+
+    start_pool(tctx, "exit", 1, 10);
+    pool = tctx->krb5_ctx->child_pool;
+
+    preq = send_request(tctx);
+    wait_for_requests(tctx, 1);
+    assert_int_not_equal(preq->ret, EOK);
+    assert_int_equal(pool->count, 0);
+
+    ret = setenv("TEST_CHILD_ACTION", "echo", 1);
+    assert_int_equal(ret, 0);
+
+    preq = send_request(tctx);
+    assert_int_equal(pool->count, 1);
+    wait_for_requests(tctx, 2);
+    assert_echoed(preq);
+}
+
+/* On timeout the worker and the copy serving the request are killed */
+void test_pool_timeout(void **state)
+{
+    struct pool_test_ctx *tctx = talloc_get_type(*state,
+                                                 struct pool_test_ctx);
+    struct pollfd pfd;
+    struct pool_test_req *preq;
+    char c;
+    int ret;
+
+    start_pool(tctx, "hang", 1, 1);
+
+    preq = send_request(tctx);
+    wait_for_requests(tctx, 1);
+    assert_int_equal(preq->ret, ETIMEDOUT);
+    assert_int_equal(tctx->krb5_ctx->child_pool->count, 0);
+
+    pfd.fd = tctx->hold_fd[0];
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, 5000);
+    assert_int_equal(ret, 1);
+    assert_int_equal(read(tctx->hold_fd[0], &c, 1), 0);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_pool_dispatch,
+                                        test_pool_setup,
+                                        test_pool_teardown),
+        cmocka_unit_test_setup_teardown(test_pool_worker_exit,
+                                        test_pool_setup,
+                                        test_pool_teardown),
+        cmocka_unit_test_setup_teardown(test_pool_timeout,
+                                        test_pool_setup,
+                                        test_pool_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -313,6 +313,149 @@ static void test_krb5_wait_queue_fail_odd_done(struct tevent_req *req)
     }
 }
 
+static void test_krb5_wait_queue_shared_done(struct tevent_req *req);
+
+static void test_krb5_wait_queue_shared(void **state)
+{
+    int i;
+    errno_t ret;
+    struct tevent_req *req;
+    struct krb5_wait_queue_stats stats;
+    struct test_krb5_wait_queue *test_ctx =
+        talloc_get_type(*state, struct test_krb5_wait_queue);
+
+    test_ctx->num_auths = 10;
+    test_ctx->pd->cmd = SSS_PAM_PREAUTH;
+
+    for (i=0; i < test_ctx->num_auths; i++) {
+        test_krb5_wait_mock_success(test_ctx, "krb5_user");
+
+        req = krb5_auth_queue_send(test_ctx,
+                                   test_ctx->tctx->ev,
+                                   test_ctx->be_ctx,
+                                   test_ctx->pd,
+                                   test_ctx->krb5_ctx);
+        assert_non_null(req);
+        tevent_req_set_callback(req, test_krb5_wait_queue_shared_done,
+                                test_ctx);
+    }
+
+    /* none of the pre-auth requests waits for another one */
+    krb5_wait_queue_get_stats(test_ctx->krb5_ctx, &stats);
+    assert_int_equal(stats.immediate, test_ctx->num_auths);
+    assert_int_equal(stats.queued, 0);
+    assert_int_equal(stats.waiting, 0);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+static void test_krb5_wait_queue_shared_done(struct tevent_req *req)
+{
+    struct test_krb5_wait_queue *test_ctx = \
+        tevent_req_callback_data(req, struct test_krb5_wait_queue);
+    errno_t ret;
+
+    ret = krb5_auth_queue_recv(req, NULL, NULL);
+    talloc_free(req);
+    assert_int_equal(ret, EOK);
+
+    test_ctx->num_finished_auths++;
+
+    if (test_ctx->num_finished_auths == test_ctx->num_auths) {
+        test_ev_done(test_ctx->tctx, EOK);
+    }
+}
+
+struct test_krb5_wait_queue_order {
+    struct test_krb5_wait_queue *test_ctx;
+    int position;
+};
+
+static void test_krb5_wait_queue_mixed_done(struct tevent_req *req);
+
+static void test_krb5_wait_queue_mixed_send(struct test_krb5_wait_queue *t,
+                                            struct pam_data *pd,
+                                            time_t us_delay,
+                                            int position)
+{
+    struct test_krb5_wait_queue_order *order;
+    struct tevent_req *req;
+
+    order = talloc_zero(t, struct test_krb5_wait_queue_order);
+    assert_non_null(order);
+    order->test_ctx = t;
+    order->position = position;
+
+    test_krb5_wait_mock(t, "krb5_user", us_delay, 0, 0, 0);
+
+    req = krb5_auth_queue_send(t, t->tctx->ev, t->be_ctx, pd, t->krb5_ctx);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_krb5_wait_queue_mixed_done, order);
+}
+
+static void test_krb5_wait_queue_mixed(void **state)
+{
+    errno_t ret;
+    struct pam_data *preauth;
+    struct pam_data *auth;
+    struct krb5_wait_queue_stats stats;
+    struct test_krb5_wait_queue *test_ctx =
+        talloc_get_type(*state, struct test_krb5_wait_queue);
+
+    preauth = talloc_zero(test_ctx, struct pam_data);
+    assert_non_null(preauth);
+    preauth->cmd = SSS_PAM_PREAUTH;
+    preauth->user = discard_const("krb5_user");
+
+    auth = talloc_zero(test_ctx, struct pam_data);
+    assert_non_null(auth);
+    auth->cmd = SSS_PAM_AUTHENTICATE;
+    auth->user = discard_const("krb5_user");
+
+    test_ctx->num_auths = 3;
+
+    /* The authentication waits for the pre-auth request, the second
+     * pre-auth request must not overtake the waiting authentication even
+     * though it is quicker. */
+    test_krb5_wait_queue_mixed_send(test_ctx, preauth, 2000, 0);
+    test_krb5_wait_queue_mixed_send(test_ctx, auth, 2000, 1);
+    test_krb5_wait_queue_mixed_send(test_ctx, preauth, 0, 2);
+
+    krb5_wait_queue_get_stats(test_ctx->krb5_ctx, &stats);
+    assert_int_equal(stats.immediate, 1);
+    assert_int_equal(stats.waiting, 2);
+    assert_int_equal(stats.max_waiting, 2);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    krb5_wait_queue_get_stats(test_ctx->krb5_ctx, &stats);
+    assert_int_equal(stats.queued, 2);
+    assert_int_equal(stats.waiting, 0);
+    assert_true(stats.max_wait_usec > 0);
+    assert_true(stats.total_wait_usec >= stats.max_wait_usec);
+}
+
+static void test_krb5_wait_queue_mixed_done(struct tevent_req *req)
+{
+    struct test_krb5_wait_queue_order *order = \
+        tevent_req_callback_data(req, struct test_krb5_wait_queue_order);
+    struct test_krb5_wait_queue *test_ctx = order->test_ctx;
+    errno_t ret;
+
+    ret = krb5_auth_queue_recv(req, NULL, NULL);
+    talloc_free(req);
+    assert_int_equal(ret, EOK);
+
+    assert_int_equal(order->position, test_ctx->num_finished_auths);
+    test_ctx->num_finished_auths++;
+
+    if (test_ctx->num_finished_auths == test_ctx->num_auths) {
+        test_ev_done(test_ctx->tctx, EOK);
+    }
+}
+
 int main(int argc, const char *argv[])
 {
     poptContext pc;
@@ -338,6 +481,16 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_krb5_wait_queue_fail_odd,
                                         test_krb5_wait_queue_setup,
                                         test_krb5_wait_queue_teardown),
+
+        /* Run requests which do not touch the ccache next to each other */
+        cmocka_unit_test_setup_teardown(test_krb5_wait_queue_shared,
+                                        test_krb5_wait_queue_setup,
+                                        test_krb5_wait_queue_teardown),
+
+        /* Make sure the requests of a user start in order */
+        cmocka_unit_test_setup_teardown(test_krb5_wait_queue_mixed,
+                                        test_krb5_wait_queue_setup,
+                                        test_krb5_wait_queue_teardown),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
@@ -0,0 +1,586 @@
+/*
+    SSSD
+
+    Tests of merging concurrent user lookups into one LDAP search
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the state of the lookups */
+#include "providers/ldap/ldap_id.c"
+#include "providers/ldap/ldap_opts.h"
+
+#define TEST_DOM_NAME "ldap_id_batch_test"
+#define TEST_SID_1 "S-1-5-21-3623811015-3361044348-30300820-1001"
+#define TEST_SID_2 "S-1-5-21-3623811015-3361044348-30300820-1002"
+#define TEST_MAX_SEARCHES 8
+
+struct ldap_id_batch_test_ctx {
+    struct tevent_context *ev;
+    struct sss_domain_info *dom;
+    struct sdap_id_ctx *id_ctx;
+    struct sdap_id_conn_ctx *conn;
+    struct sdap_domain *sdom;
+
+    int num_connected;
+
+    /* the merged search, completed by the test */
+    struct tevent_req *search_req;
+    const char *search_filter;
+    int num_searches;
+    size_t num_saved;
+
+    /* the searches of single lookups */
+    const char *single_filters[TEST_MAX_SEARCHES];
+    int num_single;
+};
+
+static struct ldap_id_batch_test_ctx *test_ctx;
+
+struct test_search_state {
+    errno_t ret;
+    struct sysdb_attrs **users;
+    size_t count;
+};
+
+bool __wrap_sdap_idmap_domain_has_algorithmic_mapping(
+                                                 struct sdap_idmap_ctx *ctx,
+                                                 const char *dom_name,
+                                                 const char *dom_sid)
+{
+    return false;
+}
+
+struct sdap_id_op *__wrap_sdap_id_op_create(TALLOC_CTX *memctx,
+                                            struct sdap_id_conn_cache *cache)
+{
+    return talloc_new(memctx);
+}
+
+struct tevent_req *__wrap_sdap_id_op_connect_send(struct sdap_id_op *op,
+                                                  TALLOC_CTX *memctx,
+                                                  int *ret_out)
+{
+    struct tevent_req *req;
+    int *state;
+
+    req = tevent_req_create(memctx, &state, int);
+    assert_non_null(req);
+
+    *ret_out = EOK;
+    tevent_req_done(req);
+    return tevent_req_post(req, test_ctx->ev);
+}
+
+int __wrap_sdap_id_op_connect_recv(struct tevent_req *req, int *dp_error)
+{
+    *dp_error = DP_ERR_OK;
+    test_ctx->num_connected++;
+    return EOK;
+}
+
+struct sdap_handle *__wrap_sdap_id_op_handle(struct sdap_id_op *op)
+{
+    return NULL;
+}
+
+int __wrap_sdap_id_op_done(struct sdap_id_op *op, int retval, int *dp_err_out)
+{
+    *dp_err_out = (retval == EOK) ? DP_ERR_OK : DP_ERR_FATAL;
+    return retval;
+}
+
+struct tevent_req *__wrap_sdap_search_user_send(TALLOC_CTX *memctx,
+                                        struct tevent_context *ev,
+                                        struct sss_domain_info *dom,
+                                        struct sdap_options *opts,
+                                        struct sdap_search_base **search_bases,
+                                        struct sdap_handle *sh,
+                                        const char **attrs,
+                                        const char *filter,
+                                        int timeout,
+                                        enum sdap_entry_lookup_type lookup_type)
+{
+    struct test_search_state *state;
+    struct tevent_req *req;
+
+    assert_null(test_ctx->search_req);
+
+    req = tevent_req_create(memctx, &state, struct test_search_state);
+    assert_non_null(req);
+
+    test_ctx->search_req = req;
+    test_ctx->search_filter = talloc_strdup(test_ctx, filter);
+    assert_non_null(test_ctx->search_filter);
+    test_ctx->num_searches++;
+    return req;
+}
+
+int __wrap_sdap_search_user_recv(TALLOC_CTX *memctx, struct tevent_req *req,
+                                 char **higher_usn,
+                                 struct sysdb_attrs ***users,
+                                 size_t *count)
+{
+    struct test_search_state *state = tevent_req_data(req,
+                                                    struct test_search_state);
+
+    if (state->ret != EOK) {
+        return state->ret;
+    }
+
+    *users = talloc_steal(memctx, state->users);
+    *count = state->count;
+    return EOK;
+}
+
+int __wrap_sdap_save_users(TALLOC_CTX *memctx,
+                           struct sysdb_ctx *sysdb,
+                           struct sss_domain_info *dom,
+                           struct sdap_options *opts,
+                           struct sysdb_attrs **users,
+                           int num_users,
+                           char **_usn_value)
+{
+    test_ctx->num_saved += num_users;
+    return EOK;
+}
+
+struct tevent_req *__wrap_sdap_get_users_send(TALLOC_CTX *memctx,
+                                        struct tevent_context *ev,
+                                        struct sss_domain_info *dom,
+                                        struct sysdb_ctx *sysdb,
+                                        struct sdap_options *opts,
+                                        struct sdap_search_base **search_bases,
+                                        struct sdap_handle *sh,
+                                        const char **attrs,
+                                        const char *filter,
+                                        int timeout,
+                                        enum sdap_entry_lookup_type lookup_type)
+{
+    struct tevent_req *req;
+    int *state;
+
+    assert_true(test_ctx->num_single < TEST_MAX_SEARCHES);
+
+    req = tevent_req_create(memctx, &state, int);
+    assert_non_null(req);
+
+    test_ctx->single_filters[test_ctx->num_single] = talloc_strdup(test_ctx,
+                                                                   filter);
+    assert_non_null(test_ctx->single_filters[test_ctx->num_single]);
+    test_ctx->num_single++;
+
+    tevent_req_done(req);
+    return tevent_req_post(req, ev);
+}
+
+int __wrap_sdap_get_users_recv(struct tevent_req *req,
+                               TALLOC_CTX *mem_ctx, char **timestamp)
+{
+    return EOK;
+}
+
+static int ldap_id_batch_test_setup(void **state)
+{
+    struct sdap_options *opts;
+    struct sdap_search_base **bases;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct ldap_id_batch_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->ev = tevent_context_init(test_ctx);
+    assert_non_null(test_ctx->ev);
+
+    test_ctx->dom = talloc_zero(test_ctx, struct sss_domain_info);
+    assert_non_null(test_ctx->dom);
+    test_ctx->dom->name = talloc_strdup(test_ctx->dom, TEST_DOM_NAME);
+    assert_non_null(test_ctx->dom->name);
+
+    opts = talloc_zero(test_ctx, struct sdap_options);
+    assert_non_null(opts);
+    ret = dp_copy_defaults(opts, default_basic_opts,
+                           SDAP_OPTS_BASIC, &opts->basic);
+    assert_int_equal(ret, EOK);
+    ret = sdap_copy_map(opts, rfc2307_user_map, SDAP_OPTS_USER,
+                        &opts->user_map);
+    assert_int_equal(ret, EOK);
+    opts->user_map_cnt = SDAP_OPTS_USER;
+
+    test_ctx->id_ctx = talloc_zero(test_ctx, struct sdap_id_ctx);
+    assert_non_null(test_ctx->id_ctx);
+    test_ctx->id_ctx->opts = opts;
+
+    test_ctx->conn = talloc_zero(test_ctx, struct sdap_id_conn_ctx);
+    assert_non_null(test_ctx->conn);
+    test_ctx->conn->id_ctx = test_ctx->id_ctx;
+
+    bases = talloc_zero_array(test_ctx, struct sdap_search_base *, 2);
+    assert_non_null(bases);
+    ret = sdap_create_search_base(bases, "dc=ldap,dc=test",
+                                  LDAP_SCOPE_SUBTREE, NULL, &bases[0]);
+    assert_int_equal(ret, EOK);
+
+    test_ctx->sdom = talloc_zero(test_ctx, struct sdap_domain);
+    assert_non_null(test_ctx->sdom);
+    test_ctx->sdom->dom = test_ctx->dom;
+    test_ctx->sdom->user_search_bases = bases;
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int ldap_id_batch_test_teardown(void **state)
+{
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void set_batch(int window, int size)
+{
+    struct dp_option *basic = test_ctx->id_ctx->opts->basic;
+
+    assert_int_equal(dp_opt_set_int(basic, SDAP_LOOKUP_BATCH_WINDOW, window),
+                     EOK);
+    assert_int_equal(dp_opt_set_int(basic, SDAP_LOOKUP_BATCH_SIZE, size),
+                     EOK);
+}
+
+/* Starts a lookup and waits until it is connected, i.e. either merged or
+ * searching on its own */
+static struct tevent_req *lookup(const char *name, int filter_type,
+                                 const char *extra_value)
+{
+    struct tevent_req *req;
+    int connected = test_ctx->num_connected;
+
+    req = users_get_send(test_ctx, test_ctx->ev, test_ctx->id_ctx,
+                         test_ctx->sdom, test_ctx->conn, name, filter_type,
+                         extra_value, BE_ATTR_CORE, false);
+    assert_non_null(req);
+
+    while (test_ctx->num_connected == connected) {
+        assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    }
+
+    return req;
+}
+
+static const char *lookup_filter(struct tevent_req *req)
+{
+    return tevent_req_data(req, struct users_get_state)->filter;
+}
+
+static struct sysdb_attrs *user_attrs(TALLOC_CTX *mem_ctx,
+                                      const char *name,
+                                      const char *uid)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(mem_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_NAME, name);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_UIDNUM, uid);
+    assert_int_equal(ret, EOK);
+
+    return attrs;
+}
+
+/* Completes the merged search with the users, or with ret when there
+ * are none */
+static void reply_search(errno_t ret, struct sysdb_attrs **users,
+                         size_t count)
+{
+    struct test_search_state *state;
+    struct tevent_req *req = test_ctx->search_req;
+
+    assert_non_null(req);
+    test_ctx->search_req = NULL;
+
+    state = tevent_req_data(req, struct test_search_state);
+    state->ret = ret;
+    state->users = talloc_steal(state, users);
+    state->count = count;
+
+    tevent_req_done(req);
+}
+
+static void wait_for(struct tevent_req *req)
+{
+    while (tevent_req_is_in_progress(req)) {
+        assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    }
+}
+
+static void assert_found(struct tevent_req *req, int expected_sdap_ret)
+{
+    int dp_error;
+    int sdap_ret;
+    errno_t ret;
+
+    assert_false(tevent_req_is_in_progress(req));
+
+    ret = users_get_recv(req, &dp_error, &sdap_ret);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(dp_error, DP_ERR_OK);
+    assert_int_equal(sdap_ret, expected_sdap_ret);
+}
+
+/* Lookups arriving together are sent as one search, the OR of their
+ * filters, which is sent as soon as there are ldap_lookup_batch_size */
+void test_batch_merge(void **state)
+{
+    struct sysdb_attrs **users;
+    struct tevent_req *alice;
+    struct tevent_req *bob;
+    struct tevent_req *carol;
+    char *filter;
+
+    set_batch(60000, 3);
+
+    alice = lookup("alice", BE_FILTER_NAME, NULL);
+    bob = lookup("bob", BE_FILTER_NAME, NULL);
+    assert_int_equal(test_ctx->num_searches, 0);
+    assert_int_equal(test_ctx->num_single, 0);
+
+    carol = lookup("carol", BE_FILTER_NAME, NULL);
+    assert_int_equal(test_ctx->num_searches, 1);
+    assert_non_null(test_ctx->search_req);
+
+    filter = talloc_asprintf(test_ctx, "(|%s%s%s)", lookup_filter(alice),
+                             lookup_filter(bob), lookup_filter(carol));
+    assert_non_null(filter);
+    assert_string_equal(test_ctx->search_filter, filter);
+    assert_null(test_ctx->conn->user_batches);
+
+    /* the server compares the names case insensitively */
+    users = talloc_zero_array(test_ctx, struct sysdb_attrs *, 2);
+    assert_non_null(users);
+    users[0] = user_attrs(users, "ALICE", "1001");
+    users[1] = user_attrs(users, "bob", "1002");
+    reply_search(EOK, users, 2);
+
+    assert_int_equal(test_ctx->num_saved, 2);
+    assert_found(alice, EOK);
+    assert_found(bob, EOK);
+
+    /* without a match in the result, the lookup makes its own search */
+    assert_int_equal(test_ctx->num_single, 1);
+    assert_string_equal(test_ctx->single_filters[0], lookup_filter(carol));
+    wait_for(carol);
+    assert_found(carol, EOK);
+    assert_int_equal(test_ctx->num_searches, 1);
+}
+
+/* Lookups by UID are merged once the window is over, an empty result
+ * answers all of them */
+void test_batch_window(void **state)
+{
+    struct tevent_req *req1;
+    struct tevent_req *req2;
+
+    set_batch(10, 50);
+
+    req1 = lookup("1001", BE_FILTER_IDNUM, NULL);
+    req2 = lookup("1002", BE_FILTER_IDNUM, NULL);
+    assert_int_equal(test_ctx->num_searches, 0);
+
+    while (test_ctx->search_req == NULL) {
+        assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    }
+    assert_int_equal(test_ctx->num_searches, 1);
+    assert_non_null(strstr(test_ctx->search_filter, lookup_filter(req1)));
+    assert_non_null(strstr(test_ctx->search_filter, lookup_filter(req2)));
+
+    reply_search(ENOENT, NULL, 0);
+
+    assert_found(req1, ENOENT);
+    assert_found(req2, ENOENT);
+    assert_int_equal(test_ctx->num_saved, 0);
+    assert_int_equal(test_ctx->num_single, 0);
+}
+
+/* A lookup which had nothing to be merged with searches on its own, and so
+ * does each lookup when a merged search fails */
+void test_batch_alone(void **state)
+{
+    struct sysdb_attrs **users;
+    struct tevent_req *req1;
+    struct tevent_req *req2;
+
+    set_batch(10, 50);
+
+    req1 = lookup("alice", BE_FILTER_NAME, NULL);
+    wait_for(req1);
+    assert_found(req1, EOK);
+    assert_int_equal(test_ctx->num_searches, 0);
+    assert_int_equal(test_ctx->num_single, 1);
+    assert_string_equal(test_ctx->single_filters[0], lookup_filter(req1));
+
+    req1 = lookup("alice", BE_FILTER_NAME, NULL);
+    req2 = lookup("bob", BE_FILTER_NAME, NULL);
+    while (test_ctx->search_req == NULL) {
+        assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    }
+
+    users = talloc_zero_array(test_ctx, struct sysdb_attrs *, 1);
+    assert_non_null(users);
+    users[0] = user_attrs(users, "alice", "1001");
+    reply_search(EIO, users, 1);
+
+    wait_for(req1);
+    wait_for(req2);
+    assert_found(req1, EOK);
+    assert_found(req2, EOK);
+    assert_int_equal(test_ctx->num_saved, 0);
+    assert_int_equal(test_ctx->num_single, 3);
+}
+
+/* Lookups by SID are merged apart from the other lookups, a SID without
+ * a match in the result is not searched on its own */
+void test_batch_sid(void **state)
+{
+    struct sysdb_attrs **users;
+    struct tevent_req *alice;
+    struct tevent_req *req1;
+    struct tevent_req *req2;
+    char *filter;
+    errno_t ret;
+
+    set_batch(60000, 2);
+    test_ctx->id_ctx->opts->user_map[SDAP_AT_USER_OBJECTSID].name =
+                                  talloc_strdup(test_ctx, "objectSID");
+    assert_non_null(
+             test_ctx->id_ctx->opts->user_map[SDAP_AT_USER_OBJECTSID].name);
+
+    alice = lookup("alice", BE_FILTER_NAME, NULL);
+    req1 = lookup(TEST_SID_1, BE_FILTER_SECID, NULL);
+    assert_int_equal(test_ctx->num_searches, 0);
+
+    req2 = lookup(TEST_SID_2, BE_FILTER_SECID, NULL);
+    assert_int_equal(test_ctx->num_searches, 1);
+
+    filter = talloc_asprintf(test_ctx, "(|%s%s)", lookup_filter(req1),
+                             lookup_filter(req2));
+    assert_non_null(filter);
+    assert_string_equal(test_ctx->search_filter, filter);
+    assert_non_null(strstr(filter, "(objectSID=" TEST_SID_1 ")"));
+
+    /* the lookup by name still waits for its window */
+    assert_non_null(test_ctx->conn->user_batches);
+    assert_true(tevent_req_is_in_progress(alice));
+
+    users = talloc_zero_array(test_ctx, struct sysdb_attrs *, 1);
+    assert_non_null(users);
+    users[0] = user_attrs(users, "bob", "1002");
+    ret = sysdb_attrs_add_string(users[0], SYSDB_SID, TEST_SID_2);
+    assert_int_equal(ret, EOK);
+    reply_search(EOK, users, 1);
+
+    assert_found(req1, ENOENT);
+    assert_found(req2, EOK);
+    assert_int_equal(test_ctx->num_single, 0);
+}
+
+/* Without a window, or for lookups by principal, nothing is merged */
+void test_batch_disabled(void **state)
+{
+    struct tevent_req *req1;
+    struct tevent_req *req2;
+
+    req1 = lookup("alice", BE_FILTER_NAME, NULL);
+    req2 = lookup("bob", BE_FILTER_NAME, NULL);
+    wait_for(req1);
+    wait_for(req2);
+    assert_found(req1, EOK);
+    assert_found(req2, EOK);
+    assert_int_equal(test_ctx->num_single, 2);
+
+    set_batch(60000, 2);
+
+    req1 = lookup("alice@LDAP.TEST", BE_FILTER_NAME, EXTRA_NAME_IS_UPN);
+    req2 = lookup("bob@LDAP.TEST", BE_FILTER_NAME, EXTRA_NAME_IS_UPN);
+    wait_for(req1);
+    wait_for(req2);
+    assert_found(req1, EOK);
+    assert_found(req2, EOK);
+    assert_int_equal(test_ctx->num_single, 4);
+    assert_int_equal(test_ctx->num_searches, 0);
+    assert_null(test_ctx->conn->user_batches);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_batch_merge,
+                                        ldap_id_batch_test_setup,
+                                        ldap_id_batch_test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_window,
+                                        ldap_id_batch_test_setup,
+                                        ldap_id_batch_test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_alone,
+                                        ldap_id_batch_test_setup,
+                                        ldap_id_batch_test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_sid,
+                                        ldap_id_batch_test_setup,
+                                        ldap_id_batch_test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_disabled,
+                                        ldap_id_batch_test_setup,
+                                        ldap_id_batch_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -268,6 +268,74 @@ static void test_id_cleanup_exp_group(void **state)
     assert_int_equal(ret, ENOENT);
 }
 
+static void test_id_cleanup_done(struct tevent_req *req)
+{
+    bool *done = tevent_req_callback_data(req, bool);
+    errno_t ret;
+
+    ret = ldap_id_cleanup_recv(req);
+    talloc_zfree(req);
+    assert_int_equal(ret, EOK);
+    *done = true;
+}
+
+static void test_id_cleanup_exp_group_sliced(void **state)
+{
+    errno_t ret;
+    struct ldb_message *msg;
+    struct sdap_domain sdom = { 0 };
+    struct tevent_req *req;
+    bool done = false;
+    const char *grps[] = { "sliced_grp", "sliced_empty1", "sliced_empty2",
+                           "sliced_empty3" };
+    const uint64_t CACHE_TIMEOUT = 30;
+    int i;
+    struct sysdb_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                            struct sysdb_test_ctx);
+
+    for (i = 0; i < 4; i++) {
+        ret = sysdb_store_group(test_ctx->domain, grps[i],
+                                10010 + i, NULL, CACHE_TIMEOUT, 0);
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = sysdb_store_user(test_ctx->domain, "sliced_user", NULL,
+                           10020, 10010, "Test user",
+                           NULL, NULL, NULL, NULL, NULL,
+                           0, 0);
+    assert_int_equal(ret, EOK);
+
+    for (i = 0; i < 4; i++) {
+        invalidate_group(test_ctx, test_ctx->domain, grps[i]);
+    }
+
+    /* one entry per slice */
+    dp_opt_set_int(test_ctx->opts->basic, SDAP_PURGE_CACHE_BATCH_SIZE, 1);
+    dp_opt_set_int(test_ctx->opts->basic, SDAP_PURGE_CACHE_TIME_BUDGET, 0);
+
+    sdom.dom = test_ctx->domain;
+
+    req = ldap_id_cleanup_send(test_ctx, test_ctx->ev, test_ctx->opts, &sdom);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_id_cleanup_done, &done);
+
+    while (!done) {
+        tevent_loop_once(test_ctx->ev);
+    }
+
+    assert_int_not_equal(sdom.last_purge.tv_sec, 0);
+
+    ret = sysdb_search_group_by_name(test_ctx, test_ctx->domain,
+                                     grps[0], NULL, &msg);
+    assert_int_equal(ret, EOK);
+
+    for (i = 1; i < 4; i++) {
+        ret = sysdb_search_group_by_name(test_ctx, test_ctx->domain,
+                                         grps[i], NULL, &msg);
+        assert_int_equal(ret, ENOENT);
+    }
+}
+
 int main(int argc, const char *argv[])
 {
     int rv;
@@ -285,6 +353,8 @@ int main(int argc, const char *argv[])
     const struct CMUnitTest tests[] = {
         cmocka_unit_test_setup_teardown(test_id_cleanup_exp_group,
                                         test_sysdb_setup, test_sysdb_teardown),
+        cmocka_unit_test_setup_teardown(test_id_cleanup_exp_group_sliced,
+                                        test_sysdb_setup, test_sysdb_teardown),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
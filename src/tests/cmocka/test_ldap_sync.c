@@ -0,0 +1,295 @@
+/*
+    SSSD
+
+    ldap_sync - Tests for the content synchronization consumer
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the static handlers of the synchronization */
+#include "providers/ldap/sdap_async_enum.c"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_ldap_sync_conf.ldb"
+#define TEST_DOM_NAME "ldap_sync_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_USER_NAME "sync_user"
+#define TEST_USER_DN "uid=sync_user,ou=people,dc=example,dc=com"
+#define TEST_GROUP_NAME "sync_group"
+#define TEST_GROUP_DN "cn=sync_group,ou=groups,dc=example,dc=com"
+
+struct ldap_sync_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct sdap_domain *sdom;
+    struct sdap_sync_ctx *sync_ctx;
+};
+
+static int test_ldap_sync_setup(void **state)
+{
+    struct ldap_sync_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct ldap_sync_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->sdom = talloc_zero(test_ctx, struct sdap_domain);
+    assert_non_null(test_ctx->sdom);
+    test_ctx->sdom->dom = test_ctx->tctx->dom;
+
+    test_ctx->sync_ctx = sdap_sync_ctx_get(test_ctx->tctx->ev, NULL,
+                                           test_ctx->sdom);
+    assert_non_null(test_ctx->sync_ctx);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_ldap_sync_teardown(void **state)
+{
+    struct ldap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct ldap_sync_test_ctx);
+
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static struct sysdb_attrs *orig_dn_attrs(TALLOC_CTX *mem_ctx, const char *dn)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(mem_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, dn);
+    assert_int_equal(ret, EOK);
+
+    return attrs;
+}
+
+static void test_ldap_sync_ctx(void **state)
+{
+    struct ldap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct ldap_sync_test_ctx);
+    struct sdap_sync_ctx *sync_ctx = test_ctx->sync_ctx;
+
+    /* one context per domain, shared by the enumerations */
+    assert_ptr_equal(sdap_sync_ctx_get(test_ctx->tctx->ev, NULL,
+                                       test_ctx->sdom),
+                     sync_ctx);
+    assert_ptr_equal(sync_ctx->users.sync_ctx, sync_ctx);
+    assert_ptr_equal(sync_ctx->groups.sync_ctx, sync_ctx);
+    assert_false(sync_ctx->users.groups);
+    assert_true(sync_ctx->groups.groups);
+}
+
+static void test_ldap_sync_cookie(void **state)
+{
+    struct ldap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct ldap_sync_test_ctx);
+    struct sdap_sync_session *session = &test_ctx->sync_ctx->users;
+    struct berval cookie;
+    errno_t ret;
+
+    cookie.bv_val = discard_const("rid=000,csn=1");
+    cookie.bv_len = strlen(cookie.bv_val);
+    ret = sdap_sync_cookie(&cookie, session);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(session->cookie.bv_len, cookie.bv_len);
+    assert_memory_equal(session->cookie.bv_val, cookie.bv_val, cookie.bv_len);
+
+    /* the last cookie is kept for the next synchronization */
+    cookie.bv_val = discard_const("rid=000,csn=22");
+    cookie.bv_len = strlen(cookie.bv_val);
+    ret = sdap_sync_cookie(&cookie, session);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(session->cookie.bv_len, cookie.bv_len);
+    assert_memory_equal(session->cookie.bv_val, cookie.bv_val, cookie.bv_len);
+}
+
+static void test_ldap_sync_queue(void **state)
+{
+    struct ldap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct ldap_sync_test_ctx);
+    struct sdap_sync_session *session = &test_ctx->sync_ctx->users;
+    errno_t ret;
+
+    ret = sdap_sync_entry(SDAP_SYNC_ADD, TEST_USER_DN,
+                          orig_dn_attrs(test_ctx, TEST_USER_DN), session);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(session->num_pending, 1);
+    assert_non_null(session->flush_timer);
+
+    ret = sdap_sync_entry(SDAP_SYNC_MODIFY, TEST_USER_DN,
+                          orig_dn_attrs(test_ctx, TEST_USER_DN), session);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(session->num_pending, 2);
+
+    /* unchanged entries are not stored again */
+    ret = sdap_sync_entry(SDAP_SYNC_PRESENT, TEST_USER_DN, NULL, session);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(session->num_pending, 2);
+}
+
+static void test_ldap_sync_groups_full_refresh(void **state)
+{
+    struct ldap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct ldap_sync_test_ctx);
+    struct sdap_sync_session *session = &test_ctx->sync_ctx->groups;
+    errno_t ret;
+
+    /* the full refresh of the groups is a group enumeration at its end */
+    session->full_refresh = true;
+    ret = sdap_sync_entry(SDAP_SYNC_ADD, TEST_GROUP_DN,
+                          orig_dn_attrs(test_ctx, TEST_GROUP_DN), session);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(session->num_pending, 0);
+    assert_null(session->flush_timer);
+
+    /* the changes sent afterwards are searched by name */
+    session->refreshed = true;
+    session->full_refresh = false;
+    ret = sdap_sync_entry(SDAP_SYNC_MODIFY, TEST_GROUP_DN,
+                          orig_dn_attrs(test_ctx, TEST_GROUP_DN), session);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(session->num_pending, 1);
+    assert_non_null(session->flush_timer);
+}
+
+static void test_ldap_sync_delete(void **state)
+{
+    struct ldap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct ldap_sync_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct ldb_message *msg;
+    errno_t ret;
+
+    ret = sysdb_store_user(dom, TEST_USER_NAME, NULL, 1234, 1234, NULL,
+                           "/home/"TEST_USER_NAME, "/bin/sh", TEST_USER_DN, NULL, NULL, 300, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_group(dom, TEST_GROUP_NAME, 4321,
+                            orig_dn_attrs(test_ctx, TEST_GROUP_DN), 300, 0);
+    assert_int_equal(ret, EOK);
+
+    /* an entry of the other type with the same DN is not touched */
+    ret = sdap_sync_entry(SDAP_SYNC_DELETE, TEST_GROUP_DN, NULL,
+                          &test_ctx->sync_ctx->users);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_search_group_by_name(test_ctx, dom, TEST_GROUP_NAME, NULL,
+                                     &msg);
+    assert_int_equal(ret, EOK);
+
+    ret = sdap_sync_entry(SDAP_SYNC_DELETE, TEST_USER_DN, NULL,
+                          &test_ctx->sync_ctx->users);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_search_user_by_name(test_ctx, dom, TEST_USER_NAME, NULL,
+                                    &msg);
+    assert_int_equal(ret, ENOENT);
+
+    ret = sdap_sync_entry(SDAP_SYNC_DELETE, TEST_GROUP_DN, NULL,
+                          &test_ctx->sync_ctx->groups);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_search_group_by_name(test_ctx, dom, TEST_GROUP_NAME, NULL,
+                                     &msg);
+    assert_int_equal(ret, ENOENT);
+
+    /* a deleted entry which is not cached is fine */
+    ret = sdap_sync_entry(SDAP_SYNC_DELETE, TEST_USER_DN, NULL,
+                          &test_ctx->sync_ctx->users);
+    assert_int_equal(ret, EOK);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_ldap_sync_ctx,
+                                        test_ldap_sync_setup,
+                                        test_ldap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_ldap_sync_cookie,
+                                        test_ldap_sync_setup,
+                                        test_ldap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_ldap_sync_queue,
+                                        test_ldap_sync_setup,
+                                        test_ldap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_ldap_sync_groups_full_refresh,
+                                        test_ldap_sync_setup,
+                                        test_ldap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_ldap_sync_delete,
+                                        test_ldap_sync_setup,
+                                        test_ldap_sync_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,273 @@
+/*
+    SSSD
+
+    Tests of the start of the responders by the monitor
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "tests/common.h"
+
+/* In order to access the startup of the services */
+#include "monitor/monitor.c"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_monitor_startup_conf.ldb"
+
+#define TEST_DOM_LDAP "ldap_dom"
+#define TEST_DOM_PROXY "proxy_dom"
+#define TEST_DOM_SUDO "sudo_dom"
+
+/* the services are queued in this order */
+#define TEST_SVC_NSS 0
+#define TEST_SVC_SUDO 1
+#define TEST_SVC_AUTOFS 2
+
+static const char *test_domains[] = { TEST_DOM_LDAP,
+                                      TEST_DOM_PROXY,
+                                      TEST_DOM_SUDO,
+                                      NULL };
+
+struct monitor_startup_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct mt_ctx *mt_ctx;
+};
+
+static struct monitor_startup_test_ctx *test_ctx;
+
+static void set_domain_option(const char *domain, const char *option,
+                              const char *value)
+{
+    const char *val[2] = { value, NULL };
+    char *path;
+    errno_t ret;
+
+    path = talloc_asprintf(test_ctx, CONFDB_DOMAIN_PATH_TMPL, domain);
+    assert_non_null(path);
+
+    ret = confdb_add_param(test_ctx->tctx->confdb, true, path, option, val);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(path);
+}
+
+static int monitor_startup_test_setup(void **state)
+{
+    struct mt_ctx *ctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct monitor_startup_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_multidom_test_ctx(test_ctx, TESTS_PATH,
+                                              TEST_CONF_DB, test_domains,
+                                              "proxy", NULL);
+    assert_non_null(test_ctx->tctx);
+
+    /* sudo rules come from LDAP, autofs maps from nowhere */
+    set_domain_option(TEST_DOM_LDAP, CONFDB_DOMAIN_ID_PROVIDER, "ldap");
+    set_domain_option(TEST_DOM_LDAP, CONFDB_DOMAIN_AUTOFS_PROVIDER, "none");
+    set_domain_option(TEST_DOM_SUDO, CONFDB_DOMAIN_SUDO_PROVIDER, "ldap");
+
+    ctx = talloc_zero(test_ctx, struct mt_ctx);
+    assert_non_null(ctx);
+    ctx->ev = test_ctx->tctx->ev;
+    ctx->cdb = test_ctx->tctx->confdb;
+    ctx->domains = test_ctx->tctx->dom;
+
+    ctx->services = talloc_zero_array(ctx, char *, 4);
+    assert_non_null(ctx->services);
+    ctx->services[TEST_SVC_NSS] = talloc_strdup(ctx->services, "nss");
+    ctx->services[TEST_SVC_SUDO] = talloc_strdup(ctx->services, "sudo");
+    ctx->services[TEST_SVC_AUTOFS] = talloc_strdup(ctx->services, "autofs");
+    ctx->num_services = 3;
+
+    ret = monitor_init_service_deps(ctx);
+    assert_int_equal(ret, EOK);
+
+    test_ctx->mt_ctx = ctx;
+    *state = test_ctx;
+    return 0;
+}
+
+static int monitor_startup_test_teardown(void **state)
+{
+    test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, test_domains);
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+/* The back end of the domain has registered */
+static void provider_started(const char *name)
+{
+    struct mt_ctx *ctx = test_ctx->mt_ctx;
+    struct mt_svc *svc;
+
+    svc = talloc_zero(ctx, struct mt_svc);
+    assert_non_null(svc);
+    svc->mt_ctx = ctx;
+    svc->type = MT_SVC_PROVIDER;
+    svc->heartbeat_fd = -1;
+    svc->provider = talloc_strdup(svc, "proxy");
+    assert_non_null(svc->provider);
+    svc->name = talloc_strdup(svc, name);
+    assert_non_null(svc->name);
+    svc->svc_started = true;
+    talloc_set_destructor((TALLOC_CTX *)svc, svc_destructor);
+
+    DLIST_ADD(ctx->svc_list, svc);
+
+    /* what mark_service_as_started() does for a provider */
+    monitor_start_ready_services(ctx, false);
+}
+
+static void assert_deps(int svc, const char **expected)
+{
+    char **domains = test_ctx->mt_ctx->svc_deps[svc].domains;
+    int i;
+
+    for (i = 0; expected[i] != NULL; i++) {
+        assert_non_null(domains[i]);
+        assert_string_equal(domains[i], expected[i]);
+    }
+    assert_null(domains[i]);
+}
+
+static bool is_queued(int svc)
+{
+    return test_ctx->mt_ctx->svc_deps[svc].queued;
+}
+
+/* The sudo and autofs responders only wait for the domains which
+ * implement them */
+void test_service_deps(void **state)
+{
+    const char *nss_deps[] = { TEST_DOM_LDAP, TEST_DOM_PROXY,
+                               TEST_DOM_SUDO, NULL };
+    const char *sudo_deps[] = { TEST_DOM_LDAP, TEST_DOM_SUDO, NULL };
+    const char *autofs_deps[] = { NULL };
+
+    assert_deps(TEST_SVC_NSS, nss_deps);
+    assert_deps(TEST_SVC_SUDO, sudo_deps);
+    assert_deps(TEST_SVC_AUTOFS, autofs_deps);
+}
+
+/* Each responder is started once its last provider has registered */
+void test_start_ready_services(void **state)
+{
+    struct mt_ctx *ctx = test_ctx->mt_ctx;
+
+    monitor_start_ready_services(ctx, false);
+    assert_false(is_queued(TEST_SVC_NSS));
+    assert_false(is_queued(TEST_SVC_SUDO));
+    assert_true(is_queued(TEST_SVC_AUTOFS));
+
+    provider_started(TEST_DOM_LDAP);
+    assert_false(is_queued(TEST_SVC_NSS));
+    assert_false(is_queued(TEST_SVC_SUDO));
+
+    provider_started(TEST_DOM_SUDO);
+    assert_false(is_queued(TEST_SVC_NSS));
+    assert_true(is_queued(TEST_SVC_SUDO));
+    assert_false(ctx->services_started);
+
+    provider_started(TEST_DOM_PROXY);
+    assert_true(is_queued(TEST_SVC_NSS));
+    assert_true(ctx->services_started);
+}
+
+/* The startup timeout starts the responders which are left */
+void test_start_forced(void **state)
+{
+    struct mt_ctx *ctx = test_ctx->mt_ctx;
+
+    provider_started(TEST_DOM_SUDO);
+    assert_false(is_queued(TEST_SVC_NSS));
+    assert_false(is_queued(TEST_SVC_SUDO));
+    assert_true(is_queued(TEST_SVC_AUTOFS));
+
+    monitor_start_ready_services(ctx, true);
+    assert_true(is_queued(TEST_SVC_NSS));
+    assert_true(is_queued(TEST_SVC_SUDO));
+    assert_true(ctx->services_started);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_service_deps,
+                                        monitor_startup_test_setup,
+                                        monitor_startup_test_teardown),
+        cmocka_unit_test_setup_teardown(test_start_ready_services,
+                                        monitor_startup_test_setup,
+                                        monitor_startup_test_teardown),
+        cmocka_unit_test_setup_teardown(test_start_forced,
+                                        monitor_startup_test_setup,
+                                        monitor_startup_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, test_domains);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, test_domains);
+    }
+    return rv;
+}
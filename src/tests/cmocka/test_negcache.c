@@ -44,6 +44,7 @@
 #include "responder/common/negcache.h"
 
 #define PORT 21
+#define UID 10001
 #define SID "S-1-2-3-4-5"
 #define CERT "MIIECTCCAvGgAwIBAgIBCTANBgkqhkiG9w0BAQsFADA0MRIwEAYDVQQKDAlJUEEuREVWRUwxHjAcBgNVBAMMFUNlcnRpZmljYXRlIEF1dGhvcml0eTAeFw0xNTA0MjgxMDIxMTFaFw0xNzA0MjgxMDIxMTFaMDIxEjAQBgNVBAoMCUlQQS5ERVZFTDEcMBoGA1UEAwwTaXBhLWRldmVsLmlwYS5kZXZlbDCCASIwDQYJKoZIhvcNAQEBBQADggEPADCCAQoCggEBALIykqtHuAwTVEofHikG/9BQy/dfeZFlsTkBg2qtnnc78w3XufbcnkpJp9Bmcsy/d9beqf5nlsxJ8TcjLsRQ9Ou6YtQjTfM3OILuOz8s0ICbF6qb66bd9hX/BrLO/9+KnpWFSR+E/YEmzgYyDTbKfBWBaGuPPrOi/K6vwkRYFZVA/FYZkYDtQhFmBO884HYzS4P6frRH3PvtRqWNCmaHpe97dGKsvnM2ybT+IMSB8/54GajQr3+BciRh2XaT4wvSTxkXM1fUgrDxqAP2AZmpuIyDyboZh+rWOwbrTPfx5SipELZG3uHhP8HMcr4qQ8b20LWgxCRuT73sIooHET350xUCAwEAAaOCASYwggEiMB8GA1UdIwQYMBaAFPKdQk4PxEglWC8czg+hPyLIVciRMDsGCCsGAQUFBwEBBC8wLTArBggrBgEFBQcwAYYfaHR0cDovL2lwYS1jYS5pcGEuZGV2ZWwvY2Evb2NzcDAOBgNVHQ8BAf8EBAMCBPAwHQYDVR0lBBYwFAYIKwYBBQUHAwEGCCsGAQUFBwMCMHQGA1UdHwRtMGswaaAxoC+GLWh0dHA6Ly9pcGEtY2EuaXBhLmRldmVsL2lwYS9jcmwvTWFzdGVyQ1JMLmJpbqI0pDIwMDEOMAwGA1UECgwFaXBhY2ExHjAcBgNVBAMMFUNlcnRpZmljYXRlIEF1dGhvcml0eTAdBgNVHQ4EFgQULSs/y/Wy/zIsqMIc3b2MgB7dMYIwDQYJKoZIhvcNAQELBQADggEBAJpHLlCnTR1TD8lxQgzl2n1JZOeryN/fAsGH0Vve2m8r5PC+ugnfAoULiuabBn1pOGxy/0x7Kg0/Iy8WRv8Fk7DqJCjXEqFXuFkZJfNDCtP9DzeNuMoV50iKoMfHS38BPFjXN+X/fSsBrA2fUWrlQCTmXlUN97gvQqxt5Slrxgukvxm9OSfu/sWz22LUvtJHupYwWv1iALgnXS86lAuVNYVALLxn34r58XsZlj5CSBMjBJWpaxEzgUdag3L2IPqOQXuPd0d8x11G9E/9gQquOSe2aiZjsdO/VYOCmzZsM2QPUMBVlBPDhfTVcWXQwN385uycW/ARtSzzSME2jKKWSIQ="
 #define PROTO "TCP"
@@ -54,6 +55,7 @@
 #define TEST_CONF_DB "test_nss_conf.ldb"
 #define TEST_DOM_NAME "nss_test"
 #define TEST_ID_PROVIDER "ldap"
+#define TEST_SHARED_FILE TESTS_PATH"/negcache_shared"
 
 /* register_cli_protocol_version is required in test since it links with
  * responder_common.c module
@@ -599,6 +601,207 @@ static void test_sss_ncache_service_port(void **state)
     assert_int_equal(ret, EEXIST);
 }
 
+/* @test_sss_ncache_case_insensitive : test that names of case insensitive
+ * domains are found regardless of their case
+ */
+static void test_sss_ncache_case_insensitive(void **state)
+{
+    int ret;
+    struct test_state *ts;
+    struct sss_domain_info *dom;
+
+    ts = talloc_get_type_abort(*state, struct test_state);
+    dom = talloc(ts, struct sss_domain_info);
+    dom->name = discard_const_p(char, TEST_DOM_NAME);
+    dom->case_sensitive = false;
+
+    ret = sss_ncache_set_user(ts->ctx, false, dom, "Foo_Name");
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_check_user(ts->ctx, LIFETIME, dom, "FOO_NAME");
+    assert_int_equal(ret, EEXIST);
+
+    ret = sss_ncache_set_group(ts->ctx, true, dom, "\xc5\xbdLUT\xc3\x9d");
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_check_group(ts->ctx, LIFETIME, dom,
+                                 "\xc5\xbelut\xc3\xbd");
+    assert_int_equal(ret, EEXIST);
+
+    /* a case sensitive domain of the same name does not match */
+    dom->case_sensitive = true;
+    ret = sss_ncache_check_user(ts->ctx, LIFETIME, dom, "FOO_NAME");
+    assert_int_equal(ret, ENOENT);
+
+    ret = sss_ncache_check_user(ts->ctx, LIFETIME, dom, "foo_name");
+    assert_int_equal(ret, EEXIST);
+}
+
+/* @test_sss_ncache_many_permanent : test that a large filter list is
+ * stored and checked correctly while the cache grows
+ */
+static void test_sss_ncache_many_permanent(void **state)
+{
+    int ret;
+    int i;
+    char name[32];
+    struct test_state *ts;
+    struct sss_domain_info *dom;
+
+    ts = talloc_get_type_abort(*state, struct test_state);
+    dom = talloc(ts, struct sss_domain_info);
+    dom->name = discard_const_p(char, TEST_DOM_NAME);
+    dom->case_sensitive = true;
+
+    for (i = 0; i < 5000; i++) {
+        snprintf(name, sizeof(name), "filtered%d", i);
+        ret = sss_ncache_set_user(ts->ctx, true, dom, name);
+        assert_int_equal(ret, EOK);
+
+        ret = sss_ncache_set_uid(ts->ctx, true, NULL, 100000 + i);
+        assert_int_equal(ret, EOK);
+    }
+
+    for (i = 0; i < 5000; i++) {
+        snprintf(name, sizeof(name), "filtered%d", i);
+        ret = sss_ncache_check_user(ts->ctx, 0, dom, name);
+        assert_int_equal(ret, EEXIST);
+
+        ret = sss_ncache_check_uid(ts->ctx, 0, NULL, 100000 + i);
+        assert_int_equal(ret, EEXIST);
+
+        snprintf(name, sizeof(name), "allowed%d", i);
+        ret = sss_ncache_check_user(ts->ctx, 0, dom, name);
+        assert_int_equal(ret, ENOENT);
+
+        ret = sss_ncache_check_uid(ts->ctx, 0, NULL, 200000 + i);
+        assert_int_equal(ret, ENOENT);
+
+        /* the uid is only filtered without a domain */
+        ret = sss_ncache_check_uid(ts->ctx, 0, dom, 100000 + i);
+        assert_int_equal(ret, ENOENT);
+    }
+
+    ret = sss_ncache_reset_permanent(ts->ctx);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_check_user(ts->ctx, 0, dom, "filtered42");
+    assert_int_equal(ret, ENOENT);
+}
+
+/* @test_sss_ncache_shared : test that temporary entries set by one
+ * responder are found by another one sharing the cache, permanent entries
+ * are not shared
+ */
+static void test_sss_ncache_shared(void **state)
+{
+    int ret;
+    FILE *f;
+    struct test_state *ts;
+    struct sss_nc_ctx *other;
+    struct sss_domain_info *dom;
+
+    ts = talloc_get_type_abort(*state, struct test_state);
+    dom = talloc(ts, struct sss_domain_info);
+    dom->name = discard_const_p(char, TEST_DOM_NAME);
+    dom->case_sensitive = true;
+
+    /* an invalid file is replaced */
+    f = fopen(TEST_SHARED_FILE, "w");
+    assert_non_null(f);
+    fputs("garbage", f);
+    fclose(f);
+
+    ret = sss_ncache_share(ts->ctx, TEST_SHARED_FILE);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_init(ts, &other);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_share(other, TEST_SHARED_FILE);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_set_user(ts->ctx, false, dom, NAME);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_set_uid(ts->ctx, false, dom, UID);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_set_group(ts->ctx, true, dom, NAME);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_check_user(other, LIFETIME, dom, NAME);
+    assert_int_equal(ret, EEXIST);
+
+    ret = sss_ncache_check_uid(other, LIFETIME, dom, UID);
+    assert_int_equal(ret, EEXIST);
+
+    /* neither another type nor another domain match */
+    ret = sss_ncache_check_group(other, LIFETIME, dom, NAME);
+    assert_int_equal(ret, ENOENT);
+
+    ret = sss_ncache_check_uid(other, LIFETIME, NULL, UID);
+    assert_int_equal(ret, ENOENT);
+
+    /* the timeout of the checking responder applies */
+    sleep(SHORTSPAN + 1);
+
+    ret = sss_ncache_check_user(other, SHORTSPAN, dom, NAME);
+    assert_int_equal(ret, ENOENT);
+
+    ret = sss_ncache_check_user(other, LIFETIME, dom, NAME);
+    assert_int_equal(ret, EEXIST);
+
+    talloc_free(other);
+    unlink(TEST_SHARED_FILE);
+}
+
+/* @test_sss_ncache_shared_case : test that the shared cache tells apart
+ * names which only differ in case in case sensitive domains
+ */
+static void test_sss_ncache_shared_case(void **state)
+{
+    int ret;
+    struct test_state *ts;
+    struct sss_nc_ctx *other;
+    struct sss_domain_info *dom;
+
+    ts = talloc_get_type_abort(*state, struct test_state);
+    dom = talloc(ts, struct sss_domain_info);
+    dom->name = discard_const_p(char, TEST_DOM_NAME);
+    dom->case_sensitive = true;
+
+    unlink(TEST_SHARED_FILE);
+
+    ret = sss_ncache_share(ts->ctx, TEST_SHARED_FILE);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_init(ts, &other);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_share(other, TEST_SHARED_FILE);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_set_user(ts->ctx, false, dom, "alice");
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_check_user(other, LIFETIME, dom, "alice");
+    assert_int_equal(ret, EEXIST);
+
+    ret = sss_ncache_check_user(other, LIFETIME, dom, "Alice");
+    assert_int_equal(ret, ENOENT);
+
+    /* in a case insensitive domain they are the same name */
+    dom->case_sensitive = false;
+    ret = sss_ncache_set_group(ts->ctx, false, dom, "Admins");
+    assert_int_equal(ret, EOK);
+
+    ret = sss_ncache_check_group(other, LIFETIME, dom, "ADMINS");
+    assert_int_equal(ret, EEXIST);
+
+    talloc_free(other);
+    unlink(TEST_SHARED_FILE);
+}
 
 static void test_sss_ncache_reset_permanent(void **state)
 {
@@ -858,6 +1061,14 @@ int main(void)
                                         teardown),
         cmocka_unit_test_setup_teardown(test_sss_ncache_service_port,
                                         setup, teardown),
+        cmocka_unit_test_setup_teardown(test_sss_ncache_case_insensitive,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_sss_ncache_many_permanent,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_sss_ncache_shared,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_sss_ncache_shared_case,
+                                        setup, teardown),
         cmocka_unit_test_setup_teardown(test_sss_ncache_reset_permanent, setup,
                                         teardown),
         cmocka_unit_test_setup_teardown(test_sss_ncache_prepopulate,
@@ -505,6 +505,188 @@ static void nested_groups_test_nested_chain(void **state)
                                        N_ELEMENTS(expected_users));
 }
 
+/* Two sibling groups with more members than lookups which may run at once,
+ * the members of the second group wait for the lookups of the first one */
+static void nested_groups_test_nested_wide_parallel(void **state)
+{
+    struct nested_groups_test_ctx *test_ctx = NULL;
+    struct tevent_req *req = NULL;
+    TALLOC_CTX *req_mem_ctx = NULL;
+    errno_t ret;
+    const char *rootgroup_members[] = { "cn=group1,"GROUP_BASE_DN,
+                                        "cn=group2,"GROUP_BASE_DN,
+                                        NULL };
+    const char *group1_members[] = { "cn=user1,"USER_BASE_DN,
+                                     "cn=user2,"USER_BASE_DN,
+                                     NULL };
+    const char *group2_members[] = { "cn=user3,"USER_BASE_DN,
+                                     "cn=user4,"USER_BASE_DN,
+                                     NULL };
+    struct sysdb_attrs *rootgroup;
+    const struct sysdb_attrs *group1_reply[2] = { NULL };
+    const struct sysdb_attrs *group2_reply[2] = { NULL };
+    const struct sysdb_attrs *user_reply[4][2] = { { NULL } };
+    const char *expected_groups[] = { "rootgroup", "group1", "group2" };
+    const char *expected_users[] = { "user1", "user2", "user3", "user4" };
+    char *name;
+    int i;
+
+    test_ctx = talloc_get_type_abort(*state, struct nested_groups_test_ctx);
+
+    ret = dp_opt_set_int(test_ctx->sdap_opts->basic,
+                         SDAP_NESTING_PARALLEL_LOOKUPS, 2);
+    assert_int_equal(ret, EOK);
+
+    /* mock return values */
+    rootgroup = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1000,
+                                            "rootgroup", rootgroup_members);
+    assert_non_null(rootgroup);
+
+    group1_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
+                                                  1001, "group1",
+                                                  group1_members);
+    assert_non_null(group1_reply[0]);
+    will_return(sdap_get_generic_recv, 1);
+    will_return(sdap_get_generic_recv, group1_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    group2_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
+                                                  1002, "group2",
+                                                  group2_members);
+    assert_non_null(group2_reply[0]);
+    will_return(sdap_get_generic_recv, 1);
+    will_return(sdap_get_generic_recv, group2_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    /* the lookups finish in the order they were started */
+    for (i = 0; i < 4; i++) {
+        name = talloc_asprintf(test_ctx, "user%d", i + 1);
+        assert_non_null(name);
+        user_reply[i][0] = mock_sysdb_user(test_ctx, USER_BASE_DN,
+                                           2001 + i, name);
+        assert_non_null(user_reply[i][0]);
+        will_return(sdap_get_generic_recv, 1);
+        will_return(sdap_get_generic_recv, user_reply[i]);
+        will_return(sdap_get_generic_recv, ERR_OK);
+    }
+
+    sss_will_return_always(sdap_has_deref_support, false);
+
+    /* run test, check for memory leaks */
+    req_mem_ctx = talloc_new(global_talloc_context);
+    assert_non_null(req_mem_ctx);
+    check_leaks_push(req_mem_ctx);
+
+    req = sdap_nested_group_send(req_mem_ctx, test_ctx->tctx->ev,
+                                 test_ctx->sdap_domain, test_ctx->sdap_opts,
+                                 test_ctx->sdap_handle, rootgroup);
+    assert_non_null(req);
+    tevent_req_set_callback(req, nested_groups_test_done, test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_true(check_leaks_pop(req_mem_ctx) == true);
+    talloc_zfree(req_mem_ctx);
+
+    /* check return code */
+    assert_int_equal(ret, ERR_OK);
+
+    assert_int_equal(test_ctx->num_users, N_ELEMENTS(expected_users));
+    assert_int_equal(test_ctx->num_groups, N_ELEMENTS(expected_groups));
+
+    compare_sysdb_string_array_noorder(test_ctx->groups,
+                                       expected_groups,
+                                       N_ELEMENTS(expected_groups));
+    compare_sysdb_string_array_noorder(test_ctx->users,
+                                       expected_users,
+                                       N_ELEMENTS(expected_users));
+}
+
+static void nested_groups_test_memo_shared_subgroup(void **state)
+{
+    struct nested_groups_test_ctx *test_ctx = NULL;
+    struct tevent_req *req = NULL;
+    TALLOC_CTX *req_mem_ctx = NULL;
+    errno_t ret;
+    const char *rootgroup_members[] = { "cn=group1,"GROUP_BASE_DN,
+                                        NULL };
+    const char *group1_members[] = { "cn=user1,"USER_BASE_DN,
+                                     NULL };
+    struct sysdb_attrs *rootgroup1;
+    struct sysdb_attrs *rootgroup2;
+    const struct sysdb_attrs *user_reply[2] = { NULL };
+    const struct sysdb_attrs *group1_reply[2] = { NULL };
+    const char *expected_groups[] = { "rootgroup2", "group1" };
+    const char *expected_users[] = { "user1" };
+
+    test_ctx = talloc_get_type_abort(*state, struct nested_groups_test_ctx);
+
+    /* mock return values, only the first request searches */
+    rootgroup1 = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1000,
+                                             "rootgroup1", rootgroup_members);
+    assert_non_null(rootgroup1);
+
+    rootgroup2 = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1001,
+                                             "rootgroup2", rootgroup_members);
+    assert_non_null(rootgroup2);
+
+    group1_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
+                                                  1002, "group1",
+                                                  group1_members);
+    assert_non_null(group1_reply[0]);
+    will_return(sdap_get_generic_recv, 1);
+    will_return(sdap_get_generic_recv, group1_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    user_reply[0] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2001, "user1");
+    assert_non_null(user_reply[0]);
+    will_return(sdap_get_generic_recv, 1);
+    will_return(sdap_get_generic_recv, user_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    sss_will_return_always(sdap_has_deref_support, false);
+
+    req = sdap_nested_group_send(test_ctx, test_ctx->tctx->ev,
+                                 test_ctx->sdap_domain, test_ctx->sdap_opts,
+                                 test_ctx->sdap_handle, rootgroup1);
+    assert_non_null(req);
+    tevent_req_set_callback(req, nested_groups_test_done, test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, ERR_OK);
+    assert_int_equal(test_ctx->num_users, 1);
+    assert_int_equal(test_ctx->num_groups, 2);
+
+    /* the second group is resolved from the memo, check for memory leaks */
+    test_ctx->tctx->done = false;
+
+    req_mem_ctx = talloc_new(global_talloc_context);
+    assert_non_null(req_mem_ctx);
+    check_leaks_push(req_mem_ctx);
+
+    req = sdap_nested_group_send(req_mem_ctx, test_ctx->tctx->ev,
+                                 test_ctx->sdap_domain, test_ctx->sdap_opts,
+                                 test_ctx->sdap_handle, rootgroup2);
+    assert_non_null(req);
+    tevent_req_set_callback(req, nested_groups_test_done, test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_true(check_leaks_pop(req_mem_ctx) == true);
+    talloc_zfree(req_mem_ctx);
+
+    /* check return code */
+    assert_int_equal(ret, ERR_OK);
+
+    assert_int_equal(test_ctx->num_users, N_ELEMENTS(expected_users));
+    assert_int_equal(test_ctx->num_groups, N_ELEMENTS(expected_groups));
+
+    compare_sysdb_string_array_noorder(test_ctx->groups,
+                                       expected_groups,
+                                       N_ELEMENTS(expected_groups));
+    compare_sysdb_string_array_noorder(test_ctx->users,
+                                       expected_users,
+                                       N_ELEMENTS(expected_users));
+}
+
 static void nested_groups_test_nested_chain_with_error(void **state)
 {
     struct nested_groups_test_ctx *test_ctx = NULL;
@@ -646,6 +828,8 @@ int main(int argc, const char *argv[])
         new_test(one_group_dup_group_members),
         new_test(nested_chain),
         new_test(nested_chain_with_error),
+        new_test(nested_wide_parallel),
+        new_test(memo_shared_subgroup),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
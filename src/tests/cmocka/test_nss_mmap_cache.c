@@ -0,0 +1,844 @@
+/*
+    SSSD
+
+    NSS Responder - Tests of the memory cache maps
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "util/mmap_cache.h"
+#include "sss_client/nss_mc.h"
+#include "sss_client/idmap/sss_nss_idmap.h"
+
+/* In order to access the slots and the clock reference bits */
+#include "responder/nss/nsssrv_mmap_cache.c"
+
+/* The binary is built with SSS_NSS_MCACHE_DIR pointing here, the responder
+ * stores the records and the NSS client reads them back like libwbclient
+ * does through sss_nss_getidsbysids(). */
+#define TEST_MC_ELEMENTS 200
+#define TEST_MC_TIMEOUT 3600
+
+struct mc_test_ctx {
+    struct sss_mc_ctx *sid_mc_ctx;
+    struct sss_mc_ctx *netgr_mc_ctx;
+    struct sss_mc_ctx *svc_mc_ctx;
+};
+
+static int test_mc_setup(void **state)
+{
+    struct mc_test_ctx *tctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    ret = mkdir(SSS_NSS_MCACHE_DIR, 0700);
+    assert_true(ret == 0 || errno == EEXIST);
+
+    tctx = talloc_zero(global_talloc_context, struct mc_test_ctx);
+    assert_non_null(tctx);
+
+    ret = sss_mmap_cache_init(tctx, "sid", SSS_MC_SID, TEST_MC_ELEMENTS,
+                              TEST_MC_TIMEOUT, &tctx->sid_mc_ctx);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_mmap_cache_init(tctx, "netgroup", SSS_MC_NETGROUP,
+                              TEST_MC_ELEMENTS, TEST_MC_TIMEOUT,
+                              &tctx->netgr_mc_ctx);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_mmap_cache_init(tctx, "services", SSS_MC_SERVICES,
+                              TEST_MC_ELEMENTS, TEST_MC_TIMEOUT,
+                              &tctx->svc_mc_ctx);
+    assert_int_equal(ret, EOK);
+
+    *state = tctx;
+    return 0;
+}
+
+static int test_mc_teardown(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+
+    assert_non_null(tctx);
+    talloc_free(tctx);
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+/* The file is kept between the tests, the next setup marks it recycled so
+ * that the client maps the new one */
+static int test_mc_group_teardown(void **state)
+{
+    unlink(SSS_NSS_MCACHE_DIR"/sid");
+    unlink(SSS_NSS_MCACHE_DIR"/netgroup");
+    unlink(SSS_NSS_MCACHE_DIR"/services");
+    rmdir(SSS_NSS_MCACHE_DIR);
+    return 0;
+}
+
+static void store_sid_by_sid(struct mc_test_ctx *tctx, const char *sid_str,
+                             const char *name_str, uint32_t id)
+{
+    struct sized_string sid;
+    struct sized_string name;
+    errno_t ret;
+
+    to_sized_string(&sid, sid_str);
+    to_sized_string(&name, name_str);
+
+    ret = sss_mmap_cache_sid_store(&tctx->sid_mc_ctx, &sid, &name, id,
+                                   SSS_ID_TYPE_UID, false);
+    assert_int_equal(ret, EOK);
+}
+
+static void store_sid(struct mc_test_ctx *tctx, const char *sid_str,
+                      const char *name_str, uint32_t id, uint32_t id_type)
+{
+    struct sized_string sid;
+    struct sized_string name;
+    errno_t ret;
+
+    to_sized_string(&sid, sid_str);
+    to_sized_string(&name, name_str);
+
+    ret = sss_mmap_cache_sid_store(&tctx->sid_mc_ctx, &sid, &name, id,
+                                   id_type, false);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_mmap_cache_sid_store(&tctx->sid_mc_ctx, &sid, &name, id,
+                                   id_type, true);
+    assert_int_equal(ret, EOK);
+}
+
+static void assert_sid_cached(const char *sid_str, const char *name_str,
+                              uint32_t id, bool by_sid, bool by_id)
+{
+    char *sid = NULL;
+    char *name = NULL;
+    uint32_t rid;
+    uint32_t id_type;
+    errno_t ret;
+
+    ret = sss_nss_mc_getsidbyname(name_str, strlen(name_str), &sid, &id_type);
+    assert_int_equal(ret, by_sid ? 0 : ENOENT);
+    if (by_sid) {
+        assert_string_equal(sid, sid_str);
+    }
+    free(sid);
+    sid = NULL;
+
+    ret = sss_nss_mc_getbysid(sid_str, strlen(sid_str), &name, &rid,
+                              &id_type);
+    assert_int_equal(ret, by_sid ? 0 : ENOENT);
+    if (by_sid) {
+        assert_string_equal(name, name_str);
+        assert_int_equal(rid, id);
+    }
+    free(name);
+
+    ret = sss_nss_mc_getsidbyid(id, &sid, &id_type);
+    assert_int_equal(ret, by_id ? 0 : ENOENT);
+    if (by_id) {
+        assert_string_equal(sid, sid_str);
+    }
+    free(sid);
+}
+
+/* A user removed from the cache is invalidated by name, the responder has
+ * no SID at hand then */
+void test_sid_invalidate_name(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    struct sized_string name;
+    errno_t ret;
+
+    store_sid(tctx, "S-1-5-21-1-2-3-1001", "alice@test", 1001,
+              SSS_ID_TYPE_UID);
+    store_sid(tctx, "S-1-5-21-1-2-3-1002", "bob@test", 1002,
+              SSS_ID_TYPE_UID);
+    assert_sid_cached("S-1-5-21-1-2-3-1001", "alice@test", 1001, true, true);
+
+    to_sized_string(&name, "alice@test");
+    ret = sss_mmap_cache_sid_invalidate_name(tctx->sid_mc_ctx, &name);
+    assert_int_equal(ret, EOK);
+    assert_sid_cached("S-1-5-21-1-2-3-1001", "alice@test", 1001, false, true);
+
+    ret = sss_mmap_cache_sid_invalidate_id(tctx->sid_mc_ctx, 1001);
+    assert_int_equal(ret, EOK);
+    assert_sid_cached("S-1-5-21-1-2-3-1001", "alice@test", 1001, false, false);
+
+    ret = sss_mmap_cache_sid_invalidate_name(tctx->sid_mc_ctx, &name);
+    assert_int_equal(ret, ENOENT);
+
+    /* other records are kept */
+    assert_sid_cached("S-1-5-21-1-2-3-1002", "bob@test", 1002, true, true);
+}
+
+/* Expired users and groups are invalidated with the SID of the entry */
+void test_sid_invalidate_sid(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    struct sized_string sid;
+    errno_t ret;
+
+    store_sid(tctx, "S-1-5-21-1-2-3-2001", "admins@test", 2001,
+              SSS_ID_TYPE_GID);
+    assert_sid_cached("S-1-5-21-1-2-3-2001", "admins@test", 2001, true, true);
+
+    to_sized_string(&sid, "S-1-5-21-1-2-3-2001");
+    ret = sss_mmap_cache_sid_invalidate(tctx->sid_mc_ctx, &sid);
+    assert_int_equal(ret, EOK);
+    ret = sss_mmap_cache_sid_invalidate_id(tctx->sid_mc_ctx, 2001);
+    assert_int_equal(ret, EOK);
+    assert_sid_cached("S-1-5-21-1-2-3-2001", "admins@test", 2001,
+                      false, false);
+}
+
+/* A netgroup which is gone must not be served from the cache anymore */
+void test_netgr_invalidate(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    uint8_t entries[sizeof(uint32_t) + sizeof("grp")];
+    struct sized_string name;
+    uint8_t *buf = NULL;
+    size_t buf_len;
+    size_t rp = 0;
+    errno_t ret;
+
+    /* a group entry as packed by the responder */
+    SAFEALIGN_SET_UINT32(entries, SSS_NETGR_REP_GROUP, &rp);
+    memcpy(entries + rp, "grp", sizeof("grp"));
+
+    to_sized_string(&name, "ngr@test");
+    ret = sss_mmap_cache_netgr_store(&tctx->netgr_mc_ctx, &name, 1,
+                                     entries, sizeof(entries));
+    assert_int_equal(ret, EOK);
+
+    ret = sss_nss_mc_getnetgr("ngr@test", strlen("ngr@test"), &buf, &buf_len);
+    assert_int_equal(ret, 0);
+    assert_int_equal(buf_len, SSS_NSS_MC_NETGR_HDR_LEN + sizeof(entries));
+    assert_memory_equal(buf + SSS_NSS_MC_NETGR_HDR_LEN, entries,
+                        sizeof(entries));
+    free(buf);
+    buf = NULL;
+
+    ret = sss_mmap_cache_netgr_invalidate(tctx->netgr_mc_ctx, &name);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_nss_mc_getnetgr("ngr@test", strlen("ngr@test"), &buf, &buf_len);
+    assert_int_equal(ret, ENOENT);
+
+    ret = sss_mmap_cache_netgr_invalidate(tctx->netgr_mc_ctx, &name);
+    assert_int_equal(ret, ENOENT);
+}
+
+/* A service as stored by the responder for the lookup by @key_str */
+static void store_svc(struct mc_test_ctx *tctx, const char *key_str,
+                      const char *alt_key_str, const char *proto_str,
+                      uint16_t port)
+{
+    const char aliases[] = "svcalias1\0svcalias2";
+    struct sized_string key;
+    struct sized_string alt_key;
+    struct sized_string name;
+    struct sized_string proto;
+    errno_t ret;
+
+    to_sized_string(&key, key_str);
+    to_sized_string(&alt_key, alt_key_str);
+    to_sized_string(&name, "testsvc");
+    to_sized_string(&proto, proto_str);
+
+    ret = sss_mmap_cache_svc_store(&tctx->svc_mc_ctx, &key, &alt_key,
+                                   &name, &proto, htons(port), 2,
+                                   discard_const(aliases), sizeof(aliases));
+    assert_int_equal(ret, EOK);
+}
+
+static void assert_svc(errno_t ret, struct servent *result,
+                       const char *proto, uint16_t port)
+{
+    assert_int_equal(ret, 0);
+    assert_string_equal(result->s_name, "testsvc");
+    assert_string_equal(result->s_proto, proto);
+    assert_int_equal(result->s_port, htons(port));
+    assert_string_equal(result->s_aliases[0], "svcalias1");
+    assert_string_equal(result->s_aliases[1], "svcalias2");
+    assert_null(result->s_aliases[2]);
+}
+
+/* A service looked up with a protocol is found by name and by port */
+void test_svc_by_name_and_port(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    struct servent result;
+    char buffer[256] __attribute__((aligned(sizeof(char *))));
+    errno_t ret;
+
+    store_svc(tctx, "testsvc/tcp", "#4242/tcp", "tcp", 4242);
+
+    ret = sss_nss_mc_getservbyname("testsvc", strlen("testsvc"),
+                                   "tcp", strlen("tcp"),
+                                   &result, buffer, sizeof(buffer));
+    assert_svc(ret, &result, "tcp", 4242);
+
+    ret = sss_nss_mc_getservbyport(htons(4242), "tcp",
+                                   &result, buffer, sizeof(buffer));
+    assert_svc(ret, &result, "tcp", 4242);
+
+    /* not for another protocol or any protocol */
+    ret = sss_nss_mc_getservbyname("testsvc", strlen("testsvc"),
+                                   "udp", strlen("udp"),
+                                   &result, buffer, sizeof(buffer));
+    assert_int_equal(ret, ENOENT);
+    ret = sss_nss_mc_getservbyname("testsvc", strlen("testsvc"), NULL, 0,
+                                   &result, buffer, sizeof(buffer));
+    assert_int_equal(ret, ENOENT);
+    ret = sss_nss_mc_getservbyport(htons(4242), "udp",
+                                   &result, buffer, sizeof(buffer));
+    assert_int_equal(ret, ENOENT);
+    ret = sss_nss_mc_getservbyport(htons(4242), NULL,
+                                   &result, buffer, sizeof(buffer));
+    assert_int_equal(ret, ENOENT);
+
+    /* the port key cannot be looked up as a name */
+    ret = sss_nss_mc_getservbyname("#4242", strlen("#4242"),
+                                   "tcp", strlen("tcp"),
+                                   &result, buffer, sizeof(buffer));
+    assert_int_equal(ret, ENOENT);
+    ret = sss_nss_mc_getservbyname("testsvc/tcp", strlen("testsvc/tcp"),
+                                   NULL, 0, &result, buffer, sizeof(buffer));
+    assert_int_equal(ret, ENOENT);
+
+    ret = sss_nss_mc_getservbyname("testsvc", strlen("testsvc"),
+                                   "tcp", strlen("tcp"),
+                                   &result, buffer, 16);
+    assert_int_equal(ret, ERANGE);
+}
+
+/* A service looked up without a protocol is only found that way, with the
+ * protocol of the reply */
+void test_svc_any_protocol(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    struct servent result;
+    char buffer[256] __attribute__((aligned(sizeof(char *))));
+    errno_t ret;
+
+    store_svc(tctx, "testsvc/", "testsvc/", "udp", 5353);
+    store_svc(tctx, "#5353/", "#5353/", "udp", 5353);
+
+    ret = sss_nss_mc_getservbyname("testsvc", strlen("testsvc"), NULL, 0,
+                                   &result, buffer, sizeof(buffer));
+    assert_svc(ret, &result, "udp", 5353);
+
+    ret = sss_nss_mc_getservbyport(htons(5353), NULL,
+                                   &result, buffer, sizeof(buffer));
+    assert_svc(ret, &result, "udp", 5353);
+
+    /* another protocol may have another port */
+    ret = sss_nss_mc_getservbyname("testsvc", strlen("testsvc"),
+                                   "udp", strlen("udp"),
+                                   &result, buffer, sizeof(buffer));
+    assert_int_equal(ret, ENOENT);
+    ret = sss_nss_mc_getservbyport(htons(5353), "udp",
+                                   &result, buffer, sizeof(buffer));
+    assert_int_equal(ret, ENOENT);
+}
+
+/* A record of the same size for every number, the cache does not grow */
+static void store_numbered(struct mc_test_ctx *tctx, int num)
+{
+    char sid[32];
+    char name[32];
+
+    snprintf(sid, sizeof(sid), "S-1-5-21-1-2-3-%04d", num);
+    snprintf(name, sizeof(name), "user%04d@test", num);
+
+    tctx->sid_mc_ctx->max_elems = tctx->sid_mc_ctx->ft_size * 8;
+    store_sid_by_sid(tctx, sid, name, num);
+}
+
+static struct sss_mc_rec *find_numbered(struct mc_test_ctx *tctx, int num)
+{
+    struct sized_string key;
+    char sid[32];
+
+    snprintf(sid, sizeof(sid), "S-1-5-21-1-2-3-%04d", num);
+    to_sized_string(&key, sid);
+
+    return sss_mc_find_record(tctx->sid_mc_ctx, &key);
+}
+
+static bool is_referenced(struct mc_test_ctx *tctx, struct sss_mc_rec *rec)
+{
+    uint32_t slot;
+    bool referenced;
+
+    slot = MC_PTR_TO_SLOT(tctx->sid_mc_ctx->data_table, rec);
+    MC_PROBE_BIT(tctx->sid_mc_ctx->ref_table, slot, referenced);
+
+    return referenced;
+}
+
+/* A record requested again is spared once by the clock hand and evicted
+ * on the next pass unless it is requested again meanwhile */
+void test_clock_second_chance(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    struct sss_mc_rec *rec;
+    uint32_t tot_slots = tctx->sid_mc_ctx->ft_size * 8;
+    int num;
+    int first_pass;
+
+    store_numbered(tctx, 9000);
+    store_numbered(tctx, 9000);
+    rec = find_numbered(tctx, 9000);
+    assert_non_null(rec);
+    assert_true(is_referenced(tctx, rec));
+
+    /* stored right after the hot record, the hand reaches it next */
+    store_numbered(tctx, 0);
+    assert_false(is_referenced(tctx, find_numbered(tctx, 0)));
+
+    for (num = 1; find_numbered(tctx, 0) != NULL; num++) {
+        assert_true((uint32_t)num < tot_slots);
+        store_numbered(tctx, num);
+    }
+    first_pass = num;
+    assert_true(tctx->sid_mc_ctx->evictions > 0);
+
+    /* the hand passed over the hot record */
+    rec = find_numbered(tctx, 9000);
+    assert_non_null(rec);
+    assert_false(is_referenced(tctx, rec));
+
+    for (; num < 2 * first_pass; num++) {
+        store_numbered(tctx, num);
+    }
+    assert_null(find_numbered(tctx, 9000));
+}
+
+/* Records requested regularly survive a flood of one-shot lookups */
+void test_clock_hot_set(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    struct sss_mc_rec *rec;
+    uint32_t tot_slots = tctx->sid_mc_ctx->ft_size * 8;
+    uint32_t rec_slots;
+    int num;
+    int hot;
+
+    for (hot = 9000; hot < 9004; hot++) {
+        store_numbered(tctx, hot);
+    }
+    rec = find_numbered(tctx, 9000);
+    assert_non_null(rec);
+    rec_slots = MC_SIZE_TO_SLOTS(rec->len);
+
+    /* many passes of the hand, the hot records are requested much more
+     * often than the hand comes around */
+    assert_true(tot_slots / rec_slots > 4 * 8);
+    for (num = 0; num < 8 * (tot_slots / rec_slots); num++) {
+        store_numbered(tctx, num);
+        if (num % 8 == 0) {
+            for (hot = 9000; hot < 9004; hot++) {
+                store_numbered(tctx, hot);
+            }
+        }
+    }
+
+    assert_true(tctx->sid_mc_ctx->evictions > 0);
+    assert_null(find_numbered(tctx, 0));
+    for (hot = 9000; hot < 9004; hot++) {
+        assert_non_null(find_numbered(tctx, hot));
+    }
+    assert_sid_cached("S-1-5-21-1-2-3-9000", "user9000@test", 9000,
+                      true, false);
+}
+
+/* The responder modifies a record while the client is reading it. The
+ * client copies what it needs out of the record and then checks the
+ * barrier; the wrapper makes the responder write in between. */
+enum torn_mode {
+    TORN_STORED,        /* a store completed meanwhile */
+    TORN_IN_PROGRESS,   /* a store started and has not finished yet */
+};
+
+#define TORN_SID "S-1-5-21-1-2-3-7000"
+#define TORN_NAME "torn@test"
+
+static struct mc_test_ctx *torn_tctx;
+static enum torn_mode torn_mode;
+static int torn_reads;
+static uint32_t torn_id;
+
+bool __real_sss_nss_mc_record_changed(struct sss_mc_rec *rec,
+                                      uint32_t barrier);
+
+bool __wrap_sss_nss_mc_record_changed(struct sss_mc_rec *rec,
+                                      uint32_t barrier)
+{
+    struct sized_string key;
+    struct sss_mc_rec *mc_rec;
+
+    if (torn_reads > 0) {
+        torn_reads--;
+
+        switch (torn_mode) {
+        case TORN_STORED:
+            store_sid_by_sid(torn_tctx, TORN_SID, TORN_NAME, ++torn_id);
+            break;
+        case TORN_IN_PROGRESS:
+            to_sized_string(&key, TORN_SID);
+            mc_rec = sss_mc_find_record(torn_tctx->sid_mc_ctx, &key);
+            assert_non_null(mc_rec);
+            MC_RAISE_BARRIER(mc_rec);
+            break;
+        }
+    }
+
+    return __real_sss_nss_mc_record_changed(rec, barrier);
+}
+
+static errno_t torn_lookup(struct mc_test_ctx *tctx, enum torn_mode mode,
+                           int reads, char **_name, uint32_t *_id)
+{
+    uint32_t id_type;
+
+    torn_tctx = tctx;
+    torn_mode = mode;
+    torn_reads = reads;
+
+    return sss_nss_mc_getbysid(TORN_SID, strlen(TORN_SID), _name, _id,
+                               &id_type);
+}
+
+/* A record changed during the lookup is read again, the client never
+ * returns what it copied before the change */
+void test_torn_read_retry(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    char *name = NULL;
+    uint32_t id = 0;
+    errno_t ret;
+
+    torn_id = 1;
+    store_sid_by_sid(tctx, TORN_SID, TORN_NAME, torn_id);
+
+    ret = torn_lookup(tctx, TORN_STORED, 1, &name, &id);
+    assert_int_equal(ret, 0);
+    assert_int_equal(torn_reads, 0);
+    assert_int_equal(torn_id, 2);
+    assert_int_equal(id, torn_id);
+    assert_string_equal(name, TORN_NAME);
+    free(name);
+    name = NULL;
+
+    /* changed on all but the last attempt */
+    ret = torn_lookup(tctx, TORN_STORED, SSS_NSS_MC_READ_RETRIES - 1,
+                      &name, &id);
+    assert_int_equal(ret, 0);
+    assert_int_equal(torn_reads, 0);
+    assert_int_equal(id, torn_id);
+    assert_string_equal(name, TORN_NAME);
+    free(name);
+    name = NULL;
+}
+
+/* The client gives up when the record keeps changing, the caller asks the
+ * responder then */
+void test_torn_read_give_up(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    struct sized_string key;
+    struct sss_mc_rec *rec;
+    char *name = NULL;
+    uint32_t id = 0;
+    errno_t ret;
+
+    torn_id = 1;
+    store_sid_by_sid(tctx, TORN_SID, TORN_NAME, torn_id);
+
+    ret = torn_lookup(tctx, TORN_STORED, SSS_NSS_MC_READ_RETRIES,
+                      &name, &id);
+    assert_int_equal(ret, EAGAIN);
+    assert_int_equal(torn_reads, 0);
+    assert_null(name);
+    assert_int_equal(id, 0);
+
+    /* a store which does not finish, the barriers of the record stay
+     * different */
+    ret = torn_lookup(tctx, TORN_IN_PROGRESS, 1, &name, &id);
+    assert_int_equal(ret, EIO);
+    assert_null(name);
+    assert_int_equal(id, 0);
+
+    /* the store finishes */
+    to_sized_string(&key, TORN_SID);
+    rec = sss_mc_find_record(tctx->sid_mc_ctx, &key);
+    assert_non_null(rec);
+    MC_LOWER_BARRIER(rec);
+
+    ret = torn_lookup(tctx, TORN_STORED, 0, &name, &id);
+    assert_int_equal(ret, 0);
+    assert_int_equal(id, torn_id);
+    assert_string_equal(name, TORN_NAME);
+    free(name);
+}
+
+/* The mapping of the client library, to check what it sees of the file it
+ * mapped before the cache was grown */
+extern struct sss_cli_mc_ctx sid_mc_ctx;
+
+/* Like store_numbered() but the cache may grow */
+static void store_growing(struct mc_test_ctx *tctx, int num)
+{
+    char sid[32];
+    char name[32];
+
+    snprintf(sid, sizeof(sid), "S-1-5-21-1-2-3-%04d", num);
+    snprintf(name, sizeof(name), "user%04d@test", num);
+
+    store_sid_by_sid(tctx, sid, name, num);
+}
+
+static bool is_chained(struct sss_mc_ctx *mcc, struct sss_mc_rec *rec,
+                       uint32_t hash)
+{
+    struct sss_mc_rec *cur;
+    uint32_t slot;
+
+    slot = mcc->hash_table[hash];
+    while (slot != MC_INVALID_VAL) {
+        assert_true(MC_SLOT_WITHIN_BOUNDS(slot, mcc->dt_size));
+        cur = MC_SLOT_TO_PTR(mcc->data_table, slot, struct sss_mc_rec);
+        if (cur == rec) {
+            return true;
+        }
+        slot = sss_mc_next_slot_with_hash(cur, hash);
+    }
+
+    return false;
+}
+
+/* Every record is reachable from both of its hash chains, by the responder
+ * and by the client */
+static void assert_numbered_cached(struct mc_test_ctx *tctx, int count)
+{
+    struct sss_mc_ctx *mcc = tctx->sid_mc_ctx;
+    struct sss_mc_rec *rec;
+    struct sized_string key;
+    char sid[32];
+    char name[32];
+    int num;
+
+    for (num = 0; num < count; num++) {
+        snprintf(sid, sizeof(sid), "S-1-5-21-1-2-3-%04d", num);
+        snprintf(name, sizeof(name), "user%04d@test", num);
+
+        to_sized_string(&key, sid);
+        rec = sss_mc_find_record(mcc, &key);
+        assert_non_null(rec);
+        assert_true(is_chained(mcc, rec, rec->hash1));
+        assert_true(is_chained(mcc, rec, rec->hash2));
+
+        to_sized_string(&key, name);
+        assert_ptr_equal(sss_mc_find_record(mcc, &key), rec);
+
+        assert_sid_cached(sid, name, num, true, false);
+    }
+}
+
+/* The cache doubles as soon as 90% of the slots are used, keeps all the
+ * records and makes the clients move to the new file */
+void test_grow_occupancy(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    struct sss_mc_header *old_hdr;
+    uint32_t tot_slots = tctx->sid_mc_ctx->ft_size * 8;
+    uint32_t used_slots;
+    size_t old_size;
+    char *name = NULL;
+    uint32_t id;
+    uint32_t id_type;
+    int num;
+    errno_t ret;
+
+    /* the client maps the current file */
+    store_growing(tctx, 0);
+    assert_sid_cached("S-1-5-21-1-2-3-0000", "user0000@test", 0,
+                      true, false);
+    old_hdr = sid_mc_ctx.mmap_base;
+    old_size = sid_mc_ctx.mmap_size;
+    assert_int_equal(old_hdr->status, SSS_MC_HEADER_ALIVE);
+
+    for (num = 1; ; num++) {
+        assert_true((uint32_t)num < tot_slots);
+
+        used_slots = tctx->sid_mc_ctx->used_slots;
+        store_growing(tctx, num);
+        if (tctx->sid_mc_ctx->ft_size * 8 != tot_slots) {
+            break;
+        }
+
+        /* no growth below the threshold */
+        assert_true((uint64_t)used_slots * 100
+                        < (uint64_t)tot_slots * SSS_MC_GROW_OCCUPANCY_PCT);
+    }
+
+    /* grown by the store which found the cache 90% full */
+    assert_true((uint64_t)used_slots * 100
+                    >= (uint64_t)tot_slots * SSS_MC_GROW_OCCUPANCY_PCT);
+    assert_int_equal(tctx->sid_mc_ctx->ft_size * 8, 2 * tot_slots);
+    assert_int_equal(sss_mc_stats(tctx->sid_mc_ctx)->grows, 1);
+    assert_int_equal(tctx->sid_mc_ctx->evictions, 0);
+
+    /* the client still holds the old file, which is recycled now */
+    assert_ptr_equal(sid_mc_ctx.mmap_base, old_hdr);
+    assert_int_equal(old_hdr->status, SSS_MC_HEADER_RECYCLED);
+    assert_int_equal(sss_nss_check_header(&sid_mc_ctx), EINVAL);
+
+    /* the next lookup moves to the new file */
+    ret = sss_nss_mc_getbysid("S-1-5-21-1-2-3-0000",
+                              strlen("S-1-5-21-1-2-3-0000"),
+                              &name, &id, &id_type);
+    assert_int_equal(ret, 0);
+    assert_string_equal(name, "user0000@test");
+    free(name);
+    assert_int_equal(sid_mc_ctx.initialized, INITIALIZED);
+    assert_true(sid_mc_ctx.mmap_size > old_size);
+    assert_int_equal(sss_nss_check_header(&sid_mc_ctx), 0);
+
+    assert_numbered_cached(tctx, num + 1);
+}
+
+/* Growing stops at eight times the configured size, the clock evicts
+ * records from there on */
+void test_grow_cap(void **state)
+{
+    struct mc_test_ctx *tctx = talloc_get_type(*state, struct mc_test_ctx);
+    uint32_t tot_slots = tctx->sid_mc_ctx->ft_size * 8;
+    uint32_t max_slots = tot_slots * SSS_MC_MAX_GROW_FACTOR;
+    uint32_t prev_slots = tot_slots;
+    uint32_t cur_slots;
+    int grows = 0;
+    int num;
+
+    for (num = 0; num < (int)max_slots; num++) {
+        store_growing(tctx, num);
+
+        cur_slots = tctx->sid_mc_ctx->ft_size * 8;
+        assert_true(cur_slots <= max_slots);
+        if (cur_slots != prev_slots) {
+            assert_int_equal(cur_slots, 2 * prev_slots);
+            prev_slots = cur_slots;
+            grows++;
+
+            /* nothing got lost on the way */
+            assert_numbered_cached(tctx, num + 1);
+        }
+    }
+
+    /* 1x -> 2x -> 4x -> 8x */
+    assert_int_equal(grows, 3);
+    assert_int_equal(sss_mc_stats(tctx->sid_mc_ctx)->grows, 3);
+    assert_int_equal(tctx->sid_mc_ctx->ft_size * 8, max_slots);
+    assert_int_equal(tctx->sid_mc_ctx->max_elems, max_slots);
+
+    /* full, records were evicted instead */
+    assert_true(tctx->sid_mc_ctx->evictions > 0);
+    assert_null(find_numbered(tctx, 0));
+    assert_non_null(find_numbered(tctx, num - 1));
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sid_invalidate_name,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_sid_invalidate_sid,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_netgr_invalidate,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_svc_by_name_and_port,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_svc_any_protocol,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_clock_second_chance,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_clock_hot_set,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_torn_read_retry,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_torn_read_give_up,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_grow_occupancy,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+        cmocka_unit_test_setup_teardown(test_grow_cap,
+                                        test_mc_setup,
+                                        test_mc_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+
+    return cmocka_run_group_tests(tests, NULL, test_mc_group_teardown);
+}
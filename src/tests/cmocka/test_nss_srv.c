@@ -2903,6 +2903,262 @@ void test_nss_getnamebysid_update(void **state)
     assert_string_equal(shell, "/bin/ksh");
 }
 
+/* Rebuild a single-command reply from a batched result so that the packet
+ * parsers above can be reused */
+static uint8_t *batch_item_to_packet(uint8_t *data, size_t data_len,
+                                     size_t *_blen)
+{
+    uint8_t *body;
+
+    body = talloc_zero_array(nss_test_ctx, uint8_t,
+                             data_len + 2 * sizeof(uint32_t));
+    if (body == NULL) return NULL;
+
+    SAFEALIGN_SETMEM_UINT32(body, 1, NULL);
+    memcpy(body + 2 * sizeof(uint32_t), data, data_len);
+    *_blen = data_len + 2 * sizeof(uint32_t);
+    return body;
+}
+
+static int test_nss_getbatch_check(uint32_t status, uint8_t *body, size_t blen)
+{
+    struct passwd pwd;
+    struct group gr;
+    uint32_t nmem;
+    uint32_t num;
+    uint32_t cmd;
+    uint32_t item_status;
+    uint8_t *data;
+    size_t data_len;
+    uint8_t *item;
+    size_t item_len;
+    size_t pos = 0;
+    errno_t ret;
+
+    assert_int_equal(status, EOK);
+
+    SAFEALIGN_COPY_UINT32(&num, body, NULL);
+    assert_int_equal(num, 3);
+
+    /* results come in the order of the request */
+    ret = sss_nss_batch_next_result(body, blen, &pos, &cmd,
+                                    &item_status, &data, &data_len);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(cmd, SSS_NSS_GETPWUID);
+    assert_int_equal(item_status, EOK);
+    item = batch_item_to_packet(data, data_len, &item_len);
+    assert_non_null(item);
+    ret = parse_user_packet(item, item_len, &pwd);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(pwd.pw_uid, 201);
+    assert_string_equal(pwd.pw_name, "testbatchuser1");
+
+    ret = sss_nss_batch_next_result(body, blen, &pos, &cmd,
+                                    &item_status, &data, &data_len);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(cmd, SSS_NSS_GETGRGID);
+    assert_int_equal(item_status, EOK);
+    item = batch_item_to_packet(data, data_len, &item_len);
+    assert_non_null(item);
+    ret = parse_group_packet(item, item_len, &gr, &nmem);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(gr.gr_gid, 1201);
+    assert_string_equal(gr.gr_name, "testbatchgroup");
+    assert_int_equal(nmem, 0);
+
+    ret = sss_nss_batch_next_result(body, blen, &pos, &cmd,
+                                    &item_status, &data, &data_len);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(cmd, SSS_NSS_GETPWUID);
+    assert_int_equal(item_status, EOK);
+    item = batch_item_to_packet(data, data_len, &item_len);
+    assert_non_null(item);
+    ret = parse_user_packet(item, item_len, &pwd);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(pwd.pw_uid, 202);
+    assert_string_equal(pwd.pw_name, "testbatchuser2");
+
+    ret = sss_nss_batch_next_result(body, blen, &pos, &cmd,
+                                    &item_status, &data, &data_len);
+    assert_int_equal(ret, ENOENT);
+
+    return EOK;
+}
+
+/* Test that several cached objects are returned in one reply */
+void test_nss_getbatch(void **state)
+{
+    errno_t ret;
+    uint8_t *body;
+    size_t pctr = 0;
+
+    ret = sysdb_add_user(nss_test_ctx->tctx->dom,
+                         "testbatchuser1", 201, 401, "test batch user1",
+                         "/home/testbatchuser1", "/bin/sh", NULL,
+                         NULL, 300, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_add_user(nss_test_ctx->tctx->dom,
+                         "testbatchuser2", 202, 401, "test batch user2",
+                         "/home/testbatchuser2", "/bin/sh", NULL,
+                         NULL, 300, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_add_group(nss_test_ctx->tctx->dom,
+                          "testbatchgroup", 1201,
+                          NULL, 300, 0);
+    assert_int_equal(ret, EOK);
+
+    body = talloc_zero_array(nss_test_ctx, uint8_t, 7 * sizeof(uint32_t));
+    assert_non_null(body);
+    SAFEALIGN_SETMEM_UINT32(body, 3, &pctr);
+    SAFEALIGN_SETMEM_UINT32(body + pctr, SSS_NSS_GETPWUID, &pctr);
+    SAFEALIGN_SETMEM_UINT32(body + pctr, 201, &pctr);
+    SAFEALIGN_SETMEM_UINT32(body + pctr, SSS_NSS_GETGRGID, &pctr);
+    SAFEALIGN_SETMEM_UINT32(body + pctr, 1201, &pctr);
+    SAFEALIGN_SETMEM_UINT32(body + pctr, SSS_NSS_GETPWUID, &pctr);
+    SAFEALIGN_SETMEM_UINT32(body + pctr, 202, &pctr);
+
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_WRAPPER);
+    will_return(__wrap_sss_packet_get_body, body);
+    will_return(__wrap_sss_packet_get_body, pctr);
+
+    /* Each result is filled in its own packet and then copied into the
+     * reply, the number of results is set at the end */
+    mock_fill_user();
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    mock_fill_group_with_members(0);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    mock_fill_user();
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+
+    set_cmd_cb(test_nss_getbatch_check);
+    ret = sss_cmd_execute(nss_test_ctx->cctx, SSS_NSS_GETBATCH,
+                          nss_test_ctx->nss_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(nss_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+static int test_nss_getbatch_sid_check(uint32_t status, uint8_t *body,
+                                       size_t blen)
+{
+    uint32_t num;
+    uint32_t cmd;
+    uint32_t item_status;
+    uint32_t id_type;
+    uint8_t *data;
+    size_t data_len;
+    size_t pos = 0;
+    errno_t ret;
+
+    assert_int_equal(status, EOK);
+
+    SAFEALIGN_COPY_UINT32(&num, body, NULL);
+    assert_int_equal(num, 2);
+
+    ret = sss_nss_batch_next_result(body, blen, &pos, &cmd,
+                                    &item_status, &data, &data_len);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(cmd, SSS_NSS_GETNAMEBYSID);
+    assert_int_equal(item_status, EOK);
+    assert_true(data_len > sizeof(uint32_t));
+    SAFEALIGN_COPY_UINT32(&id_type, data, NULL);
+    assert_int_equal(id_type, SSS_ID_TYPE_GID);
+    assert_string_equal((char *) data + sizeof(uint32_t),
+                        "Print Operators@BUILTIN");
+
+    /* Well-Known SIDs have no POSIX ID */
+    ret = sss_nss_batch_next_result(body, blen, &pos, &cmd,
+                                    &item_status, &data, &data_len);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(cmd, SSS_NSS_GETIDBYSID);
+    assert_int_equal(item_status, EINVAL);
+    assert_int_equal(data_len, 0);
+
+    ret = sss_nss_batch_next_result(body, blen, &pos, &cmd,
+                                    &item_status, &data, &data_len);
+    assert_int_equal(ret, ENOENT);
+
+    return EOK;
+}
+
+/* Test that Well-Known SIDs are resolved inside a batch request */
+void test_nss_getbatch_sid(void **state)
+{
+    errno_t ret;
+    uint8_t *body;
+    size_t pctr = 0;
+    const char *sid = "S-1-5-32-550";
+
+    body = talloc_zero_array(nss_test_ctx, uint8_t,
+                             3 * sizeof(uint32_t) + 2 * (strlen(sid) + 1));
+    assert_non_null(body);
+    SAFEALIGN_SETMEM_UINT32(body, 2, &pctr);
+    SAFEALIGN_SETMEM_UINT32(body + pctr, SSS_NSS_GETNAMEBYSID, &pctr);
+    memcpy(body + pctr, sid, strlen(sid) + 1);
+    pctr += strlen(sid) + 1;
+    SAFEALIGN_SETMEM_UINT32(body + pctr, SSS_NSS_GETIDBYSID, &pctr);
+    memcpy(body + pctr, sid, strlen(sid) + 1);
+    pctr += strlen(sid) + 1;
+
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_WRAPPER);
+    will_return(__wrap_sss_packet_get_body, body);
+    will_return(__wrap_sss_packet_get_body, pctr);
+
+    /* The name is filled in its own packet and copied into the reply, the
+     * failed item only adds its header, the number of results is set at
+     * the end */
+    mock_fill_bysid();
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+
+    set_cmd_cb(test_nss_getbatch_sid_check);
+    ret = sss_cmd_execute(nss_test_ctx->cctx, SSS_NSS_GETBATCH,
+                          nss_test_ctx->nss_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(nss_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+static enum sss_cmd_class nss_cmd_class(enum sss_cli_command cmd)
+{
+    struct sss_cmd_table *nss_cmds = get_nss_cmds();
+    int i;
+
+    for (i = 0; nss_cmds[i].cmd != SSS_CLI_NULL; i++) {
+        if (nss_cmds[i].cmd == cmd) {
+            return nss_cmds[i].cmd_class;
+        }
+    }
+
+    /* not in the table */
+    fail();
+    return SSS_CMD_INTERACTIVE;
+}
+
+/* Logins must not wait behind enumerations */
+void test_nss_cmd_classes(void **state)
+{
+    assert_int_equal(nss_cmd_class(SSS_NSS_GETPWNAM), SSS_CMD_INTERACTIVE);
+    assert_int_equal(nss_cmd_class(SSS_NSS_GETGRGID), SSS_CMD_INTERACTIVE);
+    assert_int_equal(nss_cmd_class(SSS_NSS_INITGR), SSS_CMD_INTERACTIVE);
+
+    assert_int_equal(nss_cmd_class(SSS_NSS_SETPWENT), SSS_CMD_BULK);
+    assert_int_equal(nss_cmd_class(SSS_NSS_GETGRENT), SSS_CMD_BULK);
+    assert_int_equal(nss_cmd_class(SSS_NSS_GETBATCH), SSS_CMD_BULK);
+}
+
 int main(int argc, const char *argv[])
 {
     int rv;
@@ -3016,6 +3272,11 @@ int main(int argc, const char *argv[])
                                         nss_test_setup, nss_test_teardown),
         cmocka_unit_test_setup_teardown(test_nss_getnamebysid_update,
                                         nss_test_setup, nss_test_teardown),
+        cmocka_unit_test_setup_teardown(test_nss_getbatch,
+                                        nss_test_setup, nss_test_teardown),
+        cmocka_unit_test_setup_teardown(test_nss_getbatch_sid,
+                                        nss_test_setup, nss_test_teardown),
+                                        nss_test_setup, nss_test_teardown),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
@@ -0,0 +1,381 @@
+/*
+    SSSD
+
+    NSS Responder - Tests of the worker processes
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the helper clients and the forwarding queue. The
+ * workers fail to start, there is no such binary. */
+#define NSS_WORKER_BINARY "/nonexistent/sssd_nss"
+#include "responder/common/responder_common.c"
+#include "responder/nss/nsssrv_workers.c"
+
+#define TEST_USER "alice"
+
+struct workers_test_ctx {
+    struct nss_ctx *nctx;
+    struct nss_cache_writer *writer;
+
+    /* the main process end of the connection of a worker */
+    int fd;
+    int lfd[2];
+
+    bool shutdown;
+    int shutdown_status;
+};
+
+static struct workers_test_ctx *workers_test_ctx;
+
+/* the worker exits when the main process goes away, record it instead */
+void __wrap_orderly_shutdown(int status)
+{
+    workers_test_ctx->shutdown = true;
+    workers_test_ctx->shutdown_status = status;
+}
+
+static int test_workers_setup(void **state)
+{
+    struct workers_test_ctx *tctx;
+    struct nss_ctx *nctx;
+
+    assert_true(leak_check_setup());
+
+    tctx = talloc_zero(global_talloc_context, struct workers_test_ctx);
+    assert_non_null(tctx);
+    tctx->fd = -1;
+    tctx->lfd[0] = -1;
+    tctx->lfd[1] = -1;
+
+    nctx = talloc_zero(tctx, struct nss_ctx);
+    assert_non_null(nctx);
+    nctx->rctx = talloc_zero(nctx, struct resp_ctx);
+    assert_non_null(nctx->rctx);
+    nctx->rctx->ev = tevent_context_init(nctx->rctx);
+    assert_non_null(nctx->rctx->ev);
+
+    tctx->nctx = nctx;
+    workers_test_ctx = tctx;
+    *state = tctx;
+    return 0;
+}
+
+static int test_workers_teardown(void **state)
+{
+    struct workers_test_ctx *tctx = talloc_get_type(*state,
+                                                    struct workers_test_ctx);
+
+    assert_non_null(tctx);
+
+    if (tctx->fd != -1) {
+        close(tctx->fd);
+    }
+    if (tctx->lfd[0] != -1) {
+        close(tctx->lfd[0]);
+        close(tctx->lfd[1]);
+    }
+
+    talloc_free(tctx);
+    workers_test_ctx = NULL;
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+/* Worker side, tctx->fd is what the main process reads */
+static void start_writer(struct workers_test_ctx *tctx)
+{
+    int sv[2];
+    errno_t ret;
+
+    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert_int_equal(ret, 0);
+
+    ret = nss_worker_init(tctx->nctx, sv[0]);
+    assert_int_equal(ret, EOK);
+    tctx->fd = sv[1];
+
+    assert_non_null(tctx->nctx->rctx->reply_sent_fn);
+    tctx->writer = talloc_get_type(tctx->nctx->rctx->reply_sent_pvt,
+                                   struct nss_cache_writer);
+    assert_non_null(tctx->writer);
+}
+
+/* A lookup the worker answered with num_results entries */
+static void reply_sent(struct workers_test_ctx *tctx,
+                       enum sss_cli_command cmd, uint32_t num_results)
+{
+    struct cli_ctx *cctx;
+    uint8_t *body;
+    size_t blen;
+    errno_t ret;
+
+    cctx = talloc_zero(tctx, struct cli_ctx);
+    assert_non_null(cctx);
+    cctx->rctx = tctx->nctx->rctx;
+    cctx->creq = talloc_zero(cctx, struct cli_request);
+    assert_non_null(cctx->creq);
+
+    ret = sss_packet_new(cctx->creq, sizeof(TEST_USER), cmd,
+                         &cctx->creq->in);
+    assert_int_equal(ret, EOK);
+    sss_packet_get_body(cctx->creq->in, &body, &blen);
+    memcpy(body, TEST_USER, sizeof(TEST_USER));
+
+    ret = sss_packet_new(cctx->creq, 2 * sizeof(uint32_t), cmd,
+                         &cctx->creq->out);
+    assert_int_equal(ret, EOK);
+    sss_packet_get_body(cctx->creq->out, &body, &blen);
+    SAFEALIGN_SETMEM_UINT32(body, num_results, NULL);
+    SAFEALIGN_SETMEM_UINT32(body + sizeof(uint32_t), 0, NULL);
+
+    tctx->nctx->rctx->reply_sent_fn(cctx, tctx->nctx->rctx->reply_sent_pvt);
+    talloc_free(cctx);
+}
+
+/* Reads the lookup forwarded by the worker */
+static void assert_forwarded(struct workers_test_ctx *tctx,
+                             enum sss_cli_command cmd)
+{
+    uint8_t buf[SSS_NSS_HEADER_SIZE + sizeof(TEST_USER)];
+    uint32_t val;
+    ssize_t len;
+
+    while (tctx->writer->waiting == false) {
+        assert_int_equal(tevent_loop_once(tctx->nctx->rctx->ev), 0);
+    }
+
+    len = sss_atomic_read_s(tctx->fd, buf, sizeof(buf));
+    assert_int_equal(len, sizeof(buf));
+
+    SAFEALIGN_COPY_UINT32(&val, buf, NULL);
+    assert_int_equal(val, sizeof(buf));
+    SAFEALIGN_COPY_UINT32(&val, buf + sizeof(uint32_t), NULL);
+    assert_int_equal(val, cmd);
+    assert_string_equal((char *) buf + SSS_NSS_HEADER_SIZE, TEST_USER);
+}
+
+/* The main process answers, the reply is discarded by the worker */
+static void send_reply(struct workers_test_ctx *tctx)
+{
+    uint8_t buf[SSS_NSS_HEADER_SIZE + sizeof(uint32_t)] = { 0 };
+    size_t queue_len = tctx->writer->queue_len;
+    ssize_t len;
+
+    SAFEALIGN_SETMEM_UINT32(buf, sizeof(buf), NULL);
+
+    len = sss_atomic_write_s(tctx->fd, buf, sizeof(buf));
+    assert_int_equal(len, sizeof(buf));
+
+    while (tctx->writer->queue_len == queue_len) {
+        assert_int_equal(tevent_loop_once(tctx->nctx->rctx->ev), 0);
+    }
+    assert_int_equal(tctx->writer->queue_len, queue_len - 1);
+}
+
+/* Found entries are forwarded one at a time, misses and enumerations are
+ * not forwarded at all */
+void test_worker_forward(void **state)
+{
+    struct workers_test_ctx *tctx = talloc_get_type(*state,
+                                                    struct workers_test_ctx);
+
+    start_writer(tctx);
+
+    reply_sent(tctx, SSS_NSS_GETPWNAM, 0);
+    reply_sent(tctx, SSS_NSS_GETPWENT, 1);
+    assert_int_equal(tctx->writer->queue_len, 0);
+
+    reply_sent(tctx, SSS_NSS_GETPWNAM, 1);
+    reply_sent(tctx, SSS_NSS_INITGR, 1);
+    assert_int_equal(tctx->writer->queue_len, 2);
+
+    assert_forwarded(tctx, SSS_NSS_GETPWNAM);
+
+    /* nothing else is sent until the reply came */
+    assert_true(tctx->writer->waiting);
+    assert_int_equal(tctx->writer->sent, tctx->writer->queue->len);
+
+    send_reply(tctx);
+    assert_forwarded(tctx, SSS_NSS_INITGR);
+    send_reply(tctx);
+
+    assert_null(tctx->writer->queue);
+    assert_false(tctx->shutdown);
+}
+
+/* Lookups are dropped when the main process does not keep up */
+void test_worker_queue_full(void **state)
+{
+    struct workers_test_ctx *tctx = talloc_get_type(*state,
+                                                    struct workers_test_ctx);
+    int i;
+
+    start_writer(tctx);
+
+    for (i = 0; i < NSS_WORKER_MAX_FORWARDS + 10; i++) {
+        reply_sent(tctx, SSS_NSS_GETPWNAM, 1);
+    }
+    assert_int_equal(tctx->writer->queue_len, NSS_WORKER_MAX_FORWARDS);
+
+    /* and queued again once there is room */
+    assert_forwarded(tctx, SSS_NSS_GETPWNAM);
+    send_reply(tctx);
+    reply_sent(tctx, SSS_NSS_GETPWNAM, 1);
+    assert_int_equal(tctx->writer->queue_len, NSS_WORKER_MAX_FORWARDS);
+}
+
+/* The worker exits when the main process closed the connection */
+void test_worker_main_gone(void **state)
+{
+    struct workers_test_ctx *tctx = talloc_get_type(*state,
+                                                    struct workers_test_ctx);
+
+    start_writer(tctx);
+
+    close(tctx->fd);
+    tctx->fd = -1;
+
+    while (!tctx->shutdown) {
+        assert_int_equal(tevent_loop_once(tctx->nctx->rctx->ev), 0);
+    }
+    assert_int_equal(tctx->shutdown_status, 0);
+}
+
+/* A reply nothing was asked for is a protocol error */
+void test_worker_unexpected_reply(void **state)
+{
+    struct workers_test_ctx *tctx = talloc_get_type(*state,
+                                                    struct workers_test_ctx);
+    uint32_t val = 0;
+    ssize_t len;
+
+    start_writer(tctx);
+
+    len = sss_atomic_write_s(tctx->fd, &val, sizeof(val));
+    assert_int_equal(len, sizeof(val));
+
+    while (!tctx->shutdown) {
+        assert_int_equal(tevent_loop_once(tctx->nctx->rctx->ev), 0);
+    }
+    assert_int_equal(tctx->shutdown_status, 1);
+}
+
+/* Main process side, a worker which fails is restarted later */
+static struct nss_worker *start_failing_worker(struct workers_test_ctx *tctx)
+{
+    struct nss_worker *worker;
+    errno_t ret;
+
+    ret = pipe(tctx->lfd);
+    assert_int_equal(ret, 0);
+    tctx->nctx->rctx->lfd = tctx->lfd[0];
+
+    ret = nss_workers_start(tctx->nctx, 1);
+    assert_int_equal(ret, EOK);
+    assert_non_null(tctx->nctx->workers);
+
+    worker = &tctx->nctx->workers->workers[0];
+    assert_true(worker->pid > 0);
+
+    while (worker->pid != 0) {
+        assert_int_equal(tevent_loop_once(tctx->nctx->rctx->ev), 0);
+    }
+
+    return worker;
+}
+
+void test_worker_restart(void **state)
+{
+    struct workers_test_ctx *tctx = talloc_get_type(*state,
+                                                    struct workers_test_ctx);
+    struct nss_worker *worker;
+
+    worker = start_failing_worker(tctx);
+    assert_non_null(worker->restart_te);
+}
+
+void test_worker_no_restart_on_shutdown(void **state)
+{
+    struct workers_test_ctx *tctx = talloc_get_type(*state,
+                                                    struct workers_test_ctx);
+    struct nss_worker *worker;
+
+    tctx->nctx->rctx->shutting_down = true;
+
+    worker = start_failing_worker(tctx);
+    assert_null(worker->restart_te);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_worker_forward,
+                                        test_workers_setup,
+                                        test_workers_teardown),
+        cmocka_unit_test_setup_teardown(test_worker_queue_full,
+                                        test_workers_setup,
+                                        test_workers_teardown),
+        cmocka_unit_test_setup_teardown(test_worker_main_gone,
+                                        test_workers_setup,
+                                        test_workers_teardown),
+        cmocka_unit_test_setup_teardown(test_worker_unexpected_reply,
+                                        test_workers_setup,
+                                        test_workers_teardown),
+        cmocka_unit_test_setup_teardown(test_worker_restart,
+                                        test_workers_setup,
+                                        test_workers_teardown),
+        cmocka_unit_test_setup_teardown(test_worker_no_restart_on_shutdown,
+                                        test_workers_setup,
+                                        test_workers_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
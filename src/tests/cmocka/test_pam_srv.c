@@ -871,6 +871,79 @@ void test_pam_preauth(void **state)
     assert_int_equal(ret, EOK);
 }
 
+static void common_test_pam_cmd(enum sss_cli_command cmd, const char *pwd)
+{
+    int ret;
+
+    pam_test_ctx->provider_contacted = false;
+    pam_test_ctx->tctx->done = false;
+
+    mock_input_pam(pam_test_ctx, "pamuser", pwd, NULL);
+
+    will_return(__wrap_sss_packet_get_cmd, cmd);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+
+    set_cmd_cb(test_pam_simple_check);
+    ret = sss_cmd_execute(pam_test_ctx->cctx, cmd, pam_test_ctx->pam_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(pam_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+void test_pam_preauth_cached(void **state)
+{
+    int ret;
+
+    ret = sss_hash_create(pam_test_ctx->pctx, 10,
+                          &pam_test_ctx->pctx->preauth_table);
+    assert_int_equal(ret, EOK);
+    pam_test_ctx->pctx->preauth_timeout = 30;
+
+    common_test_pam_cmd(SSS_PAM_PREAUTH, NULL);
+    assert_true(pam_test_ctx->provider_contacted);
+
+    /* The second conversation is answered from the cache */
+    common_test_pam_cmd(SSS_PAM_PREAUTH, NULL);
+    assert_false(pam_test_ctx->provider_contacted);
+
+    /* A failed authentication drops the cached response */
+    pam_test_ctx->exp_pam_status = PAM_AUTH_ERR;
+    common_test_pam_cmd(SSS_PAM_AUTHENTICATE, "12345");
+    assert_true(pam_test_ctx->provider_contacted);
+
+    pam_test_ctx->exp_pam_status = PAM_SUCCESS;
+    common_test_pam_cmd(SSS_PAM_PREAUTH, NULL);
+    assert_true(pam_test_ctx->provider_contacted);
+}
+
+void test_pam_id_snapshot(void **state)
+{
+    int ret;
+
+    ret = sss_hash_create(pam_test_ctx->pctx, 10,
+                          &pam_test_ctx->pctx->id_snapshot_table);
+    assert_int_equal(ret, EOK);
+    pam_test_ctx->pctx->id_timeout = 30;
+
+    common_test_pam_cmd(SSS_PAM_AUTHENTICATE, "12345");
+    assert_true(pam_test_ctx->provider_contacted);
+
+    /* The later phases must not look the user up again */
+    ret = sysdb_delete_user(pam_test_ctx->tctx->dom, "pamuser", 0);
+    assert_int_equal(ret, EOK);
+
+    common_test_pam_cmd(SSS_PAM_ACCT_MGMT, NULL);
+    common_test_pam_cmd(SSS_PAM_OPEN_SESSION, NULL);
+
+    ret = sysdb_add_user(pam_test_ctx->tctx->dom,
+                         "pamuser", 123, 456, "pam user",
+                         "/home/pamuser", "/bin/sh", NULL,
+                         NULL, 300, 0);
+    assert_int_equal(ret, EOK);
+}
+
 /* Cached on-line authentication */
 
 static void common_test_pam_cached_auth(const char *pwd)
@@ -1368,6 +1441,17 @@ static void set_cert_auth_param(struct pam_ctx *pctx, const char *dbpath)
     pam_test_ctx->pctx->nss_db = discard_const(dbpath);
 }
 
+static void set_cert_auth_persistent_param(struct pam_ctx *pctx,
+                                           const char *dbpath)
+{
+    int ret;
+
+    set_cert_auth_param(pctx, dbpath);
+
+    ret = p11_child_worker_setup(pctx, pctx->rctx->ev, -1, &pctx->p11_worker);
+    assert_int_equal(ret, EOK);
+}
+
 void test_pam_preauth_cert_nocert(void **state)
 {
     int ret;
@@ -1601,6 +1685,52 @@ void test_pam_cert_auth(void **state)
     assert_int_equal(ret, EOK);
 }
 
+void test_pam_preauth_cert_match_persistent(void **state)
+{
+    int ret;
+
+    set_cert_auth_persistent_param(pam_test_ctx->pctx, NSS_DB);
+
+    mock_input_pam_cert(pam_test_ctx, "pamuser", NULL);
+
+    will_return(__wrap_sss_packet_get_cmd, SSS_PAM_PREAUTH);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    mock_account_recv(0, 0, NULL, test_lookup_by_cert_cb,
+                      discard_const(TEST_TOKEN_CERT));
+
+    set_cmd_cb(test_pam_cert_check);
+    ret = sss_cmd_execute(pam_test_ctx->cctx, SSS_PAM_PREAUTH,
+                          pam_test_ctx->pam_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(pam_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+void test_pam_cert_auth_persistent(void **state)
+{
+    int ret;
+
+    set_cert_auth_persistent_param(pam_test_ctx->pctx, NSS_DB);
+
+    mock_input_pam_cert(pam_test_ctx, "pamuser", "123456");
+
+    will_return(__wrap_sss_packet_get_cmd, SSS_PAM_AUTHENTICATE);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    mock_account_recv(0, 0, NULL, test_lookup_by_cert_cb,
+                      discard_const(TEST_TOKEN_CERT));
+
+    set_cmd_cb(test_pam_simple_check);
+    ret = sss_cmd_execute(pam_test_ctx->cctx, SSS_PAM_AUTHENTICATE,
+                          pam_test_ctx->pam_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(pam_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
 int main(int argc, const char *argv[])
 {
     int rv;
@@ -1632,6 +1762,10 @@ int main(int argc, const char *argv[])
                                         pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_preauth,
                                         pam_test_setup, pam_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pam_preauth_cached,
+                                        pam_test_setup, pam_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pam_id_snapshot,
+                                        pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_offline_auth_no_hash,
                                         pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_offline_auth_success,
@@ -1706,6 +1840,10 @@ int main(int argc, const char *argv[])
                                    pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_cert_auth,
                                         pam_test_setup, pam_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pam_preauth_cert_match_persistent,
+                                        pam_test_setup, pam_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pam_cert_auth_persistent,
+                                        pam_test_setup, pam_test_teardown),
 #endif /* HAVE_NSS */
     };
 
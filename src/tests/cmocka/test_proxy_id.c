@@ -0,0 +1,331 @@
+/*
+    SSSD
+
+    Tests of the lookups and the enumeration of the proxy provider
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "tests/cmocka/common_mock_be.h"
+
+/* In order to access the lookups and the enumeration state */
+#include "providers/proxy/proxy_id.c"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_proxy_id_conf.ldb"
+#define TEST_DOM_NAME "proxy_id_test"
+
+#define TEST_USER "user"
+#define TEST_UID 10000
+#define TEST_NUM_GROUPS (ENUM_GROUPS_CHUNK * 2 + ENUM_GROUPS_CHUNK / 2)
+
+struct proxy_id_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct proxy_id_ctx *ctx;
+
+    /* the module answers NSS_STATUS_TRYAGAIN to smaller buffers */
+    size_t required_buflen;
+    size_t last_buflen;
+    int num_calls;
+
+    int next_group;
+    int num_setgrent;
+    int num_endgrent;
+};
+
+static struct proxy_id_test_ctx *test_ctx;
+
+static char *no_members[] = { NULL };
+
+static enum nss_status test_getpwnam_r(const char *name, struct passwd *result,
+                                       char *buffer, size_t buflen,
+                                       int *errnop)
+{
+    test_ctx->num_calls++;
+    test_ctx->last_buflen = buflen;
+
+    if (buflen < test_ctx->required_buflen) {
+        *errnop = ERANGE;
+        return NSS_STATUS_TRYAGAIN;
+    }
+
+    snprintf(buffer, buflen, "%s", name);
+    result->pw_name = buffer;
+    result->pw_passwd = discard_const("*");
+    result->pw_uid = TEST_UID;
+    result->pw_gid = TEST_UID;
+    result->pw_gecos = discard_const("");
+    result->pw_dir = discard_const("/home/user");
+    result->pw_shell = discard_const("/bin/sh");
+
+    *errnop = 0;
+    return NSS_STATUS_SUCCESS;
+}
+
+static enum nss_status test_setgrent(void)
+{
+    test_ctx->num_setgrent++;
+    test_ctx->next_group = 0;
+    return NSS_STATUS_SUCCESS;
+}
+
+static enum nss_status test_getgrent_r(struct group *result,
+                                       char *buffer, size_t buflen,
+                                       int *errnop)
+{
+    test_ctx->num_calls++;
+    test_ctx->last_buflen = buflen;
+
+    if (test_ctx->next_group == TEST_NUM_GROUPS) {
+        *errnop = ENOENT;
+        return NSS_STATUS_NOTFOUND;
+    }
+
+    if (buflen < test_ctx->required_buflen) {
+        *errnop = ERANGE;
+        return NSS_STATUS_TRYAGAIN;
+    }
+
+    snprintf(buffer, buflen, "group%d", test_ctx->next_group);
+    result->gr_name = buffer;
+    result->gr_passwd = discard_const("*");
+    result->gr_gid = TEST_UID + test_ctx->next_group;
+    result->gr_mem = no_members;
+    test_ctx->next_group++;
+
+    *errnop = 0;
+    return NSS_STATUS_SUCCESS;
+}
+
+static enum nss_status test_endgrent(void)
+{
+    test_ctx->num_endgrent++;
+    return NSS_STATUS_SUCCESS;
+}
+
+static int proxy_id_test_setup(void **state)
+{
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct proxy_id_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, "proxy", NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->ctx = talloc_zero(test_ctx, struct proxy_id_ctx);
+    assert_non_null(test_ctx->ctx);
+    test_ctx->ctx->be = mock_be_ctx(test_ctx, test_ctx->tctx);
+
+    test_ctx->ctx->ops.getpwnam_r = test_getpwnam_r;
+    test_ctx->ctx->ops.setgrent = test_setgrent;
+    test_ctx->ctx->ops.getgrent_r = test_getgrent_r;
+    test_ctx->ctx->ops.endgrent = test_endgrent;
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int proxy_id_test_teardown(void **state)
+{
+    talloc_zfree(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static errno_t lookup_user(void)
+{
+    struct passwd pwd;
+    char *buffer;
+    size_t buflen;
+    bool del_user;
+    errno_t ret;
+
+    buffer = proxy_alloc_buffer(test_ctx, test_ctx->ctx->pw_buflen, &buflen);
+    assert_non_null(buffer);
+
+    ret = proxy_getpw(test_ctx, test_ctx->ctx, test_ctx->tctx->dom,
+                      TEST_USER, 0, &pwd, &buffer, &buflen, &del_user);
+    if (ret == EOK) {
+        assert_false(del_user);
+        assert_string_equal(pwd.pw_name, TEST_USER);
+        assert_int_equal(pwd.pw_uid, TEST_UID);
+    }
+
+    talloc_free(buffer);
+    return ret;
+}
+
+/* The buffer grows until the entry fits, the next lookups start with the
+ * size it needed */
+void test_getpw_grow(void **state)
+{
+    errno_t ret;
+
+    test_ctx->required_buflen = DEFAULT_BUFSIZE * 4 + 1;
+
+    ret = lookup_user();
+    assert_int_equal(ret, EOK);
+    /* 4k, 8k, 16k and 32k */
+    assert_int_equal(test_ctx->num_calls, 4);
+    assert_int_equal(test_ctx->last_buflen, DEFAULT_BUFSIZE * 8);
+    assert_int_equal(test_ctx->ctx->pw_buflen, DEFAULT_BUFSIZE * 8);
+
+    test_ctx->num_calls = 0;
+    ret = lookup_user();
+    assert_int_equal(ret, EOK);
+    assert_int_equal(test_ctx->num_calls, 1);
+}
+
+/* An entry which does not fit into MAX_BUF_SIZE is an error */
+void test_getpw_too_large(void **state)
+{
+    errno_t ret;
+
+    test_ctx->required_buflen = MAX_BUF_SIZE + 1;
+
+    ret = lookup_user();
+    assert_int_equal(ret, ERANGE);
+    assert_int_equal(test_ctx->last_buflen, MAX_BUF_SIZE);
+    assert_int_equal(test_ctx->ctx->pw_buflen, MAX_BUF_SIZE);
+}
+
+static size_t num_cached_groups(void)
+{
+    struct ldb_result *res;
+    size_t count;
+    errno_t ret;
+
+    ret = sysdb_enumgrent(test_ctx, test_ctx->tctx->dom, &res);
+    assert_int_equal(ret, EOK);
+    count = res->count;
+    talloc_free(res);
+
+    return count;
+}
+
+/* Each chunk of groups is saved before the event loop gets back to the
+ * other requests, a second enumeration joins the running one */
+void test_enum_groups_chunks(void **state)
+{
+    struct proxy_enum *e = &test_ctx->ctx->enums[PROXY_ENUM_GROUPS];
+    errno_t ret;
+
+    test_ctx->required_buflen = DEFAULT_BUFSIZE * 2;
+
+    ret = proxy_enum_start(test_ctx->ctx, PROXY_ENUM_GROUPS);
+    assert_int_equal(ret, EOK);
+    assert_non_null(e->req);
+    assert_int_equal(test_ctx->num_setgrent, 1);
+
+    ret = proxy_enum_start(test_ctx->ctx, PROXY_ENUM_GROUPS);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(test_ctx->num_setgrent, 1);
+
+    /* the first chunk */
+    assert_int_equal(tevent_loop_once(test_ctx->tctx->ev), 0);
+    assert_non_null(e->req);
+    assert_int_equal(num_cached_groups(), ENUM_GROUPS_CHUNK);
+    assert_int_equal(test_ctx->ctx->gr_buflen, DEFAULT_BUFSIZE * 2);
+
+    /* the second one */
+    assert_int_equal(tevent_loop_once(test_ctx->tctx->ev), 0);
+    assert_non_null(e->req);
+    assert_int_equal(num_cached_groups(), ENUM_GROUPS_CHUNK * 2);
+
+    /* the rest */
+    while (e->req != NULL) {
+        assert_int_equal(tevent_loop_once(test_ctx->tctx->ev), 0);
+    }
+    assert_int_equal(num_cached_groups(), TEST_NUM_GROUPS);
+    assert_int_equal(test_ctx->num_setgrent, 1);
+    assert_int_equal(test_ctx->num_endgrent, 1);
+
+    /* the next enumeration starts with the larger buffer */
+    test_ctx->num_calls = 0;
+    ret = proxy_enum_start(test_ctx->ctx, PROXY_ENUM_GROUPS);
+    assert_int_equal(ret, EOK);
+    while (e->req != NULL) {
+        assert_int_equal(tevent_loop_once(test_ctx->tctx->ev), 0);
+    }
+    assert_int_equal(test_ctx->num_calls, TEST_NUM_GROUPS + 1);
+    assert_int_equal(test_ctx->num_endgrent, 2);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_getpw_grow,
+                                        proxy_id_test_setup,
+                                        proxy_id_test_teardown),
+        cmocka_unit_test_setup_teardown(test_getpw_too_large,
+                                        proxy_id_test_setup,
+                                        proxy_id_test_teardown),
+        cmocka_unit_test_setup_teardown(test_enum_groups_chunks,
+                                        proxy_id_test_setup,
+                                        proxy_id_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -333,6 +333,107 @@ void test_resolv_fake_srv(void **state)
     assert_int_equal(ret, ERR_OK);
 }
 
+static void test_resolv_fake_srv_cached_done(struct tevent_req *req)
+{
+    errno_t ret;
+    int status;
+    uint32_t ttl;
+    struct ares_srv_reply *srv_replies = NULL;
+    struct resolv_fake_ctx *test_ctx =
+        tevent_req_callback_data(req, struct resolv_fake_ctx);
+
+    ret = resolv_getsrv_recv(test_ctx, req, &status, NULL,
+                             &srv_replies, &ttl);
+    talloc_free(req);
+    assert_int_equal(ret, EOK);
+
+    assert_non_null(srv_replies);
+    assert_string_equal(srv_replies->host, "ldap.sssd.com");
+    talloc_free(srv_replies);
+
+    /* a cached answer carries the time which is left */
+    assert_true(ttl > 0 && ttl <= 500);
+
+    test_ev_done(test_ctx->ctx, EOK);
+}
+
+static void test_resolv_fake_srv_send(struct resolv_fake_ctx *test_ctx)
+{
+    struct tevent_req *req;
+    int ret;
+
+    req = resolv_getsrv_send(test_ctx, test_ctx->ctx->ev,
+                             test_ctx->resolv, TEST_SRV_QUERY);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_resolv_fake_srv_cached_done, test_ctx);
+
+    test_ctx->ctx->done = false;
+    ret = test_ev_loop(test_ctx->ctx);
+    assert_int_equal(ret, ERR_OK);
+}
+
+void test_resolv_fake_srv_cached(void **state)
+{
+    struct resolv_fake_ctx *test_ctx =
+        talloc_get_type(*state, struct resolv_fake_ctx);
+    unsigned char *buf;
+    size_t buflen;
+    struct srv_rrdata rr;
+    struct resolv_stats stats;
+
+    rr.prio = 1;
+    rr.port = 389;
+    rr.weight = 100;
+    rr.ttl = 500;
+    rr.hostname = "ldap.sssd.com";
+
+    buf = create_srv_buffer(test_ctx, TEST_SRV_QUERY, &rr, 1, &buflen);
+    assert_non_null(buf);
+
+    /* only the first query goes to the DNS server */
+    mock_ares_query(0, 0, buf, buflen);
+    test_resolv_fake_srv_send(test_ctx);
+    test_resolv_fake_srv_send(test_ctx);
+
+    /* re-reading resolv.conf forgets the answers */
+    resolv_reread_configuration(test_ctx->resolv);
+    mock_ares_query(0, 0, buf, buflen);
+    test_resolv_fake_srv_send(test_ctx);
+
+    resolv_get_stats(test_ctx->resolv, &stats);
+    assert_int_equal(stats.network[RESOLV_STATS_TYPE_SRV][RESOLV_STATS_SUCCESS],
+                     2);
+    assert_int_equal(stats.cached[RESOLV_STATS_TYPE_SRV][RESOLV_STATS_SUCCESS],
+                     1);
+    assert_int_equal(stats.network[RESOLV_STATS_TYPE_A][RESOLV_STATS_SUCCESS],
+                     0);
+}
+
+void test_resolv_fake_srv_negative(void **state)
+{
+    struct resolv_fake_ctx *test_ctx =
+        talloc_get_type(*state, struct resolv_fake_ctx);
+    struct tevent_req *req;
+    int status;
+    int ret;
+    int i;
+
+    mock_ares_query(ARES_ENOTFOUND, 0, NULL, 0);
+
+    /* the second query is answered from the cache as well */
+    for (i = 0; i < 2; i++) {
+        req = resolv_getsrv_send(test_ctx, test_ctx->ctx->ev,
+                                 test_ctx->resolv, TEST_SRV_QUERY);
+        assert_non_null(req);
+
+        assert_true(tevent_req_poll(req, test_ctx->ctx->ev));
+        ret = resolv_getsrv_recv(test_ctx, req, &status, NULL, NULL, NULL);
+        talloc_free(req);
+        assert_int_equal(ret, EIO);
+        assert_int_equal(status, ARES_ENOTFOUND);
+    }
+}
+
 int main(int argc, const char *argv[])
 {
     int rv;
@@ -348,6 +449,12 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_resolv_fake_srv,
                                         test_resolv_fake_setup,
                                         test_resolv_fake_teardown),
+        cmocka_unit_test_setup_teardown(test_resolv_fake_srv_cached,
+                                        test_resolv_fake_setup,
+                                        test_resolv_fake_teardown),
+        cmocka_unit_test_setup_teardown(test_resolv_fake_srv_negative,
+                                        test_resolv_fake_setup,
+                                        test_resolv_fake_teardown),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
@@ -91,6 +91,7 @@ struct cache_req_test_ctx {
     struct sss_domain_info *domain;
     char *name;
     bool dp_called;
+    int num_done;
 
     /* NOTE: Please, instead of adding new create_[user|group] bool,
      * use bitshift. */
@@ -130,6 +131,31 @@ static void cache_req_user_by_name_test_done(struct tevent_req *req)
     ctx->tctx->done = true;
 }
 
+static void cache_req_user_by_name_concurrent_done(struct tevent_req *req)
+{
+    struct cache_req_test_ctx *ctx = NULL;
+    struct ldb_result *result = NULL;
+    errno_t ret;
+
+    ctx = tevent_req_callback_data(req, struct cache_req_test_ctx);
+
+    ret = cache_req_user_by_name_recv(ctx, req, &result, &ctx->domain, NULL);
+    talloc_zfree(req);
+    if (ret != EOK) {
+        ctx->tctx->error = ret;
+    }
+
+    assert_non_null(result);
+    assert_int_equal(result->count, 1);
+    talloc_free(ctx->result);
+    ctx->result = result;
+
+    ctx->num_done++;
+    if (ctx->num_done == 2) {
+        ctx->tctx->done = true;
+    }
+}
+
 static void cache_req_user_by_id_test_done(struct tevent_req *req)
 {
     struct cache_req_test_ctx *ctx = NULL;
@@ -463,6 +489,55 @@ void test_user_by_name_multiple_domains_notfound(void **state)
     assert_true(test_ctx->dp_called);
 }
 
+void test_user_by_name_multiple_domains_parallel(void **state)
+{
+    struct cache_req_test_ctx *test_ctx = NULL;
+    struct sss_domain_info *domain_b = NULL;
+    struct sss_domain_info *domain_d = NULL;
+
+    test_ctx = talloc_get_type_abort(*state, struct cache_req_test_ctx);
+    test_ctx->rctx->parallel_domain_lookup = true;
+
+    /* Setup user in two domains, the first one in the domain order wins
+     * even though the lookup in the first domain needs the data provider. */
+    domain_b = find_domain_by_name(test_ctx->tctx->dom,
+                                   "responder_cache_req_test_b", true);
+    assert_non_null(domain_b);
+    domain_d = find_domain_by_name(test_ctx->tctx->dom,
+                                   "responder_cache_req_test_d", true);
+    assert_non_null(domain_d);
+
+    prepare_user(test_ctx, domain_b, 1000, time(NULL));
+    prepare_user(test_ctx, domain_d, 1000, time(NULL));
+
+    /* Mock values. */
+    will_return_always(__wrap_sss_dp_get_account_send, test_ctx);
+    will_return_always(sss_dp_get_account_recv, 0);
+    mock_parse_inp(TEST_USER_NAME, NULL, ERR_OK);
+
+    /* Test. */
+    run_user_by_name(test_ctx, NULL, 0, ERR_OK);
+    assert_true(test_ctx->dp_called);
+    check_user(test_ctx, domain_b);
+}
+
+void test_user_by_name_multiple_domains_parallel_notfound(void **state)
+{
+    struct cache_req_test_ctx *test_ctx = NULL;
+
+    test_ctx = talloc_get_type_abort(*state, struct cache_req_test_ctx);
+    test_ctx->rctx->parallel_domain_lookup = true;
+
+    /* Mock values. */
+    will_return_always(__wrap_sss_dp_get_account_send, test_ctx);
+    will_return_always(sss_dp_get_account_recv, 0);
+    mock_parse_inp(TEST_USER_NAME, NULL, ERR_OK);
+
+    /* Test. */
+    run_user_by_name(test_ctx, NULL, 0, ENOENT);
+    assert_true(test_ctx->dp_called);
+}
+
 void test_user_by_name_multiple_domains_parse(void **state)
 {
     struct cache_req_test_ctx *test_ctx = NULL;
@@ -557,6 +632,132 @@ void test_user_by_name_cache_expired(void **state)
     check_user(test_ctx, test_ctx->tctx->dom);
 }
 
+void test_user_by_name_objcache(void **state)
+{
+    struct cache_req_test_ctx *test_ctx = NULL;
+    errno_t ret;
+
+    test_ctx = talloc_get_type_abort(*state, struct cache_req_test_ctx);
+
+    ret = sss_objcache_init(test_ctx->rctx, 10, 60);
+    assert_int_equal(ret, EOK);
+
+    /* Setup user. */
+    prepare_user(test_ctx, test_ctx->tctx->dom, 1000, time(NULL));
+
+    run_user_by_name(test_ctx, test_ctx->tctx->dom, 0, ERR_OK);
+    check_user(test_ctx, test_ctx->tctx->dom);
+
+    /* The user is found in the object cache, sysdb is not searched. */
+    ret = sysdb_delete_user(test_ctx->tctx->dom, TEST_USER_NAME, 0);
+    assert_int_equal(ret, EOK);
+
+    talloc_zfree(test_ctx->result);
+    test_ctx->tctx->done = false;
+    run_user_by_name(test_ctx, test_ctx->tctx->dom, 0, ERR_OK);
+    assert_false(test_ctx->dp_called);
+    check_user(test_ctx, test_ctx->tctx->dom);
+
+    /* Mock values. */
+    /* DP should be contacted once the object cache is invalidated */
+    will_return(__wrap_sss_dp_get_account_send, test_ctx);
+    mock_account_recv_simple();
+
+    sss_objcache_invalidate(test_ctx->rctx, test_ctx->tctx->dom);
+
+    test_ctx->tctx->done = false;
+    run_user_by_name(test_ctx, test_ctx->tctx->dom, 0, ENOENT);
+    assert_true(test_ctx->dp_called);
+}
+
+void test_user_by_name_refresh_ahead(void **state)
+{
+    struct cache_req_test_ctx *test_ctx = NULL;
+    time_t expire;
+    unsigned int sent;
+    errno_t ret;
+
+    test_ctx = talloc_get_type_abort(*state, struct cache_req_test_ctx);
+
+    ret = sss_hotlist_init(test_ctx->rctx, 1);
+    assert_int_equal(ret, EOK);
+
+    /* Setup user. */
+    prepare_user(test_ctx, test_ctx->tctx->dom, 1000, time(NULL));
+    expire = time(NULL) + 1000;
+
+    run_user_by_name(test_ctx, test_ctx->tctx->dom, 0, ERR_OK);
+    check_user(test_ctx, test_ctx->tctx->dom);
+
+    talloc_zfree(test_ctx->result);
+    test_ctx->tctx->done = false;
+    run_user_by_name(test_ctx, test_ctx->tctx->dom, 0, ERR_OK);
+    assert_false(test_ctx->dp_called);
+
+    /* The user does not expire soon, it is not refreshed. */
+    sent = sss_hotlist_refresh(test_ctx->rctx, time(NULL));
+    assert_int_equal(sent, 0);
+
+    /* Mock values. */
+    will_return(__wrap_sss_dp_get_account_send, test_ctx);
+    mock_account_recv_simple();
+
+    /* The user is refreshed shortly before it expires. */
+    sent = sss_hotlist_refresh(test_ctx->rctx, expire - 10);
+    assert_int_equal(sent, 1);
+    assert_true(test_ctx->dp_called);
+
+    ret = tevent_loop_once(test_ctx->tctx->ev);
+    assert_int_equal(ret, 0);
+
+    /* Only once as long as its expiration time did not change. */
+    sent = sss_hotlist_refresh(test_ctx->rctx, expire - 10);
+    assert_int_equal(sent, 0);
+}
+
+void test_user_by_name_concurrent(void **state)
+{
+    struct cache_req_test_ctx *test_ctx = NULL;
+    TALLOC_CTX *req_mem_ctx;
+    struct tevent_req *req;
+    errno_t ret;
+    int i;
+
+    test_ctx = talloc_get_type_abort(*state, struct cache_req_test_ctx);
+
+    /* Setup user. */
+    prepare_user(test_ctx, test_ctx->tctx->dom, -1000, time(NULL));
+
+    /* Mock values. */
+    /* DP should be contacted only once */
+    will_return(__wrap_sss_dp_get_account_send, test_ctx);
+    mock_account_recv_simple();
+
+    /* Test. */
+    req_mem_ctx = talloc_new(global_talloc_context);
+    check_leaks_push(req_mem_ctx);
+
+    for (i = 0; i < 2; i++) {
+        req = cache_req_user_by_name_send(req_mem_ctx, test_ctx->tctx->ev,
+                                          test_ctx->rctx, test_ctx->ncache,
+                                          10, 0, test_ctx->tctx->dom->name,
+                                          TEST_USER_NAME);
+        assert_non_null(req);
+        tevent_req_set_callback(req, cache_req_user_by_name_concurrent_done,
+                                test_ctx);
+    }
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, ERR_OK);
+    assert_int_equal(test_ctx->num_done, 2);
+    assert_true(test_ctx->dp_called);
+    assert_true(check_leaks_pop(req_mem_ctx));
+
+    talloc_free(req_mem_ctx);
+
+    check_user(test_ctx, test_ctx->tctx->dom);
+}
+
 void test_user_by_name_cache_midpoint(void **state)
 {
     struct cache_req_test_ctx *test_ctx = NULL;
@@ -1690,6 +1891,9 @@ int main(int argc, const char *argv[])
     const struct CMUnitTest tests[] = {
         new_single_domain_test(user_by_name_cache_valid),
         new_single_domain_test(user_by_name_cache_expired),
+        new_single_domain_test(user_by_name_concurrent),
+        new_single_domain_test(user_by_name_objcache),
+        new_single_domain_test(user_by_name_refresh_ahead),
         new_single_domain_test(user_by_name_cache_midpoint),
         new_single_domain_test(user_by_name_ncache),
         new_single_domain_test(user_by_name_missing_found),
@@ -1697,6 +1901,8 @@ int main(int argc, const char *argv[])
         new_multi_domain_test(user_by_name_multiple_domains_found),
         new_multi_domain_test(user_by_name_multiple_domains_notfound),
         new_multi_domain_test(user_by_name_multiple_domains_parse),
+        new_multi_domain_test(user_by_name_multiple_domains_parallel),
+        new_multi_domain_test(user_by_name_multiple_domains_parallel_notfound),
 
         new_single_domain_test(user_by_upn_cache_valid),
         new_single_domain_test(user_by_upn_cache_expired),
@@ -0,0 +1,240 @@
+/*
+    SSSD
+
+    Tests of the reply packets of the responders
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the size of the buffer */
+#include "responder/common/responder_packet.c"
+
+#define TEST_NAME_LEN 32
+#define TEST_NAMES 100
+
+static int test_packet_setup(void **state)
+{
+    assert_true(leak_check_setup());
+    return 0;
+}
+
+static int test_packet_teardown(void **state)
+{
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+/* Appends a name the way fill_members() does */
+static void append_name(struct sss_packet *packet, int idx)
+{
+    uint8_t *body;
+    size_t blen;
+    errno_t ret;
+
+    ret = sss_packet_grow(packet, TEST_NAME_LEN);
+    assert_int_equal(ret, EOK);
+
+    sss_packet_get_body(packet, &body, &blen);
+    memset(body + blen - TEST_NAME_LEN, 'a' + idx % 26, TEST_NAME_LEN);
+}
+
+static void assert_names(struct sss_packet *packet, int count)
+{
+    uint8_t *body;
+    size_t blen;
+    int i;
+    int j;
+
+    sss_packet_get_body(packet, &body, &blen);
+    assert_int_equal(blen, count * TEST_NAME_LEN);
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < TEST_NAME_LEN; j++) {
+            assert_int_equal(body[i * TEST_NAME_LEN + j], 'a' + i % 26);
+        }
+    }
+}
+
+/* Once the space is reserved, the names are added without moving the
+ * reply */
+void test_packet_reserve(void **state)
+{
+    struct sss_packet *packet;
+    uint8_t *buffer;
+    errno_t ret;
+    int i;
+
+    ret = sss_packet_new(global_talloc_context, 0, SSS_NSS_GETGRNAM, &packet);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_packet_reserve(packet, TEST_NAMES * TEST_NAME_LEN);
+    assert_int_equal(ret, EOK);
+    assert_true(packet->bufsize >= SSS_NSS_HEADER_SIZE
+                                   + TEST_NAMES * TEST_NAME_LEN);
+    buffer = packet->buffer;
+
+    /* the reply itself does not grow */
+    assert_int_equal(sss_packet_get_len(packet), SSS_NSS_HEADER_SIZE);
+    assert_int_equal(sss_packet_get_cmd(packet), SSS_NSS_GETGRNAM);
+
+    for (i = 0; i < TEST_NAMES; i++) {
+        append_name(packet, i);
+        assert_ptr_equal(packet->buffer, buffer);
+    }
+
+    assert_names(packet, TEST_NAMES);
+    assert_true(packet->memsize <= packet->bufsize);
+
+    talloc_free(packet);
+}
+
+/* Reserving keeps what the reply already has */
+void test_packet_reserve_keeps_data(void **state)
+{
+    struct sss_packet *packet;
+    uint8_t *buffer;
+    size_t bufsize;
+    errno_t ret;
+    int i;
+
+    ret = sss_packet_new(global_talloc_context, 0, SSS_NSS_GETGRNAM, &packet);
+    assert_int_equal(ret, EOK);
+
+    for (i = 0; i < 4; i++) {
+        append_name(packet, i);
+    }
+
+    /* what is already allocated is enough */
+    buffer = packet->buffer;
+    bufsize = packet->bufsize;
+    ret = sss_packet_reserve(packet, TEST_NAME_LEN);
+    assert_int_equal(ret, EOK);
+    assert_ptr_equal(packet->buffer, buffer);
+    assert_int_equal(packet->bufsize, bufsize);
+
+    ret = sss_packet_reserve(packet, TEST_NAMES * TEST_NAME_LEN);
+    assert_int_equal(ret, EOK);
+    assert_true(packet->bufsize > bufsize);
+    assert_names(packet, 4);
+    assert_int_equal(sss_packet_get_cmd(packet), SSS_NSS_GETGRNAM);
+
+    buffer = packet->buffer;
+    for (i = 4; i < TEST_NAMES; i++) {
+        append_name(packet, i);
+    }
+    assert_ptr_equal(packet->buffer, buffer);
+    assert_names(packet, TEST_NAMES);
+
+    talloc_free(packet);
+}
+
+/* Without reserving, the same names move the reply */
+void test_packet_grow_without_reserve(void **state)
+{
+    struct sss_packet *packet;
+    uint8_t *buffer;
+    bool moved = false;
+    errno_t ret;
+    int i;
+
+    ret = sss_packet_new(global_talloc_context, 0, SSS_NSS_GETGRNAM, &packet);
+    assert_int_equal(ret, EOK);
+
+    for (i = 0; i < TEST_NAMES; i++) {
+        buffer = packet->buffer;
+        append_name(packet, i);
+        if (packet->buffer != buffer) {
+            moved = true;
+        }
+    }
+
+    assert_true(moved);
+    assert_names(packet, TEST_NAMES);
+
+    talloc_free(packet);
+}
+
+/* A size which cannot be represented is refused */
+void test_packet_reserve_overflow(void **state)
+{
+    struct sss_packet *packet;
+    uint8_t *buffer;
+    errno_t ret;
+
+    ret = sss_packet_new(global_talloc_context, 0, SSS_NSS_GETGRNAM, &packet);
+    assert_int_equal(ret, EOK);
+    buffer = packet->buffer;
+
+    ret = sss_packet_reserve(packet, SIZE_MAX);
+    assert_int_equal(ret, EINVAL);
+    assert_ptr_equal(packet->buffer, buffer);
+    assert_int_equal(sss_packet_get_len(packet), SSS_NSS_HEADER_SIZE);
+
+    talloc_free(packet);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_packet_reserve,
+                                        test_packet_setup,
+                                        test_packet_teardown),
+        cmocka_unit_test_setup_teardown(test_packet_reserve_keeps_data,
+                                        test_packet_setup,
+                                        test_packet_teardown),
+        cmocka_unit_test_setup_teardown(test_packet_grow_without_reserve,
+                                        test_packet_setup,
+                                        test_packet_teardown),
+        cmocka_unit_test_setup_teardown(test_packet_reserve_overflow,
+                                        test_packet_setup,
+                                        test_packet_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,236 @@
+/*
+    SSSD
+
+    Responders - Tests of the queue of bulk requests
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the queue */
+#include "responder/common/responder_common.c"
+
+struct sched_test_ctx {
+    struct resp_ctx *rctx;
+    int interactive_done;
+    int bulk_done;
+};
+
+static struct sched_test_ctx *sched_test_ctx;
+
+static int sched_test_interactive(struct cli_ctx *cctx)
+{
+    sched_test_ctx->interactive_done++;
+    return EOK;
+}
+
+static int sched_test_bulk(struct cli_ctx *cctx)
+{
+    sched_test_ctx->bulk_done++;
+    return EOK;
+}
+
+static struct sss_cmd_table sched_test_cmds[] = {
+    {SSS_NSS_GETPWNAM, sched_test_interactive},
+    {SSS_NSS_GETPWENT, sched_test_bulk, SSS_CMD_BULK},
+    {SSS_CLI_NULL, NULL}
+};
+
+static int test_sched_setup(void **state)
+{
+    struct resp_ctx *rctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    sched_test_ctx = talloc_zero(global_talloc_context,
+                                 struct sched_test_ctx);
+    assert_non_null(sched_test_ctx);
+
+    rctx = talloc_zero(sched_test_ctx, struct resp_ctx);
+    assert_non_null(rctx);
+    rctx->ev = tevent_context_init(rctx);
+    assert_non_null(rctx->ev);
+    rctx->sss_cmds = sched_test_cmds;
+
+    ret = client_sched_init(rctx);
+    assert_int_equal(ret, EOK);
+    assert_non_null(rctx->sched);
+
+    sched_test_ctx->rctx = rctx;
+    return 0;
+}
+
+static int test_sched_teardown(void **state)
+{
+    talloc_zfree(sched_test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+/* A client with a request which was received */
+static struct cli_ctx *sched_test_request(enum sss_cli_command cmd)
+{
+    struct cli_ctx *cctx;
+    errno_t ret;
+
+    cctx = talloc_zero(sched_test_ctx, struct cli_ctx);
+    assert_non_null(cctx);
+    cctx->rctx = sched_test_ctx->rctx;
+
+    cctx->creq = talloc_zero(cctx, struct cli_request);
+    assert_non_null(cctx->creq);
+
+    ret = sss_packet_new(cctx->creq, 0, cmd, &cctx->creq->in);
+    assert_int_equal(ret, EOK);
+
+    ret = client_dispatch(cctx);
+    assert_int_equal(ret, EOK);
+
+    return cctx;
+}
+
+/* Bulk requests wait for the event loop, interactive ones do not */
+void test_sched_bulk_queued(void **state)
+{
+    struct cli_sched *sched = sched_test_ctx->rctx->sched;
+
+    sched_test_request(SSS_NSS_GETPWENT);
+    assert_int_equal(sched_test_ctx->bulk_done, 0);
+    assert_non_null(sched->queue);
+    assert_non_null(sched->te);
+
+    sched_test_request(SSS_NSS_GETPWNAM);
+    assert_int_equal(sched_test_ctx->interactive_done, 1);
+
+    assert_int_equal(tevent_loop_once(sched_test_ctx->rctx->ev), 0);
+    assert_int_equal(sched_test_ctx->bulk_done, 1);
+    assert_null(sched->queue);
+}
+
+/* Without interactive requests the queue is drained back to back */
+void test_sched_no_gap_when_idle(void **state)
+{
+    struct cli_sched *sched = sched_test_ctx->rctx->sched;
+
+    sched_test_request(SSS_NSS_GETPWENT);
+    sched_test_request(SSS_NSS_GETPWENT);
+
+    assert_int_equal(tevent_loop_once(sched_test_ctx->rctx->ev), 0);
+    assert_int_equal(sched_test_ctx->bulk_done, 1);
+    assert_true(tevent_timeval_is_zero(&sched->next_slot));
+    assert_non_null(sched->te);
+
+    assert_int_equal(tevent_loop_once(sched_test_ctx->rctx->ev), 0);
+    assert_int_equal(sched_test_ctx->bulk_done, 2);
+}
+
+/* The gap is kept while an interactive request is in progress and dropped
+ * as soon as it was answered */
+void test_sched_gap_with_interactive(void **state)
+{
+    struct cli_sched *sched = sched_test_ctx->rctx->sched;
+    struct cli_ctx *interactive;
+    struct timeval now;
+
+    sched_test_request(SSS_NSS_GETPWENT);
+    sched_test_request(SSS_NSS_GETPWENT);
+
+    /* not answered yet, e.g. waiting for the data provider */
+    interactive = sched_test_request(SSS_NSS_GETPWNAM);
+    assert_non_null(sched->interactive);
+
+    assert_int_equal(tevent_loop_once(sched_test_ctx->rctx->ev), 0);
+    assert_int_equal(sched_test_ctx->bulk_done, 1);
+
+    now = tevent_timeval_current();
+    assert_true(tevent_timeval_compare(&sched->next_slot, &now) > 0);
+    assert_non_null(sched->te);
+
+    /* the reply was sent */
+    talloc_zfree(interactive->creq);
+    assert_null(sched->interactive);
+    assert_true(tevent_timeval_is_zero(&sched->next_slot));
+    assert_non_null(sched->te);
+
+    assert_int_equal(tevent_loop_once(sched_test_ctx->rctx->ev), 0);
+    assert_int_equal(sched_test_ctx->bulk_done, 2);
+}
+
+/* A client which goes away leaves the queue */
+void test_sched_client_freed(void **state)
+{
+    struct cli_sched *sched = sched_test_ctx->rctx->sched;
+    struct cli_ctx *cctx;
+
+    cctx = sched_test_request(SSS_NSS_GETPWENT);
+    assert_non_null(sched->queue);
+
+    talloc_free(cctx);
+    assert_null(sched->queue);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sched_bulk_queued,
+                                        test_sched_setup,
+                                        test_sched_teardown),
+        cmocka_unit_test_setup_teardown(test_sched_no_gap_when_idle,
+                                        test_sched_setup,
+                                        test_sched_teardown),
+        cmocka_unit_test_setup_teardown(test_sched_gap_with_interactive,
+                                        test_sched_setup,
+                                        test_sched_teardown),
+        cmocka_unit_test_setup_teardown(test_sched_client_freed,
+                                        test_sched_setup,
+                                        test_sched_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -26,6 +26,7 @@
 #include "tests/cmocka/common_mock.h"
 #include "providers/ldap/ldap_opts.h"
 #include "providers/ipa/ipa_opts.h"
+#include "providers/ldap/sdap_range.h"
 #include "util/crypto/sss_crypto.h"
 
 /* mock an LDAP entry */
@@ -114,10 +115,25 @@ int __wrap_ldap_set_option(LDAP *ld,
     return LDAP_OPT_SUCCESS;
 }
 
-char *__wrap_ldap_get_dn(LDAP *ld, LDAPMessage *entry)
+int __wrap_ldap_get_dn_ber(LDAP *ld, LDAPMessage *entry,
+                           BerElement **berout, struct berval *dn)
 {
     struct mock_ldap_entry *ldap_entry = mock_ldap_entry_get();
-    return discard_const(ldap_entry->dn);
+
+    *berout = NULL;
+    if (ldap_entry->dn == NULL) {
+        dn->bv_val = NULL;
+        dn->bv_len = 0;
+        return LDAP_DECODING_ERROR;
+    }
+
+    dn->bv_val = discard_const(ldap_entry->dn);
+    dn->bv_len = strlen(ldap_entry->dn);
+
+    /* the BerElement is never dereferenced, it only holds the position */
+    *berout = (BerElement *) ldap_entry;
+    will_return(mock_ldap_entry_iter, 0);
+    return LDAP_SUCCESS;
 }
 
 void __wrap_ldap_memfree(void *p)
@@ -181,33 +197,59 @@ void __wrap_ldap_value_free_len(struct berval **vals)
     talloc_free(vals);  /* Allocated on global_talloc_context */
 }
 
-char *__wrap_ldap_first_attribute(LDAP *ld,
-                                  LDAPMessage *entry,
-                                  BerElement **berout)
+int __wrap_ldap_get_attribute_ber(LDAP *ld, LDAPMessage *entry,
+                                  BerElement *ber, struct berval *attr,
+                                  struct berval **vals)
 {
     struct mock_ldap_entry *ldap_entry = mock_ldap_entry_get();
+    const char **attrvals;
+    size_t count, i;
+    int idx;
 
-    if (ldap_entry == NULL) return NULL;
-    if (ldap_entry->attrs == NULL) return NULL;
+    idx = mock_ldap_entry_iter();
+
+    attr->bv_val = NULL;
+    attr->bv_len = 0;
+    *vals = NULL;
 
-    will_return(mock_ldap_entry_iter, 1);
-    return discard_const(ldap_entry->attrs[0].name);
+    if (ldap_entry->attrs == NULL || ldap_entry->attrs[idx].name == NULL) {
+        return LDAP_SUCCESS;
+    }
+
+    attr->bv_val = discard_const(ldap_entry->attrs[idx].name);
+    attr->bv_len = strlen(attr->bv_val);
+
+    attrvals = ldap_entry->attrs[idx].values;
+    for (count = 0; attrvals[count]; count++);
+
+    /* the values point into the entry like the ones of libldap */
+    *vals = talloc_zero_array(global_talloc_context, struct berval,
+                              count + 1);
+    assert_non_null(*vals);
+
+    for (i = 0; i < count; i++) {
+        (*vals)[i].bv_val = discard_const(attrvals[i]);
+        (*vals)[i].bv_len = strlen(attrvals[i]);
+    }
+
+    will_return(mock_ldap_entry_iter, idx + 1);
+    return LDAP_SUCCESS;
 }
 
-char *__wrap_ldap_next_attribute(LDAP *ld,
-                                 LDAPMessage *entry,
-                                 BerElement *ber)
+int __wrap_ber_get_option(void *item, int option, void *outvalue)
 {
-    struct mock_ldap_entry *ldap_entry = mock_ldap_entry_get();
+    *(ber_len_t *) outvalue = 0;
+    return LBER_OPT_SUCCESS;
+}
 
-    int idx = mock_ldap_entry_iter();
-    char *val;
+void __wrap_ber_memfree(void *p)
+{
+    talloc_free(p);  /* Allocated on global_talloc_context */
+}
 
-    val = discard_const(ldap_entry->attrs[idx].name);
-    if (val != NULL) {
-        will_return(mock_ldap_entry_iter, idx + 1);
-    }
-    return val;
+void __wrap_ber_free(BerElement *ber, int freebuf)
+{
+    return;
 }
 
 /* Mock parsing search base without overlinking the test */
@@ -475,6 +517,51 @@ void test_parse_dups(void **state)
     talloc_free(attrs);
 }
 
+/* Ranged attributes keep their values and are listed for the follow-up
+ * retrieval */
+void test_parse_ranged(void **state)
+{
+    int ret;
+    struct sysdb_attrs *attrs;
+    struct parse_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                      struct parse_test_ctx);
+    struct mock_ldap_entry test_group;
+    struct sdap_attr_map *map;
+    struct ldb_message_element *el;
+
+    const char *oc_values[] = { "ipaUserGroup", NULL };
+    const char *name_values[] = { "tgroup1", NULL };
+    const char *member_values[] = { "uid=u1,dc=example,dc=com",
+                                    "uid=u2,dc=example,dc=com",
+                                    NULL };
+    struct mock_ldap_attr test_group_attrs[] = {
+        { .name = "objectClass", .values = oc_values },
+        { .name = "cn", .values = name_values },
+        { .name = "member;range=0-1", .values = member_values },
+        { NULL, NULL }
+    };
+
+    test_group.dn = "cn=testgroup,dc=example,dc=com";
+    test_group.attrs = test_group_attrs;
+    set_entry_parse(&test_group);
+
+    ret = sdap_copy_map(test_ctx, ipa_group_map, SDAP_OPTS_GROUP, &map);
+    assert_int_equal(ret, ERR_OK);
+
+    ret = sdap_parse_entry(test_ctx, &test_ctx->sh, &test_ctx->sm,
+                           map, SDAP_OPTS_GROUP,
+                           &attrs, false);
+    assert_int_equal(ret, ERR_OK);
+
+    ret = sysdb_attrs_get_el_ext(attrs, SYSDB_MEMBER, false, &el);
+    assert_int_equal(ret, ERR_OK);
+    assert_int_equal(el->num_values, 2);
+    assert_entry_has_attr(attrs, SDAP_RANGED_ATTRS, "member;range=0-1");
+
+    talloc_free(map);
+    talloc_free(attrs);
+}
+
 void test_parse_deref(void **state)
 {
     errno_t ret;
@@ -795,6 +882,46 @@ static void test_sdap_copy_map_entry_null_name(void **state)
     assert_null(uuid_val);
 }
 
+static void test_sdap_attr_map_find(void **state)
+{
+    struct copy_map_entry_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                               struct copy_map_entry_test_ctx);
+    struct sdap_attr_map *map = test_ctx->src_map;
+    struct sdap_attr_map_index *index;
+    int i;
+
+    index = sdap_attr_map_get_index(map, SDAP_OPTS_USER);
+    assert_non_null(index);
+
+    /* the names are compared case-insensitively */
+    i = sdap_attr_map_find(index, map, SDAP_OPTS_USER, "UIDnumber", 0);
+    assert_int_equal(i, SDAP_AT_USER_UID);
+
+    i = sdap_attr_map_find(index, map, SDAP_OPTS_USER, "uidNumber",
+                           SDAP_AT_USER_UID + 1);
+    assert_int_equal(i, -1);
+
+    i = sdap_attr_map_find(index, map, SDAP_OPTS_USER, "notMapped", 0);
+    assert_int_equal(i, -1);
+
+    /* a name changed after the map was built is found as well */
+    map[SDAP_AT_USER_UUID].name = discard_const("uidNumber");
+
+    index = sdap_attr_map_get_index(map, SDAP_OPTS_USER);
+    assert_non_null(index);
+
+    i = sdap_attr_map_find(index, map, SDAP_OPTS_USER, "uidnumber", 0);
+    assert_int_equal(i, SDAP_AT_USER_UID);
+
+    i = sdap_attr_map_find(index, map, SDAP_OPTS_USER, "uidnumber", i + 1);
+    assert_int_equal(i, SDAP_AT_USER_UUID);
+
+    /* the same results without the index */
+    i = sdap_attr_map_find(NULL, map, SDAP_OPTS_USER, "uidnumber",
+                           SDAP_AT_USER_UID + 1);
+    assert_int_equal(i, SDAP_AT_USER_UUID);
+}
+
 struct test_sdap_inherit_ctx {
     struct sdap_options *parent_sdap_opts;
     struct sdap_options *child_sdap_opts;
@@ -1142,6 +1269,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_parse_dups,
                                         parse_entry_test_setup,
                                         parse_entry_test_teardown),
+        cmocka_unit_test_setup_teardown(test_parse_ranged,
+                                        parse_entry_test_setup,
+                                        parse_entry_test_teardown),
         cmocka_unit_test_setup_teardown(test_parse_deref,
                                         parse_entry_test_setup,
                                         parse_entry_test_teardown),
@@ -1172,6 +1302,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_sdap_copy_map_entry_null_name,
                                         copy_map_entry_test_setup,
                                         copy_map_entry_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_attr_map_find,
+                                        copy_map_entry_test_setup,
+                                        copy_map_entry_test_teardown),
 
         /* Option inherit tests */
         cmocka_unit_test_setup_teardown(test_sdap_inherit_option_null,
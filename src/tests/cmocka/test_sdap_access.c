@@ -30,6 +30,9 @@
 
 #include "tests/common_check.h"
 #include "tests/cmocka/test_expire_common.h"
+#include "db/sysdb.h"
+#include "providers/ldap/ldap_opts.h"
+#include "providers/ldap/sdap_access.h"
 
 /* linking against function from sdap_access.c module */
 extern bool nds_check_expired(const char *exp_time_str);
@@ -62,12 +65,151 @@ void test_nds_check_expire(void **state)
     assert_false(res);
 }
 
+static struct sdap_options *access_filter_opts(TALLOC_CTX *mem_ctx)
+{
+    struct sdap_options *opts;
+    errno_t ret;
+
+    opts = talloc_zero(mem_ctx, struct sdap_options);
+    assert_non_null(opts);
+
+    ret = sdap_copy_map(opts, gen_ad2008r2_user_map, SDAP_OPTS_USER,
+                        &opts->user_map);
+    assert_int_equal(ret, EOK);
+    opts->user_map_cnt = SDAP_OPTS_USER;
+
+    return opts;
+}
+
+static bool access_filter_local(struct sdap_options *opts, const char *filter)
+{
+    struct sdap_access_filter *compiled;
+    bool local;
+    errno_t ret;
+
+    ret = sdap_access_filter_compile(opts, opts, filter, &compiled);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(compiled->filter, filter);
+
+    local = compiled->tree != NULL;
+    talloc_free(compiled);
+    return local;
+}
+
+void test_access_filter_compile(void **state)
+{
+    struct sdap_options *opts;
+
+    opts = access_filter_opts(NULL);
+
+    assert_true(access_filter_local(opts,
+                    "(memberOf=cn=admins,dc=example,dc=com)"));
+    assert_true(access_filter_local(opts,
+                    "(&(loginShell=*)(userAccountControl=512))"));
+    /* a value missing in the cache would make a negation match */
+    assert_false(access_filter_local(opts,
+                    "(!(memberOf=cn=denied,dc=example,dc=com))"));
+    assert_false(access_filter_local(opts,
+                    "(&(loginShell=*)(!(userAccountControl=514)))"));
+    /* the name and the IDs are rewritten on the way into the cache */
+    assert_false(access_filter_local(opts, "(sAMAccountName=admin)"));
+    assert_false(access_filter_local(opts, "(uidNumber>=1000)"));
+    /* not in the map */
+    assert_false(access_filter_local(opts, "(objectClass=user)"));
+    /* matching rules cannot be evaluated locally */
+    assert_false(access_filter_local(opts,
+                    "(memberOf:1.2.840.113556.1.4.1941:=cn=a,dc=b)"));
+    /* malformed */
+    assert_false(access_filter_local(opts, "(&(memberOf=cn=a"));
+
+    talloc_free(opts);
+}
+
+static bool access_filter_match(struct sdap_options *opts,
+                                struct ldb_message *entry,
+                                const char *filter)
+{
+    struct sdap_access_filter *compiled;
+    struct ldb_context *ldb;
+    bool match;
+    errno_t ret;
+
+    ret = sdap_access_filter_compile(opts, opts, filter, &compiled);
+    assert_int_equal(ret, EOK);
+    assert_non_null(compiled->tree);
+
+    ldb = ldb_init(compiled, NULL);
+    assert_non_null(ldb);
+
+    match = sdap_access_filter_match(ldb, compiled->tree, entry);
+    talloc_free(compiled);
+    return match;
+}
+
+void test_access_filter_match(void **state)
+{
+    struct sdap_options *opts;
+    struct ldb_message *entry;
+    int ret;
+
+    opts = access_filter_opts(NULL);
+
+    entry = ldb_msg_new(opts);
+    assert_non_null(entry);
+    ret = ldb_msg_add_string(entry, SYSDB_ORIG_MEMBEROF,
+                             "CN=Admins,DC=example,DC=com");
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = ldb_msg_add_string(entry, SYSDB_ORIG_MEMBEROF,
+                             "CN=Users,DC=example,DC=com");
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = ldb_msg_add_string(entry, SYSDB_SHELL, "/bin/bash");
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = ldb_msg_add_string(entry, SYSDB_AD_USER_ACCOUNT_CONTROL, "512");
+    assert_int_equal(ret, LDB_SUCCESS);
+
+    assert_true(access_filter_match(opts, entry,
+                    "(memberOf=cn=admins,dc=example,dc=com)"));
+    assert_false(access_filter_match(opts, entry,
+                    "(memberOf=cn=other,dc=example,dc=com)"));
+    assert_true(access_filter_match(opts, entry,
+                    "(&(memberOf=cn=users,dc=example,dc=com)"
+                    "(loginShell=/bin/bash))"));
+    /* DNs match regardless of spacing and escaping */
+    assert_true(access_filter_match(opts, entry,
+                    "(memberOf=cn=admins, dc=example, dc=com)"));
+    assert_true(access_filter_match(opts, entry,
+                    "(memberOf=cn=\\5c41dmins,dc=example,dc=com)"));
+    assert_false(access_filter_match(opts, entry,
+                    "(memberOf=cn=admins,dc=example)"));
+    assert_false(access_filter_match(opts, entry,
+                    "(|(memberOf=cn=other,dc=example,dc=com)"
+                    "(loginShell=/bin/zsh))"));
+
+    assert_true(access_filter_match(opts, entry, "(loginShell=*)"));
+    assert_false(access_filter_match(opts, entry, "(gecos=*)"));
+    assert_true(access_filter_match(opts, entry, "(loginShell=/bin/*)"));
+    assert_true(access_filter_match(opts, entry, "(loginShell=*bash)"));
+    assert_true(access_filter_match(opts, entry, "(loginShell=/*n/b*h)"));
+    assert_false(access_filter_match(opts, entry, "(loginShell=*zsh*)"));
+    assert_false(access_filter_match(opts, entry, "(loginShell=/usr*)"));
+
+    /* integers are compared by their value */
+    assert_true(access_filter_match(opts, entry, "(userAccountControl>=100)"));
+    assert_false(access_filter_match(opts, entry,
+                                     "(userAccountControl>=1000)"));
+    assert_true(access_filter_match(opts, entry, "(userAccountControl<=512)"));
+
+    talloc_free(opts);
+}
+
 int main(void)
 {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test_setup_teardown(test_nds_check_expire,
                                         expire_test_setup,
-                                        expire_test_teardown)
+                                        expire_test_teardown),
+        cmocka_unit_test(test_access_filter_compile),
+        cmocka_unit_test(test_access_filter_match),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,501 @@
+/*
+    SSSD
+
+    Tests of the pool of LDAP connections
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the connections of the cache */
+#include "providers/ldap/sdap_id_op.c"
+#include "providers/ldap/ldap_opts.h"
+
+#define TEST_MAX_CONNECTS 8
+
+struct sdap_id_op_test_ctx {
+    struct tevent_context *ev;
+    struct be_ctx *be;
+    struct sdap_id_ctx *id_ctx;
+    struct sdap_id_conn_ctx *id_conn;
+    struct sdap_id_conn_cache *conn_cache;
+
+    /* connections being set up, completed by the test */
+    struct tevent_req *connects[TEST_MAX_CONNECTS];
+    int num_connects;
+    int online_cb_count;
+};
+
+static struct sdap_id_op_test_ctx *test_ctx;
+
+struct tevent_req *__wrap_sdap_cli_connect_send(TALLOC_CTX *memctx,
+                                                struct tevent_context *ev,
+                                                struct sdap_options *opts,
+                                                struct be_ctx *be,
+                                                struct sdap_service *service,
+                                                bool skip_rootdse,
+                                                enum connect_tls force_tls,
+                                                bool skip_auth)
+{
+    struct tevent_req *req;
+    int *state;
+
+    assert_true(test_ctx->num_connects < TEST_MAX_CONNECTS);
+
+    req = tevent_req_create(memctx, &state, int);
+    assert_non_null(req);
+
+    test_ctx->connects[test_ctx->num_connects] = req;
+    test_ctx->num_connects++;
+    return req;
+}
+
+int __wrap_sdap_cli_connect_recv(struct tevent_req *req,
+                                 TALLOC_CTX *memctx,
+                                 bool *can_retry,
+                                 struct sdap_handle **gsh,
+                                 struct sdap_server_opts **srv_opts)
+{
+    struct sdap_handle *sh;
+    struct sdap_server_opts *opts;
+
+    *can_retry = true;
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    sh = talloc_zero(memctx, struct sdap_handle);
+    assert_non_null(sh);
+    sh->connected = true;
+
+    opts = talloc_zero(memctx, struct sdap_server_opts);
+    assert_non_null(opts);
+    opts->server_id = talloc_strdup(opts, "ldap.test");
+    assert_non_null(opts->server_id);
+
+    *gsh = sh;
+    *srv_opts = opts;
+    return EOK;
+}
+
+int __wrap_be_add_offline_cb(TALLOC_CTX *mem_ctx, struct be_ctx *ctx,
+                             be_callback_t cb, void *pvt,
+                             struct be_cb **online_cb)
+{
+    return EOK;
+}
+
+int __wrap_be_add_reconnect_cb(TALLOC_CTX *mem_ctx, struct be_ctx *ctx,
+                               be_callback_t cb, void *pvt,
+                               struct be_cb **reconnect_cb)
+{
+    return EOK;
+}
+
+bool __wrap_be_is_offline(struct be_ctx *ctx)
+{
+    return false;
+}
+
+void __wrap_be_run_online_cb(struct be_ctx *be)
+{
+    test_ctx->online_cb_count++;
+}
+
+void __wrap_be_run_unconditional_online_cb(struct be_ctx *be)
+{
+}
+
+void __wrap_be_fo_try_next_server(struct be_ctx *ctx, const char *service_name)
+{
+}
+
+int __wrap_be_fo_get_server_count(struct be_ctx *ctx, const char *service_name)
+{
+    return 1;
+}
+
+static int sdap_id_op_test_setup(void **state)
+{
+    struct sdap_service *service;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct sdap_id_op_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->ev = tevent_context_init(test_ctx);
+    assert_non_null(test_ctx->ev);
+
+    test_ctx->be = talloc_zero(test_ctx, struct be_ctx);
+    assert_non_null(test_ctx->be);
+    test_ctx->be->ev = test_ctx->ev;
+
+    test_ctx->id_ctx = talloc_zero(test_ctx, struct sdap_id_ctx);
+    assert_non_null(test_ctx->id_ctx);
+    test_ctx->id_ctx->be = test_ctx->be;
+
+    test_ctx->id_ctx->opts = talloc_zero(test_ctx->id_ctx,
+                                         struct sdap_options);
+    assert_non_null(test_ctx->id_ctx->opts);
+    ret = dp_copy_defaults(test_ctx->id_ctx->opts, default_basic_opts,
+                           SDAP_OPTS_BASIC, &test_ctx->id_ctx->opts->basic);
+    assert_int_equal(ret, EOK);
+
+    service = talloc_zero(test_ctx, struct sdap_service);
+    assert_non_null(service);
+    service->name = talloc_strdup(service, "LDAP");
+    assert_non_null(service->name);
+    service->uri = talloc_strdup(service, "ldap://ldap.test");
+    assert_non_null(service->uri);
+
+    test_ctx->id_conn = talloc_zero(test_ctx, struct sdap_id_conn_ctx);
+    assert_non_null(test_ctx->id_conn);
+    test_ctx->id_conn->id_ctx = test_ctx->id_ctx;
+    test_ctx->id_conn->service = service;
+
+    ret = sdap_id_conn_cache_create(test_ctx->id_conn, test_ctx->id_conn,
+                                    &test_ctx->conn_cache);
+    assert_int_equal(ret, EOK);
+    test_ctx->id_conn->conn_cache = test_ctx->conn_cache;
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int sdap_id_op_test_teardown(void **state)
+{
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void set_pool(int size, int min, int idle_timeout)
+{
+    struct dp_option *basic = test_ctx->id_ctx->opts->basic;
+
+    assert_int_equal(dp_opt_set_int(basic, SDAP_CONN_POOL_SIZE, size), EOK);
+    assert_int_equal(dp_opt_set_int(basic, SDAP_CONN_POOL_MIN, min), EOK);
+    assert_int_equal(dp_opt_set_int(basic, SDAP_CONN_POOL_IDLE_TIMEOUT,
+                                    idle_timeout), EOK);
+}
+
+/* Starts an operation, it is either assigned to a connection or one is
+ * being set up for it */
+static struct sdap_id_op *start_op(void)
+{
+    struct sdap_id_op *op;
+    struct tevent_req *req;
+    int ret;
+
+    op = sdap_id_op_create(test_ctx, test_ctx->conn_cache);
+    assert_non_null(op);
+
+    req = sdap_id_op_connect_send(op, op, &ret);
+    assert_int_equal(ret, EOK);
+    assert_non_null(req);
+    assert_non_null(op->conn_data);
+
+    return op;
+}
+
+static void finish_connect(int idx)
+{
+    assert_true(idx < test_ctx->num_connects);
+    tevent_req_done(test_ctx->connects[idx]);
+}
+
+static int num_connections(void)
+{
+    struct sdap_id_conn_data *conn_data;
+    int count = 0;
+
+    DLIST_FOR_EACH(conn_data, test_ctx->conn_cache->connections) {
+        count++;
+    }
+
+    return count;
+}
+
+/* The default pool of one connection shares it between all operations */
+void test_pool_single(void **state)
+{
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+    struct sdap_id_op *op3;
+
+    op1 = start_op();
+    op2 = start_op();
+    assert_int_equal(test_ctx->num_connects, 1);
+    assert_ptr_equal(op1->conn_data, op2->conn_data);
+
+    finish_connect(0);
+    assert_null(op1->conn_data->connect_req);
+    assert_int_equal(test_ctx->online_cb_count, 1);
+
+    op3 = start_op();
+    assert_ptr_equal(op3->conn_data, op1->conn_data);
+    assert_int_equal(op1->conn_data->num_ops, 3);
+    assert_int_equal(test_ctx->num_connects, 1);
+
+    talloc_free(op1);
+    talloc_free(op2);
+    talloc_free(op3);
+
+    /* the connection stays in the pool */
+    assert_int_equal(num_connections(), 1);
+    assert_int_equal(test_ctx->conn_cache->num_pooled, 1);
+}
+
+/* Another connection is only opened when the open ones are busy */
+void test_pool_grow(void **state)
+{
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+    struct sdap_id_op *op3;
+    struct sdap_id_op *op4;
+    struct sdap_id_op *op5;
+    struct sdap_id_conn_data *first;
+    struct sdap_id_conn_data *second;
+
+    set_pool(2, 1, 60);
+
+    op1 = start_op();
+    finish_connect(0);
+    first = op1->conn_data;
+
+    /* the first one is busy */
+    op2 = start_op();
+    assert_int_equal(test_ctx->num_connects, 2);
+    second = op2->conn_data;
+    assert_ptr_not_equal(second, first);
+
+    /* waits for the one being set up */
+    op3 = start_op();
+    assert_ptr_equal(op3->conn_data, second);
+    assert_int_equal(test_ctx->num_connects, 2);
+
+    finish_connect(1);
+    assert_null(second->connect_req);
+    /* the server was already known to be online */
+    assert_int_equal(test_ctx->online_cb_count, 1);
+
+    /* an unused connection comes first */
+    talloc_free(op1);
+    op4 = start_op();
+    assert_ptr_equal(op4->conn_data, first);
+
+    /* the pool is full, the least used connection is shared */
+    op5 = start_op();
+    assert_ptr_equal(op5->conn_data, first);
+    assert_int_equal(test_ctx->num_connects, 2);
+    assert_int_equal(test_ctx->conn_cache->num_pooled, 2);
+
+    talloc_free(op2);
+    talloc_free(op3);
+    talloc_free(op4);
+    talloc_free(op5);
+}
+
+/* The connections above the minimum are closed once unused */
+void test_pool_idle(void **state)
+{
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+
+    set_pool(2, 1, 1);
+
+    op1 = start_op();
+    finish_connect(0);
+    op2 = start_op();
+    finish_connect(1);
+    assert_int_equal(num_connections(), 2);
+
+    talloc_free(op1);
+    talloc_free(op2);
+    assert_non_null(test_ctx->conn_cache->connections->idle_timer);
+
+    assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    assert_int_equal(num_connections(), 1);
+    assert_int_equal(test_ctx->conn_cache->num_pooled, 1);
+
+    /* the last one is kept */
+    assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    assert_int_equal(num_connections(), 1);
+    assert_int_equal(test_ctx->conn_cache->num_pooled, 1);
+    assert_null(test_ctx->conn_cache->connections->idle_timer);
+}
+
+/* Going offline releases the whole pool */
+void test_pool_offline(void **state)
+{
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+
+    set_pool(2, 1, 60);
+
+    op1 = start_op();
+    finish_connect(0);
+    op2 = start_op();
+    finish_connect(1);
+    talloc_free(op1);
+    talloc_free(op2);
+    assert_int_equal(num_connections(), 2);
+
+    sdap_id_conn_cache_be_offline_cb(test_ctx->conn_cache);
+    assert_int_equal(num_connections(), 0);
+    assert_int_equal(test_ctx->conn_cache->num_pooled, 0);
+}
+
+/* Going offline gives up the connections being set up, their operations
+ * get an offline reply right away */
+void test_pool_offline_connecting(void **state)
+{
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+    struct tevent_req *req1;
+    struct tevent_req *req2;
+    int dp_error;
+    int ret;
+
+    set_pool(2, 1, 60);
+
+    op1 = sdap_id_op_create(test_ctx, test_ctx->conn_cache);
+    assert_non_null(op1);
+    req1 = sdap_id_op_connect_send(op1, op1, &ret);
+    assert_int_equal(ret, EOK);
+    assert_non_null(req1);
+
+    op2 = sdap_id_op_create(test_ctx, test_ctx->conn_cache);
+    assert_non_null(op2);
+    req2 = sdap_id_op_connect_send(op2, op2, &ret);
+    assert_int_equal(ret, EOK);
+    assert_non_null(req2);
+
+    /* both wait for the one being set up */
+    assert_ptr_equal(op2->conn_data, op1->conn_data);
+    assert_int_equal(num_connections(), 1);
+    assert_int_equal(test_ctx->num_connects, 1);
+
+    sdap_id_conn_cache_be_offline_cb(test_ctx->conn_cache);
+    assert_int_equal(num_connections(), 0);
+    assert_int_equal(test_ctx->conn_cache->num_pooled, 0);
+
+    ret = sdap_id_op_connect_recv(req1, &dp_error);
+    assert_int_equal(ret, EAGAIN);
+    assert_int_equal(dp_error, DP_ERR_OFFLINE);
+    assert_null(op1->conn_data);
+
+    ret = sdap_id_op_connect_recv(req2, &dp_error);
+    assert_int_equal(ret, EAGAIN);
+    assert_int_equal(dp_error, DP_ERR_OFFLINE);
+    assert_null(op2->conn_data);
+
+    talloc_free(op1);
+    talloc_free(op2);
+}
+
+/* A communication error moves all the connections to the next server */
+void test_pool_error(void **state)
+{
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+    struct sdap_id_op *op3;
+    struct sdap_id_conn_data *second;
+    int dp_error;
+    int ret;
+
+    set_pool(2, 1, 60);
+
+    op1 = start_op();
+    finish_connect(0);
+    op2 = start_op();
+    finish_connect(1);
+    second = op2->conn_data;
+
+    ret = sdap_id_op_done(op1, EIO, &dp_error);
+    assert_int_equal(ret, EAGAIN);
+    assert_int_equal(dp_error, DP_ERR_OK);
+
+    /* the failed one is closed, the other one is not reused */
+    assert_int_equal(num_connections(), 1);
+    assert_true(second->disconnecting);
+
+    op3 = start_op();
+    assert_int_equal(test_ctx->num_connects, 3);
+    assert_ptr_not_equal(op3->conn_data, second);
+
+    talloc_free(op1);
+    talloc_free(op2);
+    talloc_free(op3);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_pool_single,
+                                        sdap_id_op_test_setup,
+                                        sdap_id_op_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pool_grow,
+                                        sdap_id_op_test_setup,
+                                        sdap_id_op_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pool_idle,
+                                        sdap_id_op_test_setup,
+                                        sdap_id_op_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pool_offline,
+                                        sdap_id_op_test_setup,
+                                        sdap_id_op_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pool_offline_connecting,
+                                        sdap_id_op_test_setup,
+                                        sdap_id_op_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pool_error,
+                                        sdap_id_op_test_setup,
+                                        sdap_id_op_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,325 @@
+/*
+    SSSD
+
+    Tests of the scheduling of the LDAP searches of a connection
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the searches waiting on the handle */
+#include "providers/ldap/sdap_async.c"
+#include "providers/ldap/ldap_opts.h"
+
+#define TEST_MAX_SEARCHES 8
+
+struct sdap_sched_test_ctx {
+    struct tevent_context *ev;
+    struct sdap_options *opts;
+    struct sdap_handle *sh;
+
+    /* the filters of the searches sent to the server, in order */
+    const char *sent[TEST_MAX_SEARCHES];
+    int num_sent;
+};
+
+static struct sdap_sched_test_ctx *test_ctx;
+
+int __wrap_ldap_search_ext(LDAP *ld, LDAP_CONST char *base, int scope,
+                           LDAP_CONST char *filter, char **attrs,
+                           int attrsonly, LDAPControl **serverctrls,
+                           LDAPControl **clientctrls, struct timeval *timeout,
+                           int sizelimit, int *msgidp)
+{
+    assert_true(test_ctx->num_sent < TEST_MAX_SEARCHES);
+
+    test_ctx->sent[test_ctx->num_sent] = filter;
+    test_ctx->num_sent++;
+    *msgidp = test_ctx->num_sent;
+    return LDAP_SUCCESS;
+}
+
+int __wrap_ldap_abandon_ext(LDAP *ld, int msgid,
+                            LDAPControl **serverctrls,
+                            LDAPControl **clientctrls)
+{
+    return LDAP_SUCCESS;
+}
+
+static int sdap_sched_test_setup(void **state)
+{
+    errno_t ret;
+    int lret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct sdap_sched_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->ev = tevent_context_init(test_ctx);
+    assert_non_null(test_ctx->ev);
+
+    test_ctx->opts = talloc_zero(test_ctx, struct sdap_options);
+    assert_non_null(test_ctx->opts);
+    ret = dp_copy_defaults(test_ctx->opts, default_basic_opts,
+                           SDAP_OPTS_BASIC, &test_ctx->opts->basic);
+    assert_int_equal(ret, EOK);
+
+    test_ctx->sh = sdap_handle_create(test_ctx);
+    assert_non_null(test_ctx->sh);
+
+    /* never connects, the searches are not sent */
+    lret = ldap_initialize(&test_ctx->sh->ldap, "ldap://ldap.test");
+    assert_int_equal(lret, LDAP_SUCCESS);
+    test_ctx->sh->connected = true;
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int sdap_sched_test_teardown(void **state)
+{
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void set_limit(int limit)
+{
+    errno_t ret;
+
+    ret = dp_opt_set_int(test_ctx->opts->basic, SDAP_MAX_OUTSTANDING_OPS,
+                         limit);
+    assert_int_equal(ret, EOK);
+}
+
+/* A request state which issues its searches in @op_class */
+static TALLOC_CTX *class_state(enum sdap_op_class op_class)
+{
+    TALLOC_CTX *state;
+
+    state = talloc_new(test_ctx);
+    assert_non_null(state);
+    sdap_op_class_set(state, op_class);
+
+    return state;
+}
+
+static struct tevent_req *search(TALLOC_CTX *mem_ctx, const char *filter)
+{
+    struct tevent_req *req;
+
+    req = sdap_get_generic_ext_send(mem_ctx, test_ctx->ev, test_ctx->opts,
+                                    test_ctx->sh, "dc=test",
+                                    LDAP_SCOPE_SUBTREE, filter, NULL,
+                                    NULL, NULL, 0, 0, NULL, NULL, 0);
+    assert_non_null(req);
+
+    return req;
+}
+
+static void search_done(struct tevent_req *req)
+{
+    errno_t *_ret = tevent_req_callback_data(req, errno_t);
+
+    *_ret = sdap_get_generic_ext_recv(req, NULL, NULL, NULL);
+}
+
+/* A search finishes, the next one is sent from the event loop */
+static void finish_search(struct tevent_req *req, const char *next)
+{
+    int num_sent = test_ctx->num_sent;
+
+    talloc_free(req);
+    assert_int_equal(test_ctx->num_sent, num_sent);
+
+    assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    assert_int_equal(test_ctx->num_sent, num_sent + 1);
+    assert_string_equal(test_ctx->sent[num_sent], next);
+}
+
+/* Without a limit all the searches are sent at once */
+void test_sched_unlimited(void **state)
+{
+    struct tevent_req *req1;
+    struct tevent_req *req2;
+    struct tevent_req *req3;
+
+    req1 = search(test_ctx, "(cn=enum)");
+    req2 = search(test_ctx, "(cn=lookup)");
+    req3 = search(test_ctx, "(cn=auth)");
+    assert_int_equal(test_ctx->num_sent, 3);
+    assert_int_equal(test_ctx->sh->sched_stats.outstanding, 0);
+
+    talloc_free(req1);
+    talloc_free(req2);
+    talloc_free(req3);
+}
+
+/* The waiting searches are sent by class, then in the order they came */
+void test_sched_priority(void **state)
+{
+    struct tevent_req *enum_req;
+    struct tevent_req *refresh_req;
+    struct tevent_req *lookup_req;
+    struct tevent_req *lookup2_req;
+    struct tevent_req *auth_req;
+    struct sdap_sched_stats stats;
+
+    set_limit(1);
+
+    enum_req = search(class_state(SDAP_OP_CLASS_ENUM), "(cn=enum)");
+    assert_int_equal(test_ctx->num_sent, 1);
+
+    refresh_req = search(class_state(SDAP_OP_CLASS_REFRESH), "(cn=refresh)");
+    lookup_req = search(test_ctx, "(cn=lookup)");
+    lookup2_req = search(test_ctx, "(cn=lookup2)");
+    auth_req = search(class_state(SDAP_OP_CLASS_AUTH), "(cn=auth)");
+    assert_int_equal(test_ctx->num_sent, 1);
+
+    sdap_sched_get_stats(test_ctx->sh, &stats);
+    assert_int_equal(stats.outstanding, 1);
+    assert_int_equal(stats.queued[SDAP_OP_CLASS_AUTH], 1);
+    assert_int_equal(stats.queued[SDAP_OP_CLASS_LOOKUP], 2);
+    assert_int_equal(stats.queued[SDAP_OP_CLASS_REFRESH], 1);
+    assert_int_equal(stats.queued[SDAP_OP_CLASS_ENUM], 0);
+
+    finish_search(enum_req, "(cn=auth)");
+    finish_search(auth_req, "(cn=lookup)");
+    finish_search(lookup_req, "(cn=lookup2)");
+    finish_search(lookup2_req, "(cn=refresh)");
+
+    sdap_sched_get_stats(test_ctx->sh, &stats);
+    assert_int_equal(stats.max_outstanding, 1);
+    assert_int_equal(stats.max_queued[SDAP_OP_CLASS_LOOKUP], 2);
+    assert_int_equal(stats.total_queued[SDAP_OP_CLASS_REFRESH], 1);
+    assert_int_equal(stats.queued[SDAP_OP_CLASS_REFRESH], 0);
+
+    talloc_free(refresh_req);
+    assert_int_equal(test_ctx->sh->sched_stats.outstanding, 0);
+}
+
+/* The searches of the requests started by a marked request have its
+ * class */
+void test_sched_nested_class(void **state)
+{
+    TALLOC_CTX *auth_state;
+    TALLOC_CTX *child_state;
+    struct tevent_req *lookup_req;
+
+    set_limit(1);
+
+    lookup_req = search(test_ctx, "(cn=lookup)");
+
+    auth_state = class_state(SDAP_OP_CLASS_AUTH);
+    child_state = talloc_new(auth_state);
+    assert_non_null(child_state);
+
+    /* freed with the state */
+    search(child_state, "(cn=auth)");
+    assert_int_equal(test_ctx->num_sent, 1);
+    assert_int_equal(test_ctx->sh->sched_stats.queued[SDAP_OP_CLASS_AUTH], 1);
+    assert_int_equal(test_ctx->sh->sched_stats.queued[SDAP_OP_CLASS_LOOKUP],
+                     0);
+
+    finish_search(lookup_req, "(cn=auth)");
+
+    talloc_free(auth_state);
+    assert_int_equal(test_ctx->sh->sched_stats.outstanding, 0);
+}
+
+/* The waiting searches fail when the connection is released */
+void test_sched_release(void **state)
+{
+    struct tevent_req *req1;
+    struct tevent_req *req2;
+    struct tevent_req *req3;
+    errno_t ret1 = EOK;
+    errno_t ret2 = EOK;
+    errno_t ret3 = EOK;
+
+    set_limit(1);
+
+    req1 = search(test_ctx, "(cn=sent)");
+    tevent_req_set_callback(req1, search_done, &ret1);
+    req2 = search(test_ctx, "(cn=waiting)");
+    tevent_req_set_callback(req2, search_done, &ret2);
+    req3 = search(class_state(SDAP_OP_CLASS_ENUM), "(cn=enum)");
+    tevent_req_set_callback(req3, search_done, &ret3);
+
+    talloc_zfree(test_ctx->sh);
+
+    assert_int_equal(ret1, EIO);
+    assert_int_equal(ret2, EIO);
+    assert_int_equal(ret3, EIO);
+    assert_int_equal(test_ctx->num_sent, 1);
+
+    talloc_free(req1);
+    talloc_free(req2);
+    talloc_free(req3);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sched_unlimited,
+                                        sdap_sched_test_setup,
+                                        sdap_sched_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sched_priority,
+                                        sdap_sched_test_setup,
+                                        sdap_sched_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sched_nested_class,
+                                        sdap_sched_test_setup,
+                                        sdap_sched_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sched_release,
+                                        sdap_sched_test_setup,
+                                        sdap_sched_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
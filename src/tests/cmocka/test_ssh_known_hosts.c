@@ -0,0 +1,349 @@
+/*
+    SSSD
+
+    SSH Responder - Tests of the known_hosts file
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_ssh_known_hosts_conf.ldb"
+#define TEST_DOM_NAME "ssh_known_hosts_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_HOST_TIMEOUT 3600
+#define TEST_KNOWN_HOSTS_TIMEOUT 180
+
+#define TEST_KEY_A "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIKeyA"
+#define TEST_KEY_B "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIKeyB"
+#define TEST_KEY_C "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIKeyC"
+
+/* The file is written to TESTS_PATH instead of PUBCONF_PATH */
+#include "responder/ssh/sshsrv_private.h"
+#undef SSS_SSH_KNOWN_HOSTS_PATH
+#define SSS_SSH_KNOWN_HOSTS_PATH TESTS_PATH"/known_hosts"
+#undef SSS_SSH_KNOWN_HOSTS_TEMP_TMPL
+#define SSS_SSH_KNOWN_HOSTS_TEMP_TMPL TESTS_PATH"/.known_hosts.XXXXXX"
+
+/* In order to access the entries kept in memory */
+#include "responder/ssh/sshsrv_known_hosts.c"
+
+struct known_hosts_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct ssh_ctx *ssh_ctx;
+};
+
+static int known_hosts_test_setup(void **state)
+{
+    struct known_hosts_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct known_hosts_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->ssh_ctx = talloc_zero(test_ctx, struct ssh_ctx);
+    assert_non_null(test_ctx->ssh_ctx);
+
+    test_ctx->ssh_ctx->rctx = talloc_zero(test_ctx->ssh_ctx, struct resp_ctx);
+    assert_non_null(test_ctx->ssh_ctx->rctx);
+    test_ctx->ssh_ctx->rctx->domains = test_ctx->tctx->dom;
+    test_ctx->ssh_ctx->known_hosts_timeout = TEST_KNOWN_HOSTS_TIMEOUT;
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int known_hosts_test_setup_hashed(void **state)
+{
+    struct known_hosts_test_ctx *test_ctx;
+
+    known_hosts_test_setup(state);
+    test_ctx = talloc_get_type(*state, struct known_hosts_test_ctx);
+    test_ctx->ssh_ctx->hash_known_hosts = true;
+
+    return 0;
+}
+
+static int known_hosts_test_teardown(void **state)
+{
+    struct known_hosts_test_ctx *test_ctx;
+
+    test_ctx = talloc_get_type(*state, struct known_hosts_test_ctx);
+
+    sysdb_delete_ssh_host(test_ctx->tctx->dom, "host1");
+    sysdb_delete_ssh_host(test_ctx->tctx->dom, "host2");
+    unlink(SSS_SSH_KNOWN_HOSTS_PATH);
+
+    talloc_free(test_ctx);
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void store_host(struct known_hosts_test_ctx *test_ctx,
+                       const char *name, const char *pubkey)
+{
+    struct sysdb_attrs *attrs;
+    char *value;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    value = sss_base64_encode(attrs, (const uint8_t *)pubkey, strlen(pubkey));
+    assert_non_null(value);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_SSH_PUBKEY, value);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_ssh_host(test_ctx->tctx->dom, name, NULL,
+                               TEST_HOST_TIMEOUT, time(NULL), attrs);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(attrs);
+}
+
+/* A host key lookup of the client */
+static void lookup_host(struct known_hosts_test_ctx *test_ctx,
+                        const char *name)
+{
+    errno_t ret;
+
+    ret = ssh_known_hosts_update(test_ctx->ssh_ctx, test_ctx->tctx->dom,
+                                 name);
+    assert_int_equal(ret, EOK);
+}
+
+static char *read_known_hosts(TALLOC_CTX *mem_ctx, ino_t *_ino)
+{
+    struct stat st;
+    char *content;
+    ssize_t len;
+    int ret;
+    int fd;
+
+    fd = open(SSS_SSH_KNOWN_HOSTS_PATH, O_RDONLY);
+    assert_true(fd != -1);
+
+    ret = fstat(fd, &st);
+    assert_int_equal(ret, 0);
+    if (_ino != NULL) {
+        *_ino = st.st_ino;
+    }
+
+    content = talloc_size(mem_ctx, st.st_size + 1);
+    assert_non_null(content);
+
+    len = sss_atomic_read_s(fd, content, st.st_size);
+    assert_int_equal(len, st.st_size);
+    content[len] = '\0';
+
+    close(fd);
+    return content;
+}
+
+static size_t count_lines(const char *content)
+{
+    size_t count = 0;
+
+    for (; *content != '\0'; content++) {
+        if (*content == '\n') {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* The file has exactly the @lines, in any order */
+static void assert_known_hosts(struct known_hosts_test_ctx *test_ctx,
+                               const char **lines, ino_t *_ino)
+{
+    char *content;
+    size_t len = 0;
+    int i;
+
+    content = read_known_hosts(test_ctx, _ino);
+
+    for (i = 0; lines[i] != NULL; i++) {
+        assert_non_null(strstr(content, lines[i]));
+        len += strlen(lines[i]);
+    }
+    assert_int_equal(strlen(content), len);
+
+    talloc_free(content);
+}
+
+/* The file follows the hosts which are added, changed and removed */
+void test_known_hosts_update(void **state)
+{
+    struct known_hosts_test_ctx *test_ctx;
+    const char *first[] = { "host1 "TEST_KEY_A"\n", NULL };
+    const char *added[] = { "host1 "TEST_KEY_A"\n",
+                            "host2 "TEST_KEY_B"\n",
+                            NULL };
+    const char *changed[] = { "host1 "TEST_KEY_C"\n",
+                              "host2 "TEST_KEY_B"\n",
+                              NULL };
+    const char *removed[] = { "host1 "TEST_KEY_C"\n", NULL };
+    ino_t ino;
+    ino_t new_ino;
+
+    test_ctx = talloc_get_type(*state, struct known_hosts_test_ctx);
+
+    /* the first lookup writes the file from the cache */
+    store_host(test_ctx, "host1", TEST_KEY_A);
+    lookup_host(test_ctx, "host1");
+    assert_known_hosts(test_ctx, first, &ino);
+
+    /* a new host is appended */
+    store_host(test_ctx, "host2", TEST_KEY_B);
+    lookup_host(test_ctx, "host2");
+    assert_known_hosts(test_ctx, added, &new_ino);
+    assert_int_equal(new_ino, ino);
+
+    /* an unchanged host does not touch the file */
+    lookup_host(test_ctx, "host1");
+    assert_known_hosts(test_ctx, added, &new_ino);
+    assert_int_equal(new_ino, ino);
+
+    /* changed keys replace the old line */
+    store_host(test_ctx, "host1", TEST_KEY_C);
+    lookup_host(test_ctx, "host1");
+    assert_known_hosts(test_ctx, changed, &new_ino);
+    assert_int_not_equal(new_ino, ino);
+
+    /* a removed host is dropped */
+    ino = new_ino;
+    sysdb_delete_ssh_host(test_ctx->tctx->dom, "host2");
+    lookup_host(test_ctx, "host2");
+    assert_known_hosts(test_ctx, removed, &new_ino);
+    assert_int_not_equal(new_ino, ino);
+}
+
+/* Hashed entries are salted randomly, the entries of the hosts which did
+ * not change are written again as they were */
+void test_known_hosts_update_hashed(void **state)
+{
+    struct known_hosts_test_ctx *test_ctx;
+    char *content;
+    char *host2_line;
+    char *line_end;
+
+    test_ctx = talloc_get_type(*state, struct known_hosts_test_ctx);
+
+    store_host(test_ctx, "host1", TEST_KEY_A);
+    lookup_host(test_ctx, "host1");
+    content = read_known_hosts(test_ctx, NULL);
+    assert_int_equal(count_lines(content), 1);
+    assert_non_null(strstr(content, "|1|"));
+    assert_null(strstr(content, "host1"));
+    assert_non_null(strstr(content, " "TEST_KEY_A"\n"));
+
+    store_host(test_ctx, "host2", TEST_KEY_B);
+    lookup_host(test_ctx, "host2");
+    talloc_free(content);
+    content = read_known_hosts(test_ctx, NULL);
+    assert_int_equal(count_lines(content), 2);
+
+    /* the appended line */
+    host2_line = strstr(content, "\n") + 1;
+    line_end = strstr(host2_line, "\n");
+    assert_non_null(line_end);
+    line_end[1] = '\0';
+    assert_non_null(strstr(host2_line, " "TEST_KEY_B"\n"));
+    host2_line = talloc_strdup(test_ctx, host2_line);
+    assert_non_null(host2_line);
+
+    store_host(test_ctx, "host1", TEST_KEY_C);
+    lookup_host(test_ctx, "host1");
+    talloc_free(content);
+    content = read_known_hosts(test_ctx, NULL);
+    assert_int_equal(count_lines(content), 2);
+    assert_non_null(strstr(content, host2_line));
+    assert_non_null(strstr(content, " "TEST_KEY_C"\n"));
+    assert_null(strstr(content, TEST_KEY_A));
+
+    talloc_free(host2_line);
+    talloc_free(content);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_known_hosts_update,
+                                        known_hosts_test_setup,
+                                        known_hosts_test_teardown),
+        cmocka_unit_test_setup_teardown(test_known_hosts_update_hashed,
+                                        known_hosts_test_setup_hashed,
+                                        known_hosts_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,147 @@
+/*
+    SSSD
+
+    sss_client - Tests for the selection of the NSS client connection
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cmocka.h>
+
+/* In order to access the static connection handling */
+#include "sss_client/common.c"
+
+struct enum_thread_ctx {
+    struct sss_cli_conn *other_thread_conn;
+    bool enum_on_process_conn;
+    bool own_conn;
+};
+
+/* Continues the enumeration started by another thread */
+static void *enum_thread(void *ptr)
+{
+    struct enum_thread_ctx *ctx = (struct enum_thread_ctx *) ptr;
+    struct sss_cli_conn *conn;
+
+    conn = sss_nss_conn_get(SSS_NSS_GETPWENT);
+    ctx->enum_on_process_conn = (conn == &sss_cli_global_conn);
+    sss_nss_conn_put(conn);
+
+    conn = sss_nss_conn_get(SSS_NSS_GETPWNAM);
+    ctx->own_conn = (conn != NULL
+                        && conn != &sss_cli_global_conn
+                        && conn != ctx->other_thread_conn);
+    sss_nss_conn_put(conn);
+
+    return NULL;
+}
+
+void test_enum_across_threads(void **state)
+{
+    struct enum_thread_ctx ctx = { 0 };
+    struct sss_cli_conn *conn;
+    pthread_t thread;
+    int ret;
+
+    ret = setenv("SSS_NSS_PER_THREAD_SOCKET", "YES", 1);
+    assert_int_equal(ret, 0);
+
+    /* lookups use the connection of the thread */
+    ctx.other_thread_conn = sss_nss_conn_get(SSS_NSS_GETPWNAM);
+    assert_non_null(ctx.other_thread_conn);
+    assert_ptr_not_equal(ctx.other_thread_conn, &sss_cli_global_conn);
+    sss_nss_conn_put(ctx.other_thread_conn);
+
+    /* the enumeration is started here and continued by another thread */
+    conn = sss_nss_conn_get(SSS_NSS_SETPWENT);
+    assert_ptr_equal(conn, &sss_cli_global_conn);
+    sss_nss_conn_put(conn);
+
+    ret = pthread_create(&thread, NULL, enum_thread, &ctx);
+    assert_int_equal(ret, 0);
+    ret = pthread_join(thread, NULL);
+    assert_int_equal(ret, 0);
+
+    assert_true(ctx.enum_on_process_conn);
+    assert_true(ctx.own_conn);
+
+    conn = sss_nss_conn_get(SSS_NSS_ENDPWENT);
+    assert_ptr_equal(conn, &sss_cli_global_conn);
+    sss_nss_conn_put(conn);
+}
+
+void test_stateful_commands(void **state)
+{
+    assert_true(sss_nss_cmd_is_stateful(SSS_NSS_SETGRENT));
+    assert_true(sss_nss_cmd_is_stateful(SSS_NSS_GETGRENT));
+    assert_true(sss_nss_cmd_is_stateful(SSS_NSS_ENDGRENT));
+    assert_true(sss_nss_cmd_is_stateful(SSS_NSS_SETNETGRENT));
+    assert_true(sss_nss_cmd_is_stateful(SSS_NSS_GETNETGRENT));
+    assert_true(sss_nss_cmd_is_stateful(SSS_NSS_ENDNETGRENT));
+    assert_true(sss_nss_cmd_is_stateful(SSS_NSS_GETSERVENT));
+
+    assert_false(sss_nss_cmd_is_stateful(SSS_NSS_GETPWUID));
+    assert_false(sss_nss_cmd_is_stateful(SSS_NSS_GETGRNAM));
+    assert_false(sss_nss_cmd_is_stateful(SSS_NSS_INITGR));
+}
+
+/* Idle per-thread connections are closed, the process-wide connection
+ * which holds the enumeration state never is */
+void test_reap_keeps_process_conn(void **state)
+{
+    struct sss_cli_conn *conn;
+    int fds[2];
+    int ret;
+
+    ret = setenv("SSS_NSS_PER_THREAD_SOCKET", "YES", 1);
+    assert_int_equal(ret, 0);
+
+    ret = pipe(fds);
+    assert_int_equal(ret, 0);
+    sss_cli_global_conn.sd = fds[0];
+
+    conn = sss_nss_conn_get(SSS_NSS_GETPWNAM);
+    assert_non_null(conn);
+    conn->sd = fds[1];
+    sss_nss_conn_put(conn);
+
+    pthread_mutex_lock(&sss_cli_thread_mtx);
+    sss_cli_thread_last_reap = 0;
+    sss_cli_thread_reap_idle(time(NULL) + 2 * SSS_CLI_THREAD_CONN_IDLE);
+    pthread_mutex_unlock(&sss_cli_thread_mtx);
+
+    assert_int_equal(conn->sd, -1);
+    assert_int_equal(sss_cli_global_conn.sd, fds[0]);
+
+    sss_cli_conn_close(&sss_cli_global_conn);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_enum_across_threads),
+        cmocka_unit_test(test_stateful_commands),
+        cmocka_unit_test(test_reap_keeps_process_conn),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -478,6 +478,68 @@ void test_map_id_external(void **state)
     assert_int_equal(err, IDMAP_EXTERNAL);
 }
 
+void test_map_id_many_domains(void **state)
+{
+    struct test_ctx *test_ctx;
+    struct sss_idmap_range range;
+    enum idmap_error_code err;
+    char name[64];
+    char dom_sid[64];
+    char obj_sid[128];
+    char *sid = NULL;
+    uint32_t id;
+    int c;
+
+    test_ctx = talloc_get_type(*state, struct test_ctx);
+
+    assert_non_null(test_ctx);
+
+    /* added in an order which is neither sorted by SID nor by range */
+    for (c = 0; c < 60; c++) {
+        snprintf(name, sizeof(name), "dom%d.test", (c * 7) % 60);
+        snprintf(dom_sid, sizeof(dom_sid), "S-1-5-21-%d-456-789",
+                 (c * 7) % 60);
+        range.min = TEST_RANGE_MIN + ((c * 7) % 60) * TEST_OFFSET;
+        range.max = TEST_RANGE_MAX + ((c * 7) % 60) * TEST_OFFSET;
+
+        err = sss_idmap_add_domain_ex(test_ctx->idmap_ctx, name, dom_sid,
+                                      &range, NULL, 0, false);
+        assert_int_equal(err, IDMAP_SUCCESS);
+
+        /* lookups in between invalidate and rebuild the index */
+        if (c % 10 == 0) {
+            err = sss_idmap_sid_to_unix(test_ctx->idmap_ctx,
+                                        "S-1-5-21-0-456-789-1", &id);
+            assert_int_equal(err, IDMAP_SUCCESS);
+            assert_int_equal(id, TEST_RANGE_MIN + 1);
+        }
+    }
+
+    for (c = 0; c < 60; c++) {
+        snprintf(obj_sid, sizeof(obj_sid), "S-1-5-21-%d-456-789-%d", c, c);
+        err = sss_idmap_sid_to_unix(test_ctx->idmap_ctx, obj_sid, &id);
+        assert_int_equal(err, IDMAP_SUCCESS);
+        assert_int_equal(id, TEST_RANGE_MIN + c * TEST_OFFSET + c);
+
+        err = sss_idmap_unix_to_sid(test_ctx->idmap_ctx, id, &sid);
+        assert_int_equal(err, IDMAP_SUCCESS);
+        assert_string_equal(sid, obj_sid);
+        sss_idmap_free_sid(test_ctx->idmap_ctx, sid);
+    }
+
+    err = sss_idmap_sid_to_unix(test_ctx->idmap_ctx, "S-1-5-21-60-456-789-1",
+                                &id);
+    assert_int_equal(err, IDMAP_NO_DOMAIN);
+
+    err = sss_idmap_sid_to_unix(test_ctx->idmap_ctx, "S-1-5-21-5-456-789-1-2",
+                                &id);
+    assert_int_equal(err, IDMAP_SID_INVALID);
+
+    err = sss_idmap_unix_to_sid(test_ctx->idmap_ctx,
+                                TEST_RANGE_MAX + 1, &sid);
+    assert_int_equal(err, IDMAP_NO_DOMAIN);
+}
+
 void test_check_sid_id(void **state)
 {
     struct test_ctx *test_ctx;
@@ -700,6 +762,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_map_id_external,
                                         test_sss_idmap_setup_with_external_mappings,
                                         test_sss_idmap_teardown),
+        cmocka_unit_test_setup_teardown(test_map_id_many_domains,
+                                        test_sss_idmap_setup,
+                                        test_sss_idmap_teardown),
         cmocka_unit_test_setup_teardown(test_check_sid_id,
                                         test_sss_idmap_setup_with_domains,
                                         test_sss_idmap_teardown),
@@ -2139,6 +2139,124 @@ void test_sss_sifp_fetch_domain_by_name(void **state)
     /* messages are unrefed in the library */
 }
 
+void test_sss_sifp_fetch_users_attrs(void **state)
+{
+    sss_sifp_ctx *ctx = test_ctx.dbus_ctx;
+    DBusMessage *reply = test_ctx.reply;
+    DBusMessageIter iter;
+    DBusMessageIter array_iter;
+    DBusMessageIter user_iter;
+    DBusMessageIter attrs_iter;
+    DBusMessageIter dict_iter;
+    DBusMessageIter var_iter;
+    dbus_bool_t bret;
+    sss_sifp_error ret;
+    const char *names[] = {"user1", "user2", "missing", NULL};
+    const char *attrs[] = {"name", "gecos", NULL};
+    const char *gecos[] = {"User One", "User Two"};
+    const char *attr_name = NULL;
+    const char *prop = NULL;
+    sss_sifp_object **out = NULL;
+    int i;
+
+    dbus_message_iter_init_append(reply, &iter);
+
+    bret = dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+                                            DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                                            DBUS_TYPE_STRING_AS_STRING
+                                            DBUS_TYPE_ARRAY_AS_STRING
+                                            DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                                            DBUS_TYPE_STRING_AS_STRING
+                                            DBUS_TYPE_VARIANT_AS_STRING
+                                            DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+                                            DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+                                            &array_iter);
+    assert_true(bret);
+
+    /* the responder leaves out users which do not exist */
+    for (i = 0; i < 2; i++) {
+        bret = dbus_message_iter_open_container(&array_iter,
+                                                DBUS_TYPE_DICT_ENTRY,
+                                                NULL, &user_iter);
+        assert_true(bret);
+
+        bret = dbus_message_iter_append_basic(&user_iter, DBUS_TYPE_STRING,
+                                              &names[i]);
+        assert_true(bret);
+
+        bret = dbus_message_iter_open_container(&user_iter, DBUS_TYPE_ARRAY,
+                                                DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                                                DBUS_TYPE_STRING_AS_STRING
+                                                DBUS_TYPE_VARIANT_AS_STRING
+                                                DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+                                                &attrs_iter);
+        assert_true(bret);
+
+        bret = dbus_message_iter_open_container(&attrs_iter,
+                                                DBUS_TYPE_DICT_ENTRY,
+                                                NULL, &dict_iter);
+        assert_true(bret);
+
+        attr_name = "gecos";
+        bret = dbus_message_iter_append_basic(&dict_iter, DBUS_TYPE_STRING,
+                                              &attr_name);
+        assert_true(bret);
+
+        bret = dbus_message_iter_open_container(&dict_iter, DBUS_TYPE_VARIANT,
+                                                DBUS_TYPE_STRING_AS_STRING,
+                                                &var_iter);
+        assert_true(bret);
+
+        bret = dbus_message_iter_append_basic(&var_iter, DBUS_TYPE_STRING,
+                                              &gecos[i]);
+        assert_true(bret);
+
+        bret = dbus_message_iter_close_container(&dict_iter, &var_iter);
+        assert_true(bret);
+
+        bret = dbus_message_iter_close_container(&attrs_iter, &dict_iter);
+        assert_true(bret);
+
+        bret = dbus_message_iter_close_container(&user_iter, &attrs_iter);
+        assert_true(bret);
+
+        bret = dbus_message_iter_close_container(&array_iter, &user_iter);
+        assert_true(bret);
+    }
+
+    bret = dbus_message_iter_close_container(&iter, &array_iter);
+    assert_true(bret);
+
+    will_return(__wrap_dbus_connection_send_with_reply_and_block, reply);
+
+    /* test */
+    ret = sss_sifp_fetch_users_attrs(ctx, names, attrs, &out);
+    assert_int_equal(ret, SSS_SIFP_OK);
+    assert_non_null(out);
+
+    for (i = 0; i < 2; i++) {
+        assert_non_null(out[i]);
+        assert_non_null(out[i]->name);
+        assert_null(out[i]->object_path);
+        assert_non_null(out[i]->interface);
+        assert_non_null(out[i]->attrs);
+
+        assert_string_equal(out[i]->name, names[i]);
+        assert_string_equal(out[i]->interface, SSS_SIFP_IFACE_USERS ".User");
+
+        ret = sss_sifp_find_attr_as_string(out[i]->attrs, "gecos", &prop);
+        assert_int_equal(ret, SSS_SIFP_OK);
+        assert_string_equal(prop, gecos[i]);
+    }
+
+    assert_null(out[i]);
+
+    sss_sifp_free_object_list(ctx, &out);
+    assert_null(out);
+
+    /* messages are unrefed in the library */
+}
+
 int main(int argc, const char *argv[])
 {
     int rv;
@@ -2247,6 +2365,8 @@ int main(int argc, const char *argv[])
                                         test_setup, test_teardown_api),
         cmocka_unit_test_setup_teardown(test_sss_sifp_fetch_domain_by_name,
                                         test_setup, test_teardown_api),
+        cmocka_unit_test_setup_teardown(test_sss_sifp_fetch_users_attrs,
+                                        test_setup, test_teardown_api),
     };
 
     /* Set debug level to invalid value so we can deside if -d 0 was used. */
@@ -0,0 +1,443 @@
+/*
+    SSSD
+
+    sudo_index - Tests for the index of the sudo rules in the responder
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+/* In order to access the index itself */
+#include "responder/sudo/sudosrv_index.c"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sudo_index_conf.ldb"
+#define TEST_DOM_NAME "sudo_index_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_USER_NAME "sudo_user"
+#define TEST_USER_UID 1001
+#define TEST_GROUP_NAME "sudo_group"
+#define TEST_OTHER_GROUP_NAME "other_group"
+
+#define TEST_CACHE_TIMEOUT 5400
+
+#define TEST_ALL_FILTER "(" SYSDB_OBJECTCLASS "=" SYSDB_SUDO_CACHE_OC ")"
+#define TEST_NEW_FILTER "(" SYSDB_NAME "=rule_new)"
+
+struct sudo_index_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct sudo_ctx *sudo_ctx;
+};
+
+static int mc_resets;
+
+void __wrap_sss_mmap_cache_reset(struct sss_mc_ctx *mc_ctx)
+{
+    mc_resets++;
+}
+
+static void store_rule(struct sudo_index_test_ctx *test_ctx,
+                       const char *name,
+                       const char *order,
+                       bool expired,
+                       const char **users)
+{
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct sysdb_attrs *rule;
+    errno_t ret;
+    int i;
+
+    rule = sysdb_new_attrs(test_ctx);
+    assert_non_null(rule);
+
+    ret = sysdb_attrs_add_string(rule, SYSDB_SUDO_CACHE_AT_CN, name);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_attrs_add_string(rule, SYSDB_SUDO_CACHE_AT_COMMAND, "ALL");
+    assert_int_equal(ret, EOK);
+
+    if (order != NULL) {
+        ret = sysdb_attrs_add_string(rule, SYSDB_SUDO_CACHE_AT_ORDER, order);
+        assert_int_equal(ret, EOK);
+    }
+
+    for (i = 0; users != NULL && users[i] != NULL; i++) {
+        ret = sysdb_attrs_add_string(rule, SYSDB_SUDO_CACHE_AT_USER, users[i]);
+        assert_int_equal(ret, EOK);
+    }
+
+    /* with no timeout the rule expires at once */
+    dom->sudo_timeout = expired ? 0 : TEST_CACHE_TIMEOUT;
+    ret = sysdb_sudo_store(dom, &rule, 1);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(rule);
+}
+
+static void store_rules(struct sudo_index_test_ctx *test_ctx)
+{
+    const char *all[] = { "ALL", NULL };
+    const char *user[] = { TEST_USER_NAME, NULL };
+    const char *uid[] = { "#1001", NULL };
+    const char *group[] = { "%"TEST_GROUP_NAME, NULL };
+    const char *other[] = { "%"TEST_OTHER_GROUP_NAME, NULL };
+    const char *netgroup[] = { "+sudo_netgroup", NULL };
+    const char *multi[] = { TEST_USER_NAME, "%"TEST_OTHER_GROUP_NAME, NULL };
+    const char *nobody[] = { "nobody", "%nogroup", NULL };
+
+    store_rule(test_ctx, "defaults", NULL, false, NULL);
+    store_rule(test_ctx, "rule_all", "10", true, all);
+    store_rule(test_ctx, "rule_user", "20", false, user);
+    store_rule(test_ctx, "rule_uid", "30", true, uid);
+    store_rule(test_ctx, "rule_group", "40", false, group);
+    store_rule(test_ctx, "rule_other", "50", true, other);
+    store_rule(test_ctx, "rule_netgroup", "60", false, netgroup);
+    store_rule(test_ctx, "rule_multi", "5", false, multi);
+    store_rule(test_ctx, "rule_nobody", "70", true, nobody);
+}
+
+static int test_sudo_index_setup(void **state)
+{
+    struct sudo_index_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct sudo_index_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->sudo_ctx = talloc_zero(test_ctx, struct sudo_ctx);
+    assert_non_null(test_ctx->sudo_ctx);
+
+    store_rules(test_ctx);
+    mc_resets = 0;
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sudo_index_teardown(void **state)
+{
+    struct sudo_index_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                  struct sudo_index_test_ctx);
+
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+/* The names of the rules the filter of sysdb_get_sudo_filter() matches, in
+ * the order the responder sent them before there was an index */
+static const char **filter_rules(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *dom,
+                                 bool inverse_order,
+                                 unsigned int flags,
+                                 const char *username,
+                                 uid_t uid,
+                                 char **groupnames,
+                                 size_t *_count)
+{
+    struct ldb_message **msgs = NULL;
+    const char **names;
+    char *filter;
+    size_t count = 0;
+    size_t i;
+    errno_t ret;
+    const char *attrs[] = { SYSDB_NAME,
+                            SYSDB_SUDO_CACHE_AT_ORDER,
+                            NULL };
+
+    ret = sysdb_get_sudo_filter(mem_ctx, username, uid, groupnames, flags,
+                                &filter);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_search_custom(mem_ctx, dom, filter, SUDORULE_SUBDIR, attrs,
+                              &count, &msgs);
+    if (ret == ENOENT) {
+        count = 0;
+    } else {
+        assert_int_equal(ret, EOK);
+    }
+
+    qsort(msgs, count, sizeof(struct ldb_message *),
+          inverse_order ? sudo_order_low_cmp_fn : sudo_order_high_cmp_fn);
+
+    names = talloc_zero_array(mem_ctx, const char *, count + 1);
+    assert_non_null(names);
+
+    for (i = 0; i < count; i++) {
+        names[i] = ldb_msg_find_attr_as_string(msgs[i], SYSDB_NAME, NULL);
+        assert_non_null(names[i]);
+    }
+
+    *_count = count;
+    return names;
+}
+
+static void check_rules(struct sudo_index_test_ctx *test_ctx,
+                        unsigned int flags,
+                        const char *username,
+                        uid_t uid,
+                        char **groupnames)
+{
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_attrs **rules;
+    const char **expected;
+    const char *name;
+    size_t expected_count;
+    uint32_t count;
+    uint32_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    expected = filter_rules(tmp_ctx, dom, test_ctx->sudo_ctx->inverse_order,
+                            flags, username, uid, groupnames,
+                            &expected_count);
+
+    ret = sudosrv_index_get_rules(tmp_ctx, test_ctx->sudo_ctx, dom, flags,
+                                  username, uid, groupnames, &rules, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, expected_count);
+
+    for (i = 0; i < count; i++) {
+        /* expired rules only carry their name, the others what the client
+         * gets, in which the name is the cn */
+        ret = sysdb_attrs_get_string(rules[i],
+                                     (flags & SYSDB_SUDO_FILTER_ONLY_EXPIRED)
+                                        ? SYSDB_NAME : SYSDB_SUDO_CACHE_AT_CN,
+                                     &name);
+        assert_int_equal(ret, EOK);
+        assert_string_equal(name, expected[i]);
+    }
+    assert_null(rules[count]);
+
+    talloc_free(tmp_ctx);
+}
+
+static void check_all_flags(struct sudo_index_test_ctx *test_ctx)
+{
+    const char *groups[] = { TEST_GROUP_NAME, TEST_OTHER_GROUP_NAME, NULL };
+    const char *no_groups[] = { NULL };
+    unsigned int flags;
+
+    for (flags = 0; flags <= (SYSDB_SUDO_FILTER_USERINFO
+                              | SYSDB_SUDO_FILTER_ONLY_EXPIRED
+                              | SYSDB_SUDO_FILTER_INCLUDE_ALL
+                              | SYSDB_SUDO_FILTER_INCLUDE_DFL); flags++) {
+        check_rules(test_ctx, flags, TEST_USER_NAME, TEST_USER_UID,
+                    discard_const(groups));
+
+        /* a user with no groups and the values the filter ignores */
+        check_rules(test_ctx, flags, "nobody", TEST_USER_UID,
+                    discard_const(no_groups));
+        check_rules(test_ctx, flags, NULL, 0, NULL);
+    }
+}
+
+/* The index returns the rules of the filter in the order of sudoOrder, the
+ * highest first */
+static void test_sudo_index_filter(void **state)
+{
+    struct sudo_index_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                  struct sudo_index_test_ctx);
+
+    test_ctx->sudo_ctx->inverse_order = false;
+    check_all_flags(test_ctx);
+}
+
+/* With sudo_inverse_order the lowest sudoOrder comes first */
+static void test_sudo_index_filter_inverse(void **state)
+{
+    struct sudo_index_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                  struct sudo_index_test_ctx);
+
+    test_ctx->sudo_ctx->inverse_order = true;
+    check_all_flags(test_ctx);
+}
+
+static struct sudosrv_index *get_index(struct sudo_index_test_ctx *test_ctx)
+{
+    struct sudosrv_index *idx;
+    errno_t ret;
+
+    ret = sudosrv_index_get(test_ctx->sudo_ctx, test_ctx->tctx->dom, &idx);
+    assert_int_equal(ret, EOK);
+    assert_true(idx->valid);
+
+    return idx;
+}
+
+/* Only writes to the rules build the index again */
+static void test_sudo_index_invalidate(void **state)
+{
+    struct sudo_index_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                  struct sudo_index_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    const char *user[] = { TEST_USER_NAME, NULL };
+    struct sysdb_attrs **rules;
+    struct sudosrv_index *idx;
+    uint64_t generation;
+    uint64_t new_generation;
+    uint32_t count;
+    size_t deleted;
+    errno_t ret;
+
+    idx = get_index(test_ctx);
+    generation = idx->generation;
+    assert_int_not_equal(generation, 0);
+    assert_int_equal(idx->num_rules, 9);
+
+    /* users, groups and their memberships are not part of the index */
+    ret = sysdb_add_user(dom, TEST_USER_NAME, TEST_USER_UID, 0, NULL, NULL,
+                         NULL, NULL, NULL, TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_add_group(dom, TEST_GROUP_NAME, 2001, NULL,
+                          TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_add_group_member(dom, TEST_GROUP_NAME, TEST_USER_NAME,
+                                 SYSDB_MEMBER_USER, false);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_sudo_get_generation(dom, &new_generation);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(new_generation, generation);
+
+    idx = get_index(test_ctx);
+    assert_int_equal(idx->generation, generation);
+    assert_int_equal(mc_resets, 0);
+
+    /* a new rule */
+    store_rule(test_ctx, "rule_new", "80", false, user);
+
+    idx = get_index(test_ctx);
+    assert_true(idx->generation > generation);
+    assert_int_equal(idx->num_rules, 10);
+    assert_int_equal(mc_resets, 1);
+    generation = idx->generation;
+
+    /* the same rule stored again, only its expiration time changes */
+    check_rules(test_ctx, SYSDB_SUDO_FILTER_USERNAME, TEST_USER_NAME, 0, NULL);
+    store_rule(test_ctx, "rule_new", "80", true, user);
+
+    idx = get_index(test_ctx);
+    assert_true(idx->generation > generation);
+    assert_int_equal(mc_resets, 2);
+    generation = idx->generation;
+    check_rules(test_ctx, SYSDB_SUDO_FILTER_USERNAME
+                          | SYSDB_SUDO_FILTER_ONLY_EXPIRED,
+                TEST_USER_NAME, 0, NULL);
+
+    /* a removed rule */
+    ret = sysdb_sudo_purge(dom, TEST_NEW_FILTER, NULL, 0);
+    assert_int_equal(ret, EOK);
+
+    idx = get_index(test_ctx);
+    assert_true(idx->generation > generation);
+    assert_int_equal(idx->num_rules, 9);
+    assert_int_equal(mc_resets, 3);
+    generation = idx->generation;
+
+    /* nothing missing, nothing changes */
+    ret = sudosrv_index_get_rules(test_ctx, test_ctx->sudo_ctx, dom,
+                                  SYSDB_SUDO_FILTER_NONE, NULL, 0, NULL,
+                                  &rules, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 9);
+
+    ret = sysdb_sudo_purge_missing(dom, rules, count, &deleted);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(deleted, 0);
+
+    idx = get_index(test_ctx);
+    assert_int_equal(idx->generation, generation);
+    assert_int_equal(mc_resets, 3);
+
+    /* all rules removed, the generation still grows */
+    ret = sysdb_sudo_purge(dom, TEST_ALL_FILTER, NULL, 0);
+    assert_int_equal(ret, EOK);
+
+    idx = get_index(test_ctx);
+    assert_true(idx->generation > generation);
+    assert_int_equal(idx->num_rules, 0);
+    assert_int_equal(mc_resets, 4);
+
+    check_all_flags(test_ctx);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sudo_index_filter,
+                                        test_sudo_index_setup,
+                                        test_sudo_index_teardown),
+        cmocka_unit_test_setup_teardown(test_sudo_index_filter_inverse,
+                                        test_sudo_index_setup,
+                                        test_sudo_index_teardown),
+        cmocka_unit_test_setup_teardown(test_sudo_index_invalidate,
+                                        test_sudo_index_setup,
+                                        test_sudo_index_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
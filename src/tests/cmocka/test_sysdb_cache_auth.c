@@ -0,0 +1,408 @@
+/*
+    SSSD
+
+    sysdb_cache_auth - Tests for the asynchronous offline authentication
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "util/crypto/sss_crypto.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_cache_auth_conf.ldb"
+#define TEST_DOM_NAME "cache_auth_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_USER_FMT "cacheuser%d"
+#define TEST_UID_BASE 10000
+#define TEST_PASSWORD "12345"
+#define TEST_SALT "$6$rounds=5000$0123456789abcdef"
+
+/* number of PAM requests which arrive together in the benchmark */
+#define TEST_CONCURRENT_USERS 32
+
+struct cache_auth_test_ctx {
+    struct sss_test_ctx *tctx;
+
+    int pending;
+    int succeeded;
+    int failed;
+    int ticks;
+    struct tevent_timer *tick;
+};
+
+static int cache_auth_test_setup(void **state)
+{
+    struct cache_auth_test_ctx *test_ctx;
+    struct sss_test_conf_param params[] = {
+        { "cache_credentials", "true" },
+        { NULL, NULL },             /* Sentinel */
+    };
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct cache_auth_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         params);
+    assert_non_null(test_ctx->tctx);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int cache_auth_test_teardown(void **state)
+{
+    struct cache_auth_test_ctx *test_ctx;
+
+    test_ctx = talloc_get_type(*state, struct cache_auth_test_ctx);
+    talloc_free(test_ctx);
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void add_cached_user(struct cache_auth_test_ctx *test_ctx, int idx)
+{
+    const char *name;
+    errno_t ret;
+
+    name = talloc_asprintf(test_ctx, TEST_USER_FMT, idx);
+    assert_non_null(name);
+
+    ret = sysdb_add_user(test_ctx->tctx->dom, name,
+                         TEST_UID_BASE + idx, TEST_UID_BASE + idx,
+                         NULL, NULL, NULL, NULL, NULL, 0, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_cache_password(test_ctx->tctx->dom, name, TEST_PASSWORD);
+    assert_int_equal(ret, EOK);
+}
+
+static void test_hash_done(struct tevent_req *req)
+{
+    struct cache_auth_test_ctx *test_ctx;
+    char *hash;
+    char *sync_hash;
+    errno_t ret;
+
+    test_ctx = tevent_req_callback_data(req, struct cache_auth_test_ctx);
+
+    ret = s3crypt_sha512_recv(req, test_ctx, &hash);
+    talloc_free(req);
+    assert_int_equal(ret, EOK);
+
+    ret = s3crypt_sha512(test_ctx, TEST_PASSWORD, TEST_SALT, &sync_hash);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(hash, sync_hash);
+
+    test_ev_done(test_ctx->tctx, EOK);
+}
+
+static void test_s3crypt_sha512_async(void **state)
+{
+    struct cache_auth_test_ctx *test_ctx;
+    struct tevent_req *req;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct cache_auth_test_ctx);
+
+    req = s3crypt_sha512_send(test_ctx, test_ctx->tctx->ev,
+                              TEST_PASSWORD, TEST_SALT);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_hash_done, test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+static void test_s3crypt_sha512_cancel(void **state)
+{
+    struct cache_auth_test_ctx *test_ctx;
+    struct tevent_req *req;
+    int i;
+
+    test_ctx = talloc_get_type(*state, struct cache_auth_test_ctx);
+
+    /* requests freed while queued or running must not complete */
+    for (i = 0; i < TEST_CONCURRENT_USERS; i++) {
+        req = s3crypt_sha512_send(test_ctx, test_ctx->tctx->ev,
+                                  TEST_PASSWORD, TEST_SALT);
+        assert_non_null(req);
+        talloc_free(req);
+    }
+
+    req = s3crypt_sha512_send(test_ctx, test_ctx->tctx->ev,
+                              TEST_PASSWORD, TEST_SALT);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_hash_done, test_ctx);
+
+    assert_int_equal(test_ev_loop(test_ctx->tctx), EOK);
+}
+
+static void test_cache_password_done(struct tevent_req *req)
+{
+    struct cache_auth_test_ctx *test_ctx;
+
+    test_ctx = tevent_req_callback_data(req, struct cache_auth_test_ctx);
+
+    test_ev_done(test_ctx->tctx, sysdb_cache_password_recv(req));
+    talloc_free(req);
+}
+
+static void test_cache_auth_done(struct tevent_req *req)
+{
+    struct cache_auth_test_ctx *test_ctx;
+
+    test_ctx = tevent_req_callback_data(req, struct cache_auth_test_ctx);
+
+    test_ev_done(test_ctx->tctx, sysdb_cache_auth_recv(req, NULL, NULL));
+    talloc_free(req);
+}
+
+static errno_t run_cache_auth(struct cache_auth_test_ctx *test_ctx,
+                              const char *name, const char *password)
+{
+    struct tevent_req *req;
+
+    test_ctx->tctx->done = false;
+    req = sysdb_cache_auth_send(test_ctx, test_ctx->tctx->ev,
+                                test_ctx->tctx->dom, name, password,
+                                test_ctx->tctx->confdb, false);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_cache_auth_done, test_ctx);
+
+    return test_ev_loop(test_ctx->tctx);
+}
+
+static void test_sysdb_cache_auth_async(void **state)
+{
+    struct cache_auth_test_ctx *test_ctx;
+    struct ldb_message *msg;
+    const char *attrs[] = { SYSDB_FAILED_LOGIN_ATTEMPTS, NULL };
+    struct tevent_req *req;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct cache_auth_test_ctx);
+
+    ret = sysdb_add_user(test_ctx->tctx->dom, "cacheuser", TEST_UID_BASE,
+                         TEST_UID_BASE, NULL, NULL, NULL, NULL, NULL, 0, 0);
+    assert_int_equal(ret, EOK);
+
+    req = sysdb_cache_password_send(test_ctx, test_ctx->tctx->ev,
+                                    test_ctx->tctx->dom, "cacheuser",
+                                    TEST_PASSWORD, SSS_AUTHTOK_TYPE_PASSWORD,
+                                    0);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_cache_password_done, test_ctx);
+    assert_int_equal(test_ev_loop(test_ctx->tctx), EOK);
+
+    /* the hash is compatible with the synchronous check */
+    ret = sysdb_cache_auth(test_ctx->tctx->dom, "cacheuser", TEST_PASSWORD,
+                           test_ctx->tctx->confdb, true, NULL, NULL);
+    assert_int_equal(ret, EOK);
+
+    ret = run_cache_auth(test_ctx, "cacheuser", TEST_PASSWORD);
+    assert_int_equal(ret, EOK);
+
+    ret = run_cache_auth(test_ctx, "cacheuser", "54321");
+    assert_int_equal(ret, ERR_AUTH_FAILED);
+
+    ret = sysdb_search_user_by_name(test_ctx, test_ctx->tctx->dom,
+                                    "cacheuser", attrs, &msg);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(ldb_msg_find_attr_as_uint(msg,
+                                               SYSDB_FAILED_LOGIN_ATTEMPTS, 0),
+                     1);
+
+    ret = run_cache_auth(test_ctx, "nosuchuser", TEST_PASSWORD);
+    assert_int_equal(ret, ERR_ACCOUNT_UNKNOWN);
+}
+
+static void bench_tick(struct tevent_context *ev, struct tevent_timer *te,
+                       struct timeval tv, void *pvt)
+{
+    struct cache_auth_test_ctx *test_ctx;
+
+    test_ctx = talloc_get_type(pvt, struct cache_auth_test_ctx);
+
+    test_ctx->ticks++;
+    test_ctx->tick = tevent_add_timer(ev, test_ctx,
+                                      tevent_timeval_current_ofs(0, 1000),
+                                      bench_tick, test_ctx);
+    assert_non_null(test_ctx->tick);
+}
+
+static void bench_auth_done(struct tevent_req *req)
+{
+    struct cache_auth_test_ctx *test_ctx;
+    errno_t ret;
+
+    test_ctx = tevent_req_callback_data(req, struct cache_auth_test_ctx);
+
+    ret = sysdb_cache_auth_recv(req, NULL, NULL);
+    talloc_free(req);
+    if (ret == EOK) {
+        test_ctx->succeeded++;
+    } else {
+        test_ctx->failed++;
+    }
+
+    if (--test_ctx->pending == 0) {
+        test_ev_done(test_ctx->tctx, EOK);
+    }
+}
+
+static double bench_elapsed_ms(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000.0
+           + (now.tv_usec - start->tv_usec) / 1000.0;
+}
+
+/* Many PAM clients asking for offline authentication at the same time. The
+ * event loop keeps running while the hashes are computed, the ticks of a
+ * 1 ms timer show how often it got a chance to serve other requests. */
+static void test_sysdb_cache_auth_concurrent(void **state)
+{
+    struct cache_auth_test_ctx *test_ctx;
+    struct tevent_req *req;
+    struct timeval start;
+    double sync_ms;
+    double async_ms;
+    const char *name;
+    errno_t ret;
+    int i;
+
+    test_ctx = talloc_get_type(*state, struct cache_auth_test_ctx);
+
+    for (i = 0; i < TEST_CONCURRENT_USERS; i++) {
+        add_cached_user(test_ctx, i);
+    }
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < TEST_CONCURRENT_USERS; i++) {
+        name = talloc_asprintf(test_ctx, TEST_USER_FMT, i);
+        assert_non_null(name);
+
+        ret = sysdb_cache_auth(test_ctx->tctx->dom, name, TEST_PASSWORD,
+                               test_ctx->tctx->confdb, false, NULL, NULL);
+        assert_int_equal(ret, EOK);
+    }
+    sync_ms = bench_elapsed_ms(&start);
+
+    test_ctx->tick = tevent_add_timer(test_ctx->tctx->ev, test_ctx,
+                                      tevent_timeval_current_ofs(0, 1000),
+                                      bench_tick, test_ctx);
+    assert_non_null(test_ctx->tick);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < TEST_CONCURRENT_USERS; i++) {
+        name = talloc_asprintf(test_ctx, TEST_USER_FMT, i);
+        assert_non_null(name);
+
+        req = sysdb_cache_auth_send(test_ctx, test_ctx->tctx->ev,
+                                    test_ctx->tctx->dom, name,
+                                    i % 2 ? TEST_PASSWORD : "54321",
+                                    test_ctx->tctx->confdb, false);
+        assert_non_null(req);
+        tevent_req_set_callback(req, bench_auth_done, test_ctx);
+        test_ctx->pending++;
+    }
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+    async_ms = bench_elapsed_ms(&start);
+    talloc_zfree(test_ctx->tick);
+
+    assert_int_equal(test_ctx->succeeded, TEST_CONCURRENT_USERS / 2);
+    assert_int_equal(test_ctx->failed, TEST_CONCURRENT_USERS / 2);
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "%d offline authentications: %.1f ms on the event loop, "
+          "%.1f ms asynchronously with %d timer ticks\n",
+          TEST_CONCURRENT_USERS, sync_ms, async_ms, test_ctx->ticks);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    poptContext pc;
+    int opt;
+    int no_cleanup = 0;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_s3crypt_sha512_async,
+                                        cache_auth_test_setup,
+                                        cache_auth_test_teardown),
+        cmocka_unit_test_setup_teardown(test_s3crypt_sha512_cancel,
+                                        cache_auth_test_setup,
+                                        cache_auth_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_cache_auth_async,
+                                        cache_auth_test_setup,
+                                        cache_auth_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_cache_auth_concurrent,
+                                        cache_auth_test_setup,
+                                        cache_auth_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,320 @@
+/*
+    SSSD
+
+    sysdb - Tests for the read-only copy of the cache of the responders
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+#include <dirent.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h" /* for the state of the copy */
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sysdb_cache_copy_conf.ldb"
+#define TEST_DOM_NAME "sysdb_cache_copy_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_INTERVAL 60
+#define TEST_UID_BASE 10000
+
+struct cache_copy_test_ctx {
+    struct sss_test_ctx *tctx;
+    /* the back end */
+    struct sysdb_ctx *publisher;
+    /* a responder */
+    struct sysdb_ctx *reader;
+};
+
+static int cache_copy_test_setup(void **state)
+{
+    struct cache_copy_test_ctx *test_ctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct cache_copy_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->publisher = test_ctx->tctx->dom->sysdb;
+    sysdb_set_snapshot_publisher(test_ctx->publisher, TEST_INTERVAL);
+    /* the copy of the timestamp cache is published with the cache */
+    assert_non_null(test_ctx->publisher->ldb_ts_snap_file);
+
+    ret = sysdb_domain_init(test_ctx, test_ctx->tctx->dom, TESTS_PATH,
+                            &test_ctx->reader);
+    assert_int_equal(ret, EOK);
+    sysdb_set_snapshot_reader(test_ctx->reader, TEST_INTERVAL);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int cache_copy_test_teardown(void **state)
+{
+    struct cache_copy_test_ctx *test_ctx;
+
+    test_ctx = talloc_get_type(*state, struct cache_copy_test_ctx);
+
+    unlink(test_ctx->publisher->ldb_snap_file);
+    unlink(test_ctx->publisher->ldb_ts_snap_file);
+    talloc_free(test_ctx);
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void add_user(struct cache_copy_test_ctx *test_ctx, int idx)
+{
+    const char *name;
+    errno_t ret;
+
+    name = talloc_asprintf(test_ctx, "copyuser%d", idx);
+    assert_non_null(name);
+
+    ret = sysdb_add_user(test_ctx->tctx->dom, name,
+                         TEST_UID_BASE + idx, TEST_UID_BASE + idx,
+                         NULL, NULL, NULL, NULL, NULL, 0, 0);
+    assert_int_equal(ret, EOK);
+}
+
+/* The back end copies the cache at the start of its next transaction once
+ * the interval is over */
+static void start_next_interval(struct cache_copy_test_ctx *test_ctx)
+{
+    errno_t ret;
+
+    test_ctx->publisher->snapshot_published -= TEST_INTERVAL;
+
+    ret = sysdb_transaction_start(test_ctx->publisher);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_transaction_cancel(test_ctx->publisher);
+    assert_int_equal(ret, EOK);
+}
+
+static ino_t file_ino(const char *path)
+{
+    struct stat st;
+    int ret;
+
+    ret = stat(path, &st);
+    assert_int_equal(ret, 0);
+
+    return st.st_ino;
+}
+
+/* Looks up the user the way the responders do and returns whether the
+ * copy the responder searched has the user */
+static bool lookup_user(struct cache_copy_test_ctx *test_ctx, int idx,
+                        bool *_found)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char *attrs[] = { SYSDB_NAME, NULL };
+    struct ldb_result *res;
+    struct ldb_dn *base_dn;
+    const char *name;
+    bool in_copy;
+    int lret;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    name = talloc_asprintf(tmp_ctx, "copyuser%d", idx);
+    assert_non_null(name);
+
+    base_dn = ldb_dn_new(tmp_ctx, test_ctx->reader->ldb, SYSDB_BASE);
+    assert_non_null(base_dn);
+
+    /* the copy is checked at most once a second */
+    test_ctx->reader->snapshot_checked = 0;
+
+    ret = sysdb_read_search(tmp_ctx, test_ctx->reader, base_dn,
+                            LDB_SCOPE_SUBTREE, attrs, &res,
+                            "(&(%s)(%s=%s))", SYSDB_UC, SYSDB_NAME, name);
+    assert_int_equal(ret, EOK);
+    *_found = (res->count == 1);
+
+    assert_true(test_ctx->reader->snapshot_current);
+    assert_non_null(test_ctx->reader->ldb_snap);
+
+    base_dn = ldb_dn_new(tmp_ctx, test_ctx->reader->ldb_snap, SYSDB_BASE);
+    assert_non_null(base_dn);
+
+    lret = ldb_search(test_ctx->reader->ldb_snap, tmp_ctx, &res, base_dn,
+                      LDB_SCOPE_SUBTREE, attrs, "(&(%s)(%s=%s))",
+                      SYSDB_UC, SYSDB_NAME, name);
+    assert_int_equal(lret, LDB_SUCCESS);
+    in_copy = (res->count == 1);
+
+    talloc_free(tmp_ctx);
+    return in_copy;
+}
+
+static void assert_no_partial_copies(void)
+{
+    struct dirent *de;
+    DIR *dir;
+
+    dir = opendir(TESTS_PATH);
+    assert_non_null(dir);
+
+    while ((de = readdir(dir)) != NULL) {
+        if (strstr(de->d_name, ".snapshot.") != NULL) {
+            fail_msg("Partial copy %s left behind", de->d_name);
+        }
+    }
+
+    closedir(dir);
+}
+
+/* What a transaction commits is published by the first transaction of the
+ * next interval */
+void test_cache_copy_publish_after_commit(void **state)
+{
+    struct cache_copy_test_ctx *test_ctx;
+    ino_t ino;
+    bool found;
+
+    test_ctx = talloc_get_type(*state, struct cache_copy_test_ctx);
+
+    /* copied before the user is added */
+    add_user(test_ctx, 0);
+    ino = file_ino(test_ctx->publisher->ldb_snap_file);
+
+    assert_false(lookup_user(test_ctx, 0, &found));
+    assert_true(found);
+
+    /* not before the interval is over */
+    add_user(test_ctx, 1);
+    assert_int_equal(file_ino(test_ctx->publisher->ldb_snap_file), ino);
+    assert_false(lookup_user(test_ctx, 1, &found));
+    assert_true(found);
+
+    start_next_interval(test_ctx);
+    assert_int_not_equal(file_ino(test_ctx->publisher->ldb_snap_file), ino);
+
+    assert_true(lookup_user(test_ctx, 0, &found));
+    assert_true(found);
+    assert_true(lookup_user(test_ctx, 1, &found));
+    assert_true(found);
+}
+
+/* A copy which cannot be published does not replace the previous one */
+void test_cache_copy_failed_copy(void **state)
+{
+    struct cache_copy_test_ctx *test_ctx;
+    char *ts_snap_file;
+    ino_t ino;
+    ino_t ts_ino;
+    bool found;
+
+    test_ctx = talloc_get_type(*state, struct cache_copy_test_ctx);
+
+    add_user(test_ctx, 10);
+    start_next_interval(test_ctx);
+    ino = file_ino(test_ctx->publisher->ldb_snap_file);
+    ts_ino = file_ino(test_ctx->publisher->ldb_ts_snap_file);
+
+    add_user(test_ctx, 11);
+
+    /* the copy of the cache succeeds, the one of the timestamps fails */
+    ts_snap_file = test_ctx->publisher->ldb_ts_snap_file;
+    test_ctx->publisher->ldb_ts_snap_file = discard_const(TESTS_PATH
+                                                 "/missing/ts.snapshot");
+    start_next_interval(test_ctx);
+    test_ctx->publisher->ldb_ts_snap_file = ts_snap_file;
+
+    assert_int_equal(file_ino(test_ctx->publisher->ldb_snap_file), ino);
+    assert_int_equal(file_ino(test_ctx->publisher->ldb_ts_snap_file), ts_ino);
+    assert_no_partial_copies();
+
+    /* the responders still use the previous copy */
+    assert_true(lookup_user(test_ctx, 10, &found));
+    assert_true(found);
+    assert_false(lookup_user(test_ctx, 11, &found));
+    assert_true(found);
+
+    /* and the next interval publishes again */
+    start_next_interval(test_ctx);
+    assert_int_not_equal(file_ino(test_ctx->publisher->ldb_snap_file), ino);
+    assert_true(lookup_user(test_ctx, 11, &found));
+    assert_true(found);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_cache_copy_publish_after_commit,
+                                        cache_copy_test_setup,
+                                        cache_copy_test_teardown),
+        cmocka_unit_test_setup_teardown(test_cache_copy_failed_copy,
+                                        cache_copy_test_setup,
+                                        cache_copy_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
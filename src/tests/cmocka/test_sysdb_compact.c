@@ -0,0 +1,280 @@
+/*
+    SSSD
+
+    sysdb - Tests of the size report and compaction of the cache files
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sysdb_compact_conf.ldb"
+#define TEST_DOM_NAME "sysdb_compact_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_USERS 200
+#define TEST_KEPT_USERS 10
+#define TEST_UID_BASE 10000
+
+struct compact_test_ctx {
+    char *ldb_file;
+    char *ts_file;
+};
+
+static struct sss_test_ctx *open_cache(TALLOC_CTX *mem_ctx)
+{
+    struct sss_test_ctx *tctx;
+
+    tctx = create_dom_test_ctx(mem_ctx, TESTS_PATH, TEST_CONF_DB,
+                               TEST_DOM_NAME, TEST_ID_PROVIDER, NULL);
+    assert_non_null(tctx);
+
+    return tctx;
+}
+
+static const char *user_name(TALLOC_CTX *mem_ctx, int idx)
+{
+    const char *name;
+
+    name = talloc_asprintf(mem_ctx, "compactuser%d", idx);
+    assert_non_null(name);
+
+    return name;
+}
+
+/* Leaves a cache with most of its space in deleted records and closes it,
+ * the files cannot be opened while the cache is open in the process */
+static int compact_test_setup(void **state)
+{
+    struct compact_test_ctx *test_ctx;
+    struct sss_test_ctx *tctx;
+    errno_t ret;
+    int i;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct compact_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+    tctx = open_cache(test_ctx);
+
+    for (i = 0; i < TEST_USERS; i++) {
+        ret = sysdb_add_user(tctx->dom, user_name(tctx, i),
+                             TEST_UID_BASE + i, TEST_UID_BASE + i,
+                             NULL, NULL, NULL, NULL, NULL, 0, 0);
+        assert_int_equal(ret, EOK);
+    }
+
+    for (i = TEST_KEPT_USERS; i < TEST_USERS; i++) {
+        ret = sysdb_delete_user(tctx->dom, user_name(tctx, i), 0);
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = sysdb_get_cache_files(test_ctx, tctx->dom, TESTS_PATH,
+                                &test_ctx->ldb_file, &test_ctx->ts_file);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(tctx);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int compact_test_teardown(void **state)
+{
+    struct compact_test_ctx *test_ctx;
+
+    test_ctx = talloc_get_type(*state, struct compact_test_ctx);
+
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static ino_t file_ino(const char *path)
+{
+    struct stat st;
+    int ret;
+
+    ret = stat(path, &st);
+    assert_int_equal(ret, 0);
+
+    return st.st_ino;
+}
+
+static void assert_same_records(struct sysdb_cache_stats *before,
+                                struct sysdb_cache_stats *after)
+{
+    assert_int_equal(after->records, before->records);
+    assert_int_equal(after->data_size, before->data_size);
+}
+
+/* The users which were not deleted are still in the cache */
+static void assert_users(void)
+{
+    struct sss_test_ctx *tctx;
+    struct ldb_result *res;
+    errno_t ret;
+    int i;
+
+    tctx = open_cache(global_talloc_context);
+
+    for (i = 0; i < TEST_USERS; i++) {
+        ret = sysdb_getpwnam(tctx, tctx->dom, user_name(tctx, i), &res);
+        assert_int_equal(ret, EOK);
+        assert_int_equal(res->count, i < TEST_KEPT_USERS ? 1 : 0);
+        talloc_free(res);
+    }
+
+    talloc_free(tctx);
+}
+
+void test_cache_files(void **state)
+{
+    struct compact_test_ctx *test_ctx;
+    struct sysdb_cache_stats stats;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct compact_test_ctx);
+
+    assert_string_equal(test_ctx->ldb_file,
+                        TESTS_PATH"/cache_"TEST_DOM_NAME".ldb");
+    assert_string_equal(test_ctx->ts_file,
+                        TESTS_PATH"/timestamps_"TEST_DOM_NAME".ldb");
+
+    ret = sysdb_cache_file_stats(test_ctx->ldb_file, &stats);
+    assert_int_equal(ret, EOK);
+    assert_true(stats.records > TEST_KEPT_USERS);
+    assert_true(stats.data_size > 0);
+    assert_true(stats.file_size > stats.data_size);
+    assert_true(stats.free_records > 0);
+
+    ret = sysdb_cache_file_stats(TESTS_PATH"/missing.ldb", &stats);
+    assert_int_not_equal(ret, EOK);
+}
+
+/* Without sssd running the file is replaced by a smaller one */
+void test_cache_compact(void **state)
+{
+    struct compact_test_ctx *test_ctx;
+    struct sysdb_cache_stats before;
+    struct sysdb_cache_stats after;
+    ino_t ino;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct compact_test_ctx);
+
+    ret = sysdb_cache_file_stats(test_ctx->ldb_file, &before);
+    assert_int_equal(ret, EOK);
+    ino = file_ino(test_ctx->ldb_file);
+
+    ret = sysdb_cache_file_compact(test_ctx->ldb_file, false);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_cache_file_stats(test_ctx->ldb_file, &after);
+    assert_int_equal(ret, EOK);
+    assert_same_records(&before, &after);
+    assert_true(after.file_size < before.file_size);
+    assert_int_not_equal(file_ino(test_ctx->ldb_file), ino);
+
+    ret = sysdb_cache_file_compact(test_ctx->ts_file, false);
+    assert_int_equal(ret, EOK);
+
+    assert_users();
+}
+
+/* While sssd runs the records are repacked in the same file */
+void test_cache_compact_in_use(void **state)
+{
+    struct compact_test_ctx *test_ctx;
+    struct sysdb_cache_stats before;
+    struct sysdb_cache_stats after;
+    ino_t ino;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct compact_test_ctx);
+
+    ret = sysdb_cache_file_stats(test_ctx->ldb_file, &before);
+    assert_int_equal(ret, EOK);
+    ino = file_ino(test_ctx->ldb_file);
+
+    ret = sysdb_cache_file_compact(test_ctx->ldb_file, true);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_cache_file_stats(test_ctx->ldb_file, &after);
+    assert_int_equal(ret, EOK);
+    assert_same_records(&before, &after);
+    assert_int_equal(file_ino(test_ctx->ldb_file), ino);
+
+    assert_users();
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_cache_files,
+                                        compact_test_setup,
+                                        compact_test_teardown),
+        cmocka_unit_test_setup_teardown(test_cache_compact,
+                                        compact_test_setup,
+                                        compact_test_teardown),
+        cmocka_unit_test_setup_teardown(test_cache_compact_in_use,
+                                        compact_test_setup,
+                                        compact_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
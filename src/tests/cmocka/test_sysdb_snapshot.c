@@ -0,0 +1,282 @@
+/*
+    SSSD
+
+    sysdb_snapshot - Tests for the snapshots of the cache
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+#include <unistd.h>
+
+#include "tests/cmocka/common_mock.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sysdb_snapshot_conf.ldb"
+#define TEST_DOM_NAME "snapshot_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_USER_NAME "test_user"
+#define TEST_USER_UID 1234
+#define TEST_USER_GID 5678
+#define TEST_GROUP_NAME "test_group"
+#define TEST_GROUP_GID 5679
+
+#define TEST_CACHE_TIMEOUT 300
+
+struct sysdb_snapshot_test_ctx {
+    struct sss_test_ctx *tctx;
+    FILE *file;
+};
+
+static int test_sysdb_snapshot_setup(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sysdb_snapshot_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->file = tmpfile();
+    assert_non_null(test_ctx->file);
+
+    check_leaks_push(test_ctx);
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_snapshot_teardown(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                               struct sysdb_snapshot_test_ctx);
+
+    assert_true(check_leaks_pop(test_ctx));
+    fclose(test_ctx->file);
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void store_user_and_group(struct sysdb_snapshot_test_ctx *test_ctx)
+{
+    errno_t ret;
+
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, NULL, "/home/user",
+                           "/bin/sh", NULL, NULL, NULL, TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_group(test_ctx->tctx->dom, TEST_GROUP_NAME,
+                            TEST_GROUP_GID, NULL, TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_add_group_member(test_ctx->tctx->dom, TEST_GROUP_NAME,
+                                 TEST_USER_NAME, SYSDB_MEMBER_USER, false);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_cache_password(test_ctx->tctx->dom, TEST_USER_NAME,
+                               "Passw0rd");
+    assert_int_equal(ret, EOK);
+}
+
+static void test_sysdb_snapshot_roundtrip(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                               struct sysdb_snapshot_test_ctx);
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    struct ldb_message *msg;
+    size_t count;
+    size_t failed;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user_and_group(test_ctx);
+
+    ret = sysdb_snapshot_export(test_ctx->tctx->dom, NULL, test_ctx->file,
+                                &count);
+    assert_int_equal(ret, EOK);
+    assert_true(count >= 2);
+
+    ret = sysdb_delete_group(test_ctx->tctx->dom, TEST_GROUP_NAME, 0);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_delete_user(test_ctx->tctx->dom, TEST_USER_NAME, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_snapshot_import(test_ctx->tctx->dom, test_ctx->file,
+                                &count, &failed);
+    assert_int_equal(ret, EOK);
+    assert_true(count >= 2);
+    assert_int_equal(failed, 0);
+
+    /* the user and the group it was a member of */
+    ret = sysdb_initgroups(tmp_ctx, test_ctx->tctx->dom, TEST_USER_NAME,
+                           &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 2);
+    assert_string_equal(ldb_msg_find_attr_as_string(res->msgs[1],
+                                                    SYSDB_NAME, NULL),
+                        TEST_GROUP_NAME);
+
+    msg = res->msgs[0];
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0),
+                     1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_INITGR_EXPIRE, 0),
+                     1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_UIDNUM, 0),
+                     TEST_USER_UID);
+    /* the credentials were not exported */
+    assert_null(ldb_msg_find_element(msg, SYSDB_CACHEDPWD));
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sysdb_snapshot_import_existing(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                               struct sysdb_snapshot_test_ctx);
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    size_t count;
+    size_t failed;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user_and_group(test_ctx);
+
+    ret = sysdb_snapshot_export(test_ctx->tctx->dom, NULL, test_ctx->file,
+                                &count);
+    assert_int_equal(ret, EOK);
+
+    /* the entries in the cache are overwritten */
+    ret = sysdb_snapshot_import(test_ctx->tctx->dom, test_ctx->file,
+                                &count, &failed);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(failed, 0);
+
+    ret = sysdb_getpwnam(tmp_ctx, test_ctx->tctx->dom, TEST_USER_NAME, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_CACHE_EXPIRE, 0),
+                     1);
+
+    ret = sysdb_initgroups(tmp_ctx, test_ctx->tctx->dom, TEST_USER_NAME,
+                           &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 2);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sysdb_snapshot_bad_header(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                               struct sysdb_snapshot_test_ctx);
+    errno_t ret;
+
+    fprintf(test_ctx->file, "dn: cn=snapshot\n"
+                            "snapshotVersion: 1\n"
+                            "cacheVersion: 0.1\n"
+                            "domainName: " TEST_DOM_NAME "\n\n");
+    ret = sysdb_snapshot_import(test_ctx->tctx->dom, test_ctx->file,
+                                NULL, NULL);
+    assert_int_equal(ret, EMEDIUMTYPE);
+
+    /* no header at all */
+    rewind(test_ctx->file);
+    assert_int_equal(ftruncate(fileno(test_ctx->file), 0), 0);
+    fprintf(test_ctx->file, "dn: name=user,cn=users,cn=" TEST_DOM_NAME
+                            ",cn=sysdb\n"
+                            "name: user\n\n");
+    fflush(test_ctx->file);
+    ret = sysdb_snapshot_import(test_ctx->tctx->dom, test_ctx->file,
+                                NULL, NULL);
+    assert_int_equal(ret, EINVAL);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_snapshot_roundtrip,
+                                        test_sysdb_snapshot_setup,
+                                        test_sysdb_snapshot_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_snapshot_import_existing,
+                                        test_sysdb_snapshot_setup,
+                                        test_sysdb_snapshot_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_snapshot_bad_header,
+                                        test_sysdb_snapshot_setup,
+                                        test_sysdb_snapshot_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,307 @@
+/*
+    SSSD
+
+    sysdb_sync - Tests for the delayed flushing of the cache
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h" /* for sysdb->nosync */
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sysdb_sync_conf.ldb"
+#define TEST_DOM_NAME "sysdb_sync_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_UID_BASE 10000
+#define TEST_USERS 16
+
+struct sysdb_sync_test_ctx {
+    struct sss_test_ctx *tctx;
+    int pending;
+};
+
+static int sysdb_sync_test_setup_delay(void **state, const char *delay,
+                                       bool backend)
+{
+    struct sysdb_sync_test_ctx *test_ctx;
+    struct sysdb_ctx *sysdb;
+    errno_t ret;
+    struct sss_test_conf_param params[] = {
+        { "cache_commit_delay", delay },
+        { NULL, NULL },             /* Sentinel */
+    };
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct sysdb_sync_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         params);
+    assert_non_null(test_ctx->tctx);
+
+    if (backend) {
+        /* reopen the cache the way the back end does */
+        talloc_zfree(test_ctx->tctx->dom->sysdb);
+        ret = sysdb_domain_init_ext(test_ctx->tctx->dom, test_ctx->tctx->dom,
+                                    TESTS_PATH, SYSDB_INIT_FLAG_NOSYNC,
+                                    &sysdb);
+        assert_int_equal(ret, EOK);
+        test_ctx->tctx->dom->sysdb = sysdb;
+    }
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int sysdb_sync_test_setup(void **state)
+{
+    return sysdb_sync_test_setup_delay(state, "10", true);
+}
+
+static int sysdb_sync_test_setup_sync(void **state)
+{
+    return sysdb_sync_test_setup_delay(state, "0", true);
+}
+
+static int sysdb_sync_test_setup_other(void **state)
+{
+    return sysdb_sync_test_setup_delay(state, "10", false);
+}
+
+static int sysdb_sync_test_teardown(void **state)
+{
+    struct sysdb_sync_test_ctx *test_ctx;
+
+    test_ctx = talloc_get_type(*state, struct sysdb_sync_test_ctx);
+    talloc_free(test_ctx);
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void add_user(struct sysdb_sync_test_ctx *test_ctx, int idx)
+{
+    const char *name;
+    errno_t ret;
+
+    name = talloc_asprintf(test_ctx, "syncuser%d", idx);
+    assert_non_null(name);
+
+    ret = sysdb_add_user(test_ctx->tctx->dom, name,
+                         TEST_UID_BASE + idx, TEST_UID_BASE + idx,
+                         NULL, NULL, NULL, NULL, NULL, 0, 0);
+    assert_int_equal(ret, EOK);
+}
+
+static void test_sync_done(struct tevent_req *req)
+{
+    struct sysdb_sync_test_ctx *test_ctx;
+    errno_t ret;
+
+    test_ctx = tevent_req_callback_data(req, struct sysdb_sync_test_ctx);
+
+    ret = sysdb_sync_recv(req);
+    talloc_free(req);
+    if (ret != EOK) {
+        test_ev_done(test_ctx->tctx, ret);
+        return;
+    }
+
+    if (--test_ctx->pending == 0) {
+        test_ev_done(test_ctx->tctx, EOK);
+    }
+}
+
+static void send_sync(struct sysdb_sync_test_ctx *test_ctx)
+{
+    struct tevent_req *req;
+
+    req = sysdb_sync_send(test_ctx, test_ctx->tctx->ev,
+                          test_ctx->tctx->dom->sysdb);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_sync_done, test_ctx);
+    test_ctx->pending++;
+}
+
+static void test_sysdb_sync_commits(void **state)
+{
+    struct sysdb_sync_test_ctx *test_ctx;
+    struct ldb_message *msg;
+    errno_t ret;
+    int i;
+
+    test_ctx = talloc_get_type(*state, struct sysdb_sync_test_ctx);
+
+    ret = sysdb_sync_init(test_ctx->tctx->dom->sysdb,
+                          test_ctx->tctx->ev, 10);
+    assert_int_equal(ret, EOK);
+
+    /* the commits before each request are on disk when it completes */
+    for (i = 0; i < TEST_USERS; i++) {
+        add_user(test_ctx, i);
+        send_sync(test_ctx);
+    }
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_search_user_by_uid(test_ctx, test_ctx->tctx->dom,
+                                   TEST_UID_BASE + TEST_USERS - 1,
+                                   NULL, &msg);
+    assert_int_equal(ret, EOK);
+
+    /* nothing was committed since, the request completes right away */
+    send_sync(test_ctx);
+    test_ctx->tctx->done = false;
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+static void test_sysdb_sync_cancel(void **state)
+{
+    struct sysdb_sync_test_ctx *test_ctx;
+    struct tevent_req *req;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct sysdb_sync_test_ctx);
+
+    ret = sysdb_sync_init(test_ctx->tctx->dom->sysdb,
+                          test_ctx->tctx->ev, 10);
+    assert_int_equal(ret, EOK);
+
+    add_user(test_ctx, 0);
+
+    /* a request freed while waiting must not complete */
+    req = sysdb_sync_send(test_ctx, test_ctx->tctx->ev,
+                          test_ctx->tctx->dom->sysdb);
+    assert_non_null(req);
+    talloc_free(req);
+
+    send_sync(test_ctx);
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+static void test_sysdb_sync_disabled(void **state)
+{
+    struct sysdb_sync_test_ctx *test_ctx;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct sysdb_sync_test_ctx);
+
+    /* without a delay every commit is flushed by ldb */
+    ret = sysdb_sync_init(test_ctx->tctx->dom->sysdb,
+                          test_ctx->tctx->ev, 0);
+    assert_int_equal(ret, EOK);
+
+    add_user(test_ctx, 0);
+    send_sync(test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+static void test_sysdb_sync_other_process(void **state)
+{
+    struct sysdb_sync_test_ctx *test_ctx;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct sysdb_sync_test_ctx);
+
+    /* only the back end skips the sync of the commits */
+    assert_true(test_ctx->tctx->dom->cache_commit_delay > 0);
+    assert_false(test_ctx->tctx->dom->sysdb->nosync);
+
+    ret = sysdb_sync_init(test_ctx->tctx->dom->sysdb,
+                          test_ctx->tctx->ev, 10);
+    assert_int_equal(ret, EOK);
+    assert_null(test_ctx->tctx->dom->sysdb->sync);
+
+    add_user(test_ctx, 0);
+    send_sync(test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    poptContext pc;
+    int opt;
+    int no_cleanup = 0;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_sync_commits,
+                                        sysdb_sync_test_setup,
+                                        sysdb_sync_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_sync_cancel,
+                                        sysdb_sync_test_setup,
+                                        sysdb_sync_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_sync_disabled,
+                                        sysdb_sync_test_setup_sync,
+                                        sysdb_sync_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_sync_other_process,
+                                        sysdb_sync_test_setup_other,
+                                        sysdb_sync_test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,538 @@
+/*
+    SSSD
+
+    sysdb_ts_cache - Tests for the timestamp cache of sysdb
+
+    Copyright (C) 2016 Red Hat
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h" /* for sysdb->ldb member */
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sysdb_ts_cache_conf.ldb"
+#define TEST_DOM_NAME "ts_cache_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_USER_NAME "test_user"
+#define TEST_USER_UID 1234
+#define TEST_USER_GID 5678
+#define TEST_USER_GECOS "Gecos field"
+#define TEST_USER_HOMEDIR "/home/home"
+#define TEST_USER_SHELL "/bin/shell"
+#define TEST_USER_UPN "test_user@TS_CACHE_TEST"
+#define TEST_GROUP_NAME "test_group"
+#define TEST_GROUP_GID 5679
+
+#define TEST_CACHE_TIMEOUT 5
+#define TEST_NOW_1 100
+#define TEST_NOW_2 200
+
+struct sysdb_ts_test_ctx {
+    struct sss_test_ctx *tctx;
+};
+
+static int test_sysdb_ts_setup(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct sysdb_ts_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+    assert_non_null(test_ctx->tctx->sysdb->ldb_ts);
+
+    check_leaks_push(test_ctx);
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_ts_teardown(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+
+    assert_true(check_leaks_pop(test_ctx));
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void store_user(struct sysdb_ts_test_ctx *test_ctx,
+                       const char *gecos,
+                       time_t now)
+{
+    errno_t ret;
+
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, gecos,
+                           TEST_USER_HOMEDIR, TEST_USER_SHELL, NULL, NULL,
+                           NULL, TEST_CACHE_TIMEOUT, now);
+    assert_int_equal(ret, EOK);
+}
+
+/* the entry as written in the cache, without the timestamp cache */
+static struct ldb_message *get_cache_entry(TALLOC_CTX *mem_ctx,
+                                           struct sysdb_ts_test_ctx *test_ctx)
+{
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    int lret;
+
+    dn = sysdb_user_dn(mem_ctx, test_ctx->tctx->dom, TEST_USER_NAME);
+    assert_non_null(dn);
+
+    lret = ldb_search(test_ctx->tctx->sysdb->ldb, mem_ctx, &res, dn,
+                      LDB_SCOPE_BASE, NULL, NULL);
+    assert_int_equal(lret, LDB_SUCCESS);
+    assert_int_equal(res->count, 1);
+
+    return res->msgs[0];
+}
+
+static struct ldb_message *lookup_user(TALLOC_CTX *mem_ctx,
+                                       struct sysdb_ts_test_ctx *test_ctx)
+{
+    struct ldb_result *res;
+    errno_t ret;
+
+    ret = sysdb_getpwnam(mem_ctx, test_ctx->tctx->dom, TEST_USER_NAME, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+
+    return res->msgs[0];
+}
+
+static void test_sysdb_ts_refresh(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_1);
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_2);
+
+    /* nothing but the timestamps changed, the cache is not written */
+    msg = get_cache_entry(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_LAST_UPDATE, 0),
+                     TEST_NOW_1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+
+    msg = lookup_user(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_LAST_UPDATE, 0),
+                     TEST_NOW_2);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0),
+                     TEST_NOW_2 + TEST_CACHE_TIMEOUT);
+
+    talloc_free(tmp_ctx);
+}
+
+static void store_user_upn(struct sysdb_ts_test_ctx *test_ctx, time_t now)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_UPN, TEST_USER_UPN);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, TEST_USER_GECOS,
+                           TEST_USER_HOMEDIR, TEST_USER_SHELL, NULL, attrs,
+                           NULL, TEST_CACHE_TIMEOUT, now);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(attrs);
+}
+
+static void test_sysdb_ts_upn(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    const char *attrs[] = { SYSDB_NAME, SYSDB_CACHE_EXPIRE, NULL };
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user_upn(test_ctx, TEST_NOW_1);
+    store_user_upn(test_ctx, TEST_NOW_2);
+
+    /* the lookup by UPN sees the timestamps of the refresh, like the
+     * lookups by name and ID */
+    ret = sysdb_search_user_by_upn(tmp_ctx, test_ctx->tctx->dom,
+                                   TEST_USER_UPN, attrs, &msg);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL),
+                        TEST_USER_NAME);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0),
+                     TEST_NOW_2 + TEST_CACHE_TIMEOUT);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sysdb_ts_changed(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_1);
+    store_user(test_ctx, "Another gecos", TEST_NOW_2);
+
+    msg = get_cache_entry(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_LAST_UPDATE, 0),
+                     TEST_NOW_2);
+    assert_string_equal(ldb_msg_find_attr_as_string(msg, SYSDB_GECOS, NULL),
+                        "Another gecos");
+
+    msg = lookup_user(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_LAST_UPDATE, 0),
+                     TEST_NOW_2);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sysdb_ts_expire(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    struct ldb_dn *dn;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_1);
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_2);
+
+    dn = sysdb_user_dn(tmp_ctx, test_ctx->tctx->dom, TEST_USER_NAME);
+    assert_non_null(dn);
+
+    /* expiring the entry in the cache outdates the timestamp cache */
+    ret = sysdb_mark_entry_as_expired_ldb_dn(test_ctx->tctx->dom, dn);
+    assert_int_equal(ret, EOK);
+
+    msg = lookup_user(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0),
+                     1);
+
+    /* the expired entry is written again on the next refresh */
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_2 + 1);
+
+    msg = get_cache_entry(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0),
+                     TEST_NOW_2 + 1 + TEST_CACHE_TIMEOUT);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sysdb_ts_invalidate_bulk(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    struct ldb_dn *base_dn;
+    size_t count;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_1);
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_2);
+
+    base_dn = sysdb_user_base_dn(tmp_ctx, test_ctx->tctx->dom);
+    assert_non_null(base_dn);
+
+    ret = sysdb_invalidate_cache_entries(test_ctx->tctx->dom, base_dn,
+                                         "("SYSDB_UC")", true, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 1);
+
+    msg = lookup_user(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0),
+                     1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_INITGR_EXPIRE, 0),
+                     1);
+
+    /* expired entries are not written again */
+    ret = sysdb_invalidate_cache_entries(test_ctx->tctx->dom, base_dn,
+                                         "("SYSDB_UC")", true, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 0);
+
+    ret = sysdb_invalidate_cache_entries(test_ctx->tctx->dom, base_dn,
+                                         "(&("SYSDB_UC")("SYSDB_NAME"=none))",
+                                         true, &count);
+    assert_int_equal(ret, ENOENT);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sysdb_ts_filter(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_result *res;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_1);
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_2);
+
+    /* the cache still has TEST_NOW_1 */
+    ret = sysdb_enumpwent_filter(tmp_ctx, test_ctx->tctx->dom, NULL,
+                                 "("SYSDB_LAST_UPDATE">=200)", &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_LAST_UPDATE, 0),
+                     TEST_NOW_2);
+
+    ret = sysdb_enumpwent_filter(tmp_ctx, test_ctx->tctx->dom, NULL,
+                                 "(!("SYSDB_LAST_UPDATE">=200))", &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 0);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sysdb_ts_delete(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_1);
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_2);
+
+    ret = sysdb_delete_user(test_ctx->tctx->dom, TEST_USER_NAME, 0);
+    assert_int_equal(ret, EOK);
+
+    /* a new entry does not get the timestamps of the deleted one */
+    store_user(test_ctx, TEST_USER_GECOS, TEST_NOW_1);
+
+    msg = lookup_user(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_LAST_UPDATE, 0),
+                     TEST_NOW_1);
+
+    talloc_free(tmp_ctx);
+}
+
+static void store_group(struct sysdb_ts_test_ctx *test_ctx,
+                        const char **ghosts,
+                        time_t now)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+    int i;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    for (i = 0; ghosts[i] != NULL; i++) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_GHOST, ghosts[i]);
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = sysdb_store_group(test_ctx->tctx->dom, TEST_GROUP_NAME,
+                            TEST_GROUP_GID, attrs, TEST_CACHE_TIMEOUT, now);
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+}
+
+static struct ldb_message *get_group_cache_entry(TALLOC_CTX *mem_ctx,
+                                    struct sysdb_ts_test_ctx *test_ctx)
+{
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    int lret;
+
+    dn = sysdb_group_dn(mem_ctx, test_ctx->tctx->dom, TEST_GROUP_NAME);
+    assert_non_null(dn);
+
+    lret = ldb_search(test_ctx->tctx->sysdb->ldb, mem_ctx, &res, dn,
+                      LDB_SCOPE_BASE, NULL, NULL);
+    assert_int_equal(lret, LDB_SUCCESS);
+    assert_int_equal(res->count, 1);
+
+    return res->msgs[0];
+}
+
+static struct ldb_message_element *get_group_ghosts(TALLOC_CTX *mem_ctx,
+                                    struct sysdb_ts_test_ctx *test_ctx)
+{
+    const char *attrs[] = { SYSDB_GHOST, NULL };
+    struct ldb_message *msg;
+    errno_t ret;
+
+    ret = sysdb_search_group_by_name(mem_ctx, test_ctx->tctx->dom,
+                                     TEST_GROUP_NAME, attrs, &msg);
+    assert_int_equal(ret, EOK);
+
+    return ldb_msg_find_element(msg, SYSDB_GHOST);
+}
+
+static void test_sysdb_ts_group_members(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    const char *ghosts[] = { "ghost1", "ghost2", NULL };
+    const char *reordered[] = { "ghost2", "ghost1", NULL };
+    const char *changed[] = { "ghost1", "ghost3", NULL };
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    struct ldb_message_element *el;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    store_group(test_ctx, ghosts, TEST_NOW_1);
+    /* the same members in another order are no change */
+    store_group(test_ctx, reordered, TEST_NOW_2);
+
+    msg = get_group_cache_entry(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_LAST_UPDATE, 0),
+                     TEST_NOW_1);
+    /* the ghost members are not stored in the group entry */
+    assert_null(ldb_msg_find_element(msg, SYSDB_GHOST));
+    el = get_group_ghosts(tmp_ctx, test_ctx);
+    assert_non_null(el);
+    assert_int_equal(el->num_values, 2);
+
+    /* nor does changing them rewrite it */
+    store_group(test_ctx, changed, TEST_NOW_2 + 1);
+
+    msg = get_group_cache_entry(tmp_ctx, test_ctx);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_LAST_UPDATE, 0),
+                     TEST_NOW_1);
+    el = get_group_ghosts(tmp_ctx, test_ctx);
+    assert_non_null(el);
+    assert_int_equal(el->num_values, 2);
+    assert_string_equal((const char *)el->values[0].data, "ghost1");
+    assert_string_equal((const char *)el->values[1].data, "ghost3");
+
+    talloc_free(tmp_ctx);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_refresh,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_upn,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_changed,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_expire,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_invalidate_bulk,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_filter,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_delete,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_group_members,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+    };
+
+    /* Set debug level to invalid value so we can deside if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old db to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -211,6 +211,97 @@ static void test_sysdb_store_override(void **state)
 
 }
 
+static void test_sysdb_store_override_merged(void **state)
+{
+    int ret;
+    struct ldb_message *msg;
+    struct sysdb_attrs *attrs;
+    struct ldb_dn *override_dn;
+    struct ldb_message_element *el;
+    const char *user_attrs[] = SYSDB_PW_ATTRS;
+
+    struct sysdb_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                         struct sysdb_test_ctx);
+
+    test_ctx->domain->mpg = false;
+    test_ctx->domain->view_name = TEST_VIEW_NAME;
+
+    ret = sysdb_store_user(test_ctx->domain, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, TEST_USER_GECOS,
+                           TEST_USER_HOMEDIR, TEST_USER_SHELL, NULL, NULL, NULL,
+                           0,0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_search_user_by_name(test_ctx, test_ctx->domain, TEST_USER_NAME,
+                                    user_attrs, &msg);
+    assert_int_equal(ret, EOK);
+    assert_non_null(msg);
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_OVERRIDE_ANCHOR_UUID,
+                                 TEST_ANCHOR_PREFIX TEST_USER_SID);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_attrs_add_uint32(attrs, SYSDB_UIDNUM, TEST_USER_UID + 1);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_GECOS, "OVERRIDEGECOS");
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_override(test_ctx->domain, TEST_VIEW_NAME,
+                               SYSDB_MEMBER_USER, attrs, msg->dn);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_search_user_by_name(test_ctx, test_ctx->domain, TEST_USER_NAME,
+                                    user_attrs, &msg);
+    assert_int_equal(ret, EOK);
+    assert_non_null(msg);
+    assert_string_equal(ldb_msg_find_attr_as_string(msg,
+                                                    SYSDB_MERGED_OVERRIDE_VIEW,
+                                                    NULL),
+                        TEST_VIEW_NAME);
+
+    /* Remove the override object to make sure the merged data is used */
+    override_dn = ldb_dn_new(test_ctx, test_ctx->domain->sysdb->ldb,
+                             ldb_msg_find_attr_as_string(msg, SYSDB_OVERRIDE_DN,
+                                                         NULL));
+    assert_non_null(override_dn);
+    ret = ldb_delete(test_ctx->domain->sysdb->ldb, override_dn);
+    assert_int_equal(ret, LDB_SUCCESS);
+
+    ret = sysdb_add_overrides_to_object(test_ctx->domain, msg, NULL, NULL);
+    assert_int_equal(ret, EOK);
+
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg,
+                                                 OVERRIDE_PREFIX SYSDB_UIDNUM,
+                                                 0),
+                     TEST_USER_UID + 1);
+    el = ldb_msg_find_element(msg, OVERRIDE_PREFIX SYSDB_GECOS);
+    assert_non_null(el);
+    assert_int_equal(el->num_values, 1);
+    assert_int_equal(ldb_val_string_cmp(&el->values[0], "OVERRIDEGECOS"), 0);
+    assert_null(ldb_msg_find_element(msg, OVERRIDE_PREFIX SYSDB_SHELL));
+
+    /* Data merged for a different view is ignored */
+    test_ctx->domain->view_name = "other view";
+    ret = sysdb_add_overrides_to_object(test_ctx->domain, msg, NULL, NULL);
+    assert_int_equal(ret, ENOENT);
+    assert_null(ldb_msg_find_element(msg, OVERRIDE_PREFIX SYSDB_GECOS));
+
+    ret = sysdb_invalidate_overrides(test_ctx->domain->sysdb);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_search_user_by_name(test_ctx, test_ctx->domain, TEST_USER_NAME,
+                                    user_attrs, &msg);
+    assert_int_equal(ret, EOK);
+    assert_non_null(msg);
+    assert_null(ldb_msg_find_element(msg, SYSDB_MERGED_OVERRIDE_VIEW));
+    assert_null(ldb_msg_find_element(msg, OVERRIDE_PREFIX SYSDB_UIDNUM));
+    assert_null(ldb_msg_find_element(msg, OVERRIDE_PREFIX SYSDB_GECOS));
+}
+
 void test_sysdb_add_overrides_to_object(void **state)
 {
     int ret;
@@ -654,6 +745,44 @@ static void test_sysdb_enumpwent_views(void **state)
     check_enumpwent(ret, res, true);
 }
 
+static void test_sysdb_enumpwent_cursor(void **state)
+{
+    int ret;
+    struct sysdb_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                        struct sysdb_test_ctx);
+    struct sysdb_enum_cursor *cursor;
+    struct ldb_result *res;
+
+    ret = sysdb_enumpwent_cursor(test_ctx, test_ctx->domain, &cursor);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(sysdb_enum_cursor_count(cursor), N_ELEMENTS(users)-1);
+
+    ret = sysdb_enum_cursor_read(test_ctx, cursor, 0, 2, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 2);
+    assert_user_attrs(res->msgs[0], "barney", true);
+    assert_user_attrs(res->msgs[1], "alice", true);
+
+    /* the page is cut at the end of the cursor */
+    ret = sysdb_enum_cursor_read(test_ctx, cursor, 2, 10, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_user_attrs(res->msgs[0], "bob", true);
+
+    /* users removed after the cursor was created are skipped */
+    ret = sysdb_delete_user(test_ctx->domain, "alice", 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_enum_cursor_read(test_ctx, cursor, 0, 3, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 2);
+    assert_user_attrs(res->msgs[0], "barney", true);
+    assert_user_attrs(res->msgs[1], "bob", true);
+
+    ret = sysdb_enum_cursor_read(test_ctx, cursor, 4, 1, &res);
+    assert_int_equal(ret, EINVAL);
+}
+
 static void test_sysdb_enumpwent_filter(void **state)
 {
     int ret;
@@ -981,6 +1110,8 @@ int main(int argc, const char *argv[])
     const struct CMUnitTest tests[] = {
         cmocka_unit_test_setup_teardown(test_sysdb_store_override,
                                         test_sysdb_setup, test_sysdb_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_store_override_merged,
+                                        test_sysdb_setup, test_sysdb_teardown),
         cmocka_unit_test_setup_teardown(test_sysdb_add_overrides_to_object,
                                         test_sysdb_setup, test_sysdb_teardown),
         cmocka_unit_test_setup_teardown(test_sysdb_add_overrides_to_object_local,
@@ -999,6 +1130,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_sysdb_enumpwent_views,
                                         test_enum_users_setup,
                                         test_enum_users_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_enumpwent_cursor,
+                                        test_enum_users_setup,
+                                        test_enum_users_teardown),
         cmocka_unit_test_setup_teardown(test_sysdb_enumpwent_filter,
                                         test_enum_users_setup,
                                         test_enum_users_teardown),
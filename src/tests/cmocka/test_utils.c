@@ -815,6 +815,65 @@ void test_sss_names_init(void **state)
     talloc_free(names_ctx);
 }
 
+void test_confdb_snapshot(void **state)
+{
+    struct name_init_test_ctx *test_ctx;
+    const char *val[2] = { NULL, NULL };
+    char *value;
+    int ret;
+
+    test_ctx = talloc_get_type(*state, struct name_init_test_ctx);
+
+    /* the first lookup loads the snapshot */
+    ret = confdb_get_string(test_ctx->confdb, test_ctx, "config/sssd",
+                            "full_name_format", NULL, &value);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(value, GLOBAL_FULL_NAME_FORMAT);
+    talloc_free(value);
+
+    ret = confdb_get_string(test_ctx->confdb, test_ctx, "config/sssd",
+                            "no_such_option", "default", &value);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(value, "default");
+    talloc_free(value);
+
+    ret = confdb_get_string(test_ctx->confdb, test_ctx, "config/no_such",
+                            "full_name_format", "default", &value);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(value, "default");
+    talloc_free(value);
+
+    /* writes are seen by the following lookups */
+    ret = confdb_set_string(test_ctx->confdb, "config/sssd",
+                            "full_name_format", "%1$s");
+    assert_int_equal(ret, EOK);
+
+    ret = confdb_get_string(test_ctx->confdb, test_ctx, "CONFIG/SSSD",
+                            "full_name_format", NULL, &value);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(value, "%1$s");
+    talloc_free(value);
+
+    val[0] = "added";
+    ret = confdb_add_param(test_ctx->confdb, true,
+                           "config/new_section", "new_option", val);
+    assert_int_equal(ret, EOK);
+
+    ret = confdb_get_string(test_ctx->confdb, test_ctx, "config/new_section",
+                            "new_option", NULL, &value);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(value, "added");
+    talloc_free(value);
+
+    confdb_invalidate_snapshot(test_ctx->confdb);
+
+    ret = confdb_get_string(test_ctx->confdb, test_ctx, "config/new_section",
+                            "new_option", NULL, &value);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(value, "added");
+    talloc_free(value);
+}
+
 void test_well_known_sid_to_name(void **state)
 {
     int ret;
@@ -1523,6 +1582,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_sss_names_init,
                                         confdb_test_setup,
                                         confdb_test_teardown),
+        cmocka_unit_test_setup_teardown(test_confdb_snapshot,
+                                        confdb_test_setup,
+                                        confdb_test_teardown),
 
         cmocka_unit_test_setup_teardown(test_get_next_domain,
                                         setup_dom_tree, teardown_dom_tree),
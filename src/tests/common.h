@@ -52,6 +52,8 @@ bool _check_leaks_pop(TALLOC_CTX *ctx, const char *location)
 bool leak_check_setup(void) SSS_ATTRIBUTE_WARN_UNUSED_RESULT;
 bool leak_check_teardown(void) SSS_ATTRIBUTE_WARN_UNUSED_RESULT;
 const char *check_leaks_err_msg(void);
+/* Write the size of ctx and of each of its direct children to out */
+void check_leaks_report_sizes(TALLOC_CTX *ctx, FILE *out);
 
 void tests_set_cwd(void);
 
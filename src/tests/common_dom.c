@@ -299,6 +299,7 @@ void test_multidom_suite_cleanup(const char *tests_path,
     TALLOC_CTX *tmp_ctx = NULL;
     char *cdb_path = NULL;
     char *sysdb_path = NULL;
+    char *ts_path = NULL;
     errno_t ret;
     int i;
 
@@ -348,6 +349,29 @@ void test_multidom_suite_cleanup(const char *tests_path,
             }
 
             talloc_zfree(sysdb_path);
+
+            if (strcmp(domains[i], LOCAL_SYSDB_FILE) == 0) {
+                continue;
+            }
+
+            ts_path = talloc_asprintf(tmp_ctx, "%s/"CACHE_TIMESTAMPS_FILE,
+                                      tests_path, domains[i]);
+            if (ts_path == NULL) {
+                DEBUG(SSSDBG_CRIT_FAILURE,
+                      "Could not construct timestamp cache path\n");
+                goto done;
+            }
+
+            errno = 0;
+            ret = unlink(ts_path);
+            if (ret != 0 && errno != ENOENT) {
+                ret = errno;
+                DEBUG(SSSDBG_CRIT_FAILURE, "Could not delete the test "
+                      "timestamp cache file [%d]: (%s)\n",
+                      ret, sss_strerror(ret));
+            }
+
+            talloc_zfree(ts_path);
         }
     }
 
@@ -651,6 +651,174 @@ START_TEST(test_debug_is_set_false)
 }
 END_TEST
 
+static char *test_helper_debug_read(TALLOC_CTX *mem_ctx, FILE *file)
+{
+    char *content;
+    long filesize;
+    size_t fsize;
+
+    if (fseek(file, 0, SEEK_END) == -1) {
+        return NULL;
+    }
+
+    filesize = ftell(file);
+    if (filesize == -1) {
+        return NULL;
+    }
+    rewind(file);
+
+    content = talloc_array(mem_ctx, char, filesize + 1);
+    if (content == NULL) {
+        return NULL;
+    }
+
+    fsize = fread(content, sizeof(char), filesize, file);
+    content[fsize] = '\0';
+    return content;
+}
+
+START_TEST(test_debug_buffers)
+{
+    TALLOC_CTX *ctx;
+    char filename[24] = {'\0'};
+    char *content;
+    char *begin;
+    char *hidden;
+    char *end;
+    char *failure;
+    mode_t old_umask;
+    FILE *file;
+    int fd;
+    errno_t ret;
+
+    ctx = talloc_new(NULL);
+    fail_if(ctx == NULL);
+
+    strncpy(filename, "sssd_debug_tests.XXXXXX", 24);
+    old_umask = umask(SSS_DFL_UMASK);
+    fd = mkstemp(filename);
+    umask(old_umask);
+    fail_if(fd == -1, "mkstemp failed [%d]", errno);
+
+    file = fdopen(fd, "r");
+    fail_if(file == NULL, "fdopen failed [%d]", errno);
+
+    ret = set_debug_file_from_fd(fd);
+    fail_unless(ret == EOK, "set_debug_file_from_fd failed [%d]", ret);
+
+    debug_timestamps = 0;
+    debug_microseconds = 0;
+    debug_level = SSSDBG_FATAL_FAILURE | SSSDBG_CRIT_FAILURE
+                  | SSSDBG_OP_FAILURE;
+
+    /* keep the levels up to 6 in memory */
+    ret = debug_init_buffers(4096, 6);
+    fail_unless(ret == EOK, "debug_init_buffers failed [%d]", ret);
+    fail_unless(DEBUG_IS_WANTED(SSSDBG_TRACE_FUNC));
+    fail_if(DEBUG_IS_WANTED(SSSDBG_TRACE_ALL));
+
+    DEBUG(SSSDBG_TRACE_FUNC, "hidden message\n");
+    DEBUG(SSSDBG_TRACE_ALL, "dropped message\n");
+    content = test_helper_debug_read(ctx, file);
+    fail_if(content == NULL);
+    fail_unless(content[0] == '\0', "Message written too early: %s", content);
+
+    /* the backtrace is written right away, the failure is buffered */
+    DEBUG(SSSDBG_OP_FAILURE, "failure message\n");
+    content = test_helper_debug_read(ctx, file);
+    fail_if(content == NULL);
+    begin = strstr(content, "begin of the debug backtrace");
+    hidden = strstr(content, "hidden message");
+    end = strstr(content, "end of the debug backtrace");
+    fail_unless(begin != NULL && hidden > begin && end > hidden,
+                "Unexpected backtrace: %s", content);
+    fail_unless(strstr(content, "dropped message") == NULL);
+    fail_unless(strstr(content, "failure message") == NULL);
+
+    debug_flush();
+    content = test_helper_debug_read(ctx, file);
+    fail_if(content == NULL);
+    failure = strstr(content, "failure message");
+    fail_unless(failure > end, "Buffered message missing: %s", content);
+
+    /* the backtrace was emptied */
+    DEBUG(SSSDBG_OP_FAILURE, "second failure\n");
+    debug_flush();
+    content = test_helper_debug_read(ctx, file);
+    fail_if(content == NULL);
+    begin = strstr(content, "begin of the debug backtrace");
+    fail_unless(strstr(begin + 1, "begin of the debug backtrace") == NULL,
+                "Backtrace written twice: %s", content);
+
+    ret = debug_init_buffers(0, 0);
+    fail_unless(ret == EOK);
+    fail_unless(debug_backtrace_level == 0);
+
+    fclose(file);
+    remove(filename);
+    talloc_free(ctx);
+}
+END_TEST
+
+START_TEST(test_talloc_report)
+{
+    TALLOC_CTX *ctx;
+    TALLOC_CTX *big;
+    char filename[24] = {'\0'};
+    char *content;
+    char *root;
+    char *line;
+    mode_t old_umask;
+    FILE *file;
+    int fd;
+    errno_t ret;
+
+    ctx = talloc_named_const(NULL, 0, "report_root");
+    fail_if(ctx == NULL);
+
+    big = talloc_named_const(ctx, 0, "big_ctx");
+    fail_if(big == NULL);
+    fail_if(talloc_size(big, 8192) == NULL);
+    fail_if(talloc_size(big, 8192) == NULL);
+    fail_if(talloc_named_const(big, 100, "small_ctx") == NULL);
+
+    strncpy(filename, "sssd_debug_tests.XXXXXX", 24);
+    old_umask = umask(SSS_DFL_UMASK);
+    fd = mkstemp(filename);
+    umask(old_umask);
+    fail_if(fd == -1, "mkstemp failed [%d]", errno);
+
+    file = fdopen(fd, "r");
+    fail_if(file == NULL, "fdopen failed [%d]", errno);
+
+    ret = set_debug_file_from_fd(fd);
+    fail_unless(ret == EOK, "set_debug_file_from_fd failed [%d]", ret);
+
+    debug_timestamps = 0;
+    debug_microseconds = 0;
+    debug_level = SSSDBG_FATAL_FAILURE;
+
+    /* the report is taken before the file content is read into ctx */
+    sss_talloc_report(ctx, SSS_MEM_REPORT_DEPTH, 16000);
+
+    content = test_helper_debug_read(ctx, file);
+    fail_if(content == NULL);
+
+    root = strstr(content, "report_root: 16484 bytes in 5 blocks");
+    fail_unless(root != NULL, "Root context missing: %s", content);
+    line = strstr(content, "  big_ctx: 16484 bytes in 4 blocks");
+    fail_unless(line > root, "Child context missing: %s", content);
+    fail_unless(strstr(content, "small_ctx") == NULL,
+                "Small context reported: %s", content);
+    fail_unless(strstr(content, "3 smaller contexts not shown") != NULL,
+                "Unexpected summary: %s", content);
+
+    fclose(file);
+    remove(filename);
+    talloc_free(ctx);
+}
+END_TEST
+
 Suite *debug_suite(void)
 {
     Suite *s = suite_create("debug");
@@ -667,6 +835,8 @@ Suite *debug_suite(void)
     tcase_add_test(tc_debug, test_debug_is_notset_timestamp_microseconds);
     tcase_add_test(tc_debug, test_debug_is_set_true);
     tcase_add_test(tc_debug, test_debug_is_set_false);
+    tcase_add_test(tc_debug, test_debug_buffers);
+    tcase_add_test(tc_debug, test_talloc_report);
     tcase_set_timeout(tc_debug, 60);
 
     suite_add_tcase(s, tc_debug);
@@ -268,6 +268,157 @@ START_TEST(test_fo_resolve_service)
 }
 END_TEST
 
+START_TEST(test_fo_sort_servers_by_rtt)
+{
+    struct test_ctx *ctx;
+    uint32_t rtt;
+    int ret;
+    struct fo_server_info servers[] = {
+        { discard_const("dc1"), 389, 0 },
+        { discard_const("dc2"), 389, 0 },
+        { discard_const("dc3"), 389, 0 },
+        { discard_const("dc4"), 389, 0 },
+        { discard_const("dc5"), 389, 10 },
+        { discard_const("dc6"), 389, 10 },
+    };
+
+    ctx = setup_test();
+
+    ret = fo_get_server_rtt(ctx->fo_ctx, "dc1", &rtt);
+    fail_unless(ret == ENOENT);
+
+    /* nothing measured, the order is kept */
+    fo_sort_servers_by_rtt(ctx->fo_ctx, servers, 6);
+    fail_unless(strcmp(servers[0].host, "dc1") == 0);
+    fail_unless(strcmp(servers[5].host, "dc6") == 0);
+
+    ret = fo_record_server_rtt(ctx->fo_ctx, "dc1", 8000);
+    fail_unless(ret == EOK);
+    ret = fo_record_server_rtt(ctx->fo_ctx, "DC3", 1000);
+    fail_unless(ret == EOK);
+    ret = fo_record_server_rtt(ctx->fo_ctx, "dc6", 500);
+    fail_unless(ret == EOK);
+
+    /* the samples are smoothed */
+    ret = fo_record_server_rtt(ctx->fo_ctx, "dc1", 16000);
+    fail_unless(ret == EOK);
+    ret = fo_get_server_rtt(ctx->fo_ctx, "DC1", &rtt);
+    fail_unless(ret == EOK);
+    fail_unless(rtt == 9000, "Unexpected smoothed RTT %u", rtt);
+
+    /* the priorities are kept, the servers which were not measured go
+     * after the measured ones */
+    fo_sort_servers_by_rtt(ctx->fo_ctx, servers, 6);
+    fail_unless(strcmp(servers[0].host, "dc3") == 0);
+    fail_unless(strcmp(servers[1].host, "dc1") == 0);
+    fail_unless(strcmp(servers[2].host, "dc2") == 0);
+    fail_unless(strcmp(servers[3].host, "dc4") == 0);
+    fail_unless(strcmp(servers[4].host, "dc6") == 0);
+    fail_unless(strcmp(servers[5].host, "dc5") == 0);
+
+    talloc_free(ctx);
+}
+END_TEST
+
+START_TEST(test_fo_prefer_faster_server)
+{
+    struct test_ctx *ctx;
+    struct fo_service *service;
+    struct fo_rtt_histogram histogram;
+    int ret;
+    int i;
+
+    ctx = setup_test();
+    fail_if(ctx == NULL);
+
+    fail_if(fo_new_service(ctx->fo_ctx, "kerberos", NULL, &service) != EOK);
+    fail_if(fo_add_server(service, "localhost", 88, NULL, true) != EOK);
+    fail_if(fo_add_server(service, "127.0.0.1", 750, NULL, true) != EOK);
+
+    get_request(ctx, service, EOK, 88, PORT_WORKING, -1);
+
+    /* a slow server is kept while nothing faster is known */
+    for (i = 0; i < 4; i++) {
+        ret = fo_record_server_rtt(ctx->fo_ctx, "localhost", 400000);
+        fail_unless(ret == EOK);
+    }
+    fail_if(fo_prefer_faster_server(service));
+
+    ret = fo_record_server_rtt(ctx->fo_ctx, "127.0.0.1", 150000);
+    fail_unless(ret == EOK);
+    fail_if(fo_prefer_faster_server(service));
+
+    ret = fo_record_server_rtt(ctx->fo_ctx, "127.0.0.1", 6000);
+    fail_unless(ret == EOK);
+    fail_unless(fo_prefer_faster_server(service));
+    get_request(ctx, service, EOK, 750, -1, -1);
+
+    ret = fo_get_server_rtt_histogram(ctx->fo_ctx, "localhost", &histogram);
+    fail_unless(ret == EOK);
+    fail_unless(histogram.count == 4);
+    fail_unless(histogram.srtt == 400000);
+    fail_unless(fo_rtt_bucket_limit(5) == 500000);
+    fail_unless(histogram.buckets[5] == 4);
+
+    ret = fo_get_server_rtt_histogram(ctx->fo_ctx, "127.0.0.1", &histogram);
+    fail_unless(ret == EOK);
+    fail_unless(histogram.count == 2);
+    fail_unless(histogram.buckets[3] == 1);
+    fail_unless(histogram.buckets[5] == 1);
+
+    ret = fo_get_server_rtt_histogram(ctx->fo_ctx, "kdc", &histogram);
+    fail_unless(ret == ENOENT);
+
+    talloc_free(ctx);
+}
+END_TEST
+
+START_TEST(test_fo_prefer_healthy_server)
+{
+    struct test_ctx *ctx;
+    struct fo_service *service;
+    struct fo_server *server;
+    uint32_t rtt;
+    int ret;
+    int i;
+
+    ctx = setup_test();
+    fail_if(ctx == NULL);
+
+    fail_if(fo_new_service(ctx->fo_ctx, "ldap", NULL, &service) != EOK);
+    fail_if(fo_add_server(service, "localhost", 389, NULL, true) != EOK);
+    fail_if(fo_add_server(service, "127.0.0.1", 636, NULL, true) != EOK);
+
+    get_request(ctx, service, EOK, 389, PORT_WORKING, -1);
+    server = fo_get_active_server(service);
+    fail_if(server == NULL);
+
+    for (i = 0; i < 4; i++) {
+        ret = fo_record_server_rtt(ctx->fo_ctx, "localhost", 150000);
+        fail_unless(ret == EOK);
+        ret = fo_record_server_rtt(ctx->fo_ctx, "127.0.0.1", 150000);
+        fail_unless(ret == EOK);
+    }
+    fail_if(fo_prefer_faster_server(service));
+
+    /* the failures do not change the round trip time, but a server which
+     * fails often counts as slower */
+    for (i = 0; i < 8; i++) {
+        fo_set_port_status(server, PORT_NOT_WORKING);
+    }
+    fo_set_port_status(server, PORT_WORKING);
+
+    ret = fo_get_server_rtt(ctx->fo_ctx, "localhost", &rtt);
+    fail_unless(ret == EOK);
+    fail_unless(rtt == 150000);
+
+    fail_unless(fo_prefer_faster_server(service));
+    get_request(ctx, service, EOK, 636, -1, -1);
+
+    talloc_free(ctx);
+}
+END_TEST
+
 Suite *
 create_suite(void)
 {
@@ -279,6 +430,9 @@ create_suite(void)
     /* Do some testing */
     tcase_add_test(tc, test_fo_new_service);
     tcase_add_test(tc, test_fo_resolve_service);
+    tcase_add_test(tc, test_fo_sort_servers_by_rtt);
+    tcase_add_test(tc, test_fo_prefer_faster_server);
+    tcase_add_test(tc, test_fo_prefer_healthy_server);
     if (use_net_test) {
     }
     /* Add all test cases to the test suite */
@@ -261,6 +261,79 @@ class DSOpenLDAP(DS):
             ])
         ldap_conn.unbind_s()
 
+    def _bind_config(self):
+        """Connect to the configuration of the instance as its admin."""
+        ldapi_socket = self.run_dir + "/ldapi"
+        ldapi_url = "ldapi://" + urllib.quote(ldapi_socket, "")
+        ldap_conn = ldap.initialize(ldapi_url)
+        ldap_conn.simple_bind_s(self.admin_rdn + ",cn=config", self.admin_pw)
+        return ldap_conn
+
+    def set_size_limit(self, limit):
+        """
+            Set the maximum number of entries returned by a search.
+
+            Arguments:
+            limit       The limit, "unlimited" for none.
+        """
+        ldap_conn = self._bind_config()
+        try:
+            ldap_conn.modify_s("olcDatabase={-1}frontend,cn=config",
+                               [(ldap.MOD_REPLACE, "olcSizeLimit",
+                                 str(limit))])
+        finally:
+            ldap_conn.unbind_s()
+
+    def enable_monitor(self):
+        """
+            Enable the monitor backend, which counts the operations
+            performed by the server.
+
+            Returns True if the backend is available, False otherwise.
+        """
+        ldap_conn = self._bind_config()
+        try:
+            try:
+                ldap_conn.modify_s("cn=module{0},cn=config",
+                                   [(ldap.MOD_ADD, "olcModuleLoad",
+                                     "back_monitor")])
+            except ldap.LDAPError:
+                # Built into slapd or already loaded
+                pass
+            try:
+                ldap_conn.add_s("olcDatabase=monitor,cn=config", [
+                    ("objectClass", ["olcDatabaseConfig"]),
+                    ("olcDatabase", ["monitor"]),
+                    ("olcAccess", ["to * by * read"]),
+                ])
+            except ldap.ALREADY_EXISTS:
+                pass
+            except ldap.LDAPError:
+                return False
+        finally:
+            ldap_conn.unbind_s()
+        return True
+
+    def get_op_counts(self):
+        """
+            Get the number of completed operations of each type, e.g.
+            "Search" or "Bind", as counted by the monitor backend enabled
+            with enable_monitor().
+        """
+        ldap_conn = ldap.initialize(self.ldap_url)
+        try:
+            ldap_conn.simple_bind_s(self.admin_dn, self.admin_pw)
+            entries = ldap_conn.search_s("cn=Operations,cn=Monitor",
+                                         ldap.SCOPE_ONELEVEL,
+                                         attrlist=["cn",
+                                                   "monitorOpCompleted"])
+        finally:
+            ldap_conn.unbind_s()
+        counts = {}
+        for dn, attrs in entries:
+            counts[attrs["cn"][0]] = int(attrs["monitorOpCompleted"][0])
+        return counts
+
     def teardown(self):
         """Teardown the instance."""
         # Wait for slapd to stop
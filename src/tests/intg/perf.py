@@ -0,0 +1,101 @@
+#
+# Helpers of the performance scenarios
+#
+# Copyright (c) 2016 Red Hat, Inc.
+#
+# This is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by
+# the Free Software Foundation; version 2 only
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Recording of the metrics of the performance scenarios.
+
+Most of the scenarios are slow and only run if SSSD_PERF is set in the
+environment. The metrics of all of them are written as JSON to the file
+named by SSSD_PERF_RESULTS. If SSSD_PERF is set and SSSD_PERF_BASELINE names
+the results of an earlier run, every metric must stay within
+SSSD_PERF_TOLERANCE (a fraction, 0.2 by default) of it.
+"""
+import os
+import json
+
+PERF_ENABLED = "SSSD_PERF" in os.environ
+
+RESULTS = {}
+
+
+def load_baseline():
+    path = os.environ.get("SSSD_PERF_BASELINE")
+    if path is None:
+        return {}
+    with open(path) as f:
+        return json.load(f)
+
+
+BASELINE = load_baseline() if PERF_ENABLED else {}
+TOLERANCE = float(os.environ.get("SSSD_PERF_TOLERANCE", 0.2))
+
+
+def record(name, value):
+    """Record a metric, lower is better, and check it against the baseline"""
+    RESULTS[name] = value
+    path = os.environ.get("SSSD_PERF_RESULTS")
+    if path is not None:
+        with open(path, "w") as f:
+            json.dump(RESULTS, f, indent=4, sort_keys=True)
+    print("%s: %s" % (name, value))
+
+    if name in BASELINE:
+        limit = BASELINE[name] * (1 + TOLERANCE)
+        assert value <= limit, \
+            "%s regressed: %s, baseline %s" % (name, value, BASELINE[name])
+
+
+def process_pid(binary, arg=None):
+    """Find the PID of the running binary, with arg on its command line"""
+    for pid in os.listdir("/proc"):
+        if not pid.isdigit():
+            continue
+        try:
+            with open("/proc/%s/cmdline" % pid) as f:
+                cmdline = f.read().split("\0")
+        except IOError:
+            continue
+        if os.path.basename(cmdline[0]) == binary and \
+           (arg is None or arg in cmdline):
+            return int(pid)
+    raise Exception("%s is not running" % binary)
+
+
+def status_kb(pid, field):
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith(field + ":"):
+                return int(line.split()[1])
+    return 0
+
+
+def rss_kb(pid):
+    return status_kb(pid, "VmRSS")
+
+
+def peak_rss_kb(pid):
+    """The largest RSS of the process since it started"""
+    return status_kb(pid, "VmHWM")
+
+
+def cpu_sec(pid):
+    with open("/proc/%d/stat" % pid) as f:
+        # the command may contain spaces, the fields follow the ")"
+        fields = f.read().rsplit(")", 1)[1].split()
+    # utime and stime, the 14th and 15th fields
+    return (int(fields[11]) + int(fields[12])) / \
+        float(os.sysconf("SC_CLK_TCK"))
@@ -0,0 +1,277 @@
+#
+# Enumeration scalability scenario
+#
+# Copyright (c) 2016 Red Hat, Inc.
+#
+# This is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by
+# the Free Software Foundation; version 2 only
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Time and memory of the enumeration of growing directories.
+
+The directory grows to each of the sizes in turn, SSSD starts with an
+empty cache and enumerates it. The scenario measures the time until all
+the users and groups are enumerated and the peak RSS of the backend, which
+covers the enumeration requests and saving the entries to the cache. It
+then measures the time and the peak RSS of the NSS responder while it
+returns all the users and all the groups through setpwent()/setgrent().
+
+From the results of the smallest and the largest directory it computes
+how much the time and the peak RSS grow per thousand users, which shows
+whether the enumeration scales linearly.
+
+The scenario only runs if SSSD_PERF is set in the environment:
+
+    SSSD_PERF=1 make intgcheck
+
+SSSD_PERF_ENUM_SIZES is a comma separated list of the numbers of users,
+"1000,10000,50000" by default. Every size adds a tenth as many groups.
+See perf.py for the results and the baseline.
+"""
+import os
+import stat
+import signal
+import subprocess
+import time
+import pwd
+import grp
+import pytest
+import config
+import ds_openldap
+import ldap_ent
+from perf import PERF_ENABLED, RESULTS, record, process_pid, peak_rss_kb
+from util import unindent
+
+LDAP_BASE_DN = "dc=example,dc=com"
+
+SIZES = sorted(set(int(s) for s in
+                   os.environ.get("SSSD_PERF_ENUM_SIZES",
+                                  "1000,10000,50000").split(",")))
+
+# Users per group and groups per user
+GROUP_SHARE = 10
+USER_GROUPS = 2
+
+UID_BASE = 300000
+GID_BASE = 400000
+
+LOAD_BATCH = 1000
+ENUM_TIMEOUT = 3600
+
+pytestmark = pytest.mark.skipif(not PERF_ENABLED,
+                                reason="SSSD_PERF is not set")
+
+
+class Directory(object):
+    """The directory, which only grows"""
+
+    def __init__(self, ldap_conn):
+        self.ldap_conn = ldap_conn
+        self.users = 0
+        self.groups = 0
+
+    def grow(self, size):
+        """Add users and groups up to size users, the new users are members
+        of the new groups"""
+        ent_list = ldap_ent.List(self.ldap_conn.ds_inst.base_dn)
+        first_group = self.groups
+        # every step adds at least one group for its users
+        groups = max(size // GROUP_SHARE, first_group + 1)
+        members = dict((i, []) for i in range(first_group, groups))
+
+        for i in range(self.users, size):
+            name = "enum_user%d" % i
+            ent_list.add_user(name, UID_BASE + i,
+                              GID_BASE + first_group +
+                              i % (groups - first_group))
+            for j in range(USER_GROUPS):
+                group = first_group + (i + j) % (groups - first_group)
+                members[group].append(name)
+
+        for i in range(first_group, groups):
+            ent_list.add_group_bis("enum_group%d" % i, GID_BASE + i,
+                                   members[i])
+
+        start = time.time()
+        for i in range(0, len(ent_list), LOAD_BATCH):
+            msgids = [self.ldap_conn.add(dn, attrs)
+                      for dn, attrs in ent_list[i:i + LOAD_BATCH]]
+            for msgid in msgids:
+                self.ldap_conn.result(msgid)
+        print("Added %d entries in %.1f s" % (len(ent_list),
+                                              time.time() - start))
+
+        self.users = size
+        self.groups = groups
+
+
+@pytest.fixture(scope="module")
+def ds_inst(request):
+    """LDAP server instance fixture"""
+    ds_inst = ds_openldap.DSOpenLDAP(
+        config.PREFIX, 10389, LDAP_BASE_DN,
+        "cn=admin", "Secret123")
+    try:
+        ds_inst.setup()
+        ds_inst.set_size_limit("unlimited")
+    except:
+        ds_inst.teardown()
+        raise
+    request.addfinalizer(lambda: ds_inst.teardown())
+    return ds_inst
+
+
+@pytest.fixture(scope="module")
+def ldap_conn(request, ds_inst):
+    """LDAP server connection fixture"""
+    ldap_conn = ds_inst.bind()
+    ldap_conn.ds_inst = ds_inst
+    request.addfinalizer(lambda: ldap_conn.unbind_s())
+    return ldap_conn
+
+
+@pytest.fixture(scope="module")
+def directory(ldap_conn):
+    return Directory(ldap_conn)
+
+
+def format_conf(ldap_conn):
+    """Format the SSSD configuration of the measurements"""
+    return unindent("""\
+        [sssd]
+        domains             = LDAP
+        services            = nss
+
+        [nss]
+        memcache_timeout    = 0
+        enum_cache_timeout  = 1
+
+        [domain/LDAP]
+        ldap_auth_disable_tls_never_use_in_production = true
+        enumerate           = true
+        ldap_schema         = rfc2307bis
+        ldap_group_object_class = groupOfNames
+        id_provider         = ldap
+        ldap_uri            = {ldap_conn.ds_inst.ldap_url}
+        ldap_search_base    = {ldap_conn.ds_inst.base_dn}
+        ldap_enumeration_refresh_timeout = {ENUM_TIMEOUT}
+    """).format(ENUM_TIMEOUT=ENUM_TIMEOUT, **locals())
+
+
+def create_conf_fixture(request, contents):
+    """Generate sssd.conf and add teardown for removing it"""
+    conf = open(config.CONF_PATH, "w")
+    conf.write(contents)
+    conf.close()
+    os.chmod(config.CONF_PATH, stat.S_IRUSR | stat.S_IWUSR)
+    request.addfinalizer(lambda: os.unlink(config.CONF_PATH))
+
+
+def stop_sssd():
+    pid_file = open(config.PIDFILE_PATH, "r")
+    pid = int(pid_file.read())
+    os.kill(pid, signal.SIGTERM)
+    while True:
+        try:
+            os.kill(pid, signal.SIGCONT)
+        except:
+            break
+        time.sleep(1)
+
+
+def create_sssd_fixture(request):
+    """Start sssd and add teardown for stopping it and removing state"""
+    if subprocess.call(["sssd", "-D", "-f"]) != 0:
+        raise Exception("sssd start failed")
+
+    def teardown():
+        try:
+            stop_sssd()
+        except:
+            pass
+        for path in os.listdir(config.DB_PATH):
+            os.unlink(config.DB_PATH + "/" + path)
+        for path in os.listdir(config.MCACHE_PATH):
+            os.unlink(config.MCACHE_PATH + "/" + path)
+    request.addfinalizer(teardown)
+
+
+def count_users():
+    return len([p for p in pwd.getpwall()
+                if p.pw_name.startswith("enum_user")])
+
+
+def count_groups():
+    return len([g for g in grp.getgrall()
+                if g.gr_name.startswith("enum_group")])
+
+
+def wait_for_enumeration(users, groups):
+    """Wait until all the users and groups are enumerated"""
+    while count_users() != users or count_groups() != groups:
+        time.sleep(1)
+
+
+@pytest.fixture
+def enum(request, ldap_conn, directory, size):
+    """Grow the directory and start enumerating it, returns the time of
+    the start"""
+    directory.grow(size)
+    create_conf_fixture(request, format_conf(ldap_conn))
+    start = time.time()
+    create_sssd_fixture(request)
+    return start
+
+
+@pytest.mark.parametrize("size", SIZES)
+def test_enumeration(enum, directory, size):
+    """Time and peak RSS of the enumeration and of setpwent/setgrent"""
+    groups = directory.groups
+
+    wait_for_enumeration(size, groups)
+    record("enum_%d_sec" % size, time.time() - enum)
+    record("enum_%d_be_peak_rss_kb" % size,
+           peak_rss_kb(process_pid("sssd_be", "LDAP")))
+
+    # the responder enumerates from the cache again
+    time.sleep(2)
+    start = time.time()
+    assert count_users() == size
+    record("setpwent_%d_sec" % size, time.time() - start)
+
+    start = time.time()
+    assert count_groups() == groups
+    record("setgrent_%d_sec" % size, time.time() - start)
+
+    record("setent_%d_nss_peak_rss_kb" % size,
+           peak_rss_kb(process_pid("sssd_nss")))
+
+
+def test_scaling():
+    """Growth per thousand users between the smallest and the largest
+    directory"""
+    if len(SIZES) < 2:
+        pytest.skip("needs at least two sizes")
+
+    small = SIZES[0]
+    large = SIZES[-1]
+    for metric, name in (("enum_%d_sec", "enum_sec"),
+                         ("enum_%d_be_peak_rss_kb", "enum_be_peak_rss_kb"),
+                         ("setpwent_%d_sec", "setpwent_sec"),
+                         ("setent_%d_nss_peak_rss_kb",
+                          "setent_nss_peak_rss_kb")):
+        if metric % small not in RESULTS or metric % large not in RESULTS:
+            pytest.skip("the measurements failed")
+
+        growth = (RESULTS[metric % large] - RESULTS[metric % small]) * \
+            1000.0 / (large - small)
+        record(name + "_per_1k_users", growth)
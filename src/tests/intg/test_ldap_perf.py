@@ -0,0 +1,309 @@
+#
+# LDAP provider performance scenario
+#
+# Copyright (c) 2016 Red Hat, Inc.
+#
+# This is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by
+# the Free Software Foundation; version 2 only
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Performance of the LDAP provider with a large directory.
+
+The directory is generated from a fixed seed, so every run loads the same
+users and nested RFC2307bis groups. The scenario measures the latency of
+cold initgroups, the time of the first enumeration, the cost of one
+enumeration refresh cycle, the RSS of the backend and the number of LDAP
+operations it performs.
+
+The scenario is slow and only runs if SSSD_PERF is set in the environment:
+
+    SSSD_PERF=1 make intgcheck
+
+SSSD_PERF_USERS and SSSD_PERF_GROUPS change the size of the directory.
+See perf.py for the results and the baseline.
+"""
+import os
+import stat
+import random
+import signal
+import subprocess
+import time
+import pwd
+import grp
+import pytest
+import config
+import ds_openldap
+import ldap_ent
+import sssd_id
+from perf import PERF_ENABLED, record, process_pid, rss_kb, cpu_sec
+from util import unindent
+
+LDAP_BASE_DN = "dc=example,dc=com"
+
+NUM_USERS = int(os.environ.get("SSSD_PERF_USERS", 100000))
+NUM_GROUPS = int(os.environ.get("SSSD_PERF_GROUPS", 20000))
+SEED = 2016
+
+# Every user is a direct member of this many leaf groups
+USER_GROUPS = 5
+# Share of the groups which only contain users, the rest contain groups
+LEAF_SHARE = 0.7
+# Share of the non-leaf groups which contain other non-leaf groups
+TOP_SHARE = 0.2
+# Groups nested in each non-leaf group
+NESTED_GROUPS = 4
+
+UID_BASE = 100000
+GID_BASE = 200000
+
+INITGR_SAMPLES = 200
+REFRESH_TIMEOUT = 30
+LOAD_BATCH = 1000
+
+pytestmark = pytest.mark.skipif(not PERF_ENABLED,
+                                reason="SSSD_PERF is not set")
+
+
+def generate_directory(base_dn):
+    """Generate the users and groups, the same ones on every run"""
+    rnd = random.Random(SEED)
+    ent_list = ldap_ent.List(base_dn)
+
+    num_leaves = int(NUM_GROUPS * LEAF_SHARE)
+    num_top = int((NUM_GROUPS - num_leaves) * TOP_SHARE)
+    leaves = ["perf_group%d" % i for i in range(num_leaves)]
+    middle = ["perf_group%d" % i
+              for i in range(num_leaves, NUM_GROUPS - num_top)]
+    top = ["perf_group%d" % i
+           for i in range(NUM_GROUPS - num_top, NUM_GROUPS)]
+
+    members = dict((name, []) for name in leaves)
+    users = []
+    for i in range(NUM_USERS):
+        name = "perf_user%d" % i
+        gid = GID_BASE + rnd.randrange(num_leaves)
+        ent_list.add_user(name, UID_BASE + i, gid)
+        users.append((name, gid))
+        for group in rnd.sample(leaves, min(USER_GROUPS, num_leaves)):
+            members[group].append(name)
+
+    for i, name in enumerate(leaves):
+        ent_list.add_group_bis(name, GID_BASE + i, members[name])
+
+    for i, name in enumerate(middle):
+        ent_list.add_group_bis(name, GID_BASE + num_leaves + i, [],
+                               rnd.sample(leaves,
+                                          min(NESTED_GROUPS, num_leaves)))
+
+    # the top groups only contain groups which are already in the directory
+    for i, name in enumerate(top):
+        ent_list.add_group_bis(name, GID_BASE + NUM_GROUPS - num_top + i, [],
+                               rnd.sample(middle,
+                                          min(NESTED_GROUPS, len(middle))))
+
+    return ent_list, users
+
+
+def add_entries(ldap_conn, ent_list):
+    """Add the entries asynchronously, LOAD_BATCH at a time"""
+    for i in range(0, len(ent_list), LOAD_BATCH):
+        msgids = [ldap_conn.add(dn, attrs)
+                  for dn, attrs in ent_list[i:i + LOAD_BATCH]]
+        for msgid in msgids:
+            ldap_conn.result(msgid)
+
+
+@pytest.fixture(scope="module")
+def ds_inst(request):
+    """LDAP server instance fixture"""
+    ds_inst = ds_openldap.DSOpenLDAP(
+        config.PREFIX, 10389, LDAP_BASE_DN,
+        "cn=admin", "Secret123")
+    try:
+        ds_inst.setup()
+        ds_inst.set_size_limit("unlimited")
+        ds_inst.monitor = ds_inst.enable_monitor()
+    except:
+        ds_inst.teardown()
+        raise
+    request.addfinalizer(lambda: ds_inst.teardown())
+    return ds_inst
+
+
+@pytest.fixture(scope="module")
+def ldap_conn(request, ds_inst):
+    """LDAP server connection fixture"""
+    ldap_conn = ds_inst.bind()
+    ldap_conn.ds_inst = ds_inst
+    request.addfinalizer(lambda: ldap_conn.unbind_s())
+    return ldap_conn
+
+
+@pytest.fixture(scope="module")
+def directory(request, ldap_conn):
+    """Load the generated directory once for all the measurements"""
+    ent_list, users = generate_directory(ldap_conn.ds_inst.base_dn)
+    start = time.time()
+    add_entries(ldap_conn, ent_list)
+    print("Loaded %d entries in %.1f s" % (len(ent_list),
+                                           time.time() - start))
+    return users
+
+
+def format_conf(ldap_conn, enum):
+    """Format the SSSD configuration of the measurements"""
+    return unindent("""\
+        [sssd]
+        domains             = LDAP
+        services            = nss
+
+        [nss]
+        memcache_timeout    = 0
+        enum_cache_timeout  = 1
+
+        [domain/LDAP]
+        ldap_auth_disable_tls_never_use_in_production = true
+        enumerate           = {enum}
+        ldap_schema         = rfc2307bis
+        ldap_group_object_class = groupOfNames
+        id_provider         = ldap
+        ldap_uri            = {ldap_conn.ds_inst.ldap_url}
+        ldap_search_base    = {ldap_conn.ds_inst.base_dn}
+        ldap_enumeration_refresh_timeout = {REFRESH_TIMEOUT}
+    """).format(REFRESH_TIMEOUT=REFRESH_TIMEOUT, **locals())
+
+
+def create_conf_fixture(request, contents):
+    """Generate sssd.conf and add teardown for removing it"""
+    conf = open(config.CONF_PATH, "w")
+    conf.write(contents)
+    conf.close()
+    os.chmod(config.CONF_PATH, stat.S_IRUSR | stat.S_IWUSR)
+    request.addfinalizer(lambda: os.unlink(config.CONF_PATH))
+
+
+def stop_sssd():
+    pid_file = open(config.PIDFILE_PATH, "r")
+    pid = int(pid_file.read())
+    os.kill(pid, signal.SIGTERM)
+    while True:
+        try:
+            os.kill(pid, signal.SIGCONT)
+        except:
+            break
+        time.sleep(1)
+
+
+def create_sssd_fixture(request):
+    """Start sssd and add teardown for stopping it and removing state"""
+    if subprocess.call(["sssd", "-D", "-f"]) != 0:
+        raise Exception("sssd start failed")
+
+    def teardown():
+        try:
+            stop_sssd()
+        except:
+            pass
+        for path in os.listdir(config.DB_PATH):
+            os.unlink(config.DB_PATH + "/" + path)
+        for path in os.listdir(config.MCACHE_PATH):
+            os.unlink(config.MCACHE_PATH + "/" + path)
+    request.addfinalizer(teardown)
+
+
+def backend_pid():
+    """Find the PID of the backend of the LDAP domain"""
+    return process_pid("sssd_be", "LDAP")
+
+
+def ldap_searches(ldap_conn):
+    """Searches completed by the server, None without the monitor"""
+    if not ldap_conn.ds_inst.monitor:
+        return None
+    return ldap_conn.ds_inst.get_op_counts().get("Search", 0)
+
+
+def record_searches(name, before, after, count=1):
+    if before is not None and after is not None:
+        # the search which read "before" completed after reading it
+        record(name, (after - before - 1) / float(count))
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * pct / 100.0))]
+
+
+@pytest.fixture
+def no_enum(request, ldap_conn, directory):
+    create_conf_fixture(request, format_conf(ldap_conn, enum=False))
+    create_sssd_fixture(request)
+    return directory
+
+
+@pytest.fixture
+def enum(request, ldap_conn, directory):
+    """Start enumerating, returns the time of the start"""
+    create_conf_fixture(request, format_conf(ldap_conn, enum=True))
+    start = time.time()
+    create_sssd_fixture(request)
+    return start
+
+
+def test_cold_initgroups(ldap_conn, no_enum):
+    """Latency of initgroups of users which are not cached yet"""
+    rnd = random.Random(SEED)
+    samples = rnd.sample(no_enum, min(INITGR_SAMPLES, len(no_enum)))
+    latencies = []
+
+    searches = ldap_searches(ldap_conn)
+    for name, gid in samples:
+        start = time.time()
+        res, errno, gids = sssd_id.call_sssd_initgroups(name, gid)
+        latencies.append((time.time() - start) * 1000)
+        assert res == sssd_id.NssReturnCode.SUCCESS, \
+            "Could not find groups for user %s, %d" % (name, errno)
+        assert len(gids) >= USER_GROUPS
+    record_searches("initgr_ldap_searches_per_call", searches,
+                    ldap_searches(ldap_conn), len(samples))
+
+    record("initgr_p50_ms", percentile(latencies, 50))
+    record("initgr_p99_ms", percentile(latencies, 99))
+    record("initgr_be_rss_kb", rss_kb(backend_pid()))
+
+
+def wait_for_enumeration():
+    """Wait until all the users and groups are enumerated"""
+    while True:
+        if len([p for p in pwd.getpwall()
+                if p.pw_name.startswith("perf_user")]) == NUM_USERS and \
+           len([g for g in grp.getgrall()
+                if g.gr_name.startswith("perf_group")]) == NUM_GROUPS:
+            return
+        time.sleep(1)
+
+
+def test_enumeration(ldap_conn, enum):
+    """Duration of the first enumeration and the cost of a refresh"""
+    wait_for_enumeration()
+    record("enum_sec", time.time() - enum)
+
+    pid = backend_pid()
+    record("enum_be_rss_kb", rss_kb(pid))
+
+    # nothing changes in the directory, the refresh only has to find out
+    cpu = cpu_sec(pid)
+    searches = ldap_searches(ldap_conn)
+    time.sleep(REFRESH_TIMEOUT + 5)
+    record("refresh_be_cpu_sec", cpu_sec(pid) - cpu)
+    record_searches("refresh_ldap_searches", searches,
+                    ldap_searches(ldap_conn))
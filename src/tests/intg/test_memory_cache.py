@@ -32,6 +32,8 @@ import sssd_id
 from util import unindent
 
 LDAP_BASE_DN = "dc=example,dc=com"
+BIG_GROUP_MEMBERS = ["biguser%03d" % i for i in range(100)] + \
+                    ["x", "short", "biguser_with_a_much_longer_name"]
 
 
 @pytest.fixture(scope="module")
@@ -126,6 +128,9 @@ def load_data_to_ldap(request, ldap_conn):
     ent_list.add_group("group0x", 2000, ["user1", "user2", "user3"])
     ent_list.add_group("group1x", 2010, ["user11", "user12", "user13"])
     ent_list.add_group("group2x", 2020, ["user21", "user22", "user23"])
+
+    # large enough to be stored compacted in the memory cache
+    ent_list.add_group("groupbig", 2100, BIG_GROUP_MEMBERS)
     create_ldap_fixture(request, ldap_conn, ent_list)
 
 
@@ -372,6 +377,16 @@ def test_getgrnam_membership_with_mc(ldap_conn, sanity_rfc2307):
     test_getgrnam_membership(ldap_conn, sanity_rfc2307)
 
 
+def test_getgrnam_big_group_with_mc(ldap_conn, sanity_rfc2307):
+    expected = dict(name="groupbig", gid=2100,
+                    mem=ent.contains_only(*BIG_GROUP_MEMBERS))
+    ent.assert_group_by_name("groupbig", expected)
+    ent.assert_group_by_gid(2100, expected)
+    stop_sssd()
+    ent.assert_group_by_name("groupbig", expected)
+    ent.assert_group_by_gid(2100, expected)
+
+
 def assert_user_gids_equal(user, expected_gids):
     (res, errno, gids) = sssd_id.get_user_gids(user)
     assert res == sssd_id.NssReturnCode.SUCCESS, \
@@ -778,3 +793,28 @@ def test_removed_mc(ldap_conn, sanity_rfc2307):
         grp.getgrnam('group1')
     with pytest.raises(KeyError):
         grp.getgrgid(2001)
+
+
+def get_mc_stats(map_name):
+    output = subprocess.check_output(["sss_mcstat", map_name])
+    stats = dict()
+    for line in output.decode("utf-8").splitlines()[1:]:
+        key, value = line.strip().split(":", 1)
+        stats[key] = value.strip()
+    return stats
+
+
+def test_mc_stats(ldap_conn, sanity_rfc2307):
+    ent.assert_passwd_by_name(
+        'user1',
+        dict(name='user1', passwd='*', uid=1001, gid=2001,
+             gecos='1001', shell='/bin/bash'))
+
+    stats = get_mc_stats("passwd")
+    assert int(stats["Stores"]) >= 1
+    assert int(stats["Invalidations"]) == 0
+    assert not stats["Used slots"].startswith("0 ")
+
+    subprocess.call(["sss_cache", "-u", "user1"])
+    stats = get_mc_stats("passwd")
+    assert int(stats["Invalidations"]) >= 1
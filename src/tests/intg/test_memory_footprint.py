@@ -0,0 +1,301 @@
+#
+# Memory footprint of the daemons
+#
+# Copyright (c) 2016 Red Hat, Inc.
+#
+# This is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by
+# the Free Software Foundation; version 2 only
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Steady-state memory footprint of the monitor, the backend and the
+responders.
+
+SSSD runs against a fixed directory and the same scripted workload of
+lookups and initgroups repeats in rounds. The entries expire between the
+rounds, so every round goes through the backend again. After the warm-up
+rounds the scenario takes the RSS of every process and the total of its
+talloc memory, which the process writes to its log on SIGWINCH. Once all
+the rounds have run, the footprint must not have grown by more than
+SSSD_PERF_TOLERANCE (0.2 by default) of the steady state.
+
+The steady state is recorded as the metrics <process>_rss_kb and
+<process>_talloc_bytes, see perf.py for the results and the baseline,
+which is only checked if SSSD_PERF is set.
+"""
+import os
+import re
+import stat
+import signal
+import subprocess
+import time
+import pwd
+import grp
+import pytest
+import config
+import ds_openldap
+import ldap_ent
+import sssd_id
+from perf import TOLERANCE, record, process_pid, rss_kb
+from util import unindent
+
+LDAP_BASE_DN = "dc=example,dc=com"
+
+NUM_USERS = 500
+NUM_GROUPS = 50
+# Groups per user
+USER_GROUPS = 3
+
+UID_BASE = 500000
+GID_BASE = 600000
+
+ENTRY_CACHE_TIMEOUT = 2
+WARMUP_ROUNDS = 2
+ROUNDS = 5
+REPORT_TIMEOUT = 30
+
+# The processes are named after the logs they write to
+PROCESSES = {
+    "sssd": ("sssd", None),
+    "sssd_LDAP": ("sssd_be", "LDAP"),
+    "sssd_nss": ("sssd_nss", None),
+    "sssd_pam": ("sssd_pam", None),
+}
+
+REPORT_START_RE = re.compile(r"memory report of process (\d+),")
+REPORT_END = "end of memory report"
+REPORT_LINE_RE = re.compile(r"\(0x[0-9a-f]+\): ( *)(.*): (\d+) bytes "
+                            r"in \d+ blocks$")
+
+
+@pytest.fixture(scope="module")
+def ds_inst(request):
+    """LDAP server instance fixture"""
+    ds_inst = ds_openldap.DSOpenLDAP(
+        config.PREFIX, 10389, LDAP_BASE_DN,
+        "cn=admin", "Secret123")
+    try:
+        ds_inst.setup()
+    except:
+        ds_inst.teardown()
+        raise
+    request.addfinalizer(lambda: ds_inst.teardown())
+    return ds_inst
+
+
+@pytest.fixture(scope="module")
+def ldap_conn(request, ds_inst):
+    """LDAP server connection fixture"""
+    ldap_conn = ds_inst.bind()
+    ldap_conn.ds_inst = ds_inst
+    request.addfinalizer(lambda: ldap_conn.unbind_s())
+    return ldap_conn
+
+
+def generate_directory(base_dn):
+    """The users and groups, the same ones on every run"""
+    ent_list = ldap_ent.List(base_dn)
+    members = dict((i, []) for i in range(NUM_GROUPS))
+    for i in range(NUM_USERS):
+        name = "mem_user%d" % i
+        ent_list.add_user(name, UID_BASE + i, GID_BASE + i % NUM_GROUPS)
+        for j in range(USER_GROUPS):
+            members[(i + j) % NUM_GROUPS].append(name)
+    for i in range(NUM_GROUPS):
+        ent_list.add_group_bis("mem_group%d" % i, GID_BASE + i, members[i])
+    return ent_list
+
+
+@pytest.fixture(scope="module")
+def directory(ldap_conn):
+    for dn, attrs in generate_directory(ldap_conn.ds_inst.base_dn):
+        ldap_conn.add_s(dn, attrs)
+
+
+def format_conf(ldap_conn):
+    """Format the SSSD configuration of the measurements"""
+    return unindent("""\
+        [sssd]
+        domains             = LDAP
+        services            = nss, pam
+
+        [nss]
+        memcache_timeout    = 0
+
+        [pam]
+
+        [domain/LDAP]
+        ldap_auth_disable_tls_never_use_in_production = true
+        ldap_schema         = rfc2307bis
+        ldap_group_object_class = groupOfNames
+        id_provider         = ldap
+        auth_provider       = ldap
+        ldap_uri            = {ldap_conn.ds_inst.ldap_url}
+        ldap_search_base    = {ldap_conn.ds_inst.base_dn}
+        entry_cache_timeout = {ENTRY_CACHE_TIMEOUT}
+    """).format(ENTRY_CACHE_TIMEOUT=ENTRY_CACHE_TIMEOUT, **locals())
+
+
+def create_conf_fixture(request, contents):
+    """Generate sssd.conf and add teardown for removing it"""
+    conf = open(config.CONF_PATH, "w")
+    conf.write(contents)
+    conf.close()
+    os.chmod(config.CONF_PATH, stat.S_IRUSR | stat.S_IWUSR)
+    request.addfinalizer(lambda: os.unlink(config.CONF_PATH))
+
+
+def monitor_pid():
+    pid_file = open(config.PIDFILE_PATH, "r")
+    return int(pid_file.read())
+
+
+def stop_sssd():
+    pid = monitor_pid()
+    os.kill(pid, signal.SIGTERM)
+    while True:
+        try:
+            os.kill(pid, signal.SIGCONT)
+        except:
+            break
+        time.sleep(1)
+
+
+def create_sssd_fixture(request):
+    """Start sssd and add teardown for stopping it and removing state"""
+    if subprocess.call(["sssd", "-D", "-f"]) != 0:
+        raise Exception("sssd start failed")
+
+    def teardown():
+        try:
+            stop_sssd()
+        except:
+            pass
+        for path in os.listdir(config.DB_PATH):
+            os.unlink(config.DB_PATH + "/" + path)
+        for path in os.listdir(config.MCACHE_PATH):
+            os.unlink(config.MCACHE_PATH + "/" + path)
+    request.addfinalizer(teardown)
+
+
+@pytest.fixture
+def sssd(request, ldap_conn, directory):
+    create_conf_fixture(request, format_conf(ldap_conn))
+    create_sssd_fixture(request)
+
+
+def run_workload():
+    """One round of the scripted workload"""
+    for i in range(NUM_USERS):
+        name = "mem_user%d" % i
+        gid = GID_BASE + i % NUM_GROUPS
+        assert pwd.getpwnam(name).pw_uid == UID_BASE + i
+        assert pwd.getpwuid(UID_BASE + i).pw_name == name
+        res, errno, gids = sssd_id.call_sssd_initgroups(name, gid)
+        assert res == sssd_id.NssReturnCode.SUCCESS, \
+            "Could not find groups for user %s, %d" % (name, errno)
+    for i in range(NUM_GROUPS):
+        assert grp.getgrnam("mem_group%d" % i).gr_gid == GID_BASE + i
+        assert grp.getgrgid(GID_BASE + i).gr_name == "mem_group%d" % i
+
+
+def read_reports(log, pid):
+    """The complete memory reports of pid in the log, each a list of
+    (depth, context name, bytes)"""
+    reports = []
+    report = None
+    with open(os.path.join(config.LOG_PATH, log + ".log")) as f:
+        for line in f:
+            match = REPORT_START_RE.search(line)
+            if match:
+                report = [] if int(match.group(1)) == pid else None
+            elif report is None:
+                continue
+            elif REPORT_END in line:
+                reports.append(report)
+                report = None
+            else:
+                match = REPORT_LINE_RE.search(line.rstrip("\n"))
+                if match:
+                    report.append((len(match.group(1)) // 2,
+                                   match.group(2), int(match.group(3))))
+    return reports
+
+
+class Footprint(object):
+    """RSS and talloc memory of a process"""
+
+    def __init__(self, pid, report):
+        self.rss_kb = rss_kb(pid)
+        # the null context at depth 0 holds all the talloc memory
+        self.talloc_bytes = report[0][2] if report else 0
+        self.contexts = {}
+        for depth, name, size in report:
+            if depth == 1:
+                self.contexts[name] = self.contexts.get(name, 0) + size
+
+    def grown_contexts(self, steady):
+        """The top-level contexts which grew since steady"""
+        return ", ".join("%s +%d" % (name, size - steady.contexts.get(name, 0))
+                         for name, size in sorted(self.contexts.items())
+                         if size > steady.contexts.get(name, 0))
+
+
+def footprints():
+    """The footprint of every process, they write their memory reports
+    when the monitor receives SIGWINCH"""
+    pids = dict((log, process_pid(binary, arg))
+                for log, (binary, arg) in PROCESSES.items())
+    counts = dict((log, len(read_reports(log, pid)))
+                  for log, pid in pids.items())
+
+    os.kill(monitor_pid(), signal.SIGWINCH)
+
+    result = {}
+    deadline = time.time() + REPORT_TIMEOUT
+    while len(result) < len(pids):
+        assert time.time() < deadline, \
+            "No memory report from %s" % \
+            ", ".join(set(pids.keys()) - set(result.keys()))
+        time.sleep(1)
+        for log, pid in pids.items():
+            reports = read_reports(log, pid)
+            if log not in result and len(reports) > counts[log]:
+                result[log] = Footprint(pid, reports[-1])
+    return result
+
+
+def test_footprint(sssd):
+    """Steady-state footprint and its growth over the rounds"""
+    for i in range(WARMUP_ROUNDS):
+        run_workload()
+        time.sleep(ENTRY_CACHE_TIMEOUT + 1)
+    steady = footprints()
+
+    for log, footprint in steady.items():
+        record("%s_rss_kb" % log, footprint.rss_kb)
+        record("%s_talloc_bytes" % log, footprint.talloc_bytes)
+
+    for i in range(ROUNDS):
+        run_workload()
+        time.sleep(ENTRY_CACHE_TIMEOUT + 1)
+    final = footprints()
+
+    for log, footprint in final.items():
+        before = steady[log]
+        assert footprint.talloc_bytes <= \
+            before.talloc_bytes * (1 + TOLERANCE), \
+            "talloc memory of %s grew from %d to %d bytes: %s" % \
+            (log, before.talloc_bytes, footprint.talloc_bytes,
+             footprint.grown_contexts(before))
+        assert footprint.rss_kb <= before.rss_kb * (1 + TOLERANCE), \
+            "RSS of %s grew from %d to %d kB" % \
+            (log, before.rss_kb, footprint.rss_kb)
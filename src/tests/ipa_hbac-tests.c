@@ -820,6 +820,162 @@ START_TEST(ipa_hbac_test_allow_srchostgroup)
 }
 END_TEST
 
+START_TEST(ipa_hbac_test_index)
+{
+    enum hbac_eval_result result;
+    enum hbac_error_code code;
+    TALLOC_CTX *test_ctx;
+    struct hbac_rule **rules;
+    struct hbac_rule_index *index = NULL;
+    struct hbac_eval_req *eval_req;
+    struct hbac_info *info = NULL;
+
+    test_ctx = talloc_new(global_talloc_context);
+
+    /* Create a request */
+    eval_req = talloc_zero(test_ctx, struct hbac_eval_req);
+    fail_if (eval_req == NULL);
+
+    get_test_user(eval_req, &eval_req->user);
+    get_test_service(eval_req, &eval_req->service);
+    get_test_srchost(eval_req, &eval_req->srchost);
+
+    /* Create the rules to evaluate against */
+    rules = talloc_array(test_ctx, struct hbac_rule *, 5);
+    fail_if (rules == NULL);
+
+    /* A disabled rule which would allow everything */
+    get_allow_all_rule(rules, &rules[0]);
+    rules[0]->name = talloc_strdup(rules[0], "Disabled");
+    fail_if(rules[0]->name == NULL);
+    rules[0]->enabled = false;
+
+    /* A rule for another user */
+    get_allow_all_rule(rules, &rules[1]);
+    rules[1]->name = talloc_strdup(rules[1], "Other user");
+    fail_if(rules[1]->name == NULL);
+    rules[1]->users->category = HBAC_CATEGORY_NULL;
+    rules[1]->users->names = talloc_array(rules[1], const char *, 2);
+    fail_if(rules[1]->users->names == NULL);
+    rules[1]->users->names[0] = HBAC_TEST_INVALID_USER;
+    rules[1]->users->names[1] = NULL;
+
+    /* A rule for a group of the user and a service group, the case of
+     * the names differs from the request */
+    get_allow_all_rule(rules, &rules[2]);
+    rules[2]->name = talloc_strdup(rules[2], "Group and service group");
+    fail_if(rules[2]->name == NULL);
+    rules[2]->users->category = HBAC_CATEGORY_NULL;
+    rules[2]->users->groups = talloc_array(rules[2], const char *, 2);
+    fail_if(rules[2]->users->groups == NULL);
+    rules[2]->users->groups[0] = "TestGroup2";
+    rules[2]->users->groups[1] = NULL;
+    rules[2]->services->category = HBAC_CATEGORY_NULL;
+    rules[2]->services->groups = talloc_array(rules[2], const char *, 2);
+    fail_if(rules[2]->services->groups == NULL);
+    rules[2]->services->groups[0] = "ALL_SERVICES";
+    rules[2]->services->groups[1] = NULL;
+
+    /* A rule for the user which is checked after the previous one */
+    get_allow_all_rule(rules, &rules[3]);
+    rules[3]->name = talloc_strdup(rules[3], "User");
+    fail_if(rules[3]->name == NULL);
+    rules[3]->users->category = HBAC_CATEGORY_NULL;
+    rules[3]->users->names = talloc_array(rules[3], const char *, 2);
+    fail_if(rules[3]->users->names == NULL);
+    rules[3]->users->names[0] = HBAC_TEST_USER;
+    rules[3]->users->names[1] = NULL;
+
+    rules[4] = NULL;
+
+    code = hbac_rule_index_create(rules, &index);
+    fail_unless(code == HBAC_SUCCESS,
+                "hbac_rule_index_create failed: [%s]",
+                hbac_error_string(code));
+
+    /* The first matching rule allows the access */
+    result = hbac_evaluate_index(index, eval_req, &info);
+    fail_unless(result == HBAC_EVAL_ALLOW,
+                "Expected [%s], got [%s]; "
+                "Error: [%s]",
+                hbac_result_string(HBAC_EVAL_ALLOW),
+                hbac_result_string(result),
+                info ? hbac_error_string(info->code):"Unknown");
+    fail_unless(strcmp(info->rule_name, "Group and service group") == 0,
+                "Unexpected rule [%s]", info->rule_name);
+    hbac_free_info(info);
+    info = NULL;
+
+    /* The index must be created again when the rules change */
+    rules[2]->users->groups[0] = HBAC_TEST_INVALID_GROUP;
+    hbac_free_rule_index(index);
+    index = NULL;
+
+    code = hbac_rule_index_create(rules, &index);
+    fail_unless(code == HBAC_SUCCESS,
+                "hbac_rule_index_create failed: [%s]",
+                hbac_error_string(code));
+
+    result = hbac_evaluate_index(index, eval_req, &info);
+    fail_unless(result == HBAC_EVAL_ALLOW,
+                "Expected [%s], got [%s]; "
+                "Error: [%s]",
+                hbac_result_string(HBAC_EVAL_ALLOW),
+                hbac_result_string(result),
+                info ? hbac_error_string(info->code):"Unknown");
+    fail_unless(strcmp(info->rule_name, "User") == 0,
+                "Unexpected rule [%s]", info->rule_name);
+    hbac_free_info(info);
+    info = NULL;
+
+    /* Names which are not ASCII are compared by the evaluator */
+    eval_req->user->name = (const char *) &user_utf8_upcase;
+    rules[1]->users->names[0] = (const char *) &user_utf8_lowcase;
+    hbac_free_rule_index(index);
+    index = NULL;
+
+    code = hbac_rule_index_create(rules, &index);
+    fail_unless(code == HBAC_SUCCESS,
+                "hbac_rule_index_create failed: [%s]",
+                hbac_error_string(code));
+
+    result = hbac_evaluate_index(index, eval_req, &info);
+    fail_unless(result == HBAC_EVAL_ALLOW,
+                "Expected [%s], got [%s]; "
+                "Error: [%s]",
+                hbac_result_string(HBAC_EVAL_ALLOW),
+                hbac_result_string(result),
+                info ? hbac_error_string(info->code):"Unknown");
+    fail_unless(strcmp(info->rule_name, "Other user") == 0,
+                "Unexpected rule [%s]", info->rule_name);
+    hbac_free_info(info);
+    info = NULL;
+
+    /* Negative test */
+    rules[1]->users->names[0] = (const char *) &user_utf8_lowcase_neg;
+    hbac_free_rule_index(index);
+    index = NULL;
+
+    code = hbac_rule_index_create(rules, &index);
+    fail_unless(code == HBAC_SUCCESS,
+                "hbac_rule_index_create failed: [%s]",
+                hbac_error_string(code));
+
+    result = hbac_evaluate_index(index, eval_req, &info);
+    fail_unless(result == HBAC_EVAL_DENY,
+                "Expected [%s], got [%s]; "
+                "Error: [%s]",
+                hbac_result_string(HBAC_EVAL_DENY),
+                hbac_result_string(result),
+                info ? hbac_error_string(info->code):"Unknown");
+    hbac_free_info(info);
+    info = NULL;
+
+    hbac_free_rule_index(index);
+    talloc_free(test_ctx);
+}
+END_TEST
+
 START_TEST(ipa_hbac_test_incomplete)
 {
     TALLOC_CTX *test_ctx;
@@ -860,6 +1016,7 @@ Suite *hbac_test_suite (void)
     tcase_add_test(tc_hbac, ipa_hbac_test_allow_srchost);
     tcase_add_test(tc_hbac, ipa_hbac_test_allow_srchostgroup);
     tcase_add_test(tc_hbac, ipa_hbac_test_allow_utf8);
+    tcase_add_test(tc_hbac, ipa_hbac_test_index);
     tcase_add_test(tc_hbac, ipa_hbac_test_incomplete);
 
     suite_add_tcase(s, tc_hbac);
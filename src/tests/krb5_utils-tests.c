@@ -697,6 +697,43 @@ START_TEST(test_sss_krb5_realm_has_proxy)
 }
 END_TEST
 
+START_TEST(test_krb5_ccache_status)
+{
+    struct krb5_ctx *krb5_ctx;
+
+    krb5_ctx = talloc_zero(NULL, struct krb5_ctx);
+    fail_unless(krb5_ctx != NULL, "talloc_zero failed.");
+
+    fail_unless(krb5_ccache_status_valid(krb5_ctx, "user", "FILE:/tmp/cc",
+                                         "user@REALM") == false);
+
+    krb5_ccache_status_set(krb5_ctx, "user", "FILE:/tmp/cc", "user@REALM",
+                           time(NULL) + 3600);
+    fail_unless(krb5_ccache_status_valid(krb5_ctx, "user", "FILE:/tmp/cc",
+                                         "user@REALM") == true);
+    fail_unless(krb5_ccache_status_valid(krb5_ctx, "user", "FILE:/tmp/other",
+                                         "user@REALM") == false);
+    fail_unless(krb5_ccache_status_valid(krb5_ctx, "user", "FILE:/tmp/cc",
+                                         "other@REALM") == false);
+    fail_unless(krb5_ccache_status_valid(krb5_ctx, "user", NULL,
+                                         "user@REALM") == false);
+
+    /* a renewal replaces the entry */
+    krb5_ccache_status_set(krb5_ctx, "user", "FILE:/tmp/cc", "user@REALM",
+                           time(NULL) - 1);
+    fail_unless(krb5_ccache_status_valid(krb5_ctx, "user", "FILE:/tmp/cc",
+                                         "user@REALM") == false);
+
+    krb5_ccache_status_set(krb5_ctx, "user", "FILE:/tmp/cc", "user@REALM",
+                           time(NULL) + 3600);
+    krb5_ccache_status_remove(krb5_ctx, "user");
+    fail_unless(krb5_ccache_status_valid(krb5_ctx, "user", "FILE:/tmp/cc",
+                                         "user@REALM") == false);
+
+    talloc_free(krb5_ctx);
+}
+END_TEST
+
 Suite *krb5_utils_suite (void)
 {
     Suite *s = suite_create ("krb5_utils");
@@ -737,6 +774,7 @@ Suite *krb5_utils_suite (void)
     tcase_add_test(tc_krb5_helpers, test_compare_principal_realm);
     tcase_add_test(tc_krb5_helpers, test_parse_krb5_map_user);
     tcase_add_test(tc_krb5_helpers, test_sss_krb5_realm_has_proxy);
+    tcase_add_test(tc_krb5_helpers, test_krb5_ccache_status);
     suite_add_tcase(s, tc_krb5_helpers);
 
     return s;
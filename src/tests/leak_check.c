@@ -50,6 +50,29 @@ const char *check_leaks_err_msg(void)
     return leak_err_msg;
 }
 
+static void
+check_leaks_report_sizes_cb(const void *ptr, int depth, int max_depth,
+                            int is_ref, void *private_data)
+{
+    FILE *out = (FILE *) private_data;
+
+    if (is_ref) {
+        return;
+    }
+
+    fprintf(out, "%s%s: %zu bytes in %zu blocks\n",
+            depth == 0 ? "" : "    ", talloc_get_name(ptr),
+            talloc_total_size(ptr), talloc_total_blocks(discard_const(ptr)));
+}
+
+void
+check_leaks_report_sizes(TALLOC_CTX *ctx, FILE *out)
+{
+    /* only ctx and its direct children, the full report of a large tree
+     * hides which of them grew */
+    talloc_report_depth_cb(ctx, 0, 1, check_leaks_report_sizes_cb, out);
+}
+
 static bool
 check_leaks(TALLOC_CTX *ctx, size_t bytes, const char *location)
 {
@@ -62,6 +85,7 @@ check_leaks(TALLOC_CTX *ctx, size_t bytes, const char *location)
     bytes_allocated = talloc_total_size(ctx);
     if (bytes_allocated != bytes) {
         fprintf(stderr, "Leak report for %s:\n", location);
+        check_leaks_report_sizes(ctx, stderr);
         talloc_report_full(ctx, stderr);
         _set_leak_err_msg("%s: memory leaks detected, %zd bytes still allocated",
                           location, bytes_allocated - bytes);
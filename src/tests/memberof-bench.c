@@ -0,0 +1,383 @@
+/*
+   SSSD
+
+   Benchmark of the memberof plugin with big groups
+
+   Copyright (C) Red Hat 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <talloc.h>
+#include <popt.h>
+#include <sys/time.h>
+
+#include "util/util.h"
+#include "db/sysdb.h"
+#include "tests/common.h"
+
+/* Stores a group with many user members nested in a chain of parent groups
+ * and times the operations which make the memberof plugin update all the
+ * members or all the parents. Not run by "make check", run it with
+ * LDB_MODULES_PATH pointing to the built memberof module. */
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "memberof_bench_conf.ldb"
+#define TEST_DOM_NAME "memberof_bench"
+#define TEST_ID_PROVIDER "ldap"
+
+#define DEFAULT_MEMBERS 100000
+#define DEFAULT_DEPTH 3
+
+#define BENCH_UID_BASE 100000
+#define BENCH_GID_BASE 50000
+#define BENCH_CACHE_TIMEOUT 3600
+
+struct bench_ctx {
+    struct sss_test_ctx *tctx;
+    int num_members;
+    int depth;
+
+    char **users;
+    char **groups;
+};
+
+static double bench_msec(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000.0
+           + (now.tv_usec - start->tv_usec) / 1000.0;
+}
+
+static errno_t bench_names(struct bench_ctx *bctx)
+{
+    int i;
+
+    bctx->users = talloc_array(bctx, char *, bctx->num_members + 1);
+    bctx->groups = talloc_array(bctx, char *, bctx->depth);
+    if (bctx->users == NULL || bctx->groups == NULL) {
+        return ENOMEM;
+    }
+
+    /* the last user is added to the group later */
+    for (i = 0; i <= bctx->num_members; i++) {
+        bctx->users[i] = talloc_asprintf(bctx->users, "bench_user%d", i);
+        if (bctx->users[i] == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    /* groups[0] is the innermost one */
+    for (i = 0; i < bctx->depth; i++) {
+        bctx->groups[i] = talloc_asprintf(bctx->groups, "bench_group%d", i);
+        if (bctx->groups[i] == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t bench_add_users(struct bench_ctx *bctx)
+{
+    struct sss_domain_info *dom = bctx->tctx->dom;
+    time_t now = time(NULL);
+    bool in_transaction = false;
+    errno_t ret;
+    errno_t sret;
+    int i;
+
+    ret = sysdb_transaction_start(dom->sysdb);
+    if (ret != EOK) {
+        return ret;
+    }
+    in_transaction = true;
+
+    for (i = 0; i <= bctx->num_members; i++) {
+        ret = sysdb_add_user(dom, bctx->users[i], BENCH_UID_BASE + i,
+                             BENCH_GID_BASE, NULL, "/", "/bin/sh", NULL,
+                             NULL, BENCH_CACHE_TIMEOUT, now);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = sysdb_transaction_commit(dom->sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+    in_transaction = false;
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(dom->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    return ret;
+}
+
+/* Creates the parent groups, each one a member of the next one */
+static errno_t bench_add_parents(struct bench_ctx *bctx)
+{
+    struct sss_domain_info *dom = bctx->tctx->dom;
+    time_t now = time(NULL);
+    errno_t ret;
+    int i;
+
+    for (i = bctx->depth - 1; i > 0; i--) {
+        ret = sysdb_add_group(dom, bctx->groups[i], BENCH_GID_BASE + i,
+                              NULL, BENCH_CACHE_TIMEOUT, now);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        if (i < bctx->depth - 1) {
+            ret = sysdb_add_group_member(dom, bctx->groups[i + 1],
+                                         bctx->groups[i],
+                                         SYSDB_MEMBER_GROUP, false);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+    }
+
+    return EOK;
+}
+
+static struct sysdb_attrs *bench_member_attrs(struct bench_ctx *bctx,
+                                              int num_members)
+{
+    struct sysdb_attrs *attrs;
+    char *dn;
+    errno_t ret;
+    int i;
+
+    attrs = sysdb_new_attrs(bctx);
+    if (attrs == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < num_members; i++) {
+        dn = sysdb_user_strdn(attrs, bctx->tctx->dom->name, bctx->users[i]);
+        if (dn == NULL) {
+            talloc_free(attrs);
+            return NULL;
+        }
+
+        ret = sysdb_attrs_steal_string(attrs, SYSDB_MEMBER, dn);
+        if (ret != EOK) {
+            talloc_free(attrs);
+            return NULL;
+        }
+    }
+
+    return attrs;
+}
+
+/* Adds the big group with all its members at once */
+static errno_t bench_add_group(struct bench_ctx *bctx)
+{
+    struct sss_domain_info *dom = bctx->tctx->dom;
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = bench_member_attrs(bctx, bctx->num_members);
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_add_group(dom, bctx->groups[0], BENCH_GID_BASE, attrs,
+                          BENCH_CACHE_TIMEOUT, time(NULL));
+    talloc_free(attrs);
+    return ret;
+}
+
+/* Nests the big group, all the members gain the new parents */
+static errno_t bench_nest_group(struct bench_ctx *bctx)
+{
+    if (bctx->depth < 2) {
+        return EOK;
+    }
+
+    return sysdb_add_group_member(bctx->tctx->dom, bctx->groups[1],
+                                  bctx->groups[0], SYSDB_MEMBER_GROUP, false);
+}
+
+static errno_t bench_add_member(struct bench_ctx *bctx)
+{
+    return sysdb_add_group_member(bctx->tctx->dom, bctx->groups[0],
+                                  bctx->users[bctx->num_members],
+                                  SYSDB_MEMBER_USER, false);
+}
+
+static errno_t bench_remove_member(struct bench_ctx *bctx)
+{
+    return sysdb_remove_group_member(bctx->tctx->dom, bctx->groups[0],
+                                     bctx->users[bctx->num_members],
+                                     SYSDB_MEMBER_USER, false);
+}
+
+/* Replaces the member list with the same list without the first member,
+ * like a refresh of the group does */
+static errno_t bench_replace_members(struct bench_ctx *bctx)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = bench_member_attrs(bctx, bctx->num_members);
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+
+    /* drop the first value */
+    attrs->a[0].values++;
+    attrs->a[0].num_values--;
+
+    ret = sysdb_set_group_attr(bctx->tctx->dom, bctx->groups[0], attrs,
+                               SYSDB_MOD_REP);
+    talloc_free(attrs);
+    return ret;
+}
+
+static errno_t bench_delete_group(struct bench_ctx *bctx)
+{
+    return sysdb_delete_group(bctx->tctx->dom, bctx->groups[0], 0);
+}
+
+struct bench_step {
+    const char *name;
+    errno_t (*fn)(struct bench_ctx *bctx);
+    bool timed;
+};
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    int pc_members = DEFAULT_MEMBERS;
+    int pc_depth = DEFAULT_DEPTH;
+    int no_cleanup = 0;
+    struct bench_ctx *bctx;
+    struct timeval start;
+    errno_t ret;
+    int i;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "members", 'm', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_members, 0,
+                    "Number of user members of the big group", NULL },
+        { "depth", 'd', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_depth, 0,
+                    "Number of nested groups, including the big one", NULL },
+        { "no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+                    "Do not delete the cache after the run", NULL },
+        POPT_TABLEEND
+    };
+
+    struct bench_step steps[] = {
+        { "add users", bench_add_users, false },
+        { "add parent groups", bench_add_parents, false },
+        { "add the big group", bench_add_group, true },
+        { "nest the big group", bench_nest_group, true },
+        { "add one member", bench_add_member, true },
+        { "remove one member", bench_remove_member, true },
+        { "replace the members", bench_replace_members, true },
+        { "delete the big group", bench_delete_group, true },
+        { NULL, NULL, false }
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_members < 1 || pc_depth < 1) {
+        fprintf(stderr, "The number of members and the depth must be "
+                        "positive\n");
+        return 1;
+    }
+
+    if (!ldb_modules_path_is_set()) {
+        fprintf(stderr, "Warning: LDB_MODULES_PATH is not set, "
+                        "the installed memberof module is used.\n");
+    }
+
+    tests_set_cwd();
+    test_dom_suite_setup(TESTS_PATH);
+
+    bctx = talloc_zero(NULL, struct bench_ctx);
+    if (bctx == NULL) {
+        return 1;
+    }
+    bctx->num_members = pc_members;
+    bctx->depth = pc_depth;
+
+    bctx->tctx = create_dom_test_ctx(bctx, TESTS_PATH, TEST_CONF_DB,
+                                     TEST_DOM_NAME, TEST_ID_PROVIDER, NULL);
+    if (bctx->tctx == NULL) {
+        fprintf(stderr, "Unable to set up the cache\n");
+        ret = EIO;
+        goto done;
+    }
+
+    ret = bench_names(bctx);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    printf("%d members, %d nested groups\n", pc_members, pc_depth);
+
+    for (i = 0; steps[i].name != NULL; i++) {
+        gettimeofday(&start, NULL);
+
+        ret = steps[i].fn(bctx);
+        if (ret != EOK) {
+            fprintf(stderr, "%s failed [%d]: %s\n",
+                    steps[i].name, ret, sss_strerror(ret));
+            goto done;
+        }
+
+        if (steps[i].timed) {
+            printf("%-24s %12.1f ms\n", steps[i].name, bench_msec(&start));
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(bctx);
+    if (!no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return ret == EOK ? 0 : 1;
+}
@@ -0,0 +1,648 @@
+/*
+   SSSD
+
+   Stress benchmark of concurrent readers and a writer of the memory cache
+
+   Copyright (C) Red Hat 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <popt.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/stat.h>
+
+#include "util/util.h"
+#include "util/mmap_cache.h"
+#include "responder/nss/nsssrv_mmap_cache.h"
+#include "sss_client/nss_mc.h"
+
+/* Client threads look users and groups up in the passwd and group memory
+ * caches with the functions of the NSS client while a writer thread
+ * stores new versions of the records, invalidates them and resets the
+ * caches with the functions of the NSS responder. Every version of a
+ * record is self-describing, so a reader which gets fields of two
+ * versions, a torn read, is detected. The benchmark reports the latency
+ * of the hits, how often the readers had to restart because a record
+ * changed under them and fails if any read was torn.
+ *
+ * This binary is built with its own SSS_NSS_MCACHE_DIR so the caches are
+ * created in the current directory and not over the caches of a running
+ * SSSD. Not run by "make check". */
+
+#define DEFAULT_READERS 8
+#define DEFAULT_SECONDS 10
+#define DEFAULT_ENTRIES 1000
+#define DEFAULT_INVALIDATE 10
+#define DEFAULT_GROUPS 50
+
+#define BENCH_UID_BASE 100000
+#define BENCH_GID_BASE 50000
+#define BENCH_TIMEOUT 3600
+#define BENCH_MAX_MEMBERS 4
+#define BENCH_BUF_SIZE 4096
+
+/* Latencies are kept in log-linear buckets of nanoseconds, each power of
+ * two is split into BENCH_SUB buckets so the error is below 2%. */
+#define BENCH_SUB 64
+#define BENCH_BUCKETS (BENCH_SUB * 64)
+
+struct bench_opts {
+    int readers;
+    int seconds;
+    int entries;
+    int elements;
+    int invalidate_pct;
+    int groups_pct;
+    int reset_every;
+};
+
+struct bench_reader {
+    pthread_t thread;
+    struct bench_opts *opts;
+    unsigned int seed;
+
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t exhausted;
+    uint64_t errors;
+    uint64_t torn;
+    uint64_t retries;
+    uint64_t max;
+    uint64_t hist[BENCH_BUCKETS];
+};
+
+struct bench_writer {
+    pthread_t thread;
+    struct bench_opts *opts;
+    struct sss_mc_ctx *pw_mc;
+    struct sss_mc_ctx *gr_mc;
+    uint32_t generation;
+
+    uint64_t stores;
+    uint64_t invalidations;
+    uint64_t resets;
+    uint64_t errors;
+};
+
+static volatile int bench_stop;
+
+/* Counts the restarts of the lookups of the calling thread, the client
+ * functions call this after reading a record. */
+static __thread uint64_t bench_retries;
+
+bool __real_sss_nss_mc_record_changed(struct sss_mc_rec *rec,
+                                      uint32_t barrier);
+
+bool __wrap_sss_nss_mc_record_changed(struct sss_mc_rec *rec,
+                                      uint32_t barrier)
+{
+    bool changed;
+
+    changed = __real_sss_nss_mc_record_changed(rec, barrier);
+    if (changed) {
+        bench_retries++;
+    }
+
+    return changed;
+}
+
+static uint64_t bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t bench_bucket(uint64_t nsec)
+{
+    unsigned int shift = 0;
+
+    while ((nsec >> shift) >= 2 * BENCH_SUB) {
+        shift++;
+    }
+
+    if (shift * BENCH_SUB + (nsec >> shift) >= BENCH_BUCKETS) {
+        return BENCH_BUCKETS - 1;
+    }
+
+    return shift * BENCH_SUB + (nsec >> shift);
+}
+
+static uint64_t bench_bucket_value(size_t bucket)
+{
+    unsigned int shift;
+
+    if (bucket < 2 * BENCH_SUB) {
+        return bucket;
+    }
+
+    shift = bucket / BENCH_SUB - 1;
+    return (uint64_t) (bucket - shift * BENCH_SUB) << shift;
+}
+
+static void bench_user_name(char *buf, size_t len, int n)
+{
+    snprintf(buf, len, "mc_user%d", n);
+}
+
+static void bench_group_name(char *buf, size_t len, int n)
+{
+    snprintf(buf, len, "mc_group%d", n);
+}
+
+/* =Writer=============================================================== */
+
+/* Version @gen of user @n has the gecos "<name> <gen>" and the home
+ * directory "/home/<name>/<gen>", the length of the record changes with
+ * the version. */
+static errno_t bench_store_user(struct bench_writer *writer, int n,
+                                uint32_t gen)
+{
+    char name[64];
+    char gecos[128];
+    char home[128];
+    struct sized_string s_name;
+    struct sized_string s_pw;
+    struct sized_string s_gecos;
+    struct sized_string s_home;
+    struct sized_string s_shell;
+
+    bench_user_name(name, sizeof(name), n);
+    snprintf(gecos, sizeof(gecos), "%s %"PRIu32, name, gen);
+    snprintf(home, sizeof(home), "/home/%s/%"PRIu32, name, gen);
+
+    to_sized_string(&s_name, name);
+    to_sized_string(&s_pw, "*");
+    to_sized_string(&s_gecos, gecos);
+    to_sized_string(&s_home, home);
+    to_sized_string(&s_shell, "/bin/sh");
+
+    return sss_mmap_cache_pw_store(&writer->pw_mc, &s_name, &s_pw,
+                                   BENCH_UID_BASE + n, BENCH_GID_BASE + n,
+                                   &s_gecos, &s_home, &s_shell, false);
+}
+
+/* Version @gen of group @n has the password "<gen>" and the members
+ * mc_user<n> to mc_user<n + gen % BENCH_MAX_MEMBERS>. */
+static errno_t bench_store_group(struct bench_writer *writer, int n,
+                                 uint32_t gen)
+{
+    char name[64];
+    char pw[16];
+    char membuf[BENCH_MAX_MEMBERS * 64];
+    struct sized_string s_name;
+    struct sized_string s_pw;
+    size_t memsize = 0;
+    int members;
+    int i;
+
+    bench_group_name(name, sizeof(name), n);
+    snprintf(pw, sizeof(pw), "%"PRIu32, gen);
+
+    members = gen % BENCH_MAX_MEMBERS + 1;
+    for (i = 0; i < members; i++) {
+        bench_user_name(membuf + memsize, sizeof(membuf) - memsize,
+                        (n + i) % writer->opts->entries);
+        memsize += strlen(membuf + memsize) + 1;
+    }
+
+    to_sized_string(&s_name, name);
+    to_sized_string(&s_pw, pw);
+
+    return sss_mmap_cache_gr_store(&writer->gr_mc, &s_name, &s_pw,
+                                   BENCH_GID_BASE + n, members,
+                                   membuf, memsize);
+}
+
+static errno_t bench_invalidate(struct bench_writer *writer, int n,
+                                bool group)
+{
+    char name[64];
+    struct sized_string s_name;
+
+    if (group) {
+        bench_group_name(name, sizeof(name), n);
+        to_sized_string(&s_name, name);
+        return sss_mmap_cache_gr_invalidate(writer->gr_mc, &s_name);
+    }
+
+    bench_user_name(name, sizeof(name), n);
+    to_sized_string(&s_name, name);
+    return sss_mmap_cache_pw_invalidate(writer->pw_mc, &s_name);
+}
+
+static void *bench_writer_main(void *pvt)
+{
+    struct bench_writer *writer = pvt;
+    struct bench_opts *opts = writer->opts;
+    unsigned int seed = 1;
+    uint64_t ops = 0;
+    bool group;
+    errno_t ret;
+    int n;
+
+    while (!bench_stop) {
+        n = rand_r(&seed) % opts->entries;
+        group = rand_r(&seed) % 100 < opts->groups_pct;
+
+        if (rand_r(&seed) % 100 < opts->invalidate_pct) {
+            ret = bench_invalidate(writer, n, group);
+            /* the record may already be gone */
+            if (ret == ENOENT) {
+                ret = EOK;
+            }
+            writer->invalidations++;
+        } else {
+            writer->generation++;
+            if (group) {
+                ret = bench_store_group(writer, n, writer->generation);
+            } else {
+                ret = bench_store_user(writer, n, writer->generation);
+            }
+            writer->stores++;
+        }
+
+        if (ret != EOK) {
+            writer->errors++;
+        }
+
+        ops++;
+        if (opts->reset_every > 0 && ops % opts->reset_every == 0) {
+            sss_mmap_cache_reset(writer->pw_mc);
+            sss_mmap_cache_reset(writer->gr_mc);
+            writer->resets++;
+        }
+    }
+
+    return NULL;
+}
+
+/* =Readers============================================================== */
+
+static bool bench_check_user(struct passwd *pwd, const char *name, int n)
+{
+    char home[128];
+    const char *gen;
+    size_t len;
+
+    len = strlen(name);
+    if (strcmp(pwd->pw_name, name) != 0
+            || pwd->pw_uid != BENCH_UID_BASE + n
+            || pwd->pw_gid != BENCH_GID_BASE + n
+            || strncmp(pwd->pw_gecos, name, len) != 0
+            || pwd->pw_gecos[len] != ' '
+            || strcmp(pwd->pw_shell, "/bin/sh") != 0) {
+        return false;
+    }
+
+    /* the home directory must be of the same version as the gecos */
+    gen = pwd->pw_gecos + len + 1;
+    snprintf(home, sizeof(home), "/home/%s/%s", name, gen);
+    return strcmp(pwd->pw_dir, home) == 0;
+}
+
+static bool bench_check_group(struct group *grp, const char *name, int n,
+                              int entries)
+{
+    char member[64];
+    unsigned long gen;
+    char *endptr;
+    int members;
+    int i;
+
+    if (strcmp(grp->gr_name, name) != 0
+            || grp->gr_gid != BENCH_GID_BASE + n) {
+        return false;
+    }
+
+    errno = 0;
+    gen = strtoul(grp->gr_passwd, &endptr, 10);
+    if (errno != 0 || *endptr != '\0') {
+        return false;
+    }
+
+    /* the members must be those of the version in the password */
+    members = gen % BENCH_MAX_MEMBERS + 1;
+    for (i = 0; i < members; i++) {
+        bench_user_name(member, sizeof(member), (n + i) % entries);
+        if (grp->gr_mem[i] == NULL || strcmp(grp->gr_mem[i], member) != 0) {
+            return false;
+        }
+    }
+
+    return grp->gr_mem[members] == NULL;
+}
+
+static void *bench_reader_main(void *pvt)
+{
+    struct bench_reader *reader = pvt;
+    struct bench_opts *opts = reader->opts;
+    char buf[BENCH_BUF_SIZE];
+    char name[64];
+    struct passwd pwd;
+    struct group grp;
+    uint64_t start;
+    uint64_t nsec;
+    bool group;
+    bool valid;
+    errno_t ret;
+    int n;
+
+    while (!bench_stop) {
+        n = rand_r(&reader->seed) % opts->entries;
+        group = rand_r(&reader->seed) % 100 < opts->groups_pct;
+
+        if (group) {
+            bench_group_name(name, sizeof(name), n);
+            start = bench_now();
+            ret = sss_nss_mc_getgrnam(name, strlen(name), &grp,
+                                      buf, sizeof(buf));
+            nsec = bench_now() - start;
+            valid = ret == 0 && bench_check_group(&grp, name, n,
+                                                  opts->entries);
+        } else {
+            bench_user_name(name, sizeof(name), n);
+            start = bench_now();
+            ret = sss_nss_mc_getpwnam(name, strlen(name), &pwd,
+                                      buf, sizeof(buf));
+            nsec = bench_now() - start;
+            valid = ret == 0 && bench_check_user(&pwd, name, n);
+        }
+
+        reader->lookups++;
+        switch (ret) {
+        case 0:
+            if (!valid) {
+                reader->torn++;
+                break;
+            }
+            reader->hits++;
+            reader->hist[bench_bucket(nsec)]++;
+            if (nsec > reader->max) {
+                reader->max = nsec;
+            }
+            break;
+        case ENOENT:
+            reader->misses++;
+            break;
+        case EAGAIN:
+            /* the record kept changing, the client gave up */
+            reader->exhausted++;
+            break;
+        default:
+            reader->errors++;
+            break;
+        }
+    }
+
+    reader->retries = bench_retries;
+    return NULL;
+}
+
+/* =Report=============================================================== */
+
+static void bench_merge(struct bench_reader *dst, struct bench_reader *src)
+{
+    size_t i;
+
+    dst->lookups += src->lookups;
+    dst->hits += src->hits;
+    dst->misses += src->misses;
+    dst->exhausted += src->exhausted;
+    dst->errors += src->errors;
+    dst->torn += src->torn;
+    dst->retries += src->retries;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+    for (i = 0; i < BENCH_BUCKETS; i++) {
+        dst->hist[i] += src->hist[i];
+    }
+}
+
+static double bench_percentile(struct bench_reader *total, double pct)
+{
+    uint64_t rank;
+    uint64_t seen = 0;
+    size_t i;
+
+    if (total->hits == 0) {
+        return 0;
+    }
+
+    rank = (uint64_t) (total->hits * pct / 100.0);
+    if (rank >= total->hits) {
+        rank = total->hits - 1;
+    }
+
+    for (i = 0; i < BENCH_BUCKETS; i++) {
+        seen += total->hist[i];
+        if (seen > rank) {
+            return bench_bucket_value(i);
+        }
+    }
+
+    return total->max;
+}
+
+static void bench_report(struct bench_opts *opts, struct bench_reader *total,
+                         struct bench_writer *writer)
+{
+    double lookups = total->lookups > 0 ? total->lookups : 1;
+
+    printf("%d readers, %d entries, %d cache elements, %d s\n",
+           opts->readers, opts->entries, opts->elements, opts->seconds);
+    printf("lookups            %12"PRIu64" %10.0f/s\n",
+           total->lookups, total->lookups / (double) opts->seconds);
+    printf("  hits             %12"PRIu64" %9.2f %%\n",
+           total->hits, total->hits * 100 / lookups);
+    printf("  misses           %12"PRIu64" %9.2f %%\n",
+           total->misses, total->misses * 100 / lookups);
+    printf("  retries exceeded %12"PRIu64" %9.2f %%\n",
+           total->exhausted, total->exhausted * 100 / lookups);
+    printf("  errors           %12"PRIu64"\n", total->errors);
+    printf("  torn reads       %12"PRIu64"\n", total->torn);
+    printf("barrier retries    %12"PRIu64" %9.2f per 1000 lookups\n",
+           total->retries, total->retries * 1000 / lookups);
+    printf("hit latency        p50 %.0f ns, p99 %.0f ns, p99.9 %.0f ns, "
+           "max %"PRIu64" ns\n",
+           bench_percentile(total, 50), bench_percentile(total, 99),
+           bench_percentile(total, 99.9), total->max);
+    printf("writer             %"PRIu64" stores, %"PRIu64" invalidations, "
+           "%"PRIu64" resets, %"PRIu64" errors\n",
+           writer->stores, writer->invalidations, writer->resets,
+           writer->errors);
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    struct bench_opts opts = { 0 };
+    struct bench_writer *writer;
+    struct bench_reader *readers;
+    struct bench_reader *total;
+    TALLOC_CTX *mem_ctx;
+    errno_t ret;
+    int i;
+
+    opts.readers = DEFAULT_READERS;
+    opts.seconds = DEFAULT_SECONDS;
+    opts.entries = DEFAULT_ENTRIES;
+    opts.invalidate_pct = DEFAULT_INVALIDATE;
+    opts.groups_pct = DEFAULT_GROUPS;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "readers", 'r', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.readers, 0, "Number of reader threads", NULL },
+        { "seconds", 's', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.seconds, 0, "Duration of the run", NULL },
+        { "entries", 'e', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.entries, 0, "Number of users and of groups", NULL },
+        { "elements", '\0', POPT_ARG_INT, &opts.elements, 0,
+                    "Size of each cache, twice the entries by default",
+                    NULL },
+        { "invalidate", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.invalidate_pct, 0,
+                    "Percentage of writes which invalidate a record", NULL },
+        { "groups", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.groups_pct, 0,
+                    "Percentage of operations on groups", NULL },
+        { "reset-every", '\0', POPT_ARG_INT, &opts.reset_every, 0,
+                    "Reset the caches every N writes", NULL },
+        POPT_TABLEEND
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (opts.readers < 1 || opts.seconds < 1 || opts.entries < 1
+            || opts.elements < 0 || opts.reset_every < 0
+            || opts.invalidate_pct < 0 || opts.invalidate_pct > 100
+            || opts.groups_pct < 0 || opts.groups_pct > 100) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+    if (opts.elements == 0) {
+        opts.elements = opts.entries * 2;
+    }
+
+    if (mkdir(SSS_NSS_MCACHE_DIR, 0700) != 0 && errno != EEXIST) {
+        perror("mkdir");
+        return 1;
+    }
+
+    mem_ctx = talloc_new(NULL);
+    writer = talloc_zero(mem_ctx, struct bench_writer);
+    readers = talloc_zero_array(mem_ctx, struct bench_reader, opts.readers);
+    total = talloc_zero(mem_ctx, struct bench_reader);
+    if (writer == NULL || readers == NULL || total == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    writer->opts = &opts;
+
+    ret = sss_mmap_cache_init(writer, "passwd", SSS_MC_PASSWD,
+                              opts.elements, BENCH_TIMEOUT, &writer->pw_mc);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sss_mmap_cache_init(writer, "group", SSS_MC_GROUP,
+                              opts.elements, BENCH_TIMEOUT, &writer->gr_mc);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    /* the readers start with every entry cached */
+    for (i = 0; i < opts.entries; i++) {
+        ret = bench_store_user(writer, i, 0);
+        if (ret == EOK) {
+            ret = bench_store_group(writer, i, 0);
+        }
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    for (i = 0; i < opts.readers; i++) {
+        readers[i].opts = &opts;
+        readers[i].seed = i + 2;
+        ret = pthread_create(&readers[i].thread, NULL, bench_reader_main,
+                             &readers[i]);
+        if (ret != 0) {
+            bench_stop = 1;
+            opts.readers = i;
+            break;
+        }
+    }
+
+    if (ret == 0) {
+        ret = pthread_create(&writer->thread, NULL, bench_writer_main,
+                             writer);
+        if (ret == 0) {
+            sleep(opts.seconds);
+            bench_stop = 1;
+            pthread_join(writer->thread, NULL);
+        }
+        bench_stop = 1;
+    }
+
+    for (i = 0; i < opts.readers; i++) {
+        pthread_join(readers[i].thread, NULL);
+        bench_merge(total, &readers[i]);
+    }
+
+    if (ret != 0) {
+        goto done;
+    }
+
+    bench_report(&opts, total, writer);
+    ret = total->torn == 0 ? EOK : EFAULT;
+
+done:
+    if (ret != EOK) {
+        fprintf(stderr, "Benchmark failed [%d]: %s\n", ret, sss_strerror(ret));
+    }
+    talloc_free(mem_ctx);
+    unlink(SSS_NSS_MCACHE_DIR"/passwd");
+    unlink(SSS_NSS_MCACHE_DIR"/group");
+    rmdir(SSS_NSS_MCACHE_DIR);
+    return ret == EOK ? 0 : 1;
+}
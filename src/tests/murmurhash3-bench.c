@@ -0,0 +1,239 @@
+/*
+   SSSD
+
+   Benchmark of the murmurhash3 function used by the memory cache
+
+   Copyright (C) Red Hat 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <popt.h>
+#include <sys/time.h>
+
+#include "util/mmap_cache.h"
+
+/* Hashes keys shaped like the ones the memory cache stores and reports the
+ * hashing speed and the length of the hash table chains the keys produce
+ * with the table sizing of the responder. Not run by "make check". */
+
+#define DEFAULT_KEYS 100000
+#define DEFAULT_ROUNDS 20
+#define DEFAULT_SEED 0xdeadbeef
+
+#define MAX_CHAIN_HIST 8
+
+static double bench_msec(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000.0
+           + (now.tv_usec - start->tv_usec) / 1000.0;
+}
+
+static char **bench_keys(const char *fmt, int num_keys, size_t **_lens)
+{
+    char **keys;
+    size_t *lens;
+    int i;
+
+    keys = calloc(num_keys, sizeof(char *));
+    lens = calloc(num_keys, sizeof(size_t));
+    if (keys == NULL || lens == NULL) {
+        goto fail;
+    }
+
+    for (i = 0; i < num_keys; i++) {
+        if (asprintf(&keys[i], fmt, i) < 0) {
+            keys[i] = NULL;
+            goto fail;
+        }
+        /* the memory cache hashes the keys with the NULL terminator */
+        lens[i] = strlen(keys[i]) + 1;
+    }
+
+    *_lens = lens;
+    return keys;
+
+fail:
+    if (keys != NULL) {
+        for (i = 0; i < num_keys; i++) {
+            free(keys[i]);
+        }
+    }
+    free(keys);
+    free(lens);
+    return NULL;
+}
+
+static void bench_free_keys(char **keys, size_t *lens, int num_keys)
+{
+    int i;
+
+    for (i = 0; i < num_keys; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+    free(lens);
+}
+
+static void bench_speed(char **keys, size_t *lens, int num_keys,
+                        int rounds, uint32_t seed)
+{
+    struct timeval start;
+    volatile uint32_t sink = 0;
+    double msec;
+    size_t bytes = 0;
+    int r;
+    int i;
+
+    gettimeofday(&start, NULL);
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < num_keys; i++) {
+            sink ^= murmurhash3(keys[i], lens[i], seed);
+            bytes += lens[i];
+        }
+    }
+    msec = bench_msec(&start);
+
+    printf("  %10.1f ms %8.1f ns/key %8.1f MB/s\n", msec,
+           msec * 1000000.0 / ((double)num_keys * rounds),
+           msec > 0 ? bytes / (msec * 1000.0) : 0.0);
+}
+
+static int bench_chains(char **keys, size_t *lens, int num_keys,
+                        uint32_t seed)
+{
+    uint32_t *chains;
+    uint32_t hist[MAX_CHAIN_HIST + 1] = { 0 };
+    uint32_t ht_elems;
+    uint32_t max_chain = 0;
+    uint32_t used = 0;
+    uint32_t hash;
+    uint32_t i;
+
+    /* the responder allocates twice as many hash slots as elements */
+    ht_elems = MC_HT_ELEMS(MC_HT_SIZE(num_keys * 2));
+
+    chains = calloc(ht_elems, sizeof(uint32_t));
+    if (chains == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < (uint32_t)num_keys; i++) {
+        hash = murmurhash3(keys[i], lens[i], seed) % ht_elems;
+        chains[hash]++;
+    }
+
+    for (i = 0; i < ht_elems; i++) {
+        if (chains[i] == 0) {
+            continue;
+        }
+        used++;
+        hist[chains[i] < MAX_CHAIN_HIST ? chains[i] : MAX_CHAIN_HIST]++;
+        if (chains[i] > max_chain) {
+            max_chain = chains[i];
+        }
+    }
+
+    printf("  %u slots, %u used, average chain %.2f, longest chain %u\n",
+           ht_elems, used, used ? (double)num_keys / used : 0.0, max_chain);
+    printf("  chains of length");
+    for (i = 1; i <= MAX_CHAIN_HIST; i++) {
+        printf(" %u%s:%u", i, i == MAX_CHAIN_HIST ? "+" : "", hist[i]);
+    }
+    printf("\n");
+
+    free(chains);
+    return 0;
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    int pc_keys = DEFAULT_KEYS;
+    int pc_rounds = DEFAULT_ROUNDS;
+    unsigned int pc_seed = DEFAULT_SEED;
+    char **keys;
+    size_t *lens;
+    int ret;
+    int i;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        { "keys", 'k', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_keys, 0,
+                    "Number of keys of each shape", NULL },
+        { "rounds", 'r', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_rounds, 0,
+                    "Number of times each key is hashed", NULL },
+        { "seed", 's', POPT_ARG_INT, &pc_seed, 0,
+                    "Seed of the hash, as stored in the cache header", NULL },
+        POPT_TABLEEND
+    };
+
+    /* keys as stored by the nss, initgroups and sudo caches */
+    const char *shapes[] = {
+        "user%d",
+        "user%d@ad.example.com",
+        "%d",
+        "R:%d:administrator@ad.example.com",
+        NULL
+    };
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    if (pc_keys < 1 || pc_rounds < 1) {
+        fprintf(stderr, "The number of keys and rounds must be positive\n");
+        return 1;
+    }
+
+    printf("%d keys, %d rounds, seed 0x%08x\n", pc_keys, pc_rounds, pc_seed);
+
+    for (i = 0; shapes[i] != NULL; i++) {
+        keys = bench_keys(shapes[i], pc_keys, &lens);
+        if (keys == NULL) {
+            fprintf(stderr, "Unable to generate the keys\n");
+            return 1;
+        }
+
+        printf("%s\n", shapes[i]);
+        bench_speed(keys, lens, pc_keys, pc_rounds, pc_seed);
+        ret = bench_chains(keys, lens, pc_keys, pc_seed);
+        bench_free_keys(keys, lens, pc_keys);
+        if (ret != 0) {
+            fprintf(stderr, "Unable to compute the chains\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,512 @@
+/*
+   SSSD
+
+   Load generator and latency benchmark of the NSS responder
+
+   Copyright (C) Red Hat 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <popt.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "util/util.h"
+
+/* Runs a mix of lookups against the system NSS, usually served by the SSSD
+ * NSS responder, from several processes at once and reports the throughput
+ * and the latency percentiles of each kind of request. The users and
+ * groups looked up are <prefix><n> with IDs <id-base> + <n>, n from
+ * --start to --stop, as generated by the integration tests. Misses look up
+ * names and IDs outside of that range. Not run by "make check". */
+
+#define DEFAULT_START       1
+#define DEFAULT_STOP        1000
+#define DEFAULT_ID_BASE     10000
+#define DEFAULT_REQUESTS    10000
+#define DEFAULT_CONCURRENCY 4
+#define DEFAULT_MIX         "pwnam=30,pwuid=20,grnam=20,grgid=20,initgr=10"
+
+#define INITGR_MAX_GROUPS   1024
+
+/* Latencies are kept in log-linear buckets of nanoseconds, each power of
+ * two is split into BENCH_SUB buckets so the error is below 2%. */
+#define BENCH_SUB           64
+#define BENCH_BUCKETS       (BENCH_SUB * 64)
+
+enum bench_op {
+    BENCH_PWNAM,
+    BENCH_PWUID,
+    BENCH_GRNAM,
+    BENCH_GRGID,
+    BENCH_INITGR,
+    BENCH_ENUM,
+
+    BENCH_OP_COUNT
+};
+
+static const char *bench_op_names[] = {
+    "pwnam", "pwuid", "grnam", "grgid", "initgr", "enum"
+};
+
+struct bench_stats {
+    uint64_t count;
+    uint64_t unexpected;
+    uint64_t max;
+    uint64_t hist[BENCH_BUCKETS];
+};
+
+struct bench_opts {
+    const char *prefix;
+    int start;
+    int stop;
+    int id_base;
+    int requests;
+    int concurrency;
+    int hit_ratio;
+    int enum_every;
+    int seed;
+    int weights[BENCH_OP_COUNT];
+    int weight_sum;
+};
+
+static uint64_t bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t bench_bucket(uint64_t nsec)
+{
+    unsigned int shift = 0;
+
+    while ((nsec >> shift) >= 2 * BENCH_SUB) {
+        shift++;
+    }
+
+    if (shift * BENCH_SUB + (nsec >> shift) >= BENCH_BUCKETS) {
+        return BENCH_BUCKETS - 1;
+    }
+
+    return shift * BENCH_SUB + (nsec >> shift);
+}
+
+static uint64_t bench_bucket_value(size_t bucket)
+{
+    unsigned int shift;
+
+    if (bucket < 2 * BENCH_SUB) {
+        return bucket;
+    }
+
+    shift = bucket / BENCH_SUB - 1;
+    return (uint64_t) (bucket - shift * BENCH_SUB) << shift;
+}
+
+static void bench_record(struct bench_stats *stats, uint64_t start,
+                         bool expected)
+{
+    uint64_t nsec;
+
+    nsec = bench_now() - start;
+    stats->count++;
+    stats->hist[bench_bucket(nsec)]++;
+    if (nsec > stats->max) {
+        stats->max = nsec;
+    }
+    if (!expected) {
+        stats->unexpected++;
+    }
+}
+
+static errno_t bench_parse_mix(const char *mix, struct bench_opts *opts)
+{
+    char *copy;
+    char *item;
+    char *saveptr = NULL;
+    char *value;
+    char *endptr;
+    long weight;
+    int i;
+    errno_t ret;
+
+    copy = strdup(mix);
+    if (copy == NULL) {
+        return ENOMEM;
+    }
+
+    memset(opts->weights, 0, sizeof(opts->weights));
+    opts->weight_sum = 0;
+
+    for (item = strtok_r(copy, ",", &saveptr);
+         item != NULL;
+         item = strtok_r(NULL, ",", &saveptr)) {
+        value = strchr(item, '=');
+        if (value == NULL) {
+            ret = EINVAL;
+            goto done;
+        }
+        *value++ = '\0';
+
+        errno = 0;
+        weight = strtol(value, &endptr, 10);
+        if (errno != 0 || *endptr != '\0' || weight < 0 || weight > 1000) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        /* enumeration is driven by --enum-every, not by the mix */
+        for (i = 0; i < BENCH_ENUM; i++) {
+            if (strcmp(item, bench_op_names[i]) == 0) {
+                break;
+            }
+        }
+        if (i == BENCH_ENUM) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        opts->weights[i] = weight;
+        opts->weight_sum += weight;
+    }
+
+    ret = opts->weight_sum > 0 ? EOK : EINVAL;
+
+done:
+    free(copy);
+    return ret;
+}
+
+static enum bench_op bench_pick_op(struct bench_opts *opts,
+                                   unsigned int *seed)
+{
+    int r;
+    int i;
+
+    r = rand_r(seed) % opts->weight_sum;
+    for (i = 0; i < BENCH_ENUM; i++) {
+        if (r < opts->weights[i]) {
+            break;
+        }
+        r -= opts->weights[i];
+    }
+
+    return i;
+}
+
+static void bench_enumerate(struct bench_stats *stats)
+{
+    uint64_t start;
+
+    start = bench_now();
+    setpwent();
+    while (getpwent() != NULL);
+    endpwent();
+    setgrent();
+    while (getgrent() != NULL);
+    endgrent();
+    bench_record(stats, start, true);
+}
+
+static void bench_one(struct bench_opts *opts, enum bench_op op,
+                      unsigned int *seed, struct bench_stats *stats)
+{
+    char name[NAME_MAX];
+    gid_t groups[INITGR_MAX_GROUPS];
+    int ngroups;
+    uint64_t start;
+    bool hit;
+    bool found;
+    int n;
+
+    hit = (rand_r(seed) % 100) < opts->hit_ratio;
+    if (hit) {
+        n = opts->start + rand_r(seed) % (opts->stop - opts->start + 1);
+        snprintf(name, sizeof(name), "%s%d", opts->prefix, n);
+    } else {
+        n = opts->stop + 1 + rand_r(seed) % 1000000;
+        snprintf(name, sizeof(name), "%s_missing%d", opts->prefix, n);
+    }
+
+    start = bench_now();
+    switch (op) {
+    case BENCH_PWNAM:
+        found = getpwnam(name) != NULL;
+        break;
+    case BENCH_PWUID:
+        found = getpwuid(opts->id_base + n) != NULL;
+        break;
+    case BENCH_GRNAM:
+        found = getgrnam(name) != NULL;
+        break;
+    case BENCH_GRGID:
+        found = getgrgid(opts->id_base + n) != NULL;
+        break;
+    case BENCH_INITGR:
+        /* the primary group is always returned, more means the user
+         * was found */
+        ngroups = INITGR_MAX_GROUPS;
+        getgrouplist(name, opts->id_base + n, groups, &ngroups);
+        found = ngroups > 1;
+        break;
+    default:
+        return;
+    }
+
+    bench_record(stats, start, found == hit);
+}
+
+static void bench_worker(struct bench_opts *opts, int id, int start_fd,
+                         struct bench_stats *stats)
+{
+    unsigned int seed;
+    enum bench_op op;
+    char c;
+    int i;
+
+    /* wait until all the workers are forked */
+    if (read(start_fd, &c, 1) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    seed = opts->seed + id;
+    for (i = 0; i < opts->requests; i++) {
+        if (opts->enum_every > 0 && i % opts->enum_every == 0) {
+            bench_enumerate(&stats[BENCH_ENUM]);
+        }
+
+        op = bench_pick_op(opts, &seed);
+        bench_one(opts, op, &seed, &stats[op]);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+static uint64_t bench_percentile(struct bench_stats *stats, double pct)
+{
+    uint64_t rank;
+    uint64_t seen = 0;
+    size_t i;
+
+    rank = (uint64_t) (stats->count * pct / 100.0);
+    if (rank >= stats->count) {
+        rank = stats->count - 1;
+    }
+
+    for (i = 0; i < BENCH_BUCKETS; i++) {
+        seen += stats->hist[i];
+        if (seen > rank) {
+            return bench_bucket_value(i);
+        }
+    }
+
+    return stats->max;
+}
+
+static void bench_report(const char *what, struct bench_stats *stats,
+                         double sec)
+{
+    if (stats->count == 0) {
+        return;
+    }
+
+    printf("  %-8s %9"PRIu64" %6"PRIu64" %10.1f %9.1f %9.1f %9.1f %10.1f\n",
+           what, stats->count, stats->unexpected, stats->count / sec,
+           bench_percentile(stats, 50) / 1000.0,
+           bench_percentile(stats, 99) / 1000.0,
+           bench_percentile(stats, 99.9) / 1000.0,
+           stats->max / 1000.0);
+}
+
+static void bench_merge(struct bench_stats *dst, struct bench_stats *src)
+{
+    size_t i;
+
+    dst->count += src->count;
+    dst->unexpected += src->unexpected;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+    for (i = 0; i < BENCH_BUCKETS; i++) {
+        dst->hist[i] += src->hist[i];
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    struct bench_opts opts = { 0 };
+    const char *pc_mix = DEFAULT_MIX;
+    int pc_no_memcache = 0;
+    struct bench_stats *stats;
+    struct bench_stats *total;
+    size_t stats_size;
+    uint64_t start;
+    double sec;
+    int start_pipe[2];
+    int failed = 0;
+    int status;
+    pid_t pid;
+    int i;
+    int j;
+
+    opts.prefix = "user";
+    opts.start = DEFAULT_START;
+    opts.stop = DEFAULT_STOP;
+    opts.id_base = DEFAULT_ID_BASE;
+    opts.requests = DEFAULT_REQUESTS;
+    opts.concurrency = DEFAULT_CONCURRENCY;
+    opts.hit_ratio = 100;
+    opts.seed = time(NULL);
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        { "prefix", '\0', POPT_ARG_STRING, &opts.prefix, 0,
+                    "The prefix of the user and group names", NULL },
+        { "start", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.start, 0,
+                    "The first number appended to the prefix", NULL },
+        { "stop", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.stop, 0,
+                    "The last number appended to the prefix", NULL },
+        { "id-base", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.id_base, 0,
+                    "The ID of <prefix>0", NULL },
+        { "mix", 'm', POPT_ARG_STRING | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_mix, 0,
+                    "Weights of pwnam, pwuid, grnam, grgid and initgr", NULL },
+        { "hit-ratio", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.hit_ratio, 0,
+                    "Percentage of lookups of existing objects", NULL },
+        { "requests", 'n', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.requests, 0,
+                    "Requests sent by each worker", NULL },
+        { "concurrency", 'c', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &opts.concurrency, 0,
+                    "Number of worker processes", NULL },
+        { "enum-every", '\0', POPT_ARG_INT, &opts.enum_every, 0,
+                    "Enumerate all users and groups every N requests", NULL },
+        { "no-memcache", '\0', POPT_ARG_NONE, &pc_no_memcache, 0,
+                    "Bypass the fast memory cache", NULL },
+        { "seed", '\0', POPT_ARG_INT, &opts.seed, 0,
+                    "Seed of the random choices", NULL },
+        POPT_TABLEEND
+    };
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+            default:
+                fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                        poptBadOption(pc, 0), poptStrerror(opt));
+                poptPrintUsage(pc, stderr, 0);
+                return 1;
+        }
+    }
+
+    if (opts.stop < opts.start || opts.requests <= 0
+            || opts.concurrency <= 0 || opts.hit_ratio < 0
+            || opts.hit_ratio > 100 || opts.enum_every < 0
+            || bench_parse_mix(pc_mix, &opts) != EOK) {
+        fprintf(stderr, "\nInvalid parameters\n\n");
+        poptPrintUsage(pc, stderr, 0);
+        poptFreeContext(pc);
+        return 1;
+    }
+    poptFreeContext(pc);
+
+    if (pc_no_memcache) {
+        /* read by the client library on every lookup */
+        setenv("SSS_NSS_USE_MEMCACHE", "NO", 1);
+    }
+
+    /* the workers write their results here, the last slot is the total */
+    stats_size = sizeof(struct bench_stats) * BENCH_OP_COUNT
+                 * (opts.concurrency + 1);
+    stats = mmap(NULL, stats_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    if (pipe(start_pipe) != 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    for (i = 0; i < opts.concurrency; i++) {
+        pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            return 1;
+        } else if (pid == 0) {
+            close(start_pipe[1]);
+            bench_worker(&opts, i, start_pipe[0],
+                         &stats[i * BENCH_OP_COUNT]);
+        }
+    }
+
+    /* closing the pipe starts all the workers at once */
+    close(start_pipe[0]);
+    start = bench_now();
+    close(start_pipe[1]);
+
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+    sec = (bench_now() - start) / 1000000000.0;
+
+    total = &stats[opts.concurrency * BENCH_OP_COUNT];
+    for (i = 0; i < opts.concurrency; i++) {
+        for (j = 0; j < BENCH_OP_COUNT; j++) {
+            bench_merge(&total[j], &stats[i * BENCH_OP_COUNT + j]);
+        }
+    }
+
+    printf("%d workers, %d requests each, %d%% hits, memory cache %s, "
+           "%.2f s\n", opts.concurrency, opts.requests, opts.hit_ratio,
+           pc_no_memcache ? "bypassed" : "used", sec);
+    printf("  %-8s %9s %6s %10s %9s %9s %9s %10s\n", "request", "count",
+           "unexp", "req/s", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (j = 0; j < BENCH_OP_COUNT; j++) {
+        bench_report(bench_op_names[j], &total[j], sec);
+    }
+
+    for (j = 1; j < BENCH_ENUM; j++) {
+        bench_merge(&total[0], &total[j]);
+    }
+    bench_report("all", &total[0], sec);
+
+    if (failed > 0) {
+        fprintf(stderr, "%d workers failed\n", failed);
+    }
+
+    munmap(stats, stats_size);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
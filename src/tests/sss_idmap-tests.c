@@ -812,6 +812,57 @@ START_TEST(idmap_test_sid2smb_sid)
 }
 END_TEST
 
+START_TEST(idmap_test_sid_parse_and_format)
+{
+    enum idmap_error_code err;
+    struct sss_idmap_sid sid;
+    struct sss_idmap_sid bin_sid;
+    struct sss_idmap_sid smb_sid;
+    struct sss_idmap_sid other_sid;
+    char buf[SSS_IDMAP_SID_STR_MAX];
+
+    err = sss_idmap_sid_parse(test_sid, &sid);
+    fail_unless(err == IDMAP_SUCCESS, "Failed to parse SID string.");
+
+    err = sss_idmap_bin_sid_parse(test_bin_sid, test_bin_sid_length, &bin_sid);
+    fail_unless(err == IDMAP_SUCCESS, "Failed to parse binary SID.");
+
+    err = sss_idmap_smb_sid_parse(&test_smb_sid, &smb_sid);
+    fail_unless(err == IDMAP_SUCCESS, "Failed to parse samba dom_sid.");
+
+    fail_unless(sss_idmap_sid_cmp(&sid, &bin_sid) == 0,
+                "SID string and binary SID do not match.");
+    fail_unless(sss_idmap_sid_cmp(&sid, &smb_sid) == 0,
+                "SID string and samba dom_sid do not match.");
+
+    err = sss_idmap_sid_format(&bin_sid, buf, sizeof(buf));
+    fail_unless(err == IDMAP_SUCCESS, "Failed to format SID.");
+    fail_unless(strcmp(buf, test_sid) == 0, "SID strings do not match, "
+                                            "expected [%s], get [%s]",
+                                            test_sid, buf);
+
+    err = sss_idmap_sid_format(&bin_sid, buf, 10);
+    fail_unless(err == IDMAP_ERROR,
+                "Formatting into a too small buffer did not fail.");
+
+    err = sss_idmap_bin_sid_parse(test_bin_sid, test_bin_sid_length - 1,
+                                  &other_sid);
+    fail_unless(err == IDMAP_SID_INVALID,
+                "Parsing a truncated binary SID did not fail.");
+
+    err = sss_idmap_sid_parse(too_large_sid, &other_sid);
+    fail_unless(err == IDMAP_SID_INVALID,
+                "Parsing a SID with a too large component did not fail.");
+
+    err = sss_idmap_sid_parse(large_sid, &other_sid);
+    fail_unless(err == IDMAP_SUCCESS, "Failed to parse SID string.");
+    fail_unless(sss_idmap_sid_cmp(&sid, &other_sid) != 0,
+                "Different SIDs compare equal.");
+    fail_unless(sss_idmap_sid_cmp(&sid, &other_sid)
+                    == -sss_idmap_sid_cmp(&other_sid, &sid),
+                "SID comparison is not antisymmetric.");
+}
+END_TEST
 
 Suite *idmap_test_suite (void)
 {
@@ -860,6 +911,7 @@ Suite *idmap_test_suite (void)
     tcase_add_test(tc_conv, idmap_test_smb_sid2sid);
     tcase_add_test(tc_conv, idmap_test_sid2smb_sid);
     tcase_add_test(tc_conv, idmap_test_large_and_too_large_sid);
+    tcase_add_test(tc_conv, idmap_test_sid_parse_and_format);
 
     suite_add_tcase(s, tc_conv);
 
@@ -0,0 +1,577 @@
+/*
+   SSSD
+
+   Benchmark of the common sysdb operations on a synthetic domain
+
+   Copyright (C) Red Hat 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <talloc.h>
+#include <popt.h>
+#include <sys/time.h>
+
+#include "util/util.h"
+#include "db/sysdb.h"
+#include "tests/common.h"
+
+/* Populates a domain with users and groups and times storing them one by
+ * one and in bulk, membership updates, initgroups, enumeration and the
+ * removal of the whole domain. The groups are split in --depth levels,
+ * the users are members of the groups of the first level and each group
+ * of the other levels contains the group below it. Not run by
+ * "make check", run it with LDB_MODULES_PATH pointing to the built
+ * memberof module. */
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "sysdb_bench_conf.ldb"
+#define TEST_DOM_NAME "sysdb_bench"
+#define TEST_ID_PROVIDER "ldap"
+
+#define DEFAULT_USERS 10000
+#define DEFAULT_GROUPS 1000
+#define DEFAULT_DEPTH 3
+#define DEFAULT_GHOSTS 10
+#define DEFAULT_SAMPLES 1000
+
+#define BENCH_UID_BASE 100000
+#define BENCH_GID_BASE 50000
+#define BENCH_CACHE_TIMEOUT 3600
+
+struct bench_ctx {
+    struct sss_test_ctx *tctx;
+    int num_users;
+    int num_groups;
+    int depth;
+    int num_ghosts;
+    int samples;
+
+    /* number of groups in each level */
+    int per_level;
+
+    char **users;
+    char **groups;
+    struct sysdb_attrs **group_attrs;
+};
+
+static double bench_msec(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000.0
+           + (now.tv_usec - start->tv_usec) / 1000.0;
+}
+
+static errno_t bench_names(struct bench_ctx *bctx)
+{
+    int i;
+
+    bctx->users = talloc_array(bctx, char *, bctx->num_users);
+    bctx->groups = talloc_array(bctx, char *, bctx->num_groups);
+    if (bctx->users == NULL || bctx->groups == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < bctx->num_users; i++) {
+        bctx->users[i] = talloc_asprintf(bctx->users, "bench_user%d", i);
+        if (bctx->users[i] == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    for (i = 0; i < bctx->num_groups; i++) {
+        bctx->groups[i] = talloc_asprintf(bctx->groups, "bench_group%d", i);
+        if (bctx->groups[i] == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t bench_add_member_dn(struct sysdb_attrs *attrs,
+                                   const char *domname,
+                                   const char *name, bool group)
+{
+    char *dn;
+
+    if (group) {
+        dn = sysdb_group_strdn(attrs, domname, name);
+    } else {
+        dn = sysdb_user_strdn(attrs, domname, name);
+    }
+    if (dn == NULL) {
+        return ENOMEM;
+    }
+
+    return sysdb_attrs_steal_string(attrs, SYSDB_MEMBER, dn);
+}
+
+/* Storing a group adds to its attrs, they are built again before each
+ * step which stores the groups. */
+static errno_t bench_group_attrs(struct bench_ctx *bctx)
+{
+    const char *domname = bctx->tctx->dom->name;
+    struct sysdb_attrs *attrs;
+    char *ghost;
+    errno_t ret;
+    int i;
+    int j;
+
+    talloc_free(bctx->group_attrs);
+    bctx->group_attrs = talloc_array(bctx, struct sysdb_attrs *,
+                                     bctx->num_groups);
+    if (bctx->group_attrs == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < bctx->num_groups; i++) {
+        attrs = sysdb_new_attrs(bctx->group_attrs);
+        if (attrs == NULL) {
+            return ENOMEM;
+        }
+        bctx->group_attrs[i] = attrs;
+
+        if (i < bctx->per_level) {
+            for (j = i; j < bctx->num_users; j += bctx->per_level) {
+                ret = bench_add_member_dn(attrs, domname, bctx->users[j],
+                                          false);
+                if (ret != EOK) {
+                    return ret;
+                }
+            }
+        } else {
+            ret = bench_add_member_dn(attrs, domname,
+                                      bctx->groups[i - bctx->per_level],
+                                      true);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+
+        for (j = 0; j < bctx->num_ghosts; j++) {
+            ghost = talloc_asprintf(attrs, "bench_ghost%d_%d", i, j);
+            if (ghost == NULL) {
+                return ENOMEM;
+            }
+
+            ret = sysdb_attrs_steal_string(attrs, SYSDB_GHOST, ghost);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t bench_store_users(struct bench_ctx *bctx, size_t *_count)
+{
+    time_t now = time(NULL);
+    errno_t ret;
+    int i;
+
+    for (i = 0; i < bctx->num_users; i++) {
+        ret = sysdb_store_user(bctx->tctx->dom, bctx->users[i], NULL,
+                               BENCH_UID_BASE + i, BENCH_GID_BASE, NULL,
+                               "/", "/bin/sh", NULL, NULL, NULL,
+                               BENCH_CACHE_TIMEOUT, now);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    *_count = bctx->num_users;
+    return EOK;
+}
+
+/* The groups are stored from the first level up so that the members of
+ * each group already exist. */
+static errno_t bench_store_groups(struct bench_ctx *bctx, size_t *_count)
+{
+    time_t now = time(NULL);
+    errno_t ret;
+    int i;
+
+    for (i = 0; i < bctx->num_groups; i++) {
+        ret = sysdb_store_group(bctx->tctx->dom, bctx->groups[i],
+                                BENCH_GID_BASE + 1 + i, bctx->group_attrs[i],
+                                BENCH_CACHE_TIMEOUT, now);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    *_count = bctx->num_groups;
+    return EOK;
+}
+
+static errno_t bench_store_users_bulk(struct bench_ctx *bctx, size_t *_count)
+{
+    struct sysdb_bulk_user *users;
+    errno_t ret;
+    int i;
+
+    users = talloc_zero_array(bctx, struct sysdb_bulk_user, bctx->num_users);
+    if (users == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < bctx->num_users; i++) {
+        users[i].name = bctx->users[i];
+        users[i].uid = BENCH_UID_BASE + i;
+        users[i].gid = BENCH_GID_BASE;
+        users[i].homedir = "/";
+        users[i].shell = "/bin/sh";
+    }
+
+    ret = sysdb_store_users_bulk(bctx->tctx->dom, users, bctx->num_users,
+                                 BENCH_CACHE_TIMEOUT, time(NULL));
+    for (i = 0; ret == EOK && i < bctx->num_users; i++) {
+        ret = users[i].ret;
+    }
+
+    talloc_free(users);
+    *_count = bctx->num_users;
+    return ret;
+}
+
+static errno_t bench_store_groups_bulk(struct bench_ctx *bctx,
+                                       size_t *_count)
+{
+    struct sysdb_bulk_group *groups;
+    errno_t ret;
+    int i;
+
+    groups = talloc_zero_array(bctx, struct sysdb_bulk_group,
+                               bctx->num_groups);
+    if (groups == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < bctx->num_groups; i++) {
+        groups[i].name = bctx->groups[i];
+        groups[i].gid = BENCH_GID_BASE + 1 + i;
+        groups[i].attrs = bctx->group_attrs[i];
+    }
+
+    ret = sysdb_store_groups_bulk(bctx->tctx->dom, groups, bctx->num_groups,
+                                  BENCH_CACHE_TIMEOUT, time(NULL));
+    for (i = 0; ret == EOK && i < bctx->num_groups; i++) {
+        ret = groups[i].ret;
+    }
+
+    talloc_free(groups);
+    *_count = bctx->num_groups;
+    return ret;
+}
+
+/* Adds a user to a group of the first level and removes it again, the
+ * memberof plugin updates all the levels above. */
+static errno_t bench_update_members(struct bench_ctx *bctx, size_t *_count)
+{
+    const char *group;
+    const char *user;
+    errno_t ret;
+    int u;
+    int g;
+    int i;
+
+    for (i = 0; i < bctx->samples; i++) {
+        u = i % bctx->num_users;
+        g = (i + 1) % bctx->per_level;
+        if (g == u % bctx->per_level) {
+            /* already a member */
+            continue;
+        }
+        user = bctx->users[u];
+        group = bctx->groups[g];
+
+        ret = sysdb_add_group_member(bctx->tctx->dom, group, user,
+                                     SYSDB_MEMBER_USER, false);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sysdb_remove_group_member(bctx->tctx->dom, group, user,
+                                        SYSDB_MEMBER_USER, false);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        *_count += 2;
+    }
+
+    return EOK;
+}
+
+static errno_t bench_initgroups(struct bench_ctx *bctx, size_t *_count)
+{
+    struct ldb_result *res;
+    errno_t ret;
+    int i;
+
+    for (i = 0; i < bctx->samples; i++) {
+        ret = sysdb_initgroups_with_views(bctx, bctx->tctx->dom,
+                                          bctx->users[i % bctx->num_users],
+                                          &res);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        /* the user and one group of each level */
+        if (res->count != 1 + bctx->depth) {
+            talloc_free(res);
+            return EINVAL;
+        }
+
+        talloc_free(res);
+    }
+
+    *_count = bctx->samples;
+    return EOK;
+}
+
+static errno_t bench_enum_users(struct bench_ctx *bctx, size_t *_count)
+{
+    struct ldb_result *res;
+    errno_t ret;
+
+    ret = sysdb_enumpwent_with_views(bctx, bctx->tctx->dom, &res);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    *_count = res->count;
+    talloc_free(res);
+    return EOK;
+}
+
+static errno_t bench_enum_groups(struct bench_ctx *bctx, size_t *_count)
+{
+    struct ldb_result *res;
+    errno_t ret;
+
+    ret = sysdb_enumgrent_with_views(bctx, bctx->tctx->dom, &res);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    *_count = res->count;
+    talloc_free(res);
+    return EOK;
+}
+
+/* The groups are deleted from the top so that the memberof plugin has the
+ * fewest parents to update. */
+static errno_t bench_delete_groups(struct bench_ctx *bctx, size_t *_count)
+{
+    errno_t ret;
+    int i;
+
+    for (i = bctx->num_groups - 1; i >= 0; i--) {
+        ret = sysdb_delete_group(bctx->tctx->dom, bctx->groups[i], 0);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    *_count = bctx->num_groups;
+    return EOK;
+}
+
+static errno_t bench_delete_users(struct bench_ctx *bctx, size_t *_count)
+{
+    errno_t ret;
+    int i;
+
+    for (i = 0; i < bctx->num_users; i++) {
+        ret = sysdb_delete_user(bctx->tctx->dom, bctx->users[i], 0);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    *_count = bctx->num_users;
+    return EOK;
+}
+
+struct bench_step {
+    const char *name;
+    /* not timed */
+    errno_t (*prepare)(struct bench_ctx *bctx);
+    errno_t (*fn)(struct bench_ctx *bctx, size_t *_count);
+};
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    int pc_users = DEFAULT_USERS;
+    int pc_groups = DEFAULT_GROUPS;
+    int pc_depth = DEFAULT_DEPTH;
+    int pc_ghosts = DEFAULT_GHOSTS;
+    int pc_samples = DEFAULT_SAMPLES;
+    int pc_csv = 0;
+    int no_cleanup = 0;
+    struct bench_ctx *bctx;
+    struct timeval start;
+    size_t count;
+    double msec;
+    errno_t ret;
+    int i;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "users", 'u', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_users, 0, "Number of users", NULL },
+        { "groups", 'g', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_groups, 0, "Number of groups", NULL },
+        { "depth", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_depth, 0, "Number of levels of nested groups", NULL },
+        { "ghosts", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_ghosts, 0, "Number of ghost members of each group",
+                    NULL },
+        { "samples", 's', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_samples, 0,
+                    "Number of membership updates and initgroups", NULL },
+        { "csv", '\0', POPT_ARG_NONE, &pc_csv, 0,
+                    "Print the results as comma separated values", NULL },
+        { "no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+                    "Do not delete the cache after the run", NULL },
+        POPT_TABLEEND
+    };
+
+    struct bench_step steps[] = {
+        { "store_users", NULL, bench_store_users },
+        { "store_groups", bench_group_attrs, bench_store_groups },
+        { "store_users_bulk", NULL, bench_store_users_bulk },
+        { "store_groups_bulk", bench_group_attrs, bench_store_groups_bulk },
+        { "update_members", NULL, bench_update_members },
+        { "initgroups", NULL, bench_initgroups },
+        { "enum_users", NULL, bench_enum_users },
+        { "enum_groups", NULL, bench_enum_groups },
+        { "delete_groups", NULL, bench_delete_groups },
+        { "delete_users", NULL, bench_delete_users },
+        { NULL, NULL, NULL }
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_users < 1 || pc_depth < 1 || pc_groups < pc_depth
+            || pc_ghosts < 0 || pc_samples < 0) {
+        fprintf(stderr, "There must be at least one user and at least as "
+                        "many groups as levels\n");
+        return 1;
+    }
+
+    if (!ldb_modules_path_is_set()) {
+        fprintf(stderr, "Warning: LDB_MODULES_PATH is not set, "
+                        "the installed memberof module is used.\n");
+    }
+
+    tests_set_cwd();
+    test_dom_suite_setup(TESTS_PATH);
+
+    bctx = talloc_zero(NULL, struct bench_ctx);
+    if (bctx == NULL) {
+        return 1;
+    }
+    bctx->num_users = pc_users;
+    bctx->depth = pc_depth;
+    bctx->num_ghosts = pc_ghosts;
+    bctx->samples = pc_samples;
+    bctx->per_level = pc_groups / pc_depth;
+    /* every level has the same number of groups */
+    bctx->num_groups = bctx->per_level * pc_depth;
+
+    bctx->tctx = create_dom_test_ctx(bctx, TESTS_PATH, TEST_CONF_DB,
+                                     TEST_DOM_NAME, TEST_ID_PROVIDER, NULL);
+    if (bctx->tctx == NULL) {
+        fprintf(stderr, "Unable to set up the cache\n");
+        ret = EIO;
+        goto done;
+    }
+
+    ret = bench_names(bctx);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (pc_csv) {
+        printf("step,users,groups,depth,ghosts,count,msec,usec_per_op\n");
+    } else {
+        printf("%d users, %d groups in %d levels, %d ghosts per group\n",
+               bctx->num_users, bctx->num_groups, bctx->depth,
+               bctx->num_ghosts);
+    }
+
+    for (i = 0; steps[i].name != NULL; i++) {
+        if (steps[i].prepare != NULL) {
+            ret = steps[i].prepare(bctx);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+
+        count = 0;
+        gettimeofday(&start, NULL);
+
+        ret = steps[i].fn(bctx, &count);
+        if (ret != EOK) {
+            fprintf(stderr, "%s failed [%d]: %s\n",
+                    steps[i].name, ret, sss_strerror(ret));
+            goto done;
+        }
+
+        msec = bench_msec(&start);
+        if (pc_csv) {
+            printf("%s,%d,%d,%d,%d,%zu,%.1f,%.1f\n", steps[i].name,
+                   bctx->num_users, bctx->num_groups, bctx->depth,
+                   bctx->num_ghosts, count, msec,
+                   count > 0 ? msec * 1000.0 / count : 0.0);
+        } else {
+            printf("%-20s %8zu ops %12.1f ms %10.1f us/op\n", steps[i].name,
+                   count, msec, count > 0 ? msec * 1000.0 / count : 0.0);
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(bctx);
+    if (!no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return ret == EOK ? 0 : 1;
+}
@@ -3815,6 +3815,504 @@ done:
 }
 END_TEST
 
+START_TEST(test_sysdb_store_bulk)
+{
+    struct sysdb_test_ctx *test_ctx;
+    struct sysdb_bulk_user users[2];
+    struct sysdb_bulk_group groups[2];
+    const char *remove_attrs[] = { SYSDB_GECOS, NULL };
+    struct ldb_result *res;
+    const char *str;
+    errno_t ret;
+
+    /* Setup */
+    ret = setup_sysdb_tests(&test_ctx);
+    fail_unless(ret == EOK, "Could not set up the test");
+
+    ret = sysdb_store_user(test_ctx->domain, "bulkuser1", NULL, 38101, 0,
+                           "Bulk User", "/home/bulkuser1", "/bin/sh",
+                           NULL, NULL, NULL, 0, 0);
+    fail_unless(ret == EOK, "Could not add the first user");
+
+    /* update the existing user and add a new one */
+    memset(users, 0, sizeof(users));
+    users[0].name = "bulkuser1";
+    users[0].uid = 38101;
+    users[0].homedir = "/home/bulkuser1";
+    users[0].shell = "/bin/bash";
+    users[0].remove_attrs = discard_const(remove_attrs);
+    users[1].name = "bulkuser2";
+    users[1].uid = 38102;
+    users[1].homedir = "/home/bulkuser2";
+    users[1].shell = "/bin/sh";
+
+    ret = sysdb_store_users_bulk(test_ctx->domain, users, 2, 0, 0);
+    fail_unless(ret == EOK, "sysdb_store_users_bulk failed");
+    fail_unless(users[0].ret == EOK, "Could not update the first user");
+    fail_unless(users[1].ret == EOK, "Could not add the second user");
+
+    ret = sysdb_getpwnam(test_ctx, test_ctx->domain, "bulkuser1", &res);
+    fail_unless(ret == EOK && res->count == 1,
+                "Could not retrieve the first user from cache");
+    str = ldb_msg_find_attr_as_string(res->msgs[0], SYSDB_SHELL, NULL);
+    fail_unless(str != NULL && strcmp(str, "/bin/bash") == 0,
+                "Unexpected shell [%s]", str);
+    str = ldb_msg_find_attr_as_string(res->msgs[0], SYSDB_GECOS, NULL);
+    fail_unless(str == NULL, "The gecos was not removed");
+
+    ret = sysdb_getpwuid(test_ctx, test_ctx->domain, 38102, &res);
+    fail_unless(ret == EOK && res->count == 1,
+                "Could not retrieve the second user from cache");
+    str = ldb_msg_find_attr_as_string(res->msgs[0], SYSDB_NAME, NULL);
+    fail_unless(str != NULL && strcmp(str, "bulkuser2") == 0,
+                "Unexpected name [%s]", str);
+
+    memset(groups, 0, sizeof(groups));
+    groups[0].name = "bulkgroup1";
+    groups[0].gid = 38111;
+    groups[1].name = "bulkgroup2";
+    groups[1].gid = 38112;
+
+    ret = sysdb_store_groups_bulk(test_ctx->domain, groups, 2, 0, 0);
+    fail_unless(ret == EOK, "sysdb_store_groups_bulk failed");
+    fail_unless(groups[0].ret == EOK && groups[1].ret == EOK,
+                "Could not add the groups");
+
+    ret = sysdb_getgrgid(test_ctx, test_ctx->domain, 38112, &res);
+    fail_unless(ret == EOK && res->count == 1,
+                "Could not retrieve the group from cache");
+    str = ldb_msg_find_attr_as_string(res->msgs[0], SYSDB_NAME, NULL);
+    fail_unless(str != NULL && strcmp(str, "bulkgroup2") == 0,
+                "Unexpected name [%s]", str);
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
+START_TEST(test_sysdb_group_ghosts)
+{
+    struct sysdb_test_ctx *test_ctx;
+    struct sysdb_attrs *attrs;
+    struct ldb_message_element *el;
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    const char *ghost_attrs[] = { SYSDB_GHOST, NULL };
+    char *ghost;
+    errno_t ret;
+    int i;
+
+    /* Setup */
+    ret = setup_sysdb_tests(&test_ctx);
+    fail_unless(ret == EOK, "Could not set up the test");
+
+    attrs = sysdb_new_attrs(test_ctx);
+    fail_unless(attrs != NULL, "Out of memory");
+
+    /* more ghosts than there are buckets, with a duplicate */
+    for (i = 0; i < 100; i++) {
+        ghost = talloc_asprintf(attrs, "ghostmember%d", i % 99);
+        fail_unless(ghost != NULL, "Out of memory");
+        ret = sysdb_attrs_steal_string(attrs, SYSDB_GHOST, ghost);
+        fail_unless(ret == EOK, "Cannot add attr");
+    }
+
+    ret = sysdb_store_group(test_ctx->domain, "ghostgroup", 38121, attrs,
+                            0, 0);
+    fail_unless(ret == EOK, "Could not store the group");
+
+    ret = sysdb_search_group_by_name(test_ctx, test_ctx->domain, "ghostgroup",
+                                     ghost_attrs, &msg);
+    fail_unless(ret == EOK, "Could not retrieve the group");
+    el = ldb_msg_find_element(msg, SYSDB_GHOST);
+    fail_unless(el != NULL && el->num_values == 99,
+                "Expected 99 ghost members, got %d",
+                el ? el->num_values : 0);
+
+    ret = sysdb_getgrnam(test_ctx, test_ctx->domain, "ghostgroup", &res);
+    fail_unless(ret == EOK && res->count == 1, "sysdb_getgrnam failed");
+    el = ldb_msg_find_element(res->msgs[0], SYSDB_GHOST);
+    fail_unless(el != NULL && el->num_values == 99,
+                "Expected 99 ghost members, got %d",
+                el ? el->num_values : 0);
+
+    /* the ghost members are removed with the group */
+    ret = sysdb_delete_group(test_ctx->domain, "ghostgroup", 0);
+    fail_unless(ret == EOK, "Could not delete the group");
+
+    ret = sysdb_store_group(test_ctx->domain, "ghostgroup", 38121, NULL,
+                            0, 0);
+    fail_unless(ret == EOK, "Could not store the group again");
+
+    ret = sysdb_search_group_by_name(test_ctx, test_ctx->domain, "ghostgroup",
+                                     ghost_attrs, &msg);
+    fail_unless(ret == EOK, "Could not retrieve the group");
+    fail_unless(ldb_msg_find_element(msg, SYSDB_GHOST) == NULL,
+                "Stray ghost members");
+
+    ret = sysdb_delete_group(test_ctx->domain, "ghostgroup", 0);
+    fail_unless(ret == EOK, "Could not delete the group");
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
+/* UPGRADE_CHUNK of sysdb_upgrade.c */
+#define UPGRADE_TEST_CHUNK 1000
+#define UPGRADE_TEST_GROUPS 1500
+#define UPGRADE_TEST_GID_BASE 40000
+
+static errno_t upgrade_test_set_base(struct sysdb_test_ctx *test_ctx,
+                                     const char *attr, const char *value)
+{
+    struct ldb_message *msg;
+    int ret;
+
+    msg = ldb_msg_new(test_ctx);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    msg->dn = ldb_dn_new(msg, test_ctx->sysdb->ldb, SYSDB_BASE);
+    if (msg->dn == NULL) {
+        talloc_free(msg);
+        return ENOMEM;
+    }
+
+    ret = ldb_msg_add_empty(msg, attr, LDB_FLAG_MOD_REPLACE, NULL);
+    if (ret == LDB_SUCCESS) {
+        ret = ldb_msg_add_string(msg, attr, value);
+    }
+    if (ret == LDB_SUCCESS) {
+        ret = ldb_modify(test_ctx->sysdb->ldb, msg);
+    }
+
+    talloc_free(msg);
+    return sysdb_error_to_errno(ret);
+}
+
+static const char *upgrade_test_indexes[] = { SYSDB_UUID, SYSDB_USER_CERT,
+                                               SYSDB_UPN, SYSDB_CANONICAL_UPN,
+                                               SYSDB_GHOST, NULL };
+
+static bool upgrade_test_has_index(struct sysdb_test_ctx *test_ctx,
+                                   const char *attr)
+{
+    const char *attrs[] = { "@IDXATTR", NULL };
+    struct ldb_message_element *el;
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    bool found = false;
+    unsigned int i;
+    int ret;
+
+    dn = ldb_dn_new(test_ctx, test_ctx->sysdb->ldb, "@INDEXLIST");
+    fail_unless(dn != NULL, "Out of memory");
+
+    ret = ldb_search(test_ctx->sysdb->ldb, test_ctx, &res, dn,
+                     LDB_SCOPE_BASE, attrs, NULL);
+    fail_unless(ret == LDB_SUCCESS && res->count == 1,
+                "Could not read the indexes");
+
+    el = ldb_msg_find_element(res->msgs[0], "@IDXATTR");
+    for (i = 0; el != NULL && i < el->num_values; i++) {
+        if (strcasecmp((const char *)el->values[i].data, attr) == 0) {
+            found = true;
+        }
+    }
+
+    talloc_free(res);
+    talloc_free(dn);
+    return found;
+}
+
+START_TEST(test_sysdb_upgrade_17_indexes)
+{
+    struct sysdb_test_ctx *test_ctx;
+    struct ldb_message *msg;
+    const char *ver;
+    int ret;
+    int i;
+
+    /* Setup */
+    ret = setup_sysdb_tests(&test_ctx);
+    fail_unless(ret == EOK, "Could not set up the test");
+
+    /* a new cache has the indexes */
+    for (i = 0; upgrade_test_indexes[i] != NULL; i++) {
+        fail_unless(upgrade_test_has_index(test_ctx, upgrade_test_indexes[i]),
+                    "No index for %s", upgrade_test_indexes[i]);
+    }
+
+    /* a 0.17 cache does not */
+    msg = ldb_msg_new(test_ctx);
+    fail_unless(msg != NULL, "Out of memory");
+    msg->dn = ldb_dn_new(msg, test_ctx->sysdb->ldb, "@INDEXLIST");
+    fail_unless(msg->dn != NULL, "Out of memory");
+    ret = ldb_msg_add_empty(msg, "@IDXATTR", LDB_FLAG_MOD_DELETE, NULL);
+    fail_unless(ret == LDB_SUCCESS, "Out of memory");
+    for (i = 0; upgrade_test_indexes[i] != NULL; i++) {
+        ret = ldb_msg_add_string(msg, "@IDXATTR", upgrade_test_indexes[i]);
+        fail_unless(ret == LDB_SUCCESS, "Out of memory");
+    }
+    ret = ldb_modify(test_ctx->sysdb->ldb, msg);
+    fail_unless(ret == LDB_SUCCESS, "Could not remove the indexes");
+    talloc_free(msg);
+
+    for (i = 0; upgrade_test_indexes[i] != NULL; i++) {
+        fail_if(upgrade_test_has_index(test_ctx, upgrade_test_indexes[i]),
+                "Index for %s not removed", upgrade_test_indexes[i]);
+    }
+
+    ret = upgrade_test_set_base(test_ctx, "version", SYSDB_VERSION_0_17);
+    fail_unless(ret == EOK, "Could not set the version");
+
+    ret = sysdb_upgrade_17(test_ctx->sysdb, &ver);
+    fail_unless(ret == EOK, "The upgrade failed [%d]: %s",
+                ret, sss_strerror(ret));
+    ck_assert_str_eq(ver, SYSDB_VERSION_0_18);
+
+    for (i = 0; upgrade_test_indexes[i] != NULL; i++) {
+        fail_unless(upgrade_test_has_index(test_ctx, upgrade_test_indexes[i]),
+                    "Upgrade did not add the index for %s",
+                    upgrade_test_indexes[i]);
+    }
+
+    /* Cleanup */
+    ret = upgrade_test_set_base(test_ctx, "version", SYSDB_VERSION);
+    fail_unless(ret == EOK, "Could not restore the version");
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
+START_TEST(test_sysdb_upgrade_18_resume)
+{
+    struct sysdb_test_ctx *test_ctx;
+    struct ldb_message_element *el;
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    struct ldb_dn *base_dn;
+    const char *ghost_attrs[] = { SYSDB_GHOST, NULL };
+    const char *base_attrs[] = { "upgradeCheckpoint", NULL };
+    const char *ver;
+    char *name;
+    int ret;
+    int i;
+
+    /* Setup */
+    ret = setup_sysdb_tests(&test_ctx);
+    fail_unless(ret == EOK, "Could not set up the test");
+
+    /* groups of a 0.18 cache keep their ghost members in the entry, the
+     * names have the same length so that the upgrade sorts them by number */
+    ret = sysdb_transaction_start(test_ctx->sysdb);
+    fail_unless(ret == EOK, "Could not start the transaction");
+
+    for (i = 0; i < UPGRADE_TEST_GROUPS; i++) {
+        msg = ldb_msg_new(test_ctx);
+        fail_unless(msg != NULL, "Out of memory");
+
+        name = talloc_asprintf(msg, "upgradegroup%04d", i);
+        fail_unless(name != NULL, "Out of memory");
+        msg->dn = sysdb_group_dn(msg, test_ctx->domain, name);
+        fail_unless(msg->dn != NULL, "Out of memory");
+
+        ret = ldb_msg_add_string(msg, SYSDB_OBJECTCLASS, SYSDB_GROUP_CLASS);
+        fail_unless(ret == LDB_SUCCESS, "Out of memory");
+        ret = ldb_msg_add_string(msg, SYSDB_NAME, name);
+        fail_unless(ret == LDB_SUCCESS, "Out of memory");
+        ret = ldb_msg_add_fmt(msg, SYSDB_GIDNUM, "%d",
+                              UPGRADE_TEST_GID_BASE + i);
+        fail_unless(ret == LDB_SUCCESS, "Out of memory");
+        ret = ldb_msg_add_fmt(msg, SYSDB_GHOST, "upgradeghost%04da", i);
+        fail_unless(ret == LDB_SUCCESS, "Out of memory");
+        ret = ldb_msg_add_fmt(msg, SYSDB_GHOST, "upgradeghost%04db", i);
+        fail_unless(ret == LDB_SUCCESS, "Out of memory");
+
+        ret = ldb_add(test_ctx->sysdb->ldb, msg);
+        fail_unless(ret == LDB_SUCCESS, "Could not add group %d: %s",
+                    i, ldb_strerror(ret));
+
+        /* an interrupted run committed the first chunk, the converted
+         * groups still have the attribute until the second step */
+        if (i < UPGRADE_TEST_CHUNK) {
+            el = ldb_msg_find_element(msg, SYSDB_GHOST);
+            ret = sysdb_ghosts_modify(test_ctx->sysdb, msg->dn, el,
+                                      SYSDB_MOD_REP);
+            fail_unless(ret == EOK, "Could not convert group %d", i);
+        }
+
+        talloc_free(msg);
+    }
+
+    /* would be moved to the buckets if the first chunk ran again */
+    msg = ldb_msg_new(test_ctx);
+    fail_unless(msg != NULL, "Out of memory");
+    msg->dn = sysdb_group_dn(msg, test_ctx->domain, "upgradegroup0000");
+    fail_unless(msg->dn != NULL, "Out of memory");
+    ret = ldb_msg_add_empty(msg, SYSDB_GHOST, LDB_FLAG_MOD_ADD, NULL);
+    fail_unless(ret == LDB_SUCCESS, "Out of memory");
+    ret = ldb_msg_add_string(msg, SYSDB_GHOST, "upgradeghostagain");
+    fail_unless(ret == LDB_SUCCESS, "Out of memory");
+    ret = ldb_modify(test_ctx->sysdb->ldb, msg);
+    fail_unless(ret == LDB_SUCCESS, "Could not add the ghost member");
+    talloc_free(msg);
+
+    ret = upgrade_test_set_base(test_ctx, "upgradeCheckpoint",
+                                talloc_asprintf(test_ctx, "%s:0:%d",
+                                                SYSDB_VERSION_0_19,
+                                                UPGRADE_TEST_CHUNK));
+    fail_unless(ret == EOK, "Could not set the checkpoint");
+
+    ret = sysdb_transaction_commit(test_ctx->sysdb);
+    fail_unless(ret == EOK, "Could not commit the transaction");
+
+    /* resumed at the second chunk */
+    ret = sysdb_upgrade_18(test_ctx->sysdb, &ver);
+    fail_unless(ret == EOK, "The upgrade failed [%d]: %s",
+                ret, sss_strerror(ret));
+    ck_assert_str_eq(ver, SYSDB_VERSION_0_19);
+
+    base_dn = ldb_dn_new(test_ctx, test_ctx->sysdb->ldb, SYSDB_BASE);
+    fail_unless(base_dn != NULL, "Out of memory");
+
+    ret = ldb_search(test_ctx->sysdb->ldb, test_ctx, &res, base_dn,
+                     LDB_SCOPE_SUBTREE, ghost_attrs,
+                     "(&("SYSDB_GC")("SYSDB_GHOST"=*))");
+    fail_unless(ret == LDB_SUCCESS, "Search failed");
+    fail_unless(res->count == 0,
+                "%u groups kept the ghost attribute", res->count);
+    talloc_free(res);
+
+    for (i = 0; i < UPGRADE_TEST_GROUPS; i++) {
+        ret = sysdb_search_group_by_gid(test_ctx, test_ctx->domain,
+                                        UPGRADE_TEST_GID_BASE + i,
+                                        ghost_attrs, &msg);
+        fail_unless(ret == EOK, "Could not retrieve group %d", i);
+
+        el = ldb_msg_find_element(msg, SYSDB_GHOST);
+        fail_unless(el != NULL && el->num_values == 2,
+                    "Expected 2 ghost members of group %d, got %d",
+                    i, el ? el->num_values : 0);
+        ck_assert_str_eq((const char *)el->values[0].data,
+                         talloc_asprintf(msg, "upgradeghost%04da", i));
+        ck_assert_str_eq((const char *)el->values[1].data,
+                         talloc_asprintf(msg, "upgradeghost%04db", i));
+        talloc_free(msg);
+    }
+
+    /* the checkpoint is dropped with the version update */
+    ret = ldb_search(test_ctx->sysdb->ldb, test_ctx, &res, base_dn,
+                     LDB_SCOPE_BASE, base_attrs, NULL);
+    fail_unless(ret == LDB_SUCCESS && res->count == 1, "Search failed");
+    fail_unless(ldb_msg_find_element(res->msgs[0],
+                                     "upgradeCheckpoint") == NULL,
+                "The checkpoint was not removed");
+    talloc_free(res);
+
+    /* Cleanup */
+    ret = upgrade_test_set_base(test_ctx, "version", SYSDB_VERSION);
+    fail_unless(ret == EOK, "Could not restore the version");
+
+    for (i = 0; i < UPGRADE_TEST_GROUPS; i++) {
+        name = talloc_asprintf(test_ctx, "upgradegroup%04d", i);
+        fail_unless(name != NULL, "Out of memory");
+        ret = sysdb_delete_group(test_ctx->domain, name, 0);
+        fail_unless(ret == EOK, "Could not delete group %d", i);
+        talloc_free(name);
+    }
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
+START_TEST(test_sysdb_initgr_gids)
+{
+    struct sysdb_test_ctx *test_ctx;
+    struct sysdb_attrs *attrs;
+    struct ldb_result *res;
+    gid_t *gids;
+    size_t num_gids;
+    errno_t ret;
+
+    /* Setup */
+    ret = setup_sysdb_tests(&test_ctx);
+    fail_unless(ret == EOK, "Could not set up the test");
+
+    ret = sysdb_store_user(test_ctx->domain, "initgruser", NULL, 38201, 0,
+                           "initgr user", "/home/initgruser", "/bin/bash",
+                           NULL, NULL, NULL, 0, 0);
+    fail_unless(ret == EOK, "Could not store the user");
+
+    ret = sysdb_store_group(test_ctx->domain, "initgrgroup1", 38202, NULL,
+                            0, 0);
+    fail_unless(ret == EOK, "Could not store the group");
+
+    ret = sysdb_store_group(test_ctx->domain, "initgrgroup2", 38203, NULL,
+                            0, 0);
+    fail_unless(ret == EOK, "Could not store the group");
+
+    ret = sysdb_add_group_member(test_ctx->domain, "initgrgroup1",
+                                 "initgruser", SYSDB_MEMBER_USER, false);
+    fail_unless(ret == EOK, "Could not add the member");
+
+    /* nothing stored yet */
+    ret = sysdb_initgroups_gids(test_ctx, test_ctx->domain, "initgruser",
+                                &res, &gids, &num_gids);
+    fail_unless(ret == ENOENT, "Expected ENOENT, got %d", ret);
+
+    ret = sysdb_update_initgr_gids(test_ctx->domain, "initgruser");
+    fail_unless(ret == EOK, "Could not store the GIDs");
+
+    ret = sysdb_initgroups_gids(test_ctx, test_ctx->domain, "initgruser",
+                                &res, &gids, &num_gids);
+    fail_unless(ret == EOK, "sysdb_initgroups_gids failed");
+    fail_unless(res->count == 1, "Expected only the user entry");
+    fail_unless(num_gids == 1 && gids[0] == 38202,
+                "Unexpected GIDs, %zu of them", num_gids);
+
+    /* the memberof plugin drops the list when the memberships change */
+    ret = sysdb_add_group_member(test_ctx->domain, "initgrgroup2",
+                                 "initgruser", SYSDB_MEMBER_USER, false);
+    fail_unless(ret == EOK, "Could not add the member");
+
+    ret = sysdb_initgroups_gids(test_ctx, test_ctx->domain, "initgruser",
+                                &res, &gids, &num_gids);
+    fail_unless(ret == ENOENT, "Expected ENOENT, got %d", ret);
+
+    ret = sysdb_update_initgr_gids(test_ctx->domain, "initgruser");
+    fail_unless(ret == EOK, "Could not store the GIDs");
+
+    ret = sysdb_initgroups_gids(test_ctx, test_ctx->domain, "initgruser",
+                                &res, &gids, &num_gids);
+    fail_unless(ret == EOK, "sysdb_initgroups_gids failed");
+    fail_unless(num_gids == 2, "Expected 2 GIDs, got %zu", num_gids);
+
+    /* and so does a new GID of one of the groups */
+    attrs = sysdb_new_attrs(test_ctx);
+    fail_unless(attrs != NULL, "Out of memory");
+    ret = sysdb_attrs_add_uint32(attrs, SYSDB_GIDNUM, 38204);
+    fail_unless(ret == EOK, "Cannot add attr");
+
+    ret = sysdb_set_group_attr(test_ctx->domain, "initgrgroup2", attrs,
+                               SYSDB_MOD_REP);
+    fail_unless(ret == EOK, "Could not change the GID");
+
+    ret = sysdb_initgroups_gids(test_ctx, test_ctx->domain, "initgruser",
+                                &res, &gids, &num_gids);
+    fail_unless(ret == ENOENT, "Expected ENOENT, got %d", ret);
+
+    ret = sysdb_delete_user(test_ctx->domain, "initgruser", 0);
+    fail_unless(ret == EOK, "Could not delete the user");
+    ret = sysdb_delete_group(test_ctx->domain, "initgrgroup1", 0);
+    fail_unless(ret == EOK, "Could not delete the group");
+    ret = sysdb_delete_group(test_ctx->domain, "initgrgroup2", 0);
+    fail_unless(ret == EOK, "Could not delete the group");
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
 START_TEST (test_sysdb_update_members)
 {
     struct sysdb_test_ctx *test_ctx;
@@ -5126,6 +5624,48 @@ START_TEST(test_sysdb_has_enumerated)
 }
 END_TEST
 
+START_TEST(test_sysdb_dirsync_cookie)
+{
+    errno_t ret;
+    struct sysdb_test_ctx *test_ctx;
+    /* the cookie is binary */
+    uint8_t data[] = { 0x4d, 0x53, 0x44, 0x53, 0x00, 0x03, 0xff, 0x00 };
+    struct ldb_val cookie = { data, sizeof(data) };
+    struct ldb_val *stored;
+
+    /* Setup */
+    ret = setup_sysdb_tests(&test_ctx);
+    fail_if(ret != EOK, "Could not set up the test");
+
+    ret = sysdb_get_dirsync_cookie(test_ctx, test_ctx->domain, &stored);
+    fail_if(ret != ENOENT,
+            "Error [%d][%s] reading the cookie, ENOENT is expected",
+            ret, strerror(ret));
+
+    ret = sysdb_set_dirsync_cookie(test_ctx->domain, &cookie);
+    fail_if(ret != EOK, "Error [%d][%s] storing the cookie",
+                        ret, strerror(ret));
+
+    ret = sysdb_get_dirsync_cookie(test_ctx, test_ctx->domain, &stored);
+    fail_if(ret != EOK, "Error [%d][%s] reading the cookie",
+                        ret, strerror(ret));
+    fail_unless(stored->length == sizeof(data)
+                    && memcmp(stored->data, data, sizeof(data)) == 0,
+                "The stored cookie differs");
+
+    ret = sysdb_set_dirsync_cookie(test_ctx->domain, NULL);
+    fail_if(ret != EOK, "Error [%d][%s] removing the cookie",
+                        ret, strerror(ret));
+
+    ret = sysdb_get_dirsync_cookie(test_ctx, test_ctx->domain, &stored);
+    fail_if(ret != ENOENT,
+            "Error [%d][%s] reading the removed cookie, ENOENT is expected",
+            ret, strerror(ret));
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
 START_TEST(test_sysdb_original_dn_case_insensitive)
 {
     errno_t ret;
@@ -5231,6 +5771,50 @@ START_TEST(test_sysdb_search_sid_str)
 }
 END_TEST
 
+START_TEST(test_sysdb_search_objects_by_sids)
+{
+    errno_t ret;
+    struct sysdb_test_ctx *test_ctx;
+    struct ldb_result *res;
+    const char *sids[] = { "S-1-2-3-4-10", "S-1-2-3-4-11", "S-1-2-3-4-12" };
+    const char *attrs[] = { SYSDB_SID_STR, NULL };
+
+    /* Setup */
+    ret = setup_sysdb_tests(&test_ctx);
+    fail_if(ret != EOK, "Could not set up the test");
+
+    ret = sysdb_add_incomplete_group(test_ctx->domain,
+                                     "sidgroup10", 29010,
+                                     "cn=sidgroup10,cn=example,cn=com",
+                                     sids[0], NULL, true, 0);
+    fail_unless(ret == EOK, "sysdb_add_incomplete_group error [%d][%s]",
+                            ret, strerror(ret));
+
+    ret = sysdb_add_incomplete_group(test_ctx->domain,
+                                     "sidgroup12", 29012,
+                                     "cn=sidgroup12,cn=example,cn=com",
+                                     sids[2], NULL, true, 0);
+    fail_unless(ret == EOK, "sysdb_add_incomplete_group error [%d][%s]",
+                            ret, strerror(ret));
+
+    ret = sysdb_search_objects_by_sids(test_ctx, test_ctx->domain,
+                                       sids, 3, attrs, &res);
+    fail_unless(ret == EOK, "sysdb_search_objects_by_sids failed with [%d][%s].",
+                ret, strerror(ret));
+    fail_unless(res->count == 2, "Expected 2 objects, got [%d].", res->count);
+    talloc_free(res);
+
+    /* SIDs which are not cached are not an error */
+    ret = sysdb_search_objects_by_sids(test_ctx, test_ctx->domain,
+                                       &sids[1], 1, attrs, &res);
+    fail_unless(ret == EOK, "sysdb_search_objects_by_sids failed with [%d][%s].",
+                ret, strerror(ret));
+    fail_unless(res->count == 0, "Expected no objects, got [%d].", res->count);
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
 START_TEST(test_sysdb_search_object_by_uuid)
 {
     errno_t ret;
@@ -5288,6 +5872,7 @@ START_TEST(test_sysdb_search_user_by_cert)
     struct ldb_result *res;
     struct sysdb_attrs *attrs = NULL;
     struct ldb_val val;
+    const char *remove_attrs[] = { SYSDB_USER_CERT, NULL };
 
     /* Setup */
     ret = setup_sysdb_tests(&test_ctx);
@@ -5325,6 +5910,18 @@ START_TEST(test_sysdb_search_user_by_cert)
                       "certuser") == 0, "Unexpected object found, " \
                       "expected [%s], got [%s].", "certuser",
                       ldb_msg_find_attr_as_string(res->msgs[0],SYSDB_NAME, ""));
+
+    /* the user is not found by the hash of a removed certificate */
+    ret = sysdb_remove_attrs(test_ctx->domain, "certuser", SYSDB_MEMBER_USER,
+                             discard_const(remove_attrs));
+    fail_unless(ret == EOK, "sysdb_remove_attrs failed with [%d][%s].",
+                ret, strerror(ret));
+
+    ret = sysdb_search_user_by_cert(test_ctx, test_ctx->domain,
+                                    TEST_USER_CERT_DERB64, &res);
+    fail_unless(ret == ENOENT,
+                "Unexpected return code from sysdb_search_user_by_cert for "
+                "removed certificate, expected [%d], got [%d].", ENOENT, ret);
     talloc_free(test_ctx);
 }
 END_TEST
@@ -5690,6 +6287,67 @@ START_TEST(test_autofs_retrieve_keys_by_map)
 }
 END_TEST
 
+START_TEST(test_autofs_read_keys_by_cursor)
+{
+    struct sysdb_test_ctx *test_ctx;
+    struct sysdb_enum_cursor *cursor;
+    struct ldb_result *page;
+    struct ldb_message *entry;
+    const char *autofsmapname;
+    const char *autofskey;
+    const char *val;
+    errno_t ret;
+    size_t seen = 0;
+    const int expected = 10;
+
+    ret = setup_sysdb_tests(&test_ctx);
+    fail_if(ret != EOK, "Could not set up the test");
+
+    autofsmapname = talloc_asprintf(test_ctx, "testmap%d", _i);
+    fail_if(autofsmapname == NULL, "Out of memory\n");
+
+    ret = sysdb_autofs_entries_cursor(test_ctx, test_ctx->domain,
+                                      autofsmapname, &cursor);
+    fail_if(ret != EOK, "Cannot create cursor for map %s\n", autofsmapname);
+    fail_if(sysdb_enum_cursor_count(cursor) != expected,
+            "Expected %d entries, got %zu\n",
+            expected, sysdb_enum_cursor_count(cursor));
+
+    /* read in pages smaller than the map */
+    while (seen < sysdb_enum_cursor_count(cursor)) {
+        ret = sysdb_enum_cursor_read(test_ctx, cursor, seen, 3, &page);
+        fail_if(ret != EOK, "Cannot read the cursor at %zu\n", seen);
+        fail_if(page->count == 0 || page->count > 3,
+                "Unexpected page size %u\n", page->count);
+
+        val = ldb_msg_find_attr_as_string(page->msgs[0],
+                                          SYSDB_AUTOFS_ENTRY_VALUE, NULL);
+        fail_if(val == NULL, "Entry without value\n");
+
+        seen += page->count;
+        talloc_free(page);
+    }
+    fail_if(seen != expected, "Expected to read %d entries, got %zu\n",
+            expected, seen);
+
+    autofskey = talloc_asprintf(test_ctx, "%s_testkey%d", autofsmapname, 3);
+    fail_if(autofskey == NULL, "Out of memory\n");
+
+    ret = sysdb_get_autofsentry(test_ctx, test_ctx->domain, autofsmapname,
+                                autofskey, &entry);
+    fail_if(ret != EOK, "Cannot get key %s\n", autofskey);
+    val = ldb_msg_find_attr_as_string(entry, SYSDB_AUTOFS_ENTRY_VALUE, NULL);
+    fail_if(val == NULL || strcmp(val, "testserver:/testval3") != 0,
+            "Unexpected value %s\n", val);
+
+    ret = sysdb_get_autofsentry(test_ctx, test_ctx->domain, autofsmapname,
+                                "nosuchkey", &entry);
+    fail_unless(ret == ENOENT, "Expected ENOENT, got %d\n", ret);
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
 START_TEST(test_autofs_key_duplicate)
 {
     struct sysdb_test_ctx *test_ctx;
@@ -6504,12 +7162,14 @@ Suite *create_sysdb_suite(void)
 
     /* Test sysdb enumerated flag */
     tcase_add_test(tc_sysdb, test_sysdb_has_enumerated);
+    tcase_add_test(tc_sysdb, test_sysdb_dirsync_cookie);
 
     /* Test originalDN searches */
     tcase_add_test(tc_sysdb, test_sysdb_original_dn_case_insensitive);
 
     /* Test SID string searches */
     tcase_add_test(tc_sysdb, test_sysdb_search_sid_str);
+    tcase_add_test(tc_sysdb, test_sysdb_search_objects_by_sids);
 
     /* Test UUID string searches */
     tcase_add_test(tc_sysdb, test_sysdb_search_object_by_uuid);
@@ -6523,6 +7183,11 @@ Suite *create_sysdb_suite(void)
     /* Test user and group renames */
     tcase_add_test(tc_sysdb, test_group_rename);
     tcase_add_test(tc_sysdb, test_user_rename);
+    tcase_add_test(tc_sysdb, test_sysdb_store_bulk);
+    tcase_add_test(tc_sysdb, test_sysdb_group_ghosts);
+    tcase_add_test(tc_sysdb, test_sysdb_upgrade_17_indexes);
+    tcase_add_test(tc_sysdb, test_sysdb_upgrade_18_resume);
+    tcase_add_test(tc_sysdb, test_sysdb_initgr_gids);
 
     /* Test GetUserAttr with subdomain user */
     tcase_add_test(tc_sysdb, test_sysdb_get_user_attr_subdomain);
@@ -6721,6 +7386,9 @@ Suite *create_sysdb_suite(void)
     tcase_add_loop_test(tc_autofs, test_autofs_retrieve_keys_by_map,
                         TEST_AUTOFS_MAP_BASE, TEST_AUTOFS_MAP_BASE+10);
 
+    tcase_add_loop_test(tc_autofs, test_autofs_read_keys_by_cursor,
+                        TEST_AUTOFS_MAP_BASE, TEST_AUTOFS_MAP_BASE+10);
+
     tcase_add_loop_test(tc_autofs, test_autofs_delete_map,
                         TEST_AUTOFS_MAP_BASE, TEST_AUTOFS_MAP_BASE+10);
 
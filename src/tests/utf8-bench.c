@@ -0,0 +1,187 @@
+/*
+   SSSD
+
+   Benchmark of the case-insensitive name handling
+
+   Copyright (C) Red Hat 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <talloc.h>
+#include <popt.h>
+#include <sys/time.h>
+
+#include "util/util.h"
+#include "util/sss_utf8.h"
+
+/* Lowercases and compares names the way responders and providers do for
+ * case-insensitive domains, once with plain ASCII names which take the
+ * fast path and once with names which need the unicode library. Not run
+ * by "make check". */
+
+#define DEFAULT_ROUNDS 1000000
+
+struct bench_names {
+    const char *desc;
+    const char *upper;
+    const char *lower;
+};
+
+static double bench_msec(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000.0
+           + (now.tv_usec - start->tv_usec) / 1000.0;
+}
+
+static void bench_report(const char *what, struct timeval *start, int rounds)
+{
+    double msec;
+
+    msec = bench_msec(start);
+    printf("  %-24s %10.1f ms %8.1f ns/call\n",
+           what, msec, msec * 1000000.0 / rounds);
+}
+
+static errno_t bench_run(struct bench_names *names, int rounds)
+{
+    struct timeval start;
+    TALLOC_CTX *tmp_ctx;
+    uint8_t *lower;
+    char *tc_lower;
+    size_t len;
+    size_t nlen;
+    errno_t ret;
+    int i;
+
+    len = strlen(names->upper);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < rounds; i++) {
+        lower = sss_utf8_tolower((const uint8_t *) names->upper, len, &nlen);
+        if (lower == NULL) {
+            return ENOMEM;
+        }
+        sss_utf8_free(lower);
+    }
+    bench_report("sss_utf8_tolower", &start, rounds);
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < rounds; i++) {
+        tc_lower = sss_tc_utf8_str_tolower(tmp_ctx, names->upper);
+        if (tc_lower == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        talloc_free(tc_lower);
+    }
+    bench_report("sss_tc_utf8_str_tolower", &start, rounds);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < rounds; i++) {
+        ret = sss_utf8_case_eq((const uint8_t *) names->upper,
+                               (const uint8_t *) names->lower);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+    bench_report("sss_utf8_case_eq", &start, rounds);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < rounds; i++) {
+        if (sss_string_equal(false, names->upper, names->desc)) {
+            ret = EINVAL;
+            goto done;
+        }
+    }
+    bench_report("sss_string_equal (miss)", &start, rounds);
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    int pc_rounds = DEFAULT_ROUNDS;
+    errno_t ret;
+    int i;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "rounds", 'r', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_rounds, 0,
+                    "Number of times each operation is run", NULL },
+        POPT_TABLEEND
+    };
+
+    struct bench_names names[] = {
+        { "ascii",
+          "Administrator@AD.EXAMPLE.COM", "administrator@ad.example.com" },
+        { "unicode",
+          "M\xC3\x9C" "NCHEN@AD.EXAMPLE.COM", "m\xC3\xBC" "nchen@ad.example.com" },
+        { NULL, NULL, NULL }
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_rounds < 1) {
+        fprintf(stderr, "The number of rounds must be positive\n");
+        return 1;
+    }
+
+    printf("%d rounds\n", pc_rounds);
+
+    for (i = 0; names[i].desc != NULL; i++) {
+        printf("%s: %s\n", names[i].desc, names[i].upper);
+
+        ret = bench_run(&names[i], pc_rounds);
+        if (ret != EOK) {
+            fprintf(stderr, "%s failed [%d]: %s\n",
+                    names[i].desc, ret, sss_strerror(ret));
+            return 1;
+        }
+    }
+
+    return 0;
+}
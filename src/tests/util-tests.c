@@ -524,6 +524,66 @@ START_TEST(test_utf8_caseeq)
 }
 END_TEST
 
+START_TEST(test_utf8_ascii)
+{
+    const char *upcase = "Admin@AD.Example.COM[]";
+    const char *lowcase = "admin@ad.example.com[]";
+    const uint8_t mixed_upcase[] = { 'A', 'B', 'C', 0xC3, 0x9C, 0x0 };
+    const uint8_t mixed_lowcase[] = { 'a', 'b', 'c', 0xC3, 0xBC, 0x0 };
+    const uint8_t mixed_other[] = { 'a', 'b', 'd', 0xC3, 0xBC, 0x0 };
+    TALLOC_CTX *test_ctx;
+    uint8_t *lcase;
+    char *tc_lcase;
+    size_t nlen;
+    errno_t ret;
+
+    test_ctx = talloc_new(NULL);
+    fail_if(test_ctx == NULL);
+
+    fail_unless(sss_utf8_is_ascii((const uint8_t *) upcase, strlen(upcase)));
+    fail_if(sss_utf8_is_ascii(mixed_upcase, sizeof(mixed_upcase) - 1));
+
+    lcase = sss_utf8_tolower((const uint8_t *) upcase, strlen(upcase), &nlen);
+    fail_if(lcase == NULL);
+    fail_unless(nlen == strlen(lowcase));
+    fail_if(memcmp(lcase, lowcase, nlen));
+    sss_utf8_free(lcase);
+
+    tc_lcase = sss_tc_utf8_str_tolower(test_ctx, upcase);
+    fail_if(tc_lcase == NULL);
+    fail_unless(strcmp(tc_lcase, lowcase) == 0);
+    fail_unless(talloc_get_size(tc_lcase) == strlen(lowcase) + 1);
+
+    tc_lcase = sss_tc_utf8_str_tolower(test_ctx, "");
+    fail_if(tc_lcase == NULL);
+    fail_unless(tc_lcase[0] == '\0');
+
+    tc_lcase = sss_tc_utf8_str_tolower(test_ctx,
+                                       (const char *) mixed_upcase);
+    fail_if(tc_lcase == NULL);
+    fail_unless(strcmp(tc_lcase, (const char *) mixed_lowcase) == 0);
+
+    ret = sss_utf8_case_eq((const uint8_t *) upcase,
+                           (const uint8_t *) lowcase);
+    fail_unless(ret == EOK, "ASCII strings do not match");
+
+    ret = sss_utf8_case_eq((const uint8_t *) "admin", (const uint8_t *) "admins");
+    fail_unless(ret == ENOMATCH, "Prefix matched");
+
+    /* '[' and '{' differ only in the bit which changes the case of letters */
+    ret = sss_utf8_case_eq((const uint8_t *) "a[", (const uint8_t *) "A{");
+    fail_unless(ret == ENOMATCH, "Non-letters compared case-insensitively");
+
+    ret = sss_utf8_case_eq(mixed_upcase, mixed_lowcase);
+    fail_unless(ret == EOK, "Mixed strings do not match");
+
+    ret = sss_utf8_case_eq(mixed_upcase, mixed_other);
+    fail_unless(ret == ENOMATCH, "Different mixed strings matched");
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
 START_TEST(test_utf8_check)
 {
     const char *invalid = "ad\351la\357d";
@@ -538,6 +598,47 @@ START_TEST(test_utf8_check)
 }
 END_TEST
 
+START_TEST(test_sss_pool_size_update)
+{
+    struct sss_pool_size ps = SSS_POOL_SIZE_INIT(1024, 64 * 1024);
+    TALLOC_CTX *big;
+    TALLOC_CTX *small;
+    size_t grown;
+    int i;
+
+    big = talloc_size(global_talloc_context, 32 * 1024);
+    fail_if(big == NULL);
+    small = talloc_size(global_talloc_context, 16);
+    fail_if(small == NULL);
+
+    sss_pool_size_update(&ps, NULL);
+    fail_unless(ps.size == 1024);
+
+    /* half way towards the usage at once */
+    sss_pool_size_update(&ps, big);
+    fail_unless(ps.size > 16 * 1024 && ps.size < 32 * 1024,
+                "Unexpected size %zu", ps.size);
+    grown = ps.size;
+
+    /* back down slowly, never below the minimum */
+    sss_pool_size_update(&ps, small);
+    fail_unless(ps.size < grown && ps.size > grown / 2,
+                "Unexpected size %zu", ps.size);
+    for (i = 0; i < 200; i++) {
+        sss_pool_size_update(&ps, small);
+    }
+    fail_unless(ps.size == 1024, "Unexpected size %zu", ps.size);
+
+    /* never above the maximum */
+    ps.max = 4096;
+    sss_pool_size_update(&ps, big);
+    fail_unless(ps.size == 4096, "Unexpected size %zu", ps.size);
+
+    talloc_free(big);
+    talloc_free(small);
+}
+END_TEST
+
 START_TEST(test_murmurhash3_check)
 {
     const char *tests[6] = { "1052800007", "1052800008", "1052800000",
@@ -584,6 +685,36 @@ START_TEST(test_murmurhash3_random)
 }
 END_TEST
 
+START_TEST(test_murmurhash3_known)
+{
+    /* the hash is shared with the memory cache clients and stored in the
+     * caches, it must not change whatever the implementation */
+    const char *key = "abcdefghijklmnopq";
+    const uint32_t expected[] = {
+        0x0de5c6a9, 0x8872dbc8, 0xd2ba8c7d, 0xd201576f,
+        0xf772becd, 0x97643673, 0x26291fb3, 0x445d6324,
+        0xcf494cd2, 0x33e3a059, 0x40da7a54, 0xa7bc92ac,
+        0xb603a2be, 0xc8318a1a, 0xc5ad3fbd, 0x2c1d101f,
+        0xfd47ec7e, 0x4a38282a
+    };
+    char buf[32];
+    uint32_t result;
+    int len;
+    int off;
+
+    for (len = 0; len < sizeof(expected) / sizeof(expected[0]); len++) {
+        /* also check reads that are not aligned */
+        for (off = 0; off < 4; off++) {
+            memcpy(buf + off, key, len);
+            result = murmurhash3(buf + off, len, 0xdeadbeef);
+            fail_unless(result == expected[len],
+                        "Wrong hash of %d bytes at offset %d: 0x%08x",
+                        len, off, result);
+        }
+    }
+}
+END_TEST
+
 void setup_atomicio(void)
 {
     int ret;
@@ -1129,6 +1260,7 @@ Suite *util_suite(void)
     tcase_add_test (tc_util, test_is_host_in_domain);
     tcase_add_test (tc_util, test_known_service);
     tcase_add_test (tc_util, test_fd_nonblocking);
+    tcase_add_test (tc_util, test_sss_pool_size_update);
     tcase_set_timeout(tc_util, 60);
 
     TCase *tc_utf8 = tcase_create("utf8");
@@ -1136,6 +1268,7 @@ Suite *util_suite(void)
     tcase_add_test (tc_utf8, test_utf8_talloc_lowercase);
     tcase_add_test (tc_utf8, test_utf8_talloc_str_lowercase);
     tcase_add_test (tc_utf8, test_utf8_caseeq);
+    tcase_add_test (tc_utf8, test_utf8_ascii);
     tcase_add_test (tc_utf8, test_utf8_check);
 
     tcase_set_timeout(tc_utf8, 60);
@@ -1143,6 +1276,7 @@ Suite *util_suite(void)
     TCase *tc_mh3 = tcase_create("murmurhash3");
     tcase_add_test (tc_mh3, test_murmurhash3_check);
     tcase_add_test (tc_mh3, test_murmurhash3_random);
+    tcase_add_test (tc_mh3, test_murmurhash3_known);
     tcase_set_timeout(tc_mh3, 60);
 
     TCase *tc_atomicio = tcase_create("atomicio");
@@ -99,6 +99,10 @@ struct cache_tool_ctx {
     bool update_service_filter;
     bool update_autofs_filter;
     bool update_ssh_host_filter;
+
+    bool invalidate;
+    bool compact;
+    bool print_stats;
 };
 
 errno_t init_domains(struct cache_tool_ctx *ctx, const char *domain);
@@ -112,6 +116,7 @@ static bool invalidate_entries(TALLOC_CTX *ctx,
                                const char *filter, const char *name);
 static errno_t update_all_filters(struct cache_tool_ctx *tctx,
                                   struct sss_domain_info *dinfo);
+static errno_t compact_caches(struct cache_tool_ctx *tctx);
 
 int main(int argc, const char *argv[])
 {
@@ -128,6 +133,10 @@ int main(int argc, const char *argv[])
         goto done;
     }
 
+    if (!tctx->invalidate) {
+        goto compact;
+    }
+
     for (dinfo = tctx->domains; dinfo;
             dinfo = get_next_domain(dinfo, SSS_GND_DESCEND)) {
         if (!IS_SUBDOMAIN(dinfo)) {
@@ -197,12 +206,101 @@ int main(int argc, const char *argv[])
         }
     }
 
+compact:
+    if (tctx->compact || tctx->print_stats) {
+        ret = compact_caches(tctx);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
     ret = EOK;
 done:
     if (tctx) talloc_free(tctx);
     return ret;
 }
 
+static void print_cache_stats(const char *file)
+{
+    struct sysdb_cache_stats stats;
+    errno_t ret;
+
+    ret = sysdb_cache_file_stats(file, &stats);
+    if (ret != EOK) {
+        ERROR("Could not read %1$s\n", file);
+        return;
+    }
+
+    printf(_("%1$s: %2$lld bytes, %3$zu records with %4$zu bytes of data, "
+             "%5$d free records\n"),
+           file, (long long) stats.file_size, stats.records, stats.data_size,
+           stats.free_records);
+}
+
+static errno_t compact_cache_file(struct cache_tool_ctx *tctx,
+                                  const char *file, bool in_use)
+{
+    errno_t ret;
+
+    if (tctx->print_stats) {
+        print_cache_stats(file);
+    }
+
+    if (!tctx->compact) {
+        return EOK;
+    }
+
+    ret = sysdb_cache_file_compact(file, in_use);
+    if (ret != EOK) {
+        ERROR("Could not compact %1$s\n", file);
+        return ret;
+    }
+
+    if (tctx->print_stats) {
+        print_cache_stats(file);
+    }
+
+    return EOK;
+}
+
+/* tdb does not allow a process to open a file twice, so the connections
+ * to the caches are closed first. The files are repacked in place when
+ * sssd is running and rewritten into fresh files otherwise. */
+static errno_t compact_caches(struct cache_tool_ctx *tctx)
+{
+    struct sss_domain_info *dinfo;
+    char *ldb_file;
+    char *ts_file;
+    bool in_use;
+    errno_t ret;
+
+    in_use = (signal_sssd(0) == EOK);
+
+    for (dinfo = tctx->domains; dinfo; dinfo = get_next_domain(dinfo, 0)) {
+        ret = sysdb_get_cache_files(tctx, dinfo, DB_PATH, &ldb_file, &ts_file);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        /* the subdomains share the sysdb of their parent */
+        talloc_zfree(dinfo->sysdb);
+
+        ret = compact_cache_file(tctx, ldb_file, in_use);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        if (ts_file != NULL) {
+            ret = compact_cache_file(tctx, ts_file, in_use);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+    }
+
+    return EOK;
+}
+
 static errno_t update_filter(struct cache_tool_ctx *tctx,
                              struct sss_domain_info *dinfo,
                              char *name, bool update, const char *fmt,
@@ -359,6 +457,81 @@ static errno_t update_all_filters(struct cache_tool_ctx *tctx,
     return EOK;
 }
 
+/* Users, groups, netgroups and services are expired with a single search
+ * of the domain, the entries are not looked up by name one by one. */
+static bool invalidate_entries_bulk(TALLOC_CTX *ctx,
+                                    struct sss_domain_info *dinfo,
+                                    enum sss_cache_entry entry_type,
+                                    const char *filter, const char *name)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *base_dn = NULL;
+    const char *class_filter = NULL;
+    const char *type_string = "unknown";
+    char *bulk_filter;
+    size_t count = 0;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(ctx);
+    if (tmp_ctx == NULL) {
+        ERROR("Out of memory\n");
+        return false;
+    }
+
+    switch (entry_type) {
+    case TYPE_USER:
+        type_string = "user";
+        base_dn = sysdb_user_base_dn(tmp_ctx, dinfo);
+        class_filter = SYSDB_UC;
+        break;
+    case TYPE_GROUP:
+        type_string = "group";
+        base_dn = sysdb_group_base_dn(tmp_ctx, dinfo);
+        class_filter = SYSDB_GC;
+        break;
+    case TYPE_NETGROUP:
+        type_string = "netgroup";
+        base_dn = sysdb_netgroup_base_dn(tmp_ctx, dinfo);
+        class_filter = SYSDB_NC;
+        break;
+    case TYPE_SERVICE:
+        type_string = "service";
+        base_dn = ldb_dn_new_fmt(tmp_ctx, sysdb_ctx_get_ldb(dinfo->sysdb),
+                                 SYSDB_TMPL_SVC_BASE, dinfo->name);
+        class_filter = SYSDB_SC;
+        break;
+    default:
+        talloc_free(tmp_ctx);
+        return false;
+    }
+
+    bulk_filter = talloc_asprintf(tmp_ctx, "(&(%s)%s)", class_filter, filter);
+    if (base_dn == NULL || bulk_filter == NULL) {
+        ERROR("Out of memory\n");
+        talloc_free(tmp_ctx);
+        return false;
+    }
+
+    ret = sysdb_invalidate_cache_entries(dinfo, base_dn, bulk_filter,
+                                         entry_type == TYPE_USER, &count);
+    talloc_free(tmp_ctx);
+    if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC, "'%s' %s: Not found in domain '%s'\n",
+              type_string, name ? name : "", dinfo->name);
+        return false;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Invalidating %s in domain %s with filter %s failed\n",
+              type_string, dinfo->name, filter);
+        ERROR("Couldn't invalidate %1$s\n", type_string);
+        return false;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Invalidated %zu %s entries in domain '%s'\n",
+          count, type_string, dinfo->name);
+    return true;
+}
+
 static bool invalidate_entries(TALLOC_CTX *ctx,
                                struct sss_domain_info *dinfo,
                                enum sss_cache_entry entry_type,
@@ -376,25 +549,10 @@ static bool invalidate_entries(TALLOC_CTX *ctx,
     if (!filter) return false;
     switch (entry_type) {
     case TYPE_USER:
-        type_string = "user";
-        ret = sysdb_search_users(ctx, dinfo,
-                                 filter, attrs, &msg_count, &msgs);
-        break;
     case TYPE_GROUP:
-        type_string = "group";
-        ret = sysdb_search_groups(ctx, dinfo,
-                                  filter, attrs, &msg_count, &msgs);
-        break;
     case TYPE_NETGROUP:
-        type_string = "netgroup";
-        ret = sysdb_search_netgroups(ctx, dinfo,
-                                     filter, attrs, &msg_count, &msgs);
-        break;
     case TYPE_SERVICE:
-        type_string = "service";
-        ret = sysdb_search_services(ctx, dinfo,
-                                    filter, attrs, &msg_count, &msgs);
-        break;
+        return invalidate_entries_bulk(ctx, dinfo, entry_type, filter, name);
     case TYPE_AUTOFSMAP:
         type_string = "autofs map";
         ret = search_autofsmaps(ctx, dinfo, filter, attrs, &msg_count, &msgs);
@@ -458,28 +616,6 @@ static errno_t invalidate_entry(TALLOC_CTX *ctx,
                 SYSDB_CACHE_EXPIRE, 1);
         if (ret == EOK) {
             switch (entry_type) {
-                case TYPE_USER:
-                    /* For users, we also need to reset the initgroups
-                     * cache expiry */
-                    ret = sysdb_attrs_add_time_t(sys_attrs,
-                            SYSDB_INITGR_EXPIRE, 1);
-                    if (ret != EOK) return ret;
-
-                    ret = sysdb_set_user_attr(domain, name, sys_attrs,
-                                              SYSDB_MOD_REP);
-                    break;
-                case TYPE_GROUP:
-                    ret = sysdb_set_group_attr(domain, name, sys_attrs,
-                                               SYSDB_MOD_REP);
-                    break;
-                case TYPE_NETGROUP:
-                    ret = sysdb_set_netgroup_attr(domain, name, sys_attrs,
-                                                  SYSDB_MOD_REP);
-                    break;
-                case TYPE_SERVICE:
-                    ret = sysdb_set_service_attr(domain, name,
-                                                 sys_attrs, SYSDB_MOD_REP);
-                    break;
                 case TYPE_AUTOFSMAP:
                     ret = sysdb_set_autofsmap_attr(domain, name,
                                                    sys_attrs, SYSDB_MOD_REP);
@@ -571,6 +707,8 @@ errno_t init_context(int argc, const char *argv[], struct cache_tool_ctx **tctx)
 {
     struct cache_tool_ctx *ctx = NULL;
     int idb = INVALIDATE_NONE;
+    bool compact = false;
+    bool print_stats = false;
     char *user = NULL;
     char *group = NULL;
     char *netgroup = NULL;
@@ -618,6 +756,10 @@ errno_t init_context(int argc, const char *argv[], struct cache_tool_ctx **tctx)
 #endif /* BUILD_SSH */
         { "domain", 'd', POPT_ARG_STRING, &domain, 0,
             _("Only invalidate entries from a particular domain"), NULL },
+        { "compact", '\0', POPT_ARG_NONE, NULL, 'c',
+            _("Compact the cache files"), NULL },
+        { "cache-stats", '\0', POPT_ARG_NONE, NULL, 'r',
+            _("Show the size and the free space of the cache files"), NULL },
         POPT_TABLEEND
     };
 
@@ -653,6 +795,12 @@ errno_t init_context(int argc, const char *argv[], struct cache_tool_ctx **tctx)
             case 'e':
                 idb = INVALIDATE_EVERYTHING;
                 break;
+            case 'c':
+                compact = true;
+                break;
+            case 'r':
+                print_stats = true;
+                break;
         }
     }
 
@@ -664,7 +812,8 @@ errno_t init_context(int argc, const char *argv[], struct cache_tool_ctx **tctx)
     }
 
     if (idb == INVALIDATE_NONE && !user && !group &&
-        !netgroup && !service && !map && !ssh_host) {
+        !netgroup && !service && !map && !ssh_host &&
+        !compact && !print_stats) {
         BAD_POPT_PARAMS(pc,
                 _("Please select at least one object to invalidate\n"),
                 ret, fini);
@@ -680,6 +829,11 @@ errno_t init_context(int argc, const char *argv[], struct cache_tool_ctx **tctx)
         goto fini;
     }
 
+    ctx->invalidate = (idb != INVALIDATE_NONE || user || group ||
+                       netgroup || service || map || ssh_host);
+    ctx->compact = compact;
+    ctx->print_stats = print_stats;
+
     if (idb & INVALIDATE_USERS) {
         ctx->user_filter = talloc_asprintf(ctx, "(%s=*)", SYSDB_NAME);
         ctx->update_user_filter = false;
@@ -0,0 +1,123 @@
+/*
+    SSSD
+
+    sss_mcstat - show usage counters of the NSS memory cache
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <talloc.h>
+#include <popt.h>
+
+#include "util/util.h"
+#include "tools/tools_util.h"
+
+static errno_t print_map_usage(const char *map)
+{
+    struct sss_mc_usage usage;
+    errno_t ret;
+
+    ret = sss_mc_get_usage(map, &usage);
+    switch (ret) {
+    case EOK:
+        break;
+    case ENOENT:
+        printf(_("%s: memory cache is not available\n"), map);
+        return EOK;
+    case EAGAIN:
+        printf(_("%s: memory cache is being reset, try again later\n"), map);
+        return EOK;
+    default:
+        ERROR("Unable to read memory cache %1$s: %2$s\n",
+              map, sss_strerror(ret));
+        return ret;
+    }
+
+    printf("%s:\n", map);
+    printf(_("\tUsed slots: %"PRIu32" of %"PRIu32" (%"PRIu32"%%)\n"),
+           usage.used_slots, usage.total_slots,
+           usage.total_slots == 0 ? 0
+               : (uint32_t)((uint64_t)usage.used_slots * 100
+                            / usage.total_slots));
+    printf(_("\tStores: %"PRIu64"\n"), usage.stores);
+    printf(_("\tEvictions: %"PRIu64"\n"), usage.evictions);
+    printf(_("\tInvalidations: %"PRIu64"\n"), usage.invalidations);
+    printf(_("\tTimes grown: %"PRIu64"\n"), usage.grows);
+
+    return EOK;
+}
+
+int main(int argc, const char **argv)
+{
+    int pc_debug = SSSDBG_DEFAULT;
+    const char *map = NULL;
+    errno_t ret;
+    errno_t mret;
+    int i;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        { "debug", '\0', POPT_ARG_INT | POPT_ARGFLAG_DOC_HIDDEN, &pc_debug,
+            0, _("The debug level to run with"), NULL },
+        POPT_TABLEEND
+    };
+    poptContext pc = NULL;
+
+    debug_prg_name = argv[0];
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    poptSetOtherOptionHelp(pc, "[MAP]");
+    while((ret = poptGetNextOpt(pc)) != -1) {
+        switch(ret) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(ret));
+            poptPrintUsage(pc, stderr, 0);
+            ret = EXIT_FAILURE;
+            goto fini;
+        }
+    }
+    DEBUG_CLI_INIT(pc_debug);
+
+    map = poptGetArg(pc);
+
+    /* No more arguments expected. If something follows it is an error. */
+    if (poptGetArg(pc)) {
+        BAD_POPT_PARAMS(pc, _("Only one argument expected\n"), ret, fini);
+    }
+
+    if (map != NULL) {
+        ret = print_map_usage(map);
+        if (ret == EINVAL) {
+            BAD_POPT_PARAMS(pc, _("Unknown memory cache map\n"), ret, fini);
+        }
+    } else {
+        ret = EOK;
+        for (i = 0; sss_mc_map_names[i] != NULL; i++) {
+            mret = print_map_usage(sss_mc_map_names[i]);
+            if (mret != EOK) {
+                ret = mret;
+            }
+        }
+    }
+
+    ret = (ret == EOK) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+fini:
+    poptFreeContext(pc);
+    return ret;
+}
@@ -24,6 +24,7 @@
 #include "db/sysdb.h"
 #include "tools/common/sss_tools.h"
 #include "tools/common/sss_colondb.h"
+#include "tools/tools_util.h"
 
 #define LOCALVIEW SYSDB_LOCAL_VIEW_NAME
 #define ORIGNAME "originalName"
@@ -873,6 +874,14 @@ static errno_t override_object_del(struct sss_domain_info *domain,
         goto done;
     }
 
+    ret = ldb_msg_add_empty(msg, SYSDB_MERGED_OVERRIDE_VIEW,
+                            LDB_FLAG_MOD_REPLACE, NULL);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldb_msg_add_empty() failed\n");
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
     ret = ldb_modify(ldb, msg);
     if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_ATTRIBUTE) {
         DEBUG(SSSDBG_OP_FAILURE,
@@ -1301,6 +1310,314 @@ done:
     return ret;
 }
 
+/* Importing a file resolves all of its lines first and only then stores the
+ * overrides, in one transaction per cache. The objects that are already
+ * cached are found in an index built with a single search of each domain,
+ * only the others are looked up through NSS. */
+struct override_import_dom {
+    struct override_import_dom *next;
+    struct sss_domain_info *domain;
+    hash_table_t *names;
+    bool view_ready;
+    bool in_transaction;
+};
+
+struct override_import_obj {
+    struct override_import_obj *next;
+    struct override_import_dom *dom;
+    const char *orig_name;
+    struct sysdb_attrs *attrs;
+};
+
+struct override_import {
+    enum sysdb_member_type type;
+    struct override_import_dom *doms;
+    struct override_import_obj *objs;
+    struct override_import_obj *last;
+    size_t count;
+};
+
+static const char *import_key(TALLOC_CTX *mem_ctx,
+                              struct sss_domain_info *domain,
+                              const char *name)
+{
+    if (domain->case_sensitive) {
+        return name;
+    }
+
+    return sss_tc_utf8_str_tolower(mem_ctx, name);
+}
+
+static errno_t import_build_index(struct override_import *import,
+                                  struct override_import_dom *dom)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char *attrs[] = {SYSDB_NAME, NULL};
+    struct ldb_message **msgs = NULL;
+    size_t count = 0;
+    hash_key_t key;
+    hash_value_t value;
+    const char *name;
+    size_t i;
+    errno_t ret;
+    int hret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    switch (import->type) {
+    case SYSDB_MEMBER_USER:
+        ret = sysdb_search_users(tmp_ctx, dom->domain, "("SYSDB_NAME"=*)",
+                                 attrs, &count, &msgs);
+        break;
+    case SYSDB_MEMBER_GROUP:
+        ret = sysdb_search_groups(tmp_ctx, dom->domain, "("SYSDB_NAME"=*)",
+                                  attrs, &count, &msgs);
+        break;
+    default:
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unsupported member type %d\n",
+              import->type);
+        ret = ERR_INTERNAL;
+        goto done;
+    }
+
+    if (ret == ENOENT) {
+        count = 0;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to list objects of %s [%d]: %s\n",
+              dom->domain->name, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = sss_hash_create(dom, count, &dom->names);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    key.type = HASH_KEY_STRING;
+    value.type = HASH_VALUE_UNDEF;
+    for (i = 0; i < count; i++) {
+        name = ldb_msg_find_attr_as_string(msgs[i], SYSDB_NAME, NULL);
+        if (name == NULL) {
+            continue;
+        }
+
+        key.str = discard_const(import_key(tmp_ctx, dom->domain, name));
+        if (key.str == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        hret = hash_enter(dom->names, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "hash_enter() failed [%d]: %s\n",
+                  hret, hash_error_string(hret));
+            ret = EIO;
+            goto done;
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "%zu objects are cached in %s\n",
+          count, dom->domain->name);
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static struct override_import_dom *
+import_get_dom(struct override_import *import,
+               struct sss_domain_info *domain)
+{
+    struct override_import_dom *dom;
+    errno_t ret;
+
+    for (dom = import->doms; dom != NULL; dom = dom->next) {
+        if (dom->domain == domain) {
+            return dom;
+        }
+    }
+
+    dom = talloc_zero(import, struct override_import_dom);
+    if (dom == NULL) {
+        return NULL;
+    }
+    dom->domain = domain;
+
+    ret = import_build_index(import, dom);
+    if (ret != EOK) {
+        talloc_free(dom);
+        return NULL;
+    }
+
+    dom->next = import->doms;
+    import->doms = dom;
+    return dom;
+}
+
+/* Returns ENOENT if the object is not cached in the domain. If no domain
+ * is given the domains are searched in order as get_object_domain() does. */
+static errno_t import_find_domain(struct override_import *import,
+                                  struct sss_tool_ctx *tool_ctx,
+                                  const char *name,
+                                  struct sss_domain_info **_domain)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct override_import_dom *dom;
+    struct sss_domain_info *domain;
+    hash_key_t key;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    domain = *_domain == NULL ? tool_ctx->domains : *_domain;
+    for (; domain != NULL; domain = domain->next) {
+        dom = import_get_dom(import, domain);
+        if (dom == NULL) {
+            ret = EIO;
+            goto done;
+        }
+
+        key.type = HASH_KEY_STRING;
+        key.str = discard_const(import_key(tmp_ctx, domain, name));
+        if (key.str == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        if (hash_has_key(dom->names, &key)) {
+            *_domain = domain;
+            ret = EOK;
+            goto done;
+        }
+
+        if (*_domain != NULL) {
+            break;
+        }
+    }
+
+    ret = ENOENT;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t import_add_object(struct override_import *import,
+                                 struct sss_domain_info *domain,
+                                 const char *orig_name,
+                                 struct sysdb_attrs *attrs)
+{
+    struct override_import_obj *obj;
+    errno_t ret;
+
+    obj = talloc_zero(import, struct override_import_obj);
+    if (obj == NULL) {
+        return ENOMEM;
+    }
+
+    obj->dom = import_get_dom(import, domain);
+    if (obj->dom == NULL) {
+        talloc_free(obj);
+        return EIO;
+    }
+
+    if (!obj->dom->view_ready) {
+        ret = prepare_view_msg(domain);
+        if (ret != EOK) {
+            talloc_free(obj);
+            return ret;
+        }
+        obj->dom->view_ready = true;
+    }
+
+    obj->orig_name = talloc_strdup(obj, orig_name);
+    if (obj->orig_name == NULL) {
+        talloc_free(obj);
+        return ENOMEM;
+    }
+
+    obj->attrs = talloc_steal(obj, attrs);
+
+    if (import->last == NULL) {
+        import->objs = obj;
+    } else {
+        import->last->next = obj;
+    }
+    import->last = obj;
+    import->count++;
+
+    return EOK;
+}
+
+static errno_t import_store_objects(struct override_import *import)
+{
+    struct override_import_obj *obj;
+    struct override_import_dom *dom;
+    errno_t ret;
+    errno_t sret;
+
+    for (obj = import->objs; obj != NULL; obj = obj->next) {
+        if (!obj->dom->in_transaction) {
+            ret = sysdb_transaction_start(obj->dom->domain->sysdb);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE, "sysdb_transaction_start() failed.\n");
+                goto done;
+            }
+            obj->dom->in_transaction = true;
+        }
+
+        ret = override_object_add(obj->dom->domain, import->type, obj->attrs,
+                                  obj->orig_name);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to add override object.\n");
+            goto done;
+        }
+    }
+
+    for (dom = import->doms; dom != NULL; dom = dom->next) {
+        if (!dom->in_transaction) {
+            continue;
+        }
+
+        ret = sysdb_transaction_commit(dom->domain->sysdb);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "sysdb_transaction_commit() failed.\n");
+            goto done;
+        }
+        dom->in_transaction = false;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Imported %zu overrides\n", import->count);
+
+    /* The memory cache is invalidated once for the whole file. */
+    if (import->count > 0 && sss_memcache_clear_all() != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to clear the memory cache\n");
+    }
+
+    ret = EOK;
+
+done:
+    for (dom = import->doms; dom != NULL; dom = dom->next) {
+        if (dom->in_transaction) {
+            sret = sysdb_transaction_cancel(dom->domain->sysdb);
+            if (sret != EOK) {
+                DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+            }
+            dom->in_transaction = false;
+        }
+    }
+
+    return ret;
+}
+
 static int override_user_add(struct sss_cmdline *cmdline,
                              struct sss_tool_ctx *tool_ctx,
                              void *pvt)
@@ -1463,6 +1780,9 @@ static int override_user_import(struct sss_cmdline *cmdline,
                                 void *pvt)
 {
     TALLOC_CTX *tmp_ctx;
+    TALLOC_CTX *line_ctx;
+    struct override_import *import;
+    struct sysdb_attrs *attrs;
     struct sss_colondb *db;
     const char *filename;
     struct override_user obj;
@@ -1476,6 +1796,13 @@ static int override_user_import(struct sss_cmdline *cmdline,
         return EXIT_FAILURE;
     }
 
+    line_ctx = talloc_new(tmp_ctx);
+    if (line_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_new() failed.\n");
+        talloc_free(tmp_ctx);
+        return EXIT_FAILURE;
+    }
+
     /**
      * Format: orig_name:name:uid:gid:gecos:home:shell
      */
@@ -1504,10 +1831,17 @@ static int override_user_import(struct sss_cmdline *cmdline,
         goto done;
     }
 
-    while ((ret = sss_colondb_readline(tmp_ctx, db, table)) == EOK) {
+    import = talloc_zero(tmp_ctx, struct override_import);
+    if (import == NULL) {
+        rc = EXIT_FAILURE;
+        goto done;
+    }
+    import->type = SYSDB_MEMBER_USER;
+
+    while ((ret = sss_colondb_readline(line_ctx, db, table)) == EOK) {
         linenum++;
 
-        ret = sss_tool_parse_name(tool_ctx, tool_ctx, obj.input_name,
+        ret = sss_tool_parse_name(line_ctx, tool_ctx, obj.input_name,
                                   &obj.orig_name, &obj.domain);
         if (ret != EOK) {
             fprintf(stderr, _("Unable to parse name %s.\n"), obj.input_name);
@@ -1515,19 +1849,38 @@ static int override_user_import(struct sss_cmdline *cmdline,
             goto done;
         }
 
-        ret = get_user_domain_msg(tool_ctx, &obj);
+        ret = import_find_domain(import, tool_ctx, obj.orig_name, &obj.domain);
+        if (ret == ENOENT) {
+            /* Not cached yet, look it up through NSS. */
+            ret = get_user_domain_msg(tool_ctx, &obj);
+        }
+        if (ret != EOK) {
+            rc = EXIT_FAILURE;
+            goto done;
+        }
+
+        /* We need to parse the name and ensure that domain did not change. */
+        ret = override_fqn(line_ctx, tool_ctx, obj.domain, obj.name,
+                           &obj.name);
         if (ret != EOK) {
             rc = EXIT_FAILURE;
             goto done;
         }
 
-        ret = override_user(tool_ctx, &obj);
+        attrs = build_user_attrs(import, &obj);
+        if (attrs == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to build sysdb attrs.\n");
+            rc = EXIT_FAILURE;
+            goto done;
+        }
+
+        ret = import_add_object(import, obj.domain, obj.orig_name, attrs);
         if (ret != EOK) {
             rc = EXIT_FAILURE;
             goto done;
         }
 
-        talloc_free_children(tmp_ctx);
+        talloc_free_children(line_ctx);
     }
 
     if (ret != EOF) {
@@ -1537,6 +1890,13 @@ static int override_user_import(struct sss_cmdline *cmdline,
         goto done;
     }
 
+    ret = import_store_objects(import);
+    if (ret != EOK) {
+        fprintf(stderr, _("Unable to import overrides from %s.\n"), filename);
+        rc = EXIT_FAILURE;
+        goto done;
+    }
+
     rc = EXIT_SUCCESS;
 
 done:
@@ -1729,6 +2089,9 @@ static int override_group_import(struct sss_cmdline *cmdline,
                                  void *pvt)
 {
     TALLOC_CTX *tmp_ctx;
+    TALLOC_CTX *line_ctx;
+    struct override_import *import;
+    struct sysdb_attrs *attrs;
     struct sss_colondb *db;
     const char *filename;
     struct override_group obj;
@@ -1742,6 +2105,13 @@ static int override_group_import(struct sss_cmdline *cmdline,
         return EXIT_FAILURE;
     }
 
+    line_ctx = talloc_new(tmp_ctx);
+    if (line_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_new() failed.\n");
+        talloc_free(tmp_ctx);
+        return EXIT_FAILURE;
+    }
+
     /**
      * Format: orig_name:name:gid
      */
@@ -1766,10 +2136,17 @@ static int override_group_import(struct sss_cmdline *cmdline,
         goto done;
     }
 
-    while ((ret = sss_colondb_readline(tmp_ctx, db, table)) == EOK) {
+    import = talloc_zero(tmp_ctx, struct override_import);
+    if (import == NULL) {
+        rc = EXIT_FAILURE;
+        goto done;
+    }
+    import->type = SYSDB_MEMBER_GROUP;
+
+    while ((ret = sss_colondb_readline(line_ctx, db, table)) == EOK) {
         linenum++;
 
-        ret = sss_tool_parse_name(tool_ctx, tool_ctx, obj.input_name,
+        ret = sss_tool_parse_name(line_ctx, tool_ctx, obj.input_name,
                                   &obj.orig_name, &obj.domain);
         if (ret != EOK) {
             fprintf(stderr, _("Unable to parse name %s.\n"), obj.input_name);
@@ -1777,19 +2154,38 @@ static int override_group_import(struct sss_cmdline *cmdline,
             goto done;
         }
 
-        ret = get_group_domain_msg(tool_ctx, &obj);
+        ret = import_find_domain(import, tool_ctx, obj.orig_name, &obj.domain);
+        if (ret == ENOENT) {
+            /* Not cached yet, look it up through NSS. */
+            ret = get_group_domain_msg(tool_ctx, &obj);
+        }
         if (ret != EOK) {
             rc = EXIT_FAILURE;
             goto done;
         }
 
-        ret = override_group(tool_ctx, &obj);
+        /* We need to parse the name and ensure that domain did not change. */
+        ret = override_fqn(line_ctx, tool_ctx, obj.domain, obj.name,
+                           &obj.name);
         if (ret != EOK) {
             rc = EXIT_FAILURE;
             goto done;
         }
 
-        talloc_free_children(tmp_ctx);
+        attrs = build_group_attrs(import, &obj);
+        if (attrs == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to build sysdb attrs.\n");
+            rc = EXIT_FAILURE;
+            goto done;
+        }
+
+        ret = import_add_object(import, obj.domain, obj.orig_name, attrs);
+        if (ret != EOK) {
+            rc = EXIT_FAILURE;
+            goto done;
+        }
+
+        talloc_free_children(line_ctx);
     }
 
     if (ret != EOF) {
@@ -1799,6 +2195,13 @@ static int override_group_import(struct sss_cmdline *cmdline,
         goto done;
     }
 
+    ret = import_store_objects(import);
+    if (ret != EOK) {
+        fprintf(stderr, _("Unable to import overrides from %s.\n"), filename);
+        rc = EXIT_FAILURE;
+        goto done;
+    }
+
     rc = EXIT_SUCCESS;
 
 done:
@@ -14,6 +14,7 @@
 #include <ctype.h>
 
 #include "util/util.h"
+#include "util/strtonum.h"
 #include "db/sysdb.h"
 #include "tools/tools_util.h"
 #include "tools/sss_sync_ops.h"
@@ -55,6 +56,8 @@ struct seed_ctx {
     char *password_file;
     enum seed_pass_method password_method;
 
+    char *seed_file;
+
     bool interact;
     bool user_cached;
 };
@@ -443,6 +446,7 @@ static int seed_init(TALLOC_CTX *mem_ctx,
     const char *pc_home = NULL;
     const char *pc_shell = NULL;
     const char *pc_password_file = NULL;
+    const char *pc_seed_file = NULL;
 
     struct seed_ctx *sctx = NULL;
 
@@ -467,6 +471,9 @@ static int seed_init(TALLOC_CTX *mem_ctx,
         { "password-file", 'p', POPT_ARG_STRING, &pc_password_file, 0,
          _("File from which user's password is read "
            "(default is to prompt for password)"),NULL },
+        { "file", 'f', POPT_ARG_STRING, &pc_seed_file, 0,
+         _("LDIF file of the users and groups to seed the cache with"),
+         NULL },
         POPT_TABLEEND
     };
 
@@ -509,7 +516,8 @@ static int seed_init(TALLOC_CTX *mem_ctx,
         goto fini;
     }
 
-    poptSetOtherOptionHelp(pc, "[OPTIONS] -D <domain> -n <username>");
+    poptSetOtherOptionHelp(pc, "[OPTIONS] -D <domain> "
+                               "{-n <username> | -f <file>}");
     while ((ret = poptGetNextOpt(pc)) > 0) {
         switch (ret) {
             case 'i':
@@ -527,15 +535,29 @@ static int seed_init(TALLOC_CTX *mem_ctx,
 
     CHECK_ROOT(ret, argv[0]);
 
-    /* check username provided */
-    if (pc_name == NULL) {
-        BAD_POPT_PARAMS(pc, _("Username must be specified\n"), ret, fini);
-    }
+    if (pc_seed_file != NULL) {
+        if (pc_name != NULL || sctx->interact) {
+            BAD_POPT_PARAMS(pc,
+                    _("A file cannot be used with a username or the "
+                      "interactive mode\n"), ret, fini);
+        }
 
-    sctx->uctx->name = talloc_strdup(sctx->uctx, pc_name);
-    if (sctx->uctx->name == NULL) {
-        ret = ENOMEM;
-        goto fini;
+        sctx->seed_file = talloc_strdup(sctx, pc_seed_file);
+        if (sctx->seed_file == NULL) {
+            ret = ENOMEM;
+            goto fini;
+        }
+    } else {
+        /* check username provided */
+        if (pc_name == NULL) {
+            BAD_POPT_PARAMS(pc, _("Username must be specified\n"), ret, fini);
+        }
+
+        sctx->uctx->name = talloc_strdup(sctx->uctx, pc_name);
+        if (sctx->uctx->name == NULL) {
+            ret = ENOMEM;
+            goto fini;
+        }
     }
 
     /* check domain is provided */
@@ -780,6 +802,292 @@ done:
     return ret;
 }
 
+/* Entries are read from the file and passed to the bulk store functions in
+ * batches of this size */
+#define SEED_BULK_BATCH 1000
+
+struct seed_bulk_ctx {
+    struct sss_domain_info *domain;
+    struct ldb_context *ldb;
+    TALLOC_CTX *batch;
+
+    struct sysdb_bulk_user *users;
+    struct sysdb_bulk_group *groups;
+    size_t num;
+
+    size_t num_stored;
+    size_t num_failed;
+};
+
+static errno_t seed_bulk_flush_users(struct seed_bulk_ctx *bctx)
+{
+    errno_t ret;
+    size_t i;
+
+    ret = sysdb_store_users_bulk(bctx->domain, bctx->users, bctx->num,
+                                 bctx->domain->user_timeout, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store users [%d]: %s\n",
+                                    ret, sss_strerror(ret));
+        return ret;
+    }
+
+    for (i = 0; i < bctx->num; i++) {
+        if (bctx->users[i].ret == EOK) {
+            bctx->num_stored++;
+        } else {
+            ERROR("Failed to store user %1$s\n", bctx->users[i].name);
+            bctx->num_failed++;
+        }
+    }
+
+    talloc_free_children(bctx->batch);
+    bctx->num = 0;
+    return EOK;
+}
+
+static errno_t seed_bulk_flush_groups(struct seed_bulk_ctx *bctx)
+{
+    errno_t ret;
+    size_t i;
+
+    ret = sysdb_store_groups_bulk(bctx->domain, bctx->groups, bctx->num,
+                                  bctx->domain->group_timeout, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store groups [%d]: %s\n",
+                                    ret, sss_strerror(ret));
+        return ret;
+    }
+
+    for (i = 0; i < bctx->num; i++) {
+        if (bctx->groups[i].ret == EOK) {
+            bctx->num_stored++;
+        } else {
+            ERROR("Failed to store group %1$s\n", bctx->groups[i].name);
+            bctx->num_failed++;
+        }
+    }
+
+    talloc_free_children(bctx->batch);
+    bctx->num = 0;
+    return EOK;
+}
+
+static errno_t seed_bulk_get_id(struct ldb_message *msg, const char *attr,
+                                uint32_t *_id)
+{
+    const char *str;
+    char *endptr;
+    uint32_t id;
+
+    str = ldb_msg_find_attr_as_string(msg, attr, NULL);
+    if (str == NULL) {
+        return ENOENT;
+    }
+
+    errno = 0;
+    id = strtouint32(str, &endptr, 10);
+    if (errno != 0 || *endptr != '\0' || id == 0) {
+        return EINVAL;
+    }
+
+    *_id = id;
+    return EOK;
+}
+
+/* The users are read from posixAccount entries */
+static errno_t seed_bulk_add_user(struct seed_bulk_ctx *bctx,
+                                  struct ldb_message *msg)
+{
+    struct sysdb_bulk_user *user;
+    errno_t ret;
+
+    user = &bctx->users[bctx->num];
+    memset(user, 0, sizeof(struct sysdb_bulk_user));
+
+    user->name = ldb_msg_find_attr_as_string(msg, "uid", NULL);
+    if (user->name == NULL) {
+        return EINVAL;
+    }
+
+    ret = seed_bulk_get_id(msg, "uidNumber", &user->uid);
+    if (ret == EOK) {
+        ret = seed_bulk_get_id(msg, "gidNumber", &user->gid);
+    }
+    if (ret != EOK) {
+        return EINVAL;
+    }
+
+    user->gecos = ldb_msg_find_attr_as_string(msg, "gecos", NULL);
+    if (user->gecos == NULL) {
+        user->gecos = ldb_msg_find_attr_as_string(msg, "cn", NULL);
+    }
+    user->homedir = ldb_msg_find_attr_as_string(msg, "homeDirectory", NULL);
+    user->shell = ldb_msg_find_attr_as_string(msg, "loginShell", NULL);
+    user->orig_dn = ldb_dn_get_linearized(msg->dn);
+
+    bctx->num++;
+    return EOK;
+}
+
+/* The groups are read from posixGroup entries, their memberUid values are
+ * stored as ghost members which become real members once the users are
+ * stored */
+static errno_t seed_bulk_add_group(struct seed_bulk_ctx *bctx,
+                                   struct ldb_message *msg)
+{
+    struct sysdb_bulk_group *group;
+    struct ldb_message_element *el;
+    unsigned int i;
+    errno_t ret;
+
+    group = &bctx->groups[bctx->num];
+    memset(group, 0, sizeof(struct sysdb_bulk_group));
+
+    group->name = ldb_msg_find_attr_as_string(msg, "cn", NULL);
+    if (group->name == NULL) {
+        return EINVAL;
+    }
+
+    ret = seed_bulk_get_id(msg, "gidNumber", &group->gid);
+    if (ret != EOK) {
+        return EINVAL;
+    }
+
+    group->attrs = sysdb_new_attrs(bctx->batch);
+    if (group->attrs == NULL) {
+        return ENOMEM;
+    }
+
+    el = ldb_msg_find_element(msg, "memberUid");
+    for (i = 0; el != NULL && i < el->num_values; i++) {
+        ret = sysdb_attrs_add_string(group->attrs, SYSDB_GHOST,
+                                     (const char *)el->values[i].data);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    bctx->num++;
+    return EOK;
+}
+
+/* Reads the file once for the groups and then once more for the users, so
+ * that the users are linked to the groups they are members of when they are
+ * stored. Only SEED_BULK_BATCH entries are kept in memory at a time. */
+static errno_t seed_bulk_read_file(struct seed_bulk_ctx *bctx, FILE *file,
+                                   bool users)
+{
+    const char *class = users ? "posixAccount" : "posixGroup";
+    struct ldb_ldif *ldif;
+    errno_t ret;
+
+    rewind(file);
+
+    while ((ldif = ldb_ldif_read_file(bctx->ldb, file)) != NULL) {
+        if (ldb_msg_check_string_attribute(ldif->msg, "objectClass",
+                                           class) == 0) {
+            /* not of the kind read in this pass */
+            talloc_free(ldif);
+            continue;
+        }
+
+        /* the entry is referenced until its batch is stored */
+        talloc_steal(bctx->batch, ldif);
+
+        if (ldif->changetype != LDB_CHANGETYPE_NONE
+                && ldif->changetype != LDB_CHANGETYPE_ADD) {
+            ret = EINVAL;
+        } else if (users) {
+            ret = seed_bulk_add_user(bctx, ldif->msg);
+        } else {
+            ret = seed_bulk_add_group(bctx, ldif->msg);
+        }
+
+        if (ret == EINVAL) {
+            ERROR("Skipping invalid entry %1$s\n",
+                  ldb_dn_get_linearized(ldif->msg->dn));
+            bctx->num_failed++;
+            talloc_free(ldif);
+            continue;
+        } else if (ret != EOK) {
+            return ret;
+        }
+
+        if (bctx->num == SEED_BULK_BATCH) {
+            ret = users ? seed_bulk_flush_users(bctx)
+                        : seed_bulk_flush_groups(bctx);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+    }
+
+    if (ferror(file)) {
+        return EIO;
+    }
+
+    if (bctx->num == 0) {
+        return EOK;
+    }
+
+    return users ? seed_bulk_flush_users(bctx) : seed_bulk_flush_groups(bctx);
+}
+
+static int seed_cache_file(struct seed_ctx *sctx)
+{
+    struct seed_bulk_ctx *bctx;
+    FILE *file = NULL;
+    int ret;
+
+    bctx = talloc_zero(sctx, struct seed_bulk_ctx);
+    if (bctx == NULL) {
+        return ENOMEM;
+    }
+    bctx->domain = sctx->domain;
+    bctx->ldb = sysdb_ctx_get_ldb(sctx->sysdb);
+
+    bctx->batch = talloc_new(bctx);
+    bctx->users = talloc_array(bctx, struct sysdb_bulk_user, SEED_BULK_BATCH);
+    bctx->groups = talloc_array(bctx, struct sysdb_bulk_group,
+                                SEED_BULK_BATCH);
+    if (bctx->batch == NULL || bctx->users == NULL || bctx->groups == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    file = fopen(sctx->seed_file, "r");
+    if (file == NULL) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to open [%s] [%d][%s]\n",
+                                    sctx->seed_file, ret, strerror(ret));
+        ERROR("Failed to open %1$s\n", sctx->seed_file);
+        goto done;
+    }
+
+    ret = seed_bulk_read_file(bctx, file, false);
+    if (ret == EOK) {
+        ret = seed_bulk_read_file(bctx, file, true);
+    }
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to seed the cache from [%s] "
+                                    "[%d][%s]\n",
+                                    sctx->seed_file, ret, strerror(ret));
+        ERROR("Failed to seed the cache from %1$s\n", sctx->seed_file);
+        goto done;
+    }
+
+    printf(_("%1$zu cache entries created or updated, %2$zu failed\n"),
+           bctx->num_stored, bctx->num_failed);
+
+done:
+    if (file != NULL) {
+        fclose(file);
+    }
+    talloc_free(bctx);
+    return ret;
+}
+
 int main(int argc, const char **argv)
 {
     struct seed_ctx *sctx = NULL;
@@ -802,6 +1110,11 @@ int main(int argc, const char **argv)
         goto done;
     }
 
+    if (sctx->seed_file != NULL) {
+        ret = seed_cache_file(sctx);
+        goto done;
+    }
+
     /* get user info from domain */
     ret = seed_domain_user_info(sctx->uctx->name, sctx->uctx->domain_name,
                                 sctx->domain, &sctx->user_cached);
@@ -0,0 +1,262 @@
+/*
+    SSSD
+
+    sss_snapshot - export and import snapshots of the cache of a domain
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <talloc.h>
+#include <popt.h>
+
+#include "util/util.h"
+#include "db/sysdb.h"
+#include "db/sysdb_sudo.h"
+#include "tools/tools_util.h"
+#include "confdb/confdb.h"
+
+/* the subtrees the IPA access provider stores the HBAC rules in */
+static const char *hbac_subtrees[] = {
+    "hbac_rules",
+    "hbac_services",
+    "hbac_servicegroups",
+    "hbac_hosts",
+    "hbac_hostgroups",
+    NULL
+};
+
+static errno_t snapshot_init_domain(TALLOC_CTX *mem_ctx,
+                                    const char *domain_name,
+                                    struct sss_domain_info **_domain)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct confdb_ctx *confdb;
+    struct sss_domain_info *domain;
+    char *confdb_path;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    confdb_path = talloc_asprintf(tmp_ctx, "%s/%s", DB_PATH, CONFDB_FILE);
+    if (confdb_path == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = confdb_init(tmp_ctx, &confdb, confdb_path);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Could not initialize connection to the confdb\n");
+        ERROR("Could not initialize connection to the confdb\n");
+        goto done;
+    }
+
+    ret = sssd_domain_init(tmp_ctx, confdb, domain_name, DB_PATH, &domain);
+    if (ret != EOK) {
+        SYSDB_VERSION_ERROR(ret);
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Could not initialize connection to domain '%s' in sysdb.%s\n",
+              domain_name, ret == ENOENT ? " Domain not found." : "");
+        ERROR("Could not initialize connection to domain '%1$s' in sysdb.%2$s\n",
+              domain_name, ret == ENOENT ? " Domain not found." : "");
+        goto done;
+    }
+
+    /* the domain is allocated on the confdb */
+    talloc_steal(mem_ctx, confdb);
+    *_domain = domain;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t snapshot_export(struct sss_domain_info *domain,
+                               const char *path,
+                               bool sudo, bool hbac)
+{
+    const char *subtrees[sizeof(hbac_subtrees) / sizeof(char *) + 1];
+    FILE *file;
+    size_t count = 0;
+    errno_t ret;
+    int n = 0;
+    int i;
+
+    if (sudo) {
+        subtrees[n++] = SUDORULE_SUBDIR;
+    }
+    for (i = 0; hbac && hbac_subtrees[i] != NULL; i++) {
+        subtrees[n++] = hbac_subtrees[i];
+    }
+    subtrees[n] = NULL;
+
+    file = fopen(path, "w");
+    if (file == NULL) {
+        ret = errno;
+        ERROR("Unable to open %1$s: %2$s\n", path, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = sysdb_snapshot_export(domain, subtrees, file, &count);
+    if (fclose(file) != 0 && ret == EOK) {
+        ret = errno;
+    }
+    if (ret != EOK) {
+        ERROR("Unable to export the cache of %1$s: %2$s\n",
+              domain->name, sss_strerror(ret));
+        return ret;
+    }
+
+    printf(_("%1$zu cache entries exported\n"), count);
+    return EOK;
+}
+
+static errno_t snapshot_import(struct sss_domain_info *domain,
+                               const char *path)
+{
+    FILE *file;
+    size_t count = 0;
+    size_t failed = 0;
+    errno_t ret;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        ret = errno;
+        ERROR("Unable to open %1$s: %2$s\n", path, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = sysdb_snapshot_import(domain, file, &count, &failed);
+    fclose(file);
+    if (ret == EMEDIUMTYPE) {
+        ERROR("The snapshot was exported from another version of the "
+              "cache\n");
+        return ret;
+    } else if (ret != EOK) {
+        ERROR("Unable to import %1$s into the cache of %2$s: %3$s\n",
+              path, domain->name, sss_strerror(ret));
+        return ret;
+    }
+
+    /* the memory cache must not keep serving the entries replaced */
+    ret = sss_memcache_clear_all();
+    if (ret != EOK) {
+        ERROR("Unable to clear the memory cache\n");
+    }
+
+    printf(_("%1$zu cache entries imported, %2$zu failed\n"), count, failed);
+    return EOK;
+}
+
+int main(int argc, const char **argv)
+{
+    int pc_debug = SSSDBG_DEFAULT;
+    const char *pc_domain = NULL;
+    const char *pc_export = NULL;
+    const char *pc_import = NULL;
+    int pc_sudo = 0;
+    int pc_hbac = 0;
+    struct sss_domain_info *domain;
+    TALLOC_CTX *tmp_ctx = NULL;
+    errno_t ret;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        { "debug", '\0', POPT_ARG_INT | POPT_ARGFLAG_DOC_HIDDEN, &pc_debug,
+            0, _("The debug level to run with"), NULL },
+        { "domain", 'D', POPT_ARG_STRING, &pc_domain, 0, _("Domain"), NULL },
+        { "export", 'e', POPT_ARG_STRING, &pc_export, 0,
+            _("Export the cache of the domain to a file"), NULL },
+        { "import", 'i', POPT_ARG_STRING, &pc_import, 0,
+            _("Import a snapshot into the cache of the domain"), NULL },
+        { "sudo", '\0', POPT_ARG_NONE, &pc_sudo, 0,
+            _("Export the sudo rules as well"), NULL },
+        { "hbac", '\0', POPT_ARG_NONE, &pc_hbac, 0,
+            _("Export the HBAC rules as well"), NULL },
+        POPT_TABLEEND
+    };
+    poptContext pc = NULL;
+
+    debug_prg_name = argv[0];
+
+    ret = set_locale();
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "set_locale failed (%d): %s\n",
+                                    ret, strerror(ret));
+        ERROR("Error setting the locale\n");
+        ret = EXIT_FAILURE;
+        goto fini;
+    }
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    poptSetOtherOptionHelp(pc, "-D <domain> {-e <file> | -i <file>}");
+    while((ret = poptGetNextOpt(pc)) != -1) {
+        switch(ret) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(ret));
+            poptPrintUsage(pc, stderr, 0);
+            ret = EXIT_FAILURE;
+            goto fini;
+        }
+    }
+    DEBUG_CLI_INIT(pc_debug);
+
+    if (pc_domain == NULL) {
+        BAD_POPT_PARAMS(pc, _("Domain must be specified.\n"), ret, fini);
+    }
+
+    if ((pc_export == NULL) == (pc_import == NULL)) {
+        BAD_POPT_PARAMS(pc, _("Exactly one of --export and --import must be "
+                              "specified.\n"), ret, fini);
+    }
+
+    if (pc_import != NULL && (pc_sudo || pc_hbac)) {
+        BAD_POPT_PARAMS(pc, _("--sudo and --hbac can only be used with "
+                              "--export.\n"), ret, fini);
+    }
+
+    CHECK_ROOT(ret, argv[0]);
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        ret = EXIT_FAILURE;
+        goto fini;
+    }
+
+    ret = snapshot_init_domain(tmp_ctx, pc_domain, &domain);
+    if (ret != EOK) {
+        ret = EXIT_FAILURE;
+        goto fini;
+    }
+
+    if (pc_export != NULL) {
+        ret = snapshot_export(domain, pc_export, pc_sudo, pc_hbac);
+    } else {
+        ret = snapshot_import(domain, pc_import);
+    }
+
+    ret = (ret == EOK) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+fini:
+    talloc_free(tmp_ctx);
+    poptFreeContext(pc);
+    return ret;
+}
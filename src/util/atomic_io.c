@@ -18,6 +18,9 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdint.h>
+#include <sys/uio.h>
+
 #include "util/atomic_io.h"
 
 /* based on code from libssh <http://www.libssh.org> */
@@ -58,3 +61,58 @@ ssize_t sss_atomic_io_s(int fd, void *buf, size_t n, bool do_read)
 
     return pos;
 }
+
+ssize_t sss_atomic_write_msg_s(int fd, const void *buf, size_t n)
+{
+    uint32_t len;
+    struct iovec iov[2];
+    struct iovec *cur = iov;
+    int count = 2;
+    struct pollfd pfd;
+    ssize_t res;
+
+    if (n > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    len = n;
+
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof(len);
+    iov[1].iov_base = (void *) buf;
+    iov[1].iov_len = n;
+    if (n == 0) {
+        count = 1;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+
+    while (count > 0) {
+        res = writev(fd, cur, count);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                (void) poll(&pfd, 1, -1);
+                continue;
+            }
+            return -1;
+        }
+
+        /* skip what was written, partial writes of a pipe are possible
+         * when the message is larger than PIPE_BUF */
+        while (count > 0 && (size_t) res >= cur->iov_len) {
+            res -= cur->iov_len;
+            cur++;
+            count--;
+        }
+        if (count > 0) {
+            cur->iov_base = (uint8_t *) cur->iov_base + res;
+            cur->iov_len -= res;
+        }
+    }
+
+    return n;
+}
@@ -25,6 +25,7 @@
 #include <stdbool.h>
 #include <poll.h>
 #include <errno.h>
+#include <sys/types.h>
 
 /* Performs a read or write operation in an manner that is seemingly atomic
  * to the caller.
@@ -37,4 +38,12 @@ ssize_t sss_atomic_io_s(int fd, void *buf, size_t n, bool do_read);
 #define sss_atomic_read_s(fd, buf, n)  sss_atomic_io_s(fd, buf, n, true)
 #define sss_atomic_write_s(fd, buf, n) sss_atomic_io_s(fd, buf, n, false)
 
+/* Writes n as uint32_t followed by the n bytes of buf, the framing which the
+ * helpers that serve several requests use for their replies. The length and
+ * the data are written together without copying them.
+ *
+ * Returns n or -1 on error with errno set.
+ */
+ssize_t sss_atomic_write_msg_s(int fd, const void *buf, size_t n);
+
 #endif /* __SSSD_ATOMIC_IO_H__ */
@@ -27,11 +27,13 @@
 #include <tevent.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <spawn.h>
 
 #include "util/util.h"
 #include "util/find_uid.h"
 #include "db/sysdb.h"
 #include "util/child_common.h"
+#include "util/probes.h"
 
 struct sss_sigchild_ctx {
     struct tevent_context *ev;
@@ -216,6 +218,7 @@ static void sss_child_handler(struct tevent_context *ev,
             return;
         } else if (pid == 0) continue;
 
+        PROBE(CHILD_EXIT, pid, wait_status);
         key.ul = pid;
         error = hash_lookup(sigchld_ctx->children, &key, &value);
         if (error == HASH_SUCCESS) {
@@ -413,10 +416,16 @@ int write_pipe_recv(struct tevent_req *req)
     return EOK;
 }
 
+/* The reply is read into a buffer which doubles when it is full, large
+ * replies like GPO files or SELinux maps take a few reallocations instead
+ * of one per chunk. */
+#define READ_PIPE_INITIAL_SIZE 4096
+
 struct read_pipe_state {
     int fd;
     uint8_t *buf;
     size_t len;
+    size_t size;
 };
 
 static void read_pipe_handler(struct tevent_context *ev,
@@ -436,6 +445,7 @@ struct tevent_req *read_pipe_send(TALLOC_CTX *mem_ctx,
     state->fd = fd;
     state->buf = NULL;
     state->len = 0;
+    state->size = 0;
 
     fde = tevent_add_fd(ev, state, fd, TEVENT_FD_READ,
                         read_pipe_handler, req);
@@ -459,8 +469,8 @@ static void read_pipe_handler(struct tevent_context *ev,
     struct read_pipe_state *state = tevent_req_data(req,
                                                     struct read_pipe_state);
     ssize_t size;
+    size_t new_size;
     errno_t err;
-    uint8_t buf[CHILD_MSG_CHUNK];
 
     if (flags & TEVENT_FD_WRITE) {
         DEBUG(SSSDBG_CRIT_FAILURE, "read_pipe_done called with TEVENT_FD_WRITE,"
@@ -469,30 +479,47 @@ static void read_pipe_handler(struct tevent_context *ev,
         return;
     }
 
-    size = sss_atomic_read_s(state->fd,
-                buf,
-                CHILD_MSG_CHUNK);
+    if (state->size - state->len < CHILD_MSG_CHUNK) {
+        new_size = state->size == 0 ? READ_PIPE_INITIAL_SIZE
+                                    : state->size * 2;
+        state->buf = talloc_realloc(state, state->buf, uint8_t, new_size);
+        if (state->buf == NULL) {
+            tevent_req_error(req, ENOMEM);
+            return;
+        }
+        state->size = new_size;
+    }
+
+    /* read whatever is available straight into the buffer */
+    size = read(state->fd, state->buf + state->len, state->size - state->len);
     if (size == -1) {
         err = errno;
+        if (err == EAGAIN || err == EINTR) {
+            return;
+        }
         DEBUG(SSSDBG_CRIT_FAILURE,
               "read failed [%d][%s].\n", err, strerror(err));
         tevent_req_error(req, err);
         return;
 
     } else if (size > 0) {
-        state->buf = talloc_realloc(state, state->buf, uint8_t,
-                                    state->len + size);
-        if(!state->buf) {
-            tevent_req_error(req, ENOMEM);
-            return;
-        }
-
-        safealign_memcpy(&state->buf[state->len], buf,
-                         size, &state->len);
+        state->len += size;
         return;
 
     } else if (size == 0) {
         DEBUG(SSSDBG_TRACE_FUNC, "EOF received, client finished\n");
+
+        /* callers expect no buffer for an empty reply */
+        if (state->len == 0) {
+            talloc_zfree(state->buf);
+        } else if (state->len < state->size) {
+            state->buf = talloc_realloc(state, state->buf, uint8_t,
+                                        state->len);
+            if (state->buf == NULL) {
+                tevent_req_error(req, ENOMEM);
+                return;
+            }
+        }
         tevent_req_done(req);
         return;
 
@@ -518,6 +545,128 @@ int read_pipe_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+struct read_pipe_msg_state {
+    int fd;
+    size_t max_len;
+    uint8_t len_buf[sizeof(uint32_t)];
+    size_t len_read;
+    uint8_t *buf;
+    size_t len;
+    size_t read;
+};
+
+static void read_pipe_msg_handler(struct tevent_context *ev,
+                                  struct tevent_fd *fde,
+                                  uint16_t flags, void *pvt);
+
+struct tevent_req *read_pipe_msg_send(TALLOC_CTX *mem_ctx,
+                                      struct tevent_context *ev,
+                                      int fd, size_t max_len)
+{
+    struct tevent_req *req;
+    struct read_pipe_msg_state *state;
+    struct tevent_fd *fde;
+
+    req = tevent_req_create(mem_ctx, &state, struct read_pipe_msg_state);
+    if (req == NULL) return NULL;
+
+    state->fd = fd;
+    state->max_len = max_len;
+
+    fde = tevent_add_fd(ev, state, fd, TEVENT_FD_READ,
+                        read_pipe_msg_handler, req);
+    if (fde == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_fd failed.\n");
+        talloc_zfree(req);
+        return NULL;
+    }
+
+    return req;
+}
+
+static void read_pipe_msg_handler(struct tevent_context *ev,
+                                  struct tevent_fd *fde,
+                                  uint16_t flags, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct read_pipe_msg_state *state = tevent_req_data(req,
+                                                struct read_pipe_msg_state);
+    uint32_t len;
+    ssize_t size;
+    size_t p = 0;
+    errno_t ret;
+
+    /* the length first, then the message itself */
+    if (state->buf == NULL) {
+        size = read(state->fd, state->len_buf + state->len_read,
+                    sizeof(state->len_buf) - state->len_read);
+    } else {
+        size = read(state->fd, state->buf + state->read,
+                    state->len - state->read);
+    }
+
+    if (size == -1) {
+        ret = errno;
+        if (ret == EAGAIN || ret == EINTR) {
+            return;
+        }
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "read failed [%d][%s].\n", ret, strerror(ret));
+        tevent_req_error(req, ret);
+        return;
+    } else if (size == 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "The child closed the pipe.\n");
+        tevent_req_error(req, EPIPE);
+        return;
+    }
+
+    if (state->buf == NULL) {
+        state->len_read += size;
+        if (state->len_read < sizeof(state->len_buf)) {
+            return;
+        }
+
+        SAFEALIGN_COPY_UINT32(&len, state->len_buf, &p);
+        if (len > state->max_len) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Invalid message size %u.\n", len);
+            tevent_req_error(req, EINVAL);
+            return;
+        }
+
+        /* the child had nothing to send */
+        if (len == 0) {
+            tevent_req_done(req);
+            return;
+        }
+
+        state->buf = talloc_size(state, len);
+        if (state->buf == NULL) {
+            tevent_req_error(req, ENOMEM);
+            return;
+        }
+        state->len = len;
+        return;
+    }
+
+    state->read += size;
+    if (state->read == state->len) {
+        tevent_req_done(req);
+    }
+}
+
+int read_pipe_msg_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
+                       uint8_t **buf, ssize_t *len)
+{
+    struct read_pipe_msg_state *state = tevent_req_data(req,
+                                                struct read_pipe_msg_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *buf = talloc_steal(mem_ctx, state->buf);
+    *len = state->len;
+    return EOK;
+}
+
 static void child_invoke_callback(struct tevent_context *ev,
                                   struct tevent_immediate *imm,
                                   void *pvt);
@@ -549,6 +698,7 @@ static void child_sig_handler(struct tevent_context *ev,
         DEBUG(SSSDBG_CRIT_FAILURE,
               "waitpid did not found a child with changed status.\n");
     } else {
+        PROBE(CHILD_EXIT, ret, child_ctx->child_status);
         if (WIFEXITED(child_ctx->child_status)) {
             if (WEXITSTATUS(child_ctx->child_status) != 0) {
                 DEBUG(SSSDBG_CRIT_FAILURE,
@@ -768,6 +918,96 @@ errno_t exec_child_ex(TALLOC_CTX *mem_ctx,
     return err;
 }
 
+static sss_child_spawn_hook_t sss_child_spawn_hook;
+
+void sss_child_set_spawn_hook(sss_child_spawn_hook_t hook)
+{
+    sss_child_spawn_hook = hook;
+}
+
+errno_t spawn_child(TALLOC_CTX *mem_ctx,
+                    int *pipefd_to_child, int *pipefd_from_child,
+                    const char *binary, int debug_fd,
+                    const char *extra_argv[], bool extra_args_only,
+                    int child_in_fd, int child_out_fd,
+                    pid_t *_pid)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    char **argv = NULL;
+    pid_t pid;
+    errno_t ret;
+
+    ret = prepare_child_argv(mem_ctx, debug_fd,
+                             binary, extra_argv, extra_args_only,
+                             &argv);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "prepare_child_argv.\n");
+        return ret;
+    }
+
+    ret = posix_spawn_file_actions_init(&actions);
+    if (ret != 0) {
+        talloc_free(argv);
+        return ret;
+    }
+
+    ret = posix_spawnattr_init(&attr);
+    if (ret != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        talloc_free(argv);
+        return ret;
+    }
+
+    /* the same file descriptor setup as exec_child_ex() does after fork() */
+    ret = posix_spawn_file_actions_addclose(&actions, pipefd_to_child[1]);
+    if (ret == 0) {
+        ret = posix_spawn_file_actions_adddup2(&actions, pipefd_to_child[0],
+                                               child_in_fd);
+    }
+    if (ret == 0) {
+        ret = posix_spawn_file_actions_addclose(&actions,
+                                                pipefd_from_child[0]);
+    }
+    if (ret == 0) {
+        ret = posix_spawn_file_actions_adddup2(&actions, pipefd_from_child[1],
+                                               child_out_fd);
+    }
+#ifdef POSIX_SPAWN_USEVFORK
+    /* recent glibc does not copy the page tables anyway, older versions
+     * fork() unless asked not to */
+    if (ret == 0) {
+        ret = posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK);
+    }
+#endif
+    if (ret != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot set up the child [%d][%s].\n",
+              ret, strerror(ret));
+        goto done;
+    }
+
+    ret = posix_spawn(&pid, binary, &actions, &attr, argv, environ);
+    if (ret != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "posix_spawn of %s failed [%d][%s].\n",
+              binary, ret, strerror(ret));
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Started %s as [%d].\n", binary, pid);
+    PROBE(CHILD_SPAWN, binary, pid);
+    if (sss_child_spawn_hook != NULL) {
+        sss_child_spawn_hook(mem_ctx, binary, pid);
+    }
+    *_pid = pid;
+    ret = EOK;
+
+done:
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    talloc_free(argv);
+    return ret;
+}
+
 errno_t exec_child(TALLOC_CTX *mem_ctx,
                    int *pipefd_to_child, int *pipefd_from_child,
                    const char *binary, int debug_fd)
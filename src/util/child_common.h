@@ -33,6 +33,8 @@
 #include "util/util.h"
 
 #define IN_BUF_SIZE         512
+/* selinux_child reads the contexts of several users at once */
+#define SELINUX_CHILD_IN_BUF_SIZE (IN_BUF_SIZE * 16)
 #define CHILD_MSG_CHUNK     256
 
 struct response {
@@ -97,6 +99,15 @@ struct tevent_req *read_pipe_send(TALLOC_CTX *mem_ctx,
 int read_pipe_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
                    uint8_t **buf, ssize_t *len);
 
+/* Reads one message which a child that serves several requests prefixes
+ * with its length as uint32_t. A length of 0 means that the child had
+ * nothing to send, a length above max_len that the pipe is out of sync. */
+struct tevent_req *read_pipe_msg_send(TALLOC_CTX *mem_ctx,
+                                      struct tevent_context *ev,
+                                      int fd, size_t max_len);
+int read_pipe_msg_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
+                       uint8_t **buf, ssize_t *len);
+
 /* The pipes to communicate with the child must be nonblocking */
 void fd_nonblocking(int fd);
 
@@ -107,6 +118,24 @@ errno_t exec_child_ex(TALLOC_CTX *mem_ctx,
                       const char *extra_argv[], bool extra_args_only,
                       int child_in_fd, int child_out_fd);
 
+/* Starts binary with the same arguments and file descriptors as a fork()
+ * followed by exec_child_ex() would. posix_spawn() does not copy the memory
+ * mappings of the caller, so the cost does not grow with the size of the
+ * back end. The pid of the child is returned in _pid, the caller sets up
+ * its ends of the pipes as after fork(). */
+errno_t spawn_child(TALLOC_CTX *mem_ctx,
+                    int *pipefd_to_child, int *pipefd_from_child,
+                    const char *binary, int debug_fd,
+                    const char *extra_argv[], bool extra_args_only,
+                    int child_in_fd, int child_out_fd,
+                    pid_t *_pid);
+
+/* Called by spawn_child() with its memory context for every child it
+ * started, the back end attributes the children to its requests */
+typedef void (*sss_child_spawn_hook_t)(TALLOC_CTX *mem_ctx,
+                                       const char *binary, pid_t pid);
+void sss_child_set_spawn_hook(sss_child_spawn_hook_t hook);
+
 /* Same as exec_child_ex() except child_in_fd is set to STDIN_FILENO and
  * child_out_fd is set to STDOUT_FILENO and extra_argv is always NULL.
  */
@@ -0,0 +1,477 @@
+/*
+    SSSD
+
+    cmd_stats.c - latency histograms of the responder commands
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <ctype.h>
+
+#include "util/util.h"
+
+/* Each responder keeps its statistics in a file mapped by all of its
+ * processes, so that the NSS workers add to the same histograms and other
+ * processes, e.g. InfoPipe, can read them while the responder runs. The
+ * counters are updated with atomic operations, a reader may see a sample
+ * counted in one counter but not yet in another one. */
+#define CMD_STATS_MAGIC 0x53544353 /* SCTS */
+#define CMD_STATS_VERSION 2
+/* distinct commands per responder */
+#define CMD_STATS_SLOTS 64
+/* room for the cache counters, more than enum sss_cache_counter needs so
+ * that new counters do not change the layout */
+#define CMD_STATS_COUNTERS 16
+
+struct sss_cmd_stats_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t num_buckets;
+    uint64_t counters[CMD_STATS_COUNTERS];
+};
+
+struct sss_cmd_stats_counters {
+    uint64_t count;
+    uint64_t total_usec;
+    uint64_t max_usec;
+    uint64_t buckets[SSS_CMD_STATS_BUCKETS];
+};
+
+struct sss_cmd_stats_slot {
+    /* 0 for an unused slot */
+    uint32_t cmd;
+    uint32_t reserved;
+    struct sss_cmd_stats_counters sources[SSS_CMD_SRC_SENTINEL];
+};
+
+#define CMD_STATS_SIZE (sizeof(struct sss_cmd_stats_header) \
+                        + CMD_STATS_SLOTS * sizeof(struct sss_cmd_stats_slot))
+
+struct sss_cmd_stats {
+    void *map;
+    struct sss_cmd_stats_header *header;
+    struct sss_cmd_stats_slot *slots;
+};
+
+const char *sss_cmd_source_names[] = {
+    "memory",
+    "sysdb",
+    "dp",
+    NULL
+};
+
+const char *sss_cache_counter_names[] = {
+    "ncache_hits",
+    "ncache_misses",
+    "objcache_hits",
+    "sysdb_hits",
+    "sysdb_midpoint_refreshes",
+    "dp_lookups",
+    "inflight_joins",
+    NULL
+};
+
+static errno_t sss_cmd_stats_path(TALLOC_CTX *mem_ctx,
+                                  const char *service,
+                                  char **_path)
+{
+    const char *c;
+
+    /* the name becomes part of a path and may come from a D-Bus client */
+    if (service == NULL || *service == '\0') {
+        return EINVAL;
+    }
+    for (c = service; *c != '\0'; c++) {
+        if (!islower((unsigned char)*c)) {
+            return EINVAL;
+        }
+    }
+
+    *_path = talloc_asprintf(mem_ctx, "%s/cmdstats_%s", DB_PATH, service);
+    if (*_path == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static bool sss_cmd_stats_valid(struct sss_cmd_stats_header *header)
+{
+    return header->magic == CMD_STATS_MAGIC
+           && header->version == CMD_STATS_VERSION
+           && header->num_slots == CMD_STATS_SLOTS
+           && header->num_buckets == SSS_CMD_STATS_BUCKETS;
+}
+
+static errno_t sss_cmd_stats_create(const char *path)
+{
+    struct sss_cmd_stats_header header = { 0 };
+    char *tmp_path;
+    errno_t ret;
+    int fd;
+
+    tmp_path = talloc_asprintf(NULL, "%s.XXXXXX", path);
+    if (tmp_path == NULL) {
+        return ENOMEM;
+    }
+
+    fd = sss_unique_file(NULL, tmp_path, &ret);
+    if (fd == -1) {
+        talloc_free(tmp_path);
+        return ret;
+    }
+
+    ret = ftruncate(fd, CMD_STATS_SIZE);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    header.magic = CMD_STATS_MAGIC;
+    header.version = CMD_STATS_VERSION;
+    header.num_slots = CMD_STATS_SLOTS;
+    header.num_buckets = SSS_CMD_STATS_BUCKETS;
+
+    ret = sss_atomic_write_s(fd, &header, sizeof(header));
+    if (ret != sizeof(header)) {
+        ret = ret == -1 ? errno : EIO;
+        goto done;
+    }
+
+    /* does not replace a file created meanwhile by another process */
+    ret = link(tmp_path, path);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    close(fd);
+    unlink(tmp_path);
+    talloc_free(tmp_path);
+    return ret;
+}
+
+static errno_t sss_cmd_stats_map(const char *path, bool writable,
+                                 void **_map)
+{
+    struct stat st;
+    void *map;
+    errno_t ret;
+    int fd;
+
+    fd = sss_open_cloexec(path, writable ? O_RDWR : O_RDONLY, &ret);
+    if (fd == -1) {
+        return ret;
+    }
+
+    ret = fstat(fd, &st);
+    if (ret == -1) {
+        ret = errno;
+        close(fd);
+        return ret;
+    }
+
+    if (st.st_size != CMD_STATS_SIZE) {
+        close(fd);
+        return EINVAL;
+    }
+
+    map = mmap(NULL, CMD_STATS_SIZE,
+               writable ? PROT_READ | PROT_WRITE : PROT_READ,
+               MAP_SHARED, fd, 0);
+    ret = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        return ret;
+    }
+
+    if (!sss_cmd_stats_valid((struct sss_cmd_stats_header *)map)) {
+        munmap(map, CMD_STATS_SIZE);
+        return EINVAL;
+    }
+
+    *_map = map;
+    return EOK;
+}
+
+static int sss_cmd_stats_destructor(struct sss_cmd_stats *stats)
+{
+    munmap(stats->map, CMD_STATS_SIZE);
+    return 0;
+}
+
+errno_t sss_cmd_stats_open(TALLOC_CTX *mem_ctx,
+                           const char *service,
+                           struct sss_cmd_stats **_stats)
+{
+    struct sss_cmd_stats *stats;
+    char *path;
+    void *map;
+    errno_t ret;
+    int i;
+
+    ret = sss_cmd_stats_path(mem_ctx, service, &path);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    for (i = 0; i < 2; i++) {
+        ret = sss_cmd_stats_map(path, true, &map);
+        if (ret == EOK) {
+            break;
+        } else if (ret == EINVAL) {
+            /* left by an incompatible version */
+            unlink(path);
+        } else if (ret != ENOENT) {
+            break;
+        }
+
+        ret = sss_cmd_stats_create(path);
+        if (ret != EOK && ret != EEXIST) {
+            break;
+        }
+        ret = EAGAIN;
+    }
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Unable to open the command statistics [%s] [%d]: %s\n",
+              path, ret, sss_strerror(ret));
+        talloc_free(path);
+        return ret;
+    }
+    talloc_free(path);
+
+    stats = talloc_zero(mem_ctx, struct sss_cmd_stats);
+    if (stats == NULL) {
+        munmap(map, CMD_STATS_SIZE);
+        return ENOMEM;
+    }
+
+    stats->map = map;
+    stats->header = (struct sss_cmd_stats_header *)map;
+    stats->slots = (struct sss_cmd_stats_slot *)(stats->header + 1);
+    talloc_set_destructor(stats, sss_cmd_stats_destructor);
+
+    *_stats = stats;
+    return EOK;
+}
+
+static struct sss_cmd_stats_slot *
+sss_cmd_stats_get_slot(struct sss_cmd_stats *stats, uint32_t cmd)
+{
+    struct sss_cmd_stats_slot *slot;
+    int i;
+
+    for (i = 0; i < CMD_STATS_SLOTS; i++) {
+        slot = &stats->slots[i];
+
+        if (slot->cmd == cmd) {
+            return slot;
+        }
+
+        if (slot->cmd == 0) {
+            if (__sync_bool_compare_and_swap(&slot->cmd, 0, cmd)
+                    || slot->cmd == cmd) {
+                return slot;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int sss_cmd_stats_bucket(uint64_t usec)
+{
+    int bucket = 0;
+
+    for (usec >>= 4; usec != 0 && bucket < SSS_CMD_STATS_BUCKETS - 1;
+         usec >>= 1) {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void sss_cmd_stats_add(struct sss_cmd_stats *stats,
+                       uint32_t cmd,
+                       enum sss_cmd_source source,
+                       uint64_t usec)
+{
+    struct sss_cmd_stats_slot *slot;
+    struct sss_cmd_stats_counters *counters;
+    uint64_t max;
+
+    if (stats == NULL || cmd == 0 || source >= SSS_CMD_SRC_SENTINEL) {
+        return;
+    }
+
+    slot = sss_cmd_stats_get_slot(stats, cmd);
+    if (slot == NULL) {
+        return;
+    }
+    counters = &slot->sources[source];
+
+    __sync_add_and_fetch(&counters->count, 1);
+    __sync_add_and_fetch(&counters->total_usec, usec);
+    __sync_add_and_fetch(&counters->buckets[sss_cmd_stats_bucket(usec)], 1);
+
+    max = counters->max_usec;
+    while (usec > max) {
+        if (__sync_bool_compare_and_swap(&counters->max_usec, max, usec)) {
+            break;
+        }
+        max = counters->max_usec;
+    }
+}
+
+static errno_t sss_cmd_stats_copy(TALLOC_CTX *mem_ctx,
+                                  struct sss_cmd_stats_slot *slots,
+                                  struct sss_cmd_stats_entry **_entries,
+                                  size_t *_count)
+{
+    struct sss_cmd_stats_entry *entries;
+    struct sss_cmd_stats_counters *counters;
+    size_t count = 0;
+    int i;
+    int j;
+
+    entries = talloc_zero_array(mem_ctx, struct sss_cmd_stats_entry,
+                                CMD_STATS_SLOTS * SSS_CMD_SRC_SENTINEL);
+    if (entries == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < CMD_STATS_SLOTS && slots[i].cmd != 0; i++) {
+        for (j = 0; j < SSS_CMD_SRC_SENTINEL; j++) {
+            counters = &slots[i].sources[j];
+            if (counters->count == 0) {
+                continue;
+            }
+
+            entries[count].cmd = slots[i].cmd;
+            entries[count].source = j;
+            entries[count].count = counters->count;
+            entries[count].total_usec = counters->total_usec;
+            entries[count].max_usec = counters->max_usec;
+            memcpy(entries[count].buckets, counters->buckets,
+                   sizeof(entries[count].buckets));
+            count++;
+        }
+    }
+
+    *_entries = entries;
+    *_count = count;
+    return EOK;
+}
+
+errno_t sss_cmd_stats_get(TALLOC_CTX *mem_ctx,
+                          struct sss_cmd_stats *stats,
+                          struct sss_cmd_stats_entry **_entries,
+                          size_t *_count)
+{
+    return sss_cmd_stats_copy(mem_ctx, stats->slots, _entries, _count);
+}
+
+errno_t sss_cmd_stats_read(TALLOC_CTX *mem_ctx,
+                           const char *service,
+                           struct sss_cmd_stats_entry **_entries,
+                           size_t *_count)
+{
+    char *path;
+    void *map;
+    errno_t ret;
+
+    ret = sss_cmd_stats_path(mem_ctx, service, &path);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sss_cmd_stats_map(path, false, &map);
+    if (ret != EOK) {
+        DEBUG(ret == ENOENT ? SSSDBG_TRACE_FUNC : SSSDBG_OP_FAILURE,
+              "Unable to read the command statistics [%s] [%d]: %s\n",
+              path, ret, sss_strerror(ret));
+        talloc_free(path);
+        return ret;
+    }
+    talloc_free(path);
+
+    ret = sss_cmd_stats_copy(mem_ctx,
+                             (struct sss_cmd_stats_slot *)
+                             ((struct sss_cmd_stats_header *)map + 1),
+                             _entries, _count);
+    munmap(map, CMD_STATS_SIZE);
+    return ret;
+}
+
+uint64_t sss_cmd_stats_bucket_limit(int bucket)
+{
+    return (uint64_t)16 << bucket;
+}
+
+void sss_cmd_stats_count(struct sss_cmd_stats *stats,
+                         enum sss_cache_counter counter)
+{
+    if (stats == NULL || counter >= SSS_CACHE_COUNTER_SENTINEL
+            || counter >= CMD_STATS_COUNTERS) {
+        return;
+    }
+
+    __sync_add_and_fetch(&stats->header->counters[counter], 1);
+}
+
+errno_t sss_cmd_stats_read_counters(const char *service,
+                                    uint64_t counters[SSS_CACHE_COUNTER_SENTINEL])
+{
+    struct sss_cmd_stats_header *header;
+    char *path;
+    void *map;
+    errno_t ret;
+    int i;
+
+    ret = sss_cmd_stats_path(NULL, service, &path);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sss_cmd_stats_map(path, false, &map);
+    if (ret != EOK) {
+        DEBUG(ret == ENOENT ? SSSDBG_TRACE_FUNC : SSSDBG_OP_FAILURE,
+              "Unable to read the cache counters [%s] [%d]: %s\n",
+              path, ret, sss_strerror(ret));
+        talloc_free(path);
+        return ret;
+    }
+    talloc_free(path);
+
+    header = (struct sss_cmd_stats_header *)map;
+    for (i = 0; i < SSS_CACHE_COUNTER_SENTINEL && i < CMD_STATS_COUNTERS;
+         i++) {
+        counters[i] = header->counters[i];
+    }
+    munmap(map, CMD_STATS_SIZE);
+
+    return EOK;
+}
@@ -349,6 +349,12 @@ int s3crypt_sha512(TALLOC_CTX *memctx,
     return ret;
 }
 
+int s3crypt_sha512_r(const char *key, const char *salt,
+                     char *buffer, size_t buflen)
+{
+    return sha512_crypt_r(key, salt, buffer, buflen);
+}
+
 #define SALT_RAND_LEN 12
 
 int s3crypt_gen_salt(TALLOC_CTX *memctx, char **_salt)
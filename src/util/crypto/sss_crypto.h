@@ -3,6 +3,27 @@ int s3crypt_sha512(TALLOC_CTX *mmectx,
                    const char *key, const char *salt, char **_hash);
 int s3crypt_gen_salt(TALLOC_CTX *memctx, char **_salt);
 
+/* Size of the buffer s3crypt_sha512_r() needs for the given salt */
+#define S3CRYPT_SHA512_LEN(salt) (sizeof("$6$") - 1 + sizeof("rounds=") \
+                                  + 9 + 1 + strlen(salt) + 1 + 86 + 1)
+
+/* Does not allocate memory, can be called from any thread once the crypto
+ * library was initialized, e.g. by a first call of s3crypt_sha512() */
+int s3crypt_sha512_r(const char *key, const char *salt,
+                     char *buffer, size_t buflen);
+
+struct tevent_context;
+struct tevent_req;
+
+/* The hash is computed by a pool of threads, the result is delivered on
+ * the event loop. The key is copied and wiped when the request is done. */
+struct tevent_req *s3crypt_sha512_send(TALLOC_CTX *mem_ctx,
+                                       struct tevent_context *ev,
+                                       const char *key,
+                                       const char *salt);
+int s3crypt_sha512_recv(struct tevent_req *req,
+                        TALLOC_CTX *mem_ctx, char **_hash);
+
 /* Methods of obfuscation. */
 enum obfmethod {
     AES_256,
@@ -27,6 +48,11 @@ int sss_hmac_sha1(const unsigned char *key,
                   size_t in_len,
                   unsigned char *out);
 
+#define SSS_SHA256_LENGTH 32
+
+/* out must have room for SSS_SHA256_LENGTH bytes */
+int sss_sha256(const unsigned char *in, size_t in_len, unsigned char *out);
+
 int sss_password_encrypt(TALLOC_CTX *mem_ctx, const char *password, int plen,
                          enum obfmethod meth, char **obfpwd);
 
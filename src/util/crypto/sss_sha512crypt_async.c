@@ -0,0 +1,409 @@
+/*
+    SSSD
+
+    Computing salted SHA-512 crypt hashes outside of the event loop
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+
+#include "util/util.h"
+#include "util/crypto/sss_crypto.h"
+
+/* A salted SHA-512 crypt hash is slow on purpose, computed on the event loop
+ * it stalls every other request of the process. The hashes are computed by
+ * a few threads instead. The threads only touch the buffers of their job,
+ * they never call talloc or DEBUG. A finished job is handed back through a
+ * pipe which wakes up the event loop. */
+
+#define S3CRYPT_MAX_THREADS 4
+
+enum s3crypt_job_status {
+    S3CRYPT_JOB_QUEUED,
+    S3CRYPT_JOB_RUNNING,
+    S3CRYPT_JOB_FINISHED
+};
+
+struct s3crypt_job {
+    struct s3crypt_job *prev;
+    struct s3crypt_job *next;
+
+    enum s3crypt_job_status status;
+    char *key;
+    char *salt;
+    char *hash;
+    size_t hash_len;
+    int ret;
+
+    /* NULL if the request was freed before the job finished */
+    struct tevent_req *req;
+};
+
+struct s3crypt_pool {
+    struct tevent_context *ev;
+    struct tevent_fd *fde;
+    int pipefd[2];
+
+    /* protects the job lists and the job status */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct s3crypt_job *queued;
+    struct s3crypt_job *finished;
+    bool shutdown;
+
+    pthread_t threads[S3CRYPT_MAX_THREADS];
+    int num_threads;
+};
+
+/* There is one event loop per process, requests of another loop are
+ * served synchronously */
+static struct s3crypt_pool *s3crypt_pool;
+
+struct s3crypt_sha512_state {
+    struct s3crypt_job *job;
+    char *hash;
+};
+
+static void *s3crypt_pool_thread(void *ptr)
+{
+    struct s3crypt_pool *pool = (struct s3crypt_pool *) ptr;
+    struct s3crypt_job *job;
+    const char c = 0;
+    ssize_t len;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->queued == NULL && !pool->shutdown) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+
+        if (pool->shutdown) {
+            break;
+        }
+
+        job = pool->queued;
+        DLIST_REMOVE(pool->queued, job);
+        job->status = S3CRYPT_JOB_RUNNING;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->ret = s3crypt_sha512_r(job->key, job->salt,
+                                    job->hash, job->hash_len);
+
+        pthread_mutex_lock(&pool->lock);
+        job->status = S3CRYPT_JOB_FINISHED;
+        DLIST_ADD_END(pool->finished, job, struct s3crypt_job *);
+
+        /* if the pipe is full the event loop is woken up anyway */
+        len = write(pool->pipefd[1], &c, sizeof(c));
+        (void) len;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static void s3crypt_pool_wakeup(struct tevent_context *ev,
+                                struct tevent_fd *fde,
+                                uint16_t flags, void *pvt)
+{
+    struct s3crypt_pool *pool = talloc_get_type(pvt, struct s3crypt_pool);
+    struct s3crypt_sha512_state *state;
+    struct s3crypt_job *finished;
+    struct s3crypt_job *job;
+    struct tevent_req *req;
+    char buf[64];
+
+    while (read(pool->pipefd[0], buf, sizeof(buf)) > 0);
+
+    pthread_mutex_lock(&pool->lock);
+    finished = pool->finished;
+    pool->finished = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    while (finished != NULL) {
+        job = finished;
+        DLIST_REMOVE(finished, job);
+
+        req = job->req;
+        if (req == NULL) {
+            talloc_free(job);
+            continue;
+        }
+
+        state = tevent_req_data(req, struct s3crypt_sha512_state);
+        state->job = NULL;
+
+        if (job->ret != EOK) {
+            talloc_free(job);
+            tevent_req_error(req, EIO);
+            continue;
+        }
+
+        state->hash = talloc_steal(state, job->hash);
+        talloc_free(job);
+        tevent_req_done(req);
+    }
+}
+
+static int s3crypt_pool_destructor(struct s3crypt_pool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+
+    talloc_zfree(pool->fde);
+    close(pool->pipefd[0]);
+    close(pool->pipefd[1]);
+
+    if (s3crypt_pool == pool) {
+        s3crypt_pool = NULL;
+    }
+
+    return 0;
+}
+
+static errno_t s3crypt_pipe_setup(int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return errno;
+    }
+
+    flags = fcntl(fd, F_GETFD, 0);
+    if (flags == -1 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
+        return errno;
+    }
+
+    return EOK;
+}
+
+static errno_t s3crypt_pool_setup(struct tevent_context *ev)
+{
+    struct s3crypt_pool *pool;
+    sigset_t sigset;
+    sigset_t oldset;
+    char *hash;
+    long cpus;
+    int num_threads;
+    int ret;
+    int i;
+
+    if (s3crypt_pool != NULL) {
+        return s3crypt_pool->ev == ev ? EOK : EBUSY;
+    }
+
+    /* A crypto library which initializes itself lazily must do so before
+     * there is a second thread */
+    ret = s3crypt_sha512(NULL, "", "$6$rounds=1000$sssd", &hash);
+    if (ret != EOK) {
+        return ret;
+    }
+    talloc_free(hash);
+
+    pool = talloc_zero(ev, struct s3crypt_pool);
+    if (pool == NULL) {
+        return ENOMEM;
+    }
+    pool->ev = ev;
+
+    ret = pipe(pool->pipefd);
+    if (ret == -1) {
+        ret = errno;
+        talloc_free(pool);
+        return ret;
+    }
+
+    ret = s3crypt_pipe_setup(pool->pipefd[0]);
+    if (ret == EOK) {
+        ret = s3crypt_pipe_setup(pool->pipefd[1]);
+    }
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    ret = pthread_mutex_init(&pool->lock, NULL);
+    if (ret != 0) {
+        goto fail;
+    }
+
+    ret = pthread_cond_init(&pool->cond, NULL);
+    if (ret != 0) {
+        pthread_mutex_destroy(&pool->lock);
+        goto fail;
+    }
+
+    talloc_set_destructor(pool, s3crypt_pool_destructor);
+
+    pool->fde = tevent_add_fd(ev, pool, pool->pipefd[0], TEVENT_FD_READ,
+                              s3crypt_pool_wakeup, pool);
+    if (pool->fde == NULL) {
+        talloc_free(pool);
+        return ENOMEM;
+    }
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = MAX(1, MIN(cpus, S3CRYPT_MAX_THREADS));
+
+    /* signals are handled by the event loop of the main thread */
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, &oldset);
+    for (i = 0; i < num_threads; i++) {
+        ret = pthread_create(&pool->threads[i], NULL,
+                             s3crypt_pool_thread, pool);
+        if (ret != 0) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "pthread_create failed [%d]: %s\n", ret, sss_strerror(ret));
+            break;
+        }
+        pool->num_threads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+    if (pool->num_threads == 0) {
+        talloc_free(pool);
+        return ret;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Started %d threads to compute password hashes\n",
+          pool->num_threads);
+    s3crypt_pool = pool;
+    return EOK;
+
+fail:
+    close(pool->pipefd[0]);
+    close(pool->pipefd[1]);
+    talloc_free(pool);
+    return ret;
+}
+
+static int s3crypt_job_destructor(struct s3crypt_job *job)
+{
+    safezero(job->key, strlen(job->key));
+    return 0;
+}
+
+static int s3crypt_sha512_state_destructor(struct s3crypt_sha512_state *state)
+{
+    struct s3crypt_job *job = state->job;
+
+    if (job == NULL || s3crypt_pool == NULL) {
+        return 0;
+    }
+
+    /* a job which is already running is freed when it finishes */
+    pthread_mutex_lock(&s3crypt_pool->lock);
+    if (job->status == S3CRYPT_JOB_QUEUED) {
+        DLIST_REMOVE(s3crypt_pool->queued, job);
+        talloc_free(job);
+    } else {
+        job->req = NULL;
+    }
+    pthread_mutex_unlock(&s3crypt_pool->lock);
+
+    return 0;
+}
+
+struct tevent_req *s3crypt_sha512_send(TALLOC_CTX *mem_ctx,
+                                       struct tevent_context *ev,
+                                       const char *key,
+                                       const char *salt)
+{
+    struct s3crypt_sha512_state *state;
+    struct s3crypt_job *job;
+    struct tevent_req *req;
+    int ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct s3crypt_sha512_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    ret = s3crypt_pool_setup(ev);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Computing the hash synchronously [%d]: %s\n",
+              ret, sss_strerror(ret));
+        ret = s3crypt_sha512(state, key, salt, &state->hash);
+        goto immediately;
+    }
+
+    job = talloc_zero(s3crypt_pool, struct s3crypt_job);
+    if (job == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    job->key = talloc_strdup(job, key);
+    job->salt = talloc_strdup(job, salt);
+    job->hash_len = S3CRYPT_SHA512_LEN(salt);
+    job->hash = talloc_size(job, job->hash_len);
+    if (job->key == NULL || job->salt == NULL || job->hash == NULL) {
+        talloc_free(job);
+        ret = ENOMEM;
+        goto immediately;
+    }
+    talloc_set_destructor(job, s3crypt_job_destructor);
+
+    job->req = req;
+    job->status = S3CRYPT_JOB_QUEUED;
+    state->job = job;
+    talloc_set_destructor(state, s3crypt_sha512_state_destructor);
+
+    pthread_mutex_lock(&s3crypt_pool->lock);
+    DLIST_ADD_END(s3crypt_pool->queued, job, struct s3crypt_job *);
+    pthread_cond_signal(&s3crypt_pool->cond);
+    pthread_mutex_unlock(&s3crypt_pool->lock);
+
+    return req;
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+
+    return req;
+}
+
+int s3crypt_sha512_recv(struct tevent_req *req,
+                        TALLOC_CTX *mem_ctx, char **_hash)
+{
+    struct s3crypt_sha512_state *state;
+
+    state = tevent_req_data(req, struct s3crypt_sha512_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_hash = talloc_steal(mem_ctx, state->hash);
+
+    return EOK;
+}
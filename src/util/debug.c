@@ -45,6 +45,32 @@ int debug_to_file = 0;
 int debug_to_stderr = 0;
 const char *debug_log_file = "sssd";
 FILE *debug_file = NULL;
+int debug_backtrace_level = 0;
+
+/* Longest message that is buffered, longer ones are written directly */
+#define DEBUG_LINE_MAX 4096
+/* Memory kept for the messages of the debug backtrace */
+#define DEBUG_BACKTRACE_SIZE (256 * 1024)
+
+#define DEBUG_LEVEL_FAILURE (SSSDBG_FATAL_FAILURE | \
+                             SSSDBG_CRIT_FAILURE | \
+                             SSSDBG_OP_FAILURE)
+
+/* Only the main thread of a process sends debug messages, the buffers need
+ * no locking. They are owned by the process which set them up, a child
+ * forked between two flushes must not write the messages of its parent. */
+struct debug_buffer {
+    char *buf;
+    size_t size;
+    size_t len;
+    /* the backtrace is a ring which overwrites its oldest messages */
+    size_t start;
+    bool wrapped;
+    pid_t owner;
+};
+
+static struct debug_buffer debug_out;
+static struct debug_buffer debug_bt;
 
 errno_t set_debug_file_from_fd(const int fd)
 {
@@ -65,6 +91,7 @@ errno_t set_debug_file_from_fd(const int fd)
         return ret;
     }
 
+    debug_flush();
     debug_file = dummy;
 
     return EOK;
@@ -143,6 +170,267 @@ static void debug_printf(const char *format, ...)
     va_end(ap);
 }
 
+static void debug_write(const char *data, size_t len)
+{
+    FILE *f = debug_file ? debug_file : stderr;
+
+    fwrite(data, 1, len, f);
+    fflush(f);
+}
+
+static bool debug_buffer_owned(struct debug_buffer *b)
+{
+    if (b->buf == NULL) {
+        return false;
+    }
+
+    if (b->owner != getpid()) {
+        /* inherited from the parent, whose copy is flushed by the parent */
+        b->len = 0;
+        b->start = 0;
+        b->wrapped = false;
+        b->owner = getpid();
+    }
+
+    return true;
+}
+
+void debug_flush(void)
+{
+    if (!debug_buffer_owned(&debug_out) || debug_out.len == 0) {
+        return;
+    }
+
+    debug_write(debug_out.buf, debug_out.len);
+    debug_out.len = 0;
+}
+
+static void debug_out_append(const char *line, size_t len)
+{
+    if (debug_out.len + len > debug_out.size) {
+        debug_flush();
+    }
+
+    if (len > debug_out.size) {
+        debug_write(line, len);
+        return;
+    }
+
+    memcpy(debug_out.buf + debug_out.len, line, len);
+    debug_out.len += len;
+}
+
+static void debug_bt_append(const char *line, size_t len)
+{
+    size_t pos;
+    size_t chunk;
+
+    if (len > debug_bt.size) {
+        return;
+    }
+
+    if (debug_bt.len + len > debug_bt.size) {
+        /* drop the oldest bytes, the partial message they leave behind is
+         * skipped when the ring is written */
+        chunk = debug_bt.len + len - debug_bt.size;
+        debug_bt.start = (debug_bt.start + chunk) % debug_bt.size;
+        debug_bt.len -= chunk;
+        debug_bt.wrapped = true;
+    }
+
+    pos = (debug_bt.start + debug_bt.len) % debug_bt.size;
+    chunk = MIN(len, debug_bt.size - pos);
+    memcpy(debug_bt.buf + pos, line, chunk);
+    memcpy(debug_bt.buf, line + chunk, len - chunk);
+    debug_bt.len += len;
+}
+
+static void debug_bt_dump(void)
+{
+    static const char begin[] = "   *  ---- begin of the debug backtrace ----\n";
+    static const char end[] = "   *  ---- end of the debug backtrace ----\n";
+    size_t first;
+    size_t skip;
+    size_t pos;
+    size_t i;
+
+    if (!debug_buffer_owned(&debug_bt) || debug_bt.len == 0) {
+        return;
+    }
+
+    /* once the ring wrapped its first message may be cut */
+    skip = 0;
+    if (debug_bt.wrapped) {
+        for (i = 0; i < debug_bt.len; i++) {
+            if (debug_bt.buf[(debug_bt.start + i) % debug_bt.size] == '\n') {
+                skip = i + 1;
+                break;
+            }
+        }
+    }
+
+    debug_flush();
+    debug_write(begin, sizeof(begin) - 1);
+
+    pos = (debug_bt.start + skip) % debug_bt.size;
+    first = MIN(debug_bt.len - skip, debug_bt.size - pos);
+    debug_write(debug_bt.buf + pos, first);
+    debug_write(debug_bt.buf, debug_bt.len - skip - first);
+
+    debug_write(end, sizeof(end) - 1);
+
+    debug_bt.len = 0;
+    debug_bt.start = 0;
+    debug_bt.wrapped = false;
+}
+
+static int debug_format_prefix(char *buf, size_t size,
+                               const char *function, int level)
+{
+    struct timeval tv;
+    struct tm *tm;
+    char datetime[20];
+    int year;
+
+    if (debug_timestamps) {
+        gettimeofday(&tv, NULL);
+        tm = localtime(&tv.tv_sec);
+        year = tm->tm_year + 1900;
+        /* get date time without year */
+        memcpy(datetime, ctime(&tv.tv_sec), 19);
+        datetime[19] = '\0';
+        if (debug_microseconds) {
+            return snprintf(buf, size, "(%s:%.6ld %d) [%s] [%s] (%#.4x): ",
+                            datetime, tv.tv_usec,
+                            year, debug_prg_name,
+                            function, level);
+        } else {
+            return snprintf(buf, size, "(%s %d) [%s] [%s] (%#.4x): ",
+                            datetime, year,
+                            debug_prg_name, function, level);
+        }
+    }
+
+    return snprintf(buf, size, "[%s] [%s] (%#.4x): ",
+                    debug_prg_name, function, level);
+}
+
+/* Formats the message into memory and either appends it to the output
+ * buffer or keeps it for the backtrace. Returns false if the caller has
+ * to write the message itself, e.g. because it is too long. */
+static bool debug_buffered_vdebug(const char *function, int level,
+                                  const char *format, va_list ap)
+{
+    char line[DEBUG_LINE_MAX];
+    bool logged;
+    int plen;
+    int len;
+
+    logged = DEBUG_IS_SET(level);
+    if (logged && debug_out.buf == NULL && debug_bt.buf != NULL
+            && !(level & DEBUG_LEVEL_FAILURE)) {
+        /* nothing to buffer, keep the usual unbuffered path */
+        return false;
+    }
+
+    plen = debug_format_prefix(line, sizeof(line), function, level);
+    if (plen < 0 || plen >= sizeof(line)) {
+        return false;
+    }
+
+    len = vsnprintf(line + plen, sizeof(line) - plen, format, ap);
+    if (len < 0) {
+        return true;
+    }
+    if (plen + len >= sizeof(line)) {
+        if (logged) {
+            if (level & DEBUG_LEVEL_FAILURE) {
+                debug_bt_dump();
+            }
+            debug_flush();
+            return false;
+        }
+        /* keep the truncated message in the backtrace */
+        len = sizeof(line) - plen - 1;
+        line[sizeof(line) - 2] = '\n';
+    }
+    len += plen;
+
+    if (!logged) {
+        if (debug_buffer_owned(&debug_bt)) {
+            debug_bt_append(line, len);
+        }
+        return true;
+    }
+
+    if (level & DEBUG_LEVEL_FAILURE) {
+        /* show what led to the failure before the failure itself */
+        debug_bt_dump();
+    }
+
+    if (debug_buffer_owned(&debug_out)) {
+        debug_out_append(line, len);
+        if (level & (SSSDBG_FATAL_FAILURE | SSSDBG_CRIT_FAILURE)) {
+            /* the process may be about to exit */
+            debug_flush();
+        }
+    } else {
+        debug_write(line, len);
+    }
+
+    return true;
+}
+
+static void debug_buffers_atexit(void)
+{
+    debug_flush();
+}
+
+/* buffer_size is the size of the output buffer, the messages are written
+ * when it is full, when debug_flush() is called by the main loop before it
+ * waits for events and right away if they report a serious failure.
+ * backtrace_level is a debug level whose messages not already logged
+ * because of debug_level are kept in memory and written only before the next
+ * message about a failure. 0 disables either. */
+errno_t debug_init_buffers(size_t buffer_size, int backtrace_level)
+{
+    static bool atexit_set = false;
+
+    debug_flush();
+    free(debug_out.buf);
+    free(debug_bt.buf);
+    memset(&debug_out, 0, sizeof(debug_out));
+    memset(&debug_bt, 0, sizeof(debug_bt));
+    debug_backtrace_level = 0;
+
+    if (buffer_size > 0) {
+        debug_out.buf = malloc(buffer_size);
+        if (debug_out.buf == NULL) {
+            return ENOMEM;
+        }
+        debug_out.size = buffer_size;
+        debug_out.owner = getpid();
+
+        if (!atexit_set) {
+            if (atexit(debug_buffers_atexit) == 0) {
+                atexit_set = true;
+            }
+        }
+    }
+
+    if (backtrace_level != 0) {
+        debug_bt.buf = malloc(DEBUG_BACKTRACE_SIZE);
+        if (debug_bt.buf == NULL) {
+            return ENOMEM;
+        }
+        debug_bt.size = DEBUG_BACKTRACE_SIZE;
+        debug_bt.owner = getpid();
+        debug_backtrace_level = debug_convert_old_level(backtrace_level);
+    }
+
+    return EOK;
+}
+
 #ifdef WITH_JOURNALD
 errno_t journal_send(const char *file,
         long line,
@@ -217,12 +505,19 @@ void sss_vdebug_fn(const char *file,
     struct tm *tm;
     char datetime[20];
     int year;
+    va_list ap_buffered;
+    bool buffered;
 
 #ifdef WITH_JOURNALD
     errno_t ret;
     va_list ap_fallback;
 
     if (!debug_file && !debug_to_stderr) {
+        if (!DEBUG_IS_SET(level)) {
+            /* the backtrace is not available with journald */
+            return;
+        }
+
         /* If we are not outputting logs to files, we should be sending them
          * to journald.
          * NOTE: on modern systems, this is where stdout/stderr will end up
@@ -242,6 +537,19 @@ void sss_vdebug_fn(const char *file,
     }
 #endif
 
+    if (debug_out.buf != NULL || debug_bt.buf != NULL) {
+        va_copy(ap_buffered, ap);
+        buffered = debug_buffered_vdebug(function, level, format, ap_buffered);
+        va_end(ap_buffered);
+        if (buffered) {
+            return;
+        }
+    }
+
+    if (!DEBUG_IS_SET(level)) {
+        return;
+    }
+
     if (debug_timestamps) {
         gettimeofday(&tv, NULL);
         tm = localtime(&tv.tv_sec);
@@ -301,7 +609,7 @@ void ldb_debug_messages(void *context, enum ldb_debug_level level,
         break;
     }
 
-    if (DEBUG_IS_SET(loglevel)) {
+    if (DEBUG_IS_WANTED(loglevel)) {
         sss_vdebug_fn(__FILE__, __LINE__, "ldb", loglevel, fmt, ap);
     }
 }
@@ -367,7 +675,10 @@ int open_debug_file_ex(const char *filename, FILE **filep, bool want_cloexec)
         return ENOMEM;
     }
 
-    if (debug_file && !filep) fclose(debug_file);
+    if (debug_file && !filep) {
+        debug_flush();
+        fclose(debug_file);
+    }
 
     old_umask = umask(SSS_DFL_UMASK);
     errno = 0;
@@ -413,6 +724,8 @@ int rotate_debug_files(void)
 
     if (!debug_to_file) return EOK;
 
+    debug_flush();
+
     do {
         error = 0;
         ret = fclose(debug_file);
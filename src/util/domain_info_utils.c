@@ -211,6 +211,17 @@ errno_t sssd_domain_init(TALLOC_CTX *mem_ctx,
                          const char *domain_name,
                          const char *db_path,
                          struct sss_domain_info **_domain)
+{
+    return sssd_domain_init_ext(mem_ctx, cdb, domain_name, db_path, 0,
+                                _domain);
+}
+
+errno_t sssd_domain_init_ext(TALLOC_CTX *mem_ctx,
+                             struct confdb_ctx *cdb,
+                             const char *domain_name,
+                             const char *db_path,
+                             uint32_t sysdb_flags,
+                             struct sss_domain_info **_domain)
 {
     int ret;
     struct sss_domain_info *dom;
@@ -227,7 +238,7 @@ errno_t sssd_domain_init(TALLOC_CTX *mem_ctx,
         return EEXIST;
     }
 
-    ret = sysdb_domain_init(mem_ctx, dom, db_path, &sysdb);
+    ret = sysdb_domain_init_ext(mem_ctx, dom, db_path, sysdb_flags, &sysdb);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "Error opening cache database.\n");
         return ret;
@@ -66,3 +66,89 @@ void *sss_mem_attach(TALLOC_CTX *mem_ctx,
 
     return h;
 }
+
+/* talloc_total_size() does not count the headers of the chunks, which
+ * take room in a pool as well */
+#define SSS_POOL_CHUNK_OVERHEAD 128
+
+void sss_pool_size_update(struct sss_pool_size *ps, TALLOC_CTX *used_ctx)
+{
+    size_t used;
+
+    if (used_ctx == NULL) {
+        return;
+    }
+
+    used = talloc_total_size(used_ctx)
+           + talloc_total_blocks(used_ctx) * SSS_POOL_CHUNK_OVERHEAD;
+
+    if (used > ps->size) {
+        ps->size += (used - ps->size) / 2;
+    } else {
+        ps->size -= (ps->size - used) / 16;
+    }
+
+    if (ps->size < ps->min) {
+        ps->size = ps->min;
+    } else if (ps->size > ps->max) {
+        ps->size = ps->max;
+    }
+}
+
+struct sss_mem_report_ctx {
+    size_t min_size;
+    size_t skipped;
+};
+
+static void sss_mem_report_cb(const void *ptr, int depth, int max_depth,
+                              int is_ref, void *private_data)
+{
+    struct sss_mem_report_ctx *rctx;
+    size_t size;
+
+    rctx = talloc_get_type(private_data, struct sss_mem_report_ctx);
+
+    if (is_ref) {
+        /* counted where it is allocated */
+        return;
+    }
+
+    /* the children of a skipped context are smaller still, so the printed
+     * lines always form a tree */
+    size = talloc_total_size(ptr);
+    if (depth > 0 && size < rctx->min_size) {
+        rctx->skipped++;
+        return;
+    }
+
+    DEBUG(SSSDBG_FATAL_FAILURE, "%*s%s: %zu bytes in %zu blocks\n",
+          depth * 2, "", talloc_get_name(ptr), size,
+          talloc_total_blocks(discard_const(ptr)));
+}
+
+void sss_talloc_report(const void *ptr, int max_depth, size_t min_size)
+{
+    struct sss_mem_report_ctx *rctx;
+
+    rctx = talloc_zero(NULL, struct sss_mem_report_ctx);
+    if (rctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory, no memory report\n");
+        return;
+    }
+    rctx->min_size = min_size;
+
+    DEBUG(SSSDBG_FATAL_FAILURE,
+          "---- memory report of process %d, contexts of %zu bytes or more "
+          "up to depth %d ----\n", (int) getpid(), min_size, max_depth);
+
+    /* with null tracking enabled a NULL ptr stands for all the memory
+     * of the process */
+    talloc_report_depth_cb(discard_const(ptr), 0, max_depth,
+                           sss_mem_report_cb, rctx);
+
+    DEBUG(SSSDBG_FATAL_FAILURE,
+          "---- end of memory report, %zu smaller contexts not shown ----\n",
+          rctx->skipped);
+
+    talloc_free(rctx);
+}
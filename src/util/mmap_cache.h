@@ -79,13 +79,34 @@ typedef uint32_t rel_ptr_t;
 
 
 #define SSS_MC_MAJOR_VNO    1
-#define SSS_MC_MINOR_VNO    1
+#define SSS_MC_MINOR_VNO    4
 
 #define SSS_MC_HEADER_UNINIT    0   /* after ftruncate or before reset */
 #define SSS_MC_HEADER_ALIVE     1   /* current and in use */
 #define SSS_MC_HEADER_RECYCLED  2   /* file was recycled, reopen asap */
 
+/* sss_mc_header.flags */
+/* Name keys are hashed with their ASCII upper case letters folded to lower
+ * case (see murmurhash3_fold()), clients must do the same before looking
+ * a name up */
+#define SSS_MC_HEADER_FOLD_CASE 0x00000001
+
+/* sss_mc_rec.flags */
+/* The name of the record belongs to a case insensitive domain and must be
+ * compared ignoring case */
+#define SSS_MC_REC_FOLD_CASE    0x00000001
+
 #pragma pack(1)
+/* Usage counters of a cache file. They are only ever updated by the
+ * responder (clients map the file read-only) and outside of the header
+ * barriers, so readers must treat them as approximate. */
+struct sss_mc_stats {
+    uint64_t stores;        /* records stored or refreshed */
+    uint64_t evictions;     /* still valid records evicted to make room */
+    uint64_t invalidations; /* records explicitly invalidated */
+    uint64_t grows;         /* times the cache was grown online */
+};
+
 struct sss_mc_header {
     uint32_t b1;            /* barrier 1 */
     uint32_t major_vno;     /* major version number */
@@ -98,8 +119,9 @@ struct sss_mc_header {
     rel_ptr_t data_table;   /* data table pointer relative to mmap base */
     rel_ptr_t free_table;   /* free table pointer relative to mmap base */
     rel_ptr_t hash_table;   /* hash table pointer relative to mmap base */
-    rel_ptr_t reserved;     /* reserved for future changes */
+    uint32_t flags;         /* SSS_MC_HEADER_* flags */
     uint32_t b2;            /* barrier 2 */
+    struct sss_mc_stats stats; /* usage counters, not covered by barriers */
 };
 
 struct sss_mc_rec {
@@ -112,7 +134,7 @@ struct sss_mc_rec {
                             /* next2 is related to hash2 */
     uint32_t hash1;         /* val of first hash (usually name of record) */
     uint32_t hash2;         /* val of second hash (usually id of record) */
-    uint32_t padding;       /* padding & reserved for future changes */
+    uint32_t flags;         /* SSS_MC_REC_* flags */
     uint32_t b2;            /* barrier 2 - 32 bytes mark, fits a slot */
     char data[0];
 };
@@ -127,10 +149,18 @@ struct sss_mc_pwd_data {
                              * name, passwd, gecos, dir, shell */
 };
 
+/* Set in sss_mc_grp_data.members when the member names of a large group
+ * are stored compacted. Each member is then encoded as one byte with the
+ * length of the prefix it shares with the previous member, one byte with
+ * the length of the suffix it shares with the previous member and the zero
+ * terminated rest of the name. */
+#define SSS_MC_GRP_COMPACT_MEMBERS 0x80000000
+
 struct sss_mc_grp_data {
     rel_ptr_t name;         /* ptr to name string, rel. to struct base addr */
     uint32_t gid;
-    uint32_t members;       /* number of members in strs */
+    uint32_t members;       /* number of members in strs, possibly or-ed
+                             * with SSS_MC_GRP_COMPACT_MEMBERS */
     uint32_t strs_len;      /* length of strs */
     char strs[0];           /* concatenation of all group strings, each
                              * string is zero terminated ordered as follows:
@@ -149,6 +179,83 @@ struct sss_mc_initgr_data {
                              * after gids */
 };
 
+struct sss_mc_netgr_data {
+    rel_ptr_t name;         /* ptr to name string, rel. to struct base addr */
+    uint32_t num_entries;   /* number of entries in strs after the name */
+    uint32_t reserved;      /* reserved for future changes */
+    uint32_t strs_len;      /* length of strs */
+    char strs[0];           /* netgroup name, zero terminated, followed by
+                             * the entries serialized as in the
+                             * SSS_NSS_GETNETGRENT reply: for each entry a
+                             * 32bit type followed either by the zero
+                             * terminated host, user and domain strings or
+                             * by the zero terminated name of a member
+                             * netgroup */
+};
+
+struct sss_mc_sid_data {
+    rel_ptr_t key;          /* ptr to the lookup key, rel. to struct base addr,
+                             * either the SID string or, for records stored
+                             * for lookups by ID, the decimal POSIX ID */
+    rel_ptr_t sid;          /* ptr to SID string, rel. to struct base addr */
+    rel_ptr_t name;         /* ptr to fq name string, rel. to struct base addr */
+    uint32_t id;            /* POSIX ID */
+    uint32_t id_type;       /* enum sss_id_type */
+    uint32_t strs_len;      /* length of strs */
+    char strs[0];           /* concatenation of all zero terminated strings,
+                             * the key comes first */
+};
+
+/* Services are looked up by "<name>/<protocol>" or by "#<port>/<protocol>"
+ * with the port in host byte order ('#' cannot be part of a service name).
+ * The protocol is left empty for lookups of any protocol. */
+#define SSS_MC_SVC_PORT_KEY_PREFIX '#'
+
+struct sss_mc_svc_data {
+    rel_ptr_t key;          /* ptr to the key the record was stored for,
+                             * rel. to struct base addr */
+    rel_ptr_t alt_key;      /* ptr to the other lookup key, same as key for
+                             * records stored for lookups of any protocol */
+    rel_ptr_t name;         /* ptr to service name, rel. to struct base addr */
+    rel_ptr_t proto;        /* ptr to protocol, rel. to struct base addr */
+    uint32_t port;          /* port in network byte order */
+    uint32_t aliases;       /* number of aliases in strs */
+    uint32_t strs_len;      /* length of strs */
+    char strs[0];           /* concatenation of all zero terminated strings:
+                             * key, alt_key (if different), name, protocol,
+                             * alias1, alias2, ... */
+};
+
+/* Sudo rules are looked up by "<type>:<uid>:<username>" with the type
+ * being one of the prefixes below and the uid and username as sent by the
+ * client in the query. */
+#define SSS_MC_SUDO_RULES_PREFIX 'R'
+#define SSS_MC_SUDO_DEFAULTS_PREFIX 'D'
+
+struct sss_mc_sudo_data {
+    rel_ptr_t key;          /* ptr to key string, rel. to struct base addr */
+    uint32_t num_rules;     /* number of rules in the reply */
+    uint32_t reply_len;     /* length of the reply after the key */
+    uint32_t strs_len;      /* length of strs */
+    char strs[0];           /* zero terminated key followed by the reply
+                             * body of SSS_SUDO_GET_SUDORULES or
+                             * SSS_SUDO_GET_DEFAULTS as sent by the
+                             * responder */
+};
+
+/* Automount maps are looked up by "M:<mapname>", their entries by
+ * "E:<mapname length>:<mapname>:<key>". Map records have an empty value. */
+#define SSS_MC_AUTOFS_MAP_PREFIX 'M'
+#define SSS_MC_AUTOFS_ENTRY_PREFIX 'E'
+
+struct sss_mc_autofs_data {
+    rel_ptr_t key;          /* ptr to key string, rel. to struct base addr */
+    uint32_t value_len;     /* length of the value including the \0 */
+    uint32_t strs_len;      /* length of strs */
+    char strs[0];           /* zero terminated key followed by the zero
+                             * terminated value */
+};
+
 #pragma pack()
 
 
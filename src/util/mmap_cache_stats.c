@@ -0,0 +1,178 @@
+/*
+    SSSD
+
+    mmap_cache_stats.c - read the usage counters of a memory cache file
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include "util/util.h"
+#include "util/mmap_cache.h"
+
+#define MC_USAGE_READ_RETRIES 5
+
+/* the maps created by the NSS responder */
+const char *sss_mc_map_names[] = {
+    "passwd",
+    "group",
+    "initgroups",
+    "netgroup",
+    "sid",
+    "services",
+    NULL
+};
+
+static errno_t sss_mc_read_header(uint8_t *base, struct sss_mc_header *h)
+{
+    struct sss_mc_header *src = (struct sss_mc_header *)base;
+    uint32_t b1;
+    int count;
+
+    /* same barrier protected copy the clients do */
+    for (count = MC_USAGE_READ_RETRIES; count > 0; count--) {
+        b1 = src->b1;
+        if (!MC_VALID_BARRIER(b1)) {
+            continue;
+        }
+        __sync_synchronize();
+        memcpy(h, src, sizeof(struct sss_mc_header));
+        __sync_synchronize();
+        if (src->b2 == b1) {
+            return EOK;
+        }
+    }
+
+    return EIO;
+}
+
+errno_t sss_mc_get_usage(const char *map_name, struct sss_mc_usage *usage)
+{
+    char mc_filename[PATH_MAX];
+    struct sss_mc_header h;
+    struct stat st;
+    uint8_t *base = MAP_FAILED;
+    uint8_t *free_table;
+    uint32_t used = 0;
+    uint32_t slot;
+    int fd = -1;
+    errno_t ret;
+    int i;
+
+    if (map_name == NULL || usage == NULL) {
+        return EINVAL;
+    }
+
+    for (i = 0; sss_mc_map_names[i] != NULL; i++) {
+        if (strcmp(map_name, sss_mc_map_names[i]) == 0) {
+            break;
+        }
+    }
+    if (sss_mc_map_names[i] == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unknown memory cache map %s\n", map_name);
+        return EINVAL;
+    }
+
+    ret = snprintf(mc_filename, sizeof(mc_filename), "%s/%s",
+                   SSS_NSS_MCACHE_DIR, map_name);
+    if (ret < 0 || (size_t)ret >= sizeof(mc_filename)) {
+        return EINVAL;
+    }
+
+    fd = sss_open_cloexec(mc_filename, O_RDONLY, &ret);
+    if (fd == -1) {
+        DEBUG(ret == ENOENT ? SSSDBG_TRACE_FUNC : SSSDBG_OP_FAILURE,
+              "Unable to open memory cache file %s [%d]: %s\n",
+              mc_filename, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = fstat(fd, &st);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to stat %s [%d]: %s\n",
+              mc_filename, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    if (st.st_size < MC_HEADER_SIZE) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to mmap %s [%d]: %s\n",
+              mc_filename, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = sss_mc_read_header(base, &h);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Unable to read a consistent header of %s\n", mc_filename);
+        goto done;
+    }
+
+    if (h.major_vno != SSS_MC_MAJOR_VNO || h.minor_vno != SSS_MC_MINOR_VNO) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Memory cache file %s has unsupported version %u.%u\n",
+              mc_filename, h.major_vno, h.minor_vno);
+        ret = EINVAL;
+        goto done;
+    }
+
+    if (h.status != SSS_MC_HEADER_ALIVE) {
+        /* being reset or replaced by the responder */
+        ret = EAGAIN;
+        goto done;
+    }
+
+    if (h.free_table > st.st_size || h.ft_size > st.st_size - h.free_table
+            || h.dt_size / MC_SLOT_SIZE > h.ft_size * 8) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    usage->total_slots = h.dt_size / MC_SLOT_SIZE;
+
+    free_table = base + h.free_table;
+    for (slot = 0; slot < usage->total_slots; slot++) {
+        if (free_table[slot / 8] & (0x80 >> (slot % 8))) {
+            used++;
+        }
+    }
+    usage->used_slots = used;
+
+    usage->stores = h.stats.stores;
+    usage->evictions = h.stats.evictions;
+    usage->invalidations = h.stats.invalidations;
+    usage->grows = h.stats.grows;
+
+    ret = EOK;
+
+done:
+    if (base != MAP_FAILED) {
+        munmap(base, st.st_size);
+    }
+    close(fd);
+    return ret;
+}
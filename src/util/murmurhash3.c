@@ -8,6 +8,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 
 #include "config.h"
@@ -19,19 +20,66 @@ static uint32_t rotl(uint32_t x, int8_t r)
     return (x << r) | (x >> (32 - r));
 }
 
-/* slower than original but is endian neutral and handles platforms that
- * do only aligned reads */
+/* memcpy() keeps the read endian neutral and safe on platforms that do
+ * only aligned reads, compilers turn it into a single load where unaligned
+ * reads are allowed and le32toh() is a no-op on little endian */
 __attribute__((always_inline))
-static inline uint32_t getblock(const uint8_t *p, int i)
+static inline uint32_t getblock(const uint8_t *p)
 {
     uint32_t r;
-    size_t size = sizeof(uint32_t);
 
-    memcpy(&r, &p[i * size], size);
+    memcpy(&r, p, sizeof(uint32_t));
 
     return le32toh(r);
 }
 
+__attribute__((always_inline))
+static inline uint8_t fold_byte(uint8_t c, bool fold_case)
+{
+    if (fold_case && c >= 'A' && c <= 'Z') {
+        return c + ('a' - 'A');
+    }
+
+    return c;
+}
+
+__attribute__((always_inline))
+static inline uint32_t getblock_cased(const uint8_t *p, bool fold_case)
+{
+    uint8_t b[4];
+
+    if (!fold_case) {
+        return getblock(p);
+    }
+
+    b[0] = fold_byte(p[0], true);
+    b[1] = fold_byte(p[1], true);
+    b[2] = fold_byte(p[2], true);
+    b[3] = fold_byte(p[3], true);
+
+    return getblock(b);
+}
+
+__attribute__((always_inline))
+static inline uint32_t mix_k1(uint32_t k1)
+{
+    k1 *= 0xcc9e2d51;
+    k1 = rotl(k1, 15);
+    k1 *= 0x1b873593;
+
+    return k1;
+}
+
+__attribute__((always_inline))
+static inline uint32_t mix_h1(uint32_t h1, uint32_t k1)
+{
+    h1 ^= k1;
+    h1 = rotl(h1, 13);
+    h1 = h1 * 5 + 0xe6546b64;
+
+    return h1;
+}
+
 /*
  * Finalization mix - force all bits of a hash block to avalanche
  */
@@ -49,55 +97,53 @@ static inline uint32_t fmix(uint32_t h)
 }
 
 
-uint32_t murmurhash3(const char *key, int len, uint32_t seed)
+/* fold_case is a constant in both callers, the compiler drops the folding
+ * from murmurhash3() */
+__attribute__((always_inline))
+static inline uint32_t murmurhash3_cased(const char *key, int len,
+                                         uint32_t seed, bool fold_case)
 {
     const uint8_t *blocks;
-    const uint8_t *tail;
-    int nblocks;
+    const uint8_t *end;
     uint32_t h1;
     uint32_t k1;
-    uint32_t c1;
-    uint32_t c2;
-    int i;
+    uint32_t k2;
 
     blocks = (const uint8_t *)key;
-    nblocks = len / 4;
+    end = blocks + (len & ~7);
     h1 = seed;
-    c1 = 0xcc9e2d51;
-    c2 = 0x1b873593;
 
-    /* body */
+    /* body, two blocks per iteration so that mixing of the second block
+     * overlaps with the hash update of the first one */
 
-    for (i = 0; i < nblocks; i++) {
+    for (; blocks < end; blocks += 8) {
+        k1 = mix_k1(getblock_cased(blocks, fold_case));
+        k2 = mix_k1(getblock_cased(blocks + 4, fold_case));
 
-        k1 = getblock(blocks, i);
-
-        k1 *= c1;
-        k1 = rotl(k1, 15);
-        k1 *= c2;
+        h1 = mix_h1(h1, k1);
+        h1 = mix_h1(h1, k2);
+    }
 
-        h1 ^= k1;
-        h1 = rotl(h1, 13);
-        h1 = h1 * 5 + 0xe6546b64;
+    if (len & 4) {
+        h1 = mix_h1(h1, mix_k1(getblock_cased(blocks, fold_case)));
+        blocks += 4;
     }
 
     /* tail */
 
-    tail = (const uint8_t *)key + nblocks * 4;
-
     k1 = 0;
 
     switch (len & 3) {
     case 3:
-        k1 ^= tail[2] << 16;
+        k1 ^= fold_byte(blocks[2], fold_case) << 16;
+        /* fall through */
     case 2:
-        k1 ^= tail[1] << 8;
+        k1 ^= fold_byte(blocks[1], fold_case) << 8;
+        /* fall through */
     case 1:
-        k1 ^= tail[0];
-        k1 *= c1;
-        k1 = rotl(k1, 15);
-        k1 *= c2;
-        h1 ^= k1;
+        k1 ^= fold_byte(blocks[0], fold_case);
+        h1 ^= mix_k1(k1);
+        break;
     default:
         break;
     }
@@ -110,4 +156,12 @@ uint32_t murmurhash3(const char *key, int len, uint32_t seed)
     return h1;
 }
 
+uint32_t murmurhash3(const char *key, int len, uint32_t seed)
+{
+    return murmurhash3_cased(key, len, seed, false);
+}
 
+uint32_t murmurhash3_fold(const char *key, int len, uint32_t seed)
+{
+    return murmurhash3_cased(key, len, seed, true);
+}
@@ -17,4 +17,8 @@
  */
 uint32_t murmurhash3(const char *key, int len, uint32_t seed);
 
+/* The hash of the key with its ASCII upper case letters folded to lower
+ * case, without copying the key */
+uint32_t murmurhash3_fold(const char *key, int len, uint32_t seed);
+
 #endif /* _UTIL_MURMURHASH3_H_ */
@@ -0,0 +1,43 @@
+/*
+    SSSD
+
+    Static probes
+
+    Copyright (C) Red Hat 2016
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PROBES_H_
+#define __PROBES_H_
+
+#ifdef HAVE_SYSTEMTAP
+
+/* generated by dtrace from src/systemtap/sssd_probes.d */
+#include "stap_generated_probes.h"
+
+/* PROBE(SYSDB_TRANSACTION_START, nesting) fires the probe
+ * sysdb_transaction_start of the provider sssd. A probe nobody listens to
+ * costs a single nop. */
+#define PROBE(name, ...) SSSD_ ## name(__VA_ARGS__)
+
+#else
+
+/* The arguments are not evaluated either, they must not have side
+ * effects. */
+#define PROBE(name, ...) do { } while (0)
+
+#endif /* HAVE_SYSTEMTAP */
+
+#endif /* __PROBES_H_ */
@@ -26,12 +26,14 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <ldb.h>
 #include "util/util.h"
 #include "confdb/confdb.h"
 #include "monitor/monitor_interfaces.h"
+#include "util/strtonum.h"
 
 #ifdef HAVE_PRCTL
 #include <sys/prctl.h>
@@ -304,6 +306,7 @@ static void setup_signals(void)
      * these signals masked, we will have problems, as we won't receive them. */
     BlockSignals(false, SIGHUP);
     BlockSignals(false, SIGTERM);
+    BlockSignals(false, SIGWINCH);
 
 #ifndef HAVE_PRCTL
         /* If prctl is not defined on the system, try to handle
@@ -396,6 +399,9 @@ errno_t server_common_rotate_logs(struct confdb_ctx *confdb,
         return ret;
     }
 
+    /* the debug level may have been changed by sss_debuglevel */
+    confdb_invalidate_snapshot(confdb);
+
     /* Get new debug level from the confdb */
     ret = confdb_get_int(confdb, conf_path,
                          CONFDB_SERVICE_DEBUG_LEVEL,
@@ -443,6 +449,272 @@ static const char *get_pid_path(void)
 #endif
 }
 
+static void te_server_mem_report(struct tevent_context *ev,
+                                 struct tevent_signal *se,
+                                 int signum,
+                                 int count,
+                                 void *siginfo,
+                                 void *private_data)
+{
+    DEBUG(SSSDBG_CRIT_FAILURE, "Received SIGWINCH. Writing memory report.\n");
+
+    sss_talloc_report(NULL, SSS_MEM_REPORT_DEPTH, SSS_MEM_REPORT_MIN_SIZE);
+}
+
+static void server_trace_cb(enum tevent_trace_point point, void *pvt)
+{
+    if (point == TEVENT_TRACE_BEFORE_WAIT) {
+        debug_flush();
+    }
+}
+
+struct server_heartbeat_ctx {
+    struct sss_heartbeat *shared;
+    uint32_t interval;
+};
+
+static void server_heartbeat(struct tevent_context *ev,
+                             struct tevent_timer *te,
+                             struct timeval tv, void *pvt)
+{
+    struct server_heartbeat_ctx *hb;
+
+    hb = talloc_get_type(pvt, struct server_heartbeat_ctx);
+
+    __sync_add_and_fetch(&hb->shared->counter, 1);
+
+    tv = tevent_timeval_current_ofs(hb->interval, 0);
+    te = tevent_add_timer(ev, hb, tv, server_heartbeat, hb);
+    if (te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to schedule the heartbeat, "
+              "the monitor will ping the service instead\n");
+    }
+}
+
+static int server_heartbeat_destructor(struct server_heartbeat_ctx *hb)
+{
+    munmap(hb->shared, sizeof(struct sss_heartbeat));
+    return 0;
+}
+
+/* Without the heartbeat, which the monitor only sets up for the services
+ * it starts, the monitor falls back to D-Bus pings. */
+static void server_setup_heartbeat(TALLOC_CTX *mem_ctx,
+                                   struct tevent_context *ev)
+{
+    struct server_heartbeat_ctx *hb;
+    struct sss_heartbeat *shared;
+    const char *env;
+    uint32_t fd;
+    char *endptr;
+
+    env = getenv(SSS_HEARTBEAT_FD_ENV);
+    if (env == NULL) {
+        return;
+    }
+
+    errno = 0;
+    fd = strtouint32(env, &endptr, 10);
+    /* our own children must not inherit it */
+    unsetenv(SSS_HEARTBEAT_FD_ENV);
+    if (errno != 0 || *endptr != '\0' || fd > INT_MAX) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Invalid heartbeat descriptor\n");
+        return;
+    }
+
+    shared = mmap(NULL, sizeof(struct sss_heartbeat), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to map the heartbeat [%d]: %s\n",
+              errno, sss_strerror(errno));
+        return;
+    }
+
+    hb = talloc_zero(mem_ctx, struct server_heartbeat_ctx);
+    if (hb == NULL) {
+        munmap(shared, sizeof(struct sss_heartbeat));
+        return;
+    }
+    hb->shared = shared;
+    hb->interval = shared->interval > 0 ? shared->interval : 1;
+    talloc_set_destructor(hb, server_heartbeat_destructor);
+
+    /* the first beat tells the monitor the heartbeat is in use */
+    server_heartbeat(ev, NULL, tevent_timeval_zero(), hb);
+}
+
+struct server_startup_phase_info {
+    const char *name;
+    struct timeval begin;
+    uint64_t usec;
+    /* since the start of the process */
+    uint64_t end_usec;
+    bool running;
+};
+
+static struct {
+    struct timeval start;
+    bool ready;
+    bool done;
+    struct server_startup_phase_info phases[STARTUP_PHASE_SENTINEL];
+} server_startup = {
+    .phases = {
+        [STARTUP_PHASE_CONFDB] = { .name = "confdb" },
+        [STARTUP_PHASE_SYSDB] = { .name = "sysdb" },
+        [STARTUP_PHASE_SBUS] = { .name = "sbus" },
+        [STARTUP_PHASE_PROVIDERS] = { .name = "providers" },
+        [STARTUP_PHASE_ONLINE] = { .name = "online" },
+    },
+};
+
+static uint64_t server_startup_usec(struct timeval *from, struct timeval *to)
+{
+    struct timeval elapsed;
+
+    if (tevent_timeval_compare(from, to) > 0) {
+        return 0;
+    }
+
+    elapsed = tevent_timeval_until(from, to);
+    return (uint64_t) elapsed.tv_sec * 1000000 + elapsed.tv_usec;
+}
+
+static void server_startup_check_done(void)
+{
+    struct server_startup_phase_info *phase;
+    char *summary;
+    uint64_t total = 0;
+    int i;
+
+    if (!server_startup.ready || server_startup.done) {
+        return;
+    }
+
+    for (i = 0; i < STARTUP_PHASE_SENTINEL; i++) {
+        if (server_startup.phases[i].running) {
+            return;
+        }
+    }
+    server_startup.done = true;
+
+    summary = talloc_strdup(NULL, "");
+    for (i = 0; i < STARTUP_PHASE_SENTINEL && summary != NULL; i++) {
+        phase = &server_startup.phases[i];
+        if (phase->end_usec == 0) {
+            continue;
+        }
+
+        summary = talloc_asprintf_append(summary, ", %s %"PRIu64" ms "
+                                         "(done at %"PRIu64" ms)",
+                                         phase->name, phase->usec / 1000,
+                                         phase->end_usec / 1000);
+        if (phase->end_usec > total) {
+            total = phase->end_usec;
+        }
+    }
+
+    DEBUG(SSSDBG_IMPORTANT_INFO, "Startup finished in %"PRIu64" ms%s\n",
+          total / 1000, summary == NULL ? "" : summary);
+    talloc_free(summary);
+}
+
+void server_startup_begin(enum server_startup_phase phase)
+{
+    struct server_startup_phase_info *info;
+
+    if (phase >= STARTUP_PHASE_SENTINEL) {
+        return;
+    }
+
+    info = &server_startup.phases[phase];
+    if (info->running || server_startup.done) {
+        /* nested in the same phase, e.g. the monitor loads the configuration
+         * before server_setup() opens confdb */
+        return;
+    }
+    info->begin = tevent_timeval_current();
+    info->running = true;
+
+    if (tevent_timeval_is_zero(&server_startup.start)) {
+        server_startup.start = info->begin;
+    }
+}
+
+void server_startup_end(enum server_startup_phase phase)
+{
+    struct server_startup_phase_info *info;
+    struct timeval now;
+
+    if (phase >= STARTUP_PHASE_SENTINEL) {
+        return;
+    }
+
+    info = &server_startup.phases[phase];
+    if (!info->running) {
+        /* e.g. going offline again after the first online check */
+        return;
+    }
+
+    now = tevent_timeval_current();
+    info->usec += server_startup_usec(&info->begin, &now);
+    info->end_usec = server_startup_usec(&server_startup.start, &now);
+    info->running = false;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Startup phase %s took %"PRIu64" ms\n",
+          info->name, server_startup_usec(&info->begin, &now) / 1000);
+
+    server_startup_check_done();
+}
+
+void server_startup_ready(void)
+{
+    server_startup.ready = true;
+    server_startup_check_done();
+}
+
+errno_t server_startup_times(TALLOC_CTX *mem_ctx,
+                             const char ***_names,
+                             uint64_t **_usec,
+                             uint64_t **_end_usec,
+                             size_t *_count,
+                             bool *_done)
+{
+    const char **names;
+    uint64_t *usec;
+    uint64_t *end_usec;
+    size_t count = 0;
+    int i;
+
+    names = talloc_array(mem_ctx, const char *, STARTUP_PHASE_SENTINEL);
+    usec = talloc_array(mem_ctx, uint64_t, STARTUP_PHASE_SENTINEL);
+    end_usec = talloc_array(mem_ctx, uint64_t, STARTUP_PHASE_SENTINEL);
+    if (names == NULL || usec == NULL || end_usec == NULL) {
+        talloc_free(names);
+        talloc_free(usec);
+        talloc_free(end_usec);
+        return ENOMEM;
+    }
+
+    for (i = 0; i < STARTUP_PHASE_SENTINEL; i++) {
+        if (server_startup.phases[i].end_usec == 0) {
+            continue;
+        }
+
+        names[count] = server_startup.phases[i].name;
+        usec[count] = server_startup.phases[i].usec;
+        end_usec[count] = server_startup.phases[i].end_usec;
+        count++;
+    }
+
+    *_names = names;
+    *_usec = usec;
+    *_end_usec = end_usec;
+    *_count = count;
+    *_done = server_startup.done;
+    return EOK;
+}
+
 int server_setup(const char *name, int flags,
                  uid_t uid, gid_t gid,
                  const char *conf_entry,
@@ -456,6 +728,8 @@ int server_setup(const char *name, int flags,
     bool dt;
     bool dl;
     bool dm;
+    int buffer_size;
+    int backtrace_level;
     struct tevent_signal *tes;
     struct logrotate_ctx *lctx;
     char *locale;
@@ -518,6 +792,9 @@ int server_setup(const char *name, int flags,
     bindtextdomain(PACKAGE, LOCALEDIR);
     textdomain(PACKAGE);
 
+    /* let the memory report see the contexts allocated on NULL too */
+    talloc_enable_null_tracking();
+
     /* the event context is the top level structure.
      * Everything else should hang off that */
     event_ctx = tevent_context_init(talloc_autofree_context());
@@ -541,6 +818,14 @@ int server_setup(const char *name, int flags,
         return EIO;
     }
 
+    /* Set up an event handler for a SIGWINCH, which is ignored by default
+     * so it is safe to send to any sssd process */
+    tes = tevent_add_signal(event_ctx, event_ctx, SIGWINCH, 0,
+                            te_server_mem_report, NULL);
+    if (tes == NULL) {
+        return EIO;
+    }
+
     ctx = talloc(event_ctx, struct main_context);
     if (ctx == NULL) {
         DEBUG(SSSDBG_FATAL_FAILURE, "Out of memory, aborting!\n");
@@ -557,6 +842,7 @@ int server_setup(const char *name, int flags,
         return ENOMEM;
     }
 
+    server_startup_begin(STARTUP_PHASE_CONFDB);
     ret = confdb_init(ctx, &ctx->confdb_ctx, conf_db);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "The confdb initialization failed\n");
@@ -643,6 +929,44 @@ int server_setup(const char *name, int flags,
         }
     }
 
+    /* in-memory buffering of the debug messages */
+    ret = confdb_get_int(ctx->confdb_ctx, conf_entry,
+                         CONFDB_SERVICE_DEBUG_BUFFER_SIZE, 0, &buffer_size);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Error reading from confdb (%d) [%s]\n",
+                                     ret, strerror(ret));
+        return ret;
+    }
+
+    ret = confdb_get_int(ctx->confdb_ctx, conf_entry,
+                         CONFDB_SERVICE_DEBUG_BACKTRACE_LEVEL, 0,
+                         &backtrace_level);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Error reading from confdb (%d) [%s]\n",
+                                     ret, strerror(ret));
+        return ret;
+    }
+
+    if (buffer_size < 0) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "Ignoring negative %s\n",
+              CONFDB_SERVICE_DEBUG_BUFFER_SIZE);
+        buffer_size = 0;
+    }
+
+    if (buffer_size > 0 || backtrace_level != 0) {
+        ret = debug_init_buffers((size_t)buffer_size * 1024, backtrace_level);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE, "Error setting up the debug buffers "
+                                         "(%d) [%s]\n", ret, strerror(ret));
+            return ret;
+        }
+
+        /* write the buffered messages whenever the process becomes idle */
+        tevent_set_trace_callback(ctx->event_ctx, server_trace_cb, NULL);
+    }
+
+    server_startup_end(STARTUP_PHASE_CONFDB);
+
     sss_log(SSS_LOG_INFO, "Starting up");
 
     DEBUG(SSSDBG_TRACE_FUNC, "CONFDB: %s\n", conf_db);
@@ -662,6 +986,8 @@ int server_setup(const char *name, int flags,
     tevent_add_fd(event_ctx, event_ctx, STDIN_FILENO, stdin_event_flags,
                  server_stdin_handler, discard_const(name));
 
+    server_setup_heartbeat(ctx, event_ctx);
+
     *main_ctx = ctx;
     return EOK;
 }
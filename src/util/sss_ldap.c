@@ -282,7 +282,7 @@ static errno_t set_fd_flags_and_opts(int fd)
 }
 
 #define LDAP_PROTO_TCP 1 /* ldap://  */
-#define LDAP_PROTO_UDP 2 /* reserved */
+#define LDAP_PROTO_UDP 2 /* cldap:// */
 #define LDAP_PROTO_IPC 3 /* ldapi:// */
 #define LDAP_PROTO_EXT 4 /* user-defined socket/sockbuf */
 
@@ -298,6 +298,7 @@ struct sss_ldap_init_state {
     LDAP *ldap;
     int sd;
     const char *uri;
+    bool cldap;
 
 #ifdef HAVE_LDAP_INIT_FD
     struct tevent_timer *connect_timeout;
@@ -341,12 +342,16 @@ struct tevent_req *sss_ldap_init_send(TALLOC_CTX *mem_ctx,
 
     state->ldap = NULL;
     state->uri = uri;
+    /* connectionless LDAP as used for the netlogon ping of AD goes over UDP,
+     * libldap only supports it if it was built with LDAP_CONNECTIONLESS */
+    state->cldap = (strncasecmp(uri, "cldap://", 8) == 0);
 
 #ifdef HAVE_LDAP_INIT_FD
     struct tevent_req *subreq;
     struct timeval tv;
 
-    state->sd = socket(addr->ss_family, SOCK_STREAM, 0);
+    state->sd = socket(addr->ss_family,
+                       state->cldap ? SOCK_DGRAM : SOCK_STREAM, 0);
     if (state->sd == -1) {
         ret = errno;
         DEBUG(SSSDBG_CRIT_FAILURE,
@@ -445,7 +450,9 @@ static void sss_ldap_init_sys_connect_done(struct tevent_req *subreq)
     }
     /* Initialize LDAP handler */
 
-    lret = ldap_init_fd(state->sd, LDAP_PROTO_TCP, state->uri, &state->ldap);
+    lret = ldap_init_fd(state->sd,
+                        state->cldap ? LDAP_PROTO_UDP : LDAP_PROTO_TCP,
+                        state->uri, &state->ldap);
     if (lret != LDAP_SUCCESS) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "ldap_init_fd failed: %s. [%d][%s]\n",
@@ -59,6 +59,14 @@ int sss_ldap_get_diagnostic_msg(TALLOC_CTX *mem_ctx,
 #define LDAP_SERVER_SD_OID "1.2.840.113556.1.4.801"
 #endif /* LDAP_SERVER_SD_OID */
 
+#ifndef LDAP_SERVER_DIRSYNC_OID
+#define LDAP_SERVER_DIRSYNC_OID "1.2.840.113556.1.4.841"
+#endif /* LDAP_SERVER_DIRSYNC_OID */
+
+/* Only return the objects and attributes the caller may read, without it
+ * DirSync requires the "Replicating Directory Changes" right */
+#define LDAP_DIRSYNC_OBJECT_SECURITY ( 0x00000001 )
+
 
 /*
  * The following four flags specify which security descriptor parts to retrieve
@@ -54,7 +54,7 @@ static void sss_semanage_error_callback(void *varg,
     }
 
     va_start(ap, fmt);
-    if (DEBUG_IS_SET(level)) {
+    if (DEBUG_IS_WANTED(level)) {
         sss_vdebug_fn(__FILE__, __LINE__, "libsemanage", level, fmt, ap);
     }
     va_end(ap);
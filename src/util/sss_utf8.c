@@ -46,7 +46,48 @@ void sss_utf8_free(void *ptr)
 #endif
 
 #ifdef HAVE_LIBUNISTRING
-uint8_t *sss_utf8_tolower(const uint8_t *s, size_t len, size_t *_nlen)
+static void *sss_utf8_malloc(size_t size)
+{
+    return malloc(size);
+}
+#elif defined(HAVE_GLIB2)
+static void *sss_utf8_malloc(size_t size)
+{
+    return g_malloc(size);
+}
+#else
+#error No unicode library
+#endif
+
+#define SSS_ASCII_TOLOWER(c) \
+    (((c) >= 'A' && (c) <= 'Z') ? (c) + ('a' - 'A') : (c))
+
+bool sss_utf8_is_ascii(const uint8_t *s, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (s[i] & 0x80) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void sss_utf8_ascii_tolower(const uint8_t *s, size_t len, uint8_t *dst)
+{
+    size_t i;
+
+    /* not tolower(), the result must not depend on the locale */
+    for (i = 0; i < len; i++) {
+        dst[i] = SSS_ASCII_TOLOWER(s[i]);
+    }
+}
+
+#ifdef HAVE_LIBUNISTRING
+static uint8_t *sss_utf8_unicode_tolower(const uint8_t *s, size_t len,
+                                         size_t *_nlen)
 {
     size_t llen;
     uint8_t *lower;
@@ -58,7 +99,8 @@ uint8_t *sss_utf8_tolower(const uint8_t *s, size_t len, size_t *_nlen)
     return lower;
 }
 #elif defined(HAVE_GLIB2)
-uint8_t *sss_utf8_tolower(const uint8_t *s, size_t len, size_t *_nlen)
+static uint8_t *sss_utf8_unicode_tolower(const uint8_t *s, size_t len,
+                                         size_t *_nlen)
 {
     gchar *glower;
     size_t nlen;
@@ -85,6 +127,23 @@ uint8_t *sss_utf8_tolower(const uint8_t *s, size_t len, size_t *_nlen)
 #error No unicode library
 #endif
 
+uint8_t *sss_utf8_tolower(const uint8_t *s, size_t len, size_t *_nlen)
+{
+    uint8_t *lower;
+
+    /* an empty string is left to the library, malloc(0) may return NULL */
+    if (len == 0 || !sss_utf8_is_ascii(s, len)) {
+        return sss_utf8_unicode_tolower(s, len, _nlen);
+    }
+
+    lower = sss_utf8_malloc(len);
+    if (!lower) return NULL;
+
+    sss_utf8_ascii_tolower(s, len, lower);
+    if (_nlen) *_nlen = len;
+    return lower;
+}
+
 #ifdef HAVE_LIBUNISTRING
 bool sss_utf8_check(const uint8_t *s, size_t n)
 {
@@ -104,12 +163,31 @@ bool sss_utf8_check(const uint8_t *s, size_t n)
 #error No unicode library
 #endif
 
-/* Returns EOK on match, ENOTUNIQ if comparison succeeds but
- * does not match.
- * May return other errno error codes on failure
- */
+/* Compares the strings as long as both are ASCII. Returns EOK or
+ * ENOMATCH when that decides the comparison and EAGAIN at the first byte
+ * which is not ASCII. Two different ASCII bytes after an equal prefix can
+ * not be made equal by what follows them, so ENOMATCH is final. */
+static errno_t sss_utf8_ascii_case_eq(const uint8_t *s1, const uint8_t *s2)
+{
+    size_t i;
+
+    for (i = 0; ; i++) {
+        if ((s1[i] | s2[i]) & 0x80) {
+            return EAGAIN;
+        }
+
+        if (SSS_ASCII_TOLOWER(s1[i]) != SSS_ASCII_TOLOWER(s2[i])) {
+            return ENOMATCH;
+        }
+
+        if (s1[i] == '\0') {
+            return EOK;
+        }
+    }
+}
+
 #ifdef HAVE_LIBUNISTRING
-errno_t sss_utf8_case_eq(const uint8_t *s1, const uint8_t *s2)
+static errno_t sss_utf8_unicode_case_eq(const uint8_t *s1, const uint8_t *s2)
 {
 
     /* Do a case-insensitive comparison.
@@ -142,7 +220,7 @@ errno_t sss_utf8_case_eq(const uint8_t *s1, const uint8_t *s2)
 }
 
 #elif defined(HAVE_GLIB2)
-errno_t sss_utf8_case_eq(const uint8_t *s1, const uint8_t *s2)
+static errno_t sss_utf8_unicode_case_eq(const uint8_t *s1, const uint8_t *s2)
 {
     gchar *gs1;
     gchar *gs2;
@@ -180,6 +258,22 @@ errno_t sss_utf8_case_eq(const uint8_t *s1, const uint8_t *s2)
 #error No unicode library
 #endif
 
+/* Returns EOK on match, ENOTUNIQ if comparison succeeds but
+ * does not match.
+ * May return other errno error codes on failure
+ */
+errno_t sss_utf8_case_eq(const uint8_t *s1, const uint8_t *s2)
+{
+    errno_t ret;
+
+    ret = sss_utf8_ascii_case_eq(s1, s2);
+    if (ret != EAGAIN) {
+        return ret;
+    }
+
+    return sss_utf8_unicode_case_eq(s1, s2);
+}
+
 bool sss_string_equal(bool cs, const char *s1, const char *s2)
 {
     if (cs) {
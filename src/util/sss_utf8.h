@@ -31,6 +31,13 @@
 
 void sss_utf8_free(void *ptr);
 
+/* Names are mostly plain ASCII, the functions below handle such strings
+ * directly and use the unicode library only if there are other bytes */
+bool sss_utf8_is_ascii(const uint8_t *s, size_t len);
+
+/* Lowercases len ASCII bytes of s into dst, which may be s itself */
+void sss_utf8_ascii_tolower(const uint8_t *s, size_t len, uint8_t *dst);
+
 /* The result must be freed with sss_utf8_free() */
 uint8_t *sss_utf8_tolower(const uint8_t *s, size_t len, size_t *nlen);
 
@@ -77,6 +77,7 @@ extern int debug_microseconds;
 extern int debug_to_file;
 extern int debug_to_stderr;
 extern const char *debug_log_file;
+extern int debug_backtrace_level;
 void sss_vdebug_fn(const char *file,
                    long line,
                    const char *function,
@@ -91,6 +92,8 @@ void sss_debug_fn(const char *file,
 int debug_convert_old_level(int old_level);
 errno_t set_debug_file_from_fd(const int fd);
 int get_fd_from_debug_file(void);
+errno_t debug_init_buffers(size_t buffer_size, int backtrace_level);
+void debug_flush(void);
 
 #define SSS_DOM_ENV           "_SSS_DOM"
 
@@ -140,7 +143,7 @@ int get_fd_from_debug_file(void);
 */
 #define DEBUG(level, format, ...) do { \
     int __debug_macro_level = level; \
-    if (DEBUG_IS_SET(__debug_macro_level)) { \
+    if (DEBUG_IS_WANTED(__debug_macro_level)) { \
         sss_debug_fn(__FILE__, __LINE__, __FUNCTION__, \
                      __debug_macro_level, \
                      format, ##__VA_ARGS__); \
@@ -157,6 +160,15 @@ int get_fd_from_debug_file(void);
                                             (level & (SSSDBG_FATAL_FAILURE | \
                                                       SSSDBG_CRIT_FAILURE))))
 
+/** \def DEBUG_IS_WANTED(level)
+    \brief checks whether a message of level is logged or kept in memory for
+           the debug backtrace
+
+    \param level the debug level, please use one of the SSSDBG*_ macros
+*/
+#define DEBUG_IS_WANTED(level) (DEBUG_IS_SET(level) || \
+                                (debug_backtrace_level & (level)))
+
 #define DEBUG_INIT(dbg_lvl) do { \
     if (dbg_lvl != SSSDBG_INVALID) { \
         debug_level = debug_convert_old_level(dbg_lvl); \
@@ -268,6 +280,32 @@ int server_setup(const char *name, int flags,
                  const char *conf_entry,
                  struct main_context **main_ctx);
 void server_loop(struct main_context *main_ctx);
+
+/* Phases of the startup of a process. They may overlap, the monitor for
+ * example acknowledges the registration while the providers load. */
+enum server_startup_phase {
+    STARTUP_PHASE_CONFDB,       /* opening confdb, reading the settings */
+    STARTUP_PHASE_SYSDB,        /* opening and upgrading the caches */
+    STARTUP_PHASE_SBUS,         /* connecting and registering to the monitor */
+    STARTUP_PHASE_PROVIDERS,    /* loading and initializing the providers */
+    STARTUP_PHASE_ONLINE,       /* the first check whether a server works */
+
+    STARTUP_PHASE_SENTINEL
+};
+
+void server_startup_begin(enum server_startup_phase phase);
+void server_startup_end(enum server_startup_phase phase);
+/* All the phases of the process began, the time of each is written to the
+ * log once the ones still running end */
+void server_startup_ready(void);
+/* The phases which ended, how long they took and when they ended since the
+ * start of the process. done is true once all of them ended. */
+errno_t server_startup_times(TALLOC_CTX *mem_ctx,
+                             const char ***_names,
+                             uint64_t **_usec,
+                             uint64_t **_end_usec,
+                             size_t *_count,
+                             bool *_done);
 void orderly_shutdown(int status);
 
 /* from signal.c */
@@ -289,6 +327,26 @@ void *sss_mem_attach(TALLOC_CTX *mem_ctx,
 
 int password_destructor(void *memctx);
 
+/* Size of the talloc pools of one kind of requests, adjusted to the memory
+ * the previous requests used. It moves half way towards a larger usage and
+ * slowly back so that a single big request does not inflate all pools. */
+struct sss_pool_size {
+    size_t size;
+    size_t min;
+    size_t max;
+};
+
+#define SSS_POOL_SIZE_INIT(min, max) { (min), (min), (max) }
+
+/* Accounts the memory held by used_ctx and its children */
+void sss_pool_size_update(struct sss_pool_size *ps, TALLOC_CTX *used_ctx);
+
+/* Writes the talloc tree below ptr to the debug log, one line per context
+ * of at least min_size bytes, with its total size and number of blocks */
+#define SSS_MEM_REPORT_DEPTH 6
+#define SSS_MEM_REPORT_MIN_SIZE 16384
+void sss_talloc_report(const void *ptr, int max_depth, size_t min_size);
+
 /* from usertools.c */
 char *get_uppercase_realm(TALLOC_CTX *memctx, const char *name);
 
@@ -605,6 +663,15 @@ errno_t sssd_domain_init(TALLOC_CTX *mem_ctx,
                          const char *db_path,
                          struct sss_domain_info **_domain);
 
+/* Same as sssd_domain_init, sysdb_flags are passed to
+ * sysdb_domain_init_ext() */
+errno_t sssd_domain_init_ext(TALLOC_CTX *mem_ctx,
+                             struct confdb_ctx *cdb,
+                             const char *domain_name,
+                             const char *db_path,
+                             uint32_t sysdb_flags,
+                             struct sss_domain_info **_domain);
+
 #define IS_SUBDOMAIN(dom) ((dom)->parent != NULL)
 
 #define DOM_HAS_VIEWS(dom) ((dom)->has_views)
@@ -628,6 +695,106 @@ errno_t fix_domain_in_name_list(TALLOC_CTX *mem_ctx,
 /* from util_lock.c */
 errno_t sss_br_lock_file(int fd, size_t start, size_t len,
                          int num_tries, useconds_t wait);
+
+/* from mmap_cache_stats.c */
+struct sss_mc_usage {
+    uint64_t stores;        /* records stored or refreshed */
+    uint64_t evictions;     /* still valid records evicted to make room */
+    uint64_t invalidations; /* records explicitly invalidated */
+    uint64_t grows;         /* times the cache was grown online */
+    uint32_t used_slots;    /* data table slots currently in use */
+    uint32_t total_slots;   /* size of the data table in slots */
+};
+
+/* NULL-terminated list of the memory cache maps */
+extern const char *sss_mc_map_names[];
+
+/* Read the usage counters of one of the memory cache maps. Returns EINVAL
+ * for an unknown map, ENOENT if its file does not exist and EAGAIN if it is
+ * being reset by the responder. */
+errno_t sss_mc_get_usage(const char *map_name, struct sss_mc_usage *usage);
+
+/* from cmd_stats.c */
+
+/* Where the data of a responder reply came from */
+enum sss_cmd_source {
+    SSS_CMD_SRC_MEMORY, /* in-memory caches of the responder */
+    SSS_CMD_SRC_SYSDB,  /* the cache was searched */
+    SSS_CMD_SRC_DP,     /* the data provider was asked */
+
+    SSS_CMD_SRC_SENTINEL
+};
+
+/* NULL-terminated names of enum sss_cmd_source */
+extern const char *sss_cmd_source_names[];
+
+/* Latency buckets, see sss_cmd_stats_bucket_limit() */
+#define SSS_CMD_STATS_BUCKETS 24
+
+struct sss_cmd_stats_entry {
+    uint32_t cmd;
+    enum sss_cmd_source source;
+    uint64_t count;
+    uint64_t total_usec;
+    uint64_t max_usec;
+    uint64_t buckets[SSS_CMD_STATS_BUCKETS];
+};
+
+/* Counters of the caches of a responder, next to the command histograms */
+enum sss_cache_counter {
+    SSS_CACHE_NCACHE_HIT,       /* negative cache checks that matched */
+    SSS_CACHE_NCACHE_MISS,      /* negative cache checks that did not */
+    SSS_CACHE_OBJCACHE_HIT,     /* lookups answered by the object cache */
+    SSS_CACHE_SYSDB_HIT,        /* lookups answered by a valid sysdb entry */
+    SSS_CACHE_SYSDB_MIDPOINT,   /* same, with a refresh in the background */
+    SSS_CACHE_DP_LOOKUP,        /* lookups that had to ask the provider */
+    SSS_CACHE_INFLIGHT_JOIN,    /* lookups that waited for an identical one */
+
+    SSS_CACHE_COUNTER_SENTINEL
+};
+
+/* NULL-terminated names of enum sss_cache_counter */
+extern const char *sss_cache_counter_names[];
+
+struct sss_cmd_stats;
+
+/* Open, creating it if needed, the statistics file of the responder
+ * @service. All processes of the responder share it. */
+errno_t sss_cmd_stats_open(TALLOC_CTX *mem_ctx,
+                           const char *service,
+                           struct sss_cmd_stats **_stats);
+
+/* Count a reply to @cmd that took @usec microseconds. */
+void sss_cmd_stats_add(struct sss_cmd_stats *stats,
+                       uint32_t cmd,
+                       enum sss_cmd_source source,
+                       uint64_t usec);
+
+/* Return one entry per command and source with at least one sample. */
+errno_t sss_cmd_stats_get(TALLOC_CTX *mem_ctx,
+                          struct sss_cmd_stats *stats,
+                          struct sss_cmd_stats_entry **_entries,
+                          size_t *_count);
+
+/* Same as sss_cmd_stats_get() for the statistics file of @service, which
+ * may belong to another process. Returns ENOENT if there is none. */
+errno_t sss_cmd_stats_read(TALLOC_CTX *mem_ctx,
+                           const char *service,
+                           struct sss_cmd_stats_entry **_entries,
+                           size_t *_count);
+
+/* Samples in @bucket took less than the returned number of microseconds,
+ * the last bucket has no upper limit. */
+uint64_t sss_cmd_stats_bucket_limit(int bucket);
+
+/* Add one to @counter, @stats may be NULL. */
+void sss_cmd_stats_count(struct sss_cmd_stats *stats,
+                         enum sss_cache_counter counter);
+
+/* Read the cache counters of the responder @service, which may belong to
+ * another process. Returns ENOENT if there is no statistics file. */
+errno_t sss_cmd_stats_read_counters(const char *service,
+                                    uint64_t counters[SSS_CACHE_COUNTER_SENTINEL]);
 #include "io.h"
 
 #ifdef HAVE_PAC_RESPONDER
@@ -84,6 +84,7 @@ struct err_string error_to_str[] = {
     { "Subdomain is inactive" }, /* ERR_SUBDOM_INACTIVE */
     { "Account is locked" }, /* ERR_ACCOUNT_LOCKED */
     { "AD renewal child failed" }, /* ERR_RENEWAL_CHILD */
+    { "The server requires a full synchronization" }, /* ERR_SYNC_REFRESH_REQUIRED */
     { "ERR_LAST" } /* ERR_LAST */
 };
 